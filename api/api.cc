@@ -125,6 +125,13 @@ future<> set_server_gossip_settle(http_context& ctx) {
     });
 }
 
+// The replay progress is needed before the node is up, the rest of the commit log API is set with it.
+future<> set_server_commitlog_replay(http_context& ctx) {
+    return ctx.http_server.set_routes([&ctx](routes& r) {
+        set_commitlog_replay(ctx, r);
+    });
+}
+
 future<> set_server_done(http_context& ctx) {
     auto rb = std::make_shared < api_registry_builder > (ctx.api_doc);
 
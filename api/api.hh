@@ -116,8 +116,14 @@ future<json::json_return_type>  sum_stats(distributed<T>& d, V F::*f) {
 inline
 httpd::utils_json::histogram to_json(const utils::ihistogram& val) {
     httpd::utils_json::histogram h;
-    h = val;
+    h.count = val.count;
     h.sum = val.estimated_sum();
+    h.min = val.min;
+    h.max = val.max;
+    h.variance = val.variance;
+    h.mean = val.mean;
+    // Consumers compute percentiles out of the sample.
+    h.sample = val.values.make_sample();
     return h;
 }
 
@@ -46,6 +46,7 @@ future<> set_server_messaging_service(http_context& ctx);
 future<> set_server_storage_proxy(http_context& ctx);
 future<> set_server_stream_manager(http_context& ctx);
 future<> set_server_gossip_settle(http_context& ctx);
+future<> set_server_commitlog_replay(http_context& ctx);
 future<> set_server_done(http_context& ctx);
 
 
@@ -22,16 +22,16 @@
 #include "cache_service.hh"
 #include "api/api-doc/cache_service.json.hh"
 #include "column_family.hh"
+#include "db/row_cache_saver.hh"
 
 namespace api {
 using namespace json;
 namespace cs = httpd::cache_service_json;
 
 void set_cache_service(http_context& ctx, routes& r) {
-    cs::get_row_cache_save_period_in_seconds.set(r, [](std::unique_ptr<request> req) {
-        // We never save the cache
+    cs::get_row_cache_save_period_in_seconds.set(r, [&ctx](std::unique_ptr<request> req) {
         // Origin uses 0 for never
-        return make_ready_future<json::json_return_type>(0);
+        return make_ready_future<json::json_return_type>(ctx.db.local().get_config().row_cache_save_period());
     });
 
     cs::set_row_cache_save_period_in_seconds.set(r, [](std::unique_ptr<request> req) {
@@ -67,10 +67,8 @@ void set_cache_service(http_context& ctx, routes& r) {
         return make_ready_future<json::json_return_type>(json_void());
     });
 
-    cs::get_row_cache_keys_to_save.set(r, [](std::unique_ptr<request> req) {
-        // TBD
-        unimplemented();
-        return make_ready_future<json::json_return_type>(0);
+    cs::get_row_cache_keys_to_save.set(r, [&ctx](std::unique_ptr<request> req) {
+        return make_ready_future<json::json_return_type>(ctx.db.local().get_config().row_cache_keys_to_save());
     });
 
     cs::set_row_cache_keys_to_save.set(r, [](std::unique_ptr<request> req) {
@@ -140,9 +138,11 @@ void set_cache_service(http_context& ctx, routes& r) {
     });
 
     cs::save_caches.set(r, [](std::unique_ptr<request> req) {
-        // TBD
-        unimplemented();
-        return make_ready_future<json::json_return_type>(json_void());
+        return db::get_row_cache_saver().invoke_on_all([] (db::row_cache_saver& rcs) {
+            return rcs.save();
+        }).then([] {
+            return make_ready_future<json::json_return_type>(json_void());
+        });
     });
 
     cs::get_key_capacity.set(r, [] (std::unique_ptr<request> req) {
@@ -262,6 +262,19 @@ void set_cache_service(http_context& ctx, routes& r) {
         }, std::plus<uint64_t>());
     });
 
+    cs::get_row_table_entries.set(r, [&ctx] (std::unique_ptr<request> req) {
+        return map_reduce_cf(ctx, req->param["name"], uint64_t(0), [](const column_family& cf) {
+            return cf.get_row_cache().get_cache_tracker().table_partitions(cf.schema()->id());
+        }, std::plus<uint64_t>());
+    });
+
+    cs::get_row_table_share.set(r, [&ctx] (std::unique_ptr<request> req) {
+        return map_reduce_cf(ctx, req->param["name"], ratio_holder(), [](const column_family& cf) {
+            auto& tracker = cf.get_row_cache().get_cache_tracker();
+            return ratio_holder(tracker.partitions(), tracker.table_partitions(cf.schema()->id()));
+        }, std::plus<ratio_holder>());
+    });
+
     cs::get_counter_capacity.set(r, [] (std::unique_ptr<request> req) {
         // TBD
         // FIXME
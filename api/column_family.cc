@@ -21,11 +21,14 @@
 
 #include "column_family.hh"
 #include "api/api-doc/column_family.json.hh"
+#include <map>
 #include <vector>
 #include "http/exception.hh"
 #include "sstables/sstables.hh"
 #include "utils/estimated_histogram.hh"
+#include "dht/i_partitioner.hh"
 #include <algorithm>
+#include <boost/algorithm/string/join.hpp>
 
 namespace api {
 using namespace httpd;
@@ -76,6 +79,15 @@ future<json::json_return_type>  get_cf_stats(http_context& ctx,
     }, std::plus<int64_t>());
 }
 
+future<json::json_return_type>  get_shard_cf_stats(http_context& ctx,
+        int64_t cf_stats::*f) {
+    return ctx.db.map_reduce0([f](const database& db) {
+        return db.get_cf_stats().*f;
+    }, int64_t(0), std::plus<int64_t>()).then([](int64_t res) {
+        return make_ready_future<json::json_return_type>(res);
+    });
+}
+
 static future<json::json_return_type>  get_cf_stats_count(http_context& ctx, const sstring& name,
         utils::timed_rate_moving_average_and_histogram column_family::stats::*f) {
     return map_reduce_cf(ctx, name, int64_t(0), [f](const column_family& cf) {
@@ -133,6 +145,18 @@ static future<json::json_return_type> get_cf_histogram(http_context& ctx, utils:
     });
 }
 
+// Merges a latency histogram of the column family of all shards, reported
+// as an estimated histogram.
+template<typename Mapper>
+static future<json::json_return_type> get_cf_latency_histogram(http_context& ctx, const sstring& name, Mapper mapper) {
+    return map_reduce_cf_raw(ctx, name, utils::log_linear_histogram(), mapper,
+            std::plus<utils::log_linear_histogram>()).then([](const utils::log_linear_histogram& val) {
+        utils_json::estimated_histogram res;
+        res = val.to_estimated_histogram();
+        return make_ready_future<json::json_return_type>(res);
+    });
+}
+
 static future<json::json_return_type>  get_cf_rate_and_histogram(http_context& ctx, const sstring& name,
         utils::timed_rate_moving_average_and_histogram column_family::stats::*f) {
     utils::UUID uuid = get_uuid(name, ctx.db.local());
@@ -192,51 +216,6 @@ static integral_ratio_holder mean_row_size(column_family& cf) {
     return res;
 }
 
-static std::unordered_map<sstring, uint64_t> merge_maps(std::unordered_map<sstring, uint64_t> a,
-        const std::unordered_map<sstring, uint64_t>& b) {
-    a.insert(b.begin(), b.end());
-    return a;
-}
-
-static json::json_return_type sum_map(const std::unordered_map<sstring, uint64_t>& val) {
-    uint64_t res = 0;
-    for (auto i : val) {
-        res += i.second;
-    }
-    return res;
-}
-
-static future<json::json_return_type>  sum_sstable(http_context& ctx, const sstring name, bool total) {
-    auto uuid = get_uuid(name, ctx.db.local());
-    return ctx.db.map_reduce0([uuid, total](database& db) {
-        std::unordered_map<sstring, uint64_t> m;
-        auto sstables = (total) ? db.find_column_family(uuid).get_sstables_including_compacted_undeleted() :
-                db.find_column_family(uuid).get_sstables();
-        for (auto t : *sstables) {
-            m[t->get_filename()] = t->bytes_on_disk();
-        }
-        return m;
-    }, std::unordered_map<sstring, uint64_t>(), merge_maps).
-            then([](const std::unordered_map<sstring, uint64_t>& val) {
-        return sum_map(val);
-    });
-}
-
-
-static future<json::json_return_type> sum_sstable(http_context& ctx, bool total) {
-    return map_reduce_cf_raw(ctx, std::unordered_map<sstring, uint64_t>(), [total](column_family& cf) {
-        std::unordered_map<sstring, uint64_t> m;
-        auto sstables = (total) ? cf.get_sstables_including_compacted_undeleted() :
-                cf.get_sstables();
-        for (auto t : *sstables) {
-            m[t->get_filename()] = t->bytes_on_disk();
-        }
-        return m;
-    },merge_maps).then([](const std::unordered_map<sstring, uint64_t>& val) {
-        return sum_map(val);
-    });
-}
-
 template <typename T>
 class sum_ratio {
     uint64_t _n = 0;
@@ -284,6 +263,28 @@ ratio_holder filter_recent_false_positive_as_ratio_holder(const sstables::shared
     return ratio_holder(f + sst->filter_get_recent_true_positive(), f);
 }
 
+static sstring partition_key_to_string(const schema& s, const partition_key& key) {
+    std::vector<sstring> components;
+    auto it = s.partition_key_columns().begin();
+    for (auto&& c : key.explode(s)) {
+        components.push_back(it++->type->to_string(c));
+    }
+    return boost::algorithm::join(components, ":");
+}
+
+static std::vector<cf::partition_count> to_partition_counts(const schema& s, const std::vector<top_partitions_tracker::partition_count>& counts) {
+    std::vector<cf::partition_count> res;
+    for (auto&& p : counts) {
+        cf::partition_count pc;
+        pc.partition = partition_key_to_string(s, p.key);
+        pc.token = dht::global_partitioner().to_sstring(dht::global_partitioner().decorate_key(s, p.key).token());
+        pc.count = p.count;
+        pc.error = p.error;
+        res.push_back(std::move(pc));
+    }
+    return res;
+}
+
 void set_column_family(http_context& ctx, routes& r) {
     cf::get_column_family_name.set(r, [&ctx] (const_req req){
         vector<sstring> res;
@@ -415,12 +416,8 @@ void set_column_family(http_context& ctx, routes& r) {
     });
 
     cf::get_estimated_row_count.set(r, [&ctx] (std::unique_ptr<request> req) {
-        return map_reduce_cf(ctx, req->param["name"], int64_t(0), [](column_family& cf) {
-            uint64_t res = 0;
-            for (auto i: *cf.get_sstables() ) {
-                res += i->get_stats_metadata().estimated_row_size.count();
-            }
-            return res;
+        return map_reduce_cf(ctx, req->param["name"], uint64_t(0), [](column_family& cf) {
+            return cf.estimated_partition_count();
         },
         std::plus<uint64_t>());
     });
@@ -523,7 +520,7 @@ void set_column_family(http_context& ctx, routes& r) {
     });
 
     cf::get_all_live_ss_table_count.set(r, [&ctx] (std::unique_ptr<request> req) {
-        return get_cf_stats(ctx, &column_family::stats::live_sstable_count);
+        return get_shard_cf_stats(ctx, &cf_stats::live_sstable_count);
     });
 
     cf::get_unleveled_sstables.set(r, [&ctx] (std::unique_ptr<request> req) {
@@ -531,19 +528,19 @@ void set_column_family(http_context& ctx, routes& r) {
     });
 
     cf::get_live_disk_space_used.set(r, [&ctx] (std::unique_ptr<request> req) {
-        return sum_sstable(ctx, req->param["name"], false);
+        return get_cf_stats(ctx, req->param["name"], &column_family::stats::live_disk_space_used);
     });
 
     cf::get_all_live_disk_space_used.set(r, [&ctx] (std::unique_ptr<request> req) {
-        return sum_sstable(ctx, false);
+        return get_shard_cf_stats(ctx, &cf_stats::live_disk_space_used);
     });
 
     cf::get_total_disk_space_used.set(r, [&ctx] (std::unique_ptr<request> req) {
-        return sum_sstable(ctx, req->param["name"], true);
+        return get_cf_stats(ctx, req->param["name"], &column_family::stats::total_disk_space_used);
     });
 
     cf::get_all_total_disk_space_used.set(r, [&ctx] (std::unique_ptr<request> req) {
-        return sum_sstable(ctx, true);
+        return get_shard_cf_stats(ctx, &cf_stats::total_disk_space_used);
     });
 
     cf::get_min_row_size.set(r, [&ctx] (std::unique_ptr<request> req) {
@@ -714,12 +711,16 @@ void set_column_family(http_context& ctx, routes& r) {
 
     cf::get_true_snapshots_size.set(r, [&ctx] (std::unique_ptr<request> req) {
         auto uuid = get_uuid(req->param["name"], ctx.db.local());
-        return ctx.db.local().find_column_family(uuid).get_snapshot_details().then([](
-                const std::unordered_map<sstring, column_family::snapshot_details>& sd) {
-            int64_t res = 0;
-            for (auto i : sd) {
-                res += i.second.total;
-            }
+        return ctx.db.map_reduce(adder<int64_t>(), [uuid] (database& db) {
+            return db.find_column_family(uuid).get_snapshot_details().then([](
+                    const std::unordered_map<sstring, column_family::snapshot_details>& sd) {
+                int64_t res = 0;
+                for (auto i : sd) {
+                    res += i.second.total;
+                }
+                return res;
+            });
+        }).then([] (int64_t res) {
             return make_ready_future<json::json_return_type>(res);
         });
     });
@@ -860,17 +861,33 @@ void set_column_family(http_context& ctx, routes& r) {
     });
 
     cf::get_read_latency_estimated_histogram.set(r, [&ctx](std::unique_ptr<request> req) {
-        return map_reduce_cf(ctx, req->param["name"], utils::estimated_histogram(0), [](column_family& cf) {
-            return cf.get_stats().estimated_read;
-        },
-        utils::estimated_histogram_merge, utils_json::estimated_histogram());
+        return get_cf_latency_histogram(ctx, req->param["name"], [](column_family& cf) {
+            return cf.get_stats().reads.hist.values;
+        });
     });
 
     cf::get_write_latency_estimated_histogram.set(r, [&ctx](std::unique_ptr<request> req) {
-        return map_reduce_cf(ctx, req->param["name"], utils::estimated_histogram(0), [](column_family& cf) {
-            return cf.get_stats().estimated_write;
-        },
-        utils::estimated_histogram_merge, utils_json::estimated_histogram());
+        return get_cf_latency_histogram(ctx, req->param["name"], [](column_family& cf) {
+            return cf.get_stats().writes.hist.values;
+        });
+    });
+
+    cf::get_stage_latency_estimated_histogram.set(r, [&ctx](std::unique_ptr<request> req) {
+        using histogram_ptr = utils::log_linear_histogram column_family::stats::*;
+        static const std::unordered_map<sstring, histogram_ptr> stages = {
+            { "read_admission", &column_family::stats::estimated_read_admission },
+            { "read_execution", &column_family::stats::estimated_read_execution },
+            { "write_commitlog", &column_family::stats::estimated_write_commitlog },
+            { "write_memory_wait", &column_family::stats::estimated_write_memory_wait },
+        };
+        auto it = stages.find(req->get_query_param("stage"));
+        if (it == stages.end()) {
+            throw bad_param_exception("Unknown stage " + req->get_query_param("stage"));
+        }
+        auto h = it->second;
+        return get_cf_latency_histogram(ctx, req->param["name"], [h](column_family& cf) {
+            return cf.get_stats().*h;
+        });
     });
 
     cf::set_compaction_strategy_class.set(r, [&ctx](std::unique_ptr<request> req) {
@@ -898,6 +915,76 @@ void set_column_family(http_context& ctx, routes& r) {
         return make_ready_future<json::json_return_type>(json_void());
     });
 
+    cf::get_sstables_read_statistics.set(r, [&ctx](std::unique_ptr<request> req) {
+        auto uuid = get_uuid(req->param["name"], ctx.db.local());
+        using stats_map = std::map<sstring, sstables::read_stats>;
+        // An sstable shared by several shards is opened by each of them.
+        return ctx.db.map_reduce0([uuid] (database& db) {
+            stats_map res;
+            for (auto&& sst : *db.find_column_family(uuid).get_sstables()) {
+                res[sst->get_filename()] += sst->get_read_stats();
+            }
+            return res;
+        }, stats_map(), [] (stats_map a, const stats_map& b) {
+            for (auto&& e : b) {
+                a[e.first] += e.second;
+            }
+            return a;
+        }).then([] (const stats_map& res) {
+            std::vector<cf::sstable_read_statistics> ret;
+            for (auto&& e : res) {
+                cf::sstable_read_statistics s;
+                s.filename = e.first;
+                s.partition_lookups = e.second.partition_lookups;
+                s.filter_hits = e.second.filter_hits;
+                s.filter_false_positives = e.second.filter_false_positives;
+                s.index_page_reads = e.second.index_page_reads;
+                s.data_bytes_read = e.second.data_bytes_read;
+                s.decompressed_bytes = e.second.decompressed_bytes;
+                ret.push_back(std::move(s));
+            }
+            return make_ready_future<json::json_return_type>(ret);
+        });
+    });
+
+    cf::get_toppartitions.set(r, [&ctx](std::unique_ptr<request> req) {
+        auto uuid = get_uuid(req->param["name"], ctx.db.local());
+        size_t limit = req->get_query_param("limit").empty() ? 10 : std::stoul(req->get_query_param("limit"));
+        struct shard_result {
+            std::vector<cf::partition_count> read;
+            std::vector<cf::partition_count> write;
+            int64_t duration = 0;
+        };
+        // Partitions belong to a single shard, so the results of the shards don't overlap.
+        return ctx.db.map_reduce0([uuid, limit] (database& db) {
+            auto& cf = db.find_column_family(uuid);
+            auto res = cf.top_partitions().get(limit);
+            auto& s = *cf.schema();
+            return shard_result{to_partition_counts(s, res.reads), to_partition_counts(s, res.writes),
+                    std::chrono::duration_cast<std::chrono::milliseconds>(res.duration).count()};
+        }, shard_result(), [] (shard_result a, shard_result b) {
+            std::move(b.read.begin(), b.read.end(), std::back_inserter(a.read));
+            std::move(b.write.begin(), b.write.end(), std::back_inserter(a.write));
+            a.duration = std::max(a.duration, b.duration);
+            return a;
+        }).then([limit] (shard_result res) {
+            auto by_count = [] (const cf::partition_count& a, const cf::partition_count& b) {
+                return a.count() > b.count();
+            };
+            cf::toppartitions tp;
+            for (auto* v : { &res.read, &res.write }) {
+                std::sort(v->begin(), v->end(), by_count);
+                if (v->size() > limit) {
+                    v->resize(limit);
+                }
+            }
+            tp.read = std::move(res.read);
+            tp.write = std::move(res.write);
+            tp.duration = res.duration;
+            return make_ready_future<json::json_return_type>(tp);
+        });
+    });
+
     cf::get_sstable_count_per_level.set(r, [&ctx](std::unique_ptr<request> req) {
         return map_reduce_cf_raw(ctx, req->param["name"], std::vector<uint64_t>(), [](const column_family& cf) {
             return cf.sstable_count_per_level();
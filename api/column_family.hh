@@ -97,4 +97,8 @@ future<json::json_return_type>  get_cf_stats(http_context& ctx, const sstring& n
 future<json::json_return_type>  get_cf_stats(http_context& ctx,
         int64_t column_family::stats::*f);
 
+// Sums a statistic of all the column families, as kept by each shard.
+future<json::json_return_type>  get_shard_cf_stats(http_context& ctx,
+        int64_t cf_stats::*f);
+
 }
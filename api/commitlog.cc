@@ -21,6 +21,7 @@
 
 #include "commitlog.hh"
 #include <db/commitlog/commitlog.hh>
+#include <db/commitlog/commitlog_replayer.hh>
 #include "api/api-doc/commitlog.json.hh"
 #include <vector>
 
@@ -40,6 +41,26 @@ static auto acquire_cl_metric(http_context& ctx, Func&& func) {
     });
 }
 
+void set_commitlog_replay(http_context& ctx, routes& r) {
+    httpd::commitlog_json::get_replay_progress.set(r, [&ctx](std::unique_ptr<request> req) {
+        return ctx.db.map_reduce0([](database& db) {
+            std::vector<httpd::commitlog_json::segment_replay_progress> res;
+            for (auto&& p : db::commitlog_replayer::local_progress()) {
+                httpd::commitlog_json::segment_replay_progress sp;
+                sp.file = p.file;
+                sp.shard = engine().cpu_id();
+                sp.replayed_bytes = p.replayed_bytes;
+                sp.total_bytes = p.total_bytes;
+                sp.done = p.done;
+                res.push_back(std::move(sp));
+            }
+            return res;
+        }, std::vector<httpd::commitlog_json::segment_replay_progress>(), concat<httpd::commitlog_json::segment_replay_progress>).then([](const std::vector<httpd::commitlog_json::segment_replay_progress>& res) {
+            return make_ready_future<json::json_return_type>(res);
+        });
+    });
+}
+
 void set_commitlog(http_context& ctx, routes& r) {
     httpd::commitlog_json::get_active_segment_names.set(r,
             [&ctx](std::unique_ptr<request> req) {
@@ -26,5 +26,6 @@
 namespace api {
 
 void set_commitlog(http_context& ctx, routes& r);
+void set_commitlog_replay(http_context& ctx, routes& r);
 
 }
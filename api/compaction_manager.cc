@@ -53,6 +53,14 @@ void set_compaction_manager(http_context& ctx, routes& r) {
                 s.task_type = sstables::compaction_name(c->type);
                 s.completed = c->total_keys_written;
                 s.total = c->total_partitions;
+                s.bytes_read = c->start_size;
+                for (unsigned i = 0; i < sstables::compaction_stage_times::stages; ++i) {
+                    auto stage = sstables::compaction_stage_times::stage(i);
+                    cm::stage_time t;
+                    t.stage = sstables::compaction_stage_times::name(stage);
+                    t.microseconds = std::chrono::duration_cast<std::chrono::microseconds>(c->stage_times[stage]).count();
+                    s.stages.push(std::move(t));
+                }
                 summaries.push_back(std::move(s));
             }
             return summaries;
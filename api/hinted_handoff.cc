@@ -19,57 +19,101 @@
  * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <boost/range/adaptor/transformed.hpp>
+#include <boost/range/algorithm/sort.hpp>
+#include <boost/range/algorithm/unique.hpp>
 #include "hinted_handoff.hh"
 #include "api/api-doc/hinted_handoff.json.hh"
+#include "service/storage_proxy.hh"
 
 namespace api {
 
 using namespace json;
 namespace hh = httpd::hinted_handoff_json;
+using hints_manager = db::hints::manager;
 
-void set_hinted_handoff(http_context& ctx, routes& r) {
-    hh::list_endpoints_pending_hints.set(r, [] (std::unique_ptr<request> req) {
-        //TBD
-        unimplemented();
-        std::vector<sstring> res;
+static stdx::optional<gms::inet_address> get_host(const request& req) {
+    auto host = req.get_query_param("host");
+    if (host.empty()) {
+        return stdx::nullopt;
+    }
+    return gms::inet_address(host);
+}
+
+template <typename Func>
+static future<> for_each_hints_manager(http_context& ctx, Func&& func) {
+    return ctx.sp.invoke_on_all([func = std::forward<Func>(func)] (service::storage_proxy& sp) {
+        auto* hm = sp.get_hints_manager();
+        if (!hm) {
+            return make_ready_future<>();
+        }
+        return futurize_apply(func, *hm);
+    });
+}
+
+static future<json::json_return_type> sum_endpoint_stat(http_context& ctx, gms::inet_address ep, uint64_t hints_manager::endpoint_stats::*f) {
+    return ctx.sp.map_reduce0([ep, f] (service::storage_proxy& sp) -> uint64_t {
+        auto* hm = sp.get_hints_manager();
+        return hm ? hm->get_endpoint_stats(ep).*f : 0;
+    }, uint64_t(0), std::plus<uint64_t>()).then([] (uint64_t res) {
         return make_ready_future<json::json_return_type>(res);
     });
+}
 
-    hh::truncate_all_hints.set(r, [] (std::unique_ptr<request> req) {
-        //TBD
-        unimplemented();
-        sstring host = req->get_query_param("host");
-        return make_ready_future<json::json_return_type>(json_void());
+void set_hinted_handoff(http_context& ctx, routes& r) {
+    hh::list_endpoints_pending_hints.set(r, [&ctx] (std::unique_ptr<request> req) {
+        return ctx.sp.map_reduce0([] (service::storage_proxy& sp) {
+            auto* hm = sp.get_hints_manager();
+            return hm ? hm->endpoints_pending_hints() : std::vector<gms::inet_address>();
+        }, std::vector<gms::inet_address>(), [] (std::vector<gms::inet_address> a, const std::vector<gms::inet_address>& b) {
+            a.insert(a.end(), b.begin(), b.end());
+            return a;
+        }).then([] (std::vector<gms::inet_address> eps) {
+            boost::sort(eps);
+            eps.erase(boost::unique(eps).end(), eps.end());
+            std::vector<sstring> res;
+            res.reserve(eps.size());
+            for (auto&& ep : eps) {
+                res.push_back(ep.to_sstring());
+            }
+            return make_ready_future<json::json_return_type>(res);
+        });
     });
 
-    hh::schedule_hint_delivery.set(r, [] (std::unique_ptr<request> req) {
-        //TBD
-        unimplemented();
-        sstring host = req->get_query_param("host");
-        return make_ready_future<json::json_return_type>(json_void());
+    hh::truncate_all_hints.set(r, [&ctx] (std::unique_ptr<request> req) {
+        auto host = get_host(*req);
+        return for_each_hints_manager(ctx, [host] (hints_manager& hm) {
+            return hm.truncate_hints(host);
+        }).then([] {
+            return make_ready_future<json::json_return_type>(json_void());
+        });
     });
 
-    hh::pause_hints_delivery.set(r, [] (std::unique_ptr<request> req) {
-        //TBD
-        unimplemented();
-        sstring pause = req->get_query_param("pause");
-        return make_ready_future<json::json_return_type>(json_void());
+    hh::schedule_hint_delivery.set(r, [&ctx] (std::unique_ptr<request> req) {
+        auto host = get_host(*req);
+        return for_each_hints_manager(ctx, [host] (hints_manager& hm) {
+            hm.schedule_delivery(host);
+        }).then([] {
+            return make_ready_future<json::json_return_type>(json_void());
+        });
     });
 
-    hh::get_create_hint_count.set(r, [] (std::unique_ptr<request> req) {
-        //TBD
-        unimplemented();
-        sstring host = req->get_query_param("host");
-        return make_ready_future<json::json_return_type>(0);
+    hh::pause_hints_delivery.set(r, [&ctx] (std::unique_ptr<request> req) {
+        bool pause = req->get_query_param("pause") == "true";
+        return for_each_hints_manager(ctx, [pause] (hints_manager& hm) {
+            hm.pause_delivery(pause);
+        }).then([] {
+            return make_ready_future<json::json_return_type>(json_void());
+        });
     });
 
-    hh::get_not_stored_hints_count.set(r, [] (std::unique_ptr<request> req) {
-        //TBD
-        unimplemented();
-        sstring host = req->get_query_param("host");
-        return make_ready_future<json::json_return_type>(0);
+    hh::get_create_hint_count.set(r, [&ctx] (std::unique_ptr<request> req) {
+        return sum_endpoint_stat(ctx, gms::inet_address(req->get_query_param("host")), &hints_manager::endpoint_stats::created);
     });
-}
 
+    hh::get_not_stored_hints_count.set(r, [&ctx] (std::unique_ptr<request> req) {
+        return sum_endpoint_stat(ctx, gms::inet_address(req->get_query_param("host")), &hints_manager::endpoint_stats::not_stored);
+    });
 }
 
+}
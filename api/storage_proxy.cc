@@ -52,11 +52,11 @@ static future<json::json_return_type>  sum_timed_rate_as_long(distributed<proxy>
     });
 }
 
-static future<json::json_return_type>  sum_estimated_histogram(http_context& ctx, utils::estimated_histogram proxy::stats::*f) {
-    return ctx.sp.map_reduce0([f](const proxy& p) {return p.get_stats().*f;}, utils::estimated_histogram(),
-            utils::estimated_histogram_merge).then([](const utils::estimated_histogram& val) {
+static future<json::json_return_type>  sum_estimated_histogram(http_context& ctx, utils::timed_rate_moving_average_and_histogram proxy::stats::*f) {
+    return ctx.sp.map_reduce0([f](const proxy& p) {return (p.get_stats().*f).hist.values;}, utils::log_linear_histogram(),
+            std::plus<utils::log_linear_histogram>()).then([](const utils::log_linear_histogram& val) {
         utils_json::estimated_histogram res;
-        res = val;
+        res = val.to_estimated_histogram();
         return make_ready_future<json::json_return_type>(res);
     });
 }
@@ -70,18 +70,17 @@ static future<json::json_return_type>  total_latency(http_context& ctx, utils::t
 }
 
 void set_storage_proxy(http_context& ctx, routes& r) {
-    sp::get_total_hints.set(r, [](std::unique_ptr<request> req)  {
-        //TBD
-        unimplemented();
-        return make_ready_future<json::json_return_type>(0);
+    sp::get_total_hints.set(r, [&ctx](std::unique_ptr<request> req)  {
+        return ctx.sp.map_reduce0([] (proxy& p) -> uint64_t {
+            auto* hm = p.get_hints_manager();
+            return hm ? hm->get_stats().written : 0;
+        }, uint64_t(0), std::plus<uint64_t>()).then([] (uint64_t res) {
+            return make_ready_future<json::json_return_type>(res);
+        });
     });
 
-    sp::get_hinted_handoff_enabled.set(r, [](std::unique_ptr<request> req)  {
-        //TBD
-        // FIXME
-        // hinted handoff is not supported currently,
-        // so we should return false
-        return make_ready_future<json::json_return_type>(false);
+    sp::get_hinted_handoff_enabled.set(r, [&ctx](std::unique_ptr<request> req)  {
+        return make_ready_future<json::json_return_type>(ctx.db.local().get_config().hinted_handoff_enabled());
     });
 
     sp::set_hinted_handoff_enabled.set(r, [](std::unique_ptr<request> req)  {
@@ -105,10 +104,8 @@ void set_storage_proxy(http_context& ctx, routes& r) {
         return make_ready_future<json::json_return_type>(json_void());
     });
 
-    sp::get_max_hint_window.set(r, [](std::unique_ptr<request> req)  {
-        //TBD
-        unimplemented();
-        return make_ready_future<json::json_return_type>(0);
+    sp::get_max_hint_window.set(r, [&ctx](std::unique_ptr<request> req)  {
+        return make_ready_future<json::json_return_type>(ctx.db.local().get_config().max_hint_window_in_ms());
     });
 
     sp::set_max_hint_window.set(r, [](std::unique_ptr<request> req)  {
@@ -382,14 +379,14 @@ void set_storage_proxy(http_context& ctx, routes& r) {
     });
 
     sp::get_read_estimated_histogram.set(r, [&ctx](std::unique_ptr<request> req) {
-        return sum_estimated_histogram(ctx, &proxy::stats::estimated_read);
+        return sum_estimated_histogram(ctx, &proxy::stats::read);
     });
 
     sp::get_read_latency.set(r, [&ctx](std::unique_ptr<request> req) {
         return total_latency(ctx, &proxy::stats::read);
     });
     sp::get_write_estimated_histogram.set(r, [&ctx](std::unique_ptr<request> req) {
-        return sum_estimated_histogram(ctx, &proxy::stats::estimated_write);
+        return sum_estimated_histogram(ctx, &proxy::stats::write);
     });
 
     sp::get_write_latency.set(r, [&ctx](std::unique_ptr<request> req) {
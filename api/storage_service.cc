@@ -35,6 +35,7 @@
 #include "log.hh"
 #include "release.hh"
 #include "sstables/compaction_manager.hh"
+#include "streaming/stream_manager.hh"
 
 namespace api {
 
@@ -172,7 +173,7 @@ void set_storage_service(http_context& ctx, routes& r) {
     });
 
     ss::get_load.set(r, [&ctx](std::unique_ptr<request> req) {
-        return get_cf_stats(ctx, &column_family::stats::live_disk_space_used);
+        return get_shard_cf_stats(ctx, &cf_stats::live_disk_space_used);
     });
 
     ss::get_load_map.set(r, [] (std::unique_ptr<request> req) {
@@ -562,16 +563,17 @@ void set_storage_service(http_context& ctx, routes& r) {
     });
 
     ss::set_stream_throughput_mb_per_sec.set(r, [](std::unique_ptr<request> req) {
-        //TBD
-        unimplemented();
-        auto value = req->get_query_param("value");
-        return make_ready_future<json::json_return_type>(json_void());
+        auto value = boost::lexical_cast<uint32_t>(req->get_query_param("value"));
+        auto l = streaming::get_local_stream_manager().get_limits();
+        l.outbound_megabits_per_sec = value;
+        return streaming::get_local_stream_manager().set_limits_on_all_shards(l).then([] {
+            return make_ready_future<json::json_return_type>(json_void());
+        });
     });
 
     ss::get_stream_throughput_mb_per_sec.set(r, [](std::unique_ptr<request> req) {
-        //TBD
-        unimplemented();
-        return make_ready_future<json::json_return_type>(0);
+        int value = streaming::get_local_stream_manager().get_limits().outbound_megabits_per_sec;
+        return make_ready_future<json::json_return_type>(value);
     });
 
     ss::get_compaction_throughput_mb_per_sec.set(r, [&ctx](std::unique_ptr<request> req) {
@@ -663,6 +665,17 @@ void set_storage_service(http_context& ctx, routes& r) {
         });
     });
 
+    ss::bulk_load.set(r, [&ctx](std::unique_ptr<request> req) {
+        auto ks = validate_keyspace(ctx, req->param);
+        auto cf = req->get_query_param("cf");
+        auto coordinator = std::hash<sstring>()(cf) % smp::count;
+        return service::get_storage_service().invoke_on(coordinator, [ks = std::move(ks), cf = std::move(cf)] (service::storage_service& s) {
+            return s.bulk_load(ks, cf);
+        }).then([] {
+            return make_ready_future<json::json_return_type>(json_void());
+        });
+    });
+
     ss::sample_key_range.set(r, [](std::unique_ptr<request> req) {
         //TBD
         unimplemented();
@@ -678,10 +691,14 @@ void set_storage_service(http_context& ctx, routes& r) {
 
     ss::set_trace_probability.set(r, [](std::unique_ptr<request> req) {
         auto probability = req->get_query_param("probability");
-        return futurize<json::json_return_type>::apply([probability] {
+        auto summary_only = req->get_query_param("summary_only");
+        return futurize<json::json_return_type>::apply([probability, summary_only] {
             double real_prob = std::stod(probability.c_str());
-            return tracing::tracing::tracing_instance().invoke_on_all([real_prob] (auto& local_tracing) {
+            return tracing::tracing::tracing_instance().invoke_on_all([real_prob, summary_only] (auto& local_tracing) {
                 local_tracing.set_trace_probability(real_prob);
+                if (summary_only != "") {
+                    local_tracing.set_trace_probability_summary_only(strcasecmp(summary_only.c_str(), "true") == 0);
+                }
             }).then([] {
                 return make_ready_future<json::json_return_type>(json_void());
             });
@@ -810,7 +827,7 @@ void set_storage_service(http_context& ctx, routes& r) {
     });
 
     ss::get_metrics_load.set(r, [&ctx](std::unique_ptr<request> req) {
-        return get_cf_stats(ctx, &column_family::stats::live_disk_space_used);
+        return get_shard_cf_stats(ctx, &cf_stats::live_disk_space_used);
     });
 
     ss::get_exceptions.set(r, [](const_req req) {
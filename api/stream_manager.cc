@@ -87,6 +87,19 @@ static hs::stream_state get_state(
     return state;
 }
 
+// Keeps the current value when the parameter is not given.
+static void set_limit(const request& req, const sstring& name, uint32_t& value) {
+    auto param = req.get_query_param(name);
+    if (param.empty()) {
+        return;
+    }
+    try {
+        value = boost::lexical_cast<uint32_t>(param);
+    } catch (boost::bad_lexical_cast&) {
+        throw httpd::bad_param_exception(sprint("Bad value for %s: %s", name, param));
+    }
+}
+
 void set_stream_manager(http_context& ctx, routes& r) {
     hs::get_current_streams.set(r,
             [] (std::unique_ptr<request> req) {
@@ -158,6 +171,34 @@ void set_stream_manager(http_context& ctx, routes& r) {
             return make_ready_future<json::json_return_type>(res);
         });
     });
+
+    hs::get_stream_limits.set(r, [](std::unique_ptr<request> req) {
+        auto& sm = streaming::get_local_stream_manager();
+        auto& l = sm.get_limits();
+        hs::stream_limits res;
+        res.outbound_megabits_per_sec = l.outbound_megabits_per_sec;
+        res.per_peer_outbound_megabits_per_sec = l.per_peer_outbound_megabits_per_sec;
+        res.plans_per_peer = l.plans_per_peer;
+        res.latency_threshold_in_ms = l.latency_threshold.count();
+        res.throughput_factor = sm.get_throughput_factor();
+        return make_ready_future<json::json_return_type>(res);
+    });
+
+    hs::set_stream_limits.set(r, [](std::unique_ptr<request> req) {
+        auto l = streaming::get_local_stream_manager().get_limits();
+        uint32_t latency_threshold = l.latency_threshold.count();
+        set_limit(*req, "outbound_megabits_per_sec", l.outbound_megabits_per_sec);
+        set_limit(*req, "per_peer_outbound_megabits_per_sec", l.per_peer_outbound_megabits_per_sec);
+        set_limit(*req, "plans_per_peer", l.plans_per_peer);
+        set_limit(*req, "latency_threshold_in_ms", latency_threshold);
+        if (!l.plans_per_peer) {
+            throw httpd::bad_param_exception("plans_per_peer must be positive");
+        }
+        l.latency_threshold = std::chrono::milliseconds(latency_threshold);
+        return streaming::get_local_stream_manager().set_limits_on_all_shards(l).then([] {
+            return make_ready_future<json::json_return_type>(json_void());
+        });
+    });
 }
 
 }
@@ -24,6 +24,8 @@
 
 #include "http/exception.hh"
 #include "log.hh"
+#include "utils/alloc_profiler.hh"
+#include <boost/range/irange.hpp>
 
 namespace api {
 
@@ -65,6 +67,46 @@ void set_system(http_context& ctx, routes& r) {
         }
         return json::json_void();
     });
+
+    hs::set_alloc_profiler.set(r, [](std::unique_ptr<request> req) -> future<json::json_return_type> {
+        bool enable = strcasecmp(req->get_query_param("enable").c_str(), "true") == 0;
+        uint64_t sample_every = 1000;
+        if (req->get_query_param("sample_every") != "") {
+            try {
+                sample_every = boost::lexical_cast<uint64_t>(std::string(req->get_query_param("sample_every")));
+            } catch (boost::bad_lexical_cast& e) {
+                throw bad_param_exception("Bad sample_every " + req->get_query_param("sample_every"));
+            }
+        }
+        return smp::invoke_on_all([enable, sample_every] {
+            if (enable) {
+                utils::alloc_profiler::local().enable(sample_every);
+            } else {
+                utils::alloc_profiler::local().disable();
+            }
+        }).then([] {
+            return json::json_return_type(json::json_void());
+        });
+    });
+
+    hs::get_alloc_profiler_stacks.set(r, [](std::unique_ptr<request> req) -> future<json::json_return_type> {
+        return map_reduce(boost::irange(0u, smp::count), [] (unsigned cpu) {
+            return smp::submit_to(cpu, [] {
+                return utils::alloc_profiler::local().get_stacks();
+            });
+        }, utils::alloc_profiler::stacks(), [] (utils::alloc_profiler::stacks all, utils::alloc_profiler::stacks shard) {
+            for (auto&& e : shard) {
+                all[e.first] += e.second;
+            }
+            return all;
+        }).then([] (utils::alloc_profiler::stacks all) {
+            sstring folded;
+            for (auto&& e : all) {
+                folded += sprint("%s %d\n", e.first, e.second);
+            }
+            return json::json_return_type(folded);
+        });
+    });
 }
 
 }
@@ -70,6 +70,7 @@ class atomic_cell_type final {
     static constexpr unsigned ttl_offset = expiry_offset + expiry_size;
     static constexpr unsigned ttl_size = 4;
     friend class counter_cell_builder;
+    friend class atomic_cell_fragmented_view;
 private:
     static bool is_counter_update(bytes_view cell) {
         return cell[0] & COUNTER_UPDATE_FLAG;
@@ -121,6 +122,9 @@ class atomic_cell_type final {
     static bytes_mutable_view value(bytes_mutable_view cell) {
         return do_get_value(cell);
     }
+    static managed_bytes_view value(managed_bytes_view cell) {
+        return do_get_value(cell);
+    }
     // Can be called on live counter update cells only
     static int64_t counter_update_value(bytes_view cell) {
         return get_field<int64_t>(cell, flags_size + timestamp_size);
@@ -200,6 +204,51 @@ class atomic_cell_type final {
         serializer(b.begin() + value_offset);
         return b;
     }
+    // The *_into() variants build the cell in buf instead of allocating it,
+    // so that a caller making many short lived cells can reuse the buffer.
+    // The returned view is valid until buf is changed.
+    static bytes_view make_dead_into(bytes& buf, api::timestamp_type timestamp, gc_clock::time_point deletion_time) {
+        auto b = prepare_buffer(buf, flags_size + timestamp_size + deletion_time_size);
+        b[0] = 0;
+        set_field(b, timestamp_offset, timestamp);
+        set_field(b, deletion_time_offset, deletion_time.time_since_epoch().count());
+        return b;
+    }
+    template<typename Serializer>
+    GCC6_CONCEPT(requires requires(Serializer serializer, bytes::iterator it) {
+        serializer(it);
+    })
+    static bytes_view make_live_into(bytes& buf, api::timestamp_type timestamp, size_t size, Serializer&& serializer) {
+        auto value_offset = flags_size + timestamp_size;
+        auto b = prepare_buffer(buf, value_offset + size);
+        b[0] = LIVE_FLAG;
+        set_field(b, timestamp_offset, timestamp);
+        serializer(b.begin() + value_offset);
+        return b;
+    }
+    template<typename Serializer>
+    GCC6_CONCEPT(requires requires(Serializer serializer, bytes::iterator it) {
+        serializer(it);
+    })
+    static bytes_view make_live_into(bytes& buf, api::timestamp_type timestamp, size_t size,
+            gc_clock::time_point expiry, gc_clock::duration ttl, Serializer&& serializer) {
+        auto value_offset = flags_size + timestamp_size + expiry_size + ttl_size;
+        auto b = prepare_buffer(buf, value_offset + size);
+        b[0] = EXPIRY_FLAG | LIVE_FLAG;
+        set_field(b, timestamp_offset, timestamp);
+        set_field(b, expiry_offset, expiry.time_since_epoch().count());
+        set_field(b, ttl_offset, ttl.count());
+        serializer(b.begin() + value_offset);
+        return b;
+    }
+private:
+    static bytes_mutable_view prepare_buffer(bytes& buf, size_t size) {
+        if (buf.size() < size) {
+            buf = bytes(bytes::initialized_later(), size);
+        }
+        return bytes_mutable_view(buf.begin(), size);
+    }
+public:
     template<typename ByteContainer>
     friend class atomic_cell_base;
     friend class atomic_cell;
@@ -299,6 +348,48 @@ class atomic_cell_mutable_view final : public atomic_cell_base<bytes_mutable_vie
     friend class atomic_cell;
 };
 
+// A view of an atomic cell which, unlike atomic_cell_view, can be obtained
+// without linearizing a fragmented cell. Everything but the value is within
+// the first fragment, the value is left fragmented.
+class atomic_cell_fragmented_view final {
+    managed_bytes_view _data;
+private:
+    bytes_view metadata() const {
+        return _data.current_fragment();
+    }
+public:
+    explicit atomic_cell_fragmented_view(managed_bytes_view data) : _data(data) {}
+    bool is_counter_update() const {
+        return atomic_cell_type::is_counter_update(metadata());
+    }
+    bool is_live() const {
+        return atomic_cell_type::is_live(metadata());
+    }
+    bool is_live_and_has_ttl() const {
+        return atomic_cell_type::is_live_and_has_ttl(metadata());
+    }
+    // Can be called on live and dead cells
+    api::timestamp_type timestamp() const {
+        return atomic_cell_type::timestamp(metadata());
+    }
+    // Can be called on live cells only
+    managed_bytes_view value() const {
+        return atomic_cell_type::value(_data);
+    }
+    // Can be called only when is_dead(gc_clock::time_point)
+    gc_clock::time_point deletion_time() const {
+        return !is_live() ? atomic_cell_type::deletion_time(metadata()) : expiry() - ttl();
+    }
+    // Can be called only when is_live_and_has_ttl()
+    gc_clock::time_point expiry() const {
+        return atomic_cell_type::expiry(metadata());
+    }
+    // Can be called only when is_live_and_has_ttl()
+    gc_clock::duration ttl() const {
+        return atomic_cell_type::ttl(metadata());
+    }
+};
+
 class atomic_cell_ref final : public atomic_cell_base<managed_bytes&> {
 public:
     atomic_cell_ref(managed_bytes& buf) : atomic_cell_base(buf) {}
@@ -391,6 +482,7 @@ collection_mutation::operator collection_mutation_view() const {
 class column_definition;
 
 int compare_atomic_cell_for_merge(atomic_cell_view left, atomic_cell_view right);
+int compare_atomic_cell_for_merge(atomic_cell_fragmented_view left, atomic_cell_fragmented_view right);
 void merge_column(const column_definition& def,
         atomic_cell_or_collection& old,
         const atomic_cell_or_collection& neww);
@@ -63,6 +63,25 @@ struct appending_hash<atomic_cell_view> {
     }
 };
 
+// Feeds the same as the atomic_cell_view of a non-counter cell.
+template<>
+struct appending_hash<atomic_cell_fragmented_view> {
+    template<typename Hasher>
+    void operator()(Hasher& h, atomic_cell_fragmented_view cell, const column_definition& cdef) const {
+        feed_hash(h, cell.is_live());
+        feed_hash(h, cell.timestamp());
+        if (cell.is_live()) {
+            if (cell.is_live_and_has_ttl()) {
+                feed_hash(h, cell.expiry());
+                feed_hash(h, cell.ttl());
+            }
+            feed_hash(h, cell.value());
+        } else {
+            feed_hash(h, cell.deletion_time());
+        }
+    }
+};
+
 template<>
 struct appending_hash<atomic_cell> {
     template<typename Hasher>
@@ -38,6 +38,7 @@ class atomic_cell_or_collection final {
     atomic_cell_or_collection(atomic_cell ac) : _data(std::move(ac._data)) {}
     static atomic_cell_or_collection from_atomic_cell(atomic_cell data) { return { std::move(data._data) }; }
     atomic_cell_view as_atomic_cell() const { return atomic_cell_view::from_bytes(_data); }
+    atomic_cell_fragmented_view as_fragmented_atomic_cell() const { return atomic_cell_fragmented_view(_data.view()); }
     atomic_cell_ref as_atomic_cell_ref() { return { _data }; }
     atomic_cell_mutable_view as_mutable_atomic_cell() { return atomic_cell_mutable_view::from_bytes(_data); }
     atomic_cell_or_collection(collection_mutation cm) : _data(std::move(cm.data)) {}
@@ -61,8 +62,10 @@ class atomic_cell_or_collection final {
     }
     template<typename Hasher>
     void feed_hash(Hasher& h, const column_definition& def) const {
-        if (def.is_atomic()) {
+        if (def.is_counter()) {
             ::feed_hash(h, as_atomic_cell(), def);
+        } else if (def.is_atomic()) {
+            ::feed_hash(h, as_fragmented_atomic_cell(), def);
         } else {
             ::feed_hash(h, as_collection_mutation(), def);
         }
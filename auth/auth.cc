@@ -41,6 +41,8 @@
 #include <seastar/core/sleep.hh>
 
 #include <seastar/core/distributed.hh>
+#include <seastar/core/lowres_clock.hh>
+#include <unordered_map>
 
 #include "auth.hh"
 #include "authenticator.hh"
@@ -58,10 +60,12 @@
 const sstring auth::auth::DEFAULT_SUPERUSER_NAME("cassandra");
 const sstring auth::auth::AUTH_KS("system_auth");
 const sstring auth::auth::USERS_CF("users");
+const sstring auth::auth::SERVICE_LEVELS_CF("service_levels");
 const sstring auth::auth::AUTH_PACKAGE_NAME("org.apache.cassandra.auth.");
 
 static const sstring USER_NAME("name");
 static const sstring SUPER("super");
+static const sstring SERVICE_LEVEL("service_level");
 
 static logging::logger alogger("auth");
 
@@ -125,7 +129,9 @@ class auth::auth::permissions_cache {
     }
 
     permissions_cache(const db::config& cfg)
-                    : _cache(cfg.permissions_cache_max_entries(), std::chrono::milliseconds(cfg.permissions_validity_in_ms()), std::chrono::milliseconds(cfg.permissions_update_interval_in_ms()), alogger,
+                    : _update_interval(cfg.permissions_update_interval_in_ms())
+                    , _max_entries(cfg.permissions_cache_max_entries())
+                    , _cache(cfg.permissions_cache_max_entries(), std::chrono::milliseconds(cfg.permissions_validity_in_ms()), std::chrono::milliseconds(cfg.permissions_update_interval_in_ms()), alogger,
                         [] (const key_type& k) {
                             alogger.debug("Refreshing permissions for {}", k.first.name());
                             return authorizer::get().authorize(::make_shared<authenticated_user>(k.first), k.second);
@@ -136,10 +142,41 @@ class auth::auth::permissions_cache {
     }
 
     future<permission_set> get(::shared_ptr<authenticated_user> user, data_resource resource) {
-        return _cache.get(key_type(*user, std::move(resource)));
+        auto now = lowres_clock::now();
+        if (now >= _snapshot_expiry) {
+            _snapshot.clear();
+            _snapshot_expiry = now + _update_interval;
+        }
+        key_type k(*user, std::move(resource));
+        auto i = _snapshot.find(k);
+        if (i != _snapshot.end()) {
+            return make_ready_future<permission_set>(i->second);
+        }
+        return _cache.get(k).then([this, k, version = _version] (permission_set set) {
+            // Permissions read before they were changed aren't kept.
+            if (version == _version && _snapshot.size() < _max_entries) {
+                _snapshot.emplace(std::move(k), set);
+            }
+            return set;
+        });
+    }
+
+    void invalidate() {
+        ++_version;
+        _snapshot.clear();
+        _cache.remove_if([] (const permission_set&) { return true; });
     }
 
 private:
+    std::chrono::milliseconds _update_interval;
+    size_t _max_entries;
+    // Permissions already loaded, which every statement checks, so that they
+    // are found without going through the LRU and the loader of the cache.
+    // Dropped as a whole after each update interval, to pick up what the
+    // cache reloaded, and when permissions are changed through this node.
+    std::unordered_map<key_type, permission_set, utils::tuple_hash> _snapshot;
+    lowres_clock::time_point _snapshot_expiry;
+    uint64_t _version = 0;
     cache_type _cache;
 };
 
@@ -245,6 +282,10 @@ future<> auth::auth::setup() {
         return setup_table(USERS_CF, sprint("CREATE TABLE %s.%s (%s text, %s boolean, PRIMARY KEY(%s)) WITH gc_grace_seconds=%d",
                                         AUTH_KS, USERS_CF, USER_NAME, SUPER, USER_NAME,
                                         90 * 24 * 60 * 60)); // 3 months.
+    }).then([] {
+        return setup_table(SERVICE_LEVELS_CF, sprint("CREATE TABLE %s.%s (%s text, %s text, PRIMARY KEY(%s)) WITH gc_grace_seconds=%d",
+                                        AUTH_KS, SERVICE_LEVELS_CF, USER_NAME, SERVICE_LEVEL, USER_NAME,
+                                        90 * 24 * 60 * 60)); // 3 months.
     }).then([authenticator_name = std::move(authenticator_name)] {
         return authenticator::setup(authenticator_name);
     }).then([authorizer_name = std::move(authorizer_name)] {
@@ -288,6 +329,12 @@ future<auth::permission_set> auth::auth::get_permissions(::shared_ptr<authentica
     return perm_cache.local().get(std::move(user), std::move(resource));
 }
 
+future<> auth::auth::invalidate_permissions() {
+    return perm_cache.invoke_on_all([] (permissions_cache& cache) {
+        cache.invalidate();
+    });
+}
+
 static db::consistency_level consistency_for_user(const sstring& username) {
     if (username == auth::auth::DEFAULT_SUPERUSER_NAME) {
         return db::consistency_level::QUORUM;
@@ -331,7 +378,24 @@ future<> auth::auth::insert_user(const sstring& username, bool is_super) {
 future<> auth::auth::delete_user(const sstring& username) {
     return cql3::get_local_query_processor().process(sprint("DELETE FROM %s.%s WHERE %s = ?",
                     AUTH_KS, USERS_CF, USER_NAME),
-                    consistency_for_user(username), { username }).discard_result();
+                    consistency_for_user(username), { username }).then([username] (auto) {
+        return cql3::get_local_query_processor().process(sprint("DELETE FROM %s.%s WHERE %s = ?",
+                        AUTH_KS, SERVICE_LEVELS_CF, USER_NAME),
+                        consistency_for_user(username), { username });
+    }).discard_result();
+}
+
+future<sstring> auth::auth::get_service_level(const sstring& username) {
+    return cql3::get_local_query_processor().process(
+                    sprint("SELECT %s FROM %s.%s WHERE %s = ?",
+                                    SERVICE_LEVEL, AUTH_KS, SERVICE_LEVELS_CF,
+                                    USER_NAME), consistency_for_user(username),
+                    { username }, true).then([] (::shared_ptr<cql3::untyped_result_set> res) {
+        if (res->empty() || !res->one().has(SERVICE_LEVEL)) {
+            return sstring();
+        }
+        return res->one().get_as<sstring>(SERVICE_LEVEL);
+    });
 }
 
 future<> auth::auth::setup_table(const sstring& name, const sstring& cql) {
@@ -61,11 +61,18 @@ class auth {
     static const sstring DEFAULT_SUPERUSER_NAME;
     static const sstring AUTH_KS;
     static const sstring USERS_CF;
+    static const sstring SERVICE_LEVELS_CF;
     static const sstring AUTH_PACKAGE_NAME;
     static const std::chrono::milliseconds SUPERUSER_SETUP_DELAY;
 
     static future<permission_set> get_permissions(::shared_ptr<authenticated_user>, data_resource);
 
+    /**
+     * Drops the permissions cached on all shards, so that changes made to
+     * them through this node are seen by the next statement.
+     */
+    static future<> invalidate_permissions();
+
     /**
      * Checks if the username is stored in AUTH_KS.USERS_CF.
      *
@@ -99,6 +106,14 @@ class auth {
      */
     static future<> delete_user(const sstring& username);
 
+    /**
+     * Fetches the service level the user is attached to in AUTH_KS.SERVICE_LEVELS_CF.
+     *
+     * @param username Username to query.
+     * @return the name of the level, empty if the user isn't attached to any.
+     */
+    static future<sstring> get_service_level(const sstring& username);
+
     /**
      * Sets up Authenticator and Authorizer.
      */
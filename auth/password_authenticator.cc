@@ -43,15 +43,21 @@
 #include <crypt.h>
 #include <random>
 #include <chrono>
+#include <unordered_map>
+#include <experimental/optional>
 
 #include <seastar/core/reactor.hh>
+#include <seastar/core/semaphore.hh>
+#include <seastar/core/shared_ptr.hh>
 
 #include "auth.hh"
 #include "password_authenticator.hh"
 #include "authenticated_user.hh"
 #include "cql3/query_processor.hh"
 #include "cql3/untyped_result_set.hh"
+#include "db/config.hh"
 #include "log.hh"
+#include "md5_hasher.hh"
 #include "utils/class_registrator.hh"
 
 const sstring auth::password_authenticator::PASSWORD_AUTHENTICATOR_NAME(auth::AUTH_PACKAGE_NAME + "PasswordAuthenticator");
@@ -144,6 +150,78 @@ static sstring hashpw(const sstring& pass) {
     return hashpw(pass, gensalt());
 }
 
+// The credentials verified recently by the shard, so that a storm of
+// connections of the same users costs one query and one hash per user rather
+// than per connection. Passwords are kept as a digest salted with a random
+// salt of the shard.
+class credentials_cache {
+    struct entry {
+        bytes digest;
+        lowres_clock::time_point expiry;
+    };
+    std::unordered_map<sstring, entry> _entries;
+    bytes _salt;
+    // Verifications in progress, bounded by credentials_check_concurrency.
+    std::experimental::optional<semaphore> _checks;
+public:
+    credentials_cache() : _salt(bytes::initialized_later(), rand_bytes) {
+        std::random_device rd;
+        std::default_random_engine e1(rd());
+        std::uniform_int_distribution<int> dist(0, 255);
+        for (auto& b : _salt) {
+            b = int8_t(dist(e1));
+        }
+    }
+
+    bytes digest(const sstring& password) const {
+        md5_hasher h;
+        h.update(reinterpret_cast<const char*>(_salt.data()), _salt.size());
+        h.update(password.data(), password.size());
+        return h.finalize();
+    }
+
+    bool verified(const sstring& username, const bytes& digest) const {
+        auto it = _entries.find(username);
+        return it != _entries.end() && it->second.digest == digest && it->second.expiry > lowres_clock::now();
+    }
+
+    void insert(const sstring& username, bytes digest, const db::config& cfg) {
+        auto validity = std::chrono::milliseconds(cfg.credentials_validity_in_ms());
+        if (!validity.count()) {
+            return;
+        }
+        auto now = lowres_clock::now();
+        if (_entries.size() >= cfg.credentials_cache_max_entries() && !_entries.count(username)) {
+            for (auto it = _entries.begin(); it != _entries.end();) {
+                it = it->second.expiry <= now ? _entries.erase(it) : std::next(it);
+            }
+            if (_entries.size() >= cfg.credentials_cache_max_entries()) {
+                return;
+            }
+        }
+        _entries[username] = entry{std::move(digest), now + validity};
+    }
+
+    void invalidate(const sstring& username) {
+        _entries.erase(username);
+    }
+
+    semaphore& checks(const db::config& cfg) {
+        if (!_checks) {
+            _checks.emplace(std::max<size_t>(cfg.credentials_check_concurrency(), 1));
+        }
+        return *_checks;
+    }
+};
+
+static thread_local credentials_cache verified_credentials;
+
+static future<> invalidate_credentials(const sstring& username) {
+    return smp::invoke_on_all([username] {
+        verified_credentials.invalidate(username);
+    });
+}
+
 future<> auth::password_authenticator::init() {
     gensalt(); // do this once to determine usable hashing
 
@@ -212,30 +290,43 @@ future<::shared_ptr<auth::authenticated_user> > auth::password_authenticator::au
     auto& username = credentials.at(USERNAME_KEY);
     auto& password = credentials.at(PASSWORD_KEY);
 
+    auto& cfg = cql3::get_local_query_processor().db().local().get_config();
+    auto digest = verified_credentials.digest(password);
+    if (verified_credentials.verified(username, digest)) {
+        return make_ready_future<::shared_ptr<authenticated_user>>(::make_shared<authenticated_user>(username));
+    }
+
     // Here was a thread local, explicit cache of prepared statement. In normal execution this is
     // fine, but since we in testing set up and tear down system over and over, we'd start using
     // obsolete prepared statements pretty quickly.
     // Rely on query processing caching statements instead, and lets assume
     // that a map lookup string->statement is not gonna kill us much.
-    return futurize_apply([this, username, password] {
-        auto& qp = cql3::get_local_query_processor();
-        return qp.process(sprint("SELECT %s FROM %s.%s WHERE %s = ?", SALTED_HASH,
-                                        auth::AUTH_KS, CREDENTIALS_CF, USER_NAME),
-                        consistency_for_user(username), {username}, true);
-    }).then_wrapped([=](future<::shared_ptr<cql3::untyped_result_set>> f) {
-        try {
-            auto res = f.get0();
-            if (res->empty() || !checkpw(password, res->one().get_as<sstring>(SALTED_HASH))) {
-                throw exceptions::authentication_exception("Username and/or password are incorrect");
-            }
+    return with_semaphore(verified_credentials.checks(cfg), 1, [this, &cfg, username, password, digest = std::move(digest)] () mutable {
+        // The same credentials may have been verified while waiting.
+        if (verified_credentials.verified(username, digest)) {
             return make_ready_future<::shared_ptr<authenticated_user>>(::make_shared<authenticated_user>(username));
-        } catch (std::system_error &) {
-            std::throw_with_nested(exceptions::authentication_exception("Could not verify password"));
-        } catch (exceptions::request_execution_exception& e) {
-            std::throw_with_nested(exceptions::authentication_exception(e.what()));
-        } catch (...) {
-            std::throw_with_nested(exceptions::authentication_exception("authentication failed"));
         }
+        return futurize_apply([this, username, password] {
+            auto& qp = cql3::get_local_query_processor();
+            return qp.process(sprint("SELECT %s FROM %s.%s WHERE %s = ?", SALTED_HASH,
+                                            auth::AUTH_KS, CREDENTIALS_CF, USER_NAME),
+                            consistency_for_user(username), {username}, true);
+        }).then_wrapped([=, &cfg, digest = std::move(digest)](future<::shared_ptr<cql3::untyped_result_set>> f) mutable {
+            try {
+                auto res = f.get0();
+                if (res->empty() || !checkpw(password, res->one().get_as<sstring>(SALTED_HASH))) {
+                    throw exceptions::authentication_exception("Username and/or password are incorrect");
+                }
+                verified_credentials.insert(username, std::move(digest), cfg);
+                return make_ready_future<::shared_ptr<authenticated_user>>(::make_shared<authenticated_user>(username));
+            } catch (std::system_error &) {
+                std::throw_with_nested(exceptions::authentication_exception("Could not verify password"));
+            } catch (exceptions::request_execution_exception& e) {
+                std::throw_with_nested(exceptions::authentication_exception(e.what()));
+            } catch (...) {
+                std::throw_with_nested(exceptions::authentication_exception("authentication failed"));
+            }
+        });
     });
 }
 
@@ -259,7 +350,9 @@ future<> auth::password_authenticator::alter(sstring username,
         auto query = sprint("UPDATE %s.%s SET %s = ? WHERE %s = ?",
                         auth::AUTH_KS, CREDENTIALS_CF, SALTED_HASH, USER_NAME);
         auto& qp = cql3::get_local_query_processor();
-        return qp.process(query, consistency_for_user(username), { hashpw(password), username }).discard_result();
+        return qp.process(query, consistency_for_user(username), { hashpw(password), username }).discard_result().then([username] {
+            return invalidate_credentials(username);
+        });
     } catch (std::out_of_range&) {
         throw exceptions::invalid_request_exception("PasswordAuthenticator requires PASSWORD option");
     }
@@ -270,7 +363,9 @@ future<> auth::password_authenticator::drop(sstring username) {
         auto query = sprint("DELETE FROM %s.%s WHERE %s = ?",
                         auth::AUTH_KS, CREDENTIALS_CF, USER_NAME);
         auto& qp = cql3::get_local_query_processor();
-        return qp.process(query, consistency_for_user(username), { username }).discard_result();
+        return qp.process(query, consistency_for_user(username), { username }).discard_result().then([username] {
+            return invalidate_credentials(username);
+        });
     } catch (std::out_of_range&) {
         throw exceptions::invalid_request_exception("PasswordAuthenticator requires PASSWORD option");
     }
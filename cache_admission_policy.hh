@@ -0,0 +1,69 @@
+/*
+ * Copyright (C) 2017 ScyllaDB
+ */
+
+/*
+ * This file is part of Scylla.
+ *
+ * Scylla is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Scylla is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include "utils/frequency_sketch.hh"
+
+// Decides whether a partition read from the underlying source on a cache miss
+// should be inserted into the cache, given the partition which would be evicted
+// to make room for it. Partitions are identified by a hash of their table and key.
+//
+// Called only when the cache is under memory pressure. While there is free memory
+// all misses are populated.
+class cache_admission_policy {
+public:
+    virtual ~cache_admission_policy() {}
+    // Called for every partition looked up in the cache, hit or miss.
+    virtual void record_access(uint64_t key_hash) = 0;
+    virtual bool admit(uint64_t candidate_hash, uint64_t victim_hash) = 0;
+    virtual void clear() = 0;
+};
+
+// Admits everything, which makes the cache populate on every miss.
+class always_admit_policy final : public cache_admission_policy {
+public:
+    virtual void record_access(uint64_t) override { }
+    virtual bool admit(uint64_t, uint64_t) override { return true; }
+    virtual void clear() override { }
+};
+
+// TinyLFU: admits the candidate only if it was recently accessed more often than
+// the eviction victim. A scan touches each partition once, so the partitions it
+// brings in cannot push out the frequently read working set.
+class tinylfu_admission_policy final : public cache_admission_policy {
+    utils::frequency_sketch _sketch;
+public:
+    explicit tinylfu_admission_policy(size_t sketch_width)
+        : _sketch(sketch_width)
+    { }
+    virtual void record_access(uint64_t key_hash) override {
+        _sketch.increment(key_hash);
+    }
+    virtual bool admit(uint64_t candidate_hash, uint64_t victim_hash) override {
+        return _sketch.estimate(candidate_hash) > _sketch.estimate(victim_hash);
+    }
+    virtual void clear() override {
+        _sketch.clear();
+    }
+};
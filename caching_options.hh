@@ -21,6 +21,8 @@
 
 #pragma once
 #include <core/sstring.hh>
+#include <core/print.hh>
+#include <chrono>
 #include <boost/lexical_cast.hpp>
 #include "exceptions/exceptions.hh"
 #include "json.hh"
@@ -39,11 +41,29 @@ class caching_options {
 
     sstring _key_cache;
     sstring _row_cache;
-    caching_options(sstring k, sstring r) : _key_cache(k), _row_cache(r) {
+    // Fractions of the partitions in the shard's row cache which this table
+    // is guaranteed to keep, and may use at most, when the cache is full.
+    double _min_share = 0;
+    double _max_share = 1;
+    // The table's data stays in the cache, which never reads it from disk,
+    // within the memory budget of in-memory tables.
+    bool _in_memory = false;
+    // For how long coordinators give the results of CL ONE single partition
+    // reads to the same reads again, see service::coordinator_result_cache.
+    // Zero disables it.
+    std::chrono::milliseconds _coordinator_ttl{0};
+    caching_options(sstring k, sstring r, double min_share = 0, double max_share = 1, bool in_memory = false,
+                    std::chrono::milliseconds coordinator_ttl = std::chrono::milliseconds(0))
+        : _key_cache(k), _row_cache(r), _min_share(min_share), _max_share(max_share), _in_memory(in_memory)
+        , _coordinator_ttl(coordinator_ttl) {
         if ((k != "ALL") && (k != "NONE")) {
             throw exceptions::configuration_exception("Invalid key value: " + k); 
         }
 
+        if (min_share < 0 || max_share > 1 || min_share > max_share) {
+            throw exceptions::configuration_exception(sprint("Invalid cache shares: min_share %s, max_share %s", min_share, max_share));
+        }
+
         if ((r == "ALL") || (r == "NONE")) {
             return;
         } else {
@@ -59,8 +79,34 @@ class caching_options {
     caching_options() : _key_cache(default_key), _row_cache(default_row) {}
 public:
 
+    double min_share() const {
+        return _min_share;
+    }
+    double max_share() const {
+        return _max_share;
+    }
+    bool in_memory() const {
+        return _in_memory;
+    }
+    std::chrono::milliseconds coordinator_ttl() const {
+        return _coordinator_ttl;
+    }
+
     std::map<sstring, sstring> to_map() const {
-        return {{ "keys", _key_cache }, { "rows_per_partition", _row_cache }};
+        std::map<sstring, sstring> ret = {{ "keys", _key_cache }, { "rows_per_partition", _row_cache }};
+        if (_min_share != 0) {
+            ret.emplace("min_share", sprint("%s", _min_share));
+        }
+        if (_max_share != 1) {
+            ret.emplace("max_share", sprint("%s", _max_share));
+        }
+        if (_in_memory) {
+            ret.emplace("in_memory", "true");
+        }
+        if (_coordinator_ttl.count()) {
+            ret.emplace("coordinator_ttl_ms", sprint("%d", _coordinator_ttl.count()));
+        }
+        return ret;
     }
 
     sstring to_sstring() const {
@@ -71,24 +117,52 @@ class caching_options {
     static caching_options from_map(const Map & map) {
         sstring k = default_key;
         sstring r = default_row;
+        double min_share = 0;
+        double max_share = 1;
+        bool in_memory = false;
+        std::chrono::milliseconds coordinator_ttl(0);
 
+        auto to_share = [] (const sstring& name, const sstring& value) {
+            try {
+                return boost::lexical_cast<double>(value);
+            } catch (boost::bad_lexical_cast& e) {
+                throw exceptions::configuration_exception("Invalid " + name + " value: " + value);
+            }
+        };
         for (auto& p : map) {
             if (p.first == "keys") {
                 k = p.second;
             } else if (p.first == "rows_per_partition") {
                 r = p.second;
+            } else if (p.first == "min_share") {
+                min_share = to_share(p.first, p.second);
+            } else if (p.first == "max_share") {
+                max_share = to_share(p.first, p.second);
+            } else if (p.first == "in_memory") {
+                if (p.second != "true" && p.second != "false") {
+                    throw exceptions::configuration_exception("Invalid in_memory value: " + p.second);
+                }
+                in_memory = p.second == "true";
+            } else if (p.first == "coordinator_ttl_ms") {
+                try {
+                    coordinator_ttl = std::chrono::milliseconds(boost::lexical_cast<uint32_t>(p.second));
+                } catch (boost::bad_lexical_cast& e) {
+                    throw exceptions::configuration_exception("Invalid coordinator_ttl_ms value: " + p.second);
+                }
             } else {
                 throw exceptions::configuration_exception("Invalid caching option: " + p.first);
             }
         }
-        return caching_options(k, r);
+        return caching_options(k, r, min_share, max_share, in_memory, coordinator_ttl);
     }
     static caching_options from_sstring(const sstring& str) {
         return from_map(json::to_map(str));
     }
 
     bool operator==(const caching_options& other) const {
-        return _key_cache == other._key_cache && _row_cache == other._row_cache;
+        return _key_cache == other._key_cache && _row_cache == other._row_cache
+            && _min_share == other._min_share && _max_share == other._max_share && _in_memory == other._in_memory
+            && _coordinator_ttl == other._coordinator_ttl;
     }
     bool operator!=(const caching_options& other) const {
         return !(*this == other);
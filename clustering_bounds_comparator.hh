@@ -78,10 +78,10 @@ class bound_view {
         { }
         int operator()(const clustering_key_prefix& p1, int32_t w1, const clustering_key_prefix& p2, int32_t w2) const {
             auto type = _s.get().clustering_key_prefix_type();
-            auto res = prefix_equality_tri_compare(type->types().begin(),
+            auto res = prefix_equality_tri_compare(type->comparators().begin(),
                 type->begin(p1), type->end(p1),
                 type->begin(p2), type->end(p2),
-                ::tri_compare);
+                compare_component());
             if (res) {
                 return res;
             }
@@ -74,6 +74,9 @@ class compaction_strategy {
     // An estimation of number of compaction for strategy to be satisfied.
     int64_t estimated_pending_compactions(column_family& cf) const;
 
+    // An estimation of bytes to be written by compaction for strategy to be satisfied.
+    uint64_t backlog(column_family& cf) const;
+
     static sstring name(compaction_strategy_type type) {
         switch (type) {
         case compaction_strategy_type::null:
@@ -187,12 +187,18 @@ scylla_tests = [
     'tests/perf/perf_hash',
     'tests/perf/perf_cql_parser',
     'tests/perf/perf_simple_query',
+    'tests/perf/perf_workload',
     'tests/perf/perf_fast_forward',
     'tests/perf/perf_cache_eviction',
     'tests/cache_streamed_mutation_test',
     'tests/row_cache_stress_test',
     'tests/memory_footprint',
     'tests/perf/perf_sstable',
+    'tests/perf/perf_sstable_write',
+    'tests/perf/perf_commitlog',
+    'tests/perf/perf_repair',
+    'tests/perf/perf_lsa',
+    'tests/perf/perf_types',
     'tests/cql_query_test',
     'tests/storage_proxy_test',
     'tests/schema_change_test',
@@ -225,6 +231,14 @@ scylla_tests = [
     'tests/allocation_strategy_test',
     'tests/logalloc_test',
     'tests/log_heap_test',
+    'tests/top_k_test',
+    'tests/tournament_tree_test',
+    'tests/token_bucket_test',
+    'tests/cpu_quota_group_test',
+    'tests/replica_latency_tracker_test',
+    'tests/time_decaying_histogram_test',
+    'tests/log_linear_histogram_test',
+    'tests/cost_accountant_test',
     'tests/managed_vector_test',
     'tests/crc_test',
     'tests/flush_queue_test',
@@ -252,6 +266,7 @@ scylla_tests = [
 
 apps = [
     'scylla',
+    'tools/sstable_scan',
     ]
 
 tests = scylla_tests
@@ -329,6 +344,9 @@ scylla_core = (['database.cc',
                  'supervisor.cc',
                  'utils/logalloc.cc',
                  'utils/large_bitset.cc',
+                 'utils/alloc_profiler.cc',
+                 'utils/stall_detector.cc',
+                 'utils/cost_accountant.cc',
                  'mutation_partition.cc',
                  'mutation_partition_view.cc',
                  'mutation_partition_serializer.cc',
@@ -337,14 +355,19 @@ scylla_core = (['database.cc',
                  'mutation_query.cc',
                  'keys.cc',
                  'counters.cc',
+                 'counter_cache.cc',
+                 'querier.cc',
                  'sstables/sstables.cc',
                  'sstables/compress.cc',
+                 'sstables/read_ahead.cc',
                  'sstables/row.cc',
                  'sstables/partition.cc',
+                 'sstables/key_cache.cc',
                  'sstables/compaction.cc',
                  'sstables/compaction_strategy.cc',
                  'sstables/compaction_manager.cc',
                  'sstables/atomic_deletion.cc',
+                 'sstables/index_summary_manager.cc',
                  'sstables/integrity_checked_file_impl.cc',
                  'transport/event.cc',
                  'transport/event_notifier.cc',
@@ -408,6 +431,8 @@ scylla_core = (['database.cc',
                  'thrift/thrift_validation.cc',
                  'utils/runtime.cc',
                  'utils/murmur_hash.cc',
+                 'utils/crc.cc',
+                 'utils/adler32.cc',
                  'utils/uuid.cc',
                  'utils/big_decimal.cc',
                  'types.cc',
@@ -432,6 +457,7 @@ scylla_core = (['database.cc',
                  'cql3/selection/selectable.cc',
                  'cql3/selection/selector_factories.cc',
                  'cql3/selection/selection.cc',
+                 'cql3/selection/partial_aggregates.cc',
                  'cql3/selection/selector.cc',
                  'cql3/restrictions/statement_restrictions.cc',
                  'cql3/result_set.cc',
@@ -450,6 +476,9 @@ scylla_core = (['database.cc',
                  'db/marshal/type_parser.cc',
                  'db/batchlog_manager.cc',
                  'db/view/view.cc',
+                 'db/view/view_builder.cc',
+                 'db/hints/manager.cc',
+                 'db/row_cache_saver.cc',
                  'index/secondary_index_manager.cc',
                  'io/io.cc',
                  'utils/utils.cc',
@@ -497,18 +526,21 @@ scylla_core = (['database.cc',
                  'locator/ec2_snitch.cc',
                  'locator/ec2_multi_region_snitch.cc',
                  'message/messaging_service.cc',
+                 'message/rpc_compressor.cc',
                  'service/client_state.cc',
                  'service/migration_task.cc',
                  'service/storage_service.cc',
                  'service/misc_services.cc',
                  'service/pager/paging_state.cc',
                  'service/pager/query_pagers.cc',
+                 'service/paxos/paxos_state.cc',
                  'streaming/stream_task.cc',
                  'streaming/stream_session.cc',
                  'streaming/stream_request.cc',
                  'streaming/stream_summary.cc',
                  'streaming/stream_transfer_task.cc',
                  'streaming/stream_receive_task.cc',
+                 'streaming/stream_sstable_receiver.cc',
                  'streaming/stream_plan.cc',
                  'streaming/progress_info.cc',
                  'streaming/session_info.cc',
@@ -602,6 +634,7 @@ idls = ['idl/gossip_digest.idl.hh',
         'idl/tracing.idl.hh',
         'idl/consistency_level.idl.hh',
         'idl/cache_temperature.idl.hh',
+        'idl/paxos.idl.hh',
         ]
 
 scylla_tests_dependencies = scylla_core + api + idls + [
@@ -618,6 +651,7 @@ scylla_tests_seastar_deps = [
 
 deps = {
     'scylla': idls + ['main.cc'] + scylla_core + api,
+    'tools/sstable_scan': idls + ['tools/sstable_scan.cc'] + scylla_core + api,
 }
 
 pure_boost_tests = set([
@@ -652,12 +686,18 @@ tests_not_using_seastar_test_framework = set([
     'tests/perf/perf_cql_parser',
     'tests/message',
     'tests/perf/perf_simple_query',
+    'tests/perf/perf_workload',
     'tests/perf/perf_fast_forward',
     'tests/perf/perf_cache_eviction',
     'tests/row_cache_stress_test',
     'tests/memory_footprint',
     'tests/gossip',
     'tests/perf/perf_sstable',
+    'tests/perf/perf_sstable_write',
+    'tests/perf/perf_commitlog',
+    'tests/perf/perf_repair',
+    'tests/perf/perf_lsa',
+    'tests/perf/perf_types',
 ]) | pure_boost_tests
 
 for t in tests_not_using_seastar_test_framework:
@@ -681,6 +721,13 @@ deps['tests/UUID_test'] = ['utils/UUID_gen.cc', 'tests/UUID_test.cc', 'utils/uui
 deps['tests/murmur_hash_test'] = ['bytes.cc', 'utils/murmur_hash.cc', 'tests/murmur_hash_test.cc']
 deps['tests/allocation_strategy_test'] = ['tests/allocation_strategy_test.cc', 'utils/logalloc.cc', 'utils/dynamic_bitset.cc']
 deps['tests/log_heap_test'] = ['tests/log_heap_test.cc']
+deps['tests/top_k_test'] = ['tests/top_k_test.cc']
+deps['tests/tournament_tree_test'] = ['tests/tournament_tree_test.cc']
+deps['tests/token_bucket_test'] = ['tests/token_bucket_test.cc']
+deps['tests/cpu_quota_group_test'] = ['tests/cpu_quota_group_test.cc']
+deps['tests/replica_latency_tracker_test'] = ['tests/replica_latency_tracker_test.cc']
+deps['tests/time_decaying_histogram_test'] = ['tests/time_decaying_histogram_test.cc']
+deps['tests/log_linear_histogram_test'] = ['tests/log_linear_histogram_test.cc']
 deps['tests/anchorless_list_test'] = ['tests/anchorless_list_test.cc']
 
 warnings = [
@@ -830,7 +877,7 @@ for mode in build_modes:
 seastar_deps = 'practically_anything_can_change_so_lets_run_it_every_time_and_restat.'
 
 args.user_cflags += " " + pkg_config("--cflags", "jsoncpp")
-libs = ' '.join(['-lyaml-cpp', '-llz4', '-lz', '-lsnappy', pkg_config("--libs", "jsoncpp"),
+libs = ' '.join(['-lyaml-cpp', '-llz4', '-lz', '-lsnappy', '-lzstd', pkg_config("--libs", "jsoncpp"),
                  maybe_static(args.staticboost, '-lboost_filesystem'), ' -lcrypt',
                  maybe_static(args.staticboost, '-lboost_date_time'),
                 ])
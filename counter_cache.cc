@@ -0,0 +1,176 @@
+/*
+ * Copyright (C) 2017 ScyllaDB
+ */
+
+/*
+ * This file is part of Scylla.
+ *
+ * Scylla is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Scylla is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "counter_cache.hh"
+#include "counters.hh"
+#include "mutation.hh"
+
+counter_cache::~counter_cache() {
+    _lru.clear();
+}
+
+void counter_cache::erase(std::unordered_map<bytes, entry>::iterator it) {
+    _lru.erase(_lru.iterator_to(it->second));
+    _memory -= it->first.size() + entry_overhead;
+    _entries.erase(it);
+}
+
+bytes counter_cache::make_key(const schema& s, const partition_key& pk, const clustering_key* ck, column_id id) {
+    auto pk_bytes = pk.representation();
+    auto ck_bytes = ck ? ck->representation() : bytes_view();
+    // By schema version, as column ids may change when the schema is altered.
+    auto msb = s.version().get_most_significant_bits();
+    auto lsb = s.version().get_least_significant_bits();
+    uint32_t pk_size = pk_bytes.size();
+    bytes key(bytes::initialized_later(), sizeof(msb) + sizeof(lsb) + sizeof(id) + sizeof(pk_size) + 1 + pk_bytes.size() + ck_bytes.size());
+    auto out = key.begin();
+    auto write = [&out] (const void* p, size_t n) {
+        out = std::copy_n(reinterpret_cast<const int8_t*>(p), n, out);
+    };
+    write(&msb, sizeof(msb));
+    write(&lsb, sizeof(lsb));
+    write(&id, sizeof(id));
+    // The size of the partition key tells it from the clustering key.
+    write(&pk_size, sizeof(pk_size));
+    *out++ = ck ? 1 : 0;
+    write(pk_bytes.data(), pk_bytes.size());
+    write(ck_bytes.data(), ck_bytes.size());
+    return key;
+}
+
+stdx::optional<counter_cache::cell> counter_cache::get(const bytes& key, uint64_t generation) {
+    auto it = _entries.find(key);
+    if (it == _entries.end()) {
+        ++_misses;
+        return { };
+    }
+    if (it->second.generation != generation) {
+        erase(it);
+        ++_misses;
+        return { };
+    }
+    _lru.erase(_lru.iterator_to(it->second));
+    _lru.push_front(it->second);
+    ++_hits;
+    return it->second.value;
+}
+
+void counter_cache::put(bytes key, uint64_t generation, cell value) {
+    auto size = key.size() + entry_overhead;
+    if (size > _max_memory) {
+        return;
+    }
+    auto it = _entries.find(key);
+    if (it != _entries.end()) {
+        it->second.generation = generation;
+        it->second.value = value;
+        _lru.erase(_lru.iterator_to(it->second));
+        _lru.push_front(it->second);
+        return;
+    }
+    while (_memory + size > _max_memory) {
+        auto& victim = _lru.back();
+        erase(_entries.find(*victim.key));
+    }
+    it = _entries.emplace(std::move(key), entry()).first;
+    it->second.key = &it->first;
+    it->second.generation = generation;
+    it->second.value = value;
+    _lru.push_front(it->second);
+    _memory += size;
+}
+
+void counter_cache::remove(const bytes& key) {
+    auto it = _entries.find(key);
+    if (it != _entries.end()) {
+        erase(it);
+    }
+}
+
+template <typename Func>
+static void for_each_counter_cell(const mutation& m, Func&& func) {
+    m.partition().static_row().for_each_cell([&] (column_id id, const atomic_cell_or_collection& ac_o_c) {
+        func(nullptr, id, ac_o_c);
+    });
+    for (auto& cr : m.partition().clustered_rows()) {
+        cr.row().cells().for_each_cell([&] (column_id id, const atomic_cell_or_collection& ac_o_c) {
+            func(&cr.key(), id, ac_o_c);
+        });
+    }
+}
+
+bool transform_counter_updates_to_shards(mutation& m, counter_cache& cache, uint64_t generation, uint64_t clock_offset) {
+    std::vector<counter_cache::cell> cached;
+    bool all_cached = true;
+    for_each_counter_cell(m, [&] (const clustering_key* ck, column_id id, const atomic_cell_or_collection& ac_o_c) {
+        if (!all_cached || !ac_o_c.as_atomic_cell().is_live()) {
+            return;
+        }
+        auto c = cache.get(counter_cache::make_key(*m.schema(), m.key(), ck, id), generation);
+        if (!c) {
+            all_cached = false;
+            return;
+        }
+        cached.push_back(*c);
+    });
+    if (!all_cached) {
+        return false;
+    }
+
+    // Same as the reading path does with the local shard it read.
+    auto next = cached.begin();
+    auto transform = [&] (row& cells) {
+        cells.for_each_cell([&] (column_id, atomic_cell_or_collection& ac_o_c) {
+            auto acv = ac_o_c.as_atomic_cell();
+            if (!acv.is_live()) {
+                return; // continue -- we are in lambda
+            }
+            auto cs = counter_shard(counter_id::local(), next->value, next->logical_clock);
+            ++next;
+            cs.update(acv.counter_update_value(), clock_offset + 1);
+            ac_o_c = counter_cell_builder::from_single_shard(acv.timestamp(), cs);
+        });
+    };
+    transform(m.partition().static_row());
+    for (auto& cr : m.partition().clustered_rows()) {
+        transform(cr.row().cells());
+    }
+    return true;
+}
+
+void update_counter_cache(const mutation& m, counter_cache& cache, uint64_t generation) {
+    for_each_counter_cell(m, [&] (const clustering_key* ck, column_id id, const atomic_cell_or_collection& ac_o_c) {
+        auto acv = ac_o_c.as_atomic_cell();
+        if (!acv.is_live()) {
+            return;
+        }
+        auto cs = counter_cell_view(acv).local_shard();
+        if (cs) {
+            cache.put(counter_cache::make_key(*m.schema(), m.key(), ck, id), generation, counter_cache::cell{cs->value(), cs->logical_clock()});
+        }
+    });
+}
+
+void invalidate_counter_cache(const mutation& m, counter_cache& cache) {
+    for_each_counter_cell(m, [&] (const clustering_key* ck, column_id id, const atomic_cell_or_collection&) {
+        cache.remove(counter_cache::make_key(*m.schema(), m.key(), ck, id));
+    });
+}
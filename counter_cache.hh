@@ -0,0 +1,114 @@
+/*
+ * Copyright (C) 2017 ScyllaDB
+ */
+
+/*
+ * This file is part of Scylla.
+ *
+ * Scylla is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Scylla is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <unordered_map>
+#include <boost/intrusive/list.hpp>
+
+#include "bytes.hh"
+#include "keys.hh"
+#include "schema.hh"
+#include "stdx.hh"
+
+class mutation;
+
+/*
+ * Caches the local shard of the counter cells this node updated as the
+ * leader of the update, so that the next updates of those cells don't have
+ * to read them first.
+ *
+ * The local shard of a counter cell only changes by the updates this node
+ * leads, which the counter cell locks serialize, so the cache is kept exact
+ * by updating it once an update was applied. A table whose counters may
+ * change otherwise, as when they are deleted, streamed or truncated, bumps
+ * its counter cache generation, which makes the entries cached for it
+ * stale.
+ *
+ * The least recently used entries are evicted to stay within the memory
+ * given to the cache. A cache with no memory caches nothing.
+ */
+class counter_cache {
+public:
+    struct cell {
+        int64_t value;
+        int64_t logical_clock;
+    };
+private:
+    struct entry {
+        boost::intrusive::list_member_hook<> lru_link;
+        const bytes* key = nullptr;
+        uint64_t generation;
+        cell value;
+    };
+    using lru_type = boost::intrusive::list<entry,
+        boost::intrusive::member_hook<entry, boost::intrusive::list_member_hook<>, &entry::lru_link>,
+        boost::intrusive::constant_time_size<false>>;
+
+    // Bytes accounted to each entry on top of its key, for the map node.
+    static constexpr size_t entry_overhead = sizeof(entry) + 64;
+
+    size_t _max_memory;
+    size_t _memory = 0;
+    std::unordered_map<bytes, entry> _entries;
+    lru_type _lru;
+    uint64_t _hits = 0;
+    uint64_t _misses = 0;
+private:
+    void erase(std::unordered_map<bytes, entry>::iterator it);
+public:
+    explicit counter_cache(size_t max_memory) : _max_memory(max_memory) { }
+    counter_cache(counter_cache&&) = delete;
+    ~counter_cache();
+
+    // The cell at column id of the row ck, or of the static row if ck is
+    // nullptr, of partition pk, in this version of schema s.
+    static bytes make_key(const schema& s, const partition_key& pk, const clustering_key* ck, column_id id);
+
+    stdx::optional<cell> get(const bytes& key, uint64_t generation);
+    void put(bytes key, uint64_t generation, cell value);
+    void remove(const bytes& key);
+
+    size_t size() const {
+        return _entries.size();
+    }
+    size_t memory_used() const {
+        return _memory;
+    }
+    uint64_t hits() const {
+        return _hits;
+    }
+    uint64_t misses() const {
+        return _misses;
+    }
+};
+
+// Transforms mutation m from counter updates to counter shards using the
+// local shards cached for its cells, if all of them are cached. Otherwise
+// returns false and leaves m unchanged.
+bool transform_counter_updates_to_shards(mutation& m, counter_cache& cache, uint64_t generation, uint64_t clock_offset);
+
+// Caches the local shards of the counter shards m, which was transformed by
+// transform_counter_updates_to_shards(), was applied with.
+void update_counter_cache(const mutation& m, counter_cache& cache, uint64_t generation);
+
+// Drops the cells of m from the cache, when applying it failed.
+void invalidate_counter_cache(const mutation& m, counter_cache& cache);
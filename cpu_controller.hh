@@ -86,4 +86,42 @@ class flush_cpu_controller {
     flush_cpu_controller(flush_cpu_controller&&) = default;
 };
 
+// Proportional controller to adjust shares of compaction from its backlog.
+//
+// The backlog is the amount of bytes compaction still has to write for all tables of the
+// shard to satisfy their compaction strategies, normalized by the shard memory. If compaction
+// falls behind, read amplification grows; if it runs too fast, it steals CPU from requests.
+//
+// Below backlog_low, compaction is not behind and we leave most of the CPU to requests by
+// running it at qmin. Between backlog_low and backlog_high, the quota grows linearly up to
+// qmax, so that compaction catches up before reads have to go through too many sstables.
+class compaction_cpu_controller {
+    static constexpr float qmin = 0.05;
+    static constexpr float qmax = 1;
+    static constexpr float backlog_low = 0.5;
+    static constexpr float backlog_high = 8;
+
+    float _current_quota = 0.0f;
+    std::function<float()> _current_backlog;
+    std::chrono::milliseconds _interval;
+    timer<> _update_timer;
+
+    seastar::thread_scheduling_group _scheduling_group;
+    seastar::thread_scheduling_group *_current_scheduling_group = nullptr;
 
+    void adjust();
+public:
+    seastar::thread_scheduling_group* scheduling_group() {
+        return _current_scheduling_group;
+    }
+    float current_quota() const {
+        return _current_quota;
+    }
+
+    struct disabled {
+        seastar::thread_scheduling_group *backup;
+    };
+    compaction_cpu_controller(disabled d) : _scheduling_group(std::chrono::nanoseconds(0), 0), _current_scheduling_group(d.backup) {}
+    compaction_cpu_controller(std::chrono::milliseconds interval, std::function<float()> current_backlog);
+    compaction_cpu_controller(compaction_cpu_controller&&) = default;
+};
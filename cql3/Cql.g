@@ -358,14 +358,23 @@ useStatement returns [::shared_ptr<raw::use_statement> stmt]
  * SELECT <expression>
  * FROM <CF>
  * WHERE KEY = "key1" AND COL > 1 AND COL < 100
- * LIMIT <NUMBER>;
+ * [GROUP BY <column>, <column>, ...]
+ * [PER PARTITION LIMIT <NUMBER>]
+ * LIMIT <NUMBER>
+ * [ALLOW FILTERING]
+ * [BYPASS CACHE]
+ * [PARALLEL SCAN];
  */
 selectStatement returns [shared_ptr<raw::select_statement> expr]
     @init {
         bool is_distinct = false;
         ::shared_ptr<cql3::term::raw> limit;
+        ::shared_ptr<cql3::term::raw> per_partition_limit;
+        std::vector<shared_ptr<cql3::column_identifier::raw>> group_by_columns;
         raw::select_statement::parameters::orderings_type orderings;
         bool allow_filtering = false;
+        bool bypass_cache = false;
+        bool parallel_scan = false;
     }
     : K_SELECT ( ( K_DISTINCT { is_distinct = true; } )?
                  sclause=selectClause
@@ -373,13 +382,17 @@ selectStatement returns [shared_ptr<raw::select_statement> expr]
                )
       K_FROM cf=columnFamilyName
       ( K_WHERE wclause=whereClause )?
+      ( K_GROUP K_BY groupByClause[group_by_columns] ( ',' groupByClause[group_by_columns] )* )?
       ( K_ORDER K_BY orderByClause[orderings] ( ',' orderByClause[orderings] )* )?
+      ( K_PER K_PARTITION K_LIMIT rows=intValue { per_partition_limit = rows; } )?
       ( K_LIMIT rows=intValue { limit = rows; } )?
       ( K_ALLOW K_FILTERING  { allow_filtering = true; } )?
+      ( K_BYPASS K_CACHE     { bypass_cache = true; } )?
+      ( K_PARALLEL K_SCAN    { parallel_scan = true; } )?
       {
-          auto params = ::make_shared<raw::select_statement::parameters>(std::move(orderings), is_distinct, allow_filtering);
+          auto params = ::make_shared<raw::select_statement::parameters>(std::move(orderings), is_distinct, allow_filtering, bypass_cache, parallel_scan);
           $expr = ::make_shared<raw::select_statement>(std::move(cf), std::move(params),
-            std::move(sclause), std::move(wclause), std::move(limit));
+            std::move(sclause), std::move(wclause), std::move(limit), std::move(per_partition_limit), std::move(group_by_columns));
       }
     ;
 
@@ -440,6 +453,10 @@ orderByClause[raw::select_statement::parameters::orderings_type& orderings]
     : c=cident (K_ASC | K_DESC { reversed = true; })? { orderings.emplace_back(c, reversed); }
     ;
 
+groupByClause[std::vector<shared_ptr<cql3::column_identifier::raw>>& groups]
+    : c=cident { groups.push_back(c); }
+    ;
+
 /**
  * INSERT INTO <CF> (<column>, <column>, <column>, ...)
  * VALUES (<value>, <value>, <value>, ...)
@@ -772,6 +789,7 @@ typeColumns[::shared_ptr<create_type_statement> expr]
 /**
  * CREATE INDEX [IF NOT EXISTS] [indexName] ON <columnFamily> (<columnName>);
  * CREATE CUSTOM INDEX [IF NOT EXISTS] [indexName] ON <columnFamily> (<columnName>) USING <indexClass>;
+ * CREATE INDEX [IF NOT EXISTS] [indexName] ON <columnFamily> ((<partitionKeyColumn>, ...), <columnName>);
  */
 createIndexStatement returns [::shared_ptr<create_index_statement> expr]
     @init {
@@ -779,12 +797,17 @@ createIndexStatement returns [::shared_ptr<create_index_statement> expr]
         bool if_not_exists = false;
         auto name = ::make_shared<cql3::index_name>();
         std::vector<::shared_ptr<index_target::raw>> targets;
+        std::vector<::shared_ptr<cql3::column_identifier::raw>> partition_key;
     }
     : K_CREATE (K_CUSTOM { props->is_custom = true; })? K_INDEX (K_IF K_NOT K_EXISTS { if_not_exists = true; } )?
-        (idxName[name])? K_ON cf=columnFamilyName '(' (target1=indexIdent { targets.emplace_back(target1); } (',' target2=indexIdent { targets.emplace_back(target2); } )*)? ')'
+        (idxName[name])? K_ON cf=columnFamilyName '('
+        ( '(' k1=cident { partition_key.emplace_back(k1); } (',' kn=cident { partition_key.emplace_back(kn); } )* ')'
+              ',' target=indexIdent { targets.emplace_back(target); }
+        | (target1=indexIdent { targets.emplace_back(target1); } (',' target2=indexIdent { targets.emplace_back(target2); } )*)?
+        ) ')'
         (K_USING cls=STRING_LITERAL { props->custom_class = sstring{$cls.text}; })?
         (K_WITH properties[props])?
-      { $expr = ::make_shared<create_index_statement>(cf, name, targets, props, if_not_exists); }
+      { $expr = ::make_shared<create_index_statement>(cf, name, targets, partition_key, props, if_not_exists); }
     ;
 
 indexIdent returns [::shared_ptr<index_target::raw> id]
@@ -1538,6 +1561,10 @@ basic_unreserved_keyword returns [sstring str]
         | K_MAP
         | K_LIST
         | K_FILTERING
+        | K_BYPASS
+        | K_CACHE
+        | K_PARALLEL
+        | K_SCAN
         | K_PERMISSION
         | K_PERMISSIONS
         | K_KEYSPACES
@@ -1565,6 +1592,9 @@ basic_unreserved_keyword returns [sstring str]
         | K_LANGUAGE
         | K_NON
         | K_DETERMINISTIC
+        | K_GROUP
+        | K_PER
+        | K_PARTITION
         ) { $str = $k.text; }
     ;
 
@@ -1625,6 +1655,13 @@ K_ASC:         A S C;
 K_DESC:        D E S C;
 K_ALLOW:       A L L O W;
 K_FILTERING:   F I L T E R I N G;
+K_BYPASS:      B Y P A S S;
+K_GROUP:       G R O U P;
+K_PER:         P E R;
+K_PARTITION:   P A R T I T I O N;
+K_CACHE:       C A C H E;
+K_PARALLEL:    P A R A L L E L;
+K_SCAN:        S C A N;
 K_IF:          I F;
 K_IS:          I S;
 K_CONTAINS:    C O N T A I N S;
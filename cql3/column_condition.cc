@@ -45,6 +45,7 @@
 #include "lists.hh"
 #include "maps.hh"
 #include <boost/range/algorithm_ext/push_back.hpp>
+#include <boost/algorithm/cxx11/any_of.hpp>
 
 namespace {
 
@@ -92,7 +93,100 @@ void column_condition::collect_marker_specificaton(::shared_ptr<variable_specifi
             value->collect_marker_specification(bound_names);
         }
     }
-    _value->collect_marker_specification(bound_names);
+    if (_value) {
+        _value->collect_marker_specification(bound_names);
+    }
+}
+
+namespace {
+
+// Whether "current op value" holds, with the null semantics of CQL conditions.
+bool compare_with_operator(const operator_type& op, const abstract_type& type, const bytes_opt& value, const bytes_opt& current) {
+    if (!value) {
+        if (op == operator_type::EQ) {
+            return !current;
+        } else if (op == operator_type::NEQ) {
+            return bool(current);
+        }
+        throw exceptions::invalid_request_exception(sprint("Invalid comparison with null for operator \"%s\"", op));
+    }
+    if (!current) {
+        // the condition value is not null, so only NEQ can be true
+        return op == operator_type::NEQ;
+    }
+    auto comparison = type.compare(*current, *value);
+    if (op == operator_type::EQ) {
+        return comparison == 0;
+    } else if (op == operator_type::LT) {
+        return comparison < 0;
+    } else if (op == operator_type::LTE) {
+        return comparison <= 0;
+    } else if (op == operator_type::GT) {
+        return comparison > 0;
+    } else if (op == operator_type::GTE) {
+        return comparison >= 0;
+    } else if (op == operator_type::NEQ) {
+        return comparison != 0;
+    }
+    // IN, CONTAINS and CONTAINS KEY were handled by the caller
+    abort();
+}
+
+}
+
+bool column_condition::applies_to(const bytes_opt& current, const query_options& options) const {
+    bytes_opt current_value = current;
+    data_type value_type = column.type;
+    if (_collection_element) {
+        auto element = to_bytes_opt(_collection_element->bind_and_get(options));
+        auto ctype = static_cast<const collection_type_impl*>(column.type.get());
+        if (!element) {
+            throw exceptions::invalid_request_exception(sprint("Invalid null value for %s element access", column.type->is_map() ? "map" : "list"));
+        }
+        value_type = ctype->value_comparator();
+        current_value = { };
+        if (current) {
+            auto deserialized = column.type->deserialize(*current, options.get_cql_serialization_format());
+            if (column.type->is_map()) {
+                auto& data_map = value_cast<map_type_impl::native_type>(deserialized);
+                auto keys_type = ctype->name_comparator();
+                auto found = std::find_if(data_map.begin(), data_map.end(), [&] (auto&& e) {
+                    return keys_type->compare(e.first.serialize(), *element) == 0;
+                });
+                if (found != data_map.end()) {
+                    current_value = found->second.serialize();
+                }
+            } else {
+                auto idx = value_cast<int32_t>(int32_type->deserialize(*element));
+                if (idx < 0) {
+                    throw exceptions::invalid_request_exception(sprint("Invalid negative list index %d", idx));
+                }
+                auto& data_list = value_cast<list_type_impl::native_type>(deserialized);
+                if (size_t(idx) < data_list.size()) {
+                    current_value = data_list[idx].serialize();
+                }
+            }
+        }
+    }
+
+    if (_op != operator_type::IN) {
+        return compare_with_operator(_op, *value_type, to_bytes_opt(_value->bind_and_get(options)), current_value);
+    }
+    std::vector<bytes_opt> in_values;
+    if (_in_values.empty()) {
+        auto in_list = _value->bind(options);
+        if (!in_list) {
+            throw exceptions::invalid_request_exception("Invalid null list in IN condition");
+        }
+        in_values = static_pointer_cast<multi_item_terminal>(in_list)->get_elements();
+    } else {
+        for (auto&& v : _in_values) {
+            in_values.push_back(to_bytes_opt(v->bind_and_get(options)));
+        }
+    }
+    return boost::algorithm::any_of(in_values, [&] (const bytes_opt& v) {
+        return compare_with_operator(operator_type::EQ, *value_type, v, current_value);
+    });
 }
 
 ::shared_ptr<column_condition>
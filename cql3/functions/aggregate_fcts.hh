@@ -41,6 +41,10 @@
 
 #pragma once
 
+#include <cstring>
+#include <type_traits>
+#include <boost/range/algorithm/count_if.hpp>
+#include <seastar/core/byteorder.hh>
 #include "aggregate_function.hh"
 #include "native_aggregate_function.hh"
 
@@ -52,6 +56,60 @@ namespace functions {
  */
 namespace aggregate_fcts {
 
+// Decodes a serialized value. The fixed width numeric types are read
+// straight from their big endian form, rather than through a data_value.
+template <typename Type>
+inline
+std::enable_if_t<!std::is_arithmetic<Type>::value, Type>
+decode_value(bytes_view v) {
+    return value_cast<Type>(data_type_for<Type>()->deserialize(v));
+}
+
+template <typename Type>
+inline
+std::enable_if_t<std::is_integral<Type>::value, Type>
+decode_value(bytes_view v) {
+    if (v.size() != sizeof(Type)) {
+        // Throws the marshalling error.
+        return value_cast<Type>(data_type_for<Type>()->deserialize(v));
+    }
+    return read_be<Type>(reinterpret_cast<const char*>(v.data()));
+}
+
+template <typename Type>
+inline
+std::enable_if_t<std::is_floating_point<Type>::value, Type>
+decode_value(bytes_view v) {
+    using bits_type = std::conditional_t<sizeof(Type) == sizeof(uint32_t), uint32_t, uint64_t>;
+    static_assert(sizeof(bits_type) == sizeof(Type), "unexpected floating point width");
+    if (v.size() != sizeof(Type)) {
+        return value_cast<Type>(data_type_for<Type>()->deserialize(v));
+    }
+    auto bits = read_be<bits_type>(reinterpret_cast<const char*>(v.data()));
+    Type ret;
+    std::memcpy(&ret, &bits, sizeof(ret));
+    return ret;
+}
+
+// Decodes the non-null values of a batch of rows into a contiguous buffer,
+// which the aggregates then fold with plain loops, which the compiler can
+// vectorize for the fixed width types. The buffer is kept between batches.
+template <typename Type>
+class batch_decoder {
+    std::vector<Type> _values;
+public:
+    const std::vector<Type>& decode(const std::vector<aggregate_function::opt_bytes>& column) {
+        _values.clear();
+        _values.reserve(column.size());
+        for (auto&& v : column) {
+            if (v) {
+                _values.push_back(decode_value<Type>(*v));
+            }
+        }
+        return _values;
+    }
+};
+
 class impl_count_function : public aggregate_function::aggregate {
     int64_t _count;
 public:
@@ -79,6 +137,7 @@ make_count_rows_function() {
 template <typename Type>
 class impl_sum_function_for final : public aggregate_function::aggregate {
    Type _sum{};
+   batch_decoder<Type> _decoder;
 public:
     virtual void reset() override {
         _sum = {};
@@ -90,7 +149,12 @@ class impl_sum_function_for final : public aggregate_function::aggregate {
         if (!values[0]) {
             return;
         }
-        _sum += value_cast<Type>(data_type_for<Type>()->deserialize(*values[0]));
+        _sum += decode_value<Type>(*values[0]);
+    }
+    virtual void add_inputs(cql_serialization_format sf, const std::vector<opt_bytes>& column) override {
+        for (auto v : _decoder.decode(column)) {
+            _sum += v;
+        }
     }
 };
 
@@ -115,6 +179,7 @@ template <typename Type>
 class impl_avg_function_for final : public aggregate_function::aggregate {
    Type _sum{};
    int64_t _count = 0;
+   batch_decoder<Type> _decoder;
 public:
     virtual void reset() override {
         _sum = {};
@@ -132,7 +197,14 @@ class impl_avg_function_for final : public aggregate_function::aggregate {
             return;
         }
         ++_count;
-        _sum += value_cast<Type>(data_type_for<Type>()->deserialize(*values[0]));
+        _sum += decode_value<Type>(*values[0]);
+    }
+    virtual void add_inputs(cql_serialization_format sf, const std::vector<opt_bytes>& column) override {
+        auto& values = _decoder.decode(column);
+        _count += values.size();
+        for (auto v : values) {
+            _sum += v;
+        }
     }
 };
 
@@ -155,6 +227,7 @@ make_avg_function() {
 template <typename Type>
 class impl_max_function_for final : public aggregate_function::aggregate {
    std::experimental::optional<Type> _max{};
+   batch_decoder<Type> _decoder;
 public:
     virtual void reset() override {
         _max = {};
@@ -169,13 +242,24 @@ class impl_max_function_for final : public aggregate_function::aggregate {
         if (!values[0]) {
             return;
         }
-        auto val = value_cast<Type>(data_type_for<Type>()->deserialize(*values[0]));
+        auto val = decode_value<Type>(*values[0]);
         if (!_max) {
             _max = val;
         } else {
             _max = std::max(*_max, val);
         }
     }
+    virtual void add_inputs(cql_serialization_format sf, const std::vector<opt_bytes>& column) override {
+        auto& values = _decoder.decode(column);
+        if (values.empty()) {
+            return;
+        }
+        auto max = _max ? *_max : values.front();
+        for (auto&& v : values) {
+            max = std::max(max, v);
+        }
+        _max = std::move(max);
+    }
 };
 
 template <typename Type>
@@ -202,6 +286,7 @@ make_max_function() {
 template <typename Type>
 class impl_min_function_for final : public aggregate_function::aggregate {
    std::experimental::optional<Type> _min{};
+   batch_decoder<Type> _decoder;
 public:
     virtual void reset() override {
         _min = {};
@@ -216,13 +301,24 @@ class impl_min_function_for final : public aggregate_function::aggregate {
         if (!values[0]) {
             return;
         }
-        auto val = value_cast<Type>(data_type_for<Type>()->deserialize(*values[0]));
+        auto val = decode_value<Type>(*values[0]);
         if (!_min) {
             _min = val;
         } else {
             _min = std::min(*_min, val);
         }
     }
+    virtual void add_inputs(cql_serialization_format sf, const std::vector<opt_bytes>& column) override {
+        auto& values = _decoder.decode(column);
+        if (values.empty()) {
+            return;
+        }
+        auto min = _min ? *_min : values.front();
+        for (auto&& v : values) {
+            min = std::min(min, v);
+        }
+        _min = std::move(min);
+    }
 };
 
 template <typename Type>
@@ -264,6 +360,9 @@ class impl_count_function_for final : public aggregate_function::aggregate {
         }
         ++_count;
     }
+    virtual void add_inputs(cql_serialization_format sf, const std::vector<opt_bytes>& column) override {
+        _count += boost::count_if(column, [] (const opt_bytes& v) { return bool(v); });
+    }
 };
 
 template <typename Type>
@@ -79,6 +79,23 @@ class aggregate_function : public virtual function {
          */
         virtual void add_input(cql_serialization_format sf, const std::vector<opt_bytes>& values) = 0;
 
+        /**
+         * Adds the values of the only argument of a batch of rows.
+         *
+         * Aggregates of fixed width types override it with loops over the
+         * whole batch, without the virtual call of each row.
+         *
+         * @param protocol_version native protocol version
+         * @param column the values of the argument, one per row.
+         */
+        virtual void add_inputs(cql_serialization_format sf, const std::vector<opt_bytes>& column) {
+            std::vector<opt_bytes> values(1);
+            for (auto&& v : column) {
+                values[0] = v;
+                add_input(sf, values);
+            }
+        }
+
         /**
          * Computes and returns the aggregate current value.
          *
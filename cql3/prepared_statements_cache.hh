@@ -116,8 +116,8 @@ class prepared_statements_cache {
     value_extractor_fn _value_extractor_fn;
 
 public:
-    prepared_statements_cache(logging::logger& logger)
-        : _cache(memory::stats().total_memory() / 256, entry_expiry, logger)
+    prepared_statements_cache(logging::logger& logger, size_t max_size = memory::stats().total_memory() / 256)
+        : _cache(max_size, entry_expiry, logger)
     {}
 
     template <typename LoadFunc>
@@ -117,7 +117,8 @@ query_options::query_options(std::unique_ptr<query_options> qo, ::shared_ptr<ser
         std::move(qo->_values),
         std::move(qo->_value_views),
         qo->_skip_metadata,
-        std::move(query_options::specific_options{qo->_options.page_size, paging_state, qo->_options.serial_consistency, qo->_options.timestamp}),
+        std::move(query_options::specific_options{qo->_options.page_size, paging_state, qo->_options.serial_consistency, qo->_options.timestamp,
+                qo->_options.page_size_in_bytes}),
         qo->_cql_serialization_format) {
 
 }
@@ -162,6 +163,11 @@ int32_t query_options::get_page_size() const
     return get_specific_options().page_size;
 }
 
+uint64_t query_options::get_page_size_in_bytes() const
+{
+    return get_specific_options().page_size_in_bytes;
+}
+
 ::shared_ptr<service::pager::paging_state> query_options::get_paging_state() const
 {
     return get_specific_options().state;
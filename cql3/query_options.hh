@@ -67,6 +67,9 @@ class query_options {
         const ::shared_ptr<service::pager::paging_state> state;
         const std::experimental::optional<db::consistency_level> serial_consistency;
         const api::timestamp_type timestamp;
+        // The byte budget of a page, negotiated by the connection; zero for
+        // the server's default.
+        const uint64_t page_size_in_bytes = 0;
     };
 private:
     const db::consistency_level _consistency;
@@ -157,6 +160,8 @@ class query_options {
     bool skip_metadata() const;
     /**  The pageSize for this query. Will be <= 0 if not relevant for the query.  */
     int32_t get_page_size() const;
+    /** The byte budget of a page, zero if the client didn't ask for one. */
+    uint64_t get_page_size_in_bytes() const;
     /** The paging state for this query, or null if not relevant. */
     ::shared_ptr<service::pager::paging_state> get_paging_state() const;
     /**  Serial consistency for conditional updates. */
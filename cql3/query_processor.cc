@@ -49,6 +49,7 @@
 #include "cql3/CqlParser.hpp"
 #include "cql3/error_collector.hh"
 #include "cql3/statements/batch_statement.hh"
+#include "cql3/statements/schema_altering_statement.hh"
 #include "cql3/util.hh"
 
 namespace cql3 {
@@ -96,7 +97,8 @@ query_processor::query_processor(distributed<service::storage_proxy>& proxy, dis
         , _proxy(proxy)
         , _db(db)
         , _internal_state(new internal_state())
-        , _prepared_cache(prep_cache_log) {
+        , _prepared_cache(prep_cache_log)
+        , _unprepared_cache(prep_cache_log, memory::stats().total_memory() / 1024) {
     namespace sm = seastar::metrics;
 
     _metrics.add_group(
@@ -105,7 +107,22 @@ query_processor::query_processor(distributed<service::storage_proxy>& proxy, dis
                     sm::make_derive(
                             "statements_prepared",
                             _stats.prepare_invocations,
-                            sm::description("Counts a total number of parsed CQL requests."))});
+                            sm::description("Counts a total number of parsed CQL requests.")),
+
+                    sm::make_derive(
+                            "unprepared_cache_hits",
+                            _stats.unprepared_cache_hits,
+                            sm::description("Counts a number of unprepared CQL requests whose statement was found in the cache.")),
+
+                    sm::make_gauge(
+                            "unprepared_cache_size",
+                            [this] { return _unprepared_cache.size(); },
+                            sm::description("A number of entries in the cache of the statements of unprepared CQL requests.")),
+
+                    sm::make_gauge(
+                            "unprepared_cache_memory_footprint",
+                            [this] { return _unprepared_cache.memory_footprint(); },
+                            sm::description("Size (in bytes) of the cache of the statements of unprepared CQL requests."))});
 
     _metrics.add_group(
             "cql",
@@ -188,10 +205,38 @@ future<> query_processor::stop() {
 future<::shared_ptr<result_message>>
 query_processor::process(const sstring_view& query_string, service::query_state& query_state, query_options& options) {
     log.trace("process: \"{}\"", query_string);
+    auto& client_state = query_state.get_client_state();
+    auto key = compute_id(query_string, client_state.get_raw_keyspace());
+    auto it = _unprepared_cache.find(key);
+    if (it != _unprepared_cache.end()) {
+        ++_stats.unprepared_cache_hits;
+        tracing::trace(query_state.get_trace_state(), "Found the statement in the cache");
+        auto p = *it;
+        return process_parsed(*p, query_state, options);
+    }
+
     tracing::trace(query_state.get_trace_state(), "Parsing a statement");
-    auto p = get_statement(query_string, query_state.get_client_state());
-    options.prepare(p->bound_names);
-    auto cql_statement = p->statement;
+    auto p = get_statement(query_string, client_state);
+    // Schema changes are rare, and invalidate cached statements themselves.
+    if (dynamic_pointer_cast<statements::schema_altering_statement>(p->statement)) {
+        return process_parsed(*p, query_state, options);
+    }
+    p->raw_cql_statement = query_string.to_string();
+    auto holder = make_lw_shared(std::move(p));
+    return _unprepared_cache.get(key, [holder] {
+        return make_ready_future<std::unique_ptr<statements::prepared_statement>>(std::move(*holder));
+    }).then([this, &query_state, &options] (statements::prepared_statement::checked_weak_ptr p) {
+        return process_parsed(*p, query_state, options);
+    });
+}
+
+future<::shared_ptr<result_message>>
+query_processor::process_parsed(
+        const statements::prepared_statement& p,
+        service::query_state& query_state,
+        query_options& options) {
+    options.prepare(p.bound_names);
+    auto cql_statement = p.statement;
     if (cql_statement->get_bound_terms() != options.get_values_count()) {
         throw exceptions::invalid_request_exception("Invalid amount of bind variables");
     }
@@ -614,6 +659,9 @@ void query_processor::migration_subscriber::remove_invalid_prepared_statements(
     _qp->_prepared_cache.remove_if([&] (::shared_ptr<cql_statement> stmt) {
         return this->should_invalidate(ks_name, cf_name, stmt);
     });
+    _qp->_unprepared_cache.remove_if([&] (::shared_ptr<cql_statement> stmt) {
+        return this->should_invalidate(ks_name, cf_name, stmt);
+    });
 }
 
 bool query_processor::migration_subscriber::should_invalidate(
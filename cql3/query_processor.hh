@@ -107,6 +107,7 @@ class query_processor {
 
     struct stats {
         uint64_t prepare_invocations = 0;
+        uint64_t unprepared_cache_hits = 0;
     } _stats;
 
     cql_stats _cql_stats;
@@ -118,6 +119,11 @@ class query_processor {
 
     prepared_statements_cache _prepared_cache;
 
+    // Statements of the unprepared queries of the clients, so that repeated
+    // ones aren't parsed and prepared again. Kept apart so that they don't
+    // evict the statements which were prepared explicitly.
+    prepared_statements_cache _unprepared_cache;
+
     // A map for prepared statements used internally (which we don't want to mix with user statement, in particular we
     // don't bother with expiration on those.
     std::unordered_map<sstring, std::unique_ptr<statements::prepared_statement>> _internal_statements;
@@ -251,6 +257,12 @@ class query_processor {
     friend class migration_subscriber;
 
 private:
+    future<::shared_ptr<cql_transport::messages::result_message>>
+    process_parsed(
+            const statements::prepared_statement& p,
+            service::query_state& query_state,
+            query_options& options);
+
     query_options make_internal_options(
             const statements::prepared_statement::checked_weak_ptr& p,
             const std::initializer_list<data_value>&,
@@ -179,6 +179,36 @@ class single_column_primary_key_restrictions : public primary_key_restrictions<V
     }
 
 private:
+    // The key when all the columns are restricted by EQ.
+    ValueType compute_eq_key(const query_options& options) const {
+        static constexpr auto invalid_null_msg = std::is_same<ValueType, partition_key>::value
+            ? "Invalid null value for partition key part %s" : "Invalid null value for clustering key part %s";
+
+        if (_restrictions->size() == 1) {
+            auto&& e = *_restrictions->restrictions().begin();
+            const column_definition* def = e.first;
+            auto&& r = e.second;
+            auto&& val = r->value(options);
+            if (!val) {
+                throw exceptions::invalid_request_exception(sprint(invalid_null_msg, def->name_as_text()));
+            }
+            return ValueType::from_single_value(*_schema, std::move(*val));
+        }
+        std::vector<bytes> components;
+        components.reserve(_restrictions->size());
+        for (auto&& e : _restrictions->restrictions()) {
+            const column_definition* def = e.first;
+            auto&& r = e.second;
+            assert(components.size() == _schema->position(*def));
+            auto&& val = r->value(options);
+            if (!val) {
+                throw exceptions::invalid_request_exception(sprint(invalid_null_msg, def->name_as_text()));
+            }
+            components.emplace_back(std::move(*val));
+        }
+        return ValueType::from_exploded(*_schema, std::move(components));
+    }
+
     std::vector<range_type> compute_bounds(const query_options& options) const {
         std::vector<range_type> ranges;
 
@@ -187,30 +217,7 @@ class single_column_primary_key_restrictions : public primary_key_restrictions<V
 
         if (_restrictions->is_all_eq()) {
             ranges.reserve(1);
-            if (_restrictions->size() == 1) {
-                auto&& e = *_restrictions->restrictions().begin();
-                const column_definition* def = e.first;
-                auto&& r = e.second;
-                auto&& val = r->value(options);
-                if (!val) {
-                    throw exceptions::invalid_request_exception(sprint(invalid_null_msg, def->name_as_text()));
-                }
-                ranges.emplace_back(range_type::make_singular(ValueType::from_single_value(*_schema, std::move(*val))));
-                return ranges;
-            }
-            std::vector<bytes> components;
-            components.reserve(_restrictions->size());
-            for (auto&& e : _restrictions->restrictions()) {
-                const column_definition* def = e.first;
-                auto&& r = e.second;
-                assert(components.size() == _schema->position(*def));
-                auto&& val = r->value(options);
-                if (!val) {
-                    throw exceptions::invalid_request_exception(sprint(invalid_null_msg, def->name_as_text()));
-                }
-                components.emplace_back(std::move(*val));
-            }
-            ranges.emplace_back(range_type::make_singular(ValueType::from_exploded(*_schema, std::move(components))));
+            ranges.emplace_back(range_type::make_singular(compute_eq_key(options)));
             return ranges;
         }
 
@@ -353,16 +360,29 @@ template<>
 dht::partition_range_vector
 single_column_primary_key_restrictions<partition_key>::bounds_ranges(const query_options& options) const {
     dht::partition_range_vector ranges;
-    ranges.reserve(size());
-    for (query::range<partition_key>& r : compute_bounds(options)) {
+    if (_restrictions->is_all_eq()) {
+        // A single partition, whose ring position is built without going through a range of keys.
+        auto k = compute_eq_key(options);
+        auto token = dht::global_partitioner().get_token(*_schema, k);
+        ranges.reserve(1);
+        ranges.emplace_back(dht::partition_range::make_singular(query::ring_position(std::move(token), std::move(k))));
+        return ranges;
+    }
+    auto bounds = compute_bounds(options);
+    std::vector<partition_key_view> keys;
+    keys.reserve(bounds.size());
+    for (query::range<partition_key>& r : bounds) {
         if (!r.is_singular()) {
             throw exceptions::invalid_request_exception("Range queries on partition key values not supported.");
         }
-        ranges.emplace_back(std::move(r).transform(
-            [this] (partition_key&& k) -> query::ring_position {
-                auto token = dht::global_partitioner().get_token(*_schema, k);
-                return { std::move(token), std::move(k) };
-            }));
+        keys.push_back(r.start()->value());
+    }
+    // The keys of an IN list are hashed all at once.
+    auto tokens = dht::global_partitioner().get_tokens(*_schema, keys);
+    ranges.reserve(bounds.size());
+    for (size_t i = 0; i < bounds.size(); ++i) {
+        ranges.emplace_back(dht::partition_range::make_singular(
+                query::ring_position(std::move(tokens[i]), bounds[i].start()->value())));
     }
     return ranges;
 }
@@ -447,6 +447,18 @@ class single_column_restriction::contains final : public single_column_restricti
         return _entry_keys.size();
     }
 
+    std::vector<bytes_opt> keys(const query_options& options) const {
+        return bind_and_get(_keys, options);
+    }
+
+    std::vector<bytes_opt> entry_keys(const query_options& options) const {
+        return bind_and_get(_entry_keys, options);
+    }
+
+    std::vector<bytes_opt> entry_values(const query_options& options) const {
+        return bind_and_get(_entry_values, options);
+    }
+
     virtual bool uses_function(const sstring& ks_name, const sstring& function_name) const override {
         return abstract_restriction::term_uses_function(_values, ks_name, function_name)
             || abstract_restriction::term_uses_function(_keys, ks_name, function_name)
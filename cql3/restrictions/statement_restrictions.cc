@@ -266,9 +266,16 @@ statement_restrictions::statement_restrictions(database& db,
     }
     // Even if uses_secondary_indexing is false at this point, we'll still have to use one if
     // there is restrictions not covered by the PK.
+    // Unless they can be checked by the replicas, which selects without a supporting index
+    // have them do.
     if (!_nonprimary_key_restrictions->empty()) {
-        _uses_secondary_indexing = true;
-        _index_restrictions.push_back(_nonprimary_key_restrictions);
+        if (type.is_select() && !for_view && !_uses_secondary_indexing && !_nonprimary_key_restrictions->has_supporting_index(sim)) {
+            validate_filters();
+            _filters_on_replicas = true;
+        } else {
+            _uses_secondary_indexing = true;
+            _index_restrictions.push_back(_nonprimary_key_restrictions);
+        }
     }
 
     if (_uses_secondary_indexing && !for_view) {
@@ -399,6 +406,74 @@ bool statement_restrictions::need_filtering() {
            || (number_of_restricted_columns != 0 && _nonprimary_key_restrictions->has_multiple_contains());
 }
 
+void statement_restrictions::validate_filters() const {
+    for (auto&& e : _nonprimary_key_restrictions->restrictions()) {
+        auto& def = *e.first;
+        if (def.type->is_counter()) {
+            throw exceptions::invalid_request_exception(sprint("Cannot filter on counter column %s", def.name_as_text()));
+        }
+        if (!e.second->is_contains() && !def.is_atomic()) {
+            throw exceptions::invalid_request_exception(sprint("Cannot filter on the whole collection %s, only with CONTAINS, CONTAINS KEY or map-entry equality",
+                    def.name_as_text()));
+        }
+    }
+}
+
+std::vector<query::column_restriction> statement_restrictions::get_filters(const query_options& options) const {
+    std::vector<query::column_restriction> filters;
+    if (!_filters_on_replicas) {
+        return filters;
+    }
+    for (auto&& e : _nonprimary_key_restrictions->restrictions()) {
+        auto& def = *e.first;
+        auto& r = *e.second;
+        auto add = [&] (query::restriction_op op, std::vector<bytes_opt> values) {
+            filters.push_back(query::column_restriction{def.is_static(), def.id, op, std::move(values)});
+        };
+        if (r.is_EQ()) {
+            add(query::restriction_op::eq, r.values(options));
+        } else if (r.is_IN()) {
+            add(query::restriction_op::in, r.values(options));
+        } else if (r.is_slice()) {
+            for (auto b : {statements::bound::START, statements::bound::END}) {
+                if (!r.has_bound(b)) {
+                    continue;
+                }
+                auto values = r.bounds(b, options);
+                // A null bound doesn't restrict, like the bounds of clustering ranges.
+                if (!values.front()) {
+                    continue;
+                }
+                auto op = b == statements::bound::START
+                        ? (r.is_inclusive(b) ? query::restriction_op::gte : query::restriction_op::gt)
+                        : (r.is_inclusive(b) ? query::restriction_op::lte : query::restriction_op::lt);
+                add(op, std::move(values));
+            }
+        } else if (r.is_contains()) {
+            auto& c = static_cast<const single_column_restriction::contains&>(r);
+            // Null values don't restrict either, as when checked by is_satisfied_by().
+            for (auto&& v : c.values(options)) {
+                if (v) {
+                    add(query::restriction_op::contains, {std::move(v)});
+                }
+            }
+            for (auto&& k : c.keys(options)) {
+                if (k) {
+                    add(query::restriction_op::contains_key, {std::move(k)});
+                }
+            }
+            auto keys = c.entry_keys(options);
+            auto values = c.entry_values(options);
+            for (size_t i = 0; i < keys.size(); ++i) {
+                if (keys[i] && values[i]) {
+                    add(query::restriction_op::entry_eq, {std::move(keys[i]), std::move(values[i])});
+                }
+            }
+        }
+    }
+    return filters;
+}
+
 void statement_restrictions::validate_secondary_index_selections(bool selects_only_static_columns) {
     if (key_is_in_relation()) {
         throw exceptions::invalid_request_exception(
@@ -101,6 +101,12 @@ class statement_restrictions {
      */
     bool _is_key_range = false;
 
+    /**
+     * <code>true</code> if the restrictions on non-primary key columns are checked by the replicas
+     * against the rows they read, rather than looked up in an index.
+     */
+    bool _filters_on_replicas = false;
+
 public:
     /**
      * Creates a new empty <code>StatementRestrictions</code>.
@@ -158,6 +164,15 @@ class statement_restrictions {
         return _partition_key_restrictions;
     }
 
+    bool filters_on_replicas() const {
+        return _filters_on_replicas;
+    }
+
+    /**
+     * The restrictions on non-primary key columns, for the replicas to filter the rows they read with.
+     */
+    std::vector<query::column_restriction> get_filters(const query_options& options) const;
+
     ::shared_ptr<primary_key_restrictions<clustering_key_prefix>> get_clustering_columns_restrictions() const {
         return _clustering_columns_restrictions;
     }
@@ -373,6 +388,9 @@ class statement_restrictions {
     bool need_filtering();
 
     void validate_secondary_index_selections(bool selects_only_static_columns);
+private:
+    void validate_filters() const;
+public:
 
     /**
      * Checks if the query has some restrictions on the clustering columns.
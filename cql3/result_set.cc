@@ -39,6 +39,7 @@
  * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <arpa/inet.h>
 #include "cql3/result_set.hh"
 
 namespace cql3 {
@@ -136,19 +137,24 @@ result_set::result_set(::shared_ptr<metadata> metadata)
 { }
 
 size_t result_set::size() const {
+    if (_serialized_values) {
+        return _serialized_values / _metadata->value_count();
+    }
     return _rows.size();
 }
 
 bool result_set::empty() const {
-    return _rows.empty();
+    return !_serialized_values && _rows.empty();
 }
 
 void result_set::add_row(std::vector<bytes_opt> row) {
     assert(row.size() == _metadata->value_count());
+    deserialize_rows();
     _rows.emplace_back(std::move(row));
 }
 
 void result_set::add_column_value(bytes_opt value) {
+    deserialize_rows();
     if (_rows.empty() || _rows.back().size() == _metadata->value_count()) {
         std::vector<bytes_opt> row;
         row.reserve(_metadata->value_count());
@@ -158,11 +164,58 @@ void result_set::add_column_value(bytes_opt value) {
     _rows.back().emplace_back(std::move(value));
 }
 
+void result_set::add_serialized_value(bytes_view value) {
+    assert(_rows.empty());
+    auto size = htonl(int32_t(value.size()));
+    _serialized_rows.write(reinterpret_cast<const char*>(&size), sizeof(size));
+    _serialized_rows.write(value);
+    ++_serialized_values;
+}
+
+void result_set::add_serialized_null() {
+    assert(_rows.empty());
+    auto size = htonl(int32_t(-1));
+    _serialized_rows.write(reinterpret_cast<const char*>(&size), sizeof(size));
+    ++_serialized_values;
+}
+
+void result_set::deserialize_rows() const {
+    if (!_serialized_values) {
+        return;
+    }
+    auto value_count = _metadata->value_count();
+    auto in = _serialized_rows.linearize();
+    auto read_size = [&in] {
+        int32_t size;
+        std::copy_n(in.begin(), sizeof(size), reinterpret_cast<int8_t*>(&size));
+        in.remove_prefix(sizeof(size));
+        return int32_t(ntohl(size));
+    };
+    for (size_t i = 0; i < _serialized_values; i += value_count) {
+        std::vector<bytes_opt> row;
+        row.reserve(value_count);
+        for (size_t j = 0; j < value_count; ++j) {
+            auto size = read_size();
+            if (size < 0) {
+                row.emplace_back();
+                continue;
+            }
+            row.emplace_back(bytes(in.begin(), size));
+            in.remove_prefix(size);
+        }
+        _rows.emplace_back(std::move(row));
+    }
+    _serialized_rows = bytes_ostream();
+    _serialized_values = 0;
+}
+
 void result_set::reverse() {
+    deserialize_rows();
     std::reverse(_rows.begin(), _rows.end());
 }
 
 void result_set::trim(size_t limit) {
+    deserialize_rows();
     if (_rows.size() > limit) {
         _rows.resize(limit);
     }
@@ -177,6 +230,7 @@ const metadata& result_set::get_metadata() const {
 }
 
 const std::deque<std::vector<bytes_opt>>& result_set::rows() const {
+    deserialize_rows();
     return _rows;
 }
 
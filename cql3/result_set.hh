@@ -46,6 +46,7 @@
 #include "enum_set.hh"
 #include "service/pager/paging_state.hh"
 #include "schema.hh"
+#include "bytes_ostream.hh"
 
 namespace cql3 {
 
@@ -134,7 +135,16 @@ class prepared_metadata {
 class result_set {
 public:
     ::shared_ptr<metadata> _metadata;
-    std::deque<std::vector<bytes_opt>> _rows;
+private:
+    mutable std::deque<std::vector<bytes_opt>> _rows;
+    // Values written as the CQL binary protocol sends them, one row after the
+    // other, by selections which pass through the values they read. They are
+    // turned into _rows only if those are needed, so that the transport can
+    // send them without a vector per row and a bytes per value.
+    mutable bytes_ostream _serialized_rows;
+    mutable size_t _serialized_values = 0;
+private:
+    void deserialize_rows() const;
 public:
     result_set(std::vector<::shared_ptr<column_specification>> metadata_);
 
@@ -148,12 +158,28 @@ class result_set {
 
     void add_column_value(bytes_opt value);
 
+    // Adds the next value of the serialized rows. Rows can't be added both
+    // ways to the same result set.
+    void add_serialized_value(bytes_view value);
+    void add_serialized_null();
+
+    bool has_serialized_rows() const {
+        return _serialized_values;
+    }
+
+    // The values of the rows, each as a CQL [bytes], when
+    // has_serialized_rows().
+    const bytes_ostream& serialized_rows() const {
+        return _serialized_rows;
+    }
+
     void reverse();
 
     void trim(size_t limit);
 
     template<typename RowComparator>
     void sort(const RowComparator& cmp) {
+        deserialize_rows();
         std::sort(_rows.begin(), _rows.end(), std::ref(cmp));
     }
 
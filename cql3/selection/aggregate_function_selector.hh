@@ -47,7 +47,19 @@ namespace cql3 {
 namespace selection {
 
 class aggregate_function_selector : public abstract_function_selector_for<functions::aggregate_function> {
+    // The values of the argument of single argument aggregates are added
+    // in batches of this many rows.
+    static constexpr size_t batch_size = 256;
+
     std::unique_ptr<functions::aggregate_function::aggregate> _aggregate;
+    std::vector<bytes_opt> _batch;
+private:
+    void flush(cql_serialization_format sf) {
+        if (!_batch.empty()) {
+            _aggregate->add_inputs(sf, _batch);
+            _batch.clear();
+        }
+    }
 public:
     virtual bool is_aggregate() override {
         return true;
@@ -62,14 +74,23 @@ class aggregate_function_selector : public abstract_function_selector_for<functi
             _args[i] = s->get_output(sf);
             s->reset();
         }
-        _aggregate->add_input(sf, _args);
+        if (m != 1) {
+            _aggregate->add_input(sf, _args);
+            return;
+        }
+        _batch.push_back(std::move(_args[0]));
+        if (_batch.size() == batch_size) {
+            flush(sf);
+        }
     }
 
     virtual bytes_opt get_output(cql_serialization_format sf) override {
+        flush(sf);
         return _aggregate->compute(sf);
     }
 
     virtual void reset() override {
+        _batch.clear();
         _aggregate->reset();
     }
 
@@ -78,6 +99,7 @@ class aggregate_function_selector : public abstract_function_selector_for<functi
             : abstract_function_selector_for<functions::aggregate_function>(
                     dynamic_pointer_cast<functions::aggregate_function>(func), std::move(arg_selectors))
             , _aggregate(fun()->new_aggregate()) {
+        _batch.reserve(batch_size);
     }
 
     virtual sstring assignment_testable_source_context() const override {
@@ -0,0 +1,126 @@
+/*
+ * Copyright (C) 2017 ScyllaDB
+ */
+
+/*
+ * This file is part of Scylla.
+ *
+ * Scylla is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Scylla is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "cql3/selection/partial_aggregates.hh"
+#include "cql3/selection/selection.hh"
+#include "cql3/selection/selectable.hh"
+#include "cql3/functions/functions.hh"
+#include "cql3/column_identifier.hh"
+#include "db/system_keyspace.hh"
+
+namespace cql3 {
+
+namespace selection {
+
+// The function folding partial results of the aggregate, which has the given result type.
+static shared_ptr<functions::aggregate_function>
+merge_function_for(const sstring& function_name, data_type result_type) {
+    sstring merge_name;
+    if (function_name == "countRows" || function_name == "count" || function_name == "sum") {
+        merge_name = "sum";
+    } else if (function_name == "min" || function_name == "max") {
+        merge_name = function_name;
+    } else {
+        return {};
+    }
+    auto f = functions::functions::find(functions::function_name::native_function(merge_name), { result_type });
+    return dynamic_pointer_cast<functions::aggregate_function>(f);
+}
+
+std::experimental::optional<std::vector<query::aggregate_selector>>
+to_aggregate_selectors(schema_ptr schema, const selection& sel, const std::vector<::shared_ptr<raw_selector>>& raw_selectors) {
+    auto& names = sel.get_result_metadata()->get_names();
+    if (!sel.is_aggregate() || raw_selectors.empty() || names.size() != raw_selectors.size()) {
+        return std::experimental::nullopt;
+    }
+    std::vector<query::aggregate_selector> ret;
+    ret.reserve(raw_selectors.size());
+    for (size_t i = 0; i < raw_selectors.size(); ++i) {
+        auto fun = dynamic_pointer_cast<selectable::with_function>(raw_selectors[i]->selectable_->prepare(schema));
+        if (!fun || (fun->name().has_keyspace() && fun->name().keyspace != db::system_keyspace::NAME)) {
+            return std::experimental::nullopt;
+        }
+        query::aggregate_selector as{fun->name().name, {}};
+        for (auto&& arg : fun->args()) {
+            auto col = dynamic_pointer_cast<column_identifier>(arg);
+            if (!col) {
+                return std::experimental::nullopt;
+            }
+            as.column_names.push_back(col->text());
+        }
+        if (!merge_function_for(as.function_name, names[i]->type)) {
+            return std::experimental::nullopt;
+        }
+        ret.push_back(std::move(as));
+    }
+    return ret;
+}
+
+::shared_ptr<selection> make_aggregate_selection(database& db, schema_ptr schema, const std::vector<query::aggregate_selector>& selectors) {
+    std::vector<::shared_ptr<raw_selector>> raw_selectors;
+    raw_selectors.reserve(selectors.size());
+    for (auto&& as : selectors) {
+        std::vector<shared_ptr<selectable::raw>> args;
+        for (auto&& name : as.column_names) {
+            args.push_back(::make_shared<column_identifier::raw>(name, true));
+        }
+        auto fun = ::make_shared<selectable::with_function::raw>(functions::function_name::native_function(as.function_name), std::move(args));
+        raw_selectors.push_back(::make_shared<raw_selector>(std::move(fun), ::shared_ptr<column_identifier>()));
+    }
+    return selection::from_selectors(db, std::move(schema), raw_selectors);
+}
+
+partial_aggregates_merger::partial_aggregates_merger(const selection& sel, const std::vector<query::aggregate_selector>& selectors) {
+    auto& names = sel.get_result_metadata()->get_names();
+    assert(selectors.size() == names.size());
+    _functions.reserve(selectors.size());
+    _aggregates.reserve(selectors.size());
+    for (size_t i = 0; i < selectors.size(); ++i) {
+        auto f = merge_function_for(selectors[i].function_name, names[i]->type);
+        if (!f) {
+            throw std::runtime_error(sprint("Aggregate %s of %s cannot be merged", selectors[i].function_name, names[i]->type->as_cql3_type()->to_string()));
+        }
+        _aggregates.push_back(f->new_aggregate());
+        _functions.push_back(std::move(f));
+    }
+}
+
+void partial_aggregates_merger::add(const std::vector<bytes_opt>& partial) {
+    if (partial.size() != _aggregates.size()) {
+        throw std::runtime_error(sprint("Expected %d partial aggregates, got %d", _aggregates.size(), partial.size()));
+    }
+    for (size_t i = 0; i < partial.size(); ++i) {
+        _aggregates[i]->add_input(cql_serialization_format::internal(), { partial[i] });
+    }
+}
+
+std::vector<bytes_opt> partial_aggregates_merger::get() {
+    std::vector<bytes_opt> ret;
+    ret.reserve(_aggregates.size());
+    for (auto&& a : _aggregates) {
+        ret.push_back(a->compute(cql_serialization_format::internal()));
+    }
+    return ret;
+}
+
+}
+
+}
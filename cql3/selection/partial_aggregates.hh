@@ -0,0 +1,73 @@
+/*
+ * Copyright (C) 2017 ScyllaDB
+ */
+
+/*
+ * This file is part of Scylla.
+ *
+ * Scylla is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Scylla is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <experimental/optional>
+#include "bytes.hh"
+#include "schema.hh"
+#include "query-request.hh"
+#include "cql3/functions/aggregate_function.hh"
+#include "cql3/selection/raw_selector.hh"
+
+class database;
+
+namespace cql3 {
+
+namespace selection {
+
+class selection;
+
+/**
+ * Returns the selectors of an aggregate query which replicas can compute over
+ * disjoint sets of partitions and the coordinator can then merge, or nullopt if
+ * there is anything else than COUNT, SUM, MIN or MAX of a plain column in the
+ * selection. AVG is not mergeable from its result and is not pushed down.
+ */
+std::experimental::optional<std::vector<query::aggregate_selector>>
+to_aggregate_selectors(schema_ptr schema, const selection& sel, const std::vector<::shared_ptr<raw_selector>>& raw_selectors);
+
+/**
+ * Builds the selection of the given aggregates, as seen by the replicas.
+ */
+::shared_ptr<selection> make_aggregate_selection(database& db, schema_ptr schema, const std::vector<query::aggregate_selector>& selectors);
+
+/**
+ * Combines partial results of aggregates, each computed over a disjoint set of
+ * partitions, into the result over all of them.
+ *
+ * Counts are added up, sums are summed, minimums and maximums are folded with
+ * MIN and MAX of the same type. Null partials (MIN or MAX over no rows) are ignored.
+ */
+class partial_aggregates_merger {
+    std::vector<shared_ptr<functions::aggregate_function>> _functions;
+    std::vector<std::unique_ptr<functions::aggregate_function::aggregate>> _aggregates;
+public:
+    // sel is the selection of the aggregates, as built by make_aggregate_selection().
+    partial_aggregates_merger(const selection& sel, const std::vector<query::aggregate_selector>& selectors);
+
+    void add(const std::vector<bytes_opt>& partial);
+    std::vector<bytes_opt> get();
+};
+
+}
+
+}
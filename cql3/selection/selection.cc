@@ -105,14 +105,17 @@ class simple_selection : public selection {
     { }
 
     virtual bool is_wildcard() const override { return _is_wildcard; }
+    virtual bool is_trivial() const override { return true; }
     virtual bool is_aggregate() const override { return false; }
 protected:
     class simple_selectors : public selectors {
     private:
         std::vector<bytes_opt> _current;
+        bool _has_value = false;
     public:
         virtual void reset() override {
             _current.clear();
+            _has_value = false;
         }
 
         virtual std::vector<bytes_opt> get_output_row(cql_serialization_format sf) override {
@@ -120,7 +123,11 @@ class simple_selection : public selection {
         }
 
         virtual void add_input_row(cql_serialization_format sf, result_set_builder& rs) override {
-            _current = std::move(*rs.current);
+            // When grouping, the first row of the group is the one returned.
+            if (!_has_value) {
+                _current = std::move(*rs.current);
+                _has_value = true;
+            }
         }
 
         virtual bool is_aggregate() {
@@ -138,13 +145,14 @@ class selection_with_processing : public selection {
     ::shared_ptr<selector_factories> _factories;
 public:
     selection_with_processing(schema_ptr schema, std::vector<const column_definition*> columns,
-            std::vector<::shared_ptr<column_specification>> metadata, ::shared_ptr<selector_factories> factories)
+            std::vector<::shared_ptr<column_specification>> metadata, ::shared_ptr<selector_factories> factories,
+            bool has_group_by)
         : selection(schema, std::move(columns), std::move(metadata),
             factories->contains_write_time_selector_factory(),
             factories->contains_ttl_selector_factory())
         , _factories(std::move(factories))
     {
-        if (_factories->does_aggregation() && !_factories->contains_only_aggregate_functions()) {
+        if (!has_group_by && _factories->does_aggregation() && !_factories->contains_only_aggregate_functions()) {
             throw exceptions::invalid_request_exception("the select clause must either contains only aggregates or none");
         }
     }
@@ -222,7 +230,8 @@ uint32_t selection::add_column_for_ordering(const column_definition& c) {
     return _columns.size() - 1;
 }
 
-::shared_ptr<selection> selection::from_selectors(database& db, schema_ptr schema, const std::vector<::shared_ptr<raw_selector>>& raw_selectors) {
+::shared_ptr<selection> selection::from_selectors(database& db, schema_ptr schema, const std::vector<::shared_ptr<raw_selector>>& raw_selectors,
+        bool has_group_by) {
     std::vector<const column_definition*> defs;
 
     ::shared_ptr<selector_factories> factories =
@@ -231,7 +240,7 @@ ::shared_ptr<selection> selection::from_selectors(database& db, schema_ptr schem
 
     auto metadata = collect_metadata(schema, raw_selectors, *factories);
     if (processes_selection(raw_selectors) || raw_selectors.size() != defs.size()) {
-        return ::make_shared<selection_with_processing>(schema, std::move(defs), std::move(metadata), std::move(factories));
+        return ::make_shared<selection_with_processing>(schema, std::move(defs), std::move(metadata), std::move(factories), has_group_by);
     } else {
         return ::make_shared<simple_selection>(schema, std::move(defs), std::move(metadata), false);
     }
@@ -251,11 +260,15 @@ selection::collect_metadata(schema_ptr schema, const std::vector<::shared_ptr<ra
     return r;
 }
 
-result_set_builder::result_set_builder(const selection& s, gc_clock::time_point now, cql_serialization_format sf)
+result_set_builder::result_set_builder(const selection& s, gc_clock::time_point now, cql_serialization_format sf, size_t group_by_size)
     : _result_set(std::make_unique<result_set>(::make_shared<metadata>(*(s.get_result_metadata()))))
     , _selectors(s.new_selectors())
     , _now(now)
     , _cql_serialization_format(sf)
+    , _group_by_size(group_by_size)
+    // Not when columns were added for ordering, which aren't sent.
+    , _serialize_rows(s.is_trivial() && !group_by_size && !s._columns.empty()
+            && _result_set->get_metadata().value_count() == _result_set->get_metadata().column_count())
 {
     if (s._collect_timestamps) {
         _timestamps.resize(s._columns.size(), 0);
@@ -266,6 +279,10 @@ result_set_builder::result_set_builder(const selection& s, gc_clock::time_point
 }
 
 void result_set_builder::add_empty() {
+    if (_serialize_rows) {
+        _result_set->add_serialized_null();
+        return;
+    }
     current->emplace_back();
     if (!_timestamps.empty()) {
         _timestamps[current->size() - 1] = api::missing_timestamp;
@@ -276,10 +293,23 @@ void result_set_builder::add_empty() {
 }
 
 void result_set_builder::add(bytes_opt value) {
+    if (_serialize_rows) {
+        if (value) {
+            _result_set->add_serialized_value(*value);
+        } else {
+            _result_set->add_serialized_null();
+        }
+        return;
+    }
     current->emplace_back(std::move(value));
 }
 
 void result_set_builder::add(const column_definition& def, const query::result_atomic_cell_view& c) {
+    if (_serialize_rows) {
+        // Trivial selections collect neither timestamps nor TTLs.
+        _result_set->add_serialized_value(c.value());
+        return;
+    }
     current->emplace_back(get_value(def.type, c));
     if (!_timestamps.empty()) {
         _timestamps[current->size() - 1] = c.timestamp();
@@ -295,11 +325,18 @@ void result_set_builder::add(const column_definition& def, const query::result_a
 }
 
 void result_set_builder::add_collection(const column_definition& def, bytes_view c) {
+    if (_serialize_rows) {
+        _result_set->add_serialized_value(c);
+        return;
+    }
     current->emplace_back(to_bytes(c));
     // timestamps, ttls meaningless for collections
 }
 
 void result_set_builder::new_row() {
+    if (_serialize_rows) {
+        return;
+    }
     if (current) {
         _selectors->add_input_row(_cql_serialization_format, *this);
         if (!_selectors->is_aggregate()) {
@@ -315,14 +352,58 @@ void result_set_builder::new_row() {
     }
 }
 
-std::unique_ptr<result_set> result_set_builder::build() {
+void result_set_builder::new_row(const std::vector<bytes>& partition_key, const std::vector<bytes>& clustering_key) {
+    if (!_group_by_size) {
+        new_row();
+        return;
+    }
     if (current) {
+        _selectors->add_input_row(_cql_serialization_format, *this);
+        current->clear();
+    } else {
+        current.emplace();
+    }
+
+    auto key_component = [&] (size_t i) -> const bytes* {
+        if (i < partition_key.size()) {
+            return &partition_key[i];
+        }
+        i -= partition_key.size();
+        return i < clustering_key.size() ? &clustering_key[i] : nullptr;
+    };
+    bool same_group = bool(_last_group);
+    for (size_t i = 0; same_group && i < _group_by_size; ++i) {
+        auto c = key_component(i);
+        same_group = i < _last_group->size() ? c && *c == (*_last_group)[i] : !c;
+    }
+    if (same_group) {
+        return;
+    }
+
+    if (_last_group) {
+        _result_set->add_row(_selectors->get_output_row(_cql_serialization_format));
+        _selectors->reset();
+    } else {
+        _last_group.emplace();
+    }
+    _last_group->clear();
+    for (size_t i = 0; i < _group_by_size; ++i) {
+        auto c = key_component(i);
+        if (!c) {
+            break;
+        }
+        _last_group->push_back(*c);
+    }
+}
+
+std::unique_ptr<result_set> result_set_builder::build() {
+    if (current && !_serialize_rows) {
         _selectors->add_input_row(_cql_serialization_format, *this);
         _result_set->add_row(_selectors->get_output_row(_cql_serialization_format));
         _selectors->reset();
         current = std::experimental::nullopt;
     }
-    if (_result_set->empty() && _selectors->is_aggregate()) {
+    if (_result_set->empty() && _selectors->is_aggregate() && !_group_by_size) {
         _result_set->add_row(_selectors->get_output_row(_cql_serialization_format));
     }
     return std::move(_result_set);
@@ -375,7 +456,7 @@ void result_set_builder::visitor::accept_new_row(
         const query::result_row_view& row) {
     auto static_row_iterator = static_row.iterator();
     auto row_iterator = row.iterator();
-    _builder.new_row();
+    _builder.new_row(_partition_key, _clustering_key);
     for (auto&& def : _selection.get_columns()) {
         switch (def->kind) {
         case column_kind::partition_key:
@@ -403,7 +484,7 @@ void result_set_builder::visitor::accept_new_row(
 void result_set_builder::visitor::accept_partition_end(
         const query::result_row_view& static_row) {
     if (_row_count == 0) {
-        _builder.new_row();
+        _builder.new_row(_partition_key, {});
         auto static_row_iterator = static_row.iterator();
         for (auto&& def : _selection.get_columns()) {
             if (def->is_partition_key()) {
@@ -98,6 +98,11 @@ class selection {
         return false;
     }
 
+    // True when the selection returns the values of its columns as they are.
+    virtual bool is_trivial() const {
+        return false;
+    }
+
     /**
      * Checks if this selection contains static columns.
      * @return <code>true</code> if this selection contains static columns, <code>false</code> otherwise;
@@ -184,7 +189,9 @@ class selection {
     static std::vector<::shared_ptr<column_specification>> collect_metadata(schema_ptr schema,
         const std::vector<::shared_ptr<raw_selector>>& raw_selectors, const selector_factories& factories);
 public:
-    static ::shared_ptr<selection> from_selectors(database& db, schema_ptr schema, const std::vector<::shared_ptr<raw_selector>>& raw_selectors);
+    // With has_group_by set, aggregates may be selected together with plain columns.
+    static ::shared_ptr<selection> from_selectors(database& db, schema_ptr schema, const std::vector<::shared_ptr<raw_selector>>& raw_selectors,
+        bool has_group_by = false);
 
     virtual std::unique_ptr<selectors> new_selectors() const = 0;
 
@@ -237,13 +244,26 @@ class result_set_builder {
     std::vector<int32_t> _ttls;
     const gc_clock::time_point _now;
     cql_serialization_format _cql_serialization_format;
+    // Rows are grouped by that many leading primary key columns. 0 when not grouping.
+    const size_t _group_by_size;
+    std::experimental::optional<std::vector<bytes>> _last_group;
+    // Values are written straight into the serialized rows of the result set,
+    // without going through current and the selectors.
+    const bool _serialize_rows;
 public:
-    result_set_builder(const selection& s, gc_clock::time_point now, cql_serialization_format sf);
+    result_set_builder(const selection& s, gc_clock::time_point now, cql_serialization_format sf, size_t group_by_size = 0);
     void add_empty();
     void add(bytes_opt value);
     void add(const column_definition& def, const query::result_atomic_cell_view& c);
     void add_collection(const column_definition& def, bytes_view c);
     void new_row();
+    // Starts a row with the given primary key. When grouping, ends the current
+    // group if the row doesn't belong to it.
+    void new_row(const std::vector<bytes>& partition_key, const std::vector<bytes>& clustering_key);
+    // Number of rows (groups, when grouping) built so far, not counting the current one.
+    size_t built_rows() const {
+        return _result_set->size();
+    }
     std::unique_ptr<result_set> build();
     api::timestamp_type timestamp_of(size_t idx);
     int32_t ttl_of(size_t idx);
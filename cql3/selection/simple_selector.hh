@@ -77,6 +77,7 @@ class simple_selector : public selector {
     const uint32_t _idx;
     data_type _type;
     bytes_opt _current;
+    bool _has_value = false;
 public:
     static ::shared_ptr<factory> new_factory(const sstring& column_name, uint32_t idx, data_type type) {
         return ::make_shared<simple_selector_factory>(column_name, idx, type);
@@ -89,8 +90,13 @@ class simple_selector : public selector {
     { }
 
     virtual void add_input(cql_serialization_format sf, result_set_builder& rs) override {
-        // TODO: can we steal it?
-        _current = (*rs.current)[_idx];
+        // Aggregated together with other rows of a group, a plain column
+        // takes its value from the first row of the group.
+        if (!_has_value) {
+            // TODO: can we steal it?
+            _current = (*rs.current)[_idx];
+            _has_value = true;
+        }
     }
 
     virtual bytes_opt get_output(cql_serialization_format sf) override {
@@ -99,6 +105,7 @@ class simple_selector : public selector {
 
     virtual void reset() override {
         _current = {};
+        _has_value = false;
     }
 
     virtual data_type get_type() override {
@@ -227,11 +227,10 @@ void cf_prop_defs::apply_to_builder(schema_builder& builder) {
     if (compression_options) {
         builder.set_compressor_params(compression_parameters(*compression_options));
     }
-#if 0
-    CachingOptions cachingOptions = getCachingOptions();
-    if (cachingOptions != null)
-        cfm.caching(cachingOptions);
-#endif
+    auto caching = get_map(KW_CACHING);
+    if (caching) {
+        builder.set_caching_options(caching_options::from_map(*caching));
+    }
 }
 
 void cf_prop_defs::validate_minimum_int(const sstring& field, int32_t minimum_value, int32_t default_value) const
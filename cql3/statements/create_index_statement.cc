@@ -48,6 +48,7 @@
 #include "schema.hh"
 #include "schema_builder.hh"
 #include "request_validations.hh"
+#include "db/index/secondary_index.hh"
 
 #include <boost/range/adaptor/transformed.hpp>
 #include <boost/algorithm/string/join.hpp>
@@ -59,11 +60,13 @@ namespace statements {
 create_index_statement::create_index_statement(::shared_ptr<cf_name> name,
                                                ::shared_ptr<index_name> index_name,
                                                std::vector<::shared_ptr<index_target::raw>> raw_targets,
+                                               std::vector<::shared_ptr<column_identifier::raw>> raw_partition_key,
                                                ::shared_ptr<index_prop_defs> properties,
                                                bool if_not_exists)
     : schema_altering_statement(name)
     , _index_name(index_name->get_idx())
     , _raw_targets(raw_targets)
+    , _raw_partition_key(std::move(raw_partition_key))
     , _properties(properties)
     , _if_not_exists(if_not_exists)
 {
@@ -101,6 +104,10 @@ create_index_statement::validate(distributed<service::storage_proxy>& proxy, con
         validate_targets_for_multi_column_index(targets);
     }
 
+    if (!_raw_partition_key.empty()) {
+        validate_for_local_index(schema, targets);
+    }
+
     for (auto& target : targets) {
         auto cd = schema->get_column_definition(target->column->name());
 
@@ -215,11 +222,38 @@ void create_index_statement::validate_targets_for_multi_column_index(std::vector
     }
 }
 
+void create_index_statement::validate_for_local_index(schema_ptr schema, const std::vector<::shared_ptr<index_target>>& targets) const
+{
+    if (_properties->is_custom) {
+        throw exceptions::invalid_request_exception("CUSTOM indexes cannot be local");
+    }
+    auto partition_key = boost::copy_range<std::vector<bytes>>(_raw_partition_key
+            | boost::adaptors::transformed([schema] (auto& raw) { return raw->prepare_column_identifier(schema)->name(); }));
+    auto table_partition_key = boost::copy_range<std::vector<bytes>>(schema->partition_key_columns()
+            | boost::adaptors::transformed([] (const column_definition& cdef) { return cdef.name(); }));
+    if (partition_key != table_partition_key) {
+        throw exceptions::invalid_request_exception(
+                sprint("Local indexes must be partitioned by the whole partition key of %s.%s, in order", keyspace(), column_family()));
+    }
+    auto cd = schema->get_column_definition(targets[0]->column->name());
+    if (cd->is_partition_key()) {
+        throw exceptions::invalid_request_exception(
+                sprint("Cannot create a local index on partition key column %s", *targets[0]->column));
+    }
+    if (cd->type->is_collection()) {
+        throw exceptions::invalid_request_exception(
+                sprint("Local indexes are not supported on collection column %s", *targets[0]->column));
+    }
+}
+
 future<::shared_ptr<cql_transport::event::schema_change>>
 create_index_statement::announce_migration(distributed<service::storage_proxy>& proxy, bool is_local_only) {
     if (!service::get_local_storage_service().cluster_supports_indexes()) {
         throw exceptions::invalid_request_exception("Index support is not enabled");
     }
+    if (!_raw_partition_key.empty() && !service::get_local_storage_service().cluster_supports_local_indexes()) {
+        throw exceptions::invalid_request_exception("Local indexes require all nodes to be upgraded");
+    }
     auto& db = proxy.local().get_db().local();
     auto schema = db.find_schema(keyspace(), column_family());
     std::vector<::shared_ptr<index_target>> targets;
@@ -242,6 +276,9 @@ create_index_statement::announce_migration(distributed<service::storage_proxy>&
     } else {
         kind = schema->is_compound() ? index_metadata_kind::composites : index_metadata_kind::keys;
     }
+    if (!_raw_partition_key.empty()) {
+        index_options.emplace(db::index::secondary_index::local_index_option_name, "true");
+    }
     auto index = make_index_metadata(schema, targets, accepted_name, kind, index_options);
     auto existing_index = schema->find_index_noname(index);
     if (existing_index) {
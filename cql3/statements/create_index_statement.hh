@@ -68,6 +68,8 @@ namespace statements {
 class create_index_statement : public schema_altering_statement {
     const sstring _index_name;
     const std::vector<::shared_ptr<index_target::raw>> _raw_targets;
+    // The partition key columns of a local index, empty for a global one.
+    const std::vector<::shared_ptr<column_identifier::raw>> _raw_partition_key;
     const ::shared_ptr<index_prop_defs> _properties;
     const bool _if_not_exists;
 
@@ -75,6 +77,7 @@ class create_index_statement : public schema_altering_statement {
 public:
     create_index_statement(::shared_ptr<cf_name> name, ::shared_ptr<index_name> index_name,
             std::vector<::shared_ptr<index_target::raw>> raw_targets,
+            std::vector<::shared_ptr<column_identifier::raw>> raw_partition_key,
             ::shared_ptr<index_prop_defs> properties, bool if_not_exists);
 
     future<> check_access(const service::client_state& state) override;
@@ -88,6 +91,7 @@ class create_index_statement : public schema_altering_statement {
     void validate_is_values_index_if_target_column_not_collection(const column_definition* cd,
                                                                   ::shared_ptr<index_target> target) const;
     void validate_target_column_is_map_if_index_involves_keys(bool is_map, ::shared_ptr<index_target> target) const;
+    void validate_for_local_index(schema_ptr schema, const std::vector<::shared_ptr<index_target>>& targets) const;
     void validate_targets_for_multi_column_index(std::vector<::shared_ptr<index_target>> targets) const;
     static index_metadata make_index_metadata(schema_ptr schema,
                                               const std::vector<::shared_ptr<index_target>>& targets,
@@ -83,6 +83,8 @@ cql3::statements::drop_user_statement::execute(distributed<service::storage_prox
                 return auth::auth::delete_user(_username).then([this] {
                     return auth::authenticator::get().drop(_username);
                 });
+            }).then([] {
+                return auth::auth::invalidate_permissions();
             }).then([] {
                 return make_ready_future<::shared_ptr<cql_transport::messages::result_message>>();
             });
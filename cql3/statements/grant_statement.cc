@@ -41,10 +41,13 @@
 
 #include "grant_statement.hh"
 #include "auth/authorizer.hh"
+#include "auth/auth.hh"
 
 future<::shared_ptr<cql_transport::messages::result_message>>
 cql3::statements::grant_statement::execute(distributed<service::storage_proxy>& proxy, service::query_state& state, const query_options& options) {
     return auth::authorizer::get().grant(state.get_client_state().user(), _permissions, _resource, _username).then([] {
+        return auth::auth::invalidate_permissions();
+    }).then([] {
         return make_ready_future<::shared_ptr<cql_transport::messages::result_message>>();
     });
 }
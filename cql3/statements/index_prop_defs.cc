@@ -58,11 +58,10 @@ void cql3::statements::index_prop_defs::validate() {
     if (!is_custom && !_properties.empty()) {
         throw exceptions::invalid_request_exception("Cannot specify options for a non-CUSTOM index");
     }
-    if (get_raw_options().count(
-            db::index::secondary_index::custom_index_option_name)) {
-        throw exceptions::invalid_request_exception(
-                sprint("Cannot specify %s as a CUSTOM option",
-                        db::index::secondary_index::custom_index_option_name));
+    for (auto&& name : { db::index::secondary_index::custom_index_option_name, db::index::secondary_index::local_index_option_name }) {
+        if (get_raw_options().count(name)) {
+            throw exceptions::invalid_request_exception(sprint("Cannot specify %s as a CUSTOM option", name));
+        }
     }
 }
 
@@ -51,7 +51,14 @@
 #include <boost/range/adaptor/filtered.hpp>
 #include <boost/range/adaptor/map.hpp>
 #include <boost/range/adaptor/indirected.hpp>
+#include <boost/range/join.hpp>
+#include <boost/range/algorithm/find.hpp>
+#include <boost/algorithm/cxx11/any_of.hpp>
+#include <boost/algorithm/cxx11/all_of.hpp>
 #include "service/storage_service.hh"
+#include "service/paxos/cas_request.hh"
+#include "cql3/selection/selection.hh"
+#include "transport/messages/result_message.hh"
 #include <seastar/core/execution_stage.hh>
 
 namespace cql3 {
@@ -157,9 +164,11 @@ modification_statement::get_mutations(distributed<service::storage_proxy>& proxy
             [this, keys, ranges, now] (auto params_ptr) {
                 std::vector<mutation> mutations;
                 mutations.reserve(keys->size());
-                for (auto key : *keys) {
+                for (auto&& key : *keys) {
                     // We know key.start() must be defined since we only allow EQ relations on the partition key.
-                    mutations.emplace_back(std::move(*key.start()->value().key()), s);
+                    // Its token was computed with those of the other keys, it isn't hashed again.
+                    auto& pos = key.start()->value();
+                    mutations.emplace_back(dht::decorated_key{pos.token(), *pos.key()}, s);
                     auto& m = mutations.back();
                     for (auto&& r : *ranges) {
                         this->add_update_for_key(m, r, *params_ptr);
@@ -396,32 +405,154 @@ modification_statement::execute_without_condition(distributed<service::storage_p
     });
 }
 
+std::vector<const column_definition*>
+modification_statement::get_columns_with_conditions() const {
+    std::vector<const column_definition*> columns;
+    if (_if_not_exists || _if_exists) {
+        for (auto&& def : s->all_columns_in_select_order()) {
+            columns.push_back(&def);
+        }
+        return columns;
+    }
+    // There may be several conditions on the elements of a collection.
+    for (auto&& cond : boost::range::join(_column_conditions, _static_conditions)) {
+        if (boost::range::find(columns, &cond->column) == columns.end()) {
+            columns.push_back(&cond->column);
+        }
+    }
+    return columns;
+}
+
+class modification_statement::cas_request : public service::paxos::cas_request {
+    modification_statement& _statement;
+    const query_options& _options;
+    partition_key _key;
+    query::clustering_row_ranges _ranges;
+    ::shared_ptr<selection::selection> _selection;
+    // The partition as the last round read it.
+    std::unique_ptr<result_set> _current;
+public:
+    cas_request(modification_statement& statement, const query_options& options, partition_key key, query::clustering_row_ranges ranges)
+        : _statement(statement)
+        , _options(options)
+        , _key(std::move(key))
+        , _ranges(std::move(ranges))
+        , _selection(selection::selection::wildcard(statement.s))
+    { }
+
+    // Reads the static and regular columns of the rows the statement modifies.
+    lw_shared_ptr<query::read_command> make_read_command() const {
+        auto& s = *_statement.s;
+        std::vector<column_id> static_cols;
+        boost::range::push_back(static_cols, s.static_columns() | boost::adaptors::transformed([] (auto&& col) { return col.id; }));
+        std::vector<column_id> regular_cols;
+        boost::range::push_back(regular_cols, s.regular_columns() | boost::adaptors::transformed([] (auto&& col) { return col.id; }));
+        query::partition_slice ps(_ranges, std::move(static_cols), std::move(regular_cols),
+                query::partition_slice::option_set::of<
+                    query::partition_slice::option::send_partition_key,
+                    query::partition_slice::option::send_clustering_key>());
+        return make_lw_shared<query::read_command>(s.id(), s.version(), std::move(ps), std::numeric_limits<uint32_t>::max());
+    }
+
+    virtual std::experimental::optional<mutation> apply(const query::result& qr, const query::partition_slice& slice,
+            api::timestamp_type ts) override {
+        selection::result_set_builder builder(*_selection, gc_clock::now(), _options.get_cql_serialization_format());
+        query::result_view::consume(qr, slice, selection::result_set_builder::visitor(builder, *_statement.s, *_selection));
+        _current = builder.build();
+        if (!applies()) {
+            return { };
+        }
+        mutation m(_key, _statement.s);
+        update_parameters params(_statement.s, _options, ts, _statement.get_time_to_live(_options), { });
+        for (auto&& r : _ranges) {
+            _statement.add_update_for_key(m, r, params);
+        }
+        return std::move(m);
+    }
+
+    // The result of the statement: whether it applied and, when it didn't, the
+    // values the conditions saw.
+    std::unique_ptr<result_set> build_result_set(bool applied) const {
+        auto columns = _statement.get_columns_with_conditions();
+        std::vector<::shared_ptr<column_specification>> specs;
+        specs.push_back(::make_shared<column_specification>(_statement.keyspace(), _statement.column_family(), CAS_RESULT_COLUMN, boolean_type));
+        if (!applied) {
+            for (auto&& def : columns) {
+                specs.push_back(def->column_specification);
+            }
+        }
+        auto rs = std::make_unique<result_set>(std::move(specs));
+        auto applied_value = boolean_type->decompose(applied);
+        if (applied || !_current || _current->rows().empty()) {
+            rs->add_row({applied_value});
+            return rs;
+        }
+        for (auto&& row : _current->rows()) {
+            std::vector<bytes_opt> values;
+            values.push_back(applied_value);
+            for (auto&& def : columns) {
+                values.push_back(row[_selection->index_of(*def)]);
+            }
+            rs->add_row(std::move(values));
+        }
+        return rs;
+    }
+private:
+    bool row_exists(const std::vector<bytes_opt>& row) const {
+        auto& s = *_statement.s;
+        if (_statement.applies_only_to_static_columns()) {
+            return boost::algorithm::any_of(s.static_columns(), [&] (const column_definition& def) {
+                return bool(row[_selection->index_of(def)]);
+            });
+        }
+        // A partition with a static row and no clustering rows reads as a
+        // row with no clustering key.
+        return !s.clustering_key_size() || bool(row[_selection->index_of(s.clustering_key_columns().front())]);
+    }
+
+    bool applies() const {
+        auto& rows = _current->rows();
+        bool exists = boost::algorithm::any_of(rows, [this] (const std::vector<bytes_opt>& row) {
+            return row_exists(row);
+        });
+        if (_statement._if_not_exists) {
+            return !exists;
+        }
+        if (_statement._if_exists) {
+            return exists;
+        }
+        static const bytes_opt null;
+        auto value_of = [&] (const column_definition& def) -> const bytes_opt& {
+            // The statement modifies at most one clustering row, while the
+            // static values are the same in all rows.
+            return rows.empty() ? null : rows.front()[_selection->index_of(def)];
+        };
+        return boost::algorithm::all_of(boost::range::join(_statement._column_conditions, _statement._static_conditions),
+                [&] (const ::shared_ptr<column_condition>& cond) {
+            return cond->applies_to(value_of(cond->column), _options);
+        });
+    }
+};
+
 future<::shared_ptr<cql_transport::messages::result_message>>
 modification_statement::execute_with_condition(distributed<service::storage_proxy>& proxy, service::query_state& qs, const query_options& options) {
-    fail(unimplemented::cause::LWT);
-#if 0
-        List<ByteBuffer> keys = buildPartitionKeyNames(options);
-        // We don't support IN for CAS operation so far
-        if (keys.size() > 1)
-            throw new InvalidRequestException("IN on the partition key is not supported with conditional updates");
-
-        ByteBuffer key = keys.get(0);
-        long now = options.getTimestamp(queryState);
-        Composite prefix = createClusteringPrefix(options);
-
-        CQL3CasRequest request = new CQL3CasRequest(cfm, key, false);
-        addConditions(prefix, request, options);
-        request.addRowUpdate(prefix, this, options, now);
-
-        ColumnFamily result = StorageProxy.cas(keyspace(),
-                                               columnFamily(),
-                                               key,
-                                               request,
-                                               options.getSerialConsistency(),
-                                               options.getConsistency(),
-                                               queryState.getClientState());
-        return new ResultMessage.Rows(buildCasResultSet(key, result, options));
-#endif
+    auto keys = build_partition_keys(options);
+    // We don't support IN for CAS operation so far
+    if (keys.size() > 1) {
+        throw exceptions::invalid_request_exception("IN on the partition key is not supported with conditional updates");
+    }
+    if (requires_read()) {
+        throw exceptions::invalid_request_exception("List operations requiring a read are not supported with conditional updates");
+    }
+    inc_cql_stats();
+
+    auto request = ::make_shared<cas_request>(*this, options, *keys[0].start()->value().key(), create_clustering_ranges(options));
+    auto cl_for_paxos = options.get_serial_consistency().value_or(db::consistency_level::SERIAL);
+    return proxy.local().cas(s, request, request->make_read_command(), std::move(keys), cl_for_paxos, options.get_consistency(),
+            qs.get_trace_state()).then([request] (bool applied) {
+        return ::shared_ptr<cql_transport::messages::result_message>(
+                ::make_shared<cql_transport::messages::result_message::rows>(request->build_result_set(applied)));
+    });
 }
 
 future<::shared_ptr<cql_transport::messages::result_message>>
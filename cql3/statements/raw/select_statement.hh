@@ -75,13 +75,19 @@ class select_statement : public cf_statement
         const orderings_type _orderings;
         const bool _is_distinct;
         const bool _allow_filtering;
+        const bool _bypass_cache;
+        const bool _parallel_scan;
     public:
         parameters();
         parameters(orderings_type orderings,
             bool is_distinct,
-            bool allow_filtering);
+            bool allow_filtering,
+            bool bypass_cache = false,
+            bool parallel_scan = false);
         bool is_distinct();
         bool allow_filtering();
+        bool bypass_cache();
+        bool parallel_scan();
         orderings_type const& orderings();
     };
     template<typename T>
@@ -94,12 +100,16 @@ class select_statement : public cf_statement
     std::vector<::shared_ptr<selection::raw_selector>> _select_clause;
     std::vector<::shared_ptr<relation>> _where_clause;
     ::shared_ptr<term::raw> _limit;
+    ::shared_ptr<term::raw> _per_partition_limit;
+    std::vector<::shared_ptr<cql3::column_identifier::raw>> _group_by_columns;
 public:
     select_statement(::shared_ptr<cf_name> cf_name,
             ::shared_ptr<parameters> parameters,
             std::vector<::shared_ptr<selection::raw_selector>> select_clause,
             std::vector<::shared_ptr<relation>> where_clause,
-            ::shared_ptr<term::raw> limit);
+            ::shared_ptr<term::raw> limit,
+            ::shared_ptr<term::raw> per_partition_limit = {},
+            std::vector<::shared_ptr<cql3::column_identifier::raw>> group_by_columns = {});
 
     virtual std::unique_ptr<prepared> prepare(database& db, cql_stats& stats) override {
         return prepare(db, stats, false);
@@ -114,7 +124,11 @@ class select_statement : public cf_statement
         bool for_view = false);
 
     /** Returns a ::shared_ptr<term> for the limit or null if no limit is set */
-    ::shared_ptr<term> prepare_limit(database& db, ::shared_ptr<variable_specifications> bound_names);
+    ::shared_ptr<term> prepare_limit(database& db, ::shared_ptr<variable_specifications> bound_names, ::shared_ptr<term::raw> limit,
+        ::shared_ptr<column_specification> receiver);
+
+    /** Returns the number of primary key components the rows are grouped by, 0 if there is no GROUP BY */
+    size_t prepare_group_by(schema_ptr schema);
 
     static void verify_ordering_is_allowed(::shared_ptr<restrictions::statement_restrictions> restrictions);
 
@@ -135,7 +149,7 @@ class select_statement : public cf_statement
 
     bool contains_alias(::shared_ptr<column_identifier> name);
 
-    ::shared_ptr<column_specification> limit_receiver();
+    ::shared_ptr<column_specification> limit_receiver(bool per_partition = false);
 
 #if 0
     public:
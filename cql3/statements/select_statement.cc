@@ -44,6 +44,7 @@
 
 #include "transport/messages/result_message.hh"
 #include "cql3/selection/selection.hh"
+#include "cql3/selection/partial_aggregates.hh"
 #include "cql3/util.hh"
 #include "core/shared_ptr.hh"
 #include "query-result-reader.hh"
@@ -52,7 +53,13 @@
 #include <seastar/core/execution_stage.hh>
 #include "view_info.hh"
 #include "partition_slice_builder.hh"
-#include "cql3/untyped_result_set.hh"
+#include "service/storage_service.hh"
+#include <boost/algorithm/cxx11/all_of.hpp>
+#include <boost/algorithm/cxx11/any_of.hpp>
+#include <boost/algorithm/cxx11/none_of.hpp>
+#include <boost/range/adaptor/transformed.hpp>
+#include <boost/range/irange.hpp>
+#include <boost/range/iterator_range.hpp>
 
 namespace cql3 {
 
@@ -63,14 +70,20 @@ thread_local const shared_ptr<select_statement::parameters> select_statement::_d
 select_statement::parameters::parameters()
     : _is_distinct{false}
     , _allow_filtering{false}
+    , _bypass_cache{false}
+    , _parallel_scan{false}
 { }
 
 select_statement::parameters::parameters(orderings_type orderings,
                                          bool is_distinct,
-                                         bool allow_filtering)
+                                         bool allow_filtering,
+                                         bool bypass_cache,
+                                         bool parallel_scan)
     : _orderings{std::move(orderings)}
     , _is_distinct{is_distinct}
     , _allow_filtering{allow_filtering}
+    , _bypass_cache{bypass_cache}
+    , _parallel_scan{parallel_scan}
 { }
 
 bool select_statement::parameters::is_distinct() {
@@ -81,6 +94,14 @@ bool select_statement::parameters::allow_filtering() {
     return _allow_filtering;
 }
 
+bool select_statement::parameters::bypass_cache() {
+    return _bypass_cache;
+}
+
+bool select_statement::parameters::parallel_scan() {
+    return _parallel_scan;
+}
+
 select_statement::parameters::orderings_type const& select_statement::parameters::orderings() {
     return _orderings;
 }
@@ -93,6 +114,8 @@ select_statement::select_statement(schema_ptr schema,
                                    bool is_reversed,
                                    ordering_comparator_type ordering_comparator,
                                    ::shared_ptr<term> limit,
+                                   ::shared_ptr<term> per_partition_limit,
+                                   size_t group_by_size,
                                    cql_stats& stats)
     : _schema(schema)
     , _bound_terms(bound_terms)
@@ -101,6 +124,8 @@ select_statement::select_statement(schema_ptr schema,
     , _restrictions(std::move(restrictions))
     , _is_reversed(is_reversed)
     , _limit(std::move(limit))
+    , _per_partition_limit(std::move(per_partition_limit))
+    , _group_by_size(group_by_size)
     , _ordering_comparator(std::move(ordering_comparator))
     , _stats(stats)
 {
@@ -110,7 +135,8 @@ select_statement::select_statement(schema_ptr schema,
 bool select_statement::uses_function(const sstring& ks_name, const sstring& function_name) const {
     return _selection->uses_function(ks_name, function_name)
         || _restrictions->uses_function(ks_name, function_name)
-        || (_limit && _limit->uses_function(ks_name, function_name));
+        || (_limit && _limit->uses_function(ks_name, function_name))
+        || (_per_partition_limit && _per_partition_limit->uses_function(ks_name, function_name));
 }
 
 ::shared_ptr<const cql3::metadata> select_statement::get_result_metadata() const {
@@ -155,6 +181,19 @@ const sstring& select_statement::column_family() const {
 
 query::partition_slice
 select_statement::make_partition_slice(const query_options& options)
+{
+    if (_slice_template && _slice_template->cql_format() == options.get_cql_serialization_format()) {
+        return *_slice_template;
+    }
+    auto slice = do_make_partition_slice(options);
+    if (!_restrictions->has_clustering_columns_restriction() && !_per_partition_limit && !_restrictions->filters_on_replicas()) {
+        _slice_template = slice;
+    }
+    return slice;
+}
+
+query::partition_slice
+select_statement::do_make_partition_slice(const query_options& options)
 {
     std::vector<column_id> static_columns;
     std::vector<column_id> regular_columns;
@@ -173,10 +212,33 @@ select_statement::make_partition_slice(const query_options& options)
         }
     }
 
+    if (_parameters->bypass_cache()) {
+        _opts.set(query::partition_slice::option::bypass_cache);
+    }
+
+    if (_parameters->parallel_scan()) {
+        _opts.set(query::partition_slice::option::parallel_scan);
+    }
+
+    // Without writetime() and ttl() selected, the cells carry their values only.
+    if (!_opts.contains<query::partition_slice::option::send_timestamp>()
+            && !_opts.contains<query::partition_slice::option::send_expiry>()
+            && !_opts.contains<query::partition_slice::option::send_ttl>()
+            && service::get_local_storage_service().cluster_supports_compact_query_rows()) {
+        _opts.set(query::partition_slice::option::compact_rows);
+    }
+
     if (_parameters->is_distinct()) {
         _opts.set(query::partition_slice::option::distinct);
         return query::partition_slice({ query::clustering_range::make_open_ended_both_sides() },
-            std::move(static_columns), {}, _opts, nullptr, options.get_cql_serialization_format());
+            std::move(static_columns), {}, _opts, nullptr, options.get_cql_serialization_format(), query::max_rows,
+            _restrictions->get_filters(options));
+    }
+
+    if (_group_by_size) {
+        // Rows are assigned to groups by their key.
+        _opts.set(query::partition_slice::option::send_partition_key);
+        _opts.set(query::partition_slice::option::send_clustering_key);
     }
 
     auto bounds = _restrictions->get_clustering_bounds(options);
@@ -185,7 +247,8 @@ select_statement::make_partition_slice(const query_options& options)
         std::reverse(bounds.begin(), bounds.end());
     }
     return query::partition_slice(std::move(bounds),
-        std::move(static_columns), std::move(regular_columns), _opts, nullptr, options.get_cql_serialization_format());
+        std::move(static_columns), std::move(regular_columns), _opts, nullptr, options.get_cql_serialization_format(),
+        get_per_partition_limit(options), _restrictions->get_filters(options));
 }
 
 int32_t select_statement::get_limit(const query_options& options) const {
@@ -212,6 +275,30 @@ int32_t select_statement::get_limit(const query_options& options) const {
     }
 }
 
+uint32_t select_statement::get_per_partition_limit(const query_options& options) const {
+    if (!_per_partition_limit) {
+        return query::max_rows;
+    }
+
+    auto val = _per_partition_limit->bind_and_get(options);
+    if (val.is_null()) {
+        throw exceptions::invalid_request_exception("Invalid null value of per partition limit");
+    }
+    if (val.is_unset_value()) {
+        return query::max_rows;
+    }
+    try {
+        int32_type->validate(*val);
+        auto l = value_cast<int32_t>(int32_type->deserialize(*val));
+        if (l <= 0) {
+            throw exceptions::invalid_request_exception("PER PARTITION LIMIT must be strictly positive");
+        }
+        return l;
+    } catch (const marshal_exception& e) {
+        throw exceptions::invalid_request_exception("Invalid per partition limit value");
+    }
+}
+
 bool select_statement::needs_post_query_ordering() const {
     // We need post-query ordering only for queries with IN on the partition key and an ORDER BY.
     return _restrictions->key_is_in_relation() && !_parameters->orderings().empty();
@@ -241,26 +328,39 @@ select_statement::do_execute(distributed<service::storage_proxy>& proxy,
 
     validate_for_read(_schema->ks_name(), cl);
 
+    // Older replicas would ignore the filters.
+    if (_restrictions->filters_on_replicas() && !service::get_local_storage_service().cluster_supports_replica_filtering()) {
+        throw exceptions::invalid_request_exception("Filtering on columns without an index requires all nodes to be upgraded");
+    }
+
     int32_t limit = get_limit(options);
     auto now = gc_clock::now();
 
     ++_stats.reads;
 
+    // With GROUP BY the limit applies to the groups, which are counted by the builder.
     auto command = ::make_lw_shared<query::read_command>(_schema->id(), _schema->version(),
-        make_partition_slice(options), limit, now, tracing::make_trace_info(state.get_trace_state()), query::max_partitions, options.get_timestamp(state));
+        make_partition_slice(options), _group_by_size ? query::max_rows : limit, now, tracing::make_trace_info(state.get_trace_state()),
+        query::max_partitions, options.get_timestamp(state));
+    command->service_level = state.get_client_state().get_service_level();
 
     int32_t page_size = options.get_page_size();
 
     // An aggregation query will never be paged for the user, but we always page it internally to avoid OOM.
     // If we user provided a page_size we'll use that to page internally (because why not), otherwise we use our default
     // Note that if there are some nodes in the cluster with a version less than 2.0, we can't use paging (CASSANDRA-6707).
-    auto aggregate = _selection->is_aggregate();
+    // Groups are built like aggregates, so are not paged for the user either.
+    auto aggregate = _selection->is_aggregate() || _group_by_size;
     if (aggregate && page_size <= 0) {
         page_size = DEFAULT_COUNT_PAGE_SIZE;
     }
 
     auto key_ranges = _restrictions->get_partition_key_ranges(options);
 
+    if (_selection->is_aggregate() && !_group_by_size && can_push_down_aggregates(cl, key_ranges)) {
+        return execute_aggregates(proxy, command, std::move(key_ranges), state, options);
+    }
+
     if (!aggregate && (page_size <= 0
             || !service::pager::query_pagers::may_need_paging(page_size,
                     *command, key_ranges))) {
@@ -268,20 +368,29 @@ select_statement::do_execute(distributed<service::storage_proxy>& proxy,
     }
 
     command->slice.options.set<query::partition_slice::option::allow_short_read>();
+    command->max_result_size = options.get_page_size_in_bytes();
+    if (!command->max_result_size) {
+        command->max_result_size = uint64_t(proxy.local().get_db().local().get_config().page_size_in_kb()) * 1024;
+    }
     auto p = service::pager::query_pagers::pager(_schema, _selection,
             state, options, command, std::move(key_ranges));
 
     if (aggregate) {
         return do_with(
                 cql3::selection::result_set_builder(*_selection, now,
-                        options.get_cql_serialization_format()),
-                [p, page_size, now](auto& builder) {
-                    return do_until([p] {return p->is_exhausted();},
+                        options.get_cql_serialization_format(), _group_by_size),
+                [this, p, page_size, now, limit](auto& builder) {
+                    return do_until([this, p, &builder, limit] {
+                                return p->is_exhausted() || (_group_by_size && builder.built_rows() >= size_t(limit));
+                            },
                             [p, &builder, page_size, now] {
                                 return p->fetch_page(builder, page_size, now);
                             }
-                    ).then([&builder] {
+                    ).then([this, &builder, limit] {
                                 auto rs = builder.build();
+                                if (_group_by_size) {
+                                    rs->trim(limit);
+                                }
                                 auto msg = ::make_shared<cql_transport::messages::result_message::rows>(std::move(rs));
                                 return make_ready_future<shared_ptr<cql_transport::messages::result_message>>(std::move(msg));
                             });
@@ -338,12 +447,37 @@ select_statement::execute(distributed<service::storage_proxy>& proxy,
     }
 }
 
+// Aggregates over token ranges are folded by the replicas, unless
+// the query needs more than one replica to answer.
+bool select_statement::can_push_down_aggregates(db::consistency_level cl, const dht::partition_range_vector& partition_ranges) const {
+    return _aggregate_selectors
+        && !_limit
+        && (cl == db::consistency_level::ONE || cl == db::consistency_level::LOCAL_ONE)
+        && boost::algorithm::none_of(partition_ranges, [] (const dht::partition_range& r) { return r.is_singular(); })
+        && service::get_local_storage_service().cluster_supports_aggregate_query();
+}
+
+future<shared_ptr<cql_transport::messages::result_message>>
+select_statement::execute_aggregates(distributed<service::storage_proxy>& proxy,
+                                     lw_shared_ptr<query::read_command> cmd,
+                                     dht::partition_range_vector&& partition_ranges,
+                                     service::query_state& state,
+                                     const query_options& options)
+{
+    return proxy.local().query_aggregates(_schema, cmd, std::move(partition_ranges), *_aggregate_selectors,
+            options.get_consistency(), state.get_trace_state()).then([this] (std::vector<bytes_opt> row) -> shared_ptr<cql_transport::messages::result_message> {
+        auto rs = std::make_unique<result_set>(::make_shared<metadata>(*_selection->get_result_metadata()));
+        rs->add_row(std::move(row));
+        return ::make_shared<cql_transport::messages::result_message::rows>(std::move(rs));
+    });
+}
+
 future<::shared_ptr<cql_transport::messages::result_message>>
 select_statement::execute_internal(distributed<service::storage_proxy>& proxy,
                                    service::query_state& state,
                                    const query_options& options)
 {
-    if (options.get_specific_options().page_size > 0) {
+    if (options.get_specific_options().page_size > 0 || _group_by_size) {
         // need page, use regular execute
         return do_execute(proxy, state, options);
     }
@@ -351,6 +485,7 @@ select_statement::execute_internal(distributed<service::storage_proxy>& proxy,
     auto now = gc_clock::now();
     auto command = ::make_lw_shared<query::read_command>(_schema->id(), _schema->version(),
         make_partition_slice(options), limit, now, std::experimental::nullopt, query::max_partitions, options.get_timestamp(state));
+    command->service_level = state.get_client_state().get_service_level();
     auto partition_ranges = _restrictions->get_partition_key_ranges(options);
 
     tracing::add_table_name(state.get_trace_state(), keyspace(), column_family());
@@ -409,8 +544,12 @@ primary_key_select_statement::primary_key_select_statement(schema_ptr schema, ui
                                                            ::shared_ptr<restrictions::statement_restrictions> restrictions,
                                                            bool is_reversed,
                                                            ordering_comparator_type ordering_comparator,
-                                                           ::shared_ptr<term> limit, cql_stats &stats)
-    : select_statement{schema, bound_terms, parameters, selection, restrictions, is_reversed, ordering_comparator, limit, stats}
+                                                           ::shared_ptr<term> limit,
+                                                           ::shared_ptr<term> per_partition_limit,
+                                                           size_t group_by_size,
+                                                           cql_stats &stats)
+    : select_statement{schema, bound_terms, parameters, selection, restrictions, is_reversed, ordering_comparator, limit,
+        per_partition_limit, group_by_size, stats}
 {}
 
 ::shared_ptr<cql3::statements::select_statement>
@@ -422,7 +561,9 @@ indexed_table_select_statement::prepare(database& db,
                                         ::shared_ptr<restrictions::statement_restrictions> restrictions,
                                         bool is_reversed,
                                         ordering_comparator_type ordering_comparator,
-                                        ::shared_ptr<term> limit, cql_stats &stats)
+                                        ::shared_ptr<term> limit,
+                                        ::shared_ptr<term> per_partition_limit,
+                                        cql_stats &stats)
 {
     auto index_opt = find_idx(db, schema, restrictions);
     if (!index_opt) {
@@ -437,6 +578,7 @@ indexed_table_select_statement::prepare(database& db,
             is_reversed,
             std::move(ordering_comparator),
             limit,
+            per_partition_limit,
             stats,
             *index_opt);
 
@@ -466,9 +608,12 @@ indexed_table_select_statement::indexed_table_select_statement(schema_ptr schema
                                                            ::shared_ptr<restrictions::statement_restrictions> restrictions,
                                                            bool is_reversed,
                                                            ordering_comparator_type ordering_comparator,
-                                                           ::shared_ptr<term> limit, cql_stats &stats,
+                                                           ::shared_ptr<term> limit,
+                                                           ::shared_ptr<term> per_partition_limit,
+                                                           cql_stats &stats,
                                                            const secondary_index::index& index)
-    : select_statement{schema, bound_terms, parameters, selection, restrictions, is_reversed, ordering_comparator, limit, stats}
+    : select_statement{schema, bound_terms, parameters, selection, restrictions, is_reversed, ordering_comparator, limit,
+        per_partition_limit, 0, stats}
     , _index{index}
 {}
 
@@ -490,79 +635,206 @@ indexed_table_select_statement::do_execute(distributed<service::storage_proxy>&
 
     assert(_restrictions->uses_secondary_indexing());
 
-    return find_index_partition_ranges(proxy, state, options).then([&, this] (dht::partition_range_vector partition_ranges) {
-        auto command = ::make_lw_shared<query::read_command>(
-                _schema->id(),
-                _schema->version(),
-                make_partition_slice(options),
-                limit,
-                now,
-                tracing::make_trace_info(state.get_trace_state()),
-                query::max_partitions,
-                options.get_timestamp(state));
-        return this->execute(proxy, command, std::move(partition_ranges), state, options, now);
-    });
-}
-
-future<dht::partition_range_vector>
-indexed_table_select_statement::find_index_partition_ranges(distributed<service::storage_proxy>& proxy,
-                                             service::query_state& state,
-                                             const query_options& options)
-{
     const auto& im = _index.metadata();
     sstring index_table_name = sprint("%s_index", im.name());
     tracing::add_table_name(state.get_trace_state(), keyspace(), index_table_name);
-    auto& db = proxy.local().get_db().local();
-    const auto& view = db.find_column_family(_schema->ks_name(), index_table_name);
-    dht::partition_range_vector partition_ranges;
-    for (const auto& entry : _restrictions->get_non_pk_restriction()) {
-        auto pk = partition_key::from_optional_exploded(*view.schema(), entry.second->values(options));
-        auto dk = dht::global_partitioner().decorate_key(*view.schema(), pk);
-        auto range = dht::partition_range::make_singular(dk);
-        partition_ranges.emplace_back(range);
-    }
+    auto view_schema = proxy.local().get_db().local().find_schema(_schema->ks_name(), index_table_name);
 
-    auto now = gc_clock::now();
-    int32_t limit = get_limit(options);
+    // The index is read a page at a time, even when the query isn't paged,
+    // so that the base rows are read in batches of the keys of a page.
+    int32_t page_size = options.get_page_size();
+    auto whole_result = page_size <= 0 || _selection->is_aggregate();
+    if (page_size <= 0) {
+        page_size = DEFAULT_COUNT_PAGE_SIZE;
+    }
 
-    partition_slice_builder partition_slice_builder{*view.schema()};
+    // The index has the primary key of the base rows of the value. When a
+    // global index is on a clustering column, that column is its partition
+    // key, so the base rows are looked up by their partition only.
+    std::vector<const column_definition*> columns;
+    for (const column_definition& cdef : _schema->partition_key_columns()) {
+        columns.emplace_back(view_schema->get_column_definition(cdef.name()));
+    }
+    auto with_rows = _schema->clustering_key_size() > 0
+        && boost::algorithm::all_of(_schema->clustering_key_columns(), [&view_schema] (const column_definition& cdef) {
+            return view_schema->get_column_definition(cdef.name());
+        });
+    if (with_rows) {
+        for (const column_definition& cdef : _schema->clustering_key_columns()) {
+            columns.emplace_back(view_schema->get_column_definition(cdef.name()));
+        }
+    }
+    auto selection = selection::selection::for_columns(view_schema, std::move(columns));
+
+    partition_slice_builder partition_slice_builder{*view_schema};
+    dht::partition_range_vector view_ranges;
+    auto value = get_index_value(options);
+    if (_index.is_local()) {
+        // The entries of the value are the rows starting with it, in the
+        // index partition of each base partition the query reads.
+        if (value) {
+            view_ranges = _restrictions->get_partition_key_ranges(options);
+            partition_slice_builder.with_range(query::clustering_range::make_singular(
+                    clustering_key_prefix::from_optional_exploded(*view_schema, *value)));
+        }
+    } else if (value) {
+        auto dk = dht::global_partitioner().decorate_key(*view_schema, partition_key::from_optional_exploded(*view_schema, *value));
+        view_ranges.emplace_back(dht::partition_range::make_singular(std::move(dk)));
+    }
     auto cmd = ::make_lw_shared<query::read_command>(
-            view.schema()->id(),
-            view.schema()->version(),
+            view_schema->id(),
+            view_schema->version(),
             partition_slice_builder.build(),
             limit,
             now,
             tracing::make_trace_info(state.get_trace_state()),
             query::max_partitions,
             options.get_timestamp(state));
-    return proxy.local().query(view.schema(),
-                               cmd,
-                               std::move(partition_ranges),
-                               options.get_consistency(),
-                               state.get_trace_state()).then([cmd, this, &options, now, &view] (foreign_ptr<lw_shared_ptr<query::result>> result) {
-        std::vector<const column_definition*> columns;
-        for (const column_definition& cdef : _schema->partition_key_columns()) {
-            columns.emplace_back(view.schema()->get_column_definition(cdef.name()));
+    cmd->service_level = state.get_client_state().get_service_level();
+    cmd->slice.options.set<query::partition_slice::option::allow_short_read>();
+    auto p = service::pager::query_pagers::pager(view_schema, selection, state, options, cmd, std::move(view_ranges));
+
+    return do_with(cql3::selection::result_set_builder(*_selection, now, options.get_cql_serialization_format()),
+            [this, &proxy, &state, &options, p, page_size, now, whole_result, with_rows] (auto& builder) {
+        auto fetch_page = [this, &proxy, &state, &options, &builder, p, page_size, now, with_rows] {
+            return p->fetch_page(page_size, now).then([this, &proxy, &state, &options, &builder, now, with_rows] (std::unique_ptr<cql3::result_set> keys) {
+                return this->read_base_rows(proxy, state, options, *keys, with_rows, builder, now);
+            });
+        };
+        auto f = whole_result ? do_until([p] { return p->is_exhausted(); }, fetch_page) : fetch_page();
+        return f.then([&builder, p, whole_result] {
+            auto rs = builder.build();
+            if (!whole_result && !p->is_exhausted()) {
+                rs->get_metadata().set_has_more_pages(p->state());
+            }
+            auto msg = ::make_shared<cql_transport::messages::result_message::rows>(std::move(rs));
+            return make_ready_future<shared_ptr<cql_transport::messages::result_message>>(std::move(msg));
+        });
+    });
+}
+
+stdx::optional<std::vector<bytes_opt>>
+indexed_table_select_statement::get_index_value(const query_options& options) const
+{
+    for (const auto& entry : _restrictions->get_non_pk_restriction()) {
+        if (_index.depends_on(*entry.first)) {
+            return entry.second->values(options);
         }
-        auto selection = selection::selection::for_columns(view.schema(), columns);
-        cql3::selection::result_set_builder builder(*selection, now, options.get_cql_serialization_format());
-        query::result_view::consume(*result,
-                                    cmd->slice,
-                                    cql3::selection::result_set_builder::visitor(builder, *view.schema(), *selection));
-        auto rs = cql3::untyped_result_set(::make_shared<cql_transport::messages::result_message::rows>(std::move(builder.build())));
-        dht::partition_range_vector partition_ranges;
-        for (size_t i = 0; i < rs.size(); i++) {
-            const auto& row = rs.at(i);
-            for (const auto& column : row.get_columns()) {
-                auto blob = row.get_blob(column->name->to_cql_string());
-                auto pk = partition_key::from_exploded(*_schema, { blob });
-                auto dk = dht::global_partitioner().decorate_key(*_schema, pk);
-                auto range = dht::partition_range::make_singular(dk);
-                partition_ranges.emplace_back(range);
+    }
+    return stdx::nullopt;
+}
+
+future<>
+indexed_table_select_statement::read_base_rows(distributed<service::storage_proxy>& proxy,
+                                               service::query_state& state,
+                                               const query_options& options,
+                                               const cql3::result_set& keys,
+                                               bool with_rows,
+                                               cql3::selection::result_set_builder& builder,
+                                               gc_clock::time_point now)
+{
+    // The index lists the rows of a partition together, so they are read
+    // from the base with a single command.
+    struct base_partition {
+        partition_key key;
+        query::clustering_row_ranges ranges;
+    };
+    std::vector<base_partition> partitions;
+    auto pk_size = _schema->partition_key_size();
+    auto exploded = [] (auto begin, auto end) {
+        return boost::copy_range<std::vector<bytes>>(boost::make_iterator_range(begin, end)
+            | boost::adaptors::transformed([] (const bytes_opt& v) { return *v; }));
+    };
+    auto bounds = _restrictions->get_clustering_bounds(options);
+    partition_key::equality pk_eq(*_schema);
+    clustering_key_prefix::prefix_equal_tri_compare ck_cmp(*_schema);
+    for (auto&& row : keys.rows()) {
+        auto pk = partition_key::from_exploded(*_schema, exploded(row.begin(), row.begin() + pk_size));
+        if (partitions.empty() || !pk_eq(partitions.back().key, pk)) {
+            partitions.push_back(base_partition{std::move(pk), { }});
+        }
+        if (with_rows) {
+            auto ck = clustering_key_prefix::from_exploded(*_schema, exploded(row.begin() + pk_size, row.end()));
+            // The clustering restrictions of the query still apply to the rows of the index.
+            if (boost::algorithm::any_of(bounds, [&] (const query::clustering_range& r) { return r.contains(ck, ck_cmp); })) {
+                partitions.back().ranges.push_back(query::clustering_range::make_singular(std::move(ck)));
             }
         }
-        return make_ready_future<dht::partition_range_vector>(partition_ranges);
-    }).finally([cmd] {});
+    }
+    if (with_rows) {
+        clustering_key_prefix::less_compare ck_less(*_schema);
+        for (auto&& bp : partitions) {
+            // The index sorts the rows by the natural order of their
+            // clustering columns, which may be reversed in the base.
+            std::sort(bp.ranges.begin(), bp.ranges.end(), [&ck_less] (const query::clustering_range& a, const query::clustering_range& b) {
+                return ck_less(a.start()->value(), b.start()->value());
+            });
+        }
+        partitions.erase(std::remove_if(partitions.begin(), partitions.end(), [] (const base_partition& bp) {
+            return bp.ranges.empty();
+        }), partitions.end());
+    }
+
+    auto cmd = ::make_lw_shared<query::read_command>(
+            _schema->id(),
+            _schema->version(),
+            make_partition_slice(options),
+            query::max_rows,
+            now,
+            tracing::make_trace_info(state.get_trace_state()),
+            query::max_partitions,
+            options.get_timestamp(state));
+    cmd->service_level = state.get_client_state().get_service_level();
+
+    // The partitions of a batch are read in parallel: all together in a
+    // single query when whole partitions are read, as the storage proxy
+    // reads the partitions of a query in parallel, else each with its rows.
+    // The results are consumed in the order of the index.
+    return do_with(std::move(partitions), size_t(0), [this, &proxy, &state, &options, &builder, with_rows, cmd] (auto& partitions, size_t& next) {
+        return repeat([this, &proxy, &state, &options, &builder, with_rows, cmd, &partitions, &next] {
+            if (next == partitions.size()) {
+                return make_ready_future<stop_iteration>(stop_iteration::yes);
+            }
+            auto begin = partitions.begin() + next;
+            auto end = partitions.begin() + std::min(partitions.size(), next + base_read_batch_size);
+            next = end - partitions.begin();
+            using results_type = std::vector<foreign_ptr<lw_shared_ptr<query::result>>>;
+            auto cl = options.get_consistency();
+            future<results_type> f = make_ready_future<results_type>();
+            if (with_rows) {
+                auto results = make_lw_shared<results_type>(end - begin);
+                f = parallel_for_each(boost::irange<size_t>(0, end - begin), [this, &proxy, &state, cl, cmd, begin, results] (size_t i) {
+                    auto& bp = *(begin + i);
+                    auto command = ::make_lw_shared<query::read_command>(*cmd);
+                    command->slice.set_range(*_schema, bp.key, bp.ranges);
+                    auto dk = dht::global_partitioner().decorate_key(*_schema, bp.key);
+                    dht::partition_range_vector ranges{ dht::partition_range::make_singular(std::move(dk)) };
+                    return proxy.local().query(_schema, command, std::move(ranges), cl, state.get_trace_state()).then([results, i, command] (auto r) {
+                        (*results)[i] = std::move(r);
+                    });
+                }).then([results] {
+                    return std::move(*results);
+                });
+            } else {
+                auto ranges = boost::copy_range<dht::partition_range_vector>(boost::make_iterator_range(begin, end)
+                    | boost::adaptors::transformed([this] (const base_partition& bp) {
+                        return dht::partition_range::make_singular(dht::global_partitioner().decorate_key(*_schema, bp.key));
+                    }));
+                f = proxy.local().query(_schema, cmd, std::move(ranges), cl, state.get_trace_state()).then([] (auto r) {
+                    results_type results;
+                    results.emplace_back(std::move(r));
+                    return results;
+                });
+            }
+            return f.then([this, &builder, cmd] (results_type results) {
+                for (auto&& r : results) {
+                    query::result_view::consume(*r, cmd->slice,
+                        cql3::selection::result_set_builder::visitor(builder, *_schema, *_selection));
+                }
+                return stop_iteration::no;
+            });
+        });
+    });
 }
 
 namespace raw {
@@ -571,12 +843,16 @@ select_statement::select_statement(::shared_ptr<cf_name> cf_name,
                                    ::shared_ptr<parameters> parameters,
                                    std::vector<::shared_ptr<selection::raw_selector>> select_clause,
                                    std::vector<::shared_ptr<relation>> where_clause,
-                                   ::shared_ptr<term::raw> limit)
+                                   ::shared_ptr<term::raw> limit,
+                                   ::shared_ptr<term::raw> per_partition_limit,
+                                   std::vector<::shared_ptr<cql3::column_identifier::raw>> group_by_columns)
     : cf_statement(std::move(cf_name))
     , _parameters(std::move(parameters))
     , _select_clause(std::move(select_clause))
     , _where_clause(std::move(where_clause))
     , _limit(std::move(limit))
+    , _per_partition_limit(std::move(per_partition_limit))
+    , _group_by_columns(std::move(group_by_columns))
 { }
 
 std::unique_ptr<prepared_statement> select_statement::prepare(database& db, cql_stats& stats, bool for_view) {
@@ -585,12 +861,20 @@ std::unique_ptr<prepared_statement> select_statement::prepare(database& db, cql_
 
     auto selection = _select_clause.empty()
                      ? selection::selection::wildcard(schema)
-                     : selection::selection::from_selectors(db, schema, _select_clause);
+                     : selection::selection::from_selectors(db, schema, _select_clause, !_group_by_columns.empty());
 
     auto restrictions = prepare_restrictions(db, schema, bound_names, selection, for_view);
 
     if (_parameters->is_distinct()) {
         validate_distinct_selection(schema, selection, restrictions);
+        if (_per_partition_limit) {
+            throw exceptions::invalid_request_exception("PER PARTITION LIMIT is not allowed with SELECT DISTINCT queries");
+        }
+    }
+
+    auto group_by_size = prepare_group_by(schema);
+    if (group_by_size && restrictions->uses_secondary_indexing()) {
+        throw exceptions::invalid_request_exception("GROUP BY is not supported with secondary indexes");
     }
 
     select_statement::ordering_comparator_type ordering_comparator;
@@ -616,9 +900,13 @@ std::unique_ptr<prepared_statement> select_statement::prepare(database& db, cql_
                 std::move(restrictions),
                 is_reversed_,
                 std::move(ordering_comparator),
-                prepare_limit(db, bound_names),
+                prepare_limit(db, bound_names, _limit, limit_receiver()),
+                prepare_limit(db, bound_names, _per_partition_limit, limit_receiver(true)),
                 stats);
     } else {
+        auto aggregate_selectors = !_parameters->is_distinct() && _parameters->orderings().empty() && !group_by_size
+                ? selection::to_aggregate_selectors(schema, *selection, _select_clause)
+                : std::experimental::nullopt;
         stmt = ::make_shared<cql3::statements::primary_key_select_statement>(
                 schema,
                 bound_names->size(),
@@ -627,8 +915,13 @@ std::unique_ptr<prepared_statement> select_statement::prepare(database& db, cql_
                 std::move(restrictions),
                 is_reversed_,
                 std::move(ordering_comparator),
-                prepare_limit(db, bound_names),
+                prepare_limit(db, bound_names, _limit, limit_receiver()),
+                prepare_limit(db, bound_names, _per_partition_limit, limit_receiver(true)),
+                group_by_size,
                 stats);
+        if (aggregate_selectors) {
+            stmt->set_aggregate_selectors(std::move(*aggregate_selectors));
+        }
     }
 
     auto partition_key_bind_indices = bound_names->get_partition_key_bind_indexes(schema);
@@ -656,17 +949,51 @@ select_statement::prepare_restrictions(database& db,
 
 /** Returns a ::shared_ptr<term> for the limit or null if no limit is set */
 ::shared_ptr<term>
-select_statement::prepare_limit(database& db, ::shared_ptr<variable_specifications> bound_names)
+select_statement::prepare_limit(database& db, ::shared_ptr<variable_specifications> bound_names, ::shared_ptr<term::raw> limit,
+                                ::shared_ptr<column_specification> receiver)
 {
-    if (!_limit) {
+    if (!limit) {
         return {};
     }
 
-    auto prep_limit = _limit->prepare(db, keyspace(), limit_receiver());
+    auto prep_limit = limit->prepare(db, keyspace(), receiver);
     prep_limit->collect_marker_specification(bound_names);
     return prep_limit;
 }
 
+size_t select_statement::prepare_group_by(schema_ptr schema)
+{
+    if (_group_by_columns.empty()) {
+        return 0;
+    }
+    if (_parameters->is_distinct()) {
+        throw exceptions::invalid_request_exception("Grouping on DISTINCT queries is not supported");
+    }
+
+    size_t i = 0;
+    for (auto&& raw : _group_by_columns) {
+        ::shared_ptr<column_identifier> column = raw->prepare_column_identifier(schema);
+        auto def = schema->get_column_definition(column->name());
+        if (!def) {
+            throw exceptions::invalid_request_exception(sprint("Undefined column name %s", *column));
+        }
+        if (!def->is_primary_key()) {
+            throw exceptions::invalid_request_exception(sprint(
+                "Group by is currently only supported on the columns of the PRIMARY KEY, got %s", *column));
+        }
+        auto position = def->is_partition_key() ? def->component_index() : schema->partition_key_size() + def->component_index();
+        if (position != i) {
+            throw exceptions::invalid_request_exception(
+                "Group by currently only support groups of columns following their declared order in the PRIMARY KEY");
+        }
+        ++i;
+    }
+    if (i < schema->partition_key_size()) {
+        throw exceptions::invalid_request_exception("Group by must include all the columns of the partition key");
+    }
+    return i;
+}
+
 void select_statement::verify_ordering_is_allowed(::shared_ptr<restrictions::statement_restrictions> restrictions)
 {
     if (restrictions->uses_secondary_indexing()) {
@@ -820,6 +1147,13 @@ void select_statement::check_needs_filtering(::shared_ptr<restrictions::statemen
                     "this query despite the performance unpredictability, use ALLOW FILTERING");
         }
     }
+    // Restrictions on columns without an index are checked against every row read.
+    if (!_parameters->allow_filtering() && restrictions->filters_on_replicas()) {
+        throw exceptions::invalid_request_exception(
+            "Cannot execute this query as it might involve data filtering and "
+                "thus may have unpredictable performance. If you want to execute "
+                "this query despite the performance unpredictability, use ALLOW FILTERING");
+    }
 }
 
 bool select_statement::contains_alias(::shared_ptr<column_identifier> name) {
@@ -828,8 +1162,9 @@ bool select_statement::contains_alias(::shared_ptr<column_identifier> name) {
     });
 }
 
-::shared_ptr<column_specification> select_statement::limit_receiver() {
-    return ::make_shared<column_specification>(keyspace(), column_family(), ::make_shared<column_identifier>("[limit]", true),
+::shared_ptr<column_specification> select_statement::limit_receiver(bool per_partition) {
+    sstring name = per_partition ? "[per_partition_limit]" : "[limit]";
+    return ::make_shared<column_specification>(keyspace(), column_family(), ::make_shared<column_identifier>(name, true),
         int32_type);
 }
 
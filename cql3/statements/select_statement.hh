@@ -77,6 +77,9 @@ class select_statement : public cql_statement {
     ::shared_ptr<restrictions::statement_restrictions> _restrictions;
     bool _is_reversed;
     ::shared_ptr<term> _limit;
+    ::shared_ptr<term> _per_partition_limit;
+    // Number of leading primary key columns the rows are grouped by, 0 when not grouping.
+    size_t _group_by_size;
 
     template<typename T>
     using compare_fn = raw::select_statement::compare_fn<T>;
@@ -89,7 +92,12 @@ class select_statement : public cql_statement {
     ordering_comparator_type _ordering_comparator;
 
     query::partition_slice::option_set _opts;
+    // The slice of the statements whose slice doesn't depend on the bound
+    // values, built on the first execution and copied by the next ones.
+    std::experimental::optional<query::partition_slice> _slice_template;
     cql_stats& _stats;
+    // Set when the aggregates of the selection can be computed by the replicas.
+    std::experimental::optional<std::vector<query::aggregate_selector>> _aggregate_selectors;
 protected :
     virtual future<::shared_ptr<cql_transport::messages::result_message>> do_execute(distributed<service::storage_proxy>& proxy,
         service::query_state& state, const query_options& options);
@@ -103,6 +111,8 @@ protected :
             bool is_reversed,
             ordering_comparator_type ordering_comparator,
             ::shared_ptr<term> limit,
+            ::shared_ptr<term> per_partition_limit,
+            size_t group_by_size,
             cql_stats& stats);
 
     virtual bool uses_function(const sstring& ks_name, const sstring& function_name) const override;
@@ -135,9 +145,19 @@ protected :
 
     ::shared_ptr<restrictions::statement_restrictions> get_restrictions() const;
 
+    void set_aggregate_selectors(std::vector<query::aggregate_selector> selectors) {
+        _aggregate_selectors = std::move(selectors);
+    }
+
 protected:
+    query::partition_slice do_make_partition_slice(const query_options& options);
     int32_t get_limit(const query_options& options) const;
+    uint32_t get_per_partition_limit(const query_options& options) const;
     bool needs_post_query_ordering() const;
+    bool can_push_down_aggregates(db::consistency_level cl, const dht::partition_range_vector& partition_ranges) const;
+    future<::shared_ptr<cql_transport::messages::result_message>> execute_aggregates(distributed<service::storage_proxy>& proxy,
+        lw_shared_ptr<query::read_command> cmd, dht::partition_range_vector&& partition_ranges, service::query_state& state,
+        const query_options& options);
 };
 
 class primary_key_select_statement : public select_statement {
@@ -150,10 +170,14 @@ class primary_key_select_statement : public select_statement {
                      bool is_reversed,
                      ordering_comparator_type ordering_comparator,
                      ::shared_ptr<term> limit,
+                     ::shared_ptr<term> per_partition_limit,
+                     size_t group_by_size,
                      cql_stats &stats);
 };
 
 class indexed_table_select_statement : public select_statement {
+    // The number of base partitions read in parallel.
+    static constexpr size_t base_read_batch_size = 100;
     secondary_index::index _index;
 public:
     static ::shared_ptr<cql3::statements::select_statement> prepare(database& db,
@@ -165,6 +189,7 @@ class indexed_table_select_statement : public select_statement {
                                                                     bool is_reversed,
                                                                     ordering_comparator_type ordering_comparator,
                                                                     ::shared_ptr<term> limit,
+                                                                    ::shared_ptr<term> per_partition_limit,
                                                                     cql_stats &stats);
 
     indexed_table_select_statement(schema_ptr schema,
@@ -175,6 +200,7 @@ class indexed_table_select_statement : public select_statement {
                                    bool is_reversed,
                                    ordering_comparator_type ordering_comparator,
                                    ::shared_ptr<term> limit,
+                                   ::shared_ptr<term> per_partition_limit,
                                    cql_stats &stats,
                                    const secondary_index::index& index);
 
@@ -186,9 +212,17 @@ class indexed_table_select_statement : public select_statement {
     virtual future<::shared_ptr<cql_transport::messages::result_message>> do_execute(distributed<service::storage_proxy>& proxy,
                                                                                      service::query_state& state, const query_options& options) override;
 
-    future<dht::partition_range_vector> find_index_partition_ranges(distributed<service::storage_proxy>& proxy,
-                                                                    service::query_state& state,
-                                                                    const query_options& options);
+    // The value of the indexed column the query restricts.
+    stdx::optional<std::vector<bytes_opt>> get_index_value(const query_options& options) const;
+
+    // Reads the base rows of a page of keys read from the index into builder.
+    future<> read_base_rows(distributed<service::storage_proxy>& proxy,
+                            service::query_state& state,
+                            const query_options& options,
+                            const cql3::result_set& keys,
+                            bool with_rows,
+                            cql3::selection::result_set_builder& builder,
+                            gc_clock::time_point now);
 };
 
 }
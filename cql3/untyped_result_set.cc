@@ -47,38 +47,41 @@
 #include "result_set.hh"
 #include "transport/messages/result_message.hh"
 
-cql3::untyped_result_set_row::untyped_result_set_row(const std::unordered_map<sstring, bytes_opt>& data)
-    : _data(data)
-{}
+cql3::untyped_result_set_row::columns::columns(const std::vector<::shared_ptr<column_specification>>& cs)
+    : specs(cs)
+{
+    for (size_t i = 0; i < specs.size(); ++i) {
+        positions.emplace(specs[i]->name->to_string(), i);
+    }
+}
 
-cql3::untyped_result_set_row::untyped_result_set_row(const std::vector<::shared_ptr<column_specification>>& columns, std::vector<bytes_opt> data)
-: _columns(columns)
-, _data([&columns, data = std::move(data)] () mutable {
-    std::unordered_map<sstring, bytes_opt> tmp;
-    std::transform(columns.begin(), columns.end(), data.begin(), std::inserter(tmp, tmp.end()), [](::shared_ptr<column_specification> c, bytes_opt& d) {
-       return std::make_pair<sstring, bytes_opt>(c->name->to_string(), std::move(d));
-    });
-    return tmp;
-}())
+cql3::untyped_result_set_row::untyped_result_set_row(lw_shared_ptr<const columns> cs, const std::vector<bytes_opt>& data)
+    : _columns(std::move(cs))
+    , _data(&data)
 {}
 
 bool cql3::untyped_result_set_row::has(const sstring& name) const {
-    auto i = _data.find(name);
-    return i != _data.end() && i->second;
+    auto i = _columns->positions.find(name);
+    return i != _columns->positions.end() && (*_data)[i->second];
 }
 
 using cql_transport::messages::result_message;
 
+// The rows point into the result set of msg, rather than having their values
+// copied, as internal queries may read many.
 cql3::untyped_result_set::untyped_result_set(::shared_ptr<result_message> msg)
-    : _rows([msg]{
+    : _msg(msg)
+    , _rows([msg]{
     class visitor : public result_message::visitor_base {
     public:
         rows_type rows;
         void visit(const result_message::rows& rmrs) override {
             auto& rs = rmrs.rs();
-            auto& cn = rs.get_metadata().get_names();
-            for (auto& r : rs.rows()) {
-                rows.emplace_back(cn, r);
+            auto& rs_rows = rs.rows();
+            auto cs = make_lw_shared<row::columns>(rs.get_metadata().get_names());
+            rows.reserve(rs_rows.size());
+            for (auto& r : rs_rows) {
+                rows.emplace_back(cs, r);
             }
         }
     };
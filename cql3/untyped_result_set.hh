@@ -50,22 +50,39 @@
 namespace cql3 {
 
 class untyped_result_set_row {
+public:
+    // The columns of the rows of a result set, shared by them.
+    struct columns {
+        std::vector<::shared_ptr<column_specification>> specs;
+        std::unordered_map<sstring, size_t> positions;
+
+        explicit columns(const std::vector<::shared_ptr<column_specification>>&);
+    };
+private:
+    lw_shared_ptr<const columns> _columns;
+    // Points into the result set the row comes from, which the
+    // untyped_result_set keeps.
+    const std::vector<bytes_opt>* _data;
 private:
-    const std::vector<::shared_ptr<column_specification>> _columns;
-    const std::unordered_map<sstring, bytes_opt> _data;
+    const bytes_opt& value(const sstring& name) const {
+        return _data->at(_columns->positions.at(name));
+    }
 public:
-    untyped_result_set_row(const std::unordered_map<sstring, bytes_opt>&);
-    untyped_result_set_row(const std::vector<::shared_ptr<column_specification>>&, std::vector<bytes_opt>);
+    untyped_result_set_row(lw_shared_ptr<const columns>, const std::vector<bytes_opt>&);
     untyped_result_set_row(untyped_result_set_row&&) = default;
     untyped_result_set_row(const untyped_result_set_row&) = delete;
 
     bool has(const sstring&) const;
+    // Valid as long as the result set is.
+    bytes_view get_view(const sstring& name) const {
+        return *value(name);
+    }
     bytes get_blob(const sstring& name) const {
-        return *_data.at(name);
+        return *value(name);
     }
     template<typename T>
     T get_as(const sstring& name) const {
-        return value_cast<T>(data_type_for<T>()->deserialize(get_blob(name)));
+        return value_cast<T>(data_type_for<T>()->deserialize(get_view(name)));
     }
     template<typename T>
     std::experimental::optional<T> get_opt(const sstring& name) const {
@@ -84,7 +101,7 @@ class untyped_result_set_row {
         auto vec =
                 value_cast<map_type_impl::native_type>(
                         map_type_impl::get_instance(keytype, valtype, false)->deserialize(
-                                get_blob(name)));
+                                get_view(name)));
         std::transform(vec.begin(), vec.end(), out,
                 [](auto& p) {
                     return std::pair<K, V>(value_cast<K>(p.first), value_cast<V>(p.second));
@@ -103,7 +120,7 @@ class untyped_result_set_row {
         auto vec =
                 value_cast<list_type_impl::native_type>(
                         list_type_impl::get_instance(valtype, false)->deserialize(
-                                get_blob(name)));
+                                get_view(name)));
         std::transform(vec.begin(), vec.end(), out, [](auto& v) { return value_cast<V>(v); });
     }
     template<typename V, typename ... Rest>
@@ -119,7 +136,7 @@ class untyped_result_set_row {
                         value_cast<set_type_impl::native_type>(
                                         set_type_impl::get_instance(valtype,
                                                         false)->deserialize(
-                                                        get_blob(name)));
+                                                        get_view(name)));
         std::transform(vec.begin(), vec.end(), out, [](auto& p) {
             return value_cast<V>(p);
         });
@@ -133,7 +150,7 @@ class untyped_result_set_row {
         return res;
     }
     const std::vector<::shared_ptr<column_specification>>& get_columns() const {
-        return _columns;
+        return _columns->specs;
     }
 };
 
@@ -169,6 +186,8 @@ class untyped_result_set {
         return _rows.back();
     }
 private:
+    // Holds the values the rows point to.
+    ::shared_ptr<cql_transport::messages::result_message> _msg;
     rows_type _rows;
     untyped_result_set() = default;
 public:
@@ -40,6 +40,7 @@
 #include <boost/algorithm/string/classification.hpp>
 #include <boost/algorithm/string/split.hpp>
 #include "sstables/sstables.hh"
+#include "sstables/index_reader.hh"
 #include "sstables/compaction.hh"
 #include "sstables/remove.hh"
 #include <boost/range/adaptor/transformed.hpp>
@@ -78,6 +79,7 @@
 
 #include "checked-file-impl.hh"
 #include "disk-error-handler.hh"
+#include "json.hh"
 
 using namespace std::chrono_literals;
 
@@ -147,6 +149,20 @@ column_family::make_streaming_memtable_big_list(streaming_memtable_big& smb) {
     return make_lw_shared<memtable_list>(std::move(seal), std::move(get_schema), _config.streaming_dirty_memory_manager);
 }
 
+static std::vector<dht::partition_range> make_compaction_group_ranges(unsigned groups) {
+    auto& partitioner = dht::global_partitioner();
+    std::vector<dht::partition_range> ranges;
+    ranges.reserve(groups);
+    for (unsigned group = 0; group < groups; ++group) {
+        auto start = group == 0 ? stdx::optional<dht::partition_range::bound>()
+                : dht::partition_range::bound(dht::ring_position::starting_at(partitioner.ring_range_start(group, groups)), true);
+        auto end = group + 1 == groups ? stdx::optional<dht::partition_range::bound>()
+                : dht::partition_range::bound(dht::ring_position::starting_at(partitioner.ring_range_start(group + 1, groups)), false);
+        ranges.emplace_back(std::move(start), std::move(end));
+    }
+    return ranges;
+}
+
 column_family::column_family(schema_ptr schema, config config, db::commitlog* cl, compaction_manager& compaction_manager, cell_locker_stats& cl_stats)
     : _schema(std::move(schema))
     , _config(std::move(config))
@@ -154,15 +170,21 @@ column_family::column_family(schema_ptr schema, config config, db::commitlog* cl
     , _streaming_memtables(_config.enable_disk_writes ? make_streaming_memtable_list() : make_memory_only_memtable_list())
     , _compaction_strategy(make_compaction_strategy(_schema->compaction_strategy(), _schema->compaction_strategy_options()))
     , _sstables(make_lw_shared(_compaction_strategy.make_sstable_set(_schema)))
-    , _cache(_schema, sstables_as_snapshot_source(), global_cache_tracker(), is_continuous::yes)
+    , _cache(_schema, sstables_as_snapshot_source(),
+            _schema->caching_options().in_memory() ? in_memory_cache_tracker() : global_cache_tracker(), is_continuous::yes)
     , _commitlog(cl)
     , _compaction_manager(compaction_manager)
     , _index_manager(*this)
     , _counter_cell_locks(std::make_unique<cell_locker>(_schema, cl_stats))
+    , _top_partitions(_schema, _config.top_partitions)
+    , _cost(utils::cost_accountant::local().table(_schema->id()))
 {
     if (!_config.enable_disk_writes) {
         dblog.warn("Writes disabled, column family no durable.");
     }
+    _range_cache_hit_rates.fill(cache_temperature::invalid());
+    _compaction_group_ranges = make_compaction_group_ranges(_config.compaction_groups);
+    _config.read_concurrency_config.admission_sem = &_read_admission_sem;
     set_metrics();
 }
 
@@ -217,6 +239,7 @@ column_family::sstables_as_snapshot_source() {
 
 // define in .cc, since sstable is forward-declared in .hh
 column_family::~column_family() {
+    utils::cost_accountant::local().forget_table(_schema->id());
 }
 
 
@@ -325,7 +348,7 @@ static std::vector<sstables::shared_sstable>
 filter_sstable_for_reader(std::vector<sstables::shared_sstable>&& sstables, column_family& cf, const schema_ptr& schema,
         const sstables::key& key, const query::partition_slice& slice) {
     auto sstable_has_not_key = [&] (const sstables::shared_sstable& sst) {
-        return !sst->filter_has_key(key);
+        return !sst->filter_has_key_for_read(key);
     };
     sstables.erase(boost::remove_if(sstables, sstable_has_not_key), sstables.end());
 
@@ -363,7 +386,8 @@ filter_sstable_for_reader(std::vector<sstables::shared_sstable>&& sstables, colu
     auto sstable_has_relevant_tombstone = [&min_timestamp] (const sstables::shared_sstable& sst) {
         const auto& stats = sst->get_stats_metadata();
         // re-add sstable as candidate if it contains a tombstone that may cover a row in an included sstable.
-        return (stats.max_timestamp > min_timestamp && stats.estimated_tombstone_drop_time.bin.size());
+        // A tombstone covers data with the same timestamp.
+        return (stats.max_timestamp >= min_timestamp && stats.estimated_tombstone_drop_time.bin.size());
     };
     auto skipped = std::partition(sstables.begin(), sstables.end(), sstable_has_clustering_key);
     auto actually_skipped = std::partition(skipped, sstables.end(), sstable_has_relevant_tombstone);
@@ -475,6 +499,9 @@ class incremental_reader_selector : public reader_selector {
     }
 };
 
+// Reads a single partition from the sstables which may have it, newest
+// first, and stops at the sstables whose data is shadowed by what was read
+// from the newer ones.
 class single_key_sstable_reader final : public mutation_reader::impl {
     column_family* _cf;
     schema_ptr _schema;
@@ -491,6 +518,100 @@ class single_key_sstable_reader final : public mutation_reader::impl {
     reader_resource_tracker _resource_tracker;
     tracing::trace_state_ptr _trace_state;
     streamed_mutation::forwarding _fwd;
+    // Set when the slice selects whole rows by their full keys, of columns
+    // which are atomic cells, so that it's cheap to read them into _merged
+    // and to tell whether their cells are newer than older sstables.
+    bool _can_shadow_rows;
+    mutation_opt _merged;
+    tombstone _partition_tombstone;
+    unsigned _sstables_with_partition = 0;
+private:
+    bool can_shadow_rows() const {
+        if (_fwd == streamed_mutation::forwarding::yes || _schema->is_counter()
+                || _slice.options.contains(query::partition_slice::option::reversed)) {
+            return false;
+        }
+        auto atomic = [this] (column_kind kind, const query::column_id_vector& ids) {
+            return boost::algorithm::all_of(ids, [this, kind] (column_id id) {
+                return _schema->column_at(kind, id).is_atomic();
+            });
+        };
+        if (!atomic(column_kind::static_column, _slice.static_columns) || !atomic(column_kind::regular_column, _slice.regular_columns)) {
+            return false;
+        }
+        auto& ranges = _slice.row_ranges(*_schema, *_pr.start()->value().key());
+        return boost::algorithm::all_of(ranges, [this] (const query::clustering_range& r) {
+            return r.is_singular() && r.start()->value().is_full(*_schema);
+        });
+    }
+
+    // Whether what was read shadows all the data written at or before
+    // max_timestamp.
+    bool shadows(api::timestamp_type max_timestamp) const {
+        // A tombstone covers data with the same timestamp.
+        if (_partition_tombstone.timestamp >= max_timestamp) {
+            return true;
+        }
+        if (!_merged) {
+            return false;
+        }
+        auto& p = _merged->partition();
+        auto newer = [max_timestamp] (const row& cells, const query::column_id_vector& ids) {
+            return boost::algorithm::all_of(ids, [&cells, max_timestamp] (column_id id) {
+                auto c = cells.find_cell(id);
+                return c && c->as_atomic_cell().timestamp() > max_timestamp;
+            });
+        };
+        if (!newer(p.static_row(), _slice.static_columns)) {
+            return false;
+        }
+        auto& ranges = _slice.row_ranges(*_schema, _merged->key());
+        return boost::algorithm::all_of(ranges, [&] (const query::clustering_range& r) {
+            auto i = p.clustered_rows().find(r.start()->value(), rows_entry::compare(*_schema));
+            if (i == p.clustered_rows().end()) {
+                return false;
+            }
+            auto& row = i->row();
+            if (row.deleted_at().regular().timestamp >= max_timestamp) {
+                return true;
+            }
+            return row.marker().timestamp() > max_timestamp && newer(row.cells(), _slice.regular_columns);
+        });
+    }
+
+    bool skip_older(const std::vector<sstables::shared_sstable>& sstables, size_t next) const {
+        if (!shadows(sstables[next]->get_stats_metadata().max_timestamp)) {
+            return false;
+        }
+        tracing::trace(_trace_state, "Skipping {} sstables older than the data read from newer ones", sstables.size() - next);
+        _cf->cf_stats()->sstables_shadowed_for_single_key_reads += sstables.size() - next;
+        return true;
+    }
+
+    future<> read(const sstables::shared_sstable& sstable) {
+        tracing::trace(_trace_state, "Reading key {} from sstable {}", _pr, seastar::value_of([&sstable] { return sstable->get_filename(); }));
+        return sstable->read_row(_schema, _pr.start()->value(), _slice, _pc, _resource_tracker, _fwd).then([this] (auto smo) {
+            if (!smo) {
+                return make_ready_future<>();
+            }
+            ++_sstables_with_partition;
+            _partition_tombstone.apply(smo->partition_tombstone());
+            if (!_can_shadow_rows) {
+                _mutations.emplace_back(std::move(*smo));
+                return make_ready_future<>();
+            }
+            return mutation_from_streamed_mutation(std::move(smo)).then([this] (mutation_opt&& mo) {
+                if (!mo) {
+                    return;
+                }
+                if (_merged) {
+                    _merged->apply(std::move(*mo));
+                } else {
+                    _merged = std::move(mo);
+                }
+            });
+        });
+    }
 public:
     single_key_sstable_reader(column_family* cf,
                               schema_ptr schema,
@@ -513,6 +634,7 @@ class single_key_sstable_reader final : public mutation_reader::impl {
         , _resource_tracker(std::move(resource_tracker))
         , _trace_state(std::move(trace_state))
         , _fwd(fwd)
+        , _can_shadow_rows(can_shadow_rows())
     { }
 
     virtual future<streamed_mutation_opt> operator()() override {
@@ -520,25 +642,167 @@ class single_key_sstable_reader final : public mutation_reader::impl {
             return make_ready_future<streamed_mutation_opt>();
         }
         auto candidates = filter_sstable_for_reader(_sstables->select(_pr), *_cf, _schema, _key, _slice);
-        return parallel_for_each(std::move(candidates),
-            [this](const sstables::shared_sstable& sstable) {
-                tracing::trace(_trace_state, "Reading key {} from sstable {}", _pr, seastar::value_of([&sstable] { return sstable->get_filename(); }));
-                return sstable->read_row(_schema, _pr.start()->value(), _slice, _pc, _resource_tracker, _fwd).then([this](auto smo) {
-                    if (smo) {
-                        _mutations.emplace_back(std::move(*smo));
-                    }
+        boost::sort(candidates, [] (const sstables::shared_sstable& a, const sstables::shared_sstable& b) {
+            return a->compare_by_max_timestamp(*b) > 0;
+        });
+        // The newest sstable is read first, alone. When the rows can't be
+        // checked to shadow older data, only its partition tombstone can,
+        // so the rest of the sstables are then read in parallel.
+        return do_with(std::move(candidates), size_t(0), [this] (std::vector<sstables::shared_sstable>& candidates, size_t& next) {
+            return do_until([this, &candidates, &next] {
+                return next == candidates.size() || (next && skip_older(candidates, next));
+            }, [this, &candidates, &next] {
+                if (!next || _can_shadow_rows) {
+                    return read(candidates[next++]);
+                }
+                auto older = boost::make_iterator_range(candidates.begin() + next, candidates.end());
+                next = candidates.size();
+                return parallel_for_each(older, [this] (const sstables::shared_sstable& sstable) {
+                    return read(sstable);
                 });
+            });
         }).then([this] () -> streamed_mutation_opt {
             _done = true;
+            if (_merged) {
+                _mutations.emplace_back(streamed_mutation_from_mutation(std::move(*_merged)));
+            }
             if (_mutations.empty()) {
                 return { };
             }
-            _sstable_histogram.add(_mutations.size());
+            _sstable_histogram.add(_sstables_with_partition);
+            if (_mutations.size() == 1) {
+                return std::move(_mutations.back());
+            }
             return merge_mutations(std::move(_mutations));
         });
     }
 };
 
+// Reads the keys of the partitions of a range from the index of an sstable
+// without tombstones, returning each partition with a single live row.
+class sstable_partition_key_reader final : public mutation_reader::impl {
+    schema_ptr _schema;
+    sstables::shared_sstable _sstable;
+    const dht::partition_range* _pr;
+    std::unique_ptr<sstables::index_reader> _index;
+    bool _positioned = false;
+    bool _done = false;
+private:
+    future<> advance() {
+        if (!_positioned) {
+            _positioned = true;
+            return _index->advance_to_start(*_pr);
+        }
+        return _index->advance_to_next_partition();
+    }
+
+    streamed_mutation make_live_partition(dht::decorated_key dk) const {
+        mutation m(std::move(dk), _schema);
+        m.partition().clustered_row(*_schema, clustering_key::make_empty()).apply(row_marker(api::min_timestamp));
+        return streamed_mutation_from_mutation(std::move(m));
+    }
+public:
+    sstable_partition_key_reader(schema_ptr s, sstables::shared_sstable sst, const dht::partition_range& pr, const io_priority_class& pc)
+        : _schema(std::move(s))
+        , _sstable(std::move(sst))
+        , _pr(&pr)
+        , _index(_sstable->get_index_reader(pc))
+    { }
+
+    ~sstable_partition_key_reader() {
+        auto f = _index->close();
+        f.handle_exception([index = std::move(_index)] (auto&&) { });
+    }
+
+    virtual future<streamed_mutation_opt> operator()() override {
+        if (_done) {
+            return make_ready_future<streamed_mutation_opt>();
+        }
+        return advance().then([this] {
+            if (_index->eof()) {
+                _done = true;
+                return make_ready_future<streamed_mutation_opt>();
+            }
+            return _index->read_partition_data().then([this] {
+                auto dk = dht::global_partitioner().decorate_key(*_schema, _index->partition_key().to_partition_key(*_schema));
+                if (_pr->after(dk, dht::ring_position_comparator(*_schema))) {
+                    _done = true;
+                    return streamed_mutation_opt();
+                }
+                return streamed_mutation_opt(make_live_partition(std::move(dk)));
+            });
+        });
+    }
+
+    virtual future<> fast_forward_to(const dht::partition_range& pr) override {
+        _pr = &pr;
+        _positioned = false;
+        _done = false;
+        return make_ready_future<>();
+    }
+};
+
+// Serves the slices which read only the keys of the live partitions (see
+// partition_slice::is_partition_key_only()) from the indexes of sstables
+// without tombstones nor expiring cells, all of whose partitions are live.
+// The partitions memtables have data for, which may delete the rows of the
+// sstables, are read from the data files instead.
+class partition_key_reader final : public mutation_reader::impl {
+    std::vector<shared_memtable> _memtables;
+    mutation_reader _keys;
+    mutation_source _data_source;
+    schema_ptr _schema;
+    const query::partition_slice& _slice;
+    const io_priority_class& _pc;
+    tracing::trace_state_ptr _trace_state;
+    dht::partition_range _data_range;
+    mutation_reader _data;
+private:
+    bool needs_data(const dht::decorated_key& dk) const {
+        // A flushed memtable is read from its sstable, which the keys
+        // aren't read from.
+        return boost::algorithm::any_of(_memtables, [&dk] (const shared_memtable& mt) {
+            return mt->is_flushed() || mt->contains(dk);
+        });
+    }
+public:
+    partition_key_reader(std::vector<shared_memtable> memtables,
+                         mutation_reader keys,
+                         mutation_source data_source,
+                         schema_ptr s,
+                         const query::partition_slice& slice,
+                         const io_priority_class& pc,
+                         tracing::trace_state_ptr trace_state)
+        : _memtables(std::move(memtables))
+        , _keys(std::move(keys))
+        , _data_source(std::move(data_source))
+        , _schema(std::move(s))
+        , _slice(slice)
+        , _pc(pc)
+        , _trace_state(std::move(trace_state))
+    { }
+
+    virtual future<streamed_mutation_opt> operator()() override {
+        return _keys().then([this] (streamed_mutation_opt smo) {
+            if (!smo || !needs_data(smo->decorated_key())) {
+                return make_ready_future<streamed_mutation_opt>(std::move(smo));
+            }
+            _data_range = dht::partition_range::make_singular(smo->decorated_key());
+            _data = _data_source(_schema, _data_range, _slice, _pc, _trace_state);
+            return _data().then([this] (streamed_mutation_opt smo) {
+                if (!smo) {
+                    return (*this)();
+                }
+                return make_ready_future<streamed_mutation_opt>(std::move(smo));
+            });
+        });
+    }
+
+    virtual future<> fast_forward_to(const dht::partition_range& pr) override {
+        return _keys.fast_forward_to(pr);
+    }
+};
+
 mutation_reader
 column_family::make_sstable_reader(schema_ptr s,
                                    lw_shared_ptr<sstables::sstable_set> sstables,
@@ -581,6 +845,8 @@ column_family::make_sstable_reader(schema_ptr s,
         }
     } else {
         if (config.resources_sem) {
+            // Unlike single partition reads, scans keep a buffer for each of the sstables they merge.
+            auto estimated_memory = sstables->select(pr).size() * sstables::default_sstable_buffer_size();
             auto ms = mutation_source([&config, sstables=std::move(sstables)] (
                         schema_ptr s,
                         const dht::partition_range& pr,
@@ -594,7 +860,8 @@ column_family::make_sstable_reader(schema_ptr s,
                                     reader_resource_tracker(config.resources_sem), std::move(trace_state), fwd, fwd_mr),
                             fwd_mr);
                 });
-            return make_restricted_reader(config, std::move(ms), std::move(s), pr, slice, pc, std::move(trace_state), fwd, fwd_mr);
+            return make_restricted_reader(config, std::move(ms), std::move(s), pr, slice, pc, std::move(trace_state), fwd, fwd_mr,
+                    estimated_memory);
         } else {
             return make_mutation_reader<combined_mutation_reader>(
                     std::make_unique<incremental_reader_selector>(std::move(s), std::move(sstables), pr, slice, pc,
@@ -604,6 +871,50 @@ column_family::make_sstable_reader(schema_ptr s,
     }
 }
 
+stdx::optional<mutation_reader>
+column_family::make_partition_key_reader(schema_ptr s,
+                                         const dht::partition_range& range,
+                                         const query::partition_slice& slice,
+                                         const io_priority_class& pc,
+                                         tracing::trace_state_ptr trace_state,
+                                         streamed_mutation::forwarding fwd,
+                                         mutation_reader::forwarding fwd_mr) const {
+    if (!slice.is_partition_key_only() || range.is_singular() || fwd == streamed_mutation::forwarding::yes) {
+        return stdx::nullopt;
+    }
+    // Forwarding may move the range to any of the sstables.
+    auto candidates = fwd_mr ? *_sstables->all() : _sstables->select(range);
+    if (boost::algorithm::any_of(candidates, [] (const sstables::shared_sstable& sst) { return sst->may_have_tombstones(); })) {
+        return stdx::nullopt;
+    }
+    tracing::trace(trace_state, "Reading partition keys of {} from the index of {} sstables", range, candidates.size());
+    ++_config.cf_stats->partition_key_reads_from_index;
+
+    std::vector<mutation_reader> keys;
+    keys.reserve(candidates.size());
+    for (auto&& sst : candidates) {
+        auto rd = make_mutation_reader<sstable_partition_key_reader>(s, sst, range, pc);
+        if (sst->is_shared()) {
+            rd = make_filtering_reader(std::move(rd), belongs_to_current_shard);
+        }
+        keys.emplace_back(std::move(rd));
+    }
+    auto data_source = mutation_source([this, sstables = _sstables] (schema_ptr s,
+                const dht::partition_range& pr,
+                const query::partition_slice& slice,
+                const io_priority_class& pc,
+                tracing::trace_state_ptr trace_state,
+                streamed_mutation::forwarding fwd,
+                mutation_reader::forwarding fwd_mr) {
+        return make_sstable_reader(std::move(s), sstables, pr, slice, pc, std::move(trace_state), fwd, fwd_mr);
+    });
+    return make_mutation_reader<partition_key_reader>(
+            boost::copy_range<std::vector<shared_memtable>>(*_memtables),
+            make_combined_reader(std::move(keys), fwd_mr),
+            std::move(data_source),
+            std::move(s), slice, pc, std::move(trace_state));
+}
+
 // Exposed for testing, not performance critical.
 future<column_family::const_mutation_partition_ptr>
 column_family::find_partition(schema_ptr s, const dht::decorated_key& key) const {
@@ -681,7 +992,9 @@ column_family::make_reader(schema_ptr s,
         readers.emplace_back(mt->make_reader(s, range, slice, pc, trace_state, fwd, fwd_mr));
     }
 
-    if (_config.enable_cache) {
+    if (auto rd = make_partition_key_reader(s, range, slice, pc, trace_state, fwd, fwd_mr)) {
+        readers.emplace_back(std::move(*rd));
+    } else if (_config.enable_cache && !slice.options.contains(query::partition_slice::option::bypass_cache)) {
         readers.emplace_back(_cache.make_reader(s, range, slice, pc, std::move(trace_state), fwd, fwd_mr));
     } else {
         readers.emplace_back(make_sstable_reader(s, _sstables, range, slice, pc, std::move(trace_state), fwd, fwd_mr));
@@ -694,18 +1007,26 @@ mutation_reader
 column_family::make_streaming_reader(schema_ptr s,
                            const dht::partition_range& range) const {
     auto& slice = s->full_slice();
+    return make_streaming_reader(std::move(s), range, slice);
+}
+
+mutation_reader
+column_family::make_streaming_reader(schema_ptr s,
+                           const dht::partition_range& range,
+                           const query::partition_slice& slice,
+                           mutation_reader::forwarding fwd_mr) const {
     auto& pc = service::get_local_streaming_read_priority();
 
     std::vector<mutation_reader> readers;
     readers.reserve(_memtables->size() + 1);
 
     for (auto&& mt : *_memtables) {
-        readers.emplace_back(mt->make_reader(s, range, slice, pc, nullptr, streamed_mutation::forwarding::no, mutation_reader::forwarding::no));
+        readers.emplace_back(mt->make_reader(s, range, slice, pc, nullptr, streamed_mutation::forwarding::no, fwd_mr));
     }
 
-    readers.emplace_back(make_sstable_reader(s, _sstables, range, slice, pc, nullptr, streamed_mutation::forwarding::no, mutation_reader::forwarding::no));
+    readers.emplace_back(make_sstable_reader(s, _sstables, range, slice, pc, nullptr, streamed_mutation::forwarding::no, fwd_mr));
 
-    return make_combined_reader(std::move(readers), mutation_reader::forwarding::no);
+    return make_combined_reader(std::move(readers), fwd_mr);
 }
 
 mutation_reader
@@ -728,6 +1049,56 @@ column_family::make_streaming_reader(schema_ptr s,
     return make_multi_range_reader(s, std::move(source), ranges, slice, pc, nullptr, streamed_mutation::forwarding::no, mutation_reader::forwarding::no);
 }
 
+mutation_reader
+column_family::make_streaming_reader(schema_ptr s,
+                           const dht::partition_range_vector& ranges,
+                           const std::vector<sstables::shared_sstable>& excluded) const {
+    auto& slice = s->full_slice();
+    auto& pc = service::get_local_streaming_read_priority();
+
+    auto sstables = make_lw_shared(_compaction_strategy.make_sstable_set(_schema));
+    for (auto&& sst : *_sstables->all()) {
+        if (boost::find(excluded, sst) == excluded.end()) {
+            sstables->insert(sst);
+        }
+    }
+
+    auto source = mutation_source([this, sstables] (schema_ptr s, const dht::partition_range& range, const query::partition_slice& slice,
+                                      const io_priority_class& pc, tracing::trace_state_ptr trace_state, streamed_mutation::forwarding fwd, mutation_reader::forwarding fwd_mr) {
+        std::vector<mutation_reader> readers;
+        readers.reserve(_memtables->size() + 1);
+        for (auto&& mt : *_memtables) {
+            readers.emplace_back(mt->make_reader(s, range, slice, pc, trace_state, fwd, fwd_mr));
+        }
+        readers.emplace_back(make_sstable_reader(s, sstables, range, slice, pc, std::move(trace_state), fwd, fwd_mr));
+        return make_combined_reader(std::move(readers), fwd_mr);
+    });
+
+    return make_multi_range_reader(s, std::move(source), ranges, slice, pc, nullptr, streamed_mutation::forwarding::no, mutation_reader::forwarding::no);
+}
+
+mutation_reader
+column_family::make_streaming_reader_of(schema_ptr s,
+                           const dht::partition_range_vector& ranges,
+                           std::vector<sstables::shared_sstable> ssts) const {
+    auto& slice = s->full_slice();
+    auto& pc = service::get_local_streaming_read_priority();
+
+    // The sstables may come from anywhere, so don't trust their levels.
+    auto strategy = sstables::make_compaction_strategy(sstables::compaction_strategy_type::size_tiered, {});
+    auto sstables = make_lw_shared(strategy.make_sstable_set(_schema));
+    for (auto&& sst : ssts) {
+        sstables->insert(std::move(sst));
+    }
+
+    auto source = mutation_source([this, sstables] (schema_ptr s, const dht::partition_range& range, const query::partition_slice& slice,
+                                      const io_priority_class& pc, tracing::trace_state_ptr trace_state, streamed_mutation::forwarding fwd, mutation_reader::forwarding fwd_mr) {
+        return make_sstable_reader(s, sstables, range, slice, pc, std::move(trace_state), fwd, fwd_mr);
+    });
+
+    return make_multi_range_reader(s, std::move(source), ranges, slice, pc, nullptr, streamed_mutation::forwarding::no, mutation_reader::forwarding::no);
+}
+
 future<std::vector<locked_cell>> column_family::lock_counter_cells(const mutation& m, timeout_clock::time_point timeout) {
     assert(m.schema() == _counter_cell_locks->schema());
     return _counter_cell_locks->lock_cells(m.decorated_key(), partition_cells_range(m.partition()), timeout);
@@ -801,6 +1172,7 @@ void column_family::load_sstable(sstables::shared_sstable& sst, bool reset_level
     if (schema()->is_counter() && !sst->has_scylla_component()) {
         throw std::runtime_error("Loading non-Scylla SSTables containing counters is not supported. Use sstableloader instead.");
     }
+    invalidate_counter_cache();
     auto& shards = sst->get_shards_for_this_sstable();
     if (belongs_to_other_shard(shards)) {
         // If we're here, this sstable is shared by this and other
@@ -824,12 +1196,35 @@ void column_family::load_sstable(sstables::shared_sstable& sst, bool reset_level
     add_sstable(sst, std::move(shards));
 }
 
-void column_family::update_stats_for_new_sstable(uint64_t disk_space_used_by_sstable, const std::vector<unsigned>& shards_for_the_sstable) noexcept {
+void column_family::update_stats_for_new_sstable(const sstables::shared_sstable& sst, const std::vector<unsigned>& shards_for_the_sstable, bool live) noexcept {
     assert(!shards_for_the_sstable.empty());
-    if (*boost::min_element(shards_for_the_sstable) == engine().cpu_id()) {
+    if (*boost::min_element(shards_for_the_sstable) != engine().cpu_id()) {
+        return;
+    }
+    int64_t disk_space_used_by_sstable = sst->bytes_on_disk();
+    int64_t partitions = live ? sst->get_estimated_key_count() : 0;
+    _stats.total_disk_space_used += disk_space_used_by_sstable;
+    if (live) {
         _stats.live_disk_space_used += disk_space_used_by_sstable;
-        _stats.total_disk_space_used += disk_space_used_by_sstable;
         _stats.live_sstable_count++;
+        _stats.estimated_partitions += partitions;
+    }
+    if (auto shard_stats = _config.cf_stats) {
+        shard_stats->total_disk_space_used += disk_space_used_by_sstable;
+        if (live) {
+            shard_stats->live_disk_space_used += disk_space_used_by_sstable;
+            shard_stats->live_sstable_count++;
+            shard_stats->estimated_partitions += partitions;
+        }
+    }
+}
+
+void column_family::remove_sstable_stats_from_shard() noexcept {
+    if (auto shard_stats = _config.cf_stats) {
+        shard_stats->live_disk_space_used -= _stats.live_disk_space_used;
+        shard_stats->total_disk_space_used -= _stats.total_disk_space_used;
+        shard_stats->live_sstable_count -= _stats.live_sstable_count;
+        shard_stats->estimated_partitions -= _stats.estimated_partitions;
     }
 }
 
@@ -838,15 +1233,22 @@ void column_family::add_sstable(sstables::shared_sstable sstable, const std::vec
     auto new_sstables = make_lw_shared(*_sstables);
     new_sstables->insert(sstable);
     _sstables = std::move(new_sstables);
-    update_stats_for_new_sstable(sstable->bytes_on_disk(), shards_for_the_sstable);
+    _size_estimates.clear();
+    _estimated_partition_count = { };
+    update_stats_for_new_sstable(sstable, shards_for_the_sstable, true);
+    record_large_data(sstable);
 }
 
 future<>
-column_family::update_cache(lw_shared_ptr<memtable> m, sstables::shared_sstable sst) {
-    auto adder = [this, m, sst] {
-        auto newtab_ms = sst->as_mutation_source();
-        add_sstable(sst, {engine().cpu_id()});
-        m->mark_flushed(std::move(newtab_ms));
+column_family::update_cache(lw_shared_ptr<memtable> m, std::vector<sstables::shared_sstable> ssts) {
+    auto adder = [this, m, ssts = std::move(ssts)] {
+        auto newtab_sources = boost::copy_range<std::vector<mutation_source>>(ssts | boost::adaptors::transformed([] (auto& sst) {
+            return sst->as_mutation_source();
+        }));
+        for (auto& sst : ssts) {
+            add_sstable(sst, {engine().cpu_id()});
+        }
+        m->mark_flushed(newtab_sources.size() == 1 ? std::move(newtab_sources.front()) : make_combined_mutation_source(std::move(newtab_sources)));
         try_trigger_compaction();
     };
     if (_config.enable_cache) {
@@ -905,7 +1307,7 @@ column_family::seal_active_streaming_memtable_immediate(flush_permit&& permit) {
         with_lock(_sstables_lock.for_read(), [this, old, permit = std::move(permit)] () mutable {
             auto newtab = sstables::make_sstable(_schema,
                 _config.datadir, calculate_generation_for_new_table(),
-                sstables::sstable::version_types::ka,
+                sstables_version(),
                 sstables::sstable::format_types::big);
 
             newtab->set_unshared();
@@ -966,7 +1368,7 @@ future<> column_family::seal_active_streaming_memtable_big(streaming_memtable_bi
             return with_lock(_sstables_lock.for_read(), [this, old, &smb, permit = std::move(permit)] () mutable {
                 auto newtab = sstables::make_sstable(_schema,
                                                                 _config.datadir, calculate_generation_for_new_table(),
-                                                                sstables::sstable::version_types::ka,
+                                                                sstables_version(),
                                                                 sstables::sstable::format_types::big);
 
                 newtab->set_unshared();
@@ -1037,15 +1439,35 @@ column_family::seal_active_memtable(flush_permit&& permit) {
 
 future<stop_iteration>
 column_family::try_flush_memtable_to_sstable(lw_shared_ptr<memtable> old, sstable_write_permit&& permit) {
-    auto gen = calculate_generation_for_new_table();
-
-    auto newtab = sstables::make_sstable(_schema,
-        _config.datadir, gen,
-        sstables::sstable::version_types::ka,
-        sstables::sstable::format_types::big);
-
-    newtab->set_unshared();
-    dblog.debug("Flushing to {}", newtab->get_filename());
+    struct flush_part {
+        const dht::partition_range* range;
+        uint64_t partitions;
+        sstables::shared_sstable newtab;
+    };
+    // One sstable per compaction group the memtable has data of.
+    std::vector<flush_part> parts;
+    auto add_part = [this, &parts] (const dht::partition_range& range, uint64_t partitions) {
+        auto gen = calculate_generation_for_new_table();
+
+        auto newtab = sstables::make_sstable(_schema,
+            _config.datadir, gen,
+            sstables_version(),
+            sstables::sstable::format_types::big);
+
+        newtab->set_unshared();
+        parts.push_back(flush_part{&range, partitions, std::move(newtab)});
+    };
+    if (compaction_groups() == 1) {
+        add_part(query::full_partition_range, old->partition_count());
+    } else {
+        for (unsigned group = 0; group < compaction_groups(); ++group) {
+            auto& range = compaction_group_range(group);
+            auto partitions = old->partition_count(range);
+            if (partitions) {
+                add_part(range, partitions);
+            }
+        }
+    }
     // Note that due to our sharded architecture, it is possible that
     // in the face of a value change some shards will backup sstables
     // while others won't.
@@ -1059,22 +1481,36 @@ column_family::try_flush_memtable_to_sstable(lw_shared_ptr<memtable> old, sstabl
     // single sstable, so that is enough of a guarantee.
     auto&& priority = service::get_local_memtable_flush_priority();
     auto monitor = seastar::make_shared<permit_monitor>(std::move(permit));
-    return write_memtable_to_sstable(*old, newtab, std::move(monitor), incremental_backups_enabled(), priority, false, _config.memtable_scheduling_group).then([this, newtab, old] {
-        return newtab->open_data();
-    }).then([this, old, newtab] () {
-        dblog.debug("Flushing to {} done", newtab->get_filename());
-        return update_cache(old, newtab);
-    }).then([this, old, newtab] () noexcept {
-        _memtables->erase(old);
-        dblog.debug("Memtable for {} replaced", newtab->get_filename());
-        return stop_iteration::yes;
-    }).handle_exception([this, old, newtab] (auto e) {
-        newtab->mark_for_deletion();
-        dblog.error("failed to write sstable {}: {}", newtab->get_filename(), e);
-        // If we failed this write we will try the write again and that will create a new flush reader
-        // that will decrease dirty memory again. So we need to reset the accounting.
-        old->revert_flushed_memory();
-        return stop_iteration::no;
+    return do_with(std::move(parts), [this, old, &priority, monitor = std::move(monitor)] (std::vector<flush_part>& parts) mutable {
+        auto last = &parts.back();
+        return do_for_each(parts, [this, old, &priority, last, monitor = std::move(monitor)] (flush_part& part) {
+            dblog.debug("Flushing to {}", part.newtab->get_filename());
+            // The permit is released once the last sstable was written.
+            auto part_monitor = &part == last ? monitor : seastar::make_shared<permit_monitor>(sstable_write_permit::unconditional());
+            return write_memtable_to_sstable(*old, *part.range, part.partitions, part.newtab, std::move(part_monitor), incremental_backups_enabled(),
+                    priority, false, _config.memtable_scheduling_group).then([newtab = part.newtab] {
+                return newtab->open_data();
+            }).then([newtab = part.newtab] {
+                dblog.debug("Flushing to {} done", newtab->get_filename());
+            });
+        }).then([this, old, &parts] {
+            return update_cache(old, boost::copy_range<std::vector<sstables::shared_sstable>>(parts | boost::adaptors::transformed(std::mem_fn(&flush_part::newtab))));
+        }).then([this, old, &parts] () noexcept {
+            _memtables->erase(old);
+            for (auto& part : parts) {
+                dblog.debug("Memtable for {} replaced", part.newtab->get_filename());
+            }
+            return stop_iteration::yes;
+        }).handle_exception([this, old, &parts] (auto e) {
+            for (auto& part : parts) {
+                part.newtab->mark_for_deletion();
+            }
+            dblog.error("failed to write sstable {}: {}", parts.back().newtab->get_filename(), e);
+            // If we failed this write we will try the write again and that will create a new flush reader
+            // that will decrease dirty memory again. So we need to reset the accounting.
+            old->revert_flushed_memory();
+            return stop_iteration::no;
+        });
     });
 }
 
@@ -1093,6 +1529,8 @@ column_family::stop() {
                 return _streaming_flush_gate.close();
             }).then([this] {
                 return _sstable_deletion_gate.close();
+            }).then([this] {
+                return _large_data_gate.close();
             });
         });
     });
@@ -1169,6 +1607,45 @@ distributed_loader::flush_upload_dir(distributed<database>& db, sstring ks_name,
     });
 }
 
+// Lists the sstables of the upload directory of the column family, without
+// touching them.
+future<std::vector<sstables::entry_descriptor>>
+distributed_loader::list_upload_dir(distributed<database>& db, sstring ks_name, sstring cf_name) {
+    return do_with(std::vector<sstables::entry_descriptor>(), [&db, ks_name = std::move(ks_name), cf_name = std::move(cf_name)] (auto& descriptors) {
+        auto& cf = db.local().find_column_family(ks_name, cf_name);
+
+        return lister::scan_dir(lister::path(cf._config.datadir) / "upload", { directory_entry_type::regular },
+                [&descriptors] (lister::path parent_dir, directory_entry de) {
+            auto comps = sstables::entry_descriptor::make_descriptor(de.name);
+            if (comps.component == sstables::sstable::component_type::TOC) {
+                descriptors.push_back(std::move(comps));
+            }
+            return make_ready_future<>();
+        }, &column_family::manifest_json_filter).then([&descriptors] {
+            return std::move(descriptors);
+        });
+    });
+}
+
+future<std::vector<sstables::shared_sstable>>
+column_family::open_upload_sstables(std::vector<sstables::entry_descriptor> descriptors) {
+    return do_with(std::move(descriptors), std::vector<sstables::shared_sstable>(), [this] (auto& descriptors, auto& ssts) {
+        return do_for_each(descriptors, [this, &ssts] (const sstables::entry_descriptor& comps) {
+            auto sst = sstables::make_sstable(_schema, _config.datadir + "/upload", comps.generation,
+                comps.version, comps.format, gc_clock::now(),
+                [] (disk_error_signal_type&) { return error_handler_for_upload_dir(); });
+            return sst->load(service::get_local_streaming_read_priority()).then([this, sst, &ssts] {
+                if (_schema->is_counter() && !sst->has_scylla_component()) {
+                    throw std::runtime_error("Loading non-Scylla SSTables containing counters is not supported. Use sstableloader instead.");
+                }
+                ssts.push_back(sst);
+            });
+        }).then([&ssts] {
+            return std::move(ssts);
+        });
+    });
+}
+
 future<std::vector<sstables::entry_descriptor>>
 column_family::reshuffle_sstables(std::set<int64_t> all_generations, int64_t start) {
     struct work {
@@ -1240,30 +1717,59 @@ void column_family::set_metrics() {
                 ms::make_gauge("live_disk_space", ms::description("Live disk space used"), _stats.live_disk_space_used)(cf)(ks),
                 ms::make_gauge("total_disk_space", ms::description("Total disk space used"), _stats.total_disk_space_used)(cf)(ks),
                 ms::make_gauge("live_sstable", ms::description("Live sstable count"), _stats.live_sstable_count)(cf)(ks),
-                ms::make_gauge("pending_compaction", ms::description("Estimated number of compactions pending for this column family"), _stats.pending_compactions)(cf)(ks)
+                ms::make_gauge("pending_compaction", ms::description("Estimated number of compactions pending for this column family"), _stats.pending_compactions)(cf)(ks),
+                ms::make_derive("cpu_time_us", ms::description("Microseconds spent in the synchronous sections of the writes, reads, compactions and flushes of this column family"),
+                        [this] { return std::chrono::duration_cast<std::chrono::microseconds>(_cost->cpu_time).count(); })(cf)(ks),
+                ms::make_derive("sstable_read_bytes", ms::description("Bytes read from the data and index files of the sstables of this column family"), _cost->read_bytes)(cf)(ks),
+                ms::make_derive("sstable_write_bytes", ms::description("Bytes written to the data and index files of the sstables of this column family"), _cost->written_bytes)(cf)(ks)
         });
         if (_schema->ks_name() != db::system_keyspace::NAME && _schema->ks_name() != db::schema_tables::v3::NAME && _schema->ks_name() != "system_traces") {
             _metrics.add_group("column_family", {
-                    ms::make_histogram("read_latency", ms::description("Read latency histogram"), [this] {return _stats.estimated_read.get_histogram(std::chrono::microseconds(100));})(cf)(ks),
-                    ms::make_histogram("write_latency", ms::description("Write latency histogram"), [this] {return _stats.estimated_write.get_histogram(std::chrono::microseconds(100));})(cf)(ks),
-                    ms::make_gauge("cache_hit_rate", ms::description("Cache hit rate"), [this] {return float(_global_cache_hit_rate);})(cf)(ks)
+                    ms::make_histogram("read_latency", ms::description("Read latency histogram"), [this] {return _stats.reads.hist.values.get_histogram(std::chrono::microseconds(100));})(cf)(ks),
+                    ms::make_histogram("write_latency", ms::description("Write latency histogram"), [this] {return _stats.writes.hist.values.get_histogram(std::chrono::microseconds(100));})(cf)(ks),
+                    ms::make_histogram("read_admission_latency", ms::description("Histogram of the time reads wait for the memory of their result"), [this] {return _stats.estimated_read_admission.get_histogram(std::chrono::microseconds(10));})(cf)(ks),
+                    ms::make_histogram("read_execution_latency", ms::description("Histogram of the time reads spend reading the cache and the sstables"), [this] {return _stats.estimated_read_execution.get_histogram(std::chrono::microseconds(10));})(cf)(ks),
+                    ms::make_histogram("write_commitlog_latency", ms::description("Histogram of the time writes spend being added to the commitlog"), [this] {return _stats.estimated_write_commitlog.get_histogram(std::chrono::microseconds(10));})(cf)(ks),
+                    ms::make_histogram("write_memory_wait_latency", ms::description("Histogram of the time writes wait for dirty memory"), [this] {return _stats.estimated_write_memory_wait.get_histogram(std::chrono::microseconds(10));})(cf)(ks),
+                    ms::make_gauge("cache_hit_rate", ms::description("Cache hit rate"), [this] {return float(_global_cache_hit_rate);})(cf)(ks),
+                    ms::make_derive("cache_partition_snapshots", ms::description("Number of partition snapshots taken by cache reads"), [this] {return _cache.stats().partition_snapshots;})(cf)(ks),
+                    ms::make_derive("cache_partition_snapshot_versions", ms::description("Number of partition versions read by the partition snapshots of cache reads"), [this] {return _cache.stats().partition_snapshot_versions;})(cf)(ks),
+                    ms::make_derive("cache_partition_version_squashes", ms::description("Number of times cache reads squashed the versions of a partition with too many of them"), [this] {return _cache.stats().partition_version_squashes;})(cf)(ks),
+                    ms::make_gauge("top_partition_reads", ms::description("Estimated reads of the most read partition over the last one to two sampling windows"), [this] {return _top_partitions.top_read_count();})(cf)(ks),
+                    ms::make_gauge("top_partition_writes", ms::description("Estimated writes of the most written partition over the last one to two sampling windows"), [this] {return _top_partitions.top_write_count();})(cf)(ks)
             });
         }
     }
 }
 
+uint64_t column_family::estimated_partition_count() const {
+    if (!_estimated_partition_count) {
+        sstables::partition_count_estimator estimator;
+        for (auto&& sst : *_sstables->all()) {
+            estimator.add(*sst);
+        }
+        _estimated_partition_count = estimator.estimate();
+    }
+    return *_estimated_partition_count;
+}
+
 void column_family::rebuild_statistics() {
-    // zeroing live_disk_space_used and live_sstable_count because the
-    // sstable list was re-created
+    // zeroing the sstable statistics because the sstable list was re-created.
+    // The sstables compacted but not deleted yet still use the disk, but are
+    // not live anymore.
+    remove_sstable_stats_from_shard();
+    _size_estimates.clear();
+    _estimated_partition_count = { };
     _stats.live_disk_space_used = 0;
+    _stats.total_disk_space_used = 0;
     _stats.live_sstable_count = 0;
+    _stats.estimated_partitions = 0;
 
-    for (auto&& tab : boost::range::join(_sstables_compacted_but_not_deleted,
-                    // this might seem dangerous, but "move" here just avoids constness,
-                    // making the two ranges compatible when compiling with boost 1.55.
-                    // Noone is actually moving anything...
-                                         std::move(*_sstables->all()))) {
-        update_stats_for_new_sstable(tab->bytes_on_disk(), tab->get_shards_for_this_sstable());
+    for (auto&& tab : *_sstables->all()) {
+        update_stats_for_new_sstable(tab, tab->get_shards_for_this_sstable(), true);
+    }
+    for (auto&& tab : _sstables_compacted_but_not_deleted) {
+        update_stats_for_new_sstable(tab, tab->get_shards_for_this_sstable(), false);
     }
 }
 
@@ -1305,6 +1811,10 @@ column_family::rebuild_sstable_list(const std::vector<sstables::shared_sstable>&
     _sstables_compacted_but_not_deleted = std::move(new_compacted_but_not_deleted);
 
     rebuild_statistics();
+    for (auto&& sst : new_sstables) {
+        record_large_data(sst);
+    }
+    remove_large_data(sstables_to_remove);
 
     // Second, delete the old sstables.  This is done in the background, so we can
     // consider this compaction completed.
@@ -1365,6 +1875,51 @@ void column_family::replace_ancestors_needed_rewrite(std::vector<sstables::share
     rebuild_sstable_list(new_sstables, old_sstables);
 }
 
+// Index pages of the outputs of a compaction read before they replace its
+// inputs, at most that many, that many at a time.
+static constexpr size_t max_warmed_up_index_pages = 256;
+static constexpr size_t index_warm_up_concurrency = 4;
+
+// The index pages of the inputs of a compaction which are in the page cache
+// are those reads went to lately. The pages of their partitions in the
+// outputs are read before the outputs replace the inputs, so that those reads
+// don't all miss the cache at once right after the replacement.
+future<> column_family::warm_up_index_pages(const std::vector<sstables::shared_sstable>& old_sstables,
+                                            const std::vector<sstables::shared_sstable>& new_sstables) const {
+    std::vector<dht::decorated_key> keys;
+    for (auto&& sst : old_sstables) {
+        if (keys.size() == max_warmed_up_index_pages) {
+            break;
+        }
+        auto hot = sst->hot_index_page_keys(max_warmed_up_index_pages - keys.size());
+        std::move(hot.begin(), hot.end(), std::back_inserter(keys));
+    }
+    std::vector<std::pair<sstables::shared_sstable, dht::ring_position>> pages;
+    for (auto&& dk : keys) {
+        auto key = sstables::key::from_partition_key(*_schema, dk._key);
+        for (auto&& sst : new_sstables) {
+            if (sst->filter_has_key(key)) {
+                pages.emplace_back(sst, dk);
+            }
+        }
+    }
+    if (pages.empty()) {
+        return make_ready_future<>();
+    }
+    dblog.debug("Warming up {} index pages of the compaction of {}.{}", pages.size(), _schema->ks_name(), _schema->cf_name());
+    auto sem = make_lw_shared<semaphore>(index_warm_up_concurrency);
+    return do_with(std::move(pages), [sem] (auto& pages) {
+        return parallel_for_each(pages, [sem] (auto& p) {
+            return with_semaphore(*sem, 1, [&p] {
+                return p.first->prefetch_index_page(p.second, service::get_local_compaction_priority());
+            });
+        });
+    }).handle_exception([] (std::exception_ptr ep) {
+        // The outputs are good, they are just not warmed up.
+        dblog.warn("Failed to warm up index pages of compacted sstables: {}", ep);
+    });
+}
+
 void column_family::remove_ancestors_needed_rewrite(std::unordered_set<uint64_t> ancestors) {
     std::vector<sstables::shared_sstable> old_sstables;
     for (auto& ancestor : ancestors) {
@@ -1390,16 +1945,49 @@ column_family::compact_sstables(sstables::compaction_descriptor descriptor, bool
         auto create_sstable = [this] {
                 auto gen = this->calculate_generation_for_new_table();
                 auto sst = sstables::make_sstable(_schema, _config.datadir, gen,
-                        sstables::sstable::version_types::ka,
+                        sstables_version(),
                         sstables::sstable::format_types::big);
                 sst->set_unshared();
                 return sst;
         };
-        return sstables::compact_sstables(*sstables_to_compact, *this, create_sstable, descriptor.max_sstable_bytes, descriptor.level,
-                cleanup, _config.background_writer_scheduling_group).then([this, sstables_to_compact] (auto info) {
-            _compaction_strategy.notify_completion(*sstables_to_compact, info.new_sstables);
-            this->rebuild_sstable_list(info.new_sstables, *sstables_to_compact);
-            return info;
+        sstables::compaction_replacer replacer;
+        if (descriptor.incremental) {
+            // Exhausted input sstables are replaced as the compaction goes, so their
+            // space is released before the whole output is written.
+            replacer = [this] (const std::vector<sstables::shared_sstable>& new_sstables,
+                    const std::vector<sstables::shared_sstable>& exhausted_sstables) {
+                this->rebuild_sstable_list(new_sstables, exhausted_sstables);
+            };
+        }
+        auto incremental = descriptor.incremental;
+        auto jobs = descriptor.jobs;
+        auto tsg = _compaction_manager.scheduling_group();
+        if (!tsg) {
+            tsg = _config.background_writer_scheduling_group;
+        }
+        // Split and incremental compactions run here, as do those whose output the
+        // compaction groups split.
+        auto offloadable = _config.enable_compaction_offload && !cleanup && !incremental && jobs == 1
+                && boost::algorithm::all_of(*sstables_to_compact, [this, &sstables_to_compact] (const sstables::shared_sstable& sst) {
+                    return compaction_group_of(sst) == compaction_group_of(sstables_to_compact->front());
+                });
+        auto helper = offloadable ? pick_compaction_offload_shard() : make_ready_future<stdx::optional<shard_id>>();
+        return helper.then([this, sstables_to_compact, create_sstable = std::move(create_sstable), max_sstable_bytes = descriptor.max_sstable_bytes,
+                level = descriptor.level, cleanup, tsg, replacer = std::move(replacer), jobs] (stdx::optional<shard_id> helper) mutable {
+            if (helper) {
+                return offload_compaction(*helper, *sstables_to_compact, max_sstable_bytes, level);
+            }
+            return sstables::compact_sstables(*sstables_to_compact, *this, create_sstable, max_sstable_bytes, level,
+                    cleanup, tsg, std::move(replacer), jobs);
+        }).then([this, sstables_to_compact, incremental] (auto info) {
+            auto f = incremental ? make_ready_future<>() : warm_up_index_pages(*sstables_to_compact, info.new_sstables);
+            return f.then([this, sstables_to_compact, incremental, info = std::move(info)] () mutable {
+                _compaction_strategy.notify_completion(*sstables_to_compact, info.new_sstables);
+                if (!incremental) {
+                    this->rebuild_sstable_list(info.new_sstables, *sstables_to_compact);
+                }
+                return std::move(info);
+            });
         });
     }).then([this] (auto info) {
         if (info.type != sstables::compaction_type::Compaction) {
@@ -1418,7 +2006,16 @@ column_family::compact_sstables(sstables::compaction_descriptor descriptor, bool
     });
 }
 
-static bool needs_cleanup(const sstables::shared_sstable& sst,
+enum class sstable_ownership {
+    // Every partition of the sstable is in the owned ranges.
+    full,
+    // None is.
+    none,
+    // Only some may be.
+    partial,
+};
+
+static sstable_ownership get_sstable_ownership(const sstables::shared_sstable& sst,
                    const dht::token_range_vector& owned_ranges,
                    schema_ptr s) {
     auto first = sst->get_first_partition_key();
@@ -1427,13 +2024,16 @@ static bool needs_cleanup(const sstables::shared_sstable& sst,
     auto last_token = dht::global_partitioner().get_token(*s, last);
     dht::token_range sst_token_range = dht::token_range::make(first_token, last_token);
 
-    // return true iff sst partition range isn't fully contained in any of the owned ranges.
+    auto ownership = sstable_ownership::none;
     for (auto& r : owned_ranges) {
         if (r.contains(sst_token_range, dht::token_comparator())) {
-            return false;
+            return sstable_ownership::full;
+        }
+        if (r.overlaps(sst_token_range, dht::token_comparator())) {
+            ownership = sstable_ownership::partial;
         }
     }
-    return true;
+    return ownership;
 }
 
 future<> column_family::cleanup_sstables(sstables::compaction_descriptor descriptor) {
@@ -1441,8 +2041,19 @@ future<> column_family::cleanup_sstables(sstables::compaction_descriptor descrip
 
     return do_with(std::move(descriptor.sstables), std::move(r), [this] (auto& sstables, auto& owned_ranges) {
         return do_for_each(sstables, [this, &owned_ranges] (auto& sst) {
-            if (!owned_ranges.empty() && !needs_cleanup(sst, owned_ranges, _schema)) {
-            return make_ready_future<>();
+            // Without owned ranges, which shouldn't happen, rewrite everything
+            // rather than risk dropping data wholesale.
+            auto ownership = owned_ranges.empty() ? sstable_ownership::partial : get_sstable_ownership(sst, owned_ranges, _schema);
+            if (ownership == sstable_ownership::full) {
+                return make_ready_future<>();
+            }
+            if (ownership == sstable_ownership::none) {
+                // Nothing to keep, so there is nothing to rewrite either.
+                return with_lock(_sstables_lock.for_read(), [this, &sst] {
+                    dblog.info("Cleanup: dropping {}, which holds no data owned by this node", sst->get_filename());
+                    _compaction_strategy.notify_completion({ sst }, {});
+                    this->rebuild_sstable_list({}, { sst });
+                });
             }
 
             // this semaphore ensures that only one cleanup will run per shard.
@@ -1540,6 +2151,12 @@ std::vector<sstables::shared_sstable> column_family::select_sstables(const dht::
     return _sstables->select(range);
 }
 
+bool column_family::memtables_contain(const dht::partition_range& range) const {
+    return boost::algorithm::any_of(*_memtables, [&range] (const lw_shared_ptr<memtable>& mt) {
+        return !mt->slice(range).empty();
+    });
+}
+
 std::vector<sstables::shared_sstable> column_family::candidates_for_compaction() const {
     return boost::copy_range<std::vector<sstables::shared_sstable>>(*get_sstables()
         | boost::adaptors::filtered([this] (auto& sst) { return !_sstables_need_rewrite.count(sst->generation()); }));
@@ -1602,24 +2219,33 @@ future<> distributed_loader::open_sstable(distributed<database>& db, sstables::e
     return db.invoke_on(column_family::calculate_shard_from_sstable_generation(comps.generation),
             [&db, comps = std::move(comps), func = std::move(func), pc] (database& local) {
 
-        return with_semaphore(local.sstable_load_concurrency_sem(), 1, [&db, &local, comps = std::move(comps), func = std::move(func), pc] {
+        // Only reading the components from disk is limited, so that the next sstables
+        // are read while this one is being opened by the other shards.
+        auto f = with_semaphore(local.sstable_load_concurrency_sem(), 1, [&local, comps, pc] {
             auto& cf = local.find_column_family(comps.ks, comps.cf);
-
-            auto f = sstables::sstable::load_shared_components(cf.schema(), cf._config.datadir, comps.generation, comps.version, comps.format, pc);
-            return f.then([&db, comps = std::move(comps), func = std::move(func)] (sstables::sstable_open_info info) {
-                // shared components loaded, now opening sstable in all shards with shared components
-                return do_with(std::move(info), [&db, comps = std::move(comps), func = std::move(func)] (auto& info) {
-                    return invoke_all_with_ptr(db, std::move(info.components),
-                            [owners = info.owners, data = info.data.dup(), index = info.index.dup(), comps, func] (database& db, auto components) {
-                        auto& cf = db.find_column_family(comps.ks, comps.cf);
-                        return func(cf, sstables::foreign_sstable_open_info{std::move(components), owners, data, index});
-                    });
+            return sstables::sstable::load_shared_components(cf.schema(), cf._config.datadir, comps.generation, comps.version, comps.format, pc);
+        });
+        return f.then([&db, &local, comps = std::move(comps), func = std::move(func)] (sstables::sstable_open_info info) {
+            // shared components loaded, now opening sstable in all shards with shared components
+            return do_with(std::move(info), [&db, comps = std::move(comps), func = std::move(func)] (auto& info) {
+                return invoke_all_with_ptr(db, std::move(info.components),
+                        [owners = info.owners, data = info.data.dup(), index = info.index.dup(), comps, func] (database& db, auto components) {
+                    auto& cf = db.find_column_family(comps.ks, comps.cf);
+                    return func(cf, sstables::foreign_sstable_open_info{std::move(components), owners, data, index});
                 });
+            }).then([&local] {
+                local.note_sstable_loaded();
             });
         });
     });
 }
 
+void database::note_sstable_loaded() {
+    if (++_stats->sstables_loaded % 1000 == 0) {
+        dblog.info("Loaded {} sstables so far", _stats->sstables_loaded);
+    }
+}
+
 // global_column_family_ptr provides a way to easily retrieve local instance of a given column family.
 class global_column_family_ptr {
     distributed<database>& _db;
@@ -1659,14 +2285,101 @@ load_sstables_with_open_info(std::vector<sstables::foreign_sstable_open_info> ss
     });
 }
 
-// Return all sstables that need resharding in the system. Only one instance of a shared sstable is returned.
-static future<std::vector<sstables::shared_sstable>> get_all_shared_sstables(distributed<database>& db, global_column_family_ptr cf) {
-    class all_shared_sstables {
-        schema_ptr _schema;
-        sstring _dir;
-        std::unordered_map<int64_t, sstables::shared_sstable> _result;
-    public:
-        all_shared_sstables(global_column_family_ptr cf) : _schema(cf->schema()), _dir(cf->dir()) {}
+future<stdx::optional<shard_id>> column_family::pick_compaction_offload_shard() {
+    if (smp::count == 1 || _compaction_manager.get_stats().active_tasks <= 1) {
+        return make_ready_future<stdx::optional<shard_id>>();
+    }
+    struct shard_load {
+        shard_id shard;
+        uint64_t active_tasks;
+        uint64_t backlog;
+    };
+    auto& db = service::get_local_storage_proxy().get_db();
+    return db.map_reduce0([] (database& db) {
+        auto& cm = db.get_compaction_manager();
+        return std::vector<shard_load>{{engine().cpu_id(), cm.get_stats().active_tasks, cm.backlog()}};
+    }, std::vector<shard_load>(), [] (std::vector<shard_load> a, std::vector<shard_load> b) {
+        std::move(b.begin(), b.end(), std::back_inserter(a));
+        return a;
+    }).then([this] (std::vector<shard_load> loads) {
+        auto backlog = _compaction_manager.backlog();
+        stdx::optional<shard_id> helper;
+        uint64_t helper_backlog = backlog / 2;
+        for (auto& l : loads) {
+            if (l.shard != engine().cpu_id() && !l.active_tasks && l.backlog < helper_backlog) {
+                helper = l.shard;
+                helper_backlog = l.backlog;
+            }
+        }
+        return helper;
+    });
+}
+
+future<sstables::compaction_info>
+column_family::offload_compaction(shard_id helper, std::vector<sstables::shared_sstable> sstables, uint64_t max_sstable_bytes, uint32_t level) {
+    struct offloaded_compaction {
+        sstables::compaction_info info;
+        std::vector<sstables::foreign_sstable_open_info> new_sstables;
+    };
+    return seastar::async([this, helper, sstables = std::move(sstables), max_sstable_bytes, level] {
+        dblog.debug("Offloading compaction of {} sstables of {}.{} to shard {}", sstables.size(), _schema->ks_name(), _schema->cf_name(), helper);
+        auto infos = boost::copy_range<std::vector<sstables::foreign_sstable_open_info>>(sstables
+            | boost::adaptors::transformed([] (auto&& sst) { return sst->get_open_info().get0(); }));
+        global_column_family_ptr cf(service::get_local_storage_proxy().get_db(), _schema->ks_name(), _schema->cf_name());
+        auto owner = engine().cpu_id();
+
+        auto result = smp::submit_to(helper, [cf, owner, infos = std::move(infos), max_sstable_bytes, level] () mutable {
+            return load_sstables_with_open_info(std::move(infos), cf->schema(), cf->dir(), [] (auto& info) {
+                return true;
+            }).then([cf, owner, max_sstable_bytes, level] (std::vector<sstables::shared_sstable> sstables) {
+                return do_with(sstables::compaction_info(), [cf, owner, sstables = std::move(sstables), max_sstable_bytes, level] (auto& info) mutable {
+                    auto job = [cf, owner, sstables = std::move(sstables), max_sstable_bytes, level, &info] () mutable {
+                        auto creator = [cf, owner] {
+                            // The generation decides which shard opens the sstable on boot.
+                            auto gen = smp::submit_to(owner, [cf] {
+                                return cf->calculate_generation_for_new_table();
+                            }).get0();
+                            return sstables::make_sstable(cf->schema(), cf->dir(), gen,
+                                cf->sstables_version(), sstables::sstable::format_types::big);
+                        };
+                        return sstables::compact_sstables_for_shard(std::move(sstables), *cf, creator, max_sstable_bytes, level, owner,
+                                cf->background_writer_scheduling_group()).then([&info] (sstables::compaction_info i) {
+                            info = std::move(i);
+                        });
+                    };
+                    return cf->get_compaction_manager().run_offloaded_job(&*cf, std::move(job)).then([&info] {
+                        return seastar::async([&info] {
+                            offloaded_compaction ret;
+                            ret.new_sstables = boost::copy_range<std::vector<sstables::foreign_sstable_open_info>>(info.new_sstables
+                                | boost::adaptors::transformed([] (auto&& sst) { return sst->get_open_info().get0(); }));
+                            info.new_sstables.clear();
+                            ret.info = std::move(info);
+                            return ret;
+                        });
+                    });
+                });
+            });
+        }).get0();
+
+        auto new_sstables = load_sstables_with_open_info(std::move(result.new_sstables), _schema, _config.datadir, [] (auto& info) {
+            return true;
+        }).get0();
+        for (auto& sst : new_sstables) {
+            sst->set_unshared();
+        }
+        result.info.new_sstables = std::move(new_sstables);
+        return std::move(result.info);
+    });
+}
+
+// Return all sstables that need resharding in the system. Only one instance of a shared sstable is returned.
+static future<std::vector<sstables::shared_sstable>> get_all_shared_sstables(distributed<database>& db, global_column_family_ptr cf) {
+    class all_shared_sstables {
+        schema_ptr _schema;
+        sstring _dir;
+        std::unordered_map<int64_t, sstables::shared_sstable> _result;
+    public:
+        all_shared_sstables(global_column_family_ptr cf) : _schema(cf->schema()), _dir(cf->dir()) {}
 
         future<> operator()(std::vector<sstables::foreign_sstable_open_info> ssts_info) {
             return load_sstables_with_open_info(std::move(ssts_info), _schema, _dir, [this] (auto& info) {
@@ -1781,7 +2494,7 @@ void distributed_loader::reshard(distributed<database>& db, sstring ks_name, sst
                     }).get0();
 
                     auto sst = sstables::make_sstable(cf->schema(), cf->dir(), gen,
-                        sstables::sstable::version_types::ka, sstables::sstable::format_types::big,
+                        cf->sstables_version(), sstables::sstable::format_types::big,
                         gc_clock::now(), default_io_error_handler_gen());
                     return sst;
                 };
@@ -1857,6 +2570,8 @@ future<> distributed_loader::load_new_sstables(distributed<database>& db, sstrin
                 }
                 cf._sstables_opened_but_not_loaded.clear();
                 cf.trigger_compaction();
+            }).then([&cf] {
+                return cf.warm_in_memory_cache();
             });
         });
     }).then([&db, ks, cf] () mutable {
@@ -2030,6 +2745,7 @@ future<> distributed_loader::populate_column_family(distributed<database>& db, s
             auto& cf = db.find_column_family(ks, cfname);
             // Make sure this is called even if CF is empty
             cf.mark_ready_for_writes();
+            return cf.warm_in_memory_cache();
         });
     });
 
@@ -2049,6 +2765,20 @@ utils::UUID database::empty_version = utils::UUID_gen::get_name_UUID(bytes{});
 database::database() : database(db::config())
 {}
 
+// Like Cassandra, an unset capacity is 5% of the memory.
+static uint64_t index_summary_memory_budget(const db::config& cfg) {
+    if (cfg.index_summary_capacity_in_mb()) {
+        return uint64_t(cfg.index_summary_capacity_in_mb()) * 1024 * 1024 / smp::count;
+    }
+    return memory::stats().total_memory() / 20;
+}
+
+// -1 disables the resampling, as in Cassandra.
+static std::chrono::minutes index_summary_resize_interval(const db::config& cfg) {
+    auto interval = cfg.index_summary_resize_interval_in_minutes();
+    return std::chrono::minutes(interval == std::numeric_limits<uint32_t>::max() ? 0 : interval);
+}
+
 database::database(const db::config& cfg)
     : _stats(make_lw_shared<db_stats>())
     , _cl_stats(std::make_unique<cell_locker_stats>())
@@ -2061,11 +2791,23 @@ database::database(const db::config& cfg)
     , _memtable_cpu_controller(make_flush_cpu_controller(*_cfg, &_background_writer_scheduling_group, [this, limit = 2.0f * _dirty_memory_manager.throttle_threshold()] {
         return (_dirty_memory_manager.virtual_dirty_memory()) / limit;
     }))
+    , _sstable_load_concurrency_sem(std::max<uint32_t>(_cfg->concurrent_sstable_loads(), 1))
+    , _counter_cache(size_t(_cfg->counter_cache_size_in_mb()) * 1024 * 1024 / smp::count)
+    , _querier_cache(std::chrono::milliseconds(_cfg->querier_cache_ttl_in_ms()), _cfg->querier_cache_ttl_in_ms() ? _cfg->querier_cache_max_entries() : 0)
+    , _index_summary_manager(index_summary_memory_budget(*_cfg), index_summary_resize_interval(*_cfg), [this] {
+        std::vector<sstables::shared_sstable> sstables;
+        for (auto&& cf : _column_families) {
+            auto ssts = cf.second->get_sstables();
+            sstables.insert(sstables.end(), ssts->begin(), ssts->end());
+        }
+        return sstables;
+    })
     , _version(empty_version)
-    , _compaction_manager(std::make_unique<compaction_manager>())
+    , _compaction_manager(std::make_unique<compaction_manager>(_cfg->auto_adjust_compaction_quota()))
     , _enable_incremental_backups(cfg.incremental_backups())
 {
     _compaction_manager->start();
+    _index_summary_manager.start();
     setup_metrics();
 
     dblog.info("Row: max_vector_size: {}, internal_count: {}", size_t(row::max_vector_size), size_t(row::internal_count));
@@ -2110,6 +2852,12 @@ dirty_memory_manager::setup_collectd(sstring namestr) {
 
         sm::make_gauge(namestr +"_virtual_dirty_bytes", [this] { return virtual_dirty_memory(); },
                        sm::description("Holds the size of used memory in bytes. Compare it to \"dirty_bytes\" to see how many memory is wasted (neither used nor available).")),
+
+        sm::make_gauge(namestr + "_flush_bandwidth", [this] { return _flush_bandwidth; },
+                       sm::description("Holds the estimated rate, in bytes per second, at which flushes free dirty memory. Writes above the soft limit are admitted at a rate derived from it.")),
+
+        sm::make_derive(namestr + "_delayed_writes", [this] { return _delayed_writes; },
+                       sm::description("Holds the number of writes delayed because dirty memory was above the soft limit.")),
     });
 }
 
@@ -2149,6 +2897,20 @@ database::setup_metrics() {
                                        "High value in this metric may be an indication of storage being a bottleneck.")),
     });
 
+    _metrics.add_group("sstables", {
+        sm::make_gauge("live_disk_space", _cf_stats.live_disk_space_used,
+                       sm::description("Holds the disk space used by the live sstables of all tables, in bytes.")),
+
+        sm::make_gauge("total_disk_space", _cf_stats.total_disk_space_used,
+                       sm::description("Holds the disk space used by the sstables of all tables, including the compacted ones not deleted yet, in bytes.")),
+
+        sm::make_gauge("live_sstables", _cf_stats.live_sstable_count,
+                       sm::description("Holds the number of live sstables of all tables.")),
+
+        sm::make_gauge("estimated_partitions", _cf_stats.estimated_partitions,
+                       sm::description("Holds the estimated number of partitions in the live sstables of all tables.")),
+    });
+
     _metrics.add_group("database", {
         sm::make_gauge("requests_blocked_memory_current", [this] { return _dirty_memory_manager.region_group().blocked_requests(); },
                        sm::description(
@@ -2173,6 +2935,12 @@ database::setup_metrics() {
                        sm::description("Counts sstables that survived the clustering key filtering. "
                                        "High value indicates that bloom filter is not very efficient and still have to access a lot of sstables to get data.")),
 
+        sm::make_derive("single_key_reads_shadowed_sstables", _cf_stats.sstables_shadowed_for_single_key_reads,
+                       sm::description("Counts sstables single partition reads didn't read, for the data read from newer sstables shadowed theirs.")),
+
+        sm::make_derive("partition_key_reads_from_index", _cf_stats.partition_key_reads_from_index,
+                       sm::description("Counts partition key scans read from the sstable indexes rather than the data files.")),
+
         sm::make_derive("total_writes", _stats->total_writes,
                        sm::description("Counts the total number of successful write operations performed by this shard.")),
 
@@ -2194,6 +2962,9 @@ database::setup_metrics() {
                        sm::description("Counts the number of times the sstable read queue was overloaded. "
                                        "A non-zero value indicates that we have to drop read requests because they arrive faster than we can serve them.")),
 
+        sm::make_derive("sstables_loaded", _stats->sstables_loaded,
+                       sm::description("Counts the number of sstables whose components were loaded from disk by this shard, on startup or refresh.")),
+
         sm::make_gauge("active_reads", [this] { return _stats->active_reads; },
                        sm::description("Holds the number of currently active read operations. "),
                        {user_label_instance}),
@@ -2204,7 +2975,17 @@ database::setup_metrics() {
                                                        "In that case sstable_read_queue_overloads is going to get a non-zero value.", max_memory_concurrent_reads())),
                        {user_label_instance}),
 
-        sm::make_gauge("queued_reads", [this] { return _read_concurrency_sem.waiters(); },
+        sm::make_gauge("view_update_backlog", [this] { return max_memory_pending_view_updates() - _view_update_concurrency_sem.available_units(); },
+                       sm::description(seastar::format("Holds the amount of memory consumed by view updates which are not yet applied. "
+                                                       "Base writes are delayed in proportion to it, and wait when it reaches {}.", max_memory_pending_view_updates()))),
+
+        sm::make_gauge("queued_view_updates", [this] { return _view_update_concurrency_sem.waiters(); },
+                       sm::description("Holds the number of base writes waiting for memory for their view updates.")),
+
+        sm::make_derive("view_update_delayed_writes", _cf_stats.view_update_delayed_writes,
+                       sm::description("Counts the number of base writes delayed because of the view update backlog.")),
+
+        sm::make_gauge("queued_reads", [this] { return _stats->queued_reads; },
                        sm::description("Holds the number of currently queued read operations."),
                        {user_label_instance}),
 
@@ -2233,7 +3014,7 @@ database::setup_metrics() {
                                                        "In that case sstable_read_queue_overloads is going to get a non-zero value.", max_memory_system_concurrent_reads())),
                        {system_label_instance}),
 
-        sm::make_gauge("queued_reads", [this] { return _system_read_concurrency_sem.waiters(); },
+        sm::make_gauge("queued_reads", [this] { return _stats->queued_reads_system_keyspace; },
                        sm::description("Holds the number of currently queued read operations from \"system\" keyspace tables."),
                        {system_label_instance}),
 
@@ -2254,6 +3035,27 @@ database::setup_metrics() {
 
         sm::make_queue_length("counter_cell_lock_pending", _cl_stats->operations_waiting_for_lock,
                              sm::description("The number of counter updates waiting for a lock.")),
+
+        sm::make_derive("counter_cache_hits", [this] { return _counter_cache.hits(); },
+                       sm::description("The number of counter cells whose local shard was found in the counter cache.")),
+
+        sm::make_derive("counter_cache_misses", [this] { return _counter_cache.misses(); },
+                       sm::description("The number of counter cells whose local shard was not found in the counter cache.")),
+
+        sm::make_gauge("counter_cache_bytes", [this] { return _counter_cache.memory_used(); },
+                       sm::description("The memory used by the counter cache.")),
+
+        sm::make_derive("querier_cache_hits", [this] { return _querier_cache.hits(); },
+                       sm::description("The number of pages of single partition queries read by the reader kept from the previous page.")),
+
+        sm::make_derive("querier_cache_misses", [this] { return _querier_cache.misses(); },
+                       sm::description("The number of pages of single partition queries which couldn't be read by the reader kept from the previous page.")),
+
+        sm::make_derive("querier_cache_evictions", [this] { return _querier_cache.evictions(); },
+                       sm::description("The number of readers kept between the pages of their query which were evicted before the next page.")),
+
+        sm::make_gauge("querier_cache_size", [this] { return _querier_cache.size(); },
+                       sm::description("The number of readers kept between the pages of their query.")),
     });
 }
 
@@ -2287,8 +3089,12 @@ future<> distributed_loader::populate_keyspace(distributed<database>& db, sstrin
                 sstring cfname = cf->schema()->cf_name();
                 auto sstdir = ks.column_family_directory(cfname, uuid);
                 dblog.info("Keyspace {}: Reading CF {} ", ks_name, cfname);
+                auto start = std::chrono::steady_clock::now();
                 return ks.make_directory_for_column_family(cfname, uuid).then([&db, sstdir, uuid, ks_name, cfname] {
                     return distributed_loader::populate_column_family(db, sstdir, ks_name, cfname);
+                }).then([ks_name, cfname, start] {
+                    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+                    dblog.info("Keyspace {}: Populated CF {} in {} ms", ks_name, cfname, elapsed.count());
                 }).handle_exception([ks_name, cfname, sstdir](std::exception_ptr eptr) {
                     std::string msg =
                         sprint("Exception while populating keyspace '%s' with column family '%s' from file '%s': %s",
@@ -2302,12 +3108,19 @@ future<> distributed_loader::populate_keyspace(distributed<database>& db, sstrin
 }
 
 static future<> populate(distributed<database>& db, sstring datadir) {
-    return lister::scan_dir(datadir, { directory_entry_type::directory }, [&db] (lister::path datadir, directory_entry de) {
-        auto& ks_name = de.name;
-        if (is_system_keyspace(ks_name)) {
+    // Keyspaces are populated in parallel, the number of sstables being read at
+    // a time is limited by each shard's sstable_load_concurrency_sem().
+    return do_with(std::vector<sstring>(), [&db, datadir] (std::vector<sstring>& ks_names) {
+        return lister::scan_dir(datadir, { directory_entry_type::directory }, [&ks_names] (lister::path datadir, directory_entry de) {
+            if (!is_system_keyspace(de.name)) {
+                ks_names.push_back(de.name);
+            }
             return make_ready_future<>();
-        }
-        return distributed_loader::populate_keyspace(db, datadir.native(), ks_name);
+        }).then([&db, &ks_names, datadir] {
+            return parallel_for_each(ks_names, [&db, datadir] (const sstring& ks_name) {
+                return distributed_loader::populate_keyspace(db, datadir, ks_name);
+            });
+        });
     });
 }
 
@@ -2712,10 +3525,29 @@ keyspace::make_column_family_config(const schema& s, const db::config& db_config
     cfg.read_concurrency_config = _config.read_concurrency_config;
     cfg.streaming_read_concurrency_config = _config.streaming_read_concurrency_config;
     cfg.cf_stats = _config.cf_stats;
+    cfg.view_update_concurrency_semaphore = _config.view_update_concurrency_semaphore;
+    cfg.querier_cache = _config.querier_cache;
+    cfg.view_update_concurrency_semaphore_limit = _config.view_update_concurrency_semaphore_limit;
     cfg.enable_incremental_backups = _config.enable_incremental_backups;
     cfg.background_writer_scheduling_group = _config.background_writer_scheduling_group;
     cfg.memtable_scheduling_group = _config.memtable_scheduling_group;
     cfg.enable_metrics_reporting = db_config.enable_keyspace_column_family_metrics();
+    cfg.sstables_version = db_config.enable_sstables_mc_format() ? sstables::sstable_version_types::mc : sstables::sstable_version_types::ka;
+    cfg.enable_streaming_sstable_writes = _config.enable_disk_writes && db_config.enable_streaming_sstable_writes();
+    cfg.enable_replay_sstable_writes = _config.enable_disk_writes && db_config.commitlog_replay_to_sstables();
+    cfg.replay_run_size = size_t(db_config.commitlog_replay_run_size_in_mb()) << 20;
+    cfg.enable_compaction_offload = _config.enable_disk_writes && db_config.enable_compaction_offload();
+    auto rate = db_config.top_partitions_sample_rate();
+    cfg.top_partitions.sample_every = rate > 0 ? std::max<long>(1, std::lround(1 / std::min(rate, 1.0))) : 0;
+    cfg.top_partitions.window = std::chrono::seconds(db_config.top_partitions_window_in_s());
+    // Recording them in the system tables would write to the system tables again.
+    if (!is_system_keyspace(s.ks_name())) {
+        cfg.large_data_records_per_table = db_config.large_data_records_per_table();
+    }
+    // System tables are small, splitting them would only multiply their sstables.
+    if (!is_system_keyspace(s.ks_name())) {
+        cfg.compaction_groups = std::max<uint32_t>(db_config.compaction_groups(), 1);
+    }
 
     return cfg;
 }
@@ -2860,8 +3692,9 @@ database::existing_index_names(const sstring& ks_name, const sstring& cf_to_excl
 //  - org.apache.cassandra.db.AbstractCell#reconcile()
 //  - org.apache.cassandra.db.BufferExpiringCell#reconcile()
 //  - org.apache.cassandra.db.BufferDeletedCell#reconcile()
-int
-compare_atomic_cell_for_merge(atomic_cell_view left, atomic_cell_view right) {
+template<typename AtomicCellView>
+static int
+do_compare_atomic_cell_for_merge(const AtomicCellView& left, const AtomicCellView& right) {
     if (left.timestamp() != right.timestamp()) {
         return left.timestamp() > right.timestamp() ? 1 : -1;
     }
@@ -2894,15 +3727,25 @@ compare_atomic_cell_for_merge(atomic_cell_view left, atomic_cell_view right) {
     return 0;
 }
 
+int
+compare_atomic_cell_for_merge(atomic_cell_view left, atomic_cell_view right) {
+    return do_compare_atomic_cell_for_merge(left, right);
+}
+
+int
+compare_atomic_cell_for_merge(atomic_cell_fragmented_view left, atomic_cell_fragmented_view right) {
+    return do_compare_atomic_cell_for_merge(left, right);
+}
+
 struct query_state {
     explicit query_state(schema_ptr s,
                          const query::read_command& cmd,
-                         query::result_request request,
+                         query::result_options opts,
                          const dht::partition_range_vector& ranges,
                          query::result_memory_accounter memory_accounter = { })
             : schema(std::move(s))
             , cmd(cmd)
-            , builder(cmd.slice, request, std::move(memory_accounter))
+            , builder(cmd.slice, opts, std::move(memory_accounter))
             , limit(cmd.row_limit)
             , partition_limit(cmd.partition_limit)
             , current_partition_range(ranges.begin())
@@ -2928,29 +3771,135 @@ struct query_state {
     }
 };
 
+void column_family::invalidate_queriers() {
+    ++_querier_generation;
+    if (_config.querier_cache) {
+        _config.querier_cache->evict_all_for_table(_schema->id());
+    }
+}
+
+// Reads the page of a single partition query with the querier the previous
+// page was read with, if it was kept, and keeps the querier in turn when the
+// page ends inside the partition.
+future<> column_family::query_with_querier(query_state& qs) {
+    auto& cache = *_config.querier_cache;
+    auto& cmd = qs.cmd;
+    auto& range = *qs.current_partition_range++;
+    // Suspended readers hold on to memory which the reads waiting for it
+    // can make better use of.
+    auto sem = _config.read_concurrency_config.resources_sem;
+    while (sem && sem->waiters() && cache.evict_oldest()) { }
+    auto generation = _querier_generation;
+    std::unique_ptr<querier> q;
+    if (!cmd.is_first_page) {
+        q = cache.lookup(cmd.query_uuid, cmd, range, generation);
+    }
+    if (!q) {
+        q = std::make_unique<querier>(as_mutation_source(), qs.schema, shared_from_this(), generation, range, cmd.slice,
+                service::get_local_query_read_priority(cmd.service_level));
+    }
+    auto& qr = *q;
+    return data_query(qs.schema, qr, cmd.slice, qs.remaining_rows(), qs.remaining_partitions(), cmd.timestamp, qs.builder).then(
+            [this, &cache, &cmd, generation, q = std::move(q)] () mutable {
+        if (q->is_suspended() && generation == _querier_generation) {
+            cache.insert(cmd.query_uuid, std::move(q));
+        }
+    });
+}
+
+// Index pages read at once by the prefetch of a multi-partition read.
+static constexpr size_t index_prefetch_concurrency = 16;
+
+// The partitions of a multi-partition read are read one after the other, so
+// their index lookups would be too. The index pages of all of them, in all
+// the sstables which may have them, are instead read up front, in the
+// background. The reads then find the pages in the index page cache, or
+// wait for the prefetch already reading them.
+void column_family::prefetch_index_pages(const schema& s, const dht::partition_range_vector& ranges, const io_priority_class& pc) const {
+    std::vector<std::pair<sstables::shared_sstable, dht::ring_position>> pages;
+    for (auto&& pr : ranges) {
+        if (!pr.is_singular() || !pr.start()->value().has_key()) {
+            continue;
+        }
+        auto& pos = pr.start()->value();
+        auto key = sstables::key::from_partition_key(s, *pos.key());
+        for (auto&& sst : _sstables->select(pr)) {
+            if (sst->filter_has_key(key)) {
+                pages.emplace_back(sst, pos);
+            }
+        }
+    }
+    if (pages.empty()) {
+        return;
+    }
+    auto sem = make_lw_shared<semaphore>(index_prefetch_concurrency);
+    do_with(std::move(pages), [sem, &pc] (auto& pages) {
+        return parallel_for_each(pages, [sem, &pc] (auto& p) {
+            return with_semaphore(*sem, 1, [&p, &pc] {
+                return p.first->prefetch_index_page(p.second, pc);
+            });
+        });
+    }).handle_exception([] (std::exception_ptr ep) {
+        // The reads will run into the failure themselves.
+        dblog.debug("Failed to prefetch index pages: {}", ep);
+    });
+}
+
+static void add_stage_latency(utils::log_linear_histogram& h, const utils::latency_counter& lc) {
+    h.add(lc.latency());
+}
+
 future<lw_shared_ptr<query::result>>
-column_family::query(schema_ptr s, const query::read_command& cmd, query::result_request request,
+column_family::query(schema_ptr s, const query::read_command& cmd, query::result_options opts,
                      const dht::partition_range_vector& partition_ranges,
                      tracing::trace_state_ptr trace_state, query::result_memory_limiter& memory_limiter,
                      uint64_t max_size) {
     utils::latency_counter lc;
     _stats.reads.set_latency(lc);
-    auto f = request == query::result_request::only_digest
+    // Only single partition reads are attributed to a partition.
+    for (auto&& pr : partition_ranges) {
+        if (pr.is_singular() && pr.start()->value().has_key() && _top_partitions.sample()) {
+            _top_partitions.record_read(*pr.start()->value().key());
+        }
+    }
+    // The coordinator may ask for smaller pages, digests included, so that
+    // they stop at the same row as the data.
+    if (cmd.max_result_size && cmd.slice.options.contains<query::partition_slice::option::allow_short_read>()) {
+        max_size = std::min(max_size, cmd.max_result_size);
+    }
+    auto f = opts.request == query::result_request::only_digest
              ? memory_limiter.new_digest_read(max_size) : memory_limiter.new_data_read(max_size);
-    return f.then([this, lc, s = std::move(s), &cmd, request, &partition_ranges, trace_state = std::move(trace_state)] (query::result_memory_accounter accounter) mutable {
-        auto qs_ptr = std::make_unique<query_state>(std::move(s), cmd, request, partition_ranges, std::move(accounter));
+    return f.then([this, lc, s = std::move(s), &cmd, opts, &partition_ranges, trace_state = std::move(trace_state)] (query::result_memory_accounter accounter) mutable {
+        utils::latency_counter execution;
+        if (lc.is_start()) {
+            execution.start();
+            add_stage_latency(_stats.estimated_read_admission, utils::latency_counter(lc).stop());
+        }
+        auto qs_ptr = std::make_unique<query_state>(std::move(s), cmd, opts, partition_ranges, std::move(accounter));
         auto& qs = *qs_ptr;
-        return do_until(std::bind(&query_state::done, &qs), [this, &qs, trace_state = std::move(trace_state)] {
-            auto&& range = *qs.current_partition_range++;
-            return data_query(qs.schema, as_mutation_source(), range, qs.cmd.slice, qs.remaining_rows(),
-                              qs.remaining_partitions(), qs.cmd.timestamp, qs.builder, trace_state);
-        }).then([qs_ptr = std::move(qs_ptr), &qs] {
+        // Reads served from memory don't defer, and are charged entirely.
+        utils::cost_guard cost(_cost.get());
+        auto f = make_ready_future<>();
+        if (_config.querier_cache && partition_ranges.size() == 1 && querier::can_be_saved(cmd, partition_ranges.front(), trace_state)) {
+            f = query_with_querier(qs);
+        } else {
+            if (partition_ranges.size() > 1) {
+                prefetch_index_pages(*qs.schema, partition_ranges, service::get_local_query_read_priority(cmd.service_level));
+            }
+            f = do_until(std::bind(&query_state::done, &qs), [this, &qs, trace_state = std::move(trace_state)] {
+                auto&& range = *qs.current_partition_range++;
+                return data_query(qs.schema, as_mutation_source(), range, qs.cmd.slice, qs.remaining_rows(),
+                                  qs.remaining_partitions(), qs.cmd.timestamp, qs.builder,
+                                  service::get_local_query_read_priority(qs.cmd.service_level), trace_state);
+            });
+        }
+        return f.then([qs_ptr = std::move(qs_ptr), &qs] {
             return make_ready_future<lw_shared_ptr<query::result>>(
                     make_lw_shared<query::result>(qs.builder.build()));
-        }).finally([lc, this]() mutable {
+        }).finally([lc, execution, this]() mutable {
             _stats.reads.mark(lc);
             if (lc.is_start()) {
-                _stats.estimated_read.add(lc.latency(), _stats.reads.hist.count);
+                add_stage_latency(_stats.estimated_read_execution, execution.stop());
             }
         });
     });
@@ -2969,29 +3918,58 @@ column_family::as_mutation_source() const {
     });
 }
 
-void column_family::add_coordinator_read_latency(utils::estimated_histogram::duration latency) {
-    _stats.estimated_coordinator_read.add(std::chrono::duration_cast<std::chrono::microseconds>(latency).count());
+// Latencies seen more than a few half-lives ago hardly count, so that the
+// percentile follows a replica getting slow, or fast again, within seconds.
+static constexpr auto coordinator_read_latency_half_life = 10s;
+
+column_family::coordinator_read_latency::coordinator_read_latency()
+    : histogram(coordinator_read_latency_half_life, lowres_clock::now()) {
+}
+
+void column_family::add_coordinator_read_latency(db::consistency_level cl, utils::latency_counter::duration latency) {
+    _stats.estimated_coordinator_read.add(latency);
+    _coordinator_read_latencies[cl].histogram.add(latency, lowres_clock::now());
+}
+
+void column_family::add_write_commitlog_latency(utils::latency_counter& lc) {
+    if (lc.is_start()) {
+        add_stage_latency(_stats.estimated_write_commitlog, lc.stop());
+    }
+}
+
+void column_family::add_write_memory_wait_latency(utils::latency_counter& lc) {
+    if (lc.is_start()) {
+        add_stage_latency(_stats.estimated_write_memory_wait, lc.stop());
+    }
 }
 
-std::chrono::milliseconds column_family::get_coordinator_read_latency_percentile(double percentile) {
-    if (_cached_percentile != percentile || lowres_clock::now() - _percentile_cache_timestamp > 1s) {
-        _percentile_cache_timestamp = lowres_clock::now();
-        _cached_percentile = percentile;
-        _percentile_cache_value = std::max(_stats.estimated_coordinator_read.percentile(percentile) / 1000, int64_t(1)) * 1ms;
-        _stats.estimated_coordinator_read *= 0.9; // decay values a little to give new data points more weight
+std::chrono::microseconds column_family::get_coordinator_read_latency_percentile(db::consistency_level cl, double percentile) {
+    auto now = lowres_clock::now();
+    auto& l = _coordinator_read_latencies[cl];
+    if (l.cached_percentile != percentile || now - l.cache_timestamp > 100ms) {
+        l.cache_timestamp = now;
+        l.cached_percentile = percentile;
+        // A percentile means little until reads above it were likely seen.
+        auto min_weight = std::max(10.0, std::min(1000.0, 1 / (1 - percentile)));
+        if (l.histogram.count(now) < min_weight) {
+            l.cached_value = std::chrono::microseconds::max();
+        } else {
+            l.cached_value = l.histogram.percentile(percentile, now);
+        }
     }
-    return _percentile_cache_value;
+    return l.cached_value;
 }
 
 static thread_local auto data_query_stage = seastar::make_execution_stage("data_query", &column_family::query);
 
 future<lw_shared_ptr<query::result>, cache_temperature>
-database::query(schema_ptr s, const query::read_command& cmd, query::result_request request, const dht::partition_range_vector& ranges, tracing::trace_state_ptr trace_state,
+database::query(schema_ptr s, const query::read_command& cmd, query::result_options opts, const dht::partition_range_vector& ranges, tracing::trace_state_ptr trace_state,
                 uint64_t max_result_size) {
     column_family& cf = find_column_family(cmd.cf_id);
-    return data_query_stage(&cf, std::move(s), seastar::cref(cmd), request, seastar::cref(ranges),
+    auto hit_rate = ranges.size() == 1 ? cf.get_cache_hit_rate(ranges[0]) : cf.get_global_cache_hit_rate();
+    return data_query_stage(&cf, std::move(s), seastar::cref(cmd), opts, seastar::cref(ranges),
                             std::move(trace_state), seastar::ref(get_result_memory_limiter()),
-                            max_result_size).then_wrapped([this, s = _stats, hit_rate = cf.get_global_cache_hit_rate()] (auto f) {
+                            max_result_size).then_wrapped([this, s = _stats, hit_rate] (auto f) {
         if (f.failed()) {
             ++s->total_reads_failed;
             return make_exception_future<lw_shared_ptr<query::result>, cache_temperature>(f.get_exception());
@@ -3008,8 +3986,9 @@ future<reconcilable_result, cache_temperature>
 database::query_mutations(schema_ptr s, const query::read_command& cmd, const dht::partition_range& range,
                           query::result_memory_accounter&& accounter, tracing::trace_state_ptr trace_state) {
     column_family& cf = find_column_family(cmd.cf_id);
+    utils::cost_guard cost(&cf.cost());
     return mutation_query(std::move(s), cf.as_mutation_source(), range, cmd.slice, cmd.row_limit, cmd.partition_limit,
-            cmd.timestamp, std::move(accounter), std::move(trace_state)).then_wrapped([this, s = _stats, hit_rate = cf.get_global_cache_hit_rate()] (auto f) {
+            cmd.timestamp, std::move(accounter), std::move(trace_state)).then_wrapped([this, s = _stats, hit_rate = cf.get_cache_hit_rate(range)] (auto f) {
         if (f.failed()) {
             ++s->total_reads_failed;
             return make_exception_future<reconcilable_result, cache_temperature>(f.get_exception());
@@ -3099,6 +4078,7 @@ void column_family::do_apply(db::rp_handle&& h, Args&&... args) {
     _stats.writes.set_latency(lc);
     db::replay_position rp = h;
     check_valid_rp(rp);
+    sample_write(args...);
     try {
         _memtables->active_memtable().apply(std::forward<Args>(args)..., std::move(h));
         _highest_rp = std::max(_highest_rp, rp);
@@ -3107,18 +4087,77 @@ void column_family::do_apply(db::rp_handle&& h, Args&&... args) {
         throw;
     }
     _stats.writes.mark(lc);
-    if (lc.is_start()) {
-        _stats.estimated_write.add(lc.latency(), _stats.writes.hist.count);
+}
+
+void column_family::sample_write(const mutation& m) {
+    if (_top_partitions.sample()) {
+        _top_partitions.record_write(m.key());
     }
 }
 
+void column_family::sample_write(const frozen_mutation& m, const schema_ptr& m_schema) {
+    if (_top_partitions.sample()) {
+        _top_partitions.record_write(partition_key(m.key(*m_schema)));
+    }
+}
+
+namespace {
+
+// Finds whether a mutation deletes anything.
+class tombstone_finder : public mutation_partition_visitor {
+    bool _found = false;
+public:
+    bool found() const {
+        return _found;
+    }
+    virtual void accept_partition_tombstone(tombstone t) override {
+        _found |= bool(t);
+    }
+    virtual void accept_static_cell(column_id, atomic_cell_view cell) override {
+        _found |= !cell.is_live();
+    }
+    virtual void accept_static_cell(column_id, collection_mutation_view) override {
+        _found = true;
+    }
+    virtual void accept_row_tombstone(const range_tombstone&) override {
+        _found = true;
+    }
+    virtual void accept_row(position_in_partition_view, const row_tombstone& deleted_at, const row_marker&, is_dummy, is_continuous) override {
+        _found |= bool(deleted_at);
+    }
+    virtual void accept_row_cell(column_id, atomic_cell_view cell) override {
+        _found |= !cell.is_live();
+    }
+    virtual void accept_row_cell(column_id, collection_mutation_view) override {
+        _found = true;
+    }
+};
+
+}
+
 void
 column_family::apply(const mutation& m, db::rp_handle&& h) {
+    utils::cost_guard cost(_cost.get());
+    if (_schema->is_counter()) {
+        tombstone_finder finder;
+        m.partition().accept(*_schema, finder);
+        if (finder.found()) {
+            invalidate_counter_cache();
+        }
+    }
     do_apply(std::move(h), m);
 }
 
 void
 column_family::apply(const frozen_mutation& m, const schema_ptr& m_schema, db::rp_handle&& h) {
+    utils::cost_guard cost(_cost.get());
+    if (_schema->is_counter()) {
+        tombstone_finder finder;
+        m.partition().accept(*m_schema, finder);
+        if (finder.found()) {
+            invalidate_counter_cache();
+        }
+    }
     do_apply(std::move(h), m, m_schema);
 }
 
@@ -3161,28 +4200,45 @@ future<mutation> database::do_apply_counter_update(column_family& cf, const froz
 
             // Before counter update is applied it needs to be transformed from
             // deltas to counter shards. To do that, we need to read the current
-            // counter state for each modified cell...
-
-            tracing::trace(trace_state, "Reading counter values from the CF");
-            return counter_write_query(m_schema, cf.as_mutation_source(), m.decorated_key(), slice, trace_state)
-                    .then([this, &cf, &m, m_schema, timeout, trace_state] (auto mopt) {
-                // ...now, that we got existing state of all affected counter
-                // cells we can look for our shard in each of them, increment
-                // its clock and apply the delta.
-                transform_counter_updates_to_shards(m, mopt ? &*mopt : nullptr, cf.failed_counter_applies_to_memtable());
+            // counter state for each modified cell, unless our shard of all of
+            // them is cached...
+
+            auto generation = cf.counter_cache_generation();
+            auto f = make_ready_future<>();
+            if (transform_counter_updates_to_shards(m, _counter_cache, generation, cf.failed_counter_applies_to_memtable())) {
+                tracing::trace(trace_state, "Counter values found in the counter cache");
+            } else {
+                tracing::trace(trace_state, "Reading counter values from the CF");
+                f = counter_write_query(m_schema, cf.as_mutation_source(), m.decorated_key(), slice, trace_state)
+                        .then([&cf, &m] (auto mopt) {
+                    // ...now, that we got existing state of all affected counter
+                    // cells we can look for our shard in each of them, increment
+                    // its clock and apply the delta.
+                    transform_counter_updates_to_shards(m, mopt ? &*mopt : nullptr, cf.failed_counter_applies_to_memtable());
+                });
+            }
+            return f.then([this, &cf, &m, timeout, trace_state] {
                 tracing::trace(trace_state, "Applying counter update");
                 return this->apply_with_commitlog(cf, m, timeout);
-            }).then([&m] {
-                return std::move(m);
+            }).then_wrapped([this, &cf, &m, generation] (future<> f) {
+                if (f.failed()) {
+                    invalidate_counter_cache(m, _counter_cache);
+                    return make_exception_future<mutation>(f.get_exception());
+                }
+                // A generation bumped meanwhile leaves the cells stale.
+                update_counter_cache(m, _counter_cache, generation);
+                return make_ready_future<mutation>(std::move(m));
             });
         });
     });
 }
 
 void column_family::apply_streaming_mutation(schema_ptr m_schema, utils::UUID plan_id, const frozen_mutation& m, bool fragmented) {
+    utils::cost_guard cost(_cost.get());
     if (dblog.is_enabled(logging::log_level::trace)) {
         dblog.trace("streaming apply {}", m.pretty_printer(m_schema));
     }
+    invalidate_counter_cache();
     if (fragmented) {
         apply_streaming_big_mutation(std::move(m_schema), plan_id, m);
         return;
@@ -3196,10 +4252,248 @@ void column_family::apply_streaming_big_mutation(schema_ptr m_schema, utils::UUI
         it = _streaming_memtables_big.emplace(plan_id, make_lw_shared<streaming_memtable_big>()).first;
         it->second->memtables = _config.enable_disk_writes ? make_streaming_memtable_big_list(*it->second) : make_memory_only_memtable_list();
     }
+    invalidate_counter_cache();
     auto entry = it->second;
     entry->memtables->active_memtable().apply(m, m_schema);
 }
 
+namespace {
+
+// Returns the partitions pushed to a queue, until a disengaged one.
+class queue_reader final : public mutation_reader::impl {
+    lw_shared_ptr<queue<streamed_mutation_opt>> _queue;
+public:
+    explicit queue_reader(lw_shared_ptr<queue<streamed_mutation_opt>> q) : _queue(std::move(q)) { }
+    virtual future<streamed_mutation_opt> operator()() override {
+        return _queue->pop_eventually();
+    }
+};
+
+}
+
+column_family::streaming_sstable_writer::streaming_sstable_writer(column_family& cf)
+    : _cf(cf)
+    , _window(dht::decorated_key::less_comparator(cf.schema()))
+{ }
+
+void column_family::streaming_sstable_writer::start_sstable() {
+    auto sst = sstables::make_sstable(_cf._schema, _cf._config.datadir, _cf.calculate_generation_for_new_table(),
+            _cf.sstables_version(), sstables::sstable::format_types::big);
+    sst->set_unshared();
+    _sstables.push_back(sst);
+    _queue = make_lw_shared<queue<streamed_mutation_opt>>(16);
+
+    sstables::sstable_writer_config cfg;
+    cfg.backup = _cf.incremental_backups_enabled();
+    cfg.leave_unsealed = true;
+    cfg.thread_scheduling_group = _cf._config.background_writer_scheduling_group;
+    // The writer rebuilds the filter for the partitions actually written when
+    // there are much fewer of them.
+    static constexpr uint64_t estimated_partitions = 64 * 1024;
+    auto&& priority = service::get_local_streaming_write_priority();
+    _written = with_gate(_cf._streaming_flush_gate, [this, sst, q = _queue, cfg, &priority] {
+        return sst->write_components(make_mutation_reader<queue_reader>(q), estimated_partitions, _cf.schema(), cfg, priority);
+    }).handle_exception([q = _queue] (auto ep) {
+        dblog.error("failed to write streamed sstable: {}", ep);
+        // Fails the pushes waiting for the writer.
+        q->abort(ep);
+        return make_exception_future<>(ep);
+    });
+}
+
+future<> column_family::streaming_sstable_writer::end_sstable() {
+    if (!_queue) {
+        return make_ready_future<>();
+    }
+    auto q = std::exchange(_queue, {});
+    return q->push_eventually(streamed_mutation_opt()).then([this] {
+        return std::exchange(_written, make_ready_future<>());
+    });
+}
+
+future<> column_family::streaming_sstable_writer::write_first() {
+    auto it = _window.begin();
+    auto dk = it->first;
+    auto m = std::move(it->second.m);
+    _window_size -= it->second.size;
+    _window.erase(it);
+
+    auto f = make_ready_future<>();
+    if (_last_written && !_last_written->less_compare(*_cf.schema(), dk)) {
+        f = end_sstable();
+    }
+    _last_written = std::move(dk);
+    return f.then([this, m = std::move(m)] () mutable {
+        if (!_queue) {
+            start_sstable();
+        }
+        return _queue->push_eventually(streamed_mutation_from_mutation(std::move(m)));
+    });
+}
+
+future<> column_family::streaming_sstable_writer::write(schema_ptr m_schema, const frozen_mutation& fm) {
+    if (_aborted) {
+        return make_exception_future<>(std::runtime_error("streaming plan was aborted"));
+    }
+    auto m = fm.unfreeze(m_schema);
+    if (m_schema != _cf.schema()) {
+        m.upgrade(_cf.schema());
+    }
+    auto size = fm.representation().size();
+    auto it = _window.find(m.decorated_key());
+    if (it != _window.end()) {
+        it->second.m.apply(std::move(m));
+        it->second.size += size;
+    } else {
+        auto dk = m.decorated_key();
+        _window.emplace(std::move(dk), window_entry{std::move(m), size});
+    }
+    _window_size += size;
+    if (_window_size <= window_size_limit) {
+        return make_ready_future<>();
+    }
+    return with_semaphore(_write_sem, 1, [this] {
+        return do_until([this] { return _aborted || _window_size <= window_size_limit; }, [this] {
+            return write_first();
+        });
+    });
+}
+
+future<std::vector<sstables::shared_sstable>> column_family::streaming_sstable_writer::finish() {
+    return with_semaphore(_write_sem, 1, [this] {
+        return do_until([this] { return _window.empty(); }, [this] {
+            return write_first();
+        }).then([this] {
+            return end_sstable();
+        });
+    }).then([this] {
+        return parallel_for_each(_sstables, [this] (auto& sst) {
+            return sst->seal_sstable(_cf.incremental_backups_enabled()).then([sst] {
+                return sst->open_data();
+            });
+        });
+    }).then([this] {
+        return std::move(_sstables);
+    });
+}
+
+future<> column_family::streaming_sstable_writer::abort() {
+    _aborted = true;
+    _window.clear();
+    _window_size = 0;
+    if (_queue) {
+        _queue->abort(std::make_exception_ptr(std::runtime_error("streaming plan was aborted")));
+    }
+    return with_semaphore(_write_sem, 1, [this] {
+        return std::exchange(_written, make_ready_future<>()).handle_exception([] (auto ep) { });
+    }).then([this] {
+        for (auto&& sst : _sstables) {
+            sst->mark_for_deletion();
+        }
+    });
+}
+
+future<> column_family::write_streaming_mutation(schema_ptr m_schema, utils::UUID plan_id, const frozen_mutation& m) {
+    if (dblog.is_enabled(logging::log_level::trace)) {
+        dblog.trace("streaming write {}", m.pretty_printer(m_schema));
+    }
+    auto it = _streaming_sstable_writers.find(plan_id);
+    if (it == _streaming_sstable_writers.end()) {
+        it = _streaming_sstable_writers.emplace(plan_id, make_lw_shared<streaming_sstable_writer>(*this)).first;
+    }
+    invalidate_counter_cache();
+    auto writer = it->second;
+    return writer->write(std::move(m_schema), m).finally([writer] { });
+}
+
+column_family::replay_sstable_writer::replay_sstable_writer(column_family& cf)
+    : _cf(cf)
+    , _run(dht::decorated_key::less_comparator(cf.schema()))
+{ }
+
+future<> column_family::replay_sstable_writer::write_run() {
+    if (_run.empty()) {
+        return make_ready_future<>();
+    }
+    std::vector<mutation> run;
+    run.reserve(_run.size());
+    for (auto&& e : _run) {
+        run.push_back(std::move(e.second));
+    }
+    _run.clear();
+    _run_size = 0;
+    return with_semaphore(_write_sem, 1, [this, run = std::move(run)] () mutable {
+        auto sst = sstables::make_sstable(_cf._schema, _cf._config.datadir, _cf.calculate_generation_for_new_table(),
+                _cf.sstables_version(), sstables::sstable::format_types::big);
+        sst->set_unshared();
+        _sstables.push_back(sst);
+        dblog.debug("Writing {} replayed partitions to {}", run.size(), sst->get_filename());
+
+        sstables::sstable_writer_config cfg;
+        cfg.backup = _cf.incremental_backups_enabled();
+        cfg.leave_unsealed = true;
+        cfg.thread_scheduling_group = _cf._config.memtable_scheduling_group;
+        auto partitions = run.size();
+        auto&& priority = service::get_local_memtable_flush_priority();
+        return sst->write_components(make_reader_returning_many(std::move(run)), partitions, _cf.schema(), cfg, priority);
+    });
+}
+
+future<> column_family::replay_sstable_writer::write(mutation m, size_t size) {
+    auto it = _run.find(m.decorated_key());
+    if (it != _run.end()) {
+        it->second.apply(std::move(m));
+    } else {
+        auto dk = m.decorated_key();
+        _run.emplace(std::move(dk), std::move(m));
+    }
+    _run_size += size;
+    if (_run_size < _cf._config.replay_run_size) {
+        return make_ready_future<>();
+    }
+    return write_run();
+}
+
+future<std::vector<sstables::shared_sstable>> column_family::replay_sstable_writer::finish() {
+    return write_run().then([this] {
+        // Waits for the runs still being written.
+        return with_semaphore(_write_sem, 1, [] { });
+    }).then([this] {
+        return parallel_for_each(_sstables, [this] (auto& sst) {
+            return sst->seal_sstable(_cf.incremental_backups_enabled()).then([sst] {
+                return sst->open_data();
+            });
+        });
+    }).then([this] {
+        return std::move(_sstables);
+    });
+}
+
+future<> column_family::write_replayed_mutation(mutation m, size_t size) {
+    if (!_replay_sstable_writer) {
+        _replay_sstable_writer = make_lw_shared<replay_sstable_writer>(*this);
+    }
+    auto writer = _replay_sstable_writer;
+    return writer->write(std::move(m), size).finally([writer] { });
+}
+
+future<> column_family::finish_replayed_writes() {
+    if (!_replay_sstable_writer) {
+        return make_ready_future<>();
+    }
+    auto writer = std::exchange(_replay_sstable_writer, {});
+    return writer->finish().then([this] (auto sstables) {
+        dblog.info("Loading {} sstables written by the commitlog replay of {}.{}", sstables.size(), _schema->ks_name(), _schema->cf_name());
+        return _cache.invalidate([this, sstables = std::move(sstables)] () mutable noexcept {
+            // FIXME: this is not really noexcept, but we need to provide strong exception guarantees.
+            for (auto&& sst : sstables) {
+                this->add_sstable(sst, {engine().cpu_id()});
+            }
+            this->try_trigger_compaction();
+        });
+    }).finally([writer] { });
+}
+
 void
 column_family::check_valid_rp(const db::replay_position& rp) const {
     if (rp != db::replay_position() && rp < _lowest_allowed_rp) {
@@ -3307,22 +4601,83 @@ void dirty_memory_manager::start_reclaiming() noexcept {
     _should_flush.signal();
 }
 
+constexpr std::chrono::milliseconds dirty_memory_manager::_throttle_period;
+constexpr double dirty_memory_manager::_flush_bandwidth_smoothing;
+constexpr std::chrono::milliseconds dirty_memory_manager::_max_write_delay;
+
+void dirty_memory_manager::update_flush_bandwidth() {
+    auto flushed = std::max<int64_t>(_bytes_flushed_in_period, 0);
+    _bytes_flushed_in_period = 0;
+    // Periods in which no flush writes say nothing about the bandwidth.
+    if (flushed || !_flush_serializer.available_units()) {
+        auto bandwidth = flushed / std::chrono::duration<double>(_throttle_period).count();
+        _flush_bandwidth = _flush_bandwidth ? _flush_bandwidth + _flush_bandwidth_smoothing * (bandwidth - _flush_bandwidth) : bandwidth;
+    }
+    _tables_written = std::max(_tables_written_in_period, 1u);
+    _tables_written_in_period = 0;
+    ++_throttle_period;
+}
+
+std::chrono::steady_clock::duration dirty_memory_manager::write_delay(write_throttle& throttle, size_t size) {
+    if (throttle._period != _throttle_period) {
+        throttle._period = _throttle_period;
+        ++_tables_written_in_period;
+    }
+    auto soft_limit = soft_limit_threshold();
+    auto used = virtual_dirty_memory();
+    if (used <= soft_limit || !_flush_bandwidth) {
+        return std::chrono::steady_clock::duration(0);
+    }
+    auto excess = std::min(double(used - soft_limit) / (throttle_threshold() - soft_limit), 1.0);
+    auto rate = 2 * _flush_bandwidth * (1 - excess) / _tables_written;
+    auto now = std::chrono::steady_clock::now();
+    auto latest = now + _max_write_delay;
+    auto cost = rate ? std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(size / rate))
+                     : std::chrono::steady_clock::duration(_max_write_delay);
+    throttle._next_admission = std::min(std::max(throttle._next_admission, now) + cost, latest);
+    auto delay = throttle._next_admission - now;
+    if (delay.count() > 0) {
+        ++_delayed_writes;
+    }
+    return delay;
+}
+
+// Waits for the write throttle of the table, unless that would take the write past its
+// timeout, in which case it is left to wait for memory, if it has to, as unthrottled writes do.
+static future<> throttle_write(column_family& cf, size_t size, column_family::timeout_clock::time_point timeout) {
+    auto delay = cf.write_delay(size);
+    if (delay.count() <= 0 || std::chrono::steady_clock::duration(timeout - column_family::timeout_clock::now()) <= delay) {
+        return make_ready_future<>();
+    }
+    return sleep(delay);
+}
+
 future<> database::apply_in_memory(const frozen_mutation& m, schema_ptr m_schema, db::rp_handle&& h, timeout_clock::time_point timeout) {
     auto& cf = find_column_family(m.column_family_id());
-    return cf.dirty_memory_region_group().run_when_memory_available([this, &m, m_schema = std::move(m_schema), h = std::move(h)]() mutable {
+    utils::latency_counter lc;
+    cf.sample_write_latency(lc);
+    return throttle_write(cf, m.representation().size(), timeout).then([this, &m, m_schema = std::move(m_schema), h = std::move(h), lc, timeout] () mutable {
+      return find_column_family(m.column_family_id()).dirty_memory_region_group().run_when_memory_available([this, &m, m_schema = std::move(m_schema), h = std::move(h), lc]() mutable {
         try {
             auto& cf = find_column_family(m.column_family_id());
+            cf.add_write_memory_wait_latency(lc);
             cf.apply(m, m_schema, std::move(h));
         } catch (no_such_column_family&) {
             dblog.error("Attempting to mutate non-existent table {}", m.column_family_id());
         }
-    }, timeout);
+      }, timeout);
+    });
 }
 
 future<> database::apply_in_memory(const mutation& m, column_family& cf, db::rp_handle&& h, timeout_clock::time_point timeout) {
-    return cf.dirty_memory_region_group().run_when_memory_available([this, &m, &cf, h = std::move(h)]() mutable {
+    utils::latency_counter lc;
+    cf.sample_write_latency(lc);
+    return throttle_write(cf, m.partition().external_memory_usage(), timeout).then([this, &m, &cf, h = std::move(h), lc, timeout] () mutable {
+      return cf.dirty_memory_region_group().run_when_memory_available([this, &m, &cf, h = std::move(h), lc]() mutable {
+        cf.add_write_memory_wait_latency(lc);
         cf.apply(m, std::move(h));
-    }, timeout);
+      }, timeout);
+    });
 }
 
 future<mutation> database::apply_counter_update(schema_ptr s, const frozen_mutation& m, timeout_clock::time_point timeout, tracing::trace_state_ptr trace_state) {
@@ -3354,10 +4709,13 @@ static future<> maybe_handle_reorder(std::exception_ptr exp) {
 
 future<> database::apply_with_commitlog(column_family& cf, const mutation& m, timeout_clock::time_point timeout) {
     if (cf.commitlog() != nullptr) {
+        utils::latency_counter lc;
+        cf.sample_write_latency(lc);
         return do_with(freeze(m), [this, &m, &cf, timeout] (frozen_mutation& fm) {
             commitlog_entry_writer cew(m.schema(), fm);
             return cf.commitlog()->add_entry(m.schema()->id(), cew, timeout);
-        }).then([this, &m, &cf, timeout] (db::rp_handle h) {
+        }).then([this, &m, &cf, timeout, lc] (db::rp_handle h) mutable {
+            cf.add_write_commitlog_latency(lc);
             return apply_in_memory(m, cf, std::move(h), timeout).handle_exception(maybe_handle_reorder);
         });
     }
@@ -3368,7 +4726,14 @@ future<> database::apply_with_commitlog(schema_ptr s, column_family& cf, utils::
     auto cl = cf.commitlog();
     if (cl != nullptr) {
         commitlog_entry_writer cew(s, m);
-        return cf.commitlog()->add_entry(uuid, cew, timeout).then([&m, this, s, timeout, cl](db::rp_handle h) {
+        utils::latency_counter lc;
+        cf.sample_write_latency(lc);
+        return cf.commitlog()->add_entry(uuid, cew, timeout).then([&m, this, s, timeout, cl, lc](db::rp_handle h) mutable {
+            if (lc.is_start()) {
+                // Throws, like apply_in_memory() would, when the table was
+                // dropped meanwhile.
+                find_column_family(m.column_family_id()).add_write_commitlog_latency(lc);
+            }
             return this->apply_in_memory(m, s, std::move(h), timeout).handle_exception(maybe_handle_reorder);
         });
     }
@@ -3430,6 +4795,10 @@ future<> database::apply_streaming_mutation(schema_ptr s, utils::UUID plan_id, c
         throw std::runtime_error(sprint("attempted to mutate using not synced schema of %s.%s, version=%s",
                                  s->ks_name(), s->cf_name(), s->version()));
     }
+    auto& cf = find_column_family(m.column_family_id());
+    if (cf.writes_streaming_to_sstables()) {
+        return cf.write_streaming_mutation(std::move(s), plan_id, m);
+    }
     return _streaming_dirty_memory_manager.region_group().run_when_memory_available([this, &m, plan_id, fragmented, s = std::move(s)] {
         auto uuid = m.column_family_id();
         auto& cf = find_column_family(uuid);
@@ -3459,8 +4828,10 @@ database::make_keyspace_config(const keyspace_metadata& ksm) {
     cfg.streaming_dirty_memory_manager = &_streaming_dirty_memory_manager;
     cfg.read_concurrency_config.resources_sem = &_read_concurrency_sem;
     cfg.read_concurrency_config.active_reads = &_stats->active_reads;
+    cfg.read_concurrency_config.queued_reads = &_stats->queued_reads;
     cfg.read_concurrency_config.timeout = _cfg->read_request_timeout_in_ms() * 1ms;
     cfg.read_concurrency_config.max_queue_length = 100;
+    cfg.read_concurrency_config.max_admission_cost = max_memory_concurrent_reads() / 4;
     cfg.read_concurrency_config.raise_queue_overloaded_exception = [this] {
         ++_stats->sstable_read_queue_overloaded;
         throw std::runtime_error("sstable inactive read queue overloaded");
@@ -3469,7 +4840,11 @@ database::make_keyspace_config(const keyspace_metadata& ksm) {
     // Trust the caller to limit concurrency.
     cfg.streaming_read_concurrency_config.resources_sem = &_streaming_concurrency_sem;
     cfg.streaming_read_concurrency_config.active_reads = &_stats->active_reads_streaming;
+    cfg.streaming_read_concurrency_config.max_admission_cost = max_memory_streaming_concurrent_reads() / 4;
     cfg.cf_stats = &_cf_stats;
+    cfg.view_update_concurrency_semaphore = &_view_update_concurrency_sem;
+    cfg.querier_cache = &_querier_cache;
+    cfg.view_update_concurrency_semaphore_limit = max_memory_pending_view_updates();
     cfg.enable_incremental_backups = _enable_incremental_backups;
 
     if (_cfg->background_writer_scheduling_quota() < 1.0f) {
@@ -3564,7 +4939,11 @@ schema_ptr database::find_indexed_table(const sstring& ks_name, const sstring& i
 
 future<>
 database::stop() {
-    return _compaction_manager->stop().then([this] {
+    // The readers of the queriers keep sstables and memtables.
+    _querier_cache.evict_all();
+    return _index_summary_manager.stop().then([this] {
+        return _compaction_manager->stop();
+    }).then([this] {
         // try to ensure that CL has done disk flushing
         if (_commitlog != nullptr) {
             return _commitlog->shutdown();
@@ -3613,8 +4992,8 @@ column_family::run_with_compaction_disabled(std::function<future<> ()> func) {
 }
 
 future<> database::truncate(const keyspace& ks, column_family& cf, timestamp_func tsf, bool with_snapshot) {
-    return cf.run_async([this, &ks, &cf, tsf = std::move(tsf), with_snapshot] {
-        const auto durable = ks.metadata()->durable_writes();
+    cf.invalidate_queriers();
+    return cf.run_async([this, &cf, tsf = std::move(tsf), with_snapshot] {
         const auto auto_snapshot = with_snapshot && get_config().auto_snapshot();
 
         // Force mutations coming in to re-acquire higher rp:s
@@ -3625,14 +5004,19 @@ future<> database::truncate(const keyspace& ks, column_family& cf, timestamp_fun
         auto low_mark = cf.set_low_replay_position_mark();
 
 
-        return cf.run_with_compaction_disabled([&cf, durable, auto_snapshot, tsf = std::move(tsf), low_mark]() mutable {
+        return cf.run_with_compaction_disabled([&cf, auto_snapshot, tsf = std::move(tsf), low_mark]() mutable {
             future<> f = make_ready_future<>();
-            if (durable || auto_snapshot) {
+            if (auto_snapshot) {
                 // TODO:
                 // this is not really a guarantee at all that we've actually
                 // gotten all things to disk. Again, need queue-ish or something.
                 f = cf.flush();
             } else {
+                // Nothing needs the data on disk, so drop the memtables rather
+                // than flushing a table which may be large and busy. The
+                // truncation record then covers everything they held, so that
+                // commitlog replay skips it too.
+                low_mark = cf.set_low_replay_position_mark();
                 f = cf.clear();
             }
             return f.then([&cf, auto_snapshot, tsf = std::move(tsf), low_mark] {
@@ -3646,7 +5030,10 @@ future<> database::truncate(const keyspace& ks, column_family& cf, timestamp_fun
                         f = cf.snapshot(name);
                     }
                     return f.then([&cf, truncated_at, low_mark] {
-                        return cf.discard_sstables(truncated_at).then([&cf, truncated_at, low_mark](db::replay_position rp) {
+                        return cf.discard_sstables(truncated_at).then([&cf, truncated_at, auto_snapshot, low_mark](db::replay_position rp) {
+                            if (!auto_snapshot) {
+                                rp = std::max(rp, low_mark);
+                            }
                             // TODO: verify that rp == db::replay_position is because we have no sstables (and no data flushed)
                             if (rp == db::replay_position()) {
                                 return make_ready_future();
@@ -3666,6 +5053,21 @@ const sstring& database::get_snitch_name() const {
     return _cfg->endpoint_snitch();
 }
 
+future<> database::release_snapshot(sstring tag, std::vector<sstring> keyspace_names) {
+    std::unordered_set<sstring> ks_names_set(keyspace_names.begin(), keyspace_names.end());
+    std::vector<lw_shared_ptr<column_family>> cfs;
+    for (auto&& p : _column_families) {
+        if (ks_names_set.empty() || ks_names_set.count(p.second->schema()->ks_name())) {
+            cfs.push_back(p.second);
+        }
+    }
+    return do_with(std::move(cfs), [tag = std::move(tag)] (std::vector<lw_shared_ptr<column_family>>& cfs) {
+        return parallel_for_each(cfs, [tag] (lw_shared_ptr<column_family>& cf) {
+            return cf->release_snapshot(tag);
+        });
+    });
+}
+
 // For the filesystem operations, this code will assume that all keyspaces are visible in all shards
 // (as we have been doing for a lot of the other operations, like the snapshot itself).
 future<> database::clear_snapshot(sstring tag, std::vector<sstring> keyspace_names) {
@@ -3768,6 +5170,8 @@ future<> update_schema_version_and_announce(distributed<service::storage_proxy>&
 // group of shards only, this code will have to be updated to account for that.
 struct snapshot_manager {
     std::unordered_set<sstring> files;
+    // Files of an incremental snapshot found in an earlier one -> that snapshot.
+    std::unordered_map<sstring, sstring> previous;
     semaphore requests;
     semaphore manifest_write;
     snapshot_manager() : requests(0), manifest_write(0) {}
@@ -3778,14 +5182,32 @@ static future<>
 seal_snapshot(sstring jsondir) {
     std::ostringstream ss;
     int n = 0;
+    auto& snapshot = *pending_snapshots.at(jsondir);
     ss << "{" << std::endl << "\t\"files\" : [ ";
-    for (auto&& rf: pending_snapshots.at(jsondir)->files) {
+    for (auto&& rf: snapshot.files) {
         if (n++ > 0) {
             ss << ", ";
         }
         ss << "\"" << rf << "\"";
     }
-    ss << " ]" << std::endl << "}" << std::endl;
+    ss << " ]";
+    n = 0;
+    for (auto&& p : snapshot.previous) {
+        // A shard sharing the sstable may have linked it anyway.
+        if (snapshot.files.count(p.first)) {
+            continue;
+        }
+        if (n++ > 0) {
+            ss << ", ";
+        } else {
+            ss << "," << std::endl << "\t\"previous\" : { ";
+        }
+        ss << "\"" << p.first << "\" : \"" << p.second << "\"";
+    }
+    if (n > 0) {
+        ss << " }";
+    }
+    ss << std::endl << "}" << std::endl;
 
     auto json = ss.str();
     auto jsonfile = jsondir + "/manifest.json";
@@ -3810,37 +5232,161 @@ seal_snapshot(sstring jsondir) {
     });
 }
 
-future<> column_family::snapshot(sstring name) {
-    return flush().then([this, name = std::move(name)]() {
-        auto tables = boost::copy_range<std::vector<sstables::shared_sstable>>(*_sstables->all());
-        return do_with(std::move(tables), [this, name](std::vector<sstables::shared_sstable> & tables) {
-            auto jsondir = _config.datadir + "/snapshots/" + name;
+// Reads the sstables an incremental snapshot refers to in earlier ones from
+// its manifest, by their Data file name.
+static future<std::unordered_map<sstring, sstring>> read_snapshot_previous(lister::path manifest) {
+    return open_checked_file_dma(general_disk_error_handler, manifest.native(), open_flags::ro).then([manifest] (file f) {
+        return f.size().then([f, manifest] (uint64_t size) mutable {
+            return do_with(make_file_input_stream(std::move(f)), [size, manifest] (input_stream<char>& in) {
+                return in.read_exactly(size).then([&in, manifest] (temporary_buffer<char> buf) {
+                    return in.close().then([buf = std::move(buf), manifest] {
+                        std::unordered_map<sstring, sstring> previous;
+                        Json::Value root;
+                        Json::Reader reader;
+                        if (!reader.parse(buf.get(), buf.get() + buf.size(), root) || !root.isObject()) {
+                            dblog.warn("Unable to parse snapshot manifest {}", manifest.native());
+                            return previous;
+                        }
+                        auto files = root.get("previous", Json::Value(Json::objectValue));
+                        for (auto&& name : files.getMemberNames()) {
+                            previous.emplace(name, files[name].asString());
+                        }
+                        return previous;
+                    });
+                });
+            });
+        });
+    });
+}
 
-            return parallel_for_each(tables, [name](sstables::shared_sstable sstable) {
-                auto dir = sstable->get_dir() + "/snapshots/" + name;
-                return io_check(recursive_touch_directory, dir).then([sstable, dir] {
-                    return sstable->create_links(dir).then_wrapped([] (future<> f) {
-                        // If the SSTables are shared, one of the CPUs will fail here.
-                        // That is completely fine, though. We only need one link.
-                        try {
-                            f.get();
-                        } catch (std::system_error& e) {
-                            if (e.code() != std::error_code(EEXIST, std::system_category())) {
-                                throw;
+future<> column_family::load_snapshots() {
+    return with_semaphore(_snapshots_load_sem, 1, [this] {
+        if (_snapshots_loaded) {
+            return make_ready_future<>();
+        }
+        auto snapshots_dir = lister::path(_config.datadir) / "snapshots";
+        return io_check([snapshots_dir] { return engine().file_exists(snapshots_dir.native()); }).then([this, snapshots_dir] (bool exists) {
+            if (!exists) {
+                return make_ready_future<>();
+            }
+            return lister::scan_dir(snapshots_dir, { directory_entry_type::directory }, [this] (lister::path snapshots_dir, directory_entry de) {
+                auto name = de.name;
+                if (_snapshots.count(name)) {
+                    // Taken since this node started.
+                    return make_ready_future<>();
+                }
+                // Each shard accounts for the sstables it would have written.
+                auto mine = [] (int64_t generation) {
+                    return calculate_shard_from_sstable_generation(generation) == engine().cpu_id();
+                };
+                auto contents = make_lw_shared<snapshot_contents>();
+                return lister::scan_dir(snapshots_dir / name.c_str(), { directory_entry_type::regular }, [contents, mine] (lister::path dir, directory_entry de) {
+                    if (de.name == "manifest.json") {
+                        return read_snapshot_previous(dir / de.name.c_str()).then([contents, mine] (std::unordered_map<sstring, sstring> previous) {
+                            for (auto&& p : previous) {
+                                auto generation = sstables::entry_descriptor::make_descriptor(p.first).generation;
+                                if (mine(generation)) {
+                                    contents->referenced.emplace(generation, p.second);
+                                }
                             }
-                        }
+                        });
+                    }
+                    auto generation = sstables::entry_descriptor::make_descriptor(de.name).generation;
+                    if (!mine(generation)) {
                         return make_ready_future<>();
+                    }
+                    return io_check(file_size, (dir / de.name.c_str()).native()).then([contents, generation] (uint64_t size) {
+                        contents->linked[generation] += size;
                     });
+                }).then([this, name, contents] {
+                    _snapshots.emplace(name, std::move(*contents));
                 });
-            }).then([jsondir, &tables] {
-                // This is not just an optimization. If we have no files, jsondir may not have been created,
-                // and sync_directory would throw.
-                if (tables.size()) {
-                    return io_check(sync_directory, std::move(jsondir));
-                } else {
-                    return make_ready_future<>();
+            });
+        }).then([this] {
+            for (auto&& sst : *_sstables->all()) {
+                for (auto&& s : _snapshots) {
+                    if (s.second.linked.count(sst->generation())) {
+                        _snapshot_links.emplace(sst->generation(), s.first);
+                        break;
+                    }
                 }
-            }).finally([this, &tables, jsondir] {
+            }
+            _snapshots_loaded = true;
+        });
+    });
+}
+
+// Snapshotting a table with many sstables used to link them all at once and
+// sync the directory three times for each, stalling the filesystem for
+// everyone. Link them a batch at a time instead, syncing once per batch: the
+// manifest, written last, is what makes the snapshot complete.
+static constexpr size_t snapshot_link_batch_size = 16;
+
+future<> column_family::link_snapshot_sstables(sstring name, std::vector<sstables::shared_sstable> tables) {
+    if (tables.empty()) {
+        return make_ready_future<>();
+    }
+    auto dir = _config.datadir + "/snapshots/" + name;
+    return io_check(recursive_touch_directory, dir).then([this, name, dir, tables = std::move(tables)] () mutable {
+        return do_with(std::move(tables), size_t(0), [this, name, dir] (std::vector<sstables::shared_sstable>& tables, size_t& done) {
+            return repeat([this, name, dir, &tables, &done] {
+                if (done == tables.size()) {
+                    return make_ready_future<stop_iteration>(stop_iteration::yes);
+                }
+                auto end = std::min(tables.size(), done + snapshot_link_batch_size);
+                auto batch = boost::make_iterator_range(tables.begin() + done, tables.begin() + end);
+                done = end;
+                return parallel_for_each(batch, [this, name, dir] (sstables::shared_sstable sst) {
+                    return sst->create_snapshot_links(dir).then([this, name, sst] (bool linked) {
+                        _snapshot_links[sst->generation()] = name;
+                        auto it = _snapshots.find(name);
+                        if (linked && it != _snapshots.end()) {
+                            it->second.linked.emplace(sst->generation(), sst->bytes_on_disk());
+                        }
+                    });
+                }).then([dir] {
+                    return io_check(sync_directory, dir);
+                }).then([] {
+                    return stop_iteration::no;
+                });
+            });
+        });
+    });
+}
+
+future<> column_family::snapshot(sstring name, bool incremental) {
+    return flush().then([this, incremental] {
+        return incremental ? load_snapshots() : make_ready_future<>();
+    }).then([this, name = std::move(name), incremental]() {
+        auto tables = boost::copy_range<std::vector<sstables::shared_sstable>>(*_sstables->all());
+        std::unordered_set<int64_t> live;
+        for (auto&& sst : tables) {
+            live.insert(sst->generation());
+        }
+        for (auto it = _snapshot_links.begin(); it != _snapshot_links.end();) {
+            if (live.count(it->first)) {
+                ++it;
+            } else {
+                it = _snapshot_links.erase(it);
+            }
+        }
+        auto& contents = _snapshots[name];
+        std::vector<sstables::shared_sstable> to_link;
+        std::unordered_map<sstring, sstring> previous;
+        for (auto&& sst : tables) {
+            auto it = _snapshot_links.find(sst->generation());
+            if (incremental && it != _snapshot_links.end()) {
+                previous.emplace(sst->get_filename().substr(sst->get_dir().size() + 1), it->second);
+                contents.referenced.emplace(sst->generation(), it->second);
+            } else {
+                to_link.push_back(std::move(sst));
+            }
+        }
+        return do_with(std::move(to_link), std::move(previous), [this, name](std::vector<sstables::shared_sstable>& tables,
+                std::unordered_map<sstring, sstring>& previous) {
+            auto jsondir = _config.datadir + "/snapshots/" + name;
+
+            return link_snapshot_sstables(name, tables).finally([this, &tables, &previous, jsondir] {
                 auto shard = std::hash<sstring>()(jsondir) % smp::count;
                 std::unordered_set<sstring> table_names;
                 for (auto& sst : tables) {
@@ -3849,7 +5395,7 @@ future<> column_family::snapshot(sstring name) {
                     table_names.insert(std::move(rf));
                 }
                 return smp::submit_to(shard, [requester = engine().cpu_id(), jsondir = std::move(jsondir),
-                                              tables = std::move(table_names), datadir = _config.datadir] {
+                                              tables = std::move(table_names), previous = std::move(previous), datadir = _config.datadir] {
 
                     if (pending_snapshots.count(jsondir) == 0) {
                         pending_snapshots.emplace(jsondir, make_lw_shared<snapshot_manager>());
@@ -3858,6 +5404,9 @@ future<> column_family::snapshot(sstring name) {
                     for (auto&& sst: tables) {
                         snapshot->files.insert(std::move(sst));
                     }
+                    for (auto&& p : previous) {
+                        snapshot->previous.insert(std::move(p));
+                    }
 
                     snapshot->requests.signal(1);
                     auto my_work = make_ready_future<>();
@@ -3895,50 +5444,108 @@ future<bool> column_family::snapshot_exists(sstring tag) {
 }
 
 future<std::unordered_map<sstring, column_family::snapshot_details>> column_family::get_snapshot_details() {
-    std::unordered_map<sstring, snapshot_details> all_snapshots;
-    return do_with(std::move(all_snapshots), lister::path(_config.datadir) / "snapshots", [this] (auto& all_snapshots, const lister::path& snapshots_dir) {
-        return io_check([&] { return engine().file_exists(snapshots_dir.native()); }).then([this, &all_snapshots, &snapshots_dir](bool file_exists) {
-            if (!file_exists) {
-                return make_ready_future<>();
+    return load_snapshots().then([this] {
+        std::unordered_set<int64_t> live;
+        for (auto&& sst : *_sstables->all()) {
+            live.insert(sst->generation());
+        }
+        std::unordered_map<sstring, snapshot_details> all_snapshots;
+        for (auto&& s : _snapshots) {
+            snapshot_details details = { 0, 0 };
+            for (auto&& l : s.second.linked) {
+                details.total += l.second;
+                // The sstables still in the table take no space of their own.
+                if (!live.count(l.first)) {
+                    details.live += l.second;
+                }
             }
-            return lister::scan_dir(snapshots_dir,  { directory_entry_type::directory }, [this, &all_snapshots] (lister::path snapshots_dir, directory_entry de) {
-            auto snapshot_name = de.name;
-            all_snapshots.emplace(snapshot_name, snapshot_details());
-            return lister::scan_dir(snapshots_dir / snapshot_name.c_str(),  { directory_entry_type::regular }, [this, &all_snapshots, snapshot_name = std::move(snapshot_name)] (lister::path snapshot_dir, directory_entry de) {
-                return io_check(file_size, (snapshot_dir / de.name.c_str()).native()).then([this, &all_snapshots, snapshot_name, name = de.name] (auto size) {
-                    // The manifest is the only file expected to be in this directory not belonging to the SSTable.
-                    // For it, we account the total size, but zero it for the true size calculation.
-                    //
-                    // All the others should just generate an exception: there is something wrong, so don't blindly
-                    // add it to the size.
-                    if (name != "manifest.json") {
-                        sstables::entry_descriptor::make_descriptor(name);
-                        all_snapshots.at(snapshot_name).total += size;
-                    } else {
-                        size = 0;
+            all_snapshots.emplace(s.first, details);
+        }
+        return all_snapshots;
+    });
+}
+
+future<> column_family::release_snapshot(sstring name) {
+    if (name.empty()) {
+        _snapshots.clear();
+        _snapshot_links.clear();
+        return make_ready_future<>();
+    }
+    return load_snapshots().then([this, name] {
+        // Generation -> the snapshots referring to it in the released one.
+        std::unordered_map<int64_t, std::vector<sstring>> moves;
+        std::unordered_set<sstring> referrers;
+        for (auto&& s : _snapshots) {
+            for (auto&& r : s.second.referenced) {
+                if (r.second == name) {
+                    moves[r.first].push_back(s.first);
+                    referrers.insert(s.first);
+                }
+            }
+        }
+        auto src = lister::path(_config.datadir) / "snapshots" / name.c_str();
+        return do_with(std::move(moves), std::move(referrers), [this, name, src] (auto& moves, auto& referrers) {
+            auto f = make_ready_future<>();
+            if (!moves.empty()) {
+                f = io_check([src] { return engine().file_exists(src.native()); }).then([this, src, &moves, &referrers] (bool exists) {
+                    if (!exists) {
+                        return make_ready_future<>();
                     }
-                    return make_ready_future<uint64_t>(size);
-                }).then([this, &all_snapshots, snapshot_name, name = de.name] (auto size) {
-                    // FIXME: When we support multiple data directories, the file may not necessarily
-                    // live in this same location. May have to test others as well.
-                    return io_check(file_size, (lister::path(_config.datadir) / name.c_str()).native()).then_wrapped([&all_snapshots, snapshot_name, size] (auto fut) {
-                        try {
-                            // File exists in the main SSTable directory. Snapshots are not contributing to size
-                            fut.get0();
-                        } catch (std::system_error& e) {
-                            if (e.code() != std::error_code(ENOENT, std::system_category())) {
-                                throw;
-                            }
-                            all_snapshots.at(snapshot_name).live += size;
+                    return lister::scan_dir(src, { directory_entry_type::regular }, [&moves] (lister::path dir, directory_entry de) {
+                        if (de.name == "manifest.json") {
+                            return make_ready_future<>();
                         }
-                        return make_ready_future<>();
+                        auto it = moves.find(sstables::entry_descriptor::make_descriptor(de.name).generation);
+                        if (it == moves.end()) {
+                            return make_ready_future<>();
+                        }
+                        return parallel_for_each(it->second, [dir, name = de.name] (const sstring& referrer) {
+                            auto dst = dir.parent_path() / referrer.c_str() / name.c_str();
+                            return io_check(link_file, (dir / name.c_str()).native(), dst.native()).then_wrapped([] (future<> f) {
+                                try {
+                                    f.get();
+                                } catch (std::system_error& e) {
+                                    if (e.code() != std::error_code(EEXIST, std::system_category())) {
+                                        throw;
+                                    }
+                                }
+                            });
+                        });
+                    }).then([this, &referrers] {
+                        return parallel_for_each(referrers, [this] (const sstring& referrer) {
+                            return io_check(sync_directory, _config.datadir + "/snapshots/" + referrer);
+                        });
                     });
                 });
+            }
+            return f.then([this, name, &moves] {
+                auto& released = _snapshots[name];
+                for (auto&& m : moves) {
+                    auto size = released.linked.find(m.first);
+                    for (auto&& referrer : m.second) {
+                        auto& contents = _snapshots[referrer];
+                        contents.referenced.erase(m.first);
+                        if (size != released.linked.end()) {
+                            contents.linked.emplace(m.first, size->second);
+                        }
+                    }
+                }
+                for (auto it = _snapshot_links.begin(); it != _snapshot_links.end();) {
+                    if (it->second != name) {
+                        ++it;
+                        continue;
+                    }
+                    auto m = moves.find(it->first);
+                    if (m != moves.end()) {
+                        it->second = m->second.front();
+                        ++it;
+                    } else {
+                        it = _snapshot_links.erase(it);
+                    }
+                }
+                _snapshots.erase(name);
             });
         });
-        }).then([&all_snapshots] {
-            return std::move(all_snapshots);
-        });
     });
 }
 
@@ -3961,7 +5568,12 @@ future<> column_family::flush_streaming_mutations(utils::UUID plan_id, dht::part
     // temporary counter measure.
     dblog.debug("Flushing streaming memtable, plan={}", plan_id);
     return with_gate(_streaming_flush_gate, [this, plan_id, ranges = std::move(ranges)] () mutable {
-        return flush_streaming_big_mutations(plan_id).then([this, ranges = std::move(ranges)] (auto sstables) mutable {
+        return flush_streaming_big_mutations(plan_id).then([this, plan_id] (auto sstables) {
+            return finish_streaming_sstable_writes(plan_id).then([sstables = std::move(sstables)] (auto written) mutable {
+                std::move(written.begin(), written.end(), std::back_inserter(sstables));
+                return std::move(sstables);
+            });
+        }).then([this, ranges = std::move(ranges)] (auto sstables) mutable {
             return _streaming_memtables->seal_active_memtable_delayed().then([this] {
                 return _streaming_flush_phaser.advance_and_await();
             }).then([this, sstables = std::move(sstables), ranges = std::move(ranges)] () mutable {
@@ -3972,6 +5584,8 @@ future<> column_family::flush_streaming_mutations(utils::UUID plan_id, dht::part
                         this->add_sstable(sst, {engine().cpu_id()});
                     }
                     this->try_trigger_compaction();
+                }).then([this] {
+                    return warm_in_memory_cache();
                 });
             });
         });
@@ -3998,14 +5612,33 @@ future<std::vector<sstables::shared_sstable>> column_family::flush_streaming_big
     });
 }
 
+future<std::vector<sstables::shared_sstable>> column_family::finish_streaming_sstable_writes(utils::UUID plan_id) {
+    auto it = _streaming_sstable_writers.find(plan_id);
+    if (it == _streaming_sstable_writers.end()) {
+        return make_ready_future<std::vector<sstables::shared_sstable>>(std::vector<sstables::shared_sstable>());
+    }
+    auto writer = it->second;
+    _streaming_sstable_writers.erase(it);
+    return writer->finish().finally([writer] { });
+}
+
 future<> column_family::fail_streaming_mutations(utils::UUID plan_id) {
+    auto f = make_ready_future<>();
+    auto wit = _streaming_sstable_writers.find(plan_id);
+    if (wit != _streaming_sstable_writers.end()) {
+        auto writer = wit->second;
+        _streaming_sstable_writers.erase(wit);
+        f = writer->abort().finally([writer] { });
+    }
     auto it = _streaming_memtables_big.find(plan_id);
     if (it == _streaming_memtables_big.end()) {
-        return make_ready_future<>();
+        return f;
     }
     auto entry = it->second;
     _streaming_memtables_big.erase(it);
-    return entry->flush_in_progress.close().then([this, entry] {
+    return f.then([entry] {
+        return entry->flush_in_progress.close();
+    }).then([this, entry] {
         for (auto&& sst : entry->sstables) {
             sst->mark_for_deletion();
         }
@@ -4021,13 +5654,19 @@ future<> column_family::clear() {
     _streaming_memtables->clear();
     _streaming_memtables->add_memtable();
     _streaming_memtables_big.clear();
-    return _cache.invalidate([] { /* There is no underlying mutation source */ });
+    auto writers = std::exchange(_streaming_sstable_writers, {});
+    return parallel_for_each(writers | boost::adaptors::map_values, [] (auto writer) {
+        return writer->abort().finally([writer] { });
+    }).then([this] {
+        return _cache.invalidate([] { /* There is no underlying mutation source */ });
+    });
 }
 
 // NOTE: does not need to be futurized, but might eventually, depending on
 // if we implement notifications, whatnot.
 future<db::replay_position> column_family::discard_sstables(db_clock::time_point truncated_at) {
     assert(_compaction_disabled > 0);
+    invalidate_counter_cache();
 
     return with_lock(_sstables_lock.for_read(), [this, truncated_at] {
         struct pruner {
@@ -4053,22 +5692,144 @@ future<db::replay_position> column_family::discard_sstables(db_clock::time_point
                 }
 
                 cf._sstables = std::move(pruned);
+                cf.rebuild_statistics();
             }
         };
         auto p = make_lw_shared<pruner>(*this);
         return _cache.invalidate([p, truncated_at] {
             p->prune(truncated_at);
             dblog.debug("cleaning out row cache");
-        }).then([p]() mutable {
-            return parallel_for_each(p->remove, [](sstables::shared_sstable s) {
-                return sstables::delete_atomically({s});
-            }).then([p] {
-                return make_ready_future<db::replay_position>(p->rp);
+        }).then([this, p]() mutable {
+            std::vector<sstables::shared_sstable> unshared;
+            std::vector<sstables::shared_sstable> shared;
+            for (auto&& s : p->remove) {
+                (s->is_shared() ? shared : unshared).push_back(s);
+            }
+            remove_large_data(p->remove);
+            // Once their TOCs are renamed, the unshared sstables won't come back
+            // even if the node restarts before their files are gone, and removing
+            // the files of a large table takes a while: do that in the background.
+            // The shared ones are gone only when all shards agree, so wait for them.
+            return do_with(std::move(unshared), std::move(shared), [this, p] (std::vector<sstables::shared_sstable>& unshared,
+                    std::vector<sstables::shared_sstable>& shared) {
+                return parallel_for_each(unshared, [] (sstables::shared_sstable s) {
+                    return s->mark_for_deletion_on_disk();
+                }).then([this, &unshared] {
+                    return unshared.empty() ? make_ready_future<>() : io_check(sync_directory, _config.datadir);
+                }).then([&shared] {
+                    return parallel_for_each(shared, [] (sstables::shared_sstable s) {
+                        return sstables::delete_atomically({s});
+                    });
+                }).then([this, p, &unshared] {
+                    seastar::with_gate(_sstable_deletion_gate, [unshared = std::move(unshared)] {
+                        return parallel_for_each(unshared, [] (sstables::shared_sstable s) {
+                            return sstables::remove_by_toc_name(s->toc_filename());
+                        });
+                    }).handle_exception([] (std::exception_ptr ep) {
+                        dblog.warn("Failed to remove the sstables of a truncated table: {}", ep);
+                    });
+                    return make_ready_future<db::replay_position>(p->rp);
+                });
             });
         });
     });
 }
 
+static sstring large_data_key_to_string(const std::vector<bytes>& components, const schema::const_iterator_range_type& columns) {
+    std::vector<sstring> values;
+    auto column = columns.begin();
+    for (auto&& c : components) {
+        values.push_back(column++->type->to_string(c));
+    }
+    return ::join(":", values);
+}
+
+static sstring data_file_name(const sstables::sstable& sst) {
+    auto name = sst.get_filename();
+    return name.substr(name.find_last_of('/') + 1);
+}
+
+future<> column_family::load_large_data() {
+    if (_large_data_loaded) {
+        return make_ready_future<>();
+    }
+    return db::system_keyspace::load_large_data_sstables(_schema->ks_name(), _schema->cf_name()).then([this] (std::unordered_map<sstring, uint64_t> sstables) {
+        // Each shard removes the records of the sstables it deletes.
+        for (auto&& e : sstables) {
+            auto generation = sstables::entry_descriptor::make_descriptor(e.first).generation;
+            if (calculate_shard_from_sstable_generation(generation) == engine().cpu_id()) {
+                _large_data_records += e.second;
+                _large_data_sstables.emplace(e.first, e.second);
+            }
+        }
+        _large_data_loaded = true;
+    });
+}
+
+void column_family::record_large_data(const sstables::shared_sstable& sst) {
+    auto records = sst->release_large_data();
+    if (records.empty() || !_config.large_data_records_per_table || !db::qctx) {
+        return;
+    }
+    seastar::with_gate(_large_data_gate, [this, name = data_file_name(*sst), records = std::move(records)] () mutable {
+        return with_semaphore(_large_data_sem, 1, [this, &name, &records] {
+            return load_large_data().then([this, &name, &records] {
+                // The records are capped per shard, keeping the largest partitions and rows of each sstable.
+                auto limit = (_config.large_data_records_per_table + smp::count - 1) / smp::count;
+                auto room = limit > _large_data_records ? limit - _large_data_records : 0;
+                if (records.size() > room) {
+                    boost::sort(records, [] (const sstables::large_data_record& a, const sstables::large_data_record& b) {
+                        return a.size > b.size;
+                    });
+                    records.resize(room);
+                }
+                if (records.empty()) {
+                    return make_ready_future<>();
+                }
+                _large_data_records += records.size();
+                _large_data_sstables[name] += records.size();
+                return parallel_for_each(records, [this, &name] (const sstables::large_data_record& r) {
+                    auto& s = *_schema;
+                    auto pk = large_data_key_to_string(r.key.explode(s), s.partition_key_columns());
+                    if (r.clustering_key) {
+                        auto ck = large_data_key_to_string(r.clustering_key->explode(s), s.clustering_key_columns());
+                        return db::system_keyspace::record_large_row(s.ks_name(), s.cf_name(), name, r.size, std::move(pk), std::move(ck));
+                    }
+                    return db::system_keyspace::record_large_partition(s.ks_name(), s.cf_name(), name, r.size, std::move(pk), r.rows);
+                });
+            });
+        });
+    }).handle_exception([] (std::exception_ptr ep) {
+        dblog.warn("Failed to record large partitions and rows: {}", ep);
+    });
+}
+
+void column_family::remove_large_data(const std::vector<sstables::shared_sstable>& sstables) {
+    if (sstables.empty() || !_config.large_data_records_per_table || !db::qctx) {
+        return;
+    }
+    auto names = boost::copy_range<std::vector<sstring>>(sstables | boost::adaptors::transformed([] (const sstables::shared_sstable& sst) {
+        return data_file_name(*sst);
+    }));
+    seastar::with_gate(_large_data_gate, [this, names = std::move(names)] () mutable {
+        return with_semaphore(_large_data_sem, 1, [this, &names] {
+            return load_large_data().then([this, &names] {
+                return parallel_for_each(names, [this] (const sstring& name) {
+                    auto it = _large_data_sstables.find(name);
+                    if (it == _large_data_sstables.end()) {
+                        return make_ready_future<>();
+                    }
+                    _large_data_records -= it->second;
+                    _large_data_sstables.erase(it);
+                    return db::system_keyspace::remove_large_data(_schema->ks_name(), _schema->cf_name(), name);
+                });
+            });
+        });
+    }).handle_exception([] (std::exception_ptr ep) {
+        dblog.warn("Failed to remove the records of large partitions and rows: {}", ep);
+    });
+}
+
 future<int64_t>
 column_family::disable_sstable_write() {
     _sstable_writes_disabled_at = std::chrono::steady_clock::now();
@@ -4117,6 +5878,29 @@ std::ostream& operator<<(std::ostream& os, const keyspace_metadata& m) {
     return os;
 }
 
+future<> column_family::warm_in_memory_cache() {
+    if (!_schema->caching_options().in_memory()) {
+        return make_ready_future<>();
+    }
+    // A scan populates the cache with whole partitions, and marks the ranges
+    // between them continuous, as the tracker admits everything within its
+    // budget.
+    return do_with(_cache.make_reader(_schema), [] (mutation_reader& reader) {
+        return repeat([&reader] {
+            return reader().then([] (streamed_mutation_opt smopt) {
+                if (!smopt) {
+                    return make_ready_future<stop_iteration>(stop_iteration::yes);
+                }
+                return mutation_from_streamed_mutation(std::move(smopt)).then([] (mutation_opt) {
+                    return stop_iteration::no;
+                });
+            });
+        });
+    }).handle_exception([this] (std::exception_ptr eptr) {
+        dblog.warn("Failed to read {}.{} into the cache: {}", _schema->ks_name(), _schema->cf_name(), eptr);
+    });
+}
+
 void column_family::set_schema(schema_ptr s) {
     dblog.debug("Changing schema version of {}.{} ({}) from {} to {}",
                 _schema->ks_name(), _schema->cf_name(), _schema->id(), _schema->version(), s->version());
@@ -4135,6 +5919,10 @@ void column_family::set_schema(schema_ptr s) {
         }
     }
 
+    if (s->caching_options().in_memory() != _schema->caching_options().in_memory()) {
+        // The cache is in the region of its tracker.
+        dblog.warn("The in_memory caching option of {}.{} changes when the table is loaded again", s->ks_name(), s->cf_name());
+    }
     _cache.set_schema(s);
     _counter_cell_locks->set_schema(s);
     _schema = std::move(s);
@@ -4191,16 +5979,60 @@ std::vector<view_ptr> column_family::affected_views(const schema_ptr& base, cons
 future<> column_family::generate_and_propagate_view_updates(const schema_ptr& base,
         std::vector<view_ptr>&& views,
         mutation&& m,
-        streamed_mutation_opt existings) const {
+        streamed_mutation_opt existings,
+        size_t view_update_units) const {
     auto base_token = m.token();
     return db::view::generate_view_updates(base,
                         std::move(views),
                         streamed_mutation_from_mutation(std::move(m)),
-                        std::move(existings)).then([base_token = std::move(base_token)] (auto&& updates) {
-        db::view::mutate_MV(std::move(base_token), std::move(updates));
+                        std::move(existings)).then([this, base_token = std::move(base_token), view_update_units] (std::vector<mutation> updates) {
+        // The partitions of views with the token of the base partition, as
+        // those of local indexes, are on this replica and in this shard. They
+        // are updated before the base partition, and the write waits for them.
+        auto colocated = std::stable_partition(updates.begin(), updates.end(), [&base_token] (const mutation& m) {
+            return m.token() != base_token;
+        });
+        std::vector<mutation> local_updates(std::make_move_iterator(colocated), std::make_move_iterator(updates.end()));
+        updates.erase(colocated, updates.end());
+        // The other updates are applied in the background, holding their units until done.
+        db::view::mutate_MV(std::move(base_token), std::move(updates)).finally([this, view_update_units] {
+            release_view_update_units(view_update_units);
+        });
+        if (local_updates.empty()) {
+            return make_ready_future<>();
+        }
+        return service::get_local_storage_proxy().mutate_locally(std::move(local_updates));
     });
 }
 
+size_t column_family::view_update_units(size_t memory) const {
+    // Never wait for more than the whole semaphore.
+    return std::min(memory, _config.view_update_concurrency_semaphore_limit);
+}
+
+void column_family::release_view_update_units(size_t units) const {
+    if (_config.view_update_concurrency_semaphore) {
+        _config.view_update_concurrency_semaphore->signal(units);
+    }
+}
+
+future<> column_family::delay_for_view_update_backlog() const {
+    auto sem = _config.view_update_concurrency_semaphore;
+    if (!sem) {
+        return make_ready_future<>();
+    }
+    auto limit = _config.view_update_concurrency_semaphore_limit;
+    auto backlog = limit - std::min<size_t>(sem->available_units(), limit);
+    auto delay = db::view::calculate_view_update_delay(backlog, limit);
+    if (!delay.count()) {
+        return make_ready_future<>();
+    }
+    if (_config.cf_stats) {
+        ++_config.cf_stats->view_update_delayed_writes;
+    }
+    return sleep(delay);
+}
+
 /**
  * Given an update for the base table, calculates the set of potentially affected views,
  * generates the relevant updates, and sends them to the paired view replicas.
@@ -4214,15 +6046,33 @@ future<> column_family::push_view_replica_updates(const schema_ptr& s, const fro
     if (views.empty()) {
         return make_ready_future<>();
     }
+    auto sem = _config.view_update_concurrency_semaphore;
+    if (!sem) {
+        return do_push_view_replica_updates(std::move(m), std::move(views), 0);
+    }
+    // Each view update is estimated to be about as large as the base update.
+    auto units = view_update_units(fm.representation().size() * views.size());
+    return sem->wait(units).then([this, m = std::move(m), views = std::move(views), units] () mutable {
+        return do_push_view_replica_updates(std::move(m), std::move(views), units).handle_exception([this, units] (std::exception_ptr ep) {
+            release_view_update_units(units);
+            return make_exception_future<>(std::move(ep));
+        });
+    }).then([this] {
+        return delay_for_view_update_backlog();
+    });
+}
+
+future<> column_family::do_push_view_replica_updates(mutation m, std::vector<view_ptr> views, size_t view_update_units) const {
+    auto& base = schema();
     auto cr_ranges = db::view::calculate_affected_clustering_ranges(*base, m.decorated_key(), m.partition(), views);
     if (cr_ranges.empty()) {
-        return generate_and_propagate_view_updates(base, std::move(views), std::move(m), { });
+        return generate_and_propagate_view_updates(base, std::move(views), std::move(m), { }, view_update_units);
     }
-    // We read the whole set of regular columns in case the update now causes a base row to pass
-    // a view's filters, and a view happens to include columns that have no value in this update.
-    // Also, one of those columns can determine the lifetime of the base row, if it has a TTL.
-    auto columns = boost::copy_range<std::vector<column_id>>(
-            base->regular_columns() | boost::adaptors::transformed(std::mem_fn(&column_definition::id)));
+    // We read the columns the views include or filter on, in case the update now causes a base row
+    // to pass a view's filters, and a view happens to include columns that have no value in this update.
+    // When a view's entries live as long as the base row, all the columns are read, as any of them
+    // can determine the lifetime of the base row, if it has a TTL.
+    auto columns = db::view::regular_columns_affecting_views(*base, views);
     query::partition_slice::option_set opts;
     opts.set(query::partition_slice::option::send_partition_key);
     opts.set(query::partition_slice::option::send_clustering_key);
@@ -4234,25 +6084,97 @@ future<> column_family::push_view_replica_updates(const schema_ptr& s, const fro
         dht::partition_range::make_singular(m.decorated_key()),
         std::move(slice),
         std::move(m),
-        [base, views = std::move(views), this] (auto& pk, auto& slice, auto& m) mutable {
+        [base, views = std::move(views), view_update_units, this] (auto& pk, auto& slice, auto& m) mutable {
             auto reader = this->as_mutation_source()(
                 base,
                 pk,
                 slice,
                 service::get_local_sstable_query_read_priority());
             auto f = reader();
-            return f.then([&m, reader = std::move(reader), base = std::move(base), views = std::move(views), this] (auto&& existing) mutable {
-                return this->generate_and_propagate_view_updates(base, std::move(views), std::move(m), std::move(existing));
+            return f.then([&m, reader = std::move(reader), base = std::move(base), views = std::move(views), view_update_units, this] (auto&& existing) mutable {
+                return this->generate_and_propagate_view_updates(base, std::move(views), std::move(m), std::move(existing), view_update_units);
             });
     });
 }
 
+unsigned column_family::compaction_group_of(const dht::token& t) const {
+    return dht::global_partitioner().ring_range_of(t, compaction_groups());
+}
+
+unsigned column_family::compaction_group_of(const sstables::shared_sstable& sst) const {
+    auto first = compaction_group_of(sst->get_first_decorated_key().token());
+    auto last = compaction_group_of(sst->get_last_decorated_key().token());
+    return first == last ? first : compaction_groups();
+}
+
+static unsigned hit_rate_range_of(const dht::token& t) {
+    return dht::global_partitioner().ring_range_of(t, row_cache::hit_rate_ranges);
+}
+
+cache_temperature column_family::get_cache_hit_rate(const dht::token& t) const {
+    auto rate = _range_cache_hit_rates[hit_rate_range_of(t)];
+    return float(rate) < 0 ? _global_cache_hit_rate : rate;
+}
+
+cache_temperature column_family::get_cache_hit_rate(const dht::partition_range& pr) const {
+    if (pr.is_singular()) {
+        return get_cache_hit_rate(pr.start()->value().token());
+    }
+    return _global_cache_hit_rate;
+}
+
 void column_family::set_hit_rate(gms::inet_address addr, cache_temperature rate) {
-    auto& e = _cluster_cache_hit_rates[addr];
+    auto& e = _cluster_cache_hit_rates[addr].global;
     e.rate = rate;
     e.last_updated = lowres_clock::now();
 }
 
+void column_family::set_hit_rate(gms::inet_address addr, const dht::partition_range& pr, cache_temperature rate) {
+    if (pr.is_singular()) {
+        set_hit_rate(addr, pr.start()->value().token(), rate);
+    } else {
+        set_hit_rate(addr, rate);
+    }
+}
+
+void column_family::set_hit_rate(gms::inet_address addr, const dht::token& t, cache_temperature rate) {
+    auto& e = _cluster_cache_hit_rates[addr].ranges[hit_rate_range_of(t)];
+    e.rate = rate;
+    e.last_updated = lowres_clock::now();
+}
+
+// The hit rates of a column family are gossiped as "ks.cf:<rate>", followed
+// by "/" and two hex digits for the serialized temperature of each range of
+// the ring, which nodes which ignore them stop parsing at.
+static float parse_gossiped_hit_rates(const char* p, std::array<column_family::cache_hit_rate, row_cache::hit_rate_ranges>& ranges) {
+    char* end;
+    float f = strtof(p, &end);
+    if (*end != '/') {
+        return f;
+    }
+    ++end;
+    auto now = lowres_clock::now();
+    for (auto& r : ranges) {
+        if (!isxdigit(end[0]) || !isxdigit(end[1])) {
+            break;
+        }
+        char digits[] = { end[0], end[1], '\0' };
+        r = column_family::cache_hit_rate{cache_temperature(strtoul(digits, nullptr, 16) / 255.0f), now};
+        end += 2;
+    }
+    return f;
+}
+
+sstring column_family::gossiped_cache_hit_rates() const {
+    auto ret = sprint("%s.%s:%f/", _schema->ks_name(), _schema->cf_name(), float(_global_cache_hit_rate));
+    for (auto& r : _range_cache_hit_rates) {
+        auto rate = float(r) < 0 ? _global_cache_hit_rate : r;
+        ret += sprint("%02x", unsigned(rate.get_serialized_temperature()));
+    }
+    ret += ";";
+    return ret;
+}
+
 column_family::cache_hit_rate column_family::get_hit_rate(gms::inet_address addr) {
     auto it = _cluster_cache_hit_rates.find(addr);
     if (utils::fb_utilities::get_broadcast_address() == addr) {
@@ -4268,21 +6190,35 @@ column_family::cache_hit_rate column_family::get_hit_rate(gms::inet_address addr
             if (state) {
                 sstring me = sprint("%s.%s", _schema->ks_name(), _schema->cf_name());
                 auto i = state->value.find(me);
+                auto& e = _cluster_cache_hit_rates[addr];
                 if (i != sstring::npos) {
-                    f = strtof(&state->value[i + me.size() + 1], nullptr);
+                    f = parse_gossiped_hit_rates(&state->value[i + me.size() + 1], e.ranges);
                 } else {
                     f = 0.0f; // empty state means that node has rebooted
                 }
-                set_hit_rate(addr, cache_temperature(f));
-                return cache_hit_rate{cache_temperature(f), lowres_clock::now()};
+                e.global = cache_hit_rate{cache_temperature(f), lowres_clock::now()};
+                return e.global;
             }
         }
         return cache_hit_rate {cache_temperature(0.0f), lowres_clock::now()};
     } else {
-        return it->second;
+        return it->second.global;
     }
 }
 
+column_family::cache_hit_rate column_family::get_hit_rate(gms::inet_address addr, const dht::token& t) {
+    if (utils::fb_utilities::get_broadcast_address() == addr) {
+        return cache_hit_rate { get_cache_hit_rate(t), lowres_clock::now()};
+    }
+    auto global = get_hit_rate(addr);
+    auto it = _cluster_cache_hit_rates.find(addr);
+    if (it == _cluster_cache_hit_rates.end() || float(global.rate) < 0) {
+        return global;
+    }
+    auto& r = it->second.ranges[hit_rate_range_of(t)];
+    return float(r.rate) < 0 ? global : r;
+}
+
 void column_family::drop_hit_rate(gms::inet_address addr) {
     _cluster_cache_hit_rates.erase(addr);
 }
@@ -4313,13 +6249,24 @@ write_memtable_to_sstable(memtable& mt, sstables::shared_sstable sst,
                           seastar::shared_ptr<sstables::write_monitor> monitor,
                           bool backup, const io_priority_class& pc, bool leave_unsealed,
                           seastar::thread_scheduling_group *tsg) {
+    return write_memtable_to_sstable(mt, query::full_partition_range, mt.partition_count(), std::move(sst), std::move(monitor),
+            backup, pc, leave_unsealed, tsg);
+}
+
+future<>
+write_memtable_to_sstable(memtable& mt, const dht::partition_range& range, uint64_t estimated_partitions,
+                          sstables::shared_sstable sst,
+                          seastar::shared_ptr<sstables::write_monitor> monitor,
+                          bool backup, const io_priority_class& pc, bool leave_unsealed,
+                          seastar::thread_scheduling_group *tsg) {
     sstables::sstable_writer_config cfg;
     cfg.replay_position = mt.replay_position();
     cfg.backup = backup;
     cfg.leave_unsealed = leave_unsealed;
     cfg.thread_scheduling_group = tsg;
     cfg.monitor = std::move(monitor);
-    return sst->write_components(mt.make_flush_reader(mt.schema(), pc), mt.partition_count(), mt.schema(), cfg, pc);
+    cfg.write_behind = mt.get_dirty_memory_manager().flush_write_behind(sst->buffer_size());
+    return sst->write_components(mt.make_flush_reader(mt.schema(), pc, range), estimated_partitions, mt.schema(), cfg, pc);
 }
 
 future<>
@@ -68,10 +68,15 @@
 #include "utils/exponential_backoff_retry.hh"
 #include "utils/histogram.hh"
 #include "utils/estimated_histogram.hh"
+#include "utils/log_linear_histogram.hh"
+#include "utils/time_decaying_histogram.hh"
+#include "utils/cost_accountant.hh"
+#include "db/consistency_level_type.hh"
 #include "sstables/sstable_set.hh"
 #include "sstables/version.hh"
 #include <seastar/core/rwlock.hh>
 #include <seastar/core/shared_future.hh>
+#include <seastar/core/queue.hh>
 #include <seastar/core/metrics_registration.hh>
 #include "tracing/trace_state.hh"
 #include "db/view/view.hh"
@@ -80,6 +85,10 @@
 #include "cpu_controller.hh"
 #include "dirty_memory_manager.hh"
 #include "reader_resource_tracker.hh"
+#include "top_partitions.hh"
+#include "counter_cache.hh"
+#include "querier.hh"
+#include "sstables/index_summary_manager.hh"
 
 class cell_locker;
 class cell_locker_stats;
@@ -156,6 +165,7 @@ class memtable_list {
     std::function<schema_ptr()> _current_schema;
     dirty_memory_manager* _dirty_memory_manager;
     std::experimental::optional<shared_promise<>> _flush_coalescing;
+    write_throttle _write_throttle;
 public:
     memtable_list(
             seal_immediate_fn_type seal_immediate_fn,
@@ -239,6 +249,12 @@ class memtable_list {
     logalloc::region_group& region_group() {
         return _dirty_memory_manager->region_group();
     }
+
+    // How long a write of the given size should wait before it is applied.
+    std::chrono::steady_clock::duration write_delay(size_t size) {
+        return _dirty_memory_manager->write_delay(_write_throttle, size);
+    }
+
     // This is used for explicit flushes. Will queue the memtable for flushing and proceed when the
     // dirty_memory_manager allows us to. We will not seal at this time since the flush itself
     // wouldn't happen anyway. Keeping the memtable in memory will potentially increase the time it
@@ -267,8 +283,25 @@ struct cf_stats {
     int64_t clustering_filter_fast_path_count = 0;
     // how many sstables survived the clustering key checks
     int64_t surviving_sstables_after_clustering_filter = 0;
+    // sstables single partition reads didn't read, for newer sstables shadowed their data
+    int64_t sstables_shadowed_for_single_key_reads = 0;
+    // partition key scans read from the sstable indexes rather than the data files
+    int64_t partition_key_reads_from_index = 0;
+
+    // number of base writes delayed because of the view update backlog
+    int64_t view_update_delayed_writes = 0;
+
+    // The sums of the sstable statistics of the column families of this
+    // shard, kept up to date as sstables come and go, so that the load of
+    // the node can be reported without walking the column families.
+    int64_t live_disk_space_used = 0;
+    int64_t total_disk_space_used = 0;
+    int64_t live_sstable_count = 0;
+    int64_t estimated_partitions = 0;
 };
 
+struct query_state;
+
 class cache_temperature {
     float hit_rate;
     explicit cache_temperature(uint8_t hr) : hit_rate(hr/255.0f) {}
@@ -299,9 +332,26 @@ class column_family : public enable_lw_shared_from_this<column_family> {
         restricted_mutation_reader_config read_concurrency_config;
         restricted_mutation_reader_config streaming_read_concurrency_config;
         ::cf_stats* cf_stats = nullptr;
+        // Accounts the memory of view updates in flight, when set.
+        semaphore* view_update_concurrency_semaphore = nullptr;
+        size_t view_update_concurrency_semaphore_limit = 0;
+        // Keeps the readers of paged single partition queries between pages, when set.
+        ::querier_cache* querier_cache = nullptr;
         seastar::thread_scheduling_group* background_writer_scheduling_group = nullptr;
         seastar::thread_scheduling_group* memtable_scheduling_group = nullptr;
         bool enable_metrics_reporting = false;
+        sstables::sstable_version_types sstables_version = sstables::sstable_version_types::ka;
+        top_partitions_tracker::config top_partitions;
+        bool enable_streaming_sstable_writes = false;
+        bool enable_replay_sstable_writes = false;
+        size_t replay_run_size = 64 << 20;
+        // The most large partitions and rows recorded in the system tables
+        // for this table. Zero disables the records.
+        size_t large_data_records_per_table = 0;
+        // Token ranges the sstables are split into, see compaction_group_of().
+        unsigned compaction_groups = 1;
+        // Whether compactions may run on other shards, see pick_compaction_offload_shard().
+        bool enable_compaction_offload = false;
     };
     struct no_commitlog {};
     struct stats {
@@ -312,16 +362,26 @@ class column_family : public enable_lw_shared_from_this<column_family> {
         int64_t live_disk_space_used = 0;
         int64_t total_disk_space_used = 0;
         int64_t live_sstable_count = 0;
+        /** Estimated number of partitions in the live sstables */
+        int64_t estimated_partitions = 0;
         /** Estimated number of compactions pending for this column family */
         int64_t pending_compactions = 0;
-        utils::timed_rate_moving_average_and_histogram reads{256};
-        utils::timed_rate_moving_average_and_histogram writes{256};
-        utils::estimated_histogram estimated_read;
-        utils::estimated_histogram estimated_write;
+        // The latencies of reads and writes, whose distribution is in hist.values.
+        utils::timed_rate_moving_average_and_histogram reads;
+        utils::timed_rate_moving_average_and_histogram writes;
         utils::estimated_histogram estimated_sstable_per_read{35};
         utils::timed_rate_moving_average_and_histogram tombstone_scanned;
         utils::timed_rate_moving_average_and_histogram live_scanned;
-        utils::estimated_histogram estimated_coordinator_read;
+        utils::log_linear_histogram estimated_coordinator_read;
+        // Latencies, in microseconds, of the stages of the reads and writes
+        // of this replica. Reads wait for the memory of their result first,
+        // then read from the cache and the sstables. Writes are added to the
+        // commitlog, then wait for dirty memory before they are applied to
+        // the memtable, which writes measures.
+        utils::log_linear_histogram estimated_read_admission;
+        utils::log_linear_histogram estimated_read_execution;
+        utils::log_linear_histogram estimated_write_commitlog;
+        utils::log_linear_histogram estimated_write_memory_wait;
     };
 
     struct snapshot_details {
@@ -332,15 +392,35 @@ class column_family : public enable_lw_shared_from_this<column_family> {
         cache_temperature rate;
         lowres_clock::time_point last_updated;
     };
+    // The single partition reads of all shards in each range of the ring,
+    // by row_cache::hit_rate_ranges.
+    struct range_cache_reads {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+    };
+    using range_cache_reads_array = std::array<range_cache_reads, row_cache::hit_rate_ranges>;
+    using range_cache_hit_rates = std::array<cache_temperature, row_cache::hit_rate_ranges>;
 private:
     schema_ptr _schema;
     config _config;
     mutable stats _stats;
+    // Queues the readers of the table for admission, see restricted_mutation_reader_config::admission_sem.
+    semaphore _read_admission_sem{1};
 
     uint64_t _failed_counter_applies_to_memtable = 0;
+    // Bumped when counters may change other than by the updates this node
+    // leads, which makes their local shards cached so far stale.
+    uint64_t _counter_cache_generation = 0;
+    // Bumped when the data of the table goes away under the readers which
+    // queriers suspended between pages keep.
+    uint64_t _querier_generation = 0;
 
     template<typename... Args>
     void do_apply(db::rp_handle&&, Args&&... args);
+    void sample_write(const mutation& m);
+    void sample_write(const frozen_mutation& m, const schema_ptr& m_schema);
+    future<> query_with_querier(query_state& qs);
+    void prefetch_index_pages(const schema& s, const dht::partition_range_vector& ranges, const io_priority_class& pc) const;
 
     lw_shared_ptr<memtable_list> _memtables;
 
@@ -378,10 +458,74 @@ class column_family : public enable_lw_shared_from_this<column_family> {
     };
     std::unordered_map<utils::UUID, lw_shared_ptr<streaming_memtable_big>> _streaming_memtables_big;
 
+    // When enable_streaming_sstable_writes is set, the mutations of a streaming
+    // plan are written straight to sstables instead, without going through
+    // memtables and competing with user writes for dirty memory. Senders read
+    // their ranges in token order, but send their mutations concurrently, so
+    // mutations are put back in order in a small window first. A mutation which
+    // comes after a later partition was written starts a new sstable. As for
+    // fragmented mutations, the sstables are left unsealed and only made
+    // visible once the plan is complete.
+    class streaming_sstable_writer {
+        static constexpr size_t window_size_limit = 4 * 1024 * 1024;
+        struct window_entry {
+            mutation m;
+            size_t size;
+        };
+        column_family& _cf;
+        std::map<dht::decorated_key, window_entry, dht::decorated_key::less_comparator> _window;
+        size_t _window_size = 0;
+        stdx::optional<dht::decorated_key> _last_written;
+        // Feeds the partitions to the writer of the last sstable.
+        lw_shared_ptr<queue<streamed_mutation_opt>> _queue;
+        future<> _written = make_ready_future<>();
+        std::vector<sstables::shared_sstable> _sstables;
+        // Serializes writes of the window to the sstables.
+        semaphore _write_sem{1};
+        bool _aborted = false;
+    private:
+        void start_sstable();
+        future<> end_sstable();
+        future<> write_first();
+    public:
+        explicit streaming_sstable_writer(column_family& cf);
+        future<> write(schema_ptr m_schema, const frozen_mutation& m);
+        future<std::vector<sstables::shared_sstable>> finish();
+        future<> abort();
+    };
+    std::unordered_map<utils::UUID, lw_shared_ptr<streaming_sstable_writer>> _streaming_sstable_writers;
+
+    // When enable_replay_sstable_writes is set, the mutations replayed from the
+    // commitlog are written straight to sstables instead of memtables. They are
+    // sorted in runs of up to replay_run_size bytes, each written to an sstable
+    // once full. The sstables are left unsealed and only made visible once the
+    // replay is complete.
+    class replay_sstable_writer {
+        using run_type = std::map<dht::decorated_key, mutation, dht::decorated_key::less_comparator>;
+        column_family& _cf;
+        run_type _run;
+        size_t _run_size = 0;
+        std::vector<sstables::shared_sstable> _sstables;
+        // Writes one run at a time, so that the replay waits for the
+        // sstables rather than filling memory with runs.
+        semaphore _write_sem{1};
+    private:
+        future<> write_run();
+    public:
+        explicit replay_sstable_writer(column_family& cf);
+        future<> write(mutation m, size_t size);
+        future<std::vector<sstables::shared_sstable>> finish();
+    };
+    lw_shared_ptr<replay_sstable_writer> _replay_sstable_writer;
+
+    future<std::vector<sstables::shared_sstable>> finish_streaming_sstable_writes(utils::UUID plan_id);
     future<std::vector<sstables::shared_sstable>> flush_streaming_big_mutations(utils::UUID plan_id);
     void apply_streaming_big_mutation(schema_ptr m_schema, utils::UUID plan_id, const frozen_mutation& m);
     future<> seal_active_streaming_memtable_big(streaming_memtable_big& smb, flush_permit&&);
 
+    future<> load_snapshots();
+    future<> link_snapshot_sstables(sstring name, std::vector<sstables::shared_sstable> tables);
+
     lw_shared_ptr<memtable_list> make_memory_only_memtable_list();
     lw_shared_ptr<memtable_list> make_memtable_list();
     lw_shared_ptr<memtable_list> make_streaming_memtable_list();
@@ -411,6 +555,47 @@ class column_family : public enable_lw_shared_from_this<column_family> {
     rwlock _sstables_lock;
     mutable row_cache _cache; // Cache covers only sstables.
     std::experimental::optional<int64_t> _sstable_generation = {};
+    // What this shard knows of the snapshots of this table, so that incremental
+    // snapshots can tell which sstables are already linked, and so that
+    // get_snapshot_details() doesn't have to stat every file of every snapshot.
+    struct snapshot_contents {
+        // Generation -> size on disk, of the sstables this shard linked in the
+        // snapshot's directory.
+        std::unordered_map<int64_t, uint64_t> linked;
+        // Generation -> the earlier snapshot holding the links, of the sstables
+        // an incremental snapshot refers to instead of linking them again.
+        std::unordered_map<int64_t, sstring> referenced;
+    };
+    std::unordered_map<sstring, snapshot_contents> _snapshots;
+    // Generation -> a snapshot holding links to it, of the sstables linked by
+    // this shard.
+    std::unordered_map<int64_t, sstring> _snapshot_links;
+    // The snapshots taken before this node started are loaded from disk once,
+    // on first use.
+    bool _snapshots_loaded = false;
+    semaphore _snapshots_load_sem{1};
+    // Data file name -> number of records, of the sstables of this shard with
+    // large partitions or rows in system.large_partitions and system.large_rows,
+    // loaded on first use. The updates are serialized by _large_data_sem.
+    std::unordered_map<sstring, uint64_t> _large_data_sstables;
+    uint64_t _large_data_records = 0;
+    bool _large_data_loaded = false;
+    semaphore _large_data_sem{1};
+    seastar::gate _large_data_gate;
+public:
+    struct size_estimate {
+        int64_t partitions_count = 0;
+        int64_t mean_partition_size = 0;
+    };
+    // By the text of the bounds of the token range, as shown by system.size_estimates.
+    using size_estimates_cache = std::map<std::pair<bytes, bytes>, size_estimate>;
+private:
+    // The size estimates computed from the current sstables, dropped when
+    // the sstable set changes.
+    mutable size_estimates_cache _size_estimates;
+    // The estimated number of distinct partitions in the current sstables,
+    // dropped when the sstable set changes.
+    mutable std::experimental::optional<uint64_t> _estimated_partition_count;
 
     db::replay_position _highest_rp;
     db::replay_position _lowest_allowed_rp;
@@ -425,6 +610,9 @@ class column_family : public enable_lw_shared_from_this<column_family> {
     std::vector<view_ptr> _views;
 
     std::unique_ptr<cell_locker> _counter_cell_locks;
+    top_partitions_tracker _top_partitions;
+    // The time spent on the table, and the bytes its sstables read and wrote.
+    utils::cost_accountant::usage_ptr _cost;
     void set_metrics();
     seastar::metrics::metric_groups _metrics;
 
@@ -432,10 +620,29 @@ class column_family : public enable_lw_shared_from_this<column_family> {
     // recalculated periodically
     cache_temperature _global_cache_hit_rate = cache_temperature(0.0f);
 
+    // The hit rates of this node in each range of the ring, invalid for the
+    // ranges not read yet, and the reads they were last computed from.
+    range_cache_hit_rates _range_cache_hit_rates;
+    range_cache_reads_array _range_cache_reads;
+
+    std::vector<dht::partition_range> _compaction_group_ranges;
+
+    struct node_cache_hit_rates {
+        cache_hit_rate global;
+        // Invalid until known.
+        std::array<cache_hit_rate, row_cache::hit_rate_ranges> ranges;
+
+        node_cache_hit_rates() {
+            for (auto& r : ranges) {
+                r.rate = cache_temperature::invalid();
+            }
+        }
+    };
+
     // holds cache hit rates per each node in a cluster
     // may not have information for some node, since it fills
     // in dynamically
-    std::unordered_map<gms::inet_address, cache_hit_rate> _cluster_cache_hit_rates;
+    std::unordered_map<gms::inet_address, node_cache_hit_rates> _cluster_cache_hit_rates;
 
     // Operations like truncate, flush, query, etc, may depend on a column family being alive to
     // complete.  Some of them have their own gate already (like flush), used in specialized wait
@@ -445,11 +652,21 @@ class column_family : public enable_lw_shared_from_this<column_family> {
     // have to get.  It will be closed by stop().
     seastar::gate _async_gate;
 
-    double _cached_percentile = -1;
-    lowres_clock::time_point _percentile_cache_timestamp;
-    std::chrono::milliseconds _percentile_cache_value;
+    // The latency of the reads this shard coordinated, by consistency level,
+    // from which speculative retry decides when to read from one more replica.
+    struct coordinator_read_latency {
+        utils::time_decaying_histogram<lowres_clock> histogram;
+        double cached_percentile = -1;
+        lowres_clock::time_point cache_timestamp;
+        std::chrono::microseconds cached_value;
+
+        coordinator_read_latency();
+    };
+    std::unordered_map<db::consistency_level, coordinator_read_latency> _coordinator_read_latencies;
 private:
-    void update_stats_for_new_sstable(uint64_t disk_space_used_by_sstable, const std::vector<unsigned>& shards_for_the_sstable) noexcept;
+    // Sstables shared by several shards are accounted for by the lowest of them only.
+    void update_stats_for_new_sstable(const sstables::shared_sstable& sst, const std::vector<unsigned>& shards_for_the_sstable, bool live) noexcept;
+    void remove_sstable_stats_from_shard() noexcept;
     // Adds new sstable to the set of sstables
     // Doesn't update the cache. The cache must be synchronized in order for reads to see
     // the writes contained in this sstable.
@@ -465,7 +682,7 @@ class column_family : public enable_lw_shared_from_this<column_family> {
     lw_shared_ptr<memtable> new_streaming_memtable();
     future<stop_iteration> try_flush_memtable_to_sstable(lw_shared_ptr<memtable> memt, sstable_write_permit&& permit);
     // Caller must keep m alive.
-    future<> update_cache(lw_shared_ptr<memtable> m, sstables::shared_sstable sst);
+    future<> update_cache(lw_shared_ptr<memtable> m, std::vector<sstables::shared_sstable> ssts);
     struct merge_comparator;
 
     // update the sstable generation, making sure that new new sstables don't overwrite this one.
@@ -492,12 +709,28 @@ class column_family : public enable_lw_shared_from_this<column_family> {
     // Rebuild existing _sstables with new_sstables added to it and sstables_to_remove removed from it.
     void rebuild_sstable_list(const std::vector<sstables::shared_sstable>& new_sstables,
                               const std::vector<sstables::shared_sstable>& sstables_to_remove);
+    future<> warm_up_index_pages(const std::vector<sstables::shared_sstable>& old_sstables,
+                                 const std::vector<sstables::shared_sstable>& new_sstables) const;
     void rebuild_statistics();
 
     // This function replaces new sstables by their ancestors, which are sstables that needed resharding.
     void replace_ancestors_needed_rewrite(std::vector<sstables::shared_sstable> new_sstables);
     void remove_ancestors_needed_rewrite(std::unordered_set<uint64_t> ancestors);
+
+    // Record the large partitions and rows the sstable was written with, or
+    // remove their records once it is deleted, in the background.
+    void record_large_data(const sstables::shared_sstable& sst);
+    void remove_large_data(const std::vector<sstables::shared_sstable>& sstables);
+    future<> load_large_data();
 private:
+    // Returns the shard to run a compaction of this shard on, if this shard is
+    // already compacting and another one is idle, with a much smaller backlog.
+    future<stdx::optional<shard_id>> pick_compaction_offload_shard();
+    // Compacts sstables on shard helper, see sstables::compact_sstables_for_shard(),
+    // and loads the new sstables on this shard.
+    future<sstables::compaction_info> offload_compaction(shard_id helper, std::vector<sstables::shared_sstable> sstables,
+            uint64_t max_sstable_bytes, uint32_t level);
+
     mutation_source_opt _virtual_reader;
     // Creates a mutation reader which covers given sstables.
     // Caller needs to ensure that column_family remains live (FIXME: relax this).
@@ -512,6 +745,16 @@ class column_family : public enable_lw_shared_from_this<column_family> {
                                         streamed_mutation::forwarding fwd,
                                         mutation_reader::forwarding fwd_mr) const;
 
+    // Returns a reader of the sstables for partition key only slices which
+    // can be served from the sstable indexes, see partition_key_reader.
+    stdx::optional<mutation_reader> make_partition_key_reader(schema_ptr schema,
+                                        const dht::partition_range& range,
+                                        const query::partition_slice& slice,
+                                        const io_priority_class& pc,
+                                        tracing::trace_state_ptr trace_state,
+                                        streamed_mutation::forwarding fwd,
+                                        mutation_reader::forwarding fwd_mr) const;
+
     mutation_source sstables_as_mutation_source();
     snapshot_source sstables_as_snapshot_source();
     partition_presence_checker make_partition_presence_checker(lw_shared_ptr<sstables::sstable_set>);
@@ -526,10 +769,22 @@ class column_family : public enable_lw_shared_from_this<column_family> {
         return _config.datadir;
     }
 
+    // Reserves the generation of an sstable written outside of the table,
+    // like one received whole by streaming, to be loaded by this shard.
+    int64_t reserve_sstable_generation() {
+        return calculate_generation_for_new_table();
+    }
+
     logalloc::region_group& dirty_memory_region_group() const {
         return _config.dirty_memory_manager->region_group();
     }
 
+    // How long a write of the given size should wait before it is applied, so that writes
+    // slow down gradually as dirty memory grows above the soft limit.
+    std::chrono::steady_clock::duration write_delay(size_t size) {
+        return _memtables->write_delay(size);
+    }
+
     // Used for asynchronous operations that may defer and need to guarantee that the column
     // family will be alive until their termination
     template<typename Func, typename Futurator = futurize<std::result_of_t<Func()>>, typename... Args>
@@ -543,6 +798,23 @@ class column_family : public enable_lw_shared_from_this<column_family> {
         return _failed_counter_applies_to_memtable;
     }
 
+    uint64_t counter_cache_generation() const {
+        return _counter_cache_generation;
+    }
+    void invalidate_counter_cache() {
+        ++_counter_cache_generation;
+    }
+
+    void invalidate_queriers();
+
+    size_estimates_cache& get_size_estimates_cache() const {
+        return _size_estimates;
+    }
+
+    // Merges the cardinality estimators of the sstables, so that partitions
+    // written to several of them are counted once.
+    uint64_t estimated_partition_count() const;
+
     // This function should be called when this column family is ready for writes, IOW,
     // to produce SSTables. Extensive details about why this is important can be found
     // in Scylla's Github Issue #1014
@@ -590,10 +862,26 @@ class column_family : public enable_lw_shared_from_this<column_family> {
     mutation_reader make_streaming_reader(schema_ptr schema,
             const dht::partition_range& range = query::full_partition_range) const;
 
+    // The 'slice' parameter must be live as long as the reader is used.
+    mutation_reader make_streaming_reader(schema_ptr schema,
+            const dht::partition_range& range, const query::partition_slice& slice,
+            mutation_reader::forwarding fwd_mr = mutation_reader::forwarding::no) const;
+
     // Requires ranges to be sorted and disjoint.
     mutation_reader make_streaming_reader(schema_ptr schema,
             const dht::partition_range_vector& ranges) const;
 
+    // Like the above, but doesn't read the excluded sstables, which are streamed whole.
+    mutation_reader make_streaming_reader(schema_ptr schema,
+            const dht::partition_range_vector& ranges,
+            const std::vector<sstables::shared_sstable>& excluded) const;
+
+    // Like the above, but reads only the given sstables, which don't belong
+    // to the table, such as the ones of the upload directory being bulk loaded.
+    mutation_reader make_streaming_reader_of(schema_ptr schema,
+            const dht::partition_range_vector& ranges,
+            std::vector<sstables::shared_sstable> sstables) const;
+
     mutation_source as_mutation_source() const;
 
     void set_virtual_reader(mutation_source virtual_reader) {
@@ -615,6 +903,11 @@ class column_family : public enable_lw_shared_from_this<column_family> {
         return _cache;
     }
 
+    // Reads the whole table into the cache if it has the in_memory caching
+    // option, so that the cache covers it continuously and reads never go to
+    // the sstables. Needed after the cache is invalidated.
+    future<> warm_in_memory_cache();
+
     future<std::vector<locked_cell>> lock_counter_cells(const mutation& m, timeout_clock::time_point timeout);
 
     logalloc::occupancy_stats occupancy() const;
@@ -638,10 +931,24 @@ class column_family : public enable_lw_shared_from_this<column_family> {
     void apply(const frozen_mutation& m, const schema_ptr& m_schema, db::rp_handle&& = {});
     void apply(const mutation& m, db::rp_handle&& = {});
     void apply_streaming_mutation(schema_ptr, utils::UUID plan_id, const frozen_mutation&, bool fragmented);
+    // Writes a streamed mutation straight to the sstables of the plan, when
+    // writes_streaming_to_sstables().
+    future<> write_streaming_mutation(schema_ptr, utils::UUID plan_id, const frozen_mutation&);
+    bool writes_streaming_to_sstables() const {
+        return _config.enable_streaming_sstable_writes;
+    }
+    // Writes a mutation replayed from the commitlog straight to sstables, when
+    // writes_replay_to_sstables(). size is that of its commitlog entry.
+    future<> write_replayed_mutation(mutation m, size_t size);
+    // Makes the sstables written by the replay visible.
+    future<> finish_replayed_writes();
+    bool writes_replay_to_sstables() const {
+        return _config.enable_replay_sstable_writes;
+    }
 
     // Returns at most "cmd.limit" rows
     future<lw_shared_ptr<query::result>> query(schema_ptr,
-        const query::read_command& cmd, query::result_request request,
+        const query::read_command& cmd, query::result_options opts,
         const dht::partition_range_vector& ranges,
         tracing::trace_state_ptr trace_state,
         query::result_memory_limiter& memory_limiter,
@@ -686,6 +993,11 @@ class column_family : public enable_lw_shared_from_this<column_family> {
     // to them, and then pass that + 1 as "start".
     future<std::vector<sstables::entry_descriptor>> reshuffle_sstables(std::set<int64_t> all_generations, int64_t start);
 
+    // Opens, on this shard, the given sstables of the upload directory without
+    // adding them to the table, so that they can be read with
+    // make_streaming_reader_of().
+    future<std::vector<sstables::shared_sstable>> open_upload_sstables(std::vector<sstables::entry_descriptor> descriptors);
+
     // FIXME: this is just an example, should be changed to something more
     // general. compact_all_sstables() starts a compaction of all sstables.
     // It doesn't flush the current memtable first. It's just a ad-hoc method,
@@ -706,8 +1018,17 @@ class column_family : public enable_lw_shared_from_this<column_family> {
 
     db::replay_position set_low_replay_position_mark();
 
-    future<> snapshot(sstring name);
+    // An incremental snapshot links only the sstables no earlier snapshot has
+    // links to; the manifest lists the others under "previous", by the
+    // snapshot holding them.
+    future<> snapshot(sstring name, bool incremental = false);
+    // The sizes of the sstables this shard linked in each snapshot; those of
+    // all shards add up to the size of the snapshot.
     future<std::unordered_map<sstring, snapshot_details>> get_snapshot_details();
+    // Called on every shard before the snapshot is removed from disk, or all
+    // of them if the name is empty. The sstables later incremental snapshots
+    // refer to in it are linked into those snapshots first.
+    future<> release_snapshot(sstring name);
 
     const bool incremental_backups_enabled() const {
         return _config.enable_incremental_backups;
@@ -717,17 +1038,38 @@ class column_family : public enable_lw_shared_from_this<column_family> {
         _config.enable_incremental_backups = val;
     }
 
+    // The version in which new sstables of this column family are written.
+    sstables::sstable_version_types sstables_version() const {
+        return _config.sstables_version;
+    }
+
     const sstables::sstable_set& get_sstable_set() const;
     lw_shared_ptr<sstable_list> get_sstables() const;
     lw_shared_ptr<sstable_list> get_sstables_including_compacted_undeleted() const;
     const std::vector<sstables::shared_sstable>& compacted_undeleted_sstables() const;
     std::vector<sstables::shared_sstable> select_sstables(const dht::partition_range& range) const;
+    // Whether any memtable holds data in range.
+    bool memtables_contain(const dht::partition_range& range) const;
     std::vector<sstables::shared_sstable> candidates_for_compaction() const;
     std::vector<sstables::shared_sstable> sstables_need_rewrite() const;
     size_t sstables_count() const;
     std::vector<uint64_t> sstable_count_per_level() const;
     int64_t get_unleveled_sstables() const;
 
+    // The sstables of each shard are split into compaction groups by the ring
+    // range of their tokens. Flushes write one sstable per group, and the
+    // sstables of a group are compacted together, independently of the other
+    // groups. Compacting sstables of several groups writes them back per group.
+    unsigned compaction_groups() const {
+        return _config.compaction_groups;
+    }
+    const dht::partition_range& compaction_group_range(unsigned group) const {
+        return _compaction_group_ranges[group];
+    }
+    unsigned compaction_group_of(const dht::token& t) const;
+    // compaction_groups() for the sstables spanning several groups.
+    unsigned compaction_group_of(const sstables::shared_sstable& sst) const;
+
     void start_compaction();
     void trigger_compaction();
     void try_trigger_compaction() noexcept;
@@ -765,8 +1107,44 @@ class column_family : public enable_lw_shared_from_this<column_family> {
         _global_cache_hit_rate = rate;
     }
 
+    const range_cache_hit_rates& get_range_cache_hit_rates() const {
+        return _range_cache_hit_rates;
+    }
+
+    const range_cache_reads_array& get_range_cache_reads() const {
+        return _range_cache_reads;
+    }
+
+    void set_range_cache_hit_rates(const range_cache_hit_rates& rates, const range_cache_reads_array& reads) {
+        _range_cache_hit_rates = rates;
+        _range_cache_reads = reads;
+    }
+
+    // The hit rate of this node in the range of the ring of t, or the global
+    // one when that range wasn't read yet.
+    cache_temperature get_cache_hit_rate(const dht::token& t) const;
+    // The hit rate of this node for reading pr.
+    cache_temperature get_cache_hit_rate(const dht::partition_range& pr) const;
+    // The hit rates of this node, as gossiped in CACHE_HITRATES.
+    sstring gossiped_cache_hit_rates() const;
+
+    top_partitions_tracker& top_partitions() {
+        return _top_partitions;
+    }
+
+    utils::cost_accountant::usage& cost() {
+        return *_cost;
+    }
+
     void set_hit_rate(gms::inet_address addr, cache_temperature rate);
+    // Sets the hit rate addr had reading pr, which is the one of the range
+    // of the ring of pr for single partition ones.
+    void set_hit_rate(gms::inet_address addr, const dht::partition_range& pr, cache_temperature rate);
+    void set_hit_rate(gms::inet_address addr, const dht::token& t, cache_temperature rate);
     cache_hit_rate get_hit_rate(gms::inet_address addr);
+    // The hit rate of addr in the range of the ring of t, or its global one
+    // when that isn't known.
+    cache_hit_rate get_hit_rate(gms::inet_address addr, const dht::token& t);
     void drop_hit_rate(gms::inet_address addr);
 
     future<> run_with_compaction_disabled(std::function<future<> ()> func);
@@ -775,18 +1153,32 @@ class column_family : public enable_lw_shared_from_this<column_family> {
     void remove_view(view_ptr v);
     const std::vector<view_ptr>& views() const;
     future<> push_view_replica_updates(const schema_ptr& s, const frozen_mutation& fm) const;
-    void add_coordinator_read_latency(utils::estimated_histogram::duration latency);
-    std::chrono::milliseconds get_coordinator_read_latency_percentile(double percentile);
+    void add_coordinator_read_latency(db::consistency_level cl, utils::latency_counter::duration latency);
+    // Starts lc for the latencies of the stages of the next write.
+    void sample_write_latency(utils::latency_counter& lc) const {
+        lc.start();
+    }
+    // Add the latency of a stage of a write, when lc was started by
+    // sample_write_latency() as the stage began.
+    void add_write_commitlog_latency(utils::latency_counter& lc);
+    void add_write_memory_wait_latency(utils::latency_counter& lc);
+    // Too few reads were seen to tell when microseconds::max() is returned.
+    std::chrono::microseconds get_coordinator_read_latency_percentile(db::consistency_level cl, double percentile);
 
     secondary_index::secondary_index_manager& get_index_manager() {
         return _index_manager;
     }
 private:
     std::vector<view_ptr> affected_views(const schema_ptr& base, const mutation& update) const;
+    future<> do_push_view_replica_updates(mutation m, std::vector<view_ptr> views, size_t view_update_units) const;
     future<> generate_and_propagate_view_updates(const schema_ptr& base,
             std::vector<view_ptr>&& views,
             mutation&& m,
-            streamed_mutation_opt existings) const;
+            streamed_mutation_opt existings,
+            size_t view_update_units) const;
+    size_t view_update_units(size_t memory) const;
+    void release_view_update_units(size_t units) const;
+    future<> delay_for_view_update_backlog() const;
 
     // One does not need to wait on this future if all we are interested in, is
     // initiating the write.  The writes initiated here will eventually
@@ -947,6 +1339,11 @@ class keyspace {
         restricted_mutation_reader_config read_concurrency_config;
         restricted_mutation_reader_config streaming_read_concurrency_config;
         ::cf_stats* cf_stats = nullptr;
+        // Accounts the memory of view updates in flight, when set.
+        semaphore* view_update_concurrency_semaphore = nullptr;
+        size_t view_update_concurrency_semaphore_limit = 0;
+        // Keeps the readers of paged single partition queries between pages, when set.
+        ::querier_cache* querier_cache = nullptr;
         seastar::thread_scheduling_group* background_writer_scheduling_group = nullptr;
         seastar::thread_scheduling_group* memtable_scheduling_group = nullptr;
         bool enable_metrics_reporting = false;
@@ -1034,7 +1431,7 @@ class database {
     static size_t max_memory_concurrent_reads() { return memory::stats().total_memory() * 0.02; }
     static size_t max_memory_streaming_concurrent_reads() { return memory::stats().total_memory() * 0.02; }
     static size_t max_memory_system_concurrent_reads() { return memory::stats().total_memory() * 0.02; };
-    static constexpr size_t max_concurrent_sstable_loads() { return 3; }
+    static size_t max_memory_pending_view_updates() { return memory::stats().total_memory() * 0.1; }
     struct db_stats {
         uint64_t total_writes = 0;
         uint64_t total_writes_failed = 0;
@@ -1046,9 +1443,13 @@ class database {
         uint64_t active_reads = 0;
         uint64_t active_reads_streaming = 0;
         uint64_t active_reads_system_keyspace = 0;
+        uint64_t queued_reads = 0;
+        uint64_t queued_reads_system_keyspace = 0;
 
         uint64_t short_data_queries = 0;
         uint64_t short_mutation_queries = 0;
+
+        uint64_t sstables_loaded = 0;
     };
 
     lw_shared_ptr<db_stats> _stats;
@@ -1069,7 +1470,12 @@ class database {
     semaphore _system_read_concurrency_sem{max_memory_system_concurrent_reads()};
     restricted_mutation_reader_config _system_read_concurrency_config;
 
-    semaphore _sstable_load_concurrency_sem{max_concurrent_sstable_loads()};
+    semaphore _sstable_load_concurrency_sem;
+    semaphore _view_update_concurrency_sem{max_memory_pending_view_updates()};
+
+    counter_cache _counter_cache;
+    querier_cache _querier_cache;
+    sstables::index_summary_manager _index_summary_manager;
 
     std::unordered_map<sstring, keyspace> _keyspaces;
     std::unordered_map<utils::UUID, lw_shared_ptr<column_family>> _column_families;
@@ -1173,7 +1579,7 @@ class database {
     unsigned shard_of(const dht::token& t);
     unsigned shard_of(const mutation& m);
     unsigned shard_of(const frozen_mutation& m);
-    future<lw_shared_ptr<query::result>, cache_temperature> query(schema_ptr, const query::read_command& cmd, query::result_request request, const dht::partition_range_vector& ranges,
+    future<lw_shared_ptr<query::result>, cache_temperature> query(schema_ptr, const query::read_command& cmd, query::result_options opts, const dht::partition_range_vector& ranges,
                                                tracing::trace_state_ptr trace_state, uint64_t max_result_size);
     future<reconcilable_result, cache_temperature> query_mutations(schema_ptr, const query::read_command& cmd, const dht::partition_range& range,
                                                 query::result_memory_accounter&& accounter, tracing::trace_state_ptr trace_state);
@@ -1185,6 +1591,8 @@ class database {
     keyspace::config make_keyspace_config(const keyspace_metadata& ksm);
     const sstring& get_snitch_name() const;
     future<> clear_snapshot(sstring tag, std::vector<sstring> keyspace_names);
+    // Called on every shard before clear_snapshot(); see column_family::release_snapshot().
+    future<> release_snapshot(sstring tag, std::vector<sstring> keyspace_names);
 
     friend std::ostream& operator<<(std::ostream& out, const database& db);
     const std::unordered_map<sstring, keyspace>& get_keyspaces() const {
@@ -1210,6 +1618,9 @@ class database {
         return _ks_cf_to_uuid;
     }
 
+    const querier_cache& get_querier_cache() const {
+        return _querier_cache;
+    }
     const db::config& get_config() const {
         return *_cfg;
     }
@@ -1241,8 +1652,12 @@ class database {
     semaphore& sstable_load_concurrency_sem() {
         return _sstable_load_concurrency_sem;
     }
+    void note_sstable_loaded();
     void register_connection_drop_notifier(netw::messaging_service& ms);
 
+    const ::cf_stats& get_cf_stats() const {
+        return _cf_stats;
+    }
     db_stats& get_stats() {
         return *_stats;
     }
@@ -1260,6 +1675,7 @@ class distributed_loader {
         const io_priority_class& pc = default_priority_class());
     static future<> load_new_sstables(distributed<database>& db, sstring ks, sstring cf, std::vector<sstables::entry_descriptor> new_tables);
     static future<std::vector<sstables::entry_descriptor>> flush_upload_dir(distributed<database>& db, sstring ks_name, sstring cf_name);
+    static future<std::vector<sstables::entry_descriptor>> list_upload_dir(distributed<database>& db, sstring ks_name, sstring cf_name);
     static future<sstables::entry_descriptor> probe_file(distributed<database>& db, sstring sstdir, sstring fname);
     static future<> populate_column_family(distributed<database>& db, sstring sstdir, sstring ks, sstring cf);
     static future<> populate_keyspace(distributed<database>& db, sstring datadir, sstring ks_name);
@@ -45,6 +45,8 @@
 #include <seastar/core/metrics.hh>
 #include <boost/range/adaptor/map.hpp>
 #include <boost/range/adaptor/sliced.hpp>
+#include <boost/range/adaptor/transformed.hpp>
+#include <boost/range/algorithm/sort.hpp>
 
 #include "batchlog_manager.hh"
 #include "canonical_mutation.hh"
@@ -69,11 +71,15 @@
 #include "idl/frozen_schema.dist.impl.hh"
 #include "message/messaging_service.hh"
 #include "cql3/untyped_result_set.hh"
+#include "partition_slice_builder.hh"
+#include "query-result-set.hh"
+#include "utils/UUID_gen.hh"
 
 static logging::logger blogger("batchlog_manager");
 
 const uint32_t db::batchlog_manager::replay_interval;
 const uint32_t db::batchlog_manager::page_size;
+const size_t db::batchlog_manager::replay_memory;
 
 db::batchlog_manager::batchlog_manager(cql3::query_processor& qp)
         : _qp(qp)
@@ -91,15 +97,14 @@ future<> db::batchlog_manager::do_batch_log_replay() {
     // Use with_semaphore is much simpler, but nested invoke_on can
     // cause deadlock.
     return get_batchlog_manager().invoke_on(0, [] (auto& bm) {
-        return bm._sem.wait().then([&bm] {
-            return bm._cpu++ % smp::count;
-        });
-    }).then([] (auto dest) {
-        blogger.debug("Batchlog replay on shard {}: starts", dest);
-        return get_batchlog_manager().invoke_on(dest, [] (auto& bm) {
-            return bm.replay_all_failed_batches();
-        }).then([dest] {
-            blogger.debug("Batchlog replay on shard {}: done", dest);
+        return bm._sem.wait();
+    }).then([] {
+        // Each shard replays the part of the batchlog it stores.
+        return get_batchlog_manager().invoke_on_all([] (auto& bm) {
+            blogger.debug("Batchlog replay on shard {}: starts", engine().cpu_id());
+            return bm.replay_all_failed_batches().then([] {
+                blogger.debug("Batchlog replay on shard {}: done", engine().cpu_id());
+            });
         });
     }).finally([] {
         return get_batchlog_manager().invoke_on(0, [] (auto& bm) {
@@ -145,6 +150,19 @@ future<size_t> db::batchlog_manager::count_all_batches() const {
     });
 }
 
+utils::UUID db::batchlog_manager::make_batch_id() const {
+    auto schema = _qp.db().local().find_schema(system_keyspace::NAME, system_keyspace::BATCHLOG);
+    // One in smp::count ids belongs to this shard, so one is soon found.
+    for (unsigned i = 0; i < 8 * smp::count; ++i) {
+        auto id = utils::UUID_gen::get_time_UUID();
+        auto token = dht::global_partitioner().get_token(*schema, partition_key::from_singular(*schema, id));
+        if (dht::shard_of(token) == engine().cpu_id()) {
+            return id;
+        }
+    }
+    return utils::UUID_gen::get_time_UUID();
+}
+
 mutation db::batchlog_manager::get_batch_log_mutation_for(const std::vector<mutation>& mutations, const utils::UUID& id, int32_t version) {
     return get_batch_log_mutation_for(mutations, id, version, db_clock::now());
 }
@@ -180,12 +198,17 @@ future<> db::batchlog_manager::replay_all_failed_batches() {
 
     // rate limit is in bytes per second. Uses Double.MAX_VALUE if disabled (set to 0 in cassandra.yaml).
     // max rate is scaled by the number of nodes in the cluster (same as for HHOM - see CASSANDRA-5272).
-    auto throttle_in_kb = _qp.db().local().get_config().batchlog_replay_throttle_in_kb() / service::get_storage_service().local().get_token_metadata().get_all_endpoints().size();
+    // All shards replay at the same time, so each gets its share of it.
+    auto total_throttle_in_kb = _qp.db().local().get_config().batchlog_replay_throttle_in_kb();
+    auto throttle_in_kb = total_throttle_in_kb / service::get_storage_service().local().get_token_metadata().get_all_endpoints().size() / smp::count;
+    if (total_throttle_in_kb) {
+        throttle_in_kb = std::max<size_t>(throttle_in_kb, 1);
+    }
     auto limiter = make_lw_shared<utils::rate_limiter>(throttle_in_kb * 1000);
 
-    auto batch = [this, limiter](const cql3::untyped_result_set::row& row) {
-        auto written_at = row.get_as<db_clock::time_point>("written_at");
-        auto id = row.get_as<utils::UUID>("id");
+    auto batch = [this, limiter](const query::result_set_row& row) {
+        auto written_at = row.get_nonnull<db_clock::time_point>("written_at");
+        auto id = row.get_nonnull<utils::UUID>("id");
         // enough time for the actual write + batchlog entry mutation delivery (two separate requests).
         auto timeout = get_batch_log_timeout();
         if (db_clock::now() < written_at + timeout) {
@@ -194,18 +217,18 @@ future<> db::batchlog_manager::replay_all_failed_batches() {
         }
 
         // check version of serialization format
-        if (!row.has("version")) {
+        auto version = row.get<int32_t>("version");
+        if (!version) {
             blogger.warn("Skipping logged batch because of unknown version");
             return make_ready_future<>();
         }
 
-        auto version = row.get_as<int32_t>("version");
-        if (version != netw::messaging_service::current_version) {
+        if (*version != netw::messaging_service::current_version) {
             blogger.warn("Skipping logged batch because of incorrect version");
             return make_ready_future<>();
         }
 
-        auto data = row.get_blob("data");
+        auto data = row.get_nonnull<bytes>("data");
 
         blogger.debug("Replaying batch {}", id);
 
@@ -292,30 +315,51 @@ future<> db::batchlog_manager::replay_all_failed_batches() {
         });
     };
 
-    return seastar::with_gate(_gate, [this, batch = std::move(batch)] {
+    return seastar::with_gate(_gate, [this, batch = std::move(batch)] () mutable {
         blogger.debug("Started replayAllFailedBatches (cpu {})", engine().cpu_id());
 
-        typedef ::shared_ptr<cql3::untyped_result_set> page_ptr;
-        sstring query = sprint("SELECT id, data, written_at, version FROM %s.%s LIMIT %d", system_keyspace::NAME, system_keyspace::BATCHLOG, page_size);
-        return _qp.execute_internal(query).then([this, batch = std::move(batch)](page_ptr page) {
-            return do_with(std::move(page), [this, batch = std::move(batch)](page_ptr & page) mutable {
-                return repeat([this, &page, batch = std::move(batch)]() mutable {
+        auto schema = _qp.db().local().find_schema(system_keyspace::NAME, system_keyspace::BATCHLOG);
+        auto cmd = make_lw_shared<query::read_command>(schema->id(), schema->version(), partition_slice_builder(*schema).build(),
+                page_size, gc_clock::now(), stdx::nullopt, page_size);
+        auto ranges = dht::partition_range_vector{dht::partition_range::make_open_ended_both_sides()};
+        return do_with(std::move(batch), std::move(ranges), [this, schema, cmd] (auto& batch, dht::partition_range_vector& ranges) {
+            return repeat([this, schema, cmd, &batch, &ranges] {
+                // Reads from this shard only, which has the batches whose id
+                // it owns the token of.
+                return _qp.db().local().query(schema, *cmd, query::result_options(query::result_request::only_result, query::digest_algorithm::none),
+                        ranges, nullptr, query::result_memory_limiter::maximum_result_size).then([this, schema, cmd, &batch, &ranges] (lw_shared_ptr<query::result> result, cache_temperature) {
+                    auto page = make_lw_shared<query::result_set>(query::result_set::from_raw_result(schema, cmd->slice, *result));
                     if (page->empty()) {
                         return make_ready_future<stop_iteration>(stop_iteration::yes);
                     }
-                    auto id = page->back().get_as<utils::UUID>("id");
-                    return parallel_for_each(*page, batch).then([this, &page, id]() {
-                        if (page->size() < page_size) {
-                            return make_ready_future<stop_iteration>(stop_iteration::yes); // we've exhausted the batchlog, next query would be empty.
+                    auto last = page->rows().back().get_nonnull<utils::UUID>("id");
+                    auto done = page->rows().size() < page_size && !result->is_short_read();
+                    // Older batches are replayed first.
+                    auto rows = boost::copy_range<std::vector<const query::result_set_row*>>(page->rows() | boost::adaptors::transformed([] (auto& row) {
+                        return &row;
+                    }));
+                    boost::sort(rows, [] (const query::result_set_row* a, const query::result_set_row* b) {
+                        return a->get_nonnull<db_clock::time_point>("written_at") < b->get_nonnull<db_clock::time_point>("written_at");
+                    });
+                    return do_with(std::move(rows), [this, &batch] (std::vector<const query::result_set_row*>& rows) {
+                        return do_for_each(rows, [this, &batch] (const query::result_set_row* row) {
+                            auto size = std::min(row->get_nonnull<bytes>("data").size(), replay_memory);
+                            return get_units(_replay_memory, size).then([&batch, row] (auto units) {
+                                // Batches are replayed in the background, as long as
+                                // they fit in replay_memory.
+                                futurize<void>::apply(batch, *row).finally([units = std::move(units)] { });
+                            });
+                        }).then([this] {
+                            // Waits for the replays of the page to end.
+                            return with_semaphore(_replay_memory, replay_memory, [] { });
+                        });
+                    }).then([schema, page, last, done, &ranges] {
+                        if (done) {
+                            return stop_iteration::yes; // we've exhausted the batchlog, next query would be empty.
                         }
-                        sstring query = sprint("SELECT id, data, written_at, version FROM %s.%s WHERE token(id) > token(?) LIMIT %d",
-                                system_keyspace::NAME,
-                                system_keyspace::BATCHLOG,
-                                page_size);
-                        return _qp.execute_internal(query, {id}).then([&page](auto res) {
-                                    page = std::move(res);
-                                    return make_ready_future<stop_iteration>(stop_iteration::no);
-                                });
+                        auto key = dht::global_partitioner().decorate_key(*schema, partition_key::from_singular(*schema, last));
+                        ranges = {dht::partition_range::make_starting_with(dht::partition_range::bound(dht::ring_position(std::move(key)), false))};
+                        return stop_iteration::no;
                     });
                 });
             });
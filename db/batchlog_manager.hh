@@ -58,6 +58,7 @@ class batchlog_manager {
 private:
     static constexpr uint32_t replay_interval = 60 * 1000; // milliseconds
     static constexpr uint32_t page_size = 128; // same as HHOM, for now, w/out using any heuristics. TODO: set based on avg batch size.
+    static constexpr size_t replay_memory = 1 << 20; // bytes of batches a shard replays at the same time
 
     using clock_type = lowres_clock;
 
@@ -71,8 +72,8 @@ class batchlog_manager {
     cql3::query_processor& _qp;
     timer<clock_type> _timer;
     semaphore _sem{1};
+    semaphore _replay_memory{replay_memory};
     seastar::gate _gate;
-    unsigned _cpu = 0;
     bool _stop = false;
 
     std::random_device _rd;
@@ -94,6 +95,8 @@ class batchlog_manager {
     size_t get_total_batches_replayed() const {
         return _total_batches_replayed;
     }
+    // The id of a new batch, whose batchlog entry belongs to this shard.
+    utils::UUID make_batch_id() const;
     mutation get_batch_log_mutation_for(const std::vector<mutation>&, const utils::UUID&, int32_t);
     mutation get_batch_log_mutation_for(const std::vector<mutation>&, const utils::UUID&, int32_t, db_clock::time_point);
     db_clock::duration get_batch_log_timeout() const;
@@ -62,6 +62,9 @@
 #include <seastar/core/sleep.hh>
 #include <net/byteorder.hh>
 
+#include <lz4.h>
+#include <zstd.h>
+
 #include "seastarx.hh"
 
 #include "commitlog.hh"
@@ -71,6 +74,7 @@
 #include "utils/crc.hh"
 #include "utils/runtime.hh"
 #include "utils/flush_queue.hh"
+#include "utils/log_linear_histogram.hh"
 #include "log.hh"
 #include "commitlog_entry.hh"
 #include "service/priority_manager.hh"
@@ -117,9 +121,102 @@ db::commitlog::config::config(const db::config& cfg)
     , commitlog_total_space_in_mb(cfg.commitlog_total_space_in_mb() >= 0 ? cfg.commitlog_total_space_in_mb() : (memory::stats().total_memory() * smp::count) >> 20)
     , commitlog_segment_size_in_mb(cfg.commitlog_segment_size_in_mb())
     , commitlog_sync_period_in_ms(cfg.commitlog_sync_period_in_ms())
+    , max_recycled_segments(cfg.commitlog_recycled_segments())
     , mode(cfg.commitlog_sync() == "batch" ? sync_mode::BATCH : sync_mode::PERIODIC)
+    , batch_window(cfg.commitlog_batch_window_in_us())
+    , compression([&cfg] {
+        auto& name = cfg.commitlog_compression();
+        if (name.empty() || name == "none") {
+            return compressor::none;
+        } else if (name == "lz4") {
+            return compressor::lz4;
+        } else if (name == "zstd") {
+            return compressor::zstd;
+        }
+        throw std::invalid_argument(sprint("Unsupported commitlog compression '%s'", name));
+    }())
 {}
 
+namespace {
+
+// Identifies the compressor of a compressed entry on disk.
+enum class entry_compressor : uint8_t {
+    lz4 = 1,
+    zstd = 2,
+};
+
+// <int8_t:entry_compressor><int32_t:uncompressed size>
+constexpr size_t compressed_entry_header_size = sizeof(uint8_t) + sizeof(uint32_t);
+
+// Compresses the serialized entry in [in, in + size) into out, which has room for size bytes.
+// Returns the size of the compressed entry, or 0 if it would not be smaller than the input.
+size_t compress_entry(compressor c, const char* in, size_t size, char* out) {
+    if (size <= compressed_entry_header_size + 1) {
+        return 0;
+    }
+    auto dst = out + compressed_entry_header_size;
+    auto room = size - compressed_entry_header_size - 1;
+    size_t len = 0;
+    entry_compressor tag;
+    switch (c) {
+    case compressor::lz4: {
+        tag = entry_compressor::lz4;
+        auto ret = LZ4_compress_default(in, dst, size, room);
+        len = ret > 0 ? ret : 0;
+        break;
+    }
+    case compressor::zstd: {
+        tag = entry_compressor::zstd;
+        auto ret = ZSTD_compress(dst, room, in, size, compression_parameters::DEFAULT_ZSTD_COMPRESSION_LEVEL);
+        len = ZSTD_isError(ret) ? 0 : ret;
+        break;
+    }
+    default:
+        return 0;
+    }
+    if (!len) {
+        return 0;
+    }
+    data_output header(out, compressed_entry_header_size);
+    header.write(uint8_t(tag));
+    header.write(uint32_t(size));
+    return compressed_entry_header_size + len;
+}
+
+// Returns the serialized entry from the data of a compressed one.
+temporary_buffer<char> decompress_entry(const temporary_buffer<char>& buf) {
+    if (buf.size() < compressed_entry_header_size) {
+        throw std::runtime_error("Compressed entry too short");
+    }
+    data_input in(buf);
+    auto tag = entry_compressor(in.read<uint8_t>());
+    auto size = in.read<uint32_t>();
+    auto src = buf.get() + compressed_entry_header_size;
+    auto src_size = buf.size() - compressed_entry_header_size;
+    temporary_buffer<char> out(size);
+    switch (tag) {
+    case entry_compressor::lz4: {
+        auto ret = LZ4_decompress_safe(src, out.get_write(), src_size, size);
+        if (ret < 0 || size_t(ret) != size) {
+            throw std::runtime_error("lz4 uncompression failure");
+        }
+        break;
+    }
+    case entry_compressor::zstd: {
+        auto ret = ZSTD_decompress(out.get_write(), size, src, src_size);
+        if (ZSTD_isError(ret) || ret != size) {
+            throw std::runtime_error("zstd uncompression failure");
+        }
+        break;
+    }
+    default:
+        throw std::runtime_error(sprint("Unknown commitlog entry compressor %d", unsigned(tag)));
+    }
+    return out;
+}
+
+}
+
 db::commitlog::descriptor::descriptor(segment_id_type i, uint32_t v)
         : id(i), ver(v) {
 }
@@ -217,15 +314,20 @@ class db::commitlog::segment_manager : public ::enable_shared_from_this<segment_
         uint64_t bytes_slack = 0;
         uint64_t segments_created = 0;
         uint64_t segments_destroyed = 0;
+        uint64_t segments_recycled = 0;
+        uint64_t recycled_segments_reused = 0;
         uint64_t pending_flushes = 0;
         uint64_t flush_limit_exceeded = 0;
         uint64_t total_size = 0;
         uint64_t buffer_list_bytes = 0;
         uint64_t total_size_on_disk = 0;
         uint64_t requests_blocked_memory = 0;
+        uint64_t bytes_saved_by_compression = 0;
     };
 
     stats totals;
+    // Of the file flushes, in microseconds.
+    utils::log_linear_histogram flush_latency;
 
     size_t pending_allocations() const {
         return _request_controller.waiters();
@@ -308,13 +410,21 @@ class db::commitlog::segment_manager : public ::enable_shared_from_this<segment_
 
     void flush_segments(bool = false);
 
+    // Keeps the file of a segment which is no longer used, to be renamed and
+    // written over by a new one. Returns false if it is to be deleted instead.
+    bool recycle_segment(sstring file_name);
+
 private:
     future<> clear_reserve_segments();
+    future<> clear_recycled_segments();
 
     size_t max_request_controller_units() const;
     segment_id_type _ids = 0;
     std::vector<sseg_ptr> _segments;
     queue<sseg_ptr> _reserve_segments;
+    // Files of unused segments with their header zeroed, ready to be reused.
+    std::deque<sstring> _recycled_segments;
+    size_t _segments_being_recycled = 0;
     std::vector<buffer_type> _temp_buffers;
     std::unordered_map<flush_handler_id, flush_handler> _flush_handlers;
     flush_handler_id _flush_ids = 0;
@@ -382,6 +492,8 @@ class db::commitlog::segment : public enable_shared_from_this<segment>, public c
     uint64_t _flush_pos = 0;
     uint64_t _buf_pos = 0;
     bool _closed = false;
+    // The file held a previous segment, whose data follows what this one wrote.
+    bool _recycled = false;
 
     using buffer_type = segment_manager::buffer_type;
     using sseg_ptr = segment_manager::sseg_ptr;
@@ -398,6 +510,8 @@ class db::commitlog::segment : public enable_shared_from_this<segment>, public c
     uint64_t _num_allocs = 0;
 
     std::unordered_set<table_schema_version> _known_schema_versions;
+    // Engaged while batch mode writes wait for others to join them.
+    stdx::optional<shared_future<>> _batch_window;
 
     friend std::ostream& operator<<(std::ostream&, const segment&);
     friend class segment_manager;
@@ -424,6 +538,10 @@ class db::commitlog::segment : public enable_shared_from_this<segment>, public c
     static constexpr size_t segment_overhead_size = 2 * sizeof(uint32_t);
     static constexpr size_t descriptor_header_size = 5 * sizeof(uint32_t);
     static constexpr uint32_t segment_magic = ('S'<<24) |('C'<< 16) | ('L' << 8) | 'C';
+    // Set in the length of entries whose data is compressed.
+    static constexpr uint32_t compressed_entry_flag = 0x80000000;
+    // Entries smaller than this are not worth compressing.
+    static constexpr size_t min_compressed_entry_size = 256;
 
     // The commit log (chained) sync marker/header size in bytes (int: length + int: checksum [segmentId, position])
     static constexpr size_t sync_marker_size = 2 * sizeof(uint32_t);
@@ -432,20 +550,24 @@ class db::commitlog::segment : public enable_shared_from_this<segment>, public c
     // TODO : tune initial / default size
     static constexpr size_t default_size = align_up<size_t>(128 * 1024, alignment);
 
-    segment(::shared_ptr<segment_manager> m, const descriptor& d, file && f, bool active)
+    segment(::shared_ptr<segment_manager> m, const descriptor& d, file && f, bool active, bool recycled = false)
             : _segment_manager(std::move(m)), _desc(std::move(d)), _file(std::move(f)),
-        _file_name(_segment_manager->cfg.commit_log_location + "/" + _desc.filename()), _sync_time(
+        _file_name(_segment_manager->cfg.commit_log_location + "/" + _desc.filename()), _recycled(recycled), _sync_time(
                     clock_type::now()), _pending_ops(true) // want exception propagation
     {
         ++_segment_manager->totals.segments_created;
-        clogger.debug("Created new {} segment {}", active ? "active" : "reserve", *this);
+        clogger.debug("Created new {} segment {}{}", active ? "active" : "reserve", *this, recycled ? " (recycled)" : "");
     }
     ~segment() {
         if (is_clean()) {
-            clogger.debug("Segment {} is no longer active and will be deleted now", *this);
             ++_segment_manager->totals.segments_destroyed;
             _segment_manager->totals.total_size_on_disk -= size_on_disk();
             _segment_manager->totals.total_size -= (size_on_disk() + _buffer.size());
+            if (_segment_manager->recycle_segment(_file_name)) {
+                clogger.debug("Segment {} is no longer active and will be recycled", *this);
+                return;
+            }
+            clogger.debug("Segment {} is no longer active and will be deleted now", *this);
             try {
                 commit_io_check([] (const char* fname) { ::unlink(fname); },
                         _file_name.c_str());
@@ -553,13 +675,15 @@ class db::commitlog::segment : public enable_shared_from_this<segment>, public c
                 clogger.trace("{} already synced! ({} < {})", *this, pos, _flush_pos);
                 return make_ready_future<>();
             }
-            return _file.flush().then_wrapped([this, pos](future<> f) {
+            auto start = std::chrono::steady_clock::now();
+            return _file.flush().then_wrapped([this, pos, start](future<> f) {
                 try {
                     f.get();
                     // TODO: retry/ignore/fail/stop - optional behaviour in origin.
                     // we fast-fail the whole commit.
                     _flush_pos = std::max(pos, _flush_pos);
                     ++_segment_manager->totals.flush_count;
+                    _segment_manager->flush_latency.add(std::chrono::steady_clock::now() - start);
                     clogger.trace("{} synced to {}", *this, _flush_pos);
                 } catch (...) {
                     clogger.error("Failed to flush commits to disk: {}", std::current_exception());
@@ -584,7 +708,7 @@ class db::commitlog::segment : public enable_shared_from_this<segment>, public c
             overhead += descriptor_header_size;
         }
 
-        auto a = align_up(s + overhead, alignment);
+        auto a = align_up(s + overhead, alignment) + tail_size();
         auto k = std::max(a, default_size);
 
         for (;;) {
@@ -607,6 +731,16 @@ class db::commitlog::segment : public enable_shared_from_this<segment>, public c
         _segment_manager->totals.total_size += k;
     }
 
+    // Recycled segments write a zeroed block after each chunk, so that replay
+    // finds the end of the segment there instead of the previous segment's data.
+    size_t tail_size() const {
+        return _recycled ? alignment : 0;
+    }
+    // What of the buffer can hold entries.
+    size_t buffer_capacity() const {
+        return _buffer.size() - tail_size();
+    }
+
     bool buffer_is_empty() const {
         return _buf_pos <= segment_overhead_size
                         || (_file_pos == 0 && _buf_pos <= (segment_overhead_size + descriptor_header_size));
@@ -625,6 +759,11 @@ class db::commitlog::segment : public enable_shared_from_this<segment>, public c
         auto off = _file_pos;
         auto top = off + size;
         auto num = _num_allocs;
+        auto write_size = size;
+        if (_recycled && top + alignment <= _segment_manager->max_size) {
+            std::fill(buf.get_write() + size, buf.get_write() + size + alignment, 0);
+            write_size += alignment;
+        }
 
         _file_pos = top;
         _buf_pos = 0;
@@ -670,24 +809,26 @@ class db::commitlog::segment : public enable_shared_from_this<segment>, public c
 
         // The write will be allowed to start now, but flush (below) must wait for not only this,
         // but all previous write/flush pairs.
-        return _pending_ops.run_with_ordered_post_op(rp, [this, size, off, buf = std::move(buf)]() mutable {
+        return _pending_ops.run_with_ordered_post_op(rp, [this, size, write_size, off, buf = std::move(buf)]() mutable {
                 auto written = make_lw_shared<size_t>(0);
                 auto p = buf.get();
-                return repeat([this, size, off, written, p]() mutable {
+                return repeat([this, size, write_size, off, written, p]() mutable {
                     auto&& priority_class = service::get_local_commitlog_priority();
-                    return _file.dma_write(off + *written, p + *written, size - *written, priority_class).then_wrapped([this, size, written](future<size_t>&& f) {
+                    return _file.dma_write(off + *written, p + *written, write_size - *written, priority_class).then_wrapped([this, size, write_size, written](future<size_t>&& f) {
                         try {
                             auto bytes = std::get<0>(f.get());
+                            // The zeroed tail is overwritten by the next chunk, don't count it.
+                            auto data_bytes = std::min<size_t>(bytes, size - std::min<size_t>(size, *written));
                             *written += bytes;
-                            _segment_manager->totals.bytes_written += bytes;
-                            _segment_manager->totals.total_size_on_disk += bytes;
+                            _segment_manager->totals.bytes_written += data_bytes;
+                            _segment_manager->totals.total_size_on_disk += data_bytes;
                             ++_segment_manager->totals.cycle_count;
-                            if (*written == size) {
+                            if (*written == write_size) {
                                 return make_ready_future<stop_iteration>(stop_iteration::yes);
                             }
                             // gah, partial write. should always get here with dma chunk sized
                             // "bytes", but lets make sure...
-                            clogger.debug("Partial write {}: {}/{} bytes", *this, *written, size);
+                            clogger.debug("Partial write {}: {}/{} bytes", *this, *written, write_size);
                             *written = align_down(*written, alignment);
                             return make_ready_future<stop_iteration>(stop_iteration::no);
                             // TODO: retry/ignore/fail/stop - optional behaviour in origin.
@@ -707,6 +848,20 @@ class db::commitlog::segment : public enable_shared_from_this<segment>, public c
         });
     }
 
+    // All writes which come during the window share the write and sync of its end.
+    future<> wait_for_batch_window() {
+        auto window = _segment_manager->cfg.batch_window;
+        if (window.count() == 0) {
+            return make_ready_future<>();
+        }
+        if (!_batch_window) {
+            _batch_window = shared_future<>(sleep(window).then([me = shared_from_this()] {
+                me->_batch_window = {};
+            }));
+        }
+        return _batch_window->get_future();
+    }
+
     future<sseg_ptr> batch_cycle(timeout_clock::time_point timeout) {
         /**
          * For batch mode we force a write "immediately".
@@ -718,7 +873,9 @@ class db::commitlog::segment : public enable_shared_from_this<segment>, public c
          */
         auto me = shared_from_this();
         auto fp = _file_pos;
-        return _pending_ops.wait_for_pending(timeout).then([me = std::move(me), fp, timeout] {
+        return wait_for_batch_window().then([this, timeout] {
+            return _pending_ops.wait_for_pending(timeout);
+        }).then([me = std::move(me), fp, timeout] {
             if (fp != me->_file_pos) {
                 // some other request already wrote this buffer.
                 // If so, wait for the operation at our intended file offset
@@ -766,7 +923,7 @@ class db::commitlog::segment : public enable_shared_from_this<segment>, public c
             return finish_and_get_new(timeout).then([id, writer = std::move(writer), permit = std::move(permit), timeout] (auto new_seg) mutable {
                 return new_seg->allocate(id, std::move(writer), std::move(permit), timeout);
             });
-        } else if (!_buffer.empty() && (s > (_buffer.size() - _buf_pos))) {  // enough data?
+        } else if (!_buffer.empty() && (s > (buffer_capacity() - _buf_pos))) {  // enough data?
             if (_segment_manager->cfg.mode == sync_mode::BATCH) {
                 // TODO: this could cause starvation if we're really unlucky.
                 // If we run batch mode and find ourselves not fit in a non-empty
@@ -794,25 +951,35 @@ class db::commitlog::segment : public enable_shared_from_this<segment>, public c
 
         replay_position rp(_desc.id, position());
         auto pos = _buf_pos;
-        _buf_pos += s;
+        auto * p = _buffer.get_write() + pos;
+        auto * d = p + 2 * sizeof(uint32_t);
+
+        // actual data
+        auto data_size = write_entry_data(*writer, d, size);
+        auto entry_size = data_size + entry_overhead_size;
+        uint32_t length = entry_size;
+        if (data_size != size) {
+            length |= compressed_entry_flag;
+            // Give back the memory accounted for the part of the entry it doesn't need anymore.
+            _segment_manager->notify_memory_written(size - data_size);
+            _segment_manager->totals.bytes_saved_by_compression += size - data_size;
+        }
+
+        _buf_pos += entry_size;
         _cf_dirty[id]++; // increase use count for cf.
 
         rp_handle h(static_pointer_cast<cf_holder>(shared_from_this()), std::move(id), rp);
 
-        auto * p = _buffer.get_write() + pos;
-        auto * e = _buffer.get_write() + pos + s - sizeof(uint32_t);
+        auto * e = p + entry_size - sizeof(uint32_t);
 
-        data_output out(p, e);
+        data_output out(p, d);
         crc32_nbo crc;
 
-        out.write(uint32_t(s));
-        crc.process(uint32_t(s));
+        out.write(length);
+        crc.process(length);
         out.write(crc.checksum());
 
-        // actual data
-        writer->write(*this, out);
-
-        crc.process_bytes(p + 2 * sizeof(uint32_t), size);
+        crc.process_bytes(d, data_size);
 
         out = data_output(e, sizeof(uint32_t));
         out.write(crc.checksum());
@@ -839,6 +1006,26 @@ class db::commitlog::segment : public enable_shared_from_this<segment>, public c
         }
     }
 
+    // Writes the data of the entry at d, compressed if that is enabled and makes it
+    // smaller. Returns the size of what was written.
+    size_t write_entry_data(entry_writer& writer, char* d, size_t size) {
+        auto c = _segment_manager->cfg.compression;
+        if (c == compressor::none || size < min_compressed_entry_size) {
+            data_output out(d, size);
+            writer.write(*this, out);
+            return size;
+        }
+        std::unique_ptr<char[]> serialized(new char[size]);
+        data_output out(serialized.get(), size);
+        writer.write(*this, out);
+        auto len = compress_entry(c, serialized.get(), size, d);
+        if (!len) {
+            std::copy_n(serialized.get(), size, d);
+            return size;
+        }
+        return len;
+    }
+
     position_type position() const {
         return position_type(_file_pos + _buf_pos);
     }
@@ -1070,7 +1257,11 @@ future<> db::commitlog::segment_manager::init() {
 void db::commitlog::segment_manager::create_counters() {
     namespace sm = seastar::metrics;
 
-    _metrics.add_group("commitlog", {
+    if (cfg.metrics_category_name.empty()) {
+        return;
+    }
+
+    _metrics.add_group(cfg.metrics_category_name, {
         sm::make_gauge("segments", [this] { return _segments.size(); },
                        sm::description("Holds the current number of segments.")),
 
@@ -1082,6 +1273,15 @@ void db::commitlog::segment_manager::create_counters() {
                        sm::description("Holds the current number of unused segments. "
                                        "A non-zero value indicates that the disk write path became temporary slow.")),
 
+        sm::make_gauge("recycled_segments", [this] { return _recycled_segments.size(); },
+                       sm::description("Holds the number of files of unused segments kept to be reused by new ones.")),
+
+        sm::make_derive("segments_recycled", totals.segments_recycled,
+                       sm::description("Counts a number of unused segments whose file was kept instead of deleted.")),
+
+        sm::make_derive("recycled_segments_reused", totals.recycled_segments_reused,
+                       sm::description("Counts a number of new segments which were written over the file of a recycled one.")),
+
         sm::make_derive("alloc", totals.allocation_count,
                        sm::description("Counts a number of times a new mutation has been added to a segment. "
                                        "Divide bytes_written by this value to get the average number of bytes per mutation written to the disk.")),
@@ -1092,6 +1292,9 @@ void db::commitlog::segment_manager::create_counters() {
         sm::make_derive("flush", totals.flush_count,
                        sm::description("Counts a number of times the flush() method was called for a file.")),
 
+        sm::make_histogram("flush_latency", sm::description("Holds the latency histogram of the flushes of the segment files, in microseconds."),
+                       [this] { return flush_latency.get_histogram(std::chrono::microseconds(100)); }),
+
         sm::make_derive("bytes_written", totals.bytes_written,
                        sm::description("Counts a number of bytes written to the disk. "
                                        "Divide this value by \"alloc\" to get the average number of bytes per mutation written to the disk.")),
@@ -1099,6 +1302,9 @@ void db::commitlog::segment_manager::create_counters() {
         sm::make_derive("slack", totals.bytes_slack,
                        sm::description("Counts a number of unused bytes written to the disk due to disk segment alignment.")),
 
+        sm::make_derive("bytes_saved_by_compression", totals.bytes_saved_by_compression,
+                       sm::description("Counts a number of bytes by which compression made the entries smaller.")),
+
         sm::make_gauge("pending_flushes", totals.pending_flushes,
                        sm::description("Holds a number of currently pending flushes. See the related flush_limit_exceeded metric.")),
 
@@ -1164,8 +1370,68 @@ void db::commitlog::segment_manager::flush_segments(bool force) {
     }
 }
 
+bool db::commitlog::segment_manager::recycle_segment(sstring file_name) {
+    if (_shutdown || _recycled_segments.size() + _segments_being_recycled >= cfg.max_recycled_segments) {
+        return false;
+    }
+    ++_segments_being_recycled;
+    // Zero the header first, so that the file reads as an empty pre-allocated
+    // one if we go down before it is reused.
+    with_gate(_gate, [this, file_name] {
+        return open_checked_file_dma(commit_error_handler, file_name, open_flags::wo).then([] (file f) {
+            auto buf = allocate_aligned_buffer<char>(segment::alignment, segment::alignment);
+            std::fill(buf.get(), buf.get() + segment::alignment, 0);
+            auto p = buf.get();
+            return f.dma_write(0, p, segment::alignment).then([f, buf = std::move(buf)] (size_t written) mutable {
+                if (written != segment::alignment) {
+                    throw std::runtime_error("Short write of the segment header");
+                }
+                return f.flush();
+            }).finally([f] () mutable {
+                return f.close();
+            });
+        });
+    }).then([this, file_name] {
+        clogger.debug("Recycled segment file {}", file_name);
+        _recycled_segments.push_back(file_name);
+        ++totals.segments_recycled;
+    }).handle_exception([file_name] (auto ep) {
+        clogger.warn("Could not recycle segment file {}, deleting it: {}", file_name, ep);
+        return commit_io_check(remove_file, file_name).handle_exception([file_name] (auto ep) {
+            clogger.error("Could not delete segment file {}: {}", file_name, ep);
+        });
+    }).finally([this] {
+        --_segments_being_recycled;
+    });
+    return true;
+}
+
+future<> db::commitlog::segment_manager::clear_recycled_segments() {
+    auto files = std::exchange(_recycled_segments, {});
+    return do_with(std::move(files), [] (auto& files) {
+        return parallel_for_each(files, [] (const sstring& f) {
+            return commit_io_check(remove_file, f).handle_exception([f] (auto ep) {
+                clogger.error("Could not delete segment file {}: {}", f, ep);
+            });
+        });
+    });
+}
+
 future<db::commitlog::segment_manager::sseg_ptr> db::commitlog::segment_manager::allocate_segment(bool active) {
     descriptor d(next_id());
+    if (!_recycled_segments.empty()) {
+        // The file is already allocated, so taking it is a rename instead of a
+        // create, an allocation and later on a delete.
+        auto old_name = std::move(_recycled_segments.front());
+        _recycled_segments.pop_front();
+        auto new_name = cfg.commit_log_location + "/" + d.filename();
+        return commit_io_check(rename_file, old_name, new_name).then([new_name] {
+            return open_checked_file_dma(commit_error_handler, new_name, open_flags::wo);
+        }).then([this, d, active] (file f) {
+            ++totals.recycled_segments_reused;
+            return make_ready_future<sseg_ptr>(make_shared<segment>(this->shared_from_this(), d, std::move(f), active, true));
+        });
+    }
     file_open_options opt;
     opt.extent_allocation_size_hint = max_size;
     return open_checked_file_dma(commit_error_handler, cfg.commit_log_location + "/" + d.filename(), open_flags::wo | open_flags::create, opt).then([this, d, active](file f) {
@@ -1322,7 +1588,7 @@ future<> db::commitlog::segment_manager::shutdown() {
         }).finally([this] {
             discard_unused_segments();
             // Now that the gate is closed and requests completed we are sure nobody else will pop()
-            return clear_reserve_segments().finally([this] {
+            return when_all(clear_reserve_segments(), clear_recycled_segments()).discard_result().finally([this] {
                 return std::move(_reserve_replenisher).then_wrapped([this] (auto f) {
                     // Could be cleaner with proper seastar support
                     if (f.failed()) {
@@ -1770,11 +2036,14 @@ db::commitlog::read_log_file(file f, commit_load_reader_func next, position_type
 
                 data_input in(buf);
 
-                auto size = in.read<uint32_t>();
+                auto length = in.read<uint32_t>();
                 auto checksum = in.read<uint32_t>();
 
                 crc32_nbo crc;
-                crc.process(size);
+                crc.process(length);
+
+                auto compressed = bool(length & segment::compressed_entry_flag);
+                auto size = length & ~segment::compressed_entry_flag;
 
                 if (size < 3 * sizeof(uint32_t) || checksum != crc.checksum()) {
                     auto slack = next - pos;
@@ -1786,7 +2055,7 @@ db::commitlog::read_log_file(file f, commit_load_reader_func next, position_type
                     return skip(slack);
                 }
 
-                return fin.read_exactly(size - entry_header_size).then([this, size, crc = std::move(crc), rp](temporary_buffer<char> buf) mutable {
+                return fin.read_exactly(size - entry_header_size).then([this, size, compressed, crc = std::move(crc), rp](temporary_buffer<char> buf) mutable {
                     advance(buf);
 
                     data_input in(buf);
@@ -1806,7 +2075,18 @@ db::commitlog::read_log_file(file f, commit_load_reader_func next, position_type
                         return make_ready_future<>();
                     }
 
-                    return s.produce(buf.share(0, data_size), rp).handle_exception([this](auto ep) {
+                    auto data = buf.share(0, data_size);
+                    if (compressed) {
+                        try {
+                            data = decompress_entry(data);
+                        } catch (...) {
+                            clogger.debug("Segment entry at {} could not be uncompressed: {}. Skipping {} bytes", rp, std::current_exception(), size);
+                            corrupt_size += size;
+                            return make_ready_future<>();
+                        }
+                    }
+
+                    return s.produce(std::move(data), rp).handle_exception([this](auto ep) {
                         return this->fail();
                     });
                 });
@@ -1860,6 +2140,18 @@ uint64_t db::commitlog::get_flush_count() const {
     return _segment_manager->totals.flush_count;
 }
 
+uint64_t db::commitlog::get_bytes_written() const {
+    return _segment_manager->totals.bytes_written;
+}
+
+uint64_t db::commitlog::get_bytes_slack() const {
+    return _segment_manager->totals.bytes_slack;
+}
+
+const utils::log_linear_histogram& db::commitlog::get_flush_latency() const {
+    return _segment_manager->flush_latency;
+}
+
 uint64_t db::commitlog::get_pending_tasks() const {
     return _segment_manager->totals.pending_flushes;
 }
@@ -41,6 +41,7 @@
 #pragma once
 
 #include <memory>
+#include <chrono>
 
 #include "utils/data_output.hh"
 #include "core/future.hh"
@@ -48,8 +49,10 @@
 #include "core/stream.hh"
 #include "replay_position.hh"
 #include "commitlog_entry.hh"
+#include "compress.hh"
 
 namespace seastar { class file; }
+namespace utils { class log_linear_histogram; }
 
 #include "seastarx.hh"
 
@@ -119,12 +122,23 @@ class commitlog {
         // Max number of segments to keep in pre-alloc reserve.
         // Not (yet) configurable from scylla.conf.
         uint64_t max_reserve_segments = 12;
+        // Max number of files of unused segments kept to be renamed and
+        // reused by new ones instead of being deleted. Zero disables it.
+        uint64_t max_recycled_segments = 0;
         // Max active writes/flushes. Default value
         // zero means try to figure it out ourselves
         uint64_t max_active_writes = 0;
         uint64_t max_active_flushes = 0;
 
         sync_mode mode = sync_mode::PERIODIC;
+        // In batch mode, how long a write waits for concurrent ones to be
+        // written and synced together with it. Zero syncs right away.
+        std::chrono::microseconds batch_window{0};
+        // Compression of the entries, either none, lz4 or zstd.
+        compressor compression = compressor::none;
+        // Metrics group name. Empty means the instance registers no metrics,
+        // which is needed when several commitlogs live on the same shard.
+        sstring metrics_category_name = "commitlog";
     };
 
     struct descriptor {
@@ -271,6 +285,12 @@ class commitlog {
     uint64_t get_total_size() const;
     uint64_t get_completed_tasks() const;
     uint64_t get_flush_count() const;
+    uint64_t get_bytes_written() const;
+    uint64_t get_bytes_slack() const;
+    /**
+     * Latencies of the flushes of the segment files, in microseconds.
+     */
+    const utils::log_linear_histogram& get_flush_latency() const;
     uint64_t get_pending_tasks() const;
     uint64_t get_pending_flushes() const;
     uint64_t get_pending_allocations() const;
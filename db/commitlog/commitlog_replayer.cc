@@ -44,9 +44,12 @@
 #include <algorithm>
 #include <unordered_map>
 #include <boost/range/adaptor/map.hpp>
+#include <boost/range/irange.hpp>
 
 #include <core/future.hh>
 #include <core/sharded.hh>
+#include <core/reactor.hh>
+#include <core/semaphore.hh>
 
 #include "commitlog.hh"
 #include "commitlog_replayer.hh"
@@ -61,6 +64,12 @@
 
 static logging::logger rlogger("commitlog_replayer");
 
+static thread_local std::deque<db::commitlog_replayer::segment_progress> replay_progress;
+
+const std::deque<db::commitlog_replayer::segment_progress>& db::commitlog_replayer::local_progress() {
+    return replay_progress;
+}
+
 class db::commitlog_replayer::impl {
     struct column_mappings {
         std::unordered_map<table_schema_version, column_mapping> map;
@@ -109,8 +118,39 @@ class db::commitlog_replayer::impl {
         return _column_mappings.stop();
     }
 
-    future<> process(stats*, temporary_buffer<char> buf, replay_position rp) const;
-    future<stats> recover(sstring file) const;
+    // A mutation read from a segment, to be applied on the shard owning it.
+    struct pending_mutation {
+        commitlog_entry_reader cer;
+        // Lives in the column mappings of the shard reading the segment.
+        const column_mapping* cm;
+        replay_position rp;
+        size_t size;
+    };
+
+    struct batch {
+        std::vector<pending_mutation> entries;
+        size_t bytes = 0;
+    };
+
+    // Segments of a shard which are replayed at the same time.
+    static constexpr size_t max_concurrent_segments = 4;
+
+    // Mutations are sent to their shard in batches, to not pay for a
+    // cross-shard call for each of them.
+    static constexpr size_t max_batch_mutations = 128;
+    static constexpr size_t max_batch_bytes = 1 << 20;
+
+    struct replay_state {
+        stats s;
+        std::vector<batch> batches = std::vector<batch>(smp::count);
+        segment_progress* progress;
+    };
+
+    future<> process(replay_state*, temporary_buffer<char> buf, replay_position rp) const;
+    future<> apply(database& db, const pending_mutation&) const;
+    future<> flush_batch(replay_state*, unsigned shard) const;
+    future<> flush_batches(replay_state*) const;
+    future<stats> recover(sstring file, segment_progress& progress) const;
 
     typedef std::unordered_map<utils::UUID, replay_position> rp_map;
     typedef std::unordered_map<unsigned, rp_map> shard_rpm_map;
@@ -205,7 +245,7 @@ future<> db::commitlog_replayer::impl::init() {
 }
 
 future<db::commitlog_replayer::impl::stats>
-db::commitlog_replayer::impl::recover(sstring file) const {
+db::commitlog_replayer::impl::recover(sstring file, segment_progress& progress) const {
     assert(_column_mappings.local_is_initialized());
 
     replay_position rp{commitlog::descriptor(file)};
@@ -213,6 +253,7 @@ db::commitlog_replayer::impl::recover(sstring file) const {
 
     if (rp.id < gp.id) {
         rlogger.debug("skipping replay of fully-flushed {}", file);
+        progress.done = true;
         return make_ready_future<stats>();
     }
     position_type p = 0;
@@ -220,26 +261,37 @@ db::commitlog_replayer::impl::recover(sstring file) const {
         p = gp.pos;
     }
 
-    auto s = make_lw_shared<stats>();
+    auto rs = make_lw_shared<replay_state>();
+    rs->progress = &progress;
 
-    return db::commitlog::read_log_file(file,
-            std::bind(&impl::process, this, s.get(), std::placeholders::_1,
-                    std::placeholders::_2), p).then([](auto s) {
+    return file_size(file).then([this, file, p, rs] (uint64_t size) {
+        rs->progress->total_bytes = size;
+        return db::commitlog::read_log_file(file,
+                std::bind(&impl::process, this, rs.get(), std::placeholders::_1,
+                        std::placeholders::_2), p);
+    }).then([](auto s) {
         auto f = s->done();
         return f.finally([s = std::move(s)] {});
-    }).then_wrapped([s](future<> f) {
+    }).then_wrapped([this, rs](future<> f) {
         try {
             f.get();
         } catch (commitlog::segment_data_corruption_error& e) {
-            s->corrupt_bytes += e.bytes();
+            rs->s.corrupt_bytes += e.bytes();
         } catch (...) {
             throw;
         }
-        return make_ready_future<stats>(*s);
+        // What was read before a corruption is still to be applied.
+        return flush_batches(rs.get());
+    }).then([rs] {
+        rs->progress->replayed_bytes = rs->progress->total_bytes;
+        rs->progress->done = true;
+        return make_ready_future<stats>(rs->s);
     });
 }
 
-future<> db::commitlog_replayer::impl::process(stats* s, temporary_buffer<char> buf, replay_position rp) const {
+future<> db::commitlog_replayer::impl::process(replay_state* rs, temporary_buffer<char> buf, replay_position rp) const {
+    auto s = &rs->s;
+    rs->progress->replayed_bytes = rp.pos;
     try {
 
         commitlog_entry_reader cer(buf);
@@ -272,43 +324,12 @@ future<> db::commitlog_replayer::impl::process(stats* s, temporary_buffer<char>
         }
 
         auto shard = _qp.local().db().local().shard_of(fm);
-        return _qp.local().db().invoke_on(shard, [this, cer = std::move(cer), &src_cm, rp, shard, s] (database& db) -> future<> {
-            auto& fm = cer.mutation();
-            // TODO: might need better verification that the deserialized mutation
-            // is schema compatible. My guess is that just applying the mutation
-            // will not do this.
-            auto& cf = db.find_column_family(fm.column_family_id());
-
-            if (rlogger.is_enabled(logging::log_level::debug)) {
-                rlogger.debug("replaying at {} v={} {}:{} at {}", fm.column_family_id(), fm.schema_version(),
-                        cf.schema()->ks_name(), cf.schema()->cf_name(), rp);
-            }
-            // Removed forwarding "new" RP. Instead give none/empty.
-            // This is what origin does, and it should be fine.
-            // The end result should be that once sstables are flushed out
-            // their "replay_position" attribute will be empty, which is
-            // lower than anything the new session will produce.
-            if (cf.schema()->version() != fm.schema_version()) {
-                auto& local_cm = _column_mappings.local().map;
-                auto cm_it = local_cm.find(fm.schema_version());
-                if (cm_it == local_cm.end()) {
-                    cm_it = local_cm.emplace(fm.schema_version(), src_cm).first;
-                }
-                const column_mapping& cm = cm_it->second;
-                mutation m(fm.decorated_key(*cf.schema()), cf.schema());
-                converting_mutation_partition_applier v(cm, *cf.schema(), m.partition());
-                fm.partition().accept(cm, v);
-                cf.apply(std::move(m));
-            } else {
-                cf.apply(fm, cf.schema());
-            }
-            s->applied_mutations++;
-            return make_ready_future<>();
-        }).handle_exception([s](auto ep) {
-            s->invalid_mutations++;
-            // TODO: write mutation to file like origin.
-            rlogger.warn("error replaying: {}", ep);
-        });
+        auto& b = rs->batches[shard];
+        b.bytes += buf.size();
+        b.entries.push_back(pending_mutation{std::move(cer), &src_cm, rp, buf.size()});
+        if (b.entries.size() >= max_batch_mutations || b.bytes >= max_batch_bytes) {
+            return flush_batch(rs, shard);
+        }
     } catch (no_such_column_family&) {
         // No such CF now? Origin just ignores this.
     } catch (...) {
@@ -320,6 +341,81 @@ future<> db::commitlog_replayer::impl::process(stats* s, temporary_buffer<char>
     return make_ready_future<>();
 }
 
+future<> db::commitlog_replayer::impl::apply(database& db, const pending_mutation& pm) const {
+    auto& fm = pm.cer.mutation();
+    // TODO: might need better verification that the deserialized mutation
+    // is schema compatible. My guess is that just applying the mutation
+    // will not do this.
+    auto& cf = db.find_column_family(fm.column_family_id());
+
+    if (rlogger.is_enabled(logging::log_level::debug)) {
+        rlogger.debug("replaying at {} v={} {}:{} at {}", fm.column_family_id(), fm.schema_version(),
+                cf.schema()->ks_name(), cf.schema()->cf_name(), pm.rp);
+    }
+    // Removed forwarding "new" RP. Instead give none/empty.
+    // This is what origin does, and it should be fine.
+    // The end result should be that once sstables are flushed out
+    // their "replay_position" attribute will be empty, which is
+    // lower than anything the new session will produce.
+    if (cf.schema()->version() != fm.schema_version()) {
+        auto& local_cm = _column_mappings.local().map;
+        auto cm_it = local_cm.find(fm.schema_version());
+        if (cm_it == local_cm.end()) {
+            cm_it = local_cm.emplace(fm.schema_version(), *pm.cm).first;
+        }
+        const column_mapping& cm = cm_it->second;
+        mutation m(fm.decorated_key(*cf.schema()), cf.schema());
+        converting_mutation_partition_applier v(cm, *cf.schema(), m.partition());
+        fm.partition().accept(cm, v);
+        if (cf.writes_replay_to_sstables()) {
+            return cf.write_replayed_mutation(std::move(m), pm.size);
+        }
+        cf.apply(std::move(m));
+    } else {
+        if (cf.writes_replay_to_sstables()) {
+            return cf.write_replayed_mutation(fm.unfreeze(cf.schema()), pm.size);
+        }
+        cf.apply(fm, cf.schema());
+    }
+    return make_ready_future<>();
+}
+
+future<> db::commitlog_replayer::impl::flush_batch(replay_state* rs, unsigned shard) const {
+    auto entries = std::exchange(rs->batches[shard].entries, {});
+    rs->batches[shard].bytes = 0;
+    if (entries.empty()) {
+        return make_ready_future<>();
+    }
+    return _qp.local().db().invoke_on(shard, [this, entries = std::move(entries)] (database& db) mutable {
+        return do_with(std::move(entries), stats(), [this, &db] (std::vector<pending_mutation>& entries, stats& s) {
+            return do_for_each(entries, [this, &db, &s] (const pending_mutation& pm) {
+                return futurize_apply([this, &db, &pm] {
+                    return apply(db, pm);
+                }).then_wrapped([&s] (future<> f) {
+                    try {
+                        f.get();
+                        s.applied_mutations++;
+                    } catch (...) {
+                        s.invalid_mutations++;
+                        // TODO: write mutation to file like origin.
+                        rlogger.warn("error replaying: {}", std::current_exception());
+                    }
+                });
+            }).then([&s] {
+                return s;
+            });
+        });
+    }).then([rs] (stats s) {
+        rs->s += s;
+    });
+}
+
+future<> db::commitlog_replayer::impl::flush_batches(replay_state* rs) const {
+    return parallel_for_each(boost::irange(0u, smp::count), [this, rs] (unsigned shard) {
+        return flush_batch(rs, shard);
+    });
+}
+
 db::commitlog_replayer::commitlog_replayer(seastar::sharded<cql3::query_processor>& qp)
     : _impl(std::make_unique<impl>(qp))
 {}
@@ -357,26 +453,33 @@ future<> db::commitlog_replayer::recover(std::vector<sstring> files) {
         return map_reduce(smp::all_cpus(), [this, map](unsigned id) {
             return smp::submit_to(id, [this, id, map]() {
                 auto total = ::make_lw_shared<impl::stats>();
-                // TODO: or something. For now, we do this serialized per shard,
-                // to reduce mutation congestion. We could probably (says avi)
-                // do 2 segments in parallel or something, but lets use this first.
                 auto range = map->equal_range(id);
-                return do_for_each(range.first, range.second, [this, total](const std::pair<unsigned, sstring>& p) {
-                    auto&f = p.second;
-                    rlogger.debug("Replaying {}", f);
-                    return _impl->recover(f).then([f, total](impl::stats stats) {
-                        if (stats.corrupt_bytes != 0) {
-                            rlogger.warn("Corrupted file: {}. {} bytes skipped.", f, stats.corrupt_bytes);
-                        }
-                        rlogger.debug("Log replay of {} complete, {} replayed mutations ({} invalid, {} skipped)"
-                                        , f
-                                        , stats.applied_mutations
-                                        , stats.invalid_mutations
-                                        , stats.skipped_mutations
-                        );
-                        *total += stats;
+                replay_progress.clear();
+                for (auto it = range.first; it != range.second; ++it) {
+                    replay_progress.push_back(segment_progress{it->second});
+                }
+                // Segments are read concurrently, so that the replay keeps the disk busy
+                // while mutations are being applied. Their order doesn't matter, since
+                // applying mutations is commutative.
+                auto concurrency = make_lw_shared<semaphore>(impl::max_concurrent_segments);
+                return parallel_for_each(replay_progress, [this, total, concurrency](segment_progress& progress) {
+                    return with_semaphore(*concurrency, 1, [this, total, &progress] {
+                        auto& f = progress.file;
+                        rlogger.debug("Replaying {}", f);
+                        return _impl->recover(f, progress).then([f, total](impl::stats stats) {
+                            if (stats.corrupt_bytes != 0) {
+                                rlogger.warn("Corrupted file: {}. {} bytes skipped.", f, stats.corrupt_bytes);
+                            }
+                            rlogger.debug("Log replay of {} complete, {} replayed mutations ({} invalid, {} skipped)"
+                                            , f
+                                            , stats.applied_mutations
+                                            , stats.invalid_mutations
+                                            , stats.skipped_mutations
+                            );
+                            *total += stats;
+                        });
                     });
-                }).then([total] {
+                }).then([total, concurrency] {
                     return make_ready_future<impl::stats>(*total);
                 });
             });
@@ -386,6 +489,13 @@ future<> db::commitlog_replayer::recover(std::vector<sstring> files) {
                             , totals.invalid_mutations
                             , totals.skipped_mutations
             );
+        }).then([this] {
+            // Loads the sstables the replay wrote, if it didn't go to memtables.
+            return _impl->_qp.local().db().invoke_on_all([] (database& db) {
+                return parallel_for_each(db.get_column_families(), [] (auto& p) {
+                    return p.second->finish_replayed_writes();
+                });
+            });
         });
     }).finally([this] {
         return _impl->stop();
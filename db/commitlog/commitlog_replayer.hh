@@ -42,6 +42,7 @@
 #pragma once
 
 #include <memory>
+#include <deque>
 #include <core/future.hh>
 #include <core/sharded.hh>
 
@@ -57,6 +58,16 @@ class commitlog;
 
 class commitlog_replayer {
 public:
+    struct segment_progress {
+        sstring file;
+        uint64_t replayed_bytes = 0;
+        uint64_t total_bytes = 0;
+        bool done = false;
+    };
+
+    // The segments this shard replays or replayed in the last recover(), in replay order.
+    static const std::deque<segment_progress>& local_progress();
+
     commitlog_replayer(commitlog_replayer&&) noexcept;
     ~commitlog_replayer();
 
@@ -114,6 +114,24 @@ class config : public utils::config_file {
     val(auto_adjust_flush_quota, bool, false, Used, \
             "true: auto-adjust quota for flush processes. false: put everyone together in the static background writer group - if background writer group is enabled. Not intended for setting in normal operations" \
     )   \
+    val(streaming_cpu_quota, double, 1.0, Used, \
+            "max cpu usage ratio (between 0 and 1) for sending streamed partitions. Setting it to 1 or higher will disable it." \
+    )   \
+    val(repair_cpu_quota, double, 1.0, Used, \
+            "max cpu usage ratio (between 0 and 1) for checksumming partitions for repair. Setting it to 1 or higher will disable it." \
+    )   \
+    val(repair_checksum_parallelism, uint32_t, 2, Used, \
+            "The number of ranges each shard checksums for repair at the same time, for all repairs together. Ranges are read in parallel anyway, so more only helps when there is disk and CPU headroom." \
+    )   \
+    val(view_building_cpu_quota, double, 1.0, Used, \
+            "max cpu usage ratio (between 0 and 1) for building materialized views from existing data. Setting it to 1 or higher will disable it." \
+    )   \
+    val(service_levels, string_map, /* none */, Used, \
+            "Service levels which users can be attached to, by name, with the shares of the disk and the CPU the queries of their users get, relative to the 100 of the queries of users without a level: analytics=20 gives analytics queries a fifth of the disk bandwidth of the others when both compete, and caps them at a fifth of the CPU of each coordinator shard. Users are attached to levels in system_auth.service_levels." \
+    )   \
+    val(auto_adjust_compaction_quota, bool, false, Used, \
+            "true: auto-adjust quota for compaction from its backlog, instead of relying on compaction_throughput_mb_per_sec. false: put compaction in the static background writer group - if background writer group is enabled. Not intended for setting in normal operations" \
+    )   \
     /* Initialization properties */             \
     /* The minimal properties needed for configuring a cluster. */  \
     val(cluster_name, sstring, "", Used,   \
@@ -138,7 +156,13 @@ class config : public utils::config_file {
     val(data_file_directories, string_list, { "/var/lib/scylla/data" }, Used,   \
             "The directory location where table data (SSTables) is stored"   \
     )                                           \
-    val(saved_caches_directory, sstring, "/var/lib/scylla/saved_caches", Unused, \
+    val(hints_directory, sstring, "/var/lib/scylla/hints", Used,   \
+            "The directory where hints files are stored if hinted handoff is enabled."   \
+    )                                           \
+    val(view_hints_directory, sstring, "/var/lib/scylla/view_hints", Used,   \
+            "The directory where the view updates which could not be applied to their paired replica are stored, until they are replayed to it."   \
+    )                                           \
+    val(saved_caches_directory, sstring, "/var/lib/scylla/saved_caches", Used, \
             "The directory location where table key and row caches are stored."  \
     )                                                   \
     /* Commonly used properties */  \
@@ -204,8 +228,23 @@ class config : public utils::config_file {
             "Throttles compaction to the specified total throughput across the entire system. The faster you insert data, the faster you need to compact in order to keep the SSTable count down. The recommended Value is 16 to 32 times the rate of write throughput (in MBs/second). Setting the value to 0 disables compaction throttling.\n"  \
             "Related information: Configuring compaction"   \
     )                                                   \
-    val(compaction_large_partition_warning_threshold_mb, uint32_t, 100, Unused, \
-            "Log a warning when compacting partitions larger than this value"   \
+    val(compaction_large_partition_warning_threshold_mb, uint32_t, 100, Used, \
+            "Log a warning when writing partitions larger than this value to an sstable, and record them in system.large_partitions"   \
+    )                                               \
+    val(compaction_rows_count_warning_threshold, uint64_t, 100000, Used, \
+            "Log a warning when writing partitions with more rows than this value to an sstable, and record them in system.large_partitions"   \
+    )                                               \
+    val(compaction_large_row_warning_threshold_mb, uint32_t, 10, Used, \
+            "Log a warning when writing rows larger than this value to an sstable, and record them in system.large_rows"   \
+    )                                               \
+    val(large_data_records_per_table, uint32_t, 1000, Used, \
+            "The most partitions and rows of a table recorded in system.large_partitions and system.large_rows. The records of an sstable are removed when it is deleted."   \
+    )                                               \
+    val(enable_compaction_offload, bool, false, Used, \
+            "When a shard is already compacting, run its next compactions on an idle shard with a much smaller compaction backlog. Offloaded compactions can't purge tombstones or expired data, which the compactions run by the shard itself do later."   \
+    )                                               \
+    val(compaction_groups, uint32_t, 1, Used, \
+            "Number of token ranges the sstables of each user table are split into on every shard. Memtables are flushed into one sstable per range, and the sstables of a range are compacted together, independently of the other ranges. 1 disables the split. Changing it only affects the sstables written afterwards."   \
     )                                               \
     /* Common memtable settings */  \
     val(memtable_total_space_in_mb, uint32_t, 0, Invalid,     \
@@ -221,11 +260,17 @@ class config : public utils::config_file {
     val(concurrent_counter_writes, uint32_t, 32, Unused,     \
             "Counter writes read the current values before incrementing and writing them back. The recommended value is (16 × number_of_drives) ."  \
     )                                                   \
+    val(concurrent_sstable_loads, uint32_t, 8, Used,     \
+            "Number of sstables each shard reads the components of at the same time on startup and refresh."  \
+    )                                                   \
     /* Common automatic backup settings */  \
     val(incremental_backups, bool, false, Used,     \
             "Backs up data updated since the last snapshot was taken. When enabled, Scylla creates a hard link to each SSTable flushed or streamed locally in a backups/ subdirectory of the keyspace data. Removing these links is the operator's responsibility.\n"  \
             "Related information: Enabling incremental backups" \
     )                                                   \
+    val(incremental_snapshots, bool, false, Used,     \
+            "When enabled, a snapshot requested by the operator links only the SSTables no earlier snapshot of the table holds, and its manifest lists the others under \"previous\" along with the snapshot holding them. Clearing a snapshot later ones refer to moves the links they need into them first. Snapshots taken before truncating or dropping a table are always complete."  \
+    )                                                   \
     val(snapshot_before_compaction, bool, false, Unused,     \
             "Enable or disable taking a snapshot before each compaction. This option is useful to back up data when there is a data format change. Be careful using this option because Cassandra does not clean up older snapshots automatically.\n"  \
             "Related information: Configuring compaction"   \
@@ -257,13 +302,28 @@ class config : public utils::config_file {
     val(commitlog_sync_batch_window_in_ms, uint32_t, 10000, Used,     \
             "Controls how long the system waits for other writes before performing a sync in \"batch\" mode."    \
     )   \
+    val(commitlog_batch_window_in_us, uint32_t, 0, Used,     \
+            "In batch mode, how long a write waits for concurrent writes so that they all go to disk with a single write and sync. Zero syncs every write right away, which gives the lowest latency when writes are rare." \
+    )                                                   \
+    val(commitlog_recycled_segments, uint32_t, 0, Used,     \
+            "The maximum number of commitlog segment files kept after their data is flushed, to be renamed and written over by new segments instead of creating, allocating and deleting files. Zero disables recycling." \
+    )                                                   \
+    val(commitlog_compression, sstring, "", Used,     \
+            "Compression of the commitlog entries, either empty for none, lz4 or zstd. Entries which don't shrink are written uncompressed. Compressed commitlogs can only be replayed by versions which know about it." \
+    )                                                   \
+    val(commitlog_replay_to_sstables, bool, false, Used,     \
+            "Write the mutations replayed from the commitlog at startup straight to sstables, sorted in runs of commitlog_replay_run_size_in_mb per table and shard, instead of applying them to memtables. Large replays then write sstables of a known size, rather than many small ones flushed under memory pressure." \
+    )                                                   \
+    val(commitlog_replay_run_size_in_mb, uint32_t, 64, Used,     \
+            "With commitlog_replay_to_sstables, the size of the replayed mutations of a table sorted in memory on each shard before they are written to an sstable." \
+    )                                                   \
     val(commitlog_total_space_in_mb, int64_t, -1, Used,     \
             "Total space used for commitlogs. If the used space goes above this value, Scylla rounds up to the next nearest segment multiple and flushes memtables to disk for the oldest commitlog segments, removing those log segments. This reduces the amount of data to replay on startup, and prevents infrequently-updated tables from indefinitely keeping commitlog segments. A small total commitlog space tends to cause more flush activity on less-active tables.\n"  \
             "Related information: Configuring memtable throughput"  \
     )                                                   \
     /* Compaction settings */   \
     /* Related information: Configuring compaction */   \
-    val(compaction_preheat_key_cache, bool, true, Unused,                \
+    val(compaction_preheat_key_cache, bool, true, Used,                \
             "When set to true , cached row keys are tracked during compaction, and re-cached to their new positions in the compacted SSTable. If you have extremely large key caches for tables, set the value to false ; see Global row and key caches properties."  \
     )                                                   \
     val(concurrent_compactors, uint32_t, 0, Invalid,     \
@@ -309,10 +369,10 @@ class config : public utils::config_file {
     val(column_index_size_in_kb, uint32_t, 64, Used,     \
             "Granularity of the index of rows within a partition. For huge rows, decrease this setting to improve seek time. If you use key cache, be careful not to make this setting too large because key cache will be overwhelmed. If you're unsure of the size of the rows, it's best to use the default setting."  \
     )   \
-    val(index_summary_capacity_in_mb, uint32_t, 0, Unused,     \
+    val(index_summary_capacity_in_mb, uint32_t, 0, Used,     \
             "Fixed memory pool size in MB for SSTable index summaries. If the memory usage of all index summaries exceeds this limit, any SSTables with low read rates shrink their index summaries to meet this limit. This is a best-effort process. In extreme conditions, Cassandra may need to use more than this amount of memory."  \
     )   \
-    val(index_summary_resize_interval_in_minutes, uint32_t, 60, Unused,     \
+    val(index_summary_resize_interval_in_minutes, uint32_t, 60, Used,     \
             "How frequently index summaries should be re-sampled. This is done periodically to redistribute memory from the fixed-size pool to SSTables proportional their recent read rates. To disable, set to -1. This leaves existing index summaries at their current sampling level."  \
     )   \
     val(reduce_cache_capacity_to, double, .6, Invalid,     \
@@ -322,12 +382,27 @@ class config : public utils::config_file {
             "When Java heap usage (after a full concurrent mark sweep (CMS) garbage collection) exceeds this percentage, Cassandra reduces the cache capacity to the fraction of the current size as specified by reduce_cache_capacity_to. To disable, set the value to 1.0."  \
     )   \
     /* Disks settings */    \
-    val(stream_throughput_outbound_megabits_per_sec, uint32_t, 400, Unused,     \
-            "Throttles all outbound streaming file transfers on a node to the specified throughput. Cassandra does mostly sequential I/O when streaming data during bootstrap or repair, which can lead to saturating the network connection and degrading client (RPC) performance."  \
+    val(stream_throughput_outbound_megabits_per_sec, uint32_t, 0, Used,     \
+            "Throttles all outbound streaming file transfers on a node to the specified throughput. Cassandra does mostly sequential I/O when streaming data during bootstrap or repair, which can lead to saturating the network connection and degrading client (RPC) performance. Set to 0 to disable throttling."  \
+    )   \
+    val(stream_throughput_outbound_per_peer_megabits_per_sec, uint32_t, 0, Used,     \
+            "Throttles the outbound streaming transfers to each node to the specified throughput, in addition to stream_throughput_outbound_megabits_per_sec. Set to 0 to disable throttling."  \
+    )   \
+    val(stream_plans_per_peer, uint32_t, 2, Used,     \
+            "The number of stream plans, each covering a batch of token ranges, which bootstrap, decommission and rebuild run concurrently with each node."  \
+    )   \
+    val(stream_throttle_latency_threshold_in_ms, uint32_t, 0, Used,     \
+            "When the mean latency of the reads and writes coordinated by the node goes above this threshold, the streaming throughput limits are halved every second, down to 1/64 of them, and raised back slowly once the latency is below it. Only applies when a streaming throughput limit is set. Set to 0 to disable."  \
     )   \
     val(inter_dc_stream_throughput_outbound_megabits_per_sec, uint32_t, 0, Unused,     \
             "Throttles all streaming file transfer between the data centers. This setting allows throttles streaming throughput betweens data centers in addition to throttling all network stream traffic as configured with stream_throughput_outbound_megabits_per_sec."  \
     )   \
+    val(enable_sstable_streaming, bool, false, Used,     \
+            "When streaming a token range, send the sstables lying entirely within it as whole files, which the receiving node loads as they are, instead of sending their partitions one at a time. Used only once all nodes support it."  \
+    )   \
+    val(enable_streaming_sstable_writes, bool, false, Used,     \
+            "Write the partitions received by streaming straight to sstables, which are loaded once the streaming session is complete, instead of applying them to memtables. Keeps bootstrap and repair from competing with user writes for memtable space."  \
+    )   \
     val(trickle_fsync, bool, false, Unused,     \
             "When doing sequential writing, enabling this option tells fsync to force the operating system to flush the dirty buffers at a set interval trickle_fsync_interval_in_kb. Enable this parameter to avoid sudden dirty buffer flushing from impacting read latencies. Recommended to use on SSDs, but not on HDDs."  \
     )   \
@@ -380,6 +455,9 @@ class config : public utils::config_file {
     val(storage_port, uint16_t, 7000, Used,                \
             "The port for inter-node communication."  \
     )                                                   \
+    val(storage_shard_port, uint16_t, 0, Used,                \
+            "When set, shard N also listens to this port + N for inter-node communication, and other nodes send the replica reads and writes of a partition, and the repair requests of a range, to the port of the shard which owns it, sparing a hop between cores. Encrypted connections are not sent to these ports. Set to 0 to disable."  \
+    )                                                   \
     /* Advanced automatic backup setting */ \
     val(auto_snapshot, bool, true, Used,     \
             "Enable or disable whether a snapshot is taken of the data before keyspace truncation or dropping of tables. To prevent data loss, using the default setting is strongly advised. If you set to false, you will lose data on truncation or drop."  \
@@ -393,18 +471,24 @@ class config : public utils::config_file {
     val(key_cache_save_period, uint32_t, 14400, Unused,                \
             "Duration in seconds that keys are saved in cache. Caches are saved to saved_caches_directory. Saved caches greatly improve cold-start speeds and has relatively little effect on I/O."  \
     )   \
-    val(key_cache_size_in_mb, uint32_t, 100, Unused,                \
+    val(key_cache_size_in_mb, uint32_t, 100, Used,                \
             "A global cache setting for tables. It is the maximum size of the key cache in memory. To disable set to 0.\n"  \
             "Related information: nodetool setcachecapacity."   \
     )   \
-    val(row_cache_keys_to_save, uint32_t, 0, Unused,                \
-            "Number of keys from the row cache to save."  \
+    val(row_cache_keys_to_save, uint32_t, 0, Used,                \
+            "Number of keys from the row cache to save, per shard. (0: 100000)"  \
     )   \
     val(row_cache_size_in_mb, uint32_t, 0, Unused,                \
             "Maximum size of the row cache in memory. Row cache can save more time than key_cache_size_in_mb, but is space-intensive because it contains the entire row. Use the row cache only for hot rows or static rows. If you reduce the size, you may not get you hottest keys loaded on start up."  \
     )   \
-    val(row_cache_save_period, uint32_t, 0, Unused,     \
-            "Duration in seconds that rows are saved in cache. Caches are saved to saved_caches_directory."  \
+    val(row_cache_save_period, uint32_t, 0, Used,     \
+            "Duration in seconds after which the keys of the hottest partitions in the row cache are saved to saved_caches_directory. They are read into the cache on the next start. (0: disabled)"  \
+    )   \
+    val(row_cache_compressed_fraction, double, 0, Used,     \
+            "Fraction of the row cache memory which may hold cold partitions compressed, instead of evicting them. A read of a compressed partition decompresses it back into the cache. (0: disabled)"  \
+    )   \
+    val(in_memory_tables_memory_fraction, double, 0.2, Used,     \
+            "Fraction of the shard's memory which the cached data of the tables with the in_memory caching option may use. Above it, their data is evicted like that of other tables, and reads of it may go to disk."  \
     )   \
     val(memory_allocator, sstring, "NativeAllocator", Invalid,     \
             "The off-heap memory allocator. In addition to caches, this property affects storage engine meta data. Supported values:\n"  \
@@ -416,8 +500,8 @@ class config : public utils::config_file {
     /* Counter caches properties */ \
     /* Counter cache helps to reduce counter locks' contention for hot counter cells. In case of RF = 1 a counter cache hit will cause Cassandra to skip the read before write entirely. With RF > 1 a counter cache hit will still help to reduce the duration of the lock hold, helping with hot counter cell updates, but will not allow skipping the read entirely. Only the local (clock, count) tuple of a counter cell is kept in memory, not the whole counter, so it's relatively cheap. */    \
     /* Note: Reducing the size counter cache may result in not getting the hottest keys loaded on start-up. */  \
-    val(counter_cache_size_in_mb, uint32_t, 0, Unused,     \
-            "When no value is specified a minimum of 2.5% of Heap or 50MB. If you perform counter deletes and rely on low gc_grace_seconds, you should disable the counter cache. To disable, set to 0"  \
+    val(counter_cache_size_in_mb, uint32_t, 50, Used,     \
+            "The memory of the counter cache, divided among the shards. Updates of counter cells whose local shard is cached don't read them first. To disable, set to 0"  \
     )   \
     val(counter_cache_save_period, uint32_t, 7200, Unused,     \
             "Duration after which Cassandra should save the counter cache (keys only). Caches are saved to saved_caches_directory."  \
@@ -435,7 +519,7 @@ class config : public utils::config_file {
             "The maximum number of tombstones a query can scan before aborting."  \
     )   \
     /* Network timeout settings */  \
-    val(range_request_timeout_in_ms, uint32_t, 10000, Unused,     \
+    val(range_request_timeout_in_ms, uint32_t, 10000, Used,     \
             "The time in milliseconds that the coordinator waits for sequential or index scans to complete."  \
     )   \
     val(read_request_timeout_in_ms, uint32_t, 5000, Used,     \
@@ -444,7 +528,7 @@ class config : public utils::config_file {
     val(counter_write_request_timeout_in_ms, uint32_t, 5000, Used,     \
             "The time that the coordinator waits for counter writes to complete."  \
     )   \
-    val(cas_contention_timeout_in_ms, uint32_t, 5000, Unused,     \
+    val(cas_contention_timeout_in_ms, uint32_t, 5000, Used,     \
             "The time that the coordinator continues to retry a CAS (compare and set) operation that contends with other proposals for the same row."  \
     )   \
     val(truncate_request_timeout_in_ms, uint32_t, 10000, Used,     \
@@ -486,6 +570,18 @@ class config : public utils::config_file {
     val(inter_dc_tcp_nodelay, bool, false, Used,     \
             "Enable or disable tcp_nodelay for inter-data center communication. When disabled larger, but fewer, network packets are sent. This reduces overhead from the TCP protocol itself. However, if cross data-center responses are blocked, it will increase latency."  \
     )   \
+    val(internode_compression_per_class, string_map, /*none*/, Used,     \
+            "Overrides internode_compression for the connections of some classes of traffic between nodes: reads, writes, maintenance (repair) and streaming. Each class has its own connections. For example: {streaming: all, reads: none}."  \
+    )   \
+    val(internode_compression_algorithm_per_class, string_map, /*none*/, Used,     \
+            "The algorithm compressed connections of some classes of traffic between nodes use: lz4 or zstd. zstd compresses more, at a higher CPU cost. Defaults to {streaming: zstd}, and lz4 for the other classes. Nodes which don't support an algorithm use lz4."  \
+    )   \
+    val(internode_compression_threshold_in_bytes, uint32_t, 512, Used,     \
+            "Messages between nodes smaller than this are sent uncompressed, even on compressed connections: compressing them costs CPU and saves next to nothing."  \
+    )   \
+    val(inter_dc_tcp_nodelay_per_class, string_map, /*none*/, Used,     \
+            "Overrides inter_dc_tcp_nodelay for the connections of some classes of traffic between nodes: reads, writes, maintenance (repair) and streaming. For example: {maintenance: false, reads: true}."  \
+    )   \
     val(streaming_socket_timeout_in_ms, uint32_t, 0, Unused,     \
             "Enable or disable socket timeout for streaming operations. When a timeout occurs during streaming, streaming is retried from the start of the current file. Avoid setting this value too low, as it can result in a significant amount of data re-streaming."  \
     )   \
@@ -503,6 +599,14 @@ class config : public utils::config_file {
             "from native_transport_port will use encryption for native_transport_port_ssl while"    \
             "keeping native_transport_port unencrypted" \
     )   \
+    val(native_shard_aware_transport_port, uint16_t, 19042, Used,                \
+            "Like native_transport_port, but clients are forwarded to specific shards, based on the client-side port numbers. " \
+            "Shard-aware drivers use it to connect to the shard owning the tokens they query. Set to 0 to disable." \
+    )   \
+    val(native_shard_aware_transport_port_ssl, uint16_t, 19142, Used,                \
+            "Like native_transport_port_ssl, but clients are forwarded to specific shards, based on the client-side port numbers. " \
+            "Only used when native_transport_port_ssl is." \
+    )   \
     val(native_transport_max_threads, uint32_t, 128, Invalid,                \
             "The maximum number of thread handling requests. The meaning is the same as rpc_max_threads.\n"  \
             "Default is different (128 versus unlimited).\n"  \
@@ -551,26 +655,38 @@ class config : public utils::config_file {
     ) \
     /* Advanced fault detection settings */ \
     /* Settings to handle poorly performing or failing nodes. */    \
-    val(dynamic_snitch_badness_threshold, double, 0, Unused,     \
+    val(dynamic_snitch, bool, true, Used,     \
+            "Rank the replicas of the local data center a read can be sent to by their recent read latency and number of pending reads, so that reads avoid replicas which became slow before the failure detector marks them down."  \
+    )   \
+    val(dynamic_snitch_badness_threshold, double, 0.1, Used,     \
             "Sets the performance threshold for dynamically routing requests away from a poorly performing node. A value of 0.2 means Cassandra continues to prefer the static snitch values until the node response time is 20% worse than the best performing node. Until the threshold is reached, incoming client requests are statically routed to the closest replica (as determined by the snitch). Having requests consistently routed to a given replica can help keep a working set of data hot when read repair is less than 1."  \
     )   \
-    val(dynamic_snitch_reset_interval_in_ms, uint32_t, 60000, Unused,     \
+    val(dynamic_snitch_reset_interval_in_ms, uint32_t, 60000, Used,     \
             "Time interval in milliseconds to reset all node scores, which allows a bad node to recover."  \
     )   \
     val(dynamic_snitch_update_interval_in_ms, uint32_t, 100, Unused,     \
             "The time interval for how often the snitch calculates node scores. Because score calculation is CPU intensive, be careful when reducing this interval."  \
     )   \
-    val(hinted_handoff_enabled, bool, true, Unused,     \
+    val(speculative_retry_budget_percent, double, 10, Used,     \
+            "The most speculative reads, sent to one more replica when a read takes longer than the speculative_retry of its table, can be as a percentage of the single partition reads a shard coordinates, so that speculation can't double the load of replicas which are all slow. 100 means no limit."  \
+    )   \
+    val(max_background_read_repairs, uint32_t, 128, Used,     \
+            "The most read repair writes a shard may send without the read waiting for them, beyond which reads wait for their repair. Reads which don't wait answer sooner, but a quorum read may then return an older value than a read which completed before it. 0 makes all reads wait."  \
+    )   \
+    val(coordinator_result_cache_size_in_mb, uint32_t, 4, Used,     \
+            "The memory each shard may keep the results of the reads it coordinated in, for the tables with the coordinator_ttl_ms caching option. Those results are given again to the same CL ONE and LOCAL_ONE single partition reads until their TTL elapses or a write to their partition is coordinated by the same shard; writes coordinated elsewhere may be missed until then."  \
+    )   \
+    val(hinted_handoff_enabled, bool, true, Used,     \
             "Enable or disable hinted handoff. To enable per data center, add data center list. For example: hinted_handoff_enabled: DC1,DC2. A hint indicates that the write needs to be replayed to an unavailable node. Where Cassandra writes the hint depends on the version:\n"  \
             "\n"    \
             "\tPrior to 1.0: Writes to a live replica node.\n"  \
             "\t1.0 and later: Writes to the coordinator node.\n"  \
             "Related information: About hinted handoff writes"  \
     )   \
-    val(hinted_handoff_throttle_in_kb, uint32_t, 1024, Unused,     \
+    val(hinted_handoff_throttle_in_kb, uint32_t, 1024, Used,     \
             "Maximum throttle per delivery thread in kilobytes per second. This rate reduces proportionally to the number of nodes in the cluster. For example, if there are two nodes in the cluster, each delivery thread will use the maximum rate. If there are three, each node will throttle to half of the maximum, since the two nodes are expected to deliver hints simultaneously."  \
     )   \
-    val(max_hint_window_in_ms, uint32_t, 10800000, Unused,     \
+    val(max_hint_window_in_ms, uint32_t, 10800000, Used,     \
             "Maximum amount of time that hints are generates hints for an unresponsive node. After this interval, new hints are no longer generated until the node is back up and responsive. If the node goes down again, a new interval begins. This setting can prevent a sudden demand for resources when a node is brought back online and the rest of the cluster attempts to replay a large volume of hinted writes.\n"  \
             "Related information: Failure detection and recovery"  \
     )   \
@@ -643,6 +759,15 @@ class config : public utils::config_file {
     val(permissions_cache_max_entries, uint32_t, 1000, Used,    \
             "Maximum cached permission entries. Must have a non-zero value if permissions caching is enabled (see a permissions_validity_in_ms description)." \
     )   \
+    val(credentials_validity_in_ms, uint32_t, 2000, Used,     \
+            "How long credentials verified by the PasswordAuthenticator are trusted by each shard without verifying them again, which takes a query and a salted hash. The cache is invalidated on the node where a user is altered or dropped; the other nodes may accept the old password for that long. Setting it to 0 disables the cache." \
+    )   \
+    val(credentials_cache_max_entries, uint32_t, 1000, Used,    \
+            "Maximum cached verified credentials per shard (see credentials_validity_in_ms)." \
+    )   \
+    val(credentials_check_concurrency, uint32_t, 4, Used,    \
+            "The number of credentials each shard verifies at the same time, others waiting their turn, so that a storm of connections doesn't flood the node with system_auth queries and salted hashes." \
+    )   \
     val(server_encryption_options, string_map, /*none*/, Used,     \
             "Enable or disable inter-node encryption. You must also generate keys and provide the appropriate key and trust store locations and passwords. No custom encryption options are currently enabled. The available options are:\n"    \
             "\n"    \
@@ -697,6 +822,8 @@ class config : public utils::config_file {
     val(override_decommission, bool, false, Used, "Set true to force a decommissioned node to join the cluster") \
     val(ring_delay_ms, uint32_t, 30 * 1000, Used, "Time a node waits to hear from other nodes before joining the ring in milliseconds. Same as -Dcassandra.ring_delay_ms in cassandra.") \
     val(shadow_round_ms, uint32_t, 300 * 1000, Used, "The maximum gossip shadow round time. Can be used to reduce the gossip feature check time during node boot up.") \
+    val(gossip_max_digests_per_syn, uint32_t, 128, Used, "The maximum number of endpoints a gossip round sends the digest of. The local endpoint and the ones whose state changed lately come first, the others are sent in turn in the next rounds. Bounds the cost of gossip in large clusters. 0 sends them all.") \
+    val(gossip_compression, bool, false, Used, "Compress the connections gossip uses between nodes, whatever internode_compression is.") \
     val(fd_max_interval_ms, uint32_t, 2 * 1000, Used, "The maximum failure_detector interval time in milliseconds. Interval larger than the maximum will be ignored. Larger cluster may need to increase the default.") \
     val(fd_initial_value_ms, uint32_t, 2 * 1000, Used, "The initial failure_detector interval time in milliseconds.") \
     val(shutdown_announce_in_ms, uint32_t, 2 * 1000, Used, "Time a node waits after sending gossip shutdown message in milliseconds. Same as -Dcassandra.shutdown_announce_in_ms in cassandra.") \
@@ -704,6 +831,8 @@ class config : public utils::config_file {
     val(skip_wait_for_gossip_to_settle, int32_t, -1, Used, "An integer to configure the wait for gossip to settle. -1: wait normally, 0: do not wait at all, n: wait for at most n polls. Same as -Dcassandra.skip_wait_for_gossip_to_settle in cassandra.") \
     val(experimental, bool, false, Used, "Set to true to unlock experimental features.") \
     val(lsa_reclamation_step, size_t, 1, Used, "Minimum number of segments to reclaim in a single step") \
+    val(lsa_free_segments_reserve, size_t, 0, Used, "Number of free LSA segments to keep on each shard by compacting and evicting while the cpu is idle, so that writes rarely have to reclaim memory inline. Zero disables it.") \
+    val(lsa_hugepage_zones, bool, false, Used, "Align LSA memory zones to 2 MiB and advise the kernel to back them with transparent hugepages, reducing TLB misses on cache and memtable lookups. Has no effect where transparent hugepages are unavailable.") \
     val(prometheus_port, uint16_t, 9180, Used, "Prometheus port, set to zero to disable") \
     val(prometheus_address, sstring, "0.0.0.0", Used, "Prometheus listening address") \
     val(prometheus_prefix, sstring, "scylla", Used, "Set the prefix of the exported Prometheus metrics. Changing this will break Scylla's dashboard compatibility, do not change unless you know what you are doing.") \
@@ -715,8 +844,21 @@ class config : public utils::config_file {
     val(large_memory_allocation_warning_threshold, size_t, size_t(1) << 20, Used, "Warn about memory allocations above this size; set to zero to disable") \
     val(enable_deprecated_partitioners, bool, false, Used, "Enable the byteordered and murmurs partitioners. These partitioners are deprecated and will be removed in a future version.") \
     val(enable_keyspace_column_family_metrics, bool, false, Used, "Enable per keyspace and per column family metrics reporting") \
+    val(top_partitions_sample_rate, double, 0.01, Used, "Fraction of the single partition reads and of the writes of each table which are counted to find its most used partitions. Zero disables it.") \
+    val(top_partitions_window_in_s, uint32_t, 60, Used, "The most used partitions are counted over windows of that many seconds. Results cover the last complete window and the current one.") \
+    val(task_stall_report_threshold_ms, uint32_t, 50, Used, "Count, and log with a backtrace, the synchronous sections of the CQL server, storage proxy, compaction, memtable flush, cache population and repair holding the reactor for longer than this. Zero disables it.") \
     val(enable_sstable_data_integrity_check, bool, false, Used, "Enable interposer which checks for integrity of every sstable write." \
         " Performance is affected to some extent as a result. Useful to help debugging problems that may arise at another layers.") \
+    val(enable_sstables_mc_format, bool, false, Used, "Write new sstables in the \"mc\" format, which stores each row as a unit with delta-encoded timestamps and a bitmap of its columns instead of repeating the clustering key and column name in every cell." \
+        " Existing sstables stay readable either way. Sstables written in this format can't be read by older versions.") \
+    val(max_concurrent_partition_reads, uint32_t, 100, Used, "The maximum number of partitions of a multi-partition query (e.g. with an IN restriction on the partition key) the coordinator reads at the same time. Set to zero for no limit.") \
+    val(write_batching_window_in_us, uint32_t, 0, Used, "The time in microseconds the coordinator waits for more writes to the same replica, so that the writes it doesn't forward to other replicas are sent to it together, in one message, and applied by it with one cross-shard call per shard. Each write is still acknowledged on its own. Set to zero to send every write in its own message.") \
+    val(parallel_range_scan_concurrency, uint32_t, 16, Used, "The number of token ranges the coordinator of a parallel range scan reads at the same time. A range scan is parallel when it is asked for with SELECT ... PARALLEL SCAN, or when it asks for at least parallel_range_scan_min_rows rows.") \
+    val(parallel_range_scan_min_rows, uint32_t, 0, Used, "The number of rows from which the coordinator reads the token ranges of a range scan in parallel, rather than starting with one and doubling the concurrency after each round. Set to zero to scan in parallel only when asked for.") \
+    val(parallel_range_scan_memory_in_mb, uint32_t, 32, Used, "The memory, per shard, the results of the range reads of the parallel range scans run by this coordinator may use. Each range read is counted for the maximum size of a result page, 1MB.") \
+    val(page_size_in_kb, uint32_t, 0, Used, "The size of the pages of paged queries, in kilobytes, for the clients which don't ask for one with the SCYLLA_PAGE_SIZE_IN_BYTES startup option. Pages end at the row count asked for, or once this much data is read, whichever comes first. Set to zero to only end them at the row count, and at the 1MB each replica returns at most.") \
+    val(querier_cache_ttl_in_ms, uint32_t, 10000, Used, "The time a replica keeps the reader of a paged single partition query whose page ended inside the partition, for reading the next page. Set to zero to read every page with a new reader.") \
+    val(querier_cache_max_entries, uint32_t, 10000, Used, "The number of readers of paged queries a shard keeps between pages at most. The oldest are evicted first, and also when reads wait for memory.") \
     /* done! */
 
 #define _make_value_member(name, type, deflt, status, desc, ...)    \
@@ -157,7 +157,7 @@ std::vector<gms::inet_address>
 filter_for_query(consistency_level cl,
                  keyspace& ks,
                  std::vector<gms::inet_address> live_endpoints,
-                 read_repair_decision read_repair, gms::inet_address* extra, column_family* cf) {
+                 read_repair_decision read_repair, gms::inet_address* extra, column_family* cf, const dht::token* token) {
     size_t local_count;
 
     if (read_repair == read_repair_decision::GLOBAL) { // take RRD.GLOBAL out of the way
@@ -183,15 +183,20 @@ filter_for_query(consistency_level cl,
     }
 
     if (cf) {
-        auto get_hit_rate = [cf] (gms::inet_address ep) -> float {
+        // The hit rates of the range of the ring of the token read, when known.
+        auto get_hit_rate = [cf, token] (gms::inet_address ep) -> float {
             constexpr float max_hit_rate = 0.999;
-            auto ht = cf->get_hit_rate(ep);
+            auto ht = token ? cf->get_hit_rate(ep, *token) : cf->get_hit_rate(ep);
             if (float(ht.rate) < 0) {
                 return float(ht.rate);
             } else if (lowres_clock::now() - ht.last_updated > std::chrono::milliseconds(1000)) {
                 // if a cache entry is not updates for a while try to send traffic there
                 // to get more up to date data, mark it updated to not send to much traffic there
-                cf->set_hit_rate(ep, ht.rate);
+                if (token) {
+                    cf->set_hit_rate(ep, *token, ht.rate);
+                } else {
+                    cf->set_hit_rate(ep, ht.rate);
+                }
                 return max_hit_rate;
             } else {
                 return std::min(float(ht.rate), max_hit_rate); // calculation below cannot work with hit rate 1
@@ -285,27 +290,22 @@ void validate_for_write(const sstring& keyspace_name, consistency_level cl) {
     }
 }
 
-#if 0
-    // This is the same than validateForWrite really, but we include a slightly different error message for SERIAL/LOCAL_SERIAL
-    public void validateForCasCommit(String keyspaceName) throws InvalidRequestException
-    {
-        switch (this)
-        {
-            case EACH_QUORUM:
-                requireNetworkTopologyStrategy(keyspaceName);
-                break;
-            case SERIAL:
-            case LOCAL_SERIAL:
-                throw new InvalidRequestException(this + " is not supported as conditional update commit consistency. Use ANY if you mean \"make sure it is accepted but I don't care how many replicas commit it for non-SERIAL reads\"");
-        }
+// This is the same as validate_for_write() really, but with a different error message for SERIAL/LOCAL_SERIAL.
+void validate_for_cas_commit(const sstring& keyspace_name, consistency_level cl) {
+    switch (cl) {
+        case consistency_level::SERIAL:
+        case consistency_level::LOCAL_SERIAL:
+            throw exceptions::invalid_request_exception(sprint("%s is not supported as conditional update commit consistency. Use ANY if you mean \"make sure it is accepted but I don't care how many replicas commit it for non-SERIAL reads\"", cl));
+        default:
+            break;
     }
+}
 
-    public void validateForCas() throws InvalidRequestException
-    {
-        if (!isSerialConsistency())
-            throw new InvalidRequestException("Invalid consistency for conditional update. Must be one of SERIAL or LOCAL_SERIAL");
+void validate_for_cas(consistency_level cl) {
+    if (!is_serial_consistency(cl)) {
+        throw exceptions::invalid_request_exception("Invalid consistency for conditional update. Must be one of SERIAL or LOCAL_SERIAL");
     }
-#endif
+}
 
 bool is_serial_consistency(consistency_level cl) {
     return cl == consistency_level::SERIAL || cl == consistency_level::LOCAL_SERIAL;
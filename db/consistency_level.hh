@@ -79,7 +79,7 @@ std::vector<gms::inet_address>
 filter_for_query(consistency_level cl,
                  keyspace& ks,
                  std::vector<gms::inet_address> live_endpoints,
-                 read_repair_decision read_repair, gms::inet_address* extra, column_family* cf);
+                 read_repair_decision read_repair, gms::inet_address* extra, column_family* cf, const dht::token* token = nullptr);
 
 std::vector<gms::inet_address> filter_for_query(consistency_level cl, keyspace& ks, std::vector<gms::inet_address>& live_endpoints, column_family* cf);
 
@@ -208,6 +208,10 @@ void validate_for_read(const sstring& keyspace_name, consistency_level cl);
 
 void validate_for_write(const sstring& keyspace_name, consistency_level cl);
 
+void validate_for_cas_commit(const sstring& keyspace_name, consistency_level cl);
+
+void validate_for_cas(consistency_level cl);
+
 bool is_serial_consistency(consistency_level cl);
 
 void validate_counter_for_write(schema_ptr s, consistency_level cl);
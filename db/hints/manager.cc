@@ -0,0 +1,517 @@
+/*
+ * Copyright (C) 2017 ScyllaDB
+ */
+
+/*
+ * This file is part of Scylla.
+ *
+ * Scylla is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Scylla is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <boost/range/adaptor/map.hpp>
+#include <seastar/core/sleep.hh>
+#include <seastar/core/metrics.hh>
+#include "db/hints/manager.hh"
+#include "db/commitlog/commitlog_entry.hh"
+#include "service/storage_proxy.hh"
+#include "gms/failure_detector.hh"
+#include "gms/gossiper.hh"
+#include "converting_mutation_partition_applier.hh"
+#include "disk-error-handler.hh"
+#include "lister.hh"
+#include "database.hh"
+#include "log.hh"
+
+namespace db {
+namespace hints {
+
+static logging::logger manager_logger("hints_manager");
+
+const std::chrono::seconds manager::hints_flush_period = std::chrono::seconds(10);
+
+manager::manager(sstring hints_directory, uint32_t max_hint_window_ms, uint32_t throttle_in_kb, sstring metrics_group)
+    : _hints_dir(hints_directory + "/" + to_sstring(engine().cpu_id()))
+    , _max_hint_window_us(uint64_t(max_hint_window_ms) * 1000)
+    , _throttle_bytes_per_sec(uint64_t(throttle_in_kb) * 1024 / smp::count)
+    , _timer([this] { on_timer(); })
+{
+    namespace sm = seastar::metrics;
+
+    _metrics.add_group(metrics_group, {
+        sm::make_gauge("size_of_hints_in_progress", _stats.size_of_hints_in_progress,
+                        sm::description("Size of hinted mutations that are scheduled to be written.")),
+
+        sm::make_derive("written", _stats.written,
+                        sm::description("Number of successfully written hints.")),
+
+        sm::make_derive("errors", _stats.errors,
+                        sm::description("Number of errors during hints writes and sends.")),
+
+        sm::make_derive("dropped", _stats.dropped,
+                        sm::description("Number of dropped hints.")),
+
+        sm::make_derive("sent", _stats.sent,
+                        sm::description("Number of sent hints.")),
+
+        sm::make_derive("discarded", _stats.discarded,
+                        sm::description("Number of hints that were discarded during sending (their table was dropped, or they could not be decoded).")),
+    });
+}
+
+manager::~manager() {
+    assert(_ep_managers.empty());
+}
+
+future<> manager::start(shared_ptr<service::storage_proxy> proxy_ptr) {
+    _proxy_anchor = std::move(proxy_ptr);
+    return io_check(recursive_touch_directory, _hints_dir).then([this] {
+        return load_existing_endpoints();
+    }).then([this] {
+        _started = true;
+        _throttle_start = clock_type::now();
+        _timer.arm(hints_flush_period);
+    });
+}
+
+future<> manager::stop() {
+    manager_logger.info("Asked to stop");
+    _stopping = true;
+    _timer.cancel();
+
+    return _hints_flush_gate.close().then([this] {
+        return _hints_write_gate.close();
+    }).then([this] {
+        return parallel_for_each(_ep_managers | boost::adaptors::map_values, [] (end_point_hints_manager& ep_man) {
+            return ep_man.stop();
+        });
+    }).finally([this] {
+        _ep_managers.clear();
+        _proxy_anchor = nullptr;
+        _started = false;
+        manager_logger.info("Stopped");
+    });
+}
+
+future<> manager::load_existing_endpoints() {
+    // Hints left over from the previous run are delivered like fresh ones.
+    return lister::scan_dir(_hints_dir, { directory_entry_type::directory }, [this] (lister::path dir, directory_entry de) {
+        try {
+            get_ep_manager(gms::inet_address(de.name));
+        } catch (...) {
+            manager_logger.warn("Ignoring unexpected entry {} in {}: {}", de.name, dir.native(), std::current_exception());
+        }
+        return make_ready_future<>();
+    });
+}
+
+manager::end_point_hints_manager& manager::get_ep_manager(ep_key_type ep) {
+    auto it = _ep_managers.find(ep);
+    if (it == _ep_managers.end()) {
+        manager_logger.trace("Creating an ep_manager for {}", ep);
+        it = _ep_managers.emplace(std::piecewise_construct, std::forward_as_tuple(ep), std::forward_as_tuple(ep, *this)).first;
+    }
+    return it->second;
+}
+
+bool manager::can_hint_for(ep_key_type ep) const noexcept {
+    if (!started()) {
+        return false;
+    }
+
+    // Don't let the hints which are still being written eat all the memory.
+    // Endpoints which don't have any hints in flight are still allowed to
+    // collect new ones, so that a single slow destination doesn't disable
+    // hinting for the rest of the cluster.
+    if (_stats.size_of_hints_in_progress > max_size_of_hints_in_progress) {
+        auto it = _ep_managers.find(ep);
+        if (it != _ep_managers.end() && it->second.hints_in_progress() > 0) {
+            manager_logger.trace("size_of_hints_in_progress {} hints_in_progress_for({}) {}", _stats.size_of_hints_in_progress, ep, it->second.hints_in_progress());
+            return false;
+        }
+    }
+
+    // Don't generate hints for an endpoint which has been down for too long.
+    auto downtime_us = gms::get_local_gossiper().get_endpoint_downtime(ep);
+    if (downtime_us > 0 && uint64_t(downtime_us) > _max_hint_window_us) {
+        manager_logger.trace("{} has been down for {}us, not hinting", ep, downtime_us);
+        return false;
+    }
+
+    return true;
+}
+
+bool manager::store_hint(ep_key_type ep, schema_ptr s, lw_shared_ptr<const frozen_mutation> fm) noexcept {
+    if (!started() || !fm) {
+        return false;
+    }
+
+    try {
+        manager_logger.trace("Going to store a hint to {}", ep);
+        get_ep_manager(ep).store_hint(std::move(s), std::move(fm));
+        return true;
+    } catch (...) {
+        manager_logger.trace("Failed to store a hint to {}: {}", ep, std::current_exception());
+        ++_stats.dropped;
+        return false;
+    }
+}
+
+void manager::schedule_delivery(stdx::optional<ep_key_type> ep) {
+    if (!started()) {
+        return;
+    }
+    if (ep && !_ep_managers.count(*ep)) {
+        return;
+    }
+    // All endpoints are checked on each timer tick; the busy ones are
+    // skipped, so there is no harm in firing early.
+    _timer.rearm(clock_type::now());
+}
+
+future<> manager::truncate_hints(stdx::optional<ep_key_type> ep) {
+    if (ep) {
+        auto it = _ep_managers.find(*ep);
+        if (it == _ep_managers.end()) {
+            return make_ready_future<>();
+        }
+        return it->second.truncate();
+    }
+    return parallel_for_each(_ep_managers | boost::adaptors::map_values, [] (end_point_hints_manager& ep_man) {
+        return ep_man.truncate();
+    });
+}
+
+std::vector<manager::ep_key_type> manager::endpoints_pending_hints() const {
+    std::vector<ep_key_type> res;
+    for (auto&& e : _ep_managers) {
+        if (e.second.has_pending_hints()) {
+            res.push_back(e.first);
+        }
+    }
+    return res;
+}
+
+manager::endpoint_stats manager::get_endpoint_stats(ep_key_type ep) const {
+    auto it = _ep_managers.find(ep);
+    if (it == _ep_managers.end()) {
+        return endpoint_stats();
+    }
+    return it->second.get_stats();
+}
+
+void manager::on_timer() {
+    with_gate(_hints_flush_gate, [this] {
+        return parallel_for_each(_ep_managers | boost::adaptors::map_values, [] (end_point_hints_manager& ep_man) {
+            if (ep_man.busy()) {
+                return make_ready_future<>();
+            }
+            return ep_man.flush_and_send();
+        });
+    }).finally([this] {
+        if (!_stopping) {
+            _timer.arm(hints_flush_period);
+        }
+    });
+}
+
+future<> manager::throttle(size_t bytes) {
+    if (!_throttle_bytes_per_sec) {
+        return make_ready_future<>();
+    }
+
+    auto now = clock_type::now();
+    // Start a new accounting period when the sender was idle for a while,
+    // so that the idle time doesn't translate into an unbounded burst.
+    if (now - _throttle_start > hints_flush_period) {
+        _throttle_start = now;
+        _throttled_bytes = 0;
+    }
+
+    _throttled_bytes += bytes;
+    auto due = _throttle_start + std::chrono::duration_cast<clock_type::duration>(
+            std::chrono::duration<double>(double(_throttled_bytes) / _throttle_bytes_per_sec));
+    if (due <= now) {
+        return make_ready_future<>();
+    }
+    return sleep(due - now);
+}
+
+manager::end_point_hints_manager::end_point_hints_manager(const ep_key_type& key, manager& shard_manager)
+    : _key(key)
+    , _shard_manager(shard_manager)
+    , _hints_dir(shard_manager.hints_dir() + "/" + key.to_sstring())
+{}
+
+commitlog::config manager::end_point_hints_manager::make_commitlog_config() const {
+    commitlog::config cfg;
+
+    cfg.commit_log_location = _hints_dir;
+    cfg.commitlog_segment_size_in_mb = hints_segment_size_in_mb;
+    // commitlog divides the total space between the shards
+    cfg.commitlog_total_space_in_mb = max_hints_per_ep_size_in_mb * smp::count;
+    cfg.commitlog_sync_period_in_ms = std::chrono::duration_cast<std::chrono::milliseconds>(hints_flush_period).count();
+    // Hints have their own metrics; don't register one commitlog group per endpoint.
+    cfg.metrics_category_name = "";
+
+    return cfg;
+}
+
+// Must be called with _file_update_mutex held for read.
+future<> manager::end_point_hints_manager::get_or_load() {
+    if (_hints_store) {
+        return make_ready_future<>();
+    }
+
+    if (!_store_loading) {
+        _store_loading = shared_future<>(io_check(recursive_touch_directory, _hints_dir).then([this] {
+            return commitlog::create_commitlog(make_commitlog_config());
+        }).then([this] (commitlog l) {
+            // Segments left over in the directory are picked up by
+            // populate_segments_to_replay(), not by the commitlog itself.
+            l.get_segments_to_replay();
+            _hints_store = std::make_unique<commitlog>(std::move(l));
+        }));
+    }
+
+    return _store_loading->get_future();
+}
+
+void manager::end_point_hints_manager::store_hint(schema_ptr s, lw_shared_ptr<const frozen_mutation> fm) {
+    size_t mut_size = fm->representation().size();
+
+    with_gate(_shard_manager._hints_write_gate, [this, mut_size, s = std::move(s), fm = std::move(fm)] () mutable {
+        _shard_manager._stats.size_of_hints_in_progress += mut_size;
+        ++_hints_in_progress;
+        ++_stats.created;
+
+        return with_lock(_file_update_mutex.for_read(), [this, s = std::move(s), fm] () mutable {
+            return get_or_load().then([this, s = std::move(s), fm] {
+                commitlog_entry_writer cew(s, *fm);
+                return _hints_store->add_entry(s->id(), cew, commitlog::timeout_clock::time_point::max());
+            }).then([this] (db::rp_handle rh) {
+                // Keep the segment dirty: it must survive until the hint is delivered.
+                rh.release();
+                ++_shard_manager._stats.written;
+                ++_hints_since_flush;
+            });
+        }).finally([fm] {});
+    }).then_wrapped([this, mut_size] (future<> f) {
+        try {
+            f.get();
+        } catch (...) {
+            ++_shard_manager._stats.errors;
+            ++_stats.not_stored;
+            manager_logger.debug("Failed to store a hint to {}: {}", _key, std::current_exception());
+        }
+        _shard_manager._stats.size_of_hints_in_progress -= mut_size;
+        --_hints_in_progress;
+    });
+}
+
+future<> manager::end_point_hints_manager::populate_segments_to_replay() {
+    _segments_to_replay.clear();
+    return io_check(recursive_touch_directory, _hints_dir).then([this] {
+        return lister::scan_dir(_hints_dir, { directory_entry_type::regular }, [this] (lister::path dir, directory_entry de) {
+            try {
+                commitlog::descriptor d(de.name);
+                _segments_to_replay.push_back((dir / de.name.c_str()).native());
+            } catch (...) {
+                manager_logger.warn("Ignoring unexpected file {} in {}", de.name, dir.native());
+            }
+            return make_ready_future<>();
+        });
+    });
+}
+
+// Must be called with _file_update_mutex held for write.
+future<> manager::end_point_hints_manager::close_store() {
+    auto f = make_ready_future<>();
+    if (_hints_store) {
+        f = _hints_store->shutdown().then([this] {
+            return _hints_store->release();
+        }).finally([this] {
+            _hints_store.reset();
+        });
+    }
+    return f.finally([this] {
+        _store_loading = stdx::nullopt;
+        _hints_since_flush = 0;
+    });
+}
+
+// Closes the active hints segments, so that they can be sent.
+future<> manager::end_point_hints_manager::flush_current_hints() {
+    return with_lock(_file_update_mutex.for_write(), [this] {
+        return close_store().then([this] {
+            return populate_segments_to_replay();
+        });
+    });
+}
+
+bool manager::end_point_hints_manager::can_send() const noexcept {
+    if (_shard_manager._stopping || _shard_manager._delivery_paused) {
+        return false;
+    }
+    return gms::get_local_failure_detector().is_alive(_key);
+}
+
+future<> manager::end_point_hints_manager::flush_and_send() {
+    _busy = true;
+    return flush_current_hints().then([this] {
+        if (_segments_to_replay.empty() || !can_send()) {
+            return make_ready_future<>();
+        }
+        return send_hints();
+    }).handle_exception([this] (std::exception_ptr ep) {
+        manager_logger.warn("Failed to deliver hints to {}: {}", _key, ep);
+    }).finally([this] {
+        _busy = false;
+    });
+}
+
+future<> manager::end_point_hints_manager::send_hints() {
+    manager_logger.debug("Sending {} hints segments to {}", _segments_to_replay.size(), _key);
+    return repeat([this] {
+        if (_segments_to_replay.empty() || !can_send()) {
+            return make_ready_future<stop_iteration>(stop_iteration::yes);
+        }
+        sstring fname = _segments_to_replay.front();
+        return send_one_file(fname).then([this, fname] (bool done) {
+            if (!done) {
+                // Retry the whole file on the next round. Hints which were
+                // already delivered are sent again, which is harmless.
+                return make_ready_future<stop_iteration>(stop_iteration::yes);
+            }
+            _segments_to_replay.pop_front();
+            return remove_file(fname).handle_exception([fname] (std::exception_ptr ep) {
+                manager_logger.warn("Failed to remove hints segment {}: {}", fname, ep);
+            }).then([] {
+                return stop_iteration::no;
+            });
+        });
+    }).finally([this] {
+        _column_mappings.clear();
+    });
+}
+
+mutation manager::end_point_hints_manager::get_mutation(const commitlog_entry_reader& cer) {
+    auto& fm = cer.mutation();
+    auto& cf = _shard_manager.local_storage_proxy().get_db().local().find_column_family(fm.column_family_id());
+
+    if (cer.get_column_mapping()) {
+        _column_mappings.emplace(fm.schema_version(), *cer.get_column_mapping());
+    }
+
+    if (cf.schema()->version() == fm.schema_version()) {
+        return fm.unfreeze(cf.schema());
+    }
+
+    auto cm_it = _column_mappings.find(fm.schema_version());
+    if (cm_it == _column_mappings.end()) {
+        throw std::runtime_error(sprint("unknown schema version %s", fm.schema_version()));
+    }
+
+    mutation m(fm.decorated_key(*cf.schema()), cf.schema());
+    converting_mutation_partition_applier v(cm_it->second, *cf.schema(), m.partition());
+    fm.partition().accept(cm_it->second, v);
+    return m;
+}
+
+future<> manager::end_point_hints_manager::send_one_hint(temporary_buffer<char> buf, lw_shared_ptr<bool> ok) {
+    return get_units(_send_limiter, 1).then([this, buf = std::move(buf), ok] (auto units) mutable {
+        size_t size = buf.size();
+        stdx::optional<mutation> m;
+        try {
+            commitlog_entry_reader cer(buf);
+            m = get_mutation(cer);
+        } catch (no_such_column_family&) {
+            manager_logger.debug("Discarding a hint to {}: table was dropped", _key);
+            ++_shard_manager._stats.discarded;
+            return make_ready_future<>();
+        } catch (...) {
+            manager_logger.warn("Discarding a hint to {}: {}", _key, std::current_exception());
+            ++_shard_manager._stats.discarded;
+            return make_ready_future<>();
+        }
+
+        return _shard_manager.throttle(size).then([this, ok, m = std::move(*m), units = std::move(units)] () mutable {
+            // Sent in the background; send_one_file() waits for all the
+            // in-flight hints by draining _send_limiter.
+            _shard_manager.local_storage_proxy().send_to_endpoint(std::move(m), _key, db::write_type::SIMPLE).then_wrapped([this, ok, units = std::move(units)] (future<> f) {
+                try {
+                    f.get();
+                    ++_shard_manager._stats.sent;
+                } catch (...) {
+                    manager_logger.debug("Failed to send a hint to {}: {}", _key, std::current_exception());
+                    ++_shard_manager._stats.errors;
+                    *ok = false;
+                }
+            });
+        });
+    });
+}
+
+// Returns true if all the hints in the file were handled.
+future<bool> manager::end_point_hints_manager::send_one_file(sstring fname) {
+    auto ok = make_lw_shared<bool>(true);
+
+    return commitlog::read_log_file(fname, [this, ok] (temporary_buffer<char> buf, db::replay_position rp) {
+        if (!*ok || !can_send()) {
+            *ok = false;
+            return make_ready_future<>();
+        }
+        return send_one_hint(std::move(buf), ok);
+    }).then([] (auto s) {
+        auto f = s->done();
+        return f.finally([s = std::move(s)] {});
+    }).then_wrapped([this, ok, fname] (future<> f) {
+        try {
+            f.get();
+        } catch (commitlog::segment_data_corruption_error& e) {
+            // The readable part of the segment was sent; the rest is lost.
+            manager_logger.warn("Hints segment {} is corrupted ({} bytes lost)", fname, e.bytes());
+        } catch (...) {
+            manager_logger.warn("Failed to read hints segment {}: {}", fname, std::current_exception());
+            *ok = false;
+        }
+        return get_units(_send_limiter, max_hints_send_queue_length).then([ok] (auto units) {
+            return *ok;
+        });
+    });
+}
+
+future<> manager::end_point_hints_manager::truncate() {
+    return with_lock(_file_update_mutex.for_write(), [this] {
+        return close_store().then([this] {
+            return populate_segments_to_replay();
+        }).then([this] {
+            auto segments = std::move(_segments_to_replay);
+            _segments_to_replay.clear();
+            return do_with(std::move(segments), [] (std::list<sstring>& segments) {
+                return parallel_for_each(segments, [] (const sstring& fname) {
+                    return remove_file(fname);
+                });
+            });
+        });
+    });
+}
+
+future<> manager::end_point_hints_manager::stop() {
+    return with_lock(_file_update_mutex.for_write(), [this] {
+        return close_store();
+    });
+}
+
+}
+}
@@ -0,0 +1,236 @@
+/*
+ * Copyright (C) 2017 ScyllaDB
+ */
+
+/*
+ * This file is part of Scylla.
+ *
+ * Scylla is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Scylla is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <unordered_map>
+#include <list>
+#include <chrono>
+#include <seastar/core/gate.hh>
+#include <seastar/core/rwlock.hh>
+#include <seastar/core/semaphore.hh>
+#include <seastar/core/shared_future.hh>
+#include <seastar/core/timer.hh>
+#include <seastar/core/metrics_registration.hh>
+#include "gms/inet_address.hh"
+#include "db/commitlog/commitlog.hh"
+#include "frozen_mutation.hh"
+#include "schema.hh"
+#include "stdx.hh"
+#include "seastarx.hh"
+
+namespace service {
+class storage_proxy;
+}
+
+namespace db {
+namespace hints {
+
+/*
+ * Per-shard hinted handoff manager.
+ *
+ * Mutations that could not be delivered to a replica (the replica is known
+ * to be down, or the write to it timed out) are appended to a per-endpoint
+ * hints log. The log reuses the commitlog segment machinery, one commitlog
+ * instance per destination, stored in <hints_directory>/<shard>/<endpoint>.
+ *
+ * Every hints_flush_period the active segments of each endpoint are closed
+ * and, if the failure detector reports the endpoint as alive, the closed
+ * segments are replayed to it, throttled to hinted_handoff_throttle_in_kb.
+ * A segment is removed once all of its hints were delivered; a segment that
+ * failed to be delivered completely is retried on the next round.
+ *
+ * storage_proxy keeps a second manager for the view updates which couldn't be
+ * applied to their paired replica, in their own directory.
+ */
+class manager {
+public:
+    using ep_key_type = gms::inet_address;
+    using clock_type = lowres_clock;
+
+    struct stats {
+        uint64_t size_of_hints_in_progress = 0;
+        uint64_t written = 0;
+        uint64_t errors = 0;
+        uint64_t dropped = 0;
+        uint64_t sent = 0;
+        uint64_t discarded = 0;
+    };
+
+    struct endpoint_stats {
+        uint64_t created = 0;
+        uint64_t not_stored = 0;
+    };
+
+    static const std::chrono::seconds hints_flush_period;
+    // Bound on the memory held by hints which are still being written.
+    static constexpr size_t max_size_of_hints_in_progress = 10 * 1024 * 1024;
+    // Maximum number of hints being sent concurrently to a single endpoint.
+    static constexpr size_t max_hints_send_queue_length = 128;
+    static constexpr uint64_t hints_segment_size_in_mb = 32;
+    static constexpr uint64_t max_hints_per_ep_size_in_mb = 128;
+
+private:
+    class end_point_hints_manager {
+        ep_key_type _key;
+        manager& _shard_manager;
+        sstring _hints_dir;
+        std::unique_ptr<commitlog> _hints_store;
+        stdx::optional<shared_future<>> _store_loading;
+        // Held for read while hints are appended, for write while the
+        // active segments are being closed or removed.
+        seastar::rwlock _file_update_mutex;
+        std::list<sstring> _segments_to_replay;
+        std::unordered_map<table_schema_version, column_mapping> _column_mappings;
+        semaphore _send_limiter{max_hints_send_queue_length};
+        uint64_t _hints_in_progress = 0;
+        uint64_t _hints_since_flush = 0;
+        bool _busy = false;
+        endpoint_stats _stats;
+    public:
+        end_point_hints_manager(const ep_key_type& key, manager& shard_manager);
+        end_point_hints_manager(end_point_hints_manager&&) = delete;
+
+        const ep_key_type& end_point_key() const noexcept {
+            return _key;
+        }
+
+        uint64_t hints_in_progress() const noexcept {
+            return _hints_in_progress;
+        }
+
+        const endpoint_stats& get_stats() const noexcept {
+            return _stats;
+        }
+
+        bool has_pending_hints() const noexcept {
+            return _hints_in_progress || _hints_since_flush || !_segments_to_replay.empty();
+        }
+
+        bool busy() const noexcept {
+            return _busy;
+        }
+
+        // Appends the hint to the endpoint's log in the background.
+        // Throws if the manager is being stopped.
+        void store_hint(schema_ptr s, lw_shared_ptr<const frozen_mutation> fm);
+
+        // Closes the active segments and replays all closed ones, if the
+        // endpoint can currently receive them.
+        future<> flush_and_send();
+
+        // Drops all hints stored for this endpoint.
+        future<> truncate();
+
+        future<> stop();
+    private:
+        future<> get_or_load();
+        future<> close_store();
+        future<> flush_current_hints();
+        future<> populate_segments_to_replay();
+        future<> send_hints();
+        future<bool> send_one_file(sstring fname);
+        future<> send_one_hint(temporary_buffer<char> buf, lw_shared_ptr<bool> ok);
+        mutation get_mutation(const commitlog_entry_reader& cer);
+        bool can_send() const noexcept;
+        commitlog::config make_commitlog_config() const;
+    };
+
+    using ep_managers_map_type = std::unordered_map<ep_key_type, end_point_hints_manager>;
+
+    sstring _hints_dir;
+    uint64_t _max_hint_window_us;
+    uint64_t _throttle_bytes_per_sec;
+    shared_ptr<service::storage_proxy> _proxy_anchor;
+    ep_managers_map_type _ep_managers;
+    stats _stats;
+    timer<clock_type> _timer;
+    seastar::gate _hints_write_gate;
+    seastar::gate _hints_flush_gate;
+    bool _started = false;
+    bool _stopping = false;
+    bool _delivery_paused = false;
+    // Send throttling state, shared by all endpoints of this shard.
+    clock_type::time_point _throttle_start;
+    uint64_t _throttled_bytes = 0;
+    seastar::metrics::metric_groups _metrics;
+
+public:
+    manager(sstring hints_directory, uint32_t max_hint_window_ms, uint32_t throttle_in_kb, sstring metrics_group = "hints_manager");
+    manager(manager&&) = delete;
+    ~manager();
+
+    future<> start(shared_ptr<service::storage_proxy> proxy_ptr);
+    future<> stop();
+
+    bool started() const noexcept {
+        return _started && !_stopping;
+    }
+
+    // Returns true if a hint should be generated for the given endpoint:
+    // it hasn't been down longer than max_hint_window_in_ms and we are not
+    // holding too many hints in memory already.
+    bool can_hint_for(ep_key_type ep) const noexcept;
+
+    // Stores a hint for the given endpoint in the background.
+    // Returns false if the hint was dropped.
+    bool store_hint(ep_key_type ep, schema_ptr s, lw_shared_ptr<const frozen_mutation> fm) noexcept;
+
+    // Triggers immediate hints delivery to the given endpoint, or to all
+    // endpoints if none is given.
+    void schedule_delivery(stdx::optional<ep_key_type> ep = {});
+
+    void pause_delivery(bool pause) noexcept {
+        _delivery_paused = pause;
+    }
+
+    future<> truncate_hints(stdx::optional<ep_key_type> ep = {});
+
+    std::vector<ep_key_type> endpoints_pending_hints() const;
+    endpoint_stats get_endpoint_stats(ep_key_type ep) const;
+
+    const stats& get_stats() const noexcept {
+        return _stats;
+    }
+
+    uint64_t size_of_hints_in_progress() const noexcept {
+        return _stats.size_of_hints_in_progress;
+    }
+
+private:
+    const sstring& hints_dir() const noexcept {
+        return _hints_dir;
+    }
+
+    service::storage_proxy& local_storage_proxy() const noexcept {
+        return *_proxy_anchor;
+    }
+
+    end_point_hints_manager& get_ep_manager(ep_key_type ep);
+    future<> load_existing_endpoints();
+    void on_timer();
+    // Delays the sender so that hints are delivered at no more than
+    // _throttle_bytes_per_sec.
+    future<> throttle(size_t bytes);
+};
+
+}
+}
@@ -45,4 +45,5 @@ const sstring db::index::secondary_index::custom_index_option_name = "class_name
 const sstring db::index::secondary_index::index_keys_option_name = "index_keys";
 const sstring db::index::secondary_index::index_values_option_name = "index_values";
 const sstring db::index::secondary_index::index_entries_option_name = "index_keys_and_values";
+const sstring db::index::secondary_index::local_index_option_name = "local";
 
@@ -71,6 +71,11 @@ class secondary_index {
      */
     static const sstring index_entries_option_name;
 
+    /**
+     * The name of the option set on local indexes, which are partitioned like their table.
+     */
+    static const sstring local_index_option_name;
+
 #if 0 // TODO:
 
     public static final AbstractType<?> keyComparator = StorageService.getPartitioner().preservesOrder()
@@ -0,0 +1,235 @@
+/*
+ * Copyright (C) 2017 ScyllaDB
+ */
+
+/*
+ * This file is part of Scylla.
+ *
+ * Scylla is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Scylla is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <boost/algorithm/string/predicate.hpp>
+#include <seastar/core/fstream.hh>
+#include <seastar/core/reactor.hh>
+#include <seastar/core/thread.hh>
+#include "db/row_cache_saver.hh"
+#include "service/priority_manager.hh"
+#include "utils/data_input.hh"
+#include "utils/data_output.hh"
+#include "database.hh"
+#include "lister.hh"
+#include "log.hh"
+
+namespace db {
+
+static logging::logger rcslogger("row_cache_saver");
+
+distributed<row_cache_saver> _the_row_cache_saver;
+
+// File layout: magic, version, count, then count * (table id, key blob).
+static constexpr uint32_t saved_cache_magic = 0x53524331; // "SRC1"
+static constexpr uint32_t saved_cache_version = 1;
+static const sstring saved_cache_prefix = "row_cache-";
+static const sstring saved_cache_suffix = ".db";
+
+row_cache_saver::row_cache_saver(database& db)
+    : _db(db)
+    , _dir(db.get_config().saved_caches_directory())
+    , _keys_to_save(db.get_config().row_cache_keys_to_save() ? db.get_config().row_cache_keys_to_save() : default_keys_to_save)
+    , _save_period(db.get_config().row_cache_save_period())
+    , _timer([this] { on_timer(); })
+{ }
+
+sstring row_cache_saver::file_name(unsigned shard) const {
+    return sprint("%s/%s%d%s", _dir, saved_cache_prefix, shard, saved_cache_suffix);
+}
+
+future<> row_cache_saver::start() {
+    return recursive_touch_directory(_dir).then([this] {
+        // Don't delay the boot, the node can serve reads from sstables meanwhile.
+        with_gate(_gate, [this] {
+            return load();
+        });
+        if (_save_period.count()) {
+            _timer.arm(_save_period);
+        }
+    }).handle_exception([this] (auto ep) {
+        rcslogger.warn("Cannot use saved caches directory {}: {}", _dir, ep);
+    });
+}
+
+future<> row_cache_saver::stop() {
+    _stopping = true;
+    _timer.cancel();
+    return _gate.close().then([this] {
+        // Keep the saved keys fresh across a rolling restart.
+        if (_save_period.count()) {
+            return save();
+        }
+        return make_ready_future<>();
+    });
+}
+
+void row_cache_saver::on_timer() {
+    with_gate(_gate, [this] {
+        return save();
+    }).finally([this] {
+        if (!_stopping) {
+            _timer.arm(_save_period);
+        }
+    });
+}
+
+future<> row_cache_saver::save() {
+    auto keys = global_cache_tracker().hottest_partitions(_keys_to_save);
+    auto buf = with_linearized_managed_bytes([&] {
+        size_t size = 3 * sizeof(uint32_t);
+        for (auto&& k : keys) {
+            size += 2 * sizeof(int64_t) + data_output::serialized_size(k.second.view().representation());
+        }
+        temporary_buffer<char> buf(size);
+        data_output out(buf.get_write(), size);
+        out.write(saved_cache_magic);
+        out.write(saved_cache_version);
+        out.write(uint32_t(keys.size()));
+        for (auto&& k : keys) {
+            out.write(k.first.get_most_significant_bits());
+            out.write(k.first.get_least_significant_bits());
+            out.write(k.second.view().representation());
+        }
+        return buf;
+    });
+
+    // Write to a temporary file and rename it, so that a crash never leaves a truncated file behind.
+    auto final_name = file_name(engine().cpu_id());
+    auto tmp_name = final_name + ".tmp";
+    auto nr_keys = keys.size();
+    return open_file_dma(tmp_name, open_flags::wo | open_flags::create | open_flags::truncate).then([buf = std::move(buf)] (file f) mutable {
+        file_output_stream_options options;
+        options.io_priority_class = service::get_local_streaming_write_priority();
+        return do_with(make_file_output_stream(std::move(f), options), std::move(buf), [] (output_stream<char>& out, temporary_buffer<char>& buf) {
+            return out.write(buf.get(), buf.size()).then([&out] {
+                return out.flush();
+            }).finally([&out] {
+                return out.close();
+            });
+        });
+    }).then([tmp_name, final_name] {
+        return rename_file(tmp_name, final_name);
+    }).then([this] {
+        return sync_directory(_dir);
+    }).then([final_name, nr_keys] {
+        rcslogger.debug("Saved {} keys to {}", nr_keys, final_name);
+    }).handle_exception([final_name] (auto ep) {
+        rcslogger.warn("Failed to save row cache keys to {}: {}", final_name, ep);
+    });
+}
+
+future<std::vector<std::pair<utils::UUID, partition_key>>> row_cache_saver::read_keys(sstring fname) {
+    return open_file_dma(fname, open_flags::ro).then([] (file f) {
+        return do_with(std::move(f), [] (file& f) {
+            return f.size().then([&f] (uint64_t size) {
+                return f.dma_read_exactly<char>(0, size, service::get_local_streaming_read_priority());
+            }).finally([&f] {
+                return f.close();
+            });
+        });
+    }).then([fname] (temporary_buffer<char> buf) {
+        std::vector<std::pair<utils::UUID, partition_key>> keys;
+        data_input in(buf);
+        if (in.read<uint32_t>() != saved_cache_magic || in.read<uint32_t>() != saved_cache_version) {
+            throw std::runtime_error("unrecognized file format");
+        }
+        auto count = in.read<uint32_t>();
+        keys.reserve(count);
+        while (count--) {
+            auto msb = in.read<int64_t>();
+            auto lsb = in.read<int64_t>();
+            keys.emplace_back(utils::UUID(msb, lsb), partition_key::from_bytes(to_bytes(in.read_view_to_blob<uint32_t>())));
+        }
+        return keys;
+    });
+}
+
+future<> row_cache_saver::populate(const utils::UUID& table_id, const partition_key& key) {
+    column_family* cf;
+    try {
+        cf = &_db.find_column_family(table_id);
+    } catch (no_such_column_family&) {
+        return make_ready_future<>();
+    }
+    auto s = cf->schema();
+    auto dk = dht::global_partitioner().decorate_key(*s, key);
+    if (dht::shard_of(dk.token()) != engine().cpu_id()) {
+        return make_ready_future<>();
+    }
+    auto range = make_lw_shared<dht::partition_range>(dht::partition_range::make_singular(std::move(dk)));
+    auto reader = cf->make_reader(s, *range, s->full_slice(), service::get_local_streaming_read_priority());
+    return do_with(std::move(reader), [this, range] (mutation_reader& reader) {
+        return reader().then([this] (streamed_mutation_opt smopt) {
+            if (!smopt) {
+                return make_ready_future<>();
+            }
+            ++_loaded;
+            return do_with(std::move(*smopt), [] (streamed_mutation& sm) {
+                return repeat([&sm] {
+                    while (!sm.is_buffer_empty()) {
+                        sm.pop_mutation_fragment();
+                    }
+                    if (sm.is_end_of_stream()) {
+                        return make_ready_future<stop_iteration>(stop_iteration::yes);
+                    }
+                    return sm.fill_buffer().then([] { return stop_iteration::no; });
+                });
+            });
+        });
+    });
+}
+
+future<> row_cache_saver::load() {
+    return seastar::async([this] {
+        std::vector<sstring> files;
+        lister::scan_dir(_dir, { directory_entry_type::regular }, [&files] (lister::path dir, directory_entry de) {
+            files.push_back((dir / de.name.c_str()).native());
+            return make_ready_future<>();
+        }, [] (const lister::path&, const directory_entry& de) {
+            return boost::starts_with(de.name, saved_cache_prefix) && boost::ends_with(de.name, saved_cache_suffix);
+        }).get();
+
+        for (auto&& fname : files) {
+            std::vector<std::pair<utils::UUID, partition_key>> keys;
+            try {
+                keys = read_keys(fname).get0();
+            } catch (...) {
+                rcslogger.warn("Ignoring saved cache file {}: {}", fname, std::current_exception());
+                continue;
+            }
+            for (auto&& k : keys) {
+                if (_stopping) {
+                    return;
+                }
+                try {
+                    populate(k.first, k.second).get();
+                } catch (...) {
+                    rcslogger.warn("Failed to load a saved key of table {} from {}: {}", k.first, fname, std::current_exception());
+                }
+            }
+        }
+        rcslogger.info("Loaded {} partitions into row cache from {}", _loaded, _dir);
+    }).handle_exception([this] (auto ep) {
+        rcslogger.warn("Failed to load saved row cache keys from {}: {}", _dir, ep);
+    });
+}
+
+}
@@ -0,0 +1,88 @@
+/*
+ * Copyright (C) 2017 ScyllaDB
+ */
+
+/*
+ * This file is part of Scylla.
+ *
+ * Scylla is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Scylla is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <seastar/core/distributed.hh>
+#include <seastar/core/gate.hh>
+#include <seastar/core/timer.hh>
+#include "keys.hh"
+#include "utils/UUID.hh"
+#include "seastarx.hh"
+
+class database;
+
+namespace db {
+
+/*
+ * Per-shard saver of the row cache contents, for warm restarts.
+ *
+ * Every row_cache_save_period seconds the keys of the row_cache_keys_to_save
+ * most recently used partitions of this shard are written to
+ * <saved_caches_directory>/row_cache-<shard>.db. Only keys are saved.
+ *
+ * On start, all saved files are read by every shard, which reads the
+ * partitions it owns through the cache in the background, at streaming
+ * priority. Since each shard picks its own keys, files saved with a
+ * different shard count are still useful.
+ */
+class row_cache_saver {
+public:
+    using clock_type = lowres_clock;
+    // Saved when row_cache_keys_to_save is 0.
+    static constexpr size_t default_keys_to_save = 100000;
+private:
+    database& _db;
+    sstring _dir;
+    size_t _keys_to_save;
+    std::chrono::seconds _save_period;
+    timer<clock_type> _timer;
+    seastar::gate _gate;
+    bool _stopping = false;
+    uint64_t _loaded = 0;
+public:
+    explicit row_cache_saver(database& db);
+
+    // Starts loading saved keys in the background and arms the periodic save.
+    future<> start();
+    future<> stop();
+
+    // Writes keys of the hottest cached partitions of this shard.
+    future<> save();
+private:
+    sstring file_name(unsigned shard) const;
+    future<> load();
+    future<std::vector<std::pair<utils::UUID, partition_key>>> read_keys(sstring fname);
+    future<> populate(const utils::UUID& table_id, const partition_key& key);
+    void on_timer();
+};
+
+extern distributed<row_cache_saver> _the_row_cache_saver;
+
+inline distributed<row_cache_saver>& get_row_cache_saver() {
+    return _the_row_cache_saver;
+}
+
+inline row_cache_saver& get_local_row_cache_saver() {
+    return _the_row_cache_saver.local();
+}
+
+}
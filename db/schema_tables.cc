@@ -64,8 +64,12 @@
 #include "db/config.hh"
 #include "md5_hasher.hh"
 
+#include <unordered_set>
 #include <boost/algorithm/string/predicate.hpp>
 #include <boost/range/algorithm/copy.hpp>
+#include <boost/range/algorithm/sort.hpp>
+#include <boost/range/adaptor/transformed.hpp>
+#include <boost/range/irange.hpp>
 #include <boost/range/adaptor/map.hpp>
 #include <boost/range/join.hpp>
 
@@ -528,41 +532,153 @@ schema_ptr aggregates() {
     }
 #endif
 
+/*
+ * The partitions of the schema tables the schema digest is computed from,
+ * by schema table and keyspace, so that only the partitions of the
+ * keyspaces a merge changed are read again when it is recomputed.
+ *
+ * Keyspaces are marked dirty once the mutations changing them were
+ * applied, and the dirty ones are taken before their partitions are read,
+ * so a keyspace changed while the digest is computed is read again by the
+ * next computation.
+ */
+class schema_digest_cache {
+    // By schema table, in the order of ALL.
+    std::vector<std::map<sstring, mutation>> _partitions;
+    std::set<sstring> _dirty;
+    bool _all_dirty = true;
+    // Serializes the computations of the digest.
+    semaphore _lock{1};
+public:
+    semaphore& lock() {
+        return _lock;
+    }
+    void mark_dirty(const std::set<sstring>& keyspaces) {
+        for (auto&& keyspace_name : keyspaces) {
+            if (!is_system_keyspace(keyspace_name)) {
+                _dirty.insert(keyspace_name);
+            }
+        }
+    }
+    void mark_all_dirty() {
+        _all_dirty = true;
+    }
+    bool all_dirty() const {
+        return _all_dirty;
+    }
+    std::set<sstring> take_dirty() {
+        _all_dirty = false;
+        return std::exchange(_dirty, { });
+    }
+    std::vector<std::map<sstring, mutation>>& partitions() {
+        return _partitions;
+    }
+};
+
+static thread_local schema_digest_cache the_schema_digest_cache;
+
+static void mark_schema_digest_dirty(const std::set<sstring>& keyspaces) {
+    smp::invoke_on_all([keyspaces] {
+        the_schema_digest_cache.mark_dirty(keyspaces);
+    }).get();
+}
+
+static sstring keyspace_of(const schema& s, const mutation& m) {
+    return value_cast<sstring>(utf8_type->deserialize(m.key().get_component(s, 0)));
+}
+
+// Reads every partition of the schema table, but those of the system keyspaces.
+static future<std::map<sstring, mutation>> read_schema_table_partitions(distributed<service::storage_proxy>& proxy, const sstring& table) {
+    return db::system_keyspace::query_mutations(proxy, NAME, table).then([&proxy, table] (auto rs) {
+        auto s = proxy.local().get_db().local().find_schema(NAME, table);
+        std::map<sstring, mutation> partitions;
+        for (auto&& p : rs->partitions()) {
+            auto mut = p.mut().unfreeze(s);
+            auto keyspace_name = keyspace_of(*s, mut);
+            if (is_system_keyspace(keyspace_name)) {
+                continue;
+            }
+            partitions.emplace(std::move(keyspace_name), std::move(mut));
+        }
+        return partitions;
+    });
+}
+
+// Reads the partition of the keyspace in the schema table, as
+// read_schema_table_partitions() would.
+static future<stdx::optional<mutation>> read_schema_table_partition(distributed<service::storage_proxy>& proxy, const sstring& table, const sstring& keyspace_name) {
+    auto s = proxy.local().get_db().local().find_schema(NAME, table);
+    auto slice = partition_slice_builder(*s).build();
+    auto cmd = make_lw_shared<query::read_command>(s->id(), s->version(), std::move(slice), std::numeric_limits<uint32_t>::max());
+    auto dk = dht::global_partitioner().decorate_key(*s, partition_key::from_singular(*s, keyspace_name));
+    return do_with(dht::partition_range::make_singular(std::move(dk)), [&proxy, s, cmd] (auto& range) {
+        return proxy.local().query_mutations_locally(s, cmd, range).then([s] (foreign_ptr<lw_shared_ptr<reconcilable_result>> rr, cache_temperature) {
+            auto&& partitions = rr->partitions();
+            if (partitions.empty()) {
+                return stdx::optional<mutation>();
+            }
+            return stdx::make_optional(partitions.begin()->mut().unfreeze(s));
+        });
+    });
+}
+
 /**
  * Read schema from system keyspace and calculate MD5 digest of every row, resulting digest
  * will be converted into UUID which would act as content-based version of the schema.
+ *
+ * The partitions of the keyspaces which didn't change since the last time
+ * are not read again.
  */
 future<utils::UUID> calculate_schema_digest(distributed<service::storage_proxy>& proxy)
 {
-    auto map = [&proxy] (sstring table) {
-        return db::system_keyspace::query_mutations(proxy, NAME, table).then([&proxy, table] (auto rs) {
-            auto s = proxy.local().get_db().local().find_schema(NAME, table);
-            std::vector<mutation> mutations;
-            for (auto&& p : rs->partitions()) {
-                auto mut = p.mut().unfreeze(s);
-                auto partition_key = value_cast<sstring>(utf8_type->deserialize(mut.key().get_component(*s, 0)));
-                if (is_system_keyspace(partition_key)) {
-                    continue;
-                }
-                mutations.emplace_back(std::move(mut));
-            }
-            return mutations;
+  auto& cache = the_schema_digest_cache;
+  return with_semaphore(cache.lock(), 1, [&proxy, &cache] {
+    auto f = make_ready_future<>();
+    if (cache.all_dirty()) {
+        cache.take_dirty();
+        f = do_with(std::vector<std::map<sstring, mutation>>(), [&proxy, &cache] (auto& partitions) {
+            return do_for_each(ALL.begin(), ALL.end(), [&proxy, &partitions] (const char* table) {
+                return read_schema_table_partitions(proxy, table).then([&partitions] (std::map<sstring, mutation> p) {
+                    partitions.emplace_back(std::move(p));
+                });
+            }).then([&cache, &partitions] {
+                cache.partitions() = std::move(partitions);
+            });
         });
-    };
-    auto reduce = [] (auto& hash, auto&& mutations) {
-        for (const mutation& m : mutations) {
-            feed_hash_for_schema_digest(hash, m);
-        }
-    };
-    return do_with(md5_hasher(), [map, reduce] (auto& hash) {
-        return do_for_each(ALL.begin(), ALL.end(), [&hash, map, reduce] (auto& table) {
-            return map(table).then([&hash, reduce] (auto&& mutations) {
-                reduce(hash, mutations);
+    } else {
+        f = do_with(cache.take_dirty(), [&proxy, &cache] (const std::set<sstring>& keyspaces) {
+            return do_for_each(boost::irange<size_t>(0, ALL.size()), [&proxy, &cache, &keyspaces] (size_t i) {
+                return do_for_each(keyspaces, [&proxy, &cache, i] (const sstring& keyspace_name) {
+                    return read_schema_table_partition(proxy, ALL[i], keyspace_name).then([&cache, i, &keyspace_name] (stdx::optional<mutation> m) {
+                        auto& partitions = cache.partitions()[i];
+                        partitions.erase(keyspace_name);
+                        if (m) {
+                            partitions.emplace(keyspace_name, std::move(*m));
+                        }
+                    });
+                });
             });
-        }).then([&hash] {
-            return make_ready_future<utils::UUID>(utils::UUID_gen::get_name_UUID(hash.finalize()));
         });
+    }
+    return f.then([&cache] {
+        md5_hasher hash;
+        for (auto&& partitions : cache.partitions()) {
+            // In ring order, as a scan of the table returns them.
+            auto ms = boost::copy_range<std::vector<const mutation*>>(partitions | boost::adaptors::map_values
+                    | boost::adaptors::transformed([] (const mutation& m) { return &m; }));
+            boost::sort(ms, [] (const mutation* a, const mutation* b) {
+                return a->decorated_key().less_compare(*a->schema(), b->decorated_key());
+            });
+            for (const mutation* m : ms) {
+                feed_hash_for_schema_digest(hash, *m);
+            }
+        }
+        return utils::UUID_gen::get_name_UUID(hash.finalize());
+    }).handle_exception([&cache] (std::exception_ptr ep) {
+        cache.mark_all_dirty();
+        return make_exception_future<utils::UUID>(std::move(ep));
     });
+  });
 }
 
 future<std::vector<frozen_mutation>> convert_schema_to_mutations(distributed<service::storage_proxy>& proxy)
@@ -734,14 +850,59 @@ static read_table_names_of_keyspace(distributed<service::storage_proxy>& proxy,
     });
 }
 
+// The tables and views which schema mutations may change, by keyspace. A
+// keyspace maps to nullopt when any of its tables may change.
+using affected_tables = std::map<sstring, stdx::optional<std::set<sstring>>>;
+
+// Whether the rows of the schema table are of one table or view each, the
+// name of which is the first component of their clustering key.
+static bool is_per_table_schema_table(const schema& s) {
+    static const std::unordered_set<sstring> names = { TABLES, SCYLLA_TABLES, COLUMNS, DROPPED_COLUMNS, TRIGGERS, VIEWS, INDEXES };
+    return names.count(s.cf_name());
+}
+
+static void add_affected_tables(affected_tables& affected, const sstring& keyspace_name, const mutation& m) {
+    auto it = affected.emplace(keyspace_name, std::set<sstring>()).first;
+    auto& tables = it->second;
+    if (!tables || !is_per_table_schema_table(*m.schema())) {
+        return;
+    }
+    auto& p = m.partition();
+    auto table_name = [&m] (const clustering_key_prefix& ck) -> stdx::optional<sstring> {
+        if (ck.is_empty(*m.schema())) {
+            return { };
+        }
+        return value_cast<sstring>(utf8_type->deserialize(*ck.begin(*m.schema())));
+    };
+    if (p.partition_tombstone()) {
+        tables = { };
+        return;
+    }
+    for (auto&& rt : p.row_tombstones()) {
+        auto start = table_name(rt.start);
+        if (!start || start != table_name(rt.end)) {
+            tables = { };
+            return;
+        }
+        tables->emplace(std::move(*start));
+    }
+    for (auto&& row : p.clustered_rows()) {
+        tables->emplace(*table_name(row.key()));
+    }
+}
+
 // Call inside a seastar thread
 static
 std::map<qualified_name, schema_mutations>
-read_tables_for_keyspaces(distributed<service::storage_proxy>& proxy, const std::set<sstring>& keyspace_names, schema_ptr s)
+read_tables_for_keyspaces(distributed<service::storage_proxy>& proxy, const affected_tables& affected, schema_ptr s)
 {
     std::map<qualified_name, schema_mutations> result;
-    for (auto&& keyspace_name : keyspace_names) {
+    for (auto&& e : affected) {
+        auto& keyspace_name = e.first;
         for (auto&& table_name : read_table_names_of_keyspace(proxy, keyspace_name, s).get0()) {
+            if (e.second && !e.second->count(table_name)) {
+                continue;
+            }
             auto qn = qualified_name(keyspace_name, table_name);
             result.emplace(qn, read_table_mutations(proxy, qn, s).get0());
         }
@@ -780,11 +941,16 @@ static future<> do_merge_schema(distributed<service::storage_proxy>& proxy, std:
 {
    return seastar::async([&proxy, mutations = std::move(mutations), do_flush] () mutable {
        schema_ptr s = keyspaces();
-       // compare before/after schemas of the affected keyspaces only
+       // compare before/after schemas of the affected keyspaces only, and
+       // of the tables of them the mutations are to, so that the cost of a
+       // change doesn't grow with the number of tables.
        std::set<sstring> keyspaces;
+       affected_tables affected;
        std::set<utils::UUID> column_families;
        for (auto&& mutation : mutations) {
-           keyspaces.emplace(value_cast<sstring>(utf8_type->deserialize(mutation.key().get_component(*s, 0))));
+           auto keyspace_name = value_cast<sstring>(utf8_type->deserialize(mutation.key().get_component(*s, 0)));
+           add_affected_tables(affected, keyspace_name, mutation);
+           keyspaces.emplace(std::move(keyspace_name));
            column_families.emplace(mutation.column_family_id());
            // We must force recalculation of schema version after the merge, since the resulting
            // schema may be a mix of the old and new schemas.
@@ -793,9 +959,9 @@ static future<> do_merge_schema(distributed<service::storage_proxy>& proxy, std:
 
        // current state of the schema
        auto&& old_keyspaces = read_schema_for_keyspaces(proxy, KEYSPACES, keyspaces).get0();
-       auto&& old_column_families = read_tables_for_keyspaces(proxy, keyspaces, tables());
+       auto&& old_column_families = read_tables_for_keyspaces(proxy, affected, tables());
        auto&& old_types = read_schema_for_keyspaces(proxy, TYPES, keyspaces).get0();
-       auto&& old_views = read_tables_for_keyspaces(proxy, keyspaces, views());
+       auto&& old_views = read_tables_for_keyspaces(proxy, affected, views());
 #if 0 // not in 2.1.8
        /*auto& old_functions = */read_schema_for_keyspaces(proxy, FUNCTIONS, keyspaces).get0();
        /*auto& old_aggregates = */read_schema_for_keyspaces(proxy, AGGREGATES, keyspaces).get0();
@@ -811,6 +977,7 @@ static future<> do_merge_schema(distributed<service::storage_proxy>& proxy, std:
        }
 
        proxy.local().mutate_locally(std::move(mutations)).get0();
+       mark_schema_digest_dirty(keyspaces);
 
        if (do_flush) {
            proxy.local().get_db().invoke_on_all([s, cfs = std::move(column_families)] (database& db) {
@@ -823,9 +990,9 @@ static future<> do_merge_schema(distributed<service::storage_proxy>& proxy, std:
 
        // with new data applied
        auto&& new_keyspaces = read_schema_for_keyspaces(proxy, KEYSPACES, keyspaces).get0();
-       auto&& new_column_families = read_tables_for_keyspaces(proxy, keyspaces, tables());
+       auto&& new_column_families = read_tables_for_keyspaces(proxy, affected, tables());
        auto&& new_types = read_schema_for_keyspaces(proxy, TYPES, keyspaces).get0();
-       auto&& new_views = read_tables_for_keyspaces(proxy, keyspaces, views());
+       auto&& new_views = read_tables_for_keyspaces(proxy, affected, views());
 #if 0 // not in 2.1.8
        /*auto& new_functions = */read_schema_for_keyspaces(proxy, FUNCTIONS, keyspaces).get0();
        /*auto& new_aggregates = */read_schema_for_keyspaces(proxy, AGGREGATES, keyspaces).get0();
@@ -246,8 +246,18 @@ class size_estimates_mutation_reader final : public mutation_reader::impl {
 
     /**
      * Add a new range_estimates for the specified range, considering the sstables associated with `cf`.
+     * The estimate is kept by `cf` until its sstables change.
      */
     static system_keyspace::range_estimates estimate(const column_family& cf, const token_range& r) {
+        auto& cache = cf.get_size_estimates_cache();
+        auto it = cache.find(std::make_pair(r.start, r.end));
+        if (it == cache.end()) {
+            it = cache.emplace(std::make_pair(r.start, r.end), compute_estimate(cf, r)).first;
+        }
+        return {cf.schema(), r.start, r.end, it->second.partitions_count, it->second.mean_partition_size};
+    }
+
+    static column_family::size_estimate compute_estimate(const column_family& cf, const token_range& r) {
         int64_t count{0};
         utils::estimated_histogram hist{0};
         auto from_bytes = [] (auto& b) {
@@ -265,7 +275,7 @@ class size_estimates_mutation_reader final : public mutation_reader::impl {
                 hist.merge(sstable->get_stats_metadata().estimated_row_size);
             }
         }
-        return {cf.schema(), r.start, r.end, count, count > 0 ? hist.mean() : 0};
+        return {count, count > 0 ? hist.mean() : 0};
     }
 };
 
@@ -440,6 +440,72 @@ schema_ptr size_estimates() {
     return size_estimates;
 }
 
+schema_ptr scylla_views_builds_in_progress() {
+    static thread_local auto schema = [] {
+        schema_builder builder(make_lw_shared(::schema(generate_legacy_id(NAME, SCYLLA_VIEWS_BUILDS_IN_PROGRESS), NAME, SCYLLA_VIEWS_BUILDS_IN_PROGRESS,
+        // partition key
+        {{"keyspace_name", utf8_type}},
+        // clustering key
+        {{"view_name", utf8_type}, {"cpu_id", int32_type}},
+        // regular columns
+        {{"next_token", utf8_type}, {"done", boolean_type}},
+        // static columns
+        {},
+        // regular column name type
+        utf8_type,
+        // comment
+        "views builds current progress, per shard"
+       )));
+       builder.with_version(generate_schema_version(builder.uuid()));
+       return builder.build(schema_builder::compact_storage::no);
+    }();
+    return schema;
+}
+
+schema_ptr built_views() {
+    static thread_local auto schema = [] {
+        schema_builder builder(make_lw_shared(::schema(generate_legacy_id(NAME, BUILT_VIEWS), NAME, BUILT_VIEWS,
+        // partition key
+        {{"keyspace_name", utf8_type}},
+        // clustering key
+        {{"view_name", utf8_type}},
+        // regular columns
+        {},
+        // static columns
+        {},
+        // regular column name type
+        utf8_type,
+        // comment
+        "built views"
+       )));
+       builder.with_version(generate_schema_version(builder.uuid()));
+       return builder.build(schema_builder::compact_storage::no);
+    }();
+    return schema;
+}
+
+schema_ptr available_ranges() {
+    static thread_local auto schema = [] {
+        schema_builder builder(make_lw_shared(::schema(generate_legacy_id(NAME, AVAILABLE_RANGES), NAME, AVAILABLE_RANGES,
+        // partition key
+        {{"keyspace_name", utf8_type}},
+        // clustering key
+        {},
+        // regular columns
+        {{"ranges", set_type_impl::get_instance(bytes_type, true)}},
+        // static columns
+        {},
+        // regular column name type
+        utf8_type,
+        // comment
+        "ranges received by the bootstrap or rebuild in progress"
+       )));
+       builder.with_version(generate_schema_version(builder.uuid()));
+       return builder.build(schema_builder::compact_storage::no);
+    }();
+    return schema;
+}
+
 namespace v3 {
 
 schema_ptr batches() {
@@ -1072,9 +1138,13 @@ struct truncation_record {
 
 #include "idl/replay_position.dist.hh"
 #include "idl/truncation_record.dist.hh"
+#include "idl/token.dist.hh"
+#include "idl/range.dist.hh"
 #include "serializer_impl.hh"
 #include "idl/replay_position.dist.impl.hh"
 #include "idl/truncation_record.dist.impl.hh"
+#include "idl/token.dist.impl.hh"
+#include "idl/range.dist.impl.hh"
 
 namespace db {
 namespace system_keyspace {
@@ -1508,6 +1578,44 @@ future<> set_bootstrap_state(bootstrap_state state) {
     });
 }
 
+future<dht::token_range_vector> get_available_ranges(sstring ks_name) {
+    sstring req = sprint("SELECT ranges FROM system.%s WHERE keyspace_name = ?", AVAILABLE_RANGES);
+    return execute_cql(req, std::move(ks_name)).then([] (::shared_ptr<cql3::untyped_result_set> msg) {
+        dht::token_range_vector ranges;
+        if (msg->empty() || !msg->one().has("ranges")) {
+            return ranges;
+        }
+        auto blob = msg->one().get_blob("ranges");
+        auto cdef = available_ranges()->get_column_definition("ranges");
+        auto deserialized = value_cast<set_type_impl::native_type>(cdef->type->deserialize(blob));
+        ranges.reserve(deserialized.size());
+        for (auto& v : deserialized) {
+            ranges.push_back(ser::deserialize_from_buffer(value_cast<bytes>(v), boost::type<dht::token_range>()));
+        }
+        return ranges;
+    });
+}
+
+future<> update_available_ranges(sstring ks_name, const dht::token_range_vector& ranges) {
+    set_type_impl::native_type values;
+    values.reserve(ranges.size());
+    for (auto& r : ranges) {
+        values.push_back(data_value(ser::serialize_to_buffer<bytes>(r)));
+    }
+    sstring req = sprint("UPDATE system.%s SET ranges = ranges + ? WHERE keyspace_name = ?", AVAILABLE_RANGES);
+    auto set_type = set_type_impl::get_instance(bytes_type, true);
+    return execute_cql(req, make_set_value(set_type, std::move(values)), std::move(ks_name)).discard_result().then([] {
+        return force_blocking_flush(AVAILABLE_RANGES);
+    });
+}
+
+future<> reset_available_ranges(sstring ks_name) {
+    sstring req = sprint("DELETE FROM system.%s WHERE keyspace_name = ?", AVAILABLE_RANGES);
+    return execute_cql(req, std::move(ks_name)).discard_result().then([] {
+        return force_blocking_flush(AVAILABLE_RANGES);
+    });
+}
+
 future<bool>
 is_index_built(const sstring& ks_name, const sstring& index_name) {
     auto req = sprint("SELECT index_name FROM %s.\"%s\" WHERE table_name=? AND index_name=?", NAME, BUILT_INDEXES);
@@ -1532,6 +1640,50 @@ set_index_removed(const sstring& ks_name, const sstring& index_name) {
     });
 }
 
+schema_ptr large_partitions() {
+    static thread_local auto schema = [] {
+        schema_builder builder(make_lw_shared(::schema(generate_legacy_id(NAME, LARGE_PARTITIONS), NAME, LARGE_PARTITIONS,
+        // partition key
+        {{"keyspace_name", utf8_type}, {"table_name", utf8_type}},
+        // clustering key
+        {{"sstable_name", utf8_type}, {"partition_size", reversed_type_impl::get_instance(long_type)}, {"partition_key", utf8_type}},
+        // regular columns
+        {{"rows", long_type}, {"compaction_time", timestamp_type}},
+        // static columns
+        {},
+        // regular column name type
+        utf8_type,
+        // comment
+        "partitions larger than compaction_large_partition_warning_threshold_mb or with more rows than compaction_rows_count_warning_threshold"
+       )));
+       builder.with_version(generate_schema_version(builder.uuid()));
+       return builder.build(schema_builder::compact_storage::no);
+    }();
+    return schema;
+}
+
+schema_ptr large_rows() {
+    static thread_local auto schema = [] {
+        schema_builder builder(make_lw_shared(::schema(generate_legacy_id(NAME, LARGE_ROWS), NAME, LARGE_ROWS,
+        // partition key
+        {{"keyspace_name", utf8_type}, {"table_name", utf8_type}},
+        // clustering key
+        {{"sstable_name", utf8_type}, {"row_size", reversed_type_impl::get_instance(long_type)}, {"partition_key", utf8_type}, {"clustering_key", utf8_type}},
+        // regular columns
+        {{"compaction_time", timestamp_type}},
+        // static columns
+        {},
+        // regular column name type
+        utf8_type,
+        // comment
+        "rows larger than compaction_large_row_warning_threshold_mb"
+       )));
+       builder.with_version(generate_schema_version(builder.uuid()));
+       return builder.build(schema_builder::compact_storage::no);
+    }();
+    return schema;
+}
+
 std::vector<schema_ptr> all_tables() {
     std::vector<schema_ptr> r;
     auto schema_tables = db::schema_tables::all_tables();
@@ -1540,6 +1692,8 @@ std::vector<schema_ptr> all_tables() {
                     peers(), peer_events(), range_xfers(),
                     compactions_in_progress(), compaction_history(),
                     sstable_activity(), size_estimates(),
+                    scylla_views_builds_in_progress(), built_views(),
+                    large_partitions(), large_rows(), available_ranges(),
     });
     // legacy schema
     r.insert(r.end(), {
@@ -1579,8 +1733,10 @@ void make(database& db, bool durable, bool volatile_testing_only) {
             // don't make system keyspace reads wait for user reads
             kscfg.read_concurrency_config.resources_sem = &db.system_keyspace_read_concurrency_sem();
             kscfg.read_concurrency_config.active_reads = &db.get_stats().active_reads_system_keyspace;
+            kscfg.read_concurrency_config.queued_reads = &db.get_stats().queued_reads_system_keyspace;
             kscfg.read_concurrency_config.timeout = {};
             kscfg.read_concurrency_config.max_queue_length = std::numeric_limits<size_t>::max();
+            kscfg.read_concurrency_config.max_admission_cost = database::max_memory_system_concurrent_reads() / 4;
             // don't make system keyspace writes wait for user writes (if under pressure)
             kscfg.dirty_memory_manager = &db._system_dirty_memory_manager;
             keyspace _ks{ksm, std::move(kscfg)};
@@ -1624,6 +1780,93 @@ future<utils::UUID> set_local_host_id(const utils::UUID& host_id) {
     });
 }
 
+// The key of the partition in system.paxos has the same token as the
+// partition of the table, so its Paxos state lives on the same shard.
+static bytes paxos_row_key(const schema& s, partition_key_view key) {
+    auto&& legacy = key.legacy_form(s);
+    return bytes(legacy.begin(), legacy.end());
+}
+
+static int32_t paxos_ttl(const schema& s) {
+    // Keep the Paxos state around for at least 3h.
+    return std::max<int32_t>(3 * 3600, s.gc_grace_seconds().count());
+}
+
+static bytes serialize_paxos_update(const frozen_mutation& fm) {
+    bytes b(bytes::initialized_later(), fm.representation().size());
+    auto out = b.begin();
+    for (bytes_view frag : fm.representation()) {
+        out = std::copy(frag.begin(), frag.end(), out);
+    }
+    return b;
+}
+
+static frozen_mutation deserialize_paxos_update(bytes_view b) {
+    bytes_ostream out;
+    out.write(b);
+    return frozen_mutation(std::move(out));
+}
+
+future<service::paxos::paxos_state> load_paxos_state(partition_key_view key, schema_ptr s) {
+    sstring req = sprint("SELECT * FROM system.%s WHERE row_key = ? AND cf_id = ?", PAXOS);
+    return execute_cql(req, paxos_row_key(*s, key), s->id()).then([] (::shared_ptr<cql3::untyped_result_set> results) {
+        if (results->empty()) {
+            return service::paxos::paxos_state();
+        }
+        auto& row = results->one();
+        auto promised = row.has("in_progress_ballot")
+                ? row.get_as<utils::UUID>("in_progress_ballot") : utils::UUID_gen::min_time_UUID(0);
+        // Either both the proposal and its ballot are set, or neither.
+        std::experimental::optional<service::paxos::proposal> accepted;
+        if (row.has("proposal")) {
+            accepted = service::paxos::proposal(row.get_as<utils::UUID>("proposal_ballot"),
+                    deserialize_paxos_update(row.get_blob("proposal")));
+        }
+        // Same for the most recent commit.
+        std::experimental::optional<service::paxos::proposal> most_recent;
+        if (row.has("most_recent_commit")) {
+            most_recent = service::paxos::proposal(row.get_as<utils::UUID>("most_recent_commit_at"),
+                    deserialize_paxos_update(row.get_blob("most_recent_commit")));
+        }
+        return service::paxos::paxos_state(promised, std::move(accepted), std::move(most_recent));
+    });
+}
+
+future<> save_paxos_promise(const schema& s, const partition_key& key, const utils::UUID& ballot) {
+    sstring req = sprint("UPDATE system.%s USING TIMESTAMP ? AND TTL ? SET in_progress_ballot = ? WHERE row_key = ? AND cf_id = ?", PAXOS);
+    return execute_cql(req,
+            utils::UUID_gen::micros_timestamp(ballot),
+            paxos_ttl(s),
+            ballot,
+            paxos_row_key(s, key),
+            s.id()).discard_result();
+}
+
+future<> save_paxos_proposal(const schema& s, const service::paxos::proposal& proposal) {
+    sstring req = sprint("UPDATE system.%s USING TIMESTAMP ? AND TTL ? SET proposal_ballot = ?, proposal = ? WHERE row_key = ? AND cf_id = ?", PAXOS);
+    return execute_cql(req,
+            utils::UUID_gen::micros_timestamp(proposal.ballot),
+            paxos_ttl(s),
+            proposal.ballot,
+            serialize_paxos_update(proposal.update),
+            paxos_row_key(s, proposal.update.key(s)),
+            s.id()).discard_result();
+}
+
+future<> save_paxos_decision(const schema& s, const service::paxos::proposal& decision) {
+    // The accepted proposal is erased with the timestamp of the decision, so
+    // that a newer one is kept if the decision is an old one.
+    sstring req = sprint("UPDATE system.%s USING TIMESTAMP ? AND TTL ? SET proposal_ballot = null, proposal = null,"
+            " most_recent_commit_at = ?, most_recent_commit = ? WHERE row_key = ? AND cf_id = ?", PAXOS);
+    return execute_cql(req,
+            utils::UUID_gen::micros_timestamp(decision.ballot),
+            paxos_ttl(s),
+            decision.ballot,
+            serialize_paxos_update(decision.update),
+            paxos_row_key(s, decision.update.key(s)),
+            s.id()).discard_result();
+}
+
 std::unordered_map<gms::inet_address, locator::endpoint_dc_rack>
 load_dc_rack_info() {
     return _local_cache.local()._cached_dc_rack_info;
@@ -1734,6 +1977,109 @@ future<std::vector<compaction_history_entry>> get_compaction_history() {
     });
 }
 
+future<> register_view_for_building(sstring ks_name, sstring view_name) {
+    // Clears the token left over by an earlier build of a view with the same name.
+    sstring req = sprint("INSERT INTO system.%s (keyspace_name, view_name, cpu_id, next_token, done) VALUES (?, ?, ?, ?, ?)",
+            SCYLLA_VIEWS_BUILDS_IN_PROGRESS);
+    return execute_cql(req, std::move(ks_name), std::move(view_name), int32_t(engine().cpu_id()),
+            data_value::make_null(utf8_type), false).discard_result();
+}
+
+future<> update_view_build_progress(sstring ks_name, sstring view_name, const dht::token& next_token) {
+    sstring req = sprint("INSERT INTO system.%s (keyspace_name, view_name, cpu_id, next_token) VALUES (?, ?, ?, ?)",
+            SCYLLA_VIEWS_BUILDS_IN_PROGRESS);
+    return execute_cql(req, std::move(ks_name), std::move(view_name), int32_t(engine().cpu_id()),
+            dht::global_partitioner().to_sstring(next_token)).discard_result();
+}
+
+future<> finish_view_build_on_shard(sstring ks_name, sstring view_name) {
+    sstring req = sprint("INSERT INTO system.%s (keyspace_name, view_name, cpu_id, done) VALUES (?, ?, ?, ?)",
+            SCYLLA_VIEWS_BUILDS_IN_PROGRESS);
+    return execute_cql(req, std::move(ks_name), std::move(view_name), int32_t(engine().cpu_id()), true).discard_result();
+}
+
+future<> remove_view_build_progress(sstring ks_name, sstring view_name) {
+    sstring req = sprint("DELETE FROM system.%s WHERE keyspace_name = ? AND view_name = ?", SCYLLA_VIEWS_BUILDS_IN_PROGRESS);
+    return execute_cql(req, std::move(ks_name), std::move(view_name)).discard_result();
+}
+
+future<std::vector<view_build_progress>> load_view_build_progress() {
+    sstring req = sprint("SELECT keyspace_name, view_name, cpu_id, next_token, done FROM system.%s", SCYLLA_VIEWS_BUILDS_IN_PROGRESS);
+    return execute_cql(req).then([] (::shared_ptr<cql3::untyped_result_set> rs) {
+        std::vector<view_build_progress> progress;
+        progress.reserve(rs->size());
+        for (auto&& row : *rs) {
+            view_build_progress p;
+            p.view = view_name(row.get_as<sstring>("keyspace_name"), row.get_as<sstring>("view_name"));
+            p.cpu_id = row.get_as<int32_t>("cpu_id");
+            if (row.has("next_token")) {
+                p.next_token = dht::global_partitioner().from_sstring(row.get_as<sstring>("next_token"));
+            }
+            p.done = row.has("done") && row.get_as<bool>("done");
+            progress.push_back(std::move(p));
+        }
+        return progress;
+    });
+}
+
+future<> mark_view_as_built(sstring ks_name, sstring view_name) {
+    sstring req = sprint("INSERT INTO system.%s (keyspace_name, view_name) VALUES (?, ?)", BUILT_VIEWS);
+    return execute_cql(req, std::move(ks_name), std::move(view_name)).discard_result().then([] {
+        return force_blocking_flush(BUILT_VIEWS);
+    });
+}
+
+future<> remove_built_view(sstring ks_name, sstring view_name) {
+    sstring req = sprint("DELETE FROM system.%s WHERE keyspace_name = ? AND view_name = ?", BUILT_VIEWS);
+    return execute_cql(req, std::move(ks_name), std::move(view_name)).discard_result();
+}
+
+future<> record_large_partition(sstring ks_name, sstring cf_name, sstring sstable_name, int64_t partition_size,
+        sstring partition_key, int64_t rows) {
+    sstring req = sprint("INSERT INTO system.%s (keyspace_name, table_name, sstable_name, partition_size, partition_key, rows, compaction_time) VALUES (?, ?, ?, ?, ?, ?, ?)",
+            LARGE_PARTITIONS);
+    return execute_cql(req, std::move(ks_name), std::move(cf_name), std::move(sstable_name), partition_size,
+            std::move(partition_key), rows, db_clock::now()).discard_result();
+}
+
+future<> record_large_row(sstring ks_name, sstring cf_name, sstring sstable_name, int64_t row_size,
+        sstring partition_key, sstring clustering_key) {
+    sstring req = sprint("INSERT INTO system.%s (keyspace_name, table_name, sstable_name, row_size, partition_key, clustering_key, compaction_time) VALUES (?, ?, ?, ?, ?, ?, ?)",
+            LARGE_ROWS);
+    return execute_cql(req, std::move(ks_name), std::move(cf_name), std::move(sstable_name), row_size,
+            std::move(partition_key), std::move(clustering_key), db_clock::now()).discard_result();
+}
+
+future<> remove_large_data(sstring ks_name, sstring cf_name, sstring sstable_name) {
+    return parallel_for_each(std::vector<sstring>{LARGE_PARTITIONS, LARGE_ROWS}, [=] (sstring table) {
+        sstring req = sprint("DELETE FROM system.%s WHERE keyspace_name = ? AND table_name = ? AND sstable_name = ?", table);
+        return execute_cql(req, ks_name, cf_name, sstable_name).discard_result();
+    });
+}
+
+future<std::unordered_map<sstring, uint64_t>> load_large_data_sstables(sstring ks_name, sstring cf_name) {
+    return do_with(std::unordered_map<sstring, uint64_t>(), [ks_name = std::move(ks_name), cf_name = std::move(cf_name)] (auto& sstables) {
+        return parallel_for_each(std::vector<sstring>{LARGE_PARTITIONS, LARGE_ROWS}, [&sstables, ks_name, cf_name] (sstring table) {
+            sstring req = sprint("SELECT sstable_name FROM system.%s WHERE keyspace_name = ? AND table_name = ?", table);
+            return execute_cql(req, ks_name, cf_name).then([&sstables] (::shared_ptr<cql3::untyped_result_set> rs) {
+                for (auto&& row : *rs) {
+                    sstables[row.get_as<sstring>("sstable_name")]++;
+                }
+            });
+        }).then([&sstables] {
+            return std::move(sstables);
+        });
+    });
+}
+
+future<std::vector<view_name>> load_built_views() {
+    sstring req = sprint("SELECT keyspace_name, view_name FROM system.%s", BUILT_VIEWS);
+    return execute_cql(req).then([] (::shared_ptr<cql3::untyped_result_set> rs) {
+        return boost::copy_range<std::vector<view_name>>(*rs | boost::adaptors::transformed([] (const cql3::untyped_result_set::row& row) {
+            return view_name(row.get_as<sstring>("keyspace_name"), row.get_as<sstring>("view_name"));
+        }));
+    });
+}
 
 future<int> increment_and_get_generation() {
     auto req = sprint("SELECT gossip_generation FROM system.%s WHERE key='%s'", LOCAL, LOCAL);
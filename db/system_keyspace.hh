@@ -50,6 +50,7 @@
 #include "locator/token_metadata.hh"
 #include "db_clock.hh"
 #include "db/commitlog/replay_position.hh"
+#include "service/paxos/paxos_state.hh"
 #include <map>
 
 namespace service {
@@ -80,6 +81,11 @@ static constexpr auto COMPACTIONS_IN_PROGRESS = "compactions_in_progress";
 static constexpr auto COMPACTION_HISTORY = "compaction_history";
 static constexpr auto SSTABLE_ACTIVITY = "sstable_activity";
 static constexpr auto SIZE_ESTIMATES = "size_estimates";
+static constexpr auto SCYLLA_VIEWS_BUILDS_IN_PROGRESS = "scylla_views_builds_in_progress";
+static constexpr auto BUILT_VIEWS = "built_views";
+static constexpr auto LARGE_PARTITIONS = "large_partitions";
+static constexpr auto LARGE_ROWS = "large_rows";
+static constexpr auto AVAILABLE_RANGES = "available_ranges";
 
 namespace v3 {
 static constexpr auto BATCHES = "batches";
@@ -121,6 +127,11 @@ struct range_estimates {
 extern schema_ptr hints();
 extern schema_ptr batchlog();
 extern schema_ptr built_indexes(); // TODO (from Cassandra): make private
+extern schema_ptr scylla_views_builds_in_progress();
+extern schema_ptr built_views();
+extern schema_ptr large_partitions();
+extern schema_ptr large_rows();
+extern schema_ptr available_ranges();
 
 namespace legacy {
 
@@ -364,6 +375,39 @@ enum class bootstrap_state {
                                        std::unordered_map<int32_t, int64_t> rows_merged);
     future<std::vector<compaction_history_entry>> get_compaction_history();
 
+    using view_name = std::pair<sstring, sstring>;
+
+    // Where the build of a view stands on one shard.
+    struct view_build_progress {
+        view_name view;
+        unsigned cpu_id;
+        // The token to resume from, or disengaged if the shard hasn't processed any partition yet.
+        std::experimental::optional<dht::token> next_token;
+        bool done = false;
+    };
+
+    future<> register_view_for_building(sstring ks_name, sstring view_name);
+    future<> update_view_build_progress(sstring ks_name, sstring view_name, const dht::token& next_token);
+    future<> finish_view_build_on_shard(sstring ks_name, sstring view_name);
+    // Drops the progress of all shards.
+    future<> remove_view_build_progress(sstring ks_name, sstring view_name);
+    // The progress entries of all shards, including those of a previous boot with a different shard count.
+    future<std::vector<view_build_progress>> load_view_build_progress();
+    future<> mark_view_as_built(sstring ks_name, sstring view_name);
+    future<> remove_built_view(sstring ks_name, sstring view_name);
+    future<std::vector<view_name>> load_built_views();
+
+    // The partitions and rows an sstable was written with above the
+    // compaction_*_warning_threshold options, identified by the name of its
+    // data file.
+    future<> record_large_partition(sstring ks_name, sstring cf_name, sstring sstable_name, int64_t partition_size,
+            sstring partition_key, int64_t rows);
+    future<> record_large_row(sstring ks_name, sstring cf_name, sstring sstable_name, int64_t row_size,
+            sstring partition_key, sstring clustering_key);
+    future<> remove_large_data(sstring ks_name, sstring cf_name, sstring sstable_name);
+    // The number of large partitions and rows recorded for each sstable of the table.
+    future<std::unordered_map<sstring, uint64_t>> load_large_data_sstables(sstring ks_name, sstring cf_name);
+
     typedef std::vector<db::replay_position> replay_positions;
 
     future<> save_truncation_record(const column_family&, db_clock::time_point truncated_at, db::replay_position);
@@ -492,6 +536,12 @@ bootstrap_state get_bootstrap_state();
 bool was_decommissioned();
 future<> set_bootstrap_state(bootstrap_state state);
 
+// The ranges of the keyspace which were received by a bootstrap or a rebuild
+// that hasn't completed yet, so that it resumes after them when retried.
+future<dht::token_range_vector> get_available_ranges(sstring ks_name);
+future<> update_available_ranges(sstring ks_name, const dht::token_range_vector& ranges);
+future<> reset_available_ranges(sstring ks_name);
+
 #if 0
     public static boolean isIndexBuilt(String keyspaceName, String indexName)
     {
@@ -529,71 +579,14 @@ future<> set_bootstrap_state(bootstrap_state state);
      */
     future<utils::UUID> set_local_host_id(const utils::UUID& host_id);
 
-#if 0
-
-    public static PaxosState loadPaxosState(ByteBuffer key, CFMetaData metadata)
-    {
-        String req = "SELECT * FROM system.%s WHERE row_key = ? AND cf_id = ?";
-        UntypedResultSet results = executeInternal(String.format(req, PAXOS), key, metadata.cfId);
-        if (results.isEmpty())
-            return new PaxosState(key, metadata);
-        UntypedResultSet.Row row = results.one();
-        Commit promised = row.has("in_progress_ballot")
-                        ? new Commit(key, row.getUUID("in_progress_ballot"), ArrayBackedSortedColumns.factory.create(metadata))
-                        : Commit.emptyCommit(key, metadata);
-        // either we have both a recently accepted ballot and update or we have neither
-        Commit accepted = row.has("proposal")
-                        ? new Commit(key, row.getUUID("proposal_ballot"), ColumnFamily.fromBytes(row.getBytes("proposal")))
-                        : Commit.emptyCommit(key, metadata);
-        // either most_recent_commit and most_recent_commit_at will both be set, or neither
-        Commit mostRecent = row.has("most_recent_commit")
-                          ? new Commit(key, row.getUUID("most_recent_commit_at"), ColumnFamily.fromBytes(row.getBytes("most_recent_commit")))
-                          : Commit.emptyCommit(key, metadata);
-        return new PaxosState(promised, accepted, mostRecent);
-    }
-
-    public static void savePaxosPromise(Commit promise)
-    {
-        String req = "UPDATE system.%s USING TIMESTAMP ? AND TTL ? SET in_progress_ballot = ? WHERE row_key = ? AND cf_id = ?";
-        executeInternal(String.format(req, PAXOS),
-                        UUIDGen.microsTimestamp(promise.ballot),
-                        paxosTtl(promise.update.metadata),
-                        promise.ballot,
-                        promise.key,
-                        promise.update.id());
-    }
-
-    public static void savePaxosProposal(Commit proposal)
-    {
-        executeInternal(String.format("UPDATE system.%s USING TIMESTAMP ? AND TTL ? SET proposal_ballot = ?, proposal = ? WHERE row_key = ? AND cf_id = ?", PAXOS),
-                        UUIDGen.microsTimestamp(proposal.ballot),
-                        paxosTtl(proposal.update.metadata),
-                        proposal.ballot,
-                        proposal.update.toBytes(),
-                        proposal.key,
-                        proposal.update.id());
-    }
-
-    private static int paxosTtl(CFMetaData metadata)
-    {
-        // keep paxos state around for at least 3h
-        return Math.max(3 * 3600, metadata.getGcGraceSeconds());
-    }
-
-    public static void savePaxosCommit(Commit commit)
-    {
-        // We always erase the last proposal (with the commit timestamp to no erase more recent proposal in case the commit is old)
-        // even though that's really just an optimization  since SP.beginAndRepairPaxos will exclude accepted proposal older than the mrc.
-        String cql = "UPDATE system.%s USING TIMESTAMP ? AND TTL ? SET proposal_ballot = null, proposal = null, most_recent_commit_at = ?, most_recent_commit = ? WHERE row_key = ? AND cf_id = ?";
-        executeInternal(String.format(cql, PAXOS),
-                        UUIDGen.microsTimestamp(commit.ballot),
-                        paxosTtl(commit.update.metadata),
-                        commit.ballot,
-                        commit.update.toBytes(),
-                        commit.key,
-                        commit.update.id());
-    }
+    // The Paxos state of a partition of the table, kept in system.paxos under
+    // a key with the token of the partition, so on the shard owning it.
+    future<service::paxos::paxos_state> load_paxos_state(partition_key_view key, schema_ptr s);
+    future<> save_paxos_promise(const schema& s, const partition_key& key, const utils::UUID& ballot);
+    future<> save_paxos_proposal(const schema& s, const service::paxos::proposal& proposal);
+    future<> save_paxos_decision(const schema& s, const service::paxos::proposal& decision);
 
+#if 0
     /**
      * Returns a RestorableMeter tracking the average read rate of a particular SSTable, restoring the last-seen rate
      * from values in system.sstable_activity if present.
@@ -49,6 +49,7 @@
 #include "cql3/statements/select_statement.hh"
 #include "cql3/util.hh"
 #include "db/view/view.hh"
+#include "gms/failure_detector.hh"
 #include "gms/inet_address.hh"
 #include "keys.hh"
 #include "locator/network_topology_strategy.hh"
@@ -779,11 +780,45 @@ get_view_natural_endpoint(const sstring& keyspace_name,
 
 // Take the view mutations generated by generate_view_updates(), which pertain
 // to a modification of a single base partition, and apply them to the
-// appropriate paired replicas. This is done asynchronously - we do not wait
-// for the writes to complete.
+// appropriate paired replicas. The returned future resolves when all the
+// writes are done; failures are logged, not propagated, and the updates to
+// paired replicas which are down or time out are replayed later. The base write
+// does not wait for it, but the memory of the updates is accounted until then.
 // FIXME: I dropped a lot of parameters the Cassandra version had,
 // we may need them back: writeCommitLog, baseComplete, queryStartNanoTime.
-void mutate_MV(const dht::token& base_token,
+std::vector<column_id> regular_columns_affecting_views(const schema& base, const std::vector<view_ptr>& views) {
+    auto all = [&base] {
+        return boost::copy_range<std::vector<column_id>>(
+                base.regular_columns() | boost::adaptors::transformed(std::mem_fn(&column_definition::id)));
+    };
+    std::vector<bool> affecting(base.regular_columns_count());
+    for (auto&& v : views) {
+        view_info& vf = *v->view_info();
+        // The view entries expire with the last column of the base row, see view_updates::compute_row_marker().
+        if (vf.include_all_columns() || !vf.base_non_pk_column_in_view_pk(base)) {
+            return all();
+        }
+        for (auto&& cdef : base.regular_columns()) {
+            if (vf.view_column(base, cdef.id)) {
+                affecting[cdef.id] = true;
+            }
+        }
+        for (auto&& cdef : vf.select_statement().get_restrictions()->get_non_pk_restriction() | boost::adaptors::map_keys) {
+            if (cdef->is_regular()) {
+                affecting[cdef->id] = true;
+            }
+        }
+    }
+    std::vector<column_id> columns;
+    for (column_id id = 0; id < affecting.size(); ++id) {
+        if (affecting[id]) {
+            columns.push_back(id);
+        }
+    }
+    return columns;
+}
+
+future<> mutate_MV(const dht::token& base_token,
         std::vector<mutation> mutations)
 {
 #if 0
@@ -815,6 +850,10 @@ void mutate_MV(const dht::token& base_token,
                                                                                                           () -> asyncRemoveFromBatchlog(batchlogEndpoints, batchUUID));
             // add a handler for each mutation - includes checking availability, but doesn't initiate any writes, yet
 #endif
+    // The updates are applied to this node with one call per shard, and sent
+    // to each paired endpoint in one message.
+    std::vector<mutation> local_mutations;
+    std::vector<std::pair<mutation, gms::inet_address>> remote_mutations;
     for (auto& mut : mutations) {
         auto view_token = mut.token();
         auto keyspace_name = mut.schema()->ks_name();
@@ -826,13 +865,7 @@ void mutate_MV(const dht::token& base_token,
             auto my_address = utils::fb_utilities::get_broadcast_address();
             if (*paired_endpoint == my_address && pending_endpoints.empty() &&
                 service::get_local_storage_service().is_joined()) {
-                    // Note that we start here an asynchronous apply operation, and
-                    // do not wait for it to complete.
-                    // Note also that mutate_locally(mut) copies mut (in
-                    // frozen from) so don't need to increase its lifetime.
-                    service::get_local_storage_proxy().mutate_locally(mut).handle_exception([] (auto ep) {
-                        vlogger.error("Error applying local view update: {}", ep);
-                    });
+                    local_mutations.push_back(std::move(mut));
             } else {
 #if 0
                         wrappers.add(wrapViewBatchResponseHandler(mutation,
@@ -844,13 +877,16 @@ void mutate_MV(const dht::token& base_token,
                                                                   cleanup,
                                                                   queryStartNanoTime));
 #endif
-                // FIXME: Temporary hack: send the write directly to paired_endpoint,
-                // without a batchlog, and without checking for success
-                // Note we don't wait for the asynchronous operation to complete
-                // FIXME: need to extend mut's lifetime???
-                service::get_local_storage_proxy().send_to_endpoint(mut, *paired_endpoint, db::write_type::VIEW).handle_exception([paired_endpoint] (auto ep) {
-                    vlogger.error("Error applying view update to {}: {}", *paired_endpoint, ep);
-                });;
+                // Sent directly to paired_endpoint, without a batchlog. The
+                // updates to a replica which is down, or which time out, are
+                // recorded in the view hints log and replayed to it later.
+                if (!gms::get_local_failure_detector().is_alive(*paired_endpoint)) {
+                    if (!service::get_local_storage_proxy().hint_view_update(mut, *paired_endpoint)) {
+                        vlogger.warn("Dropped a view update to {}, which is down", *paired_endpoint);
+                    }
+                    continue;
+                }
+                remote_mutations.emplace_back(std::move(mut), *paired_endpoint);
             }
         } else {
 #if 0
@@ -893,6 +929,24 @@ void mutate_MV(const dht::token& base_token,
         viewWriteMetrics.addNano(System.nanoTime() - startTime);
     }
 #endif
+    auto local = local_mutations.size();
+    auto remote = remote_mutations.size();
+    auto& proxy = service::get_local_storage_proxy();
+    auto local_write = local ? proxy.mutate_locally(std::move(local_mutations)) : make_ready_future<>();
+    auto remote_write = remote ? proxy.send_to_endpoints(std::move(remote_mutations), db::write_type::VIEW) : make_ready_future<>();
+    return when_all(local_write.handle_exception([local] (auto ep) {
+        vlogger.error("Error applying {} local view updates: {}", local, ep);
+    }), remote_write.handle_exception([remote] (auto ep) {
+        vlogger.warn("Error applying {} view updates to paired endpoints, the ones which timed out are replayed later: {}", remote, ep);
+    })).discard_result();
+}
+
+std::chrono::microseconds calculate_view_update_delay(size_t backlog, size_t max_backlog) {
+    if (!max_backlog) {
+        return std::chrono::microseconds(0);
+    }
+    auto ratio = std::min(double(backlog) / max_backlog, 1.0);
+    return std::chrono::duration_cast<std::chrono::microseconds>(max_view_update_delay * ratio);
 }
 
 } // namespace view
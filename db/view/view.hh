@@ -21,6 +21,8 @@
 
 #pragma once
 
+#include <chrono>
+
 #include "dht/i_partitioner.hh"
 #include "gc_clock.hh"
 #include "query-request.hh"
@@ -91,9 +93,29 @@ query::clustering_row_ranges calculate_affected_clustering_ranges(
         const mutation_partition& mp,
         const std::vector<view_ptr>& views);
 
-void mutate_MV(const dht::token& base_token,
+/**
+ * The regular columns of the base table which the view updates of the views
+ * need to know the existing values of.
+ *
+ * Those are the columns the views include or filter on, unless the lifetime
+ * of the entries of one of the views depends on all the columns of the base
+ * row, which is the case when no regular column is part of its primary key.
+ */
+std::vector<column_id> regular_columns_affecting_views(const schema& base, const std::vector<view_ptr>& views);
+
+future<> mutate_MV(const dht::token& base_token,
         std::vector<mutation> mutations);
 
+// The delay of a base write when the view updates of the shard reach their memory limit.
+constexpr std::chrono::milliseconds max_view_update_delay{100};
+
+/**
+ * Returns how long a base write should wait before being acknowledged, in
+ * proportion to the memory of the view updates still in flight on this shard,
+ * so that writers slow down before the updates hit their memory limit.
+ */
+std::chrono::microseconds calculate_view_update_delay(size_t backlog, size_t max_backlog);
+
 }
 
 }
@@ -0,0 +1,313 @@
+/*
+ * Copyright (C) 2017 ScyllaDB
+ */
+
+/*
+ * This file is part of Scylla.
+ *
+ * Scylla is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Scylla is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <boost/algorithm/cxx11/all_of.hpp>
+#include <boost/range/adaptor/map.hpp>
+#include <boost/range/algorithm/find_if.hpp>
+#include <seastar/core/reactor.hh>
+#include <seastar/core/sleep.hh>
+#include <seastar/core/thread.hh>
+#include "db/view/view_builder.hh"
+#include "db/view/view.hh"
+#include "service/migration_manager.hh"
+#include "service/priority_manager.hh"
+#include "database.hh"
+#include "view_info.hh"
+#include "log.hh"
+
+namespace db {
+
+namespace view {
+
+static logging::logger vblogger("view_builder");
+
+distributed<view_builder> _the_view_builder;
+
+view_builder::view_builder(database& db)
+    : _db(db)
+{ }
+
+future<> view_builder::start() {
+    service::get_local_migration_manager().register_listener(this);
+    _build_loop = run();
+    if (engine().cpu_id() != 0) {
+        return make_ready_future<>();
+    }
+    // Shard 0 reads the status once for all shards, so that none of them sees what another already wrote.
+    return seastar::async([this] {
+        auto built = system_keyspace::load_built_views().get0();
+        auto progress = system_keyspace::load_view_build_progress().get0();
+        std::unordered_map<view_name, std::vector<system_keyspace::view_build_progress>, utils::tuple_hash> by_view;
+        for (auto&& p : progress) {
+            by_view[p.view].push_back(std::move(p));
+        }
+        for (auto&& e : by_view) {
+            auto& entries = e.second;
+            auto same_shards = entries.size() == smp::count && boost::algorithm::all_of(entries, [] (auto& p) {
+                return p.cpu_id < smp::count;
+            });
+            if (same_shards) {
+                continue;
+            }
+            // The shard count changed, so the partitions of a shard are not the ones of the saved entry.
+            // Scanning again from the lowest token any shard still had to process covers everything left.
+            auto all_done = true;
+            std::experimental::optional<dht::token> from;
+            auto from_start = false;
+            for (auto&& p : entries) {
+                if (p.done) {
+                    continue;
+                }
+                all_done = false;
+                if (!p.next_token) {
+                    from_start = true;
+                } else if (!from || *p.next_token < *from) {
+                    from = p.next_token;
+                }
+            }
+            system_keyspace::remove_view_build_progress(e.first.first, e.first.second).get();
+            if (all_done) {
+                system_keyspace::mark_view_as_built(e.first.first, e.first.second).get();
+                built.push_back(e.first);
+                entries.clear();
+                continue;
+            }
+            if (from_start) {
+                from = {};
+            }
+            entries.clear();
+            for (unsigned shard = 0; shard < smp::count; ++shard) {
+                entries.push_back(system_keyspace::view_build_progress{e.first, shard, from, false});
+            }
+            vblogger.info("Resuming the build of view {}.{} on the new shards", e.first.first, e.first.second);
+        }
+        container().invoke_on_all([built = std::move(built), by_view = std::move(by_view)] (view_builder& vb) {
+            std::vector<system_keyspace::view_build_progress> mine;
+            for (auto&& e : by_view) {
+                auto it = boost::range::find_if(e.second, [] (auto& p) { return p.cpu_id == engine().cpu_id(); });
+                if (it != e.second.end()) {
+                    mine.push_back(*it);
+                }
+            }
+            return vb.load_status(built, std::move(mine));
+        }).get();
+    });
+}
+
+future<> view_builder::stop() {
+    service::get_local_migration_manager().unregister_listener(this);
+    _stopping = true;
+    _work.broken();
+    return _gate.close().then([this] {
+        return std::move(_build_loop);
+    });
+}
+
+future<> view_builder::load_status(std::vector<view_name> built, std::vector<system_keyspace::view_build_progress> progress) {
+    std::unordered_set<view_name, utils::tuple_hash> built_set(built.begin(), built.end());
+    std::unordered_map<view_name, system_keyspace::view_build_progress, utils::tuple_hash> progress_map;
+    for (auto&& p : progress) {
+        progress_map.emplace(p.view, std::move(p));
+    }
+    std::vector<view_ptr> views;
+    for (auto&& cf : _db.get_column_families() | boost::adaptors::map_values) {
+        if (cf->schema()->is_view()) {
+            views.push_back(view_ptr(cf->schema()));
+        }
+    }
+    return do_with(std::move(views), std::move(built_set), std::move(progress_map),
+            [this] (auto& views, auto& built_set, auto& progress_map) {
+        return do_for_each(views, [this, &built_set, &progress_map] (const view_ptr& view) {
+            view_name name(view->ks_name(), view->cf_name());
+            if (built_set.count(name)) {
+                return make_ready_future<>();
+            }
+            auto it = progress_map.find(name);
+            if (it == progress_map.end()) {
+                // Created while the node was down, or before views were built from existing data.
+                return system_keyspace::register_view_for_building(name.first, name.second).then([this, view] {
+                    add_pending(view, {});
+                });
+            }
+            auto& p = it->second;
+            if (p.done) {
+                auto shard = engine().cpu_id();
+                return container().invoke_on(0, [name = std::move(name), shard] (view_builder& vb) {
+                    return vb.mark_done_on_shard(name, shard);
+                });
+            }
+            // Rewritten so that entries of a resharded build are saved with their new shard.
+            auto f = p.next_token
+                    ? system_keyspace::update_view_build_progress(name.first, name.second, *p.next_token)
+                    : system_keyspace::register_view_for_building(name.first, name.second);
+            return f.then([this, view, next_token = p.next_token] {
+                add_pending(view, next_token);
+            });
+        });
+    });
+}
+
+void view_builder::add_pending(view_ptr view, std::experimental::optional<dht::token> next_token) {
+    auto it = boost::range::find_if(_pending, [&view] (const view_build_status& s) {
+        return s.view->id() == view->id();
+    });
+    if (it != _pending.end()) {
+        return;
+    }
+    vblogger.debug("Building view {}.{} on shard {}", view->ks_name(), view->cf_name(), engine().cpu_id());
+    _pending.push_back(view_build_status{std::move(view), std::move(next_token)});
+    _work.signal();
+}
+
+future<> view_builder::run() {
+    return do_until([this] { return _stopping; }, [this] {
+        if (_pending.empty()) {
+            return _work.wait();
+        }
+        return with_gate(_gate, [this] {
+            return do_build_step();
+        }).handle_exception([this] (std::exception_ptr ep) {
+            if (_stopping) {
+                return make_ready_future<>();
+            }
+            vblogger.warn("Error while building views: {}", ep);
+            return sleep(std::chrono::seconds(1));
+        });
+    }).handle_exception_type([] (const broken_semaphore&) { });
+}
+
+future<> view_builder::do_build_step() {
+    auto& status = _pending.front();
+    auto view = status.view;
+    auto& base = _db.find_column_family(view->view_info()->base_id());
+    auto schema = base.schema();
+    auto range = make_lw_shared<dht::partition_range>(status.next_token
+            ? dht::partition_range::make_starting_with(dht::ring_position::starting_at(*status.next_token))
+            : query::full_partition_range);
+    // Doesn't populate the cache, and reads at streaming priority.
+    auto reader = make_lw_shared<mutation_reader>(base.make_streaming_reader(schema, *range));
+    auto processed = make_lw_shared<size_t>(0);
+    auto next_token = make_lw_shared<std::experimental::optional<dht::token>>();
+    return repeat([this, schema, view, reader, processed, next_token] {
+        return service::throttle(service::get_local_view_building_cpu()).then([reader] {
+            return (*reader)();
+        }).then([this, schema, view, processed, next_token] (streamed_mutation_opt smopt) {
+            if (!smopt || _stopping) {
+                return make_ready_future<stop_iteration>(stop_iteration::yes);
+            }
+            auto token = smopt->decorated_key().token();
+            if (*processed == batch_size) {
+                // Resuming includes this partition, which is not processed yet.
+                *next_token = std::move(token);
+                return make_ready_future<stop_iteration>(stop_iteration::yes);
+            }
+            ++*processed;
+            auto f = service::get_local_view_building_cpu().run([&] {
+                return generate_view_updates(schema, {view}, std::move(*smopt), {});
+            });
+            return f.then([token = std::move(token)] (std::vector<mutation> updates) {
+                return mutate_MV(token, std::move(updates));
+            }).then([] {
+                return stop_iteration::no;
+            });
+        });
+    }).then([this, view, next_token] {
+        if (_stopping) {
+            return make_ready_future<>();
+        }
+        return finish_step(view, std::move(*next_token));
+    }).finally([reader, range] { });
+}
+
+future<> view_builder::finish_step(view_ptr view, std::experimental::optional<dht::token> next_token) {
+    // The view may have been dropped meanwhile.
+    if (_pending.empty() || _pending.front().view->id() != view->id()) {
+        return make_ready_future<>();
+    }
+    if (next_token) {
+        _pending.front().next_token = next_token;
+        return system_keyspace::update_view_build_progress(view->ks_name(), view->cf_name(), *next_token);
+    }
+    _pending.pop_front();
+    view_name name(view->ks_name(), view->cf_name());
+    auto shard = engine().cpu_id();
+    return system_keyspace::finish_view_build_on_shard(name.first, name.second).then([this, name = std::move(name), shard] () mutable {
+        return container().invoke_on(0, [name = std::move(name), shard] (view_builder& vb) {
+            return vb.mark_done_on_shard(name, shard);
+        });
+    });
+}
+
+future<> view_builder::mark_done_on_shard(view_name name, unsigned shard) {
+    auto& shards = _shards_done[name];
+    shards.insert(shard);
+    if (shards.size() < smp::count) {
+        return make_ready_future<>();
+    }
+    _shards_done.erase(name);
+    return system_keyspace::mark_view_as_built(name.first, name.second).then([name] {
+        return system_keyspace::remove_view_build_progress(name.first, name.second);
+    }).then([name] {
+        vblogger.info("Finished building view {}.{}", name.first, name.second);
+    });
+}
+
+void view_builder::on_create_view(const sstring& ks_name, const sstring& view_name) {
+    view_ptr view;
+    try {
+        view = view_ptr(_db.find_schema(ks_name, view_name));
+    } catch (no_such_column_family&) {
+        return;
+    }
+    with_gate(_gate, [this, view = std::move(view)] {
+        return system_keyspace::register_view_for_building(view->ks_name(), view->cf_name()).then([this, view] {
+            add_pending(view, {});
+        });
+    }).handle_exception([ks_name, view_name] (std::exception_ptr ep) {
+        vblogger.warn("Failed to register view {}.{} for building: {}", ks_name, view_name, ep);
+    });
+}
+
+void view_builder::on_drop_view(const sstring& ks_name, const sstring& view_name) {
+    auto name = std::make_pair(ks_name, view_name);
+    auto it = boost::range::find_if(_pending, [&name] (const view_build_status& s) {
+        return s.view->ks_name() == name.first && s.view->cf_name() == name.second;
+    });
+    // The front view is being built, the step in flight sees it is gone when it finishes.
+    if (it != _pending.end()) {
+        _pending.erase(it);
+    }
+    _shards_done.erase(name);
+    if (engine().cpu_id() != 0) {
+        return;
+    }
+    with_gate(_gate, [name] {
+        return system_keyspace::remove_view_build_progress(name.first, name.second).then([name] {
+            return system_keyspace::remove_built_view(name.first, name.second);
+        });
+    }).handle_exception([name] (std::exception_ptr ep) {
+        vblogger.warn("Failed to remove the build status of view {}.{}: {}", name.first, name.second, ep);
+    });
+}
+
+}
+
+}
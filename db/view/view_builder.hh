@@ -0,0 +1,126 @@
+/*
+ * Copyright (C) 2017 ScyllaDB
+ */
+
+/*
+ * This file is part of Scylla.
+ *
+ * Scylla is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Scylla is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <deque>
+#include <experimental/optional>
+#include <unordered_map>
+#include <unordered_set>
+#include <seastar/core/distributed.hh>
+#include <seastar/core/gate.hh>
+#include <seastar/core/semaphore.hh>
+#include "db/system_keyspace.hh"
+#include "dht/i_partitioner.hh"
+#include "schema.hh"
+#include "service/migration_listener.hh"
+#include "utils/hash.hh"
+#include "seastarx.hh"
+
+class database;
+
+namespace db {
+
+namespace view {
+
+/*
+ * Builds materialized views from the data already in their base tables.
+ *
+ * Writes to the base table issued after a view is created update it as
+ * usual. The builder goes over the rest: every shard walks the partitions of
+ * the base table it owns, in token order and at streaming priority, and
+ * applies the view updates generated for them as if they were just written.
+ * Shards build their views one at a time, concurrently with each other.
+ *
+ * After every batch_size partitions a shard saves the token to resume from in
+ * system.scylla_views_builds_in_progress, so a restart picks up where the
+ * build stopped. Once all shards are done, shard 0 records the view in
+ * system.built_views.
+ */
+class view_builder final : public service::migration_listener,
+                           public seastar::async_sharded_service<view_builder>,
+                           public seastar::peering_sharded_service<view_builder> {
+public:
+    // Partitions read between two saves of the progress.
+    static constexpr size_t batch_size = 128;
+private:
+    using view_name = system_keyspace::view_name;
+
+    struct view_build_status {
+        view_ptr view;
+        // Disengaged when starting from the first partition.
+        std::experimental::optional<dht::token> next_token;
+    };
+
+    database& _db;
+    // Views still to be built on this shard, in build order.
+    std::deque<view_build_status> _pending;
+    semaphore _work{0};
+    seastar::gate _gate;
+    future<> _build_loop = make_ready_future<>();
+    bool _stopping = false;
+    // On shard 0, the shards which finished building each view.
+    std::unordered_map<view_name, std::unordered_set<unsigned>, utils::tuple_hash> _shards_done;
+public:
+    explicit view_builder(database& db);
+
+    // Resumes the builds interrupted by the last shutdown and starts the ones never started.
+    future<> start();
+    future<> stop();
+
+    virtual void on_create_keyspace(const sstring& ks_name) override {}
+    virtual void on_create_column_family(const sstring& ks_name, const sstring& cf_name) override {}
+    virtual void on_create_user_type(const sstring& ks_name, const sstring& type_name) override {}
+    virtual void on_create_function(const sstring& ks_name, const sstring& function_name) override {}
+    virtual void on_create_aggregate(const sstring& ks_name, const sstring& aggregate_name) override {}
+    virtual void on_create_view(const sstring& ks_name, const sstring& view_name) override;
+
+    virtual void on_update_keyspace(const sstring& ks_name) override {}
+    virtual void on_update_column_family(const sstring& ks_name, const sstring& cf_name, bool columns_changed) override {}
+    virtual void on_update_user_type(const sstring& ks_name, const sstring& type_name) override {}
+    virtual void on_update_function(const sstring& ks_name, const sstring& function_name) override {}
+    virtual void on_update_aggregate(const sstring& ks_name, const sstring& aggregate_name) override {}
+    virtual void on_update_view(const sstring& ks_name, const sstring& view_name, bool columns_changed) override {}
+
+    virtual void on_drop_keyspace(const sstring& ks_name) override {}
+    virtual void on_drop_column_family(const sstring& ks_name, const sstring& cf_name) override {}
+    virtual void on_drop_user_type(const sstring& ks_name, const sstring& type_name) override {}
+    virtual void on_drop_function(const sstring& ks_name, const sstring& function_name) override {}
+    virtual void on_drop_aggregate(const sstring& ks_name, const sstring& aggregate_name) override {}
+    virtual void on_drop_view(const sstring& ks_name, const sstring& view_name) override;
+private:
+    future<> load_status(std::vector<view_name> built, std::vector<system_keyspace::view_build_progress> progress);
+    void add_pending(view_ptr view, std::experimental::optional<dht::token> next_token);
+    future<> run();
+    future<> do_build_step();
+    future<> finish_step(view_ptr view, std::experimental::optional<dht::token> next_token);
+    future<> mark_done_on_shard(view_name name, unsigned shard);
+};
+
+extern distributed<view_builder> _the_view_builder;
+
+inline distributed<view_builder>& get_view_builder() {
+    return _the_view_builder;
+}
+
+}
+
+}
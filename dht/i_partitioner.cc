@@ -158,12 +158,29 @@ std::ostream& operator<<(std::ostream& out, const decorated_key& dk) {
 }
 
 // FIXME: make it per-keyspace
+std::vector<token> i_partitioner::get_tokens(const schema& s, const std::vector<partition_key_view>& keys) {
+    return boost::copy_range<std::vector<token>>(keys | boost::adaptors::transformed([this, &s] (partition_key_view key) {
+        return get_token(s, key);
+    }));
+}
+
+std::vector<token> i_partitioner::get_tokens(const std::vector<sstables::key_view>& keys) {
+    return boost::copy_range<std::vector<token>>(keys | boost::adaptors::transformed([this] (const sstables::key_view& key) {
+        return get_token(key);
+    }));
+}
+
 std::unique_ptr<i_partitioner> default_partitioner;
 
+std::unique_ptr<i_partitioner> make_partitioner(const sstring& class_name, unsigned shard_count, unsigned ignore_msb)
+{
+    return create_object<i_partitioner, const unsigned&, const unsigned&>(class_name, shard_count, ignore_msb);
+}
+
 void set_global_partitioner(const sstring& class_name, unsigned ignore_msb)
 {
     try {
-        default_partitioner = create_object<i_partitioner, const unsigned&, const unsigned&>(class_name, smp::count, ignore_msb);
+        default_partitioner = make_partitioner(class_name, smp::count, ignore_msb);
     } catch (std::exception& e) {
         auto supported_partitioners = ::join(", ", class_registry<i_partitioner>::classes() |
                 boost::adaptors::map_keys);
@@ -248,6 +248,13 @@ class i_partitioner {
     virtual token get_token(const schema& s, partition_key_view key) = 0;
     virtual token get_token(const sstables::key_view& key) = 0;
 
+    /**
+     * @return the tokens of the keys, in their order. Cheaper than getting
+     * them one by one, for partitioners which can hash many keys at once.
+     */
+    virtual std::vector<token> get_tokens(const schema& s, const std::vector<partition_key_view>& keys);
+    virtual std::vector<token> get_tokens(const std::vector<sstables::key_view>& keys);
+
 
     /**
      * @return a partitioner-specific string representation of this token
@@ -312,6 +319,29 @@ class i_partitioner {
      */
     virtual token token_for_next_shard(const token& t, shard_id shard, unsigned spans = 1) const = 0;
 
+    /**
+     * Splits the ring in nr_ranges ranges, the same on all nodes, and returns
+     * the one t falls in.
+     */
+    virtual unsigned ring_range_of(const token& t, unsigned nr_ranges) const {
+        if (t._kind != token::kind::key || t._data.empty()) {
+            return t._kind == token::kind::after_all_keys ? nr_ranges - 1 : 0;
+        }
+        return uint8_t(t._data[0]) * nr_ranges / 256;
+    }
+
+    /**
+     * Returns the first token of the range of ring_range_of(), so that
+     * ring_range_of(ring_range_start(r, nr_ranges), nr_ranges) == r.
+     */
+    virtual token ring_range_start(unsigned range, unsigned nr_ranges) const {
+        if (range == 0) {
+            return minimum_token();
+        }
+        auto first = std::min<unsigned>((range * 256 + nr_ranges - 1) / nr_ranges, 255);
+        return token(token::kind::key, managed_bytes({int8_t(first)}));
+    }
+
     /**
      * Gets the first shard of the minimum token.
      */
@@ -350,6 +380,13 @@ class i_partitioner {
         return _shard_count;
     }
 
+    /**
+     * @return number of most significant token bits ignored when computing the shard of a token
+     */
+    virtual unsigned sharding_ignore_msb() const {
+        return 0;
+    }
+
     friend bool operator==(const token& t1, const token& t2);
     friend bool operator<(const token& t1, const token& t2);
     friend int tri_compare(const token& t1, const token& t2);
@@ -595,6 +632,9 @@ std::ostream& operator<<(std::ostream& out, const token& t);
 std::ostream& operator<<(std::ostream& out, const decorated_key& t);
 
 void set_global_partitioner(const sstring& class_name, unsigned ignore_msb = 0);
+// A partitioner of the given class for another shard count, like the one of
+// another node.
+std::unique_ptr<i_partitioner> make_partitioner(const sstring& class_name, unsigned shard_count, unsigned ignore_msb);
 i_partitioner& global_partitioner();
 
 unsigned shard_of(const token&);
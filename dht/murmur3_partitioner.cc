@@ -25,6 +25,7 @@
 #include "utils/class_registrator.hh"
 #include <boost/lexical_cast.hpp>
 #include <boost/range/irange.hpp>
+#include <boost/range/adaptor/transformed.hpp>
 
 namespace dht {
 
@@ -100,6 +101,52 @@ murmur3_partitioner::get_token(const schema& s, partition_key_view key) {
     return get_token(hash[0]);
 }
 
+std::vector<token>
+murmur3_partitioner::get_tokens(const std::vector<bytes_view>& keys) {
+    std::vector<std::array<uint64_t, 2>> hashes;
+    utils::murmur_hash::hash3_x64_128(keys, 0, hashes);
+    std::vector<token> tokens;
+    tokens.reserve(keys.size());
+    for (size_t i = 0; i < keys.size(); ++i) {
+        tokens.push_back(keys[i].empty() ? minimum_token() : get_token(hashes[i][0]));
+    }
+    return tokens;
+}
+
+std::vector<token>
+murmur3_partitioner::get_tokens(const std::vector<sstables::key_view>& keys) {
+    return get_tokens(boost::copy_range<std::vector<bytes_view>>(keys | boost::adaptors::transformed([] (const sstables::key_view& key) {
+        return bytes_view(key);
+    })));
+}
+
+std::vector<token>
+murmur3_partitioner::get_tokens(const schema& s, const std::vector<partition_key_view>& keys) {
+    std::vector<bytes_view> legacy_keys;
+    legacy_keys.reserve(keys.size());
+    // The legacy form of a single component key is the component itself.
+    // That of a compound key is linearized, in the order of the keys.
+    std::vector<bytes> linearized;
+    if (s.partition_key_size() == 1) {
+        for (auto&& key : keys) {
+            legacy_keys.push_back(*key.begin(s));
+        }
+    } else {
+        linearized.reserve(keys.size());
+        for (auto&& key : keys) {
+            auto&& legacy = key.legacy_form(s);
+            linearized.emplace_back(bytes::initialized_later(), legacy.size());
+            std::copy(legacy.begin(), legacy.end(), linearized.back().begin());
+            legacy_keys.push_back(linearized.back());
+        }
+    }
+    std::vector<std::array<uint64_t, 2>> hashes;
+    utils::murmur_hash::hash3_x64_128(legacy_keys, 0, hashes);
+    return boost::copy_range<std::vector<token>>(hashes | boost::adaptors::transformed([this] (const std::array<uint64_t, 2>& hash) {
+        return get_token(hash[0]);
+    }));
+}
+
 token murmur3_partitioner::get_random_token() {
     auto rand = dht::get_random_number<uint64_t>();
     return get_token(rand);
@@ -257,6 +304,27 @@ murmur3_partitioner::shard_of(const token& t) const {
     abort();
 }
 
+unsigned
+murmur3_partitioner::ring_range_of(const token& t, unsigned nr_ranges) const {
+    switch (t._kind) {
+        case token::kind::before_all_keys:
+            return 0;
+        case token::kind::after_all_keys:
+            return nr_ranges - 1;
+        case token::kind::key:
+            return (uint128_t(unbias(t)) * nr_ranges) >> 64;
+    }
+    abort();
+}
+
+token
+murmur3_partitioner::ring_range_start(unsigned range, unsigned nr_ranges) const {
+    if (range == 0) {
+        return minimum_token();
+    }
+    return bias(((uint128_t(range) << 64) + nr_ranges - 1) / nr_ranges);
+}
+
 token
 murmur3_partitioner::token_for_next_shard(const token& t, shard_id shard, unsigned spans) const {
     uint64_t n = 0;
@@ -40,6 +40,8 @@ class murmur3_partitioner final : public i_partitioner {
     virtual const sstring name() const { return "org.apache.cassandra.dht.Murmur3Partitioner"; }
     virtual token get_token(const schema& s, partition_key_view key) override;
     virtual token get_token(const sstables::key_view& key) override;
+    virtual std::vector<token> get_tokens(const schema& s, const std::vector<partition_key_view>& keys) override;
+    virtual std::vector<token> get_tokens(const std::vector<sstables::key_view>& keys) override;
     virtual token get_random_token() override;
     virtual bool preserves_order() override { return false; }
     virtual std::map<token, float> describe_ownership(const std::vector<token>& sorted_tokens) override;
@@ -52,10 +54,16 @@ class murmur3_partitioner final : public i_partitioner {
 
     virtual unsigned shard_of(const token& t) const override;
     virtual token token_for_next_shard(const token& t, shard_id shard, unsigned spans) const override;
+    virtual unsigned ring_range_of(const token& t, unsigned nr_ranges) const override;
+    virtual token ring_range_start(unsigned range, unsigned nr_ranges) const override;
+    virtual unsigned sharding_ignore_msb() const override {
+        return _sharding_ignore_msb_bits;
+    }
 private:
     using uint128_t = unsigned __int128;
     static int64_t normalize(int64_t in);
     token get_token(bytes_view key);
+    std::vector<token> get_tokens(const std::vector<bytes_view>& keys);
     token get_token(uint64_t value) const;
     token bias(uint64_t value) const;      // translate from a zero-baed range
     uint64_t unbias(const token& t) const; // translate to a zero-baed range
@@ -45,7 +45,9 @@
 #include "log.hh"
 #include "streaming/stream_plan.hh"
 #include "streaming/stream_state.hh"
+#include "streaming/stream_manager.hh"
 #include "service/storage_service.hh"
+#include "db/system_keyspace.hh"
 
 namespace dht {
 
@@ -263,8 +265,39 @@ void range_streamer::add_ranges(const sstring& keyspace_name, dht::token_range_v
     _to_stream.emplace(keyspace_name, std::move(range_fetch_map));
 }
 
+void range_streamer::skip_available_ranges() {
+    for (auto& stream : _to_stream) {
+        const auto& keyspace = stream.first;
+        auto available = db::system_keyspace::get_available_ranges(keyspace).get0();
+        if (available.empty()) {
+            continue;
+        }
+        for (auto& ip_range : stream.second) {
+            auto& range_vec = ip_range.second;
+            auto nr_ranges = range_vec.size();
+            range_vec.erase(std::remove_if(range_vec.begin(), range_vec.end(), [&available] (const dht::token_range& r) {
+                return std::any_of(available.begin(), available.end(), [&r] (const dht::token_range& a) {
+                    return a.contains(r, dht::tri_compare);
+                });
+            }), range_vec.end());
+            logger.info("{} with {} for keyspace={}: skipping {} out of {} ranges, received by an earlier run",
+                    _description, ip_range.first, keyspace, nr_ranges - range_vec.size(), nr_ranges);
+        }
+    }
+}
+
+future<> range_streamer::update_available_ranges(const sstring& keyspace, const dht::token_range_vector& ranges) {
+    if (!_resumable || !_nr_rx_added) {
+        return make_ready_future<>();
+    }
+    return db::system_keyspace::update_available_ranges(keyspace, ranges);
+}
+
 future<> range_streamer::stream_async() {
     return seastar::async([this] {
+        if (_resumable && _nr_rx_added) {
+            skip_available_ranges();
+        }
         int sleep_time = 60;
         for (;;) {
             try {
@@ -279,6 +312,11 @@ future<> range_streamer::stream_async() {
                 }
             }
         }
+        if (_resumable && _nr_rx_added) {
+            for (auto& stream : _to_stream) {
+                db::system_keyspace::reset_available_ranges(stream.first).get();
+            }
+        }
     });
 }
 
@@ -300,8 +338,11 @@ future<> range_streamer::do_stream_async() {
                 unsigned sp_index = 0;
                 unsigned nr_ranges_streamed = 0;
                 size_t nr_ranges_total = range_vec.size();
-                dht::token_range_vector ranges_to_stream;
-                auto do_streaming = [&] {
+                // Up to plans_per_peer stream plans run with the peer at a time.
+                auto plans_per_peer = std::max(1u, streaming::get_local_stream_manager().get_limits().plans_per_peer);
+                semaphore plans_limiter(plans_per_peer);
+                std::exception_ptr error;
+                auto do_streaming = [&] (dht::token_range_vector ranges_to_stream) {
                     auto sp = stream_plan(sprint("%s-%s-index-%d", description, keyspace, sp_index++));
                     logger.info("{} with {} for keyspace={}, {} out of {} ranges: ranges = {}",
                             description, source, keyspace, nr_ranges_streamed, nr_ranges_total, ranges_to_stream.size());
@@ -310,30 +351,42 @@ future<> range_streamer::do_stream_async() {
                     } else if (_nr_tx_added) {
                         sp.transfer_ranges(source, keyspace, ranges_to_stream, _column_families[keyspace]);
                     }
-                    sp.execute().discard_result().get();
-                    ranges_to_stream.clear();
-                };
-                try {
-                    for (auto it = range_vec.begin(); it < range_vec.end();) {
-                        ranges_to_stream.push_back(*it);
-                        it = range_vec.erase(it);
-                        nr_ranges_streamed++;
-                        if (ranges_to_stream.size() < _nr_ranges_per_stream_plan) {
-                            continue;
-                        } else {
-                            do_streaming();
+                    auto received = ranges_to_stream;
+                    return futurize<stream_state>::apply([&sp] {
+                        return sp.execute();
+                    }).then([this, keyspace, received = std::move(received)] (stream_state) {
+                        // The plan's ranges are complete, so a later run skips them.
+                        return update_available_ranges(keyspace, received);
+                    }).handle_exception([&, ranges_to_stream = std::move(ranges_to_stream)] (std::exception_ptr ep) {
+                        // The ranges of a failed plan are streamed again on retry.
+                        for (auto& range : ranges_to_stream) {
+                            range_vec.push_back(range);
                         }
+                        if (!error) {
+                            error = ep;
+                        }
+                    }).finally([&plans_limiter] {
+                        plans_limiter.signal();
+                    });
+                };
+                std::vector<future<>> plans;
+                while (!range_vec.empty() && !error) {
+                    plans_limiter.wait().get();
+                    if (error) {
+                        plans_limiter.signal();
+                        break;
                     }
-                    if (ranges_to_stream.size() > 0) {
-                        do_streaming();
-                    }
-                } catch (...) {
-                    for (auto& range : ranges_to_stream) {
-                        range_vec.push_back(range);
-                    }
+                    auto n = std::min<size_t>(range_vec.size(), _nr_ranges_per_stream_plan);
+                    dht::token_range_vector ranges_to_stream(range_vec.begin(), range_vec.begin() + n);
+                    range_vec.erase(range_vec.begin(), range_vec.begin() + n);
+                    nr_ranges_streamed += n;
+                    plans.push_back(do_streaming(std::move(ranges_to_stream)));
+                }
+                when_all(plans.begin(), plans.end()).get();
+                if (error) {
                     auto t = std::chrono::duration_cast<std::chrono::seconds>(lowres_clock::now() - start_time).count();
-                    logger.warn("{} with {} for keyspace={} failed, took {} seconds: {}", description, keyspace, source, t, std::current_exception());
-                    throw;
+                    logger.warn("{} with {} for keyspace={} failed, took {} seconds: {}", description, source, keyspace, t, error);
+                    std::rethrow_exception(error);
                 }
                 auto t = std::chrono::duration_cast<std::chrono::seconds>(lowres_clock::now() - start_time).count();
                 logger.info("{} with {} for keyspace={} succeeded, took {} seconds", description, keyspace, source, t);
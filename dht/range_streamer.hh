@@ -118,6 +118,13 @@ class range_streamer {
         _source_filters.emplace(std::move(filter));
     }
 
+    // Records the ranges received in system.available_ranges as their stream
+    // plans complete, and skips those recorded by an earlier run which was
+    // interrupted, so that retrying it only streams what is missing.
+    void set_resumable() {
+        _resumable = true;
+    }
+
     void add_ranges(const sstring& keyspace_name, dht::token_range_vector ranges);
     void add_tx_ranges(const sstring& keyspace_name, std::unordered_map<inet_address, dht::token_range_vector> ranges_per_endpoint, std::vector<sstring> column_families = {});
     void add_rx_ranges(const sstring& keyspace_name, std::unordered_map<inet_address, dht::token_range_vector> ranges_per_endpoint, std::vector<sstring> column_families = {});
@@ -165,6 +172,9 @@ class range_streamer {
     future<> do_stream_async();
     size_t nr_ranges_to_stream();
 private:
+    // Must be called in a seastar thread.
+    void skip_available_ranges();
+    future<> update_available_ranges(const sstring& keyspace, const dht::token_range_vector& ranges);
     distributed<database>& _db;
     token_metadata& _metadata;
     std::unordered_set<token> _tokens;
@@ -182,6 +192,7 @@ class range_streamer {
     // Number of tx and rx ranges added
     unsigned _nr_tx_added = 0;
     unsigned _nr_rx_added = 0;
+    bool _resumable = false;
 };
 
 } // dht
@@ -26,6 +26,7 @@
 #include <seastar/core/future.hh>
 #include <seastar/core/metrics_registration.hh>
 #include <seastar/core/semaphore.hh>
+#include <seastar/core/timer.hh>
 #include "database_fwd.hh"
 #include "utils/logalloc.hh"
 
@@ -71,6 +72,13 @@ class flush_permit {
     future<flush_permit> reacquire_sstable_write_permit() &&;
 };
 
+// The admission clock of the writes of a table, see dirty_memory_manager::write_delay().
+class write_throttle {
+    friend class dirty_memory_manager;
+    std::chrono::steady_clock::time_point _next_admission;
+    uint64_t _period = 0;
+};
+
 class dirty_memory_manager: public logalloc::region_group_reclaimer {
     // We need a separate boolean, because from the LSA point of view, pressure may still be
     // mounting, in which case the pressure flag could be set back on if we force it off.
@@ -93,9 +101,31 @@ class dirty_memory_manager: public logalloc::region_group_reclaimer {
     // is mostly about dangling continuations. So that doesn't have to be a small number.
     static constexpr unsigned _max_background_work = 20;
     semaphore _background_work_flush_serializer = { _max_background_work };
+    // Bounds on the number of data file buffers a flush keeps in flight, see flush_write_behind().
+    static constexpr size_t _min_flush_write_behind = 10;
+    static constexpr size_t _max_flush_write_behind = 64;
+    // The buffers in flight may take up to this fraction of the dirty memory threshold.
+    static constexpr size_t _flush_write_behind_fraction = 64;
     condition_variable _should_flush;
     int64_t _dirty_bytes_released_pre_accounted = 0;
 
+    // The flush bandwidth is estimated every period from the memory virtually freed by flushes.
+    static constexpr std::chrono::milliseconds _throttle_period{100};
+    static constexpr double _flush_bandwidth_smoothing = 0.2;
+    // Writes are never delayed longer, whatever their rate, since region_group blocks them
+    // anyway at the hard limit.
+    static constexpr std::chrono::milliseconds _max_write_delay{100};
+    timer<> _throttle_timer;
+    // In bytes per second, 0 until a flush was seen.
+    double _flush_bandwidth = 0;
+    int64_t _bytes_flushed_in_period = 0;
+    uint64_t _throttle_period = 1;
+    unsigned _tables_written_in_period = 0;
+    unsigned _tables_written = 1;
+    uint64_t _delayed_writes = 0;
+
+    void update_flush_bandwidth();
+
     future<> flush_when_needed();
 
     future<> _waiting_flush;
@@ -143,12 +173,24 @@ class dirty_memory_manager: public logalloc::region_group_reclaimer {
     //
     // We then set the soft limit to 80 % of the virtual dirty hard limit, which is equal to 40 % of
     // the user-supplied threshold.
+    //
+    // Write Throttling
+    // ----------------
+    // Above the soft limit, writes are delayed so that they are admitted at a rate which falls
+    // from twice the estimated flush bandwidth at the soft limit to nothing at the hard limit.
+    // Latency then grows with virtual dirty memory, and the hard limit, at which region_group
+    // blocks writes until a flush frees memory, is rarely reached. Each table which wrote in the
+    // last period can write at an equal part of that rate, so that a table writing a lot delays
+    // its own writes more than those of the others.
     dirty_memory_manager(database& db, size_t threshold, double soft_limit)
         : logalloc::region_group_reclaimer(threshold / 2, threshold * soft_limit / 2)
         , _db(&db)
         , _region_group(*this)
         , _flush_serializer(1)
-        , _waiting_flush(flush_when_needed()) {}
+        , _throttle_timer([this] { update_flush_bandwidth(); })
+        , _waiting_flush(flush_when_needed()) {
+        _throttle_timer.arm_periodic(_throttle_period);
+    }
 
     dirty_memory_manager() : logalloc::region_group_reclaimer()
         , _db(nullptr)
@@ -171,11 +213,13 @@ class dirty_memory_manager: public logalloc::region_group_reclaimer {
     void revert_potentially_cleaned_up_memory(logalloc::region* from, int64_t delta) {
         _region_group.update(delta);
         _dirty_bytes_released_pre_accounted -= delta;
+        _bytes_flushed_in_period -= delta;
     }
 
     void account_potentially_cleaned_up_memory(logalloc::region* from, int64_t delta) {
         _region_group.update(-delta);
         _dirty_bytes_released_pre_accounted += delta;
+        _bytes_flushed_in_period += delta;
     }
 
     size_t real_dirty_memory() const {
@@ -188,6 +232,23 @@ class dirty_memory_manager: public logalloc::region_group_reclaimer {
 
     future<> flush_one(memtable_list& cf, flush_permit&& permit);
 
+    // How long a write of the given size to the table of the throttle should wait before it is
+    // applied, see Write Throttling above. Charges the write to the throttle.
+    std::chrono::steady_clock::duration write_delay(write_throttle& throttle, size_t size);
+
+    uint64_t delayed_writes() const {
+        return _delayed_writes;
+    }
+
+    // How many buffers of the given size a memtable flush may have in flight to the disk.
+    // Serializing and compressing the next buffers overlaps with writing those, so that a
+    // flush is limited by the disk rather than by CPU and disk taking turns. Since only one
+    // flush writes data at a time, this also bounds the memory held by in-flight writes.
+    unsigned flush_write_behind(size_t buffer_size) const {
+        auto buffers = throttle_threshold() / _flush_write_behind_fraction / buffer_size;
+        return std::max(_min_flush_write_behind, std::min(_max_flush_write_behind, buffers));
+    }
+
     future<flush_permit> get_flush_permit() {
         return get_units(_background_work_flush_serializer, 1).then([this] (auto&& units) {
             return this->get_flush_permit(std::move(units));
@@ -164,6 +164,8 @@ struct mutation_write_timeout_exception : public request_timeout_exception {
 struct overloaded_exception : public cassandra_exception {
     overloaded_exception(size_t c) noexcept :
         cassandra_exception(exception_code::OVERLOADED, prepare_message("Too many in flight hints: %lu", c)) {}
+    overloaded_exception(sstring msg) noexcept :
+        cassandra_exception(exception_code::OVERLOADED, std::move(msg)) {}
 };
 
 class request_validation_exception : public cassandra_exception {
@@ -68,7 +68,6 @@ class flat_mutation_reader final {
     class impl {
         circular_buffer<mutation_fragment> _buffer;
         size_t _buffer_size = 0;
-        bool _consume_done = false;
     protected:
         static constexpr size_t max_buffer_size_in_bytes = 8 * 1024;
         bool _end_of_stream = false;
@@ -117,15 +116,21 @@ class flat_mutation_reader final {
         // Stops when consumer returns stop_iteration::yes or end of stream is reached.
         // Next call will start from the next mutation_fragment in the stream.
         future<> consume_pausable(Consumer consumer) {
-            _consume_done = false;
-            return do_until([this] { return (is_end_of_stream() && is_buffer_empty()) || _consume_done; }, [this, consumer = std::move(consumer)] () mutable {
+            return repeat([this, consumer = std::move(consumer)] () mutable {
                 if (is_buffer_empty()) {
-                    return fill_buffer();
+                    if (is_end_of_stream()) {
+                        return make_ready_future<stop_iteration>(stop_iteration::yes);
+                    }
+                    return fill_buffer().then([] { return stop_iteration::no; });
                 }
-
-                _consume_done = consumer(pop_mutation_fragment()) == stop_iteration::yes;
-
-                return make_ready_future<>();
+                // The whole buffer is consumed without a continuation per
+                // fragment.
+                while (!is_buffer_empty()) {
+                    if (consumer(pop_mutation_fragment()) == stop_iteration::yes) {
+                        return make_ready_future<stop_iteration>(stop_iteration::yes);
+                    }
+                }
+                return make_ready_future<stop_iteration>(stop_iteration::no);
             });
         }
 
@@ -219,6 +224,9 @@ class flat_mutation_reader final {
         return _impl->consume(std::move(consumer));
     }
 
+    // Must not be called when the buffer is empty.
+    mutation_fragment pop_mutation_fragment() { return _impl->pop_mutation_fragment(); }
+
     void next_partition() { _impl->next_partition(); }
 
     future<> fill_buffer() { return _impl->fill_buffer(); }
@@ -60,8 +60,8 @@ enum class application_state {
     SUPPORTED_FEATURES,
     CACHE_HITRATES,
     SCHEMA_TABLES_VERSION,
+    SHARDING,
     // pad to allow adding new states to existing cluster
-    X4,
     X5,
     X6,
     X7,
@@ -61,6 +61,7 @@
 #include "dht/i_partitioner.hh"
 #include <boost/range/algorithm/set_algorithm.hpp>
 #include <boost/range/adaptors.hpp>
+#include <boost/range/algorithm/count_if.hpp>
 
 namespace gms {
 
@@ -249,6 +250,14 @@ future<> gossiper::handle_ack_msg(msg_addr id, gossip_digest_ack ack_msg) {
     auto g_digest_list = ack_msg.get_gossip_digest_list();
     auto& ep_state_map = ack_msg.get_endpoint_state_map();
 
+    if (_tracking_convergence && _seeds.count(id.addr)) {
+        if (is_converged_with(ep_state_map)) {
+            _converged_seeds.insert(id.addr);
+        } else {
+            _converged_seeds.erase(id.addr);
+        }
+    }
+
     auto f = make_ready_future<>();
     if (ep_state_map.size() > 0) {
         /* Notify the Failure Detector */
@@ -833,6 +842,7 @@ void gossiper::evict_from_membership(inet_address endpoint) {
         g.endpoint_state_map.erase(endpoint);
     }).get();
     _expire_time_endpoint_map.erase(endpoint);
+    _digest_state_versions.erase(endpoint);
     get_local_failure_detector().remove(endpoint);
     quarantine_endpoint(endpoint);
     logger.debug("evicting {} from gossip", endpoint);
@@ -869,6 +879,11 @@ void gossiper::make_random_gossip_digest(std::vector<gossip_digest>& g_digests)
         endpoints.push_back(x.first);
     }
     std::shuffle(endpoints.begin(), endpoints.end(), _random_engine);
+    auto& cfg = service::get_local_storage_service().db().local().get_config();
+    size_t max_digests = cfg.gossip_max_digests_per_syn();
+    if (max_digests && endpoints.size() > max_digests) {
+        endpoints = select_digest_endpoints(std::move(endpoints), max_digests);
+    }
     for (auto& endpoint : endpoints) {
         auto es = get_endpoint_state_for_endpoint_ptr(endpoint);
         if (es) {
@@ -891,6 +906,55 @@ void gossiper::make_random_gossip_digest(std::vector<gossip_digest>& g_digests)
 #endif
 }
 
+// The number of rounds an endpoint whose application states changed is
+// favoured in bounded digests.
+static constexpr unsigned digest_recent_change_rounds = 10;
+
+std::vector<inet_address> gossiper::select_digest_endpoints(std::vector<inet_address> endpoints, size_t max_digests) {
+    ++_digest_round;
+    std::vector<inet_address> selected;
+    std::unordered_set<inet_address> taken;
+    auto take = [&] (inet_address ep) {
+        if (selected.size() < max_digests && taken.insert(ep).second) {
+            selected.push_back(ep);
+        }
+    };
+    // Nobody else spreads our heartbeat as fresh as we do.
+    take(get_broadcast_address());
+    // Then the endpoints whose states changed lately, in random order, so
+    // that changes spread within a few rounds. The heartbeat is left out,
+    // as it changes every round.
+    auto recent_budget = std::max<size_t>(1, max_digests / 2);
+    for (auto& ep : endpoints) {
+        auto es = get_endpoint_state_for_endpoint_ptr(ep);
+        if (!es) {
+            continue;
+        }
+        int generation = es->get_heart_beat_state().get_generation();
+        int version = 0;
+        for (auto& entry : es->get_application_state_map()) {
+            version = std::max(version, entry.second.version);
+        }
+        auto& sv = _digest_state_versions[ep];
+        if (sv.generation != generation || sv.version != version) {
+            sv = digest_state_version{generation, version, _digest_round};
+        }
+        if (_digest_round - sv.changed_round < digest_recent_change_rounds && selected.size() < recent_budget) {
+            take(ep);
+        }
+    }
+    // And the others in turn, so that every endpoint is in a digest at least
+    // once every endpoints.size() / max_digests rounds.
+    std::sort(endpoints.begin(), endpoints.end());
+    size_t i = 0;
+    for (; i < endpoints.size() && selected.size() < max_digests; ++i) {
+        take(endpoints[(_digest_cursor + i) % endpoints.size()]);
+    }
+    _digest_cursor = (_digest_cursor + i) % endpoints.size();
+    logger.trace("make_random_gossip_digest: {} out of {} endpoints", selected.size(), endpoints.size());
+    return selected;
+}
+
 future<> gossiper::replicate(inet_address ep, const endpoint_state& es) {
     return container().invoke_on_all([ep, es, orig = engine().cpu_id(), self = shared_from_this()] (gossiper& g) {
         if (engine().cpu_id() != orig) {
@@ -1849,6 +1913,36 @@ sstring gossiper::get_gossip_status(const inet_address& endpoint) const {
     return do_get_gossip_status(get_application_state_ptr(endpoint, application_state::STATUS));
 }
 
+bool gossiper::is_converged_with(const std::map<inet_address, endpoint_state>& remote_states) const {
+    for (auto&& e : remote_states) {
+        if (e.first == get_broadcast_address()) {
+            continue;
+        }
+        auto* local = get_endpoint_state_for_endpoint_ptr(e.first);
+        if (!local
+                || local->get_heart_beat_state().get_generation() != e.second.get_heart_beat_state().get_generation()
+                || !e.second.get_application_state_map().empty()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void gossiper::send_gossip_to_seeds() {
+    std::vector<gossip_digest> g_digests;
+    make_random_gossip_digest(g_digests);
+    gossip_digest_syn message(get_cluster_name(), get_partitioner_name(), g_digests);
+    for (auto&& seed : _seeds) {
+        if (seed == get_broadcast_address()) {
+            continue;
+        }
+        auto id = get_msg_addr(seed);
+        ms().send_gossip_digest_syn(id, message).handle_exception([id] (auto ep) {
+            logger.trace("Fail to send GossipDigestSyn to {}: {}", id, ep);
+        });
+    }
+}
+
 future<> gossiper::wait_for_gossip_to_settle() {
     return seastar::async([this] {
         auto& cfg = service::get_local_storage_service().db().local().get_config();
@@ -1862,12 +1956,32 @@ future<> gossiper::wait_for_gossip_to_settle() {
         int32_t total_polls = 0;
         int32_t num_okay = 0;
         int32_t ep_size = endpoint_state_map.size();
+        auto seeds = boost::count_if(_seeds, [this] (const inet_address& seed) { return seed != get_broadcast_address(); });
+        auto quorum = seeds / 2 + 1;
+        auto start = clk::now();
         logger.info("Waiting for gossip to settle before accepting client requests...");
-        sleep(GOSSIP_SETTLE_MIN_WAIT_MS).get();
-        while (num_okay < GOSSIP_SETTLE_POLL_SUCCESSES_REQUIRED) {
+        // Gossip has settled once a quorum of the seeds has nothing newer to
+        // tell us than heartbeats, and the endpoints found alive were marked
+        // so. Without other seeds to ask, or while they don't answer, it has
+        // once the number of known endpoints stops changing.
+        _converged_seeds.clear();
+        _tracking_convergence = true;
+        auto stop_tracking = seastar::defer([this] {
+            _tracking_convergence = false;
+            _converged_seeds.clear();
+        });
+        while (true) {
+            if (seeds) {
+                _converged_seeds.clear();
+                send_gossip_to_seeds();
+            }
             sleep(GOSSIP_SETTLE_POLL_INTERVAL_MS).get();
             int32_t current_size = endpoint_state_map.size();
             total_polls++;
+            if (seeds && _converged_seeds.size() >= size_t(quorum) && _pending_mark_alive_endpoints.empty()) {
+                logger.info("Gossip converged with {} of {} seeds after {} polls; proceeding", _converged_seeds.size(), seeds, total_polls);
+                break;
+            }
             if (current_size == ep_size) {
                 logger.debug("Gossip looks settled");
                 num_okay++;
@@ -1876,16 +1990,15 @@ future<> gossiper::wait_for_gossip_to_settle() {
                 num_okay = 0;
             }
             ep_size = current_size;
+            if (num_okay >= GOSSIP_SETTLE_POLL_SUCCESSES_REQUIRED && clk::now() - start >= GOSSIP_SETTLE_MIN_WAIT_MS) {
+                logger.info("Gossip settled after {} polls; proceeding", total_polls);
+                break;
+            }
             if (force_after > 0 && total_polls > force_after) {
                 logger.warn("Gossip not settled but startup forced by skip_wait_for_gossip_to_settle. Gossp total polls: {}", total_polls);
                 break;
             }
         }
-        if (total_polls > GOSSIP_SETTLE_POLL_SUCCESSES_REQUIRED) {
-            logger.info("Gossip settled after {} extra polls; proceeding", total_polls - GOSSIP_SETTLE_POLL_SUCCESSES_REQUIRED);
-        } else {
-            logger.info("No gossip backlog; proceeding");
-        }
     });
 }
 
@@ -339,6 +339,24 @@ class gossiper : public i_failure_detection_event_listener, public seastar::asyn
      */
     void make_random_gossip_digest(std::vector<gossip_digest>& g_digests);
 
+    /**
+     * Chooses the endpoints a digest bounded to max_digests covers: the
+     * local one, some whose application states changed lately, and the
+     * others in turn.
+     */
+    std::vector<inet_address> select_digest_endpoints(std::vector<inet_address> endpoints, size_t max_digests);
+
+    struct digest_state_version {
+        int generation = 0;
+        int version = 0;
+        unsigned changed_round = 0;
+    };
+    // The last application state version seen of each endpoint, and the digest round it was first seen in.
+    std::unordered_map<inet_address, digest_state_version> _digest_state_versions;
+    unsigned _digest_round = 0;
+    // Where the endpoints taken in turn into bounded digests start from next.
+    size_t _digest_cursor = 0;
+
 public:
     /**
      * This method will begin removing an existing endpoint from the cluster by spoofing its state
@@ -540,6 +558,15 @@ class gossiper : public i_failure_detection_event_listener, public seastar::asyn
     sstring get_gossip_status(const inet_address& endpoint) const;
 public:
     future<> wait_for_gossip_to_settle();
+private:
+    // Whether the states in an ACK to our SYN are only heartbeats of
+    // endpoints we know the current generation of.
+    bool is_converged_with(const std::map<inet_address, endpoint_state>& remote_states) const;
+    void send_gossip_to_seeds();
+    // While waiting for gossip to settle: the seeds whose last ACK had
+    // nothing newer than what we know but heartbeats.
+    bool _tracking_convergence = false;
+    std::unordered_set<inet_address> _converged_seeds;
 private:
     uint64_t _nr_run = 0;
     bool _ms_registered = false;
@@ -246,6 +246,12 @@ class versioned_value {
             return versioned_value(hitrates);
         }
 
+        // The shard count, the sharding ignored msb bits and the port of shard 0.
+        versioned_value sharding(unsigned shard_count, unsigned sharding_ignore_msb, uint16_t shard_port) {
+            return versioned_value(to_sstring(shard_count) + sstring(DELIMITER_STR) +
+                to_sstring(sharding_ignore_msb) + sstring(DELIMITER_STR) + to_sstring(shard_port));
+        }
+
     };
 }; // class versioned_value
 
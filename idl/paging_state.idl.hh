@@ -4,6 +4,8 @@ class paging_state {
     partition_key get_partition_key();
     std::experimental::optional<clustering_key> get_clustering_key();
     uint32_t get_remaining();
+    uint32_t get_remaining_in_partition() [[version 2.1]] = std::numeric_limits<uint32_t>::max();
+    utils::UUID get_query_uuid() [[version 2.2]] = utils::UUID();
 };
 }
 }
@@ -22,8 +22,25 @@
 enum class repair_checksum : uint8_t {
     legacy = 0,
     streamed = 1,
+    streamed_murmur3 = 2,
 };
 
 class partition_checksum {
   std::array<uint8_t, 32> digest();
 };
+
+enum class partition_region : uint8_t {
+    partition_start,
+    static_row,
+    clustered,
+    partition_end,
+};
+
+class repair_row_hash {
+    dht::token token();
+    partition_key key();
+    partition_region region();
+    int32_t bound_weight();
+    std::experimental::optional<clustering_key_prefix> ckey();
+    uint64_t hash();
+};
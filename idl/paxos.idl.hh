@@ -0,0 +1,39 @@
+/*
+ * Copyright 2018 ScyllaDB
+ */
+
+/*
+ * This file is part of Scylla.
+ *
+ * Scylla is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Scylla is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+namespace service {
+namespace paxos {
+
+class proposal {
+    utils::UUID ballot;
+    frozen_mutation update;
+};
+
+class prepare_response {
+    bool promised;
+    utils::UUID most_recent_promised_ballot;
+    std::experimental::optional<service::paxos::proposal> accepted_proposal;
+    std::experimental::optional<service::paxos::proposal> most_recent_commit;
+    std::experimental::optional<query::result> data;
+};
+
+}
+}
@@ -11,7 +11,12 @@ class qr_cell stub [[writable]] {
 };
 
 class qr_row stub [[writable]] {
-    std::vector<std::experimental::optional<qr_cell>> cells; // ordered as requested in partition_slice
+    std::vector<std::experimental::optional<qr_cell>> cells; // ordered as requested in partition_slice, empty when compact_rows option set
+
+    // Present when compact_rows option set in partition_slice. The values of the cells, ordered as requested
+    // in partition_slice, each eight of them preceded by a byte with bit i set if the i-th of them is present.
+    // A present value is written as its little endian uint32_t size, followed by the value, see compact_row_writer.
+    bytes compact_cells [[version 2.2]];
 };
 
 class qr_clustered_row stub [[writable]] {
@@ -32,6 +37,7 @@ class query_result stub [[writable]] {
 enum class digest_algorithm : uint8_t {
     none = 0,  // digest not required
     MD5 = 1,   // default algorithm
+    MURMUR3 = 2, // 128-bit MurmurHash3, used once all nodes support it
 };
 
 }
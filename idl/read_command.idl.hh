@@ -30,6 +30,25 @@ class specific_ranges {
     std::vector<nonwrapping_range<clustering_key_prefix>> ranges();
 };
 
+enum class restriction_op : uint8_t {
+    eq,
+    in,
+    lt,
+    lte,
+    gt,
+    gte,
+    contains,
+    contains_key,
+    entry_eq,
+};
+
+struct column_restriction {
+    bool is_static;
+    uint32_t column;
+    query::restriction_op op;
+    std::vector<std::experimental::optional<bytes>> values;
+};
+
 class partition_slice {
     std::vector<nonwrapping_range<clustering_key_prefix>> default_row_ranges();
     std::vector<uint32_t> static_columns;
@@ -38,6 +57,7 @@ class partition_slice {
     std::unique_ptr<query::specific_ranges> get_specific_ranges();
     cql_serialization_format cql_format();
     uint32_t partition_row_limit() [[version 1.3]] = std::numeric_limits<uint32_t>::max();
+    std::vector<query::column_restriction> filters() [[version 2.2]] = std::vector<query::column_restriction>();
 };
 
 class read_command {
@@ -48,6 +68,15 @@ class read_command {
     std::chrono::time_point<gc_clock, gc_clock::duration> timestamp;
     std::experimental::optional<tracing::trace_info> trace_info [[version 1.3]];
     uint32_t partition_limit [[version 1.3]] = std::numeric_limits<uint32_t>::max();
+    utils::UUID query_uuid [[version 2.2]] = utils::UUID();
+    bool is_first_page [[version 2.2]] = false;
+    sstring service_level [[version 2.2]] = sstring();
+    uint64_t max_result_size [[version 2.2]] = 0;
+};
+
+struct aggregate_selector {
+    sstring function_name;
+    std::vector<sstring> column_names;
 };
 
 }
@@ -46,6 +46,7 @@
 #include "db/query_context.hh"
 #include "schema_builder.hh"
 #include "database.hh"
+#include "db/index/secondary_index.hh"
 
 #include <boost/range/adaptor/map.hpp>
 
@@ -68,6 +69,15 @@ const index_metadata& index::metadata() const {
     return _im;
 }
 
+bool index::is_local() const {
+    return is_local_index(_im);
+}
+
+bool is_local_index(const index_metadata& im) {
+    auto it = im.options().find(db::index::secondary_index::local_index_option_name);
+    return it != im.options().end() && it->second == "true";
+}
+
 secondary_index_manager::secondary_index_manager(column_family& cf)
     : _cf{cf}
 {}
@@ -104,9 +114,18 @@ view_ptr secondary_index_manager::create_view_for_index(const index_metadata& im
     if (target_type != cql3::statements::index_target::target_type::values) {
         throw std::runtime_error(sprint("Unsupported index target type: %s", to_sstring(target_type)));
     }
-    builder.with_column(index_target->name(), index_target->type, column_kind::partition_key);
-    for (auto& col : schema->partition_key_columns()) {
-        builder.with_column(col.name(), col.type, column_kind::clustering_key);
+    if (is_local_index(im)) {
+        // The entries of a partition are in a partition of the same key,
+        // clustered by the value first.
+        for (auto& col : schema->partition_key_columns()) {
+            builder.with_column(col.name(), col.type, column_kind::partition_key);
+        }
+        builder.with_column(index_target->name(), index_target->type, column_kind::clustering_key);
+    } else {
+        builder.with_column(index_target->name(), index_target->type, column_kind::partition_key);
+        for (auto& col : schema->partition_key_columns()) {
+            builder.with_column(col.name(), col.type, column_kind::clustering_key);
+        }
     }
     for (auto& col : schema->clustering_key_columns()) {
         if (col == *index_target) {
@@ -58,8 +58,14 @@ class index {
     bool depends_on(const column_definition& cdef) const;
     bool supports_expression(const column_definition& cdef, const cql3::operator_type& op) const;
     const index_metadata& metadata() const;
+    /// Whether the index is partitioned like its table, the entries of a
+    /// partition being in a partition of the same key, on the same replicas,
+    /// rather than in a partition of the indexed value.
+    bool is_local() const;
 };
 
+bool is_local_index(const index_metadata& im);
+
 class secondary_index_manager {
     column_family& _cf;
     /// The key of the map is the name of the index as stored in system tables.
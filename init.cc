@@ -43,6 +43,7 @@ void init_storage_service(distributed<database>& db) {
 void init_ms_fd_gossiper(sstring listen_address_in
                 , uint16_t storage_port
                 , uint16_t ssl_storage_port
+                , uint16_t storage_shard_port
                 , bool tcp_nodelay_inter_dc
                 , sstring ms_encrypt_what
                 , sstring ms_trust_store
@@ -51,6 +52,11 @@ void init_ms_fd_gossiper(sstring listen_address_in
                 , sstring ms_tls_prio
                 , bool ms_client_auth
                 , sstring ms_compress
+                , bool ms_compress_gossip
+                , const std::unordered_map<sstring, sstring>& ms_compress_per_class
+                , const std::unordered_map<sstring, sstring>& ms_compression_algorithm_per_class
+                , size_t ms_compression_threshold
+                , const std::unordered_map<sstring, sstring>& tcp_nodelay_inter_dc_per_class
                 , db::seed_provider_type seed_provider
                 , sstring cluster_name
                 , double phi
@@ -84,6 +90,47 @@ void init_ms_fd_gossiper(sstring listen_address_in
         tndw = tcp_nodelay_what::local;
     }
 
+    using connection_class = netw::messaging_service::connection_class;
+    netw::messaging_service::connection_classes_options class_options;
+    auto class_of = [] (const sstring& name) {
+        static const std::unordered_map<sstring, connection_class> classes = {
+            { "reads", connection_class::reads },
+            { "writes", connection_class::writes },
+            { "maintenance", connection_class::maintenance },
+            { "streaming", connection_class::streaming },
+        };
+        auto it = classes.find(name);
+        if (it == classes.end()) {
+            throw std::runtime_error(sprint("Unknown internode connection class %s, supported classes = { reads, writes, maintenance, streaming }", name));
+        }
+        return size_t(it->second);
+    };
+    for (auto&& e : ms_compress_per_class) {
+        auto& options = class_options[class_of(e.first)];
+        if (e.second == "all") {
+            options.compress = compress_what::all;
+        } else if (e.second == "dc") {
+            options.compress = compress_what::dc;
+        } else {
+            options.compress = compress_what::none;
+        }
+    }
+    class_options[size_t(connection_class::streaming)].compression_algorithm = netw::rpc_compression_algorithm::zstd;
+    for (auto&& e : ms_compression_algorithm_per_class) {
+        auto& options = class_options[class_of(e.first)];
+        if (e.second == "zstd") {
+            options.compression_algorithm = netw::rpc_compression_algorithm::zstd;
+        } else {
+            options.compression_algorithm = netw::rpc_compression_algorithm::lz4;
+        }
+    }
+    for (auto& options : class_options) {
+        options.compression_threshold = ms_compression_threshold;
+    }
+    for (auto&& e : tcp_nodelay_inter_dc_per_class) {
+        class_options[class_of(e.first)].tcp_nodelay = e.second == "true" ? tcp_nodelay_what::all : tcp_nodelay_what::local;
+    }
+
     future<> f = make_ready_future<>();
     std::shared_ptr<credentials_builder> creds;
 
@@ -109,7 +156,7 @@ void init_ms_fd_gossiper(sstring listen_address_in
     // Init messaging_service
     // Delay listening messaging_service until gossip message handlers are registered
     bool listen_now = false;
-    netw::get_messaging_service().start(listen, storage_port, ew, cw, tndw, ssl_storage_port, creds, sltba, listen_now).get();
+    netw::get_messaging_service().start(listen, storage_port, ew, cw, ms_compress_gossip, tndw, ssl_storage_port, storage_shard_port, creds, sltba, listen_now, class_options).get();
 
     // #293 - do not stop anything
     //engine().at_exit([] { return netw::get_messaging_service().stop(); });
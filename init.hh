@@ -35,6 +35,7 @@ void init_storage_service(distributed<database>& db);
 void init_ms_fd_gossiper(sstring listen_address
                 , uint16_t storage_port
                 , uint16_t ssl_storage_port
+                , uint16_t storage_shard_port
                 , bool tcp_nodelay_inter_dc
                 , sstring ms_encrypt_what
                 , sstring ms_trust_store
@@ -43,6 +44,11 @@ void init_ms_fd_gossiper(sstring listen_address
                 , sstring ms_tls_prio
                 , bool ms_client_auth
                 , sstring ms_compress
+                , bool ms_compress_gossip
+                , const std::unordered_map<sstring, sstring>& ms_compress_per_class
+                , const std::unordered_map<sstring, sstring>& ms_compression_algorithm_per_class
+                , size_t ms_compression_threshold
+                , const std::unordered_map<sstring, sstring>& tcp_nodelay_inter_dc_per_class
                 , db::seed_provider_type seed_provider
                 , sstring cluster_name = "Test Cluster"
                 , double phi = 8
@@ -34,10 +34,10 @@ if [ "$ID" = "ubuntu" ]; then
 
     apt -y update
 
-    apt -y install libsystemd-dev python3-pyparsing libsnappy-dev libjsoncpp-dev libyaml-cpp-dev libthrift-dev antlr3-c++-dev antlr3 thrift-compiler
+    apt -y install libsystemd-dev python3-pyparsing libsnappy-dev libzstd-dev libjsoncpp-dev libyaml-cpp-dev libthrift-dev antlr3-c++-dev antlr3 thrift-compiler
 elif [ "$ID" = "debian" ]; then
-    apt -y install libyaml-cpp-dev libjsoncpp-dev libsnappy-dev
+    apt -y install libyaml-cpp-dev libjsoncpp-dev libsnappy-dev libzstd-dev
     echo antlr3 and thrift still missing - waiting for ppa
 elif [ "$ID" = "centos" ] || [ "$ID" = "fedora" ]; then
-    yum install -y yaml-cpp-devel thrift-devel antlr3-tool antlr3-C++-devel jsoncpp-devel snappy-devel
+    yum install -y yaml-cpp-devel thrift-devel antlr3-tool antlr3-C++-devel jsoncpp-devel snappy-devel libzstd-devel
 fi
@@ -69,6 +69,11 @@ class compound_view_wrapper {
         return get_compound_type(s)->deserialize_value(_bytes);
     }
 
+    // See compound_type::serialize_comparable().
+    bytes serialize_comparable(const schema& s) const {
+        return get_compound_type(s)->serialize_comparable(_bytes);
+    }
+
     bytes_view representation() const {
         return _bytes;
     }
@@ -223,6 +228,11 @@ class compound_wrapper {
         return get_compound_type(s)->deserialize_value(_bytes);
     }
 
+    // See compound_type::serialize_comparable().
+    bytes serialize_comparable(const schema& s) const {
+        return get_compound_type(s)->serialize_comparable(_bytes);
+    }
+
     std::vector<bytes> explode() const {
         std::vector<bytes> result;
         for (bytes_view c : components()) {
@@ -377,18 +387,18 @@ class prefix_view_on_full_compound {
 
         bool operator()(const prefix_view_on_full_compound& k1, const PrefixTopLevel& k2) const {
             return lexicographical_tri_compare(
-                prefix_type->types().begin(), prefix_type->types().end(),
+                prefix_type->comparators().begin(), prefix_type->comparators().end(),
                 k1.begin(), k1.end(),
                 prefix_type->begin(k2), prefix_type->end(k2),
-                tri_compare) < 0;
+                compare_component()) < 0;
         }
 
         bool operator()(const PrefixTopLevel& k1, const prefix_view_on_full_compound& k2) const {
             return lexicographical_tri_compare(
-                prefix_type->types().begin(), prefix_type->types().end(),
+                prefix_type->comparators().begin(), prefix_type->comparators().end(),
                 prefix_type->begin(k1), prefix_type->end(k1),
                 k2.begin(), k2.end(),
-                tri_compare) < 0;
+                compare_component()) < 0;
         }
     };
 };
@@ -424,18 +434,18 @@ class prefix_view_on_prefix_compound {
 
         bool operator()(const prefix_view_on_prefix_compound& k1, const TopLevel& k2) const {
             return lexicographical_tri_compare(
-                prefix_type->types().begin(), prefix_type->types().end(),
+                prefix_type->comparators().begin(), prefix_type->comparators().end(),
                 k1.begin(), k1.end(),
                 prefix_type->begin(k2), prefix_type->end(k2),
-                tri_compare) < 0;
+                compare_component()) < 0;
         }
 
         bool operator()(const TopLevel& k1, const prefix_view_on_prefix_compound& k2) const {
             return lexicographical_tri_compare(
-                prefix_type->types().begin(), prefix_type->types().end(),
+                prefix_type->comparators().begin(), prefix_type->comparators().end(),
                 prefix_type->begin(k1), prefix_type->end(k1),
                 k2.begin(), k2.end(),
-                tri_compare) < 0;
+                compare_component()) < 0;
         }
     };
 };
@@ -468,18 +478,18 @@ class prefixable_full_compound : public compound_wrapper<TopLevel, TopLevelView>
 
         bool operator()(const TopLevel& k1, const PrefixTopLevel& k2) const {
             return lexicographical_tri_compare(
-                prefix_type->types().begin(), prefix_type->types().end(),
+                prefix_type->comparators().begin(), prefix_type->comparators().end(),
                 full_type->begin(k1), full_type->end(k1),
                 prefix_type->begin(k2), prefix_type->end(k2),
-                tri_compare) < 0;
+                compare_component()) < 0;
         }
 
         bool operator()(const PrefixTopLevel& k1, const TopLevel& k2) const {
             return lexicographical_tri_compare(
-                prefix_type->types().begin(), prefix_type->types().end(),
+                prefix_type->comparators().begin(), prefix_type->comparators().end(),
                 prefix_type->begin(k1), prefix_type->end(k1),
                 full_type->begin(k2), full_type->end(k2),
-                tri_compare) < 0;
+                compare_component()) < 0;
         }
     };
 
@@ -497,17 +507,17 @@ class prefixable_full_compound : public compound_wrapper<TopLevel, TopLevelView>
         { }
 
         bool operator()(const TopLevel& k1, const PrefixTopLevel& k2) const {
-            return prefix_equality_tri_compare(prefix_type->types().begin(),
+            return prefix_equality_tri_compare(prefix_type->comparators().begin(),
                 full_type->begin(k1), full_type->end(k1),
                 prefix_type->begin(k2), prefix_type->end(k2),
-                tri_compare) < 0;
+                compare_component()) < 0;
         }
 
         bool operator()(const PrefixTopLevel& k1, const TopLevel& k2) const {
-            return prefix_equality_tri_compare(prefix_type->types().begin(),
+            return prefix_equality_tri_compare(prefix_type->comparators().begin(),
                 prefix_type->begin(k1), prefix_type->end(k1),
                 full_type->begin(k2), full_type->end(k2),
-                tri_compare) < 0;
+                compare_component()) < 0;
         }
     };
 
@@ -579,10 +589,10 @@ class prefix_compound_wrapper : public compound_wrapper<TopLevel, TopLevelView>
         { }
 
         bool operator()(const TopLevel& k1, const TopLevel& k2) const {
-            return prefix_equality_tri_compare(prefix_type->types().begin(),
+            return prefix_equality_tri_compare(prefix_type->comparators().begin(),
                 prefix_type->begin(k1), prefix_type->end(k1),
                 prefix_type->begin(k2), prefix_type->end(k2),
-                tri_compare) < 0;
+                compare_component()) < 0;
         }
     };
 
@@ -595,10 +605,10 @@ class prefix_compound_wrapper : public compound_wrapper<TopLevel, TopLevelView>
         { }
 
         int operator()(const TopLevel& k1, const TopLevel& k2) const {
-            return prefix_equality_tri_compare(prefix_type->types().begin(),
+            return prefix_equality_tri_compare(prefix_type->comparators().begin(),
                 prefix_type->begin(k1), prefix_type->end(k1),
                 prefix_type->begin(k2), prefix_type->end(k2),
-                tri_compare);
+                compare_component());
         }
     };
 };
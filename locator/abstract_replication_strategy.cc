@@ -23,6 +23,7 @@
 #include "utils/class_registrator.hh"
 #include "exceptions/exceptions.hh"
 #include "stdx.hh"
+#include <seastar/core/thread.hh>
 
 namespace locator {
 
@@ -74,19 +75,47 @@ void abstract_replication_strategy::validate_replication_strategy(const sstring&
 }
 
 std::vector<inet_address> abstract_replication_strategy::get_natural_endpoints(const token& search_token) {
-    const token& key_token = _token_metadata.first_token(search_token);
-    auto& cached_endpoints = get_cached_endpoints();
-    auto res = cached_endpoints.find(key_token);
+    auto& ring = get_ring();
+    if (ring.empty()) {
+        return calculate_natural_endpoints(search_token, _token_metadata);
+    }
+    return ring.get_natural_endpoints(search_token);
+}
 
-    if (res == cached_endpoints.end()) {
-        auto endpoints = calculate_natural_endpoints(search_token, _token_metadata);
-        cached_endpoints.emplace(key_token, endpoints);
+bool replica_ring::valid_for(const abstract_replication_strategy& s, const token_metadata& tm) const {
+    return _ring_version == tm.get_ring_version()
+            && _type == s.get_type()
+            && _config_options == s.get_config_options()
+            && _tokens == tm.sorted_tokens();
+}
 
-        return std::move(endpoints);
+std::shared_ptr<const replica_ring>
+abstract_replication_strategy::make_replica_ring(token_metadata& tm, bool preemptible) const {
+    auto& tokens = tm.sorted_tokens();
+    std::vector<uint32_t> replica_set_index;
+    replica_set_index.reserve(tokens.size());
+    std::vector<std::vector<inet_address>> replica_sets;
+    std::map<std::vector<inet_address>, uint32_t> known_sets;
+    for (auto&& t : tokens) {
+        auto endpoints = calculate_natural_endpoints(t, tm);
+        auto it = known_sets.find(endpoints);
+        if (it == known_sets.end()) {
+            it = known_sets.emplace(endpoints, replica_sets.size()).first;
+            replica_sets.push_back(std::move(endpoints));
+        }
+        replica_set_index.push_back(it->second);
+        if (preemptible && need_preempt()) {
+            seastar::thread::yield();
+        }
     }
+    return std::make_shared<const replica_ring>(tokens, std::move(replica_set_index), std::move(replica_sets),
+            tm.get_ring_version(), _my_type, _config_options);
+}
 
-    ++_cache_hits_count;
-    return res->second;
+void abstract_replication_strategy::set_replica_ring(std::shared_ptr<const replica_ring> ring) {
+    if (ring->valid_for(*this, _token_metadata)) {
+        _ring = std::move(ring);
+    }
 }
 
 void abstract_replication_strategy::validate_replication_factor(sstring rf) const
@@ -102,14 +131,14 @@ void abstract_replication_strategy::validate_replication_factor(sstring rf) cons
     }
 }
 
-inline std::unordered_map<token, std::vector<inet_address>>&
-abstract_replication_strategy::get_cached_endpoints() {
-    if (_last_invalidated_ring_version != _token_metadata.get_ring_version()) {
-        _cached_endpoints.clear();
-        _last_invalidated_ring_version = _token_metadata.get_ring_version();
+const replica_ring& abstract_replication_strategy::get_ring() {
+    if (!_ring || _ring->ring_version() != _token_metadata.get_ring_version()) {
+        _ring = make_replica_ring(_token_metadata);
+        ++_ring_builds_count;
+        logger.debug("Computed the replicas of {} ranges of keyspace {}, in {} distinct sets",
+                _token_metadata.sorted_tokens().size(), _ks_name, _ring->replica_sets_count());
     }
-
-    return _cached_endpoints;
+    return *_ring;
 }
 
 static
@@ -21,6 +21,8 @@
 
 #pragma once
 
+#include <algorithm>
+#include <map>
 #include <memory>
 #include <functional>
 #include <unordered_map>
@@ -44,16 +46,67 @@ enum class replication_strategy_type {
     everywhere_topology,
 };
 
+class abstract_replication_strategy;
+
+/*
+ * The replicas of every range of the ring, for one version of the token
+ * metadata and one replication strategy.
+ *
+ * The ring is immutable once built, so it can be shared read-only by the
+ * strategies of all shards. Tokens are kept sorted and point into a list of
+ * the distinct replica sets, which with vnodes are far fewer than the tokens.
+ */
+class replica_ring {
+    std::vector<token> _tokens;
+    // Index in _replica_sets of the replicas of the range ending at each token.
+    std::vector<uint32_t> _replica_set_index;
+    std::vector<std::vector<inet_address>> _replica_sets;
+    long _ring_version;
+    replication_strategy_type _type;
+    std::map<sstring, sstring> _config_options;
+public:
+    replica_ring(std::vector<token> tokens, std::vector<uint32_t> replica_set_index,
+            std::vector<std::vector<inet_address>> replica_sets, long ring_version,
+            replication_strategy_type type, std::map<sstring, sstring> config_options)
+        : _tokens(std::move(tokens))
+        , _replica_set_index(std::move(replica_set_index))
+        , _replica_sets(std::move(replica_sets))
+        , _ring_version(ring_version)
+        , _type(type)
+        , _config_options(std::move(config_options))
+    { }
+
+    bool empty() const {
+        return _tokens.empty();
+    }
+
+    // The replicas of the range search_token belongs to. Must not be empty().
+    const std::vector<inet_address>& get_natural_endpoints(const token& search_token) const {
+        auto it = std::lower_bound(_tokens.begin(), _tokens.end(), search_token);
+        auto i = it == _tokens.end() ? 0 : std::distance(_tokens.begin(), it);
+        return _replica_sets[_replica_set_index[i]];
+    }
+
+    size_t replica_sets_count() const {
+        return _replica_sets.size();
+    }
+
+    long ring_version() const {
+        return _ring_version;
+    }
+
+    // Whether the ring was computed for a strategy like s and the token metadata it currently sees.
+    bool valid_for(const abstract_replication_strategy& s, const token_metadata& tm) const;
+};
+
 class abstract_replication_strategy {
 private:
-    long _last_invalidated_ring_version = 0;
-    std::unordered_map<token, std::vector<inet_address>> _cached_endpoints;
-    uint64_t _cache_hits_count = 0;
+    std::shared_ptr<const replica_ring> _ring;
+    uint64_t _ring_builds_count = 0;
 
     static logging::logger logger;
 
-    std::unordered_map<token, std::vector<inet_address>>&
-    get_cached_endpoints();
+    const replica_ring& get_ring();
 protected:
     sstring _ks_name;
     // TODO: Do we need this member at all?
@@ -98,8 +151,18 @@ class abstract_replication_strategy {
     virtual void validate_options() const = 0;
     virtual std::experimental::optional<std::set<sstring>> recognized_options() const = 0;
     virtual size_t get_replication_factor() const = 0;
-    uint64_t get_cache_hits_count() const { return _cache_hits_count; }
+    // Number of times the replica ring was computed by this strategy.
+    uint64_t get_ring_builds_count() const { return _ring_builds_count; }
     replication_strategy_type get_type() const { return _my_type; }
+    const std::map<sstring, sstring>& get_config_options() const { return _config_options; }
+    long get_ring_version() const { return _token_metadata.get_ring_version(); }
+
+    // Computes the replicas of all the ranges of tm. When preemptible, must
+    // run in a seastar::thread, which yields between tokens as needed.
+    std::shared_ptr<const replica_ring> make_replica_ring(token_metadata& tm, bool preemptible = false) const;
+    // Uses a ring computed elsewhere, typically on another shard. Ignored
+    // if it doesn't match the strategy or its current token metadata.
+    void set_replica_ring(std::shared_ptr<const replica_ring> ring);
 
     // get_ranges() returns the list of ranges held by the given endpoint.
     // The list is sorted, and its elements are non overlapping and non wrap-around.
@@ -31,6 +31,7 @@
 #include <algorithm>
 #include <boost/icl/interval.hpp>
 #include <boost/icl/interval_map.hpp>
+#include <seastar/core/reactor.hh>
 
 namespace locator {
 
@@ -47,29 +48,60 @@ static void remove_by_value(C& container, V value) {
     }
 }
 
-token_metadata::token_metadata(std::map<token, inet_address> token_to_endpoint_map, std::unordered_map<inet_address, utils::UUID> endpoints_map, topology topology) :
-    _token_to_endpoint_map(token_to_endpoint_map), _endpoint_to_host_id_map(endpoints_map), _topology(topology) {
-    _sorted_tokens = sort_tokens();
+// Allocates the shared data of a token_metadata, to be freed on the
+// current shard by whichever shard drops its last reference.
+template <typename T>
+static std::shared_ptr<T> make_shared_ring_data(T data) {
+    auto owner = engine().cpu_id();
+    return std::shared_ptr<T>(new T(std::move(data)), [owner] (T* p) {
+        if (engine().cpu_id() == owner) {
+            delete p;
+        } else {
+            smp::submit_to(owner, [p] {
+                delete p;
+            });
+        }
+    });
+}
+
+token_metadata::token_metadata(std::shared_ptr<token_ring> ring, std::unordered_map<inet_address, utils::UUID> endpoints_map, topology topology) :
+    _ring(std::move(ring)), _endpoint_to_host_id_map(endpoints_map), _topology(topology) {
 }
 
-std::vector<token> token_metadata::sort_tokens() {
-    std::vector<token> sorted;
-    sorted.reserve(_token_to_endpoint_map.size());
+const token_metadata::token_ring& token_metadata::ring() const {
+    static const token_ring empty_ring;
+    return _ring ? *_ring : empty_ring;
+}
 
-    for (auto&& i : _token_to_endpoint_map) {
-        sorted.push_back(i.first);
+token_metadata::token_ring& token_metadata::mutable_ring() {
+    auto shard = engine().cpu_id();
+    // Other copies can only drop their references concurrently, so a
+    // count of one can't go stale.
+    if (!_ring || _ring.use_count() > 1 || _ring->owner != shard) {
+        auto copy = ring();
+        copy.owner = shard;
+        _ring = make_shared_ring_data(std::move(copy));
     }
+    return *_ring;
+}
+
+void token_metadata::sort_tokens() {
+    auto& r = mutable_ring();
+    r.sorted_tokens.clear();
+    r.sorted_tokens.reserve(r.token_to_endpoint_map.size());
 
-    return sorted;
+    for (auto&& i : r.token_to_endpoint_map) {
+        r.sorted_tokens.push_back(i.first);
+    }
 }
 
 const std::vector<token>& token_metadata::sorted_tokens() const {
-    return _sorted_tokens;
+    return ring().sorted_tokens;
 }
 
 std::vector<token> token_metadata::get_tokens(const inet_address& addr) const {
     std::vector<token> res;
-    for (auto&& i : _token_to_endpoint_map) {
+    for (auto&& i : ring().token_to_endpoint_map) {
         if (i.second == addr) {
             res.push_back(i.first);
         }
@@ -105,6 +137,7 @@ void token_metadata::update_normal_tokens(std::unordered_map<inet_address, std::
         return;
     }
 
+    auto& ring = mutable_ring();
     bool should_sort_tokens = false;
     for (auto&& i : endpoint_tokens) {
         inet_address endpoint = i.first;
@@ -116,9 +149,9 @@ void token_metadata::update_normal_tokens(std::unordered_map<inet_address, std::
             throw std::runtime_error(msg);
         }
 
-        for(auto it = _token_to_endpoint_map.begin(), ite = _token_to_endpoint_map.end(); it != ite;) {
+        for(auto it = ring.token_to_endpoint_map.begin(), ite = ring.token_to_endpoint_map.end(); it != ite;) {
             if(it->second == endpoint) {
-                it = _token_to_endpoint_map.erase(it);
+                it = ring.token_to_endpoint_map.erase(it);
             } else {
                 ++it;
             }
@@ -130,7 +163,7 @@ void token_metadata::update_normal_tokens(std::unordered_map<inet_address, std::
         remove_from_moving(endpoint); // also removing this endpoint from moving
         for (const token& t : tokens)
         {
-            auto prev = _token_to_endpoint_map.insert(std::pair<token, inet_address>(t, endpoint));
+            auto prev = ring.token_to_endpoint_map.insert(std::pair<token, inet_address>(t, endpoint));
             should_sort_tokens |= prev.second; // new token inserted -> sort
             if (prev.first->second != endpoint) {
                 tlogger.warn("Token {} changing ownership from {} to {}", t, prev.first->second, endpoint);
@@ -140,31 +173,32 @@ void token_metadata::update_normal_tokens(std::unordered_map<inet_address, std::
     }
 
     if (should_sort_tokens) {
-        _sorted_tokens = sort_tokens();
+        sort_tokens();
     }
 }
 
 size_t token_metadata::first_token_index(const token& start) const {
-    if (_sorted_tokens.empty()) {
+    auto& sorted = ring().sorted_tokens;
+    if (sorted.empty()) {
         auto msg = sprint("sorted_tokens is empty in first_token_index!");
         tlogger.error("{}", msg);
         throw std::runtime_error(msg);
     }
-    auto it = std::lower_bound(_sorted_tokens.begin(), _sorted_tokens.end(), start);
-    if (it == _sorted_tokens.end()) {
+    auto it = std::lower_bound(sorted.begin(), sorted.end(), start);
+    if (it == sorted.end()) {
         return 0;
     } else {
-        return std::distance(_sorted_tokens.begin(), it);
+        return std::distance(sorted.begin(), it);
     }
 }
 
 const token& token_metadata::first_token(const token& start) const {
-    return _sorted_tokens[first_token_index(start)];
+    return ring().sorted_tokens[first_token_index(start)];
 }
 
 std::experimental::optional<inet_address> token_metadata::get_endpoint(const token& token) const {
-    auto it = _token_to_endpoint_map.find(token);
-    if (it == _token_to_endpoint_map.end()) {
+    auto it = ring().token_to_endpoint_map.find(token);
+    if (it == ring().token_to_endpoint_map.end()) {
         return std::experimental::nullopt;
     } else {
         return it->second;
@@ -175,7 +209,7 @@ void token_metadata::debug_show() {
     auto reporter = std::make_shared<timer<lowres_clock>>();
     reporter->set_callback ([reporter, this] {
         print("Endpoint -> Token\n");
-        for (auto x : _token_to_endpoint_map) {
+        for (auto x : ring().token_to_endpoint_map) {
             print("inet_address=%s, token=%s\n", x.second, x.first);
         }
         print("Endpoint -> UUID\n");
@@ -183,7 +217,7 @@ void token_metadata::debug_show() {
             print("inet_address=%s, uuid=%s\n", x.first, x.second);
         }
         print("Sorted Token\n");
-        for (auto x : _sorted_tokens) {
+        for (auto x : ring().sorted_tokens) {
             print("token=%s\n", x);
         }
     });
@@ -274,8 +308,8 @@ void token_metadata::add_bootstrap_tokens(std::unordered_set<token> tokens, inet
             throw std::runtime_error(msg);
         }
 
-        auto old_endpoint2 = _token_to_endpoint_map.find(t);
-        if (old_endpoint2 != _token_to_endpoint_map.end() && (*old_endpoint2).second != endpoint) {
+        auto old_endpoint2 = ring().token_to_endpoint_map.find(t);
+        if (old_endpoint2 != ring().token_to_endpoint_map.end() && (*old_endpoint2).second != endpoint) {
             auto msg = sprint("Bootstrap Token collision between %s and %s (token %s", (*old_endpoint2).second, endpoint, t);
             throw std::runtime_error(msg);
         }
@@ -312,11 +346,11 @@ bool token_metadata::is_leaving(inet_address endpoint) {
 
 void token_metadata::remove_endpoint(inet_address endpoint) {
     remove_by_value(_bootstrap_tokens, endpoint);
-    remove_by_value(_token_to_endpoint_map, endpoint);
+    remove_by_value(mutable_ring().token_to_endpoint_map, endpoint);
     _topology.remove_endpoint(endpoint);
     _leaving_endpoints.erase(endpoint);
     _endpoint_to_host_id_map.erase(endpoint);
-    _sorted_tokens = sort_tokens();
+    sort_tokens();
     invalidate_cached_rings();
 }
 
@@ -413,33 +447,33 @@ void token_metadata::set_pending_ranges(const sstring& keyspace_name,
         std::unordered_multimap<range<token>, inet_address> new_pending_ranges) {
     if (new_pending_ranges.empty()) {
         _pending_ranges.erase(keyspace_name);
-        _pending_ranges_map.erase(keyspace_name);
-        _pending_ranges_interval_map.erase(keyspace_name);
         return;
     }
-    std::unordered_map<range<token>, std::unordered_set<inet_address>> map;
+    keyspace_pending_ranges pending;
     for (const auto& x : new_pending_ranges) {
-        map[x.first].emplace(x.second);
+        pending.ranges_map[x.first].emplace(x.second);
     }
 
     // construct a interval map to speed up the search
-    _pending_ranges_interval_map[keyspace_name] = {};
-    for (const auto& m : map) {
-        _pending_ranges_interval_map[keyspace_name] +=
-                std::make_pair(range_to_interval(m.first), m.second);
+    for (const auto& m : pending.ranges_map) {
+        pending.interval_map += std::make_pair(range_to_interval(m.first), m.second);
     }
-    _pending_ranges[keyspace_name] = std::move(new_pending_ranges);
-    _pending_ranges_map[keyspace_name] = std::move(map);
+    pending.ranges = std::move(new_pending_ranges);
+    _pending_ranges[keyspace_name] = make_shared_ring_data(std::move(pending));
 }
 
-std::unordered_multimap<range<token>, inet_address>&
+const std::unordered_multimap<range<token>, inet_address>&
 token_metadata::get_pending_ranges_mm(sstring keyspace_name) {
-    return _pending_ranges[keyspace_name];
+    static const std::unordered_multimap<range<token>, inet_address> empty;
+    auto it = _pending_ranges.find(keyspace_name);
+    return it == _pending_ranges.end() ? empty : it->second->ranges;
 }
 
 const std::unordered_map<range<token>, std::unordered_set<inet_address>>&
 token_metadata::get_pending_ranges(sstring keyspace_name) {
-    return _pending_ranges_map[keyspace_name];
+    static const std::unordered_map<range<token>, std::unordered_set<inet_address>> empty;
+    auto it = _pending_ranges.find(keyspace_name);
+    return it == _pending_ranges.end() ? empty : it->second->ranges_map;
 }
 
 std::vector<range<token>>
@@ -456,15 +490,29 @@ token_metadata::get_pending_ranges(sstring keyspace_name, inet_address endpoint)
 }
 
 void token_metadata::calculate_pending_ranges(abstract_replication_strategy& strategy, const sstring& keyspace_name) {
-    std::unordered_multimap<range<token>, inet_address> new_pending_ranges;
-
-    if (_bootstrap_tokens.empty() && _leaving_endpoints.empty() && _moving_endpoints.empty()) {
+    if (!has_pending_changes()) {
         tlogger.debug("No bootstrapping, leaving or moving nodes -> empty pending ranges for {}", keyspace_name);
-        set_pending_ranges(keyspace_name, std::move(new_pending_ranges));
+        set_pending_ranges(keyspace_name, {});
         return;
     }
 
-    std::unordered_multimap<inet_address, dht::token_range> address_ranges = strategy.get_address_ranges(*this);
+    auto metadata = clone_only_token_map(); // don't do this in the loop! #7758
+    set_pending_ranges(keyspace_name, calculate_pending_ranges(strategy, metadata));
+
+    if (tlogger.is_enabled(logging::log_level::debug)) {
+        tlogger.debug("Pending ranges: {}", (_pending_ranges.empty() ? "<empty>" : print_pending_ranges()));
+    }
+}
+
+std::unordered_multimap<range<token>, inet_address>
+token_metadata::calculate_pending_ranges(abstract_replication_strategy& strategy, token_metadata& metadata) {
+    std::unordered_multimap<range<token>, inet_address> new_pending_ranges;
+
+    if (!has_pending_changes()) {
+        return new_pending_ranges;
+    }
+
+    std::unordered_multimap<inet_address, dht::token_range> address_ranges = strategy.get_address_ranges(metadata);
 
     // FIMXE
     // Copy of metadata reflecting the situation after all leave operations are finished.
@@ -480,7 +528,6 @@ void token_metadata::calculate_pending_ranges(abstract_replication_strategy& str
     }
     // for each of those ranges, find what new nodes will be responsible for the range when
     // all leaving nodes are gone.
-    auto metadata = clone_only_token_map(); // don't do this in the loop! #7758
     for (const auto& r : affected_ranges) {
         auto t = r.end() ? r.end()->value() : dht::maximum_token();
         auto current_endpoints = strategy.calculate_natural_endpoints(t, metadata);
@@ -545,11 +592,7 @@ void token_metadata::calculate_pending_ranges(abstract_replication_strategy& str
         all_left_metadata.remove_endpoint(endpoint);
     }
 
-    set_pending_ranges(keyspace_name, std::move(new_pending_ranges));
-
-    if (tlogger.is_enabled(logging::log_level::debug)) {
-        tlogger.debug("Pending ranges: {}", (_pending_ranges.empty() ? "<empty>" : print_pending_ranges()));
-    }
+    return new_pending_ranges;
 }
 sstring token_metadata::print_pending_ranges() {
     std::stringstream ss;
@@ -557,7 +600,7 @@ sstring token_metadata::print_pending_ranges() {
     for (auto& x : _pending_ranges) {
         auto& keyspace_name = x.first;
         ss << "\nkeyspace_name = " << keyspace_name << " {\n";
-        for (auto& m : x.second) {
+        for (auto& m : x.second->ranges) {
             ss << m.second << " : " << m.first << "\n";
         }
         ss << "}\n";
@@ -590,21 +633,18 @@ void token_metadata::add_moving_endpoint(token t, inet_address endpoint) {
 }
 
 std::vector<gms::inet_address> token_metadata::pending_endpoints_for(const token& token, const sstring& keyspace_name) {
-    // Fast path 0: no pending ranges at all
-    if (_pending_ranges_interval_map.empty()) {
-        return {};
-    }
-
-    // Fast path 1: no pending ranges for this keyspace_name
-    if (_pending_ranges_interval_map[keyspace_name].empty()) {
+    // Fast path: no pending ranges for this keyspace_name
+    auto pending = _pending_ranges.find(keyspace_name);
+    if (pending == _pending_ranges.end()) {
         return {};
     }
 
     // Slow path: lookup pending ranges
     std::vector<gms::inet_address> endpoints;
     auto interval = range_to_interval(range<dht::token>(token));
-    auto it = _pending_ranges_interval_map[keyspace_name].find(interval);
-    if (it != _pending_ranges_interval_map[keyspace_name].end()) {
+    auto& interval_map = pending->second->interval_map;
+    auto it = interval_map.find(interval);
+    if (it != interval_map.end()) {
         // interval_map does not work with std::vector, convert to std::vector of ips
         endpoints = std::vector<gms::inet_address>(it->second.begin(), it->second.end());
     }
@@ -612,14 +652,14 @@ std::vector<gms::inet_address> token_metadata::pending_endpoints_for(const token
 }
 
 std::map<token, inet_address> token_metadata::get_normal_and_bootstrapping_token_to_endpoint_map() {
-    std::map<token, inet_address> ret(_token_to_endpoint_map.begin(), _token_to_endpoint_map.end());
+    std::map<token, inet_address> ret(ring().token_to_endpoint_map.begin(), ring().token_to_endpoint_map.end());
     ret.insert(_bootstrap_tokens.begin(), _bootstrap_tokens.end());
     return ret;
 }
 
 std::multimap<inet_address, token> token_metadata::get_endpoint_to_token_map_for_reading() {
     std::multimap<inet_address, token> cloned;
-    for (const auto& x : _token_to_endpoint_map) {
+    for (const auto& x : ring().token_to_endpoint_map) {
         cloned.emplace(x.second, x.first);
     }
     return cloned;
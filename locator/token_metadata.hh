@@ -39,6 +39,7 @@
 #pragma once
 
 #include <map>
+#include <memory>
 #include <unordered_set>
 #include <unordered_map>
 #include "gms/inet_address.hh"
@@ -135,13 +136,30 @@ class token_metadata final {
     using UUID = utils::UUID;
     using inet_address = gms::inet_address;
 private:
-    /**
-     * Maintains token to endpoint map of every node in the cluster.
-     * Each Token is associated with exactly one Address, but each Address may have
-     * multiple tokens.  Hence, the BiMultiValMap collection.
-     */
-    // FIXME: have to be BiMultiValMap
-    std::map<token, inet_address> _token_to_endpoint_map;
+    struct token_ring {
+        /**
+         * Maintains token to endpoint map of every node in the cluster.
+         * Each Token is associated with exactly one Address, but each Address may have
+         * multiple tokens.  Hence, the BiMultiValMap collection.
+         */
+        // FIXME: have to be BiMultiValMap
+        std::map<token, inet_address> token_to_endpoint_map;
+        std::vector<token> sorted_tokens;
+        // The shard which allocated the ring, and which frees it.
+        unsigned owner = 0;
+    };
+
+    struct keyspace_pending_ranges {
+        std::unordered_multimap<range<token>, inet_address> ranges;
+        std::unordered_map<range<token>, std::unordered_set<inet_address>> ranges_map;
+        boost::icl::interval_map<token, std::unordered_set<inet_address>> interval_map;
+    };
+
+    // The data proportional to the number of tokens is shared, read-only, by
+    // the copies of the token_metadata, of which storage_service keeps one per
+    // shard, until one of them changes it. It's freed on the shard which
+    // allocated it. A null _ring is an empty one.
+    std::shared_ptr<token_ring> _ring;
 
     /** Maintains endpoint to host ID map of every node in the cluster */
     std::unordered_map<inet_address, utils::UUID> _endpoint_to_host_id_map;
@@ -150,17 +168,16 @@ class token_metadata final {
     std::unordered_set<inet_address> _leaving_endpoints;
     std::unordered_map<token, inet_address> _moving_endpoints;
 
-    std::unordered_map<sstring, std::unordered_multimap<range<token>, inet_address>> _pending_ranges;
-    std::unordered_map<sstring, std::unordered_map<range<token>, std::unordered_set<inet_address>>> _pending_ranges_map;
-    std::unordered_map<sstring, boost::icl::interval_map<token, std::unordered_set<inet_address>>> _pending_ranges_interval_map;
-
-    std::vector<token> _sorted_tokens;
+    std::unordered_map<sstring, std::shared_ptr<const keyspace_pending_ranges>> _pending_ranges;
 
     topology _topology;
 
     long _ring_version = 0;
 
-    std::vector<token> sort_tokens();
+    const token_ring& ring() const;
+    // Returns the ring, copied first if it is shared with other token_metadata.
+    token_ring& mutable_ring();
+    void sort_tokens();
 
     class tokens_iterator :
             public std::iterator<std::input_iterator_tag, token> {
@@ -228,7 +245,7 @@ class token_metadata final {
         friend class token_metadata;
     };
 
-    token_metadata(std::map<token, inet_address> token_to_endpoint_map, std::unordered_map<inet_address, utils::UUID> endpoints_map, topology topology);
+    token_metadata(std::shared_ptr<token_ring> ring, std::unordered_map<inet_address, utils::UUID> endpoints_map, topology topology);
 public:
     token_metadata() {};
     const std::vector<token>& sorted_tokens() const;
@@ -240,7 +257,7 @@ class token_metadata final {
     std::experimental::optional<inet_address> get_endpoint(const token& token) const;
     std::vector<token> get_tokens(const inet_address& addr) const;
     const std::map<token, inet_address>& get_token_to_endpoint() const {
-        return _token_to_endpoint_map;
+        return ring().token_to_endpoint_map;
     }
 
     const std::unordered_set<inet_address>& get_leaving_endpoints() const {
@@ -546,7 +563,7 @@ class token_metadata final {
      * bootstrap tokens and leaving endpoints are not included in the copy.
      */
     token_metadata clone_only_token_map() {
-        return token_metadata(this->_token_to_endpoint_map, this->_endpoint_to_host_id_map, this->_topology);
+        return token_metadata(this->_ring, this->_endpoint_to_host_id_map, this->_topology);
     }
 #if 0
 
@@ -621,7 +638,7 @@ class token_metadata final {
     static range<dht::token> interval_to_range(boost::icl::interval<token>::interval_type i);
 
 private:
-    std::unordered_multimap<range<token>, inet_address>& get_pending_ranges_mm(sstring keyspace_name);
+    const std::unordered_multimap<range<token>, inet_address>& get_pending_ranges_mm(sstring keyspace_name);
     void set_pending_ranges(const sstring& keyspace_name, std::unordered_multimap<range<token>, inet_address> new_pending_ranges);
 
 public:
@@ -653,6 +670,17 @@ class token_metadata final {
      * changes state in the cluster, so it should be manageable.
      */
     void calculate_pending_ranges(abstract_replication_strategy& strategy, const sstring& keyspace_name);
+    /**
+     * Same as above, but returns the pending ranges instead of storing them,
+     * so that they can be computed once for all the keyspaces with the same
+     * replication strategy and options. metadata must be a
+     * clone_only_token_map() of this object, which the calculations of all
+     * keyspaces can share.
+     */
+    std::unordered_multimap<range<token>, inet_address> calculate_pending_ranges(abstract_replication_strategy& strategy, token_metadata& metadata);
+    bool has_pending_changes() const {
+        return !_bootstrap_tokens.empty() || !_leaving_endpoints.empty() || !_moving_endpoints.empty();
+    }
 public:
 
     token get_predecessor(token t);
@@ -32,9 +32,12 @@
 #include "service/storage_service.hh"
 #include "service/migration_manager.hh"
 #include "service/load_broadcaster.hh"
+#include "service/priority_manager.hh"
 #include "streaming/stream_session.hh"
 #include "db/system_keyspace.hh"
 #include "db/batchlog_manager.hh"
+#include "db/row_cache_saver.hh"
+#include "db/view/view_builder.hh"
 #include "db/commitlog/commitlog.hh"
 #include "db/commitlog/commitlog_replayer.hh"
 #include "utils/runtime.hh"
@@ -58,6 +61,8 @@
 #include "service/cache_hitrate_calculator.hh"
 #include "sstables/compaction_manager.hh"
 #include "sstables/sstables.hh"
+#include "utils/stall_detector.hh"
+#include "sstables/key_cache.hh"
 
 thread_local disk_error_signal_type commit_error;
 thread_local disk_error_signal_type general_disk_error;
@@ -441,6 +446,12 @@ int main(int ac, char** av) {
             supervisor::notify("starting per-shard database core");
             // Note: changed from using a move here, because we want the config object intact.
             db.start(std::ref(*cfg)).get();
+            smp::invoke_on_all([&cfg] {
+                service::get_local_priority_manager().set_cpu_quotas(*cfg);
+                service::get_local_priority_manager().set_service_levels(*cfg);
+                global_cache_tracker().set_compressed_fraction(cfg->row_cache_compressed_fraction());
+                in_memory_cache_tracker().set_eviction_floor(cfg->in_memory_tables_memory_fraction() * memory::stats().total_memory());
+            }).get();
             engine().at_exit([&db, &return_value] {
                 // A shared sstable must be compacted by all shards before it can be deleted.
                 // Since we're stoping, that's not going to happen.  Cancel those pending
@@ -462,6 +473,12 @@ int main(int ac, char** av) {
             dirs.touch_and_lock(db.local().get_config().data_file_directories()).get();
             supervisor::notify("creating commitlog directory");
             dirs.touch_and_lock(db.local().get_config().commitlog_directory()).get();
+            if (db.local().get_config().hinted_handoff_enabled()) {
+                supervisor::notify("creating hints directory");
+                dirs.touch_and_lock(db.local().get_config().hints_directory()).get();
+            }
+            supervisor::notify("creating view hints directory");
+            dirs.touch_and_lock(db.local().get_config().view_hints_directory()).get();
             supervisor::notify("verifying data and commitlog directories");
             std::unordered_set<sstring> directories;
             directories.insert(db.local().get_config().data_file_directories().cbegin(),
@@ -504,6 +521,7 @@ int main(int ac, char** av) {
             init_ms_fd_gossiper(listen_address
                     , storage_port
                     , ssl_storage_port
+                    , cfg->storage_shard_port()
                     , tcp_nodelay_inter_dc
                     , encrypt_what
                     , trust_store
@@ -512,6 +530,11 @@ int main(int ac, char** av) {
                     , prio
                     , clauth
                     , cfg->internode_compression()
+                    , cfg->gossip_compression()
+                    , cfg->internode_compression_per_class()
+                    , cfg->internode_compression_algorithm_per_class()
+                    , cfg->internode_compression_threshold_in_bytes()
+                    , cfg->inter_dc_tcp_nodelay_per_class()
                     , seed_provider
                     , cluster_name
                     , phi
@@ -534,6 +557,8 @@ int main(int ac, char** av) {
             // #293 - do not stop anything
             // engine().at_exit([] { return db::get_batchlog_manager().stop(); });
             sstables::init_metrics().get();
+            sstables::init_key_cache(size_t(cfg->key_cache_size_in_mb()) << 20).get();
+            utils::init_stall_detector(std::chrono::milliseconds(cfg->task_stall_report_threshold_ms())).get();
 
             db::system_keyspace::minimal_setup(db, qp);
 
@@ -557,6 +582,7 @@ int main(int ac, char** av) {
             if (cl != nullptr) {
                 auto paths = cl->get_segments_to_replay();
                 if (!paths.empty()) {
+                    api::set_server_commitlog_replay(ctx).get();
                     supervisor::notify("replaying commit log");
                     auto rp = db::commitlog_replayer::create_replayer(qp).get0();
                     rp.recover(paths).get();
@@ -587,6 +613,14 @@ int main(int ac, char** av) {
                     cf.trigger_compaction();
                 }
             }).get();
+            supervisor::notify("loading saved row cache keys");
+            db::get_row_cache_saver().start(std::ref(db)).get();
+            db::get_row_cache_saver().invoke_on_all([] (db::row_cache_saver& rcs) {
+                return rcs.start();
+            }).get();
+            engine().at_exit([] {
+                return db::get_row_cache_saver().stop();
+            });
             api::set_server_storage_service(ctx).get();
             api::set_server_gossip(ctx).get();
             api::set_server_snitch(ctx).get();
@@ -605,7 +639,7 @@ int main(int ac, char** av) {
             supervisor::notify("starting streaming service");
             streaming::stream_session::init_streaming_service(db).get();
             api::set_server_stream_manager(ctx).get();
-            // Start handling REPAIR_CHECKSUM_RANGE messages
+            // Start handling repair messages
             netw::get_messaging_service().invoke_on_all([&db] (auto& ms) {
                 ms.register_repair_checksum_range([&db] (sstring keyspace, sstring cf, dht::token_range range, rpc::optional<repair_checksum> hash_version) {
                     auto hv = hash_version ? *hash_version : repair_checksum::legacy;
@@ -614,6 +648,21 @@ int main(int ac, char** av) {
                         return checksum_range(db, keyspace, cf, range, hv);
                     });
                 });
+                ms.register_repair_get_row_hashes([&db] (sstring keyspace, sstring cf, dht::token_range range, stdx::optional<repair_row_hash> start_after, uint32_t max_rows) {
+                    return do_with(std::move(keyspace), std::move(cf), std::move(range), std::move(start_after),
+                            [&db, max_rows] (auto& keyspace, auto& cf, auto& range, auto& start_after) {
+                        return get_row_hashes(db, keyspace, cf, range, start_after, max_rows);
+                    });
+                });
+                ms.register_repair_get_rows([&db] (sstring keyspace, sstring cf, dht::token_range range, stdx::optional<repair_row_hash> start_after, std::vector<repair_row_hash> rows) {
+                    return do_with(std::move(keyspace), std::move(cf), std::move(range), std::move(start_after), std::move(rows),
+                            [&db] (auto& keyspace, auto& cf, auto& range, auto& start_after, auto& rows) {
+                        return get_rows(db, keyspace, cf, range, start_after, rows);
+                    });
+                });
+                ms.register_repair_put_rows([] (const rpc::client_info& cinfo, std::vector<frozen_mutation> mutations) {
+                    return put_rows(std::move(mutations), netw::messaging_service::get_source(cinfo).addr);
+                });
             }).get();
             supervisor::notify("starting storage service", true);
             auto& ss = service::get_local_storage_service();
@@ -624,6 +673,14 @@ int main(int ac, char** av) {
             db::get_batchlog_manager().invoke_on_all([] (db::batchlog_manager& b) {
                 return b.start();
             }).get();
+            supervisor::notify("starting view builder");
+            db::view::get_view_builder().start(std::ref(db)).get();
+            db::view::get_view_builder().invoke_on_all([] (db::view::view_builder& vb) {
+                return vb.start();
+            }).get();
+            engine().at_exit([] {
+                return db::view::get_view_builder().stop();
+            });
             supervisor::notify("starting load broadcaster");
             // should be unique_ptr, but then lambda passed to at_exit will be non copieable and
             // casting to std::function<> will fail to compile
@@ -637,21 +694,40 @@ int main(int ac, char** av) {
             cf_cache_hitrate_calculator.local().run_on(engine().cpu_id());
             gms::get_local_gossiper().wait_for_gossip_to_settle().get();
             api::set_server_gossip_settle(ctx).get();
+            supervisor::notify("starting hinted handoff manager");
+            proxy.invoke_on_all([] (service::storage_proxy& p) {
+                return p.start_hints_manager();
+            }).get();
+            engine().at_exit([&proxy] {
+                return proxy.invoke_on_all([] (service::storage_proxy& p) {
+                    return p.stop_hints_manager();
+                });
+            });
             supervisor::notify("starting native transport");
             service::get_local_storage_service().start_native_transport().get();
             if (start_thrift) {
                 service::get_local_storage_service().start_rpc_server().get();
             }
-            if (cfg->defragment_memory_on_idle()) {
-                smp::invoke_on_all([] () {
-                    engine().set_idle_cpu_handler([] (reactor::work_waiting_on_reactor check_for_work) {
+            smp::invoke_on_all([&cfg] () {
+                logalloc::shard_tracker().set_reclamation_step(cfg->lsa_reclamation_step());
+                logalloc::shard_tracker().set_free_segments_reserve(cfg->lsa_free_segments_reserve());
+            }).get();
+            if (cfg->defragment_memory_on_idle() || cfg->lsa_free_segments_reserve()) {
+                smp::invoke_on_all([defragment = cfg->defragment_memory_on_idle()] () {
+                    engine().set_idle_cpu_handler([defragment] (reactor::work_waiting_on_reactor check_for_work) {
+                        auto r = logalloc::shard_tracker().refill_reserve_on_idle(check_for_work);
+                        if (!defragment || r == reactor::idle_cpu_handler_result::interrupted_by_higher_priority_task) {
+                            return r;
+                        }
                         return logalloc::shard_tracker().compact_on_idle(check_for_work);
                     });
                 }).get();
             }
-            smp::invoke_on_all([&cfg] () {
-                return logalloc::shard_tracker().set_reclamation_step(cfg->lsa_reclamation_step());
-            }).get();
+            if (cfg->lsa_hugepage_zones()) {
+                smp::invoke_on_all([] {
+                    logalloc::shard_tracker().set_hugepage_zones(true);
+                }).get();
+            }
             if (cfg->abort_on_lsa_bad_alloc()) {
                 smp::invoke_on_all([&cfg]() {
                     return logalloc::shard_tracker().enable_abort_on_bad_alloc();
@@ -45,3 +45,16 @@ write_memtable_to_sstable(memtable& mt,
 future<>
 write_memtable_to_sstable(memtable& mt,
         sstables::shared_sstable sst);
+
+// Writes only the partitions of range, which the memtable has about
+// estimated_partitions of.
+future<>
+write_memtable_to_sstable(memtable& mt,
+        const dht::partition_range& range,
+        uint64_t estimated_partitions,
+        sstables::shared_sstable sst,
+        seastar::shared_ptr<sstables::write_monitor> mon,
+        bool backup,
+        const io_priority_class& pc,
+        bool leave_unsealed,
+        seastar::thread_scheduling_group* tsg);
@@ -25,6 +25,8 @@
 #include "sstable_mutation_readers.hh"
 #include "stdx.hh"
 #include "partition_snapshot_reader.hh"
+#include "utils/task_context_guard.hh"
+#include "utils/cost_accountant.hh"
 
 memtable::memtable(schema_ptr schema, dirty_memory_manager& dmm, memtable_list* memtable_list)
         : logalloc::region(dmm.region_group())
@@ -432,10 +434,12 @@ class partition_snapshot_accounter {
 
 class flush_reader final : public mutation_reader::impl, private iterator_reader {
     flush_memory_accounter _flushed_memory;
+    utils::cost_accountant::usage_ptr _cost;
 public:
-    flush_reader(schema_ptr s, lw_shared_ptr<memtable> m)
-        : iterator_reader(std::move(s), m, query::full_partition_range)
+    flush_reader(schema_ptr s, lw_shared_ptr<memtable> m, const dht::partition_range& range)
+        : iterator_reader(std::move(s), m, range)
         , _flushed_memory(*m)
+        , _cost(utils::cost_accountant::local().find_table(schema()->id()))
     {}
     flush_reader(const flush_reader&) = delete;
     flush_reader(flush_reader&&) = delete;
@@ -443,6 +447,8 @@ class flush_reader final : public mutation_reader::impl, private iterator_reader
     flush_reader& operator=(const flush_reader&) = delete;
 
     virtual future<streamed_mutation_opt> operator()() override {
+        utils::task_context_guard task_ctx(utils::task_context::memtable_flush);
+        utils::cost_guard cost(_cost.get());
         return read_section()(region(), [&] {
             return with_linearized_managed_bytes([&] {
                 memtable_entry* e = fetch_entry();
@@ -510,13 +516,13 @@ memtable::make_flat_reader(schema_ptr s,
 }
 
 mutation_reader
-memtable::make_flush_reader(schema_ptr s, const io_priority_class& pc) {
+memtable::make_flush_reader(schema_ptr s, const io_priority_class& pc, const dht::partition_range& range) {
     if (group()) {
-        return make_mutation_reader<flush_reader>(std::move(s), shared_from_this());
+        return make_mutation_reader<flush_reader>(std::move(s), shared_from_this(), range);
     } else {
         auto& full_slice = s->full_slice();
         return mutation_reader_from_flat_mutation_reader(s, make_flat_mutation_reader<scanning_reader>(s, shared_from_this(),
-            query::full_partition_range, full_slice, pc, mutation_reader::forwarding::no));
+            range, full_slice, pc, mutation_reader::forwarding::no));
     }
 }
 
@@ -558,7 +564,9 @@ memtable::apply(const frozen_mutation& m, const schema_ptr& m_schema, db::rp_han
         _allocating_section(*this, [&, this] {
           with_linearized_managed_bytes([&] {
             auto& p = find_or_create_partition_slow(m.key(*_schema));
-            p.apply(*_schema, m.partition(), *m_schema);
+            // The allocating section retries after running out of memory,
+            // which is fine for partially applied mutations.
+            p.apply_monotonically(*_schema, m.partition(), *m_schema);
           });
         });
     });
@@ -585,6 +593,31 @@ size_t memtable::partition_count() const {
     return partitions.size();
 }
 
+size_t memtable::partition_count(const dht::partition_range& range) {
+    return _read_section(*this, [&] {
+        managed_bytes::linearization_context_guard lcg;
+        auto cmp = memtable_entry::compare(_schema);
+        auto begin = range.start()
+            ? (range.start()->is_inclusive()
+                ? partitions.lower_bound(range.start()->value(), cmp)
+                : partitions.upper_bound(range.start()->value(), cmp))
+            : partitions.begin();
+        auto end = range.end()
+            ? (range.end()->is_inclusive()
+                ? partitions.upper_bound(range.end()->value(), cmp)
+                : partitions.lower_bound(range.end()->value(), cmp))
+            : partitions.end();
+        return size_t(std::distance(begin, end));
+    });
+}
+
+bool memtable::contains(const dht::decorated_key& key) {
+    return _read_section(*this, [&] {
+        managed_bytes::linearization_context_guard lcg;
+        return partitions.find(key, memtable_entry::compare(_schema)) != partitions.end();
+    });
+}
+
 memtable_entry::memtable_entry(memtable_entry&& o) noexcept
     : _link()
     , _schema(std::move(o._schema))
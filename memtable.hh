@@ -39,7 +39,11 @@ class frozen_mutation;
 namespace bi = boost::intrusive;
 
 class memtable_entry {
-    bi::set_member_hook<> _link;
+public:
+    // Packs the node color into the parent pointer, saving a word per partition.
+    using link_type = bi::set_member_hook<bi::optimize_size<true>>;
+private:
+    link_type _link;
     schema_ptr _schema;
     dht::decorated_key _key;
     partition_entry _pe;
@@ -101,7 +105,7 @@ class dirty_memory_manager;
 class memtable final : public enable_lw_shared_from_this<memtable>, private logalloc::region {
 public:
     using partitions_type = bi::set<memtable_entry,
-        bi::member_hook<memtable_entry, bi::set_member_hook<>, &memtable_entry::_link>,
+        bi::member_hook<memtable_entry, memtable_entry::link_type, &memtable_entry::_link>,
         bi::compare<memtable_entry::compare>>;
 private:
     dirty_memory_manager& _dirty_mgr;
@@ -166,12 +170,20 @@ class memtable final : public enable_lw_shared_from_this<memtable>, private loga
     logalloc::region_group* region_group() {
         return group();
     }
+
+    dirty_memory_manager& get_dirty_memory_manager() {
+        return _dirty_mgr;
+    }
 public:
     memtable_list* get_memtable_list() {
         return _memtable_list;
     }
 
     size_t partition_count() const;
+    // Walks the partitions of the range, use sparingly.
+    size_t partition_count(const dht::partition_range& range);
+    // Whether the memtable has data for the partition.
+    bool contains(const dht::decorated_key& key);
     logalloc::occupancy_stats occupancy() const;
 
     // Creates a reader of data in this memtable for given partition range.
@@ -209,7 +221,10 @@ class memtable final : public enable_lw_shared_from_this<memtable>, private loga
         return make_flat_reader(s, range, full_slice);
     }
 
-    mutation_reader make_flush_reader(schema_ptr, const io_priority_class& pc);
+    // Reading disjoint ranges, which the caller keeps alive, flushes the
+    // memtable into several sstables.
+    mutation_reader make_flush_reader(schema_ptr, const io_priority_class& pc,
+                                      const dht::partition_range& range = query::full_partition_range);
 
     mutation_source as_data_source();
 
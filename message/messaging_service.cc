@@ -38,6 +38,7 @@
 #include "frozen_schema.hh"
 #include "repair/repair.hh"
 #include "digest_algorithm.hh"
+#include "service/paxos/proposal.hh"
 #include "idl/consistency_level.dist.hh"
 #include "idl/tracing.dist.hh"
 #include "idl/result.dist.hh"
@@ -55,6 +56,7 @@
 #include "idl/partition_checksum.dist.hh"
 #include "idl/query.dist.hh"
 #include "idl/cache_temperature.dist.hh"
+#include "idl/paxos.dist.hh"
 #include "serializer_impl.hh"
 #include "serialization_visitors.hh"
 #include "idl/consistency_level.dist.impl.hh"
@@ -74,8 +76,10 @@
 #include "idl/partition_checksum.dist.impl.hh"
 #include "idl/query.dist.impl.hh"
 #include "idl/cache_temperature.dist.impl.hh"
+#include "idl/paxos.dist.impl.hh"
 #include "rpc/lz4_compressor.hh"
 #include "rpc/multi_algo_compressor_factory.hh"
+#include <seastar/core/metrics.hh>
 #include "partition_range_compat.hh"
 #include "stdx.hh"
 
@@ -120,7 +124,56 @@ using rpc_protocol = rpc::protocol<serializer, messaging_verb>;
 using namespace std::chrono_literals;
 
 static rpc::lz4_compressor::factory lz4_compressor_factory;
-static rpc::multi_algo_compressor_factory compressor_factory(&lz4_compressor_factory);
+
+struct messaging_service::peer_compression {
+    lw_shared_ptr<rpc_compression_stats> stats = make_lw_shared<rpc_compression_stats>();
+    std::vector<std::unique_ptr<adaptive_rpc_compressor_factory>> adaptive_factories;
+    // By connection class. Plain LZ4 comes last, for older nodes.
+    std::array<std::unique_ptr<rpc::multi_algo_compressor_factory>, connection_class_count> factories;
+    seastar::metrics::metric_groups metrics;
+};
+
+// Servers accept any of the compressors, in the order the client prefers them.
+struct messaging_service::server_compression {
+    adaptive_rpc_compressor_factory lz4;
+    adaptive_rpc_compressor_factory zstd;
+    rpc::multi_algo_compressor_factory factory;
+
+    explicit server_compression(size_t threshold)
+        : lz4(rpc_compression_algorithm::lz4, threshold)
+        , zstd(rpc_compression_algorithm::zstd, threshold)
+        , factory(std::vector<const rpc::compressor::factory*>{&lz4, &zstd, &lz4_compressor_factory})
+    { }
+};
+
+const rpc::compressor::factory* messaging_service::get_compressor_factory(gms::inet_address ep, unsigned cls) {
+    namespace sm = seastar::metrics;
+    auto& pc = _peer_compression[ep];
+    if (!pc) {
+        pc = std::make_unique<peer_compression>();
+        static const auto peer_label = sm::label("peer");
+        auto stats = pc->stats;
+        pc->metrics.add_group("messaging_service", {
+            sm::make_derive("compressed_frames", sm::description("Frames sent on the compressed connections to the peer."),
+                    {peer_label(ep)}, [stats] { return stats->frames; }),
+            sm::make_derive("uncompressed_small_frames", sm::description("Frames sent uncompressed on the compressed connections to the peer, for they were below the compression threshold."),
+                    {peer_label(ep)}, [stats] { return stats->bypassed_frames; }),
+            sm::make_derive("compression_bytes_before", sm::description("Bytes of the frames sent on the compressed connections to the peer, before compression."),
+                    {peer_label(ep)}, [stats] { return stats->bytes_before; }),
+            sm::make_derive("compression_bytes_after", sm::description("Bytes of the frames sent on the compressed connections to the peer, after compression."),
+                    {peer_label(ep)}, [stats] { return stats->bytes_after; }),
+        });
+    }
+    auto& factory = pc->factories[cls];
+    if (!factory) {
+        auto& options = _class_options[cls];
+        auto adaptive = std::make_unique<adaptive_rpc_compressor_factory>(options.compression_algorithm, options.compression_threshold, pc->stats);
+        factory = std::make_unique<rpc::multi_algo_compressor_factory>(
+                std::vector<const rpc::compressor::factory*>{adaptive.get(), &lz4_compressor_factory});
+        pc->adaptive_factories.push_back(std::move(adaptive));
+    }
+    return factory.get();
+}
 
 struct messaging_service::rpc_protocol_wrapper : public rpc_protocol { using rpc_protocol::rpc_protocol; };
 
@@ -197,6 +250,11 @@ void messaging_service::foreach_server_connection_stats(std::function<void(const
             });
         }
     }
+    if (_shard_server) {
+        _shard_server->foreach_connection([f](const rpc_protocol::server::connection& c) {
+            f(c.info(), c.get_stats());
+        });
+    }
 }
 
 void messaging_service::increment_dropped_messages(messaging_verb verb) {
@@ -237,7 +295,7 @@ void register_handler(messaging_service* ms, messaging_verb verb, Func&& func) {
 }
 
 messaging_service::messaging_service(gms::inet_address ip, uint16_t port, bool listen_now)
-    : messaging_service(std::move(ip), port, encrypt_what::none, compress_what::none, tcp_nodelay_what::all, 0, nullptr, false, listen_now)
+    : messaging_service(std::move(ip), port, encrypt_what::none, compress_what::none, false, tcp_nodelay_what::all, 0, 0, nullptr, false, listen_now)
 {}
 
 static
@@ -253,9 +311,8 @@ rpc_resource_limits() {
 void messaging_service::start_listen() {
     bool listen_to_bc = _should_listen_to_broadcast_address && _listen_address != utils::fb_utilities::get_broadcast_address();
     rpc::server_options so;
-    if (_compress_what != compress_what::none) {
-        so.compressor_factory = &compressor_factory;
-    }
+    // Clients which don't want compression don't negotiate it.
+    so.compressor_factory = &_server_compression->factory;
     // FIXME: we don't set so.tcp_nodelay, because we can't tell at this point whether the connection will come from a
     //        local or remote datacenter, and whether or not the connection will be used for gossip. We can fix
     //        the first by wrapping its server_socket, but not the second.
@@ -271,6 +328,13 @@ void messaging_service::start_listen() {
         }
     }
 
+    // Only this shard listens to its port, so that all the connections to it
+    // are received here.
+    if (_shard_port && !_shard_server) {
+        auto addr = ipv4_addr{_listen_address.raw_addr(), uint16_t(_shard_port + engine().cpu_id())};
+        _shard_server = std::make_unique<rpc_protocol_server_wrapper>(*_rpc, so, addr, rpc_resource_limits());
+    }
+
     if (!_server_tls[0]) {
         auto listen = [&] (const gms::inet_address& a) {
             return std::unique_ptr<rpc_protocol_server_wrapper>(
@@ -296,6 +360,9 @@ void messaging_service::start_listen() {
             mlogger.info("Starting Encrypted Messaging Service on SSL port {}", _ssl_port);
         }
         mlogger.info("Starting Messaging Service on port {}", _port);
+        if (_shard_port) {
+            mlogger.info("Starting Messaging Service on ports {}-{} for connections to each shard", _shard_port, _shard_port + smp::count - 1);
+        }
     }
 }
 
@@ -303,17 +370,24 @@ messaging_service::messaging_service(gms::inet_address ip
         , uint16_t port
         , encrypt_what ew
         , compress_what cw
+        , bool compress_gossip
         , tcp_nodelay_what tnw
         , uint16_t ssl_port
+        , uint16_t shard_port
         , std::shared_ptr<seastar::tls::credentials_builder> credentials
         , bool sltba
-        , bool listen_now)
+        , bool listen_now
+        , connection_classes_options class_options)
     : _listen_address(ip)
     , _port(port)
     , _ssl_port(ssl_port)
+    , _shard_port(shard_port)
     , _encrypt_what(ew)
     , _compress_what(cw)
+    , _compress_gossip(compress_gossip)
     , _tcp_nodelay_what(tnw)
+    , _class_options(std::move(class_options))
+    , _server_compression(std::make_unique<server_compression>(_class_options[unsigned(connection_class::writes)].compression_threshold))
     , _should_listen_to_broadcast_address(sltba)
     , _rpc(new rpc_protocol_wrapper(serializer { }))
     , _credentials(credentials ? credentials->build_server_credentials() : nullptr)
@@ -321,6 +395,11 @@ messaging_service::messaging_service(gms::inet_address ip
     _rpc->set_logger([] (const sstring& log) {
             rpc_logger.info("{}", log);
     });
+    namespace sm = seastar::metrics;
+    _metrics.add_group("messaging_service", {
+        sm::make_derive("tls_client_connections", _tls_client_connects,
+                sm::description("Encrypted connections opened to other nodes, each of which took a full TLS handshake.")),
+    });
     register_handler(this, messaging_verb::CLIENT_ID, [] (rpc::client_info& ci, gms::inet_address broadcast_address, uint32_t src_cpu_id, rpc::optional<uint64_t> max_result_size) {
         ci.attach_auxiliary("baddr", broadcast_address);
         ci.attach_auxiliary("src_cpu_id", src_cpu_id);
@@ -360,12 +439,13 @@ future<> messaging_service::stop_tls_server() {
 }
 
 future<> messaging_service::stop_nontls_server() {
+    auto f = _shard_server ? _shard_server->stop() : make_ready_future<>();
     for (auto&& s : _server) {
         if (s) {
-            return s->stop();
+            return when_all(s->stop(), std::move(f)).discard_result();
         }
     }
-    return make_ready_future<>();
+    return f;
 }
 
 future<> messaging_service::stop_client() {
@@ -386,7 +466,8 @@ rpc::no_wait_type messaging_service::no_wait() {
 }
 
 static unsigned get_rpc_client_idx(messaging_verb verb) {
-    unsigned idx = 0;
+    using connection_class = messaging_service::connection_class;
+    auto idx = connection_class::writes;
     // GET_SCHEMA_VERSION is sent from read/mutate verbs so should be
     // sent on a different connection to avoid potential deadlocks
     // as well as reduce latency as there are potentially many requests
@@ -396,17 +477,28 @@ static unsigned get_rpc_client_idx(messaging_verb verb) {
         verb == messaging_verb::GOSSIP_SHUTDOWN ||
         verb == messaging_verb::GOSSIP_ECHO ||
         verb == messaging_verb::GET_SCHEMA_VERSION) {
-        idx = 1;
+        idx = connection_class::gossip;
     } else if (verb == messaging_verb::PREPARE_MESSAGE ||
                verb == messaging_verb::PREPARE_DONE_MESSAGE ||
                verb == messaging_verb::STREAM_MUTATION ||
                verb == messaging_verb::STREAM_MUTATION_DONE ||
-               verb == messaging_verb::COMPLETE_MESSAGE) {
-        idx = 2;
+               verb == messaging_verb::COMPLETE_MESSAGE ||
+               verb == messaging_verb::STREAM_SSTABLE_DATA ||
+               verb == messaging_verb::STREAM_SSTABLE_DONE) {
+        idx = connection_class::streaming;
     } else if (verb == messaging_verb::MUTATION_DONE) {
-        idx = 3;
+        idx = connection_class::mutation_done;
+    } else if (verb == messaging_verb::READ_DATA ||
+               verb == messaging_verb::READ_MUTATION_DATA ||
+               verb == messaging_verb::READ_DIGEST) {
+        idx = connection_class::reads;
+    } else if (verb == messaging_verb::REPAIR_CHECKSUM_RANGE ||
+               verb == messaging_verb::REPAIR_GET_ROW_HASHES ||
+               verb == messaging_verb::REPAIR_GET_ROWS ||
+               verb == messaging_verb::REPAIR_PUT_ROWS) {
+        idx = connection_class::maintenance;
     }
-    return idx;
+    return unsigned(idx);
 }
 
 /**
@@ -456,10 +548,64 @@ void messaging_service::cache_preferred_ip(gms::inet_address ep, gms::inet_addre
     _preferred_ip_cache[ep] = ip;
 }
 
+void messaging_service::set_peer_sharding(gms::inet_address ep, unsigned shard_count, unsigned sharding_ignore_msb, uint16_t shard_port) {
+    if (!shard_port || !shard_count) {
+        _peer_sharding.erase(ep);
+        return;
+    }
+    auto partitioner = dht::make_partitioner(dht::global_partitioner().name(), shard_count, sharding_ignore_msb);
+    _peer_sharding[ep] = peer_sharding{shard_port, std::move(partitioner)};
+}
+
+msg_addr messaging_service::replica_addr(gms::inet_address ep, const dht::token& t) const {
+    auto it = _peer_sharding.find(ep);
+    if (it == _peer_sharding.end()) {
+        return msg_addr{ep, 0};
+    }
+    return msg_addr{ep, it->second.partitioner->shard_of(t)};
+}
+
+// The port of the shard of a peer which replica and repair requests to it
+// connect to, or 0 when they connect to the peer as a whole. Encrypted
+// connections always go to the SSL port.
+uint16_t messaging_service::replica_port(messaging_verb verb, msg_addr id) const {
+    auto cls = connection_class(get_rpc_client_idx(verb));
+    if (cls != connection_class::writes && cls != connection_class::reads && cls != connection_class::maintenance) {
+        return 0;
+    }
+    auto it = _peer_sharding.find(id.addr);
+    if (it == _peer_sharding.end() || id.cpu_id >= it->second.partitioner->shard_count()) {
+        return 0;
+    }
+    if (_encrypt_what != encrypt_what::none) {
+        return 0;
+    }
+    return it->second.shard_port + id.cpu_id;
+}
+
+unsigned messaging_service::client_idx(messaging_verb verb, msg_addr id) const {
+    auto idx = get_rpc_client_idx(verb);
+    if (replica_port(verb, id)) {
+        switch (connection_class(idx)) {
+        case connection_class::reads:
+            return connection_class_count + 1;
+        case connection_class::maintenance:
+            return connection_class_count + 2;
+        default:
+            return connection_class_count;
+        }
+    }
+    return idx;
+}
+
+msg_addr messaging_service::client_key(messaging_verb verb, msg_addr id) const {
+    return replica_port(verb, id) ? id : msg_addr{id.addr, 0};
+}
+
 shared_ptr<messaging_service::rpc_protocol_client_wrapper> messaging_service::get_rpc_client(messaging_verb verb, msg_addr id) {
     assert(!_stopping);
-    auto idx = get_rpc_client_idx(verb);
-    auto it = _clients[idx].find(id);
+    auto idx = client_idx(verb, id);
+    auto it = _clients[idx].find(client_key(verb, id));
 
     if (it != _clients[idx].end()) {
         auto c = it->second.rpc_client;
@@ -487,12 +633,19 @@ shared_ptr<messaging_service::rpc_protocol_client_wrapper> messaging_service::ge
                         != snitch_ptr->get_rack(utils::fb_utilities::get_broadcast_address());
     }();
 
-    auto must_compress = [&id, this] {
-        if (_compress_what == compress_what::none) {
+    auto cls = get_rpc_client_idx(verb);
+    auto& class_options = _class_options[cls];
+    auto must_compress = [&id, &class_options, verb, this] {
+        if (get_rpc_client_idx(verb) == unsigned(connection_class::gossip) && _compress_gossip) {
+            return true;
+        }
+
+        auto compress = class_options.compress.value_or(_compress_what);
+        if (compress == compress_what::none) {
             return false;
         }
 
-        if (_compress_what == compress_what::dc) {
+        if (compress == compress_what::dc) {
             auto& snitch_ptr = locator::i_endpoint_snitch::get_local_snitch_ptr();
             return snitch_ptr->get_datacenter(id.addr)
                             != snitch_ptr->get_datacenter(utils::fb_utilities::get_broadcast_address());
@@ -502,10 +655,10 @@ shared_ptr<messaging_service::rpc_protocol_client_wrapper> messaging_service::ge
     }();
 
     auto must_tcp_nodelay = [&] {
-        if (idx == 1) {
-            return true; // gossip
+        if (get_rpc_client_idx(verb) == unsigned(connection_class::gossip)) {
+            return true;
         }
-        if (_tcp_nodelay_what == tcp_nodelay_what::local) {
+        if (class_options.tcp_nodelay.value_or(_tcp_nodelay_what) == tcp_nodelay_what::local) {
             auto& snitch_ptr = locator::i_endpoint_snitch::get_local_snitch_ptr();
             return snitch_ptr->get_datacenter(id.addr)
                             == snitch_ptr->get_datacenter(utils::fb_utilities::get_broadcast_address());
@@ -513,24 +666,26 @@ shared_ptr<messaging_service::rpc_protocol_client_wrapper> messaging_service::ge
         return true;
     }();
 
-    auto remote_addr = ipv4_addr(get_preferred_ip(id.addr).raw_addr(), must_encrypt ? _ssl_port : _port);
+    auto shard_port = replica_port(verb, id);
+    auto remote_addr = ipv4_addr(get_preferred_ip(id.addr).raw_addr(), must_encrypt ? _ssl_port : shard_port ? shard_port : _port);
     auto local_addr = ipv4_addr{_listen_address.raw_addr(), 0};
 
     rpc::client_options opts;
     // send keepalive messages each minute if connection is idle, drop connection after 10 failures
     opts.keepalive = std::experimental::optional<net::tcp_keepalive_params>({60s, 60s, 10});
     if (must_compress) {
-        opts.compressor_factory = &compressor_factory;
+        opts.compressor_factory = get_compressor_factory(id.addr, cls);
     }
     opts.tcp_nodelay = must_tcp_nodelay;
 
+    _tls_client_connects += must_encrypt;
     auto client = must_encrypt ?
                     ::make_shared<rpc_protocol_client_wrapper>(*_rpc, std::move(opts),
                                     remote_addr, local_addr, _credentials) :
                     ::make_shared<rpc_protocol_client_wrapper>(*_rpc, std::move(opts),
                                     remote_addr, local_addr);
 
-    it = _clients[idx].emplace(id, shard_info(std::move(client))).first;
+    it = _clients[idx].emplace(client_key(verb, id), shard_info(std::move(client))).first;
     uint32_t src_cpu_id = engine().cpu_id();
     _rpc->make_client<rpc::no_wait_type(gms::inet_address, uint32_t, uint64_t)>(messaging_verb::CLIENT_ID)(*it->second.rpc_client, utils::fb_utilities::get_broadcast_address(), src_cpu_id,
                                                                                                            query::result_memory_limiter::maximum_result_size);
@@ -565,7 +720,7 @@ bool messaging_service::remove_rpc_client_one(clients_map& clients, msg_addr id,
 }
 
 void messaging_service::remove_error_rpc_client(messaging_verb verb, msg_addr id) {
-    if (remove_rpc_client_one(_clients[get_rpc_client_idx(verb)], id, true)) {
+    if (remove_rpc_client_one(_clients[client_idx(verb, id)], client_key(verb, id), true)) {
         for (auto&& cb : _connection_drop_notifiers) {
             cb(id.addr);
         }
@@ -573,8 +728,21 @@ void messaging_service::remove_error_rpc_client(messaging_verb verb, msg_addr id
 }
 
 void messaging_service::remove_rpc_client(msg_addr id) {
-    for (auto& c : _clients) {
-        remove_rpc_client_one(c, id, false);
+    for (auto idx = 0u; idx < connection_class_count; ++idx) {
+        remove_rpc_client_one(_clients[idx], msg_addr{id.addr, 0}, false);
+    }
+    // The connections to all the shards of the peer go too.
+    for (auto idx = connection_class_count; idx < _clients.size(); ++idx) {
+        auto& shard_clients = _clients[idx];
+        std::vector<msg_addr> ids;
+        for (auto& c : shard_clients) {
+            if (c.first.addr == id.addr) {
+                ids.push_back(c.first);
+            }
+        }
+        for (auto& shard_id : ids) {
+            remove_rpc_client_one(shard_clients, shard_id, false);
+        }
     }
 }
 
@@ -707,6 +875,26 @@ future<> messaging_service::send_complete_message(msg_addr id, UUID plan_id, uns
         plan_id, dst_cpu_id, failed);
 }
 
+// STREAM_SSTABLE_DATA
+void messaging_service::register_stream_sstable_data(std::function<future<> (const rpc::client_info& cinfo, UUID plan_id, UUID cf_id, int64_t generation,
+        sstring file_name, sstring component, uint64_t offset, bytes data, unsigned dst_cpu_id)>&& func) {
+    register_handler(this, messaging_verb::STREAM_SSTABLE_DATA, std::move(func));
+}
+future<> messaging_service::send_stream_sstable_data(msg_addr id, UUID plan_id, UUID cf_id, int64_t generation,
+        sstring file_name, sstring component, uint64_t offset, bytes data, unsigned dst_cpu_id) {
+    return send_message<void>(this, messaging_verb::STREAM_SSTABLE_DATA, id,
+        plan_id, cf_id, generation, std::move(file_name), std::move(component), offset, std::move(data), dst_cpu_id);
+}
+
+// STREAM_SSTABLE_DONE
+void messaging_service::register_stream_sstable_done(std::function<future<> (const rpc::client_info& cinfo, UUID plan_id, UUID cf_id, int64_t generation, unsigned dst_cpu_id)>&& func) {
+    register_handler(this, messaging_verb::STREAM_SSTABLE_DONE, std::move(func));
+}
+future<> messaging_service::send_stream_sstable_done(msg_addr id, UUID plan_id, UUID cf_id, int64_t generation, unsigned dst_cpu_id) {
+    return send_message<void>(this, messaging_verb::STREAM_SSTABLE_DONE, id,
+        plan_id, cf_id, generation, dst_cpu_id);
+}
+
 void messaging_service::register_gossip_echo(std::function<future<> ()>&& func) {
     register_handler(this, messaging_verb::GOSSIP_ECHO, std::move(func));
 }
@@ -793,6 +981,19 @@ future<> messaging_service::send_mutation(msg_addr id, clock_type::time_point ti
         std::move(reply_to), std::move(shard), std::move(response_id), std::move(trace_info));
 }
 
+void messaging_service::register_mutation_batch(std::function<future<rpc::no_wait_type> (const rpc::client_info&, rpc::opt_time_point, std::vector<frozen_mutation> fms,
+    inet_address reply_to, unsigned shard, std::vector<response_id_type> response_ids)>&& func) {
+    register_handler(this, netw::messaging_verb::MUTATION_BATCH, std::move(func));
+}
+void messaging_service::unregister_mutation_batch() {
+    _rpc->unregister_handler(netw::messaging_verb::MUTATION_BATCH);
+}
+future<> messaging_service::send_mutation_batch(msg_addr id, clock_type::time_point timeout, const std::vector<frozen_mutation>& fms,
+    inet_address reply_to, unsigned shard, const std::vector<response_id_type>& response_ids) {
+    return send_message_oneway_timeout(this, timeout, messaging_verb::MUTATION_BATCH, std::move(id), fms,
+        std::move(reply_to), std::move(shard), response_ids);
+}
+
 void messaging_service::register_counter_mutation(std::function<future<> (const rpc::client_info&, rpc::opt_time_point, std::vector<frozen_mutation> fms, db::consistency_level cl, stdx::optional<tracing::trace_info> trace_info)>&& func) {
     register_handler(this, netw::messaging_verb::COUNTER_MUTATION, std::move(func));
 }
@@ -823,6 +1024,55 @@ future<query::result, rpc::optional<cache_temperature>> messaging_service::send_
     return send_message_timeout<future<query::result, rpc::optional<cache_temperature>>>(this, messaging_verb::READ_DATA, std::move(id), timeout, cmd, pr, da);
 }
 
+void messaging_service::register_aggregate_query(std::function<future<std::vector<bytes_opt>> (const rpc::client_info&, query::read_command cmd,
+        dht::partition_range_vector prs, std::vector<query::aggregate_selector> selectors)>&& func) {
+    register_handler(this, netw::messaging_verb::AGGREGATE_QUERY, std::move(func));
+}
+void messaging_service::unregister_aggregate_query() {
+    _rpc->unregister_handler(netw::messaging_verb::AGGREGATE_QUERY);
+}
+future<std::vector<bytes_opt>> messaging_service::send_aggregate_query(msg_addr id, clock_type::time_point timeout, const query::read_command& cmd,
+        const dht::partition_range_vector& prs, const std::vector<query::aggregate_selector>& selectors) {
+    return send_message_timeout<std::vector<bytes_opt>>(this, messaging_verb::AGGREGATE_QUERY, std::move(id), timeout, cmd, prs, selectors);
+}
+
+void messaging_service::register_paxos_prepare(std::function<future<service::paxos::prepare_response> (const rpc::client_info&, rpc::opt_time_point,
+        query::read_command cmd, partition_key key, utils::UUID ballot, bool only_digest, query::digest_algorithm da)>&& func) {
+    register_handler(this, netw::messaging_verb::PAXOS_PREPARE, std::move(func));
+}
+void messaging_service::unregister_paxos_prepare() {
+    _rpc->unregister_handler(netw::messaging_verb::PAXOS_PREPARE);
+}
+future<service::paxos::prepare_response> messaging_service::send_paxos_prepare(msg_addr id, clock_type::time_point timeout, const query::read_command& cmd,
+        const partition_key& key, utils::UUID ballot, bool only_digest, query::digest_algorithm da) {
+    return send_message_timeout<service::paxos::prepare_response>(this, messaging_verb::PAXOS_PREPARE, std::move(id), timeout, cmd, key, ballot,
+        only_digest, da);
+}
+
+void messaging_service::register_paxos_accept(std::function<future<bool> (const rpc::client_info&, rpc::opt_time_point,
+        service::paxos::proposal proposal, stdx::optional<tracing::trace_info> trace_info)>&& func) {
+    register_handler(this, netw::messaging_verb::PAXOS_ACCEPT, std::move(func));
+}
+void messaging_service::unregister_paxos_accept() {
+    _rpc->unregister_handler(netw::messaging_verb::PAXOS_ACCEPT);
+}
+future<bool> messaging_service::send_paxos_accept(msg_addr id, clock_type::time_point timeout, const service::paxos::proposal& proposal,
+        stdx::optional<tracing::trace_info> trace_info) {
+    return send_message_timeout<bool>(this, messaging_verb::PAXOS_ACCEPT, std::move(id), timeout, proposal, std::move(trace_info));
+}
+
+void messaging_service::register_paxos_learn(std::function<future<> (const rpc::client_info&, rpc::opt_time_point,
+        service::paxos::proposal decision, stdx::optional<tracing::trace_info> trace_info)>&& func) {
+    register_handler(this, netw::messaging_verb::PAXOS_LEARN, std::move(func));
+}
+void messaging_service::unregister_paxos_learn() {
+    _rpc->unregister_handler(netw::messaging_verb::PAXOS_LEARN);
+}
+future<> messaging_service::send_paxos_learn(msg_addr id, clock_type::time_point timeout, const service::paxos::proposal& decision,
+        stdx::optional<tracing::trace_info> trace_info) {
+    return send_message_timeout<void>(this, messaging_verb::PAXOS_LEARN, std::move(id), timeout, decision, std::move(trace_info));
+}
+
 void messaging_service::register_get_schema_version(std::function<future<frozen_schema>(unsigned, table_schema_version)>&& func) {
     register_handler(this, netw::messaging_verb::GET_SCHEMA_VERSION, std::move(func));
 }
@@ -853,14 +1103,14 @@ future<reconcilable_result, rpc::optional<cache_temperature>> messaging_service:
     return send_message_timeout<future<reconcilable_result, rpc::optional<cache_temperature>>>(this, messaging_verb::READ_MUTATION_DATA, std::move(id), timeout, cmd, pr);
 }
 
-void messaging_service::register_read_digest(std::function<future<query::result_digest, api::timestamp_type, cache_temperature> (const rpc::client_info&, query::read_command cmd, compat::wrapping_partition_range pr)>&& func) {
+void messaging_service::register_read_digest(std::function<future<query::result_digest, api::timestamp_type, cache_temperature> (const rpc::client_info&, query::read_command cmd, compat::wrapping_partition_range pr, rpc::optional<query::digest_algorithm> oda)>&& func) {
     register_handler(this, netw::messaging_verb::READ_DIGEST, std::move(func));
 }
 void messaging_service::unregister_read_digest() {
     _rpc->unregister_handler(netw::messaging_verb::READ_DIGEST);
 }
-future<query::result_digest, rpc::optional<api::timestamp_type>, rpc::optional<cache_temperature>> messaging_service::send_read_digest(msg_addr id, clock_type::time_point timeout, const query::read_command& cmd, const dht::partition_range& pr) {
-    return send_message_timeout<future<query::result_digest, rpc::optional<api::timestamp_type>, rpc::optional<cache_temperature>>>(this, netw::messaging_verb::READ_DIGEST, std::move(id), timeout, cmd, pr);
+future<query::result_digest, rpc::optional<api::timestamp_type>, rpc::optional<cache_temperature>> messaging_service::send_read_digest(msg_addr id, clock_type::time_point timeout, const query::read_command& cmd, const dht::partition_range& pr, query::digest_algorithm da) {
+    return send_message_timeout<future<query::result_digest, rpc::optional<api::timestamp_type>, rpc::optional<cache_temperature>>>(this, netw::messaging_verb::READ_DIGEST, std::move(id), timeout, cmd, pr, da);
 }
 
 // Wrapper for TRUNCATE
@@ -905,4 +1155,53 @@ future<partition_checksum> messaging_service::send_repair_checksum_range(
             std::move(keyspace), std::move(cf), std::move(range), hash_version);
 }
 
+// Wrapper for REPAIR_GET_ROW_HASHES
+void messaging_service::register_repair_get_row_hashes(
+        std::function<future<std::vector<repair_row_hash>> (sstring keyspace, sstring cf,
+                dht::token_range range, stdx::optional<repair_row_hash> start_after, uint32_t max_rows)>&& f) {
+    register_handler(this, messaging_verb::REPAIR_GET_ROW_HASHES, std::move(f));
+}
+void messaging_service::unregister_repair_get_row_hashes() {
+    _rpc->unregister_handler(messaging_verb::REPAIR_GET_ROW_HASHES);
+}
+future<std::vector<repair_row_hash>> messaging_service::send_repair_get_row_hashes(
+        msg_addr id, sstring keyspace, sstring cf, ::dht::token_range range,
+        stdx::optional<repair_row_hash> start_after, uint32_t max_rows)
+{
+    return send_message<std::vector<repair_row_hash>>(this,
+            messaging_verb::REPAIR_GET_ROW_HASHES, std::move(id),
+            std::move(keyspace), std::move(cf), std::move(range), std::move(start_after), max_rows);
+}
+
+// Wrapper for REPAIR_GET_ROWS
+void messaging_service::register_repair_get_rows(
+        std::function<future<std::vector<frozen_mutation>> (sstring keyspace, sstring cf,
+                dht::token_range range, stdx::optional<repair_row_hash> start_after, std::vector<repair_row_hash> rows)>&& f) {
+    register_handler(this, messaging_verb::REPAIR_GET_ROWS, std::move(f));
+}
+void messaging_service::unregister_repair_get_rows() {
+    _rpc->unregister_handler(messaging_verb::REPAIR_GET_ROWS);
+}
+future<std::vector<frozen_mutation>> messaging_service::send_repair_get_rows(
+        msg_addr id, sstring keyspace, sstring cf, ::dht::token_range range,
+        stdx::optional<repair_row_hash> start_after, std::vector<repair_row_hash> rows)
+{
+    return send_message<std::vector<frozen_mutation>>(this,
+            messaging_verb::REPAIR_GET_ROWS, std::move(id),
+            std::move(keyspace), std::move(cf), std::move(range), std::move(start_after), std::move(rows));
+}
+
+// Wrapper for REPAIR_PUT_ROWS
+void messaging_service::register_repair_put_rows(
+        std::function<future<> (const rpc::client_info& cinfo, std::vector<frozen_mutation> mutations)>&& f) {
+    register_handler(this, messaging_verb::REPAIR_PUT_ROWS, std::move(f));
+}
+void messaging_service::unregister_repair_put_rows() {
+    _rpc->unregister_handler(messaging_verb::REPAIR_PUT_ROWS);
+}
+future<> messaging_service::send_repair_put_rows(msg_addr id, std::vector<frozen_mutation> mutations)
+{
+    return send_message<void>(this, messaging_verb::REPAIR_PUT_ROWS, std::move(id), std::move(mutations));
+}
+
 } // namespace net
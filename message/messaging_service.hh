@@ -25,6 +25,7 @@
 #include "core/reactor.hh"
 #include "core/distributed.hh"
 #include "core/sstring.hh"
+#include "core/metrics_registration.hh"
 #include "gms/inet_address.hh"
 #include "rpc/rpc_types.hh"
 #include <unordered_map>
@@ -34,6 +35,8 @@
 #include "repair/repair.hh"
 #include "tracing/tracing.hh"
 #include "digest_algorithm.hh"
+#include "dht/i_partitioner.hh"
+#include "message/rpc_compressor.hh"
 
 #include <seastar/net/tls.hh>
 
@@ -60,6 +63,13 @@ class frozen_mutation;
 class frozen_schema;
 class partition_checksum;
 
+namespace service {
+namespace paxos {
+    class proposal;
+    class prepare_response;
+}
+}
+
 namespace dht {
     class token;
 }
@@ -108,7 +118,17 @@ enum class messaging_verb : int32_t {
     GET_SCHEMA_VERSION = 21,
     SCHEMA_CHECK = 22,
     COUNTER_MUTATION = 23,
-    LAST = 24,
+    REPAIR_GET_ROW_HASHES = 24,
+    REPAIR_GET_ROWS = 25,
+    REPAIR_PUT_ROWS = 26,
+    AGGREGATE_QUERY = 27,
+    STREAM_SSTABLE_DATA = 28,
+    STREAM_SSTABLE_DONE = 29,
+    MUTATION_BATCH = 30,
+    PAXOS_PREPARE = 31,
+    PAXOS_ACCEPT = 32,
+    PAXOS_LEARN = 33,
+    LAST = 34,
 };
 
 } // namespace netw
@@ -136,6 +156,12 @@ struct msg_addr {
     struct hash {
         size_t operator()(const msg_addr& id) const;
     };
+    // Unlike operator==, tells the shards of a node apart.
+    struct shard_equal {
+        bool operator()(const msg_addr& x, const msg_addr& y) const {
+            return x.addr == y.addr && x.cpu_id == y.cpu_id;
+        }
+    };
 };
 
 class messaging_service : public seastar::async_sharded_service<messaging_service> {
@@ -148,7 +174,9 @@ class messaging_service : public seastar::async_sharded_service<messaging_servic
     using msg_addr = netw::msg_addr;
     using inet_address = gms::inet_address;
     using UUID = utils::UUID;
-    using clients_map = std::unordered_map<msg_addr, shard_info, msg_addr::hash>;
+    // Keyed by the destination shard for the connections to a port per
+    // shard, and by the node, with a cpu_id of 0, for the others.
+    using clients_map = std::unordered_map<msg_addr, shard_info, msg_addr::hash, msg_addr::shard_equal>;
 
     // This should change only if serialization format changes
     static constexpr int32_t current_version = 0;
@@ -189,13 +217,42 @@ class messaging_service : public seastar::async_sharded_service<messaging_servic
         all,
     };
 
+    // Verbs are sent on connections of their class, so that a burst of one
+    // kind of traffic isn't queued in front of another one.
+    enum class connection_class : unsigned {
+        writes,         // and the verbs of no other class
+        gossip,
+        streaming,
+        mutation_done,
+        reads,
+        maintenance,    // repair
+        count,
+    };
+    static constexpr size_t connection_class_count = size_t(connection_class::count);
+
+    // Overrides the node wide settings for the connections of a class.
+    struct connection_class_options {
+        stdx::optional<compress_what> compress;
+        stdx::optional<tcp_nodelay_what> tcp_nodelay;
+        rpc_compression_algorithm compression_algorithm = rpc_compression_algorithm::lz4;
+        // Frames smaller than this are sent uncompressed.
+        size_t compression_threshold = 0;
+    };
+    using connection_classes_options = std::array<connection_class_options, connection_class_count>;
+
 private:
     gms::inet_address _listen_address;
     uint16_t _port;
     uint16_t _ssl_port;
+    // Shard N also listens to _shard_port + N, for connections to it alone.
+    // 0 when disabled.
+    uint16_t _shard_port;
     encrypt_what _encrypt_what;
     compress_what _compress_what;
+    // Compress the gossip connections, whatever _compress_what is.
+    bool _compress_gossip;
     tcp_nodelay_what _tcp_nodelay_what;
+    connection_classes_options _class_options;
     bool _should_listen_to_broadcast_address;
     // map: Node broadcast address -> Node internal IP for communication within the same data center
     std::unordered_map<gms::inet_address, gms::inet_address> _preferred_ip_cache;
@@ -203,8 +260,27 @@ class messaging_service : public seastar::async_sharded_service<messaging_servic
     std::array<std::unique_ptr<rpc_protocol_server_wrapper>, 2> _server;
     ::shared_ptr<seastar::tls::server_credentials> _credentials;
     std::array<std::unique_ptr<rpc_protocol_server_wrapper>, 2> _server_tls;
-    std::array<clients_map, 4> _clients;
+    std::unique_ptr<rpc_protocol_server_wrapper> _shard_server;
+    // By connection class, followed by the writes, the reads and the repair
+    // requests sent to the shards of peers which listen to a port per shard,
+    // by destination shard.
+    std::array<clients_map, connection_class_count + 3> _clients;
+    // How peers which listen to a port per shard shard their data.
+    struct peer_sharding {
+        uint16_t shard_port;
+        std::unique_ptr<dht::i_partitioner> partitioner;
+    };
+    std::unordered_map<gms::inet_address, peer_sharding> _peer_sharding;
+    // The compressors offered by the connections to a peer, and what they
+    // compressed.
+    struct peer_compression;
+    std::unordered_map<gms::inet_address, std::unique_ptr<peer_compression>> _peer_compression;
+    struct server_compression;
+    std::unique_ptr<server_compression> _server_compression;
     uint64_t _dropped_messages[static_cast<int32_t>(messaging_verb::LAST)] = {};
+    // Each of which takes a full handshake: the TLS layer doesn't resume sessions.
+    uint64_t _tls_client_connects = 0;
+    seastar::metrics::metric_groups _metrics;
     bool _stopping = false;
     std::list<std::function<void(gms::inet_address ep)>> _connection_drop_notifiers;
 
@@ -213,13 +289,16 @@ class messaging_service : public seastar::async_sharded_service<messaging_servic
 public:
     messaging_service(gms::inet_address ip = gms::inet_address("0.0.0.0"),
             uint16_t port = 7000, bool listen_now = true);
-    messaging_service(gms::inet_address ip, uint16_t port, encrypt_what, compress_what, tcp_nodelay_what,
-            uint16_t ssl_port, std::shared_ptr<seastar::tls::credentials_builder>,
-            bool sltba = false, bool listen_now = true);
+    messaging_service(gms::inet_address ip, uint16_t port, encrypt_what, compress_what, bool compress_gossip, tcp_nodelay_what,
+            uint16_t ssl_port, uint16_t shard_port, std::shared_ptr<seastar::tls::credentials_builder>,
+            bool sltba = false, bool listen_now = true, connection_classes_options class_options = {});
     ~messaging_service();
 public:
     void start_listen();
     uint16_t port();
+    uint16_t shard_port() const {
+        return _shard_port;
+    }
     gms::inet_address listen_address();
     future<> stop_tls_server();
     future<> stop_nontls_server();
@@ -232,6 +311,15 @@ class messaging_service : public seastar::async_sharded_service<messaging_servic
     future<> init_local_preferred_ip_cache();
     void cache_preferred_ip(gms::inet_address ep, gms::inet_address ip);
 
+    // Records how a peer shards its data, as it gossips it. A shard_port of 0
+    // means that the peer has no port per shard.
+    void set_peer_sharding(gms::inet_address ep, unsigned shard_count, unsigned sharding_ignore_msb, uint16_t shard_port);
+    // The address of the shard of a peer which owns the token, so that replica
+    // requests sent to it are received by that shard, with no hop to another
+    // core. Falls back to the peer as a whole when the peer has no port per
+    // shard.
+    msg_addr replica_addr(gms::inet_address ep, const dht::token& t) const;
+
     // Wrapper for PREPARE_MESSAGE verb
     void register_prepare_message(std::function<future<streaming::prepare_message> (const rpc::client_info& cinfo,
             streaming::prepare_message msg, UUID plan_id, sstring description)>&& func);
@@ -252,11 +340,36 @@ class messaging_service : public seastar::async_sharded_service<messaging_servic
     void register_complete_message(std::function<future<> (const rpc::client_info& cinfo, UUID plan_id, unsigned dst_cpu_id, rpc::optional<bool> failed)>&& func);
     future<> send_complete_message(msg_addr id, UUID plan_id, unsigned dst_cpu_id, bool failed = false);
 
+    // Wrapper for STREAM_SSTABLE_DATA verb: a chunk of a component of a whole sstable
+    void register_stream_sstable_data(std::function<future<> (const rpc::client_info& cinfo, UUID plan_id, UUID cf_id, int64_t generation,
+            sstring file_name, sstring component, uint64_t offset, bytes data, unsigned dst_cpu_id)>&& func);
+    future<> send_stream_sstable_data(msg_addr id, UUID plan_id, UUID cf_id, int64_t generation,
+            sstring file_name, sstring component, uint64_t offset, bytes data, unsigned dst_cpu_id);
+
+    // Wrapper for STREAM_SSTABLE_DONE verb: all components of a whole sstable were sent
+    void register_stream_sstable_done(std::function<future<> (const rpc::client_info& cinfo, UUID plan_id, UUID cf_id, int64_t generation, unsigned dst_cpu_id)>&& func);
+    future<> send_stream_sstable_done(msg_addr id, UUID plan_id, UUID cf_id, int64_t generation, unsigned dst_cpu_id);
+
     // Wrapper for REPAIR_CHECKSUM_RANGE verb
     void register_repair_checksum_range(std::function<future<partition_checksum> (sstring keyspace, sstring cf, dht::token_range range, rpc::optional<repair_checksum> hash_version)>&& func);
     void unregister_repair_checksum_range();
     future<partition_checksum> send_repair_checksum_range(msg_addr id, sstring keyspace, sstring cf, dht::token_range range, repair_checksum hash_version);
 
+    // Wrapper for REPAIR_GET_ROW_HASHES verb
+    void register_repair_get_row_hashes(std::function<future<std::vector<repair_row_hash>> (sstring keyspace, sstring cf, dht::token_range range, stdx::optional<repair_row_hash> start_after, uint32_t max_rows)>&& func);
+    void unregister_repair_get_row_hashes();
+    future<std::vector<repair_row_hash>> send_repair_get_row_hashes(msg_addr id, sstring keyspace, sstring cf, dht::token_range range, stdx::optional<repair_row_hash> start_after, uint32_t max_rows);
+
+    // Wrapper for REPAIR_GET_ROWS verb
+    void register_repair_get_rows(std::function<future<std::vector<frozen_mutation>> (sstring keyspace, sstring cf, dht::token_range range, stdx::optional<repair_row_hash> start_after, std::vector<repair_row_hash> rows)>&& func);
+    void unregister_repair_get_rows();
+    future<std::vector<frozen_mutation>> send_repair_get_rows(msg_addr id, sstring keyspace, sstring cf, dht::token_range range, stdx::optional<repair_row_hash> start_after, std::vector<repair_row_hash> rows);
+
+    // Wrapper for REPAIR_PUT_ROWS verb
+    void register_repair_put_rows(std::function<future<> (const rpc::client_info& cinfo, std::vector<frozen_mutation> mutations)>&& func);
+    void unregister_repair_put_rows();
+    future<> send_repair_put_rows(msg_addr id, std::vector<frozen_mutation> mutations);
+
     // Wrapper for GOSSIP_ECHO verb
     void register_gossip_echo(std::function<future<> ()>&& func);
     void unregister_gossip_echo();
@@ -301,6 +414,13 @@ class messaging_service : public seastar::async_sharded_service<messaging_servic
     future<> send_mutation(msg_addr id, clock_type::time_point timeout, const frozen_mutation& fm, std::vector<inet_address> forward,
         inet_address reply_to, unsigned shard, response_id_type response_id, std::experimental::optional<tracing::trace_info> trace_info = std::experimental::nullopt);
 
+    // Wrapper for MUTATION_BATCH: mutations without forwarding, each acknowledged by MUTATION_DONE of its response id
+    void register_mutation_batch(std::function<future<rpc::no_wait_type> (const rpc::client_info&, rpc::opt_time_point, std::vector<frozen_mutation> fms,
+        inet_address reply_to, unsigned shard, std::vector<response_id_type> response_ids)>&& func);
+    void unregister_mutation_batch();
+    future<> send_mutation_batch(msg_addr id, clock_type::time_point timeout, const std::vector<frozen_mutation>& fms,
+        inet_address reply_to, unsigned shard, const std::vector<response_id_type>& response_ids);
+
     // Wrapper for COUNTER_MUTATION
     void register_counter_mutation(std::function<future<> (const rpc::client_info&, rpc::opt_time_point, std::vector<frozen_mutation> fms, db::consistency_level cl, stdx::optional<tracing::trace_info> trace_info)>&& func);
     void unregister_counter_mutation();
@@ -317,6 +437,34 @@ class messaging_service : public seastar::async_sharded_service<messaging_servic
     void unregister_read_data();
     future<query::result, rpc::optional<cache_temperature>> send_read_data(msg_addr id, clock_type::time_point timeout, const query::read_command& cmd, const dht::partition_range& pr, query::digest_algorithm da);
 
+    // Wrapper for AGGREGATE_QUERY
+    void register_aggregate_query(std::function<future<std::vector<bytes_opt>> (const rpc::client_info&, query::read_command cmd,
+        dht::partition_range_vector prs, std::vector<query::aggregate_selector> selectors)>&& func);
+    void unregister_aggregate_query();
+    future<std::vector<bytes_opt>> send_aggregate_query(msg_addr id, clock_type::time_point timeout, const query::read_command& cmd,
+        const dht::partition_range_vector& prs, const std::vector<query::aggregate_selector>& selectors);
+
+    // Wrapper for PAXOS_PREPARE: the promise, with the partition read by cmd right after it
+    void register_paxos_prepare(std::function<future<service::paxos::prepare_response> (const rpc::client_info&, rpc::opt_time_point,
+        query::read_command cmd, partition_key key, utils::UUID ballot, bool only_digest, query::digest_algorithm da)>&& func);
+    void unregister_paxos_prepare();
+    future<service::paxos::prepare_response> send_paxos_prepare(msg_addr id, clock_type::time_point timeout, const query::read_command& cmd,
+        const partition_key& key, utils::UUID ballot, bool only_digest, query::digest_algorithm da);
+
+    // Wrapper for PAXOS_ACCEPT
+    void register_paxos_accept(std::function<future<bool> (const rpc::client_info&, rpc::opt_time_point,
+        service::paxos::proposal proposal, stdx::optional<tracing::trace_info> trace_info)>&& func);
+    void unregister_paxos_accept();
+    future<bool> send_paxos_accept(msg_addr id, clock_type::time_point timeout, const service::paxos::proposal& proposal,
+        stdx::optional<tracing::trace_info> trace_info);
+
+    // Wrapper for PAXOS_LEARN
+    void register_paxos_learn(std::function<future<> (const rpc::client_info&, rpc::opt_time_point,
+        service::paxos::proposal decision, stdx::optional<tracing::trace_info> trace_info)>&& func);
+    void unregister_paxos_learn();
+    future<> send_paxos_learn(msg_addr id, clock_type::time_point timeout, const service::paxos::proposal& decision,
+        stdx::optional<tracing::trace_info> trace_info);
+
     // Wrapper for GET_SCHEMA_VERSION
     void register_get_schema_version(std::function<future<frozen_schema>(unsigned, table_schema_version)>&& func);
     void unregister_get_schema_version();
@@ -333,9 +481,9 @@ class messaging_service : public seastar::async_sharded_service<messaging_servic
     future<reconcilable_result, rpc::optional<cache_temperature>> send_read_mutation_data(msg_addr id, clock_type::time_point timeout, const query::read_command& cmd, const dht::partition_range& pr);
 
     // Wrapper for READ_DIGEST
-    void register_read_digest(std::function<future<query::result_digest, api::timestamp_type, cache_temperature> (const rpc::client_info&, query::read_command cmd, compat::wrapping_partition_range pr)>&& func);
+    void register_read_digest(std::function<future<query::result_digest, api::timestamp_type, cache_temperature> (const rpc::client_info&, query::read_command cmd, compat::wrapping_partition_range pr, rpc::optional<query::digest_algorithm> oda)>&& func);
     void unregister_read_digest();
-    future<query::result_digest, rpc::optional<api::timestamp_type>, rpc::optional<cache_temperature>> send_read_digest(msg_addr id, clock_type::time_point timeout, const query::read_command& cmd, const dht::partition_range& pr);
+    future<query::result_digest, rpc::optional<api::timestamp_type>, rpc::optional<cache_temperature>> send_read_digest(msg_addr id, clock_type::time_point timeout, const query::read_command& cmd, const dht::partition_range& pr, query::digest_algorithm da);
 
     // Wrapper for TRUNCATE
     void register_truncate(std::function<future<>(sstring, sstring)>&& func);
@@ -349,6 +497,10 @@ class messaging_service : public seastar::async_sharded_service<messaging_servic
     void foreach_server_connection_stats(std::function<void(const rpc::client_info&, const rpc::stats&)>&& f) const;
 private:
     bool remove_rpc_client_one(clients_map& clients, msg_addr id, bool dead_only);
+    uint16_t replica_port(messaging_verb verb, msg_addr id) const;
+    const rpc::compressor::factory* get_compressor_factory(gms::inet_address ep, unsigned cls);
+    unsigned client_idx(messaging_verb verb, msg_addr id) const;
+    msg_addr client_key(messaging_verb verb, msg_addr id) const;
 public:
     // Return rpc::protocol::client for a shard which is a ip + cpuid pair.
     shared_ptr<rpc_protocol_client_wrapper> get_rpc_client(messaging_verb verb, msg_addr id);
@@ -0,0 +1,188 @@
+/*
+ * Copyright (C) 2018 ScyllaDB
+ */
+
+/*
+ * This file is part of Scylla.
+ *
+ * Scylla is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Scylla is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "message/rpc_compressor.hh"
+#include "rpc/lz4_compressor.hh"
+#include "core/byteorder.hh"
+#include "core/print.hh"
+#include "util/variant_utils.hh"
+#include <zstd.h>
+
+namespace netw {
+
+namespace {
+
+// The first byte of each frame.
+enum class frame_type : uint8_t {
+    raw = 0,
+    lz4 = 1,
+    // Followed by the size of the frame before compression, as 4 bytes.
+    zstd = 2,
+};
+
+static constexpr int zstd_compression_level = 3;
+
+template <typename Buf>
+temporary_buffer<char>& first_fragment(Buf& buf) {
+    return seastar::visit(buf.bufs,
+        [] (temporary_buffer<char>& b) -> temporary_buffer<char>& { return b; },
+        [] (std::vector<temporary_buffer<char>>& bufs) -> temporary_buffer<char>& { return bufs.front(); });
+}
+
+template <typename Buf>
+temporary_buffer<char> linearize(Buf& buf) {
+    return seastar::visit(buf.bufs,
+        [&buf] (temporary_buffer<char>& b) { return b.share(0, buf.size); },
+        [&buf] (std::vector<temporary_buffer<char>>& bufs) {
+            temporary_buffer<char> out(buf.size);
+            auto p = out.get_write();
+            auto left = size_t(buf.size);
+            for (auto&& b : bufs) {
+                auto n = std::min(b.size(), left);
+                p = std::copy_n(b.get(), n, p);
+                left -= n;
+            }
+            return out;
+        });
+}
+
+class adaptive_rpc_compressor : public rpc::compressor {
+    struct cctx_deleter {
+        void operator()(ZSTD_CCtx* ctx) const { ZSTD_freeCCtx(ctx); }
+    };
+    struct dctx_deleter {
+        void operator()(ZSTD_DCtx* ctx) const { ZSTD_freeDCtx(ctx); }
+    };
+    rpc_compression_algorithm _algorithm;
+    size_t _threshold;
+    lw_shared_ptr<rpc_compression_stats> _stats;
+    rpc::lz4_compressor _lz4;
+    std::unique_ptr<ZSTD_CCtx, cctx_deleter> _cctx;
+    std::unique_ptr<ZSTD_DCtx, dctx_deleter> _dctx;
+private:
+    rpc::snd_buf compress_raw(size_t head_space, rpc::snd_buf& data) {
+        auto in = linearize(data);
+        temporary_buffer<char> out(head_space + 1 + in.size());
+        out.get_write()[head_space] = char(frame_type::raw);
+        std::copy_n(in.get(), in.size(), out.get_write() + head_space + 1);
+        return rpc::snd_buf(std::move(out));
+    }
+    rpc::snd_buf compress_zstd(size_t head_space, rpc::snd_buf& data) {
+        if (!_cctx) {
+            _cctx.reset(ZSTD_createCCtx());
+        }
+        auto in = linearize(data);
+        auto bound = ZSTD_compressBound(in.size());
+        temporary_buffer<char> out(head_space + 5 + bound);
+        auto p = out.get_write() + head_space;
+        *p++ = char(frame_type::zstd);
+        write_le<uint32_t>(p, in.size());
+        p += 4;
+        auto ret = ZSTD_compressCCtx(_cctx.get(), p, bound, in.get(), in.size(), zstd_compression_level);
+        if (ZSTD_isError(ret)) {
+            throw std::runtime_error(sprint("rpc zstd compression failure: %s", ZSTD_getErrorName(ret)));
+        }
+        out.trim(head_space + 5 + ret);
+        return rpc::snd_buf(std::move(out));
+    }
+    rpc::rcv_buf decompress_zstd(rpc::rcv_buf& data) {
+        if (data.size < 4) {
+            throw std::runtime_error("truncated rpc zstd frame");
+        }
+        if (!_dctx) {
+            _dctx.reset(ZSTD_createDCtx());
+        }
+        auto in = linearize(data);
+        auto size = read_le<uint32_t>(in.get());
+        temporary_buffer<char> out(size);
+        auto ret = ZSTD_decompressDCtx(_dctx.get(), out.get_write(), size, in.get() + 4, in.size() - 4);
+        if (ZSTD_isError(ret) || ret != size) {
+            throw std::runtime_error(sprint("rpc zstd decompression failure: %s", ZSTD_isError(ret) ? ZSTD_getErrorName(ret) : "bad size"));
+        }
+        return rpc::rcv_buf(std::move(out));
+    }
+public:
+    adaptive_rpc_compressor(rpc_compression_algorithm algorithm, size_t threshold, lw_shared_ptr<rpc_compression_stats> stats)
+        : _algorithm(algorithm), _threshold(threshold), _stats(std::move(stats)) { }
+
+    virtual rpc::snd_buf compress(size_t head_space, rpc::snd_buf data) override {
+        auto size = data.size;
+        rpc::snd_buf out;
+        bool bypassed = size < _threshold;
+        if (bypassed) {
+            out = compress_raw(head_space, data);
+        } else if (_algorithm == rpc_compression_algorithm::zstd) {
+            out = compress_zstd(head_space, data);
+        } else {
+            out = _lz4.compress(head_space + 1, std::move(data));
+            first_fragment(out).get_write()[head_space] = char(frame_type::lz4);
+        }
+        if (_stats) {
+            _stats->frames++;
+            _stats->bypassed_frames += bypassed;
+            _stats->bytes_before += size;
+            _stats->bytes_after += out.size - head_space;
+        }
+        return out;
+    }
+
+    virtual rpc::rcv_buf decompress(rpc::rcv_buf data) override {
+        if (data.size < 1) {
+            throw std::runtime_error("truncated compressed rpc frame");
+        }
+        auto& first = first_fragment(data);
+        auto type = frame_type(first[0]);
+        first.trim_front(1);
+        data.size -= 1;
+        switch (type) {
+        case frame_type::raw:
+            return data;
+        case frame_type::lz4:
+            return _lz4.decompress(std::move(data));
+        case frame_type::zstd:
+            return decompress_zstd(data);
+        }
+        throw std::runtime_error(sprint("unknown compressed rpc frame type %d", unsigned(type)));
+    }
+};
+
+}
+
+adaptive_rpc_compressor_factory::adaptive_rpc_compressor_factory(rpc_compression_algorithm algorithm, size_t threshold,
+        lw_shared_ptr<rpc_compression_stats> stats)
+    : _algorithm(algorithm)
+    , _feature(algorithm == rpc_compression_algorithm::zstd ? "ZSTD_ADAPTIVE" : "LZ4_ADAPTIVE")
+    , _threshold(threshold)
+    , _stats(std::move(stats))
+{ }
+
+const sstring& adaptive_rpc_compressor_factory::supported() const {
+    return _feature;
+}
+
+std::unique_ptr<rpc::compressor> adaptive_rpc_compressor_factory::negotiate(sstring feature, bool is_server) const {
+    if (feature != _feature) {
+        return nullptr;
+    }
+    return std::make_unique<adaptive_rpc_compressor>(_algorithm, _threshold, _stats);
+}
+
+}
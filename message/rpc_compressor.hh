@@ -0,0 +1,65 @@
+/*
+ * Copyright (C) 2018 ScyllaDB
+ */
+
+/*
+ * This file is part of Scylla.
+ *
+ * Scylla is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Scylla is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "rpc/rpc_types.hh"
+#include "core/shared_ptr.hh"
+#include "core/sstring.hh"
+
+namespace netw {
+
+enum class rpc_compression_algorithm {
+    lz4,
+    zstd,
+};
+
+// The frames a node sent on its compressed connections to a peer.
+struct rpc_compression_stats {
+    uint64_t frames = 0;
+    // Frames below the threshold, sent uncompressed.
+    uint64_t bypassed_frames = 0;
+    uint64_t bytes_before = 0;
+    uint64_t bytes_after = 0;
+};
+
+// Negotiates compressors which compress the frames of a connection with the
+// given algorithm, except the frames smaller than the threshold, which are
+// sent as they are: compressing small messages, like acknowledgments, costs
+// CPU and saves next to nothing. Each frame starts with a byte telling how it
+// was sent, so the threshold is up to the sender.
+//
+// Peers which don't know the algorithm negotiate the plain LZ4 compressor
+// instead, which the multi_algo_compressor_factory this one is part of
+// should also offer.
+class adaptive_rpc_compressor_factory : public rpc::compressor::factory {
+    rpc_compression_algorithm _algorithm;
+    sstring _feature;
+    size_t _threshold;
+    lw_shared_ptr<rpc_compression_stats> _stats;
+public:
+    // stats may be null.
+    adaptive_rpc_compressor_factory(rpc_compression_algorithm algorithm, size_t threshold, lw_shared_ptr<rpc_compression_stats> stats = {});
+    virtual const sstring& supported() const override;
+    virtual std::unique_ptr<rpc::compressor> negotiate(sstring feature, bool is_server) const override;
+};
+
+}
@@ -0,0 +1,138 @@
+/*
+ * Copyright (C) 2017 ScyllaDB
+ */
+
+/*
+ * This file is part of Scylla.
+ *
+ * Scylla is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Scylla is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <array>
+#include <algorithm>
+#include "utils/murmur_hash.hh"
+#include "hashing.hh"
+#include "bytes.hh"
+
+// Incremental MurmurHash3 x64_128. Feeding data in any number of pieces gives
+// the same 128-bit result as utils::murmur_hash::hash3_x64_128() over the
+// concatenation of the pieces. Much faster than MD5, but not cryptographic.
+class murmur3_hasher {
+    static constexpr uint64_t c1 = 0x87c37b91114253d5ULL;
+    static constexpr uint64_t c2 = 0x4cf5ad432745937fULL;
+public:
+    static constexpr size_t digest_size = 16;
+private:
+    uint64_t _h1;
+    uint64_t _h2;
+    uint64_t _length = 0;
+    std::array<uint8_t, 16> _buf;
+    size_t _buf_size = 0;
+private:
+    static uint64_t load64(const uint8_t* p) {
+        const uint8_t* it = p;
+        return utils::murmur_hash::read_block(it);
+    }
+
+    void process_block(const uint8_t* p) {
+        using namespace utils::murmur_hash;
+        uint64_t k1 = load64(p);
+        uint64_t k2 = load64(p + 8);
+
+        k1 *= c1; k1 = rotl64(k1, 31); k1 *= c2; _h1 ^= k1;
+        _h1 = rotl64(_h1, 27); _h1 += _h2; _h1 = _h1 * 5 + 0x52dce729;
+
+        k2 *= c2; k2 = rotl64(k2, 33); k2 *= c1; _h2 ^= k2;
+        _h2 = rotl64(_h2, 31); _h2 += _h1; _h2 = _h2 * 5 + 0x38495ab5;
+    }
+public:
+    explicit murmur3_hasher(uint64_t seed = 0) : _h1(seed), _h2(seed) { }
+
+    void update(const char* ptr, size_t length) {
+        auto p = reinterpret_cast<const uint8_t*>(ptr);
+        _length += length;
+        if (_buf_size) {
+            auto n = std::min(length, _buf.size() - _buf_size);
+            std::copy_n(p, n, _buf.begin() + _buf_size);
+            _buf_size += n;
+            p += n;
+            length -= n;
+            if (_buf_size < _buf.size()) {
+                return;
+            }
+            process_block(_buf.data());
+            _buf_size = 0;
+        }
+        while (length >= _buf.size()) {
+            process_block(p);
+            p += _buf.size();
+            length -= _buf.size();
+        }
+        std::copy_n(p, length, _buf.begin());
+        _buf_size = length;
+    }
+
+    std::array<uint64_t, 2> finalize_u64() {
+        using namespace utils::murmur_hash;
+        uint64_t k1 = 0;
+        uint64_t k2 = 0;
+        auto& t = _buf;
+        switch (_buf_size) {
+            case 15: k2 ^= uint64_t(t[14]) << 48;
+            case 14: k2 ^= uint64_t(t[13]) << 40;
+            case 13: k2 ^= uint64_t(t[12]) << 32;
+            case 12: k2 ^= uint64_t(t[11]) << 24;
+            case 11: k2 ^= uint64_t(t[10]) << 16;
+            case 10: k2 ^= uint64_t(t[9]) << 8;
+            case  9: k2 ^= uint64_t(t[8]);
+                k2 *= c2; k2 = rotl64(k2, 33); k2 *= c1; _h2 ^= k2;
+            case  8: k1 ^= uint64_t(t[7]) << 56;
+            case  7: k1 ^= uint64_t(t[6]) << 48;
+            case  6: k1 ^= uint64_t(t[5]) << 40;
+            case  5: k1 ^= uint64_t(t[4]) << 32;
+            case  4: k1 ^= uint64_t(t[3]) << 24;
+            case  3: k1 ^= uint64_t(t[2]) << 16;
+            case  2: k1 ^= uint64_t(t[1]) << 8;
+            case  1: k1 ^= uint64_t(t[0]);
+                k1 *= c1; k1 = rotl64(k1, 31); k1 *= c2; _h1 ^= k1;
+        };
+
+        _h1 ^= _length;
+        _h2 ^= _length;
+        _h1 += _h2;
+        _h2 += _h1;
+        _h1 = fmix(_h1);
+        _h2 = fmix(_h2);
+        _h1 += _h2;
+        _h2 += _h1;
+        return {{ _h1, _h2 }};
+    }
+
+    std::array<uint8_t, digest_size> finalize_array() {
+        auto h = finalize_u64();
+        std::array<uint8_t, digest_size> array;
+        for (unsigned i = 0; i < 8; ++i) {
+            array[i] = h[0] >> (8 * i);
+            array[8 + i] = h[1] >> (8 * i);
+        }
+        return array;
+    }
+
+    bytes finalize() {
+        auto array = finalize_array();
+        return bytes(reinterpret_cast<const int8_t*>(array.data()), array.size());
+    }
+};
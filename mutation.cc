@@ -114,26 +114,27 @@ mutation::query(query::result::builder& builder,
     auto is_reversed = slice.options.contains<query::partition_slice::option::reversed>();
     mutation_partition& p = partition();
     auto limit = std::min(row_limit, slice.partition_row_limit());
-    p.compact_for_query(*schema(), now, slice.row_ranges(*schema(), key()), is_reversed, limit);
+    // Rows are filtered after compaction, which mustn't drop those they would be counted instead of.
+    p.compact_for_query(*schema(), now, slice.row_ranges(*schema(), key()), is_reversed, slice.filters().empty() ? limit : query::max_rows);
     p.query_compacted(pb, *schema(), limit);
 }
 
 query::result
 mutation::query(const query::partition_slice& slice,
-    query::result_request request,
+    query::result_options opts,
     gc_clock::time_point now, uint32_t row_limit) &&
 {
-    query::result::builder builder(slice, request, { });
+    query::result::builder builder(slice, opts, { });
     std::move(*this).query(builder, slice, now, row_limit);
     return builder.build();
 }
 
 query::result
 mutation::query(const query::partition_slice& slice,
-    query::result_request request,
+    query::result_options opts,
     gc_clock::time_point now, uint32_t row_limit) const&
 {
-    return mutation(*this).query(slice, request, now, row_limit);
+    return mutation(*this).query(slice, opts, now, row_limit);
 }
 
 size_t
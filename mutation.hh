@@ -107,14 +107,14 @@ class mutation final {
 public:
     // The supplied partition_slice must be governed by this mutation's schema
     query::result query(const query::partition_slice&,
-        query::result_request request = query::result_request::only_result,
+        query::result_options opts = query::result_options(),
         gc_clock::time_point now = gc_clock::now(),
         uint32_t row_limit = query::max_rows) &&;
 
     // The supplied partition_slice must be governed by this mutation's schema
     // FIXME: Slower than the r-value version
     query::result query(const query::partition_slice&,
-        query::result_request request = query::result_request::only_result,
+        query::result_options opts = query::result_options(),
         gc_clock::time_point now = gc_clock::now(),
         uint32_t row_limit = query::max_rows) const&;
 
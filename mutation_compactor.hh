@@ -76,6 +76,9 @@ class compact_mutation {
     range_tombstone_accumulator _range_tombstones;
 
     bool _static_row_live{};
+    // Whether the static row satisfies the filters of the slice on static
+    // columns, so that the rows of the partition may be returned.
+    bool _static_row_matches{};
     uint32_t _rows_in_current_partition;
     uint32_t _current_partition_limit;
     bool _empty_partition{};
@@ -161,6 +164,7 @@ class compact_mutation {
         _empty_partition = true;
         _rows_in_current_partition = 0;
         _static_row_live = false;
+        _static_row_matches = !_slice.has_static_filters();
         _range_tombstones.clear();
         _current_partition_limit = std::min(_row_limit, _partition_row_limit);
         _max_purgeable = api::missing_timestamp;
@@ -179,6 +183,13 @@ class compact_mutation {
                                                      row_tombstone(current_tombstone),
                                                      _query_time, _can_gc, _gc_before);
         _static_row_live = is_live;
+        if (is_live && _slice.has_static_filters()) {
+            _static_row_matches = _slice.static_row_matches(_schema, sr.cells());
+            if (!_static_row_matches) {
+                _static_row_live = false;
+                return stop_iteration::no;
+            }
+        }
         if (is_live || (!only_live() && !sr.empty())) {
             partition_is_not_empty();
             return _consumer.consume(std::move(sr), current_tombstone, is_live);
@@ -195,6 +206,10 @@ class compact_mutation {
         t.apply(current_tombstone);
         bool is_live = cr.marker().compact_and_expire(t.tomb(), _query_time, _can_gc, _gc_before);
         is_live |= cr.cells().compact_and_expire(_schema, column_kind::regular_column, t, _query_time, _can_gc, _gc_before);
+        // Rows filtered out are neither returned nor counted.
+        if (is_live && (!_static_row_matches || !_slice.clustering_row_matches(_schema, cr.cells()))) {
+            return stop_iteration::no;
+        }
         if (only_live() && is_live) {
             partition_is_not_empty();
             auto stop = _consumer.consume(std::move(cr), t, true);
@@ -230,7 +245,8 @@ class compact_mutation {
         if (!_empty_partition) {
             // #589 - Do not add extra row for statics unless we did a CK range-less query.
             // See comment in query
-            if (_rows_in_current_partition == 0 && _static_row_live && !_has_ck_selector) {
+            // Nor when rows are filtered on regular columns, which it has none of.
+            if (_rows_in_current_partition == 0 && _static_row_live && !_has_ck_selector && !_slice.has_regular_filters()) {
                 ++_rows_in_current_partition;
             }
 
@@ -34,6 +34,7 @@
 #include "mutation_compactor.hh"
 #include "intrusive_set_external_comparator.hh"
 #include "counters.hh"
+#include "querier.hh"
 #include <seastar/core/execution_stage.hh>
 
 template<bool reversed>
@@ -203,7 +204,9 @@ auto apply_reversibly_intrusive_set(const schema& s, mutation_partition::rows_ty
         while (src_i != src.end()) {
             rows_entry& src_e = *src_i;
 
-            auto i = dst.lower_bound(src_e, cmp);
+            // Rows past the last one of dst, as most of time series writes, are
+            // appended without searching the tree.
+            auto i = dst.empty() || cmp(*dst.rbegin(), src_e) ? dst.end() : dst.lower_bound(src_e, cmp);
             if (i == dst.end() || cmp(src_e, *i)) {
                 // Construct erased entry which will represent missing dst entry for revert.
                 rows_entry* empty_e = current_allocator().construct<rows_entry>(rows_entry::erased_tag{}, src_e);
@@ -413,6 +416,18 @@ mutation_partition::apply(const schema& s, mutation_partition_view p, const sche
     }
 }
 
+void
+mutation_partition::apply_monotonically(const schema& s, mutation_partition_view p, const schema& p_schema) {
+    // Merging counter shards isn't idempotent in the presence of counter updates,
+    // so they keep the strong guarantees.
+    if (p_schema.version() != s.version() || s.is_counter()) {
+        apply(s, p, p_schema);
+        return;
+    }
+    mutation_partition_applier applier(s, *this);
+    p.accept(s, applier);
+}
+
 tombstone
 mutation_partition::range_tombstone_for_row(const schema& schema, const clustering_key& key) const {
     tombstone t = _tombstone;
@@ -520,48 +535,61 @@ mutation_partition::find_row(const schema& s, const clustering_key& key) const {
     return &i->row().cells();
 }
 
+// Time series writes mostly add rows past the last one of the partition,
+// which is checked for first, in constant time, instead of searching the tree.
+template<typename Key>
+std::pair<mutation_partition::rows_type::iterator, bool>
+mutation_partition::find_row_for_insert(const schema& s, const Key& key) {
+    rows_entry::compare cmp(s);
+    if (_rows.empty() || cmp(*_rows.rbegin(), key)) {
+        return { _rows.end(), false };
+    }
+    auto i = _rows.lower_bound(key, cmp);
+    return { i, i != _rows.end() && !cmp(key, *i) };
+}
+
 deletable_row&
 mutation_partition::clustered_row(const schema& s, clustering_key&& key) {
-    auto i = _rows.find(key, rows_entry::compare(s));
-    if (i == _rows.end()) {
+    auto i = find_row_for_insert(s, key);
+    if (!i.second) {
         auto e = current_allocator().construct<rows_entry>(std::move(key));
-        _rows.insert(i, *e, rows_entry::compare(s));
+        _rows.insert_before(i.first, *e);
         return e->row();
     }
-    return i->row();
+    return i.first->row();
 }
 
 deletable_row&
 mutation_partition::clustered_row(const schema& s, const clustering_key& key) {
-    auto i = _rows.find(key, rows_entry::compare(s));
-    if (i == _rows.end()) {
+    auto i = find_row_for_insert(s, key);
+    if (!i.second) {
         auto e = current_allocator().construct<rows_entry>(key);
-        _rows.insert(i, *e, rows_entry::compare(s));
+        _rows.insert_before(i.first, *e);
         return e->row();
     }
-    return i->row();
+    return i.first->row();
 }
 
 deletable_row&
 mutation_partition::clustered_row(const schema& s, clustering_key_view key) {
-    auto i = _rows.find(key, rows_entry::compare(s));
-    if (i == _rows.end()) {
+    auto i = find_row_for_insert(s, key);
+    if (!i.second) {
         auto e = current_allocator().construct<rows_entry>(key);
-        _rows.insert(i, *e, rows_entry::compare(s));
+        _rows.insert_before(i.first, *e);
         return e->row();
     }
-    return i->row();
+    return i.first->row();
 }
 
 deletable_row&
 mutation_partition::clustered_row(const schema& s, position_in_partition_view pos, is_dummy dummy, is_continuous continuous) {
-    auto i = _rows.find(pos, rows_entry::compare(s));
-    if (i == _rows.end()) {
+    auto i = find_row_for_insert(s, pos);
+    if (!i.second) {
         auto e = current_allocator().construct<rows_entry>(s, pos, dummy, continuous);
-        _rows.insert(i, *e, rows_entry::compare(s));
+        _rows.insert_before(i.first, *e);
         return e->row();
     }
-    return i->row();
+    return i.first->row();
 }
 
 mutation_partition::rows_type::const_iterator
@@ -690,8 +718,34 @@ void write_counter_cell(RowWriter& w, const query::partition_slice& slice, ::ato
             .end_qr_cell();
 }
 
+template<typename RowWriter>
+void skip_cell(RowWriter& w) {
+    w.add().skip();
+}
+
+// The compact_rows format carries the values only.
+static void skip_cell(query::compact_row_writer& w) {
+    w.skip();
+}
+
+static void write_cell(query::compact_row_writer& w, const query::partition_slice& slice, ::atomic_cell_view c) {
+    w.write(c.value());
+}
+
+static void write_cell(query::compact_row_writer& w, const query::partition_slice& slice, const data_type& type, collection_mutation_view v) {
+    auto ctype = static_pointer_cast<const collection_type_impl>(type);
+    if (slice.options.contains<query::partition_slice::option::collections_as_maps>()) {
+        ctype = map_type_impl::get_instance(ctype->name_comparator(), ctype->value_comparator(), true);
+    }
+    w.write(ctype->to_value(v, slice.cql_format()));
+}
+
+static void write_counter_cell(query::compact_row_writer& w, const query::partition_slice& slice, ::atomic_cell_view c) {
+    w.write(counter_cell_view::total_value_type()->decompose(counter_cell_view(c).total_value()));
+}
+
 // returns the timestamp of a latest update to the row
-static api::timestamp_type hash_row_slice(md5_hasher& hasher,
+static api::timestamp_type hash_row_slice(query::digester& hasher,
     const schema& s,
     column_kind kind,
     const row& cells,
@@ -729,13 +783,13 @@ static void get_compacted_row_slice(const schema& s,
     for (auto id : columns) {
         const atomic_cell_or_collection* cell = cells.find_cell(id);
         if (!cell) {
-            writer.add().skip();
+            skip_cell(writer);
         } else {
             auto&& def = s.column_at(kind, id);
             if (def.is_atomic()) {
                 auto c = cell->as_atomic_cell();
                 if (!c.is_live()) {
-                    writer.add().skip();
+                    skip_cell(writer);
                 } else if (def.is_counter()) {
                     write_counter_cell(writer, slice, cell->as_atomic_cell());
                 } else {
@@ -745,7 +799,7 @@ static void get_compacted_row_slice(const schema& s,
                 auto&& mut = cell->as_collection_mutation();
                 auto&& ctype = static_pointer_cast<const collection_type_impl>(def.type);
                 if (!ctype->is_any_live(mut)) {
-                    writer.add().skip();
+                    skip_cell(writer);
                 } else {
                     write_cell(writer, slice, def.type, mut);
                 }
@@ -754,6 +808,24 @@ static void get_compacted_row_slice(const schema& s,
     }
 }
 
+// Writes the cells of a row, finishing its qr_row, in the format requested by the slice.
+template<typename CellsWriter>
+static auto write_row_slice(const schema& s,
+    const query::partition_slice& slice,
+    column_kind kind,
+    const row& cells,
+    const std::vector<column_id>& columns,
+    CellsWriter&& wr)
+{
+    if (slice.options.contains<query::partition_slice::option::compact_rows>()) {
+        query::compact_row_writer cw;
+        get_compacted_row_slice(s, slice, kind, cells, columns, cw);
+        return std::move(wr).end_cells().write_compact_cells(cw.finish());
+    }
+    get_compacted_row_slice(s, slice, kind, cells, columns, wr);
+    return std::move(wr).end_cells().write_compact_cells(bytes_view());
+}
+
 bool has_any_live_data(const schema& s, column_kind kind, const row& cells, tombstone tomb = tombstone(),
                        gc_clock::time_point now = gc_clock::time_point::min()) {
     bool any_live = false;
@@ -788,29 +860,31 @@ mutation_partition::query_compacted(query::result::partition_writer& pw, const s
     }
 
     auto static_cells_wr = pw.start().start_static_row().start_cells();
-
-    if (!slice.static_columns.empty()) {
-        if (pw.requested_result()) {
-            get_compacted_row_slice(s, slice, column_kind::static_column, static_row(), slice.static_columns, static_cells_wr);
-        }
-        if (pw.requested_digest()) {
-            auto pt = partition_tombstone();
-            ::feed_hash(pw.digest(), pt);
-            auto t = hash_row_slice(pw.digest(), s, column_kind::static_column, static_row(), slice.static_columns);
-            pw.last_modified() = std::max({pw.last_modified(), pt.timestamp, t});
+    auto static_row_wr = [&] {
+        if (!slice.static_columns.empty() && pw.requested_result()) {
+            return write_row_slice(s, slice, column_kind::static_column, static_row(), slice.static_columns, std::move(static_cells_wr));
         }
+        return std::move(static_cells_wr).end_cells().write_compact_cells(bytes_view());
+    }();
+
+    if (!slice.static_columns.empty() && pw.requested_digest()) {
+        auto pt = partition_tombstone();
+        ::feed_hash(pw.digest(), pt);
+        auto t = hash_row_slice(pw.digest(), s, column_kind::static_column, static_row(), slice.static_columns);
+        pw.last_modified() = std::max({pw.last_modified(), pt.timestamp, t});
     }
 
-    auto rows_wr = std::move(static_cells_wr).end_cells()
+    auto rows_wr = std::move(static_row_wr)
             .end_static_row()
             .start_rows();
 
     uint32_t row_count = 0;
+    auto static_row_matches = slice.static_row_matches(s, static_row());
 
     auto is_reversed = slice.options.contains(query::partition_slice::option::reversed);
     auto send_ck = slice.options.contains(query::partition_slice::option::send_clustering_key);
     for_each_row(s, query::clustering_range::make_open_ended_both_sides(), is_reversed, [&] (const rows_entry& e) {
-        if (e.dummy()) {
+        if (e.dummy() || !static_row_matches || !slice.clustering_row_matches(s, e.row().cells())) {
             return stop_iteration::no;
         }
         auto& row = e.row();
@@ -832,8 +906,8 @@ mutation_partition::query_compacted(query::result::partition_writer& pw, const s
                         return rows_wr.add().skip_key().start_cells().start_cells();
                     }
                 }();
-                get_compacted_row_slice(s, slice, column_kind::regular_column, row.cells(), slice.regular_columns, cells_wr);
-                std::move(cells_wr).end_cells().end_cells().end_qr_clustered_row();
+                write_row_slice(s, slice, column_kind::regular_column, row.cells(), slice.regular_columns, std::move(cells_wr))
+                        .end_cells().end_qr_clustered_row();
             }
             ++row_count;
             if (--limit == 0) {
@@ -849,7 +923,7 @@ mutation_partition::query_compacted(query::result::partition_writer& pw, const s
     // If ck:s exist, and we do a restriction on them, we either have maching
     // rows, or return nothing, since cql does not allow "is null".
     if (row_count == 0
-            && (has_ck_selector(pw.ranges())
+            && (has_ck_selector(pw.ranges()) || slice.has_regular_filters() || !static_row_matches
                     || !has_any_live_data(s, column_kind::static_column, static_row()))) {
         pw.retract();
     } else {
@@ -874,6 +948,9 @@ operator<<(std::ostream& os, const row& r) {
     case row::storage_type::vector:
         cells = ::join(", ", r.get_range_vector());
         break;
+    case row::storage_type::sparse:
+        cells = ::join(", ", r.get_range_sparse());
+        break;
     }
     return fprint(os, "{row: %s}", cells);
 }
@@ -1024,7 +1101,7 @@ apply_reversibly(const column_definition& def, atomic_cell_or_collection& dst,
             auto did_apply = counter_cell_view::apply_reversibly(dst, src);
             src_ac.set_revert(did_apply);
         } else {
-            if (compare_atomic_cell_for_merge(dst.as_atomic_cell(), src.as_atomic_cell()) < 0) {
+            if (compare_atomic_cell_for_merge(dst.as_fragmented_atomic_cell(), src.as_fragmented_atomic_cell()) < 0) {
                 std::swap(dst, src);
                 src_ac.set_revert(true);
             } else {
@@ -1069,6 +1146,19 @@ row::apply(const column_definition& column, atomic_cell_or_collection&& value) {
     apply_reversibly(column, value);
 }
 
+void
+row::apply(const column_definition& column, atomic_cell_view cell) {
+    if (!column.is_counter()) {
+        auto existing = find_cell(column.id);
+        if (existing && compare_atomic_cell_for_merge(existing->as_fragmented_atomic_cell(),
+                atomic_cell_fragmented_view(cell.serialize())) >= 0) {
+            return;
+        }
+    }
+    atomic_cell_or_collection tmp(cell);
+    apply(column, std::move(tmp));
+}
+
 template<typename Func, typename Rollback>
 void row::for_each_cell(Func&& func, Rollback&& rollback) {
     static_assert(noexcept(rollback(std::declval<column_id>(), std::declval<atomic_cell_or_collection&>())),
@@ -1091,6 +1181,22 @@ void row::for_each_cell(Func&& func, Rollback&& rollback) {
             }
             throw;
         }
+    } else if (_type == storage_type::sparse) {
+        auto& sp = _storage.sparse;
+        size_type done = 0;
+        try {
+            sp.for_each_until([&] (column_id id, size_type pos) {
+                func(id, sp.cells[pos]);
+                ++done;
+                return stop_iteration::no;
+            });
+        } catch (...) {
+            while (done) {
+                --done;
+                rollback(sp.select(done), sp.cells[done]);
+            }
+            throw;
+        }
     } else {
         auto i = _storage.set.begin();
         try {
@@ -1129,9 +1235,25 @@ row::apply_reversibly(const column_definition& column, atomic_cell_or_collection
         } else {
             ::apply_reversibly(column, _storage.vector.v[id], value);
         }
+    } else if (_type != storage_type::set && id < max_sparse_size) {
+        if (_type == storage_type::vector) {
+            vector_to_sparse();
+        }
+        auto& sp = _storage.sparse;
+        auto pos = sp.rank(id);
+        if (sp.test(id)) {
+            ::apply_reversibly(column, sp.cells[pos], value);
+        } else {
+            sp.grow_to(id);
+            sp.cells.emplace(sp.cells.begin() + pos, std::move(value));
+            sp.set(id);
+            _size++;
+        }
     } else {
         if (_type == storage_type::vector) {
             vector_to_set();
+        } else if (_type == storage_type::sparse) {
+            sparse_to_set();
         }
         auto i = _storage.set.lower_bound(id, cell_entry::compare());
         if (i == _storage.set.end() || i->id() != id) {
@@ -1157,6 +1279,18 @@ row::revert(const column_definition& column, atomic_cell_or_collection& src) noe
         } else {
             ::revert(column, dst, src);
         }
+    } else if (_type == storage_type::sparse) {
+        auto& sp = _storage.sparse;
+        auto pos = sp.rank(id);
+        auto& dst = sp.cells[pos];
+        if (!src) {
+            std::swap(dst, src);
+            sp.cells.erase(sp.cells.begin() + pos);
+            sp.reset(id);
+            --_size;
+        } else {
+            ::revert(column, dst, src);
+        }
     } else {
         auto i = _storage.set.find(id, cell_entry::compare());
         auto& dst = i->cell();
@@ -1176,9 +1310,19 @@ row::append_cell(column_id id, atomic_cell_or_collection value) {
         _storage.vector.v.resize(id);
         _storage.vector.v.emplace_back(std::move(value));
         _storage.vector.present.set(id);
+    } else if (_type != storage_type::set && id < max_sparse_size) {
+        if (_type == storage_type::vector) {
+            vector_to_sparse();
+        }
+        auto& sp = _storage.sparse;
+        sp.grow_to(id);
+        sp.cells.emplace_back(std::move(value));
+        sp.set(id);
     } else {
         if (_type == storage_type::vector) {
             vector_to_set();
+        } else if (_type == storage_type::sparse) {
+            sparse_to_set();
         }
         auto e = current_allocator().construct<cell_entry>(id, std::move(value));
         _storage.set.insert(_storage.set.end(), *e);
@@ -1193,6 +1337,11 @@ row::find_cell(column_id id) const {
             return nullptr;
         }
         return &_storage.vector.v[id];
+    } else if (_type == storage_type::sparse) {
+        if (!_storage.sparse.test(id)) {
+            return nullptr;
+        }
+        return &_storage.sparse.cells[_storage.sparse.rank(id)];
     } else {
         auto i = _storage.set.find(id, cell_entry::compare());
         if (i == _storage.set.end()) {
@@ -1209,6 +1358,11 @@ size_t row::external_memory_usage() const {
         for (auto&& ac_o_c : _storage.vector.v) {
             mem += ac_o_c.external_memory_usage();
         }
+    } else if (_type == storage_type::sparse) {
+        mem += _storage.sparse.present.external_memory_usage() + _storage.sparse.cells.external_memory_usage();
+        for (auto&& ac_o_c : _storage.sparse.cells) {
+            mem += ac_o_c.external_memory_usage();
+        }
     } else {
         for (auto&& ce : _storage.set) {
             mem += sizeof(cell_entry) + ce.cell().external_memory_usage();
@@ -1400,6 +1554,8 @@ row::row(const row& o)
 {
     if (_type == storage_type::vector) {
         new (&_storage.vector) vector_storage(o._storage.vector);
+    } else if (_type == storage_type::sparse) {
+        new (&_storage.sparse) sparse_storage(o._storage.sparse);
     } else {
         auto cloner = [] (const auto& x) {
             return current_allocator().construct<std::remove_const_t<std::remove_reference_t<decltype(x)>>>(x);
@@ -1417,6 +1573,8 @@ row::row(const row& o)
 row::~row() {
     if (_type == storage_type::vector) {
         _storage.vector.~vector_storage();
+    } else if (_type == storage_type::sparse) {
+        _storage.sparse.~sparse_storage();
     } else {
         _storage.set.clear_and_dispose(current_deleter<cell_entry>());
         _storage.set.~map_type();
@@ -1468,32 +1626,93 @@ void row::vector_to_set()
     _type = storage_type::set;
 }
 
+void row::vector_to_sparse()
+{
+    assert(_type == storage_type::vector);
+    static_assert(max_vector_size <= sparse_storage::bits_per_word, "vector storage must fit in one bitmap word");
+    sparse_storage sparse;
+    sparse.present.push_back(_storage.vector.present.to_ullong());
+    sparse.cells.reserve(_size);
+    for (auto i : bitsets::for_each_set(_storage.vector.present)) {
+        sparse.cells.emplace_back(std::move(_storage.vector.v[i]));
+    }
+    _storage.vector.~vector_storage();
+    new (&_storage.sparse) sparse_storage(std::move(sparse));
+    _type = storage_type::sparse;
+}
+
+void row::sparse_to_set()
+{
+    assert(_type == storage_type::sparse);
+    auto& sp = _storage.sparse;
+    map_type set;
+    try {
+        sp.for_each_until([&] (column_id id, size_type pos) {
+            auto e = current_allocator().construct<cell_entry>(id, std::move(sp.cells[pos]));
+            set.insert(set.end(), *e);
+            return stop_iteration::no;
+        });
+    } catch (...) {
+        set.clear_and_dispose([&sp, del = current_deleter<cell_entry>()] (cell_entry* ce) noexcept {
+            sp.cells[sp.rank(ce->id())] = std::move(ce->cell());
+            del(ce);
+        });
+        throw;
+    }
+    _storage.sparse.~sparse_storage();
+    new (&_storage.set) map_type(std::move(set));
+    _type = storage_type::set;
+}
+
+column_id row::last_column_id() const
+{
+    switch (_type) {
+    case storage_type::vector:
+        return _storage.vector.v.size() - 1;
+    case storage_type::sparse:
+        return _storage.sparse.select(_storage.sparse.cells.size() - 1);
+    case storage_type::set:
+        return _storage.set.rbegin()->id();
+    }
+    abort();
+}
+
 void row::reserve(column_id last_column)
 {
     if (_type == storage_type::vector && last_column >= internal_count) {
-        if (last_column >= max_vector_size) {
+        if (last_column >= max_sparse_size) {
             vector_to_set();
+        } else if (last_column >= max_vector_size) {
+            vector_to_sparse();
+            _storage.sparse.grow_to(last_column);
         } else {
             _storage.vector.v.reserve(last_column);
         }
+    } else if (_type == storage_type::sparse && last_column >= max_sparse_size) {
+        sparse_to_set();
     }
 }
 
 template<typename Func>
-auto row::with_both_ranges(const row& other, Func&& func) const {
-    if (_type == storage_type::vector) {
-        if (other._type == storage_type::vector) {
-            return func(get_range_vector(), other.get_range_vector());
-        } else {
-            return func(get_range_vector(), other.get_range_set());
-        }
-    } else {
-        if (other._type == storage_type::vector) {
-            return func(get_range_set(), other.get_range_vector());
-        } else {
-            return func(get_range_set(), other.get_range_set());
-        }
+auto row::with_range(Func&& func) const {
+    switch (_type) {
+    case storage_type::vector:
+        return func(get_range_vector());
+    case storage_type::sparse:
+        return func(get_range_sparse());
+    case storage_type::set:
+        return func(get_range_set());
     }
+    abort();
+}
+
+template<typename Func>
+auto row::with_both_ranges(const row& other, Func&& func) const {
+    return with_range([&] (auto r1) {
+        return other.with_range([&] (auto r2) {
+            return func(r1, r2);
+        });
+    });
 }
 
 bool row::operator==(const row& other) const {
@@ -1534,6 +1753,8 @@ row::row(row&& other) noexcept
     : _type(other._type), _size(other._size) {
     if (_type == storage_type::vector) {
         new (&_storage.vector) vector_storage(std::move(other._storage.vector));
+    } else if (_type == storage_type::sparse) {
+        new (&_storage.sparse) sparse_storage(std::move(other._storage.sparse));
     } else {
         new (&_storage.set) map_type(std::move(other._storage.set));
     }
@@ -1551,11 +1772,7 @@ void row::apply_reversibly(const schema& s, column_kind kind, row& other) {
     if (other.empty()) {
         return;
     }
-    if (other._type == storage_type::vector) {
-        reserve(other._storage.vector.v.size() - 1);
-    } else {
-        reserve(other._storage.set.rbegin()->id());
-    }
+    reserve(other.last_column_id());
     other.for_each_cell([&] (column_id id, atomic_cell_or_collection& cell) {
         apply_reversibly(s.column_at(kind, id), cell);
     }, [&] (column_id id, atomic_cell_or_collection& cell) noexcept {
@@ -1567,11 +1784,7 @@ void row::apply(const schema& s, column_kind kind, const row& other) {
     if (other.empty()) {
         return;
     }
-    if (other._type == storage_type::vector) {
-        reserve(other._storage.vector.v.size() - 1);
-    } else {
-        reserve(other._storage.set.rbegin()->id());
-    }
+    reserve(other.last_column_id());
     other.for_each_cell([&] (column_id id, const atomic_cell_or_collection& cell) {
         apply(s.column_at(kind, id), cell);
     });
@@ -1581,11 +1794,7 @@ void row::apply(const schema& s, column_kind kind, row&& other) {
     if (other.empty()) {
         return;
     }
-    if (other._type == storage_type::vector) {
-        reserve(other._storage.vector.v.size() - 1);
-    } else {
-        reserve(other._storage.set.rbegin()->id());
-    }
+    reserve(other.last_column_id());
     other.for_each_cell([&] (column_id id, atomic_cell_or_collection& cell) {
         apply(s.column_at(kind, id), std::move(cell));
     });
@@ -1672,7 +1881,7 @@ row row::difference(const schema& s, column_kind kind, const row& other) const
                     r.append_cell(c.first, std::move(*cell));
                 }
             } else if (s.column_at(kind, c.first).is_atomic()) {
-                if (compare_atomic_cell_for_merge(c.second.as_atomic_cell(), it->second.as_atomic_cell()) > 0) {
+                if (compare_atomic_cell_for_merge(c.second.as_fragmented_atomic_cell(), it->second.as_fragmented_atomic_cell()) > 0) {
                     r.append_cell(c.first, c.second);
                 }
             } else {
@@ -1804,17 +2013,23 @@ mutation_querier::mutation_querier(const schema& s, query::result::partition_wri
 void mutation_querier::query_static_row(const row& r, tombstone current_tombstone)
 {
     const query::partition_slice& slice = _pw.slice();
+    auto& result_out = _static_cells_wr._out;
+    auto start = result_out.size();
+    auto static_row_wr = [&] {
+        if (!slice.static_columns.empty() && _pw.requested_result()) {
+            return write_row_slice(_schema, slice, column_kind::static_column,
+                                   r, slice.static_columns, std::move(_static_cells_wr));
+        }
+        return std::move(_static_cells_wr).end_cells().write_compact_cells(bytes_view());
+    }();
     if (!slice.static_columns.empty()) {
         if (_pw.requested_result()) {
-            auto start = _static_cells_wr._out.size();
-            get_compacted_row_slice(_schema, slice, column_kind::static_column,
-                                    r, slice.static_columns, _static_cells_wr);
-            _memory_accounter.update(_static_cells_wr._out.size() - start);
+            _memory_accounter.update(result_out.size() - start);
         } else if (_short_reads_allowed) {
             seastar::measuring_output_stream stream;
             ser::qr_partition__static_row__cells<seastar::measuring_output_stream> out(stream, { });
             get_compacted_row_slice(_schema, slice, column_kind::static_column,
-                                    r, slice.static_columns, _static_cells_wr);
+                                    r, slice.static_columns, out);
             _memory_accounter.update(stream.size());
         }
         if (_pw.requested_digest()) {
@@ -1824,7 +2039,7 @@ void mutation_querier::query_static_row(const row& r, tombstone current_tombston
             _pw.last_modified() = std::max({_pw.last_modified(), current_tombstone.timestamp, t});
         }
     }
-    _rows_wr.emplace(std::move(_static_cells_wr).end_cells().end_static_row().start_rows());
+    _rows_wr.emplace(std::move(static_row_wr).end_static_row().start_rows());
 }
 
 stop_iteration mutation_querier::consume(static_row&& sr, tombstone current_tombstone) {
@@ -1861,8 +2076,8 @@ stop_iteration mutation_querier::consume(clustering_row&& cr, row_tombstone curr
                 return rows_writer.add().skip_key().start_cells().start_cells();
             }
         }();
-        get_compacted_row_slice(_schema, slice, column_kind::regular_column, cr.cells(), slice.regular_columns, cells_wr);
-        std::move(cells_wr).end_cells().end_cells().end_qr_clustered_row();
+        write_row_slice(_schema, slice, column_kind::regular_column, cr.cells(), slice.regular_columns, std::move(cells_wr))
+                .end_cells().end_qr_clustered_row();
     };
 
     auto stop = stop_iteration::no;
@@ -1890,7 +2105,7 @@ uint32_t mutation_querier::consume_end_of_stream() {
     // If ck:s exist, and we do a restriction on them, we either have maching
     // rows, or return nothing, since cql does not allow "is null".
     if (!_live_clustering_rows
-        && (has_ck_selector(_pw.ranges()) || !_live_data_in_static_row)) {
+        && (has_ck_selector(_pw.ranges()) || !_live_data_in_static_row || _pw.slice().has_regular_filters())) {
         _pw.retract();
         return 0;
     } else {
@@ -1960,6 +2175,7 @@ future<> data_query(
         uint32_t partition_limit,
         gc_clock::time_point query_time,
         query::result::builder& builder,
+        const io_priority_class& pc,
         tracing::trace_state_ptr trace_ptr)
 {
     if (row_limit == 0 || slice.partition_row_limit() == 0 || partition_limit == 0) {
@@ -1972,15 +2188,36 @@ future<> data_query(
     auto cfq = make_stable_flattened_mutations_consumer<compact_for_query<emit_only_live_rows::yes, query_result_builder>>(
             *s, query_time, slice, row_limit, partition_limit, std::move(qrb));
 
-    auto reader = source(s, range, slice, service::get_local_sstable_query_read_priority(), std::move(trace_ptr));
-    return consume_flattened(std::move(reader), std::move(cfq), is_reversed);
+    auto reader = is_reversed ? make_reversing_reader(source, s, range, slice, pc, std::move(trace_ptr))
+                              : source(s, range, slice, pc, std::move(trace_ptr));
+    return consume_flattened(std::move(reader), std::move(cfq));
+}
+
+future<> data_query(
+        schema_ptr s,
+        querier& q,
+        const query::partition_slice& slice,
+        uint32_t row_limit,
+        uint32_t partition_limit,
+        gc_clock::time_point query_time,
+        query::result::builder& builder)
+{
+    if (row_limit == 0 || slice.partition_row_limit() == 0 || partition_limit == 0) {
+        return make_ready_future<>();
+    }
+
+    auto qrb = query_result_builder(*s, builder);
+    auto cfq = std::make_unique<compact_for_query<emit_only_live_rows::yes, query_result_builder>>(
+            *s, query_time, slice, row_limit, partition_limit, std::move(qrb));
+    auto& c = *cfq;
+    return q.consume_page(c).finally([cfq = std::move(cfq)] { });
 }
 
 class reconcilable_result_builder {
     const schema& _schema;
     const query::partition_slice& _slice;
 
-    std::vector<partition> _result;
+    utils::chunked_vector<partition> _result;
     uint32_t _live_rows;
 
     bool _has_ck_selector{};
@@ -2076,8 +2313,10 @@ static do_mutation_query(schema_ptr s,
     auto cfq = make_stable_flattened_mutations_consumer<compact_for_query<emit_only_live_rows::no, reconcilable_result_builder>>(
             *s, query_time, slice, row_limit, partition_limit, std::move(rrb));
 
-    auto reader = source(s, range, slice, service::get_local_sstable_query_read_priority(), std::move(trace_ptr));
-    return consume_flattened(std::move(reader), std::move(cfq), is_reversed);
+    auto& pc = service::get_local_sstable_query_read_priority();
+    auto reader = is_reversed ? make_reversing_reader(source, s, range, slice, pc, std::move(trace_ptr))
+                              : source(s, range, slice, pc, std::move(trace_ptr));
+    return consume_flattened(std::move(reader), std::move(cfq));
 }
 
 static thread_local auto mutation_query_stage = seastar::make_execution_stage("mutation_query", do_mutation_query);
@@ -2183,6 +2422,27 @@ void mutation_partition::evict() noexcept {
     _static_row = {};
 }
 
+size_t mutation_partition::evict_last_rows(size_t count) noexcept {
+    if (_rows.empty()) {
+        return 0;
+    }
+    auto last = std::prev(_rows.end());
+    auto first = last;
+    auto i = last;
+    for (size_t n = 0; n < 2 * count; ++n) {
+        if (i == _rows.begin()) {
+            return 0;
+        }
+        --i;
+        if (n < count) {
+            first = i;
+        }
+    }
+    _rows.erase_and_dispose(first, last, current_deleter<rows_entry>());
+    last->set_continuous(false);
+    return count;
+}
+
 bool
 mutation_partition::check_continuity(const schema& s, const position_range& r, is_continuous cont) {
     auto less = rows_entry::compare(s);
@@ -29,6 +29,7 @@
 #include <boost/range/adaptor/filtered.hpp>
 
 #include <seastar/core/bitset-iter.hh>
+#include <seastar/core/bitops.hh>
 
 #include "schema.hh"
 #include "tombstone.hh"
@@ -94,6 +95,7 @@ class row {
 
     enum class storage_type {
         vector,
+        sparse,
         set,
     };
     storage_type _type = storage_type::vector;
@@ -104,6 +106,8 @@ class row {
         boost::intrusive::compare<cell_entry::compare>, boost::intrusive::constant_time_size<false>>;
 public:
     static constexpr size_t max_vector_size = 32;
+    // Bounds the size of the bitmap of sparse rows, rows with higher column ids use the set.
+    static constexpr size_t max_sparse_size = 1024;
     static constexpr size_t internal_count = (sizeof(map_type) + sizeof(cell_entry)) / sizeof(atomic_cell_or_collection);
 private:
     using vector_type = managed_vector<atomic_cell_or_collection, internal_count, size_type>;
@@ -113,11 +117,84 @@ class row {
         vector_type v;
     };
 
+    // Cells of the columns set in the bitmap, packed in column order, so that
+    // the cell of a column is at the rank of its bit. Costs one bit per column
+    // id up to the last one, instead of a set node per cell.
+    struct sparse_storage {
+        using word_type = uint64_t;
+        static constexpr unsigned bits_per_word = std::numeric_limits<word_type>::digits;
+
+        managed_vector<word_type, 1, size_type> present;
+        managed_vector<atomic_cell_or_collection, 0, size_type> cells;
+
+        static word_type bit(column_id id) {
+            return word_type(1) << (id % bits_per_word);
+        }
+        bool test(column_id id) const {
+            auto w = id / bits_per_word;
+            return w < present.size() && (present[w] & bit(id));
+        }
+        // Number of cells of columns lower than id.
+        size_type rank(column_id id) const {
+            auto w = id / bits_per_word;
+            auto full_words = std::min<size_t>(w, present.size());
+            size_type r = 0;
+            for (size_t i = 0; i < full_words; ++i) {
+                r += __builtin_popcountll(present[i]);
+            }
+            if (w < present.size()) {
+                r += __builtin_popcountll(present[w] & (bit(id) - 1));
+            }
+            return r;
+        }
+        // Column of the n-th cell.
+        column_id select(size_type n) const {
+            for (size_t w = 0;; ++w) {
+                auto word = present[w];
+                size_type count = __builtin_popcountll(word);
+                if (n < count) {
+                    while (n--) {
+                        word &= word - 1;
+                    }
+                    return w * bits_per_word + count_trailing_zeros(word);
+                }
+                n -= count;
+            }
+        }
+        // Makes room in the bitmap for id. Doesn't set it.
+        void grow_to(column_id id) {
+            auto words = id / bits_per_word + 1;
+            if (present.size() < words) {
+                present.resize(words);
+            }
+        }
+        void set(column_id id) { present[id / bits_per_word] |= bit(id); }
+        void reset(column_id id) { present[id / bits_per_word] &= ~bit(id); }
+
+        // Calls func(column_id, size_type position) for each cell, in column order,
+        // until it returns stop_iteration::yes.
+        template<typename Func>
+        void for_each_until(Func&& func) const {
+            size_type pos = 0;
+            for (size_t w = 0; w < present.size(); ++w) {
+                auto word = present[w];
+                while (word) {
+                    column_id id = w * bits_per_word + count_trailing_zeros(word);
+                    word &= word - 1;
+                    if (func(id, pos++) == stop_iteration::yes) {
+                        return;
+                    }
+                }
+            }
+        }
+    };
+
     union storage {
         storage() { }
         ~storage() { }
         map_type set;
         vector_storage vector;
+        sparse_storage sparse;
     } _storage;
 public:
     row();
@@ -149,6 +226,23 @@ class row {
                     _size--;
                 }
             }
+        } else if (_type == storage_type::sparse) {
+            auto& sp = _storage.sparse;
+            size_type pos = 0;
+            for (size_t w = 0; w < sp.present.size(); ++w) {
+                auto word = sp.present[w];
+                while (word) {
+                    column_id id = w * sparse_storage::bits_per_word + count_trailing_zeros(word);
+                    word &= word - 1;
+                    if (func(id, sp.cells[pos])) {
+                        sp.cells.erase(sp.cells.begin() + pos);
+                        sp.reset(id);
+                        _size--;
+                    } else {
+                        ++pos;
+                    }
+                }
+            }
         } else {
             for (auto it = _storage.set.begin(); it != _storage.set.end();) {
                 if (func(it->id(), it->cell())) {
@@ -173,6 +267,12 @@ class row {
             return std::pair<column_id, const atomic_cell_or_collection&>(t.get<0>(), t.get<1>());
         });
     }
+    auto get_range_sparse() const {
+        return boost::irange<size_type>(0, _storage.sparse.cells.size())
+        | boost::adaptors::transformed([this] (size_type pos) {
+            return std::pair<column_id, const atomic_cell_or_collection&>(_storage.sparse.select(pos), _storage.sparse.cells[pos]);
+        });
+    }
     auto get_range_set() const {
         auto range = boost::make_iterator_range(_storage.set.begin(), _storage.set.end());
         return range | boost::adaptors::transformed([] (const cell_entry& c) {
@@ -180,9 +280,15 @@ class row {
         });
     }
     template<typename Func>
+    auto with_range(Func&& func) const;
+    template<typename Func>
     auto with_both_ranges(const row& other, Func&& func) const;
 
     void vector_to_set();
+    void vector_to_sparse();
+    void sparse_to_set();
+    // The highest column id in this row, which must not be empty.
+    column_id last_column_id() const;
 
     // Calls Func(column_id, atomic_cell_or_collection&) for each cell in this row.
     //
@@ -203,6 +309,11 @@ class row {
             for (auto i : bitsets::for_each_set(_storage.vector.present)) {
                 func(i, _storage.vector.v[i]);
             }
+        } else if (_type == storage_type::sparse) {
+            _storage.sparse.for_each_until([this, &func] (column_id id, size_type pos) {
+                func(id, _storage.sparse.cells[pos]);
+                return stop_iteration::no;
+            });
         } else {
             for (auto& cell : _storage.set) {
                 func(cell.id(), cell.cell());
@@ -227,6 +338,11 @@ class row {
                     break;
                 }
             }
+        } else if (_type == storage_type::sparse) {
+            _storage.sparse.for_each_until([this, &func] (column_id id, size_type pos) {
+                const auto& c = _storage.sparse.cells[pos];
+                return func(id, c);
+            });
         } else {
             for (auto& cell : _storage.set) {
                 const auto& c = cell.cell();
@@ -250,6 +366,12 @@ class row {
     //
     void apply(const column_definition& column, atomic_cell_or_collection&& cell);
 
+    // Merges cell into the row. Unlike the other overloads, it doesn't copy
+    // cells which lose to the one the row already has.
+    //
+    // Same guarantees as apply(const column_definition&, const atomic_cell_or_collection&).
+    void apply(const column_definition& column, atomic_cell_view cell);
+
     // Equivalent to calling apply_reversibly() with a row containing only given cell.
     // See reversibly_mergeable.hh
     void apply_reversibly(const column_definition& column, atomic_cell_or_collection& cell);
@@ -900,6 +1022,10 @@ class mutation_partition final {
     bool fully_discontinuous(const schema&, const position_range&);
     // Removes all data, marking affected ranges as discontinuous.
     void evict() noexcept;
+    // Removes the last count rows, marking the range they were in as
+    // discontinuous, when at least count rows would be left. Keeps the last
+    // entry, which must be a dummy. Returns the number of rows removed.
+    size_t evict_last_rows(size_t count) noexcept;
     // Applies mutation_fragment.
     // The fragment must be goverened by the same schema as this object.
     void apply(const schema& s, const mutation_fragment&);
@@ -936,6 +1062,15 @@ class mutation_partition final {
     void apply(const schema& s, mutation_partition&& p);
     // Same guarantees and constraints as for apply(const schema&, const mutation_partition&, const schema&).
     void apply(const schema& this_schema, mutation_partition_view p, const schema& p_schema);
+    //
+    // Applies p to current object, merging its rows and cells in place instead of
+    // building a temporary mutation_partition first, so that only the rows and cells
+    // which win are allocated. Falls back to apply() when the schemas differ or
+    // the table has counters.
+    //
+    // If exception is thrown, this object will be left with a part of p applied.
+    // Applying p again gives the same result as if the exception had not occurred.
+    void apply_monotonically(const schema& this_schema, mutation_partition_view p, const schema& p_schema);
 
     // Converts partition to the new schema. When succeeds the partition should only be accessed
     // using the new schema.
@@ -946,6 +1081,11 @@ class mutation_partition final {
     void insert_row(const schema& s, const clustering_key& key, deletable_row&& row);
     void insert_row(const schema& s, const clustering_key& key, const deletable_row& row);
 
+    // Returns the row with the given key, if present, or else the position at
+    // which to insert it.
+    template<typename Key>
+    std::pair<rows_type::iterator, bool> find_row_for_insert(const schema& s, const Key& key);
+
     uint32_t do_compact(const schema& s,
         gc_clock::time_point now,
         const std::vector<query::clustering_range>& row_ranges,
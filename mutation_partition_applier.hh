@@ -39,7 +39,7 @@ class mutation_partition_applier : public mutation_partition_visitor {
     }
 
     virtual void accept_static_cell(column_id id, atomic_cell_view cell) override {
-        _p._static_row.apply(_schema.column_at(column_kind::static_column, id), atomic_cell_or_collection(cell));
+        _p._static_row.apply(_schema.column_at(column_kind::static_column, id), cell);
     }
 
     virtual void accept_static_cell(column_id id, collection_mutation_view collection) override {
@@ -58,7 +58,7 @@ class mutation_partition_applier : public mutation_partition_visitor {
     }
 
     virtual void accept_row_cell(column_id id, atomic_cell_view cell) override {
-        _current_row->cells().apply(_schema.column_at(column_kind::regular_column, id), atomic_cell_or_collection(cell));
+        _current_row->cells().apply(_schema.column_at(column_kind::regular_column, id), cell);
     }
 
     virtual void accept_row_cell(column_id id, collection_mutation_view collection) override {
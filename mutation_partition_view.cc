@@ -107,8 +107,53 @@ collection_mutation read_collection_cell(ser::collection_cell_view cv)
     return collection_type_impl::serialize_mutation_form(mut);
 }
 
+// Builds live, expiring and dead cells in buf, which is reused for all cells
+// of the partition, and passes them to func as views. Only counter cells,
+// which are rare, are allocated.
+template<typename Func>
+void visit_atomic_cell(atomic_cell_variant& acv, bytes& buf, Func&& func)
+{
+    class atomic_cell_view_visitor : public boost::static_visitor<> {
+        bytes& _buf;
+        Func& _func;
+    public:
+        atomic_cell_view_visitor(bytes& buf, Func& func) : _buf(buf), _func(func) { }
+
+        void operator()(ser::live_cell_view& lcv) const {
+            auto value = lcv.value();
+            auto size = value.size();
+            _func(atomic_cell_view::from_bytes(atomic_cell_type::make_live_into(_buf, lcv.created_at(), size,
+                    [&value] (bytes::iterator out) { std::move(value).copy_to(out); })));
+        }
+        void operator()(ser::expiring_cell_view& ecv) const {
+            auto lcv = ecv.c();
+            auto value = lcv.value();
+            auto size = value.size();
+            _func(atomic_cell_view::from_bytes(atomic_cell_type::make_live_into(_buf, lcv.created_at(), size,
+                    ecv.expiry(), ecv.ttl(), [&value] (bytes::iterator out) { std::move(value).copy_to(out); })));
+        }
+        void operator()(ser::dead_cell_view& dcv) const {
+            auto tomb = dcv.tomb();
+            _func(atomic_cell_view::from_bytes(atomic_cell_type::make_dead_into(_buf, tomb.timestamp(), tomb.deletion_time())));
+        }
+        void operator()(ser::counter_cell_view& ccv) const {
+            auto&& outer = current_allocator();
+            with_allocator(standard_allocator(), [&] {
+                auto cell = read_atomic_cell(ccv);
+                with_allocator(outer, [&] {
+                    _func(atomic_cell_view(cell));
+                });
+            });
+        }
+        void operator()(ser::unknown_variant_type&) const {
+            throw std::runtime_error("Trying to deserialize cell in unknown state");
+        }
+    };
+    boost::apply_visitor(atomic_cell_view_visitor(buf, func), acv);
+}
+
 template<typename Visitor>
-void read_and_visit_row(ser::row_view rv, const column_mapping& cm, column_kind kind, Visitor&& visitor)
+void read_and_visit_row(ser::row_view rv, const column_mapping& cm, column_kind kind, bytes& buf, Visitor&& visitor)
 {
     for (auto&& cv : rv.columns()) {
         auto id = cv.id();
@@ -118,21 +163,17 @@ void read_and_visit_row(ser::row_view rv, const column_mapping& cm, column_kind
             Visitor& _visitor;
             column_id _id;
             const column_mapping_entry& _col;
+            bytes& _buf;
         public:
-            explicit atomic_cell_or_collection_visitor(Visitor& v, column_id id, const column_mapping_entry& col)
-                : _visitor(v), _id(id), _col(col) { }
+            explicit atomic_cell_or_collection_visitor(Visitor& v, column_id id, const column_mapping_entry& col, bytes& buf)
+                : _visitor(v), _id(id), _col(col), _buf(buf) { }
 
             void operator()(atomic_cell_variant& acv) const {
                 if (!_col.type()->is_atomic()) {
                     throw std::runtime_error("A collection expected, got an atomic cell");
                 }
-                // FIXME: Pass view to cell to avoid copy
-                auto&& outer = current_allocator();
-                with_allocator(standard_allocator(), [&] {
-                    auto cell = read_atomic_cell(acv);
-                    with_allocator(outer, [&] {
-                        _visitor.accept_atomic_cell(_id, cell);
-                    });
+                visit_atomic_cell(acv, _buf, [this] (atomic_cell_view cell) {
+                    _visitor.accept_atomic_cell(_id, cell);
                 });
             }
             void operator()(ser::collection_cell_view& ccv) const {
@@ -153,7 +194,7 @@ void read_and_visit_row(ser::row_view rv, const column_mapping& cm, column_kind
             }
         };
         auto&& cell = cv.c();
-        boost::apply_visitor(atomic_cell_or_collection_visitor(visitor, id, col), cell);
+        boost::apply_visitor(atomic_cell_or_collection_visitor(visitor, id, col, buf), cell);
     }
 }
 
@@ -196,14 +237,16 @@ mutation_partition_view::accept(const column_mapping& cm, mutation_partition_vis
     struct static_row_cell_visitor {
         mutation_partition_visitor& _visitor;
 
-        void accept_atomic_cell(column_id id, const atomic_cell& ac) const {
+        void accept_atomic_cell(column_id id, atomic_cell_view ac) const {
            _visitor.accept_static_cell(id, ac);
         }
         void accept_collection(column_id id, const collection_mutation& cm) const {
            _visitor.accept_static_cell(id, cm);
         }
     };
-    read_and_visit_row(mpv.static_row(), cm, column_kind::static_column, static_row_cell_visitor{visitor});
+    // Cells are built in buf before being given to the visitor.
+    bytes buf;
+    read_and_visit_row(mpv.static_row(), cm, column_kind::static_column, buf, static_row_cell_visitor{visitor});
 
     for (auto&& rt : mpv.range_tombstones()) {
         visitor.accept_row_tombstone(rt);
@@ -216,14 +259,14 @@ mutation_partition_view::accept(const column_mapping& cm, mutation_partition_vis
         struct cell_visitor {
             mutation_partition_visitor& _visitor;
 
-            void accept_atomic_cell(column_id id, const atomic_cell& ac) const {
+            void accept_atomic_cell(column_id id, atomic_cell_view ac) const {
                _visitor.accept_row_cell(id, ac);
             }
             void accept_collection(column_id id, const collection_mutation& cm) const {
                _visitor.accept_row_cell(id, cm);
             }
         };
-        read_and_visit_row(cr.cells(), cm, column_kind::regular_column, cell_visitor{visitor});
+        read_and_visit_row(cr.cells(), cm, column_kind::regular_column, buf, cell_visitor{visitor});
     }
 }
 
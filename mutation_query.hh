@@ -25,6 +25,7 @@
 #include "query-result.hh"
 #include "mutation_reader.hh"
 #include "frozen_mutation.hh"
+#include "utils/chunked_vector.hh"
 
 class reconcilable_result;
 class frozen_reconcilable_result;
@@ -69,17 +70,18 @@ class reconcilable_result {
     uint32_t _row_count;
     query::short_read _short_read;
     query::result_memory_tracker _memory_tracker;
-    std::vector<partition> _partitions;
+    // Pages of many small partitions could need large contiguous allocations.
+    utils::chunked_vector<partition> _partitions;
 public:
     ~reconcilable_result();
     reconcilable_result();
     reconcilable_result(reconcilable_result&&) = default;
     reconcilable_result& operator=(reconcilable_result&&) = default;
-    reconcilable_result(uint32_t row_count, std::vector<partition> partitions, query::short_read short_read,
+    reconcilable_result(uint32_t row_count, utils::chunked_vector<partition> partitions, query::short_read short_read,
                         query::result_memory_tracker memory_tracker = { });
 
-    const std::vector<partition>& partitions() const;
-    std::vector<partition>& partitions();
+    const utils::chunked_vector<partition>& partitions() const;
+    utils::chunked_vector<partition>& partitions();
 
     uint32_t row_count() const {
         return _row_count;
@@ -105,7 +107,7 @@ class reconcilable_result {
     printer pretty_printer(schema_ptr) const;
 };
 
-query::result to_data_query_result(const reconcilable_result&, schema_ptr, const query::partition_slice&, uint32_t row_limit, uint32_t partition_limit, query::result_request result_type = query::result_request::only_result);
+query::result to_data_query_result(const reconcilable_result&, schema_ptr, const query::partition_slice&, uint32_t row_limit, uint32_t partition_limit, query::result_options opts = query::result_options());
 
 // Performs a query on given data source returning data in reconcilable form.
 //
@@ -138,8 +140,22 @@ future<> data_query(
     uint32_t partition_limit,
     gc_clock::time_point query_time,
     query::result::builder& builder,
+    const io_priority_class& pc,
     tracing::trace_state_ptr trace_ptr = nullptr);
 
+class querier;
+
+// Reads the next page of the query q reads, asked for with slice.
+// q must be kept alive until the returned future resolves.
+future<> data_query(
+    schema_ptr s,
+    querier& q,
+    const query::partition_slice& slice,
+    uint32_t row_limit,
+    uint32_t partition_limit,
+    gc_clock::time_point query_time,
+    query::result::builder& builder);
+
 // Performs a query for counter updates.
 future<mutation_opt> counter_write_query(schema_ptr, const mutation_source&,
                                          const dht::decorated_key& dk,
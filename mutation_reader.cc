@@ -78,7 +78,7 @@ const dht::token* combined_mutation_reader::current_position() const {
         return nullptr;
     }
 
-    return &_ptables.front().m.decorated_key().token();
+    return &_ptables.top().m.decorated_key().token();
 }
 
 future<> combined_mutation_reader::prepare_next() {
@@ -87,8 +87,7 @@ future<> combined_mutation_reader::prepare_next() {
     return parallel_for_each(_next, [this] (mutation_reader* mr) {
         return (*mr)().then([this, mr] (streamed_mutation_opt next) {
             if (next) {
-                _ptables.emplace_back(mutation_and_reader { std::move(*next), mr });
-                boost::range::push_heap(_ptables, &heap_compare);
+                _ptables.push(mutation_and_reader { std::move(*next), mr });
             } else if (_fwd_mr == mutation_reader::forwarding::no) {
                 _all_readers.remove_if([mr] (auto& r) { return &r == mr; });
             }
@@ -107,15 +106,12 @@ future<streamed_mutation_opt> combined_mutation_reader::next() {
     }
 
     while (!_ptables.empty()) {
-        boost::range::pop_heap(_ptables, &heap_compare);
-        auto& candidate = _ptables.back();
-        streamed_mutation& m = candidate.m;
-
-        _current.emplace_back(std::move(m));
+        auto& candidate = _ptables.top();
+        _current.emplace_back(std::move(candidate.m));
         _next.emplace_back(candidate.read);
-        _ptables.pop_back();
+        _ptables.pop();
 
-        if (_ptables.empty() || !_current.back().decorated_key().equal(*_current.back().schema(), _ptables.front().m.decorated_key())) {
+        if (_ptables.empty() || !_current.back().decorated_key().equal(*_current.back().schema(), _ptables.top().m.decorated_key())) {
             // key has changed, so emit accumulated mutation
             break;
         }
@@ -366,15 +362,47 @@ class restricting_mutation_reader : public mutation_reader::impl {
 
     const restricted_mutation_reader_config& _config;
     boost::variant<mutation_source_and_params, mutation_reader> _reader_or_mutation_source;
+    size_t _admission_cost;
+    semaphore::time_point _deadline = semaphore::time_point::max();
 
     static const std::size_t new_reader_base_cost{16 * 1024};
 
+    static size_t admission_cost(const restricted_mutation_reader_config& config, size_t estimated_memory) {
+        auto cost = std::min(estimated_memory, config.max_admission_cost);
+        return cost > new_reader_base_cost ? cost : size_t(new_reader_base_cost);
+    }
+
+    future<> wait(semaphore& sem, size_t units) {
+        return _deadline != semaphore::time_point::max() ? sem.wait(_deadline, units) : sem.wait(units);
+    }
+
+    future<> admit() {
+        if (!_config.admission_sem) {
+            return wait(*_config.resources_sem, _admission_cost);
+        }
+        return wait(*_config.admission_sem, 1).then([this] {
+            return wait(*_config.resources_sem, _admission_cost).finally([this] {
+                _config.admission_sem->signal(1);
+            });
+        });
+    }
+
     future<> create_reader() {
-        auto f = _config.timeout.count() != 0
-                ? _config.resources_sem->wait(_config.timeout, new_reader_base_cost)
-                : _config.resources_sem->wait(new_reader_base_cost);
+        // No one would read the result.
+        if (semaphore::clock::now() >= _deadline) {
+            return make_exception_future<>(semaphore_timed_out());
+        }
+        if (_config.queued_reads) {
+            ++(*_config.queued_reads);
+        }
+        return admit().finally([this] {
+            if (_config.queued_reads) {
+                --(*_config.queued_reads);
+            }
+        }).then([this] {
+            // The buffers are accounted for by the tracked files as they are read.
+            _config.resources_sem->signal(_admission_cost - new_reader_base_cost);
 
-        return f.then([this] {
             mutation_reader reader = boost::get<mutation_source_and_params>(_reader_or_mutation_source)();
             _reader_or_mutation_source = std::move(reader);
 
@@ -394,13 +422,19 @@ class restricting_mutation_reader : public mutation_reader::impl {
             const io_priority_class& pc,
             tracing::trace_state_ptr trace_state,
             streamed_mutation::forwarding fwd,
-            mutation_reader::forwarding fwd_mr)
+            mutation_reader::forwarding fwd_mr,
+            size_t estimated_memory)
         : _config(config)
         , _reader_or_mutation_source(
-                mutation_source_and_params{std::move(ms), std::move(s), range, slice, pc, std::move(trace_state), fwd, fwd_mr}) {
-        if (_config.resources_sem->waiters() >= _config.max_queue_length) {
+                mutation_source_and_params{std::move(ms), std::move(s), range, slice, pc, std::move(trace_state), fwd, fwd_mr})
+        , _admission_cost(admission_cost(_config, estimated_memory)) {
+        auto queued = _config.resources_sem->waiters() + (_config.admission_sem ? _config.admission_sem->waiters() : 0);
+        if (queued >= _config.max_queue_length) {
             _config.raise_queue_overloaded_exception();
         }
+        if (_config.timeout.count() != 0) {
+            _deadline = semaphore::clock::now() + std::chrono::duration_cast<semaphore::duration>(_config.timeout);
+        }
     }
     ~restricting_mutation_reader() {
         if (boost::get<mutation_reader>(&_reader_or_mutation_source)) {
@@ -442,8 +476,10 @@ make_restricted_reader(const restricted_mutation_reader_config& config,
         const io_priority_class& pc,
         tracing::trace_state_ptr trace_state,
         streamed_mutation::forwarding fwd,
-        mutation_reader::forwarding fwd_mr) {
-    return make_mutation_reader<restricting_mutation_reader>(config, std::move(ms), std::move(s), range, slice, pc, std::move(trace_state), fwd, fwd_mr);
+        mutation_reader::forwarding fwd_mr,
+        size_t estimated_memory) {
+    return make_mutation_reader<restricting_mutation_reader>(config, std::move(ms), std::move(s), range, slice, pc, std::move(trace_state), fwd, fwd_mr,
+            estimated_memory);
 }
 
 class multi_range_mutation_reader : public mutation_reader::impl {
@@ -500,6 +536,195 @@ make_multi_range_reader(schema_ptr s, mutation_source source, const dht::partiti
                                                              slice, pc, std::move(trace_state), fwd, fwd_mr);
 }
 
+// The clustering fragments of a partition read backwards are held in memory
+// that many bytes at a time, give or take a fragment.
+static constexpr size_t reversed_read_window_size = 128 * 1024;
+
+// Reads the partitions of a source with their clustering fragments reversed,
+// without holding whole partitions in memory.
+//
+// The partition is first read forwards, to split it into windows of about
+// reversed_read_window_size bytes: only the keys starting the windows are
+// kept, along with the fragments of the last window. The windows are then
+// emitted backwards, each one read forwards again from the source, which
+// skips to it as for any clustering range, and reversed in memory.
+//
+// Rows written between the two reads show up if their window is read
+// later, as they would on the next page of a paged read.
+class reversing_reader final : public mutation_reader::impl {
+    struct state {
+        mutation_source source;
+        schema_ptr schema;
+        query::partition_slice slice;
+        const io_priority_class& pc;
+    };
+
+    class reversing_partition final : public streamed_mutation::impl {
+        lw_shared_ptr<const state> _state;
+        dht::partition_range _range;
+        streamed_mutation_opt _forward;
+        mutation_fragment_opt _static_row;
+        // Keys starting the windows after the first one.
+        std::vector<clustering_key> _window_starts;
+        size_t _windows_left = 0;
+        // Fragments of the window being emitted, in forward order.
+        std::vector<mutation_fragment> _window;
+        size_t _window_size = 0;
+        stdx::optional<mutation_reader> _window_reader;
+        streamed_mutation_opt _window_sm;
+    private:
+        // Range tombstones carried over to the next window must be trimmed,
+        // and so must those from the reads of a window, which may extend past it.
+        static bool trim_back(const schema& s, range_tombstone& rt, const clustering_key& end) {
+            position_in_partition::less_compare less(s);
+            auto pos = position_in_partition::before_key(end);
+            if (!less(rt.position(), pos)) {
+                return false;
+            }
+            if (less(pos, rt.end_position())) {
+                rt.end = end;
+                rt.end_kind = bound_kind::excl_end;
+            }
+            return true;
+        }
+        void start_window(const clustering_key& start) {
+            std::vector<mutation_fragment> carried;
+            _window_size = 0;
+            auto pos = position_in_partition::before_key(start);
+            for (auto&& mf : _window) {
+                if (mf.is_range_tombstone() && mf.as_mutable_range_tombstone().trim_front(*_schema, pos)) {
+                    _window_size += mf.memory_usage();
+                    carried.push_back(std::move(mf));
+                }
+            }
+            _window = std::move(carried);
+            _window_starts.push_back(start);
+        }
+        future<> scan() {
+            return repeat([this] {
+                return (*_forward)().then([this] (mutation_fragment_opt mf) {
+                    if (!mf) {
+                        return stop_iteration::yes;
+                    }
+                    if (mf->is_static_row()) {
+                        _static_row = std::move(mf);
+                        return stop_iteration::no;
+                    }
+                    if (mf->is_clustering_row() && _window_size >= reversed_read_window_size) {
+                        start_window(mf->as_clustering_row().key());
+                    }
+                    _window_size += mf->memory_usage();
+                    _window.push_back(std::move(*mf));
+                    return stop_iteration::no;
+                });
+            }).then([this] {
+                _forward = { };
+                _windows_left = _window_starts.size();
+            });
+        }
+        future<> read_window(size_t i) {
+            auto start = i ? position_in_partition::before_key(_window_starts[i - 1]) : position_in_partition::before_all_clustered_rows();
+            auto end = position_in_partition::before_key(_window_starts[i]);
+            _window_reader = _state->source(_schema, _range, _state->slice, _state->pc, nullptr, streamed_mutation::forwarding::yes);
+            return (*_window_reader)().then([this, i, range = position_range(std::move(start), std::move(end))] (streamed_mutation_opt sm) mutable {
+                if (!sm) {
+                    return make_ready_future<>();
+                }
+                _window_sm = std::move(sm);
+                return _window_sm->fast_forward_to(std::move(range)).then([this, i] {
+                    return repeat([this, i] {
+                        return (*_window_sm)().then([this, i] (mutation_fragment_opt mf) {
+                            if (!mf) {
+                                return stop_iteration::yes;
+                            }
+                            if (mf->is_range_tombstone()) {
+                                auto& rt = mf->as_mutable_range_tombstone();
+                                if ((i && !rt.trim_front(*_schema, position_in_partition::before_key(_window_starts[i - 1])))
+                                        || !trim_back(*_schema, rt, _window_starts[i])) {
+                                    return stop_iteration::no;
+                                }
+                            }
+                            if (!mf->is_static_row()) {
+                                _window.push_back(std::move(*mf));
+                            }
+                            return stop_iteration::no;
+                        });
+                    });
+                });
+            }).finally([this] {
+                _window_sm = { };
+                _window_reader = { };
+            });
+        }
+    public:
+        reversing_partition(lw_shared_ptr<const state> st, streamed_mutation sm)
+            : streamed_mutation::impl(sm.schema(), sm.decorated_key(), sm.partition_tombstone())
+            , _state(std::move(st))
+            , _range(dht::partition_range::make_singular(_key))
+            , _forward(std::move(sm))
+        { }
+
+        virtual future<> fill_buffer() override {
+            if (_forward) {
+                return scan().then([this] { return fill_buffer(); });
+            }
+            if (_static_row) {
+                push_mutation_fragment(std::move(*_static_row));
+                _static_row = { };
+            }
+            while (!is_buffer_full()) {
+                if (!_window.empty()) {
+                    auto mf = std::move(_window.back());
+                    _window.pop_back();
+                    if (mf.is_range_tombstone()) {
+                        mf.as_mutable_range_tombstone().flip();
+                    }
+                    push_mutation_fragment(std::move(mf));
+                } else if (_windows_left) {
+                    return read_window(--_windows_left).then([this] { return fill_buffer(); });
+                } else {
+                    _end_of_stream = true;
+                    break;
+                }
+            }
+            return make_ready_future<>();
+        }
+    };
+
+    lw_shared_ptr<const state> _state;
+    mutation_reader _reader;
+private:
+    static query::partition_slice forward_slice(const query::partition_slice& slice) {
+        auto forward = slice;
+        forward.options.remove(query::partition_slice::option::reversed);
+        return forward;
+    }
+public:
+    reversing_reader(mutation_source source, schema_ptr s, const dht::partition_range& pr, const query::partition_slice& slice,
+            const io_priority_class& pc, tracing::trace_state_ptr trace_state)
+        : _state(make_lw_shared<const state>(state{std::move(source), s, forward_slice(slice), pc}))
+        , _reader(_state->source(std::move(s), pr, _state->slice, pc, std::move(trace_state)))
+    { }
+
+    virtual future<streamed_mutation_opt> operator()() override {
+        return _reader().then([this] (streamed_mutation_opt sm) -> streamed_mutation_opt {
+            if (!sm) {
+                return { };
+            }
+            return make_streamed_mutation<reversing_partition>(_state, std::move(*sm));
+        });
+    }
+
+    virtual future<> fast_forward_to(const dht::partition_range& pr) override {
+        return _reader.fast_forward_to(pr);
+    }
+};
+
+mutation_reader make_reversing_reader(mutation_source source, schema_ptr s, const dht::partition_range& pr,
+        const query::partition_slice& slice, const io_priority_class& pc, tracing::trace_state_ptr trace_state) {
+    return make_mutation_reader<reversing_reader>(std::move(source), std::move(s), pr, slice, pc, std::move(trace_state));
+}
+
 snapshot_source make_empty_snapshot_source() {
     return snapshot_source([] {
         return make_empty_mutation_source();
@@ -563,19 +788,26 @@ mutation_reader mutation_reader_from_flat_mutation_reader(schema_ptr s, flat_mut
                     if (_end_of_stream) {
                         return make_ready_future<>();
                     }
-                    return _state->_mr.consume_pausable([this] (mutation_fragment_opt&& mfopt) {
-                        assert(bool(mfopt));
-                        if (mfopt->is_end_of_partition()) {
-                            _end_of_stream = true;
-                            return stop_iteration::yes;
-                        } else {
-                            this->push_mutation_fragment(std::move(*mfopt));
-                            return is_buffer_full() ? stop_iteration::yes : stop_iteration::no;
+                    // Moves the fragments of the partition from the buffer of
+                    // the flat reader, which is filled only when it's empty.
+                    return do_until([this] { return _end_of_stream || is_buffer_full(); }, [this] {
+                        auto& mr = _state->_mr;
+                        if (mr.is_buffer_empty()) {
+                            if (mr.is_end_of_stream()) {
+                                _end_of_stream = true;
+                                return make_ready_future<>();
+                            }
+                            return mr.fill_buffer();
                         }
-                    }).then([this] {
-                        if (_state->_mr.is_end_of_stream() && _state->_mr.is_buffer_empty()) {
-                            _end_of_stream = true;
+                        while (!mr.is_buffer_empty() && !is_buffer_full()) {
+                            auto mf = mr.pop_mutation_fragment();
+                            if (mf.is_end_of_partition()) {
+                                _end_of_stream = true;
+                                break;
+                            }
+                            this->push_mutation_fragment(std::move(mf));
                         }
+                        return make_ready_future<>();
                     });
                 }
 
@@ -30,6 +30,7 @@
 #include "core/do_with.hh"
 #include "tracing/trace_state.hh"
 #include "flat_mutation_reader.hh"
+#include "utils/tournament_tree.hh"
 
 // A mutation_reader is an object which allows iterating on mutations: invoke
 // the function to get a future for the next mutation, with an unset optional
@@ -146,13 +147,13 @@ class combined_mutation_reader : public mutation_reader::impl {
             }
         };
     };
-    std::vector<mutation_and_reader> _ptables;
-    // comparison function for std::make_heap()/std::push_heap()
-    static bool heap_compare(const mutation_and_reader& a, const mutation_and_reader& b) {
-        auto&& s = a.m.schema();
-        // order of comparison is inverted, because heaps produce greatest value first
-        return b.m.decorated_key().less_compare(*s, a.m.decorated_key());
-    }
+    struct key_less_compare {
+        bool operator()(const mutation_and_reader& a, const mutation_and_reader& b) const {
+            return a.m.decorated_key().less_compare(*a.m.schema(), b.m.decorated_key());
+        }
+    };
+    // The next partition of each reader, first partition on top.
+    utils::tournament_tree<mutation_and_reader, key_less_compare> _ptables;
     std::vector<streamed_mutation> _current;
     std::vector<mutation_reader*> _next;
     mutation_reader::forwarding _fwd_mr;
@@ -485,8 +486,22 @@ snapshot_source make_empty_snapshot_source();
 struct restricted_mutation_reader_config {
     semaphore* resources_sem = nullptr;
     uint64_t* active_reads = nullptr;
+    // Counts the readers waiting for admission, when set.
+    uint64_t* queued_reads = nullptr;
+    // When set, only one of the readers sharing it waits in resources_sem at
+    // a time, the others queueing here. Given one per table, the tables with
+    // queued readers are admitted round-robin, instead of in the order their
+    // readers arrived, so that a burst of reads of one table doesn't hold up
+    // the others.
+    semaphore* admission_sem = nullptr;
+    // Starting when the reader is created. Readers still queued when it
+    // passes fail with semaphore_timed_out without being created.
     std::chrono::nanoseconds timeout = {};
+    // Readers queued in resources_sem, plus those of the same admission_sem.
     size_t max_queue_length = std::numeric_limits<size_t>::max();
+    // Bounds the memory a reader is charged at admission, so that one
+    // expecting more than resources_sem holds can still be admitted.
+    size_t max_admission_cost = std::numeric_limits<size_t>::max();
     std::function<void ()> raise_queue_overloaded_exception = default_raise_queue_overloaded_exception;
 
     static void default_raise_queue_overloaded_exception() {
@@ -503,6 +518,9 @@ struct restricted_mutation_reader_config {
 // a semaphore to track and limit the memory usage of readers. It also
 // contains a timeout and a maximum queue size for inactive readers
 // whose construction is blocked.
+// The reader is admitted once the memory it is expected to buffer,
+// estimated_memory, is available. Only a base cost is held from then on,
+// the buffers being accounted as they are read.
 mutation_reader make_restricted_reader(const restricted_mutation_reader_config& config,
         mutation_source ms,
         schema_ptr s,
@@ -511,7 +529,8 @@ mutation_reader make_restricted_reader(const restricted_mutation_reader_config&
         const io_priority_class& pc = default_priority_class(),
         tracing::trace_state_ptr trace_state = nullptr,
         streamed_mutation::forwarding fwd = streamed_mutation::forwarding::no,
-        mutation_reader::forwarding fwd_mr = mutation_reader::forwarding::yes);
+        mutation_reader::forwarding fwd_mr = mutation_reader::forwarding::yes,
+        size_t estimated_memory = 0);
 
 inline mutation_reader make_restricted_reader(const restricted_mutation_reader_config& config,
         mutation_source ms,
@@ -650,6 +669,14 @@ stable_flattened_mutations_consumer<FlattenedConsumer> make_stable_flattened_mut
     return { std::make_unique<FlattenedConsumer>(std::forward<Args>(args)...) };
 }
 
+// Reads the partitions of the source with their clustering fragments in
+// reverse order, as reverse_streamed_mutation() would, but without reading
+// each partition into memory. Reads the partitions twice.
+//
+// pr and slice must be alive as long as the reader is used.
+mutation_reader make_reversing_reader(mutation_source source, schema_ptr s, const dht::partition_range& pr,
+        const query::partition_slice& slice, const io_priority_class& pc, tracing::trace_state_ptr trace_state = nullptr);
+
 // Requires ranges to be sorted and disjoint.
 mutation_reader
 make_multi_range_reader(schema_ptr s, mutation_source source, const dht::partition_range_vector& ranges,
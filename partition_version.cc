@@ -162,6 +162,9 @@ void partition_snapshot::merge_partition_versions() {
                 throw;
             }
             current = next;
+            if (need_preempt()) {
+                break;
+            }
         }
     }
 }
@@ -176,6 +179,16 @@ unsigned partition_snapshot::version_count()
     return count;
 }
 
+unsigned partition_entry::version_count()
+{
+    unsigned count = 0;
+    for (auto&& v : versions()) {
+        (void)v;
+        count++;
+    }
+    return count;
+}
+
 partition_entry::partition_entry(mutation_partition mp)
 {
     auto new_version = current_allocator().construct<partition_version>(std::move(mp));
@@ -238,6 +251,15 @@ void partition_entry::apply(const schema& s, mutation_partition_view mpv, const
     }
 }
 
+void partition_entry::apply_monotonically(const schema& s, mutation_partition_view mpv, const schema& mp_schema)
+{
+    if (!_snapshot) {
+        _version->partition().apply_monotonically(s, mpv, mp_schema);
+    } else {
+        apply(s, mpv, mp_schema);
+    }
+}
+
 // Iterates over all rows in mutation represented by partition_entry.
 // It abstracts away the fact that rows may be spread across multiple versions.
 class partition_entry::rows_iterator final {
@@ -576,6 +598,17 @@ std::ostream& operator<<(std::ostream& out, partition_entry& e) {
     return out;
 }
 
+size_t partition_entry::evict_last_rows(size_t count) noexcept {
+    if (!_version || _snapshot || _version->next()) {
+        return 0;
+    }
+    auto evicted = _version->partition().evict_last_rows(count);
+    if (evicted) {
+        current_allocator().invalidate_references();
+    }
+    return evicted;
+}
+
 void partition_entry::evict() noexcept {
     if (!_version) {
         return;
@@ -240,6 +240,8 @@ class partition_snapshot : public enable_lw_shared_from_this<partition_snapshot>
     // If possible merges the version pointed to by this snapshot with
     // adjacent partition versions. Leaves the snapshot in an unspecified state.
     // Can be retried if previous merge attempt has failed.
+    // Stops between versions when preemption is needed, leaving the versions
+    // which weren't merged yet to the merges of the snapshots next to them.
     void merge_partition_versions();
 
     ~partition_snapshot();
@@ -319,14 +321,37 @@ class partition_entry {
     // Includes versions referenced by snapshots.
     void evict() noexcept;
 
+    // Removes the last count rows of the partition, marking the range they
+    // were in as discontinuous, when at least count rows would be left and
+    // the partition has a single version, which no snapshot reads. Returns
+    // the number of rows removed.
+    size_t evict_last_rows(size_t count) noexcept;
+
     partition_version_ref& version() {
         return _version;
     }
 
+    // True if the entry has a single version, which no snapshot reads.
+    bool has_single_unread_version() {
+        return _version && !_snapshot && !_version->next();
+    }
+
     partition_version_range versions() {
         return _version->elements_from_this();
     }
 
+    // The number of versions a read of the latest one merges, including
+    // those kept only for older snapshots.
+    unsigned version_count();
+
+    // Replaces the versions with a single one, which merges them. Snapshots
+    // keep reading the versions they were taken of.
+    // Strong exception guarantees.
+    // needs to be called with reclaiming disabled
+    void squash_versions(schema_ptr s) {
+        upgrade(s, s);
+    }
+
     // Strong exception guarantees.
     // Assumes this instance and mp are fully continuous.
     void apply(const schema& s, const mutation_partition& mp, const schema& mp_schema);
@@ -335,6 +360,10 @@ class partition_entry {
     // Assumes this instance and mpv are fully continuous.
     void apply(const schema& s, mutation_partition_view mpv, const schema& mp_schema);
 
+    // Same guarantees as mutation_partition::apply_monotonically().
+    // Assumes this instance and mpv are fully continuous.
+    void apply_monotonically(const schema& s, mutation_partition_view mpv, const schema& mp_schema);
+
     // Adds mutation_partition represented by "other" to the one represented
     // by this entry.
     //
@@ -255,6 +255,9 @@ class position_in_partition {
     bool is_clustering_row() const { return has_clustering_key() && !_bound_weight; }
     bool has_clustering_key() const { return _type == partition_region::clustered; }
 
+    partition_region region() const { return _type; }
+    int bound_weight() const { return _bound_weight; }
+
     bool is_after_all_clustered_rows(const schema& s) const {
         return is_partition_end() || (_ck && _ck->is_empty(s) && _bound_weight > 0);
     }
@@ -0,0 +1,181 @@
+/*
+ * Copyright (C) 2017 ScyllaDB
+ */
+
+/*
+ * This file is part of Scylla.
+ *
+ * Scylla is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Scylla is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "querier.hh"
+#include "database.hh"
+
+querier::querier(const mutation_source& ms, schema_ptr s, lw_shared_ptr<column_family> cf, uint64_t generation,
+        dht::partition_range range, query::partition_slice slice, const io_priority_class& pc)
+    : _schema(std::move(s))
+    , _cf(std::move(cf))
+    , _generation(generation)
+    , _range(std::make_unique<const dht::partition_range>(std::move(range)))
+    , _slice(std::make_unique<const query::partition_slice>(std::move(slice)))
+    , _reversed(_slice->options.contains(query::partition_slice::option::reversed))
+    , _reader(_reversed ? make_reversing_reader(ms, _schema, *_range, *_slice, pc)
+                        : ms(_schema, *_range, *_slice, pc))
+    , _range_tombstones(*_schema, _reversed)
+{ }
+
+bool querier::can_be_saved(const query::read_command& cmd, const dht::partition_range& range, const tracing::trace_state_ptr& trace_state) {
+    // The reader would keep the trace of the first page. Partition row
+    // limits are set for the rest of a partition by the pager, so would
+    // change the slice from a page to the next.
+    return cmd.query_uuid != utils::UUID()
+        && range.is_singular()
+        && !trace_state
+        && cmd.slice.partition_row_limit() == query::max_rows
+        && !cmd.slice.options.contains(query::partition_slice::option::distinct);
+}
+
+void querier::start_partition(streamed_mutation&& sm) {
+    _current.emplace(std::move(sm));
+    _range_tombstones.clear();
+    _range_tombstones.set_partition_tombstone(_current->partition_tombstone());
+    _static_row = { };
+    _last_ckey = { };
+}
+
+static bool equal_bounds(const schema& s, const stdx::optional<query::clustering_range::bound>& a,
+        const stdx::optional<query::clustering_range::bound>& b) {
+    if (!a || !b) {
+        return !a && !b;
+    }
+    return a->is_inclusive() == b->is_inclusive() && clustering_key_prefix::equality(s)(a->value(), b->value());
+}
+
+static bool equal_ranges(const schema& s, const query::clustering_row_ranges& a, const query::clustering_row_ranges& b) {
+    return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin(), [&s] (auto& x, auto& y) {
+        return equal_bounds(s, x.start(), y.start()) && equal_bounds(s, x.end(), y.end());
+    });
+}
+
+bool querier::matches(const query::read_command& cmd, const dht::partition_range& range, uint64_t generation) const {
+    if (!_current || !_last_ckey || generation != _generation || cmd.schema_version != _schema->version()) {
+        return false;
+    }
+    auto& dk = _current->decorated_key();
+    if (!range.is_singular() || !dht::ring_position(dk).equal(*_schema, range.start()->value())) {
+        return false;
+    }
+    auto& slice = cmd.slice;
+    if (slice.options.mask() != _slice->options.mask() || slice.static_columns != _slice->static_columns
+            || slice.regular_columns != _slice->regular_columns
+            || !equal_ranges(*_schema, slice.default_row_ranges(), _slice->default_row_ranges())) {
+        return false;
+    }
+    // The pager continues the partition after the last row it got, in the
+    // order of the query.
+    auto& ranges = slice.row_ranges(*_schema, dk.key());
+    if (ranges.empty()) {
+        return false;
+    }
+    auto& bound = _reversed ? ranges.back().end() : ranges.front().start();
+    return bound && !bound->is_inclusive() && clustering_key_prefix::equality(*_schema)(bound->value(), *_last_ckey);
+}
+
+querier_cache::querier_cache(std::chrono::milliseconds ttl, size_t max_entries)
+    : _ttl(ttl)
+    , _max_entries(max_entries)
+    , _expiry_timer([this] { evict_expired(); })
+{ }
+
+querier_cache::~querier_cache() {
+    evict_all();
+}
+
+void querier_cache::erase(std::unordered_map<utils::UUID, entry>::iterator it) {
+    _lru.erase(_lru.iterator_to(it->second));
+    _entries.erase(it);
+}
+
+void querier_cache::evict_expired() {
+    auto now = lowres_clock::now();
+    while (!_lru.empty() && _lru.front().expires <= now) {
+        ++_evictions;
+        erase(_entries.find(_lru.front().key));
+    }
+    if (!_lru.empty()) {
+        _expiry_timer.arm(_lru.front().expires);
+    }
+}
+
+void querier_cache::insert(utils::UUID key, std::unique_ptr<querier> q) {
+    if (!_max_entries) {
+        return;
+    }
+    auto it = _entries.find(key);
+    if (it != _entries.end()) {
+        erase(it);
+    }
+    while (_entries.size() >= _max_entries) {
+        evict_oldest();
+    }
+    q->suspend();
+    auto& e = _entries.emplace(key, entry{ {}, key, std::move(q), lowres_clock::now() + _ttl }).first->second;
+    _lru.push_back(e);
+    if (!_expiry_timer.armed()) {
+        _expiry_timer.arm(e.expires);
+    }
+}
+
+std::unique_ptr<querier> querier_cache::lookup(utils::UUID key, const query::read_command& cmd, const dht::partition_range& range, uint64_t generation) {
+    auto it = _entries.find(key);
+    if (it == _entries.end()) {
+        ++_misses;
+        return nullptr;
+    }
+    std::unique_ptr<querier> q;
+    if (it->second.q->matches(cmd, range, generation)) {
+        ++_hits;
+        q = std::move(it->second.q);
+    } else {
+        ++_misses;
+    }
+    erase(it);
+    return q;
+}
+
+bool querier_cache::evict_oldest() {
+    if (_lru.empty()) {
+        return false;
+    }
+    ++_evictions;
+    erase(_entries.find(_lru.front().key));
+    return true;
+}
+
+void querier_cache::evict_all_for_table(const utils::UUID& cf_id) {
+    for (auto it = _entries.begin(); it != _entries.end();) {
+        if (it->second.q->schema()->id() == cf_id) {
+            _lru.erase(_lru.iterator_to(it->second));
+            it = _entries.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void querier_cache::evict_all() {
+    _lru.clear();
+    _entries.clear();
+    _expiry_timer.cancel();
+}
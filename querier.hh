@@ -0,0 +1,243 @@
+/*
+ * Copyright (C) 2017 ScyllaDB
+ */
+
+/*
+ * This file is part of Scylla.
+ *
+ * Scylla is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Scylla is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <memory>
+#include <unordered_map>
+#include <boost/intrusive/list.hpp>
+#include <seastar/core/timer.hh>
+#include <seastar/core/lowres_clock.hh>
+
+#include "mutation_reader.hh"
+#include "query-request.hh"
+#include "range_tombstone.hh"
+#include "schema.hh"
+#include "stdx.hh"
+#include "utils/UUID.hh"
+
+class column_family;
+
+/*
+ * Reads the pages of a single partition query, keeping its reader between
+ * them, so that a page which ends inside the partition can be continued
+ * where it ended instead of looking the partition up again.
+ *
+ * The querier owns the range and the slice its reader was made with. The
+ * fragments of the partition the reader stopped in which a new compactor
+ * needs to continue it, its tombstone, static row and the range tombstones
+ * which may still cover the rows left, are kept aside.
+ */
+class querier {
+    schema_ptr _schema;
+    lw_shared_ptr<column_family> _cf;
+    uint64_t _generation;
+    std::unique_ptr<const dht::partition_range> _range;
+    std::unique_ptr<const query::partition_slice> _slice;
+    bool _reversed;
+    mutation_reader _reader;
+    // The partition the last page stopped in, when it did.
+    stdx::optional<streamed_mutation> _current;
+    range_tombstone_accumulator _range_tombstones;
+    stdx::optional<static_row> _static_row;
+    stdx::optional<clustering_key_prefix> _last_ckey;
+    // Set when the current partition wasn't given to a consumer yet, on the
+    // page which continues it.
+    bool _resume = false;
+private:
+    void start_partition(streamed_mutation&& sm);
+
+    template <typename Consumer>
+    void resume_partition(Consumer& c) {
+        _resume = false;
+        c.consume_new_partition(_current->decorated_key());
+        if (auto t = _range_tombstones.get_partition_tombstone()) {
+            c.consume(t);
+        }
+        if (_static_row) {
+            c.consume(static_row(*_static_row));
+        }
+        if (_last_ckey) {
+            for (auto&& rt : _range_tombstones.range_tombstones_for_row(*_last_ckey)) {
+                c.consume(range_tombstone(rt));
+            }
+        }
+    }
+
+    template <typename Consumer>
+    stop_iteration consume_fragment(mutation_fragment&& mf, Consumer& c) {
+        if (mf.is_clustering_row()) {
+            auto& ck = mf.as_clustering_row().key();
+            _range_tombstones.tombstone_for_row(ck);
+            _last_ckey = ck;
+        } else if (mf.is_range_tombstone()) {
+            _range_tombstones.apply(mf.as_range_tombstone());
+        } else if (mf.is_static_row() && !mf.as_static_row().empty()) {
+            _static_row = mf.as_static_row();
+        }
+        return std::move(mf).consume_streamed_mutation(c);
+    }
+
+    // Like do_consume_streamed_mutation_flattened(), but keeps the current
+    // partition when the consumer stops inside it.
+    template <typename Consumer>
+    future<stop_iteration> consume_partition(Consumer& c) {
+        do {
+            if (_current->is_buffer_empty()) {
+                if (_current->is_end_of_stream()) {
+                    break;
+                }
+                auto f = _current->fill_buffer();
+                if (!f.available()) {
+                    return f.then([this, &c] { return consume_partition(c); });
+                }
+                f.get();
+            } else if (consume_fragment(_current->pop_mutation_fragment(), c) == stop_iteration::yes) {
+                auto stop = c.consume_end_of_partition();
+                if (stop == stop_iteration::no || (_current->is_buffer_empty() && _current->is_end_of_stream())) {
+                    _current = { };
+                }
+                return make_ready_future<stop_iteration>(stop);
+            }
+        } while (true);
+        auto stop = c.consume_end_of_partition();
+        _current = { };
+        return make_ready_future<stop_iteration>(stop);
+    }
+public:
+    querier(const mutation_source& ms, schema_ptr s, lw_shared_ptr<column_family> cf, uint64_t generation,
+            dht::partition_range range, query::partition_slice slice, const io_priority_class& pc);
+
+    // Whether the pages of a query read with cmd over range may be read by a
+    // querier, which is kept between them.
+    static bool can_be_saved(const query::read_command& cmd, const dht::partition_range& range, const tracing::trace_state_ptr& trace_state);
+
+    // Consumes the next page into the flattened consumer c, as consume_flattened() does.
+    template <typename Consumer>
+    GCC6_CONCEPT(
+        requires FlattenedConsumer<Consumer>()
+    )
+    future<> consume_page(Consumer& c) {
+        if (_current && _resume) {
+            resume_partition(c);
+        }
+        return repeat([this, &c] {
+            if (_current) {
+                return consume_partition(c);
+            }
+            return _reader().then([this, &c] (streamed_mutation_opt smopt) {
+                if (!smopt) {
+                    return make_ready_future<stop_iteration>(stop_iteration::yes);
+                }
+                start_partition(std::move(*smopt));
+                c.consume_new_partition(_current->decorated_key());
+                if (auto t = _range_tombstones.get_partition_tombstone()) {
+                    c.consume(t);
+                }
+                return consume_partition(c);
+            });
+        }).then([&c] {
+            return c.consume_end_of_stream();
+        });
+    }
+
+    // Whether the last page stopped inside the partition, so that the next
+    // one may be read by this querier.
+    bool is_suspended() const {
+        return bool(_current);
+    }
+
+    // Prepares this querier, suspended, for reading the next page.
+    void suspend() {
+        _resume = true;
+    }
+
+    // Whether the page read with cmd over range continues the last page
+    // this querier read.
+    bool matches(const query::read_command& cmd, const dht::partition_range& range, uint64_t generation) const;
+
+    const schema_ptr& schema() const {
+        return _schema;
+    }
+};
+
+/*
+ * The queriers suspended between two pages of their query, by query id.
+ *
+ * A querier holds on to the sstables and memtables its reader reads, and
+ * to the memory of the reader, so queriers are only kept for a while, and
+ * the oldest are evicted first when there are too many of them, or when
+ * new reads wait for memory.
+ */
+class querier_cache {
+    struct entry {
+        boost::intrusive::list_member_hook<> link;
+        utils::UUID key;
+        std::unique_ptr<querier> q;
+        lowres_clock::time_point expires;
+    };
+    using lru_type = boost::intrusive::list<entry,
+        boost::intrusive::member_hook<entry, boost::intrusive::list_member_hook<>, &entry::link>,
+        boost::intrusive::constant_time_size<false>>;
+
+    std::chrono::milliseconds _ttl;
+    size_t _max_entries;
+    std::unordered_map<utils::UUID, entry> _entries;
+    // Oldest first.
+    lru_type _lru;
+    timer<lowres_clock> _expiry_timer;
+    uint64_t _hits = 0;
+    uint64_t _misses = 0;
+    uint64_t _evictions = 0;
+private:
+    void erase(std::unordered_map<utils::UUID, entry>::iterator it);
+    void evict_expired();
+public:
+    querier_cache(std::chrono::milliseconds ttl, size_t max_entries);
+    querier_cache(querier_cache&&) = delete;
+    ~querier_cache();
+
+    void insert(utils::UUID key, std::unique_ptr<querier> q);
+
+    // Removes and returns the querier of the query key, when it can read
+    // the page read with cmd over range. Otherwise returns nullptr, and
+    // drops the querier, as the query went on without it.
+    std::unique_ptr<querier> lookup(utils::UUID key, const query::read_command& cmd, const dht::partition_range& range, uint64_t generation);
+
+    // Returns false when the cache is empty.
+    bool evict_oldest();
+
+    void evict_all_for_table(const utils::UUID& cf_id);
+    void evict_all();
+
+    size_t size() const {
+        return _entries.size();
+    }
+    uint64_t hits() const {
+        return _hits;
+    }
+    uint64_t misses() const {
+        return _misses;
+    }
+    uint64_t evictions() const {
+        return _evictions;
+    }
+};
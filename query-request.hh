@@ -30,6 +30,8 @@
 #include "range.hh"
 #include "tracing/tracing.hh"
 
+class row;
+
 namespace query {
 
 template <typename T>
@@ -94,13 +96,45 @@ class specific_ranges {
 
 constexpr auto max_rows = std::numeric_limits<uint32_t>::max();
 
+enum class restriction_op : uint8_t {
+    eq, in, lt, lte, gt, gte,
+    // Of collections.
+    contains, contains_key,
+    // m[values[0]] = values[1], of maps.
+    entry_eq,
+};
+
+// A restriction of an ALLOW FILTERING query on a static or regular column,
+// which replicas check the rows they read against, so that the rows which
+// don't satisfy it are neither returned nor counted against the limits.
+//
+// A null value satisfies nothing.
+struct column_restriction {
+    bool is_static;
+    column_id column;
+    restriction_op op;
+    std::vector<bytes_opt> values;
+
+    // Whether the cells of a compacted row satisfy the restriction.
+    bool is_satisfied_by(const schema& s, const row& cells) const;
+};
+
+std::ostream& operator<<(std::ostream& out, const column_restriction& r);
+
 // Specifies subset of rows, columns and cell attributes to be returned in a query.
 // Can be accessed across cores.
 // Schema-dependent.
 class partition_slice {
 public:
     enum class option { send_clustering_key, send_partition_key, send_timestamp, send_expiry, reversed, distinct, collections_as_maps, send_ttl,
-                        allow_short_read, };
+                        allow_short_read,
+                        // Read from sstables directly, neither reading from nor populating the row cache.
+                        bypass_cache,
+                        // Read the ranges of a range scan concurrently, see storage_proxy::query_partition_key_range().
+                        parallel_scan,
+                        // Write the rows of the result in the compact format, see qr_row. Requires that
+                        // timestamps, expiries and TTLs are not requested.
+                        compact_rows, };
     using option_set = enum_set<super_enum<option,
         option::send_clustering_key,
         option::send_partition_key,
@@ -110,7 +144,10 @@ class partition_slice {
         option::distinct,
         option::collections_as_maps,
         option::send_ttl,
-        option::allow_short_read>>;
+        option::allow_short_read,
+        option::bypass_cache,
+        option::parallel_scan,
+        option::compact_rows>>;
     clustering_row_ranges _row_ranges;
 public:
     std::vector<column_id> static_columns; // TODO: consider using bitmap
@@ -120,12 +157,16 @@ class partition_slice {
     std::unique_ptr<specific_ranges> _specific_ranges;
     cql_serialization_format _cql_format;
     uint32_t _partition_row_limit;
+    std::vector<column_restriction> _filters;
+    bool _has_static_filters = false;
+    bool _has_regular_filters = false;
 public:
     partition_slice(clustering_row_ranges row_ranges, std::vector<column_id> static_columns,
         std::vector<column_id> regular_columns, option_set options,
         std::unique_ptr<specific_ranges> specific_ranges = nullptr,
         cql_serialization_format = cql_serialization_format::internal(),
-        uint32_t partition_row_limit = max_rows);
+        uint32_t partition_row_limit = max_rows,
+        std::vector<column_restriction> filters = { });
     partition_slice(const partition_slice&);
     partition_slice(partition_slice&&);
     ~partition_slice();
@@ -154,6 +195,31 @@ class partition_slice {
         _partition_row_limit = limit;
     }
 
+    // The rows of a partition are returned only if its static row satisfies
+    // the filters on static columns, and if they satisfy those on regular
+    // columns.
+    const std::vector<column_restriction>& filters() const {
+        return _filters;
+    }
+    void set_filters(std::vector<column_restriction> filters);
+    bool has_static_filters() const {
+        return _has_static_filters;
+    }
+    bool has_regular_filters() const {
+        return _has_regular_filters;
+    }
+    bool static_row_matches(const schema& s, const row& cells) const;
+    bool clustering_row_matches(const schema& s, const row& cells) const;
+
+    // Whether only the keys of the live partitions are read, as by SELECT
+    // DISTINCT of the partition key. Inferred from the slice, so that it
+    // works with the replicas which don't know about it.
+    bool is_partition_key_only() const {
+        return options.contains(option::distinct) && static_columns.empty() && regular_columns.empty()
+            && _filters.empty() && !_specific_ranges
+            && _row_ranges.size() == 1 && _row_ranges.front().is_full();
+    }
+
     friend std::ostream& operator<<(std::ostream& out, const partition_slice& ps);
     friend std::ostream& operator<<(std::ostream& out, const specific_ranges& ps);
 };
@@ -172,6 +238,16 @@ class read_command {
     gc_clock::time_point timestamp;
     std::experimental::optional<tracing::trace_info> trace_info;
     uint32_t partition_limit; // The maximum number of live partitions to return.
+    // Identifies the pages of a paged query, so that replicas can continue
+    // a page with the reader which read the previous one. Not set for
+    // queries which aren't paged.
+    utils::UUID query_uuid;
+    bool is_first_page = false;
+    // Of the user the query is for, whose reads replicas schedule within it.
+    sstring service_level;
+    // The size of the result of each replica, in bytes, when short reads
+    // are allowed. Zero for the replica's default.
+    uint64_t max_result_size = 0;
     api::timestamp_type read_timestamp; // not serialized
 public:
     read_command(utils::UUID cf_id,
@@ -192,7 +268,41 @@ class read_command {
         , read_timestamp(rt)
     { }
 
+    read_command(utils::UUID cf_id,
+                 table_schema_version schema_version,
+                 partition_slice slice,
+                 uint32_t row_limit,
+                 gc_clock::time_point now,
+                 std::experimental::optional<tracing::trace_info> ti,
+                 uint32_t partition_limit,
+                 utils::UUID query_uuid,
+                 bool is_first_page,
+                 sstring service_level,
+                 uint64_t max_result_size,
+                 api::timestamp_type rt = api::missing_timestamp)
+        : cf_id(std::move(cf_id))
+        , schema_version(std::move(schema_version))
+        , slice(std::move(slice))
+        , row_limit(row_limit)
+        , timestamp(now)
+        , trace_info(std::move(ti))
+        , partition_limit(partition_limit)
+        , query_uuid(query_uuid)
+        , is_first_page(is_first_page)
+        , service_level(std::move(service_level))
+        , max_result_size(max_result_size)
+        , read_timestamp(rt)
+    { }
+
     friend std::ostream& operator<<(std::ostream& out, const read_command& r);
 };
 
+// One aggregate of a query which replicas compute over the partitions they own,
+// for the coordinator to combine. Only aggregates whose partial results can be
+// merged by the coordinator are sent: countRows, count, sum, min and max.
+struct aggregate_selector {
+    sstring function_name;
+    std::vector<sstring> column_names;
+};
+
 }
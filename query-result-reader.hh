@@ -22,6 +22,7 @@
 #pragma once
 
 #include <boost/range/adaptor/transformed.hpp>
+#include <seastar/core/byteorder.hh>
 
 #include "query-request.hh"
 #include "query-result.hh"
@@ -77,12 +78,40 @@ class result_row_view {
         cells_vec _cells;
         cells_vec::iterator _i;
         bytes _tmp_value;
+        // Non-empty if the row was written in the compact_rows format.
+        bytes _compact;
+        size_t _compact_pos = 0;
+        uint8_t _presence = 0;
+        unsigned _column = 0;
+    private:
+        // See qr_row::compact_cells.
+        std::experimental::optional<bytes_view> next_compact_value() {
+            auto bit = _column++ % 8;
+            if (!bit) {
+                _presence = _compact_pos < _compact.size() ? uint8_t(_compact[_compact_pos++]) : 0;
+            }
+            if (!(_presence & (1 << bit))) {
+                return {};
+            }
+            auto size = read_le<uint32_t>(reinterpret_cast<const char*>(_compact.begin() + _compact_pos));
+            auto value = bytes_view(_compact.begin() + _compact_pos + sizeof(uint32_t), size);
+            _compact_pos += sizeof(uint32_t) + size;
+            return {value};
+        }
     public:
         iterator_type(ser::qr_row_view v)
             : _cells(v.cells())
             , _i(_cells.begin())
+            , _compact(v.compact_cells())
         { }
         std::experimental::optional<result_atomic_cell_view> next_atomic_cell() {
+            if (!_compact.empty()) {
+                auto value = next_compact_value();
+                if (!value) {
+                    return {};
+                }
+                return {result_atomic_cell_view(api::missing_timestamp, {}, {}, *value)};
+            }
             auto cell_opt = *_i++;
             if (!cell_opt) {
                 return {};
@@ -95,6 +124,9 @@ class result_row_view {
             return {result_atomic_cell_view(timestamp, expiry, ttl, _tmp_value)};
         }
         std::experimental::optional<bytes_view> next_collection_cell() {
+            if (!_compact.empty()) {
+                return next_compact_value();
+            }
             auto cell_opt = *_i++;
             if (!cell_opt) {
                 return {};
@@ -104,6 +136,10 @@ class result_row_view {
             return {bytes_view(_tmp_value)};
         };
         void skip(const column_definition& def) {
+            if (!_compact.empty()) {
+                next_compact_value();
+                return;
+            }
             ++_i;
         }
     };
@@ -26,6 +26,9 @@
 #include "query-request.hh"
 #include "query-result.hh"
 #include "digest_algorithm.hh"
+#include "bytes_ostream.hh"
+
+#include <seastar/core/byteorder.hh>
 
 #include "idl/uuid.dist.hh"
 #include "idl/keys.dist.hh"
@@ -38,6 +41,39 @@
 
 namespace query {
 
+// Collects the cells of a row in the format of qr_row::compact_cells, written
+// when the compact_rows option is set: a presence bitmap and the bare values,
+// instead of a frame with optional metadata for each cell.
+class compact_row_writer {
+    bytes_ostream _out;
+    bytes_ostream::value_type* _presence = nullptr;
+    unsigned _columns = 0;
+private:
+    void next_column(bool present) {
+        auto bit = _columns++ % 8;
+        if (!bit) {
+            _presence = _out.write_place_holder(1);
+            *_presence = 0;
+        }
+        if (present) {
+            *_presence |= 1 << bit;
+        }
+    }
+public:
+    void skip() {
+        next_column(false);
+    }
+    void write(bytes_view value) {
+        next_column(true);
+        write_le<uint32_t>(reinterpret_cast<char*>(_out.write_place_holder(sizeof(uint32_t))), value.size());
+        _out.write(value);
+    }
+    // The view is valid as long as the writer, which can't be written to anymore.
+    bytes_view finish() {
+        return _out.linearize();
+    }
+};
+
 class result::partition_writer {
     result_request _request;
     ser::after_qr_partition__key<bytes_ostream> _w;
@@ -48,8 +84,8 @@ class result::partition_writer {
     const clustering_row_ranges& _ranges;
     ser::query_result__partitions<bytes_ostream>& _pw;
     ser::vector_position _pos;
-    md5_hasher& _digest;
-    md5_hasher _digest_pos;
+    digester& _digest;
+    digester _digest_pos;
     uint32_t& _row_count;
     uint32_t& _partition_count;
     api::timestamp_type& _last_modified;
@@ -61,7 +97,7 @@ class result::partition_writer {
         ser::query_result__partitions<bytes_ostream>& pw,
         ser::vector_position pos,
         ser::after_qr_partition__key<bytes_ostream> w,
-        md5_hasher& digest,
+        digester& digest,
         uint32_t& row_count,
         uint32_t& partition_count,
         api::timestamp_type& last_modified)
@@ -104,7 +140,7 @@ class result::partition_writer {
     const partition_slice& slice() const {
         return _slice;
     }
-    md5_hasher& digest() {
+    digester& digest() {
         return _digest;
     }
     uint32_t& row_count() {
@@ -121,7 +157,7 @@ class result::partition_writer {
 
 class result::builder {
     bytes_ostream _out;
-    md5_hasher _digest;
+    digester _digest;
     const partition_slice& _slice;
     ser::query_result__partitions<bytes_ostream> _w;
     result_request _request;
@@ -131,10 +167,11 @@ class result::builder {
     short_read _short_read;
     result_memory_accounter _memory_accounter;
 public:
-    builder(const partition_slice& slice, result_request request, result_memory_accounter memory_accounter)
-        : _slice(slice)
+    builder(const partition_slice& slice, result_options options, result_memory_accounter memory_accounter)
+        : _digest(options.digest_algo)
+        , _slice(slice)
         , _w(ser::writer_of_query_result<bytes_ostream>(_out).start_partitions())
-        , _request(request)
+        , _request(options.request)
         , _memory_accounter(std::move(memory_accounter))
     { }
     builder(builder&&) = delete; // _out is captured by reference
@@ -26,6 +26,8 @@
 #include "bytes_ostream.hh"
 #include "query-request.hh"
 #include "md5_hasher.hh"
+#include "murmur3_hasher.hh"
+#include "digest_algorithm.hh"
 #include <experimental/optional>
 #include <seastar/util/bool_class.hh>
 #include "seastarx.hh"
@@ -268,9 +270,56 @@ enum class result_request {
     result_and_digest,
 };
 
+// What a query should return, and how the digest is computed if one is requested.
+struct result_options {
+    result_request request = result_request::only_result;
+    digest_algorithm digest_algo = digest_algorithm::MD5;
+
+    result_options() = default;
+    result_options(result_request request, digest_algorithm digest_algo = digest_algorithm::MD5)
+        : request(request)
+        , digest_algo(digest_algo)
+    { }
+};
+
+// Computes the digest of a query result with one of the supported algorithms.
+class digester {
+    digest_algorithm _algo;
+    md5_hasher _md5;
+    murmur3_hasher _murmur3;
+public:
+    explicit digester(digest_algorithm algo = digest_algorithm::MD5) : _algo(algo) { }
+
+    void update(const char* ptr, size_t length) {
+        switch (_algo) {
+        case digest_algorithm::none:
+            break;
+        case digest_algorithm::MD5:
+            _md5.update(ptr, length);
+            break;
+        case digest_algorithm::MURMUR3:
+            _murmur3.update(ptr, length);
+            break;
+        }
+    }
+
+    std::array<uint8_t, 16> finalize_array() {
+        switch (_algo) {
+        case digest_algorithm::MD5:
+            return _md5.finalize_array();
+        case digest_algorithm::MURMUR3:
+            return _murmur3.finalize_array();
+        case digest_algorithm::none:
+            break;
+        }
+        return {};
+    }
+};
+
 class result_digest {
 public:
     static_assert(16 == CryptoPP::Weak::MD5::DIGESTSIZE, "MD5 digest size is all wrong");
+    static_assert(16 == murmur3_hasher::digest_size, "murmur3 digest size is all wrong");
     using type = std::array<uint8_t, 16>;
 private:
     type _digest;
@@ -386,6 +435,10 @@ class result {
         return _short_read;
     }
 
+    void mark_as_short_read() {
+        _short_read = short_read::yes;
+    }
+
     const stdx::optional<uint32_t>& partition_count() const {
         return _partition_count;
     }
@@ -29,6 +29,8 @@
 #include "mutation_partition_serializer.hh"
 #include "query-result-reader.hh"
 #include "query_result_merger.hh"
+#include "mutation_partition.hh"
+#include "types.hh"
 
 namespace query {
 
@@ -54,9 +56,30 @@ std::ostream& operator<<(std::ostream& out, const partition_slice& ps) {
     out << ", options=" << sprint("%x", ps.options.mask()); // FIXME: pretty print options
     out << ", cql_format=" << ps.cql_format();
     out << ", partition_row_limit=" << ps._partition_row_limit;
+    if (!ps._filters.empty()) {
+        out << ", filters=[" << join(", ", ps._filters) << "]";
+    }
     return out << "}";
 }
 
+std::ostream& operator<<(std::ostream& out, const column_restriction& r) {
+    static const char* ops[] = { "eq", "in", "lt", "lte", "gt", "gte", "contains", "contains_key", "entry_eq" };
+    out << "{" << (r.is_static ? "static " : "") << r.column << " " << ops[size_t(r.op)] << " [";
+    bool first = true;
+    for (auto&& v : r.values) {
+        if (!first) {
+            out << ", ";
+        }
+        first = false;
+        if (v) {
+            out << to_hex(*v);
+        } else {
+            out << "null";
+        }
+    }
+    return out << "]}";
+}
+
 std::ostream& operator<<(std::ostream& out, const read_command& r) {
     return out << "read_command{"
         << "cf_id=" << r.cf_id
@@ -64,7 +87,11 @@ std::ostream& operator<<(std::ostream& out, const read_command& r) {
         << ", slice=" << r.slice << ""
         << ", limit=" << r.row_limit
         << ", timestamp=" << r.timestamp.time_since_epoch().count() << "}"
-        << ", partition_limit=" << r.partition_limit << "}";
+        << ", partition_limit=" << r.partition_limit
+        << ", query_uuid=" << r.query_uuid
+        << ", is_first_page=" << r.is_first_page
+        << ", service_level=" << r.service_level
+        << ", max_result_size=" << r.max_result_size << "}";
 }
 
 std::ostream& operator<<(std::ostream& out, const specific_ranges& s) {
@@ -77,7 +104,8 @@ partition_slice::partition_slice(clustering_row_ranges row_ranges,
     option_set options,
     std::unique_ptr<specific_ranges> specific_ranges,
     cql_serialization_format cql_format,
-    uint32_t partition_row_limit)
+    uint32_t partition_row_limit,
+    std::vector<column_restriction> filters)
     : _row_ranges(std::move(row_ranges))
     , static_columns(std::move(static_columns))
     , regular_columns(std::move(regular_columns))
@@ -85,7 +113,9 @@ partition_slice::partition_slice(clustering_row_ranges row_ranges,
     , _specific_ranges(std::move(specific_ranges))
     , _cql_format(std::move(cql_format))
     , _partition_row_limit(partition_row_limit)
-{}
+{
+    set_filters(std::move(filters));
+}
 
 partition_slice::partition_slice(partition_slice&&) = default;
 
@@ -101,11 +131,139 @@ partition_slice::partition_slice(const partition_slice& s)
     , _specific_ranges(s._specific_ranges ? std::make_unique<specific_ranges>(*s._specific_ranges) : nullptr)
     , _cql_format(s._cql_format)
     , _partition_row_limit(s._partition_row_limit)
+    , _filters(s._filters)
+    , _has_static_filters(s._has_static_filters)
+    , _has_regular_filters(s._has_regular_filters)
 {}
 
 partition_slice::~partition_slice()
 {}
 
+void partition_slice::set_filters(std::vector<column_restriction> filters) {
+    _filters = std::move(filters);
+    _has_static_filters = std::any_of(_filters.begin(), _filters.end(), [] (auto& f) { return f.is_static; });
+    _has_regular_filters = std::any_of(_filters.begin(), _filters.end(), [] (auto& f) { return !f.is_static; });
+}
+
+static bool row_matches(const std::vector<column_restriction>& filters, bool is_static, const schema& s, const row& cells) {
+    return std::all_of(filters.begin(), filters.end(), [&] (const column_restriction& f) {
+        return f.is_static != is_static || f.is_satisfied_by(s, cells);
+    });
+}
+
+bool partition_slice::static_row_matches(const schema& s, const row& cells) const {
+    return !_has_static_filters || row_matches(_filters, true, s, cells);
+}
+
+bool partition_slice::clustering_row_matches(const schema& s, const row& cells) const {
+    return !_has_regular_filters || row_matches(_filters, false, s, cells);
+}
+
+static bool value_is_satisfied_by(const abstract_type& type, restriction_op op, const std::vector<bytes_opt>& values, bytes_view value) {
+    auto compare = [&] () -> stdx::optional<int> {
+        if (values.size() != 1 || !values[0]) {
+            return { };
+        }
+        return type.compare(value, *values[0]);
+    };
+    switch (op) {
+    case restriction_op::eq: {
+        auto c = compare();
+        return c && *c == 0;
+    }
+    case restriction_op::in:
+        return std::any_of(values.begin(), values.end(), [&] (const bytes_opt& v) {
+            return v && type.compare(value, *v) == 0;
+        });
+    case restriction_op::lt: {
+        auto c = compare();
+        return c && *c < 0;
+    }
+    case restriction_op::lte: {
+        auto c = compare();
+        return c && *c <= 0;
+    }
+    case restriction_op::gt: {
+        auto c = compare();
+        return c && *c > 0;
+    }
+    case restriction_op::gte: {
+        auto c = compare();
+        return c && *c >= 0;
+    }
+    default:
+        return false;
+    }
+}
+
+// The keys and values of the live elements of a collection, the elements of
+// sets being their keys.
+static std::vector<std::pair<bytes, bytes>> collection_elements(const collection_type_impl& ctype, const column_definition& def,
+        const atomic_cell_or_collection& cell) {
+    std::vector<std::pair<bytes, bytes>> elements;
+    if (def.type->is_multi_cell()) {
+        auto mv = ctype.deserialize_mutation_form(cell.as_collection_mutation());
+        for (auto&& e : mv.cells) {
+            if (e.second.is_live()) {
+                elements.emplace_back(to_bytes(e.first), to_bytes(e.second.value()));
+            }
+        }
+        return elements;
+    }
+    auto c = cell.as_atomic_cell();
+    if (!c.is_live()) {
+        return elements;
+    }
+    auto v = def.type->deserialize(c.value());
+    if (ctype.is_map()) {
+        for (auto&& e : value_cast<map_type_impl::native_type>(v)) {
+            elements.emplace_back(e.first.serialize(), e.second.serialize());
+        }
+    } else if (ctype.is_set()) {
+        for (auto&& e : value_cast<set_type_impl::native_type>(v)) {
+            elements.emplace_back(e.serialize(), bytes());
+        }
+    } else {
+        for (auto&& e : value_cast<list_type_impl::native_type>(v)) {
+            elements.emplace_back(bytes(), e.serialize());
+        }
+    }
+    return elements;
+}
+
+bool column_restriction::is_satisfied_by(const schema& s, const row& cells) const {
+    auto& def = s.column_at(is_static ? column_kind::static_column : column_kind::regular_column, column);
+    auto cell = cells.find_cell(column);
+    if (!cell) {
+        return false;
+    }
+    if (op != restriction_op::contains && op != restriction_op::contains_key && op != restriction_op::entry_eq) {
+        if (!def.is_atomic()) {
+            return false;
+        }
+        auto c = cell->as_atomic_cell();
+        return c.is_live() && value_is_satisfied_by(*def.type, op, values, c.value());
+    }
+    if (!def.type->is_collection() || values.empty() || !values[0]) {
+        return false;
+    }
+    auto& ctype = static_cast<const collection_type_impl&>(*def.type);
+    auto elements = collection_elements(ctype, def, *cell);
+    auto& key_type = *ctype.name_comparator();
+    auto& value_type = ctype.is_set() ? *ctype.name_comparator() : *ctype.value_comparator();
+    return std::any_of(elements.begin(), elements.end(), [&] (const std::pair<bytes, bytes>& e) {
+        switch (op) {
+        case restriction_op::contains:
+            return value_type.compare(ctype.is_set() ? e.first : e.second, *values[0]) == 0;
+        case restriction_op::contains_key:
+            return ctype.is_map() && key_type.compare(e.first, *values[0]) == 0;
+        default:
+            return ctype.is_map() && values.size() == 2 && values[1]
+                && key_type.compare(e.first, *values[0]) == 0 && value_type.compare(e.second, *values[1]) == 0;
+        }
+    });
+}
+
 const clustering_row_ranges& partition_slice::row_ranges(const schema& s, const partition_key& k) const {
     auto* r = _specific_ranges ? _specific_ranges->range_for(s, k) : nullptr;
     return r ? *r : _row_ranges;
@@ -191,6 +349,7 @@ static void write_partial_partition(ser::writer_of_qr_partition<bytes_ostream>&&
     }
     auto rows_wr = std::move(static_cells_wr)
             .end_cells()
+            .write_compact_cells(pv.static_row().compact_cells())
             .end_static_row()
             .start_rows();
     auto rows = pv.rows();
@@ -242,6 +401,10 @@ foreign_ptr<lw_shared_ptr<query::result>> result_merger::get() {
         if (row_count >= _max_rows || partition_count >= _max_partitions) {
             break;
         }
+        if (w.size() >= _max_size && &r != &_partial.back()) {
+            is_short_read = short_read::yes;
+            break;
+        }
     }
 
     std::move(partitions).end_partitions().end_query_result();
@@ -21,6 +21,7 @@
 
 #pragma once
 
+#include <limits>
 #include "core/distributed.hh"
 #include "query-result.hh"
 
@@ -32,10 +33,14 @@ class result_merger {
     std::vector<foreign_ptr<lw_shared_ptr<query::result>>> _partial;
     const uint32_t _max_rows;
     const uint32_t _max_partitions;
+    // The results after the one which reaches it are dropped, and the
+    // merged result is then a short read.
+    const uint64_t _max_size;
 public:
-    explicit result_merger(uint32_t max_rows, uint32_t max_partitions)
+    explicit result_merger(uint32_t max_rows, uint32_t max_partitions, uint64_t max_size = std::numeric_limits<uint64_t>::max())
             : _max_rows(max_rows)
             , _max_partitions(max_partitions)
+            , _max_size(max_size)
     { }
 
     void reserve(size_t size) {
@@ -44,17 +44,7 @@ void range_tombstone_list::apply_reversibly(const schema& s,
         reverter& rev)
 {
     if (!_tombstones.empty()) {
-        bound_view::compare less(s);
-        bound_view start_bound(start, start_kind);
-        auto last = --_tombstones.end();
-        range_tombstones_type::iterator it;
-        if (less(start_bound, last->end_bound())) {
-            it = _tombstones.upper_bound(start_bound, [less](auto&& sb, auto&& rt) {
-                return less(sb, rt.end_bound());
-            });
-        } else {
-            it = _tombstones.end();
-        }
+        auto it = insertion_point(s, bound_view(start, start_kind));
         insert_from(s, std::move(it), std::move(start), start_kind, std::move(end), end_kind, std::move(tomb), rev);
         return;
     }
@@ -64,6 +54,23 @@ void range_tombstone_list::apply_reversibly(const schema& s,
     rt.release();
 }
 
+/*
+ * Returns the first element which ends after start_bound. Tombstones are
+ * appended in clustering order by most writers, so the last element is
+ * checked before searching the tree.
+ */
+range_tombstone_list::range_tombstones_type::iterator
+range_tombstone_list::insertion_point(const schema& s, bound_view start_bound) {
+    bound_view::compare less(s);
+    auto last = std::prev(_tombstones.end());
+    if (!less(start_bound, last->end_bound())) {
+        return _tombstones.end();
+    }
+    return _tombstones.upper_bound(start_bound, [less](auto&& sb, auto&& rt) {
+        return less(sb, rt.end_bound());
+    });
+}
+
 /*
  * Inserts a new element starting at the position pointed to by the iterator, it.
  * This method assumes that:
@@ -423,17 +430,56 @@ bool range_tombstone_list::equal(const schema& s, const range_tombstone_list& ot
     });
 }
 
+/*
+ * Returns true if rt can be linked into the list before it, as is, without
+ * affecting its neighbours. The iterator must be the insertion_point() of rt.
+ */
+bool range_tombstone_list::can_link_before(const schema& s, range_tombstones_type::iterator it, const range_tombstone& rt) const {
+    bound_view::compare less(s);
+    if (it != _tombstones.end()) {
+        if (!less(rt.end_bound(), it->start_bound())
+                || (it->tomb == rt.tomb && rt.end_bound().adjacent(s, it->start_bound()))) {
+            return false;
+        }
+    }
+    if (it != _tombstones.begin()) {
+        auto prev = std::prev(it);
+        if (prev->tomb == rt.tomb && prev->end_bound().adjacent(s, rt.start_bound())) {
+            return false;
+        }
+    }
+    return true;
+}
+
 void range_tombstone_list::apply_monotonically(const schema& s, range_tombstone_list&& list) {
+    if (_tombstones.empty()) {
+        _tombstones.swap(list._tombstones);
+        return;
+    }
     auto del = current_deleter<range_tombstone>();
     auto it = list.begin();
     while (it != list.end()) {
-        // FIXME: Optimize by stealing the entry
+        // Entries which don't overlap with ours are moved over without copying.
+        auto pos = insertion_point(s, it->start_bound());
+        if (can_link_before(s, pos, *it)) {
+            auto& rt = *it;
+            it = list._tombstones.erase(it);
+            _tombstones.insert_before(pos, rt);
+            continue;
+        }
         apply_monotonically(s, *it);
         it = list._tombstones.erase_and_dispose(it, del);
     }
 }
 
 void range_tombstone_list::apply_monotonically(const schema& s, const range_tombstone_list& list) {
+    if (_tombstones.empty()) {
+        auto cloner = [] (const range_tombstone& x) {
+            return current_allocator().construct<range_tombstone>(x);
+        };
+        _tombstones.clone_from(list._tombstones, cloner, current_deleter<range_tombstone>());
+        return;
+    }
     for (auto&& rt : list) {
         apply_monotonically(s, rt);
     }
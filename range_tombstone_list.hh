@@ -190,4 +190,6 @@ class range_tombstone_list final {
     void insert_from(const schema& s, range_tombstones_type::iterator it, clustering_key_prefix start,
                      bound_kind start_kind, clustering_key_prefix end, bound_kind end_kind, tombstone tomb, reverter& rev);
     range_tombstones_type::iterator find(const schema& s, const range_tombstone& rt);
+    range_tombstones_type::iterator insertion_point(const schema& s, bound_view start_bound);
+    bool can_link_before(const schema& s, range_tombstones_type::iterator it, const range_tombstone& rt) const;
 };
@@ -177,6 +177,10 @@ class read_context final : public enable_lw_shared_from_this<read_context> {
         } else {
             _cache._stats.reads_with_no_misses.mark();
         }
+        if (!_range_query) {
+            auto r = dht::global_partitioner().ring_range_of(_range.start()->value().token(), row_cache::hit_rate_ranges);
+            ++(_underlying_created ? _cache._stats.range_reads_with_misses : _cache._stats.range_reads_with_no_misses)[r];
+        }
     }
     read_context(const read_context&) = delete;
     row_cache& cache() { return _cache; }
@@ -28,8 +28,13 @@
 #include "db/config.hh"
 #include "service/storage_service.hh"
 #include "service/priority_manager.hh"
+#include "service/storage_proxy.hh"
+#include "service/migration_manager.hh"
 #include "message/messaging_service.hh"
 #include "sstables/sstables.hh"
+#include "partition_slice_builder.hh"
+#include "murmur3_hasher.hh"
+#include "utils/task_context_guard.hh"
 
 #include <boost/algorithm/string/predicate.hpp>
 #include <boost/algorithm/string/split.hpp>
@@ -40,6 +45,9 @@
 #include <cryptopp/sha.h>
 #include <seastar/core/gate.hh>
 #include <seastar/util/defer.hh>
+#include <seastar/core/lowres_clock.hh>
+#include <deque>
+#include <unordered_map>
 
 static logging::logger rlogger("repair");
 
@@ -455,10 +463,24 @@ class sha256_hasher {
     }
 };
 
+class murmur3_checksum_hasher {
+    murmur3_hasher hash;
+public:
+    void update(const char* ptr, size_t length) {
+        hash.update(ptr, length);
+    }
+
+    void finalize(std::array<uint8_t, 32>& digest) {
+        auto h = hash.finalize_array();
+        std::fill(std::copy(h.begin(), h.end(), digest.begin()), digest.end(), 0);
+    }
+};
+
 future<partition_checksum> partition_checksum::compute_legacy(streamed_mutation m)
 {
     return mutation_from_streamed_mutation(std::move(m)).then([] (auto mopt) {
         assert(mopt);
+        utils::task_context_guard task_ctx(utils::task_context::repair);
         std::array<uint8_t, 32> digest;
         sha256_hasher h;
         feed_hash(h, *mopt);
@@ -467,13 +489,31 @@ future<partition_checksum> partition_checksum::compute_legacy(streamed_mutation
     });
 }
 
+// Runs the wrapped consumer in the repair task_context.
+template <typename Consumer>
+class repair_task_context_consumer {
+    Consumer _consumer;
+public:
+    explicit repair_task_context_consumer(Consumer consumer) : _consumer(std::move(consumer)) { }
+    template <typename... Args>
+    auto consume(Args&&... args) {
+        utils::task_context_guard task_ctx(utils::task_context::repair);
+        return _consumer.consume(std::forward<Args>(args)...);
+    }
+    auto consume_end_of_stream() {
+        utils::task_context_guard task_ctx(utils::task_context::repair);
+        return _consumer.consume_end_of_stream();
+    }
+};
+
+template <typename Hasher>
 future<partition_checksum> partition_checksum::compute_streamed(streamed_mutation m)
 {
     auto& s = *m.schema();
-    auto h = make_lw_shared<sha256_hasher>();
+    auto h = make_lw_shared<Hasher>();
     m.key().feed_hash(*h, s);
     return do_with(std::move(m), [&s, h] (auto& sm) mutable {
-        mutation_hasher<sha256_hasher> mh(s, *h);
+        repair_task_context_consumer<mutation_hasher<Hasher>> mh(mutation_hasher<Hasher>(s, *h));
         return consume(sm, std::move(mh)).then([ h ] {
             std::array<uint8_t, 32> digest;
             h->finalize(digest);
@@ -486,7 +526,8 @@ future<partition_checksum> partition_checksum::compute(streamed_mutation m, repa
 {
     switch (hash_version) {
     case repair_checksum::legacy: return compute_legacy(std::move(m));
-    case repair_checksum::streamed: return compute_streamed(std::move(m));
+    case repair_checksum::streamed: return compute_streamed<sha256_hasher>(std::move(m));
+    case repair_checksum::streamed_murmur3: return compute_streamed<murmur3_checksum_hasher>(std::move(m));
     default: throw std::runtime_error(sprint("Unknown hash version: %d", static_cast<int>(hash_version)));
     }
 }
@@ -529,26 +570,17 @@ std::ostream& operator<<(std::ostream& out, const partition_checksum& c) {
     return out;
 }
 
-// Calculate the checksum of the data held *on this shard* of a column family,
-// in the given token range.
-// All parameters to this function are constant references, and the caller
-// must ensure they live as long as the future returned by this function is
-// not resolved.
-// FIXME: Both master and slave will typically call this on consecutive ranges
-// so it would be useful to have this code cache its stopping point or have
-// some object live throughout the operation. Moreover, it makes sense to to
-// vary the collection of sstables used throught a long repair.
-static future<partition_checksum> checksum_range_shard(database &db,
-        const sstring& keyspace_name, const sstring& cf_name,
-        const dht::partition_range_vector& prs, repair_checksum hash_version) {
-    auto& cf = db.find_column_family(keyspace_name, cf_name);
-    auto reader = cf.make_streaming_reader(cf.schema(), prs);
-    return do_with(std::move(reader), partition_checksum(),
-        [hash_version] (auto& reader, auto& checksum) {
+static future<partition_checksum> checksum_reader(mutation_reader& reader, repair_checksum hash_version) {
+    return do_with(partition_checksum(), [&reader, hash_version] (auto& checksum) {
         return repeat([&reader, &checksum, hash_version] () {
-            return reader().then([&checksum, hash_version] (auto mopt) {
+            return service::throttle(service::get_local_repair_cpu()).then([&reader] {
+                return reader();
+            }).then([&checksum, hash_version] (auto mopt) {
                 if (mopt) {
-                    return partition_checksum::compute(std::move(*mopt), hash_version).then([&checksum] (auto pc) {
+                    auto f = service::get_local_repair_cpu().run([&] {
+                        return partition_checksum::compute(std::move(*mopt), hash_version);
+                    });
+                    return f.then([&checksum] (auto pc) {
                         checksum.add(pc);
                         return stop_iteration::no;
                     });
@@ -562,18 +594,228 @@ static future<partition_checksum> checksum_range_shard(database &db,
     });
 }
 
+// Readers of the ranges of tables recently checksummed by this shard, kept
+// so that the checksum of a following range of the same table fast forwards
+// one of them instead of creating a new reader, which has to locate the range
+// again in every sstable. Both the repair master and its peers checksum the
+// ranges of a table in ring order, so the next range usually follows.
+//
+// Readers are kept for max_age only, so that they don't pin compacted
+// sstables and don't miss much of the data written meanwhile.
+class checksum_reader_cache {
+public:
+    struct entry {
+        utils::UUID cf_id;
+        schema_ptr s;
+        // The sstables the reader was created from; it is only reused while
+        // they are still the sstables of the table.
+        lw_shared_ptr<sstable_list> sstables;
+        // The reader refers to it, so it must not move.
+        std::unique_ptr<dht::partition_range> range;
+        mutation_reader reader;
+        lowres_clock::time_point created;
+    };
+private:
+    static constexpr size_t max_entries = 4;
+    static constexpr std::chrono::seconds max_age{10};
+    std::deque<entry> _entries;
+    timer<lowres_clock> _expiry_timer{[this] { expire(); }};
+private:
+    void expire() {
+        auto now = lowres_clock::now();
+        _entries.erase(std::remove_if(_entries.begin(), _entries.end(), [now] (const entry& e) {
+            return now - e.created > max_age;
+        }), _entries.end());
+        if (!_entries.empty()) {
+            _expiry_timer.arm(max_age);
+        }
+    }
+
+    static bool follows(const schema& s, const dht::partition_range& prev, const dht::partition_range& next) {
+        if (!prev.end() || !next.start()) {
+            return false;
+        }
+        auto c = dht::ring_position_comparator(s)(prev.end()->value(), next.start()->value());
+        return c < 0 || (c == 0 && (!prev.end()->is_inclusive() || !next.start()->is_inclusive()));
+    }
+public:
+    future<entry> get(column_family& cf, const dht::partition_range& range) {
+        auto now = lowres_clock::now();
+        expire();
+        auto s = cf.schema();
+        auto sstables = cf.get_sstables();
+        auto it = std::find_if(_entries.begin(), _entries.end(), [&] (const entry& e) {
+            return e.cf_id == s->id() && e.s == s && e.sstables == sstables && follows(*s, *e.range, range);
+        });
+        if (it == _entries.end()) {
+            auto pr = std::make_unique<dht::partition_range>(range);
+            auto reader = cf.make_streaming_reader(s, *pr, s->full_slice(), mutation_reader::forwarding::yes);
+            return make_ready_future<entry>(entry{s->id(), s, std::move(sstables), std::move(pr), std::move(reader), now});
+        }
+        auto e = std::move(*it);
+        _entries.erase(it);
+        auto pr = std::make_unique<dht::partition_range>(range);
+        auto f = e.reader.fast_forward_to(*pr);
+        return f.then([e = std::move(e), pr = std::move(pr)] () mutable {
+            e.range = std::move(pr);
+            return std::move(e);
+        });
+    }
+
+    void put(entry e) {
+        if (_entries.size() >= max_entries) {
+            _entries.pop_front();
+        }
+        _entries.push_back(std::move(e));
+        if (!_expiry_timer.armed()) {
+            _expiry_timer.arm(max_age);
+        }
+    }
+
+    void clear() {
+        _expiry_timer.cancel();
+        _entries.clear();
+    }
+};
+
+constexpr std::chrono::seconds checksum_reader_cache::max_age;
+
+static thread_local checksum_reader_cache checksum_readers;
+
+static future<partition_checksum> do_checksum_range_shard(column_family& cf,
+        const dht::partition_range_vector& prs, repair_checksum hash_version) {
+    if (prs.size() != 1) {
+        auto reader = cf.make_streaming_reader(cf.schema(), prs);
+        return do_with(std::move(reader), [hash_version] (auto& reader) {
+            return checksum_reader(reader, hash_version);
+        });
+    }
+    return checksum_readers.get(cf, prs.front()).then([hash_version] (auto e) {
+        return do_with(std::move(e), [hash_version] (auto& e) {
+            return checksum_reader(e.reader, hash_version).then([&e] (partition_checksum checksum) {
+                checksum_readers.put(std::move(e));
+                return checksum;
+            });
+        });
+    });
+}
+
+// Checksums of the ranges recently computed by this shard, along with the
+// sstables they were computed from. Most data doesn't change between two
+// repairs: the checksum of a range whose sstables are still the same, and
+// which has no data in memtables, is reused instead of reading the range
+// again.
+//
+// The checksums are kept in memory only, and are lost on restart.
+class range_checksum_cache {
+    struct key {
+        utils::UUID cf_id;
+        repair_checksum hash_version;
+        dht::token_range range;
+
+        bool operator==(const key& o) const {
+            return cf_id == o.cf_id && hash_version == o.hash_version && range.equal(o.range, dht::token_comparator());
+        }
+    };
+    struct key_hash {
+        size_t operator()(const key& k) const {
+            return std::hash<utils::UUID>()(k.cf_id) ^ std::hash<dht::token_range>()(k.range);
+        }
+    };
+    struct entry {
+        table_schema_version schema_version;
+        std::vector<int64_t> generations;
+        partition_checksum checksum;
+    };
+    static constexpr size_t max_entries = 100000;
+    std::unordered_map<key, entry, key_hash> _entries;
+private:
+    static std::vector<int64_t> generations(const column_family& cf, const dht::partition_range_vector& prs) {
+        std::vector<int64_t> ret;
+        for (auto&& pr : prs) {
+            for (auto&& sst : cf.select_sstables(pr)) {
+                ret.push_back(sst->generation());
+            }
+        }
+        boost::sort(ret);
+        ret.erase(std::unique(ret.begin(), ret.end()), ret.end());
+        return ret;
+    }
+public:
+    // The sstables the checksum of prs would be computed from, or nothing
+    // if the range has data in memtables.
+    stdx::optional<std::vector<int64_t>> sources(const column_family& cf, const dht::partition_range_vector& prs) const {
+        for (auto&& pr : prs) {
+            if (cf.memtables_contain(pr)) {
+                return { };
+            }
+        }
+        return generations(cf, prs);
+    }
+
+    stdx::optional<partition_checksum> get(const column_family& cf, repair_checksum hash_version,
+            const dht::token_range& range, const std::vector<int64_t>& sources) {
+        auto it = _entries.find(key{cf.schema()->id(), hash_version, range});
+        if (it == _entries.end() || it->second.schema_version != cf.schema()->version() || it->second.generations != sources) {
+            return { };
+        }
+        return it->second.checksum;
+    }
+
+    void put(const schema& s, repair_checksum hash_version, const dht::token_range& range,
+            std::vector<int64_t> sources, const partition_checksum& checksum) {
+        if (_entries.size() >= max_entries) {
+            _entries.erase(_entries.begin());
+        }
+        _entries[key{s.id(), hash_version, range}] = entry{s.version(), std::move(sources), checksum};
+    }
+
+    void clear() {
+        _entries.clear();
+    }
+};
+
+static thread_local range_checksum_cache range_checksums;
+
+// Calculate the checksum of the data held *on this shard* of a column family,
+// in the given token range.
+// All parameters to this function are constant references, and the caller
+// must ensure they live as long as the future returned by this function is
+// not resolved.
+static future<partition_checksum> checksum_range_shard(database &db,
+        const sstring& keyspace_name, const sstring& cf_name, const dht::token_range& range,
+        const dht::partition_range_vector& prs, repair_checksum hash_version) {
+    auto& cf = db.find_column_family(keyspace_name, cf_name);
+    auto sources = range_checksums.sources(cf, prs);
+    if (sources) {
+        if (auto checksum = range_checksums.get(cf, hash_version, range, *sources)) {
+            return make_ready_future<partition_checksum>(*checksum);
+        }
+    }
+    return do_checksum_range_shard(cf, prs, hash_version).then([s = cf.schema(), &range, hash_version, sources = std::move(sources)] (partition_checksum checksum) mutable {
+        if (sources) {
+            range_checksums.put(*s, hash_version, range, std::move(*sources), checksum);
+        }
+        return checksum;
+    });
+}
+
 // It is counter-productive to allow a large number of range checksum
 // operations to proceed in parallel (on the same shard), because the read
 // operation can already parallelize itself as much as needed, and doing
 // multiple reads in parallel just adds a lot of memory overheads.
 // So checksum_parallelism_semaphore is used to limit this parallelism,
-// and should be set to 1, or another small number.
+// and should be set to 1, or another small number, with the
+// repair_checksum_parallelism option.
 //
 // Note that checksumming_parallelism_semaphore applies not just in the
 // repair master, but also in the slave: The repair slave may receive many
 // checksum requests in parallel, but will only work on one or a few
 // (checksum_parallelism_semaphore) at once.
-static thread_local semaphore checksum_parallelism_semaphore(2);
+static semaphore& checksum_parallelism_semaphore(const database& db) {
+    static thread_local semaphore sem(std::max<uint32_t>(db.get_config().repair_checksum_parallelism(), 1));
+    return sem;
+}
 
 // Calculate the checksum of the data held on all shards of a column family,
 // in the given token range.
@@ -591,14 +833,14 @@ future<partition_checksum> checksum_range(seastar::sharded<database> &db,
         const ::dht::token_range& range, repair_checksum hash_version) {
     auto& schema = db.local().find_column_family(keyspace, cf).schema();
     auto shard_ranges = dht::split_range_to_shards(dht::to_partition_range(range), *schema);
-    return do_with(partition_checksum(), std::move(shard_ranges), [&db, &keyspace, &cf, hash_version] (auto& result, auto& shard_ranges) {
-        return parallel_for_each(shard_ranges, [&db, &keyspace, &cf, &result, hash_version] (auto& shard_range) {
+    return do_with(partition_checksum(), std::move(shard_ranges), [&db, &keyspace, &cf, &range, hash_version] (auto& result, auto& shard_ranges) {
+        return parallel_for_each(shard_ranges, [&db, &keyspace, &cf, &range, &result, hash_version] (auto& shard_range) {
             auto& shard = shard_range.first;
             auto& prs = shard_range.second;
-            return db.invoke_on(shard, [keyspace, cf, prs = std::move(prs), hash_version] (database& db) mutable {
-                return do_with(std::move(keyspace), std::move(cf), std::move(prs), [&db, hash_version] (auto& keyspace, auto& cf, auto& prs) {
-                    return seastar::with_semaphore(checksum_parallelism_semaphore, 1, [&db, hash_version, &keyspace, &cf, &prs] {
-                        return checksum_range_shard(db, keyspace, cf, prs, hash_version);
+            return db.invoke_on(shard, [keyspace, cf, range, prs = std::move(prs), hash_version] (database& db) mutable {
+                return do_with(std::move(keyspace), std::move(cf), std::move(range), std::move(prs), [&db, hash_version] (auto& keyspace, auto& cf, auto& range, auto& prs) {
+                    return seastar::with_semaphore(checksum_parallelism_semaphore(db), 1, [&db, hash_version, &keyspace, &cf, &range, &prs] {
+                        return checksum_range_shard(db, keyspace, cf, range, prs, hash_version);
                     });
                 });
             }).then([&result] (partition_checksum sum) {
@@ -610,6 +852,318 @@ future<partition_checksum> checksum_range(seastar::sharded<database> &db,
     });
 }
 
+// Hashes the content of a single fragment for row-level repair. The position
+// of the fragment isn't fed to the hasher, as it is a part of repair_row_hash
+// already.
+//
+// Note that, unlike mutation_hasher, range tombstones are hashed as they are
+// emitted by the reader, without making them disjoint first. Replicas holding
+// the same data in differently overlapping range tombstones will only see
+// them as differing fragments and exchange them, which is harmless.
+class repair_row_hasher {
+    const schema& _s;
+    sha256_hasher& _h;
+private:
+    void consume_cell(const column_definition& col, const atomic_cell_or_collection& cell) {
+        feed_hash(_h, col.name());
+        feed_hash(_h, col.type->name());
+        cell.feed_hash(_h, col);
+    }
+public:
+    repair_row_hasher(const schema& s, sha256_hasher& h) : _s(s), _h(h) { }
+
+    void operator()(const partition_start& ps) {
+        feed_hash(_h, ps.partition_tombstone());
+    }
+
+    void operator()(const static_row& sr) {
+        sr.cells().for_each_cell([&] (column_id id, const atomic_cell_or_collection& cell) {
+            consume_cell(_s.static_column_at(id), cell);
+        });
+    }
+
+    void operator()(const clustering_row& cr) {
+        cr.key().feed_hash(_h, _s);
+        feed_hash(_h, cr.tomb());
+        feed_hash(_h, cr.marker());
+        cr.cells().for_each_cell([&] (column_id id, const atomic_cell_or_collection& cell) {
+            consume_cell(_s.regular_column_at(id), cell);
+        });
+    }
+
+    void operator()(const range_tombstone& rt) {
+        rt.start.feed_hash(_h, _s);
+        feed_hash(_h, rt.start_kind);
+        rt.end.feed_hash(_h, _s);
+        feed_hash(_h, rt.end_kind);
+        feed_hash(_h, rt.tomb);
+    }
+
+    void operator()(const partition_end&) { }
+};
+
+static uint64_t hash_repair_row(const schema& s, const mutation_fragment& mf) {
+    sha256_hasher h;
+    mf.visit(repair_row_hasher(s, h));
+    std::array<uint8_t, 32> digest;
+    h.finalize(digest);
+    return qword(digest, 0);
+}
+
+std::ostream& operator<<(std::ostream& out, const repair_row_hash& rh) {
+    return out << "{" << rh._dk << ", " << rh._pos << ", " << rh._hash << "}";
+}
+
+// Feeds the fragments produced by reader, along with their repair_row_hash,
+// to func until it returns stop_iteration::yes, skipping the fragments which
+// don't hold any data and, if start_after isn't null, those positioned at or
+// before it in its partition. Returns stop_iteration::yes if func asked to
+// stop, stop_iteration::no if the end of the stream was reached.
+template <typename Func>
+static future<stop_iteration> consume_repair_rows(schema_ptr s, flat_mutation_reader reader,
+        const repair_row_hash* start_after, Func& func) {
+    return do_with(std::move(reader), stdx::optional<dht::decorated_key>(), stop_iteration::no,
+            [s, start_after, &func] (auto& reader, auto& dk, auto& stopped) {
+        return repeat([s, start_after, &func, &reader, &dk, &stopped] {
+            return reader().then([s, start_after, &func, &dk, &stopped] (mutation_fragment_opt mfopt) {
+                if (!mfopt) {
+                    return stop_iteration::yes;
+                }
+                auto& mf = *mfopt;
+                if (mf.is_partition_start()) {
+                    dk = mf.as_partition_start().key();
+                    if (!mf.as_partition_start().partition_tombstone()) {
+                        return stop_iteration::no;
+                    }
+                } else if (mf.is_end_of_partition() || (mf.is_static_row() && mf.as_static_row().empty())) {
+                    return stop_iteration::no;
+                }
+                position_in_partition pos(mf.position());
+                if (start_after && dk->equal(*s, start_after->decorated_key())
+                        && position_in_partition::tri_compare(*s)(pos, start_after->position()) <= 0) {
+                    return stop_iteration::no;
+                }
+                auto hash = hash_repair_row(*s, mf);
+                stopped = func(repair_row_hash(*dk, std::move(pos), hash), std::move(mf));
+                return stopped;
+            });
+        }).then([&stopped] {
+            return stopped;
+        });
+    });
+}
+
+static query::partition_slice make_repair_slice(const schema& s, const position_in_partition& start) {
+    if (!start.has_clustering_key()) {
+        return s.full_slice();
+    }
+    auto ck_start = query::clustering_range::bound(start.key(), true);
+    return partition_slice_builder(s)
+        .with_range(query::clustering_range::make_starting_with(std::move(ck_start)))
+        .build();
+}
+
+// Reads the fragments of a column family held on this shard: first those of
+// the partition of start_after which follow it, if start_after isn't null,
+// then those in prs, which must be sorted and disjoint. Each fragment is fed,
+// along with its repair_row_hash, to func until it returns stop_iteration::yes.
+// The partition of start_after is read with a clustering restriction, so
+// resuming in the middle of a wide partition doesn't read it from the start.
+// All reference parameters must be kept alive by the caller until the
+// returned future is resolved.
+template <typename Func>
+static future<> read_repair_rows_shard(database& db, const sstring& keyspace, const sstring& cf_name,
+        const repair_row_hash* start_after, const dht::partition_range_vector& prs, Func func) {
+    auto& cf = db.find_column_family(keyspace, cf_name);
+    auto s = cf.schema();
+    return do_with(std::move(func), [&cf, s, start_after, &prs] (Func& func) {
+        return seastar::with_semaphore(checksum_parallelism_semaphore(db), 1, [&cf, s, start_after, &prs, &func] {
+            auto f = make_ready_future<stop_iteration>(stop_iteration::no);
+            if (start_after) {
+                f = do_with(dht::partition_range::make_singular(dht::ring_position(start_after->decorated_key())),
+                        make_repair_slice(*s, start_after->position()),
+                        [&cf, s, start_after, &func] (auto& pr, auto& slice) {
+                    auto reader = flat_mutation_reader_from_mutation_reader(s, cf.make_streaming_reader(s, pr, slice),
+                            streamed_mutation::forwarding::no);
+                    return consume_repair_rows(s, std::move(reader), start_after, func);
+                });
+            }
+            return f.then([&cf, s, &prs, &func] (stop_iteration stop) {
+                if (stop || prs.empty()) {
+                    return make_ready_future<>();
+                }
+                auto reader = flat_mutation_reader_from_mutation_reader(s, cf.make_streaming_reader(s, prs),
+                        streamed_mutation::forwarding::no);
+                return consume_repair_rows(s, std::move(reader), nullptr, func).discard_result();
+            });
+        });
+    });
+}
+
+// Splits the part of range which follows the partition of start_after into
+// the ranges held by each shard. The shard holding start_after is always
+// included, since the rest of its partition has to be read too.
+static std::map<unsigned, dht::partition_range_vector> split_range_after(const schema& s,
+        const ::dht::token_range& range, const stdx::optional<repair_row_hash>& start_after) {
+    auto pr = dht::to_partition_range(range);
+    std::map<unsigned, dht::partition_range_vector> shard_ranges;
+    if (start_after) {
+        auto start = dht::partition_range::bound(dht::ring_position(start_after->decorated_key()), false);
+        auto rest = pr.trim_front(stdx::make_optional(std::move(start)), dht::ring_position_comparator(s));
+        if (rest) {
+            shard_ranges = dht::split_range_to_shards(std::move(*rest), s);
+        }
+        shard_ranges[dht::shard_of(start_after->token())];
+    } else {
+        shard_ranges = dht::split_range_to_shards(std::move(pr), s);
+    }
+    return shard_ranges;
+}
+
+// Merges the batches of row hashes read by each shard into a single sorted
+// batch. The result doesn't extend past the end of any batch which was cut
+// short by the limit, since rows following it weren't read, and it holds no
+// more than max_rows entries, except for ones sharing the last position.
+static std::vector<repair_row_hash> merge_row_hashes(const schema& s,
+        std::vector<std::vector<repair_row_hash>> batches, size_t max_rows) {
+    repair_row_hash::tri_compare cmp(s);
+    stdx::optional<repair_row_hash> boundary;
+    for (auto& batch : batches) {
+        if (batch.size() >= max_rows && (!boundary || cmp.compare_position(batch.back(), *boundary) < 0)) {
+            boundary = batch.back();
+        }
+    }
+    std::vector<repair_row_hash> merged;
+    for (auto& batch : batches) {
+        std::move(batch.begin(), batch.end(), std::back_inserter(merged));
+    }
+    boost::sort(merged, repair_row_hash::less_compare(s));
+    auto end = merged.begin();
+    for (auto it = merged.begin(); it != merged.end(); ++it) {
+        if (boundary && cmp.compare_position(*it, *boundary) > 0) {
+            break;
+        }
+        if (size_t(it - merged.begin()) >= max_rows && cmp.compare_position(*it, *std::prev(it)) != 0) {
+            break;
+        }
+        end = std::next(it);
+    }
+    merged.erase(end, merged.end());
+    return merged;
+}
+
+future<std::vector<repair_row_hash>> get_row_hashes(seastar::sharded<database>& db,
+        const sstring& keyspace, const sstring& cf, const ::dht::token_range& range,
+        const stdx::optional<repair_row_hash>& start_after, size_t max_rows) {
+    auto schema = db.local().find_column_family(keyspace, cf).schema();
+    auto shard_ranges = split_range_after(*schema, range, start_after);
+    return do_with(std::vector<std::vector<repair_row_hash>>(), std::move(shard_ranges),
+            [&db, &keyspace, &cf, &start_after, max_rows, schema] (auto& batches, auto& shard_ranges) {
+        return parallel_for_each(shard_ranges, [&db, &keyspace, &cf, &start_after, max_rows, &batches] (auto& shard_range) {
+            auto shard = shard_range.first;
+            stdx::optional<repair_row_hash> head;
+            if (start_after && dht::shard_of(start_after->token()) == shard) {
+                head = start_after;
+            }
+            return db.invoke_on(shard, [keyspace, cf, head = std::move(head), prs = std::move(shard_range.second), max_rows] (database& db) mutable {
+                return do_with(std::move(keyspace), std::move(cf), std::move(head), std::move(prs), std::vector<repair_row_hash>(),
+                        [&db, max_rows] (auto& keyspace, auto& cf, auto& head, auto& prs, auto& hashes) {
+                    auto s = db.find_column_family(keyspace, cf).schema();
+                    auto collect = [s, &hashes, max_rows] (repair_row_hash rh, mutation_fragment) {
+                        // Don't split rows sharing a position between batches,
+                        // the next batch starts after the last position.
+                        if (hashes.size() >= max_rows && repair_row_hash::tri_compare(*s).compare_position(hashes.back(), rh) != 0) {
+                            return stop_iteration::yes;
+                        }
+                        hashes.push_back(std::move(rh));
+                        return stop_iteration::no;
+                    };
+                    return read_repair_rows_shard(db, keyspace, cf, head ? &*head : nullptr, prs, std::move(collect)).then([&hashes] {
+                        return std::move(hashes);
+                    });
+                });
+            }).then([&batches] (std::vector<repair_row_hash> hashes) {
+                batches.push_back(std::move(hashes));
+            });
+        }).then([&batches, max_rows, schema] {
+            return merge_row_hashes(*schema, std::move(batches), max_rows);
+        });
+    });
+}
+
+future<std::vector<frozen_mutation>> get_rows(seastar::sharded<database>& db,
+        const sstring& keyspace, const sstring& cf, const ::dht::token_range& range,
+        const stdx::optional<repair_row_hash>& start_after, const std::vector<repair_row_hash>& rows) {
+    auto schema = db.local().find_column_family(keyspace, cf).schema();
+    auto shard_ranges = split_range_after(*schema, range, start_after);
+    return do_with(std::vector<frozen_mutation>(), std::move(shard_ranges),
+            [&db, &keyspace, &cf, &start_after, &rows] (auto& mutations, auto& shard_ranges) {
+        return parallel_for_each(shard_ranges, [&db, &keyspace, &cf, &start_after, &rows, &mutations] (auto& shard_range) {
+            auto shard = shard_range.first;
+            std::vector<repair_row_hash> shard_rows;
+            for (auto& rh : rows) {
+                if (dht::shard_of(rh.token()) == shard) {
+                    shard_rows.push_back(rh);
+                }
+            }
+            if (shard_rows.empty()) {
+                return make_ready_future<>();
+            }
+            stdx::optional<repair_row_hash> head;
+            if (start_after && dht::shard_of(start_after->token()) == shard) {
+                head = start_after;
+            }
+            return db.invoke_on(shard, [keyspace, cf, head = std::move(head), prs = std::move(shard_range.second),
+                    shard_rows = std::move(shard_rows)] (database& db) mutable {
+                return do_with(std::move(keyspace), std::move(cf), std::move(head), std::move(prs), std::move(shard_rows),
+                        std::vector<frozen_mutation>(), stdx::optional<mutation>(),
+                        [&db] (auto& keyspace, auto& cf, auto& head, auto& prs, auto& rows, auto& mutations, auto& current) {
+                    auto s = db.find_column_family(keyspace, cf).schema();
+                    auto collect = [s, &rows, &mutations, &current, next = size_t(0)] (repair_row_hash rh, mutation_fragment mf) mutable {
+                        repair_row_hash::tri_compare cmp(*s);
+                        while (next < rows.size() && cmp(rows[next], rh) < 0) {
+                            ++next;
+                        }
+                        if (next == rows.size()) {
+                            return stop_iteration::yes;
+                        }
+                        if (cmp(rows[next], rh) == 0) {
+                            if (!current || !current->decorated_key().equal(*s, rh.decorated_key())) {
+                                if (current) {
+                                    mutations.push_back(freeze(*current));
+                                }
+                                current.emplace(rh.decorated_key(), s);
+                            }
+                            current->apply(mf);
+                        }
+                        return stop_iteration::no;
+                    };
+                    return read_repair_rows_shard(db, keyspace, cf, head ? &*head : nullptr, prs, std::move(collect)).then([&mutations, &current] {
+                        if (current) {
+                            mutations.push_back(freeze(*current));
+                        }
+                        return std::move(mutations);
+                    });
+                });
+            }).then([&mutations] (std::vector<frozen_mutation> shard_mutations) {
+                std::move(shard_mutations.begin(), shard_mutations.end(), std::back_inserter(mutations));
+            });
+        }).then([&mutations] {
+            return std::move(mutations);
+        });
+    });
+}
+
+future<> put_rows(std::vector<frozen_mutation> mutations, gms::inet_address from) {
+    return do_with(std::move(mutations), [from] (auto& mutations) {
+        return parallel_for_each(mutations, [from] (const frozen_mutation& fm) {
+            return service::get_schema_for_write(fm.schema_version(), netw::msg_addr{from}).then([&fm] (schema_ptr s) {
+                return service::get_local_storage_proxy().mutate_locally(s, fm);
+            });
+        });
+    });
+}
+
 // parallelism_semaphore limits the number of parallel ongoing checksum
 // comparisons. This could mean, for example, that this number of checksum
 // requests have been sent to other nodes and we are waiting for them to
@@ -645,6 +1199,209 @@ static future<uint64_t> estimate_partitions(seastar::sharded<database>& db, cons
     );
 }
 
+row_transfer_plan plan_row_transfers(const schema& s, const std::vector<std::vector<repair_row_hash>>& hashes, size_t batch_size) {
+    repair_row_hash::tri_compare cmp(s);
+    // Replicas which returned a full batch may have more rows after it, so
+    // only the rows up to the end of the batch which ends first can be
+    // compared now. The next batch starts right after it.
+    const repair_row_hash* boundary = nullptr;
+    for (auto& h : hashes) {
+        if (h.size() >= batch_size && (!boundary || cmp.compare_position(h.back(), *boundary) < 0)) {
+            boundary = &h.back();
+        }
+    }
+
+    // Find the replicas holding each row.
+    std::map<repair_row_hash, std::vector<size_t>, repair_row_hash::less_compare> holders{repair_row_hash::less_compare(s)};
+    for (size_t idx = 0; idx < hashes.size(); ++idx) {
+        for (auto& rh : hashes[idx]) {
+            if (boundary && cmp.compare_position(rh, *boundary) > 0) {
+                break;
+            }
+            auto& nodes = holders.emplace(rh, std::vector<size_t>()).first->second;
+            if (nodes.empty() || nodes.back() != idx) {
+                nodes.push_back(idx);
+            }
+        }
+    }
+
+    // Every row missing on some of the replicas is fetched from the first
+    // replica holding it, and sent to the replicas missing it. Rows with the
+    // same source and targets are transferred together.
+    row_transfer_plan plan;
+    for (auto& e : holders) {
+        auto& nodes = e.second;
+        if (nodes.size() == hashes.size()) {
+            continue;
+        }
+        std::vector<size_t> targets;
+        for (size_t idx = 0, i = 0; idx < hashes.size(); ++idx) {
+            if (i < nodes.size() && nodes[i] == idx) {
+                ++i;
+            } else {
+                targets.push_back(idx);
+            }
+        }
+        plan.transfers[std::make_pair(nodes.front(), std::move(targets))].push_back(e.first);
+    }
+    if (boundary) {
+        plan.next_start_after = *boundary;
+    }
+    return plan;
+}
+
+// Number of row hashes requested from each replica at a time by row-level
+// repair.
+static constexpr size_t row_hashes_batch_size = 1024;
+
+// Limits the number of sub-ranges synchronized row by row at the same time.
+// Each of them holds a batch of row hashes from every replica, and the rows
+// being transferred, in memory.
+static thread_local semaphore row_level_sync_parallelism_semaphore(16);
+
+// The address of the shard of a neighbor owning the start of a range. The
+// ranges repaired are pieces of the ranges of a single local shard, which
+// with the usual identical sharding of the nodes is owned by the same shard
+// of the neighbor: it serves the requests about the range itself, without
+// forwarding them to another core. When the neighbor shards differently,
+// the shard receiving the requests still splits them across its shards.
+static netw::msg_addr neighbor_shard_addr(gms::inet_address neighbor, const ::dht::token_range& range) {
+    auto t = range.start() ? range.start()->value() : dht::minimum_token();
+    return netw::get_local_messaging_service().replica_addr(neighbor, t);
+}
+
+// Synchronizes a sub-range between this node and the given neighbors row by
+// row. The row hashes of all the replicas are compared in sorted batches, and
+// the fragments missing on a replica are fetched from one of the replicas
+// holding them and sent to it. Unlike request_transfer_ranges(), which
+// streams the whole sub-range, only the differing rows are transferred.
+class row_level_repair {
+    repair_info& _ri;
+    sstring _cf;
+    dht::token_range _range;
+    schema_ptr _schema;
+    // This node comes first.
+    std::vector<gms::inet_address> _nodes;
+    stdx::optional<repair_row_hash> _start_after;
+    bool _done = false;
+    uint64_t _rows_transferred = 0;
+public:
+    row_level_repair(repair_info& ri, sstring cf, dht::token_range range, const std::vector<gms::inet_address>& neighbors)
+        : _ri(ri)
+        , _cf(std::move(cf))
+        , _range(std::move(range))
+        , _schema(ri.db.local().find_column_family(ri.keyspace, _cf).schema()) {
+        _nodes.reserve(neighbors.size() + 1);
+        _nodes.push_back(utils::fb_utilities::get_broadcast_address());
+        boost::copy(neighbors, std::back_inserter(_nodes));
+    }
+
+    future<> run() {
+        return do_until([this] { return _done; }, [this] {
+            check_in_shutdown();
+            _ri.check_in_abort();
+            return get_row_hashes_from_all().then([this] (std::vector<std::vector<repair_row_hash>> hashes) {
+                return sync_batch(std::move(hashes));
+            });
+        }).then([this] {
+            rlogger.debug("Synced range {} of {}.{} with {}: {} rows transferred", _range, _ri.keyspace, _cf, _nodes, _rows_transferred);
+        });
+    }
+private:
+    future<std::vector<repair_row_hash>> get_row_hashes_from(size_t idx) {
+        if (idx == 0) {
+            return get_row_hashes(_ri.db, _ri.keyspace, _cf, _range, _start_after, row_hashes_batch_size);
+        }
+        return netw::get_local_messaging_service().send_repair_get_row_hashes(neighbor_shard_addr(_nodes[idx], _range),
+                _ri.keyspace, _cf, _range, _start_after, row_hashes_batch_size);
+    }
+
+    future<std::vector<std::vector<repair_row_hash>>> get_row_hashes_from_all() {
+        auto hashes = make_lw_shared<std::vector<std::vector<repair_row_hash>>>(_nodes.size());
+        return parallel_for_each(boost::irange(size_t(0), _nodes.size()), [this, hashes] (size_t idx) {
+            return get_row_hashes_from(idx).then([hashes, idx] (std::vector<repair_row_hash> h) {
+                (*hashes)[idx] = std::move(h);
+            });
+        }).then([hashes] {
+            return std::move(*hashes);
+        });
+    }
+
+    future<std::vector<frozen_mutation>> get_rows_from(size_t idx, const stdx::optional<repair_row_hash>& start_after,
+            const std::vector<repair_row_hash>& rows) {
+        if (idx == 0) {
+            return get_rows(_ri.db, _ri.keyspace, _cf, _range, start_after, rows);
+        }
+        auto addr = neighbor_shard_addr(_nodes[idx], _range);
+        return netw::get_local_messaging_service().send_repair_get_rows(addr, _ri.keyspace, _cf, _range, start_after, rows).then(
+                [this, addr] (std::vector<frozen_mutation> mutations) {
+            // Convert the rows to our schema, the replicas we forward them to
+            // might not know the schema version of the source.
+            return do_with(std::move(mutations), std::vector<frozen_mutation>(), [this, addr] (auto& in, auto& out) {
+                return do_for_each(in, [this, addr, &out] (const frozen_mutation& fm) {
+                    return service::get_schema_for_write(fm.schema_version(), addr).then([this, &fm, &out] (schema_ptr s) {
+                        if (s->version() == _schema->version()) {
+                            out.push_back(fm);
+                            return;
+                        }
+                        auto m = fm.unfreeze(s);
+                        m.upgrade(_schema);
+                        out.push_back(freeze(m));
+                    });
+                }).then([&out] {
+                    return std::move(out);
+                });
+            });
+        });
+    }
+
+    future<> put_rows_to(size_t idx, const std::vector<frozen_mutation>& mutations) {
+        if (idx == 0) {
+            return parallel_for_each(mutations, [this] (const frozen_mutation& fm) {
+                return service::get_local_storage_proxy().mutate_locally(_schema, fm);
+            });
+        }
+        return netw::get_local_messaging_service().send_repair_put_rows(neighbor_shard_addr(_nodes[idx], _range), mutations);
+    }
+
+    // Sends the rows fetched from the source node to all the targets.
+    future<> transfer_rows(size_t source, const std::vector<size_t>& targets,
+            const stdx::optional<repair_row_hash>& start_after, const std::vector<repair_row_hash>& rows) {
+        _rows_transferred += rows.size() * targets.size();
+        return get_rows_from(source, start_after, rows).then([this, &targets] (std::vector<frozen_mutation> mutations) {
+            return do_with(std::move(mutations), [this, &targets] (const auto& mutations) {
+                return parallel_for_each(targets, [this, &mutations] (size_t idx) {
+                    return put_rows_to(idx, mutations);
+                });
+            });
+        });
+    }
+
+    future<> sync_batch(std::vector<std::vector<repair_row_hash>> hashes) {
+        auto plan = plan_row_transfers(*_schema, hashes, row_hashes_batch_size);
+        auto& transfers = plan.transfers;
+        auto start_after = std::exchange(_start_after, std::move(plan.next_start_after));
+        _done = !_start_after;
+        if (transfers.empty()) {
+            return make_ready_future<>();
+        }
+        _ri.check_in_abort();
+        return do_with(std::move(transfers), std::move(start_after), [this] (const auto& transfers, const auto& start_after) {
+            return parallel_for_each(transfers, [this, &start_after] (const auto& t) {
+                return transfer_rows(t.first.first, t.first.second, start_after, t.second);
+            });
+        });
+    }
+};
+
+static future<> sync_range_row_level(repair_info& ri, const sstring& cf, const ::dht::token_range& range,
+        const std::vector<gms::inet_address>& neighbors) {
+    return seastar::with_semaphore(row_level_sync_parallelism_semaphore, 1, [&ri, cf, range, neighbors] {
+        auto rlr = make_lw_shared<row_level_repair>(ri, cf, range, neighbors);
+        return rlr->run().finally([rlr] { });
+    });
+}
+
 // Repair a single cf in a single local range.
 // Comparable to RepairJob in Origin.
 static future<> repair_cf_range(repair_info& ri,
@@ -666,8 +1423,9 @@ static future<> repair_cf_range(repair_info& ri,
             check_in_shutdown();
             ri.check_in_abort();
             return seastar::get_units(parallelism_semaphore, 1).then([&ri, &completion, &success, &neighbors, &cf, range] (auto signal_sem) {
-                auto checksum_type = service::get_local_storage_service().cluster_supports_large_partitions()
-                                     ? repair_checksum::streamed : repair_checksum::legacy;
+                auto& ss = service::get_local_storage_service();
+                auto checksum_type = ss.cluster_supports_murmur3_digest() ? repair_checksum::streamed_murmur3
+                                   : ss.cluster_supports_large_partitions() ? repair_checksum::streamed : repair_checksum::legacy;
 
                 // Ask this node, and all neighbors, to calculate checksums in
                 // this range. When all are done, compare the results, and if
@@ -678,7 +1436,7 @@ static future<> repair_cf_range(repair_info& ri,
                 for (auto&& neighbor : neighbors) {
                     checksums.push_back(
                             netw::get_local_messaging_service().send_repair_checksum_range(
-                                    netw::msg_addr{neighbor}, ri.keyspace, cf, range, checksum_type));
+                                    neighbor_shard_addr(neighbor, range), ri.keyspace, cf, range, checksum_type));
                 }
 
                 completion.enter();
@@ -817,6 +1575,17 @@ static future<> repair_cf_range(repair_info& ri,
                         rlogger.debug("Found differing range {} on nodes {}, in = {}, out = {}", range,
                                 live_neighbors, live_neighbors_in, live_neighbors_out);
                         ri.check_in_abort();
+                        if (service::get_local_storage_service().cluster_supports_row_level_repair()) {
+                            // Only the rows which differ are synced, between
+                            // the nodes which would stream the range.
+                            std::vector<gms::inet_address> nodes(live_neighbors_in);
+                            for (auto& node : live_neighbors_out) {
+                                if (!boost::algorithm::any_of_equal(nodes, node)) {
+                                    nodes.push_back(node);
+                                }
+                            }
+                            return sync_range_row_level(ri, cf, range, nodes);
+                        }
                         return ri.request_transfer_ranges(cf, range, live_neighbors_in, live_neighbors_out);
                     }
                     return make_ready_future<>();
@@ -1246,9 +2015,14 @@ future<repair_status> repair_get_status(seastar::sharded<database>& db, int id)
 future<> repair_shutdown(seastar::sharded<database>& db) {
     rlogger.info("Starting shutdown of repair");
     return db.invoke_on(0, [] (database& localdb) {
-        return repair_tracker.shutdown().then([] {
-            rlogger.info("Completed shutdown of repair");
+        return repair_tracker.shutdown();
+    }).then([&db] {
+        return db.invoke_on_all([] (database& localdb) {
+            checksum_readers.clear();
+            range_checksums.clear();
         });
+    }).then([] {
+        rlogger.info("Completed shutdown of repair");
     });
 }
 
@@ -21,6 +21,7 @@
 
 #pragma once
 
+#include <map>
 #include <unordered_map>
 #include <exception>
 
@@ -29,6 +30,9 @@
 #include <seastar/core/future.hh>
 
 #include "database.hh"
+#include "frozen_mutation.hh"
+#include "position_in_partition.hh"
+#include "gms/inet_address.hh"
 #include "utils/UUID.hh"
 
 
@@ -76,6 +80,7 @@ future<> repair_abort_all(seastar::sharded<database>& db);
 enum class repair_checksum {
     legacy = 0,
     streamed = 1,
+    streamed_murmur3 = 2,
 };
 
 // The class partition_checksum calculates a 256-bit cryptographically-secure
@@ -86,11 +91,16 @@ enum class repair_checksum {
 // independently calculate the checksums of different subsets of the original
 // set, and then combine the results into one checksum with the add() method.
 // The hash of an individual partition uses both its key and value.
+//
+// With repair_checksum::streamed_murmur3, the partitions are hashed with the
+// 128-bit MurmurHash3 instead, which is much cheaper but only protects against
+// accidental differences. The upper half of the digest is then zero.
 class partition_checksum {
 private:
     std::array<uint8_t, 32> _digest; // 256 bits
 private:
     static future<partition_checksum> compute_legacy(streamed_mutation m);
+    template <typename Hasher>
     static future<partition_checksum> compute_streamed(streamed_mutation m);
 public:
     constexpr partition_checksum() : _digest{} { }
@@ -112,6 +122,115 @@ future<partition_checksum> checksum_range(seastar::sharded<database> &db,
         const sstring& keyspace, const sstring& cf,
         const ::dht::token_range& range, repair_checksum rt);
 
+// Row-level repair describes the data of a range by a list of repair_row_hash
+// entries, one for each fragment (partition tombstone, static row, clustering
+// row or range tombstone) of the partitions in the range. An entry identifies
+// the fragment by its position and carries a hash of its content, so replicas
+// can work out which fragments they are missing by comparing these lists,
+// instead of streaming the whole range when anything in it differs.
+class repair_row_hash {
+    dht::decorated_key _dk;
+    position_in_partition _pos;
+    uint64_t _hash;
+public:
+    repair_row_hash(dht::decorated_key dk, position_in_partition pos, uint64_t hash)
+        : _dk(std::move(dk)), _pos(std::move(pos)), _hash(hash) { }
+    repair_row_hash(dht::token token, partition_key key, partition_region region, int32_t bound_weight,
+            stdx::optional<clustering_key_prefix> ckey, uint64_t hash)
+        : _dk{std::move(token), std::move(key)}
+        , _pos(position_in_partition_view(region, bound_weight, ckey ? &*ckey : nullptr))
+        , _hash(hash) { }
+
+    const dht::decorated_key& decorated_key() const { return _dk; }
+    const position_in_partition& position() const { return _pos; }
+
+    const dht::token& token() const { return _dk._token; }
+    const partition_key& key() const { return _dk._key; }
+    partition_region region() const { return _pos.region(); }
+    int32_t bound_weight() const { return _pos.bound_weight(); }
+    stdx::optional<clustering_key_prefix> ckey() const {
+        if (!_pos.has_clustering_key()) {
+            return stdx::nullopt;
+        }
+        return _pos.key();
+    }
+    uint64_t hash() const { return _hash; }
+
+    // Orders entries by ring position, then by position in partition and
+    // then by hash. Several entries can share a position, e.g. range
+    // tombstones starting at the same bound.
+    class tri_compare {
+        const schema& _s;
+        position_in_partition::tri_compare _cmp;
+    public:
+        explicit tri_compare(const schema& s) : _s(s), _cmp(s) { }
+        // Compares the positions only, ignoring the hashes.
+        int compare_position(const repair_row_hash& a, const repair_row_hash& b) const {
+            auto r = a._dk.tri_compare(_s, b._dk);
+            if (r != 0) {
+                return r;
+            }
+            return _cmp(a._pos, b._pos);
+        }
+        int operator()(const repair_row_hash& a, const repair_row_hash& b) const {
+            auto r = compare_position(a, b);
+            if (r != 0) {
+                return r;
+            }
+            return a._hash < b._hash ? -1 : (a._hash > b._hash ? 1 : 0);
+        }
+    };
+
+    class less_compare {
+        tri_compare _cmp;
+    public:
+        explicit less_compare(const schema& s) : _cmp(s) { }
+        bool operator()(const repair_row_hash& a, const repair_row_hash& b) const {
+            return _cmp(a, b) < 0;
+        }
+    };
+
+    friend std::ostream& operator<<(std::ostream&, const repair_row_hash&);
+};
+
+// Calculate the row hashes of the data held on all shards of a column family,
+// in the given token range, for the fragments positioned after start_after
+// (or from the beginning of the range if not engaged). The result is sorted
+// and holds at least max_rows entries unless the end of the range was
+// reached; entries sharing a position are never split between batches,
+// so the last entry can be used as start_after of the next batch.
+// All parameters to this function are constant references, and the caller
+// must ensure they live as long as the future returned by this function is
+// not resolved.
+future<std::vector<repair_row_hash>> get_row_hashes(seastar::sharded<database>& db,
+        const sstring& keyspace, const sstring& cf, const ::dht::token_range& range,
+        const stdx::optional<repair_row_hash>& start_after, size_t max_rows);
+
+// Read the fragments described by rows, which must be sorted and positioned
+// after start_after, from all shards of a column family in the given token
+// range. The same lifetime requirements as for get_row_hashes() apply.
+future<std::vector<frozen_mutation>> get_rows(seastar::sharded<database>& db,
+        const sstring& keyspace, const sstring& cf, const ::dht::token_range& range,
+        const stdx::optional<repair_row_hash>& start_after, const std::vector<repair_row_hash>& rows);
+
+// Apply rows sent by the repair master at the given address to the local
+// replica.
+future<> put_rows(std::vector<frozen_mutation> mutations, gms::inet_address from);
+
+// The transfers which synchronize the replicas of a range over a batch of
+// their row hashes, each of at most batch_size entries unless they share a
+// position, as returned by get_row_hashes() for the same start_after.
+struct row_transfer_plan {
+    // Where the next batch starts, disengaged when the batches reached the
+    // end of the range.
+    stdx::optional<repair_row_hash> next_start_after;
+    // The rows to fetch from a replica and to send to others, keyed by the
+    // source and the targets, as indexes into the batches.
+    std::map<std::pair<size_t, std::vector<size_t>>, std::vector<repair_row_hash>> transfers;
+};
+
+row_transfer_plan plan_row_transfers(const schema& s, const std::vector<std::vector<repair_row_hash>>& hashes, size_t batch_size);
+
 namespace std {
 template<>
 struct hash<partition_checksum> {
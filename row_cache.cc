@@ -25,16 +25,22 @@
 #include "core/future-util.hh"
 #include <seastar/core/metrics.hh>
 #include <seastar/util/defer.hh>
+#include <seastar/core/byteorder.hh>
 #include "memtable.hh"
 #include "partition_snapshot_reader.hh"
 #include <chrono>
 #include "utils/move.hh"
 #include <boost/version.hpp>
+#include <boost/algorithm/cxx11/any_of.hpp>
+#include <boost/range/adaptor/map.hpp>
 #include <sys/sdt.h>
 #include "stdx.hh"
 #include "cache_streamed_mutation.hh"
 #include "read_context.hh"
 #include "schema_upgrader.hh"
+#include "utils/task_context_guard.hh"
+#include "frozen_mutation.hh"
+#include "sstables/compress.hh"
 
 using namespace std::chrono_literals;
 using namespace cache;
@@ -55,25 +61,54 @@ cache_tracker& global_cache_tracker() {
     return instance;
 }
 
-cache_tracker::cache_tracker() {
-    setup_metrics();
+cache_tracker& in_memory_cache_tracker() {
+    static thread_local cache_tracker instance("in_memory_cache");
+    return instance;
+}
+
+cache_tracker::cache_tracker(const sstring& metrics_group)
+    : _admission_policy(std::make_unique<tinylfu_admission_policy>(memory::stats().total_memory() / 2048))
+{
+    setup_metrics(metrics_group);
 
     _region.make_evictable([this] {
         return with_allocator(_region.allocator(), [this] {
           // Removing a partition may require reading large keys when we rebalance
           // the rbtree, so linearize anything we read
           return with_linearized_managed_bytes([&] {
+           if (_region.occupancy().used_space() <= _eviction_floor) {
+               return memory::reclaiming_result::reclaimed_nothing;
+           }
            try {
-            auto evict_last = [this](lru_type& lru) {
-                cache_entry& ce = lru.back();
+            auto evict = [this](lru_type& lru, cache_entry& ce) {
                 auto it = row_cache::partitions_type::s_iterator_to(ce);
                 clear_continuity(*std::next(it));
-                lru.pop_back_and_dispose(current_deleter<cache_entry>());
+                if (auto share = find_share(*ce.schema())) {
+                    --share->partitions;
+                }
+                lru.erase_and_dispose(lru.iterator_to(ce), current_deleter<cache_entry>());
             };
+            if (_secondary_evictor && _evict_secondary_next) {
+                _evict_secondary_next = false;
+                if (_secondary_evictor() == memory::reclaiming_result::reclaimed_something) {
+                    return memory::reclaiming_result::reclaimed_something;
+                }
+            }
+            _evict_secondary_next = true;
+            if (!_compressed_lru.empty()) {
+                erase_compressed(_compressed_lru.back());
+                ++_stats.compressed_partition_evictions;
+                return memory::reclaiming_result::reclaimed_something;
+            }
             if (_lru.empty()) {
-                return memory::reclaiming_result::reclaimed_nothing;
+                return _secondary_evictor ? _secondary_evictor() : memory::reclaiming_result::reclaimed_nothing;
+            }
+            cache_entry& victim = eviction_victim();
+            if (auto evicted = victim.partition().evict_last_rows(partial_eviction_rows)) {
+                _stats.row_evictions += evicted;
+                return memory::reclaiming_result::reclaimed_something;
             }
-            evict_last(_lru);
+            evict(_lru, victim);
             --_stats.partitions;
             ++_stats.partition_evictions;
             return memory::reclaiming_result::reclaimed_something;
@@ -93,22 +128,25 @@ cache_tracker::~cache_tracker() {
 }
 
 void
-cache_tracker::setup_metrics() {
+cache_tracker::setup_metrics(const sstring& group) {
     namespace sm = seastar::metrics;
-    _metrics.add_group("cache", {
+    _metrics.add_group(group, {
         sm::make_gauge("bytes_used", sm::description("current bytes used by the cache out of the total size of memory"), [this] { return _region.occupancy().used_space(); }),
         sm::make_gauge("bytes_total", sm::description("total size of memory for the cache"), [this] { return _region.occupancy().total_space(); }),
         sm::make_derive("partition_hits", sm::description("number of partitions needed by reads and found in cache"), _stats.partition_hits),
         sm::make_derive("partition_misses", sm::description("number of partitions needed by reads and missing in cache"), _stats.partition_misses),
         sm::make_derive("partition_insertions", sm::description("total number of partitions added to cache"), _stats.partition_insertions),
+        sm::make_derive("cold_partition_insertions", sm::description("total number of partitions added to cache by range scans, at the end of the LRU"), _stats.cold_partition_insertions),
         sm::make_derive("row_hits", sm::description("total number of rows needed by reads and found in cache"), _stats.row_hits),
         sm::make_derive("row_misses", sm::description("total number of rows needed by reads and missing in cache"), _stats.row_misses),
         sm::make_derive("row_insertions", sm::description("total number of rows added to cache"), _stats.row_insertions),
         sm::make_derive("concurrent_misses_same_key", sm::description("total number of operation with misses same key"), _stats.concurrent_misses_same_key),
         sm::make_derive("partition_merges", sm::description("total number of partitions merged"), _stats.partition_merges),
         sm::make_derive("partition_evictions", sm::description("total number of evicted partitions"), _stats.partition_evictions),
+        sm::make_derive("row_evictions", sm::description("total number of rows evicted from the end of large partitions which stayed in cache"), _stats.row_evictions),
         sm::make_derive("partition_removals", sm::description("total number of invalidated partitions"), _stats.partition_removals),
         sm::make_derive("mispopulations", sm::description("number of entries not inserted by reads"), _stats.mispopulations),
+        sm::make_derive("admission_rejections", sm::description("number of partitions not inserted by reads because they were less frequently accessed than the eviction victim"), _stats.admission_rejections),
         sm::make_gauge("partitions", sm::description("total number of cached partitions"), _stats.partitions),
         sm::make_derive("reads", sm::description("number of started reads"), _stats.reads),
         sm::make_derive("reads_with_misses", sm::description("number of reads which had to read from sstables"), _stats.reads_with_misses),
@@ -116,6 +154,11 @@ cache_tracker::setup_metrics() {
         sm::make_derive("sstable_reader_recreations", sm::description("number of times sstable reader was recreated due to memtable flush"), _stats.underlying_recreations),
         sm::make_derive("sstable_partition_skips", sm::description("number of times sstable reader was fast forwarded across partitions"), _stats.underlying_partition_skips),
         sm::make_derive("sstable_row_skips", sm::description("number of times sstable reader was fast forwarded within a partition"), _stats.underlying_row_skips),
+        sm::make_derive("partition_compressions", sm::description("number of cold partitions compressed instead of evicted"), _stats.partition_compressions),
+        sm::make_derive("compressed_partition_hits", sm::description("number of partitions needed by reads and found compressed"), _stats.compressed_partition_hits),
+        sm::make_derive("compressed_partition_evictions", sm::description("number of compressed partitions evicted"), _stats.compressed_partition_evictions),
+        sm::make_gauge("compressed_partitions", sm::description("total number of compressed partitions"), _stats.compressed_partitions),
+        sm::make_gauge("compressed_bytes", sm::description("memory used by compressed partitions"), _stats.compressed_bytes),
     });
 }
 
@@ -135,7 +178,13 @@ void cache_tracker::clear() {
             }
         };
         clear(_lru);
+        while (!_compressed_lru.empty()) {
+            erase_compressed(_compressed_lru.back());
+        }
     });
+    for (auto&& share : _table_shares) {
+        share.second.partitions = 0;
+    }
     _stats.partition_removals += _stats.partitions;
     _stats.partitions = 0;
     allocator().invalidate_references();
@@ -149,15 +198,26 @@ void cache_tracker::touch(cache_entry& e) {
     move_to_front(_lru, e);
 }
 
-void cache_tracker::insert(cache_entry& entry) {
+void cache_tracker::insert(cache_entry& entry, cold c) {
     ++_stats.partition_insertions;
     ++_stats.partitions;
     // partition_range_cursor depends on this to detect invalidation of _end
     _region.allocator().invalidate_references();
-    _lru.push_front(entry);
+    if (c) {
+        ++_stats.cold_partition_insertions;
+        _lru.push_back(entry);
+    } else {
+        _lru.push_front(entry);
+    }
+    if (auto share = find_share(*entry.schema())) {
+        ++share->partitions;
+    }
 }
 
-void cache_tracker::on_erase() {
+void cache_tracker::on_erase(const cache_entry& entry) {
+    if (auto share = find_share(*entry.schema())) {
+        --share->partitions;
+    }
     --_stats.partitions;
     ++_stats.partition_removals;
     allocator().invalidate_references();
@@ -191,6 +251,231 @@ void cache_tracker::on_miss_already_populated() {
     ++_stats.concurrent_misses_same_key;
 }
 
+void cache_tracker::on_compressed_partition_hit() {
+    ++_stats.compressed_partition_hits;
+}
+
+std::vector<std::pair<utils::UUID, partition_key>> cache_tracker::hottest_partitions(size_t max) {
+    std::vector<std::pair<utils::UUID, partition_key>> ret;
+    ret.reserve(std::min<size_t>(max, _stats.partitions));
+    // Entries must not be evicted or moved while we copy their keys.
+    logalloc::reclaim_lock rl(_region);
+    for (auto&& e : _lru) {
+        if (ret.size() >= max) {
+            break;
+        }
+        ret.emplace_back(e.schema()->id(), e.key().key());
+    }
+    return ret;
+}
+
+uint64_t cache_tracker::key_hash(const schema& s, const dht::decorated_key& dk) {
+    return std::hash<dht::decorated_key>()(dk) * 31 + std::hash<utils::UUID>()(s.id());
+}
+
+bool cache_tracker::under_memory_pressure() const {
+    // Free LSA segments will be used by cache before anything gets evicted.
+    auto free = memory::stats().free_memory() + logalloc::shard_tracker().occupancy().free_space();
+    return free < memory::stats().total_memory() / 16;
+}
+
+void cache_tracker::on_partition_access(const schema& s, const dht::decorated_key& dk) {
+    _admission_policy->record_access(key_hash(s, dk));
+}
+
+bool cache_tracker::should_admit(const schema& s, const dht::decorated_key& dk) {
+    if (_lru.empty() || !under_memory_pressure() || _region.occupancy().used_space() < _eviction_floor) {
+        return true;
+    }
+    auto share = find_share(s);
+    if (share && over_max_share(*share)) {
+        ++_stats.admission_rejections;
+        return false;
+    }
+    cache_entry& victim = eviction_victim();
+    if (_admission_policy->admit(key_hash(s, dk), key_hash(*victim.schema(), victim.key()))) {
+        return true;
+    }
+    ++_stats.admission_rejections;
+    return false;
+}
+
+cache_tracker::table_share* cache_tracker::find_share(const schema& s) {
+    auto i = _table_shares.find(s.id());
+    return i == _table_shares.end() ? nullptr : &i->second;
+}
+
+bool cache_tracker::over_max_share(const table_share& share) const {
+    return share.partitions > share.max_share * _stats.partitions;
+}
+
+bool cache_tracker::under_min_share(const table_share& share) const {
+    return share.partitions <= share.min_share * _stats.partitions;
+}
+
+void cache_tracker::update_shares_enabled() {
+    _shares_enabled = boost::algorithm::any_of(_table_shares | boost::adaptors::map_values, [] (const table_share& share) {
+        return share.min_share != 0 || share.max_share != 1;
+    });
+}
+
+cache_entry& cache_tracker::eviction_victim() {
+    if (!_shares_enabled) {
+        return _lru.back();
+    }
+    cache_entry* victim = nullptr;
+    unsigned scanned = 0;
+    for (auto it = _lru.rbegin(); it != _lru.rend() && scanned < max_victim_scan; ++it, ++scanned) {
+        auto share = find_share(*it->schema());
+        if (!share) {
+            victim = victim ? victim : &*it;
+            continue;
+        }
+        if (over_max_share(*share)) {
+            return *it;
+        }
+        if (!victim && !under_min_share(*share)) {
+            victim = &*it;
+        }
+    }
+    // Something has to be evicted, even if all candidates are protected.
+    return victim ? *victim : _lru.back();
+}
+
+void cache_tracker::register_table(const schema& s) {
+    auto& share = _table_shares[s.id()];
+    if (++share.caches == 2) {
+        drop_compressed(s.id());
+    }
+    update_table_share(s);
+}
+
+void cache_tracker::update_table_share(const schema& s) noexcept {
+    if (auto share = find_share(s)) {
+        share->min_share = s.caching_options().min_share();
+        share->max_share = s.caching_options().max_share();
+        update_shares_enabled();
+    }
+}
+
+void cache_tracker::unregister_table(const schema& s) noexcept {
+    auto i = _table_shares.find(s.id());
+    if (i != _table_shares.end() && i->second.caches == 1) {
+        drop_compressed(s.id());
+    }
+    if (i != _table_shares.end() && !--i->second.caches) {
+        _table_shares.erase(i);
+        update_shares_enabled();
+    }
+}
+
+uint64_t cache_tracker::table_partitions(const utils::UUID& table_id) const {
+    auto i = _table_shares.find(table_id);
+    return i == _table_shares.end() ? 0 : i->second.partitions;
+}
+
+void cache_tracker::set_compressed_fraction(double fraction) {
+    _compressed_fraction = fraction;
+    if (!fraction) {
+        with_allocator(allocator(), [this] {
+            while (!_compressed_lru.empty()) {
+                erase_compressed(_compressed_lru.back());
+            }
+        });
+    }
+}
+
+void cache_tracker::compress_cold_partition() noexcept {
+    if (!_compressed_fraction || _lru.empty() || !under_memory_pressure()
+            || _stats.compressed_bytes > _compressed_fraction * _region.occupancy().total_space()) {
+        return;
+    }
+    try {
+        _compress_section(_region, [this] {
+          with_linearized_managed_bytes([this] {
+            cache_entry& victim = _lru.back();
+            auto share = find_share(*victim.schema());
+            if (!share || share->caches != 1 || !victim.partition().has_single_unread_version()) {
+                return;
+            }
+            const mutation_partition& mp = victim.partition().version()->partition();
+            if (!mp.is_fully_continuous()) {
+                return;
+            }
+            auto data = compressed_cache_entry::compress(mutation(victim.schema(), victim.key(), mp));
+            if (data.empty()) {
+                return;
+            }
+            with_allocator(allocator(), [&] {
+                auto ce = current_allocator().construct<compressed_cache_entry>(victim.schema(), victim.key(), data);
+                _compressed.insert(*ce);
+                _compressed_lru.push_front(*ce);
+                ++_stats.compressed_partitions;
+                _stats.compressed_bytes += ce->compressed_size();
+
+                auto it = row_cache::partitions_type::s_iterator_to(victim);
+                clear_continuity(*std::next(it));
+                --share->partitions;
+                _lru.erase_and_dispose(_lru.iterator_to(victim), current_deleter<cache_entry>());
+                --_stats.partitions;
+                ++_stats.partition_compressions;
+                allocator().invalidate_references();
+            });
+          });
+        });
+    } catch (...) {
+        // The partition stays uncompressed, to be evicted as usual.
+    }
+}
+
+compressed_cache_entry* cache_tracker::find_compressed(const schema& s, const dht::decorated_key& dk) {
+    if (_compressed.empty()) {
+        return nullptr;
+    }
+    auto i = _compressed.find(compressed_cache_entry::key_view{s.id(), dk}, compressed_cache_entry::compare());
+    return i == _compressed.end() ? nullptr : &*i;
+}
+
+void cache_tracker::erase_compressed(const schema& s, dht::ring_position_view start, dht::ring_position_view end) {
+    if (_compressed.empty()) {
+        return;
+    }
+    compressed_cache_entry::compare cmp;
+    auto i = _compressed.lower_bound(compressed_cache_entry::key_view{s.id(), start}, cmp);
+    auto e = _compressed.lower_bound(compressed_cache_entry::key_view{s.id(), end}, cmp);
+    with_allocator(allocator(), [&] {
+        while (i != e) {
+            erase_compressed(*i++);
+        }
+    });
+}
+
+void cache_tracker::erase_compressed(const schema& s, const dht::decorated_key& dk) {
+    if (auto ce = find_compressed(s, dk)) {
+        with_allocator(allocator(), [&] {
+            erase_compressed(*ce);
+        });
+    }
+}
+
+void cache_tracker::erase_compressed(compressed_cache_entry& ce) noexcept {
+    --_stats.compressed_partitions;
+    _stats.compressed_bytes -= ce.compressed_size();
+    current_deleter<compressed_cache_entry>()(&ce);
+}
+
+void cache_tracker::drop_compressed(const utils::UUID& table) noexcept {
+    with_allocator(allocator(), [&] {
+        auto i = _compressed_lru.begin();
+        while (i != _compressed_lru.end()) {
+            auto& ce = *i++;
+            if (ce.schema()->id() == table) {
+                erase_compressed(ce);
+            }
+        }
+    });
+}
+
 allocation_strategy& cache_tracker::allocator() {
     return _region.allocator();
 }
@@ -284,6 +569,13 @@ class partition_range_cursor final {
         return _it != _end;
     }
 
+    // Returns the entry after the current one, if it is inside the requested range.
+    // Call only when in_range() and cache entry reference is valid.
+    cache_entry* next_in_range() {
+        auto next = std::next(_it);
+        return next != _end ? &*next : nullptr;
+    }
+
     // Returns current position of the cursor.
     // Result valid as long as this instance is valid and not advanced.
     dht::ring_position_view position() const {
@@ -346,6 +638,9 @@ class single_partition_populating_reader final : public mutation_reader::impl {
                     _cache._read_section(_cache._tracker.region(), [this, ctx = std::move(ctx)] {
                         with_allocator(_cache._tracker.allocator(), [this, &ctx] {
                             dht::decorated_key dk = ctx->range().start()->value().as_decorated_key();
+                            if (!_cache._tracker.should_admit(*_cache._schema, dk)) {
+                                return;
+                            }
                             _cache.do_find_or_create_entry(dk, nullptr, [&] (auto i) {
                                 mutation_partition mp(_cache._schema);
                                 cache_entry* entry = current_allocator().construct<cache_entry>(
@@ -365,6 +660,9 @@ class single_partition_populating_reader final : public mutation_reader::impl {
             }
             if (phase == _cache.phase_of(ctx->range().start()->value())) {
                 return _cache._read_section(_cache._tracker.region(), [&] {
+                    if (!_cache._tracker.should_admit(*_cache._schema, sm->decorated_key())) {
+                        return read_directly_from_underlying(std::move(*sm), *ctx);
+                    }
                     cache_entry& e = _cache.find_or_create(sm->decorated_key(), sm->partition_tombstone(), phase);
                     return e.read(_cache, *ctx, std::move(*sm), phase);
                 });
@@ -457,10 +755,18 @@ class range_populating_reader {
                     return std::move(smopt);
                 }
                 _cache.on_partition_miss();
+                _cache._tracker.on_partition_access(*_cache._schema, smopt->decorated_key());
                 if (_reader.creation_phase() == _cache.phase_of(smopt->decorated_key())) {
                     return _cache._read_section(_cache._tracker.region(), [&] {
+                        if (!_cache._tracker.should_admit(*_cache._schema, smopt->decorated_key())) {
+                            // The range up to the next partition is not going to be complete in cache.
+                            _last_key = {};
+                            return read_directly_from_underlying(std::move(*smopt), _read_context);
+                        }
+                        // The partitions a scan populates are less likely to be read again than those
+                        // of single partition reads, so they are the first to go.
                         cache_entry& e = _cache.find_or_create(smopt->decorated_key(), smopt->partition_tombstone(), _reader.creation_phase(),
-                            can_set_continuity() ? &*_last_key : nullptr);
+                            can_set_continuity() ? &*_last_key : nullptr, cache_tracker::cold::yes);
                         _last_key = row_cache::previous_entry_pointer(smopt->decorated_key());
                         return e.read(_cache, _read_context, std::move(*smopt), _reader.creation_phase());
                     });
@@ -488,6 +794,10 @@ class range_populating_reader {
 };
 
 class scanning_and_populating_reader final : public mutation_reader::impl {
+    // The most cached partitions which are read again from the underlying
+    // source, so that the ranges missing around them are read together.
+    static constexpr unsigned max_batched_partitions = 16;
+
     const dht::partition_range* _pr;
     row_cache& _cache;
     lw_shared_ptr<read_context> _read_context;
@@ -501,6 +811,7 @@ class scanning_and_populating_reader final : public mutation_reader::impl {
     streamed_mutation read_from_entry(cache_entry& ce) {
         _cache.upgrade_entry(ce);
         _cache._tracker.touch(ce);
+        _cache._tracker.on_partition_access(*_cache._schema, ce.key());
         _cache.on_partition_hit();
         return ce.read(_cache, *_read_context);
     }
@@ -528,6 +839,16 @@ class scanning_and_populating_reader final : public mutation_reader::impl {
                     return streamed_mutation_opt(std::move(sm));
                 } else {
                     if (_primary.in_range()) {
+                        // When the cached partitions after the missing range have missing ranges after them
+                        // too, they are read from the underlying source with all of those ranges, in one
+                        // read, which also makes them continuous with each other.
+                        for (unsigned batched = 0; batched < max_batched_partitions; ++batched) {
+                            auto next = _primary.next_in_range();
+                            if (!next || next->continuous()) {
+                                break;
+                            }
+                            _primary.next();
+                        }
                         cache_entry& e = _primary.entry();
                         _secondary_range = dht::partition_range(_lower_bound ? std::move(_lower_bound) : _pr->start(),
                             dht::partition_range::bound{e.key(), false});
@@ -614,6 +935,7 @@ row_cache::make_reader(schema_ptr s,
                        mutation_reader::forwarding fwd_mr)
 {
     auto ctx = make_lw_shared<read_context>(*this, std::move(s), range, slice, pc, trace_state, fwd, fwd_mr);
+    _tracker.compress_cold_partition();
 
     if (!ctx->is_range_query()) {
         return _read_section(_tracker.region(), [&] {
@@ -624,13 +946,20 @@ row_cache::make_reader(schema_ptr s,
             if (i != _partitions.end() && !cmp(pos, i->position())) {
                 cache_entry& e = *i;
                 _tracker.touch(e);
+                _tracker.on_partition_access(*_schema, e.key());
                 upgrade_entry(e);
                 on_partition_hit();
                 return make_reader_returning(e.read(*this, *ctx));
             } else if (i->continuous()) {
                 return make_empty_reader();
+            } else if (auto ce = _tracker.find_compressed(*_schema, pos.as_decorated_key())) {
+                cache_entry& e = promote(*ce, i);
+                _tracker.on_partition_access(*_schema, e.key());
+                _tracker.on_compressed_partition_hit();
+                return make_reader_returning(e.read(*this, *ctx));
             } else {
                 on_partition_miss();
+                _tracker.on_partition_access(*_schema, pos.as_decorated_key());
                 return make_mutation_reader<single_partition_populating_reader>(*this, std::move(ctx));
             }
           });
@@ -644,21 +973,23 @@ row_cache::~row_cache() {
     with_allocator(_tracker.allocator(), [this] {
         _partitions.clear_and_dispose([this, deleter = current_deleter<cache_entry>()] (auto&& p) mutable {
             if (!p->is_dummy_entry()) {
-                _tracker.on_erase();
+                _tracker.on_erase(*p);
             }
             deleter(p);
         });
     });
+    _tracker.unregister_table(*_schema);
 }
 
 void row_cache::clear_now() noexcept {
     with_allocator(_tracker.allocator(), [this] {
         auto it = _partitions.erase_and_dispose(_partitions.begin(), partitions_end(), [this, deleter = current_deleter<cache_entry>()] (auto&& p) mutable {
-            _tracker.on_erase();
+            _tracker.on_erase(*p);
             deleter(p);
         });
         _tracker.clear_continuity(*it);
     });
+    _tracker.drop_compressed(_schema->id());
 }
 
 template<typename CreateEntry, typename VisitEntry>
@@ -673,6 +1004,7 @@ cache_entry& row_cache::do_find_or_create_entry(const dht::decorated_key& key,
             return with_linearized_managed_bytes([&] () -> cache_entry& {
                 auto i = _partitions.lower_bound(key, cache_entry::compare(_schema));
                 if (i == _partitions.end() || !i->key().equal(*_schema, key)) {
+                    _tracker.erase_compressed(*_schema, key);
                     i = create_entry(i);
                 } else {
                     visit_entry(i);
@@ -695,10 +1027,12 @@ cache_entry& row_cache::do_find_or_create_entry(const dht::decorated_key& key,
     });
 }
 
-cache_entry& row_cache::find_or_create(const dht::decorated_key& key, tombstone t, row_cache::phase_type phase, const previous_entry_pointer* previous) {
+cache_entry& row_cache::find_or_create(const dht::decorated_key& key, tombstone t, row_cache::phase_type phase, const previous_entry_pointer* previous,
+                                       cache_tracker::cold cold) {
+    utils::task_context_guard task_ctx(utils::task_context::cache_population);
     return do_find_or_create_entry(key, previous, [&] (auto i) { // create
         auto entry = current_allocator().construct<cache_entry>(cache_entry::incomplete_tag{}, _schema, key, t);
-        _tracker.insert(*entry);
+        _tracker.insert(*entry, cold);
         return _partitions.insert(i, *entry);
     }, [&] (auto i) { // visit
         _tracker.on_miss_already_populated();
@@ -709,7 +1043,19 @@ cache_entry& row_cache::find_or_create(const dht::decorated_key& key, tombstone
     });
 }
 
+cache_entry& row_cache::promote(compressed_cache_entry& ce, partitions_type::iterator i) {
+    auto m = ce.decompress();
+    return with_allocator(_tracker.allocator(), [&] () -> cache_entry& {
+        cache_entry* entry = current_allocator().construct<cache_entry>(m.schema(), m.decorated_key(), m.partition());
+        upgrade_entry(*entry);
+        _tracker.erase_compressed(ce);
+        _tracker.insert(*entry);
+        return *_partitions.insert(i, *entry);
+    });
+}
+
 void row_cache::populate(const mutation& m, const previous_entry_pointer* previous) {
+  utils::task_context_guard task_ctx(utils::task_context::cache_population);
   _populate_section(_tracker.region(), [&] {
     do_find_or_create_entry(m.decorated_key(), previous, [&] (auto i) {
         cache_entry* entry = current_allocator().construct<cache_entry>(
@@ -857,12 +1203,16 @@ future<> row_cache::update(external_updater eu, memtable& m) {
             entry.partition().apply_to_incomplete(*_schema, std::move(mem_e.partition()), *mem_e.schema());
             _tracker.touch(entry);
             _tracker.on_merge();
-        } else if (cache_i->continuous() || is_present(mem_e.key()) == partition_presence_checker_result::definitely_doesnt_exist) {
-            cache_entry* entry = current_allocator().construct<cache_entry>(
-                mem_e.schema(), std::move(mem_e.key()), std::move(mem_e.partition()));
-            entry->set_continuous(cache_i->continuous());
-            _tracker.insert(*entry);
-            _partitions.insert(cache_i, *entry);
+        } else {
+            // A compressed partition would miss the write.
+            _tracker.erase_compressed(*_schema, mem_e.key());
+            if (cache_i->continuous() || is_present(mem_e.key()) == partition_presence_checker_result::definitely_doesnt_exist) {
+                cache_entry* entry = current_allocator().construct<cache_entry>(
+                    mem_e.schema(), std::move(mem_e.key()), std::move(mem_e.partition()));
+                entry->set_continuous(cache_i->continuous());
+                _tracker.insert(*entry);
+                _partitions.insert(cache_i, *entry);
+            }
         }
     });
 }
@@ -879,6 +1229,7 @@ future<> row_cache::update_invalidating(external_updater eu, memtable& m) {
             upgrade_entry(e);
             e.partition().apply_to_incomplete(*_schema, std::move(mem_e.partition()), *mem_e.schema());
         } else {
+            _tracker.erase_compressed(*_schema, mem_e.key());
             _tracker.clear_continuity(*cache_i);
         }
     });
@@ -902,11 +1253,12 @@ void row_cache::touch(const dht::decorated_key& dk) {
 void row_cache::invalidate_locked(const dht::decorated_key& dk) {
     auto pos = _partitions.lower_bound(dk, cache_entry::compare(_schema));
     if (pos == partitions_end() || !pos->key().equal(*_schema, dk)) {
+        _tracker.erase_compressed(*_schema, dk);
         _tracker.clear_continuity(*pos);
     } else {
         auto it = _partitions.erase_and_dispose(pos,
             [this, &dk, deleter = current_deleter<cache_entry>()](auto&& p) mutable {
-                _tracker.on_erase();
+                _tracker.on_erase(*p);
                 deleter(p);
             });
         _tracker.clear_continuity(*it);
@@ -942,11 +1294,12 @@ void row_cache::invalidate_unwrapped(const dht::partition_range& range) {
     logalloc::reclaim_lock _(_tracker.region());
 
     auto cmp = cache_entry::compare(_schema);
+    _tracker.erase_compressed(*_schema, dht::ring_position_view::for_range_start(range), dht::ring_position_view::for_range_end(range));
     auto begin = _partitions.lower_bound(dht::ring_position_view::for_range_start(range), cmp);
     auto end = _partitions.lower_bound(dht::ring_position_view::for_range_end(range), cmp);
     with_allocator(_tracker.allocator(), [this, begin, end] {
         auto it = _partitions.erase_and_dispose(begin, end, [this, deleter = current_deleter<cache_entry>()] (auto&& p) mutable {
-            _tracker.on_erase();
+            _tracker.on_erase(*p);
             deleter(p);
         });
         assert(it != _partitions.end());
@@ -961,6 +1314,7 @@ row_cache::row_cache(schema_ptr s, snapshot_source src, cache_tracker& tracker,
     , _underlying(src())
     , _snapshot_source(std::move(src))
 {
+    _tracker.register_table(*_schema);
     with_allocator(_tracker.allocator(), [this, cont] {
         cache_entry* entry = current_allocator().construct<cache_entry>(cache_entry::dummy_entry_tag());
         _partitions.insert(*entry);
@@ -993,8 +1347,55 @@ cache_entry::~cache_entry() {
     _pe.evict();
 }
 
+constexpr size_t compressed_cache_entry::max_uncompressed_size;
+
+compressed_cache_entry::compressed_cache_entry(compressed_cache_entry&& o) noexcept
+    : _schema(std::move(o._schema))
+    , _key(std::move(o._key))
+    , _data(std::move(o._data))
+    , _lru_link()
+    , _set_link()
+{
+    if (o._lru_link.is_linked()) {
+        auto prev = o._lru_link.prev_;
+        o._lru_link.unlink();
+        cache_tracker::compressed_lru_type::node_algorithms::link_after(prev, _lru_link.this_ptr());
+    }
+    if (o._set_link.is_linked()) {
+        using container_type = cache_tracker::compressed_set_type;
+        container_type::node_algorithms::replace_node(o._set_link.this_ptr(), _set_link.this_ptr());
+        container_type::node_algorithms::init(o._set_link.this_ptr());
+    }
+}
+
+bytes compressed_cache_entry::compress(const mutation& m) {
+    bytes_ostream out = freeze(m).representation();
+    auto in = out.linearize();
+    if (in.size() > max_uncompressed_size) {
+        return bytes();
+    }
+    bytes data(bytes::initialized_later(), compress_max_size_lz4(in.size()));
+    auto size = compress_lz4(reinterpret_cast<const char*>(in.begin()), in.size(), reinterpret_cast<char*>(data.begin()), data.size());
+    if (size >= in.size()) {
+        return bytes();
+    }
+    data.resize(size);
+    return data;
+}
+
+mutation compressed_cache_entry::decompress() const {
+    bytes_view in = _data;
+    auto size = read_le<uint32_t>(reinterpret_cast<const char*>(in.begin()));
+    bytes data(bytes::initialized_later(), size);
+    uncompress_lz4(reinterpret_cast<const char*>(in.begin()), in.size(), reinterpret_cast<char*>(data.begin()), data.size());
+    bytes_ostream out;
+    out.write(data);
+    return frozen_mutation(std::move(out)).unfreeze(_schema);
+}
+
 void row_cache::set_schema(schema_ptr new_schema) noexcept {
     _schema = std::move(new_schema);
+    _tracker.update_table_share(*_schema);
 }
 
 streamed_mutation cache_entry::read(row_cache& rc, read_context& reader) {
@@ -1011,7 +1412,13 @@ streamed_mutation cache_entry::read(row_cache& rc, read_context& reader,
 
 // Assumes reader is in the corresponding partition
 streamed_mutation cache_entry::do_read(row_cache& rc, read_context& reader) {
+    if (_pe.version_count() >= row_cache::max_partition_versions) {
+        _pe.squash_versions(_schema);
+        ++rc._stats.partition_version_squashes;
+    }
     auto snp = _pe.read(rc._tracker.region(), _schema, reader.phase());
+    ++rc._stats.partition_snapshots;
+    rc._stats.partition_snapshot_versions += snp->version_count();
     auto ckr = query::clustering_key_filter_ranges::get_ranges(*_schema, reader.slice(), _key.key());
     auto sm = make_cache_streamed_mutation(_schema, _key, std::move(ckr), rc, reader.shared_from_this(), std::move(snp));
     if (reader.schema()->version() != _schema->version()) {
@@ -23,6 +23,8 @@
 
 #include <boost/intrusive/list.hpp>
 #include <boost/intrusive/set.hpp>
+#include <unordered_map>
+#include <array>
 
 #include "core/memory.hh"
 #include <seastar/core/thread.hh>
@@ -34,6 +36,7 @@
 #include "utils/histogram.hh"
 #include "partition_version.hh"
 #include "utils/estimated_histogram.hh"
+#include "cache_admission_policy.hh"
 #include "tracing/trace_state.hh"
 #include <seastar/core/metrics_registration.hh>
 
@@ -62,7 +65,8 @@ class cache_entry {
     // _lru_link, but it's convenient to do so too. We may also want to have
     // multiple eviction spaces in the future and thus multiple LRUs.
     using lru_link_type = bi::list_member_hook<bi::link_mode<bi::auto_unlink>>;
-    using cache_link_type = bi::set_member_hook<bi::link_mode<bi::auto_unlink>>;
+    // optimize_size<> packs the node color into the parent pointer, saving a word per partition.
+    using cache_link_type = bi::set_member_hook<bi::link_mode<bi::auto_unlink>, bi::optimize_size<true>>;
 
     schema_ptr _schema;
     dht::decorated_key _key;
@@ -180,12 +184,86 @@ class cache_entry {
     friend std::ostream& operator<<(std::ostream&, cache_entry&);
 };
 
+// A cold partition taken off the LRU of cache_tracker, kept serialized and
+// compressed in the cache region instead of being evicted. Readers don't see
+// it: a single partition read which misses the cache promotes it back to a
+// cache_entry.
+//
+// Only fully continuous partitions are compressed, so the promoted entry is
+// complete. Compressed partitions are kept only for tables with a single
+// row_cache using the tracker, so they are identified by the table id.
+class compressed_cache_entry {
+    using lru_link_type = bi::list_member_hook<bi::link_mode<bi::auto_unlink>>;
+    using set_link_type = bi::set_member_hook<bi::link_mode<bi::auto_unlink>, bi::optimize_size<true>>;
+
+    schema_ptr _schema;
+    dht::decorated_key _key;
+    // The frozen_mutation of the partition, compressed with compress_lz4(),
+    // which prefixes it with its uncompressed size.
+    managed_bytes _data;
+    lru_link_type _lru_link;
+    set_link_type _set_link;
+public:
+    friend class cache_tracker;
+
+    // Partitions bigger than this when serialized are evicted as usual.
+    static constexpr size_t max_uncompressed_size = 128 * 1024;
+
+    struct key_view {
+        const utils::UUID& table;
+        dht::ring_position_view position;
+    };
+
+    compressed_cache_entry(schema_ptr s, const dht::decorated_key& key, bytes_view data)
+        : _schema(std::move(s))
+        , _key(key)
+        , _data(data)
+    { }
+    compressed_cache_entry(compressed_cache_entry&&) noexcept;
+
+    const schema_ptr& schema() const { return _schema; }
+    const dht::decorated_key& key() const { return _key; }
+    size_t compressed_size() const { return _data.size(); }
+
+    // Returns the compressed representation of the partition, or an empty
+    // one if it is too big, or doesn't compress.
+    static bytes compress(const mutation&);
+    // Returns the partition. Must be called with managed bytes linearized.
+    mutation decompress() const;
+
+    struct compare {
+        static int tri_compare(const utils::UUID& t1, dht::ring_position_view p1,
+                const utils::UUID& t2, dht::ring_position_view p2, const schema& s) {
+            if (t1 != t2) {
+                return t1 < t2 ? -1 : 1;
+            }
+            return dht::ring_position_comparator(s)(p1, p2);
+        }
+        bool operator()(const compressed_cache_entry& a, const compressed_cache_entry& b) const {
+            return tri_compare(a._schema->id(), a._key, b._schema->id(), b._key, *a._schema) < 0;
+        }
+        bool operator()(const key_view& a, const compressed_cache_entry& b) const {
+            return tri_compare(a.table, a.position, b._schema->id(), b._key, *b._schema) < 0;
+        }
+        bool operator()(const compressed_cache_entry& a, const key_view& b) const {
+            return tri_compare(a._schema->id(), a._key, b.table, b.position, *a._schema) < 0;
+        }
+    };
+};
+
 // Tracks accesses and performs eviction of cache entries.
 class cache_tracker final {
 public:
     using lru_type = bi::list<cache_entry,
         bi::member_hook<cache_entry, cache_entry::lru_link_type, &cache_entry::_lru_link>,
         bi::constant_time_size<false>>; // we need this to have bi::auto_unlink on hooks.
+    using compressed_lru_type = bi::list<compressed_cache_entry,
+        bi::member_hook<compressed_cache_entry, compressed_cache_entry::lru_link_type, &compressed_cache_entry::_lru_link>,
+        bi::constant_time_size<false>>;
+    using compressed_set_type = bi::set<compressed_cache_entry,
+        bi::member_hook<compressed_cache_entry, compressed_cache_entry::set_link_type, &compressed_cache_entry::_set_link>,
+        bi::constant_time_size<false>,
+        bi::compare<compressed_cache_entry::compare>>;
 public:
     friend class row_cache;
     friend class cache::read_context;
@@ -197,56 +275,159 @@ class cache_tracker final {
         uint64_t row_hits;
         uint64_t row_misses;
         uint64_t partition_insertions;
+        uint64_t cold_partition_insertions;
         uint64_t row_insertions;
         uint64_t concurrent_misses_same_key;
         uint64_t partition_merges;
         uint64_t partition_evictions;
+        uint64_t row_evictions;
         uint64_t partition_removals;
         uint64_t partitions;
         uint64_t mispopulations;
+        uint64_t admission_rejections;
         uint64_t underlying_recreations;
         uint64_t underlying_partition_skips;
         uint64_t underlying_row_skips;
         uint64_t reads;
         uint64_t reads_with_misses;
         uint64_t reads_done;
+        uint64_t partition_compressions;
+        uint64_t compressed_partition_hits;
+        uint64_t compressed_partition_evictions;
+        uint64_t compressed_partitions;
+        uint64_t compressed_bytes;
 
         uint64_t active_reads() const {
             return reads_done - reads;
         }
     };
+    // Partitions of a table in this cache, and its shares from caching_options.
+    struct table_share {
+        uint64_t partitions = 0;
+        double min_share = 0;
+        double max_share = 1;
+        unsigned caches = 0;
+    };
+    // How many of the least recently used entries eviction looks at to find one
+    // which the table shares allow to evict.
+    static constexpr unsigned max_victim_scan = 32;
+    // Eviction removes this many rows from the end of a victim with at
+    // least twice as many, instead of the whole partition, so that large
+    // partitions leave the cache gradually.
+    static constexpr size_t partial_eviction_rows = 256;
 private:
     stats _stats{};
     seastar::metrics::metric_groups _metrics;
     logalloc::region _region;
     lru_type _lru;
+    std::function<memory::reclaiming_result()> _secondary_evictor;
+    bool _evict_secondary_next = false;
+    std::unique_ptr<cache_admission_policy> _admission_policy;
+    std::unordered_map<utils::UUID, table_share> _table_shares;
+    bool _shares_enabled = false;
+    // The compressed tier. Its entries are all colder than those of _lru, and
+    // are evicted first.
+    compressed_lru_type _compressed_lru;
+    compressed_set_type _compressed;
+    double _compressed_fraction = 0;
+    logalloc::allocating_section _compress_section;
+    size_t _eviction_floor = 0;
 private:
-    void setup_metrics();
+    void setup_metrics(const sstring& group);
+    static uint64_t key_hash(const schema&, const dht::decorated_key&);
+    bool under_memory_pressure() const;
+    table_share* find_share(const schema&);
+    bool over_max_share(const table_share&) const;
+    bool under_min_share(const table_share&) const;
+    void update_shares_enabled();
+    // The entry to evict next: the least recently used one, unless that would
+    // take a table below its minimum share. Entries of tables above their
+    // maximum share are evicted first.
+    cache_entry& eviction_victim();
+    void erase_compressed(compressed_cache_entry&) noexcept;
+    // Drops the compressed partitions of the table.
+    void drop_compressed(const utils::UUID& table) noexcept;
 public:
-    cache_tracker();
+    // Cold entries are inserted at the end of the LRU, to be evicted first,
+    // unless they are touched before that.
+    using cold = bool_class<class cold_tag>;
+
+    cache_tracker() : cache_tracker("cache") { }
+    // The metrics of the tracker are in the given group.
+    explicit cache_tracker(const sstring& metrics_group);
     ~cache_tracker();
     void clear();
     void touch(cache_entry&);
-    void insert(cache_entry&);
+    void insert(cache_entry&, cold = cold::no);
     void clear_continuity(cache_entry& ce);
-    void on_erase();
+    void on_erase(const cache_entry&);
     void on_merge();
     void on_partition_hit();
     void on_partition_miss();
     void on_row_hit();
     void on_row_miss();
     void on_miss_already_populated();
+    void on_compressed_partition_hit();
     void on_mispopulate();
+    // Feeds the admission policy. Called for every partition looked up by a read.
+    void on_partition_access(const schema&, const dht::decorated_key&);
+    // Returns true if a partition missing in cache should be populated. When cache
+    // is under memory pressure, the admission policy compares the candidate with
+    // the partition which would be evicted next.
+    bool should_admit(const schema&, const dht::decorated_key&);
+    void set_admission_policy(std::unique_ptr<cache_admission_policy> policy) {
+        _admission_policy = std::move(policy);
+    }
+    // The compressed tier may hold up to this fraction of the memory of the
+    // cache region. Zero disables it.
+    void set_compressed_fraction(double fraction);
+    // Nothing is evicted while the cache region uses at most this much
+    // memory, and misses are always populated.
+    void set_eviction_floor(size_t bytes) {
+        _eviction_floor = bytes;
+    }
+    // Moves the least recently used partition to the compressed tier, if it's
+    // enabled and has room, and cache is under memory pressure.
+    // Erases a cache entry, so must not be called with references to entries held.
+    void compress_cold_partition() noexcept;
+    // Must be called with managed bytes linearized.
+    compressed_cache_entry* find_compressed(const schema&, const dht::decorated_key&);
+    // Erases the compressed partitions of the table in [start, end).
+    // Must be called with managed bytes linearized.
+    void erase_compressed(const schema&, dht::ring_position_view start, dht::ring_position_view end);
+    void erase_compressed(const schema&, const dht::decorated_key&);
     allocation_strategy& allocator();
     logalloc::region& region();
     const logalloc::region& region() const;
     uint64_t partitions() const { return _stats.partitions; }
     const stats& get_stats() const { return _stats; }
+    // Called by each row_cache of the table when created or when its schema changes.
+    void register_table(const schema&);
+    void update_table_share(const schema&) noexcept;
+    void unregister_table(const schema&) noexcept;
+    // Returns the number of partitions of the table in this cache.
+    uint64_t table_partitions(const utils::UUID& table_id) const;
+    // Returns the table ids and keys of up to max most recently used partitions,
+    // most recently used first.
+    std::vector<std::pair<utils::UUID, partition_key>> hottest_partitions(size_t max);
+    // Registers the evictor of another cache which allocates in region(), like
+    // the sstable index page cache. It is invoked with the region's allocator,
+    // alternately with partition eviction, so that both caches shrink under
+    // memory pressure. Pass an empty function to unregister.
+    void set_secondary_evictor(std::function<memory::reclaiming_result()> evictor) {
+        _secondary_evictor = std::move(evictor);
+    }
 };
 
 // Returns a reference to shard-wide cache_tracker.
 cache_tracker& global_cache_tracker();
 
+// Returns a reference to the shard-wide cache_tracker of the tables with the
+// in_memory caching option. Its eviction floor is the memory budget of these
+// tables, so that other tables can't evict their data, and they can't evict
+// the data of other tables.
+cache_tracker& in_memory_cache_tracker();
+
 //
 // A data source which wraps another data source such that data obtained from the underlying data source
 // is cached in-memory in order to serve queries faster.
@@ -281,12 +462,26 @@ class row_cache final {
     // must be left in the state in which it was before the call.
     using external_updater = std::function<void()>;
 public:
+    // The ring is split in this many ranges, the same on all nodes, for
+    // which hit rates are kept apart.
+    static constexpr unsigned hit_rate_ranges = 16;
     struct stats {
         utils::timed_rate_moving_average hits;
         utils::timed_rate_moving_average misses;
         utils::timed_rate_moving_average reads_with_misses;
         utils::timed_rate_moving_average reads_with_no_misses;
+        // Single partition reads, by the range of the ring of their key.
+        std::array<uint64_t, hit_rate_ranges> range_reads_with_misses{};
+        std::array<uint64_t, hit_rate_ranges> range_reads_with_no_misses{};
+        // Snapshots taken by reads, and the versions of the partitions they read.
+        uint64_t partition_snapshots = 0;
+        uint64_t partition_snapshot_versions = 0;
+        uint64_t partition_version_squashes = 0;
     };
+    // Reads of a partition with this many versions squash them first, so
+    // that reads of partitions written to while long reads keep their old
+    // versions don't merge ever more of them.
+    static constexpr unsigned max_partition_versions = 8;
 private:
     cache_tracker& _tracker;
     stats _stats{};
@@ -372,9 +567,17 @@ class row_cache final {
     //
     // Since currently every entry has to have a complete tombstone, it has to be provided here.
     // The entry which is returned will have the tombstone applied to it.
+    // An entry which is created is inserted cold, when asked to be.
+    //
+    // Must be run under reclaim lock
+    cache_entry& find_or_create(const dht::decorated_key& key, tombstone t, row_cache::phase_type phase, const previous_entry_pointer* previous = nullptr,
+                                cache_tracker::cold cold = cache_tracker::cold::no);
+
+    // Replaces the compressed partition with a cache entry inserted before i,
+    // which must be the lower bound of its key.
     //
     // Must be run under reclaim lock
-    cache_entry& find_or_create(const dht::decorated_key& key, tombstone t, row_cache::phase_type phase, const previous_entry_pointer* previous = nullptr);
+    cache_entry& promote(compressed_cache_entry&, partitions_type::iterator i);
 
     partitions_type::iterator partitions_end() {
         return std::prev(_partitions.end());
@@ -93,6 +93,17 @@ struct container_traits<std::vector<T>> {
     }
 };
 
+template<typename T>
+struct container_traits<utils::chunked_vector<T>> {
+    struct back_emplacer {
+        utils::chunked_vector<T>& c;
+        back_emplacer(utils::chunked_vector<T>& c_) : c(c_) {}
+        void operator()(T&& v) {
+            c.emplace_back(std::move(v));
+        }
+    };
+};
+
 template<typename T, size_t N>
 struct container_traits<std::array<T, N>> {
     struct back_emplacer {
@@ -172,6 +183,30 @@ struct serializer<std::vector<T>> {
     }
 };
 
+// Same format as std::vector, for sequences which can be too large for
+// a contiguous allocation.
+template<typename T>
+struct serializer<utils::chunked_vector<T>> {
+    template<typename Input>
+    static utils::chunked_vector<T> read(Input& in) {
+        auto sz = deserialize(in, boost::type<uint32_t>());
+        utils::chunked_vector<T> v;
+        v.reserve(sz);
+        deserialize_array_helper<false, T>::doit(in, v, sz);
+        return v;
+    }
+    template<typename Output>
+    static void write(Output& out, const utils::chunked_vector<T>& v) {
+        safe_serialize_as_uint32(out, v.size());
+        serialize_array_helper<false, T>::doit(out, v);
+    }
+    template<typename Input>
+    static void skip(Input& in) {
+        auto sz = deserialize(in, boost::type<uint32_t>());
+        skip_array<T>(in, sz);
+    }
+};
+
 template<typename T, typename Ratio>
 struct serializer<std::chrono::duration<T, Ratio>> {
     template<typename Input>
@@ -280,6 +315,17 @@ class deserialized_bytes_proxy {
     explicit deserialized_bytes_proxy(seastar::memory_input_stream<Iterator> stream)
         : _stream(std::move(stream)) { }
 
+    size_t size() const {
+        return _stream.size();
+    }
+
+    // Copies the bytes to out, which has room for size() of them, so that
+    // they can be read without allocating.
+    [[gnu::always_inline]]
+    void copy_to(bytes::iterator out) && {
+        _stream.read(reinterpret_cast<char*>(out), _stream.size());
+    }
+
     [[gnu::always_inline]]
     operator bytes() && {
         bytes v(bytes::initialized_later(), _stream.size());
@@ -71,6 +71,16 @@ future<> service::client_state::check_user_exists() {
     });
 }
 
+future<> service::client_state::load_service_level() {
+    if (_user->is_anonymous()) {
+        return make_ready_future();
+    }
+
+    return auth::auth::get_service_level(_user->name()).then([this] (sstring service_level) {
+        _service_level = std::move(service_level);
+    });
+}
+
 void service::client_state::validate_login() const {
     if (!_user) {
         throw exceptions::unauthorized_exception("You have not logged in");
@@ -90,6 +100,7 @@ void service::client_state::merge(const client_state& other) {
     }
     if (_user == nullptr) {
         _user = other._user;
+        _service_level = other._service_level;
     }
     _last_timestamp_micros = std::max(_last_timestamp_micros, other._last_timestamp_micros);
 }
@@ -99,6 +99,9 @@ class client_state {
     // Address of a client
     socket_address _remote_address;
 
+    // Of the logged in user, for the scheduling of their queries.
+    sstring _service_level;
+
 public:
     struct internal_tag {};
     struct external_tag {};
@@ -231,6 +234,15 @@ class client_state {
      */
     future<> check_user_exists();
 
+    /**
+     * Fetches the service level of the logged in user.
+     */
+    future<> load_service_level();
+
+    const sstring& get_service_level() const {
+        return _service_level;
+    }
+
     future<> has_all_keyspaces_access(auth::permission) const;
     future<> has_keyspace_access(const sstring&, auth::permission) const;
     future<> has_column_family_access(const sstring&, const sstring&, auth::permission) const;
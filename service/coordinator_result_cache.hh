@@ -0,0 +1,172 @@
+/*
+ * Copyright (C) 2018 ScyllaDB
+ */
+
+/*
+ * This file is part of Scylla.
+ *
+ * Scylla is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Scylla is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <list>
+#include <unordered_map>
+#include <vector>
+#include <seastar/core/shared_ptr.hh>
+#include <seastar/core/lowres_clock.hh>
+#include "bytes.hh"
+#include "dht/i_partitioner.hh"
+#include "query-result.hh"
+#include "utils/UUID.hh"
+
+namespace service {
+
+/*
+ * Results of the reads coordinated by this shard, of the tables which opt in
+ * with the coordinator_ttl_ms caching option, given again to the same reads
+ * for that long without asking any replica.
+ *
+ * Only single partition reads at CL ONE and LOCAL_ONE are cached, keyed by
+ * all of the read command which affects its result, i.e. the statement and
+ * its bound values. Writes coordinated by this shard drop the results of the
+ * partitions they write to, as do reads which were in flight during such a
+ * write. Writes coordinated elsewhere may not be seen by cached reads for up
+ * to the TTL; replicas answering a CL ONE read may miss them as well.
+ *
+ * The cache is bounded by memory and drops the least recently used results
+ * first.
+ */
+class coordinator_result_cache {
+public:
+    using clock = lowres_clock;
+    struct stats {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        uint64_t invalidations = 0;
+        uint64_t evictions = 0;
+    };
+private:
+    struct entry {
+        bytes key;
+        utils::UUID table;
+        std::vector<dht::token> tokens;
+        lw_shared_ptr<query::result> result;
+        clock::time_point expiry;
+        size_t memory;
+    };
+    using lru_type = std::list<entry>;
+    // Least recently used first.
+    lru_type _lru;
+    // Keyed by views of entry::key.
+    std::unordered_map<bytes_view, lru_type::iterator> _index;
+    std::unordered_map<utils::UUID, unsigned> _table_entries;
+    size_t _memory = 0;
+    size_t _max_memory;
+    // Advanced by each invalidation, so that the results of the reads which
+    // were in flight meanwhile aren't cached.
+    uint64_t _generation = 0;
+    stats _stats;
+private:
+    void erase(lru_type::iterator it) {
+        _index.erase(bytes_view(it->key));
+        if (!--_table_entries[it->table]) {
+            _table_entries.erase(it->table);
+        }
+        _memory -= it->memory;
+        _lru.erase(it);
+    }
+public:
+    explicit coordinator_result_cache(size_t max_memory) : _max_memory(max_memory) { }
+
+    uint64_t generation() const {
+        return _generation;
+    }
+
+    lw_shared_ptr<query::result> get(const bytes& key, clock::time_point now = clock::now()) {
+        auto it = _index.find(bytes_view(key));
+        if (it == _index.end()) {
+            ++_stats.misses;
+            return { };
+        }
+        auto e = it->second;
+        if (e->expiry <= now) {
+            erase(e);
+            ++_stats.misses;
+            return { };
+        }
+        _lru.splice(_lru.end(), _lru, e);
+        ++_stats.hits;
+        return e->result;
+    }
+
+    // The result of a read of the given partitions of the table, which
+    // started when the cache was at the given generation.
+    void put(bytes key, const utils::UUID& table, std::vector<dht::token> tokens, lw_shared_ptr<query::result> result,
+            clock::duration ttl, uint64_t generation, clock::time_point now = clock::now()) {
+        if (generation != _generation) {
+            return;
+        }
+        auto memory = sizeof(entry) + 2 * key.size() + tokens.size() * sizeof(dht::token) + result->buf().size();
+        // A few large results would flush all the others.
+        if (memory > _max_memory / 8) {
+            return;
+        }
+        auto it = _index.find(bytes_view(key));
+        if (it != _index.end()) {
+            erase(it->second);
+        }
+        _lru.push_back(entry{std::move(key), table, std::move(tokens), std::move(result), now + ttl, memory});
+        auto e = std::prev(_lru.end());
+        _index.emplace(bytes_view(e->key), e);
+        ++_table_entries[table];
+        _memory += memory;
+        while (_memory > _max_memory) {
+            erase(_lru.begin());
+            ++_stats.evictions;
+        }
+    }
+
+    // Called for each write to a table which caches results. Such tables are
+    // rarely written to, so the entries are looked through.
+    void invalidate(const utils::UUID& table, const dht::token& token) {
+        ++_generation;
+        if (!_table_entries.count(table)) {
+            return;
+        }
+        for (auto it = _lru.begin(); it != _lru.end();) {
+            auto next = std::next(it);
+            if (it->table == table && std::find(it->tokens.begin(), it->tokens.end(), token) != it->tokens.end()) {
+                erase(it);
+                ++_stats.invalidations;
+            }
+            it = next;
+        }
+    }
+
+    size_t size() const {
+        return _lru.size();
+    }
+
+    size_t memory() const {
+        return _memory;
+    }
+
+    const stats& get_stats() const {
+        return _stats;
+    }
+};
+
+}
@@ -48,11 +48,23 @@
 #include "service/migration_task.hh"
 #include "utils/runtime.hh"
 #include "gms/gossiper.hh"
+#include <seastar/core/metrics.hh>
 
 namespace service {
 
 static logging::logger mlogger("migration_manager");
 
+struct schema_pull_stats {
+    // GET_SCHEMA_VERSION requests sent by this shard, for all shards.
+    uint64_t pulls = 0;
+    // Unknown versions this shard waited for, and for how long, in
+    // microseconds.
+    uint64_t waits = 0;
+    uint64_t wait_time = 0;
+};
+
+static thread_local schema_pull_stats pull_stats;
+
 distributed<service::migration_manager> _the_migration_manager;
 
 using namespace std::chrono_literals;
@@ -62,6 +74,19 @@ const std::chrono::milliseconds migration_manager::migration_delay = 60000ms;
 migration_manager::migration_manager()
     : _listeners{}
 {
+    setup_metrics();
+}
+
+void migration_manager::setup_metrics() {
+    namespace sm = seastar::metrics;
+    _metrics.add_group("migration_manager", {
+        sm::make_derive("schema_pulls", [] { return pull_stats.pulls; },
+                        sm::description("Number of schema versions requested from other nodes by this shard.")),
+        sm::make_derive("schema_pull_waits", [] { return pull_stats.waits; },
+                        sm::description("Number of requests of unknown schema versions which waited for their definition.")),
+        sm::make_derive("schema_pull_wait_time", [] { return pull_stats.wait_time; },
+                        sm::description("Total microseconds requests of unknown schema versions waited for their definition.")),
+    });
 }
 
 future<> migration_manager::stop()
@@ -928,11 +953,39 @@ static future<> maybe_sync(const schema_ptr& s, netw::messaging_service::msg_add
     });
 }
 
+// Each version is pulled by a single shard, so that the requests for it of
+// all shards wait for one GET_SCHEMA_VERSION, coalesced by the registry of
+// that shard, which may also know the version already.
+static unsigned schema_pull_shard(table_schema_version v) {
+    return std::hash<table_schema_version>()(v) % smp::count;
+}
+
+static future<frozen_schema> pull_schema_definition(table_schema_version v, netw::messaging_service::msg_addr dst) {
+    mlogger.debug("Requesting schema {} from {}", v, dst);
+    ++pull_stats.pulls;
+    auto& ms = netw::get_local_messaging_service();
+    return ms.send_get_schema_version(dst, v);
+}
+
 future<schema_ptr> get_schema_definition(table_schema_version v, netw::messaging_service::msg_addr dst) {
     return local_schema_registry().get_or_load(v, [dst] (table_schema_version v) {
-        mlogger.debug("Requesting schema {} from {}", v, dst);
-        auto& ms = netw::get_local_messaging_service();
-        return ms.send_get_schema_version(dst, v);
+        auto start = std::chrono::steady_clock::now();
+        ++pull_stats.waits;
+        auto f = [&] {
+            auto shard = schema_pull_shard(v);
+            if (shard == engine().cpu_id()) {
+                return pull_schema_definition(v, dst);
+            }
+            return smp::submit_to(shard, [v, dst] {
+                return get_schema_definition(v, dst).then([] (schema_ptr s) {
+                    return s->registry_entry()->frozen();
+                });
+            });
+        }();
+        return f.finally([start] {
+            auto waited = std::chrono::steady_clock::now() - start;
+            pull_stats.wait_time += std::chrono::duration_cast<std::chrono::microseconds>(waited).count();
+        });
     });
 }
 
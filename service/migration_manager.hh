@@ -49,6 +49,7 @@
 #include "message/messaging_service.hh"
 #include "utils/UUID.hh"
 #include "utils/serialized_action.hh"
+#include <seastar/core/metrics_registration.hh>
 
 #include <vector>
 
@@ -58,6 +59,8 @@ class migration_manager : public seastar::async_sharded_service<migration_manage
     std::vector<migration_listener*> _listeners;
     std::unordered_map<netw::messaging_service::msg_addr, serialized_action, netw::messaging_service::msg_addr::hash> _schema_pulls;
     static const std::chrono::milliseconds migration_delay;
+    seastar::metrics::metric_groups _metrics;
+    void setup_metrics();
 public:
     migration_manager();
 
@@ -59,11 +59,7 @@ void load_broadcaster::start_broadcasting() {
     _timer.set_callback([this] {
         llogger.debug("Disseminating load info ...");
         _done = _db.map_reduce0([](database& db) {
-            int64_t res = 0;
-            for (auto i : db.get_column_families()) {
-                res += i.second->get_stats().live_disk_space_used;
-            }
-            return res;
+            return db.get_cf_stats().live_disk_space_used;
         }, int64_t(0), std::plus<int64_t>()).then([this] (int64_t size) {
             gms::versioned_value::factory value_factory;
             return _gossiper.add_local_application_state(gms::application_state::LOAD,
@@ -108,13 +104,40 @@ void cache_hitrate_calculator::run_on(size_t master, lowres_clock::duration d) {
     }
 }
 
+// The hit rates of cf in each range of the ring, from the reads of all
+// shards since they were last computed, averaged with the last ones so that
+// a few reads don't swing them. The ranges not read since keep their rate.
+// All shards compute the same rates, from the same reads.
+static column_family::range_cache_hit_rates range_hit_rates(const column_family& cf, const column_family::range_cache_reads_array& reads) {
+    auto rates = cf.get_range_cache_hit_rates();
+    auto& last_reads = cf.get_range_cache_reads();
+    for (unsigned i = 0; i < rates.size(); i++) {
+        auto hits = reads[i].hits - std::min(reads[i].hits, last_reads[i].hits);
+        auto misses = reads[i].misses - std::min(reads[i].misses, last_reads[i].misses);
+        if (!hits && !misses) {
+            continue;
+        }
+        auto rate = float(hits) / (hits + misses);
+        if (float(rates[i]) >= 0) {
+            rate = (rate + float(rates[i])) / 2;
+        }
+        rates[i] = cache_temperature(rate);
+    }
+    return rates;
+}
+
 future<lowres_clock::duration> cache_hitrate_calculator::recalculate_hitrates() {
     struct stat {
         float h = 0;
         float m = 0;
+        column_family::range_cache_reads_array ranges;
         stat& operator+=(stat& o) {
             h += o.h;
             m += o.m;
+            for (unsigned i = 0; i < ranges.size(); i++) {
+                ranges[i].hits += o.ranges[i].hits;
+                ranges[i].misses += o.ranges[i].misses;
+            }
             return *this;
         }
     };
@@ -127,7 +150,12 @@ future<lowres_clock::duration> cache_hitrate_calculator::recalculate_hitrates()
         return boost::copy_range<std::unordered_map<utils::UUID, stat>>(db.get_column_families() | boost::adaptors::filtered(non_system_filter) |
                 boost::adaptors::transformed([]  (const std::pair<utils::UUID, lw_shared_ptr<column_family>>& cf) {
             auto& stats = cf.second->get_row_cache().stats();
-            return std::make_pair(cf.first, stat{float(stats.reads_with_no_misses.rate().rates[0]), float(stats.reads_with_misses.rate().rates[0])});
+            stat st{float(stats.reads_with_no_misses.rate().rates[0]), float(stats.reads_with_misses.rate().rates[0])};
+            for (unsigned i = 0; i < st.ranges.size(); i++) {
+                st.ranges[i].hits = stats.range_reads_with_no_misses[i];
+                st.ranges[i].misses = stats.range_reads_with_misses[i];
+            }
+            return std::make_pair(cf.first, st);
         }));
     };
 
@@ -152,9 +180,12 @@ future<lowres_clock::duration> cache_hitrate_calculator::recalculate_hitrates()
                 if (engine().cpu_id() == cpuid) {
                     // calculate max difference between old rate and new one for all cfs
                     _diff = std::max(_diff, std::abs(float(cf.second->get_global_cache_hit_rate()) - rate));
-                    gstate += sprint("%s.%s:%f;", cf.second->schema()->ks_name(), cf.second->schema()->cf_name(), rate);
                 }
                 cf.second->set_global_cache_hit_rate(cache_temperature(rate));
+                cf.second->set_range_cache_hit_rates(range_hit_rates(*cf.second, s.ranges), s.ranges);
+                if (engine().cpu_id() == cpuid) {
+                    gstate += cf.second->gossiped_cache_hit_rates();
+                }
             }
             if (gstate.size()) {
                 auto& g = gms::get_local_gossiper();
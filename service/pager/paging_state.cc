@@ -51,8 +51,9 @@
 #include "message/messaging_service.hh"
 
 service::pager::paging_state::paging_state(partition_key pk, std::experimental::optional<clustering_key> ck,
-        uint32_t rem)
-        : _partition_key(std::move(pk)), _clustering_key(std::move(ck)), _remaining(rem) {
+        uint32_t rem, uint32_t rem_in_partition, utils::UUID query_uuid)
+        : _partition_key(std::move(pk)), _clustering_key(std::move(ck)), _remaining(rem), _remaining_in_partition(rem_in_partition)
+        , _query_uuid(query_uuid) {
 }
 
 ::shared_ptr<service::pager::paging_state> service::pager::paging_state::deserialize(
@@ -42,9 +42,11 @@
 #pragma once
 
 #include <experimental/optional>
+#include <limits>
 
 #include "bytes.hh"
 #include "keys.hh"
+#include "utils/UUID.hh"
 
 namespace service {
 
@@ -54,9 +56,12 @@ class paging_state final {
     partition_key _partition_key;
     std::experimental::optional<clustering_key> _clustering_key;
     uint32_t _remaining;
+    uint32_t _remaining_in_partition;
+    utils::UUID _query_uuid;
 
 public:
-    paging_state(partition_key pk, std::experimental::optional<clustering_key> ck, uint32_t rem);
+    paging_state(partition_key pk, std::experimental::optional<clustering_key> ck, uint32_t rem,
+            uint32_t rem_in_partition = std::numeric_limits<uint32_t>::max(), utils::UUID query_uuid = utils::UUID());
 
     /**
      * Last processed key, i.e. where to start from in next paging round
@@ -77,6 +82,20 @@ class paging_state final {
     uint32_t get_remaining() const {
         return _remaining;
     }
+    /**
+     * Max remaining rows to fetch from the last processed partition,
+     * when the query has a PER PARTITION LIMIT.
+     */
+    uint32_t get_remaining_in_partition() const {
+        return _remaining_in_partition;
+    }
+    /**
+     * Identifies the pages of the query to the replicas, see
+     * query::read_command::query_uuid.
+     */
+    utils::UUID get_query_uuid() const {
+        return _query_uuid;
+    }
 
     static ::shared_ptr<paging_state> deserialize(bytes_opt bytes);
     bytes_opt serialize() const;
@@ -65,6 +65,47 @@ class service::pager::query_pagers::impl : public query_pager {
     {}
 
 private:
+    class myvisitor : public cql3::selection::result_set_builder::visitor {
+    public:
+        uint32_t total_rows = 0;
+        uint32_t last_partition_rows = 0;
+        std::experimental::optional<partition_key> last_pkey;
+        std::experimental::optional<clustering_key> last_ckey;
+
+        myvisitor(cql3::selection::result_set_builder& builder,
+                const schema& s,
+                const cql3::selection::selection& selection)
+                : visitor(builder, s, selection) {
+        }
+
+        void accept_new_partition(uint32_t) {
+            throw std::logic_error("Should not reach!");
+        }
+        void accept_new_partition(const partition_key& key, uint32_t row_count) {
+            qlogger.trace("Accepting partition: {} ({})", key, row_count);
+            total_rows += std::max(row_count, 1u);
+            last_pkey = key;
+            last_ckey = { };
+            last_partition_rows = 0;
+            visitor::accept_new_partition(key, row_count);
+        }
+        void accept_new_row(const clustering_key& key,
+                const query::result_row_view& static_row,
+                const query::result_row_view& row) {
+            last_ckey = key;
+            ++last_partition_rows;
+            visitor::accept_new_row(key, static_row, row);
+        }
+        void accept_new_row(const query::result_row_view& static_row,
+                const query::result_row_view& row) {
+            ++last_partition_rows;
+            visitor::accept_new_row(static_row, row);
+        }
+        void accept_partition_end(const query::result_row_view& static_row) {
+            visitor::accept_partition_end(static_row);
+        }
+    };
+
     static bool has_clustering_keys(const schema& s, const query::read_command& cmd) {
         return s.clustering_key_size() > 0
                && !cmd.slice.options.contains<query::partition_slice::option::distinct>();
@@ -77,7 +118,21 @@ class service::pager::query_pagers::impl : public query_pager {
             _max = state->get_remaining();
             _last_pkey = state->get_partition_key();
             _last_ckey = state->get_clustering_key();
+            _remaining_in_partition = state->get_remaining_in_partition();
+            _query_uuid = state->get_query_uuid();
+        }
+
+        // Replicas keep the readers of the pages of the query under this id,
+        // to continue them with the next page.
+        _cmd->is_first_page = _query_uuid == utils::UUID();
+        if (_cmd->is_first_page) {
+            _query_uuid = utils::make_random_uuid();
         }
+        _cmd->query_uuid = _query_uuid;
+
+        // Set when the previous page ended inside a partition which hasn't yet
+        // returned all the rows its PER PARTITION LIMIT allows.
+        std::experimental::optional<uint32_t> remainder_limit;
 
         if (_last_pkey) {
             auto dpk = dht::global_partitioner().decorate_key(*_schema, *_last_pkey);
@@ -171,7 +226,18 @@ class service::pager::query_pagers::impl : public query_pager {
             // last ck can be empty depending on whether we
             // deserialized state or not. This case means "last page ended on
             // something-not-bound-by-clustering" (i.e. a static row, alone)
-            const bool has_ck = _has_clustering_keys && _last_ckey;
+            bool has_ck = _has_clustering_keys && _last_ckey;
+
+            auto partition_row_limit = _cmd->slice.partition_row_limit();
+            if (has_ck && partition_row_limit != query::max_rows) {
+                auto remaining = std::min(_remaining_in_partition, partition_row_limit);
+                if (remaining == 0) {
+                    // The last partition is done, continue with the next one.
+                    has_ck = false;
+                } else {
+                    remainder_limit = remaining;
+                }
+            }
 
             // If we have no clustering keys, it should mean we only have one row
             // per PK. Thus we can just bypass the last one.
@@ -201,6 +267,10 @@ class service::pager::query_pagers::impl : public query_pager {
                 _cmd->cf_id, page_size, max_rows
                 );
 
+        if (remainder_limit) {
+            return fetch_partition_remainder(builder, page_size, max_rows, *remainder_limit, now);
+        }
+
         auto ranges = _ranges;
         auto command = ::make_lw_shared<query::read_command>(*_cmd);
         return get_local_storage_proxy().query(_schema, std::move(command), std::move(ranges),
@@ -210,6 +280,45 @@ class service::pager::query_pagers::impl : public query_pager {
                 });
     }
 
+    // Reads the rest of the last partition, which may return at most
+    // remaining more rows, then goes on with the next partitions if the
+    // page isn't full yet.
+    future<> fetch_partition_remainder(cql3::selection::result_set_builder& builder, uint32_t page_size, uint32_t max_rows,
+            uint32_t remaining, gc_clock::time_point now) {
+        auto command = ::make_lw_shared<query::read_command>(*_cmd);
+        command->slice.set_partition_row_limit(remaining);
+        auto dpk = dht::global_partitioner().decorate_key(*_schema, *_last_pkey);
+        dht::partition_range_vector ranges{ dht::partition_range::make_singular(std::move(dpk)) };
+
+        qlogger.trace("Fetching at most {} remaining rows of {}", remaining, *_last_pkey);
+
+        return get_local_storage_proxy().query(_schema, std::move(command), std::move(ranges),
+                _options.get_consistency(), _state.get_trace_state()).then(
+                [this, &builder, page_size, max_rows, remaining, now] (foreign_ptr<lw_shared_ptr<query::result>> results) {
+            myvisitor v(builder, *_schema, *_selection);
+            query::result_view::consume(*results, _cmd->slice, v);
+            _cmd->slice.clear_range(*_schema, *_last_pkey);
+
+            _max = _max - v.total_rows;
+            if (v.last_ckey) {
+                _last_ckey = v.last_ckey;
+            }
+            _remaining_in_partition = remaining - std::min(v.last_partition_rows, remaining);
+            if (v.total_rows < std::min(max_rows, remaining) && !results->is_short_read()) {
+                // Nothing more in this partition.
+                _remaining_in_partition = 0;
+            }
+            _exhausted = _max == 0;
+
+            qlogger.debug("Fetched {} remaining rows of the last partition, max_remain={} {}", v.total_rows, _max, _exhausted ? "(exh)" : "");
+
+            if (_exhausted || _remaining_in_partition || results->is_short_read() || v.total_rows >= page_size) {
+                return make_ready_future<>();
+            }
+            return this->fetch_page(builder, page_size - v.total_rows, now);
+        });
+    }
+
     future<std::unique_ptr<cql3::result_set>> fetch_page(uint32_t page_size,
             gc_clock::time_point now) override {
         return do_with(
@@ -227,43 +336,6 @@ class service::pager::query_pagers::impl : public query_pager {
             foreign_ptr<lw_shared_ptr<query::result>> results,
             uint32_t page_size, gc_clock::time_point now) {
 
-        class myvisitor : public cql3::selection::result_set_builder::visitor {
-        public:
-            uint32_t total_rows = 0;
-            std::experimental::optional<partition_key> last_pkey;
-            std::experimental::optional<clustering_key> last_ckey;
-
-            myvisitor(cql3::selection::result_set_builder& builder,
-                    const schema& s,
-                    const cql3::selection::selection& selection)
-                    : visitor(builder, s, selection) {
-            }
-
-            void accept_new_partition(uint32_t) {
-                throw std::logic_error("Should not reach!");
-            }
-            void accept_new_partition(const partition_key& key, uint32_t row_count) {
-                qlogger.trace("Accepting partition: {} ({})", key, row_count);
-                total_rows += std::max(row_count, 1u);
-                last_pkey = key;
-                last_ckey = { };
-                visitor::accept_new_partition(key, row_count);
-            }
-            void accept_new_row(const clustering_key& key,
-                    const query::result_row_view& static_row,
-                    const query::result_row_view& row) {
-                last_ckey = key;
-                visitor::accept_new_row(key, static_row, row);
-            }
-            void accept_new_row(const query::result_row_view& static_row,
-                    const query::result_row_view& row) {
-                visitor::accept_new_row(static_row, row);
-            }
-            void accept_partition_end(const query::result_row_view& static_row) {
-                visitor::accept_partition_end(static_row);
-            }
-        };
-
         myvisitor v(builder, *_schema, *_selection);
         query::result_view::consume(*results, _cmd->slice, v);
 
@@ -280,6 +352,8 @@ class service::pager::query_pagers::impl : public query_pager {
         _exhausted = (v.total_rows < page_size && !results->is_short_read()) || _max == 0;
         _last_pkey = v.last_pkey;
         _last_ckey = v.last_ckey;
+        auto partition_row_limit = _cmd->slice.partition_row_limit();
+        _remaining_in_partition = partition_row_limit - std::min(v.last_partition_rows, partition_row_limit);
 
         qlogger.debug("Fetched {} rows, max_remain={} {}", v.total_rows, _max, _exhausted ? "(exh)" : "");
 
@@ -303,7 +377,7 @@ class service::pager::query_pagers::impl : public query_pager {
         return _exhausted ?
                         nullptr :
                         ::make_shared<const paging_state>(*_last_pkey,
-                                        _last_ckey, _max);
+                                        _last_ckey, _max, _remaining_in_partition, _query_uuid);
     }
 
 private:
@@ -311,6 +385,8 @@ class service::pager::query_pagers::impl : public query_pager {
     const bool _has_clustering_keys;
     bool _exhausted = false;
     uint32_t _max;
+    uint32_t _remaining_in_partition = query::max_rows;
+    utils::UUID _query_uuid;
 
     std::experimental::optional<partition_key> _last_pkey;
     std::experimental::optional<clustering_key> _last_ckey;
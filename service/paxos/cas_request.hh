@@ -0,0 +1,49 @@
+/*
+ * Copyright (C) 2018 ScyllaDB
+ */
+
+/*
+ * This file is part of Scylla.
+ *
+ * Scylla is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Scylla is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <experimental/optional>
+#include "mutation.hh"
+#include "query-request.hh"
+#include "query-result.hh"
+
+namespace service {
+
+namespace paxos {
+
+// The compare-and-set of storage_proxy::cas().
+class cas_request {
+public:
+    virtual ~cas_request() = default;
+    // Given the partition as read by the command passed to cas(), returns
+    // the update to make, with all its cells written at the timestamp ts, or
+    // nothing when the conditions of the request don't hold.
+    //
+    // May be called more than once, for each Paxos round the coordinator
+    // needs; the last call is the one which counts.
+    virtual std::experimental::optional<mutation> apply(const query::result& qr, const query::partition_slice& slice,
+            api::timestamp_type ts) = 0;
+};
+
+}
+
+}
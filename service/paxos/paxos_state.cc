@@ -0,0 +1,124 @@
+/*
+ * Copyright (C) 2018 ScyllaDB
+ */
+
+/*
+ * This file is part of Scylla.
+ *
+ * Scylla is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Scylla is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <unordered_map>
+#include "core/semaphore.hh"
+#include "service/paxos/paxos_state.hh"
+#include "service/storage_proxy.hh"
+#include "db/system_keyspace.hh"
+#include "dht/i_partitioner.hh"
+#include "log.hh"
+
+namespace service {
+
+namespace paxos {
+
+static logging::logger paxos_logger("paxos");
+
+// Serializes the Paxos steps of the partitions of the shard. Partitions
+// are told apart by token only, so colliding ones wait for each other,
+// which is harmless.
+class key_lock_map {
+    std::unordered_map<dht::token, semaphore> _locks;
+public:
+    template <typename Func>
+    futurize_t<std::result_of_t<Func()>> with_locked_key(const dht::token& key, Func&& func) {
+        auto& sem = _locks.emplace(key, 1).first->second;
+        return with_semaphore(sem, 1, std::forward<Func>(func)).finally([this, key] {
+            auto it = _locks.find(key);
+            if (it != _locks.end() && it->second.current() == 1 && !it->second.waiters()) {
+                _locks.erase(it);
+            }
+        });
+    }
+};
+
+static thread_local key_lock_map paxos_locks;
+
+future<prepare_response> paxos_state::prepare(tracing::trace_state_ptr tr_state, schema_ptr s, const query::read_command& cmd,
+        const partition_key& key, utils::UUID ballot, bool only_digest, query::digest_algorithm da,
+        clock_type::time_point timeout) {
+    auto dk = dht::global_partitioner().decorate_key(*s, key);
+    auto token = dk.token();
+    return paxos_locks.with_locked_key(token, [tr_state, s = std::move(s), &cmd, dk = std::move(dk), ballot, only_digest, da] () mutable {
+        return db::system_keyspace::load_paxos_state(dk.key(), s).then([tr_state, s, &cmd, dk, ballot, only_digest, da] (paxos_state state) mutable {
+            if (ballot_tri_compare(ballot, state._promised_ballot) <= 0) {
+                tracing::trace(tr_state, "Promise rejected; {} is not sufficiently newer than {}", ballot, state._promised_ballot);
+                return make_ready_future<prepare_response>(prepare_response(false, state._promised_ballot));
+            }
+            tracing::trace(tr_state, "Promising ballot {}", ballot);
+            return db::system_keyspace::save_paxos_promise(*s, dk.key(), ballot).then([tr_state, s, &cmd, dk, only_digest, da] () mutable {
+                // Nothing can be accepted or learned for the partition here
+                // until the lock is released, so the data read is the value
+                // the next decision applies to, unless there are proposals
+                // in progress, which the coordinator has to finish first.
+                auto opts = query::result_options(only_digest ? query::result_request::only_digest : query::result_request::result_and_digest, da);
+                return do_with(dht::partition_range_vector{dht::partition_range::make_singular(std::move(dk))}, [tr_state, s, &cmd, opts] (auto& ranges) {
+                    return get_local_storage_proxy().get_db().local().query(s, cmd, opts, ranges, tr_state,
+                            query::result_memory_limiter::maximum_result_size);
+                });
+            }).then([ballot, state = std::move(state)] (lw_shared_ptr<query::result> r, cache_temperature) mutable {
+                // Without the memory tracker, which belongs to this shard.
+                auto data = query::result(bytes_ostream(r->buf()), r->digest(), r->last_modified(), r->is_short_read(),
+                        r->row_count(), r->partition_count());
+                return prepare_response(true, ballot, std::move(state._accepted_proposal), std::move(state._most_recent_commit),
+                        std::move(data));
+            });
+        });
+    });
+}
+
+future<bool> paxos_state::accept(tracing::trace_state_ptr tr_state, schema_ptr s, proposal p, clock_type::time_point timeout) {
+    auto token = dht::global_partitioner().get_token(*s, p.update.key(*s));
+    return paxos_locks.with_locked_key(token, [tr_state, s = std::move(s), p = std::move(p)] () mutable {
+        auto key = p.update.key(*s);
+        return db::system_keyspace::load_paxos_state(key, s).then([tr_state, s, p = std::move(p)] (paxos_state state) mutable {
+            // Accepting the proposal of the ballot promised is what the
+            // promise was for, so only newer promises reject it.
+            if (ballot_tri_compare(p.ballot, state._promised_ballot) < 0) {
+                tracing::trace(tr_state, "Rejecting proposal for {} because in_progress is now {}", p.ballot, state._promised_ballot);
+                return make_ready_future<bool>(false);
+            }
+            tracing::trace(tr_state, "Accepting proposal {}", p.ballot);
+            return do_with(std::move(p), [s] (proposal& p) {
+                return db::system_keyspace::save_paxos_proposal(*s, p);
+            }).then([] {
+                return true;
+            });
+        });
+    });
+}
+
+future<> paxos_state::learn(tracing::trace_state_ptr tr_state, schema_ptr s, proposal decision, clock_type::time_point timeout) {
+    tracing::trace(tr_state, "Committing proposal {}", decision.ballot);
+    // The update and the decision are written with the timestamp of the
+    // ballot, so that applying an old decision again changes nothing, and
+    // there is no need to take the lock.
+    return do_with(std::move(decision), [tr_state, s = std::move(s), timeout] (proposal& decision) {
+        return get_local_storage_proxy().mutate_locally(s, decision.update, timeout).then([s, &decision] {
+            return db::system_keyspace::save_paxos_decision(*s, decision);
+        });
+    });
+}
+
+}
+
+}
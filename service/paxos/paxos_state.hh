@@ -0,0 +1,76 @@
+/*
+ * Copyright (C) 2018 ScyllaDB
+ */
+
+/*
+ * This file is part of Scylla.
+ *
+ * Scylla is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Scylla is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <experimental/optional>
+#include "core/future.hh"
+#include "core/lowres_clock.hh"
+#include "digest_algorithm.hh"
+#include "query-request.hh"
+#include "schema.hh"
+#include "service/paxos/proposal.hh"
+#include "tracing/trace_state.hh"
+#include "utils/UUID_gen.hh"
+
+namespace service {
+
+namespace paxos {
+
+// The acceptor side of the Paxos rounds of a partition, as persisted in
+// system.paxos.
+//
+// The functions must be called on the shard owning the partition. They are
+// serialized per partition on it, so that loading, checking and saving the
+// state is atomic.
+class paxos_state {
+    utils::UUID _promised_ballot = utils::UUID_gen::min_time_UUID(0);
+    std::experimental::optional<proposal> _accepted_proposal;
+    std::experimental::optional<proposal> _most_recent_commit;
+public:
+    using clock_type = lowres_clock;
+
+    paxos_state() = default;
+    paxos_state(utils::UUID promised_ballot, std::experimental::optional<proposal> accepted_proposal,
+            std::experimental::optional<proposal> most_recent_commit)
+        : _promised_ballot(std::move(promised_ballot))
+        , _accepted_proposal(std::move(accepted_proposal))
+        , _most_recent_commit(std::move(most_recent_commit))
+    { }
+
+    // Promises not to accept proposals of older ballots than the given one,
+    // unless a newer one was promised already. Once it promised, reads the
+    // partition with cmd, the result and its digest, or only the digest, so
+    // that the coordinator learns the current value in the same round trip.
+    static future<prepare_response> prepare(tracing::trace_state_ptr tr_state, schema_ptr s, const query::read_command& cmd,
+            const partition_key& key, utils::UUID ballot, bool only_digest, query::digest_algorithm da,
+            clock_type::time_point timeout);
+
+    // Accepts the proposal unless a newer ballot was promised.
+    static future<bool> accept(tracing::trace_state_ptr tr_state, schema_ptr s, proposal p, clock_type::time_point timeout);
+
+    // Applies the decided update and records it as the most recent commit.
+    static future<> learn(tracing::trace_state_ptr tr_state, schema_ptr s, proposal decision, clock_type::time_point timeout);
+};
+
+}
+
+}
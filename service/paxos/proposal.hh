@@ -0,0 +1,85 @@
+/*
+ * Copyright (C) 2018 ScyllaDB
+ */
+
+/*
+ * This file is part of Scylla.
+ *
+ * Scylla is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Scylla is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <experimental/optional>
+#include "frozen_mutation.hh"
+#include "query-result.hh"
+#include "utils/UUID.hh"
+
+namespace service {
+
+namespace paxos {
+
+// Ballots are time UUIDs, ordered by their time first.
+inline int ballot_tri_compare(const utils::UUID& a, const utils::UUID& b) {
+    auto ta = a.timestamp();
+    auto tb = b.timestamp();
+    if (ta != tb) {
+        return ta < tb ? -1 : 1;
+    }
+    auto la = uint64_t(a.get_least_significant_bits());
+    auto lb = uint64_t(b.get_least_significant_bits());
+    return la < lb ? -1 : la > lb;
+}
+
+// An update of a partition, proposed or decided in the Paxos round of the
+// ballot.
+class proposal {
+public:
+    utils::UUID ballot;
+    frozen_mutation update;
+
+    proposal(utils::UUID ballot, frozen_mutation update)
+        : ballot(std::move(ballot))
+        , update(std::move(update))
+    { }
+};
+
+// The answer of a replica to a prepare. When promised is false, the replica
+// has promised a newer ballot, most_recent_promised_ballot, and the rest is
+// unset. Otherwise, it reports the proposal it accepted and not yet learned
+// the decision of, if any, the last decision it learned, and the partition
+// as it read it right after promising, either whole or as a digest only.
+class prepare_response {
+public:
+    bool promised;
+    utils::UUID most_recent_promised_ballot;
+    std::experimental::optional<proposal> accepted_proposal;
+    std::experimental::optional<proposal> most_recent_commit;
+    std::experimental::optional<query::result> data;
+
+    prepare_response(bool promised, utils::UUID most_recent_promised_ballot,
+            std::experimental::optional<proposal> accepted_proposal = { },
+            std::experimental::optional<proposal> most_recent_commit = { },
+            std::experimental::optional<query::result> data = { })
+        : promised(promised)
+        , most_recent_promised_ballot(std::move(most_recent_promised_ballot))
+        , accepted_proposal(std::move(accepted_proposal))
+        , most_recent_commit(std::move(most_recent_commit))
+        , data(std::move(data))
+    { }
+};
+
+}
+
+}
@@ -18,8 +18,71 @@
  * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
  */
 #include "priority_manager.hh"
+#include "db/config.hh"
+#include <seastar/core/metrics.hh>
 
 namespace service {
+
+service_level::service_level(const sstring& name, uint32_t shares)
+    : read_priority(engine().register_one_priority_class("query_" + name, shares))
+    , cpu(std::chrono::milliseconds(1), std::min(1.0, shares / 100.0))
+{ }
+
+void priority_manager::setup_metrics() {
+    namespace sm = seastar::metrics;
+    auto runtime = [] (cpu_quota_group& g) {
+        return [&g] {
+            return std::chrono::duration_cast<std::chrono::microseconds>(g.runtime()).count();
+        };
+    };
+    _metrics.add_group("cpu_quota", {
+        sm::make_derive("streaming_runtime", runtime(_streaming_cpu),
+                        sm::description("Microseconds of CPU used by sending streamed partitions.")),
+        sm::make_derive("repair_runtime", runtime(_repair_cpu),
+                        sm::description("Microseconds of CPU used by checksumming partitions for repair.")),
+        sm::make_derive("view_building_runtime", runtime(_view_building_cpu),
+                        sm::description("Microseconds of CPU used by building materialized views from existing data.")),
+        sm::make_gauge("streaming_quota", [this] { return _streaming_cpu.quota(); },
+                        sm::description("The share of the CPU sending streamed partitions may use.")),
+        sm::make_gauge("repair_quota", [this] { return _repair_cpu.quota(); },
+                        sm::description("The share of the CPU checksumming partitions for repair may use.")),
+        sm::make_gauge("view_building_quota", [this] { return _view_building_cpu.quota(); },
+                        sm::description("The share of the CPU building materialized views may use.")),
+    });
+}
+
+void priority_manager::set_cpu_quotas(const db::config& cfg) {
+    _streaming_cpu.set_quota(cfg.streaming_cpu_quota());
+    _repair_cpu.set_quota(cfg.repair_cpu_quota());
+    _view_building_cpu.set_quota(cfg.view_building_cpu_quota());
+}
+
+void priority_manager::set_service_levels(const db::config& cfg) {
+    namespace sm = seastar::metrics;
+    static const sm::label service_level_label("service_level");
+    for (auto&& e : cfg.service_levels()) {
+        auto shares = std::max<uint32_t>(std::stoul(e.second), 1);
+        auto sl = std::make_unique<service_level>(e.first, shares);
+        auto& cpu = sl->cpu;
+        _metrics.add_group("cpu_quota", {
+            sm::make_derive("service_level_runtime", [&cpu] {
+                return std::chrono::duration_cast<std::chrono::microseconds>(cpu.runtime()).count();
+            }, sm::description("Microseconds of CPU used by coordinating the queries of the users of the service level."))(service_level_label(e.first)),
+            sm::make_gauge("service_level_quota", [&cpu] { return cpu.quota(); },
+                    sm::description("The share of the CPU coordinating the queries of the users of the service level may use."))(service_level_label(e.first)),
+        });
+        _service_levels.emplace(e.first, std::move(sl));
+    }
+}
+
+service_level* priority_manager::find_service_level(const sstring& name) {
+    if (name.empty()) {
+        return nullptr;
+    }
+    auto it = _service_levels.find(name);
+    return it == _service_levels.end() ? nullptr : it->second.get();
+}
+
 priority_manager& get_local_priority_manager() {
     static thread_local priority_manager pm = priority_manager();
     return pm;
@@ -21,10 +21,32 @@
 #include <seastar/core/future.hh>
 #include <seastar/core/distributed.hh>
 #include <seastar/core/reactor.hh>
+#include <seastar/core/sleep.hh>
+#include <seastar/core/metrics_registration.hh>
+
+#include <unordered_map>
+#include <memory>
 
 #include "seastarx.hh"
+#include "utils/cpu_quota_group.hh"
+
+namespace db {
+class config;
+}
 
 namespace service {
+
+using cpu_quota_group = utils::cpu_quota_group<>;
+
+// The disk and CPU shares of the queries of the users attached to the level,
+// relative to the 100 of the queries of the other users.
+struct service_level {
+    ::io_priority_class read_priority;
+    cpu_quota_group cpu;
+
+    service_level(const sstring& name, uint32_t shares);
+};
+
 class priority_manager {
     ::io_priority_class _commitlog_priority;
     ::io_priority_class _mt_flush_priority;
@@ -33,6 +55,15 @@ class priority_manager {
     ::io_priority_class _sstable_query_read;
     ::io_priority_class _compaction_priority;
 
+    // Compaction and memtable flushes run in threads, under the thread
+    // scheduling groups of their controllers. This background work doesn't.
+    cpu_quota_group _streaming_cpu{std::chrono::milliseconds(1), 1.0};
+    cpu_quota_group _repair_cpu{std::chrono::milliseconds(1), 1.0};
+    cpu_quota_group _view_building_cpu{std::chrono::milliseconds(1), 1.0};
+    std::unordered_map<sstring, std::unique_ptr<service_level>> _service_levels;
+    seastar::metrics::metric_groups _metrics;
+private:
+    void setup_metrics();
 public:
     const ::io_priority_class&
     commitlog_priority() {
@@ -64,6 +95,33 @@ class priority_manager {
         return _compaction_priority;
     }
 
+    cpu_quota_group& streaming_cpu() {
+        return _streaming_cpu;
+    }
+
+    cpu_quota_group& repair_cpu() {
+        return _repair_cpu;
+    }
+
+    cpu_quota_group& view_building_cpu() {
+        return _view_building_cpu;
+    }
+
+    void set_cpu_quotas(const db::config& cfg);
+
+    // Creates the levels of the service_levels option. Called once, at startup.
+    void set_service_levels(const db::config& cfg);
+
+    // Null for the empty name and unknown levels, whose queries are treated
+    // as those of users without a level.
+    service_level* find_service_level(const sstring& name);
+
+    const ::io_priority_class&
+    query_read_priority(const sstring& service_level) {
+        auto sl = find_service_level(service_level);
+        return sl ? sl->read_priority : _sstable_query_read;
+    }
+
     priority_manager()
         : _commitlog_priority(engine().register_one_priority_class("commitlog", 100))
         , _mt_flush_priority(engine().register_one_priority_class("memtable_flush", 100))
@@ -72,7 +130,9 @@ class priority_manager {
         , _sstable_query_read(engine().register_one_priority_class("query", 100))
         , _compaction_priority(engine().register_one_priority_class("compaction", 100))
 
-    {}
+    {
+        setup_metrics();
+    }
 };
 
 priority_manager& get_local_priority_manager();
@@ -105,4 +165,30 @@ const inline ::io_priority_class&
 get_local_compaction_priority() {
     return get_local_priority_manager().compaction_priority();
 }
+
+inline cpu_quota_group& get_local_streaming_cpu() {
+    return get_local_priority_manager().streaming_cpu();
+}
+
+inline cpu_quota_group& get_local_repair_cpu() {
+    return get_local_priority_manager().repair_cpu();
+}
+
+inline cpu_quota_group& get_local_view_building_cpu() {
+    return get_local_priority_manager().view_building_cpu();
+}
+
+const inline ::io_priority_class&
+get_local_query_read_priority(const sstring& service_level) {
+    return get_local_priority_manager().query_read_priority(service_level);
+}
+
+// Resolves once the group may run more.
+inline future<> throttle(cpu_quota_group& g) {
+    auto d = g.delay();
+    if (d == cpu_quota_group::duration(0)) {
+        return make_ready_future<>();
+    }
+    return seastar::sleep(d);
+}
 }
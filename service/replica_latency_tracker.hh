@@ -0,0 +1,121 @@
+/*
+ * Copyright (C) 2017 ScyllaDB
+ */
+
+/*
+ * This file is part of Scylla.
+ *
+ * Scylla is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Scylla is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <unordered_map>
+#include <vector>
+#include "gms/inet_address.hh"
+
+namespace service {
+
+/*
+ * Ranks the replicas of reads by how fast they answered lately, as the
+ * dynamic snitch of Cassandra does.
+ *
+ * Each replica has an exponentially weighted moving average of the latency
+ * of the reads sent to it, and the number of those which are still waiting
+ * for an answer. Its score is the average latency times one plus that
+ * number, so that a replica which stalls gets a bad score before any of its
+ * slow answers is seen. Replicas which had no reads for the reset interval
+ * are forgotten, so that one avoided for being slow is tried again.
+ */
+class replica_latency_tracker {
+public:
+    using clock = std::chrono::steady_clock;
+private:
+    // The weight of a new latency in the average.
+    static constexpr double alpha = 0.1;
+
+    struct replica {
+        double latency_us = 0;
+        unsigned in_flight = 0;
+        bool measured = false;
+        clock::time_point last_update;
+    };
+    std::unordered_map<gms::inet_address, replica> _replicas;
+public:
+    void start_read(gms::inet_address ep) {
+        ++_replicas[ep].in_flight;
+    }
+
+    // Failed reads count too: they took that long to fail.
+    void end_read(gms::inet_address ep, clock::duration latency, clock::time_point now = clock::now()) {
+        auto& r = _replicas[ep];
+        if (r.in_flight) {
+            --r.in_flight;
+        }
+        double us = std::chrono::duration_cast<std::chrono::duration<double, std::micro>>(latency).count();
+        r.latency_us = r.measured ? alpha * us + (1 - alpha) * r.latency_us : us;
+        r.measured = true;
+        r.last_update = now;
+    }
+
+    // Zero for replicas which weren't read from lately, so that they get tried.
+    double score(gms::inet_address ep, clock::duration reset_interval, clock::time_point now = clock::now()) const {
+        auto it = _replicas.find(ep);
+        if (it == _replicas.end() || !it->second.measured) {
+            return 0;
+        }
+        if (!it->second.in_flight && now - it->second.last_update > reset_interval) {
+            return 0;
+        }
+        return it->second.latency_us * (1 + it->second.in_flight);
+    }
+
+    /*
+     * Orders the replicas in [begin, end) by score, if the first one scores
+     * worse than (1 + badness_threshold) times the best one. The order is
+     * kept otherwise, so that the same replica keeps getting the same reads,
+     * which keeps its cache hot.
+     */
+    template <typename Iterator>
+    void sort(Iterator begin, Iterator end, double badness_threshold, clock::duration reset_interval, clock::time_point now = clock::now()) const {
+        if (end - begin < 2) {
+            return;
+        }
+        std::vector<std::pair<double, gms::inet_address>> scores;
+        scores.reserve(end - begin);
+        for (auto it = begin; it != end; ++it) {
+            scores.emplace_back(score(*it, reset_interval, now), *it);
+        }
+        auto best = std::min_element(scores.begin(), scores.end(), [] (auto& a, auto& b) {
+            return a.first < b.first;
+        })->first;
+        if (scores.front().first <= best * (1 + badness_threshold)) {
+            return;
+        }
+        std::stable_sort(scores.begin(), scores.end(), [] (auto& a, auto& b) {
+            return a.first < b.first;
+        });
+        std::transform(scores.begin(), scores.end(), begin, [] (auto& s) {
+            return s.second;
+        });
+    }
+
+    void remove(gms::inet_address ep) {
+        _replicas.erase(ep);
+    }
+};
+
+}
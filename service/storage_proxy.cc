@@ -56,11 +56,15 @@
 #include "db/config.hh"
 #include "db/batchlog_manager.hh"
 #include "exceptions/exceptions.hh"
+#include "cql3/selection/selection.hh"
+#include "cql3/selection/partial_aggregates.hh"
 #include <boost/range/algorithm_ext/push_back.hpp>
 #include <boost/iterator/counting_iterator.hpp>
 #include <boost/range/adaptors.hpp>
 #include <boost/algorithm/cxx11/any_of.hpp>
 #include <boost/algorithm/cxx11/none_of.hpp>
+#include <boost/algorithm/cxx11/all_of.hpp>
+#include <boost/range/join.hpp>
 #include <boost/range/algorithm/count_if.hpp>
 #include <boost/range/algorithm/find.hpp>
 #include <boost/range/algorithm/find_if.hpp>
@@ -69,7 +73,9 @@
 #include <boost/range/numeric.hpp>
 #include <boost/range/algorithm/sort.hpp>
 #include <boost/range/empty.hpp>
+#include <boost/range/irange.hpp>
 #include <boost/range/algorithm/min_element.hpp>
+#include <boost/range/algorithm/max_element.hpp>
 #include <boost/range/adaptor/transformed.hpp>
 #include "utils/latency.hh"
 #include "schema.hh"
@@ -78,6 +84,26 @@
 #include <seastar/util/lazy.hh>
 #include "core/metrics.hh"
 #include <seastar/core/execution_stage.hh>
+#include "utils/task_context_guard.hh"
+#include "service/paxos/paxos_state.hh"
+#include "service/paxos/cas_request.hh"
+#include "idl/uuid.dist.hh"
+#include "idl/keys.dist.hh"
+#include "idl/token.dist.hh"
+#include "idl/ring_position.dist.hh"
+#include "idl/range.dist.hh"
+#include "idl/tracing.dist.hh"
+#include "idl/read_command.dist.hh"
+#include "serializer_impl.hh"
+#include "idl/uuid.dist.impl.hh"
+#include "idl/keys.dist.impl.hh"
+#include "idl/token.dist.impl.hh"
+#include "idl/ring_position.dist.impl.hh"
+#include "idl/range.dist.impl.hh"
+#include "idl/tracing.dist.impl.hh"
+#include "idl/read_command.dist.impl.hh"
+#include "core/sleep.hh"
+#include <random>
 
 namespace service {
 
@@ -377,6 +403,10 @@ storage_proxy::response_id_type storage_proxy::register_response_handler(shared_
             if (e.handler->_cl == db::consistency_level::ANY && hints) {
                 slogger.trace("Wrote hint to satisfy CL.ANY after no replicas acknowledged the write");
             }
+        } else if (e.handler->_type == db::write_type::VIEW) {
+            // The view would diverge from the base otherwise. The write
+            // still times out, the update is replayed later.
+            hint_view_updates(e.handler->_mutation_holder, e.handler->get_targets());
         }
 
         e.handler->on_timeout();
@@ -480,11 +510,16 @@ inline uint64_t& storage_proxy::split_stats::get_ep_stat(gms::inet_address ep) {
 }
 
 storage_proxy::~storage_proxy() {}
-storage_proxy::storage_proxy(distributed<database>& db) : _db(db) {
+storage_proxy::storage_proxy(distributed<database>& db)
+    : _db(db)
+    , _overload_write_bytes(memory::stats().total_memory() / 5)
+    , _result_cache(size_t(db.local().get_config().coordinator_result_cache_size_in_mb()) << 20) {
     namespace sm = seastar::metrics;
+    static const sm::label reason_label("reason");
+    _mutation_batch_timer.set_callback([this] { send_mutation_batches(); });
     _metrics.add_group(COORDINATOR_STATS_CATEGORY, {
-        sm::make_histogram("read_latency", sm::description("The general read latency histogram"), [this]{ return _stats.estimated_read.get_histogram(16, 20);}),
-        sm::make_histogram("write_latency", sm::description("The general write latency histogram"), [this]{return _stats.estimated_write.get_histogram(16, 20);}),
+        sm::make_histogram("read_latency", sm::description("The general read latency histogram"), [this]{ return _stats.read.hist.values.get_histogram(16, 20);}),
+        sm::make_histogram("write_latency", sm::description("The general write latency histogram"), [this]{return _stats.write.hist.values.get_histogram(16, 20);}),
         sm::make_queue_length("foreground_writes", [this] { return _stats.writes - _stats.background_writes; },
                        sm::description("number of currently pending foreground write requests")),
 
@@ -497,6 +532,12 @@ storage_proxy::storage_proxy(distributed<database>& db) : _db(db) {
         sm::make_total_operations("throttled_writes", [this] { return _stats.throttled_writes; },
                        sm::description("number of throttled write requests")),
 
+        sm::make_total_operations("shed_requests", [this] { return _stats.requests_shed_write_bytes; },
+                       sm::description("number of client requests rejected as overloaded because of the memory of the writes in flight"), {reason_label("write_bytes")}),
+
+        sm::make_total_operations("shed_requests", [this] { return _stats.requests_shed_hints; },
+                       sm::description("number of client requests rejected as overloaded because of the hints in flight"), {reason_label("hints")}),
+
         sm::make_current_bytes("queued_write_bytes", [this] { return _stats.queued_write_bytes; },
                        sm::description("number of bytes in pending write requests")),
 
@@ -512,6 +553,15 @@ storage_proxy::storage_proxy(distributed<database>& db) : _db(db) {
         sm::make_total_operations("read_retries", [this] { return _stats.read_retries; },
                        sm::description("number of read retry attempts")),
 
+        sm::make_total_operations("mutation_batches", [this] { return _stats.sent_mutation_batches; },
+                       sm::description("number of messages carrying the writes to a replica made during a batching window")),
+
+        sm::make_total_operations("speculative_reads", [this] { return _stats.speculative_reads; },
+                       sm::description("number of reads sent to an additional replica because the first ones were slow to reply")),
+
+        sm::make_total_operations("speculative_reads_over_budget", [this] { return _stats.speculative_reads_over_budget; },
+                       sm::description("number of speculative reads not sent because of speculative_retry_budget_percent")),
+
         sm::make_total_operations("canceled_read_repairs", [this] { return _stats.global_read_repairs_canceled_due_to_concurrent_write; },
                        sm::description("number of global read repairs canceled due to a concurrent write")),
 
@@ -521,6 +571,30 @@ storage_proxy::storage_proxy(distributed<database>& db) : _db(db) {
         sm::make_total_operations("background_read_repairs", [this] { return _stats.read_repair_repaired_background; },
                        sm::description("number of background read repairs")),
 
+        sm::make_total_operations("background_read_repair_writes", [this] { return _stats.background_read_repair_writes; },
+                       sm::description("number of read repair writes the read didn't wait for")),
+
+        sm::make_total_operations("result_cache_hits", [this] { return _result_cache.get_stats().hits; },
+                       sm::description("number of reads given a result kept by the coordinator result cache")),
+
+        sm::make_total_operations("result_cache_misses", [this] { return _result_cache.get_stats().misses; },
+                       sm::description("number of cacheable reads which weren't in the coordinator result cache")),
+
+        sm::make_total_operations("result_cache_invalidations", [this] { return _result_cache.get_stats().invalidations; },
+                       sm::description("number of results dropped from the coordinator result cache by a write to their partition")),
+
+        sm::make_total_operations("result_cache_evictions", [this] { return _result_cache.get_stats().evictions; },
+                       sm::description("number of results dropped from the coordinator result cache to make room")),
+
+        sm::make_current_bytes("result_cache_bytes", [this] { return _result_cache.memory(); },
+                       sm::description("memory taken by the coordinator result cache")),
+
+        sm::make_total_operations("read_repairs_over_budget", [this] { return _stats.read_repairs_over_budget; },
+                       sm::description("number of read repair writes the read waited for, because of max_background_read_repairs")),
+
+        sm::make_queue_length("current_background_read_repairs", [this] { return _background_read_repairs; },
+                       sm::description("number of read repair writes currently in the background")),
+
         sm::make_total_operations("write_timeouts", [this] { return _stats.write_timeouts._count; },
                        sm::description("number of write request failed due to a timeout")),
 
@@ -538,6 +612,21 @@ storage_proxy::storage_proxy(distributed<database>& db) : _db(db) {
 
         sm::make_total_operations("range_unavailable", [this] { return _stats.range_slice_unavailables._count; },
                        sm::description("number of range read operations failed due to an \"unavailable\" error")),
+
+        sm::make_total_operations("parallel_range_scans", [this] { return _stats.parallel_range_scans; },
+                       sm::description("number of range read operations which read their token ranges in parallel")),
+
+        sm::make_queue_length("parallel_range_scans_blocked_memory", [this] { return _parallel_scan_memory.waiters(); },
+                       sm::description("number of rounds of parallel range scans waiting for the memory of their results")),
+
+        sm::make_total_operations("cas_contention", [this] { return _stats.cas_contention; },
+                       sm::description("number of Paxos rounds of lightweight transactions which a newer ballot preempted")),
+
+        sm::make_total_operations("cas_unfinished_commits", [this] { return _stats.cas_unfinished_commits; },
+                       sm::description("number of Paxos rounds of lightweight transactions which had to finish an earlier round first")),
+
+        sm::make_total_operations("cas_read_fallbacks", [this] { return _stats.cas_read_fallbacks; },
+                       sm::description("number of lightweight transactions which had to read the current values at QUORUM, as the replicas disagreed")),
     });
 
     _metrics.add_group(REPLICA_STATS_CATEGORY, {
@@ -553,6 +642,9 @@ storage_proxy::storage_proxy(distributed<database>& db) : _db(db) {
         sm::make_total_operations("forwarding_errors", _stats.forwarding_errors,
                        sm::description("number of errors during forwarding mutations to other replica Nodes")),
 
+        sm::make_total_operations("received_mutation_batches", _stats.received_mutation_batches,
+                       sm::description("number of messages carrying several mutations received by a replica Node")),
+
         sm::make_total_operations("reads", _stats.replica_data_reads,
                        sm::description("number of remote data read requests this Node received"), {storage_proxy::split_stats::op_type_label("data")}),
 
@@ -563,6 +655,35 @@ storage_proxy::storage_proxy(distributed<database>& db) : _db(db) {
                        sm::description("number of remote digest read requests this Node received"), {storage_proxy::split_stats::op_type_label("digest")}),
 
     });
+
+    auto& cfg = _db.local().get_config();
+    _parallel_scan_memory.signal(std::max<size_t>(query::result_memory_limiter::maximum_result_size,
+            size_t(cfg.parallel_range_scan_memory_in_mb()) * 1024 * 1024));
+    if (cfg.hinted_handoff_enabled()) {
+        _hints_manager = std::make_unique<db::hints::manager>(cfg.hints_directory(), cfg.max_hint_window_in_ms(), cfg.hinted_handoff_throttle_in_kb());
+    }
+    _view_hints_manager = std::make_unique<db::hints::manager>(cfg.view_hints_directory(), cfg.max_hint_window_in_ms(), cfg.hinted_handoff_throttle_in_kb(),
+            "view_hints_manager");
+}
+
+future<> storage_proxy::start_hints_manager() {
+    auto f = _view_hints_manager->start(shared_from_this());
+    if (!_hints_manager) {
+        return f;
+    }
+    return f.then([this] {
+        return _hints_manager->start(shared_from_this());
+    });
+}
+
+future<> storage_proxy::stop_hints_manager() {
+    auto stop = [] (db::hints::manager* m) {
+        if (!m || !m->started()) {
+            return make_ready_future<>();
+        }
+        return m->stop();
+    };
+    return when_all(stop(_hints_manager.get()), stop(_view_hints_manager.get())).discard_result();
 }
 
 storage_proxy::rh_entry::rh_entry(shared_ptr<abstract_write_response_handler>&& h, std::function<void()>&& cb) : handler(std::move(h)), expire_timer(std::move(cb)) {}
@@ -967,6 +1088,7 @@ future<>
 storage_proxy::mutate_locally(const mutation& m, clock_type::time_point timeout) {
     auto shard = _db.local().shard_of(m);
     return _db.invoke_on(shard, [s = global_schema_ptr(m.schema()), m = freeze(m), timeout] (database& db) -> future<> {
+        utils::task_context_guard task_ctx(utils::task_context::storage_proxy);
         return db.apply(s, m, timeout);
     });
 }
@@ -975,15 +1097,103 @@ future<>
 storage_proxy::mutate_locally(const schema_ptr& s, const frozen_mutation& m, clock_type::time_point timeout) {
     auto shard = _db.local().shard_of(m);
     return _db.invoke_on(shard, [&m, gs = global_schema_ptr(s), timeout] (database& db) -> future<> {
+        utils::task_context_guard task_ctx(utils::task_context::storage_proxy);
         return db.apply(gs, m, timeout);
     });
 }
 
 future<>
 storage_proxy::mutate_locally(std::vector<mutation> mutations, clock_type::time_point timeout) {
-    return do_with(std::move(mutations), [this, timeout] (std::vector<mutation>& pmut){
-        return parallel_for_each(pmut.begin(), pmut.end(), [this, timeout] (const mutation& m) {
-            return mutate_locally(m, timeout);
+    auto fms = boost::copy_range<std::vector<frozen_mutation>>(mutations | boost::adaptors::transformed([] (const mutation& m) {
+        return freeze(m);
+    }));
+    return do_with(std::move(mutations), std::move(fms), [this, timeout] (std::vector<mutation>& mutations, std::vector<frozen_mutation>& fms) {
+        std::vector<std::pair<const frozen_mutation*, schema_ptr>> by_shard;
+        by_shard.reserve(mutations.size());
+        for (size_t i = 0; i < mutations.size(); ++i) {
+            by_shard.emplace_back(&fms[i], mutations[i].schema());
+        }
+        return mutate_locally_by_shard(std::move(by_shard), timeout).then([] (std::vector<std::exception_ptr> errors) {
+            auto it = boost::find_if(errors, [] (const std::exception_ptr& eptr) { return bool(eptr); });
+            return it == errors.end() ? make_ready_future<>() : make_exception_future<>(*it);
+        });
+    });
+}
+
+// The mutations are applied with one call to each of the shards they belong
+// to, rather than one call per mutation.
+future<std::vector<std::exception_ptr>>
+storage_proxy::mutate_locally_by_shard(std::vector<std::pair<const frozen_mutation*, schema_ptr>> mutations, clock_type::time_point timeout) {
+    auto n = mutations.size();
+    return do_with(std::move(mutations), std::vector<std::vector<size_t>>(smp::count), std::vector<std::exception_ptr>(n),
+            [this, timeout] (auto& mutations, auto& by_shard, auto& errors) {
+        for (size_t i = 0; i < mutations.size(); ++i) {
+            by_shard[_db.local().shard_of(*mutations[i].first)].push_back(i);
+        }
+        return parallel_for_each(boost::irange<unsigned>(0, smp::count), [this, &mutations, &by_shard, &errors, timeout] (unsigned shard) {
+            auto& indexes = by_shard[shard];
+            if (indexes.empty()) {
+                return make_ready_future<>();
+            }
+            auto schemas = boost::copy_range<std::vector<global_schema_ptr>>(indexes | boost::adaptors::transformed([&mutations] (size_t i) {
+                return global_schema_ptr(mutations[i].second);
+            }));
+            return _db.invoke_on(shard, [&mutations, &indexes, schemas = std::move(schemas), timeout] (database& db) mutable {
+                return do_with(std::move(schemas), std::vector<std::exception_ptr>(indexes.size()), [&db, &mutations, &indexes, timeout] (auto& schemas, auto& errors) {
+                    return parallel_for_each(boost::irange<size_t>(0, indexes.size()), [&db, &mutations, &indexes, &schemas, &errors, timeout] (size_t j) {
+                        // apply() may throw, putting it into apply() converts exception to a future.
+                        return futurize<void>::apply([&] {
+                            return db.apply(schemas[j], *mutations[indexes[j]].first, timeout);
+                        }).then_wrapped([&errors, j] (future<> f) {
+                            if (f.failed()) {
+                                errors[j] = f.get_exception();
+                            }
+                        });
+                    }).then([&errors] {
+                        return std::move(errors);
+                    });
+                });
+            }).then([&indexes, &errors] (std::vector<std::exception_ptr> shard_errors) {
+                for (size_t j = 0; j < indexes.size(); ++j) {
+                    errors[indexes[j]] = std::move(shard_errors[j]);
+                }
+            });
+        }).then([&errors] {
+            return std::move(errors);
+        });
+    });
+}
+
+future<std::vector<bool>>
+storage_proxy::mutate_batch_locally(std::vector<frozen_mutation> fms, netw::msg_addr src_addr, clock_type::time_point timeout) {
+    using mutations_type = std::vector<std::pair<const frozen_mutation*, schema_ptr>>;
+    return do_with(std::move(fms), mutations_type(), [this, src_addr, timeout] (std::vector<frozen_mutation>& fms, mutations_type& mutations) {
+        mutations.reserve(fms.size());
+        // FIXME: get_schema_for_write() doesn't timeout
+        return do_for_each(fms, [&mutations, src_addr] (const frozen_mutation& fm) {
+            return get_schema_for_write(fm.schema_version(), src_addr).then([&mutations, &fm] (schema_ptr s) {
+                mutations.emplace_back(&fm, std::move(s));
+            });
+        }).then([this, &mutations, timeout] {
+            return mutate_locally_by_shard(std::move(mutations), timeout);
+        }).then([src_addr] (std::vector<std::exception_ptr> errors) {
+            return boost::copy_range<std::vector<bool>>(errors | boost::adaptors::transformed([src_addr] (const std::exception_ptr& eptr) {
+                if (!eptr) {
+                    return true;
+                }
+                seastar::log_level l = seastar::log_level::warn;
+                try {
+                    std::rethrow_exception(eptr);
+                } catch (timed_out_error&) {
+                    // ignore timeouts so that logs are not flooded.
+                    // database total_writes_timedout counter was incremented.
+                    l = seastar::log_level::debug;
+                } catch (...) {
+                    // ignore
+                }
+                slogger.log(l, "Failed to apply mutation from {}: {}", src_addr.addr, eptr);
+                return false;
+            }));
         });
     });
 }
@@ -1029,6 +1239,7 @@ storage_proxy::mutate_streaming_mutation(const schema_ptr& s, utils::UUID plan_i
  */
 storage_proxy::response_id_type
 storage_proxy::create_write_response_handler(const mutation& m, db::consistency_level cl, db::write_type type, tracing::trace_state_ptr tr_state) {
+    invalidate_cached_results(*m.schema(), m.token());
     auto keyspace_name = m.schema()->ks_name();
     keyspace& ks = _db.local().find_keyspace(keyspace_name);
     auto& rs = ks.get_replication_strategy();
@@ -1121,7 +1332,11 @@ future<std::vector<storage_proxy::unique_response_handler>> storage_proxy::mutat
 
 future<> storage_proxy::mutate_begin(std::vector<unique_response_handler> ids, db::consistency_level cl,
                                      stdx::optional<clock_type::time_point> timeout_opt) {
-    return parallel_for_each(ids, [this, cl, timeout_opt] (unique_response_handler& protected_response) {
+    // The mutations of a request are sent together to each replica, and
+    // applied to this node with one call per shard, once they were all
+    // prepared. parallel_for_each() prepares them all before returning.
+    _batching_mutations = ids.size() > 1;
+    auto f = parallel_for_each(ids, [this, cl, timeout_opt] (unique_response_handler& protected_response) {
         auto response_id = protected_response.id;
         // it is better to send first and hint afterwards to reduce latency
         // but request may complete before hint_to_dead_endpoints() is called and
@@ -1135,6 +1350,12 @@ future<> storage_proxy::mutate_begin(std::vector<unique_response_handler> ids, d
         send_to_live_endpoints(protected_response.release(), timeout); // response is now running and it will either complete or timeout
         return std::move(f);
     });
+    if (_batching_mutations) {
+        _batching_mutations = false;
+        apply_local_mutation_batch();
+        send_mutation_batches();
+    }
+    return f;
 }
 
 // this function should be called with a future that holds result of mutation attempt (usually
@@ -1142,9 +1363,6 @@ future<> storage_proxy::mutate_begin(std::vector<unique_response_handler> ids, d
 future<> storage_proxy::mutate_end(future<> mutate_result, utils::latency_counter lc, tracing::trace_state_ptr trace_state) {
     assert(mutate_result.available());
     _stats.write.mark(lc.stop().latency());
-    if (lc.is_start()) {
-        _stats.estimated_write.add(lc.latency(), _stats.write.hist.count);
-    }
     try {
         mutate_result.get();
         tracing::trace(trace_state, "Mutation successfully completed");
@@ -1213,6 +1431,7 @@ future<> storage_proxy::mutate_counters(Range&& mutations, db::consistency_level
     // Choose a leader for each mutation
     std::unordered_map<gms::inet_address, std::vector<frozen_mutation_and_schema>> leaders;
     for (auto& m : mutations) {
+        invalidate_cached_results(*m.schema(), m.token());
         auto leader = find_leader_for_counter_update(m, cl);
         leaders[leader].emplace_back(frozen_mutation_and_schema { freeze(m), m.schema() });
         // FIXME: check if CL can be reached
@@ -1374,7 +1593,7 @@ storage_proxy::mutate_atomically(std::vector<mutation> mutations, db::consistenc
                 , _mutations(std::move(mutations))
                 , _cl(cl)
                 , _trace_state(std::move(tr_state))
-                , _batch_uuid(utils::UUID_gen::get_time_UUID())
+                , _batch_uuid(db::get_batchlog_manager().local().make_batch_id())
                 , _batchlog_endpoints(
                         [this]() -> std::unordered_set<gms::inet_address> {
                             auto local_addr = utils::fb_utilities::get_broadcast_address();
@@ -1467,6 +1686,104 @@ future<> storage_proxy::send_to_endpoint(mutation m, gms::inet_address target, d
         });
 }
 
+future<> storage_proxy::send_to_endpoints(std::vector<std::pair<mutation, gms::inet_address>> mutations, db::write_type type) {
+    utils::latency_counter lc;
+    lc.start();
+
+    return mutate_prepare(mutations, db::consistency_level::ONE, type,
+        [this] (const std::pair<mutation, gms::inet_address>& m, db::consistency_level cl, db::write_type type) {
+            auto& ks = _db.local().find_keyspace(m.first.schema()->ks_name());
+            return create_write_response_handler(ks, cl, type, std::make_unique<shared_mutation>(m.first), {m.second}, {}, {}, nullptr);
+        }).then([this] (std::vector<unique_response_handler> ids) {
+            return mutate_begin(std::move(ids), db::consistency_level::ONE);
+        }).then_wrapped([p = shared_from_this(), lc] (future<>&& f) {
+            return p->mutate_end(std::move(f), lc, nullptr);
+        });
+}
+
+// A batch is sent before the end of its window once it is this large.
+static constexpr size_t max_mutation_batch_size = 64;
+static constexpr size_t max_mutation_batch_bytes = 128 * 1024;
+
+future<> storage_proxy::send_batched_mutation(gms::inet_address ep, const frozen_mutation& m, response_id_type response_id, clock_type::time_point timeout) {
+    auto& b = _mutation_batches[ep];
+    if (!b) {
+        b = make_lw_shared<mutation_batch>();
+        auto window = _db.local().get_config().write_batching_window_in_us();
+        if (window && !_mutation_batch_timer.armed()) {
+            _mutation_batch_timer.arm(std::chrono::microseconds(window));
+        }
+    }
+    b->mutations.push_back(m);
+    b->response_ids.push_back(response_id);
+    b->bytes += m.representation().size();
+    // The mutations of a window have about the same timeout: the batch is
+    // given the latest, for none to be dropped before its time.
+    b->timeout = std::max(b->timeout, timeout);
+    auto f = b->sent.get_shared_future();
+    if (b->mutations.size() >= max_mutation_batch_size || b->bytes >= max_mutation_batch_bytes) {
+        send_mutation_batch(ep);
+    }
+    return f;
+}
+
+void storage_proxy::send_mutation_batch(gms::inet_address ep) {
+    auto it = _mutation_batches.find(ep);
+    auto b = std::move(it->second);
+    _mutation_batches.erase(it);
+    ++_stats.sent_mutation_batches;
+    auto& ms = netw::get_local_messaging_service();
+    ms.send_mutation_batch(netw::messaging_service::msg_addr{ep, 0}, b->timeout, b->mutations,
+            utils::fb_utilities::get_broadcast_address(), engine().cpu_id(), b->response_ids).then_wrapped([b, p = shared_from_this()] (future<> f) {
+        if (f.failed()) {
+            b->sent.set_exception(f.get_exception());
+        } else {
+            b->sent.set_value();
+        }
+    });
+}
+
+void storage_proxy::send_mutation_batches() {
+    while (!_mutation_batches.empty()) {
+        send_mutation_batch(_mutation_batches.begin()->first);
+    }
+}
+
+future<> storage_proxy::add_to_local_mutation_batch(schema_ptr s, lw_shared_ptr<const frozen_mutation> m, clock_type::time_point timeout) {
+    _local_mutation_batch.push_back(local_mutation{std::move(m), std::move(s), timeout, promise<>()});
+    return _local_mutation_batch.back().applied.get_future();
+}
+
+void storage_proxy::apply_local_mutation_batch() {
+    auto batch = std::exchange(_local_mutation_batch, {});
+    if (batch.empty()) {
+        return;
+    }
+    auto timeout = boost::max_element(batch, [] (const local_mutation& a, const local_mutation& b) {
+        return a.timeout < b.timeout;
+    })->timeout;
+    auto mutations = boost::copy_range<std::vector<std::pair<const frozen_mutation*, schema_ptr>>>(batch | boost::adaptors::transformed([] (const local_mutation& lm) {
+        return std::make_pair(lm.fm.get(), lm.s);
+    }));
+    mutate_locally_by_shard(std::move(mutations), timeout).then_wrapped([batch = std::move(batch), p = shared_from_this()] (future<std::vector<std::exception_ptr>> f) mutable {
+        if (f.failed()) {
+            auto eptr = f.get_exception();
+            for (auto& lm : batch) {
+                lm.applied.set_exception(eptr);
+            }
+            return;
+        }
+        auto errors = f.get0();
+        for (size_t i = 0; i < batch.size(); ++i) {
+            if (errors[i]) {
+                batch[i].applied.set_exception(errors[i]);
+            } else {
+                batch[i].applied.set_value();
+            }
+        }
+    });
+}
+
 /**
  * Send the mutations to the right targets, write it locally if it corresponds or writes a hint when the node
  * is not available.
@@ -1509,7 +1826,8 @@ void storage_proxy::send_to_live_endpoints(storage_proxy::response_id_type respo
     auto lmutate = [handler_ptr, response_id, this, my_address, timeout] (lw_shared_ptr<const frozen_mutation> m) mutable {
         tracing::trace(handler_ptr->get_trace_state(), "Executing a mutation locally");
         auto s = handler_ptr->get_schema();
-        return mutate_locally(std::move(s), *m, timeout).then([response_id, this, my_address, m, h = std::move(handler_ptr), p = shared_from_this()] {
+        auto f = _batching_mutations ? add_to_local_mutation_batch(std::move(s), m, timeout) : mutate_locally(std::move(s), *m, timeout);
+        return f.then([response_id, this, my_address, m, h = std::move(handler_ptr), p = shared_from_this()] {
             // make mutation alive until it is processed locally, otherwise it
             // may disappear if write timeouts before this future is ready
             got_response(response_id, my_address);
@@ -1525,8 +1843,17 @@ void storage_proxy::send_to_live_endpoints(storage_proxy::response_id_type respo
         auto& tr_state = handler_ptr->get_trace_state();
         tracing::trace(tr_state, "Sending a mutation to /{}", coordinator);
 
-        return ms.send_mutation(netw::messaging_service::msg_addr{coordinator, 0}, timeout, m,
-                std::move(forward), my_address, engine().cpu_id(), response_id, tracing::make_trace_info(tr_state)).finally([this, p = shared_from_this(), h = std::move(handler_ptr), msize] {
+        future<> f = make_ready_future<>();
+        // Traced writes are sent on their own, for the trace info is per message.
+        if (forward.empty() && !tr_state && (_batching_mutations || _db.local().get_config().write_batching_window_in_us())
+                && service::get_local_storage_service().cluster_supports_mutation_batch()) {
+            f = send_batched_mutation(coordinator, m, response_id, timeout);
+        } else {
+            auto token = m.decorated_key(*handler_ptr->get_schema()).token();
+            f = ms.send_mutation(ms.replica_addr(coordinator, token), timeout, m,
+                    std::move(forward), my_address, engine().cpu_id(), response_id, tracing::make_trace_info(tr_state));
+        }
+        return f.finally([this, p = shared_from_this(), h = std::move(handler_ptr), msize] {
             _stats.queued_write_bytes -= msize;
             unthrottle();
         });
@@ -1586,6 +1913,25 @@ size_t storage_proxy::hint_to_dead_endpoints(std::unique_ptr<mutation_holder>& m
             std::bind(std::mem_fn(&storage_proxy::submit_hint), this, std::ref(mh), std::placeholders::_1));
 }
 
+template<typename Range>
+size_t storage_proxy::hint_view_updates(std::unique_ptr<mutation_holder>& mh, const Range& targets) noexcept
+{
+    return boost::count_if(targets, [this, &mh] (gms::inet_address target) {
+        if (!_view_hints_manager->can_hint_for(target)) {
+            return false;
+        }
+        slogger.debug("Adding view update hint for {}", target);
+        return _view_hints_manager->store_hint(target, mh->schema(), mh->get_mutation_for(target));
+    });
+}
+
+bool storage_proxy::hint_view_update(const mutation& m, gms::inet_address target) {
+    if (!_view_hints_manager->can_hint_for(target)) {
+        return false;
+    }
+    return _view_hints_manager->store_hint(target, m.schema(), make_lw_shared<const frozen_mutation>(freeze(m)));
+}
+
 size_t storage_proxy::get_hints_in_progress_for(gms::inet_address target) {
     auto it = _hints_in_progress.find(target);
 
@@ -1598,32 +1944,10 @@ size_t storage_proxy::get_hints_in_progress_for(gms::inet_address target) {
 
 bool storage_proxy::submit_hint(std::unique_ptr<mutation_holder>& mh, gms::inet_address target)
 {
-    warn(unimplemented::cause::HINT);
     // local write that time out should be handled by LocalMutationRunnable
-    assert(is_me(target));
-    return false;
-#if 0
-    HintRunnable runnable = new HintRunnable(target)
-    {
-        public void runMayThrow()
-        {
-            int ttl = HintedHandOffManager.calculateHintTTL(mutation);
-            if (ttl > 0)
-            {
-                slogger.debug("Adding hint for {}", target);
-                writeHintForMutation(mutation, System.currentTimeMillis(), ttl, target);
-                // Notify the handler only for CL == ANY
-                if (responseHandler != null && responseHandler.consistencyLevel == ConsistencyLevel.ANY)
-                    responseHandler.response(null);
-            } else
-            {
-                slogger.debug("Skipped writing hint for {} (ttl {})", target, ttl);
-            }
-        }
-    };
-
-    return submitHint(runnable);
-#endif
+    assert(!is_me(target));
+    slogger.debug("Adding hint for {}", target);
+    return _hints_manager->store_hint(target, mh->schema(), mh->get_mutation_for(target));
 }
 
 #if 0
@@ -1782,7 +2106,20 @@ future<> storage_proxy::schedule_repair(std::unordered_map<dht::token, std::unor
     if (diffs.empty()) {
         return make_ready_future<>();
     }
-    return mutate_internal(diffs | boost::adaptors::map_values, cl, false, std::move(trace_state));
+    if (_background_read_repairs >= _db.local().get_config().max_background_read_repairs()) {
+        _stats.read_repairs_over_budget++;
+        return mutate_internal(diffs | boost::adaptors::map_values, cl, false, std::move(trace_state));
+    }
+    // The client is answered without waiting for the repair to reach the
+    // replicas, unless too many repairs are already in the background.
+    ++_background_read_repairs;
+    _stats.background_read_repair_writes++;
+    mutate_internal(diffs | boost::adaptors::map_values, cl, false, std::move(trace_state)).handle_exception([] (std::exception_ptr eptr) {
+        slogger.debug("Background read repair failed: {}", eptr);
+    }).finally([p = shared_from_this()] {
+        --p->_background_read_repairs;
+    });
+    return make_ready_future<>();
 }
 
 class abstract_read_resolver {
@@ -2240,6 +2577,8 @@ class data_read_resolver : public abstract_read_resolver {
     stdx::optional<reconcilable_result> resolve(schema_ptr schema, const query::read_command& cmd, uint32_t original_row_limit, uint32_t original_per_partition_limit,
             uint32_t original_partition_limit) {
         assert(_data_results.size());
+        // Merging the replies of large partitions is a known source of stalls.
+        utils::task_context_guard task_ctx(utils::task_context::storage_proxy);
 
         if (_data_results.size() == 1) {
             // if there is a result only from one node there is nothing to reconcile
@@ -2289,11 +2628,12 @@ class data_read_resolver : public abstract_read_resolver {
             std::vector<version>& v = versions.back();
             v.reserve(_targets_count);
             for (reply& r : _data_results) {
-                auto pit = r.result->partitions().rbegin();
-                if (pit != r.result->partitions().rend() && pit->mut().key(s).legacy_equal(s, max_key)) {
-                    bool reached_partition_end = pit->row_count() < cmd.slice.partition_row_limit();
-                    v.emplace_back(r.from, std::move(*pit), r.reached_end, reached_partition_end);
-                    r.result->partitions().pop_back();
+                auto& partitions = r.result->partitions();
+                if (!partitions.empty() && partitions.back().mut().key(s).legacy_equal(s, max_key)) {
+                    auto& p = partitions.back();
+                    bool reached_partition_end = p.row_count() < cmd.slice.partition_row_limit();
+                    v.emplace_back(r.from, std::move(p), r.reached_end, reached_partition_end);
+                    partitions.pop_back();
                 } else {
                     // put empty partition for destination without result
                     v.emplace_back(r.from, stdx::optional<partition>(), r.reached_end, true);
@@ -2385,8 +2725,8 @@ class data_read_resolver : public abstract_read_resolver {
 
         // build reconcilable_result from reconciled data
         // traverse backwards since large keys are at the start
-        std::vector<partition> vec;
-        auto r = boost::accumulate(reconciled_partitions | boost::adaptors::reversed, std::ref(vec), [] (std::vector<partition>& a, const mutation_and_live_row_count& m_a_rc) {
+        utils::chunked_vector<partition> vec;
+        auto r = boost::accumulate(reconciled_partitions | boost::adaptors::reversed, std::ref(vec), [] (utils::chunked_vector<partition>& a, const mutation_and_live_row_count& m_a_rc) {
             a.emplace_back(partition(m_a_rc.live_row_count, freeze(m_a_rc.mut)));
             return std::ref(a);
         });
@@ -2401,6 +2741,12 @@ class data_read_resolver : public abstract_read_resolver {
     }
 };
 
+// MD5 is used until all nodes are able to compute the cheaper murmur3 digest.
+static query::digest_algorithm digest_algorithm_for_reads() {
+    return service::get_local_storage_service().cluster_supports_murmur3_digest()
+           ? query::digest_algorithm::MURMUR3 : query::digest_algorithm::MD5;
+}
+
 class abstract_read_executor : public enable_shared_from_this<abstract_read_executor> {
 protected:
     using targets_iterator = std::vector<gms::inet_address>::iterator;
@@ -2419,12 +2765,14 @@ class abstract_read_executor : public enable_shared_from_this<abstract_read_exec
     promise<foreign_ptr<lw_shared_ptr<query::result>>> _result_promise;
     tracing::trace_state_ptr _trace_state;
     lw_shared_ptr<column_family> _cf;
+    // Chosen once, so that all replicas of this read compute comparable digests.
+    query::digest_algorithm _digest_algorithm;
 
 public:
     abstract_read_executor(schema_ptr s, lw_shared_ptr<column_family> cf, shared_ptr<storage_proxy> proxy, lw_shared_ptr<query::read_command> cmd, dht::partition_range pr, db::consistency_level cl, size_t block_for,
             std::vector<gms::inet_address> targets, tracing::trace_state_ptr trace_state) :
                            _schema(std::move(s)), _proxy(std::move(proxy)), _cmd(std::move(cmd)), _partition_range(std::move(pr)), _cl(cl), _block_for(block_for), _targets(std::move(targets)), _trace_state(std::move(trace_state)),
-                           _cf(std::move(cf)) {
+                           _cf(std::move(cf)), _digest_algorithm(digest_algorithm_for_reads()) {
         _proxy->_stats.reads++;
     }
     virtual ~abstract_read_executor() {
@@ -2432,6 +2780,21 @@ class abstract_read_executor : public enable_shared_from_this<abstract_read_exec
     };
 
 protected:
+    replica_latency_tracker::clock::time_point start_replica_read(gms::inet_address ep) {
+        _proxy->_replica_latencies.start_read(ep);
+        return replica_latency_tracker::clock::now();
+    }
+    void end_replica_read(gms::inet_address ep, replica_latency_tracker::clock::time_point start) {
+        auto now = replica_latency_tracker::clock::now();
+        _proxy->_replica_latencies.end_read(ep, now - start, now);
+    }
+    // Single partition reads go to the shard of the replica which owns the partition.
+    netw::messaging_service::msg_addr replica_addr(netw::messaging_service& ms, gms::inet_address ep) const {
+        if (!_partition_range.is_singular()) {
+            return netw::messaging_service::msg_addr{ep, 0};
+        }
+        return ms.replica_addr(ep, _partition_range.start()->value().token());
+    }
     future<foreign_ptr<lw_shared_ptr<reconcilable_result>>, cache_temperature> make_mutation_data_request(lw_shared_ptr<query::read_command> cmd, gms::inet_address ep, clock_type::time_point timeout) {
         ++_proxy->_stats.mutation_data_read_attempts.get_ep_stat(ep);
         if (is_me(ep)) {
@@ -2440,7 +2803,7 @@ class abstract_read_executor : public enable_shared_from_this<abstract_read_exec
         } else {
             auto& ms = netw::get_local_messaging_service();
             tracing::trace(_trace_state, "read_mutation_data: sending a message to /{}", ep);
-            return ms.send_read_mutation_data(netw::messaging_service::msg_addr{ep, 0}, timeout, *cmd, _partition_range).then([this, ep](reconcilable_result&& result, rpc::optional<cache_temperature> hit_rate) {
+            return ms.send_read_mutation_data(replica_addr(ms, ep), timeout, *cmd, _partition_range).then([this, ep](reconcilable_result&& result, rpc::optional<cache_temperature> hit_rate) {
                 tracing::trace(_trace_state, "read_mutation_data: got response from /{}", ep);
                 return make_ready_future<foreign_ptr<lw_shared_ptr<reconcilable_result>>, cache_temperature>(make_foreign(::make_lw_shared<reconcilable_result>(std::move(result))), hit_rate.value_or(cache_temperature::invalid()));
             });
@@ -2451,12 +2814,12 @@ class abstract_read_executor : public enable_shared_from_this<abstract_read_exec
         if (is_me(ep)) {
             tracing::trace(_trace_state, "read_data: querying locally");
             auto qrr = want_digest ? query::result_request::result_and_digest : query::result_request::only_result;
-            return _proxy->query_result_local(_schema, _cmd, _partition_range, qrr, _trace_state);
+            return _proxy->query_result_local(_schema, _cmd, _partition_range, query::result_options(qrr, _digest_algorithm), _trace_state);
         } else {
             auto& ms = netw::get_local_messaging_service();
             tracing::trace(_trace_state, "read_data: sending a message to /{}", ep);
-            auto da = want_digest ? query::digest_algorithm::MD5 : query::digest_algorithm::none;
-            return ms.send_read_data(netw::messaging_service::msg_addr{ep, 0}, timeout, *_cmd, _partition_range, da).then([this, ep](query::result&& result, rpc::optional<cache_temperature> hit_rate) {
+            auto da = want_digest ? _digest_algorithm : query::digest_algorithm::none;
+            return ms.send_read_data(replica_addr(ms, ep), timeout, *_cmd, _partition_range, da).then([this, ep](query::result&& result, rpc::optional<cache_temperature> hit_rate) {
                 tracing::trace(_trace_state, "read_data: got response from /{}", ep);
                 return make_ready_future<foreign_ptr<lw_shared_ptr<query::result>>, cache_temperature>(make_foreign(::make_lw_shared<query::result>(std::move(result))), hit_rate.value_or(cache_temperature::invalid()));
             });
@@ -2466,11 +2829,11 @@ class abstract_read_executor : public enable_shared_from_this<abstract_read_exec
         ++_proxy->_stats.digest_read_attempts.get_ep_stat(ep);
         if (is_me(ep)) {
             tracing::trace(_trace_state, "read_digest: querying locally");
-            return _proxy->query_result_local_digest(_schema, _cmd, _partition_range, _trace_state);
+            return _proxy->query_result_local_digest(_schema, _cmd, _partition_range, _trace_state, _digest_algorithm);
         } else {
             auto& ms = netw::get_local_messaging_service();
             tracing::trace(_trace_state, "read_digest: sending a message to /{}", ep);
-            return ms.send_read_digest(netw::messaging_service::msg_addr{ep, 0}, timeout, *_cmd, _partition_range).then([this, ep] (query::result_digest d, rpc::optional<api::timestamp_type> t,
+            return ms.send_read_digest(replica_addr(ms, ep), timeout, *_cmd, _partition_range, _digest_algorithm).then([this, ep] (query::result_digest d, rpc::optional<api::timestamp_type> t,
                     rpc::optional<cache_temperature> hit_rate) {
                 tracing::trace(_trace_state, "read_digest: got response from /{}", ep);
                 return make_ready_future<query::result_digest, api::timestamp_type, cache_temperature>(d, t ? t.value() : api::missing_timestamp, hit_rate.value_or(cache_temperature::invalid()));
@@ -2479,10 +2842,12 @@ class abstract_read_executor : public enable_shared_from_this<abstract_read_exec
     }
     future<> make_mutation_data_requests(lw_shared_ptr<query::read_command> cmd, data_resolver_ptr resolver, targets_iterator begin, targets_iterator end, clock_type::time_point timeout) {
         return parallel_for_each(begin, end, [this, &cmd, resolver = std::move(resolver), timeout] (gms::inet_address ep) {
-            return make_mutation_data_request(cmd, ep, timeout).then_wrapped([this, resolver, ep] (future<foreign_ptr<lw_shared_ptr<reconcilable_result>>, cache_temperature> f) {
+            auto start = start_replica_read(ep);
+            return make_mutation_data_request(cmd, ep, timeout).then_wrapped([this, resolver, ep, start] (future<foreign_ptr<lw_shared_ptr<reconcilable_result>>, cache_temperature> f) {
+                end_replica_read(ep, start);
                 try {
                     auto v = f.get();
-                    _cf->set_hit_rate(ep, std::get<1>(v));
+                    _cf->set_hit_rate(ep, _partition_range, std::get<1>(v));
                     resolver->add_mutate_data(ep, std::get<0>(std::move(v)));
                     ++_proxy->_stats.mutation_data_read_completed.get_ep_stat(ep);
                 } catch(...) {
@@ -2494,10 +2859,12 @@ class abstract_read_executor : public enable_shared_from_this<abstract_read_exec
     }
     future<> make_data_requests(digest_resolver_ptr resolver, targets_iterator begin, targets_iterator end, clock_type::time_point timeout, bool want_digest) {
         return parallel_for_each(begin, end, [this, resolver = std::move(resolver), timeout, want_digest] (gms::inet_address ep) {
-            return make_data_request(ep, timeout, want_digest).then_wrapped([this, resolver, ep] (future<foreign_ptr<lw_shared_ptr<query::result>>, cache_temperature> f) {
+            auto start = start_replica_read(ep);
+            return make_data_request(ep, timeout, want_digest).then_wrapped([this, resolver, ep, start] (future<foreign_ptr<lw_shared_ptr<query::result>>, cache_temperature> f) {
+                end_replica_read(ep, start);
                 try {
                     auto v = f.get();
-                    _cf->set_hit_rate(ep, std::get<1>(v));
+                    _cf->set_hit_rate(ep, _partition_range, std::get<1>(v));
                     resolver->add_data(ep, std::get<0>(std::move(v)));
                     ++_proxy->_stats.data_read_completed.get_ep_stat(ep);
                 } catch(...) {
@@ -2509,10 +2876,12 @@ class abstract_read_executor : public enable_shared_from_this<abstract_read_exec
     }
     future<> make_digest_requests(digest_resolver_ptr resolver, targets_iterator begin, targets_iterator end, clock_type::time_point timeout) {
         return parallel_for_each(begin, end, [this, resolver = std::move(resolver), timeout] (gms::inet_address ep) {
-            return make_digest_request(ep, timeout).then_wrapped([this, resolver, ep] (future<query::result_digest, api::timestamp_type, cache_temperature> f) {
+            auto start = start_replica_read(ep);
+            return make_digest_request(ep, timeout).then_wrapped([this, resolver, ep, start] (future<query::result_digest, api::timestamp_type, cache_temperature> f) {
+                end_replica_read(ep, start);
                 try {
                     auto v = f.get();
-                    _cf->set_hit_rate(ep, std::get<2>(v));
+                    _cf->set_hit_rate(ep, _partition_range, std::get<2>(v));
                     resolver->add_digest(ep, std::get<0>(v), std::get<1>(v));
                     ++_proxy->_stats.digest_read_completed.get_ep_stat(ep);
                 } catch(...) {
@@ -2554,14 +2923,34 @@ class abstract_read_executor : public enable_shared_from_this<abstract_read_exec
                 // than the total number of column we are interested in (which may be < count on a retry).
                 // So in particular, if no host returned count live columns, we know it's not a short read.
                 bool can_send_short_read = rr_opt && rr_opt->is_short_read() && rr_opt->row_count() > 0;
+                lw_shared_ptr<query::result> data_result;
+                bool filtered_out = false;
                 if (rr_opt && (can_send_short_read || data_resolver->all_reached_end() || rr_opt->row_count() >= original_row_limit()
                                || data_resolver->live_partition_count() >= original_partition_limit())
                         && !data_resolver->any_partition_short_read()) {
-                    auto result = ::make_foreign(::make_lw_shared(
-                            to_data_query_result(std::move(*rr_opt), _schema, _cmd->slice, _cmd->row_limit, cmd->partition_limit)));
-                    // wait for write to complete before returning result to prevent multiple concurrent read requests to
-                    // trigger repair multiple times and to prevent quorum read to return an old value, even after a quorum
-                    // another read had returned a newer value (but the newer value had not yet been sent to the other replicas)
+                    data_result = ::make_lw_shared(
+                            to_data_query_result(std::move(*rr_opt), _schema, _cmd->slice, _cmd->row_limit, cmd->partition_limit));
+                    // The rows which don't satisfy the filters of the query were
+                    // counted against the limits, so there may be more rows to
+                    // return than those which do.
+                    if (!_cmd->slice.filters().empty() && !data_result->is_short_read() && !data_resolver->all_reached_end()) {
+                        data_result->ensure_counts();
+                        if (*data_result->row_count() < original_row_limit() && *data_result->partition_count() < original_partition_limit()) {
+                            if (*data_result->row_count() && _cmd->slice.options.contains<query::partition_slice::option::allow_short_read>()) {
+                                data_result->mark_as_short_read();
+                            } else {
+                                data_result = { };
+                                filtered_out = true;
+                            }
+                        }
+                    }
+                }
+                if (data_result) {
+                    auto result = ::make_foreign(std::move(data_result));
+                    // The repair writes only what each replica misses. It is waited for only when it can't be sent
+                    // in the background, as waiting prevents concurrent reads from triggering the repair several
+                    // times, and a quorum read from returning an old value after another read had returned a newer
+                    // one, at the cost of the latency of the read. Setting max_background_read_repairs to 0 always waits.
                     _proxy->schedule_repair(data_resolver->get_diffs_for_repair(), _cl, _trace_state).then([this, result = std::move(result)] () mutable {
                         _result_promise.set_value(std::move(result));
                     }).handle_exception([this, exec] (std::exception_ptr eptr) {
@@ -2599,6 +2988,11 @@ class abstract_read_executor : public enable_shared_from_this<abstract_read_exec
                             _retry_cmd->row_limit = x(cmd->row_limit, data_resolver->total_live_count());
                         }
                     }
+                    if (filtered_out) {
+                        // None of the rows read satisfy the filters, read more of them.
+                        _retry_cmd->row_limit = std::max(_retry_cmd->row_limit,
+                                static_cast<uint32_t>(std::min<uint64_t>(query::max_rows, uint64_t(cmd->row_limit) * 2)));
+                    }
 
                     // We may be unable to send a single live row because of replicas bailing out too early.
                     // If that is the case disallow short reads so that we can make progress.
@@ -2615,7 +3009,16 @@ class abstract_read_executor : public enable_shared_from_this<abstract_read_exec
         });
     }
     void reconcile(db::consistency_level cl, storage_proxy::clock_type::time_point timeout) {
-        reconcile(cl, timeout, _cmd);
+        if (_cmd->slice.filters().empty()) {
+            reconcile(cl, timeout, _cmd);
+            return;
+        }
+        // Replicas which filtered the rows they send to be reconciled would
+        // leave out the newer versions of those which no longer satisfy the
+        // filters, so the coordinator filters them once reconciled.
+        auto cmd = make_lw_shared<query::read_command>(*_cmd);
+        cmd->slice.set_filters({ });
+        reconcile(cl, timeout, std::move(cmd));
     }
 
 public:
@@ -2682,6 +3085,10 @@ class abstract_read_executor : public enable_shared_from_this<abstract_read_exec
     lw_shared_ptr<column_family>& get_cf() {
         return _cf;
     }
+
+    db::consistency_level get_cl() const {
+        return _cl;
+    }
 };
 
 class never_speculating_read_executor : public abstract_read_executor {
@@ -2712,7 +3119,8 @@ class speculating_read_executor : public abstract_read_executor {
     using abstract_read_executor::abstract_read_executor;
     virtual future<> make_requests(digest_resolver_ptr resolver, storage_proxy::clock_type::time_point timeout) {
         _speculate_timer.set_callback([this, resolver, timeout] {
-            if (!resolver->is_completed()) { // at the time the callback runs request may be completed already
+            // at the time the callback runs request may be completed already
+            if (!resolver->is_completed() && _proxy->try_speculate()) {
                 resolver->add_wait_targets(1); // we send one more request so wait for it too
                 // FIXME: consider disabling for CL=*ONE
                 bool want_digest = true;
@@ -2724,9 +3132,9 @@ class speculating_read_executor : public abstract_read_executor {
         });
         auto& sr = _schema->speculative_retry();
         auto t = (sr.get_type() == speculative_retry::type::PERCENTILE) ?
-            std::min(_cf->get_coordinator_read_latency_percentile(sr.get_value()), std::chrono::milliseconds(_proxy->get_db().local().get_config().read_request_timeout_in_ms()/2)) :
-            std::chrono::milliseconds(unsigned(sr.get_value()));
-        _speculate_timer.arm(t);
+            std::min(_cf->get_coordinator_read_latency_percentile(_cl, sr.get_value()), std::chrono::microseconds(std::chrono::milliseconds(_proxy->get_db().local().get_config().read_request_timeout_in_ms()/2))) :
+            std::chrono::microseconds(std::chrono::milliseconds(unsigned(sr.get_value())));
+        _speculate_timer.arm(std::chrono::duration_cast<storage_proxy::clock_type::duration>(t));
 
         // if CL + RR result in covering all replicas, getReadExecutor forces AlwaysSpeculating.  So we know
         // that the last replica in our list is "extra."
@@ -2763,6 +3171,27 @@ class range_slice_read_executor : public never_speculating_read_executor {
     }
 };
 
+// Speculative reads may come in bursts, when a replica stalls, but not for
+// longer than it takes to spend this much credit.
+static constexpr double max_speculative_read_credit = 100;
+
+void storage_proxy::earn_speculative_read_credit() {
+    auto percent = _db.local().get_config().speculative_retry_budget_percent();
+    _speculative_read_credit = std::min(max_speculative_read_credit, _speculative_read_credit + percent / 100);
+}
+
+bool storage_proxy::try_speculate() {
+    if (_db.local().get_config().speculative_retry_budget_percent() < 100) {
+        if (_speculative_read_credit < 1) {
+            _stats.speculative_reads_over_budget++;
+            return false;
+        }
+        _speculative_read_credit -= 1;
+    }
+    _stats.speculative_reads++;
+    return true;
+}
+
 db::read_repair_decision storage_proxy::new_read_repair_decision(const schema& s) {
     double chance = _read_repair_chance(_urandom);
     if (s.read_repair_chance() > chance) {
@@ -2782,13 +3211,14 @@ ::shared_ptr<abstract_read_executor> storage_proxy::get_read_executor(lw_shared_
     keyspace& ks = _db.local().find_keyspace(schema->ks_name());
     speculative_retry::type retry_type = schema->speculative_retry().get_type();
     gms::inet_address extra_replica;
+    earn_speculative_read_credit();
 
     std::vector<gms::inet_address> all_replicas = get_live_sorted_endpoints(ks, token);
     db::read_repair_decision repair_decision = new_read_repair_decision(*schema);
     auto cf = _db.local().find_column_family(schema).shared_from_this();
     std::vector<gms::inet_address> target_replicas = db::filter_for_query(cl, ks, all_replicas, repair_decision,
             retry_type == speculative_retry::type::NONE ? nullptr : &extra_replica,
-            _db.local().get_config().cache_hit_rate_read_balancing() ? &*cf : nullptr);
+            _db.local().get_config().cache_hit_rate_read_balancing() ? &*cf : nullptr, &token);
 
     slogger.trace("creating read executor for token {} with all: {} targets: {} rp decision: {}", token, all_replicas, target_replicas, repair_decision);
     tracing::trace(trace_state, "Creating read executor for token {} with all: {} targets: {} repair decision: {}", token, all_replicas, target_replicas, repair_decision);
@@ -2844,29 +3274,195 @@ ::shared_ptr<abstract_read_executor> storage_proxy::get_read_executor(lw_shared_
 }
 
 future<query::result_digest, api::timestamp_type, cache_temperature>
-storage_proxy::query_result_local_digest(schema_ptr s, lw_shared_ptr<query::read_command> cmd, const dht::partition_range& pr, tracing::trace_state_ptr trace_state, uint64_t max_size) {
-    return query_result_local(std::move(s), std::move(cmd), pr, query::result_request::only_digest, std::move(trace_state), max_size).then([] (foreign_ptr<lw_shared_ptr<query::result>> result, cache_temperature hit_rate) {
+storage_proxy::query_result_local_digest(schema_ptr s, lw_shared_ptr<query::read_command> cmd, const dht::partition_range& pr, tracing::trace_state_ptr trace_state, query::digest_algorithm da, uint64_t max_size) {
+    return query_result_local(std::move(s), std::move(cmd), pr, query::result_options(query::result_request::only_digest, da), std::move(trace_state), max_size).then([] (foreign_ptr<lw_shared_ptr<query::result>> result, cache_temperature hit_rate) {
         return make_ready_future<query::result_digest, api::timestamp_type, cache_temperature>(*result->digest(), result->last_modified(), hit_rate);
     });
 }
 
 future<foreign_ptr<lw_shared_ptr<query::result>>, cache_temperature>
-storage_proxy::query_result_local(schema_ptr s, lw_shared_ptr<query::read_command> cmd, const dht::partition_range& pr, query::result_request request, tracing::trace_state_ptr trace_state, uint64_t max_size) {
+storage_proxy::query_result_local(schema_ptr s, lw_shared_ptr<query::read_command> cmd, const dht::partition_range& pr, query::result_options opts, tracing::trace_state_ptr trace_state, uint64_t max_size) {
     if (pr.is_singular()) {
         unsigned shard = _db.local().shard_of(pr.start()->value().token());
-        return _db.invoke_on(shard, [max_size, gs = global_schema_ptr(s), prv = dht::partition_range_vector({pr}) /* FIXME: pr is copied */, cmd, request, gt = tracing::global_trace_state_ptr(std::move(trace_state))] (database& db) mutable {
+        return _db.invoke_on(shard, [max_size, gs = global_schema_ptr(s), prv = dht::partition_range_vector({pr}) /* FIXME: pr is copied */, cmd, opts, gt = tracing::global_trace_state_ptr(std::move(trace_state))] (database& db) mutable {
             tracing::trace(gt, "Start querying the token range that starts with {}", seastar::value_of([&prv] { return prv.begin()->start()->value().token(); }));
-            return db.query(gs, *cmd, request, prv, gt, max_size).then([trace_state = gt.get()](auto&& f, cache_temperature ht) {
+            return db.query(gs, *cmd, opts, prv, gt, max_size).then([trace_state = gt.get()](auto&& f, cache_temperature ht) {
                 tracing::trace(trace_state, "Querying is done");
                 return make_ready_future<foreign_ptr<lw_shared_ptr<query::result>>, cache_temperature>(make_foreign(std::move(f)), ht);
             });
         });
     } else {
-        return query_nonsingular_mutations_locally(s, cmd, {pr}, std::move(trace_state), max_size).then([s, cmd, request] (foreign_ptr<lw_shared_ptr<reconcilable_result>>&& r, cache_temperature&& ht) {
+        return query_nonsingular_mutations_locally(s, cmd, {pr}, std::move(trace_state), max_size).then([s, cmd, opts] (foreign_ptr<lw_shared_ptr<reconcilable_result>>&& r, cache_temperature&& ht) {
             return make_ready_future<foreign_ptr<lw_shared_ptr<query::result>>, cache_temperature>(
-                    ::make_foreign(::make_lw_shared(to_data_query_result(*r, s, cmd->slice,  cmd->row_limit, cmd->partition_limit, request))), ht);
+                    ::make_foreign(::make_lw_shared(to_data_query_result(*r, s, cmd->slice,  cmd->row_limit, cmd->partition_limit, opts))), ht);
+        });
+    }
+}
+
+// Partitions read at a time when folding aggregates on a shard. Pages are not
+// cut short on size, so that each one ends at a partition boundary.
+static constexpr uint32_t aggregate_query_page_partitions = 100;
+
+// Feeds a page of results into the aggregates and remembers where it ended.
+class aggregate_page_visitor {
+    cql3::selection::result_set_builder::visitor _visitor;
+    stdx::optional<partition_key> _last_key;
+    uint32_t _partitions = 0;
+public:
+    aggregate_page_visitor(cql3::selection::result_set_builder& builder, const schema& s, const cql3::selection::selection& sel)
+        : _visitor(builder, s, sel)
+    { }
+    void accept_new_partition(const partition_key& key, uint32_t row_count) {
+        _last_key = key;
+        ++_partitions;
+        _visitor.accept_new_partition(key, row_count);
+    }
+    void accept_new_partition(uint32_t row_count) {
+        ++_partitions;
+        _visitor.accept_new_partition(row_count);
+    }
+    void accept_new_row(const clustering_key& key, const query::result_row_view& static_row, const query::result_row_view& row) {
+        _visitor.accept_new_row(key, static_row, row);
+    }
+    void accept_new_row(const query::result_row_view& static_row, const query::result_row_view& row) {
+        _visitor.accept_new_row(static_row, row);
+    }
+    void accept_partition_end(const query::result_row_view& static_row) {
+        _visitor.accept_partition_end(static_row);
+    }
+    uint32_t partitions() const {
+        return _partitions;
+    }
+    const stdx::optional<partition_key>& last_key() const {
+        return _last_key;
+    }
+};
+
+// Computes the aggregates over ranges owned by the current shard.
+static future<std::vector<bytes_opt>>
+query_aggregates_on_shard(database& db, schema_ptr s, query::read_command cmd, dht::partition_range_vector ranges,
+        const std::vector<query::aggregate_selector>& selectors, tracing::trace_state_ptr trace_state) {
+    struct aggregate_state {
+        schema_ptr s;
+        ::shared_ptr<cql3::selection::selection> sel;
+        cql3::selection::result_set_builder builder;
+        query::read_command cmd;
+        dht::partition_range_vector ranges;
+        dht::partition_range_vector page_range;
+
+        aggregate_state(database& db, schema_ptr s_, query::read_command cmd_, dht::partition_range_vector ranges_,
+                const std::vector<query::aggregate_selector>& selectors)
+            : s(std::move(s_))
+            , sel(cql3::selection::make_aggregate_selection(db, s, selectors))
+            , builder(*sel, cmd_.timestamp, cql_serialization_format::internal())
+            , cmd(std::move(cmd_))
+            , ranges(std::move(ranges_))
+        { }
+    };
+    cmd.row_limit = query::max_rows;
+    cmd.partition_limit = aggregate_query_page_partitions;
+    cmd.slice.options.set<query::partition_slice::option::send_partition_key>();
+    cmd.slice.options.remove<query::partition_slice::option::allow_short_read>();
+    auto st = std::make_unique<aggregate_state>(db, std::move(s), std::move(cmd), std::move(ranges), selectors);
+    auto& state = *st;
+    return do_for_each(state.ranges, [&db, &state, trace_state] (dht::partition_range& range) {
+        return repeat([&db, &state, &range, trace_state] {
+            state.page_range = { range };
+            return db.query(state.s, state.cmd, query::result_options(query::result_request::only_result, query::digest_algorithm::none),
+                    state.page_range, trace_state, query::result_memory_limiter::maximum_result_size).then([&state, &range] (lw_shared_ptr<query::result> res, cache_temperature) {
+                aggregate_page_visitor v(state.builder, *state.s, *state.sel);
+                query::result_view::consume(*res, state.cmd.slice, v);
+                if (v.partitions() < state.cmd.partition_limit) {
+                    return stop_iteration::yes;
+                }
+                dht::ring_position last(dht::global_partitioner().decorate_key(*state.s, *v.last_key()));
+                if (range.end() && range.end()->value().tri_compare(*state.s, last) <= 0) {
+                    return stop_iteration::yes;
+                }
+                range = dht::partition_range(dht::partition_range::bound(std::move(last), false), range.end());
+                return stop_iteration::no;
+            });
         });
+    }).then([&state] {
+        auto rs = state.builder.build();
+        return rs->rows().front();
+    }).finally([st = std::move(st)] { });
+}
+
+future<std::vector<bytes_opt>>
+storage_proxy::query_aggregates_locally(schema_ptr s, lw_shared_ptr<query::read_command> cmd, dht::partition_range_vector prs,
+        std::vector<query::aggregate_selector> selectors, tracing::trace_state_ptr trace_state) {
+    std::map<unsigned, dht::partition_range_vector> ranges_per_shard;
+    for (auto&& pr : prs) {
+        for (auto&& x : dht::split_range_to_shards(std::move(pr), *s)) {
+            auto& ranges = ranges_per_shard[x.first];
+            std::move(x.second.begin(), x.second.end(), std::back_inserter(ranges));
+        }
     }
+    auto sel = cql3::selection::make_aggregate_selection(_db.local(), s, selectors);
+    auto merger = cql3::selection::partial_aggregates_merger(*sel, selectors);
+    return do_with(std::move(ranges_per_shard), std::move(selectors), std::move(merger),
+            [this, s, cmd, gt = tracing::global_trace_state_ptr(std::move(trace_state))] (auto& ranges_per_shard, auto& selectors, auto& merger) {
+        return parallel_for_each(ranges_per_shard, [this, s, cmd, gt, &selectors, &merger] (auto& x) {
+            return _db.invoke_on(x.first, [gs = global_schema_ptr(s), cmd = *cmd, ranges = std::move(x.second), selectors, gt] (database& db) mutable {
+                return query_aggregates_on_shard(db, gs, std::move(cmd), std::move(ranges), selectors, gt);
+            }).then([&merger] (std::vector<bytes_opt> partial) {
+                merger.add(partial);
+            });
+        }).then([&merger] {
+            return merger.get();
+        });
+    });
+}
+
+future<std::vector<bytes_opt>>
+storage_proxy::query_aggregates(schema_ptr s, lw_shared_ptr<query::read_command> cmd, dht::partition_range_vector partition_ranges,
+        std::vector<query::aggregate_selector> selectors, db::consistency_level cl, tracing::trace_state_ptr trace_state) {
+    keyspace& ks = _db.local().find_keyspace(s->ks_name());
+    auto timeout = clock_type::now() + std::chrono::milliseconds(_db.local().get_config().range_request_timeout_in_ms());
+    dht::partition_range_vector ranges;
+    if (ks.get_replication_strategy().get_type() == locator::replication_strategy_type::local) {
+        ranges = std::move(partition_ranges);
+    } else {
+        for (auto&& r : partition_ranges) {
+            auto restricted_ranges = get_restricted_ranges(*s, std::move(r));
+            std::move(restricted_ranges.begin(), restricted_ranges.end(), std::back_inserter(ranges));
+        }
+    }
+
+    // Each replica gets all the ranges it was picked for in one request and folds them
+    // on all its shards in parallel, so only the partial results cross the network.
+    std::unordered_map<gms::inet_address, dht::partition_range_vector> ranges_per_endpoint;
+    for (auto&& r : ranges) {
+        auto live_endpoints = get_live_sorted_endpoints(ks, end_token(r));
+        auto endpoints = filter_for_query(cl, ks, live_endpoints, nullptr);
+        if (endpoints.empty()) {
+            throw exceptions::unavailable_exception(cl, block_for(ks, cl), 0);
+        }
+        ranges_per_endpoint[endpoints.front()].push_back(std::move(r));
+    }
+    tracing::trace(trace_state, "Querying aggregates of {} ranges from {} replicas", ranges.size(), ranges_per_endpoint.size());
+
+    auto sel = cql3::selection::make_aggregate_selection(_db.local(), s, selectors);
+    auto merger = cql3::selection::partial_aggregates_merger(*sel, selectors);
+    return do_with(std::move(ranges_per_endpoint), std::move(selectors), std::move(merger),
+            [this, s, cmd, timeout, trace_state = std::move(trace_state)] (auto& ranges_per_endpoint, auto& selectors, auto& merger) {
+        return parallel_for_each(ranges_per_endpoint, [this, s, cmd, timeout, trace_state, &selectors, &merger] (auto& x) {
+            auto f = make_ready_future<std::vector<bytes_opt>>();
+            if (is_me(x.first)) {
+                f = query_aggregates_locally(s, cmd, std::move(x.second), selectors, trace_state);
+            } else {
+                tracing::trace(trace_state, "Sending aggregate query of {} ranges to /{}", x.second.size(), x.first);
+                auto& ms = netw::get_local_messaging_service();
+                f = ms.send_aggregate_query(netw::messaging_service::msg_addr{x.first, 0}, timeout, *cmd, x.second, selectors);
+            }
+            return f.then([&merger] (std::vector<bytes_opt> partial) {
+                merger.add(partial);
+            });
+        }).then([&merger] {
+            return merger.get();
+        });
+    });
 }
 
 void storage_proxy::handle_read_error(std::exception_ptr eptr, bool range) {
@@ -2884,6 +3480,21 @@ void storage_proxy::handle_read_error(std::exception_ptr eptr, bool range) {
     }
 }
 
+// The size at which the coordinator stops adding the results of replicas
+// to a page, when the query asks for a byte budget and may be short.
+static uint64_t result_size_limit(const query::read_command& cmd) {
+    if (!cmd.max_result_size || !cmd.slice.options.contains<query::partition_slice::option::allow_short_read>()) {
+        return std::numeric_limits<uint64_t>::max();
+    }
+    return cmd.max_result_size;
+}
+
+static uint64_t results_size(const std::vector<foreign_ptr<lw_shared_ptr<query::result>>>& results) {
+    return boost::accumulate(results | boost::adaptors::transformed([] (const foreign_ptr<lw_shared_ptr<query::result>>& r) {
+        return uint64_t(r->buf().size());
+    }), uint64_t(0));
+}
+
 future<foreign_ptr<lw_shared_ptr<query::result>>>
 storage_proxy::query_singular(lw_shared_ptr<query::read_command> cmd, dht::partition_range_vector&& partition_ranges, db::consistency_level cl, tracing::trace_state_ptr trace_state) {
     std::vector<::shared_ptr<abstract_read_executor>> exec;
@@ -2897,20 +3508,27 @@ storage_proxy::query_singular(lw_shared_ptr<query::read_command> cmd, dht::parti
         exec.push_back(get_read_executor(cmd, std::move(pr), cl, trace_state));
     }
 
-    query::result_merger merger(cmd->row_limit, cmd->partition_limit);
+    query::result_merger merger(cmd->row_limit, cmd->partition_limit, result_size_limit(*cmd));
     merger.reserve(exec.size());
 
-    auto f = ::map_reduce(exec.begin(), exec.end(), [timeout] (::shared_ptr<abstract_read_executor>& rex) {
-        utils::latency_counter lc;
-        lc.start();
-        return rex->execute(timeout).finally([lc, rex] () mutable {
-            if (lc.is_start()) {
-                rex->get_cf()->add_coordinator_read_latency(lc.stop().latency());
-            }
+    // All partitions are read in parallel, up to max_concurrent_partition_reads
+    // at a time, and merged in the order of the ranges.
+    auto concurrency = _db.local().get_config().max_concurrent_partition_reads();
+    auto sem = make_lw_shared<semaphore>(concurrency ? concurrency : exec.size());
+
+    auto f = ::map_reduce(exec.begin(), exec.end(), [timeout, sem] (::shared_ptr<abstract_read_executor>& rex) {
+        return with_semaphore(*sem, 1, [timeout, rex] {
+            utils::latency_counter lc;
+            lc.start();
+            return rex->execute(timeout).finally([lc, rex] () mutable {
+                if (lc.is_start()) {
+                    rex->get_cf()->add_coordinator_read_latency(rex->get_cl(), lc.stop().latency());
+                }
+            });
         });
     }, std::move(merger));
 
-    return f.handle_exception([exec = std::move(exec), p = shared_from_this()] (std::exception_ptr eptr) {
+    return f.handle_exception([exec = std::move(exec), sem, p = shared_from_this()] (std::exception_ptr eptr) {
         // hold onto exec until read is complete
         p->handle_read_error(eptr, false);
         return make_exception_future<foreign_ptr<lw_shared_ptr<query::result>>>(eptr);
@@ -2920,7 +3538,7 @@ storage_proxy::query_singular(lw_shared_ptr<query::read_command> cmd, dht::parti
 future<std::vector<foreign_ptr<lw_shared_ptr<query::result>>>>
 storage_proxy::query_partition_key_range_concurrent(storage_proxy::clock_type::time_point timeout, std::vector<foreign_ptr<lw_shared_ptr<query::result>>>&& results,
         lw_shared_ptr<query::read_command> cmd, db::consistency_level cl, dht::partition_range_vector::iterator&& i,
-        dht::partition_range_vector&& ranges, int concurrency_factor, tracing::trace_state_ptr trace_state,
+        dht::partition_range_vector&& ranges, int concurrency_factor, bool parallel, semaphore_units<> memory, tracing::trace_state_ptr trace_state,
         uint32_t remaining_row_count, uint32_t remaining_partition_count) {
     schema_ptr schema = local_schema_registry().get(cmd->schema_version);
     keyspace& ks = _db.local().find_keyspace(schema->ks_name());
@@ -2940,7 +3558,8 @@ storage_proxy::query_partition_key_range_concurrent(storage_proxy::clock_type::t
         // getRestrictedRange has broken the queried range into per-[vnode] token ranges, but this doesn't take
         // the replication factor into account. If the intersection of live endpoints for 2 consecutive ranges
         // still meets the CL requirements, then we can merge both ranges into the same RangeSliceCommand.
-        while (i != ranges.end())
+        // Parallel scans don't, so that the ranges are read from as many replicas as possible at once.
+        while (!parallel && i != ranges.end())
         {
             dht::partition_range& next_range = *i;
             std::vector<gms::inet_address> next_endpoints = get_live_sorted_endpoints(ks, end_token(next_range));
@@ -3008,7 +3627,7 @@ storage_proxy::query_partition_key_range_concurrent(storage_proxy::clock_type::t
         exec.push_back(::make_shared<range_slice_read_executor>(schema, cf.shared_from_this(), p, cmd, std::move(range), cl, std::move(filtered_endpoints), trace_state));
     }
 
-    query::result_merger merger(cmd->row_limit, cmd->partition_limit);
+    query::result_merger merger(cmd->row_limit, cmd->partition_limit, result_size_limit(*cmd));
     merger.reserve(exec.size());
 
     auto f = ::map_reduce(exec.begin(), exec.end(), [timeout] (::shared_ptr<abstract_read_executor>& rex) {
@@ -3016,19 +3635,32 @@ storage_proxy::query_partition_key_range_concurrent(storage_proxy::clock_type::t
     }, std::move(merger));
 
     return f.then([p, exec = std::move(exec), results = std::move(results), i = std::move(i), ranges = std::move(ranges),
-                   cl, cmd, concurrency_factor, timeout, remaining_row_count, remaining_partition_count, trace_state = std::move(trace_state)]
+                   cl, cmd, concurrency_factor, parallel, memory = std::move(memory), timeout, remaining_row_count, remaining_partition_count, trace_state = std::move(trace_state)]
                    (foreign_ptr<lw_shared_ptr<query::result>>&& result) mutable {
+        {
+            // The reads of this round are done; their memory is released before waiting for that of the next one.
+            auto done = std::move(memory);
+        }
         result->ensure_counts();
         remaining_row_count -= result->row_count().value();
         remaining_partition_count -= result->partition_count().value();
         results.emplace_back(std::move(result));
         if (i == ranges.end() || !remaining_row_count || !remaining_partition_count) {
             return make_ready_future<std::vector<foreign_ptr<lw_shared_ptr<query::result>>>>(std::move(results));
+        } else if (results_size(results) >= result_size_limit(*cmd)) {
+            // The page is full, the next one starts with the ranges left.
+            results.back()->mark_as_short_read();
+            return make_ready_future<std::vector<foreign_ptr<lw_shared_ptr<query::result>>>>(std::move(results));
         } else {
             cmd->row_limit = remaining_row_count;
             cmd->partition_limit = remaining_partition_count;
+            if (parallel) {
+                return p->query_partition_key_range_parallel(timeout, std::move(results), cmd, cl, std::move(i),
+                        std::move(ranges), std::move(trace_state), remaining_row_count, remaining_partition_count);
+            }
             return p->query_partition_key_range_concurrent(timeout, std::move(results), cmd, cl, std::move(i),
-                    std::move(ranges), concurrency_factor * 2, std::move(trace_state), remaining_row_count, remaining_partition_count);
+                    std::move(ranges), concurrency_factor * 2, false, semaphore_units<>(p->_parallel_scan_memory, 0), std::move(trace_state),
+                    remaining_row_count, remaining_partition_count);
         }
     }).handle_exception([p] (std::exception_ptr eptr) {
         p->handle_read_error(eptr, true);
@@ -3036,6 +3668,26 @@ storage_proxy::query_partition_key_range_concurrent(storage_proxy::clock_type::t
     });
 }
 
+// A round of a parallel scan reads as many ranges as the configured concurrency
+// and the memory left for the results of parallel scans allow, at least one.
+future<std::vector<foreign_ptr<lw_shared_ptr<query::result>>>>
+storage_proxy::query_partition_key_range_parallel(storage_proxy::clock_type::time_point timeout, std::vector<foreign_ptr<lw_shared_ptr<query::result>>>&& results,
+        lw_shared_ptr<query::read_command> cmd, db::consistency_level cl, dht::partition_range_vector::iterator&& i,
+        dht::partition_range_vector&& ranges, tracing::trace_state_ptr trace_state,
+        uint32_t remaining_row_count, uint32_t remaining_partition_count) {
+    auto& cfg = _db.local().get_config();
+    auto memory_limit = std::max<size_t>(1, size_t(cfg.parallel_range_scan_memory_in_mb()) * 1024 * 1024 / query::result_memory_limiter::maximum_result_size);
+    auto concurrency = std::min<size_t>(std::max<uint32_t>(1, cfg.parallel_range_scan_concurrency()), std::distance(i, ranges.end()));
+    auto available = _parallel_scan_memory.current() / query::result_memory_limiter::maximum_result_size;
+    concurrency = std::max<size_t>(1, std::min({concurrency, memory_limit, available}));
+    return get_units(_parallel_scan_memory, concurrency * query::result_memory_limiter::maximum_result_size).then([p = shared_from_this(), timeout, results = std::move(results),
+            cmd, cl, i = std::move(i), ranges = std::move(ranges), concurrency, trace_state = std::move(trace_state),
+            remaining_row_count, remaining_partition_count] (semaphore_units<> memory) mutable {
+        return p->query_partition_key_range_concurrent(timeout, std::move(results), cmd, cl, std::move(i), std::move(ranges), concurrency,
+                true, std::move(memory), std::move(trace_state), remaining_row_count, remaining_partition_count);
+    });
+}
+
 future<foreign_ptr<lw_shared_ptr<query::result>>>
 storage_proxy::query_partition_key_range(lw_shared_ptr<query::read_command> cmd, dht::partition_range_vector partition_ranges, db::consistency_level cl, tracing::trace_state_ptr trace_state) {
     schema_ptr schema = local_schema_registry().get(cmd->schema_version);
@@ -3068,15 +3720,30 @@ storage_proxy::query_partition_key_range(lw_shared_ptr<query::read_command> cmd,
     int concurrency_factor = 1;
 #endif
 
+    // A parallel scan reads the ranges it is split into concurrently from the
+    // first round on, instead of ramping the concurrency up. The results are
+    // still merged in the order of the ranges.
+    auto& cfg = _db.local().get_config();
+    auto parallel = ranges.size() > 1 && (cmd->slice.options.contains(query::partition_slice::option::parallel_scan)
+            || (cfg.parallel_range_scan_min_rows() && cmd->row_limit >= cfg.parallel_range_scan_min_rows()));
+
     std::vector<foreign_ptr<lw_shared_ptr<query::result>>> results;
     results.reserve(ranges.size()/concurrency_factor + 1);
-    slogger.debug("Estimated result rows per range: {}; requested rows: {}, ranges.size(): {}; concurrent range requests: {}",
-            result_rows_per_range, cmd->row_limit, ranges.size(), concurrency_factor);
-
-    return query_partition_key_range_concurrent(timeout, std::move(results), cmd, cl, ranges.begin(), std::move(ranges), concurrency_factor,
-                                                std::move(trace_state), cmd->row_limit, cmd->partition_limit)
-            .then([row_limit = cmd->row_limit, partition_limit = cmd->partition_limit](std::vector<foreign_ptr<lw_shared_ptr<query::result>>> results) {
-        query::result_merger merger(row_limit, partition_limit);
+    slogger.debug("Estimated result rows per range: {}; requested rows: {}, ranges.size(): {}; concurrent range requests: {}; parallel: {}",
+            result_rows_per_range, cmd->row_limit, ranges.size(), concurrency_factor, parallel);
+
+    future<std::vector<foreign_ptr<lw_shared_ptr<query::result>>>> f = make_ready_future<std::vector<foreign_ptr<lw_shared_ptr<query::result>>>>();
+    if (parallel) {
+        ++_stats.parallel_range_scans;
+        f = query_partition_key_range_parallel(timeout, std::move(results), cmd, cl, ranges.begin(), std::move(ranges),
+                std::move(trace_state), cmd->row_limit, cmd->partition_limit);
+    } else {
+        f = query_partition_key_range_concurrent(timeout, std::move(results), cmd, cl, ranges.begin(), std::move(ranges), concurrency_factor,
+                false, semaphore_units<>(_parallel_scan_memory, 0), std::move(trace_state), cmd->row_limit, cmd->partition_limit);
+    }
+    return f.then([row_limit = cmd->row_limit, partition_limit = cmd->partition_limit, max_size = result_size_limit(*cmd)] (
+            std::vector<foreign_ptr<lw_shared_ptr<query::result>>> results) {
+        query::result_merger merger(row_limit, partition_limit, max_size);
         merger.reserve(results.size());
 
         for (auto&& r: results) {
@@ -3087,11 +3754,68 @@ storage_proxy::query_partition_key_range(lw_shared_ptr<query::read_command> cmd,
     });
 }
 
+void storage_proxy::invalidate_cached_results(const schema& s, const dht::token& token) {
+    if (s.caching_options().coordinator_ttl().count()) {
+        _result_cache.invalidate(s.id(), token);
+    }
+}
+
+// The key of a read in the coordinator result cache: all of its command but
+// what doesn't change its result, and its partitions. Disengaged for reads
+// which can't be cached.
+static stdx::optional<bytes> result_cache_key(const query::read_command& cmd, const dht::partition_range_vector& partition_ranges,
+        db::consistency_level cl) {
+    if (cl != db::consistency_level::ONE && cl != db::consistency_level::LOCAL_ONE) {
+        return { };
+    }
+    if (!boost::algorithm::all_of(partition_ranges, [] (const dht::partition_range& r) { return query::is_single_partition(r); })) {
+        return { };
+    }
+    auto c = cmd;
+    c.timestamp = gc_clock::time_point();
+    c.trace_info = stdx::nullopt;
+    c.query_uuid = utils::UUID();
+    c.is_first_page = false;
+    c.service_level = sstring();
+    bytes_ostream out;
+    ser::serialize(out, c);
+    ser::serialize(out, partition_ranges);
+    return to_bytes(out.linearize());
+}
+
 future<foreign_ptr<lw_shared_ptr<query::result>>>
 storage_proxy::query(schema_ptr s,
     lw_shared_ptr<query::read_command> cmd,
     dht::partition_range_vector&& partition_ranges,
     db::consistency_level cl, tracing::trace_state_ptr trace_state)
+{
+    auto ttl = s->caching_options().coordinator_ttl();
+    auto key = ttl.count() ? result_cache_key(*cmd, partition_ranges, cl) : stdx::nullopt;
+    if (!key) {
+        return query_uncached(std::move(s), std::move(cmd), std::move(partition_ranges), cl, std::move(trace_state));
+    }
+    if (auto r = _result_cache.get(*key)) {
+        tracing::trace(trace_state, "Result given by the coordinator result cache");
+        return make_ready_future<foreign_ptr<lw_shared_ptr<query::result>>>(make_foreign(std::move(r)));
+    }
+    auto tokens = boost::copy_range<std::vector<dht::token>>(partition_ranges | boost::adaptors::transformed([] (const dht::partition_range& r) {
+        return r.start()->value().token();
+    }));
+    auto generation = _result_cache.generation();
+    return query_uncached(s, std::move(cmd), std::move(partition_ranges), cl, std::move(trace_state)).then(
+            [p = shared_from_this(), s, key = std::move(*key), tokens = std::move(tokens), ttl, generation] (foreign_ptr<lw_shared_ptr<query::result>> res) mutable {
+        // A copy, without the memory accounting of the read.
+        auto copy = make_lw_shared<query::result>(bytes_ostream(res->buf()), res->is_short_read(), res->row_count(), res->partition_count());
+        p->_result_cache.put(std::move(key), s->id(), std::move(tokens), std::move(copy), ttl, generation);
+        return std::move(res);
+    });
+}
+
+future<foreign_ptr<lw_shared_ptr<query::result>>>
+storage_proxy::query_uncached(schema_ptr s,
+    lw_shared_ptr<query::read_command> cmd,
+    dht::partition_range_vector&& partition_ranges,
+    db::consistency_level cl, tracing::trace_state_ptr trace_state)
 {
     if (slogger.is_enabled(logging::log_level::trace) || qlogger.is_enabled(logging::log_level::trace)) {
         static thread_local int next_id = 0;
@@ -3137,9 +3861,6 @@ storage_proxy::do_query(schema_ptr s,
         try {
             return query_singular(cmd, std::move(partition_ranges), cl, std::move(trace_state)).finally([lc, p] () mutable {
                     p->_stats.read.mark(lc.stop().latency());
-                    if (lc.is_start()) {
-                        p->_stats.estimated_read.add(lc.latency(), p->_stats.read.hist.count);
-                    }
             });
         } catch (const no_such_column_family&) {
             _stats.read.mark(lc.stop().latency());
@@ -3149,9 +3870,6 @@ storage_proxy::do_query(schema_ptr s,
 
     return query_partition_key_range(cmd, std::move(partition_ranges), cl, std::move(trace_state)).finally([lc, p] () mutable {
         p->_stats.range.mark(lc.stop().latency());
-        if (lc.is_start()) {
-            p->_stats.estimated_range.add(lc.latency(), p->_stats.range.hist.count);
-        }
     });
 }
 
@@ -3221,6 +3939,385 @@ storage_proxy::do_query(schema_ptr s,
     }
 #endif
 
+namespace {
+
+// The replicas taking part in the Paxos rounds of a partition.
+struct paxos_participants {
+    // Closest first.
+    std::vector<gms::inet_address> live;
+    size_t required;
+};
+
+}
+
+static paxos_participants get_paxos_participants(keyspace& ks, const schema& s, const dht::token& token, db::consistency_level cl_for_paxos) {
+    auto natural = ks.get_replication_strategy().get_natural_endpoints(token);
+    auto pending = get_local_storage_service().get_token_metadata().pending_endpoints_for(token, s.ks_name());
+    pending.erase(boost::range::remove_if(pending, [&natural] (gms::inet_address ep) {
+        return boost::range::find(natural, ep) != natural.end();
+    }), pending.end());
+    if (cl_for_paxos == db::consistency_level::LOCAL_SERIAL) {
+        auto not_local = [] (gms::inet_address ep) { return !db::is_local(ep); };
+        natural.erase(boost::range::remove_if(natural, not_local), natural.end());
+        pending.erase(boost::range::remove_if(pending, not_local), pending.end());
+    }
+    // Like the writes, the rounds need the pending replicas on top of a
+    // quorum of the natural ones, so that a quorum remains after the move.
+    auto required = natural.size() / 2 + 1 + pending.size();
+    std::vector<gms::inet_address> live;
+    for (auto ep : boost::range::join(natural, pending)) {
+        if (gms::get_local_failure_detector().is_alive(ep)) {
+            live.push_back(ep);
+        }
+    }
+    if (live.size() < required) {
+        throw exceptions::unavailable_exception(cl_for_paxos, required, live.size());
+    }
+    auto my_address = utils::fb_utilities::get_broadcast_address();
+    locator::i_endpoint_snitch::get_local_snitch_ptr()->sort_by_proximity(my_address, live);
+    auto it = boost::range::find(live, my_address);
+    if (it != live.end() && it != live.begin()) {
+        std::iter_swap(it, live.begin());
+    }
+    return paxos_participants{std::move(live), required};
+}
+
+// Resolves with the responses of the first `needed` futures to succeed, or
+// with those of all which did, once they all completed, if fewer did. The
+// others complete in the background.
+template <typename T>
+static future<std::vector<T>> first_responses(std::vector<future<T>> futures, size_t needed) {
+    struct collector {
+        std::vector<T> responses;
+        size_t pending;
+        size_t needed;
+        promise<std::vector<T>> done;
+        bool resolved = false;
+
+        void maybe_resolve() {
+            if (!resolved && (responses.size() >= needed || !pending)) {
+                resolved = true;
+                done.set_value(std::move(responses));
+            }
+        }
+    };
+    auto c = make_lw_shared<collector>();
+    c->pending = futures.size();
+    c->needed = needed;
+    auto result = c->done.get_future();
+    for (auto& f : futures) {
+        f.then_wrapped([c] (future<T> f) {
+            --c->pending;
+            try {
+                auto response = f.get0();
+                if (!c->resolved) {
+                    c->responses.push_back(std::move(response));
+                }
+            } catch (...) {
+                slogger.debug("Paxos message failed: {}", std::current_exception());
+            }
+            c->maybe_resolve();
+        });
+    }
+    c->maybe_resolve();
+    return result;
+}
+
+static thread_local int64_t last_paxos_ballot_micros = api::min_timestamp;
+
+// Makes a ballot newer than min_micros, and than the previous one of the
+// shard. The clock sequence of the ballot is the shard, so that the
+// coordinators of the shards of a node never make the same ballot.
+static utils::UUID make_paxos_ballot(int64_t min_micros) {
+    auto micros = std::max({api::new_timestamp(), min_micros + 1, last_paxos_ballot_micros + 1});
+    last_paxos_ballot_micros = micros;
+    auto ballot = utils::UUID_gen::get_time_UUID(std::chrono::system_clock::time_point(std::chrono::microseconds(micros)));
+    auto lsb = (ballot.get_least_significant_bits() & ~(int64_t(0x3fff) << 48)) | (int64_t(engine().cpu_id() & 0x3fff) << 48);
+    return utils::UUID(ballot.get_most_significant_bits(), lsb);
+}
+
+// Gives the round which outbid ours some time to complete, so that the
+// two don't keep outbidding each other.
+static future<stdx::optional<bool>> paxos_contention_backoff() {
+    static thread_local std::default_random_engine random_engine{std::random_device{}()};
+    std::uniform_int_distribution<int> delay(0, 100);
+    return sleep(std::chrono::milliseconds(delay(random_engine))).then([] {
+        return stdx::optional<bool>();
+    });
+}
+
+static db::consistency_level paxos_quorum(db::consistency_level cl_for_paxos) {
+    return cl_for_paxos == db::consistency_level::LOCAL_SERIAL ? db::consistency_level::LOCAL_QUORUM : db::consistency_level::QUORUM;
+}
+
+future<paxos::prepare_response>
+storage_proxy::paxos_prepare_on(gms::inet_address ep, schema_ptr s, lw_shared_ptr<query::read_command> cmd,
+        const dht::decorated_key& key, utils::UUID ballot, bool only_digest, query::digest_algorithm da,
+        clock_type::time_point timeout, tracing::trace_state_ptr tr_state) {
+    if (ep == utils::fb_utilities::get_broadcast_address()) {
+        // The Paxos state of the partition is on its shard, so are the
+        // reads of the state and of the data.
+        auto shard = _db.local().shard_of(key.token());
+        return _db.invoke_on(shard, [gs = global_schema_ptr(s), cmd = *cmd, key = key.key(), ballot, only_digest, da, timeout,
+                gt = tracing::global_trace_state_ptr(std::move(tr_state))] (database&) {
+            return paxos::paxos_state::prepare(gt, gs, cmd, key, ballot, only_digest, da, timeout);
+        });
+    }
+    tracing::trace(tr_state, "Sending a prepare of {} to /{}", ballot, ep);
+    return netw::get_local_messaging_service().send_paxos_prepare(netw::messaging_service::msg_addr{ep, 0}, timeout, *cmd, key.key(),
+            ballot, only_digest, da);
+}
+
+future<bool>
+storage_proxy::paxos_accept_on(gms::inet_address ep, schema_ptr s, const paxos::proposal& p, clock_type::time_point timeout,
+        tracing::trace_state_ptr tr_state) {
+    if (ep == utils::fb_utilities::get_broadcast_address()) {
+        auto shard = _db.local().shard_of(p.update);
+        return _db.invoke_on(shard, [gs = global_schema_ptr(s), p, timeout, gt = tracing::global_trace_state_ptr(std::move(tr_state))] (database&) {
+            return paxos::paxos_state::accept(gt, gs, p, timeout);
+        });
+    }
+    tracing::trace(tr_state, "Sending an accept of {} to /{}", p.ballot, ep);
+    return netw::get_local_messaging_service().send_paxos_accept(netw::messaging_service::msg_addr{ep, 0}, timeout, p,
+            tracing::make_trace_info(tr_state));
+}
+
+future<>
+storage_proxy::paxos_learn_on(gms::inet_address ep, schema_ptr s, const paxos::proposal& decision, clock_type::time_point timeout,
+        tracing::trace_state_ptr tr_state) {
+    if (ep == utils::fb_utilities::get_broadcast_address()) {
+        auto shard = _db.local().shard_of(decision.update);
+        return _db.invoke_on(shard, [gs = global_schema_ptr(s), decision, timeout, gt = tracing::global_trace_state_ptr(std::move(tr_state))] (database&) {
+            return paxos::paxos_state::learn(gt, gs, decision, timeout);
+        });
+    }
+    tracing::trace(tr_state, "Sending a commit of {} to /{}", decision.ballot, ep);
+    return netw::get_local_messaging_service().send_paxos_learn(netw::messaging_service::msg_addr{ep, 0}, timeout, decision,
+            tracing::make_trace_info(tr_state));
+}
+
+// Resolves with whether the required participants accepted the proposal.
+future<bool>
+storage_proxy::paxos_accept(schema_ptr s, const std::vector<gms::inet_address>& participants, size_t required,
+        db::consistency_level cl_for_paxos, const paxos::proposal& p, clock_type::time_point timeout, tracing::trace_state_ptr tr_state) {
+    std::vector<future<bool>> futures;
+    futures.reserve(participants.size());
+    for (auto ep : participants) {
+        futures.push_back(paxos_accept_on(ep, s, p, timeout, tr_state));
+    }
+    return first_responses(std::move(futures), required).then([s, required, cl_for_paxos] (std::vector<bool> accepts) {
+        if (accepts.size() < required) {
+            throw exceptions::mutation_write_timeout_exception(s->ks_name(), s->cf_name(), cl_for_paxos, accepts.size(), required, db::write_type::CAS);
+        }
+        return boost::algorithm::all_of_equal(accepts, true);
+    });
+}
+
+// Sends the decision to all the live replicas, waiting for the acknowledgements
+// cl requires.
+future<>
+storage_proxy::paxos_learn(schema_ptr s, const dht::token& token, db::consistency_level cl, const paxos::proposal& decision,
+        clock_type::time_point timeout, tracing::trace_state_ptr tr_state) {
+    invalidate_cached_results(*s, token);
+    keyspace& ks = _db.local().find_keyspace(s->ks_name());
+    auto natural = ks.get_replication_strategy().get_natural_endpoints(token);
+    auto pending = get_local_storage_service().get_token_metadata().pending_endpoints_for(token, s->ks_name());
+    pending.erase(boost::range::remove_if(pending, [&natural] (gms::inet_address ep) {
+        return boost::range::find(natural, ep) != natural.end();
+    }), pending.end());
+    auto counts = [cl] (gms::inet_address ep) {
+        return !db::is_datacenter_local(cl) || db::is_local(ep);
+    };
+    size_t required = 0;
+    if (cl != db::consistency_level::ANY) {
+        required = db::block_for(ks, cl) + boost::count_if(pending, counts);
+    }
+    std::vector<future<bool>> futures;
+    for (auto ep : boost::range::join(natural, pending)) {
+        if (!gms::get_local_failure_detector().is_alive(ep)) {
+            continue;
+        }
+        auto f = paxos_learn_on(ep, s, decision, timeout, tr_state).then([] {
+            return true;
+        });
+        if (counts(ep)) {
+            futures.push_back(std::move(f));
+        } else {
+            f.handle_exception([] (std::exception_ptr eptr) {
+                slogger.debug("Paxos commit failed: {}", eptr);
+                return false;
+            });
+        }
+    }
+    return first_responses(std::move(futures), required).then([s, cl, required] (std::vector<bool> acks) {
+        if (acks.size() < required) {
+            throw exceptions::mutation_write_timeout_exception(s->ks_name(), s->cf_name(), cl, acks.size(), required, db::write_type::CAS);
+        }
+    });
+}
+
+future<bool>
+storage_proxy::cas(schema_ptr s, shared_ptr<paxos::cas_request> request, lw_shared_ptr<query::read_command> cmd,
+        dht::partition_range_vector partition_ranges, db::consistency_level cl_for_paxos, db::consistency_level cl_for_commit,
+        tracing::trace_state_ptr tr_state) {
+    assert(partition_ranges.size() == 1 && query::is_single_partition(partition_ranges[0]));
+    db::validate_for_cas(cl_for_paxos);
+    db::validate_for_cas_commit(s->ks_name(), cl_for_commit);
+    cmd->trace_info = tracing::make_trace_info(tr_state);
+    auto& cfg = _db.local().get_config();
+    auto cas_timeout = clock_type::now() + std::chrono::milliseconds(cfg.cas_contention_timeout_in_ms());
+    auto da = digest_algorithm_for_reads();
+    auto key = partition_ranges[0].start()->value().as_decorated_key();
+
+    return do_with(std::move(key), int64_t(api::min_timestamp), [this, s, request, cmd, cl_for_paxos, cl_for_commit, cas_timeout, da, tr_state]
+            (const dht::decorated_key& key, int64_t& min_ballot_micros) {
+        return repeat_until_value([this, s, request, cmd, cl_for_paxos, cl_for_commit, cas_timeout, da, tr_state, &key, &min_ballot_micros] {
+            auto p = get_paxos_participants(_db.local().find_keyspace(s->ks_name()), *s, key.token(), cl_for_paxos);
+            auto now = clock_type::now();
+            if (now >= cas_timeout) {
+                throw exceptions::mutation_write_timeout_exception(s->ks_name(), s->cf_name(), cl_for_paxos, 0, p.required, db::write_type::CAS);
+            }
+            auto timeout = std::min(cas_timeout, now + std::chrono::milliseconds(_db.local().get_config().write_request_timeout_in_ms()));
+            auto ballot = make_paxos_ballot(min_ballot_micros);
+            tracing::trace(tr_state, "Preparing {}", ballot);
+
+            // The closest participant reads the data, the others only its
+            // digest, in the same round trip as the promise.
+            std::vector<future<std::pair<gms::inet_address, paxos::prepare_response>>> futures;
+            futures.reserve(p.live.size());
+            for (auto ep : p.live) {
+                bool only_digest = ep != p.live.front();
+                futures.push_back(paxos_prepare_on(ep, s, cmd, key, ballot, only_digest, da, timeout, tr_state).then([ep] (paxos::prepare_response r) {
+                    return std::make_pair(ep, std::move(r));
+                }));
+            }
+            return first_responses(std::move(futures), p.required).then([this, s, request, cmd, cl_for_paxos, cl_for_commit, timeout, tr_state, &key,
+                    &min_ballot_micros, p = std::move(p), ballot] (std::vector<std::pair<gms::inet_address, paxos::prepare_response>> responses) mutable
+                    -> future<stdx::optional<bool>> {
+                if (responses.size() < p.required) {
+                    throw exceptions::mutation_write_timeout_exception(s->ks_name(), s->cf_name(), cl_for_paxos, responses.size(), p.required,
+                            db::write_type::CAS);
+                }
+                for (auto& r : responses) {
+                    if (!r.second.promised) {
+                        tracing::trace(tr_state, "Some replicas have already promised a higher ballot than ours; aborting");
+                        ++_stats.cas_contention;
+                        min_ballot_micros = std::max(min_ballot_micros, utils::UUID_gen::micros_timestamp(r.second.most_recent_promised_ballot));
+                        return paxos_contention_backoff();
+                    }
+                }
+
+                const std::pair<gms::inet_address, paxos::prepare_response>* most_recent_commit = nullptr;
+                for (auto& r : responses) {
+                    auto& c = r.second.most_recent_commit;
+                    if (c && (!most_recent_commit || paxos::ballot_tri_compare(c->ballot, most_recent_commit->second.most_recent_commit->ballot) > 0)) {
+                        most_recent_commit = &r;
+                    }
+                }
+                auto is_newer = [] (const paxos::proposal& a, const stdx::optional<paxos::proposal>& b) {
+                    return !b || paxos::ballot_tri_compare(a.ballot, b->ballot) > 0;
+                };
+
+                // A proposal accepted after the most recent decision may have
+                // been decided too, so it has to be finished before ours.
+                const std::pair<gms::inet_address, paxos::prepare_response>* in_progress = nullptr;
+                for (auto& r : responses) {
+                    auto& a = r.second.accepted_proposal;
+                    if (a && (!most_recent_commit || is_newer(*a, most_recent_commit->second.most_recent_commit))
+                            && (!in_progress || is_newer(*a, in_progress->second.accepted_proposal))) {
+                        in_progress = &r;
+                    }
+                }
+                if (in_progress) {
+                    tracing::trace(tr_state, "Finishing incomplete paxos round {}", in_progress->second.accepted_proposal->ballot);
+                    ++_stats.cas_unfinished_commits;
+                    // Proposed again with our ballot, which was promised.
+                    auto refreshed = make_lw_shared<paxos::proposal>(ballot, in_progress->second.accepted_proposal->update);
+                    auto src = netw::messaging_service::msg_addr{in_progress->first, 0};
+                    return get_schema_for_write(refreshed->update.schema_version(), src).then([this, refreshed, p = std::move(p), cl_for_paxos,
+                            timeout, tr_state, &key] (schema_ptr us) {
+                        return paxos_accept(us, p.live, p.required, cl_for_paxos, *refreshed, timeout, tr_state).then([this, us, refreshed,
+                                cl_for_paxos, timeout, tr_state, &key] (bool accepted) {
+                            if (!accepted) {
+                                ++_stats.cas_contention;
+                                return paxos_contention_backoff();
+                            }
+                            return paxos_learn(us, key.token(), paxos_quorum(cl_for_paxos), *refreshed, timeout, tr_state).then([] {
+                                return stdx::optional<bool>();
+                            });
+                        });
+                    });
+                }
+
+                // The participants which missed the most recent decision read
+                // stale data, so they learn it and the round starts over.
+                if (most_recent_commit) {
+                    auto& decision = *most_recent_commit->second.most_recent_commit;
+                    std::vector<gms::inet_address> missing;
+                    for (auto& r : responses) {
+                        auto& c = r.second.most_recent_commit;
+                        if (!c || c->ballot != decision.ballot) {
+                            missing.push_back(r.first);
+                        }
+                    }
+                    if (!missing.empty()) {
+                        tracing::trace(tr_state, "Repairing replicas that missed the most recent commit");
+                        auto d = make_lw_shared<paxos::proposal>(decision);
+                        auto src = netw::messaging_service::msg_addr{most_recent_commit->first, 0};
+                        return get_schema_for_write(d->update.schema_version(), src).then([this, d, missing = std::move(missing), timeout,
+                                tr_state] (schema_ptr us) {
+                            return parallel_for_each(missing, [this, us, d, timeout, tr_state] (gms::inet_address ep) {
+                                return paxos_learn_on(ep, us, *d, timeout, tr_state);
+                            });
+                        }).then([] {
+                            return stdx::optional<bool>();
+                        });
+                    }
+                }
+
+                // All participants have the same decisions applied, so unless
+                // some other write got to some of them, they read the same.
+                auto data = boost::find_if(responses, [&p] (auto& r) {
+                    return r.first == p.live.front();
+                });
+                auto digests_match = boost::algorithm::all_of(responses, [&responses] (auto& r) {
+                    return r.second.data && r.second.data->digest() && *r.second.data->digest() == *responses.front().second.data->digest();
+                });
+                future<foreign_ptr<lw_shared_ptr<query::result>>> f = make_ready_future<foreign_ptr<lw_shared_ptr<query::result>>>();
+                if (data != responses.end() && digests_match) {
+                    f = make_ready_future<foreign_ptr<lw_shared_ptr<query::result>>>(
+                            make_foreign(make_lw_shared<query::result>(std::move(*data->second.data))));
+                } else {
+                    tracing::trace(tr_state, "Digest mismatch or no data, reading at {}", paxos_quorum(cl_for_paxos));
+                    ++_stats.cas_read_fallbacks;
+                    f = query(s, cmd, {dht::partition_range::make_singular(key)}, paxos_quorum(cl_for_paxos), tr_state);
+                }
+                return f.then([this, s, request, cmd, cl_for_paxos, cl_for_commit, timeout, tr_state, &key, p = std::move(p), ballot]
+                        (foreign_ptr<lw_shared_ptr<query::result>> qr) {
+                    auto m = request->apply(*qr, cmd->slice, utils::UUID_gen::micros_timestamp(ballot));
+                    if (!m) {
+                        tracing::trace(tr_state, "CAS precondition does not match current values");
+                        return make_ready_future<stdx::optional<bool>>(false);
+                    }
+                    auto proposal = make_lw_shared<paxos::proposal>(ballot, freeze(*m));
+                    return paxos_accept(s, p.live, p.required, cl_for_paxos, *proposal, timeout, tr_state).then([this, s, proposal,
+                            cl_for_commit, timeout, tr_state, &key] (bool accepted) {
+                        if (!accepted) {
+                            tracing::trace(tr_state, "Paxos proposal not accepted (pre-empted by a higher ballot)");
+                            ++_stats.cas_contention;
+                            return paxos_contention_backoff();
+                        }
+                        tracing::trace(tr_state, "Paxos proposal accepted, committing at {}", cl_for_commit);
+                        return paxos_learn(s, key.token(), cl_for_commit, *proposal, timeout, tr_state).then([] {
+                            return stdx::optional<bool>(true);
+                        });
+                    });
+                });
+            });
+        });
+    });
+}
+
 std::vector<gms::inet_address> storage_proxy::get_live_endpoints(keyspace& ks, const dht::token& token) {
     auto& rs = ks.get_replication_strategy();
     std::vector<gms::inet_address> eps = rs.get_natural_endpoints(token);
@@ -3231,12 +4328,25 @@ std::vector<gms::inet_address> storage_proxy::get_live_endpoints(keyspace& ks, c
 
 std::vector<gms::inet_address> storage_proxy::get_live_sorted_endpoints(keyspace& ks, const dht::token& token) {
     auto eps = get_live_endpoints(ks, token);
-    locator::i_endpoint_snitch::get_local_snitch_ptr()->sort_by_proximity(utils::fb_utilities::get_broadcast_address(), eps);
-    // FIXME: before dynamic snitch is implement put local address (if present) at the beginning
-    auto it = boost::range::find(eps, utils::fb_utilities::get_broadcast_address());
+    auto& snitch = locator::i_endpoint_snitch::get_local_snitch_ptr();
+    auto my_address = utils::fb_utilities::get_broadcast_address();
+    snitch->sort_by_proximity(my_address, eps);
+    // Put local address (if present) at the beginning
+    auto it = boost::range::find(eps, my_address);
     if (it != eps.end() && it != eps.begin()) {
         std::iter_swap(it, eps.begin());
     }
+    auto& cfg = _db.local().get_config();
+    if (cfg.dynamic_snitch()) {
+        // Only the replicas of the local data center are ranked, the others
+        // are slower for being remote, not for being loaded.
+        auto my_dc = snitch->get_datacenter(my_address);
+        auto local_end = std::find_if(eps.begin(), eps.end(), [&] (gms::inet_address ep) {
+            return snitch->get_datacenter(ep) != my_dc;
+        });
+        _replica_latencies.sort(eps.begin(), local_end, cfg.dynamic_snitch_badness_threshold(),
+                std::chrono::milliseconds(cfg.dynamic_snitch_reset_interval_in_ms()));
+    }
     return eps;
 }
 
@@ -3391,32 +4501,12 @@ bool storage_proxy::should_hint(gms::inet_address ep) noexcept {
         return false;
     }
 
-    return false;
-#if 0
-    if (DatabaseDescriptor.shouldHintByDC())
-    {
-        final String dc = DatabaseDescriptor.getEndpointSnitch().getDatacenter(ep);
-        //Disable DC specific hints
-        if(!DatabaseDescriptor.hintedHandoffEnabled(dc))
-        {
-            HintedHandOffManager.instance.metrics.incrPastWindow(ep);
-            return false;
-        }
-    }
-    else if (!DatabaseDescriptor.hintedHandoffEnabled())
-    {
-        HintedHandOffManager.instance.metrics.incrPastWindow(ep);
+    if (!_hints_manager) {
         return false;
     }
 
-    boolean hintWindowExpired = Gossiper.instance.getEndpointDowntime(ep) > DatabaseDescriptor.getMaxHintWindow();
-    if (hintWindowExpired)
-    {
-        HintedHandOffManager.instance.metrics.incrPastWindow(ep);
-        Tracing.trace("Not hinting {} which has been down {}ms", ep, Gossiper.instance.getEndpointDowntime(ep));
-    }
-    return !hintWindowExpired;
-#endif
+    // Takes care of the hint window and of the amount of hints in flight
+    return _hints_manager->can_hint_for(ep);
 }
 
 future<> storage_proxy::truncate_blocking(sstring keyspace, sstring cfname) {
@@ -3726,6 +4816,39 @@ void storage_proxy::init_messaging_service() {
             });
         });
     });
+    ms.register_mutation_batch([] (const rpc::client_info& cinfo, rpc::opt_time_point t, std::vector<frozen_mutation> in, gms::inet_address reply_to, unsigned shard, std::vector<storage_proxy::response_id_type> response_ids) {
+        auto src_addr = netw::messaging_service::get_source(cinfo);
+        auto p = get_local_shared_storage_proxy();
+
+        storage_proxy::clock_type::time_point timeout;
+        if (!t) {
+            auto timeout_in_ms = p->_db.local().get_config().write_request_timeout_in_ms();
+            timeout = clock_type::now() + std::chrono::milliseconds(timeout_in_ms);
+        } else {
+            timeout = *t;
+        }
+
+        ++p->_stats.received_mutation_batches;
+        p->_stats.received_mutations += in.size();
+        return p->mutate_batch_locally(std::move(in), std::move(src_addr), timeout).then([reply_to, shard, response_ids = std::move(response_ids)] (std::vector<bool> applied) {
+            return do_with(std::move(response_ids), std::move(applied), [reply_to, shard] (auto& response_ids, auto& applied) {
+                return parallel_for_each(boost::irange<size_t>(0, response_ids.size()), [&response_ids, &applied, reply_to, shard] (size_t i) {
+                    if (!applied[i]) {
+                        return make_ready_future<>();
+                    }
+                    auto& ms = netw::get_local_messaging_service();
+                    // We wait for send_mutation_done to complete, as the MUTATION handler does.
+                    return ms.send_mutation_done(netw::messaging_service::msg_addr{reply_to, shard}, shard, response_ids[i]).then_wrapped([] (future<> f) {
+                        f.ignore_ready_future();
+                    });
+                });
+            });
+        }).then_wrapped([p] (future<> f) {
+            // ignore ressult, since we'll be returning them via MUTATION_DONE verbs
+            f.ignore_ready_future();
+            return netw::messaging_service::no_wait();
+        });
+    });
     ms.register_mutation_done([] (const rpc::client_info& cinfo, unsigned shard, storage_proxy::response_id_type response_id) {
         auto& from = cinfo.retrieve_auxiliary<gms::inet_address>("baddr");
         return get_storage_proxy().invoke_on(shard, [from, response_id] (storage_proxy& sp) {
@@ -3758,10 +4881,11 @@ void storage_proxy::init_messaging_service() {
                     qrr = query::result_request::only_result;
                     break;
                 case query::digest_algorithm::MD5:
+                case query::digest_algorithm::MURMUR3:
                     qrr = query::result_request::result_and_digest;
                     break;
                 }
-                return p->query_result_local(std::move(s), cmd, std::move(pr2.first), qrr, trace_state_ptr, max_size);
+                return p->query_result_local(std::move(s), cmd, std::move(pr2.first), query::result_options(qrr, da), trace_state_ptr, max_size);
             }).finally([&trace_state_ptr, src_ip] () mutable {
                 tracing::trace(trace_state_ptr, "read_data handling is done, sending a response to /{}", src_ip);
             });
@@ -3795,7 +4919,7 @@ void storage_proxy::init_messaging_service() {
             });
         });
     });
-    ms.register_read_digest([] (const rpc::client_info& cinfo, query::read_command cmd, compat::wrapping_partition_range pr) {
+    ms.register_read_digest([] (const rpc::client_info& cinfo, query::read_command cmd, compat::wrapping_partition_range pr, rpc::optional<query::digest_algorithm> oda) {
         tracing::trace_state_ptr trace_state_ptr;
         auto src_addr = netw::messaging_service::get_source(cinfo);
         if (cmd.trace_info) {
@@ -3803,17 +4927,18 @@ void storage_proxy::init_messaging_service() {
             tracing::begin(trace_state_ptr);
             tracing::trace(trace_state_ptr, "read_digest: message received from /{}", src_addr.addr);
         }
+        auto da = oda.value_or(query::digest_algorithm::MD5);
         auto max_size = cinfo.retrieve_auxiliary<uint64_t>("max_result_size");
-        return do_with(std::move(pr), get_local_shared_storage_proxy(), std::move(trace_state_ptr), [&cinfo, cmd = make_lw_shared<query::read_command>(std::move(cmd)), src_addr = std::move(src_addr), max_size] (compat::wrapping_partition_range& pr, shared_ptr<storage_proxy>& p, tracing::trace_state_ptr& trace_state_ptr) mutable {
+        return do_with(std::move(pr), get_local_shared_storage_proxy(), std::move(trace_state_ptr), [&cinfo, cmd = make_lw_shared<query::read_command>(std::move(cmd)), src_addr = std::move(src_addr), da, max_size] (compat::wrapping_partition_range& pr, shared_ptr<storage_proxy>& p, tracing::trace_state_ptr& trace_state_ptr) mutable {
             p->_stats.replica_digest_reads++;
             auto src_ip = src_addr.addr;
-            return get_schema_for_read(cmd->schema_version, std::move(src_addr)).then([cmd, &pr, &p, &trace_state_ptr, max_size] (schema_ptr s) {
+            return get_schema_for_read(cmd->schema_version, std::move(src_addr)).then([cmd, da, &pr, &p, &trace_state_ptr, max_size] (schema_ptr s) {
                 auto pr2 = compat::unwrap(std::move(pr), *s);
                 if (pr2.second) {
                     // this function assumes singular queries but doesn't validate
                     throw std::runtime_error("READ_DIGEST called with wrapping range");
                 }
-                return p->query_result_local_digest(std::move(s), cmd, std::move(pr2.first), trace_state_ptr, max_size);
+                return p->query_result_local_digest(std::move(s), cmd, std::move(pr2.first), trace_state_ptr, da, max_size);
             }).finally([&trace_state_ptr, src_ip] () mutable {
                 tracing::trace(trace_state_ptr, "read_digest handling is done, sending a response to /{}", src_ip);
             });
@@ -3828,6 +4953,76 @@ void storage_proxy::init_messaging_service() {
         });
     });
 
+    ms.register_aggregate_query([] (const rpc::client_info& cinfo, query::read_command cmd, dht::partition_range_vector prs, std::vector<query::aggregate_selector> selectors) {
+        tracing::trace_state_ptr trace_state_ptr;
+        auto src_addr = netw::messaging_service::get_source(cinfo);
+        if (cmd.trace_info) {
+            trace_state_ptr = tracing::tracing::get_local_tracing_instance().create_session(*cmd.trace_info);
+            tracing::begin(trace_state_ptr);
+            tracing::trace(trace_state_ptr, "aggregate_query: message received from /{}", src_addr.addr);
+        }
+        return do_with(get_local_shared_storage_proxy(), std::move(trace_state_ptr), [cmd = make_lw_shared<query::read_command>(std::move(cmd)), prs = std::move(prs), selectors = std::move(selectors), src_addr = std::move(src_addr)] (shared_ptr<storage_proxy>& p, tracing::trace_state_ptr& trace_state_ptr) mutable {
+            auto src_ip = src_addr.addr;
+            return get_schema_for_read(cmd->schema_version, std::move(src_addr)).then([cmd, prs = std::move(prs), selectors = std::move(selectors), &p, &trace_state_ptr] (schema_ptr s) mutable {
+                return p->query_aggregates_locally(std::move(s), cmd, std::move(prs), std::move(selectors), trace_state_ptr);
+            }).finally([&trace_state_ptr, src_ip] () mutable {
+                tracing::trace(trace_state_ptr, "aggregate_query handling is done, sending a response to /{}", src_ip);
+            });
+        });
+    });
+
+    ms.register_paxos_prepare([] (const rpc::client_info& cinfo, rpc::opt_time_point t, query::read_command cmd, partition_key key,
+            utils::UUID ballot, bool only_digest, query::digest_algorithm da) {
+        tracing::trace_state_ptr trace_state_ptr;
+        auto src_addr = netw::messaging_service::get_source(cinfo);
+        if (cmd.trace_info) {
+            trace_state_ptr = tracing::tracing::get_local_tracing_instance().create_session(*cmd.trace_info);
+            tracing::begin(trace_state_ptr);
+            tracing::trace(trace_state_ptr, "paxos_prepare: message received from /{} ballot {}", src_addr.addr, ballot);
+        }
+        auto p = get_local_shared_storage_proxy();
+        auto timeout = t ? *t : clock_type::now() + std::chrono::milliseconds(p->_db.local().get_config().write_request_timeout_in_ms());
+        return get_schema_for_read(cmd.schema_version, std::move(src_addr)).then([p, cmd = make_lw_shared<query::read_command>(std::move(cmd)),
+                key = std::move(key), ballot, only_digest, da, timeout, trace_state_ptr = std::move(trace_state_ptr)] (schema_ptr s) {
+            auto dk = dht::global_partitioner().decorate_key(*s, key);
+            return p->paxos_prepare_on(utils::fb_utilities::get_broadcast_address(), s, cmd, dk, ballot, only_digest, da, timeout, trace_state_ptr);
+        });
+    });
+    ms.register_paxos_accept([] (const rpc::client_info& cinfo, rpc::opt_time_point t, paxos::proposal proposal,
+            stdx::optional<tracing::trace_info> trace_info) {
+        tracing::trace_state_ptr trace_state_ptr;
+        auto src_addr = netw::messaging_service::get_source(cinfo);
+        if (trace_info) {
+            trace_state_ptr = tracing::tracing::get_local_tracing_instance().create_session(*trace_info);
+            tracing::begin(trace_state_ptr);
+            tracing::trace(trace_state_ptr, "paxos_accept: message received from /{} ballot {}", src_addr.addr, proposal.ballot);
+        }
+        auto p = get_local_shared_storage_proxy();
+        auto timeout = t ? *t : clock_type::now() + std::chrono::milliseconds(p->_db.local().get_config().write_request_timeout_in_ms());
+        auto schema_version = proposal.update.schema_version();
+        return get_schema_for_write(schema_version, std::move(src_addr)).then([p, proposal = std::move(proposal), timeout,
+                trace_state_ptr = std::move(trace_state_ptr)] (schema_ptr s) {
+            return p->paxos_accept_on(utils::fb_utilities::get_broadcast_address(), s, proposal, timeout, trace_state_ptr);
+        });
+    });
+    ms.register_paxos_learn([] (const rpc::client_info& cinfo, rpc::opt_time_point t, paxos::proposal decision,
+            stdx::optional<tracing::trace_info> trace_info) {
+        tracing::trace_state_ptr trace_state_ptr;
+        auto src_addr = netw::messaging_service::get_source(cinfo);
+        if (trace_info) {
+            trace_state_ptr = tracing::tracing::get_local_tracing_instance().create_session(*trace_info);
+            tracing::begin(trace_state_ptr);
+            tracing::trace(trace_state_ptr, "paxos_learn: message received from /{} ballot {}", src_addr.addr, decision.ballot);
+        }
+        auto p = get_local_shared_storage_proxy();
+        auto timeout = t ? *t : clock_type::now() + std::chrono::milliseconds(p->_db.local().get_config().write_request_timeout_in_ms());
+        auto schema_version = decision.update.schema_version();
+        return get_schema_for_write(schema_version, std::move(src_addr)).then([p, decision = std::move(decision), timeout,
+                trace_state_ptr = std::move(trace_state_ptr)] (schema_ptr s) {
+            return p->paxos_learn_on(utils::fb_utilities::get_broadcast_address(), s, decision, timeout, trace_state_ptr);
+        });
+    });
+
     ms.register_get_schema_version([] (unsigned shard, table_schema_version v) {
         return get_storage_proxy().invoke_on(shard, [v] (auto&& sp) {
             slogger.debug("Schema version request for {}", v);
@@ -3839,11 +5034,16 @@ void storage_proxy::init_messaging_service() {
 void storage_proxy::uninit_messaging_service() {
     auto& ms = netw::get_local_messaging_service();
     ms.unregister_mutation();
+    ms.unregister_mutation_batch();
     ms.unregister_mutation_done();
     ms.unregister_read_data();
     ms.unregister_read_mutation_data();
     ms.unregister_read_digest();
+    ms.unregister_aggregate_query();
     ms.unregister_truncate();
+    ms.unregister_paxos_prepare();
+    ms.unregister_paxos_accept();
+    ms.unregister_paxos_learn();
 }
 
 // Merges reconcilable_result:s from different shards into one
@@ -3859,7 +5059,7 @@ class mutation_result_merger {
     // batches that share a key should be merged and sorted in decorated_key
     // order
     struct partitions_batch {
-        std::vector<partition> partitions;
+        utils::chunked_vector<partition> partitions;
         query::short_read short_read;
     };
     std::multimap<unsigned, partitions_batch> _partitions;
@@ -3882,7 +5082,7 @@ class mutation_result_merger {
             // A short result was added that goes before this one.
             return;
         }
-        std::vector<partition> partitions;
+        utils::chunked_vector<partition> partitions;
         partitions.reserve(partial_result->partitions().size());
         // Following three lines to simplify patch; can remove later
         for (const partition& p : partial_result->partitions()) {
@@ -3899,7 +5099,7 @@ class mutation_result_merger {
     reconcilable_result get() && {
         auto unsorted = std::unordered_set<unsigned>();
         struct partitions_and_last_key {
-            std::vector<partition> partitions;
+            utils::chunked_vector<partition> partitions;
             stdx::optional<dht::decorated_key> last; // set if we had a short read
         };
         auto merged = std::map<unsigned, partitions_and_last_key>();
@@ -3956,11 +5156,14 @@ class mutation_result_merger {
                 // We need to remove all partitions that are after that short
                 // read.
                 auto it = boost::range::upper_bound(batch.partitions, std::move(*batch.last), cmp);
-                batch.partitions.erase(it, batch.partitions.end());
+                auto n = size_t(it - batch.partitions.begin());
+                while (batch.partitions.size() > n) {
+                    batch.partitions.pop_back();
+                }
             }
         }
 
-        auto final = std::vector<partition>();
+        auto final = utils::chunked_vector<partition>();
         final.reserve(_partition_count);
         for (auto&& batch : merged | boost::adaptors::map_values) {
             std::move(batch.partitions.begin(), batch.partitions.end(), std::back_inserter(final));
@@ -4182,8 +5385,10 @@ storage_proxy::query_nonsingular_mutations_locally(schema_ptr s, lw_shared_ptr<q
 
 future<>
 storage_proxy::stop() {
+    _mutation_batch_timer.cancel();
+    send_mutation_batches();
     uninit_messaging_service();
-    return make_ready_future<>();
+    return stop_hints_manager();
 }
 
 }
@@ -52,7 +52,12 @@
 #include "utils/estimated_histogram.hh"
 #include "tracing/trace_state.hh"
 #include <seastar/core/metrics.hh>
+#include <seastar/core/shared_future.hh>
 #include "frozen_mutation.hh"
+#include "db/hints/manager.hh"
+#include "service/replica_latency_tracker.hh"
+#include "service/coordinator_result_cache.hh"
+#include "message/messaging_service_fwd.hh"
 
 namespace compat {
 
@@ -66,6 +71,12 @@ class abstract_write_response_handler;
 class abstract_read_executor;
 class mutation_holder;
 
+namespace paxos {
+class cas_request;
+class proposal;
+class prepare_response;
+}
+
 class storage_proxy : public seastar::async_sharded_service<storage_proxy> /*implements StorageProxyMBean*/ {
 public:
     using clock_type = lowres_clock;
@@ -153,6 +164,8 @@ class storage_proxy : public seastar::async_sharded_service<storage_proxy> /*imp
         uint64_t read_repair_repaired_blocking = 0;
         uint64_t read_repair_repaired_background = 0;
         uint64_t global_read_repairs_canceled_due_to_concurrent_write = 0;
+        uint64_t background_read_repair_writes = 0;
+        uint64_t read_repairs_over_budget = 0; // waited for, for max_background_read_repairs were in the background
 
         // number of mutations received as a coordinator
         uint64_t received_mutations = 0;
@@ -164,17 +177,19 @@ class storage_proxy : public seastar::async_sharded_service<storage_proxy> /*imp
         uint64_t forwarded_mutations = 0;
         uint64_t forwarding_errors = 0;
 
+        // number of MUTATION_BATCH messages sent and received
+        uint64_t sent_mutation_batches = 0;
+        uint64_t received_mutation_batches = 0;
+
         // number of read requests received as a replica
         uint64_t replica_data_reads = 0;
         uint64_t replica_digest_reads = 0;
         uint64_t replica_mutation_data_reads = 0;
 
+        // The latencies of the requests, whose distribution is in hist.values.
         utils::timed_rate_moving_average_and_histogram read;
         utils::timed_rate_moving_average_and_histogram write;
         utils::timed_rate_moving_average_and_histogram range;
-        utils::estimated_histogram estimated_read;
-        utils::estimated_histogram estimated_write;
-        utils::estimated_histogram estimated_range;
         uint64_t writes = 0;
         uint64_t background_writes = 0; // client no longer waits for the write
         uint64_t background_write_bytes = 0;
@@ -182,7 +197,15 @@ class storage_proxy : public seastar::async_sharded_service<storage_proxy> /*imp
         uint64_t reads = 0;
         uint64_t background_reads = 0; // client no longer waits for the read
         uint64_t read_retries = 0; // read is retried with new limit
+        uint64_t speculative_reads = 0;
+        uint64_t speculative_reads_over_budget = 0; // not sent, for they would exceed speculative_retry_budget_percent
         uint64_t throttled_writes = 0; // total number of writes ever delayed due to throttling
+        uint64_t requests_shed_write_bytes = 0; // client requests rejected, see shed_request()
+        uint64_t requests_shed_hints = 0;
+        uint64_t parallel_range_scans = 0;
+        uint64_t cas_contention = 0; // Paxos rounds retried because a newer ballot was promised
+        uint64_t cas_unfinished_commits = 0; // Paxos rounds spent on finishing an earlier one
+        uint64_t cas_read_fallbacks = 0; // the prepares read different data, which was read again
 
         // Data read attempts
         split_stats data_read_attempts;
@@ -215,9 +238,48 @@ class storage_proxy : public seastar::async_sharded_service<storage_proxy> /*imp
     // just skip an entry if request no longer exists.
     circular_buffer<response_id_type> _throttled_writes;
     constexpr static size_t _max_hints_in_progress = 128; // origin multiplies by FBUtilities.getAvailableProcessors() but we already sharded
+    // Beyond which new client requests are rejected, see overloaded().
+    constexpr static size_t _overload_hints_in_progress = 4 * _max_hints_in_progress;
+    size_t _overload_write_bytes;
     size_t _total_hints_in_progress = 0;
     std::unordered_map<gms::inet_address, size_t> _hints_in_progress;
+    std::unique_ptr<db::hints::manager> _hints_manager;
+    // The view updates which timed out, or whose paired replica is down,
+    // replayed to it once it is reachable.
+    std::unique_ptr<db::hints::manager> _view_hints_manager;
     stats _stats;
+    replica_latency_tracker _replica_latencies;
+    coordinator_result_cache _result_cache;
+    // Each read which may speculate earns a fraction of a speculative read,
+    // which each speculative read spends.
+    double _speculative_read_credit = 0;
+    // Read repair writes which reads didn't wait for.
+    uint32_t _background_read_repairs = 0;
+    // Writes to a replica waiting for the end of the batching window, to be
+    // sent together in one MUTATION_BATCH.
+    struct mutation_batch {
+        std::vector<frozen_mutation> mutations;
+        std::vector<response_id_type> response_ids;
+        size_t bytes = 0;
+        clock_type::time_point timeout = clock_type::time_point::min();
+        shared_promise<> sent;
+    };
+    std::unordered_map<gms::inet_address, lw_shared_ptr<mutation_batch>> _mutation_batches;
+    timer<> _mutation_batch_timer;
+    // Set while mutate_begin() sends the mutations of a request, which are
+    // then batched without waiting for the window to end.
+    bool _batching_mutations = false;
+    // The mutations of that request to apply to this node.
+    struct local_mutation {
+        lw_shared_ptr<const frozen_mutation> fm;
+        schema_ptr s;
+        clock_type::time_point timeout;
+        promise<> applied;
+    };
+    std::vector<local_mutation> _local_mutation_batch;
+    // Bounds the memory of the results of the range reads parallel range
+    // scans have in flight, counted for the maximum size of a result each.
+    semaphore _parallel_scan_memory{0};
     static constexpr float CONCURRENT_SUBREQUESTS_MARGIN = 0.10;
     // for read repair chance calculation
     std::default_random_engine _urandom;
@@ -236,6 +298,18 @@ class storage_proxy : public seastar::async_sharded_service<storage_proxy> /*imp
     response_id_type create_write_response_handler(const mutation&, db::consistency_level cl, db::write_type type, tracing::trace_state_ptr tr_state);
     response_id_type create_write_response_handler(const std::unordered_map<gms::inet_address, std::experimental::optional<mutation>>&, db::consistency_level cl, db::write_type type, tracing::trace_state_ptr tr_state);
     void send_to_live_endpoints(response_id_type response_id, clock_type::time_point timeout);
+    // Resolves once the batch the mutation went into was sent.
+    future<> send_batched_mutation(gms::inet_address ep, const frozen_mutation& m, response_id_type response_id, clock_type::time_point timeout);
+    void send_mutation_batch(gms::inet_address ep);
+    void send_mutation_batches();
+    future<> add_to_local_mutation_batch(schema_ptr s, lw_shared_ptr<const frozen_mutation> m, clock_type::time_point timeout);
+    void apply_local_mutation_batch();
+    // The mutations must be kept alive until the result, which has the error
+    // of each of them, or nullptr, is ready.
+    future<std::vector<std::exception_ptr>> mutate_locally_by_shard(std::vector<std::pair<const frozen_mutation*, schema_ptr>> mutations,
+            clock_type::time_point timeout);
+    // The result tells which of the mutations were applied.
+    future<std::vector<bool>> mutate_batch_locally(std::vector<frozen_mutation> mutations, netw::msg_addr src_addr, clock_type::time_point timeout);
     template<typename Range>
     size_t hint_to_dead_endpoints(std::unique_ptr<mutation_holder>& mh, const Range& targets) noexcept;
     void hint_to_dead_endpoints(response_id_type, db::consistency_level);
@@ -243,25 +317,50 @@ class storage_proxy : public seastar::async_sharded_service<storage_proxy> /*imp
     size_t get_hints_in_progress_for(gms::inet_address target);
     bool should_hint(gms::inet_address ep) noexcept;
     bool submit_hint(std::unique_ptr<mutation_holder>& mh, gms::inet_address target);
+    template<typename Range>
+    size_t hint_view_updates(std::unique_ptr<mutation_holder>& mh, const Range& targets) noexcept;
     std::vector<gms::inet_address> get_live_endpoints(keyspace& ks, const dht::token& token);
     std::vector<gms::inet_address> get_live_sorted_endpoints(keyspace& ks, const dht::token& token);
     db::read_repair_decision new_read_repair_decision(const schema& s);
+    void earn_speculative_read_credit();
     ::shared_ptr<abstract_read_executor> get_read_executor(lw_shared_ptr<query::read_command> cmd, dht::partition_range pr, db::consistency_level cl, tracing::trace_state_ptr trace_state);
     future<foreign_ptr<lw_shared_ptr<query::result>>, cache_temperature> query_result_local(schema_ptr, lw_shared_ptr<query::read_command> cmd, const dht::partition_range& pr,
-                                                                           query::result_request request,
+                                                                           query::result_options opts,
                                                                            tracing::trace_state_ptr trace_state,
                                                                            uint64_t max_size = query::result_memory_limiter::maximum_result_size);
     future<query::result_digest, api::timestamp_type, cache_temperature> query_result_local_digest(schema_ptr, lw_shared_ptr<query::read_command> cmd, const dht::partition_range& pr, tracing::trace_state_ptr trace_state,
+                                                                                  query::digest_algorithm da,
                                                                                   uint64_t max_size  = query::result_memory_limiter::maximum_result_size);
     future<foreign_ptr<lw_shared_ptr<query::result>>> query_partition_key_range(lw_shared_ptr<query::read_command> cmd, dht::partition_range_vector partition_ranges, db::consistency_level cl, tracing::trace_state_ptr trace_state);
     dht::partition_range_vector get_restricted_ranges(const schema& s, dht::partition_range range);
     float estimate_result_rows_per_range(lw_shared_ptr<query::read_command> cmd, keyspace& ks);
+    future<paxos::prepare_response> paxos_prepare_on(gms::inet_address ep, schema_ptr s, lw_shared_ptr<query::read_command> cmd,
+            const dht::decorated_key& key, utils::UUID ballot, bool only_digest, query::digest_algorithm da,
+            clock_type::time_point timeout, tracing::trace_state_ptr tr_state);
+    future<bool> paxos_accept_on(gms::inet_address ep, schema_ptr s, const paxos::proposal& p, clock_type::time_point timeout,
+            tracing::trace_state_ptr tr_state);
+    future<> paxos_learn_on(gms::inet_address ep, schema_ptr s, const paxos::proposal& decision, clock_type::time_point timeout,
+            tracing::trace_state_ptr tr_state);
+    future<bool> paxos_accept(schema_ptr s, const std::vector<gms::inet_address>& participants, size_t required,
+            db::consistency_level cl_for_paxos, const paxos::proposal& p, clock_type::time_point timeout, tracing::trace_state_ptr tr_state);
+    future<> paxos_learn(schema_ptr s, const dht::token& token, db::consistency_level cl, const paxos::proposal& decision,
+            clock_type::time_point timeout, tracing::trace_state_ptr tr_state);
     static std::vector<gms::inet_address> intersection(const std::vector<gms::inet_address>& l1, const std::vector<gms::inet_address>& l2);
+    future<std::vector<foreign_ptr<lw_shared_ptr<query::result>>>> query_partition_key_range_parallel(clock_type::time_point timeout,
+            std::vector<foreign_ptr<lw_shared_ptr<query::result>>>&& results, lw_shared_ptr<query::read_command> cmd, db::consistency_level cl, dht::partition_range_vector::iterator&& i,
+            dht::partition_range_vector&& ranges, tracing::trace_state_ptr trace_state,
+            uint32_t remaining_row_count, uint32_t remaining_partition_count);
     future<std::vector<foreign_ptr<lw_shared_ptr<query::result>>>> query_partition_key_range_concurrent(clock_type::time_point timeout,
             std::vector<foreign_ptr<lw_shared_ptr<query::result>>>&& results, lw_shared_ptr<query::read_command> cmd, db::consistency_level cl, dht::partition_range_vector::iterator&& i,
-            dht::partition_range_vector&& ranges, int concurrency_factor, tracing::trace_state_ptr trace_state,
+            dht::partition_range_vector&& ranges, int concurrency_factor, bool parallel, semaphore_units<> memory, tracing::trace_state_ptr trace_state,
             uint32_t remaining_row_count, uint32_t remaining_partition_count);
 
+    void invalidate_cached_results(const schema& s, const dht::token& token);
+    future<foreign_ptr<lw_shared_ptr<query::result>>> query_uncached(schema_ptr,
+        lw_shared_ptr<query::read_command> cmd,
+        dht::partition_range_vector&& partition_ranges,
+        db::consistency_level cl,
+        tracing::trace_state_ptr trace_state);
     future<foreign_ptr<lw_shared_ptr<query::result>>> do_query(schema_ptr,
         lw_shared_ptr<query::read_command> cmd,
         dht::partition_range_vector&& partition_ranges,
@@ -280,6 +379,8 @@ class storage_proxy : public seastar::async_sharded_service<storage_proxy> /*imp
     future<> mutate_internal(Range mutations, db::consistency_level cl, bool counter_write, tracing::trace_state_ptr tr_state, stdx::optional<clock_type::time_point> timeout_opt = { });
     future<foreign_ptr<lw_shared_ptr<reconcilable_result>>, cache_temperature> query_nonsingular_mutations_locally(
             schema_ptr s, lw_shared_ptr<query::read_command> cmd, const dht::partition_range_vector&& pr, tracing::trace_state_ptr trace_state, uint64_t max_size);
+    future<std::vector<bytes_opt>> query_aggregates_locally(schema_ptr s, lw_shared_ptr<query::read_command> cmd, dht::partition_range_vector prs,
+            std::vector<query::aggregate_selector> selectors, tracing::trace_state_ptr trace_state);
 
     struct frozen_mutation_and_schema {
         frozen_mutation fm;
@@ -303,13 +404,27 @@ class storage_proxy : public seastar::async_sharded_service<storage_proxy> /*imp
 
     void init_messaging_service();
 
+    // Starts the hints manager, if hinted handoff is enabled, and the view
+    // hints manager. Must be called after gossip has started.
+    future<> start_hints_manager();
+    future<> stop_hints_manager();
+
+    // Returns nullptr if hinted handoff is disabled.
+    db::hints::manager* get_hints_manager() {
+        return _hints_manager.get();
+    }
+
+    // Records a view update for its paired replica, to be replayed to it.
+    // Returns false if the update was dropped.
+    bool hint_view_update(const mutation& m, gms::inet_address target);
+
     // Applies mutation on this node.
     // Resolves with timed_out_error when timeout is reached.
     future<> mutate_locally(const mutation& m, clock_type::time_point timeout = clock_type::time_point::max());
     // Applies mutation on this node.
     // Resolves with timed_out_error when timeout is reached.
     future<> mutate_locally(const schema_ptr&, const frozen_mutation& m, clock_type::time_point timeout = clock_type::time_point::max());
-    // Applies mutations on this node.
+    // Applies mutations on this node, with one call to each shard they belong to.
     // Resolves with timed_out_error when timeout is reached.
     future<> mutate_locally(std::vector<mutation> mutation, clock_type::time_point timeout = clock_type::time_point::max());
 
@@ -348,12 +463,34 @@ class storage_proxy : public seastar::async_sharded_service<storage_proxy> /*imp
     */
     future<> mutate_atomically(std::vector<mutation> mutations, db::consistency_level cl, tracing::trace_state_ptr tr_state);
 
+    /**
+     * Applies the update of the request to a single partition if its
+     * conditions hold for the partition as read by cmd, atomically with the
+     * read, and tells whether they did. Uses Paxos among the replicas of the
+     * partition, of the local data center only for LOCAL_SERIAL, and commits
+     * the update with cl_for_commit.
+     *
+     * The read is done by the prepares, so an uncontended update costs a
+     * round trip for the prepare and one for the accept, plus one for the
+     * commit unless cl_for_commit is ANY. Rounds which lose to concurrent
+     * ones are retried after a random delay, for up to
+     * cas_contention_timeout_in_ms.
+     */
+    future<bool> cas(schema_ptr s, shared_ptr<paxos::cas_request> request, lw_shared_ptr<query::read_command> cmd,
+            dht::partition_range_vector partition_ranges, db::consistency_level cl_for_paxos, db::consistency_level cl_for_commit,
+            tracing::trace_state_ptr tr_state);
+
     // Send a mutation to one specific remote target.
     // Inspired by Cassandra's StorageProxy.sendToHintedEndpoints but without
     // hinted handoff support, and just one target. See also
     // send_to_live_endpoints() - another take on the same original function.
+    // Used by the hints manager to deliver hints.
     future<> send_to_endpoint(mutation m, gms::inet_address target, db::write_type type);
 
+    // Like send_to_endpoint(), for each mutation and its target. The
+    // mutations to the same target are sent to it in one message.
+    future<> send_to_endpoints(std::vector<std::pair<mutation, gms::inet_address>> mutations, db::write_type type);
+
     /**
      * Performs the truncate operatoin, which effectively deletes all data from
      * the column family cfname
@@ -377,6 +514,20 @@ class storage_proxy : public seastar::async_sharded_service<storage_proxy> /*imp
         db::consistency_level cl,
         tracing::trace_state_ptr trace_state);
 
+    /*
+     * Computes the given aggregates over non-singular partition ranges. Every
+     * range is read from a single live replica, which folds all the ranges it
+     * was picked for on all its shards and returns the partial results to be
+     * merged here. Gives the consistency of CL ONE; callers must check that
+     * cluster_supports_aggregate_query().
+     */
+    future<std::vector<bytes_opt>> query_aggregates(schema_ptr,
+        lw_shared_ptr<query::read_command> cmd,
+        dht::partition_range_vector partition_ranges,
+        std::vector<query::aggregate_selector> selectors,
+        db::consistency_level cl,
+        tracing::trace_state_ptr trace_state);
+
     future<foreign_ptr<lw_shared_ptr<reconcilable_result>>, cache_temperature> query_mutations_locally(
         schema_ptr, lw_shared_ptr<query::read_command> cmd, const dht::partition_range&,
         tracing::trace_state_ptr trace_state = nullptr,
@@ -396,10 +547,41 @@ class storage_proxy : public seastar::async_sharded_service<storage_proxy> /*imp
 
     future<> stop();
 
+    const coordinator_result_cache& get_result_cache() const {
+        return _result_cache;
+    }
+
     const stats& get_stats() const {
         return _stats;
     }
 
+    enum class overload_reason {
+        none,
+        write_bytes,
+        hints,
+    };
+    // Why a new client request should be rejected with an overloaded error
+    // rather than coordinated, if it should, counting the rejection: the
+    // writes coordinated by the shard hold twice the memory at which they
+    // start being throttled, or there are several times more hints in flight
+    // than writes to a node with hints in progress are allowed. Cheap, as it
+    // is checked for every request.
+    overload_reason shed_request() {
+        if (_stats.background_write_bytes + _stats.queued_write_bytes > _overload_write_bytes) {
+            ++_stats.requests_shed_write_bytes;
+            return overload_reason::write_bytes;
+        }
+        if (_total_hints_in_progress > _overload_hints_in_progress) {
+            ++_stats.requests_shed_hints;
+            return overload_reason::hints;
+        }
+        return overload_reason::none;
+    }
+
+    // Whether a read may be sent to one more replica, within
+    // speculative_retry_budget_percent.
+    bool try_speculate();
+
     friend class abstract_read_executor;
     friend class abstract_write_response_handler;
 };
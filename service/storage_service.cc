@@ -73,6 +73,7 @@
 #include "supervisor.hh"
 #include "sstables/compaction_manager.hh"
 #include "sstables/sstables.hh"
+#include "sstables/remove.hh"
 
 using token = dht::token;
 using UUID = utils::UUID;
@@ -90,6 +91,14 @@ static const sstring INDEXES_FEATURE = "INDEXES";
 static const sstring DIGEST_MULTIPARTITION_READ_FEATURE = "DIGEST_MULTIPARTITION_READ";
 static const sstring CORRECT_COUNTER_ORDER_FEATURE = "CORRECT_COUNTER_ORDER";
 static const sstring SCHEMA_TABLES_V3 = "SCHEMA_TABLES_V3";
+static const sstring ROW_LEVEL_REPAIR_FEATURE = "ROW_LEVEL_REPAIR";
+static const sstring MURMUR3_DIGEST_FEATURE = "MURMUR3_DIGEST";
+static const sstring AGGREGATE_QUERY_FEATURE = "AGGREGATE_QUERY";
+static const sstring SSTABLE_STREAMING_FEATURE = "SSTABLE_STREAMING";
+static const sstring MUTATION_BATCH_FEATURE = "MUTATION_BATCH";
+static const sstring REPLICA_FILTERING_FEATURE = "REPLICA_FILTERING";
+static const sstring LOCAL_INDEXES_FEATURE = "LOCAL_INDEXES";
+static const sstring COMPACT_QUERY_ROWS_FEATURE = "COMPACT_QUERY_ROWS";
 
 distributed<storage_service> _the_storage_service;
 
@@ -133,7 +142,15 @@ sstring storage_service::get_config_supported_features() {
         COUNTERS_FEATURE,
         DIGEST_MULTIPARTITION_READ_FEATURE,
         CORRECT_COUNTER_ORDER_FEATURE,
-        SCHEMA_TABLES_V3
+        SCHEMA_TABLES_V3,
+        ROW_LEVEL_REPAIR_FEATURE,
+        MURMUR3_DIGEST_FEATURE,
+        AGGREGATE_QUERY_FEATURE,
+        SSTABLE_STREAMING_FEATURE,
+        MUTATION_BATCH_FEATURE,
+        REPLICA_FILTERING_FEATURE,
+        LOCAL_INDEXES_FEATURE,
+        COMPACT_QUERY_ROWS_FEATURE
     };
     if (service::get_local_storage_service()._db.local().get_config().experimental()) {
         features.push_back(MATERIALIZED_VIEWS_FEATURE);
@@ -311,6 +328,8 @@ void storage_service::prepare_to_join(std::vector<inet_address> loaded_endpoints
     app_states.emplace(gms::application_state::SUPPORTED_FEATURES, value_factory.supported_features(features));
     app_states.emplace(gms::application_state::CACHE_HITRATES, value_factory.cache_hitrates(""));
     app_states.emplace(gms::application_state::SCHEMA_TABLES_VERSION, versioned_value(db::schema_tables::version));
+    app_states.emplace(gms::application_state::SHARDING, value_factory.sharding(smp::count,
+            dht::global_partitioner().sharding_ignore_msb(), netw::get_local_messaging_service().shard_port()));
     slogger.info("Starting up server gossip");
 
     auto& gossiper = gms::get_local_gossiper();
@@ -344,6 +363,14 @@ void storage_service::register_features() {
     _digest_multipartition_read_feature = gms::feature(DIGEST_MULTIPARTITION_READ_FEATURE);
     _correct_counter_order_feature = gms::feature(CORRECT_COUNTER_ORDER_FEATURE);
     _schema_tables_v3 = gms::feature(SCHEMA_TABLES_V3);
+    _row_level_repair_feature = gms::feature(ROW_LEVEL_REPAIR_FEATURE);
+    _murmur3_digest_feature = gms::feature(MURMUR3_DIGEST_FEATURE);
+    _aggregate_query_feature = gms::feature(AGGREGATE_QUERY_FEATURE);
+    _sstable_streaming_feature = gms::feature(SSTABLE_STREAMING_FEATURE);
+    _mutation_batch_feature = gms::feature(MUTATION_BATCH_FEATURE);
+    _replica_filtering_feature = gms::feature(REPLICA_FILTERING_FEATURE);
+    _local_indexes_feature = gms::feature(LOCAL_INDEXES_FEATURE);
+    _compact_query_rows_feature = gms::feature(COMPACT_QUERY_ROWS_FEATURE);
 
     if (_db.local().get_config().experimental()) {
         _materialized_views_feature = gms::feature(MATERIALIZED_VIEWS_FEATURE);
@@ -1005,6 +1032,9 @@ void storage_service::on_change(inet_address endpoint, application_state state,
         // we have (most likely) modified token metadata
         replicate_to_all_cores().get();
     } else {
+        if (state == application_state::SHARDING) {
+            update_peer_sharding(endpoint, value);
+        }
         auto& gossiper = gms::get_local_gossiper();
         auto* ep_state = gossiper.get_endpoint_state_for_endpoint_ptr(endpoint);
         if (!ep_state || gossiper.is_dead_state(*ep_state)) {
@@ -1023,8 +1053,33 @@ void storage_service::on_change(inet_address endpoint, application_state state,
 }
 
 
+// Runs inside seastar::async context
+void storage_service::update_peer_sharding(inet_address endpoint, const versioned_value& value) {
+    std::vector<sstring> pieces;
+    boost::split(pieces, value.value, boost::is_any_of(sstring(versioned_value::DELIMITER_STR)));
+    unsigned shard_count = 0;
+    unsigned ignore_msb = 0;
+    uint16_t shard_port = 0;
+    try {
+        if (pieces.size() >= 3) {
+            shard_count = boost::lexical_cast<unsigned>(pieces[0]);
+            ignore_msb = boost::lexical_cast<unsigned>(pieces[1]);
+            shard_port = boost::lexical_cast<uint16_t>(pieces[2]);
+        }
+    } catch (boost::bad_lexical_cast&) {
+        slogger.warn("Fail to parse sharding of {}: {}", endpoint, value);
+        shard_count = 0;
+    }
+    netw::get_messaging_service().invoke_on_all([endpoint, shard_count, ignore_msb, shard_port] (auto& ms) {
+        ms.set_peer_sharding(endpoint, shard_count, ignore_msb, shard_port);
+    }).get();
+}
+
 void storage_service::on_remove(gms::inet_address endpoint) {
     slogger.debug("endpoint={} on_remove", endpoint);
+    netw::get_messaging_service().invoke_on_all([endpoint] (auto& ms) {
+        ms.set_peer_sharding(endpoint, 0, 0, 0);
+    }).get();
     _token_metadata.remove_endpoint(endpoint);
     update_pending_ranges().get();
 }
@@ -1369,6 +1424,8 @@ future<> storage_service::init_server(int delay) {
 future<> storage_service::replicate_tm_only() {
     _shadow_token_metadata = _token_metadata;
 
+    // The copies share the token ring and the pending ranges of shard 0,
+    // which is copied again only when shard 0 next changes it.
     return get_storage_service().invoke_on_all([this](storage_service& local_ss){
         if (engine().cpu_id() != 0) {
             local_ss._token_metadata = _shadow_token_metadata;
@@ -1391,6 +1448,31 @@ future<> storage_service::replicate_to_all_cores() {
 future<> storage_service::do_replicate_to_all_cores() {
     return replicate_tm_only().handle_exception([] (auto e) {
         slogger.error("Fail to replicate _token_metadata: {}", e);
+    }).then([this] {
+        return precompute_replica_rings().handle_exception([] (auto e) {
+            slogger.warn("Fail to precompute the replicas of the ring: {}", e);
+        });
+    });
+}
+
+future<> storage_service::precompute_replica_rings() {
+    return seastar::async([this] {
+        // A copy, which doesn't change while computing yields.
+        auto tm = _shadow_token_metadata;
+        std::vector<lw_shared_ptr<keyspace_metadata>> keyspaces;
+        for (auto&& e : _db.local().get_keyspaces()) {
+            keyspaces.push_back(e.second.metadata());
+        }
+        for (auto&& ksm : keyspaces) {
+            auto rs = locator::abstract_replication_strategy::create_replication_strategy(ksm->name(),
+                    ksm->strategy_name(), tm, ksm->strategy_options());
+            auto ring = rs->make_replica_ring(tm, true);
+            _db.invoke_on_all([name = ksm->name(), ring] (database& db) {
+                if (db.has_keyspace(name)) {
+                    db.find_keyspace(name).get_replication_strategy().set_replica_ring(ring);
+                }
+            }).get();
+        }
     });
 }
 
@@ -1780,7 +1862,7 @@ future<> storage_service::take_snapshot(sstring tag, std::vector<sstring> keyspa
                     auto& ks = db.find_keyspace(ks_name);
                     return parallel_for_each(ks.metadata()->cf_meta_data(), [&db, tag = std::move(tag)] (auto& pair) {
                         auto& cf = db.find_column_family(pair.second);
-                        return cf.snapshot(tag);
+                        return cf.snapshot(tag, db.get_config().incremental_snapshots());
                     });
                 });
             });
@@ -1812,14 +1894,18 @@ future<> storage_service::take_column_family_snapshot(sstring ks_name, sstring c
         return check_snapshot_not_exist(_db.local(), ks_name, tag).then([this, ks_name, cf_name, tag] {
             return _db.invoke_on_all([ks_name, cf_name, tag] (database &db) {
                 auto& cf = db.find_column_family(ks_name, cf_name);
-                return cf.snapshot(tag);
+                return cf.snapshot(tag, db.get_config().incremental_snapshots());
             });
         });
     });
 }
 
 future<> storage_service::clear_snapshot(sstring tag, std::vector<sstring> keyspace_names) {
-    return _db.local().clear_snapshot(tag, keyspace_names);
+    return _db.invoke_on_all([tag, keyspace_names] (database& db) {
+        return db.release_snapshot(tag, keyspace_names);
+    }).then([this, tag, keyspace_names] {
+        return _db.local().clear_snapshot(tag, keyspace_names);
+    });
 }
 
 future<std::unordered_map<sstring, std::vector<service::storage_service::snapshot_details>>>
@@ -1844,9 +1930,10 @@ storage_service::get_snapshot_details() {
                         rp.emplace(cf.first, std::move(cf.second));
                         continue;
                     }
+                    // Each shard accounts for the sstables it linked.
                     auto& rcf = rp.at(cf.first);
-                    rcf.live = cf.second.live;
-                    rcf.total = cf.second.total;
+                    rcf.live += cf.second.live;
+                    rcf.total += cf.second.total;
                 }
             }
             return make_ready_future<>();
@@ -1980,10 +2067,14 @@ future<> storage_service::start_native_transport() {
 
                 struct listen_cfg {
                     ipv4_addr addr;
+                    bool is_shard_aware;
                     std::shared_ptr<seastar::tls::credentials_builder> cred;
                 };
 
-                std::vector<listen_cfg> configs({ { ipv4_addr{ip, cfg.native_transport_port()} }});
+                std::vector<listen_cfg> configs({ { ipv4_addr{ip, cfg.native_transport_port()}, false } });
+                if (cfg.native_shard_aware_transport_port()) {
+                    configs.emplace_back(listen_cfg{ipv4_addr{ip, cfg.native_shard_aware_transport_port()}, true});
+                }
 
                 // main should have made sure values are clean and neatish
                 if (ceo.at("enabled") == "true") {
@@ -2007,17 +2098,23 @@ future<> storage_service::start_native_transport() {
                     slogger.info("Enabling encrypted CQL connections between client and server");
 
                     if (cfg.native_transport_port_ssl.is_set() && cfg.native_transport_port_ssl() != cfg.native_transport_port()) {
-                        configs.emplace_back(listen_cfg{ipv4_addr{ip, cfg.native_transport_port_ssl()}, std::move(cred)});
+                        configs.emplace_back(listen_cfg{ipv4_addr{ip, cfg.native_transport_port_ssl()}, false, cred});
+                        if (cfg.native_shard_aware_transport_port_ssl()) {
+                            configs.emplace_back(listen_cfg{ipv4_addr{ip, cfg.native_shard_aware_transport_port_ssl()}, true, std::move(cred)});
+                        }
                     } else {
-                        configs.back().cred = std::move(cred);
+                        for (auto&& c : configs) {
+                            c.cred = cred;
+                        }
                     }
                 }
 
                 return f.then([cserver, configs = std::move(configs), keepalive] {
                     return parallel_for_each(configs, [cserver, keepalive](const listen_cfg & cfg) {
-                        return cserver->invoke_on_all(&cql_transport::cql_server::listen, cfg.addr, cfg.cred, keepalive).then([cfg] {
-                            slogger.info("Starting listening for CQL clients on {} ({})"
+                        return cserver->invoke_on_all(&cql_transport::cql_server::listen, cfg.addr, cfg.cred, keepalive, cfg.is_shard_aware).then([cfg] {
+                            slogger.info("Starting listening for CQL clients on {} ({}{})"
                                             , cfg.addr, cfg.cred ? "encrypted" : "unencrypted"
+                                            , cfg.is_shard_aware ? ", shard-aware" : ""
                                             );
                         });
                     });
@@ -2344,6 +2441,7 @@ future<> storage_service::rebuild(sstring source_dc) {
         slogger.info("rebuild from dc: {}", source_dc == "" ? "(any dc)" : source_dc);
         auto streamer = make_lw_shared<dht::range_streamer>(ss._db, ss._token_metadata, ss.get_broadcast_address(), "Rebuild");
         streamer->add_source_filter(std::make_unique<dht::range_streamer::failure_detector_source_filter>(gms::get_local_failure_detector()));
+        streamer->set_resumable();
         if (source_dc != "") {
             streamer->add_source_filter(std::make_unique<dht::range_streamer::single_datacenter_filter>(source_dc));
         }
@@ -2752,6 +2850,62 @@ future<> storage_service::load_new_sstables(sstring ks_name, sstring cf_name) {
     });
 }
 
+future<> storage_service::bulk_load(sstring ks_name, sstring cf_name) {
+    if (_loading_new_sstables) {
+        throw std::runtime_error("Already loading SSTables. Try again later");
+    } else {
+        _loading_new_sstables = true;
+    }
+
+    return seastar::async([this, ks_name, cf_name] {
+        auto sstables = distributed_loader::list_upload_dir(_db, ks_name, cf_name).get0();
+        if (sstables.empty()) {
+            slogger.info("No SSTables to bulk load were found for {}.{}", ks_name, cf_name);
+            return false;
+        }
+        slogger.info("Bulk loading {} SSTables for {}.{}...", sstables.size(), ks_name, cf_name);
+
+        auto my_address = get_broadcast_address();
+        auto& strat = _db.local().find_keyspace(ks_name).get_replication_strategy();
+        auto tm = _token_metadata.clone_only_token_map();
+        std::unordered_map<inet_address, dht::token_range_vector> ranges_per_endpoint;
+        for (auto& x : strat.get_range_addresses(tm)) {
+            ranges_per_endpoint[x.second].emplace_back(x.first);
+        }
+
+        // Every shard of every replica reads its own share of the ranges out
+        // of the sstables, in parallel, at the streaming priority.
+        bool is_replica = false;
+        streaming::stream_plan plan("Bulk load");
+        for (auto& x : ranges_per_endpoint) {
+            if (x.first == my_address) {
+                is_replica = true;
+                continue;
+            }
+            slogger.debug("Will stream ranges {} of {}.{} to endpoint {}", x.second, ks_name, cf_name, x.first);
+            plan.transfer_sstables(x.first, ks_name, cf_name, std::move(x.second), sstables);
+        }
+        plan.execute().discard_result().get();
+        slogger.info("Done streaming SSTables of {}.{} to the other replicas", ks_name, cf_name);
+        return is_replica;
+    }).then_wrapped([this, ks_name, cf_name] (future<bool> f) {
+        _loading_new_sstables = false;
+        if (!f.get0()) {
+            return distributed_loader::list_upload_dir(_db, ks_name, cf_name).then([this, ks_name, cf_name] (auto sstables) {
+                auto& cf = _db.local().find_column_family(ks_name, cf_name);
+                return parallel_for_each(sstables, [&cf, ks_name, cf_name] (const sstables::entry_descriptor& comps) {
+                    auto toc = sstables::sstable::filename(cf.dir() + "/upload", ks_name, cf_name, comps.version,
+                            comps.generation, comps.format, sstables::sstable::component_type::TOC);
+                    return sstables::remove_by_toc_name(toc);
+                });
+            });
+        }
+        // This node owns some of the data too, so it loads the sstables like
+        // a refresh does, leaving what it doesn't own to cleanup.
+        return load_new_sstables(ks_name, cf_name);
+    });
+}
+
 void storage_service::set_load_broadcaster(shared_ptr<load_broadcaster> lb) {
     _lb = lb;
 }
@@ -3130,26 +3284,79 @@ std::chrono::milliseconds storage_service::get_ring_delay() {
     return std::chrono::milliseconds(ring_delay);
 }
 
+std::unordered_map<sstring, storage_service::pending_ranges_type>
+storage_service::calculate_pending_ranges(token_metadata& tm, bool preemptible) {
+    std::unordered_map<sstring, pending_ranges_type> ret;
+    auto keyspaces = _db.local().get_non_system_keyspaces();
+    if (!tm.has_pending_changes()) {
+        for (auto& keyspace_name : keyspaces) {
+            ret.emplace(keyspace_name, pending_ranges_type());
+        }
+        return ret;
+    }
+    // The pending ranges only depend on the replication strategy and its
+    // options, which most keyspaces share.
+    using strategy_key = std::pair<locator::replication_strategy_type, std::map<sstring, sstring>>;
+    std::map<strategy_key, const pending_ranges_type*> calculated;
+    auto metadata = tm.clone_only_token_map();
+    for (auto& keyspace_name : keyspaces) {
+        if (!_db.local().has_keyspace(keyspace_name)) {
+            continue;
+        }
+        auto& strategy = _db.local().find_keyspace(keyspace_name).get_replication_strategy();
+        auto key = strategy_key(strategy.get_type(), strategy.get_config_options());
+        auto it = calculated.find(key);
+        if (it != calculated.end()) {
+            ret.emplace(keyspace_name, *it->second);
+            continue;
+        }
+        auto& ranges = ret[keyspace_name] = tm.calculate_pending_ranges(strategy, metadata);
+        calculated.emplace(std::move(key), &ranges);
+        if (preemptible && seastar::thread::should_yield()) {
+            seastar::thread::yield();
+        }
+    }
+    return ret;
+}
+
 void storage_service::do_update_pending_ranges() {
     if (engine().cpu_id() != 0) {
         throw std::runtime_error("do_update_pending_ranges should be called on cpu zero");
     }
-    // long start = System.currentTimeMillis();
-    auto keyspaces = _db.local().get_non_system_keyspaces();
-    for (auto& keyspace_name : keyspaces) {
-        auto& ks = _db.local().find_keyspace(keyspace_name);
-        auto& strategy = ks.get_replication_strategy();
-        get_local_storage_service().get_token_metadata().calculate_pending_ranges(strategy, keyspace_name);
+    ++_pending_ranges_generation;
+    for (auto&& x : calculate_pending_ranges(_token_metadata, false)) {
+        _token_metadata.set_pending_ranges(x.first, std::move(x.second));
+    }
+    if (slogger.is_enabled(logging::log_level::debug)) {
+        slogger.debug("Pending ranges: {}", _token_metadata.print_pending_ranges());
     }
-    // slogger.debug("finished calculation for {} keyspaces in {}ms", keyspaces.size(), System.currentTimeMillis() - start);
 }
 
 future<> storage_service::update_pending_ranges() {
     return get_storage_service().invoke_on(0, [] (auto& ss){
         ss._update_jobs++;
-        ss.do_update_pending_ranges();
-        // calculate_pending_ranges will modify token_metadata, we need to repliate to other cores
-        return ss.replicate_to_all_cores().finally([&ss, ss0 = ss.shared_from_this()] {
+        return with_semaphore(ss._pending_ranges_sem, 1, [&ss] {
+            // Calculated on a snapshot of the token metadata, in the
+            // background, so that large rings don't stall the shard. Topology
+            // changes made meanwhile schedule their own calculation.
+            return seastar::async([&ss] {
+                auto generation = ++ss._pending_ranges_generation;
+                auto snapshot = ss._token_metadata;
+                auto pending_ranges = ss.calculate_pending_ranges(snapshot, true);
+                if (generation != ss._pending_ranges_generation) {
+                    slogger.debug("Pending ranges were calculated meanwhile, dropping the results");
+                    return;
+                }
+                for (auto&& x : pending_ranges) {
+                    if (ss._db.local().has_keyspace(x.first)) {
+                        ss._token_metadata.set_pending_ranges(x.first, std::move(x.second));
+                    }
+                }
+            });
+        }).then([&ss] {
+            // calculate_pending_ranges will modify token_metadata, we need to repliate to other cores
+            return ss.replicate_to_all_cores();
+        }).finally([&ss, ss0 = ss.shared_from_this()] {
             ss._update_jobs--;
         });
     });
@@ -114,6 +114,11 @@ class storage_service : public service::migration_listener, public gms::i_endpoi
 #endif
     distributed<database>& _db;
     int _update_jobs{0};
+    // Serializes the calculations of pending ranges which yield.
+    semaphore _pending_ranges_sem{1};
+    // Bumped by each calculation of pending ranges, so that a calculation
+    // which yielded doesn't store its results over those of a newer one.
+    uint64_t _pending_ranges_generation = 0;
     // Note that this is obviously only valid for the current shard. Users of
     // this facility should elect a shard to be the coordinator based on any
     // given objective criteria
@@ -139,7 +144,10 @@ class storage_service : public service::migration_listener, public gms::i_endpoi
     void uninit_messaging_service();
 
 private:
+    using pending_ranges_type = std::unordered_multimap<range<token>, inet_address>;
     void do_update_pending_ranges();
+    // Must run in a seastar::thread. Yields between the distinct replication strategies.
+    std::unordered_map<sstring, pending_ranges_type> calculate_pending_ranges(token_metadata& tm, bool preemptible);
 
 public:
     future<> keyspace_changed(const sstring& ks_name);
@@ -267,6 +275,14 @@ class storage_service : public service::migration_listener, public gms::i_endpoi
     gms::feature _digest_multipartition_read_feature;
     gms::feature _correct_counter_order_feature;
     gms::feature _schema_tables_v3;
+    gms::feature _row_level_repair_feature;
+    gms::feature _murmur3_digest_feature;
+    gms::feature _aggregate_query_feature;
+    gms::feature _sstable_streaming_feature;
+    gms::feature _mutation_batch_feature;
+    gms::feature _replica_filtering_feature;
+    gms::feature _local_indexes_feature;
+    gms::feature _compact_query_rows_feature;
 public:
     void enable_all_features() {
         _range_tombstones_feature.enable();
@@ -277,6 +293,14 @@ class storage_service : public service::migration_listener, public gms::i_endpoi
         _digest_multipartition_read_feature.enable();
         _correct_counter_order_feature.enable();
         _schema_tables_v3.enable();
+        _row_level_repair_feature.enable();
+        _murmur3_digest_feature.enable();
+        _aggregate_query_feature.enable();
+        _sstable_streaming_feature.enable();
+        _mutation_batch_feature.enable();
+        _replica_filtering_feature.enable();
+        _local_indexes_feature.enable();
+        _compact_query_rows_feature.enable();
     }
 
     void finish_bootstrapping() {
@@ -683,6 +707,8 @@ class storage_service : public service::migration_listener, public gms::i_endpoi
 private:
     void update_peer_info(inet_address endpoint);
     void do_update_system_peers_table(gms::inet_address endpoint, const application_state& state, const versioned_value& value);
+    // Tells the messaging service of every shard how the endpoint shards its data.
+    void update_peer_sharding(gms::inet_address endpoint, const versioned_value& value);
     sstring get_application_state_value(inet_address endpoint, application_state appstate);
     std::unordered_set<token> get_tokens_for(inet_address endpoint);
     future<> replicate_to_all_cores();
@@ -699,6 +725,15 @@ class storage_service : public service::migration_listener, public gms::i_endpoi
      */
     future<> replicate_tm_only();
 
+    /**
+     * Computes on shard 0 the replicas of all ranges of every keyspace, for
+     * the token_metadata just replicated, and hands them to all shards. Saves
+     * every shard from computing them on its request path.
+     *
+     * Should run on shard 0 only.
+     */
+    future<> precompute_replica_rings();
+
     /**
      * Handle node bootstrap
      *
@@ -2078,6 +2113,19 @@ class storage_service : public service::migration_listener, public gms::i_endpoi
      * @return a future<> when the operation finishes.
      */
     future<> load_new_sstables(sstring ks_name, sstring cf_name);
+
+    /**
+     * Load the SSTables of the upload directory of a column family into the
+     * cluster, by streaming their data to the replicas owning it.
+     *
+     * If this node is a replica of some of the data, the SSTables are then
+     * loaded locally as by load_new_sstables(), otherwise they are removed.
+     *
+     * @param ks_name the keyspace of the column family.
+     * @param cf_name the column family whose upload directory is loaded.
+     * @return a future<> when the operation finishes.
+     */
+    future<> bulk_load(sstring ks_name, sstring cf_name);
 #if 0
     /**
      * #{@inheritDoc}
@@ -2241,6 +2289,38 @@ class storage_service : public service::migration_listener, public gms::i_endpoi
     const gms::feature& cluster_supports_schema_tables_v3() const {
         return _schema_tables_v3;
     }
+
+    bool cluster_supports_row_level_repair() const {
+        return bool(_row_level_repair_feature);
+    }
+
+    bool cluster_supports_murmur3_digest() const {
+        return bool(_murmur3_digest_feature);
+    }
+
+    bool cluster_supports_aggregate_query() const {
+        return bool(_aggregate_query_feature);
+    }
+
+    bool cluster_supports_replica_filtering() const {
+        return bool(_replica_filtering_feature);
+    }
+
+    bool cluster_supports_local_indexes() const {
+        return bool(_local_indexes_feature);
+    }
+
+    bool cluster_supports_compact_query_rows() const {
+        return bool(_compact_query_rows_feature);
+    }
+
+    bool cluster_supports_sstable_streaming() const {
+        return bool(_sstable_streaming_feature);
+    }
+
+    bool cluster_supports_mutation_batch() const {
+        return bool(_mutation_batch_feature);
+    }
 };
 
 inline future<> init_storage_service(distributed<database>& db) {
@@ -47,10 +47,12 @@
 #include <boost/range/algorithm.hpp>
 #include <boost/range/adaptors.hpp>
 #include <boost/range/join.hpp>
+#include <boost/range/irange.hpp>
 #include <boost/algorithm/cxx11/any_of.hpp>
 
 #include "core/future-util.hh"
 #include "core/pipe.hh"
+#include <seastar/util/defer.hh>
 
 #include "sstables.hh"
 #include "compaction.hh"
@@ -64,28 +66,86 @@
 #include "db_clock.hh"
 #include "mutation_compactor.hh"
 #include "leveled_manifest.hh"
+#include "utils/UUID_gen.hh"
+#include "utils/task_context_guard.hh"
+#include "utils/cost_accountant.hh"
 
 namespace sstables {
 
 logging::logger clogger("compaction");
 
-static api::timestamp_type get_max_purgeable_timestamp(const column_family& cf, sstable_set::incremental_selector& selector,
-        const std::unordered_set<shared_sstable>& compacting_set, const dht::decorated_key& dk) {
-    auto timestamp = api::max_timestamp;
-    stdx::optional<utils::hashed_key> hk;
-    for (auto&& sst : boost::range::join(selector.select(dk.token()).sstables, cf.compacted_undeleted_sstables())) {
-        if (compacting_set.count(sst)) {
-            continue;
+// Calculates the timestamp below which the tombstones of a partition being
+// compacted can be purged: the minimum timestamp of the sstables outside the
+// compaction which may hold the partition.
+//
+// Expects the partitions in token order. The sstables overlapping a token are
+// selected once per interval of the selector, sorted by their minimum
+// timestamp, so that the bloom filters are only checked until the first
+// sstable holding the partition is found, and never for the sstables which
+// can't lower the result.
+class max_purgeable_timestamp_calculator {
+    const column_family& _cf;
+    sstable_set::incremental_selector& _selector;
+    std::unordered_set<shared_sstable> _compacting;
+    // Non-compacting sstables which overlap [_first, _next), by ascending minimum timestamp.
+    std::vector<shared_sstable> _candidates;
+    stdx::optional<dht::token> _first;
+    dht::token _next;
+private:
+    void select(const dht::token& t) {
+        auto selection = _selector.select(t);
+        _candidates.clear();
+        for (auto&& sst : selection.sstables) {
+            if (!_compacting.count(sst)) {
+                _candidates.push_back(sst);
+            }
         }
-        if (!hk) {
-            hk = sstables::sstable::make_hashed_key(*cf.schema(), dk.key());
+        boost::sort(_candidates, [] (const shared_sstable& a, const shared_sstable& b) {
+            return a->get_stats_metadata().min_timestamp < b->get_stats_metadata().min_timestamp;
+        });
+        _first = t;
+        _next = selection.next_token;
+    }
+public:
+    max_purgeable_timestamp_calculator(const column_family& cf, sstable_set::incremental_selector& selector,
+            std::unordered_set<shared_sstable> compacting)
+        : _cf(cf)
+        , _selector(selector)
+        , _compacting(std::move(compacting)) {
+    }
+
+    api::timestamp_type operator()(const dht::decorated_key& dk) {
+        auto& t = dk.token();
+        if (!_first || t < *_first || !(t < _next)) {
+            select(t);
         }
-        if (sst->filter_has_key(*hk)) {
-            timestamp = std::min(timestamp, sst->get_stats_metadata().min_timestamp);
+        auto timestamp = api::max_timestamp;
+        stdx::optional<utils::hashed_key> hk;
+        auto has_key = [&] (const shared_sstable& sst) {
+            if (!hk) {
+                hk = sstables::sstable::make_hashed_key(*_cf.schema(), dk.key());
+            }
+            return sst->filter_has_key(*hk);
+        };
+        // Sstables compacted by other compactions but not deleted yet can
+        // still hold data shadowed by the tombstones. There are few of them.
+        for (auto&& sst : _cf.compacted_undeleted_sstables()) {
+            if (!_compacting.count(sst) && sst->get_stats_metadata().min_timestamp < timestamp && has_key(sst)) {
+                timestamp = sst->get_stats_metadata().min_timestamp;
+            }
+        }
+        for (auto&& sst : _candidates) {
+            if (sst->get_stats_metadata().min_timestamp >= timestamp) {
+                break;
+            }
+            if (has_key(sst)) {
+                timestamp = sst->get_stats_metadata().min_timestamp;
+                break;
+            }
         }
+        return timestamp;
     }
-    return timestamp;
-}
+};
 
 static bool belongs_to_current_node(const dht::token& t, const dht::token_range_vector& sorted_owned_ranges) {
     auto low = std::lower_bound(sorted_owned_ranges.begin(), sorted_owned_ranges.end(), t,
@@ -128,20 +188,71 @@ static std::vector<shared_sstable> get_uncompacting_sstables(column_family& cf,
     return not_compacted_sstables;
 }
 
+using compaction_stage = compaction_stage_times::stage;
+
+// Splits the time of the compaction thread between the stages of the
+// compaction. The time of a stage timed, or added, within another is
+// deducted from the latter.
+class compaction_stage_clock {
+    using clock = compaction_stage_times::clock;
+    compaction_stage_times& _times;
+    // Of all stages.
+    clock::duration _total = clock::duration::zero();
+public:
+    explicit compaction_stage_clock(compaction_stage_times& times) : _times(times) {}
+
+    void add(compaction_stage s, clock::duration d) {
+        _times[s] += d;
+        _total += d;
+    }
+
+    template <typename Func>
+    auto timed(compaction_stage s, Func&& func) {
+        auto start = clock::now();
+        auto total = _total;
+        auto account = defer([&] {
+            add(s, std::max(clock::now() - start - (_total - total), clock::duration::zero()));
+        });
+        return func();
+    }
+};
+
+// Reports the compression of the new sstables, and their writes, as stages
+// of the compaction.
+class compaction_write_monitor final : public write_monitor {
+    compaction_stage_clock& _clock;
+public:
+    explicit compaction_write_monitor(compaction_stage_clock& clock) : _clock(clock) {}
+
+    virtual void on_write_completed() override { }
+    virtual void on_flush_completed() override { }
+    virtual void on_compress(std::chrono::steady_clock::duration d) override {
+        _clock.add(compaction_stage::compress, d);
+    }
+    virtual void on_write_wait(std::chrono::steady_clock::duration d) override {
+        _clock.add(compaction_stage::write_wait, d);
+    }
+};
+
 class compaction;
 
 class compacting_sstable_writer {
     compaction& _c;
     sstable_writer* _writer = nullptr;
+    // Of the table, set with the first partition.
+    utils::cost_accountant::usage* _cost = nullptr;
 public:
     explicit compacting_sstable_writer(compaction& c) : _c(c) {}
 
+    void check_stop_requested() const;
     void consume_new_partition(const dht::decorated_key& dk);
 
-    void consume(tombstone t) { _writer->consume(t); }
-    stop_iteration consume(static_row&& sr, tombstone, bool) { return _writer->consume(std::move(sr)); }
-    stop_iteration consume(clustering_row&& cr, row_tombstone, bool) { return _writer->consume(std::move(cr)); }
-    stop_iteration consume(range_tombstone&& rt) { return _writer->consume(std::move(rt)); }
+    void consume(tombstone t);
+    stop_iteration consume(static_row&& sr, tombstone, bool);
+    // Also checked between rows, so that stopping a compaction, like
+    // truncate does, doesn't wait for the end of a large partition.
+    stop_iteration consume(clustering_row&& cr, row_tombstone, bool);
+    stop_iteration consume(range_tombstone&& rt);
 
     stop_iteration consume_end_of_partition();
     void consume_end_of_stream();
@@ -158,6 +269,20 @@ class compaction {
     std::vector<unsigned long> _ancestors;
     db::replay_position _rp;
     seastar::thread_scheduling_group* _tsg;
+    // The partitions which are compacted. Only those of the input sstables which
+    // fall into it are read and written.
+    dht::partition_range _range = query::full_partition_range;
+    // New sstables which were already handed over to the column family by an
+    // incremental compaction. They must survive if the compaction fails.
+    std::unordered_set<shared_sstable> _replaced_new_sstables;
+    // Input sstables whose data is all expired and purgeable. They aren't read, and
+    // are replaced with nothing.
+    std::unordered_set<shared_sstable> _expired_sstables;
+    uint64_t _expired_size = 0;
+    compaction_stage_clock _stage_clock{_info->stage_times};
+    seastar::shared_ptr<write_monitor> _write_monitor = seastar::make_shared<compaction_write_monitor>(_stage_clock);
+    // Of the sstables read, when last accounted.
+    uint64_t _decompress_ns = 0;
 protected:
     compaction(column_family& cf, std::vector<shared_sstable> sstables, uint64_t max_sstable_size, uint32_t sstable_level, seastar::thread_scheduling_group* tsg)
         : _cf(cf)
@@ -170,7 +295,9 @@ class compaction {
     }
 
     uint64_t partitions_per_sstable() const {
-        uint64_t estimated_sstables = std::max(1UL, uint64_t(ceil(double(_info->start_size) / _max_sstable_size)));
+        // The output shrinks as much as the partitions of the inputs overlap.
+        auto output_ratio = _info->total_partitions ? std::min(1.0, double(_estimated_partitions) / _info->total_partitions) : 1.0;
+        uint64_t estimated_sstables = std::max(1UL, uint64_t(ceil(double(_info->start_size) * output_ratio / _max_sstable_size)));
         return ceil(double(_estimated_partitions) / estimated_sstables);
     }
 
@@ -209,14 +336,21 @@ class compaction {
         auto ssts = make_lw_shared<sstables::sstable_set>(_cf.get_compaction_strategy().make_sstable_set(_cf.schema()));
         auto schema = _cf.schema();
         sstring formatted_msg = "[";
+        partition_count_estimator estimator;
 
         for (auto& sst : _sstables) {
+            if (_expired_sstables.count(sst)) {
+                formatted_msg += sprint("%s:level=%d:expired, ", sst->get_filename(), sst->get_sstable_level());
+                _info->start_size += sst->bytes_on_disk();
+                _expired_size += sst->bytes_on_disk();
+                continue;
+            }
             // We also capture the sstable, so we keep it alive while the read isn't done
             ssts->insert(sst);
-            // FIXME: If the sstables have cardinality estimation bitmaps, use that
-            // for a better estimate for the number of partitions in the merged
-            // sstable than just adding up the lengths of individual sstables.
-            _estimated_partitions += sst->get_estimated_key_count();
+            // The cardinality estimators of the sstables are merged, so that
+            // partitions present in several of them are counted once when
+            // sizing the output sstables.
+            estimator.add(*sst);
             _info->total_partitions += sst->get_estimated_key_count();
             // Compacted sstable keeps track of its ancestors.
             _ancestors.push_back(sst->generation());
@@ -232,6 +366,8 @@ class compaction {
             _rp = std::max(_rp, sst->get_stats_metadata().position);
         }
         formatted_msg += "]";
+        _decompress_ns = input_decompress_ns();
+        _estimated_partitions = estimator.estimate();
         _info->sstables = _sstables.size();
         _info->ks = schema->ks_name();
         _info->cf = schema->cf_name();
@@ -239,7 +375,7 @@ class compaction {
 
         return ::make_range_sstable_reader(_cf.schema(),
                 ssts,
-                query::full_partition_range,
+                _range,
                 _cf.schema()->full_slice(),
                 service::get_local_compaction_priority(),
                 no_resource_tracking(),
@@ -269,6 +405,10 @@ class compaction {
             std::chrono::duration_cast<std::chrono::milliseconds>(duration).count(), throughput,
             _info->total_partitions, _info->total_keys_written);
         report_finish(formatted_msg, ended_at);
+        if (_expired_size) {
+            _cf.get_compaction_manager().account_expired_sstables(_expired_sstables.size(), _expired_size);
+        }
+        _cf.get_compaction_manager().account_stage_times(_cf.get_compaction_strategy().type(), _info->stage_times, _info->start_size);
 
         auto info = std::move(_info);
         _cf.get_compaction_manager().deregister_compaction(info);
@@ -304,34 +444,150 @@ class compaction {
     const schema_ptr& schema() const {
         return _cf.schema();
     }
+
+    // The jobs of a split compaction which read the same sstables count the
+    // decompression of each other.
+    uint64_t input_decompress_ns() const {
+        uint64_t ns = 0;
+        for (auto& sst : _sstables) {
+            ns += sst->get_read_stats().compaction_decompress_ns;
+        }
+        return ns;
+    }
+
+    template <typename Func>
+    auto timed_read(Func&& func) {
+        return _stage_clock.timed(compaction_stage::read_wait, [&] {
+            // The chunks are decompressed by the read-ahead, mostly while
+            // the thread waits for the input.
+            auto account = defer([&] {
+                auto ns = input_decompress_ns();
+                _stage_clock.add(compaction_stage::decompress, std::chrono::nanoseconds(ns - std::exchange(_decompress_ns, ns)));
+            });
+            return func();
+        });
+    }
+
+    template <typename Func>
+    auto timed_merge(Func&& func) {
+        return _stage_clock.timed(compaction_stage::merge, std::forward<Func>(func));
+    }
+
+    // consume_flattened_in_thread(), timing the stages of the compaction.
+    template <typename Consumer, typename Filter>
+    void consume_in_thread(::mutation_reader& mr, Consumer& c, Filter&& filter) {
+        while (true) {
+            auto smopt = timed_read([&] { return mr().get0(); });
+            if (!smopt) {
+                break;
+            }
+            auto& sm = *smopt;
+            if (!filter(sm)) {
+                continue;
+            }
+            timed_merge([&] {
+                c.consume_new_partition(sm.decorated_key());
+                if (sm.partition_tombstone()) {
+                    c.consume(sm.partition_tombstone());
+                }
+            });
+            auto stop = stop_iteration::no;
+            while (!stop) {
+                if (sm.is_buffer_empty()) {
+                    if (sm.is_end_of_stream()) {
+                        break;
+                    }
+                    timed_read([&] { sm.fill_buffer().get(); });
+                    continue;
+                }
+                // Timed by buffer rather than by fragment, to keep clock reads few.
+                stop = timed_merge([&] {
+                    while (!sm.is_buffer_empty()) {
+                        if (sm.pop_mutation_fragment().consume_streamed_mutation(c) == stop_iteration::yes) {
+                            return stop_iteration::yes;
+                        }
+                    }
+                    return stop_iteration::no;
+                });
+            }
+            if (timed_merge([&] { return c.consume_end_of_partition(); }) == stop_iteration::yes) {
+                break;
+            }
+        }
+        timed_merge([&] { c.consume_end_of_stream(); });
+    }
 public:
     static future<compaction_info> run(std::unique_ptr<compaction> c);
 
     friend class compacting_sstable_writer;
 };
 
-void compacting_sstable_writer::consume_new_partition(const dht::decorated_key& dk) {
+void compacting_sstable_writer::check_stop_requested() const {
     if (_c._info->is_stop_requested()) {
         // Compaction manager will catch this exception and re-schedule the compaction.
         throw compaction_stop_exception(_c._info->ks, _c._info->cf, _c._info->stop_requested);
     }
-    _writer = _c.select_sstable_writer(dk);
-    _writer->consume_new_partition(dk);
+}
+
+void compacting_sstable_writer::consume_new_partition(const dht::decorated_key& dk) {
+    check_stop_requested();
+    utils::task_context_guard task_ctx(utils::task_context::compaction);
+    _cost = &_c._cf.cost();
+    utils::cost_guard cost(_cost);
+    _c._stage_clock.timed(compaction_stage::serialize, [&] {
+        _writer = _c.select_sstable_writer(dk);
+        _writer->consume_new_partition(dk);
+    });
     _c._info->total_keys_written++;
 }
 
+void compacting_sstable_writer::consume(tombstone t) {
+    _c._stage_clock.timed(compaction_stage::serialize, [&] {
+        _writer->consume(t);
+    });
+}
+
+stop_iteration compacting_sstable_writer::consume(static_row&& sr, tombstone, bool) {
+    utils::task_context_guard task_ctx(utils::task_context::compaction);
+    utils::cost_guard cost(_cost);
+    return _c._stage_clock.timed(compaction_stage::serialize, [&] {
+        return _writer->consume(std::move(sr));
+    });
+}
+
+stop_iteration compacting_sstable_writer::consume(clustering_row&& cr, row_tombstone, bool) {
+    check_stop_requested();
+    utils::task_context_guard task_ctx(utils::task_context::compaction);
+    utils::cost_guard cost(_cost);
+    return _c._stage_clock.timed(compaction_stage::serialize, [&] {
+        return _writer->consume(std::move(cr));
+    });
+}
+
+stop_iteration compacting_sstable_writer::consume(range_tombstone&& rt) {
+    return _c._stage_clock.timed(compaction_stage::serialize, [&] {
+        return _writer->consume(std::move(rt));
+    });
+}
+
 stop_iteration compacting_sstable_writer::consume_end_of_partition() {
-    auto ret = _writer->consume_end_of_partition();
-    if (ret == stop_iteration::yes) {
-        // stop sstable writer being currently used.
-        _c.stop_sstable_writer();
-    }
-    return ret;
+    utils::task_context_guard task_ctx(utils::task_context::compaction);
+    utils::cost_guard cost(_cost);
+    return _c._stage_clock.timed(compaction_stage::serialize, [&] {
+        auto ret = _writer->consume_end_of_partition();
+        if (ret == stop_iteration::yes) {
+            // stop sstable writer being currently used.
+            _c.stop_sstable_writer();
+        }
+        return ret;
+    });
 }
 
 void compacting_sstable_writer::consume_end_of_stream() {
     // this will stop any writer opened by compaction.
-    _c.finish_sstable_writer();
+    _c._stage_clock.timed(compaction_stage::serialize, [&] {
+        _c.finish_sstable_writer();
+    });
 }
 
 class regular_compaction : public compaction {
@@ -343,14 +599,84 @@ class regular_compaction : public compaction {
     // sstable being currently written.
     shared_sstable _sst;
     stdx::optional<sstable_writer> _writer;
+    // Set for incremental compaction.
+    compaction_replacer _replacer;
+    utils::UUID _run_identifier;
+    // Input sstables which still hold data not written to a reported sstable.
+    std::vector<shared_sstable> _unreleased_sstables;
+    // Sealed new sstables not reported to _replacer yet.
+    std::vector<shared_sstable> _unreported_sstables;
+    // Set when this is one of the jobs of a split compaction.
+    bool _split = false;
+    // Set when compacting on behalf of another shard.
+    stdx::optional<shard_id> _owner;
+private:
+    // Reports sealed sstables together with the inputs which don't hold data past last_key,
+    // or with all remaining inputs if last_key is null.
+    void release_exhausted_sstables(const dht::decorated_key* last_key) {
+        auto it = boost::partition(_unreleased_sstables, [&] (const shared_sstable& sst) {
+            return last_key && sst->get_last_decorated_key().tri_compare(*schema(), *last_key) > 0;
+        });
+        std::vector<shared_sstable> exhausted(it, _unreleased_sstables.end());
+        if (exhausted.empty() && (last_key || _unreported_sstables.empty())) {
+            return;
+        }
+        _unreleased_sstables.erase(it, _unreleased_sstables.end());
+        clogger.debug("Releasing {} exhausted sstables of {}.{}, replaced by {} new sstables",
+                exhausted.size(), _info->ks, _info->cf, _unreported_sstables.size());
+        _replacer(_unreported_sstables, exhausted);
+        _replaced_new_sstables.insert(_unreported_sstables.begin(), _unreported_sstables.end());
+        _unreported_sstables.clear();
+    }
+
+    // Until an input sstable is released, its data is still read together with new sstables
+    // which were already reported. So a tombstone may only be purged if no other unreleased
+    // input can contain data shadowed by it.
+    api::timestamp_type max_purgeable_for_unreleased_sstables(const dht::decorated_key& dk) const {
+        auto timestamp = api::max_timestamp;
+        unsigned candidates = 0;
+        auto hk = sstables::sstable::make_hashed_key(*schema(), dk.key());
+        for (auto&& sst : _unreleased_sstables) {
+            if (sst->filter_has_key(hk)) {
+                timestamp = std::min(timestamp, sst->get_stats_metadata().min_timestamp);
+                candidates++;
+            }
+        }
+        return candidates > 1 ? timestamp : api::max_timestamp;
+    }
 public:
     regular_compaction(column_family& cf, std::vector<shared_sstable> sstables, std::function<shared_sstable()> creator,
-            uint64_t max_sstable_size, uint32_t sstable_level, seastar::thread_scheduling_group* tsg)
+            uint64_t max_sstable_size, uint32_t sstable_level, seastar::thread_scheduling_group* tsg, compaction_replacer replacer)
         : compaction(cf, std::move(sstables), max_sstable_size, sstable_level, tsg)
         , _creator(std::move(creator))
         , _set(cf.get_sstable_set())
         , _selector(_set.make_incremental_selector())
+        , _replacer(std::move(replacer))
+        , _run_identifier(utils::UUID_gen::get_time_UUID())
     {
+        if (_replacer) {
+            _unreleased_sstables = _sstables;
+        }
+        auto gc_before = gc_clock::now() - _cf.schema()->gc_grace_seconds();
+        auto compacting = _sstables;
+        for (auto& sst : get_fully_expired_sstables(_cf, compacting, gc_before.time_since_epoch().count())) {
+            _expired_sstables.insert(sst);
+        }
+    }
+
+    // Makes this compaction one of the jobs of a split compaction, compacting only
+    // the partitions of range, with new sstables belonging to the run of all jobs.
+    void restrict_to(dht::partition_range range, utils::UUID run_identifier) {
+        _range = std::move(range);
+        _run_identifier = run_identifier;
+        _split = true;
+    }
+
+    // Makes this compaction run on behalf of shard owner, writing its partitions. The
+    // other sstables of owner aren't known here, so nothing is purged.
+    void run_for_shard(shard_id owner) {
+        _owner = owner;
+        _expired_sstables.clear();
     }
 
     void report_start(const sstring& formatted_msg) const override {
@@ -362,15 +688,23 @@ class regular_compaction : public compaction {
     }
 
     virtual std::function<api::timestamp_type(const dht::decorated_key&)> max_purgeable_func() override {
+        if (_owner) {
+            return compaction::max_purgeable_func();
+        }
         std::unordered_set<shared_sstable> compacting(_sstables.begin(), _sstables.end());
-        return [this, compacting = std::move(compacting)] (const dht::decorated_key& dk) {
-            return get_max_purgeable_timestamp(_cf, _selector, compacting, dk);
+        auto calculator = max_purgeable_timestamp_calculator(_cf, _selector, std::move(compacting));
+        return [this, calculator = std::move(calculator)] (const dht::decorated_key& dk) mutable {
+            auto timestamp = calculator(dk);
+            if (_replacer) {
+                timestamp = std::min(timestamp, max_purgeable_for_unreleased_sstables(dk));
+            }
+            return timestamp;
         };
     }
 
     virtual std::function<bool(const streamed_mutation& sm)> filter_func() const override {
-        return [] (const streamed_mutation& sm) {
-            return dht::shard_of(sm.decorated_key().token()) == engine().cpu_id();
+        return [shard = _owner.value_or(engine().cpu_id())] (const streamed_mutation& sm) {
+            return dht::shard_of(sm.decorated_key().token()) == shard;
         };
     }
 
@@ -378,10 +712,16 @@ class regular_compaction : public compaction {
         if (!_writer) {
             _sst = _creator();
             setup_new_sstable(_sst);
+            if (_replacer || _split) {
+                _sst->set_run_identifier(_run_identifier);
+            }
 
             auto&& priority = service::get_local_compaction_priority();
             sstable_writer_config cfg;
             cfg.max_sstable_size = _max_sstable_size;
+            // The key cache of the owner isn't this shard's.
+            cfg.preheat_key_cache = !_owner;
+            cfg.monitor = _write_monitor;
             _writer.emplace(_sst->get_writer(*_cf.schema(), partitions_per_sstable(), cfg, priority));
         }
         return &*_writer;
@@ -389,20 +729,27 @@ class regular_compaction : public compaction {
 
     virtual void stop_sstable_writer() override {
         finish_new_sstable(_writer, _sst);
+        if (_replacer) {
+            _unreported_sstables.push_back(_sst);
+            release_exhausted_sstables(&_sst->get_last_decorated_key());
+        }
     }
 
     virtual void finish_sstable_writer() override {
         if (_writer) {
             stop_sstable_writer();
         }
+        if (_replacer) {
+            release_exhausted_sstables(nullptr);
+        }
     }
 };
 
 class cleanup_compaction final : public regular_compaction {
 public:
     cleanup_compaction(column_family& cf, std::vector<shared_sstable> sstables, std::function<shared_sstable()> creator,
-            uint64_t max_sstable_size, uint32_t sstable_level, seastar::thread_scheduling_group* tsg)
-        : regular_compaction(cf, std::move(sstables), std::move(creator), max_sstable_size, sstable_level, tsg)
+            uint64_t max_sstable_size, uint32_t sstable_level, seastar::thread_scheduling_group* tsg, compaction_replacer replacer)
+        : regular_compaction(cf, std::move(sstables), std::move(creator), max_sstable_size, sstable_level, tsg, std::move(replacer))
     {
         _info->type = compaction_type::Cleanup;
     }
@@ -465,6 +812,7 @@ class resharding_compaction final : public compaction {
 
             sstable_writer_config cfg;
             cfg.max_sstable_size = _max_sstable_size;
+            cfg.monitor = _write_monitor;
             auto&& priority = service::get_local_compaction_priority();
             writer.emplace(sst->get_writer(*_cf.schema(), partitions_per_sstable(), cfg, priority, _shard));
         }
@@ -498,9 +846,13 @@ future<compaction_info> compaction::run(std::unique_ptr<compaction> c) {
 
         auto start_time = db_clock::now();
         try {
-            consume_flattened_in_thread(reader, cfc, c->filter_func());
+            c->consume_in_thread(reader, cfc, c->filter_func());
         } catch (...) {
-            delete_sstables_for_interrupted_compaction(c->_info->new_sstables, c->_info->ks, c->_info->cf);
+            auto& new_sstables = c->_info->new_sstables;
+            new_sstables.erase(boost::remove_if(new_sstables, [&c] (const shared_sstable& sst) {
+                return c->_replaced_new_sstables.count(sst);
+            }), new_sstables.end());
+            delete_sstables_for_interrupted_compaction(new_sstables, c->_info->ks, c->_info->cf);
             c = nullptr; // make sure writers are stopped while running in thread context
             throw;
         }
@@ -518,13 +870,168 @@ static std::unique_ptr<compaction> make_compaction(bool cleanup, Params&&... par
     }
 }
 
+// Returns up to jobs - 1 increasing tokens splitting the data of sstables into
+// about equal parts. Summary entries are sampled about every
+// sstable::default_summary_byte_cost bytes of data, so each entry of a sstable is
+// given an equal share of its size.
+static std::vector<dht::token> split_tokens(const std::vector<shared_sstable>& sstables, unsigned jobs) {
+    std::vector<std::pair<dht::token, double>> samples;
+    double total = 0;
+    for (auto& sst : sstables) {
+        auto& entries = sst->get_summary().entries;
+        if (entries.empty()) {
+            continue;
+        }
+        auto weight = double(sst->data_size()) / entries.size();
+        for (auto& e : entries) {
+            samples.emplace_back(e.token, weight);
+        }
+        total += sst->data_size();
+    }
+    boost::sort(samples, [] (auto& a, auto& b) { return a.first < b.first; });
+
+    std::vector<dht::token> tokens;
+    double seen = 0;
+    auto next = total / jobs;
+    for (auto& s : samples) {
+        if (tokens.size() + 1 == jobs) {
+            break;
+        }
+        seen += s.second;
+        if (seen >= next) {
+            if (tokens.empty() || tokens.back() < s.first) {
+                tokens.push_back(s.first);
+            }
+            next = total * (tokens.size() + 1) / jobs;
+        }
+    }
+    return tokens;
+}
+
+// Returns the ranges between the split tokens.
+static std::vector<dht::partition_range> split_ranges(const std::vector<dht::token>& tokens) {
+    std::vector<dht::partition_range> ranges;
+    for (size_t i = 0; i <= tokens.size(); ++i) {
+        auto start = i == 0 ? stdx::optional<dht::partition_range::bound>()
+                : dht::partition_range::bound(dht::ring_position::ending_at(tokens[i - 1]), false);
+        auto end = i == tokens.size() ? stdx::optional<dht::partition_range::bound>()
+                : dht::partition_range::bound(dht::ring_position::ending_at(tokens[i]), true);
+        ranges.emplace_back(std::move(start), std::move(end));
+    }
+    return ranges;
+}
+
+// Returns the ranges of the compaction groups of cf the sstables have data of.
+static std::vector<dht::partition_range> compaction_group_ranges(column_family& cf, const std::vector<shared_sstable>& sstables) {
+    std::vector<bool> overlapped(cf.compaction_groups());
+    for (auto& sst : sstables) {
+        auto first = cf.compaction_group_of(sst->get_first_decorated_key().token());
+        auto last = cf.compaction_group_of(sst->get_last_decorated_key().token());
+        std::fill(overlapped.begin() + first, overlapped.begin() + last + 1, true);
+    }
+    std::vector<dht::partition_range> ranges;
+    for (unsigned group = 0; group < overlapped.size(); ++group) {
+        if (overlapped[group]) {
+            ranges.push_back(cf.compaction_group_range(group));
+        }
+    }
+    return ranges;
+}
+
+// Compacts sstables with one job per range, each reading only the inputs which
+// overlap its range. Jobs run concurrently.
+static future<compaction_info> compact_split_sstables(std::vector<shared_sstable> sstables, column_family& cf,
+        std::function<shared_sstable()> creator, uint64_t max_sstable_size, uint32_t sstable_level,
+        seastar::thread_scheduling_group* tsg, std::vector<dht::partition_range> ranges) {
+    auto run_identifier = utils::UUID_gen::get_time_UUID();
+    auto cmp = dht::ring_position_comparator(*cf.schema());
+    std::vector<std::unique_ptr<compaction>> jobs;
+    for (auto& range : ranges) {
+        auto overlapping = boost::copy_range<std::vector<shared_sstable>>(sstables | boost::adaptors::filtered([&] (const shared_sstable& sst) {
+            auto sst_range = dht::partition_range::make(dht::ring_position(sst->get_first_decorated_key()),
+                    dht::ring_position(sst->get_last_decorated_key()));
+            return range.overlaps(sst_range, cmp);
+        }));
+        if (overlapping.empty()) {
+            continue;
+        }
+        auto c = std::make_unique<regular_compaction>(cf, std::move(overlapping), creator, max_sstable_size, sstable_level, tsg, compaction_replacer());
+        c->restrict_to(std::move(range), run_identifier);
+        jobs.push_back(std::move(c));
+    }
+
+    auto infos = make_lw_shared<std::vector<stdx::optional<compaction_info>>>(jobs.size());
+    auto indexes = boost::irange<size_t>(0, jobs.size());
+    auto jobs_ptr = make_lw_shared<std::vector<std::unique_ptr<compaction>>>(std::move(jobs));
+    return parallel_for_each(indexes, [infos, jobs_ptr] (size_t i) {
+        return compaction::run(std::move((*jobs_ptr)[i])).then([infos, i] (compaction_info info) {
+            (*infos)[i] = std::move(info);
+        });
+    }).then_wrapped([infos, sstables = std::move(sstables), &cf] (future<> f) mutable {
+        auto& schema = *cf.schema();
+        if (f.failed()) {
+            // Failed jobs deleted their own new sstables already.
+            for (auto& info : *infos) {
+                if (info) {
+                    delete_sstables_for_interrupted_compaction(info->new_sstables, info->ks, info->cf);
+                }
+            }
+            return make_exception_future<compaction_info>(f.get_exception());
+        }
+        // Input sstables spanning several ranges were accounted by each of their jobs.
+        compaction_info ret;
+        ret.ks = schema.ks_name();
+        ret.cf = schema.cf_name();
+        ret.sstables = sstables.size();
+        ret.ended_at = 0;
+        for (auto& sst : sstables) {
+            ret.start_size += sst->bytes_on_disk();
+            ret.total_partitions += sst->get_estimated_key_count();
+        }
+        for (auto& info : *infos) {
+            ret.end_size += info->end_size;
+            ret.total_keys_written += info->total_keys_written;
+            ret.ended_at = std::max(ret.ended_at, info->ended_at);
+            std::move(info->new_sstables.begin(), info->new_sstables.end(), std::back_inserter(ret.new_sstables));
+        }
+        return make_ready_future<compaction_info>(std::move(ret));
+    });
+}
+
 future<compaction_info>
 compact_sstables(std::vector<shared_sstable> sstables, column_family& cf, std::function<shared_sstable()> creator,
-        uint64_t max_sstable_size, uint32_t sstable_level, bool cleanup, seastar::thread_scheduling_group *tsg) {
+        uint64_t max_sstable_size, uint32_t sstable_level, bool cleanup, seastar::thread_scheduling_group *tsg,
+        compaction_replacer replacer, unsigned jobs) {
+    if (sstables.empty()) {
+        throw std::runtime_error(sprint("Called compaction with empty set on behalf of {}.{}", cf.schema()->ks_name(), cf.schema()->cf_name()));
+    }
+    // Keeps the output of sstables spanning several compaction groups apart.
+    if (cf.compaction_groups() > 1 && !cleanup && !replacer) {
+        auto ranges = compaction_group_ranges(cf, sstables);
+        if (ranges.size() > 1) {
+            clogger.debug("Splitting compaction of {}.{} into {} compaction groups", cf.schema()->ks_name(), cf.schema()->cf_name(), ranges.size());
+            return compact_split_sstables(std::move(sstables), cf, std::move(creator), max_sstable_size, sstable_level, tsg, std::move(ranges));
+        }
+    }
+    if (jobs > 1 && !cleanup && !replacer) {
+        auto tokens = split_tokens(sstables, jobs);
+        if (!tokens.empty()) {
+            clogger.debug("Splitting compaction of {}.{} into {} jobs", cf.schema()->ks_name(), cf.schema()->cf_name(), tokens.size() + 1);
+            return compact_split_sstables(std::move(sstables), cf, std::move(creator), max_sstable_size, sstable_level, tsg, split_ranges(tokens));
+        }
+    }
+    auto c = make_compaction(cleanup, cf, std::move(sstables), std::move(creator), max_sstable_size, sstable_level, tsg, std::move(replacer));
+    return compaction::run(std::move(c));
+}
+
+future<compaction_info>
+compact_sstables_for_shard(std::vector<shared_sstable> sstables, column_family& cf, std::function<shared_sstable()> creator,
+        uint64_t max_sstable_size, uint32_t sstable_level, shard_id owner, seastar::thread_scheduling_group* tsg) {
     if (sstables.empty()) {
         throw std::runtime_error(sprint("Called compaction with empty set on behalf of {}.{}", cf.schema()->ks_name(), cf.schema()->cf_name()));
     }
-    auto c = make_compaction(cleanup, cf, std::move(sstables), std::move(creator), max_sstable_size, sstable_level, tsg);
+    auto c = std::make_unique<regular_compaction>(cf, std::move(sstables), std::move(creator), max_sstable_size, sstable_level, tsg, compaction_replacer());
+    c->run_for_shard(owner);
     return compaction::run(std::move(c));
 }
 
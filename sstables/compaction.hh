@@ -25,6 +25,8 @@
 #include "database_fwd.hh"
 #include "shared_sstable.hh"
 #include <seastar/core/thread.hh>
+#include <array>
+#include <chrono>
 #include <functional>
 
 namespace sstables {
@@ -36,6 +38,12 @@ namespace sstables {
         int level;
         // Threshold size for sstable(s) to be created.
         uint64_t max_sstable_bytes;
+        // If true, the output is written as a run of max_sstable_bytes fragments, and
+        // input sstables are released as soon as all of their data was written out.
+        bool incremental = false;
+        // Number of jobs the compaction is split into, each compacting a disjoint token
+        // range of the input concurrently with the others. Ignored by incremental compaction.
+        unsigned jobs = 1;
 
         compaction_descriptor() = default;
 
@@ -80,6 +88,42 @@ namespace sstables {
         }
     }
 
+    // The time a compaction spent in each of its stages, which add up to the
+    // time of its thread:
+    //   - read_wait: waiting for the input, and parsing and merging it,
+    //   - decompress: decompressing the chunks of the input,
+    //   - merge: compacting the merged partitions, purging what is expired
+    //     or shadowed,
+    //   - serialize: building the output sstables, but for:
+    //   - compress: compressing the chunks of the output,
+    //   - write_wait: waiting for the writes of the output.
+    struct compaction_stage_times {
+        using clock = std::chrono::steady_clock;
+        enum class stage {
+            read_wait,
+            decompress,
+            merge,
+            serialize,
+            compress,
+            write_wait,
+        };
+        static constexpr unsigned stages = 6;
+
+        std::array<clock::duration, stages> times = {};
+
+        clock::duration& operator[](stage s) {
+            return times[unsigned(s)];
+        }
+        clock::duration operator[](stage s) const {
+            return times[unsigned(s)];
+        }
+
+        static const char* name(stage s) {
+            static const char* names[] = { "read_wait", "decompress", "merge", "serialize", "compress", "write_wait" };
+            return names[unsigned(s)];
+        }
+    };
+
     struct compaction_info {
         compaction_type type = compaction_type::Compaction;
         sstring ks;
@@ -92,6 +136,8 @@ namespace sstables {
         int64_t ended_at;
         std::vector<shared_sstable> new_sstables;
         sstring stop_requested;
+        // Updated as the compaction runs.
+        compaction_stage_times stage_times;
 
         bool is_stop_requested() const {
             return stop_requested.size() > 0;
@@ -102,6 +148,13 @@ namespace sstables {
         }
     };
 
+    // Called by incremental compaction every time an output sstable is sealed,
+    // with the new sstables which weren't reported yet and the input sstables
+    // whose data was all written to reported sstables. The caller is expected
+    // to replace the latter with the former in the sstable set.
+    using compaction_replacer = std::function<void(const std::vector<shared_sstable>& new_sstables,
+            const std::vector<shared_sstable>& exhausted_sstables)>;
+
     // Compact a list of N sstables into M sstables.
     // Returns info about the finished compaction, which includes vector to new sstables.
     //
@@ -113,9 +166,29 @@ namespace sstables {
     // If cleanup is true, mutation that doesn't belong to current node will be
     // cleaned up, log messages will inform the user that compact_sstables runs for
     // cleaning operation, and compaction history will not be updated.
+    // If replacer is given, the compaction is incremental: all new sstables
+    // belong to a single run, and they are handed to replacer as they are
+    // sealed, together with the input sstables they make redundant. Temporary
+    // disk space is then bounded by a few max_sstable_size. The returned
+    // compaction_info still lists all new sstables.
+    // Otherwise, the input may be split into up to jobs disjoint token ranges, of
+    // about the same amount of data, compacted concurrently. New sstables of all
+    // jobs then belong to a single run, and are deleted if any job fails. Input
+    // spanning several compaction groups of cf is split the same way, by group,
+    // regardless of jobs.
     future<compaction_info> compact_sstables(std::vector<shared_sstable> sstables,
             column_family& cf, std::function<shared_sstable()> creator,
             uint64_t max_sstable_size, uint32_t sstable_level, bool cleanup = false,
+            seastar::thread_scheduling_group* tsg = nullptr,
+            compaction_replacer replacer = {}, unsigned jobs = 1);
+
+    // Compacts sstables of shard owner on the current shard, on its behalf. cf is
+    // the current shard's instance of their table. Only the partitions of owner
+    // are written, and no tombstone or expired data is purged: the other
+    // sstables of owner, which may hold data they shadow, aren't known here.
+    future<compaction_info> compact_sstables_for_shard(std::vector<shared_sstable> sstables,
+            column_family& cf, std::function<shared_sstable()> creator,
+            uint64_t max_sstable_size, uint32_t sstable_level, shard_id owner,
             seastar::thread_scheduling_group* tsg = nullptr);
 
     // Compacts a set of N shared sstables into M sstables. For every shard involved,
@@ -23,8 +23,12 @@
 #include "sstables/sstables.hh"
 #include "database.hh"
 #include <seastar/core/metrics.hh>
+#include <seastar/core/memory.hh>
 #include "exceptions.hh"
 #include <cmath>
+#include <boost/range/numeric.hpp>
+#include <boost/range/adaptor/transformed.hpp>
+#include <boost/range/algorithm/stable_sort.hpp>
 
 static logging::logger cmlog("compaction_manager");
 
@@ -67,14 +71,16 @@ class compacting_sstable_registration {
 class compaction_weight_registration {
     compaction_manager* _cm;
     column_family* _cf;
+    unsigned _group;
     int _weight;
 public:
-    compaction_weight_registration(compaction_manager* cm, column_family* cf, int weight)
+    compaction_weight_registration(compaction_manager* cm, column_family* cf, unsigned group, int weight)
         : _cm(cm)
         , _cf(cf)
+        , _group(group)
         , _weight(weight)
     {
-        _cm->register_weight(_cf, _weight);
+        _cm->register_weight(_cf, _group, _weight);
     }
 
     compaction_weight_registration& operator=(const compaction_weight_registration&) = delete;
@@ -91,6 +97,7 @@ class compaction_weight_registration {
     compaction_weight_registration(compaction_weight_registration&& other) noexcept
         : _cm(other._cm)
         , _cf(other._cf)
+        , _group(other._group)
         , _weight(other._weight)
     {
         other._cm = nullptr;
@@ -100,7 +107,7 @@ class compaction_weight_registration {
 
     ~compaction_weight_registration() {
         if (_cm) {
-            _cm->deregister_weight(_cf, _weight);
+            _cm->deregister_weight(_cf, _group, _weight);
         }
     }
 };
@@ -133,7 +140,7 @@ static inline int calculate_weight(const std::vector<sstables::shared_sstable>&
     return calculate_weight(get_total_size(sstables));
 }
 
-int compaction_manager::trim_to_compact(column_family* cf, sstables::compaction_descriptor& descriptor) {
+int compaction_manager::trim_to_compact(column_family* cf, unsigned group, sstables::compaction_descriptor& descriptor) {
     int weight = calculate_weight(descriptor.sstables);
     // NOTE: a compaction job with level > 0 cannot be trimmed because leveled
     // compaction relies on higher levels having no overlapping sstables.
@@ -144,8 +151,12 @@ int compaction_manager::trim_to_compact(column_family* cf, sstables::compaction_
     if (it == _weight_tracker.end()) {
         return weight;
     }
+    auto git = it->second.find(group);
+    if (git == it->second.end()) {
+        return weight;
+    }
 
-    std::unordered_set<int>& s = it->second;
+    std::unordered_multiset<int>& s = git->second;
     uint64_t total_size = get_total_size(descriptor.sstables);
     int min_threshold = cf->schema()->min_compaction_threshold();
 
@@ -161,12 +172,16 @@ int compaction_manager::trim_to_compact(column_family* cf, sstables::compaction_
     return weight;
 }
 
-bool compaction_manager::can_register_weight(column_family* cf, int weight, bool parallel_compaction) {
+bool compaction_manager::can_register_weight(column_family* cf, unsigned group, int weight, bool parallel_compaction, bool leveled) {
     auto it = _weight_tracker.find(cf);
     if (it == _weight_tracker.end()) {
         return true;
     }
-    std::unordered_set<int>& s = it->second;
+    auto git = it->second.find(group);
+    if (git == it->second.end()) {
+        return true;
+    }
+    std::unordered_multiset<int>& s = git->second;
     // Only one weight is allowed if parallel compaction is disabled.
     if (!parallel_compaction && !s.empty()) {
         return false;
@@ -174,7 +189,7 @@ bool compaction_manager::can_register_weight(column_family* cf, int weight, bool
     // TODO: Maybe allow only *smaller* compactions to start? That can be done
     // by returning true only if weight is not in the set and is lower than any
     // entry in the set.
-    if (s.count(weight)) {
+    if (s.count(weight) && !leveled) {
         // If reached this point, it means that there is an ongoing compaction
         // with the weight of the compaction job.
         return false;
@@ -182,19 +197,18 @@ bool compaction_manager::can_register_weight(column_family* cf, int weight, bool
     return true;
 }
 
-void compaction_manager::register_weight(column_family* cf, int weight) {
-    auto it = _weight_tracker.find(cf);
-    if (it == _weight_tracker.end()) {
-        _weight_tracker.insert({cf, {weight}});
-    } else {
-        it->second.insert(weight);
-    }
+void compaction_manager::register_weight(column_family* cf, unsigned group, int weight) {
+    _weight_tracker[cf][group].insert(weight);
 }
 
-void compaction_manager::deregister_weight(column_family* cf, int weight) {
+void compaction_manager::deregister_weight(column_family* cf, unsigned group, int weight) {
     auto it = _weight_tracker.find(cf);
     assert(it != _weight_tracker.end());
-    it->second.erase(weight);
+    auto git = it->second.find(group);
+    assert(git != it->second.end());
+    auto w = git->second.find(weight);
+    assert(w != git->second.end());
+    git->second.erase(w);
 }
 
 std::vector<sstables::shared_sstable> compaction_manager::get_candidates(const column_family& cf) {
@@ -209,6 +223,27 @@ std::vector<sstables::shared_sstable> compaction_manager::get_candidates(const c
     return candidates;
 }
 
+std::vector<std::pair<unsigned, std::vector<sstables::shared_sstable>>> compaction_manager::get_candidates_by_group(const column_family& cf) {
+    std::vector<std::pair<unsigned, std::vector<sstables::shared_sstable>>> ret;
+    if (cf.compaction_groups() == 1) {
+        ret.emplace_back(0, get_candidates(cf));
+        return ret;
+    }
+    std::vector<std::vector<sstables::shared_sstable>> groups(cf.compaction_groups() + 1);
+    for (auto& sst : get_candidates(cf)) {
+        groups[cf.compaction_group_of(sst)].push_back(std::move(sst));
+    }
+    for (unsigned group = 0; group < groups.size(); ++group) {
+        if (!groups[group].empty()) {
+            ret.emplace_back(group, std::move(groups[group]));
+        }
+    }
+    boost::stable_sort(ret, [] (auto& a, auto& b) {
+        return a.second.size() > b.second.size();
+    });
+    return ret;
+}
+
 void compaction_manager::register_compacting_sstables(const std::vector<sstables::shared_sstable>& sstables) {
     for (auto& sst : sstables) {
         _compacting_sstables.insert(sst);
@@ -271,6 +306,17 @@ void compaction_manager::submit_sstable_rewrite(column_family* cf, sstables::sha
     });
 }
 
+// A major compaction is split into one job per major_compaction_job_size bytes of
+// input, up to max_major_compaction_jobs. The jobs run on the same shard, so
+// splitting doesn't use more cpus, but keeps more reads and writes in flight.
+static constexpr uint64_t major_compaction_job_size = 10ULL << 30;
+static constexpr unsigned max_major_compaction_jobs = 4;
+
+static unsigned major_compaction_jobs(const std::vector<sstables::shared_sstable>& sstables) {
+    auto size = boost::accumulate(sstables | boost::adaptors::transformed(std::mem_fn(&sstables::sstable::data_size)), uint64_t(0));
+    return std::max(1U, std::min(max_major_compaction_jobs, unsigned(size / major_compaction_job_size)));
+}
+
 future<> compaction_manager::submit_major_compaction(column_family* cf) {
     if (_stopped) {
         return make_ready_future<>();
@@ -296,7 +342,10 @@ future<> compaction_manager::submit_major_compaction(column_family* cf) {
             auto sstables = get_candidates(*cf);
             auto compacting = compacting_sstable_registration(this, sstables);
 
-            return cf->compact_sstables(sstables::compaction_descriptor(std::move(sstables))).then([compacting = std::move(compacting)] {});
+            auto descriptor = sstables::compaction_descriptor(std::move(sstables));
+            descriptor.jobs = major_compaction_jobs(descriptor.sstables);
+
+            return cf->compact_sstables(std::move(descriptor)).then([compacting = std::move(compacting)] {});
         });
     }).then_wrapped([this, task] (future<> f) {
         _stats.active_tasks--;
@@ -351,6 +400,24 @@ future<> compaction_manager::run_resharding_job(column_family* cf, std::function
     return task->compaction_done.get_future().then([task] {});
 }
 
+future<> compaction_manager::run_offloaded_job(column_family* cf, std::function<future<>()> job) {
+    if (_stopped) {
+        return make_exception_future<>(sstables::compaction_stop_exception(cf->schema()->ks_name(), cf->schema()->cf_name(), "shutdown"));
+    }
+    auto task = make_lw_shared<compaction_manager::task>();
+    task->compacting_cf = cf;
+    _tasks.push_back(task);
+    _stats.active_tasks++;
+
+    shared_future<> done = with_lock(_compaction_locks[cf].for_read(), std::move(job)).finally([this, task] {
+        _stats.active_tasks--;
+        _tasks.remove(task);
+    });
+    // Stopping only waits for the job, its failure is reported to the other shard.
+    task->compaction_done = done.get_future().handle_exception([] (std::exception_ptr) { });
+    return done.get_future();
+}
+
 future<> compaction_manager::task_stop(lw_shared_ptr<compaction_manager::task> task) {
     task->stopping = true;
     auto f = task->compaction_done.get_future();
@@ -360,7 +427,18 @@ future<> compaction_manager::task_stop(lw_shared_ptr<compaction_manager::task> t
     });
 }
 
-compaction_manager::compaction_manager() = default;
+static compaction_cpu_controller make_compaction_cpu_controller(bool auto_adjust, std::function<float()> fn) {
+    if (auto_adjust) {
+        return compaction_cpu_controller(std::chrono::milliseconds(250), std::move(fn));
+    }
+    return compaction_cpu_controller(compaction_cpu_controller::disabled{nullptr});
+}
+
+compaction_manager::compaction_manager(bool auto_adjust_cpu_quota)
+    : _cpu_controller(make_compaction_cpu_controller(auto_adjust_cpu_quota, [this] {
+        return float(backlog()) / memory::stats().total_memory();
+    }))
+{}
 
 compaction_manager::~compaction_manager() {
     // Assert that compaction manager was explicitly stopped, if started.
@@ -368,13 +446,45 @@ compaction_manager::~compaction_manager() {
     assert(_stopped == true);
 }
 
+void compaction_manager::account_stage_times(sstables::compaction_strategy_type strategy, const sstables::compaction_stage_times& times, uint64_t input_bytes) {
+    if (!input_bytes) {
+        return;
+    }
+    auto mb = double(input_bytes) / (1 << 20);
+    auto& histograms = _stage_times[unsigned(strategy)];
+    for (unsigned s = 0; s < histograms.size(); ++s) {
+        histograms[s].add(uint64_t(std::chrono::duration_cast<std::chrono::microseconds>(times.times[s]).count() / mb));
+    }
+}
+
 void compaction_manager::register_metrics() {
     namespace sm = seastar::metrics;
+    sm::label strategy_label("strategy");
+    sm::label stage_label("stage");
 
     _metrics.add_group("compaction_manager", {
         sm::make_gauge("compactions", [this] { return _stats.active_tasks; },
                        sm::description("Holds the number of currently active compactions.")),
+        sm::make_gauge("backlog", [this] { return backlog(); },
+                       sm::description("Holds the estimated number of bytes compaction has to write.")),
+        sm::make_gauge("cpu_quota", [this] { return _cpu_controller.current_quota(); },
+                       sm::description("Holds the CPU quota of compaction, if auto-adjusted.")),
+        sm::make_derive("expired_sstables", [this] { return _stats.expired_sstables; },
+                       sm::description("Counts the fully expired sstables dropped by compactions without being read.")),
+        sm::make_derive("expired_sstables_bytes", [this] { return _stats.expired_sstables_bytes; },
+                       sm::description("Counts the bytes of fully expired sstables dropped by compactions without being read.")),
     });
+
+    for (unsigned type = 0; type < strategy_types; ++type) {
+        auto strategy = strategy_label(sstables::compaction_strategy::name(sstables::compaction_strategy_type(type)));
+        for (unsigned s = 0; s < sstables::compaction_stage_times::stages; ++s) {
+            auto stage = stage_label(sstables::compaction_stage_times::name(sstables::compaction_stage_times::stage(s)));
+            _metrics.add_group("compaction_manager", {
+                sm::make_histogram("stage_time", sm::description("Holds the histogram of the time compactions spent in a stage, in microseconds per MB of input."),
+                               [this, type, s] { return _stage_times[type][s].get_histogram(); })(strategy)(stage),
+            });
+        }
+    }
 }
 
 void compaction_manager::start() {
@@ -383,6 +493,39 @@ void compaction_manager::start() {
     _compaction_submission_timer.arm(periodic_compaction_submission_interval());
 }
 
+uint64_t compaction_manager::backlog() {
+    uint64_t backlog = 0;
+    for (auto& e : _compaction_locks) {
+        backlog += e.first->get_compaction_strategy().backlog(*e.first);
+    }
+    return backlog;
+}
+
+void compaction_cpu_controller::adjust() {
+    auto backlog = _current_backlog();
+    if (backlog < backlog_low) {
+        _current_quota = qmin;
+    } else if (backlog < backlog_high) {
+        _current_quota = qmin + (backlog - backlog_low) * (qmax - qmin) / (backlog_high - backlog_low);
+    } else {
+        _current_quota = qmax;
+    }
+
+    cmlog.trace("backlog {}, quota {}", backlog, _current_quota);
+    _scheduling_group.update_usage(_current_quota);
+}
+
+compaction_cpu_controller::compaction_cpu_controller(std::chrono::milliseconds interval, std::function<float()> current_backlog)
+    : _current_quota(qmin)
+    , _current_backlog(std::move(current_backlog))
+    , _interval(interval)
+    , _update_timer([this] { adjust(); })
+    , _scheduling_group(std::chrono::milliseconds(1), qmin)
+    , _current_scheduling_group(&_scheduling_group)
+{
+    _update_timer.arm_periodic(_interval);
+}
+
 std::function<void()> compaction_manager::compaction_submission_callback() {
     return [this] () mutable {
         for (auto& e: _compaction_locks) {
@@ -463,18 +606,34 @@ void compaction_manager::submit(column_family* cf) {
         return with_lock(_compaction_locks[cf].for_read(), [this, task] () mutable {
             column_family& cf = *task->compacting_cf;
             sstables::compaction_strategy cs = cf.get_compaction_strategy();
-            sstables::compaction_descriptor descriptor = cs.get_sstables_for_compaction(cf, get_candidates(cf));
-            int weight = trim_to_compact(&cf, descriptor);
+            // The job of the first compaction group which needs one and can run it.
+            sstables::compaction_descriptor descriptor;
+            unsigned group = 0;
+            int weight = 0;
+            for (auto& candidates : get_candidates_by_group(cf)) {
+                auto d = cs.get_sstables_for_compaction(cf, std::move(candidates.second));
+                auto w = trim_to_compact(&cf, candidates.first, d);
+                if (d.sstables.empty()) {
+                    continue;
+                }
+                if (!can_register_weight(&cf, candidates.first, w, cs.parallel_compaction(), d.level > 0)) {
+                    cmlog.debug("Refused compaction job ({} sstable(s)) of weight {} for {}.{}",
+                        d.sstables.size(), w, cf.schema()->ks_name(), cf.schema()->cf_name());
+                    continue;
+                }
+                descriptor = std::move(d);
+                group = candidates.first;
+                weight = w;
+                break;
+            }
 
             // Stop compaction task immediately if strategy is satisfied or job cannot run in parallel.
-            if (descriptor.sstables.empty() || !can_register_weight(&cf, weight, cs.parallel_compaction())) {
+            if (descriptor.sstables.empty()) {
                 _stats.pending_tasks--;
-                cmlog.debug("Refused compaction job ({} sstable(s)) of weight {} for {}.{}",
-                    descriptor.sstables.size(), weight, cf.schema()->ks_name(), cf.schema()->cf_name());
                 return make_ready_future<stop_iteration>(stop_iteration::yes);
             }
             auto compacting = compacting_sstable_registration(this, descriptor.sstables);
-            auto c_weight = compaction_weight_registration(this, &cf, weight);
+            auto c_weight = compaction_weight_registration(this, &cf, group, weight);
             cmlog.debug("Accepted compaction job ({} sstable(s)) of weight {} for {}.{}",
                 descriptor.sstables.size(), weight, cf.schema()->ks_name(), cf.schema()->cf_name());
 
@@ -30,10 +30,14 @@
 #include <seastar/core/metrics_registration.hh>
 #include "log.hh"
 #include "utils/exponential_backoff_retry.hh"
+#include "utils/log_linear_histogram.hh"
+#include "compaction_strategy.hh"
+#include <array>
 #include <vector>
 #include <list>
 #include <functional>
 #include "sstables/compaction.hh"
+#include "cpu_controller.hh"
 
 class column_family;
 class compacting_sstable_registration;
@@ -48,6 +52,9 @@ class compaction_manager {
         int64_t completed_tasks = 0;
         uint64_t active_tasks = 0; // Number of compaction going on.
         int64_t errors = 0;
+        // Fully expired sstables dropped by compactions without being read.
+        uint64_t expired_sstables = 0;
+        uint64_t expired_sstables_bytes = 0;
     };
 private:
     struct task {
@@ -67,15 +74,22 @@ class compaction_manager {
     stats _stats;
     seastar::metrics::metric_groups _metrics;
 
+    static constexpr unsigned strategy_types = unsigned(sstables::compaction_strategy_type::time_window) + 1;
+    using stage_histograms = std::array<utils::log_linear_histogram, sstables::compaction_stage_times::stages>;
+    // Of the compactions of each strategy, the time spent in each stage per
+    // MB of input, in microseconds.
+    std::array<stage_histograms, strategy_types> _stage_times;
+
     std::list<lw_shared_ptr<sstables::compaction_info>> _compactions;
 
     // Store sstables that are being compacted at the moment. That's needed to prevent
     // a sstable from being compacted twice.
     std::unordered_set<sstables::shared_sstable> _compacting_sstables;
 
-    // Keep track of weight of ongoing compaction for each column family.
-    // That's used to allow parallel compaction on the same column family.
-    std::unordered_map<column_family*, std::unordered_set<int>> _weight_tracker;
+    // Keep track of weight of ongoing compaction for each compaction group of
+    // each column family. That's used to allow parallel compaction on the same
+    // column family.
+    std::unordered_map<column_family*, std::unordered_map<unsigned, std::unordered_multiset<int>>> _weight_tracker;
 
     // Purpose is to serialize major compaction across all column families, so as to
     // reduce disk space requirement.
@@ -85,6 +99,8 @@ class compaction_manager {
 
     semaphore _resharding_sem{1};
 
+    compaction_cpu_controller _cpu_controller;
+
     std::function<void()> compaction_submission_callback();
     // all registered column families are submitted for compaction at a constant interval.
     // Submission is a NO-OP when there's nothing to do, so it's fine to call it regularly.
@@ -94,21 +110,27 @@ class compaction_manager {
     future<> task_stop(lw_shared_ptr<task> task);
 
     // Return true if weight is not registered. If parallel_compaction is not
-    // true, only one weight is allowed to be registered.
-    bool can_register_weight(column_family* cf, int weight, bool parallel_compaction);
-    // Register weight for a column family. Do that only if can_register_weight()
-    // returned true.
-    void register_weight(column_family* cf, int weight);
-    // Deregister weight for a column family.
-    void deregister_weight(column_family* cf, int weight);
+    // true, only one weight is allowed to be registered. Leveled jobs, whose
+    // strategy makes sure they don't conflict, may share their weight. Jobs
+    // of different compaction groups don't conflict either.
+    bool can_register_weight(column_family* cf, unsigned group, int weight, bool parallel_compaction, bool leveled = false);
+    // Register weight for a compaction group of a column family. Do that only
+    // if can_register_weight() returned true.
+    void register_weight(column_family* cf, unsigned group, int weight);
+    // Deregister weight for a compaction group of a column family.
+    void deregister_weight(column_family* cf, unsigned group, int weight);
 
     // If weight of compaction job is taken, it will be trimmed until its new
     // weight is not taken or its size is equal to minimum threshold.
     // Return weight of compaction job.
-    int trim_to_compact(column_family* cf, sstables::compaction_descriptor& descriptor);
+    int trim_to_compact(column_family* cf, unsigned group, sstables::compaction_descriptor& descriptor);
 
     // Get candidates for compaction strategy, which are all sstables but the ones being compacted.
     std::vector<sstables::shared_sstable> get_candidates(const column_family& cf);
+    // Get the candidates of each compaction group of cf with any, the groups
+    // with the most candidates first. The sstables spanning several groups
+    // are the candidates of group cf.compaction_groups().
+    std::vector<std::pair<unsigned, std::vector<sstables::shared_sstable>>> get_candidates_by_group(const column_family& cf);
 
     void register_compacting_sstables(const std::vector<sstables::shared_sstable>& sstables);
     void deregister_compacting_sstables(const std::vector<sstables::shared_sstable>& sstables);
@@ -126,7 +148,9 @@ class compaction_manager {
     // Returns true if error is judged not fatal, and compaction can be retried.
     inline bool maybe_stop_on_error(future<> f);
 public:
-    compaction_manager();
+    // If auto_adjust_cpu_quota is true, compaction runs in its own scheduling group,
+    // whose quota follows the compaction backlog.
+    explicit compaction_manager(bool auto_adjust_cpu_quota = false);
     ~compaction_manager();
 
     void register_metrics();
@@ -165,6 +189,11 @@ class compaction_manager {
     // sstables created by the process to their owner shards.
     future<> run_resharding_job(column_family* cf, std::function<future<>()> job);
 
+    // Runs job, a compaction of sstables of another shard, as a compaction of
+    // cf, this shard's instance of their table. Fails like the job, so that the
+    // other shard can retry.
+    future<> run_offloaded_job(column_family* cf, std::function<future<>()> job);
+
     // Remove a column family from the compaction manager.
     // Cancel requests on cf and wait for a possible ongoing compaction on cf.
     future<> remove(column_family* cf);
@@ -173,6 +202,23 @@ class compaction_manager {
         return _stats;
     }
 
+    // Sum of the compaction backlog of all registered column families, in bytes.
+    uint64_t backlog();
+
+    // Scheduling group compaction should run in, or nullptr if its quota isn't auto-adjusted.
+    seastar::thread_scheduling_group* scheduling_group() {
+        return _cpu_controller.scheduling_group();
+    }
+
+    void account_expired_sstables(uint64_t count, uint64_t bytes) {
+        _stats.expired_sstables += count;
+        _stats.expired_sstables_bytes += bytes;
+    }
+
+    // Accounts the stage times of a finished compaction of input_bytes, of a
+    // table with the given strategy.
+    void account_stage_times(sstables::compaction_strategy_type strategy, const sstables::compaction_stage_times& times, uint64_t input_bytes);
+
     void register_compaction(lw_shared_ptr<sstables::compaction_info> c) {
         _compactions.push_back(c);
     }
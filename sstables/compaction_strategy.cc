@@ -39,6 +39,7 @@
 
 #include <vector>
 #include <chrono>
+#include <cmath>
 
 #include "sstables.hh"
 #include "compaction.hh"
@@ -49,6 +50,7 @@
 #include "sstable_set.hh"
 #include "compatible_ring_position.hh"
 #include <boost/range/algorithm/find.hpp>
+#include <boost/range/algorithm/find_if.hpp>
 #include <boost/range/adaptors.hpp>
 #include <boost/icl/interval_map.hpp>
 #include <boost/algorithm/cxx11/any_of.hpp>
@@ -149,40 +151,139 @@ sstable_set::make_incremental_selector() const {
     return incremental_selector(_impl->make_incremental_selector());
 }
 
-// default sstable_set, not specialized for anything
-class bag_sstable_set : public sstable_set_impl {
-    // erasing is slow, but select() is fast
-    std::vector<shared_sstable> _sstables;
+// default sstable_set, for sstables which may overlap in any way.
+//
+// The sstables are kept in an interval tree of their token ranges, so that
+// reads only consider those whose range contains the tokens they read,
+// instead of checking the bloom filter of every sstable. The tree is a
+// vector sorted by first token: the root of the entries in [lo, hi) is the
+// one in the middle, and _max_last of it is the entry with the largest last
+// token in [lo, hi). Sets are modified rarely, and are small enough that
+// rebuilding it on each change is cheaper than copying a node-based tree
+// along with the set.
+class interval_sstable_set : public sstable_set_impl {
+    struct entry {
+        dht::token first;
+        dht::token last;
+        shared_sstable sst;
+    };
+    std::vector<entry> _entries;
+    std::vector<uint32_t> _max_last;
+private:
+    uint32_t build(uint32_t lo, uint32_t hi) {
+        auto mid = lo + (hi - lo) / 2;
+        auto max = mid;
+        auto update = [this, &max] (uint32_t i) {
+            if (_entries[max].last < _entries[i].last) {
+                max = i;
+            }
+        };
+        if (lo < mid) {
+            update(build(lo, mid));
+        }
+        if (mid + 1 < hi) {
+            update(build(mid + 1, hi));
+        }
+        _max_last[mid] = max;
+        return max;
+    }
+
+    void rebuild() {
+        _max_last.resize(_entries.size());
+        if (!_entries.empty()) {
+            build(0, _entries.size());
+        }
+    }
+
+    // Calls f with the index of each entry which overlaps [start, end], in order of first token.
+    template <typename Func>
+    void for_each_overlapping(uint32_t lo, uint32_t hi, const dht::token& start, const dht::token& end, Func&& f) const {
+        if (lo >= hi) {
+            return;
+        }
+        auto mid = lo + (hi - lo) / 2;
+        if (_entries[_max_last[mid]].last < start) {
+            return;
+        }
+        for_each_overlapping(lo, mid, start, end, f);
+        if (end < _entries[mid].first) {
+            return;
+        }
+        if (!(_entries[mid].last < start)) {
+            f(mid);
+        }
+        for_each_overlapping(mid + 1, hi, start, end, f);
+    }
+
+    template <typename Func>
+    void for_each_overlapping(const dht::token& start, const dht::token& end, Func&& f) const {
+        for_each_overlapping(0, _entries.size(), start, end, f);
+    }
 public:
     virtual std::unique_ptr<sstable_set_impl> clone() const override {
-        return std::make_unique<bag_sstable_set>(*this);
+        return std::make_unique<interval_sstable_set>(*this);
     }
     virtual std::vector<shared_sstable> select(const dht::partition_range& range = query::full_partition_range) const override {
-        return _sstables;
+        // Tokens are enough to tell which sstables can't have keys in the range.
+        auto start = range.start() ? range.start()->value().token() : dht::minimum_token();
+        auto end = range.end() ? range.end()->value().token() : dht::maximum_token();
+        std::vector<shared_sstable> r;
+        for_each_overlapping(start, end, [this, &r] (uint32_t i) {
+            r.push_back(_entries[i].sst);
+        });
+        return r;
     }
     virtual void insert(shared_sstable sst) override {
-        _sstables.push_back(std::move(sst));
+        auto first = sst->get_first_decorated_key().token();
+        auto last = sst->get_last_decorated_key().token();
+        auto it = std::upper_bound(_entries.begin(), _entries.end(), first, [] (const dht::token& t, const entry& e) {
+            return t < e.first;
+        });
+        _entries.insert(it, entry{std::move(first), std::move(last), std::move(sst)});
+        rebuild();
     }
     virtual void erase(shared_sstable sst) override {
-        _sstables.erase(boost::find(_sstables, sst));
+        _entries.erase(boost::find_if(_entries, [&sst] (const entry& e) { return e.sst == sst; }));
+        rebuild();
     }
     virtual std::unique_ptr<incremental_selector_impl> make_incremental_selector() const override;
     class incremental_selector;
 };
 
-class bag_sstable_set::incremental_selector : public incremental_selector_impl {
-    const std::vector<shared_sstable>& _sstables;
+class interval_sstable_set::incremental_selector : public incremental_selector_impl {
+    const interval_sstable_set& _set;
 public:
-    incremental_selector(const std::vector<shared_sstable>& sstables)
-        : _sstables(sstables) {
+    incremental_selector(const interval_sstable_set& set)
+        : _set(set) {
     }
+    // The selection stays the same until either the next sstable starts,
+    // or one of the selected ones ends.
     virtual std::tuple<dht::token_range, std::vector<shared_sstable>, dht::token> select(const dht::token& token) override {
-        return std::make_tuple(dht::token_range::make_open_ended_both_sides(), _sstables, dht::maximum_token());
+        std::vector<shared_sstable> ssts;
+        const dht::token* min_last = nullptr;
+        _set.for_each_overlapping(token, token, [this, &ssts, &min_last] (uint32_t i) {
+            auto& e = _set._entries[i];
+            ssts.push_back(e.sst);
+            if (!min_last || e.last < *min_last) {
+                min_last = &e.last;
+            }
+        });
+        auto next = std::upper_bound(_set._entries.begin(), _set._entries.end(), token, [] (const dht::token& t, const entry& e) {
+            return t < e.first;
+        });
+        using bound = dht::token_range::bound;
+        if (next == _set._entries.end()) {
+            auto range = min_last ? dht::token_range::make({token, true}, {*min_last, true})
+                                  : dht::token_range::make_starting_with({token, true});
+            return std::make_tuple(std::move(range), std::move(ssts), dht::maximum_token());
+        }
+        auto end = min_last && *min_last < next->first ? bound(*min_last, true) : bound(next->first, false);
+        return std::make_tuple(dht::token_range::make({token, true}, std::move(end)), std::move(ssts), next->first);
     }
 };
 
-std::unique_ptr<incremental_selector_impl> bag_sstable_set::make_incremental_selector() const {
-    return std::make_unique<incremental_selector>(_sstables);
+std::unique_ptr<incremental_selector_impl> interval_sstable_set::make_incremental_selector() const {
+    return std::make_unique<incremental_selector>(*this);
 }
 
 // specialized when sstables are partitioned in the token range space
@@ -329,7 +430,7 @@ std::unique_ptr<incremental_selector_impl> partitioned_sstable_set::make_increme
 }
 
 std::unique_ptr<sstable_set_impl> compaction_strategy_impl::make_sstable_set(schema_ptr schema) const {
-    return std::make_unique<bag_sstable_set>();
+    return std::make_unique<interval_sstable_set>();
 }
 
 std::unique_ptr<sstable_set_impl> leveled_compaction_strategy::make_sstable_set(schema_ptr schema) const {
@@ -339,16 +440,116 @@ std::unique_ptr<sstable_set_impl> leveled_compaction_strategy::make_sstable_set(
 std::vector<resharding_descriptor>
 compaction_strategy_impl::get_resharding_jobs(column_family& cf, std::vector<sstables::shared_sstable> candidates) {
     std::vector<resharding_descriptor> jobs;
-    shard_id reshard_at_current = 0;
 
     clogger.debug("Trying to get resharding jobs for {}.{}...", cf.schema()->ks_name(), cf.schema()->cf_name());
     for (auto& candidate : candidates) {
         auto level = candidate->get_sstable_level();
-        jobs.push_back(resharding_descriptor{{std::move(candidate)}, std::numeric_limits<uint64_t>::max(), reshard_at_current++ % smp::count, level});
+        jobs.push_back(resharding_descriptor{{std::move(candidate)}, std::numeric_limits<uint64_t>::max(), 0, level});
     }
+    balance_resharding_jobs(jobs);
     return jobs;
 }
 
+// The largest jobs are given out first, each to the shard with the fewest
+// bytes so far. Among those, a shard owning the sstables of the job is
+// preferred, as it shares their components already.
+void compaction_strategy_impl::balance_resharding_jobs(std::vector<resharding_descriptor>& jobs) {
+    auto job_size = [] (const resharding_descriptor& job) {
+        uint64_t size = 0;
+        for (auto& sst : job.sstables) {
+            size += sst->data_size();
+        }
+        return size;
+    };
+    auto owns = [] (const resharding_descriptor& job, shard_id shard) {
+        return boost::algorithm::any_of(job.sstables, [shard] (const shared_sstable& sst) {
+            return boost::range::find(sst->get_shards_for_this_sstable(), shard) != sst->get_shards_for_this_sstable().end();
+        });
+    };
+
+    std::vector<std::pair<uint64_t, resharding_descriptor*>> by_size;
+    by_size.reserve(jobs.size());
+    for (auto& job : jobs) {
+        by_size.emplace_back(job_size(job), &job);
+    }
+    std::stable_sort(by_size.begin(), by_size.end(), [] (auto& a, auto& b) {
+        return a.first > b.first;
+    });
+
+    std::vector<uint64_t> shard_bytes(smp::count);
+    for (auto& p : by_size) {
+        auto& job = *p.second;
+        shard_id best = 0;
+        for (shard_id shard = 1; shard < smp::count; shard++) {
+            if (shard_bytes[shard] < shard_bytes[best]
+                    || (shard_bytes[shard] == shard_bytes[best] && owns(job, shard) && !owns(job, best))) {
+                best = shard;
+            }
+        }
+        job.reshard_at = best;
+        shard_bytes[best] += p.first;
+    }
+}
+
+bool compaction_strategy_impl::worth_dropping_tombstones(const shared_sstable& sst, gc_clock::time_point gc_before, column_family& cf) {
+    if (_disable_tombstone_compaction) {
+        return false;
+    }
+    // ignore sstables that were created just recently because there's a chance
+    // that expired tombstones still cover old data and thus cannot be removed.
+    // We want to avoid a compaction loop here on the same data by considering
+    // only old enough sstables.
+    if (db_clock::now()-_tombstone_compaction_interval < sst->data_file_write_time()) {
+        return false;
+    }
+    auto droppable_ratio = sst->estimate_droppable_tombstone_ratio(gc_before);
+    if (droppable_ratio < _tombstone_threshold) {
+        return false;
+    }
+    if (_unchecked_tombstone_compaction) {
+        return true;
+    }
+    // A tombstone can't be purged while it may cover data of another sstable, so compacting
+    // sst alone drops nothing of the keys such sstables have. Those keys aren't counted, or
+    // the same sstable would keep being compacted in place of regular compactions.
+    auto& first = sst->get_first_decorated_key().token();
+    auto& last = sst->get_last_decorated_key().token();
+    auto range = dht::token_range::make(first, last);
+    auto max_timestamp = sst->get_stats_metadata().max_timestamp;
+    uint64_t overlapping_keys = 0;
+    for (auto& other : *cf.get_sstables()) {
+        if (other == sst || other->get_stats_metadata().min_timestamp > max_timestamp
+                || other->get_last_decorated_key().token() < first || other->get_first_decorated_key().token() > last) {
+            continue;
+        }
+        overlapping_keys += other->estimated_keys_for_range(range);
+    }
+    if (!overlapping_keys) {
+        return true;
+    }
+    auto keys = sst->get_estimated_key_count();
+    auto remaining_ratio = keys > overlapping_keys ? double(keys - overlapping_keys) / keys : 0;
+    return remaining_ratio * droppable_ratio >= _tombstone_threshold;
+}
+
+// Each byte is rewritten once per tier it has to climb until it reaches the size of the
+// whole table, and each tier is min_threshold times larger than the one below it.
+uint64_t compaction_strategy_impl::backlog(column_family& cf) const {
+    uint64_t total_size = 0;
+    for (auto& sst : *cf.get_sstables()) {
+        total_size += sst->data_size();
+    }
+    auto fan_out = std::log(std::max(2, cf.schema()->min_compaction_threshold()));
+    double backlog = 0;
+    for (auto& sst : *cf.get_sstables()) {
+        auto size = sst->data_size();
+        if (size) {
+            backlog += size * std::log(double(total_size) / size) / fan_out;
+        }
+    }
+    return backlog;
+}
+
 //
 // Null compaction strategy is the default compaction strategy.
 // As the name implies, it does nothing.
@@ -363,6 +564,10 @@ class null_compaction_strategy : public compaction_strategy_impl {
         return 0;
     }
 
+    virtual uint64_t backlog(column_family& cf) const override {
+        return 0;
+    }
+
     virtual compaction_strategy_type type() const {
         return compaction_strategy_type::null;
     }
@@ -435,6 +640,10 @@ int64_t compaction_strategy::estimated_pending_compactions(column_family& cf) co
     return _compaction_strategy_impl->estimated_pending_compactions(cf);
 }
 
+uint64_t compaction_strategy::backlog(column_family& cf) const {
+    return _compaction_strategy_impl->backlog(cf);
+}
+
 bool compaction_strategy::use_clustering_key_filter() const {
     return _compaction_strategy_impl->use_clustering_key_filter();
 }
@@ -34,11 +34,15 @@ class compaction_strategy_impl {
 protected:
     const sstring TOMBSTONE_THRESHOLD_OPTION = "tombstone_threshold";
     const sstring TOMBSTONE_COMPACTION_INTERVAL_OPTION = "tombstone_compaction_interval";
+    const sstring UNCHECKED_TOMBSTONE_COMPACTION_OPTION = "unchecked_tombstone_compaction";
 
     bool _use_clustering_key_filter = false;
     bool _disable_tombstone_compaction = false;
     float _tombstone_threshold = DEFAULT_TOMBSTONE_THRESHOLD;
     db_clock::duration _tombstone_compaction_interval = DEFAULT_TOMBSTONE_COMPACTION_INTERVAL();
+    // If false, the keys of a sstable which sstables holding older data may have are not
+    // counted as droppable.
+    bool _unchecked_tombstone_compaction = false;
 public:
     static stdx::optional<sstring> get_value(const std::map<sstring, sstring>& options, const sstring& name) {
         auto it = options.find(name);
@@ -59,6 +63,9 @@ class compaction_strategy_impl {
         auto interval = property_definitions::to_long(TOMBSTONE_COMPACTION_INTERVAL_OPTION, tmp_value, DEFAULT_TOMBSTONE_COMPACTION_INTERVAL().count());
         _tombstone_compaction_interval = db_clock::duration(std::chrono::seconds(interval));
 
+        tmp_value = get_value(options, UNCHECKED_TOMBSTONE_COMPACTION_OPTION);
+        _unchecked_tombstone_compaction = property_definitions::to_boolean(UNCHECKED_TOMBSTONE_COMPACTION_OPTION, tmp_value, false);
+
         // FIXME: validate options.
     }
 public:
@@ -71,6 +78,7 @@ class compaction_strategy_impl {
         return true;
     }
     virtual int64_t estimated_pending_compactions(column_family& cf) const = 0;
+    virtual uint64_t backlog(column_family& cf) const;
     virtual std::unique_ptr<sstable_set_impl> make_sstable_set(schema_ptr schema) const;
 
     bool use_clustering_key_filter() const {
@@ -78,20 +86,13 @@ class compaction_strategy_impl {
     }
 
     // Check if a given sstable is entitled for tombstone compaction based on its
-    // droppable tombstone histogram and gc_before.
-    bool worth_dropping_tombstones(const shared_sstable& sst, gc_clock::time_point gc_before) {
-        if (_disable_tombstone_compaction) {
-            return false;
-        }
-        // ignore sstables that were created just recently because there's a chance
-        // that expired tombstones still cover old data and thus cannot be removed.
-        // We want to avoid a compaction loop here on the same data by considering
-        // only old enough sstables.
-        if (db_clock::now()-_tombstone_compaction_interval < sst->data_file_write_time()) {
-            return false;
-        }
-        return sst->estimate_droppable_tombstone_ratio(gc_before) >= _tombstone_threshold;
-    }
+    // droppable tombstone histogram and gc_before, and on the sstables of cf
+    // which may hold data shadowed by its tombstones.
+    bool worth_dropping_tombstones(const shared_sstable& sst, gc_clock::time_point gc_before, column_family& cf);
+protected:
+    // Chooses the shard each of the jobs runs at, so that all shards reshard
+    // about as many bytes in parallel.
+    static void balance_resharding_jobs(std::vector<resharding_descriptor>& jobs);
 };
 
 }
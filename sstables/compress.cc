@@ -21,6 +21,7 @@
 
 #include <stdexcept>
 #include <cstdlib>
+#include <cmath>
 
 #include <boost/range/algorithm/find_if.hpp>
 #include <seastar/core/align.hh>
@@ -33,10 +34,13 @@
 #include <lz4.h>
 #include <zlib.h>
 #include <snappy-c.h>
+#include <zstd.h>
+#include <zdict.h>
 
 #include "unimplemented.hh"
 #include "stdx.hh"
 #include "segmented_compress_params.hh"
+#include "exceptions.hh"
 
 namespace sstables {
 
@@ -258,9 +262,174 @@ void compression::segmented_offsets::push_back(uint64_t offset) {
     ++_size;
 }
 
+static const bytes zstd_dictionary_option_prefix = to_bytes("zstd_dictionary.");
+// Option values are limited to 64k, so the dictionary is split into pieces.
+static constexpr size_t zstd_dictionary_piece_size = 32 * 1024;
+// Upper bound on the data buffered by the writer for dictionary training.
+static constexpr size_t max_zstd_dictionary_sample_size = 4 * 1024 * 1024;
+
+class compression::zstd_state {
+    struct cctx_deleter {
+        void operator()(ZSTD_CCtx* ctx) const { ZSTD_freeCCtx(ctx); }
+    };
+    struct dctx_deleter {
+        void operator()(ZSTD_DCtx* ctx) const { ZSTD_freeDCtx(ctx); }
+    };
+    struct cdict_deleter {
+        void operator()(ZSTD_CDict* dict) const { ZSTD_freeCDict(dict); }
+    };
+    struct ddict_deleter {
+        void operator()(ZSTD_DDict* dict) const { ZSTD_freeDDict(dict); }
+    };
+
+    int _level;
+    size_t _wanted_dictionary_size;
+    bool _dictionary_done;
+    // Contexts are reused across chunks to avoid reallocating their
+    // internal tables for each one.
+    std::unique_ptr<ZSTD_CCtx, cctx_deleter> _cctx;
+    std::unique_ptr<ZSTD_DCtx, dctx_deleter> _dctx;
+    std::unique_ptr<ZSTD_CDict, cdict_deleter> _cdict;
+    std::unique_ptr<ZSTD_DDict, ddict_deleter> _ddict;
+public:
+    zstd_state(int level, size_t wanted_dictionary_size)
+        : _level(level)
+        , _wanted_dictionary_size(wanted_dictionary_size)
+        , _dictionary_done(wanted_dictionary_size == 0) {
+    }
+
+    size_t dictionary_sample_size() const {
+        if (_dictionary_done) {
+            return 0;
+        }
+        return std::min(_wanted_dictionary_size * 100, max_zstd_dictionary_sample_size);
+    }
+
+    // Returns false if no dictionary could be trained on the samples.
+    bool train(const std::vector<temporary_buffer<char>>& samples, bytes& dictionary) {
+        _dictionary_done = true;
+        std::vector<size_t> sizes;
+        sizes.reserve(samples.size());
+        size_t total = 0;
+        for (auto&& sample : samples) {
+            sizes.push_back(sample.size());
+            total += sample.size();
+        }
+        std::unique_ptr<char[]> buf(new char[total]);
+        auto p = buf.get();
+        for (auto&& sample : samples) {
+            p = std::copy_n(sample.get(), sample.size(), p);
+        }
+        bytes dict(bytes::initialized_later(), _wanted_dictionary_size);
+        auto ret = ZDICT_trainFromBuffer(dict.begin(), dict.size(), buf.get(), sizes.data(), sizes.size());
+        if (ZDICT_isError(ret)) {
+            sstlog.debug("zstd dictionary training on {} bytes failed: {}, compressing without dictionary", total, ZDICT_getErrorName(ret));
+            return false;
+        }
+        dictionary = bytes(dict.begin(), ret);
+        load_dictionary(dictionary);
+        return true;
+    }
+
+    void load_dictionary(bytes_view dictionary) {
+        _dictionary_done = true;
+        _cdict.reset(ZSTD_createCDict(dictionary.data(), dictionary.size(), _level));
+        _ddict.reset(ZSTD_createDDict(dictionary.data(), dictionary.size()));
+        if (!_cdict || !_ddict) {
+            throw std::bad_alloc();
+        }
+    }
+
+    size_t compress(const char* input, size_t input_len, char* output, size_t output_len) {
+        if (!_cctx) {
+            _cctx.reset(ZSTD_createCCtx());
+            if (!_cctx) {
+                throw std::bad_alloc();
+            }
+        }
+        auto ret = _cdict
+                ? ZSTD_compress_usingCDict(_cctx.get(), output, output_len, input, input_len, _cdict.get())
+                : ZSTD_compressCCtx(_cctx.get(), output, output_len, input, input_len, _level);
+        if (ZSTD_isError(ret)) {
+            throw std::runtime_error(sprint("zstd compression failure: %s", ZSTD_getErrorName(ret)));
+        }
+        return ret;
+    }
+
+    size_t uncompress(const char* input, size_t input_len, char* output, size_t output_len) {
+        if (!_dctx) {
+            _dctx.reset(ZSTD_createDCtx());
+            if (!_dctx) {
+                throw std::bad_alloc();
+            }
+        }
+        auto ret = _ddict
+                ? ZSTD_decompress_usingDDict(_dctx.get(), output, output_len, input, input_len, _ddict.get())
+                : ZSTD_decompressDCtx(_dctx.get(), output, output_len, input, input_len);
+        if (ZSTD_isError(ret)) {
+            throw std::runtime_error(sprint("zstd uncompression failure: %s", ZSTD_getErrorName(ret)));
+        }
+        return ret;
+    }
+};
+
+// Reads back the dictionary stored by compression::train_dictionary().
+static bytes zstd_dictionary_from_options(const disk_array<uint32_t, option>& options) {
+    bytes dictionary;
+    size_t pieces = 0;
+    for (auto&& opt : options.elements) {
+        bytes_view key(opt.key.value);
+        bytes_view prefix(zstd_dictionary_option_prefix);
+        if (key.size() <= prefix.size() || key.substr(0, prefix.size()) != prefix) {
+            continue;
+        }
+        if (key.substr(prefix.size()) != bytes_view(to_bytes(to_sstring(pieces).c_str()))) {
+            throw malformed_sstable_exception(sprint("unexpected zstd dictionary piece %d", pieces));
+        }
+        dictionary += opt.value.value;
+        ++pieces;
+    }
+    return dictionary;
+}
+
+size_t compression::dictionary_sample_size() const {
+    return _zstd ? _zstd->dictionary_sample_size() : 0;
+}
+
+void compression::train_dictionary(const std::vector<temporary_buffer<char>>& samples) {
+    bytes dictionary;
+    if (!_zstd || !_zstd->train(samples, dictionary)) {
+        return;
+    }
+    for (size_t pos = 0, piece = 0; pos < dictionary.size(); pos += zstd_dictionary_piece_size, ++piece) {
+        auto len = std::min(zstd_dictionary_piece_size, dictionary.size() - pos);
+        options.elements.push_back({zstd_dictionary_option_prefix + to_bytes(to_sstring(piece).c_str()),
+                bytes(dictionary.begin() + pos, len)});
+    }
+}
+
+size_t compression::uncompress_zstd(const char* input, size_t input_len, char* output, size_t output_len) const {
+    return _zstd->uncompress(input, input_len, output, output_len);
+}
+
+size_t compression::compress_zstd(const char* input, size_t input_len, char* output, size_t output_len) const {
+    return _zstd->compress(input, input_len, output, output_len);
+}
+
+size_t compression::compress_max_size_zstd(size_t input_len) {
+    return ZSTD_compressBound(input_len);
+}
+
 void compression::update(uint64_t compressed_file_length) {
     // FIXME: also process _compression.options (just for crc-check frequency)
-     if (name.value == "LZ4Compressor") {
+     if (name.value == "ZstdCompressor") {
+         // The level is irrelevant for decompression.
+         _zstd = make_shared<zstd_state>(compression_parameters::DEFAULT_ZSTD_COMPRESSION_LEVEL, 0);
+         auto dictionary = zstd_dictionary_from_options(options);
+         if (!dictionary.empty()) {
+             _zstd->load_dictionary(dictionary);
+         }
+     } else if (name.value == "LZ4Compressor") {
          _uncompress = uncompress_lz4;
      } else if (name.value == "SnappyCompressor") {
          _uncompress = uncompress_snappy;
@@ -274,6 +443,7 @@ void compression::update(uint64_t compressed_file_length) {
 }
 
 void compression::set_compressor(compressor c) {
+     _zstd = nullptr;
      if (c == compressor::lz4) {
          _compress = compress_lz4;
          _compress_max_size = compress_max_size_lz4;
@@ -286,11 +456,21 @@ void compression::set_compressor(compressor c) {
          _compress = compress_deflate;
          _compress_max_size = compress_max_size_deflate;
          name.value = "DeflateCompressor";
+     } else if (c == compressor::zstd) {
+         _zstd = make_shared<zstd_state>(compression_parameters::DEFAULT_ZSTD_COMPRESSION_LEVEL, 0);
+         name.value = "ZstdCompressor";
      } else {
          throw std::runtime_error("unsupported compressor type");
      }
 }
 
+void compression::set_compressor(const compression_parameters& cp) {
+    set_compressor(cp.get_compressor());
+    if (_zstd) {
+        _zstd = make_shared<zstd_state>(cp.compression_level(), cp.dictionary_size());
+    }
+}
+
 // locate() takes a byte position in the uncompressed stream, and finds the
 // the location of the compressed chunk on disk which contains it, and the
 // offset in this chunk.
@@ -309,6 +489,35 @@ compression::locate(uint64_t position) const {
     return { chunk_start, chunk_end - chunk_start, chunk_offset };
 }
 
+constexpr uint32_t chunk_length_advisor::min_chunk_length;
+constexpr uint32_t chunk_length_advisor::max_chunk_length;
+constexpr uint64_t chunk_length_advisor::min_reads;
+
+void chunk_length_advisor::record_read(const utils::UUID& table, uint64_t bytes) {
+    // Weight of the latest read in the average.
+    static constexpr double alpha = 1.0 / 256;
+    auto& r = _tables[table];
+    auto log2_size = std::log2(double(std::max<uint64_t>(bytes, 1)));
+    if (r.count++) {
+        r.log2_size += alpha * (log2_size - r.log2_size);
+    } else {
+        r.log2_size = log2_size;
+    }
+}
+
+uint32_t chunk_length_advisor::chunk_length(const utils::UUID& table, uint32_t default_chunk_length) const {
+    auto it = _tables.find(table);
+    if (it == _tables.end() || it->second.count < min_reads) {
+        return default_chunk_length;
+    }
+    auto typical_size = std::exp2(it->second.log2_size);
+    auto chunk_length = min_chunk_length;
+    while (chunk_length < max_chunk_length && chunk_length < typical_size) {
+        chunk_length *= 2;
+    }
+    return chunk_length;
+}
+
 }
 
 size_t uncompress_lz4(const char* input, size_t input_len,
@@ -456,10 +665,17 @@ class compressed_file_data_source_impl : public data_source_impl {
     uint64_t _pos;
     uint64_t _beg_pos;
     uint64_t _end_pos;
+    uint64_t* _decompressed_bytes;
+    uint64_t* _decompress_ns;
 public:
+    // make_stream(f, pos, len) opens the stream of the compressed chunks.
+    template <typename StreamFactory>
     compressed_file_data_source_impl(file f, sstables::compression* cm,
-                uint64_t pos, size_t len, file_input_stream_options options)
+                uint64_t pos, size_t len, StreamFactory&& make_stream, uint64_t* decompressed_bytes = nullptr,
+                uint64_t* decompress_ns = nullptr)
             : _compression_metadata(cm)
+            , _decompressed_bytes(decompressed_bytes)
+            , _decompress_ns(decompress_ns)
     {
         _beg_pos = pos;
         if (pos > _compression_metadata->uncompressed_file_length()) {
@@ -480,10 +696,9 @@ class compressed_file_data_source_impl : public data_source_impl {
         // and open a file_input_stream to read that range.
         auto start = _compression_metadata->locate(_beg_pos);
         auto end = _compression_metadata->locate(_end_pos - 1);
-        _input_stream = make_file_input_stream(std::move(f),
+        _input_stream = make_stream(std::move(f),
                 start.chunk_start,
-                end.chunk_start + end.chunk_len - start.chunk_start,
-                std::move(options));
+                end.chunk_start + end.chunk_len - start.chunk_start);
         _underlying_pos = start.chunk_start;
         _pos = _beg_pos;
     }
@@ -515,9 +730,16 @@ class compressed_file_data_source_impl : public data_source_impl {
                         _compression_metadata->uncompressed_chunk_length());
                 // The compressed data is the whole chunk, minus the last 4
                 // bytes (which contain the checksum verified above).
+                auto start = _decompress_ns ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point();
                 auto len = _compression_metadata->uncompress(
                         buf.get(), compressed_len,
                         out.get_write(), out.size());
+                if (_decompress_ns) {
+                    *_decompress_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+                }
+                if (_decompressed_bytes) {
+                    *_decompressed_bytes += len;
+                }
                 out.trim(len);
                 out.trim_front(addr.offset);
                 _pos += out.size();
@@ -551,10 +773,12 @@ class compressed_file_data_source_impl : public data_source_impl {
 
 class compressed_file_data_source : public data_source {
 public:
+    template <typename StreamFactory>
     compressed_file_data_source(file f, sstables::compression* cm,
-            uint64_t offset, size_t len, file_input_stream_options options)
+            uint64_t offset, size_t len, StreamFactory&& make_stream, uint64_t* decompressed_bytes = nullptr,
+            uint64_t* decompress_ns = nullptr)
         : data_source(std::make_unique<compressed_file_data_source_impl>(
-                std::move(f), cm, offset, len, std::move(options)))
+                std::move(f), cm, offset, len, std::forward<StreamFactory>(make_stream), decompressed_bytes, decompress_ns))
         {}
 };
 
@@ -563,5 +787,18 @@ input_stream<char> make_compressed_file_input_stream(
         file_input_stream_options options)
 {
     return input_stream<char>(compressed_file_data_source(
-            std::move(f), cm, offset, len, std::move(options)));
+            std::move(f), cm, offset, len, [&options] (file f, uint64_t pos, uint64_t len) {
+                return make_file_input_stream(std::move(f), pos, len, std::move(options));
+            }));
+}
+
+input_stream<char> make_compressed_file_input_stream(
+        file f, sstables::compression* cm, uint64_t offset, size_t len,
+        const io_priority_class& pc, sstables::read_ahead_policy policy,
+        uint64_t* bytes_read, uint64_t* decompressed_bytes, uint64_t* decompress_ns)
+{
+    return input_stream<char>(compressed_file_data_source(
+            std::move(f), cm, offset, len, [&pc, policy, bytes_read] (file f, uint64_t pos, uint64_t len) {
+                return sstables::make_adaptive_file_input_stream(std::move(f), pos, len, pc, policy, bytes_read);
+            }, decompressed_bytes, decompress_ns));
 }
@@ -37,6 +37,11 @@
 // LZ4, Snappy, and Deflate - the default (and therefore most important) is
 // LZ4. Each compressor is an implementation of the "compressor" class.
 //
+// We additionally support Zstandard. Zstd chunks can optionally be compressed
+// with a dictionary trained on the first chunks written to the sstable; the
+// dictionary is stored in the options of the "compression_metadata", split
+// into pieces so that each fits in an option value.
+//
 // Each compressed chunk is followed by a 4-byte checksum of the compressed
 // data, using the Adler32 algorithm. In Cassandra, there is a parameter
 // "crc_check_chance" (defaulting to 1.0) which determines the probability
@@ -47,6 +52,7 @@
 // level Cassandra rows, not disk blocks.
 
 #include <vector>
+#include <unordered_map>
 #include <cstdint>
 #include <iterator>
 #include <zlib.h>
@@ -56,6 +62,9 @@
 #include "core/shared_ptr.hh"
 #include "types.hh"
 #include "../compress.hh"
+#include "read_ahead.hh"
+#include "utils/adler32.hh"
+#include "utils/UUID.hh"
 
 // An "uncompress_func" is a function which uncompresses the given compressed
 // input chunk, and writes the uncompressed data into the given output buffer.
@@ -88,15 +97,11 @@ inline uint32_t init_checksum_adler32() {
 }
 
 inline uint32_t checksum_adler32(const char* input, size_t input_len) {
-    auto init = adler32(0, Z_NULL, 0);
-    // yuck, zlib uses unsigned char while we use char :-(
-    return adler32(init, reinterpret_cast<const unsigned char *>(input),
-            input_len);
+    return utils::adler32(init_checksum_adler32(), reinterpret_cast<const uint8_t*>(input), input_len);
 }
 
 inline uint32_t checksum_adler32(uint32_t adler, const char* input, size_t input_len) {
-    return adler32(adler, reinterpret_cast<const unsigned char *>(input),
-            input_len);
+    return utils::adler32(adler, reinterpret_cast<const uint8_t*>(input), input_len);
 }
 
 inline uint32_t checksum_adler32_combine(uint32_t adler1, uint32_t adler2, size_t input_len2) {
@@ -300,6 +305,10 @@ struct compression {
         }
     };
 
+    // Holds the zstd compression level, dictionary and (de)compression
+    // contexts. Defined in compress.cc.
+    class zstd_state;
+
     disk_string<uint16_t> name;
     disk_array<uint32_t, option> options;
     uint32_t chunk_len;
@@ -312,18 +321,32 @@ struct compression {
     compress_func *_compress = nullptr;
     // Return maximum length of data that compressor may output.
     compress_max_size_func *_compress_max_size = nullptr;
+    // Set instead of the function pointers above for ZstdCompressor.
+    shared_ptr<zstd_state> _zstd;
     // Variables *not* found in the "Compression Info" file (added by update()):
     uint64_t _compressed_file_length = 0;
     uint32_t _full_checksum;
 public:
     // Set the compressor algorithm, please check the definition of enum compressor.
     void set_compressor(compressor c);
+    // Like above, but also applies compressor specific parameters, like the
+    // zstd compression level and dictionary size.
+    void set_compressor(const compression_parameters& cp);
     // After changing _compression, update() must be called to update
     // additional variables depending on it.
     void update(uint64_t compressed_file_length);
     operator bool() const {
-        return _uncompress != nullptr;
+        return _uncompress != nullptr || _zstd;
     }
+
+    // Amount of uncompressed data the writer should buffer and pass to
+    // train_dictionary() before compressing any chunk. 0 if no dictionary
+    // is wanted, or if it was already trained.
+    size_t dictionary_sample_size() const;
+    // Trains the dictionary used to compress all chunks on the given sample
+    // of chunks, and stores it in options. If training fails, e.g. because
+    // there is too little data, chunks are compressed without a dictionary.
+    void train_dictionary(const std::vector<temporary_buffer<char>>& samples);
     // locate() locates in the compressed file the given byte position of
     // the uncompressed data:
     //   1. The byte range containing the appropriate compressed chunk, and
@@ -377,6 +400,9 @@ struct compression {
     size_t uncompress(
             const char* input, size_t input_len,
             char* output, size_t output_len) const {
+        if (_zstd) {
+            return uncompress_zstd(input, input_len, output, output_len);
+        }
         if (!_uncompress) {
             throw std::runtime_error("uncompress is not supported");
         }
@@ -385,17 +411,63 @@ struct compression {
     size_t compress(
             const char* input, size_t input_len,
             char* output, size_t output_len) const {
+        if (_zstd) {
+            return compress_zstd(input, input_len, output, output_len);
+        }
         if (!_compress) {
             throw std::runtime_error("compress is not supported");
         }
         return _compress(input, input_len, output, output_len);
     }
     size_t compress_max_size(size_t input_len) const {
+        if (_zstd) {
+            return compress_max_size_zstd(input_len);
+        }
         return _compress_max_size(input_len);
     }
+private:
+    size_t uncompress_zstd(const char* input, size_t input_len, char* output, size_t output_len) const;
+    size_t compress_zstd(const char* input, size_t input_len, char* output, size_t output_len) const;
+    static size_t compress_max_size_zstd(size_t input_len);
     friend class sstable;
 };
 
+// Picks the chunk length of the sstables written for tables with
+// chunk_length_kb set to "auto", from the sizes of the data file reads of the
+// table seen by this shard: the smallest power of two covering their typical
+// size, so that point reads don't decompress much more than they return, and
+// scans get bigger chunks which compress better.
+//
+// Reads are averaged geometrically, so a few scans don't outweigh many point
+// reads, and recent reads weigh more, so that the chunk length of the sstables
+// written by compaction follows changes of the workload.
+class chunk_length_advisor {
+public:
+    static constexpr uint32_t min_chunk_length = 4 * 1024;
+    static constexpr uint32_t max_chunk_length = 64 * 1024;
+    // Reads of a table needed before its chunk length is picked.
+    static constexpr uint64_t min_reads = 1000;
+private:
+    struct table_reads {
+        uint64_t count = 0;
+        // Moving average of log2 of the read sizes.
+        double log2_size = 0;
+    };
+    std::unordered_map<utils::UUID, table_reads> _tables;
+public:
+    static chunk_length_advisor& local() {
+        static thread_local chunk_length_advisor advisor;
+        return advisor;
+    }
+
+    void record_read(const utils::UUID& table, uint64_t bytes);
+    // Returns default_chunk_length until min_reads reads of the table were seen.
+    uint32_t chunk_length(const utils::UUID& table, uint32_t default_chunk_length) const;
+    void forget(const utils::UUID& table) {
+        _tables.erase(table);
+    }
+};
+
 }
 
 
@@ -406,3 +478,13 @@ struct compression {
 // sstable alive, and the compression metadata is only a part of it.
 input_stream<char> make_compressed_file_input_stream(
         file f, sstables::compression *cm, uint64_t offset, size_t len, class file_input_stream_options options);
+
+// Reads the compressed chunks ahead as policy says. The bytes read from the
+// file and those uncompressed out of them are added to bytes_read and
+// decompressed_bytes, and the nanoseconds spent uncompressing them to
+// decompress_ns, when given, which must outlive the stream.
+input_stream<char> make_compressed_file_input_stream(
+        file f, sstables::compression *cm, uint64_t offset, size_t len,
+        const io_priority_class& pc, sstables::read_ahead_policy policy,
+        uint64_t* bytes_read = nullptr, uint64_t* decompressed_bytes = nullptr,
+        uint64_t* decompress_ns = nullptr);
@@ -24,6 +24,7 @@
 #include "core/future.hh"
 #include "core/iostream.hh"
 #include "sstables/exceptions.hh"
+#include "vint-serialization.hh"
 #include <seastar/core/byteorder.hh>
 
 template<typename T>
@@ -56,6 +57,7 @@ class continuous_data_consumer {
         READING_U32,
         READING_U64,
         READING_BYTES,
+        READING_UNSIGNED_VINT,
     } _prestate = prestate::NONE;
 
     // state for non-NONE prestates
@@ -72,7 +74,7 @@ class continuous_data_consumer {
         uint16_t uint16;
         uint8_t  uint8;
     } _read_int;
-    // state for READING_BYTES prestate
+    // state for READING_BYTES and READING_UNSIGNED_VINT prestates
     temporary_buffer<char> _read_bytes;
     temporary_buffer<char>* _read_bytes_where; // which temporary_buffer to set, _key or _val?
 
@@ -144,6 +146,31 @@ class continuous_data_consumer {
         }
     }
 
+    // Read an unsigned variable-length integer (see vint-serialization.hh)
+    // into _u64. The length of the integer is only known once its first
+    // byte is available.
+    inline read_status read_unsigned_vint(temporary_buffer<char>& data) {
+        if (data.empty()) {
+            _read_bytes = temporary_buffer<char>();
+            _pos = 0;
+            _prestate = prestate::READING_UNSIGNED_VINT;
+            return read_status::waiting;
+        }
+        auto len = unsigned_vint::serialized_size_from_first_byte(*data.begin());
+        if (data.size() >= len) {
+            _u64 = unsigned_vint::deserialize(bytes_view(reinterpret_cast<const bytes::value_type*>(data.get()), len)).value;
+            data.trim_front(len);
+            return read_status::ready;
+        } else {
+            _read_bytes = temporary_buffer<char>(len);
+            std::copy(data.begin(), data.end(), _read_bytes.get_write());
+            _pos = data.size();
+            data.trim(0);
+            _prestate = prestate::READING_UNSIGNED_VINT;
+            return read_status::waiting;
+        }
+    }
+
     inline void process_buffer(temporary_buffer<char>& data) {
         if (__builtin_expect((_prestate != prestate::NONE), 0)) {
             do_process_buffer(data);
@@ -166,6 +193,20 @@ class continuous_data_consumer {
                 *_read_bytes_where = std::move(_read_bytes);
                 _prestate = prestate::NONE;
             }
+        } else if (_prestate == prestate::READING_UNSIGNED_VINT) {
+            if (_read_bytes.empty()) {
+                _read_bytes = temporary_buffer<char>(unsigned_vint::serialized_size_from_first_byte(*data.begin()));
+            }
+            auto n = std::min(_read_bytes.size() - _pos, data.size());
+            std::copy(data.begin(), data.begin() + n,
+                    _read_bytes.get_write() + _pos);
+            data.trim_front(n);
+            _pos += n;
+            if (_pos == _read_bytes.size()) {
+                _u64 = unsigned_vint::deserialize(bytes_view(reinterpret_cast<const bytes::value_type*>(_read_bytes.get()), _read_bytes.size())).value;
+                _read_bytes.release();
+                _prestate = prestate::NONE;
+            }
         } else {
             // in the middle of reading an integer
             unsigned len;
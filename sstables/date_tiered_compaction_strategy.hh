@@ -447,8 +447,8 @@ class date_tiered_compaction_strategy : public compaction_strategy_impl {
         }
 
         // filter out sstables which droppable tombstone ratio isn't greater than the defined threshold.
-        auto e = boost::range::remove_if(candidates, [this, &gc_before] (const sstables::shared_sstable& sst) -> bool {
-            return !worth_dropping_tombstones(sst, gc_before);
+        auto e = boost::range::remove_if(candidates, [this, &gc_before, &cfs] (const sstables::shared_sstable& sst) -> bool {
+            return !worth_dropping_tombstones(sst, gc_before, cfs);
         });
         candidates.erase(e, candidates.end());
         if (candidates.empty()) {
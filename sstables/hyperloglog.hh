@@ -137,11 +137,60 @@ class HyperLogLog {
         alphaMM_ = alpha * m_ * m_;
     }
 
+    /**
+     * Reads an estimator written by get_bytes(), in the format of the
+     * HyperLogLogPlus of Cassandra's compaction metadata. The registers may
+     * also be one per byte, as written by older versions.
+     *
+     * @exception std::invalid_argument the bytes are malformed, or hold a
+     *            sparse estimator, which isn't supported.
+     */
     static HyperLogLog from_bytes(temporary_buffer<uint8_t> bytes) {
-        // FIXME: implement class that creates a HyperLogLog from an array of bytes.
-        // This will useful if we need to work with the cardinality data from the
-        // compaction metadata.
-        abort();
+        auto p = bytes.get();
+        auto end = p + bytes.size();
+        auto read_var_int = [&] {
+            unsigned int value = 0;
+            for (unsigned shift = 0; shift < 32; shift += 7) {
+                if (p == end) {
+                    throw std::invalid_argument("truncated cardinality estimator");
+                }
+                auto b = *p++;
+                value |= unsigned(b & 0x7F) << shift;
+                if (!(b & 0x80)) {
+                    return value;
+                }
+            }
+            throw std::invalid_argument("malformed cardinality estimator");
+        };
+        if (end - p < ssize_t(sizeof(int32_t))
+                || read_be<int32_t>(reinterpret_cast<const char*>(p)) != -version) {
+            throw std::invalid_argument("unsupported cardinality estimator version");
+        }
+        p += sizeof(int32_t);
+        auto b = read_var_int();
+        read_var_int(); // sp
+        if (read_var_int() != 0) {
+            throw std::invalid_argument("sparse cardinality estimators are not supported");
+        }
+        if (b < 4 || b > 16) {
+            throw std::invalid_argument("bit width must be in the range [4,16]");
+        }
+        HyperLogLog hll(b);
+        auto size = read_var_int();
+        if (size_t(end - p) < size) {
+            throw std::invalid_argument("truncated cardinality estimator");
+        }
+        if (size == hll.m_) {
+            std::copy(p, p + size, hll.M_.begin());
+        } else if (size == packed_registers_size(hll.m_)) {
+            for (uint32_t i = 0; i < hll.m_; ++i) {
+                auto word = read_be<uint32_t>(reinterpret_cast<const char*>(p + i / registers_per_word * sizeof(uint32_t)));
+                hll.M_[i] = (word >> (register_bits * (i % registers_per_word))) & register_mask;
+            }
+        } else {
+            throw std::invalid_argument("malformed cardinality estimator");
+        }
+        return hll;
     }
 
     /**
@@ -179,15 +228,16 @@ class HyperLogLog {
         size += size_unsigned_var_int(b_); // p; register width = b_.
         size += size_unsigned_var_int(0); // sp; // sparse set = 0.
         size += size_unsigned_var_int(0); // type;
-        size += size_unsigned_var_int(M_.size()); // register size;
-        size += M_.size();
+        size += size_unsigned_var_int(packed_registers_size(m_)); // register size;
+        size += packed_registers_size(m_);
         return size;
     }
 
+    // The registers are packed as Cassandra's RegisterSet does, six 5-bit
+    // registers to a big endian 32-bit word, so that the estimator can be
+    // read by Cassandra, and merged with the ones it writes.
     temporary_buffer<uint8_t> get_bytes() {
         // FIXME: add support to SPARSE format.
-        static constexpr int version = 2;
-
         size_t s = get_bytes_size();
         temporary_buffer<uint8_t> bytes(s);
         size_t offset = 0;
@@ -202,10 +252,16 @@ class HyperLogLog {
         // write type (NORMAL always!)
         offset += write_unsigned_var_int(0, bytes.get_write() + offset);
         // write register size
-        offset += write_unsigned_var_int(M_.size(), bytes.get_write() + offset);
+        offset += write_unsigned_var_int(packed_registers_size(m_), bytes.get_write() + offset);
         // write register
-        memcpy(bytes.get_write() + offset, M_.data(), M_.size());
-        offset += M_.size();
+        for (uint32_t i = 0; i < m_; i += registers_per_word) {
+            uint32_t word = 0;
+            for (uint32_t j = 0; j < registers_per_word && i + j < m_; ++j) {
+                word |= uint32_t(std::min(M_[i + j], uint8_t(register_mask))) << (register_bits * j);
+            }
+            write_be<uint32_t>(reinterpret_cast<char*>(bytes.get_write() + offset), word);
+            offset += sizeof(uint32_t);
+        }
 
         bytes.trim(offset);
         if (s != offset) {
@@ -279,6 +335,13 @@ class HyperLogLog {
         return m_;
     }
 
+    /**
+     * Returns the register bit width.
+     */
+    uint8_t precision() const {
+        return b_;
+    }
+
     /**
      * Exchanges the content of the instance
      *
@@ -330,9 +393,19 @@ class HyperLogLog {
     double alphaMM_; ///< alpha * m^2
     std::vector<uint8_t> M_; ///< registers
 
-    uint8_t rho(uint32_t x, uint8_t b) {
+    static constexpr int version = 2;
+    static constexpr uint32_t register_bits = 5;
+    static constexpr uint32_t registers_per_word = 32 / register_bits;
+    static constexpr uint8_t register_mask = (1 << register_bits) - 1;
+
+    static uint32_t packed_registers_size(uint32_t m) {
+        return (m + registers_per_word - 1) / registers_per_word * sizeof(uint32_t);
+    }
+
+    // The position of the first set bit of the b leftmost bits of x.
+    uint8_t rho(uint64_t x, uint8_t b) {
         uint8_t v = 1;
-        while (v <= b && !(x & 0x80000000)) {
+        while (v <= b && !(x & 0x8000000000000000)) {
             v++;
             x <<= 1;
         }
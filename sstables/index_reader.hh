@@ -245,6 +245,7 @@ class index_reader {
                 try {
                     f.get();
                     _reader.emplace(_sstable, _pc, position, end, quantity);
+                    ++_sstable->_read_stats.index_page_reads;
                 } catch (...) {
                     _reader = stdx::nullopt;
                     throw;
@@ -297,6 +298,8 @@ class index_reader {
         , _pc(pc)
     {
         sstlog.trace("index {}: index_reader for {}", this, _sstable->get_filename());
+        ++_sstable->_active_index_readers;
+        ++_sstable->_index_reads;
     }
 
     index_reader(const index_reader& r)
@@ -312,6 +315,11 @@ class index_reader {
         , _element(r._element)
     {
         sstlog.trace("index {}: index_reader for {}", this, _sstable->get_filename());
+        ++_sstable->_active_index_readers;
+    }
+
+    ~index_reader() {
+        --_sstable->_active_index_readers;
     }
 
     // Valid if partition_data_ready()
@@ -399,28 +407,28 @@ class index_reader {
 
         if (sstlog.is_enabled(seastar::log_level::trace)) {
             sstlog.trace("index {}: promoted index:", this);
-            for (auto&& e : pi->entries) {
+            pi->for_each([] (const promoted_index::entry& e) {
                 sstlog.trace("  {}-{}: +{} len={}", e.start, e.end, e.offset, e.width);
-            }
+            });
         }
 
         auto cmp_with_start = [pos_cmp = position_in_partition::composite_less_compare(s)]
-            (position_in_partition_view pos, const promoted_index::entry& e) -> bool {
-            return pos_cmp(pos, e.start);
+            (position_in_partition_view pos, composite_view start) -> bool {
+            return pos_cmp(pos, start);
         };
 
         // Optimize short skips which typically land in the same block
-        if (_current_pi_idx >= pi->entries.size() || cmp_with_start(pos, pi->entries[_current_pi_idx])) {
+        if (_current_pi_idx >= pi->size() || cmp_with_start(pos, (*pi)[_current_pi_idx].start)) {
             sstlog.trace("index {}: position in current block", this);
             return make_ready_future<>();
         }
 
-        auto i = std::upper_bound(pi->entries.begin() + _current_pi_idx, pi->entries.end(), pos, cmp_with_start);
-        _current_pi_idx = std::distance(pi->entries.begin(), i);
-        if (i != pi->entries.begin()) {
+        auto i = pi->upper_bound(_current_pi_idx, pos, cmp_with_start);
+        _current_pi_idx = i;
+        if (i) {
             --i;
         }
-        _data_file_position = e.position() + i->offset;
+        _data_file_position = e.position() + (*pi)[i].offset;
         _element = indexable_element::cell;
         sstlog.trace("index {}: skipped to cell, _current_pi_idx={}, _data_file_position={}", this, _current_pi_idx, _data_file_position);
         return make_ready_future<>();
@@ -454,23 +462,23 @@ class index_reader {
             sstlog.error("Failed to get promoted index for sstable {}, page {}, index {}: {}", _sstable->get_filename(),
                 _current_summary_idx, _current_index_idx, std::current_exception());
         }
-        if (!pi || pi->entries.empty()) {
+        if (!pi || pi->empty()) {
             sstlog.trace("index {}: no promoted index", this);
             return advance_to_next_partition();
         }
 
         auto cmp_with_start = [pos_cmp = position_in_partition::composite_less_compare(s)]
-            (position_in_partition_view pos, const promoted_index::entry& e) -> bool {
-            return pos_cmp(pos, e.start);
+            (position_in_partition_view pos, composite_view start) -> bool {
+            return pos_cmp(pos, start);
         };
 
-        auto i = std::upper_bound(pi->entries.begin() + _current_pi_idx, pi->entries.end(), pos, cmp_with_start);
-        _current_pi_idx = std::distance(pi->entries.begin(), i);
-        if (i == pi->entries.end()) {
+        auto i = pi->upper_bound(_current_pi_idx, pos, cmp_with_start);
+        _current_pi_idx = i;
+        if (i == pi->size()) {
             return advance_to_next_partition();
         }
 
-        _data_file_position = e.position() + i->offset;
+        _data_file_position = e.position() + (*pi)[i].offset;
         _element = indexable_element::cell;
         sstlog.trace("index {}: skipped to cell, _current_pi_idx={}, _data_file_position={}", this, _current_pi_idx, _data_file_position);
         return make_ready_future<>();
@@ -0,0 +1,160 @@
+/*
+ * Copyright (C) 2017 ScyllaDB
+ */
+
+/*
+ * This file is part of Scylla.
+ *
+ * Scylla is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Scylla is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <seastar/core/metrics.hh>
+
+#include "index_summary_manager.hh"
+#include "sstables.hh"
+#include "downsampling.hh"
+#include "log.hh"
+
+namespace sstables {
+
+static logging::logger smlog("index_summary_manager");
+
+// Below, a summary is left as it is, to avoid resampling it over and over
+// for small changes of its reads.
+static constexpr double upsample_threshold = 1.5;
+static constexpr double downsample_threshold = 0.75;
+
+index_summary_manager::index_summary_manager(uint64_t memory_budget, std::chrono::minutes resize_interval, sstables_source sstables)
+    : _memory_budget(memory_budget)
+    , _resize_interval(resize_interval)
+    , _sstables(std::move(sstables))
+    , _timer([this] {
+        redistribute_summaries().handle_exception([] (std::exception_ptr ep) {
+            smlog.warn("Failed to redistribute the summaries: {}", ep);
+        }).finally([this] {
+            arm();
+        });
+    })
+{
+    setup_metrics();
+}
+
+void index_summary_manager::setup_metrics() {
+    namespace sm = seastar::metrics;
+    _metrics.add_group("sstables", {
+        sm::make_gauge("summary_memory", [this] { return _stats.summary_memory; },
+            sm::description("Memory used by the summaries of the sstables, as of their last redistribution")),
+        sm::make_gauge("summary_memory_budget", [this] { return _memory_budget; },
+            sm::description("Memory the summaries of the sstables are resampled to fit in")),
+        sm::make_gauge("filter_memory", [this] { return _stats.filter_memory; },
+            sm::description("Memory used by the bloom filters of the sstables, as of the last redistribution of the summaries")),
+        sm::make_derive("summary_downsamples", [this] { return _stats.downsampled_summaries; },
+            sm::description("Summaries of cold sstables downsampled to fit in the budget")),
+        sm::make_derive("summary_upsamples", [this] { return _stats.upsampled_summaries; },
+            sm::description("Summaries of hot sstables read again from disk at a higher density")),
+    });
+}
+
+void index_summary_manager::arm() {
+    if (_resize_interval.count() && !_stopped) {
+        _timer.arm(_resize_interval);
+    }
+}
+
+void index_summary_manager::start() {
+    arm();
+}
+
+future<> index_summary_manager::stop() {
+    _stopped = true;
+    _timer.cancel();
+    return _gate.close();
+}
+
+future<> index_summary_manager::redistribute_summaries() {
+    return with_gate(_gate, [this] {
+        struct candidate {
+            shared_sstable sst;
+            uint64_t reads;
+            // The memory of the summary at its full sampling level.
+            double full_memory;
+            int full_level;
+            int min_level;
+            int level;
+        };
+        auto candidates = make_lw_shared<std::vector<candidate>>();
+        uint64_t fixed_memory = 0;
+        uint64_t filter_memory = 0;
+        double full_memory = 0;
+        double min_memory = 0;
+        uint64_t reads = 0;
+        for (auto&& sst : _sstables()) {
+            auto memory = sst->get_summary().memory_footprint();
+            filter_memory += sst->filter_memory_size();
+            auto sst_reads = sst->take_index_reads();
+            if (!sst->can_resample_summary()) {
+                fixed_memory += memory;
+                continue;
+            }
+            auto& s = *sst->get_schema();
+            auto full_level = sst->summary_full_sampling_level();
+            auto min_level = std::min(full_level, std::max(1, downsampling::BASE_SAMPLING_LEVEL * s.min_index_interval() / s.max_index_interval()));
+            auto sst_full_memory = double(memory) * full_level / sst->summary_sampling_level();
+            full_memory += sst_full_memory;
+            min_memory += sst_full_memory * min_level / full_level;
+            reads += sst_reads;
+            candidates->push_back(candidate{sst, sst_reads, sst_full_memory, full_level, min_level, full_level});
+        }
+        _stats.filter_memory = filter_memory;
+
+        double budget = _memory_budget > fixed_memory ? _memory_budget - fixed_memory : 0;
+        if (full_memory > budget) {
+            // Every summary keeps its minimum level, the rest of the budget
+            // goes to the sstables read the most.
+            auto spare = std::max(0.0, budget - min_memory);
+            for (auto&& c : *candidates) {
+                auto share = reads ? spare * c.reads / reads : spare * c.full_memory / full_memory;
+                auto extra_levels = c.full_memory ? int(share / c.full_memory * c.full_level) : c.full_level;
+                c.level = std::min(c.full_level, c.min_level + extra_levels);
+            }
+        }
+        smlog.debug("Redistributing {} bytes among the summaries of {} sstables, which need {} bytes at full sampling",
+                budget, candidates->size(), full_memory);
+
+        return do_for_each(*candidates, [this] (candidate& c) {
+            auto current = c.sst->summary_sampling_level();
+            auto resample = c.level < current
+                    ? c.level <= current * downsample_threshold
+                    : c.level > current && (c.level >= current * upsample_threshold || c.level == c.full_level);
+            if (!resample) {
+                return make_ready_future<>();
+            }
+            auto upsample = c.level > current;
+            return c.sst->resample_summary(c.level).then([this, upsample] (bool resampled) {
+                if (resampled) {
+                    ++(upsample ? _stats.upsampled_summaries : _stats.downsampled_summaries);
+                }
+            }).handle_exception([sst = c.sst] (std::exception_ptr ep) {
+                smlog.warn("Failed to resample the summary of {}: {}", sst->get_filename(), ep);
+            });
+        }).then([this, candidates, fixed_memory] {
+            _stats.summary_memory = fixed_memory;
+            for (auto&& c : *candidates) {
+                _stats.summary_memory += c.sst->get_summary().memory_footprint();
+            }
+        });
+    });
+}
+
+}
@@ -0,0 +1,79 @@
+/*
+ * Copyright (C) 2017 ScyllaDB
+ */
+
+/*
+ * This file is part of Scylla.
+ *
+ * Scylla is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Scylla is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <functional>
+#include <vector>
+#include <seastar/core/gate.hh>
+#include <seastar/core/lowres_clock.hh>
+#include <seastar/core/metrics_registration.hh>
+#include <seastar/core/timer.hh>
+
+#include "shared_sstable.hh"
+#include "seastarx.hh"
+
+namespace sstables {
+
+// Keeps the summaries of the sstables of a shard within a memory budget,
+// as Cassandra's IndexSummaryManager does: every resize interval the
+// budget is shared out in proportion to the index lookups of each sstable
+// since the last time, the coldest summaries being downsampled down to
+// their max_index_interval, and the summaries of sstables which got hot
+// again being read back from disk at a higher density.
+class index_summary_manager {
+public:
+    struct stats {
+        // As of the last redistribution.
+        uint64_t summary_memory = 0;
+        uint64_t filter_memory = 0;
+        uint64_t downsampled_summaries = 0;
+        uint64_t upsampled_summaries = 0;
+    };
+    using sstables_source = std::function<std::vector<shared_sstable>()>;
+private:
+    uint64_t _memory_budget;
+    std::chrono::minutes _resize_interval;
+    sstables_source _sstables;
+    timer<lowres_clock> _timer;
+    seastar::gate _gate;
+    bool _stopped = false;
+    stats _stats;
+    seastar::metrics::metric_groups _metrics;
+private:
+    void setup_metrics();
+    void arm();
+public:
+    // A zero resize interval disables the periodic redistribution.
+    index_summary_manager(uint64_t memory_budget, std::chrono::minutes resize_interval, sstables_source sstables);
+
+    void start();
+    future<> stop();
+
+    future<> redistribute_summaries();
+
+    const stats& get_stats() const {
+        return _stats;
+    }
+};
+
+}
@@ -0,0 +1,150 @@
+/*
+ * Copyright (C) 2018 ScyllaDB
+ */
+
+/*
+ * This file is part of Scylla.
+ *
+ * Scylla is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Scylla is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "sstables/key_cache.hh"
+#include "core/metrics.hh"
+#include "core/reactor.hh"
+
+namespace sstables {
+
+key_cache::key_cache()
+    : _capacity(0)
+{ }
+
+key_cache::~key_cache() {
+    while (!_lru.empty()) {
+        erase(_lru.back());
+    }
+}
+
+void key_cache::set_capacity(size_t capacity) {
+    _capacity = capacity;
+    evict();
+}
+
+void key_cache::register_metrics() {
+    namespace sm = seastar::metrics;
+    _metrics.add_group("sstables", {
+        sm::make_derive("key_cache_hits", _stats.hits,
+            sm::description("Single partition reads which found the partition's data file position in the key cache")),
+        sm::make_derive("key_cache_misses", _stats.misses,
+            sm::description("Single partition reads which had to look the partition up in the index")),
+        sm::make_derive("key_cache_populations", _stats.populations,
+            sm::description("Data file positions inserted into the key cache, by reads or compaction")),
+        sm::make_derive("key_cache_evictions", _stats.evictions,
+            sm::description("Partitions evicted from the key cache due to its size limit")),
+        sm::make_gauge("key_cache_partitions", _stats.entries,
+            sm::description("Partitions currently held in the key cache")),
+        sm::make_gauge("key_cache_bytes", _stats.memory,
+            sm::description("Memory used by the key cache")),
+    });
+}
+
+key_cache::entry* key_cache::find(const utils::UUID& table, bytes_view key) {
+    auto it = _entries.find(key_view{table, key}, compare());
+    return it == _entries.end() ? nullptr : &*it;
+}
+
+void key_cache::touch(entry& e) {
+    _lru.erase(_lru.iterator_to(e));
+    _lru.push_front(e);
+}
+
+void key_cache::add_position(entry& e, position pos) {
+    auto it = std::find_if(e.positions.begin(), e.positions.end(), [&] (const position& p) {
+        return p.generation == pos.generation;
+    });
+    if (it != e.positions.end()) {
+        e.positions.erase(it);
+    } else if (e.positions.size() == max_positions) {
+        e.positions.pop_back();
+    }
+    e.positions.insert(e.positions.begin(), pos);
+    ++_stats.populations;
+}
+
+void key_cache::erase(entry& e) {
+    _entries.erase(_entries.iterator_to(e));
+    _lru.erase(_lru.iterator_to(e));
+    --_stats.entries;
+    _stats.memory -= e.memory_usage();
+    delete &e;
+}
+
+void key_cache::evict() {
+    while (_stats.memory > _capacity && !_lru.empty()) {
+        erase(_lru.back());
+        ++_stats.evictions;
+    }
+}
+
+std::experimental::optional<key_cache::position> key_cache::lookup(const utils::UUID& table, int64_t generation, bytes_view key) {
+    if (!_capacity) {
+        return { };
+    }
+    auto e = find(table, key);
+    if (e) {
+        for (auto&& p : e->positions) {
+            if (p.generation == generation) {
+                touch(*e);
+                ++_stats.hits;
+                return p;
+            }
+        }
+    }
+    ++_stats.misses;
+    return { };
+}
+
+void key_cache::populate(const utils::UUID& table, bytes_view key, position pos) {
+    if (!_capacity) {
+        return;
+    }
+    auto e = find(table, key);
+    if (!e) {
+        e = new entry(table, bytes(key));
+        _entries.insert(*e);
+        _lru.push_front(*e);
+        ++_stats.entries;
+        _stats.memory += e->memory_usage();
+    } else {
+        touch(*e);
+    }
+    add_position(*e, pos);
+    evict();
+}
+
+void key_cache::preheat(const utils::UUID& table, bytes_view key, position pos) {
+    auto e = find(table, key);
+    if (e) {
+        add_position(*e, pos);
+    }
+}
+
+future<> init_key_cache(size_t capacity) {
+    return smp::invoke_on_all([capacity] {
+        auto& cache = key_cache::local();
+        cache.set_capacity(capacity / smp::count);
+        cache.register_metrics();
+    });
+}
+
+}
@@ -0,0 +1,149 @@
+/*
+ * Copyright (C) 2018 ScyllaDB
+ */
+
+/*
+ * This file is part of Scylla.
+ *
+ * Scylla is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Scylla is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <experimental/optional>
+#include <boost/intrusive/list.hpp>
+#include <boost/intrusive/set.hpp>
+#include <boost/container/static_vector.hpp>
+#include "core/future.hh"
+#include "core/metrics_registration.hh"
+#include "types.hh"
+#include "seastarx.hh"
+#include "utils/UUID.hh"
+
+namespace sstables {
+
+namespace bi = boost::intrusive;
+
+// Remembers where in the data files of the shard's sstables recently read
+// partitions are, so that reading one of them again goes straight to the data
+// file, without the summary lookup and the index page read and parse.
+//
+// Only partitions without a promoted index are cached: slicing the others needs
+// the index anyway.
+//
+// Entries are keyed by table and partition key, and hold the positions of the
+// partition in the few sstables of the table it was last found in. This lets
+// compaction record where the cached partitions it writes end up
+// (compaction_preheat_key_cache), so their reads don't miss once the compacted
+// sstables are gone. Positions in deleted sstables are never looked up again,
+// as generations aren't reused, and age out.
+//
+// The memory of the entries is bounded by key_cache_size_in_mb, split evenly
+// among the shards. Least recently used entries are evicted first.
+class key_cache {
+public:
+    struct position {
+        int64_t generation;
+        // Of the partition and right past it, in the uncompressed data file.
+        uint64_t start;
+        uint64_t end;
+    };
+    struct stats {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        uint64_t populations = 0;
+        uint64_t evictions = 0;
+        uint64_t entries = 0;
+        uint64_t memory = 0;
+    };
+private:
+    static constexpr size_t max_positions = 4;
+
+    class entry {
+    public:
+        bi::set_member_hook<> set_link;
+        bi::list_member_hook<> lru_link;
+        utils::UUID table;
+        bytes key;
+        // Most recently added first.
+        boost::container::static_vector<position, max_positions> positions;
+
+        entry(utils::UUID table, bytes key) : table(table), key(std::move(key)) { }
+        size_t memory_usage() const {
+            return sizeof(entry) + key.size();
+        }
+    };
+    struct key_view {
+        const utils::UUID& table;
+        bytes_view key;
+    };
+    struct compare {
+        static int tri_compare(const utils::UUID& t1, bytes_view k1, const utils::UUID& t2, bytes_view k2) {
+            if (t1 != t2) {
+                return t1 < t2 ? -1 : 1;
+            }
+            return compare_unsigned(k1, k2);
+        }
+        bool operator()(const entry& a, const entry& b) const {
+            return tri_compare(a.table, a.key, b.table, b.key) < 0;
+        }
+        bool operator()(const key_view& a, const entry& b) const {
+            return tri_compare(a.table, a.key, b.table, b.key) < 0;
+        }
+        bool operator()(const entry& a, const key_view& b) const {
+            return tri_compare(a.table, a.key, b.table, b.key) < 0;
+        }
+    };
+    using set_type = bi::set<entry, bi::member_hook<entry, bi::set_member_hook<>, &entry::set_link>, bi::compare<compare>>;
+    using lru_type = bi::list<entry, bi::member_hook<entry, bi::list_member_hook<>, &entry::lru_link>>;
+
+    set_type _entries;
+    lru_type _lru;
+    size_t _capacity;
+    stats _stats;
+    seastar::metrics::metric_groups _metrics;
+private:
+    entry* find(const utils::UUID& table, bytes_view key);
+    void touch(entry& e);
+    void add_position(entry& e, position pos);
+    void erase(entry& e);
+    void evict();
+public:
+    key_cache();
+    ~key_cache();
+    key_cache(const key_cache&) = delete;
+
+    static key_cache& local() {
+        static thread_local key_cache cache;
+        return cache;
+    }
+
+    // Zero disables the cache.
+    void set_capacity(size_t capacity);
+    void register_metrics();
+
+    std::experimental::optional<position> lookup(const utils::UUID& table, int64_t generation, bytes_view key);
+    void populate(const utils::UUID& table, bytes_view key, position pos);
+    // Like populate(), but only if the partition is cached for some sstable of the table.
+    void preheat(const utils::UUID& table, bytes_view key, position pos);
+
+    const stats& get_stats() const {
+        return _stats;
+    }
+};
+
+// Sizes the caches of all shards, and registers their metrics.
+future<> init_key_cache(size_t capacity);
+
+}
@@ -32,6 +32,19 @@ class leveled_compaction_strategy : public compaction_strategy_impl {
     int32_t _max_sstable_size_in_mb = DEFAULT_MAX_SSTABLE_SIZE_IN_MB;
     stdx::optional<std::vector<stdx::optional<dht::decorated_key>>> _last_compacted_keys;
     std::vector<int> _compaction_counter;
+    // Compactions into levels above L0 picked by this strategy, which may still run.
+    struct running_compaction {
+        std::vector<shared_sstable> sstables;
+        uint32_t level;
+        dht::partition_range range;
+    };
+    std::vector<running_compaction> _running_compactions;
+
+    // Forgets the compactions whose sstables aren't all being compacted anymore, as they
+    // are either done or failed.
+    void forget_finished_compactions(column_family& cfs, const std::vector<shared_sstable>& candidates);
+
+    compaction_descriptor get_next_compaction(column_family& cfs, std::vector<sstables::shared_sstable> candidates);
 public:
     leveled_compaction_strategy(const std::map<sstring, sstring>& options)
         : compaction_strategy_impl(options)
@@ -62,9 +75,7 @@ class leveled_compaction_strategy : public compaction_strategy_impl {
 
     virtual int64_t estimated_pending_compactions(column_family& cf) const override;
 
-    virtual bool parallel_compaction() const override {
-        return false;
-    }
+    virtual uint64_t backlog(column_family& cf) const override;
 
     virtual compaction_strategy_type type() const {
         return compaction_strategy_type::leveled;
@@ -72,13 +83,39 @@ class leveled_compaction_strategy : public compaction_strategy_impl {
     virtual std::unique_ptr<sstable_set_impl> make_sstable_set(schema_ptr schema) const override;
 };
 
+void leveled_compaction_strategy::forget_finished_compactions(column_family& cfs, const std::vector<shared_sstable>& candidates) {
+    std::unordered_set<shared_sstable> available(candidates.begin(), candidates.end());
+    auto sstables = cfs.get_sstables();
+    _running_compactions.erase(boost::remove_if(_running_compactions, [&] (const running_compaction& c) {
+        return boost::algorithm::any_of(c.sstables, [&] (const shared_sstable& sst) {
+            return available.count(sst) || !sstables->count(sst);
+        });
+    }), _running_compactions.end());
+}
+
+// Compactions run in parallel as long as those into a given level don't overlap. The
+// picked compaction is assumed to start running, if it doesn't its sstables are still
+// candidates on the next pick, which forgets it.
 compaction_descriptor leveled_compaction_strategy::get_sstables_for_compaction(column_family& cfs, std::vector<sstables::shared_sstable> candidates) {
+    auto descriptor = get_next_compaction(cfs, std::move(candidates));
+    if (descriptor.level > 0 && !descriptor.sstables.empty()) {
+        auto range = leveled_manifest::key_range(*cfs.schema(), descriptor.sstables);
+        _running_compactions.push_back({ descriptor.sstables, uint32_t(descriptor.level), std::move(range) });
+    }
+    return descriptor;
+}
+
+compaction_descriptor leveled_compaction_strategy::get_next_compaction(column_family& cfs, std::vector<sstables::shared_sstable> candidates) {
+    forget_finished_compactions(cfs, candidates);
     // NOTE: leveled_manifest creation may be slightly expensive, so later on,
     // we may want to store it in the strategy itself. However, the sstable
     // lists managed by the manifest may become outdated. For example, one
     // sstable in it may be marked for deletion after compacted.
     // Currently, we create a new manifest whenever it's time for compaction.
     leveled_manifest manifest = leveled_manifest::create(cfs, candidates, _max_sstable_size_in_mb);
+    for (auto& c : _running_compactions) {
+        manifest.add_running_compaction(c.level, c.range);
+    }
     if (!_last_compacted_keys) {
         generate_last_compacted_keys(manifest);
     }
@@ -97,8 +134,8 @@ compaction_descriptor leveled_compaction_strategy::get_sstables_for_compaction(c
     for (auto level = int(manifest.get_level_count()); level >= 0; level--) {
         auto& sstables = manifest.get_level(level);
         // filter out sstables which droppable tombstone ratio isn't greater than the defined threshold.
-        auto e = boost::range::remove_if(sstables, [this, &gc_before] (const sstables::shared_sstable& sst) -> bool {
-            return !worth_dropping_tombstones(sst, gc_before);
+        auto e = boost::range::remove_if(sstables, [this, &gc_before, &cfs] (const sstables::shared_sstable& sst) -> bool {
+            return !worth_dropping_tombstones(sst, gc_before, cfs);
         });
         sstables.erase(e, sstables.end());
         if (sstables.empty()) {
@@ -116,13 +153,11 @@ std::vector<resharding_descriptor> leveled_compaction_strategy::get_resharding_j
     leveled_manifest manifest = leveled_manifest::create(cf, candidates, _max_sstable_size_in_mb);
 
     std::vector<resharding_descriptor> descriptors;
-    shard_id target_shard = 0;
-    auto get_shard = [&target_shard] { return target_shard++ % smp::count; };
 
     // Basically, we'll iterate through all levels, and for each, we'll sort the
     // sstables by first key because there's a need to reshard together adjacent
     // sstables.
-    // The shard at which the job will run is chosen in a round-robin fashion.
+    // The shards at which the jobs will run are chosen once all of them are known.
     for (auto level = 0U; level <= manifest.get_level_count(); level++) {
         uint64_t max_sstable_size = !level ? std::numeric_limits<uint64_t>::max() : (_max_sstable_size_in_mb*1024*1024);
         auto& sstables = manifest.get_level(level);
@@ -130,7 +165,7 @@ std::vector<resharding_descriptor> leveled_compaction_strategy::get_resharding_j
             return i->compare_by_first_key(*j) < 0;
         });
 
-        resharding_descriptor current_descriptor = resharding_descriptor{{}, max_sstable_size, get_shard(), level};
+        resharding_descriptor current_descriptor = resharding_descriptor{{}, max_sstable_size, 0, level};
 
         for (auto it = sstables.begin(); it != sstables.end(); it++) {
             current_descriptor.sstables.push_back(*it);
@@ -138,10 +173,11 @@ std::vector<resharding_descriptor> leveled_compaction_strategy::get_resharding_j
             auto next = std::next(it);
             if (current_descriptor.sstables.size() == smp::count || next == sstables.end()) {
                 descriptors.push_back(std::move(current_descriptor));
-                current_descriptor = resharding_descriptor{{}, max_sstable_size, get_shard(), level};
+                current_descriptor = resharding_descriptor{{}, max_sstable_size, 0, level};
             }
         }
     }
+    balance_resharding_jobs(descriptors);
     return descriptors;
 }
 
@@ -194,4 +230,24 @@ int64_t leveled_compaction_strategy::estimated_pending_compactions(column_family
     return manifest.get_estimated_tasks();
 }
 
+// Data in L0, and data exceeding the capacity of any other level, has to be merged into the
+// next level, which rewrites about fan-out times as many bytes.
+uint64_t leveled_compaction_strategy::backlog(column_family& cf) const {
+    static constexpr uint64_t fan_out = 10;
+    std::vector<uint64_t> level_size(leveled_manifest::MAX_LEVELS);
+    for (auto& sst : *cf.get_sstables()) {
+        auto level = std::min<uint32_t>(sst->get_sstable_level(), leveled_manifest::MAX_LEVELS - 1);
+        level_size[level] += sst->data_size();
+    }
+    uint64_t max_sstable_size_in_bytes = uint64_t(_max_sstable_size_in_mb) * 1024 * 1024;
+    uint64_t backlog = level_size[0] * fan_out;
+    for (auto level = 1; level < leveled_manifest::MAX_LEVELS; level++) {
+        auto max_bytes = leveled_manifest::max_bytes_for_level(level, max_sstable_size_in_bytes);
+        if (level_size[level] > max_bytes) {
+            backlog += (level_size[level] - max_bytes) * fan_out;
+        }
+    }
+    return backlog;
+}
+
 }
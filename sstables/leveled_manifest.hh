@@ -46,10 +46,13 @@
 #include "range.hh"
 #include "log.hh"
 #include <boost/range/algorithm/partial_sort.hpp>
+#include <boost/algorithm/cxx11/any_of.hpp>
 
 class leveled_manifest {
     schema_ptr _schema;
     std::vector<std::vector<sstables::shared_sstable>> _generations;
+    // The ranges which running compactions write into each level.
+    std::vector<std::vector<dht::partition_range>> _running_ranges;
     uint64_t _max_sstable_size_in_bytes;
 #if 0
     private final SizeTieredCompactionStrategyOptions options;
@@ -89,6 +92,7 @@ class leveled_manifest {
         // updated, we will still have sstables of the older, potentially smaller size.  So don't make this
         // dependent on maxSSTableSize.)
         _generations.resize(MAX_LEVELS);
+        _running_ranges.resize(MAX_LEVELS);
     }
 public:
     static leveled_manifest create(column_family& cfs, std::vector<sstables::shared_sstable>& sstables, int max_sstable_size_in_mb) {
@@ -109,6 +113,40 @@ class leveled_manifest {
         return manifest;
     }
 
+    // The range of keys spanned by sstables.
+    static dht::partition_range key_range(const schema& s, const std::vector<sstables::shared_sstable>& sstables) {
+        auto first = &sstables.front()->get_first_decorated_key();
+        auto last = &sstables.front()->get_last_decorated_key();
+        for (auto& sst : sstables) {
+            if (sst->get_first_decorated_key().tri_compare(s, *first) < 0) {
+                first = &sst->get_first_decorated_key();
+            }
+            if (sst->get_last_decorated_key().tri_compare(s, *last) > 0) {
+                last = &sst->get_last_decorated_key();
+            }
+        }
+        return dht::partition_range::make(dht::ring_position(*first), dht::ring_position(*last));
+    }
+
+    // Tells the manifest that a compaction is writing the keys of range into level, so
+    // that compactions into the same level, which would write overlapping sstables
+    // into it, aren't picked while it runs.
+    void add_running_compaction(uint32_t level, dht::partition_range range) {
+        _running_ranges.at(level).push_back(std::move(range));
+    }
+
+    // Whether compacting sstables into level conflicts with a running compaction.
+    // Nothing conflicts in L0, whose sstables may overlap.
+    bool conflicts_with_running_compactions(uint32_t level, const std::vector<sstables::shared_sstable>& sstables) const {
+        if (level == 0 || sstables.empty()) {
+            return false;
+        }
+        auto range = key_range(*_schema, sstables);
+        return boost::algorithm::any_of(_running_ranges.at(level), [&] (const dht::partition_range& r) {
+            return r.overlaps(range, dht::ring_position_comparator(*_schema));
+        });
+    }
+
     // Return first set of overlapping sstables for a given level.
     // Assumes _generations[level] is already sorted by first key.
     std::vector<sstables::shared_sstable> overlapping_sstables(int level) const {
@@ -237,7 +275,13 @@ class leveled_manifest {
                 int next_level = get_next_level(info.candidates, info.can_promote);
 
                 if (info.can_promote) {
-                    info.candidates = get_overlapping_starved_sstables(next_level, std::move(info.candidates), compaction_counter);
+                    auto candidates = get_overlapping_starved_sstables(next_level, std::vector<sstables::shared_sstable>(info.candidates), compaction_counter);
+                    // A starved sstable may raise the level the candidates are compacted into.
+                    auto level = get_next_level(candidates, info.can_promote);
+                    if (!conflicts_with_running_compactions(level, candidates)) {
+                        info.candidates = std::move(candidates);
+                        next_level = level;
+                    }
                 }
 #if 0
                 if (logger.isDebugEnabled())
@@ -258,6 +302,12 @@ class leveled_manifest {
         if (info.candidates.empty()) {
             return sstables::compaction_descriptor();
         }
+        if (conflicts_with_running_compactions(get_next_level(info.candidates, info.can_promote), info.candidates)) {
+            // Another compaction is writing into L1. Meanwhile, keep the number of L0
+            // sstables reads have to look at down by size-tiering them.
+            logger.debug("L0 can't be promoted while overlapping compactions into L1 run, performing size-tiering there instead");
+            return sstables::compaction_descriptor(size_tiered_most_interesting_bucket(get_level(0)));
+        }
         auto next_level = get_next_level(info.candidates, info.can_promote);
         return sstables::compaction_descriptor(std::move(info.candidates), next_level, _max_sstable_size_in_bytes);
     }
@@ -459,6 +509,9 @@ class leveled_manifest {
         // invariant to be restored.
         auto overlapping_current_level = overlapping_sstables(level);
         if (!overlapping_current_level.empty()) {
+            if (conflicts_with_running_compactions(level, overlapping_current_level)) {
+                return { {}, false };
+            }
             logger.info("Leveled compaction strategy is restoring invariant of level {} by compacting {} sstables on behalf of {}.{}",
                 level, overlapping_current_level.size(), s.ks_name(), s.cf_name());
             return { overlapping_current_level, false };
@@ -466,11 +519,17 @@ class leveled_manifest {
 
         int start = sstable_index_based_on_last_compacted_key(sstables, level, s, last_compacted_keys);
 
-        auto pos = start % sstables.size();
-        auto candidates = overlapping(*_schema, sstables.at(pos), get_level(level + 1));
-        candidates.push_back(sstables.at(pos));
-
-        return { candidates, true };
+        // Skip the sstables whose compaction would overlap running compactions into the
+        // next level, so that compactions of disjoint ranges run in parallel.
+        for (size_t i = 0; i < sstables.size(); i++) {
+            auto pos = (start + i) % sstables.size();
+            auto candidates = overlapping(*_schema, sstables.at(pos), get_level(level + 1));
+            candidates.push_back(sstables.at(pos));
+            if (!conflicts_with_running_compactions(level + 1, candidates)) {
+                return { candidates, true };
+            }
+        }
+        return { {}, true };
     }
 
     /**
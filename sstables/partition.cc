@@ -30,10 +30,13 @@
 #include "dht/i_partitioner.hh"
 #include <seastar/core/byteorder.hh>
 #include "index_reader.hh"
+#include "key_cache.hh"
 #include "counters.hh"
 #include "utils/data_input.hh"
 #include "clustering_ranges_walker.hh"
 #include "binary_search.hh"
+#include "mutation_compactor.hh"
+#include "service/priority_manager.hh"
 
 namespace sstables {
 
@@ -96,6 +99,12 @@ class mp_row_consumer : public row_consumer {
     // _range_tombstones holds only tombstones which are relevant for current ranges.
     range_tombstone_stream _range_tombstones;
     bool _first_row_encountered = false;
+
+    // Expiring cells which expired by then are read as the dead cells they
+    // turn into, without copying their values. Only query reads do that:
+    // they compact the cells the same way anyway, while compaction, streaming
+    // and repair see the cells as they were written.
+    gc_clock::time_point _expired_before;
 public:
     void set_streamed_mutation(sstable_streamed_mutation* sm) {
         _sm = sm;
@@ -289,10 +298,21 @@ class mp_row_consumer : public row_consumer {
         }
     }
 
+    // The static row is right after the partition header, so reading it means
+    // reading from the front of the partition, even when the promoted index
+    // could take us straight to the block of the first requested row. Only
+    // read it when the slice can see it: it selects static columns, filters
+    // on them, or may return a partition with no rows. Forwarding readers
+    // always start with the static row, their consumers expect it.
+    bool needs_static_row(const query::clustering_row_ranges& ranges) const {
+        return _schema->has_static_columns()
+            && (_fwd || !_slice.static_columns.empty() || _slice.has_static_filters() || !has_ck_selector(ranges));
+    }
+
     void set_up_ck_ranges(const partition_key& pk) {
         sstlog.trace("mp_row_consumer {}: set_up_ck_ranges({})", this, pk);
         _ck_ranges = query::clustering_key_filter_ranges::get_ranges(*_schema, _slice, pk);
-        _ck_ranges_walker = clustering_ranges_walker(*_schema, _ck_ranges->ranges(), _schema->has_static_columns());
+        _ck_ranges_walker = clustering_ranges_walker(*_schema, _ck_ranges->ranges(), needs_static_row(_ck_ranges->ranges()));
         _last_lower_bound_counter = 0;
         _fwd_end = _fwd ? position_in_partition::before_all_clustered_rows() : position_in_partition::after_all_clustered_rows();
         _out_of_range = false;
@@ -312,6 +332,7 @@ class mp_row_consumer : public row_consumer {
             , _slice(slice)
             , _fwd(fwd)
             , _range_tombstones(*_schema)
+            , _expired_before(&pc == &service::get_local_sstable_query_read_priority() ? gc_clock::now() : gc_clock::time_point::min())
     { }
 
     mp_row_consumer(const schema_ptr schema,
@@ -489,8 +510,11 @@ class mp_row_consumer : public row_consumer {
 
     atomic_cell make_atomic_cell(uint64_t timestamp, bytes_view value, uint32_t ttl, uint32_t expiration) {
         if (ttl) {
-            return atomic_cell::make_live(timestamp, value,
-                gc_clock::time_point(gc_clock::duration(expiration)), gc_clock::duration(ttl));
+            auto expiry = gc_clock::time_point(gc_clock::duration(expiration));
+            if (expiry <= _expired_before) {
+                return atomic_cell::make_dead(timestamp, expiry - gc_clock::duration(ttl));
+            }
+            return atomic_cell::make_live(timestamp, value, expiry, gc_clock::duration(ttl));
         } else {
             return atomic_cell::make_live(timestamp, value);
         }
@@ -778,6 +802,15 @@ struct sstable_data_source : public enable_lw_shared_from_this<sstable_data_sour
         , _schema(std::move(s))
     { }
 
+    // For a partition whose position is known without the index.
+    sstable_data_source(single_partition_tag, schema_ptr s, shared_sstable sst, mp_row_consumer&& consumer,
+        sstable::disk_read_range toread)
+        : _sst(std::move(sst))
+        , _consumer(std::move(consumer))
+        , _context(_sst->data_consume_single_partition(_consumer, std::move(toread)))
+        , _schema(std::move(s))
+    { }
+
     ~sstable_data_source() {
         auto close = [] (std::unique_ptr<index_reader>& ptr) {
             if (ptr) {
@@ -1011,26 +1044,57 @@ static inline bytes_view consume_bytes(bytes_view& p, size_t len) {
     return ret;
 }
 
+promoted_index::promoted_index(bytes_view blocks, uint32_t size, bool is_compound)
+    : _blocks(blocks)
+    , _size(size)
+    , _is_compound(is_compound)
+{
+    // Validates the lengths, so that blocks can be parsed without checks later.
+    _samples.reserve((size + sample_interval - 1) / sample_interval);
+    bytes_view data = _blocks;
+    for (uint32_t i = 0; i < size; ++i) {
+        if (i % sample_interval == 0) {
+            _samples.push_back(_blocks.size() - data.size());
+        }
+        consume_bytes(data, consume_be<uint16_t>(data));
+        consume_bytes(data, consume_be<uint16_t>(data));
+        consume_bytes(data, 2 * sizeof(uint64_t));
+    }
+}
+
+promoted_index::entry promoted_index::parse_entry(uint32_t& offset) const {
+    bytes_view data = _blocks.substr(offset);
+    uint16_t len = consume_be<uint16_t>(data);
+    auto start_ck = composite_view(consume_bytes(data, len), _is_compound);
+    len = consume_be<uint16_t>(data);
+    auto end_ck = composite_view(consume_bytes(data, len), _is_compound);
+    uint64_t block_offset = consume_be<uint64_t>(data);
+    uint64_t width = consume_be<uint64_t>(data);
+    offset = _blocks.size() - data.size();
+    return entry{start_ck, end_ck, block_offset, width};
+}
+
+composite_view promoted_index::parse_start(uint32_t offset) const {
+    bytes_view data = _blocks.substr(offset);
+    uint16_t len = consume_be<uint16_t>(data);
+    return composite_view(consume_bytes(data, len), _is_compound);
+}
+
+promoted_index::entry promoted_index::operator[](size_t i) const {
+    uint32_t offset = _samples[i / sample_interval];
+    for (auto n = i % sample_interval; n; --n) {
+        parse_entry(offset);
+    }
+    return parse_entry(offset);
+}
+
 promoted_index promoted_index_view::parse(const schema& s) const {
     bytes_view data = _bytes;
 
-    sstables::deletion_time del_time;
-    del_time.local_deletion_time = consume_be<uint32_t>(data);
-    del_time.marked_for_delete_at = consume_be<uint64_t>(data);
-
+    // Skip the deletion time.
+    consume_bytes(data, sizeof(uint32_t) + sizeof(uint64_t));
     auto num_blocks = consume_be<uint32_t>(data);
-    std::deque<promoted_index::entry> entries;
-    while (num_blocks--) {
-        uint16_t len = consume_be<uint16_t>(data);
-        auto start_ck = composite_view(consume_bytes(data, len), s.is_compound());
-        len = consume_be<uint16_t>(data);
-        auto end_ck = composite_view(consume_bytes(data, len), s.is_compound());
-        uint64_t offset = consume_be<uint64_t>(data);
-        uint64_t width = consume_be<uint64_t>(data);
-        entries.emplace_back(promoted_index::entry{start_ck, end_ck, offset, width});
-    }
-
-    return promoted_index{del_time, std::move(entries)};
+    return promoted_index(data, num_blocks, s.is_compound());
 }
 
 sstables::deletion_time promoted_index_view::get_deletion_time() const {
@@ -1263,6 +1327,16 @@ sstables::sstable::read_row(schema_ptr schema,
     reader_resource_tracker resource_tracker,
     streamed_mutation::forwarding fwd)
 {
+    auto cached = key_cache::local().lookup(_schema->id(), _generation, key.key()->representation());
+    if (cached) {
+        _filter_tracker.add_true_positive();
+        auto consumer = mp_row_consumer(schema, slice, pc, std::move(resource_tracker), fwd);
+        auto ds = make_lw_shared<sstable_data_source>(sstable_data_source::single_partition_tag(), std::move(schema),
+            shared_from_this(), std::move(consumer), sstable::disk_read_range(cached->start, cached->end));
+        ds->_will_likely_slice = sstable_data_source::will_likely_slice(slice);
+        return ds->read_partition().finally([ds]{});
+    }
+
     auto lh_index = get_index_reader(pc);
     auto f = lh_index->advance_and_check_if_present(key);
     return f.then([this, &slice, &pc, resource_tracker = std::move(resource_tracker), fwd, lh_index = std::move(lh_index), s = std::move(schema), key] (bool present) mutable {
@@ -1273,9 +1347,15 @@ sstables::sstable::read_row(schema_ptr schema,
 
         _filter_tracker.add_true_positive();
 
+        // Reading the partition again needs the index only if it has a promoted index.
+        auto cacheable = !lh_index->current_partition_entry().get_promoted_index_view();
         auto rh_index = std::make_unique<index_reader>(*lh_index);
         auto f = advance_to_upper_bound(*rh_index, *_schema, slice, key);
-        return f.then([this, &slice, &pc, resource_tracker = std::move(resource_tracker), fwd, lh_index = std::move(lh_index), rh_index = std::move(rh_index), s = std::move(s)] () mutable {
+        return f.then([this, &slice, &pc, resource_tracker = std::move(resource_tracker), fwd, lh_index = std::move(lh_index), rh_index = std::move(rh_index), s = std::move(s), key, cacheable] () mutable {
+            if (cacheable) {
+                key_cache::local().populate(_schema->id(), key.key()->representation(),
+                    key_cache::position{_generation, lh_index->data_file_position(), rh_index->data_file_position()});
+            }
             auto consumer = mp_row_consumer(s, slice, pc, std::move(resource_tracker), fwd);
             auto ds = make_lw_shared<sstable_data_source>(sstable_data_source::single_partition_tag(), std::move(s),
                 shared_from_this(), std::move(consumer), std::move(lh_index), std::move(rh_index));
@@ -25,6 +25,7 @@
 
 #include <seastar/core/shared_ptr.hh>
 #include <seastar/core/shared_ptr_incomplete.hh>
+#include <chrono>
 
 namespace sstables {
 class write_monitor {
@@ -32,6 +33,10 @@ class write_monitor {
     virtual ~write_monitor() { }
     virtual void on_write_completed() = 0;
     virtual void on_flush_completed() = 0;
+    // Called as the data file is written, with the time spent compressing a
+    // chunk, and waiting for a write which couldn't be put behind.
+    virtual void on_compress(std::chrono::steady_clock::duration) { }
+    virtual void on_write_wait(std::chrono::steady_clock::duration) { }
 };
 
 struct noop_write_monitor final : public write_monitor {
@@ -0,0 +1,148 @@
+/*
+ * Copyright (C) 2017 ScyllaDB
+ */
+
+/*
+ * This file is part of Scylla.
+ *
+ * Scylla is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Scylla is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <deque>
+#include "core/align.hh"
+#include "core/future-util.hh"
+#include "read_ahead.hh"
+
+namespace sstables {
+
+class adaptive_file_data_source_impl : public data_source_impl {
+    struct pending_read {
+        uint64_t pos;
+        uint64_t end;
+        future<temporary_buffer<char>> buf;
+    };
+    file _file;
+    const io_priority_class& _pc;
+    read_ahead_policy _policy;
+    uint64_t* _bytes_read;
+    // Where the next read starts, past the reads in flight.
+    uint64_t _pos;
+    uint64_t _end;
+    size_t _buffer_size;
+    // The number of buffers the reader got since the last skip.
+    unsigned _consumed = 0;
+    // In the order of the file.
+    std::deque<pending_read> _reads;
+private:
+    void issue_read() {
+        // Reads end on a page boundary, so that the next ones are aligned.
+        auto end = std::min(_end, align_up(_pos + _buffer_size, uint64_t(read_ahead_page_size)));
+        _reads.push_back(pending_read{_pos, end, _file.dma_read_bulk<char>(_pos, end - _pos, _pc)});
+        if (_bytes_read) {
+            *_bytes_read += end - _pos;
+        }
+        _pos = end;
+    }
+
+    static void discard(pending_read&& r) {
+        r.buf.then_wrapped([] (future<temporary_buffer<char>> f) {
+            f.ignore_ready_future();
+        });
+    }
+
+    void restart_at(uint64_t pos) {
+        while (!_reads.empty()) {
+            discard(std::move(_reads.front()));
+            _reads.pop_front();
+        }
+        _pos = std::min(pos, _end);
+        _buffer_size = _policy.min_buffer_size;
+        _consumed = 0;
+    }
+public:
+    adaptive_file_data_source_impl(file f, uint64_t pos, uint64_t len, const io_priority_class& pc, read_ahead_policy policy,
+            uint64_t* bytes_read)
+        : _file(std::move(f))
+        , _pc(pc)
+        , _policy(policy)
+        , _bytes_read(bytes_read)
+        , _pos(pos)
+        , _end(pos + len)
+        , _buffer_size(policy.min_buffer_size)
+    { }
+
+    virtual ~adaptive_file_data_source_impl() {
+        restart_at(_end);
+    }
+
+    virtual future<temporary_buffer<char>> get() override {
+        if (_reads.empty()) {
+            if (_pos >= _end) {
+                return make_ready_future<temporary_buffer<char>>();
+            }
+            issue_read();
+        }
+        auto r = std::move(_reads.front());
+        _reads.pop_front();
+        // The reader goes on reading where the previous buffer ended.
+        if (_consumed++) {
+            _buffer_size = std::min(_buffer_size * 2, _policy.max_buffer_size);
+            auto ahead = _buffer_size == _policy.max_buffer_size ? _policy.max_read_ahead : 1;
+            while (_reads.size() < ahead && _pos < _end) {
+                issue_read();
+            }
+        }
+        return std::move(r.buf);
+    }
+
+    virtual future<temporary_buffer<char>> skip(uint64_t n) override {
+        auto pos = (_reads.empty() ? _pos : _reads.front().pos) + n;
+        while (!_reads.empty() && _reads.front().end <= pos) {
+            discard(std::move(_reads.front()));
+            _reads.pop_front();
+        }
+        if (_reads.empty()) {
+            restart_at(pos);
+            return make_ready_future<temporary_buffer<char>>();
+        }
+        // The skip ends inside a buffer already being read.
+        auto& r = _reads.front();
+        auto trim = pos - r.pos;
+        r.buf = r.buf.then([trim] (temporary_buffer<char> buf) {
+            buf.trim_front(std::min<uint64_t>(trim, buf.size()));
+            return buf;
+        });
+        r.pos = pos;
+        return make_ready_future<temporary_buffer<char>>();
+    }
+
+    virtual future<> close() override {
+        auto reads = std::move(_reads);
+        _reads.clear();
+        return do_with(std::move(reads), [] (std::deque<pending_read>& reads) {
+            return parallel_for_each(reads, [] (pending_read& r) {
+                return r.buf.then_wrapped([] (future<temporary_buffer<char>> f) {
+                    f.ignore_ready_future();
+                });
+            });
+        });
+    }
+};
+
+input_stream<char> make_adaptive_file_input_stream(file f, uint64_t pos, uint64_t len,
+        const io_priority_class& pc, read_ahead_policy policy, uint64_t* bytes_read) {
+    return input_stream<char>(data_source(std::make_unique<adaptive_file_data_source_impl>(std::move(f), pos, len, pc, policy, bytes_read)));
+}
+
+}
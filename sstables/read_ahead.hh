@@ -0,0 +1,51 @@
+/*
+ * Copyright (C) 2017 ScyllaDB
+ */
+
+/*
+ * This file is part of Scylla.
+ *
+ * Scylla is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Scylla is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "core/file.hh"
+#include "core/iostream.hh"
+#include "seastarx.hh"
+
+namespace sstables {
+
+// The size of the reads of the disk are multiples of it, past the first one.
+static constexpr size_t read_ahead_page_size = 4096;
+
+// How a stream of a file reads ahead of its reader.
+//
+// The first read is the pages up to min_buffer_size past the position the
+// stream starts at. Each time the reader consumes a buffer and asks for the
+// next, the buffers double, up to max_buffer_size, with one buffer read
+// ahead, then max_read_ahead buffers once they are the largest. A skip
+// starts over from the smallest buffers, without reading ahead.
+struct read_ahead_policy {
+    size_t min_buffer_size;
+    size_t max_buffer_size;
+    unsigned max_read_ahead;
+};
+
+// The bytes read from the file, read ahead or not, are added to bytes_read
+// when given, which must outlive the stream.
+input_stream<char> make_adaptive_file_input_stream(file f, uint64_t pos, uint64_t len,
+        const io_priority_class& pc, read_ahead_policy policy, uint64_t* bytes_read = nullptr);
+
+}
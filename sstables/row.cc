@@ -21,6 +21,7 @@
 
 #include "sstables.hh"
 #include "consumer.hh"
+#include "db/marshal/type_parser.hh"
 
 namespace sstables {
 
@@ -358,6 +359,11 @@ class data_consume_rows_context : public data_consumer::continuous_data_consumer
                 , _consumer(consumer) {
     }
 
+    // Everything not yet consumed is still in the input stream.
+    row_consumer::proceed consume_buffered() {
+        return row_consumer::proceed::yes;
+    }
+
     void verify_end_state() {
         // If reading a partial row (i.e., when we have a clustering row
         // filter and using a promoted index), we may be in ATOM_START or ATOM_START_2
@@ -387,34 +393,571 @@ class data_consume_rows_context : public data_consumer::continuous_data_consumer
     }
 };
 
+static void ensure_unit_len(bytes_view v, size_t len) {
+    if (v.size() < len) {
+        throw malformed_sstable_exception(sprint("Expected %d bytes in row unit, but remaining is %d", len, v.size()));
+    }
+}
+
+static uint8_t consume_u8(bytes_view& v) {
+    ensure_unit_len(v, 1);
+    uint8_t ret = v[0];
+    v.remove_prefix(1);
+    return ret;
+}
+
+static uint64_t consume_unsigned_vint(bytes_view& v) {
+    ensure_unit_len(v, 1);
+    ensure_unit_len(v, unsigned_vint::serialized_size_from_first_byte(v[0]));
+    auto d = unsigned_vint::deserialize(v);
+    v.remove_prefix(d.size);
+    return d.value;
+}
+
+static int64_t consume_signed_vint(bytes_view& v) {
+    ensure_unit_len(v, 1);
+    ensure_unit_len(v, unsigned_vint::serialized_size_from_first_byte(v[0]));
+    auto d = signed_vint::deserialize(v);
+    v.remove_prefix(d.size);
+    return d.value;
+}
+
+static bytes_view consume_vint_prefixed_bytes(bytes_view& v) {
+    auto len = consume_unsigned_vint(v);
+    ensure_unit_len(v, len);
+    auto ret = bytes_view(v.data(), len);
+    v.remove_prefix(len);
+    return ret;
+}
+
+// mc_consume_rows_context reads the Data component of "mc" sstables (see
+// sstable::write_mc_clustered_row()) into the same row_consumer interface
+// as data_consume_rows_context, by translating each unit back into the
+// cells, row markers and tombstones an "la" sstable stores for it.
+//
+// Each unit is read into memory as a whole. Since the consumer may ask to
+// stop after any of the atoms of a unit, the rest of the unit is kept
+// until the consumer asks for more.
+class mc_consume_rows_context : public data_consumer::continuous_data_consumer<mc_consume_rows_context> {
+private:
+    enum class state {
+        PARTITION_START,
+        PARTITION_KEY_BYTES,
+        DELETION_TIME,
+        DELETION_TIME_2,
+        DELETION_TIME_3,
+        UNIT_START,
+        UNIT_FLAGS,
+        UNIT_SIZE,
+        UNIT_BODY,
+        UNIT_BODY_2,
+        UNIT_ATOMS,
+    } _state = state::PARTITION_START;
+
+    // The atoms of a unit, in the order an "la" sstable has them.
+    enum class atom {
+        range_tombstone,
+        row_marker,
+        row_tombstone,
+        shadowable_row_tombstone,
+        cells,
+        done,
+    };
+
+    struct column_info {
+        // Null if the column is not in the current schema.
+        const column_definition* cdef;
+        bool is_complex;
+    };
+
+    row_consumer& _consumer;
+    const schema& _schema;
+    const serialization_header& _header;
+    std::vector<column_info> _static_columns;
+    std::vector<column_info> _regular_columns;
+
+    temporary_buffer<char> _key;
+    temporary_buffer<char> _unit;
+
+    // state for the unit being consumed
+    bytes_view _unit_data;
+    unit_flags _flags;
+    atom _atom;
+    composite _clustering;
+    bytes_view _first_clustering_component;
+    api::timestamp_type _row_timestamp;
+    int32_t _row_ttl;
+    int32_t _row_local_deletion_time;
+    deletion_time _row_tombstone;
+    deletion_time _shadowable_row_tombstone;
+    bytes _start_name;
+    bytes _end_name;
+    const std::vector<column_info>* _columns;
+    std::vector<column_id> _present_columns;
+    size_t _next_column;
+    // number of cells left in the complex column being consumed, if any
+    stdx::optional<uint64_t> _complex_cells_left;
+
+    // state for the cell being consumed
+    cell_flags _cell_flags;
+    api::timestamp_type _cell_timestamp;
+    int32_t _cell_ttl;
+    int32_t _cell_local_deletion_time;
+    bytes_view _cell_path;
+    bytes_view _cell_value;
+public:
+    bool non_consuming() const {
+        return (((_state == state::DELETION_TIME_3)
+                || (_state == state::UNIT_FLAGS)
+                || (_state == state::UNIT_BODY_2)
+                || (_state == state::UNIT_ATOMS)) && (_prestate == prestate::NONE));
+    }
+
+    row_consumer::proceed process_state(temporary_buffer<char>& data) {
+        sstlog.trace("mc_consume_rows_context {}: state={}, size={}", this, static_cast<int>(_state), data.size());
+        switch (_state) {
+        case state::PARTITION_START:
+            if (read_16(data) != read_status::ready) {
+                _state = state::PARTITION_KEY_BYTES;
+                break;
+            }
+        case state::PARTITION_KEY_BYTES:
+            if (read_bytes(data, _u16, _key) != read_status::ready) {
+                _state = state::DELETION_TIME;
+                break;
+            }
+        case state::DELETION_TIME:
+            if (read_32(data) != read_status::ready) {
+                _state = state::DELETION_TIME_2;
+                break;
+            }
+            // fallthrough
+        case state::DELETION_TIME_2:
+            if (read_64(data) != read_status::ready) {
+                _state = state::DELETION_TIME_3;
+                break;
+            }
+            // fallthrough
+        case state::DELETION_TIME_3: {
+            deletion_time del;
+            del.local_deletion_time = _u32;
+            del.marked_for_delete_at = _u64;
+            auto ret = _consumer.consume_row_start(key_view(to_bytes_view(_key)), del);
+            _key.release();
+            _state = state::UNIT_START;
+            if (ret == row_consumer::proceed::no) {
+                return row_consumer::proceed::no;
+            }
+        }
+        case state::UNIT_START:
+            if (read_8(data) != read_status::ready) {
+                _state = state::UNIT_FLAGS;
+                break;
+            }
+            // fallthrough
+        case state::UNIT_FLAGS:
+            _flags = unit_flags(_u8);
+            if ((_flags & unit_flags::end_of_partition) != unit_flags::none) {
+                _state = state::PARTITION_START;
+                if (_consumer.consume_row_end() == row_consumer::proceed::no) {
+                    return row_consumer::proceed::no;
+                }
+                break;
+            }
+        case state::UNIT_SIZE:
+            if (read_unsigned_vint(data) != read_status::ready) {
+                _state = state::UNIT_BODY;
+                break;
+            }
+        case state::UNIT_BODY:
+            if (_u64 > std::numeric_limits<uint32_t>::max()) {
+                throw malformed_sstable_exception(sprint("row unit too large: %d bytes", _u64));
+            }
+            if (read_bytes(data, _u64, _unit) != read_status::ready) {
+                _state = state::UNIT_BODY_2;
+                break;
+            }
+            // fallthrough
+        case state::UNIT_BODY_2:
+            start_unit();
+            _state = state::UNIT_ATOMS;
+            // fallthrough
+        case state::UNIT_ATOMS:
+            return consume_atoms();
+        default:
+            throw malformed_sstable_exception("unknown state");
+        }
+
+        return row_consumer::proceed::yes;
+    }
+
+    mc_consume_rows_context(row_consumer& consumer, const schema& s, const serialization_header& header,
+            input_stream<char> && input, uint64_t start, uint64_t maxlen)
+                : continuous_data_consumer(std::move(input), start, maxlen)
+                , _consumer(consumer)
+                , _schema(s)
+                , _header(header)
+                , _static_columns(map_columns(header.static_columns.elements, column_kind::static_column))
+                , _regular_columns(map_columns(header.regular_columns.elements, column_kind::regular_column)) {
+    }
+
+    // Feeds the consumer the rest of the unit it stopped in the middle of.
+    // These atoms are no longer in the input stream, so they need to be
+    // consumed before reading it further.
+    row_consumer::proceed consume_buffered() {
+        temporary_buffer<char> empty;
+        return process(empty);
+    }
+
+    void verify_end_state() {
+        // As in data_consume_rows_context, when reading a partial partition
+        // we may end without seeing the end of partition.
+        if (_state == state::UNIT_START && _prestate == prestate::NONE) {
+            _consumer.consume_row_end();
+            return;
+        }
+        if (_state != state::PARTITION_START || _prestate != prestate::NONE) {
+            throw malformed_sstable_exception("end of input, but not end of row");
+        }
+    }
+
+    void reset(indexable_element el) {
+        switch (el) {
+        case indexable_element::partition:
+            _state = state::PARTITION_START;
+            break;
+        case indexable_element::cell:
+            _state = state::UNIT_START;
+            break;
+        default:
+            assert(0);
+        }
+        _unit.release();
+        _consumer.reset(el);
+    }
+private:
+    std::vector<column_info> map_columns(const utils::chunked_vector<serialization_header_column>& columns, column_kind kind) const {
+        std::vector<column_info> ret;
+        ret.reserve(columns.size());
+        for (auto&& c : columns) {
+            auto cdef = _schema.get_column_definition(c.name.value);
+            if (cdef && cdef->kind == kind) {
+                ret.push_back(column_info{cdef, cdef->is_multi_cell()});
+            } else {
+                // The column was dropped, but we still need to know how to skip it.
+                auto type = db::marshal::type_parser::parse(sstring(reinterpret_cast<const char*>(c.type_name.value.data()), c.type_name.value.size()));
+                ret.push_back(column_info{nullptr, type->is_multi_cell()});
+            }
+        }
+        return ret;
+    }
+
+    api::timestamp_type decode_timestamp(int64_t delta) const {
+        return int64_t(uint64_t(_header.timestamp_base) + uint64_t(delta));
+    }
+
+    int32_t decode_local_deletion_time(int64_t delta) const {
+        return _header.local_deletion_time_base + delta;
+    }
+
+    int32_t decode_ttl(int64_t delta) const {
+        return _header.ttl_base + delta;
+    }
+
+    deletion_time consume_deletion() {
+        deletion_time del;
+        del.marked_for_delete_at = decode_timestamp(consume_signed_vint(_unit_data));
+        del.local_deletion_time = decode_local_deletion_time(consume_signed_vint(_unit_data));
+        return del;
+    }
+
+    void consume_clustering_prefix(std::vector<bytes_view>& components) {
+        auto size = consume_unsigned_vint(_unit_data);
+        components.clear();
+        components.reserve(size);
+        while (size--) {
+            components.push_back(consume_vint_prefixed_bytes(_unit_data));
+        }
+    }
+
+    bool has(unit_flags f) const {
+        return (_flags & f) != unit_flags::none;
+    }
+
+    bool has(cell_flags f) const {
+        return (_cell_flags & f) != cell_flags::none;
+    }
+
+    // Parses everything in the unit but the cells.
+    void start_unit() {
+        _unit_data = to_bytes_view(_unit);
+        std::vector<bytes_view> components;
+        if (has(unit_flags::is_marker)) {
+            auto start_kind = bound_kind(consume_u8(_unit_data));
+            consume_clustering_prefix(components);
+            _start_name = serialize_colname(composite::serialize_value(components), {}, bound_kind_to_start_marker(start_kind));
+            auto end_kind = bound_kind(consume_u8(_unit_data));
+            consume_clustering_prefix(components);
+            _end_name = serialize_colname(composite::serialize_value(components), {}, bound_kind_to_end_marker(end_kind));
+            _row_tombstone = consume_deletion();
+            _atom = atom::range_tombstone;
+            return;
+        }
+
+        if (has(unit_flags::is_static)) {
+            _columns = &_static_columns;
+            _clustering = composite::static_prefix(_schema);
+        } else {
+            _columns = &_regular_columns;
+            consume_clustering_prefix(components);
+            _clustering = composite::serialize_value(components);
+            _first_clustering_component = components.empty() ? bytes_view() : components.front();
+        }
+        if (has(unit_flags::has_timestamp)) {
+            _row_timestamp = decode_timestamp(consume_signed_vint(_unit_data));
+        }
+        if (has(unit_flags::has_ttl)) {
+            _row_ttl = decode_ttl(consume_signed_vint(_unit_data));
+            _row_local_deletion_time = decode_local_deletion_time(consume_signed_vint(_unit_data));
+        }
+        if (has(unit_flags::has_deletion)) {
+            _row_tombstone = consume_deletion();
+        }
+        if (has(unit_flags::has_shadowable_deletion)) {
+            _shadowable_row_tombstone = consume_deletion();
+        }
+
+        auto column_count = _columns->size();
+        _present_columns.clear();
+        if (has(unit_flags::has_all_columns)) {
+            for (column_id id = 0; id < column_count; ++id) {
+                _present_columns.push_back(id);
+            }
+        } else if (column_count < 64) {
+            auto missing = consume_unsigned_vint(_unit_data);
+            for (column_id id = 0; id < column_count; ++id) {
+                if (!(missing & (uint64_t(1) << id))) {
+                    _present_columns.push_back(id);
+                }
+            }
+        } else {
+            auto present = consume_unsigned_vint(_unit_data);
+            while (present--) {
+                auto id = consume_unsigned_vint(_unit_data);
+                if (id >= column_count) {
+                    throw malformed_sstable_exception(sprint("column %d not in serialization header", id));
+                }
+                _present_columns.push_back(id);
+            }
+        }
+        _next_column = 0;
+        _complex_cells_left = stdx::nullopt;
+        _atom = atom::row_marker;
+    }
+
+    void consume_cell_body(bool is_complex) {
+        _cell_flags = cell_flags(consume_u8(_unit_data));
+        if (has(cell_flags::use_row_timestamp)) {
+            _cell_timestamp = _row_timestamp;
+        } else {
+            _cell_timestamp = decode_timestamp(consume_signed_vint(_unit_data));
+        }
+        _cell_ttl = 0;
+        _cell_local_deletion_time = 0;
+        if (has(cell_flags::use_row_ttl)) {
+            _cell_ttl = _row_ttl;
+            _cell_local_deletion_time = _row_local_deletion_time;
+        } else {
+            if (has(cell_flags::is_deleted) || has(cell_flags::is_expiring)) {
+                _cell_local_deletion_time = decode_local_deletion_time(consume_signed_vint(_unit_data));
+            }
+            if (has(cell_flags::is_expiring)) {
+                _cell_ttl = decode_ttl(consume_signed_vint(_unit_data));
+            }
+        }
+        _cell_path = is_complex ? consume_vint_prefixed_bytes(_unit_data) : bytes_view();
+        _cell_value = has(cell_flags::has_empty_value) ? bytes_view() : consume_vint_prefixed_bytes(_unit_data);
+    }
+
+    row_consumer::proceed feed_cell(bytes_view name, const column_definition& cdef) {
+        if (has(cell_flags::is_deleted)) {
+            deletion_time del;
+            del.local_deletion_time = _cell_local_deletion_time;
+            del.marked_for_delete_at = _cell_timestamp;
+            return _consumer.consume_deleted_cell(name, del);
+        } else if (cdef.is_counter()) {
+            return _consumer.consume_counter_cell(name, _cell_value, _cell_timestamp);
+        }
+        return _consumer.consume_cell(name, _cell_value, _cell_timestamp, _cell_ttl, _cell_local_deletion_time);
+    }
+
+    // The name of the cell of an atomic column in an "la" sstable; see
+    // sstable::write_clustered_row() and sstable::write_static_row().
+    bytes cell_name(const column_definition& cdef) const {
+        if (_schema.is_compound()) {
+            if (_schema.is_dense()) {
+                return to_bytes(bytes_view(_clustering));
+            }
+            return serialize_colname(_clustering, { bytes_view(cdef.name()) }, composite::eoc::none);
+        }
+        if (_schema.is_dense()) {
+            return to_bytes(_first_clustering_component);
+        }
+        return cdef.name();
+    }
+
+    // Consumes the next atom of the unit.
+    row_consumer::proceed consume_atom() {
+        switch (_atom) {
+        case atom::range_tombstone:
+            _atom = atom::done;
+            return _consumer.consume_range_tombstone(to_bytes_view(_start_name), to_bytes_view(_end_name), _row_tombstone);
+        case atom::row_marker:
+            _atom = atom::row_tombstone;
+            if (has(unit_flags::has_timestamp)) {
+                auto name = serialize_colname(_clustering, { bytes_view() }, composite::eoc::none);
+                if (has(unit_flags::has_ttl) && _row_ttl == expired_liveness_ttl) {
+                    deletion_time del;
+                    del.local_deletion_time = _row_local_deletion_time;
+                    del.marked_for_delete_at = _row_timestamp;
+                    return _consumer.consume_deleted_cell(to_bytes_view(name), del);
+                } else if (has(unit_flags::has_ttl)) {
+                    return _consumer.consume_cell(to_bytes_view(name), bytes_view(), _row_timestamp, _row_ttl, _row_local_deletion_time);
+                }
+                return _consumer.consume_cell(to_bytes_view(name), bytes_view(), _row_timestamp, 0, 0);
+            }
+            return row_consumer::proceed::yes;
+        case atom::row_tombstone:
+            _atom = atom::shadowable_row_tombstone;
+            if (has(unit_flags::has_deletion)) {
+                auto start = serialize_colname(_clustering, {}, composite::eoc::start);
+                auto end = serialize_colname(_clustering, {}, composite::eoc::end);
+                return _consumer.consume_range_tombstone(to_bytes_view(start), to_bytes_view(end), _row_tombstone);
+            }
+            return row_consumer::proceed::yes;
+        case atom::shadowable_row_tombstone:
+            _atom = atom::cells;
+            if (has(unit_flags::has_shadowable_deletion)) {
+                auto start = serialize_colname(_clustering, {}, composite::eoc::start);
+                return _consumer.consume_shadowable_row_tombstone(to_bytes_view(start), _shadowable_row_tombstone);
+            }
+            return row_consumer::proceed::yes;
+        case atom::cells:
+            return consume_next_cell();
+        case atom::done:
+            break;
+        }
+        return row_consumer::proceed::yes;
+    }
+
+    row_consumer::proceed consume_next_cell() {
+        if (_next_column == _present_columns.size()) {
+            if (!_unit_data.empty()) {
+                throw malformed_sstable_exception(sprint("%d unexpected bytes at the end of row unit", _unit_data.size()));
+            }
+            _atom = atom::done;
+            return row_consumer::proceed::yes;
+        }
+        auto& column = (*_columns)[_present_columns[_next_column]];
+        if (!column.is_complex) {
+            ++_next_column;
+            consume_cell_body(false);
+            if (!column.cdef) {
+                return row_consumer::proceed::yes;
+            }
+            auto name = cell_name(*column.cdef);
+            return feed_cell(to_bytes_view(name), *column.cdef);
+        }
+        if (!_complex_cells_left) {
+            // Start of the collection: its tombstone, if any, and cell count.
+            bool has_tombstone = consume_u8(_unit_data);
+            deletion_time del;
+            if (has_tombstone) {
+                del = consume_deletion();
+            }
+            _complex_cells_left = consume_unsigned_vint(_unit_data);
+            if (has_tombstone && column.cdef) {
+                bytes_view column_name = column.cdef->name();
+                auto start = serialize_colname(_clustering, { column_name }, composite::eoc::start);
+                auto end = serialize_colname(_clustering, { column_name }, composite::eoc::end);
+                return _consumer.consume_range_tombstone(to_bytes_view(start), to_bytes_view(end), del);
+            }
+            return row_consumer::proceed::yes;
+        }
+        if (!*_complex_cells_left) {
+            ++_next_column;
+            _complex_cells_left = stdx::nullopt;
+            return row_consumer::proceed::yes;
+        }
+        --*_complex_cells_left;
+        consume_cell_body(true);
+        if (!column.cdef) {
+            return row_consumer::proceed::yes;
+        }
+        auto name = serialize_colname(_clustering, { bytes_view(column.cdef->name()), _cell_path }, composite::eoc::none);
+        return feed_cell(to_bytes_view(name), *column.cdef);
+    }
+
+    row_consumer::proceed consume_atoms() {
+        while (_atom != atom::done) {
+            if (consume_atom() == row_consumer::proceed::no) {
+                if (_atom == atom::done) {
+                    finish_unit();
+                }
+                return row_consumer::proceed::no;
+            }
+        }
+        finish_unit();
+        return row_consumer::proceed::yes;
+    }
+
+    void finish_unit() {
+        _unit.release();
+        _state = state::UNIT_START;
+    }
+};
+
 // data_consume_rows() and data_consume_rows_at_once() both can read just a
 // single row or many rows. The difference is that data_consume_rows_at_once()
 // is optimized to reading one or few rows (reading it all into memory), while
 // data_consume_rows() uses a read buffer, so not all the rows need to fit
 // memory in the same time (they are delivered to the consumer one by one).
 class data_consume_context::impl {
+public:
+    virtual ~impl() {}
+    virtual future<> read() = 0;
+    virtual future<> fast_forward_to(uint64_t begin, uint64_t end) = 0;
+    virtual future<> skip_to(indexable_element el, uint64_t begin) = 0;
+    virtual bool eof() const = 0;
+};
+
+template <typename Context>
+class data_consume_context_impl final : public data_consume_context::impl {
 private:
     shared_sstable _sst;
-    std::unique_ptr<data_consume_rows_context> _ctx;
+    std::unique_ptr<Context> _ctx;
 public:
-    impl(shared_sstable sst, row_consumer& consumer, input_stream<char>&& input, uint64_t start, uint64_t maxlen)
+    data_consume_context_impl(shared_sstable sst, std::unique_ptr<Context> ctx)
         : _sst(std::move(sst))
-        , _ctx(new data_consume_rows_context(consumer, std::move(input), start, maxlen))
+        , _ctx(std::move(ctx))
     { }
-    ~impl() {
+    ~data_consume_context_impl() {
         if (_ctx) {
             auto f = _ctx->close();
             f.handle_exception([ctx = std::move(_ctx), sst = std::move(_sst)] (auto) { });
         }
     }
-    future<> read() {
+    virtual future<> read() override {
+        if (_ctx->consume_buffered() == row_consumer::proceed::no) {
+            return make_ready_future<>();
+        }
         return _ctx->consume_input(*_ctx);
     }
-    future<> fast_forward_to(uint64_t begin, uint64_t end) {
+    virtual future<> fast_forward_to(uint64_t begin, uint64_t end) override {
         _ctx->reset(indexable_element::partition);
         return _ctx->fast_forward_to(begin, end);
     }
-    future<> skip_to(indexable_element el, uint64_t begin) {
+    virtual future<> skip_to(indexable_element el, uint64_t begin) override {
         sstlog.trace("data_consume_rows_context {}: skip_to({} -> {}, el={})", _ctx.get(), _ctx->position(), begin, static_cast<int>(el));
         if (begin <= _ctx->position()) {
             return make_ready_future<>();
@@ -422,11 +965,21 @@ class data_consume_context::impl {
         _ctx->reset(el);
         return _ctx->skip_to(begin);
     }
-    bool eof() const {
+    virtual bool eof() const override {
         return _ctx->eof();
     }
 };
 
+std::unique_ptr<data_consume_context::impl> sstable::make_data_consume_context(row_consumer& consumer,
+        input_stream<char>&& input, uint64_t start, uint64_t maxlen) {
+    if (_version == version_types::mc) {
+        auto ctx = std::make_unique<mc_consume_rows_context>(consumer, *_schema, get_serialization_header(), std::move(input), start, maxlen);
+        return std::make_unique<data_consume_context_impl<mc_consume_rows_context>>(shared_from_this(), std::move(ctx));
+    }
+    auto ctx = std::make_unique<data_consume_rows_context>(consumer, std::move(input), start, maxlen);
+    return std::make_unique<data_consume_context_impl<data_consume_rows_context>>(shared_from_this(), std::move(ctx));
+}
+
 data_consume_context::~data_consume_context() = default;
 data_consume_context::data_consume_context(data_consume_context&& o) noexcept
     : _pimpl(std::move(o._pimpl))
@@ -456,27 +1009,45 @@ data_consume_context sstable::data_consume_rows(
     // This potentially enables read-ahead beyond end, until last_end, which
     // can be beneficial if the user wants to fast_forward_to() on the
     // returned context, and may make small skips.
-    return std::make_unique<data_consume_context::impl>(shared_from_this(),
-            consumer, data_stream(toread.start, last_end - toread.start,
-                consumer.io_priority(), consumer.resource_tracker(), _partition_range_history), toread.start, toread.end - toread.start);
+    record_read_size(toread);
+    return make_data_consume_context(consumer, data_stream(toread.start, last_end - toread.start,
+                consumer.io_priority(), consumer.resource_tracker(), data_read_ahead_policy(consumer.io_priority(), false)),
+                toread.start, toread.end - toread.start);
 }
 
 data_consume_context sstable::data_consume_single_partition(
         row_consumer& consumer, sstable::disk_read_range toread) {
-    return std::make_unique<data_consume_context::impl>(shared_from_this(),
-            consumer, data_stream(toread.start, toread.end - toread.start,
-                 consumer.io_priority(), consumer.resource_tracker(), _single_partition_history), toread.start, toread.end - toread.start);
+    record_read_size(toread);
+    return make_data_consume_context(consumer, data_stream(toread.start, toread.end - toread.start,
+                 consumer.io_priority(), consumer.resource_tracker(), data_read_ahead_policy(consumer.io_priority(), true)),
+                 toread.start, toread.end - toread.start);
 }
 
 
+// Reads the whole data file, as compaction does, so isn't a read the chunk
+// length should be tuned for.
 data_consume_context sstable::data_consume_rows(row_consumer& consumer) {
-    return data_consume_rows(consumer, {0, data_size()}, data_size());
+    return make_data_consume_context(consumer, data_stream(0, data_size(),
+                consumer.io_priority(), consumer.resource_tracker(), data_read_ahead_policy(consumer.io_priority(), false)),
+                0, data_size());
+}
+
+void sstable::record_read_size(const disk_read_range& toread) const {
+    if (toread && _schema->get_compressor_params().auto_chunk_length()) {
+        chunk_length_advisor::local().record_read(_schema->id(), toread.end - toread.start);
+    }
 }
 
 future<> sstable::data_consume_rows_at_once(row_consumer& consumer,
         uint64_t start, uint64_t end) {
-    return data_read(start, end - start, consumer.io_priority()).then([&consumer]
+    return data_read(start, end - start, consumer.io_priority()).then([this, &consumer]
                                                (temporary_buffer<char> buf) {
+        if (_version == version_types::mc) {
+            mc_consume_rows_context ctx(consumer, *_schema, get_serialization_header(), input_stream<char>(), 0, -1);
+            ctx.process(buf);
+            ctx.verify_end_state();
+            return;
+        }
         data_consume_rows_context ctx(consumer, input_stream<char>(), 0, -1);
         ctx.process(buf);
         ctx.verify_end_state();
@@ -23,8 +23,11 @@
 
 #include "types.hh"
 #include <vector>
+#include <boost/intrusive/list.hpp>
+#include <boost/intrusive/set.hpp>
 #include <seastar/core/future.hh>
 #include "utils/loading_shared_values.hh"
+#include "utils/managed_bytes.hh"
 
 namespace sstables {
 
@@ -33,6 +36,12 @@ using index_list = std::vector<index_entry>;
 // Associative cache of summary index -> index_list
 // Entries stay around as long as there is any live external reference (list_ptr) to them.
 // Supports asynchronous insertion, ensures that only one entry will be loaded.
+//
+// In addition, a serialized copy of every loaded list is kept in the row cache's
+// LSA region (see global_cache_tracker()) after the last reference is dropped, so
+// that a later load of the same page doesn't have to read it from disk. Cached
+// pages of all sstables of a shard share one LRU and are evicted alternately with
+// cached partitions.
 class shared_index_lists {
 public:
     using key_type = uint64_t;
@@ -40,6 +49,11 @@ class shared_index_lists {
         uint64_t hits = 0; // Number of times entry was found ready
         uint64_t misses = 0; // Number of times entry was not found
         uint64_t blocks = 0; // Number of times entry was not ready (>= misses)
+        uint64_t cache_hits = 0; // Number of missed entries loaded from the page cache
+        uint64_t cache_misses = 0; // Number of missed entries read from disk
+        uint64_t cache_populations = 0; // Number of pages inserted into the page cache
+        uint64_t cache_evictions = 0; // Number of pages evicted from the page cache
+        uint64_t cached_pages = 0; // Number of pages currently in the page cache
     } _shard_stats;
 
     struct stats_updater {
@@ -52,27 +66,88 @@ class shared_index_lists {
     using loading_shared_lists_type = utils::loading_shared_values<key_type, index_list, std::hash<key_type>, std::equal_to<key_type>, stats_updater>;
     // Pointer to index_list
     using list_ptr = loading_shared_lists_type::entry_ptr;
+
+    // A serialized index_list, allocated in the cache region.
+    class cached_page {
+    public:
+        using lru_link_type = bi::list_member_hook<bi::link_mode<bi::auto_unlink>>;
+        using set_link_type = bi::set_member_hook<bi::link_mode<bi::auto_unlink>>;
+    private:
+        lru_link_type _lru_link;
+        set_link_type _link;
+        key_type _key;
+        managed_bytes _data;
+        friend class shared_index_lists;
+    public:
+        cached_page(key_type key, managed_bytes data) noexcept;
+        cached_page(cached_page&&) noexcept;
+        ~cached_page();
+
+        key_type key() const { return _key; }
+
+        struct compare {
+            bool operator()(const cached_page& a, const cached_page& b) const { return a._key < b._key; }
+            bool operator()(key_type a, const cached_page& b) const { return a < b._key; }
+            bool operator()(const cached_page& a, key_type b) const { return a._key < b; }
+        };
+    };
+
+    using lru_type = bi::list<cached_page,
+        bi::member_hook<cached_page, cached_page::lru_link_type, &cached_page::_lru_link>,
+        bi::constant_time_size<false>>; // we need this to have bi::auto_unlink on hooks.
+    using cached_pages_type = bi::set<cached_page,
+        bi::member_hook<cached_page, cached_page::set_link_type, &cached_page::_link>,
+        bi::constant_time_size<false>, // we need this to have bi::auto_unlink on hooks.
+        bi::compare<cached_page::compare>>;
 private:
 
     loading_shared_lists_type _lists;
+    cached_pages_type _cached_pages;
+
+    // Returns a copy of the cached page for the given key, if there is one.
+    stdx::optional<index_list> lookup_cached(key_type key);
+    // Inserts a copy of the list into the page cache. Failure to do so is ignored.
+    void populate(key_type key, const index_list& list) noexcept;
 public:
 
     shared_index_lists() = default;
     shared_index_lists(shared_index_lists&&) = delete;
     shared_index_lists(const shared_index_lists&) = delete;
+    ~shared_index_lists();
 
     // Returns a future which resolves with a shared pointer to index_list for given key.
     // Always returns a valid pointer if succeeds. The pointer is never invalidated externally.
     //
-    // If entry is missing, the loader is invoked. If list is already loading, this invocation
-    // will wait for prior loading to complete and use its result when it's done.
+    // If entry is missing, it is taken from the page cache, or else the loader is invoked.
+    // If list is already loading, this invocation will wait for prior loading to complete
+    // and use its result when it's done.
     //
     // The loader object does not survive deferring, so the caller must deal with its liveness.
     template<typename Loader>
     future<list_ptr> get_or_load(const key_type& key, Loader&& loader) {
-        return _lists.get_or_load(key, std::forward<Loader>(loader));
+        return _lists.get_or_load(key, [this, &loader] (const key_type& key) -> future<index_list> {
+            auto cached = lookup_cached(key);
+            if (cached) {
+                ++_shard_stats.cache_hits;
+                return make_ready_future<index_list>(std::move(*cached));
+            }
+            ++_shard_stats.cache_misses;
+            return futurize_apply(loader, key).then([this, key] (index_list list) {
+                populate(key, list);
+                return list;
+            });
+        });
     }
 
+    // Drops all pages of this sstable from the page cache.
+    void evict_cached_pages() noexcept;
+
+    // Drops the pages of all sstables of the shard from the page cache.
+    static void evict_all_cached_pages() noexcept;
+
+    // Returns the keys of at most max pages of this sstable in the page cache.
+    std::vector<key_type> cached_page_keys(size_t max) const;
+
     static const stats& shard_stats() { return _shard_stats; }
 };
 
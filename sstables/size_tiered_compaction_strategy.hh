@@ -28,15 +28,20 @@ class size_tiered_compaction_strategy_options {
     static constexpr double DEFAULT_BUCKET_LOW = 0.5;
     static constexpr double DEFAULT_BUCKET_HIGH = 1.5;
     static constexpr double DEFAULT_COLD_READS_TO_OMIT = 0.05;
+    static constexpr uint64_t DEFAULT_FRAGMENT_SIZE_IN_MB = 0;
     const sstring MIN_SSTABLE_SIZE_KEY = "min_sstable_size";
     const sstring BUCKET_LOW_KEY = "bucket_low";
     const sstring BUCKET_HIGH_KEY = "bucket_high";
     const sstring COLD_READS_TO_OMIT_KEY = "cold_reads_to_omit";
+    const sstring FRAGMENT_SIZE_IN_MB_KEY = "fragment_size_in_mb";
 
     uint64_t min_sstable_size = DEFAULT_MIN_SSTABLE_SIZE;
     double bucket_low = DEFAULT_BUCKET_LOW;
     double bucket_high = DEFAULT_BUCKET_HIGH;
     double cold_reads_to_omit =  DEFAULT_COLD_READS_TO_OMIT;
+    // If not zero, compaction writes runs of sstables of this size and releases
+    // input sstables incrementally. A run is then bucketed as a single sstable.
+    uint64_t fragment_size = DEFAULT_FRAGMENT_SIZE_IN_MB * 1024 * 1024;
 public:
     size_tiered_compaction_strategy_options(const std::map<sstring, sstring>& options) {
         using namespace cql3::statements;
@@ -52,6 +57,9 @@ class size_tiered_compaction_strategy_options {
 
         tmp_value = compaction_strategy_impl::get_value(options, COLD_READS_TO_OMIT_KEY);
         cold_reads_to_omit = property_definitions::to_double(COLD_READS_TO_OMIT_KEY, tmp_value, DEFAULT_COLD_READS_TO_OMIT);
+
+        tmp_value = compaction_strategy_impl::get_value(options, FRAGMENT_SIZE_IN_MB_KEY);
+        fragment_size = property_definitions::to_long(FRAGMENT_SIZE_IN_MB_KEY, tmp_value, DEFAULT_FRAGMENT_SIZE_IN_MB) * 1024 * 1024;
     }
 
     size_tiered_compaction_strategy_options() {
@@ -59,6 +67,7 @@ class size_tiered_compaction_strategy_options {
         bucket_low = DEFAULT_BUCKET_LOW;
         bucket_high = DEFAULT_BUCKET_HIGH;
         cold_reads_to_omit = DEFAULT_COLD_READS_TO_OMIT;
+        fragment_size = DEFAULT_FRAGMENT_SIZE_IN_MB * 1024 * 1024;
     }
 
     // FIXME: convert java code below.
@@ -111,8 +120,17 @@ class size_tiered_compaction_strategy : public compaction_strategy_impl {
     // Return a list of pair of shared_sstable and its respective size.
     std::vector<std::pair<sstables::shared_sstable, uint64_t>> create_sstable_and_length_pairs(const std::vector<sstables::shared_sstable>& sstables) const;
 
+    // Return a list of pair of the first sstable of each run and the run size, with runs
+    // made of the sstables sharing the same run identifier.
+    std::vector<std::pair<sstables::shared_sstable, uint64_t>> create_run_and_length_pairs(const std::vector<sstables::shared_sstable>& sstables,
+            std::unordered_map<utils::UUID, std::vector<sstables::shared_sstable>>& runs) const;
+
     // Group files of similar size into buckets.
-    std::vector<std::vector<sstables::shared_sstable>> get_buckets(const std::vector<sstables::shared_sstable>& sstables) const;
+    std::vector<std::vector<sstables::shared_sstable>> get_buckets(std::vector<std::pair<sstables::shared_sstable, uint64_t>> sorted_sstables) const;
+
+    std::vector<std::vector<sstables::shared_sstable>> get_buckets(const std::vector<sstables::shared_sstable>& sstables) const {
+        return get_buckets(create_sstable_and_length_pairs(sstables));
+    }
 
     // Maybe return a bucket of sstables to compact
     std::vector<sstables::shared_sstable>
@@ -172,11 +190,30 @@ size_tiered_compaction_strategy::create_sstable_and_length_pairs(const std::vect
     return sstable_length_pairs;
 }
 
+std::vector<std::pair<sstables::shared_sstable, uint64_t>>
+size_tiered_compaction_strategy::create_run_and_length_pairs(const std::vector<sstables::shared_sstable>& sstables,
+        std::unordered_map<utils::UUID, std::vector<sstables::shared_sstable>>& runs) const {
+    for (auto& sstable : sstables) {
+        runs[sstable->run_identifier()].push_back(sstable);
+    }
+
+    std::vector<std::pair<sstables::shared_sstable, uint64_t>> run_length_pairs;
+    run_length_pairs.reserve(runs.size());
+
+    for (auto& run : runs) {
+        uint64_t run_size = 0;
+        for (auto& sstable : run.second) {
+            run_size += sstable->data_size();
+        }
+        run_length_pairs.emplace_back(run.second.front(), run_size);
+    }
+
+    return run_length_pairs;
+}
+
 std::vector<std::vector<sstables::shared_sstable>>
-size_tiered_compaction_strategy::get_buckets(const std::vector<sstables::shared_sstable>& sstables) const {
+size_tiered_compaction_strategy::get_buckets(std::vector<std::pair<sstables::shared_sstable, uint64_t>> sorted_sstables) const {
     // sstables sorted by size of its data file.
-    auto sorted_sstables = create_sstable_and_length_pairs(sstables);
-
     std::sort(sorted_sstables.begin(), sorted_sstables.end(), [] (auto& i, auto& j) {
         return i.second < j.second;
     });
@@ -231,19 +268,30 @@ std::vector<sstables::shared_sstable>
 size_tiered_compaction_strategy::most_interesting_bucket(std::vector<std::vector<sstables::shared_sstable>> buckets,
         unsigned min_threshold, unsigned max_threshold)
 {
-    std::vector<std::pair<std::vector<sstables::shared_sstable>, uint64_t>> pruned_buckets_and_hotness;
+    struct bucket_and_hotness {
+        std::vector<sstables::shared_sstable> bucket;
+        double hotness;
+        uint64_t avg_size;
+    };
+    std::vector<bucket_and_hotness> pruned_buckets_and_hotness;
     pruned_buckets_and_hotness.reserve(buckets.size());
 
-    // FIXME: add support to get hotness for each bucket.
-
     for (auto& bucket : buckets) {
-        // FIXME: the coldest sstables will be trimmed to meet the threshold, so we must add support to this feature
-        // by converting SizeTieredCompactionStrategy::trimToThresholdWithHotness.
-        // By the time being, we will only compact buckets that meet the threshold.
-        bucket.resize(std::min(bucket.size(), size_t(max_threshold)));
+        // The coldest sstables are left out of buckets above the threshold, as
+        // SizeTieredCompactionStrategy::trimToThresholdWithHotness does.
+        if (bucket.size() > size_t(max_threshold)) {
+            std::stable_sort(bucket.begin(), bucket.end(), [] (const sstables::shared_sstable& a, const sstables::shared_sstable& b) {
+                return a->read_hotness() > b->read_hotness();
+            });
+            bucket.resize(max_threshold);
+        }
         if (is_bucket_interesting(bucket, min_threshold)) {
+            double hotness = 0;
+            for (auto& sst : bucket) {
+                hotness += sst->read_hotness();
+            }
             auto avg = avg_size(bucket);
-            pruned_buckets_and_hotness.push_back({ std::move(bucket), avg });
+            pruned_buckets_and_hotness.push_back({ std::move(bucket), hotness, avg });
         }
     }
 
@@ -251,15 +299,16 @@ size_tiered_compaction_strategy::most_interesting_bucket(std::vector<std::vector
         return std::vector<sstables::shared_sstable>();
     }
 
-    // NOTE: Compacting smallest sstables first, located at the beginning of the sorted vector.
-    auto& min = *std::min_element(pruned_buckets_and_hotness.begin(), pruned_buckets_and_hotness.end(), [] (auto& i, auto& j) {
-        // FIXME: ignoring hotness by the time being.
-
-        return i.second < j.second;
+    // Compacting the sstables read the most first, as it saves the most
+    // reads, and among equally hot ones, the smallest sstables first.
+    auto& hottest = *std::min_element(pruned_buckets_and_hotness.begin(), pruned_buckets_and_hotness.end(), [] (auto& i, auto& j) {
+        if (i.hotness != j.hotness) {
+            return i.hotness > j.hotness;
+        }
+        return i.avg_size < j.avg_size;
     });
-    auto hottest = std::move(min.first);
 
-    return hottest;
+    return std::move(hottest.bucket);
 }
 
 compaction_descriptor size_tiered_compaction_strategy::get_sstables_for_compaction(column_family& cfs, std::vector<sstables::shared_sstable> candidates) {
@@ -270,9 +319,26 @@ compaction_descriptor size_tiered_compaction_strategy::get_sstables_for_compacti
 
     // TODO: Add support to filter cold sstables (for reference: SizeTieredCompactionStrategy::filterColdSSTables).
 
+    if (_options.fragment_size) {
+        // Buckets are made of runs, each run being represented by its first sstable.
+        std::unordered_map<utils::UUID, std::vector<sstables::shared_sstable>> runs;
+        auto run_buckets = get_buckets(create_run_and_length_pairs(candidates, runs));
+
+        if (is_any_bucket_interesting(run_buckets, min_threshold)) {
+            std::vector<sstables::shared_sstable> most_interesting;
+            for (auto& first : most_interesting_bucket(std::move(run_buckets), min_threshold, max_threshold)) {
+                auto& run = runs[first->run_identifier()];
+                most_interesting.insert(most_interesting.end(), run.begin(), run.end());
+            }
+            auto descriptor = sstables::compaction_descriptor(std::move(most_interesting), 0, _options.fragment_size);
+            descriptor.incremental = true;
+            return descriptor;
+        }
+    }
+
     auto buckets = get_buckets(candidates);
 
-    if (is_any_bucket_interesting(buckets, min_threshold)) {
+    if (!_options.fragment_size && is_any_bucket_interesting(buckets, min_threshold)) {
         std::vector<sstables::shared_sstable> most_interesting = most_interesting_bucket(std::move(buckets), min_threshold, max_threshold);
         return sstables::compaction_descriptor(std::move(most_interesting));
     }
@@ -283,8 +349,8 @@ compaction_descriptor size_tiered_compaction_strategy::get_sstables_for_compacti
     // tombstone purge, i.e. less likely to shadow even older data.
     for (auto&& sstables : buckets | boost::adaptors::reversed) {
         // filter out sstables which droppable tombstone ratio isn't greater than the defined threshold.
-        auto e = boost::range::remove_if(sstables, [this, &gc_before] (const sstables::shared_sstable& sst) -> bool {
-            return !worth_dropping_tombstones(sst, gc_before);
+        auto e = boost::range::remove_if(sstables, [this, &gc_before, &cfs] (const sstables::shared_sstable& sst) -> bool {
+            return !worth_dropping_tombstones(sst, gc_before, cfs);
         });
         sstables.erase(e, sstables.end());
         if (sstables.empty()) {
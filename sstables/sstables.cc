@@ -40,8 +40,10 @@
 #include "compress.hh"
 #include "unimplemented.hh"
 #include "index_reader.hh"
+#include "key_cache.hh"
 #include "remove.hh"
 #include "memtable.hh"
+#include "row_cache.hh"
 #include "range.hh"
 #include "downsampling.hh"
 #include <boost/filesystem/operations.hpp>
@@ -57,12 +59,16 @@
 #include "utils/phased_barrier.hh"
 #include "range_tombstone_list.hh"
 #include "counters.hh"
+#include "vint-serialization.hh"
 #include "binary_search.hh"
 #include "utils/bloom_filter.hh"
+#include "utils/UUID_gen.hh"
 
 #include "checked-file-impl.hh"
+#include "utils/cost_accountant.hh"
 #include "integrity_checked_file_impl.hh"
 #include "service/storage_service.hh"
+#include "service/priority_manager.hh"
 
 thread_local disk_error_signal_type sstable_read_error;
 thread_local disk_error_signal_type sstable_write_error;
@@ -178,7 +184,8 @@ make_sstable(schema_ptr schema, sstring dir, int64_t generation, sstable_version
 
 std::unordered_map<sstable::version_types, sstring, enum_hash<sstable::version_types>> sstable::_version_string = {
     { sstable::version_types::ka , "ka" },
-    { sstable::version_types::la , "la" }
+    { sstable::version_types::la , "la" },
+    { sstable::version_types::mc , "mc" }
 };
 
 std::unordered_map<sstable::format_types, sstring, enum_hash<sstable::format_types>> sstable::_format_string = {
@@ -621,6 +628,9 @@ void write(file_writer& out, const disk_set_of_tagged_union<TagType, Members...>
     }
 }
 
+// How much of the Summary entries is read at once.
+static constexpr size_t summary_entries_read_size = 128 * 1024;
+
 future<> parse(random_access_reader& in, summary& s) {
     using pos_type = typename decltype(summary::positions)::value_type;
 
@@ -654,24 +664,48 @@ future<> parse(random_access_reader& in, summary& s) {
 
             assert(s.positions.size() == (s.entries.size() + 1));
 
+            // The entries are read many at a time, and parsed in place from
+            // the buffer they were read into.
             auto idx = make_lw_shared<size_t>(0);
-            return do_for_each(s.entries.begin(), s.entries.end(), [idx, &in, &s] (auto& entry) {
-                auto pos = s.positions[(*idx)++];
-                auto next = s.positions[*idx];
-
-                auto entrysize = next - pos;
-
-                return in.read_exactly(entrysize).then([&entry, entrysize] (auto buf) {
-                    check_buf_size(buf, entrysize);
-
-                    auto keysize = entrysize - 8;
-                    entry.key = bytes(reinterpret_cast<const int8_t*>(buf.get()), keysize);
-                    buf.trim_front(keysize);
-                    // FIXME: This is a le read. We should make this explicit
-                    entry.position = *(reinterpret_cast<const net::packed<uint64_t> *>(buf.get()));
-                    entry.token = dht::global_partitioner().get_token(entry.get_key());
-
-                    return make_ready_future<>();
+            return repeat([idx, &in, &s] {
+                auto first = *idx;
+                if (first == s.entries.size()) {
+                    return make_ready_future<stop_iteration>(stop_iteration::yes);
+                }
+                auto last = first + 1;
+                while (last < s.entries.size() && s.positions[last + 1] >= s.positions[first]
+                        && s.positions[last + 1] - s.positions[first] <= summary_entries_read_size) {
+                    ++last;
+                }
+                if (s.positions[last] < s.positions[first]) {
+                    throw malformed_sstable_exception(sprint("Summary entry %d ends before it starts", first));
+                }
+                auto len = s.positions[last] - s.positions[first];
+                return in.read_exactly(len).then([idx, first, last, len, &s] (temporary_buffer<char> buf) {
+                    check_buf_size(buf, len);
+                    for (auto i = first; i < last; ++i) {
+                        auto pos = s.positions[i];
+                        auto next = s.positions[i + 1];
+                        if (next < pos + 8) {
+                            throw malformed_sstable_exception(sprint("Summary entry %d is too short", i));
+                        }
+                        auto p = buf.get() + (pos - s.positions[first]);
+                        auto keysize = next - pos - 8;
+                        auto& entry = s.entries[i];
+                        entry.key = bytes(reinterpret_cast<const int8_t*>(p), keysize);
+                        // FIXME: This is a le read. We should make this explicit
+                        entry.position = *(reinterpret_cast<const net::packed<uint64_t> *>(p + keysize));
+                    }
+                    // The keys read at once are hashed at once.
+                    auto keys = boost::copy_range<std::vector<key_view>>(boost::irange(first, last) | boost::adaptors::transformed([&s] (size_t i) {
+                        return s.entries[i].get_key();
+                    }));
+                    auto tokens = dht::global_partitioner().get_tokens(keys);
+                    for (auto i = first; i < last; ++i) {
+                        s.entries[i].token = std::move(tokens[i - first]);
+                    }
+                    *idx = last;
+                    return stop_iteration::no;
                 });
             }).then([&s] {
                 // Delete last element which isn't part of the on-disk format.
@@ -681,6 +715,39 @@ future<> parse(random_access_reader& in, summary& s) {
     });
 }
 
+// The Filter component, read straight into the bitset of the filter rather
+// than into a vector of its words first.
+struct filter_bits {
+    uint32_t hashes = 0;
+    stdx::optional<large_bitset> bits;
+};
+
+future<> parse(random_access_reader& in, filter_bits& f) {
+    auto nr_words = make_lw_shared<uint32_t>(0);
+    return parse(in, f.hashes, *nr_words).then([&in, &f, nr_words] {
+        f.bits.emplace(size_t(*nr_words) * 64);
+        auto done = make_lw_shared<size_t>(0);
+        // The words of a bitset are contiguous within each of its blocks,
+        // so a block is read at a time.
+        return repeat([&in, &f, nr_words, done] {
+            if (*done == *nr_words) {
+                return make_ready_future<stop_iteration>(stop_iteration::yes);
+            }
+            auto start = f.bits->int_at(*done * 64);
+            auto now = std::min<size_t>(*nr_words - *done, f.bits->contiguous_ints_at(*done * 64));
+            return in.read_exactly(now * sizeof(uint64_t)).then([start, now, done] (temporary_buffer<char> buf) {
+                check_buf_size(buf, now * sizeof(uint64_t));
+                auto words = reinterpret_cast<const net::packed<uint64_t>*>(buf.get());
+                for (size_t i = 0; i < now; ++i) {
+                    start[i] = net::ntoh(words[i]);
+                }
+                *done += now;
+                return stop_iteration::no;
+            });
+        });
+    });
+}
+
 inline void write(file_writer& out, const summary_entry& entry) {
     // FIXME: summary entry is supposedly written in memory order, but that
     // would prevent portability of summary file between machines of different
@@ -704,6 +771,68 @@ inline void write(file_writer& out, const summary& s) {
     write(out, s.first_key, s.last_key);
 }
 
+// Drops entries of the summary as Cassandra's IndexSummaryBuilder.downsample()
+// does, so that downsampling::get_effective_index_interval_after_index() holds
+// for the result.
+static summary downsample_summary(const summary& s, int sampling_level) {
+    int current = s.header.sampling_level;
+    auto start_points = downsampling::get_start_points(current, sampling_level);
+    summary ret;
+    ret.header = s.header;
+    ret.header.sampling_level = sampling_level;
+    for (int64_t i = 0; i < int64_t(s.entries.size()); ++i) {
+        auto dropped = std::any_of(start_points.begin(), start_points.end(), [&] (int start) {
+            return (i - start) % current == 0;
+        });
+        if (!dropped) {
+            ret.entries.push_back(s.entries[i]);
+        }
+    }
+    ret.header.size = ret.entries.size();
+    ret.header.memory_size = ret.header.size * sizeof(uint32_t);
+    for (auto& e : ret.entries) {
+        ret.positions.push_back(ret.header.memory_size);
+        ret.header.memory_size += e.key.size() + sizeof(e.position);
+    }
+    ret.first_key = s.first_key;
+    ret.last_key = s.last_key;
+    return ret;
+}
+
+bool sstable::can_resample_summary() const {
+    return _components.get_owner_shard() == engine().cpu_id() && _shards.size() == 1 && _components->summary;
+}
+
+future<bool> sstable::resample_summary(int sampling_level, const io_priority_class& pc) {
+    sampling_level = std::min(sampling_level, _full_sampling_level);
+    if (!can_resample_summary() || sampling_level < 1 || sampling_level == summary_sampling_level()) {
+        return make_ready_future<bool>(false);
+    }
+    auto install = [this] (summary s) {
+        if (_active_index_readers || !s) {
+            return false;
+        }
+        sstlog.debug("Resampling the summary of {} from level {} to {}", get_filename(), summary_sampling_level(), s.header.sampling_level);
+        _components->summary = std::move(s);
+        // The cached index pages are keyed by summary entry.
+        _index_lists.evict_cached_pages();
+        return true;
+    };
+    if (sampling_level < summary_sampling_level()) {
+        return make_ready_future<bool>(install(downsample_summary(_components->summary, sampling_level)));
+    }
+    if (!has_component(component_type::Summary)) {
+        return make_ready_future<bool>(false);
+    }
+    auto s = make_lw_shared<summary>();
+    return read_simple<component_type::Summary>(*s, pc).then([this, s, sampling_level, install, self = shared_from_this()] {
+        if (sampling_level < int(s->header.sampling_level)) {
+            *s = downsample_summary(*s, sampling_level);
+        }
+        return install(std::move(*s));
+    });
+}
+
 future<summary_entry&> sstable::read_summary_entry(size_t i) {
     // The last one is the boundary marker
     if (i >= (_components->summary.entries.size())) {
@@ -740,6 +869,8 @@ future<> parse(random_access_reader& in, statistics& s) {
                     return parse<compaction_metadata>(in, s.contents[val.first]);
                 case metadata_type::Stats:
                     return parse<stats_metadata>(in, s.contents[val.first]);
+                case metadata_type::Serialization:
+                    return parse<serialization_header>(in, s.contents[val.first]);
                 default:
                     sstlog.warn("Invalid metadata type at Statistics file: {} ", int(val.first));
                     return make_ready_future<>();
@@ -1089,6 +1220,30 @@ std::unique_ptr<index_reader> sstable::get_index_reader(const io_priority_class&
     return std::make_unique<index_reader>(shared_from_this(), pc);
 }
 
+std::vector<dht::decorated_key> sstable::hot_index_page_keys(size_t max) const {
+    std::vector<dht::decorated_key> keys;
+    auto& summary = get_summary();
+    for (auto idx : _index_lists.cached_page_keys(max)) {
+        auto& e = summary.entries[idx];
+        keys.push_back(dht::decorated_key{e.token, e.get_key().to_partition_key(*_schema)});
+    }
+    return keys;
+}
+
+future<> sstable::prefetch_index_page(dht::ring_position pos, const io_priority_class& pc) {
+    return do_with(get_index_reader(pc), std::move(pos), [] (std::unique_ptr<index_reader>& ir, dht::ring_position& pos) {
+        return ir->advance_to(dht::ring_position_view(pos)).then([&ir] {
+            // Partitions at the start of the index are found without its
+            // page, which their reads need anyway.
+            return ir->eof() ? make_ready_future<>() : ir->read_partition_data();
+        }).finally([&ir] {
+            return ir->close();
+        });
+    });
+}
+
+static constexpr size_t whole_component_buffer_size = 1 << 20;
+
 template <sstable::component_type Type, typename T>
 future<> sstable::read_simple(T& component, const io_priority_class& pc) {
 
@@ -1098,7 +1253,13 @@ future<> sstable::read_simple(T& component, const io_priority_class& pc) {
         auto fut = fi.size();
         return fut.then([this, &component, fi = std::move(fi)] (uint64_t size) {
             auto f = make_checked_file(_read_error_handler, fi);
-            auto r = make_lw_shared<file_random_access_reader>(std::move(f), size, sstable_buffer_size);
+            // The Summary and the Filter are read whole when the sstable is
+            // loaded, so they are read in large chunks.
+            auto buffer_size = sstable_buffer_size;
+            if (Type == component_type::Summary || Type == component_type::Filter) {
+                buffer_size = std::max(buffer_size, std::min<size_t>(align_up(size, uint64_t(4096)), whole_component_buffer_size));
+            }
+            auto r = make_lw_shared<file_random_access_reader>(std::move(f), size, buffer_size);
             auto fut = parse(*r, component);
             return fut.finally([r] {
                 return r->close();
@@ -1272,7 +1433,9 @@ future<> sstable::read_summary(const io_priority_class& pc) {
         // We'll try to keep the main code path exception free, but if an exception does happen
         // we can try to regenerate the Summary.
         if (has_component(sstable::component_type::Summary)) {
-            return read_simple<component_type::Summary>(_components->summary, pc).handle_exception([this, &pc] (auto ep) {
+            return read_simple<component_type::Summary>(_components->summary, pc).then([this] {
+                _full_sampling_level = _components->summary.header.sampling_level;
+            }).handle_exception([this, &pc] (auto ep) {
                 sstlog.warn("Couldn't read summary file {}: {}. Recreating it.", this->filename(component_type::Summary), ep);
                 return this->generate_summary(pc);
             });
@@ -1288,6 +1451,7 @@ future<> sstable::open_data() {
                     .then([this] (auto files) {
         _index_file = std::get<file>(std::get<0>(files).get());
         _data_file  = std::get<file>(std::get<1>(files).get());
+        account_data_io();
         return this->update_info_for_opened_data();
     }).then([this] {
         _shards = compute_shards_for_this_sstable();
@@ -1343,20 +1507,49 @@ future<> sstable::create_data() {
         // without its exception being examined.
         _index_file = std::get<file>(std::get<0>(files).get());
         _data_file  = std::get<file>(std::get<1>(files).get());
+        account_data_io();
     });
 }
 
+void sstable::account_data_io() {
+    auto u = utils::cost_accountant::local().find_table(_schema->id());
+    if (u) {
+        _index_file = utils::make_cost_accounting_file(std::move(_index_file), u);
+        _data_file = utils::make_cost_accounting_file(std::move(_data_file), std::move(u));
+    }
+}
+
+// Set in the hash count of Filter.db when the filter is a blocked bloom filter.
+// Versions which don't know about it see a negative hash count, which makes
+// their filter probe no bits and report every key as present.
+static constexpr uint32_t blocked_filter_flag = 1u << 31;
+
+static const sstring bloom_filter_format_key = "bloom_filter_format";
+
+// The format is chosen per table with the bloom_filter_format compaction option,
+// "classic" (the default) or "blocked".
+static utils::filter::filter_format filter_format_for(const schema& s) {
+    auto&& options = s.compaction_strategy_options();
+    auto it = options.find(bloom_filter_format_key);
+    if (it != options.end() && it->second == "blocked") {
+        return utils::filter::filter_format::blocked;
+    }
+    return utils::filter::filter_format::classic;
+}
+
 future<> sstable::read_filter(const io_priority_class& pc) {
     if (!has_component(sstable::component_type::Filter)) {
         _components->filter = std::make_unique<utils::filter::always_present_filter>();
         return make_ready_future<>();
     }
 
-    return do_with(sstables::filter(), [this, &pc] (auto& filter) {
+    return do_with(filter_bits(), [this, &pc] (auto& filter) {
         return this->read_simple<sstable::component_type::Filter>(filter, pc).then([this, &filter] {
-            large_bitset bs(filter.buckets.elements.size() * 64);
-            bs.load(filter.buckets.elements.begin(), filter.buckets.elements.end());
-            _components->filter = utils::filter::create_filter(filter.hashes, std::move(bs));
+            auto format = utils::filter::filter_format::classic;
+            if (filter.hashes & blocked_filter_flag) {
+                format = utils::filter::filter_format::blocked;
+            }
+            _components->filter = utils::filter::create_filter(filter.hashes & ~blocked_filter_flag, std::move(*filter.bits), format);
         });
     });
 }
@@ -1366,12 +1559,16 @@ void sstable::write_filter(const io_priority_class& pc) {
         return;
     }
 
-    auto f = static_cast<utils::filter::murmur3_bloom_filter *>(_components->filter.get());
+    auto f = static_cast<utils::filter::bloom_filter *>(_components->filter.get());
 
     auto&& bs = f->bits();
     utils::chunked_vector<uint64_t> v(align_up(bs.size(), size_t(64)) / 64);
     bs.save(v.begin());
-    auto filter = sstables::filter(f->num_hashes(), std::move(v));
+    uint32_t hashes = f->num_hashes();
+    if (f->format() == utils::filter::filter_format::blocked) {
+        hashes |= blocked_filter_flag;
+    }
+    auto filter = sstables::filter(hashes, std::move(v));
     write_simple<sstable::component_type::Filter>(filter, pc);
 }
 
@@ -1397,6 +1594,7 @@ future<> sstable::load(sstables::foreign_sstable_open_info info) {
         _components = std::move(info.components);
         _data_file = make_checked_file(_read_error_handler, info.data.to_file());
         _index_file = make_checked_file(_read_error_handler, info.index.to_file());
+        account_data_io();
         _shards = std::move(info.owners);
         validate_min_max_metadata();
         return update_info_for_opened_data();
@@ -1420,13 +1618,13 @@ future<foreign_sstable_open_info> sstable::get_open_info() & {
     });
 }
 
-static composite::eoc bound_kind_to_start_marker(bound_kind start_kind) {
+composite::eoc bound_kind_to_start_marker(bound_kind start_kind) {
     return start_kind == bound_kind::excl_start
          ? composite::eoc::end
          : composite::eoc::start;
 }
 
-static composite::eoc bound_kind_to_end_marker(bound_kind end_kind) {
+composite::eoc bound_kind_to_end_marker(bound_kind end_kind) {
     return end_kind == bound_kind::excl_end
          ? composite::eoc::start
          : composite::eoc::end;
@@ -1451,7 +1649,7 @@ static void output_promoted_index_entry(bytes_ostream& promoted_index,
 }
 
 // FIXME: use this in write_column_name() instead of repeating the code
-static bytes serialize_colname(const composite& clustering_key,
+bytes serialize_colname(const composite& clustering_key,
         const std::vector<bytes_view>& column_names, composite::eoc marker) {
     auto c = composite::from_exploded(column_names, marker);
     auto ck_bview = bytes_view(clustering_key);
@@ -1519,6 +1717,10 @@ void sstable::maybe_flush_pi_block(file_writer& out,
             auto& rts = _pi_write.tombstone_accumulator->range_tombstones_for_row(
                     clustering_key_prefix::from_range(clustering_key.values()));
             for (const auto& rt : rts) {
+                if (_version == version_types::mc) {
+                    write_mc_range_tombstone(out, *_pi_write.schemap, rt);
+                    continue;
+                }
                 auto start = composite::from_clustering_element(*_pi_write.schemap, rt.start);
                 auto end = composite::from_clustering_element(*_pi_write.schemap, rt.end);
                 write_range_tombstone(out,
@@ -1831,6 +2033,355 @@ void sstable::write_static_row(file_writer& out, const schema& schema, const row
     });
 }
 
+// Rows of "mc" sstables.
+//
+// The partition header is the same as in earlier versions. Each static row,
+// clustering row and range tombstone which follows is written as a unit:
+//
+//   flags (1 byte), body size (unsigned vint), body
+//
+// and the partition ends with a unit that only has the end_of_partition
+// flag. The body of a row starts with its clustering key (absent for the
+// static row), followed by its liveness info and tombstones, and the cells of
+// the columns present in the row, in the order of the serialization header.
+// Columns are identified by their position in the header, so unless the row
+// has all of them, the cells are preceded by a bitmap of the missing ones.
+// Timestamps, local deletion times and TTLs are stored as signed vint deltas
+// from the bases in the header.
+
+static void write_unsigned_vint(bytes_ostream& out, uint64_t value) {
+    unsigned_vint::serialize(value, out.write_place_holder(unsigned_vint::serialized_size(value)));
+}
+
+static void write_signed_vint(bytes_ostream& out, int64_t value) {
+    signed_vint::serialize(value, out.write_place_holder(signed_vint::serialized_size(value)));
+}
+
+template <typename T>
+static void append_be(bytes_ostream& out, T value) {
+    write_be<T>(reinterpret_cast<char*>(out.write_place_holder(sizeof(T))), value);
+}
+
+static void write_vint_prefixed_bytes(bytes_ostream& out, bytes_view value) {
+    write_unsigned_vint(out, value.size());
+    out.write(value);
+}
+
+static void write_clustering_prefix(bytes_ostream& out, const schema& s, const clustering_key_prefix& prefix) {
+    write_unsigned_vint(out, prefix.size(s));
+    for (auto&& c : prefix.components(s)) {
+        write_vint_prefixed_bytes(out, c);
+    }
+}
+
+static void write_mc_unit(file_writer& out, unit_flags flags, const bytes_ostream& body) {
+    std::array<bytes::value_type, 9> size;
+    auto size_len = unsigned_vint::serialize(body.size(), size.begin());
+    write(out, static_cast<uint8_t>(flags), bytes_view(size.data(), size_len));
+    for (bytes_view fragment : body) {
+        write(out, fragment);
+    }
+}
+
+int64_t sstable::mc_timestamp_delta(api::timestamp_type timestamp) {
+    if (!_mc_write.timestamp_base) {
+        _mc_write.timestamp_base = timestamp;
+    }
+    // Tombstones may carry api::min_timestamp, so let the delta wrap around.
+    return int64_t(uint64_t(timestamp) - uint64_t(*_mc_write.timestamp_base));
+}
+
+int64_t sstable::mc_local_deletion_time_delta(int32_t local_deletion_time) {
+    if (!_mc_write.local_deletion_time_base) {
+        _mc_write.local_deletion_time_base = local_deletion_time;
+    }
+    return int64_t(local_deletion_time) - *_mc_write.local_deletion_time_base;
+}
+
+int64_t sstable::mc_ttl_delta(int32_t ttl) {
+    if (!_mc_write.ttl_base) {
+        _mc_write.ttl_base = ttl;
+    }
+    return int64_t(ttl) - *_mc_write.ttl_base;
+}
+
+void sstable::write_mc_deletion(bytes_ostream& out, tombstone t) {
+    int32_t deletion_time = t.deletion_time.time_since_epoch().count();
+
+    update_cell_stats(_c_stats, t.timestamp);
+    _c_stats.update_max_local_deletion_time(deletion_time);
+    _c_stats.tombstone_histogram.update(deletion_time);
+
+    write_signed_vint(out, mc_timestamp_delta(t.timestamp));
+    write_signed_vint(out, mc_local_deletion_time_delta(deletion_time));
+}
+
+unit_flags sstable::write_mc_liveness(bytes_ostream& out, const row_marker& marker) {
+    uint64_t timestamp = marker.timestamp();
+
+    update_cell_stats(_c_stats, timestamp);
+
+    write_signed_vint(out, mc_timestamp_delta(timestamp));
+    if (marker.is_dead(_now)) {
+        int32_t deletion_time = marker.deletion_time().time_since_epoch().count();
+
+        _c_stats.tombstone_histogram.update(deletion_time);
+
+        write_signed_vint(out, mc_ttl_delta(expired_liveness_ttl));
+        write_signed_vint(out, mc_local_deletion_time_delta(deletion_time));
+        return unit_flags::has_timestamp | unit_flags::has_ttl;
+    } else if (marker.is_expiring()) {
+        write_signed_vint(out, mc_ttl_delta(marker.ttl().count()));
+        write_signed_vint(out, mc_local_deletion_time_delta(marker.expiry().time_since_epoch().count()));
+        return unit_flags::has_timestamp | unit_flags::has_ttl;
+    }
+    return unit_flags::has_timestamp;
+}
+
+// Writes a cell of an "mc" row. If the row has liveness info, cells which
+// share its timestamp or its TTL and expiry don't repeat them.
+void sstable::write_mc_cell(bytes_ostream& out, atomic_cell_view cell, const column_definition& cdef,
+        const row_marker* liveness, stdx::optional<bytes_view> path) {
+    uint64_t timestamp = cell.timestamp();
+
+    update_cell_stats(_c_stats, timestamp);
+
+    auto flags = cell_flags::none;
+    if (liveness && liveness->timestamp() == api::timestamp_type(timestamp)) {
+        flags = flags | cell_flags::use_row_timestamp;
+    }
+
+    bytes_ostream counter_value;
+    bytes_view value;
+    int32_t ttl = 0;
+    int32_t local_deletion_time = 0;
+    if (cell.is_dead(_now)) {
+        // tombstone cell
+        local_deletion_time = cell.deletion_time().time_since_epoch().count();
+
+        _c_stats.update_max_local_deletion_time(local_deletion_time);
+        _c_stats.tombstone_histogram.update(local_deletion_time);
+
+        flags = flags | cell_flags::is_deleted;
+    } else if (cdef.is_counter()) {
+        // counter cell, serialized the same way as in "ka" sstables
+        assert(!cell.is_counter_update());
+
+        counter_cell_view ccv(cell);
+        auto shard_count = ccv.shard_count();
+
+        append_be<int16_t>(counter_value, shard_count);
+        for (auto i = 0u; i < shard_count; i++) {
+            append_be<int16_t>(counter_value, std::numeric_limits<int16_t>::min() + i);
+        }
+        auto write_shard = [&] (auto&& s) {
+            auto uuid = s.id().to_uuid();
+            append_be<int64_t>(counter_value, uuid.get_most_significant_bits());
+            append_be<int64_t>(counter_value, uuid.get_least_significant_bits());
+            append_be<int64_t>(counter_value, s.logical_clock());
+            append_be<int64_t>(counter_value, s.value());
+        };
+        if (service::get_local_storage_service().cluster_supports_correct_counter_order()) {
+            for (auto&& s : ccv.shards()) {
+                write_shard(s);
+            }
+        } else {
+            for (auto&& s : ccv.shards_compatible_with_1_7_4()) {
+                write_shard(s);
+            }
+        }
+        value = counter_value.linearize();
+
+        _c_stats.update_max_local_deletion_time(std::numeric_limits<int>::max());
+    } else if (cell.is_live_and_has_ttl()) {
+        // expiring cell
+        ttl = cell.ttl().count();
+        local_deletion_time = cell.expiry().time_since_epoch().count();
+        value = cell.value();
+
+        _c_stats.update_max_local_deletion_time(local_deletion_time);
+        // see write_cell()
+        _c_stats.tombstone_histogram.update(local_deletion_time);
+
+        flags = flags | cell_flags::is_expiring;
+        if (liveness && !liveness->is_dead(_now) && liveness->is_expiring()
+                && liveness->ttl().count() == ttl
+                && liveness->expiry().time_since_epoch().count() == local_deletion_time) {
+            flags = flags | cell_flags::use_row_ttl;
+        }
+    } else {
+        // regular cell
+        value = cell.value();
+
+        _c_stats.update_max_local_deletion_time(std::numeric_limits<int>::max());
+    }
+    if (value.empty()) {
+        flags = flags | cell_flags::has_empty_value;
+    }
+
+    append_be<uint8_t>(out, static_cast<uint8_t>(flags));
+    if ((flags & cell_flags::use_row_timestamp) == cell_flags::none) {
+        write_signed_vint(out, mc_timestamp_delta(timestamp));
+    }
+    if ((flags & cell_flags::use_row_ttl) == cell_flags::none) {
+        if ((flags & (cell_flags::is_deleted | cell_flags::is_expiring)) != cell_flags::none) {
+            write_signed_vint(out, mc_local_deletion_time_delta(local_deletion_time));
+        }
+        if ((flags & cell_flags::is_expiring) != cell_flags::none) {
+            write_signed_vint(out, mc_ttl_delta(ttl));
+        }
+    }
+    if (path) {
+        write_vint_prefixed_bytes(out, *path);
+    }
+    if ((flags & cell_flags::has_empty_value) == cell_flags::none) {
+        write_vint_prefixed_bytes(out, value);
+    }
+}
+
+// A collection is written as a byte telling whether it has a tombstone, the
+// tombstone, the number of cells and the cells, each with its path.
+void sstable::write_mc_collection(bytes_ostream& out, const column_definition& cdef, collection_mutation_view collection,
+        const row_marker* liveness) {
+    auto t = static_pointer_cast<const collection_type_impl>(cdef.type);
+    auto mview = t->deserialize_mutation_form(collection);
+    append_be<uint8_t>(out, bool(mview.tomb));
+    if (mview.tomb) {
+        write_mc_deletion(out, mview.tomb);
+    }
+    write_unsigned_vint(out, mview.cells.size());
+    for (auto& cp : mview.cells) {
+        write_mc_cell(out, cp.second, cdef, liveness, cp.first);
+    }
+}
+
+unit_flags sstable::write_mc_cells(bytes_ostream& out, const schema& schema, column_kind kind, const row& cells,
+        const row_marker* liveness) {
+    auto flags = unit_flags::none;
+    auto column_count = kind == column_kind::static_column ? schema.static_columns_count() : schema.regular_columns_count();
+    if (cells.size() == column_count) {
+        flags = unit_flags::has_all_columns;
+    } else if (column_count < 64) {
+        uint64_t missing = (uint64_t(1) << column_count) - 1;
+        cells.for_each_cell([&] (column_id id, const atomic_cell_or_collection&) {
+            missing &= ~(uint64_t(1) << id);
+        });
+        write_unsigned_vint(out, missing);
+    } else {
+        write_unsigned_vint(out, cells.size());
+        cells.for_each_cell([&] (column_id id, const atomic_cell_or_collection&) {
+            write_unsigned_vint(out, id);
+        });
+    }
+
+    cells.for_each_cell([&] (column_id id, const atomic_cell_or_collection& c) {
+        auto&& column_definition = schema.column_at(kind, id);
+        if (!column_definition.is_atomic()) {
+            write_mc_collection(out, column_definition, c.as_collection_mutation(), liveness);
+            return;
+        }
+        write_mc_cell(out, c.as_atomic_cell(), column_definition, liveness, stdx::nullopt);
+    });
+    return flags;
+}
+
+void sstable::write_mc_clustered_row(file_writer& out, const schema& schema, const clustering_row& clustered_row) {
+    auto clustering_key = composite::from_clustering_element(schema, clustered_row.key());
+
+    // Promoted index blocks start only at unit boundaries. Name the unit
+    // after the first atom an "la" sstable would have written for the row.
+    if (schema.is_compound()) {
+        if (schema.is_dense()) {
+            maybe_flush_pi_block(out, composite(), { bytes_view(clustering_key) });
+        } else {
+            maybe_flush_pi_block(out, clustering_key, { bytes_view() });
+        }
+    } else {
+        if (schema.is_dense()) {
+            maybe_flush_pi_block(out, composite(), { bytes_view(clustered_row.key().get_component(schema, 0)) });
+        } else {
+            maybe_flush_pi_block(out, clustering_key, {});
+        }
+    }
+
+    bytes_ostream body;
+    auto flags = unit_flags::none;
+    write_clustering_prefix(body, schema, clustered_row.key());
+
+    // Like "la" sstables, we keep row markers only for tables with CQL rows.
+    const row_marker* liveness = nullptr;
+    if (schema.is_compound() && !schema.is_dense() && !clustered_row.marker().is_missing()) {
+        liveness = &clustered_row.marker();
+        flags = flags | write_mc_liveness(body, *liveness);
+    }
+    // Promoted index blocks don't start in the middle of a row, so unlike
+    // write_clustered_row() we don't need to track the row's tombstone in
+    // the tombstone accumulator.
+    if (clustered_row.tomb()) {
+        flags = flags | unit_flags::has_deletion;
+        write_mc_deletion(body, clustered_row.tomb().regular());
+        if (clustered_row.tomb().is_shadowable()) {
+            flags = flags | unit_flags::has_shadowable_deletion;
+            write_mc_deletion(body, clustered_row.tomb().shadowable().tomb());
+        }
+    }
+
+    if (schema.clustering_key_size()) {
+        column_name_helper::min_max_components(schema, _collector.min_column_names(), _collector.max_column_names(),
+            clustered_row.key().components());
+    }
+
+    flags = flags | write_mc_cells(body, schema, column_kind::regular_column, clustered_row.cells(), liveness);
+    write_mc_unit(out, flags, body);
+}
+
+void sstable::write_mc_static_row(file_writer& out, const schema& schema, const row& static_row) {
+    if (static_row.empty()) {
+        return;
+    }
+    if (schema.is_compound()) {
+        maybe_flush_pi_block(out, composite::static_prefix(schema), {});
+    } else {
+        maybe_flush_pi_block(out, composite(), {});
+    }
+
+    bytes_ostream body;
+    auto flags = unit_flags::is_static;
+    flags = flags | write_mc_cells(body, schema, column_kind::static_column, static_row, nullptr);
+    write_mc_unit(out, flags, body);
+}
+
+void sstable::write_mc_range_tombstone(file_writer& out, const schema& schema, const range_tombstone& rt) {
+    if (!rt.tomb) {
+        return;
+    }
+
+    bytes_ostream body;
+    append_be<uint8_t>(body, static_cast<uint8_t>(rt.start_kind));
+    write_clustering_prefix(body, schema, rt.start);
+    append_be<uint8_t>(body, static_cast<uint8_t>(rt.end_kind));
+    write_clustering_prefix(body, schema, rt.end);
+    write_mc_deletion(body, rt.tomb);
+    write_mc_unit(out, unit_flags::is_marker | unit_flags::has_deletion, body);
+}
+
+serialization_header sstable::make_serialization_header(const schema& s) const {
+    serialization_header h;
+    h.timestamp_base = _mc_write.timestamp_base.value_or(0);
+    h.local_deletion_time_base = _mc_write.local_deletion_time_base.value_or(0);
+    h.ttl_base = _mc_write.ttl_base.value_or(0);
+    auto make_column = [] (const column_definition& cdef) {
+        return serialization_header_column{{cdef.name()}, {to_bytes(cdef.type->name())}};
+    };
+    for (auto&& cdef : s.static_columns()) {
+        h.static_columns.elements.push_back(make_column(cdef));
+    }
+    for (auto&& cdef : s.regular_columns()) {
+        h.regular_columns.elements.push_back(make_column(cdef));
+    }
+    return h;
+}
+
 static void write_index_header(file_writer& out, disk_string_view<uint16_t>& key, uint64_t pos) {
     write(out, key, pos);
 }
@@ -1886,8 +2437,12 @@ static void seal_summary(summary& s,
 
 static void prepare_compression(compression& c, const schema& schema) {
     const auto& cp = schema.get_compressor_params();
-    c.set_compressor(cp.get_compressor());
-    c.set_uncompressed_chunk_length(cp.chunk_length());
+    c.set_compressor(cp);
+    auto chunk_length = cp.chunk_length();
+    if (cp.auto_chunk_length()) {
+        chunk_length = chunk_length_advisor::local().chunk_length(schema.id(), chunk_length);
+    }
+    c.set_uncompressed_chunk_length(chunk_length);
     // FIXME: crc_check_chance can be configured by the user.
     // probability to verify the checksum of a compressed chunk we read.
     // defaults to 1.0.
@@ -2022,9 +2577,15 @@ components_writer::components_writer(sstable& sst, const schema& s, file_writer&
     , _index_needs_close(true)
     , _max_sstable_size(cfg.max_sstable_size)
     , _tombstone_written(false)
+    , _large_partition_threshold(uint64_t(get_config().compaction_large_partition_warning_threshold_mb()) << 20)
+    , _rows_count_threshold(get_config().compaction_rows_count_warning_threshold())
+    , _large_row_threshold(uint64_t(get_config().compaction_large_row_warning_threshold_mb()) << 20)
+    , _large_data_limit(get_config().large_data_records_per_table())
     , _summary_byte_cost(summary_byte_cost())
+    , _estimated_partitions(estimated_partitions)
+    , _preheat_key_cache(cfg.preheat_key_cache && get_config().compaction_preheat_key_cache())
 {
-    _sst._components->filter = utils::i_filter::get_filter(estimated_partitions, _schema.bloom_filter_fp_chance());
+    _sst._components->filter = utils::i_filter::get_filter(estimated_partitions, _schema.bloom_filter_fp_chance(), filter_format_for(_schema));
     _sst._pi_write.desired_block_size = cfg.promoted_index_block_size.value_or(get_config().column_index_size_in_kb() * 1024);
 
     prepare_summary(_sst._components->summary, estimated_partitions, _schema.min_index_interval());
@@ -2037,9 +2598,21 @@ void components_writer::consume_new_partition(const dht::decorated_key& dk) {
     _sst._c_stats.start_offset = _out.offset();
 
     _partition_key = key::from_partition_key(_schema, dk.key());
+    if (_preheat_key_cache) {
+        _preheat_key = to_bytes(bytes_view(dk.key().representation()));
+    }
 
     maybe_add_summary_entry(dk.token(), bytes_view(*_partition_key));
-    _sst._components->filter->add(bytes_view(*_partition_key));
+    auto hk = utils::make_hashed_key(bytes_view(*_partition_key));
+    _sst._components->filter->add(hk);
+    if (!_filter_keys_dropped) {
+        if (_filter_keys.size() < max_filter_keys) {
+            _filter_keys.push_back(hk);
+        } else {
+            _filter_keys_dropped = true;
+            _filter_keys = { };
+        }
+    }
     _sst._collector.add_key(bytes_view(*_partition_key));
 
     auto p_key = disk_string_view<uint16_t>();
@@ -2062,6 +2635,25 @@ void components_writer::consume_new_partition(const dht::decorated_key& dk) {
     write(_out, p_key);
 
     _tombstone_written = false;
+    _partition_rows = 0;
+}
+
+void components_writer::maybe_record_large_data(const clustering_key_prefix* ck, uint64_t size, uint64_t rows) {
+    auto threshold = ck ? _large_row_threshold : _large_partition_threshold;
+    if ((!threshold || size < threshold) && (ck || !_rows_count_threshold || rows < _rows_count_threshold)) {
+        return;
+    }
+    auto pk = _partition_key->to_partition_key(_schema);
+    if (ck) {
+        sstlog.warn("Writing large row {}/{}:{} ({} bytes) to {}", _schema.ks_name(), _schema.cf_name(),
+                pk, *ck, size, _sst.get_filename());
+    } else {
+        sstlog.warn("Writing large partition {}/{}:{} ({} bytes, {} rows) to {}", _schema.ks_name(), _schema.cf_name(),
+                pk, size, rows, _sst.get_filename());
+    }
+    if (_sst._large_data.size() < _large_data_limit) {
+        _sst._large_data.push_back(large_data_record{std::move(pk), ck ? stdx::make_optional(*ck) : stdx::nullopt, size, rows});
+    }
 }
 
 void components_writer::consume(tombstone t) {
@@ -2088,13 +2680,24 @@ void components_writer::consume(tombstone t) {
 
 stop_iteration components_writer::consume(static_row&& sr) {
     ensure_tombstone_is_written();
-    _sst.write_static_row(_out, _schema, sr.cells());
+    if (_sst._version == sstable::version_types::mc) {
+        _sst.write_mc_static_row(_out, _schema, sr.cells());
+    } else {
+        _sst.write_static_row(_out, _schema, sr.cells());
+    }
     return stop_iteration::no;
 }
 
 stop_iteration components_writer::consume(clustering_row&& cr) {
     ensure_tombstone_is_written();
-    _sst.write_clustered_row(_out, _schema, cr);
+    auto start = _out.offset();
+    if (_sst._version == sstable::version_types::mc) {
+        _sst.write_mc_clustered_row(_out, _schema, cr);
+    } else {
+        _sst.write_clustered_row(_out, _schema, cr);
+    }
+    _partition_rows++;
+    maybe_record_large_data(&cr.key(), _out.offset() - start, 1);
     return stop_iteration::no;
 }
 
@@ -2105,6 +2708,12 @@ stop_iteration components_writer::consume(range_tombstone&& rt) {
     // to be repeated in the data file. Note that apply() also drops ranges
     // already closed by rt.start, so the accumulator doesn't grow boundless.
     _sst._pi_write.tombstone_accumulator->apply(rt);
+    if (_sst._version == sstable::version_types::mc) {
+        auto start = composite::from_clustering_element(_schema, rt.start);
+        _sst.maybe_flush_pi_block(_out, start, {}, bound_kind_to_start_marker(rt.start_kind));
+        _sst.write_mc_range_tombstone(_out, _schema, rt);
+        return stop_iteration::no;
+    }
     auto start = composite::from_clustering_element(_schema, std::move(rt.start));
     auto start_marker = bound_kind_to_start_marker(rt.start_kind);
     auto end = composite::from_clustering_element(_schema, std::move(rt.end));
@@ -2126,17 +2735,28 @@ stop_iteration components_writer::consume_end_of_partition() {
             _out.offset() - _sst._pi_write.block_start_offset);
         _sst._pi_write.numblocks++;
     }
+    // Partitions with a promoted index aren't cached.
+    bool preheat = _preheat_key_cache && _sst._pi_write.data.empty();
     write_index_promoted(_index, _sst._pi_write.data, _sst._pi_write.deltime,
             _sst._pi_write.numblocks);
     _sst._pi_write.data = {};
     _sst._pi_write.block_first_colname = {};
 
     ensure_tombstone_is_written();
-    int16_t end_of_row = 0;
-    write(_out, end_of_row);
+    if (_sst._version == sstable::version_types::mc) {
+        write(_out, static_cast<uint8_t>(unit_flags::end_of_partition));
+    } else {
+        int16_t end_of_row = 0;
+        write(_out, end_of_row);
+    }
 
     // compute size of the current row.
     _sst._c_stats.row_size = _out.offset() - _sst._c_stats.start_offset;
+    maybe_record_large_data(nullptr, _sst._c_stats.row_size, _partition_rows);
+    if (preheat) {
+        key_cache::local().preheat(_schema.id(), _preheat_key,
+            key_cache::position{_sst._generation, _sst._c_stats.start_offset, _out.offset()});
+    }
     // update is about merging column_stats with the data being stored by collector.
     _sst._collector.update(_schema, std::move(_sst._c_stats));
     _sst._c_stats.reset();
@@ -2149,7 +2769,25 @@ stop_iteration components_writer::consume_end_of_partition() {
     return get_offset() < _max_sstable_size ? stop_iteration::no : stop_iteration::yes;
 }
 
+// The estimate the filter was sized for may be well above the number of
+// partitions written, when the partitions of the sstables a compaction
+// merges overlap more than their cardinality estimators tell, for example.
+void components_writer::maybe_rebuild_filter() {
+    if (_filter_keys_dropped || _filter_keys.empty() || _filter_keys.size() * 2 > _estimated_partitions) {
+        return;
+    }
+    sstlog.debug("Rebuilding the filter of {} for {} partitions, instead of the {} estimated",
+            _sst.get_filename(), _filter_keys.size(), _estimated_partitions);
+    auto filter = utils::i_filter::get_filter(_filter_keys.size(), _schema.bloom_filter_fp_chance(), filter_format_for(_schema));
+    for (auto&& hk : _filter_keys) {
+        filter->add(hk);
+    }
+    _sst._components->filter = std::move(filter);
+}
+
 void components_writer::consume_end_of_stream() {
+    maybe_rebuild_filter();
+    _filter_keys = { };
     seal_summary(_sst._components->summary, std::move(_first_key), std::move(_last_key)); // what if there is only one partition? what if it is empty?
 
     _index_needs_close = false;
@@ -2160,6 +2798,10 @@ void components_writer::consume_end_of_stream() {
     }
 
     _sst.set_first_and_last_keys();
+    if (_sst._version == sstable::version_types::mc) {
+        _sst._components->statistics.contents[metadata_type::Serialization] =
+                std::make_unique<serialization_header>(_sst.make_serialization_header(_schema));
+    }
     seal_statistics(_sst._components->statistics, _sst._collector, dht::global_partitioner().name(), _schema.bloom_filter_fp_chance(),
             _sst._schema, _sst.get_first_decorated_key(), _sst.get_last_decorated_key());
 }
@@ -2195,6 +2837,9 @@ sstable::write_scylla_metadata(const io_priority_class& pc, shard_id shard) {
     auto sm = create_sharding_metadata(_schema, first_key, last_key, shard);
     _components->scylla_metadata.emplace();
     _components->scylla_metadata->data.set<scylla_metadata_type::Sharding>(std::move(sm));
+    auto run_id = _run_identifier ? *_run_identifier : utils::UUID_gen::get_time_UUID();
+    _components->scylla_metadata->data.set<scylla_metadata_type::RunIdentifier>(sstables::run_identifier{
+            uint64_t(run_id.get_most_significant_bits()), uint64_t(run_id.get_least_significant_bits())});
 
     write_simple<component_type::Scylla>(*_components->scylla_metadata, pc);
 }
@@ -2204,13 +2849,14 @@ void sstable_writer::prepare_file_writer()
     file_output_stream_options options;
     options.io_priority_class = _pc;
     options.buffer_size = _sst.sstable_buffer_size;
-    options.write_behind = 10;
+    options.write_behind = _write_behind;
 
     if (!_compression_enabled) {
-        _writer = std::make_unique<checksummed_file_writer>(std::move(_sst._data_file), std::move(options), true);
+        _writer = std::make_unique<checksummed_file_writer>(std::move(_sst._data_file), std::move(options), true, _monitor.get());
     } else {
         prepare_compression(_sst._components->compression, _schema);
-        _writer = std::make_unique<file_writer>(make_compressed_file_output_stream(std::move(_sst._data_file), std::move(options), &_sst._components->compression));
+        _writer = std::make_unique<file_writer>(make_compressed_file_output_stream(std::move(_sst._data_file), std::move(options),
+                &_sst._components->compression, _monitor.get()));
     }
 }
 
@@ -2247,6 +2893,7 @@ sstable_writer::sstable_writer(sstable& sst, const schema& s, uint64_t estimated
     , _leave_unsealed(cfg.leave_unsealed)
     , _shard(shard)
     , _monitor(cfg.monitor)
+    , _write_behind(cfg.write_behind)
 {
     _sst.generate_toc(_schema.get_compressor_params().get_compressor(), _schema.bloom_filter_fp_chance());
     _sst.write_toc(_pc);
@@ -2420,6 +3067,9 @@ const sstring sstable::filename(sstring dir, sstring ks, sstring cf, version_typ
         },
         { sstable::version_types::la, [] (entry_descriptor d) {
             return _version_string.at(d.version) + "-" + to_sstring(d.generation) + "-" + _format_string.at(d.format) + "-" + _component_map.at(d.component); }
+        },
+        { sstable::version_types::mc, [] (entry_descriptor d) {
+            return _version_string.at(d.version) + "-" + to_sstring(d.generation) + "-" + _format_string.at(d.format) + "-" + _component_map.at(d.component); }
         }
     };
 
@@ -2430,7 +3080,8 @@ const sstring sstable::filename(sstring dir, sstring ks, sstring cf, version_typ
                                 format_types format, sstring component) {
     static std::unordered_map<version_types, const char*, enum_hash<version_types>> fmtmap = {
         { sstable::version_types::ka, "{0}-{1}-{2}-{3}-{5}" },
-        { sstable::version_types::la, "{2}-{3}-{4}-{5}" }
+        { sstable::version_types::la, "{2}-{3}-{4}-{5}" },
+        { sstable::version_types::mc, "{2}-{3}-{4}-{5}" }
     };
 
     return dir + "/" + seastar::format(fmtmap[version], ks, cf, _version_string.at(version), to_sstring(generation), _format_string.at(format), component);
@@ -2448,6 +3099,35 @@ std::vector<std::pair<sstable::component_type, sstring>> sstable::all_components
     return all;
 }
 
+future<> sstable::mark_for_deletion_on_disk() {
+    assert(!_shared);
+    return sstable_write_io_check(rename_file, filename(component_type::TOC), filename(component_type::TemporaryTOC));
+}
+
+future<bool> sstable::create_snapshot_links(sstring dir) const {
+    auto dst = sstable::filename(dir, _schema->ks_name(), _schema->cf_name(), _version, _generation, _format, component_type::TOC);
+    return sstable_write_io_check(::link_file, filename(component_type::TOC), dst).then_wrapped([this, dir] (future<> f) {
+        try {
+            f.get();
+        } catch (std::system_error& e) {
+            if (e.code() != std::error_code(EEXIST, std::system_category())) {
+                throw;
+            }
+            return make_ready_future<bool>(false);
+        }
+        return parallel_for_each(all_components(), [this, dir] (auto p) {
+            if (p.first == component_type::TOC) {
+                return make_ready_future<>();
+            }
+            auto src = sstable::filename(_dir, _schema->ks_name(), _schema->cf_name(), _version, _generation, _format, p.second);
+            auto dst = sstable::filename(dir, _schema->ks_name(), _schema->cf_name(), _version, _generation, _format, p.second);
+            return this->sstable_write_io_check(::link_file, std::move(src), std::move(dst));
+        }).then([] {
+            return true;
+        });
+    });
+}
+
 future<> sstable::create_links(sstring dir, int64_t generation) const {
     // TemporaryTOC is always first, TOC is always last
     auto dst = sstable::filename(dir, _schema->ks_name(), _schema->cf_name(), _version, generation, _format, component_type::TemporaryTOC);
@@ -2496,7 +3176,7 @@ future<> sstable::set_generation(int64_t new_generation) {
 }
 
 entry_descriptor entry_descriptor::make_descriptor(sstring fname) {
-    static std::regex la("la-(\\d+)-(\\w+)-(.*)");
+    static std::regex la_mc("(la|mc)-(\\d+)-(\\w+)-(.*)");
     static std::regex ka("(\\w+)-(\\w+)-ka-(\\d+)-(.*)");
 
     std::smatch match;
@@ -2510,13 +3190,14 @@ entry_descriptor entry_descriptor::make_descriptor(sstring fname) {
     sstring cf;
 
     std::string s(fname);
-    if (std::regex_match(s, match, la)) {
+    if (std::regex_match(s, match, la_mc)) {
         sstring ks = "";
         sstring cf = "";
-        version = sstable::version_types::la;
-        generation = match[1].str();
-        format = sstring(match[2].str());
-        component = sstring(match[3].str());
+        auto v = sstring(match[1].str());
+        version = sstable::version_from_sstring(v);
+        generation = match[2].str();
+        format = sstring(match[3].str());
+        component = sstring(match[4].str());
     } else if (std::regex_match(s, match, ka)) {
         ks = match[1].str();
         cf = match[2].str();
@@ -2546,27 +3227,43 @@ sstable::component_type sstable::component_from_sstring(sstring &s) {
     }
 }
 
-input_stream<char> sstable::data_stream(uint64_t pos, size_t len, const io_priority_class& pc, reader_resource_tracker resource_tracker, lw_shared_ptr<file_input_stream_history> history) {
-    file_input_stream_options options;
-    options.buffer_size = sstable_buffer_size;
-    options.io_priority_class = pc;
-    options.read_ahead = 4;
-    options.dynamic_adjustments = std::move(history);
+read_ahead_policy sstable::data_read_ahead_policy(const io_priority_class& pc, bool single_partition) const {
+    auto max = std::max(sstable_buffer_size, read_ahead_page_size);
+    if (pc.id() == service::get_local_compaction_priority().id()) {
+        return read_ahead_policy{max, max, 4};
+    }
+    if (pc.id() == service::get_local_streaming_read_priority().id()) {
+        // Streaming runs in the background, with fewer reads in flight.
+        return read_ahead_policy{max, max, 2};
+    }
+    if (single_partition) {
+        // The reader may stop anywhere in the partition, so doesn't read
+        // far ahead of itself.
+        return read_ahead_policy{read_ahead_page_size, max, 1};
+    }
+    return read_ahead_policy{read_ahead_page_size, max, 4};
+}
 
+input_stream<char> sstable::data_stream(uint64_t pos, size_t len, const io_priority_class& pc, reader_resource_tracker resource_tracker, read_ahead_policy policy) {
     auto f = resource_tracker.track(_data_file);
 
-    input_stream<char> stream;
     if (_components->compression) {
+        // An sstable is read by a single compaction at a time, or by the jobs
+        // of a split one, which can tell its decompression time apart this way.
+        auto decompress_ns = pc.id() == service::get_local_compaction_priority().id() ? &_read_stats.compaction_decompress_ns : nullptr;
         return make_compressed_file_input_stream(f, &_components->compression,
-                pos, len, std::move(options));
+                pos, len, pc, policy, &_read_stats.data_bytes_read, &_read_stats.decompressed_bytes, decompress_ns);
 
     }
 
-    return make_file_input_stream(f, pos, len, std::move(options));
+    return make_adaptive_file_input_stream(f, pos, len, pc, policy, &_read_stats.data_bytes_read);
 }
 
 future<temporary_buffer<char>> sstable::data_read(uint64_t pos, size_t len, const io_priority_class& pc) {
-    return do_with(data_stream(pos, len, pc, no_resource_tracking(), {}), [len] (auto& stream) {
+    // All of it is read at once.
+    auto buffer_size = align_up(std::max<size_t>(len, 1), read_ahead_page_size);
+    auto policy = read_ahead_policy{buffer_size, buffer_size, 0};
+    return do_with(data_stream(pos, len, pc, no_resource_tracking(), policy), [len] (auto& stream) {
         return stream.read_exactly(len).finally([&stream] {
             return stream.close();
         });
@@ -2896,6 +3593,46 @@ uint64_t sstable::estimated_keys_for_range(const dht::token_range& range) {
     return std::max(uint64_t(1), estimated_keys);
 }
 
+void partition_count_estimator::add(const sstable& sst) {
+    _sum += sst.get_estimated_key_count();
+    if (!_mergeable) {
+        return;
+    }
+    try {
+        auto& elements = sst.get_compaction_metadata().cardinality.elements;
+        temporary_buffer<uint8_t> bytes(elements.size());
+        std::copy(elements.begin(), elements.end(), bytes.get_write());
+        auto hll = hll::HyperLogLog::from_bytes(std::move(bytes));
+        if (!_merged) {
+            _merged = std::move(hll);
+        } else if (_merged->precision() == hll.precision()) {
+            _merged->merge(hll);
+        } else {
+            _mergeable = false;
+        }
+    } catch (...) {
+        sstlog.debug("Cannot merge the cardinality estimator of {}: {}", sst.get_filename(), std::current_exception());
+        _mergeable = false;
+    }
+}
+
+uint64_t partition_count_estimator::estimate() const {
+    if (!_mergeable || !_merged) {
+        return _sum;
+    }
+    return std::min(_sum, std::max(uint64_t(1), uint64_t(std::llround(_merged->estimate()))));
+}
+
+utils::UUID sstable::run_identifier() const {
+    const auto* ri = _components->scylla_metadata
+            ? _components->scylla_metadata->data.get<scylla_metadata_type::RunIdentifier, sstables::run_identifier>()
+            : nullptr;
+    if (!ri) {
+        return utils::UUID(0, _generation);
+    }
+    return utils::UUID(ri->most_significant_bits, ri->least_significant_bits);
+}
+
 std::vector<unsigned>
 sstable::compute_shards_for_this_sstable() const {
     std::unordered_set<unsigned> shards;
@@ -2982,6 +3719,184 @@ atomic_deletion_cancelled::what() const noexcept {
 }
 
 thread_local shared_index_lists::stats shared_index_lists::_shard_stats;
+
+namespace {
+
+// LRU of the index pages of all sstables of the shard, evicted by the
+// cache_tracker together with cached partitions.
+class index_page_lru {
+    shared_index_lists::lru_type _lru;
+public:
+    index_page_lru() {
+        global_cache_tracker().set_secondary_evictor([this] { return evict_one(); });
+    }
+    ~index_page_lru() {
+        global_cache_tracker().set_secondary_evictor({});
+    }
+    // Must be called with the cache region's allocator.
+    memory::reclaiming_result evict_one() noexcept {
+        if (_lru.empty()) {
+            return memory::reclaiming_result::reclaimed_nothing;
+        }
+        _lru.pop_back_and_dispose(current_deleter<shared_index_lists::cached_page>());
+        ++shared_index_lists::_shard_stats.cache_evictions;
+        return memory::reclaiming_result::reclaimed_something;
+    }
+    void insert(shared_index_lists::cached_page& page) {
+        _lru.push_front(page);
+    }
+    void touch(shared_index_lists::cached_page& page) {
+        _lru.erase(_lru.iterator_to(page));
+        _lru.push_front(page);
+    }
+};
+
+index_page_lru& shard_index_page_lru() {
+    static thread_local index_page_lru lru;
+    return lru;
+}
+
+// Cached pages are only ever read back on the shard which wrote them, so
+// integers are stored in host byte order.
+bytes serialize_index_list(const index_list& list) {
+    size_t size = sizeof(uint32_t);
+    for (auto&& e : list) {
+        size += 2 * sizeof(uint32_t) + sizeof(uint64_t) + e.get_key_bytes().size() + e.get_promoted_index_bytes().size();
+    }
+    bytes b(bytes::initialized_later(), size);
+    auto out = b.begin();
+    auto put = [&out] (auto v) {
+        out = std::copy_n(reinterpret_cast<const bytes::value_type*>(&v), sizeof(v), out);
+    };
+    auto put_bytes = [&] (bytes_view v) {
+        put(uint32_t(v.size()));
+        out = std::copy(v.begin(), v.end(), out);
+    };
+    put(uint32_t(list.size()));
+    for (auto&& e : list) {
+        put_bytes(e.get_key_bytes());
+        put(uint64_t(e.position()));
+        put_bytes(e.get_promoted_index_bytes());
+    }
+    return b;
+}
+
+index_list deserialize_index_list(bytes_view v) {
+    auto get = [&v] (auto& x) {
+        std::copy_n(v.begin(), sizeof(x), reinterpret_cast<bytes::value_type*>(&x));
+        v.remove_prefix(sizeof(x));
+    };
+    auto get_buffer = [&] {
+        uint32_t len;
+        get(len);
+        temporary_buffer<char> buf(reinterpret_cast<const char*>(v.data()), len);
+        v.remove_prefix(len);
+        return buf;
+    };
+    uint32_t count;
+    get(count);
+    index_list list;
+    list.reserve(count);
+    for (uint32_t i = 0; i < count; ++i) {
+        auto key = get_buffer();
+        uint64_t position;
+        get(position);
+        auto promoted_index = get_buffer();
+        list.emplace_back(std::move(key), position, std::move(promoted_index));
+    }
+    return list;
+}
+
+}
+
+shared_index_lists::cached_page::cached_page(key_type key, managed_bytes data) noexcept
+    : _key(key)
+    , _data(std::move(data))
+{
+    ++_shard_stats.cached_pages;
+}
+
+shared_index_lists::cached_page::cached_page(cached_page&& o) noexcept
+    : _key(o._key)
+    , _data(std::move(o._data))
+{
+    ++_shard_stats.cached_pages;
+    if (o._lru_link.is_linked()) {
+        auto prev = o._lru_link.prev_;
+        o._lru_link.unlink();
+        lru_type::node_algorithms::link_after(prev, _lru_link.this_ptr());
+    }
+    if (o._link.is_linked()) {
+        cached_pages_type::node_algorithms::replace_node(o._link.this_ptr(), _link.this_ptr());
+        cached_pages_type::node_algorithms::init(o._link.this_ptr());
+    }
+}
+
+shared_index_lists::cached_page::~cached_page() {
+    --_shard_stats.cached_pages;
+}
+
+shared_index_lists::~shared_index_lists() {
+    evict_cached_pages();
+}
+
+void shared_index_lists::evict_cached_pages() noexcept {
+    if (_cached_pages.empty()) {
+        return;
+    }
+    with_allocator(global_cache_tracker().allocator(), [this] {
+        _cached_pages.clear_and_dispose(current_deleter<cached_page>());
+    });
+}
+
+void shared_index_lists::evict_all_cached_pages() noexcept {
+    with_allocator(global_cache_tracker().allocator(), [] {
+        auto& lru = shard_index_page_lru();
+        while (lru.evict_one() == memory::reclaiming_result::reclaimed_something) { }
+    });
+}
+
+std::vector<shared_index_lists::key_type> shared_index_lists::cached_page_keys(size_t max) const {
+    std::vector<key_type> keys;
+    for (auto&& page : _cached_pages) {
+        if (keys.size() == max) {
+            break;
+        }
+        keys.push_back(page.key());
+    }
+    return keys;
+}
+
+stdx::optional<index_list> shared_index_lists::lookup_cached(key_type key) {
+    auto i = _cached_pages.find(key, cached_page::compare());
+    if (i == _cached_pages.end()) {
+        return stdx::nullopt;
+    }
+    // Pages must not move while being copied out.
+    logalloc::reclaim_lock rl(global_cache_tracker().region());
+    shard_index_page_lru().touch(*i);
+    return with_linearized_managed_bytes([&] {
+        return stdx::make_optional(deserialize_index_list(bytes_view(i->_data)));
+    });
+}
+
+void shared_index_lists::populate(key_type key, const index_list& list) noexcept {
+    try {
+        auto data = serialize_index_list(list);
+        auto& lru = shard_index_page_lru();
+        with_allocator(global_cache_tracker().allocator(), [&] {
+            if (_cached_pages.find(key, cached_page::compare()) != _cached_pages.end()) {
+                return;
+            }
+            auto page = current_allocator().construct<cached_page>(key, managed_bytes(bytes_view(data)));
+            _cached_pages.insert(*page);
+            lru.insert(*page);
+            ++_shard_stats.cache_populations;
+        });
+    } catch (...) {
+        sstlog.debug("failed to insert index page {} into the page cache: {}", key, std::current_exception());
+    }
+}
 static thread_local seastar::metrics::metric_groups metrics;
 
 future<> init_metrics() {
@@ -2991,9 +3906,19 @@ future<> init_metrics() {
         sm::make_derive("index_page_hits", [] { return shared_index_lists::shard_stats().hits; },
             sm::description("Index page requests which could be satisfied without waiting")),
         sm::make_derive("index_page_misses", [] { return shared_index_lists::shard_stats().misses; },
-            sm::description("Index page requests which initiated a read from disk")),
+            sm::description("Index page requests which initiated a load, from the index page cache or disk")),
         sm::make_derive("index_page_blocks", [] { return shared_index_lists::shard_stats().blocks; },
             sm::description("Index page requests which needed to wait due to page not being loaded yet")),
+        sm::make_derive("index_page_cache_hits", [] { return shared_index_lists::shard_stats().cache_hits; },
+            sm::description("Index page misses which were satisfied from the index page cache")),
+        sm::make_derive("index_page_cache_misses", [] { return shared_index_lists::shard_stats().cache_misses; },
+            sm::description("Index page misses which had to read the page from disk")),
+        sm::make_derive("index_page_cache_populations", [] { return shared_index_lists::shard_stats().cache_populations; },
+            sm::description("Index pages inserted into the index page cache")),
+        sm::make_derive("index_page_cache_evictions", [] { return shared_index_lists::shard_stats().cache_evictions; },
+            sm::description("Index pages evicted from the index page cache due to memory pressure")),
+        sm::make_gauge("index_page_cache_pages", [] { return shared_index_lists::shard_stats().cached_pages; },
+            sm::description("Index pages currently held in the index page cache")),
     });
   });
 }
@@ -46,6 +46,7 @@
 #include "core/stream.hh"
 #include "writer.hh"
 #include "metadata_collector.hh"
+#include "downsampling.hh"
 #include "filter.hh"
 #include "exceptions.hh"
 #include "mutation_reader.hh"
@@ -65,6 +66,14 @@ namespace sstables {
 
 extern logging::logger sstlog;
 
+// Serializes a column name, from the clustering prefix and the column name
+// components, the way cells and range tombstones are named in the Data
+// component of "ka" and "la" sstables.
+bytes serialize_colname(const composite& clustering_key,
+        const std::vector<bytes_view>& column_names, composite::eoc marker);
+composite::eoc bound_kind_to_start_marker(bound_kind start_kind);
+composite::eoc bound_kind_to_end_marker(bound_kind end_kind);
+
 // data_consume_context is an object returned by sstable::data_consume_rows()
 // which allows knowing when the consumer stops reading, and starting it again
 // (e.g., when the consumer wants to stop after every sstable row).
@@ -81,7 +90,9 @@ extern logging::logger sstlog;
 // Moreover, the sstable object used for the sstable::data_consume_rows()
 // call which created this data_consume_context, must also be kept alive.
 class data_consume_context {
+public:
     class impl;
+private:
     std::unique_ptr<impl> _pimpl;
     // This object can only be constructed by sstable::data_consume_rows()
     data_consume_context(std::unique_ptr<impl>);
@@ -134,6 +145,46 @@ struct sstable_open_info;
 
 class index_reader;
 
+// A partition or a row written above the thresholds of the configuration,
+// recorded in system.large_partitions or system.large_rows once the sstable
+// is added to its table.
+struct large_data_record {
+    partition_key key;
+    // Set for large rows.
+    stdx::optional<clustering_key_prefix> clustering_key;
+    // Of the partition, or of the row.
+    uint64_t size;
+    uint64_t rows;
+};
+
+// The reads an sstable served on this shard since it was opened.
+struct read_stats {
+    // Single-partition reads which checked its filter.
+    uint64_t partition_lookups = 0;
+    // The lookups its filter let through, false positives included.
+    uint64_t filter_hits = 0;
+    uint64_t filter_false_positives = 0;
+    // Pages of the index read from disk, those found in the cache aside.
+    uint64_t index_page_reads = 0;
+    // Bytes read from the data file, compressed or not, read-ahead included.
+    uint64_t data_bytes_read = 0;
+    // Bytes out of the compressed chunks of the data file.
+    uint64_t decompressed_bytes = 0;
+    // Time spent decompressing the chunks read by compaction, in nanoseconds.
+    uint64_t compaction_decompress_ns = 0;
+
+    read_stats& operator+=(const read_stats& o) {
+        partition_lookups += o.partition_lookups;
+        filter_hits += o.filter_hits;
+        filter_false_positives += o.filter_false_positives;
+        index_page_reads += o.index_page_reads;
+        data_bytes_read += o.data_bytes_read;
+        decompressed_bytes += o.decompressed_bytes;
+        compaction_decompress_ns += o.compaction_decompress_ns;
+        return *this;
+    }
+};
+
 struct sstable_writer_config {
     std::experimental::optional<size_t> promoted_index_block_size;
     uint64_t max_sstable_size = std::numeric_limits<uint64_t>::max();
@@ -142,6 +193,13 @@ struct sstable_writer_config {
     stdx::optional<db::replay_position> replay_position;
     seastar::thread_scheduling_group* thread_scheduling_group = nullptr;
     seastar::shared_ptr<write_monitor> monitor = default_write_monitor();
+    // Buffers of the data file which may be in flight to the disk while the
+    // following ones are serialized and compressed.
+    unsigned write_behind = default_write_behind;
+    static constexpr unsigned default_write_behind = 10;
+    // Whether the partitions in the key cache should learn their positions
+    // in the sstable, for compaction output (compaction_preheat_key_cache).
+    bool preheat_key_cache = false;
 };
 
 static constexpr inline size_t default_sstable_buffer_size() {
@@ -282,6 +340,14 @@ class sstable : public enable_lw_shared_from_this<sstable> {
         return _generation;
     }
 
+    version_types get_version() const {
+        return _version;
+    }
+
+    format_types get_format() const {
+        return _format;
+    }
+
     // read_row() reads the entire sstable row (partition) at a given
     // partition key k, or a subset of this row. The subset is defined by
     // a filter on the clustering keys which we want to read, which
@@ -383,6 +449,18 @@ class sstable : public enable_lw_shared_from_this<sstable> {
         return _marked_for_deletion;
     }
 
+    // The large partitions and rows written to this sstable, taken out of it
+    // by its table.
+    std::vector<large_data_record> release_large_data() {
+        return std::exchange(_large_data, {});
+    }
+
+    // Renames the TOC of an unshared sstable to a temporary one, so that its
+    // files are removed on startup if they weren't before. The directory is
+    // left for the caller to sync, once for all the sstables it marks; the
+    // files can then be removed in the background with remove_by_toc_name().
+    future<> mark_for_deletion_on_disk();
+
     void add_ancestor(int64_t generation) {
         _collector.add_ancestor(generation);
     }
@@ -410,6 +488,11 @@ class sstable : public enable_lw_shared_from_this<sstable> {
         return _filter_file_size;
     }
 
+    // Size of the buffers used to read and write the components.
+    size_t buffer_size() const {
+        return sstable_buffer_size;
+    }
+
     db_clock::time_point data_file_write_time() const {
         return _data_file_write_time;
     }
@@ -455,6 +538,11 @@ class sstable : public enable_lw_shared_from_this<sstable> {
         return create_links(dir, _generation);
     }
 
+    // Links the components into a snapshot directory, TOC first, without
+    // syncing the directory, which is left to the caller. Returns false if
+    // the TOC was already linked there, by another shard sharing this sstable.
+    future<bool> create_snapshot_links(sstring dir) const;
+
     /**
      * Note. This is using the Origin definition of
      * max_data_age, which is load time. This could maybe
@@ -490,11 +578,22 @@ class sstable : public enable_lw_shared_from_this<sstable> {
 
     foreign_ptr<lw_shared_ptr<shareable_components>> _components = make_foreign(make_lw_shared<shareable_components>());
     shared_index_lists _index_lists;
+    // The index readers of this sstable, which rely on the entries of
+    // its summary staying the same.
+    unsigned _active_index_readers = 0;
+    // The index lookups since take_index_reads() was last called.
+    uint64_t _index_reads = 0;
+    read_stats _read_stats;
+    // The sampling level of the summary on disk, which resampling can't exceed.
+    int _full_sampling_level = downsampling::BASE_SAMPLING_LEVEL;
     bool _shared = true;  // across shards; safe default
+    stdx::optional<utils::UUID> _run_identifier; // for writing
     // NOTE: _collector and _c_stats are used to generation of statistics file
     // when writing a new sstable.
     metadata_collector _collector;
     column_stats _c_stats;
+    // The large partitions and rows written, capped by large_data_records_per_table.
+    std::vector<large_data_record> _large_data;
     file _index_file;
     file _data_file;
     uint64_t _data_file_size;
@@ -507,9 +606,6 @@ class sstable : public enable_lw_shared_from_this<sstable> {
     stdx::optional<dht::decorated_key> _first;
     stdx::optional<dht::decorated_key> _last;
 
-    lw_shared_ptr<file_input_stream_history> _single_partition_history = make_lw_shared<file_input_stream_history>();
-    lw_shared_ptr<file_input_stream_history> _partition_range_history = make_lw_shared<file_input_stream_history>();
-
     // _pi_write is used temporarily for building the promoted
     // index (column sample) of one partition when writing a new sstable.
     struct {
@@ -527,6 +623,15 @@ class sstable : public enable_lw_shared_from_this<sstable> {
         size_t desired_block_size;
     } _pi_write;
 
+    // Bases of the delta-encoded timestamps, local deletion times and TTLs
+    // of "mc" rows, set by the first value written. They are stored in the
+    // serialization header.
+    struct {
+        stdx::optional<api::timestamp_type> timestamp_base;
+        stdx::optional<int32_t> local_deletion_time_base;
+        stdx::optional<int32_t> ttl_base;
+    } _mc_write;
+
     void maybe_flush_pi_block(file_writer& out,
             const composite& clustering_key,
             const std::vector<bytes_view>& column_names,
@@ -611,7 +716,21 @@ class sstable : public enable_lw_shared_from_this<sstable> {
     // about the buffer size to read, and where exactly to stop reading
     // (even when a large buffer size is used).
     input_stream<char> data_stream(uint64_t pos, size_t len, const io_priority_class& pc,
-                                   reader_resource_tracker resource_tracker, lw_shared_ptr<file_input_stream_history> history);
+                                   reader_resource_tracker resource_tracker, read_ahead_policy policy);
+
+    // How the readers of the data file read ahead. Compaction and streaming
+    // read the whole range they were given, so read ahead as much as they
+    // can from the start. Queries start with the page the index points at,
+    // because most reads of a single partition need little more, and read
+    // further ahead as they go on reading.
+    read_ahead_policy data_read_ahead_policy(const io_priority_class& pc, bool single_partition) const;
+
+    // Makes the data_consume_context parsing the given part of the data
+    // file according to the version of this sstable.
+    std::unique_ptr<data_consume_context::impl> make_data_consume_context(row_consumer& consumer,
+            input_stream<char>&& input, uint64_t start, uint64_t maxlen);
+    // Feeds chunk_length_advisor, for tables letting it pick their chunk length.
+    void record_read_size(const disk_read_range& toread) const;
 
     // Read exactly the specific byte range from the data file (after
     // uncompression, if the file is compressed). This can be used to read
@@ -641,12 +760,37 @@ class sstable : public enable_lw_shared_from_this<sstable> {
     void write_row_tombstone(file_writer& out, const composite& key, const row_tombstone t);
     void write_deletion_time(file_writer& out, const tombstone t);
 
+    // NOTE: functions used to generate rows of "mc" sstables.
+    void write_mc_clustered_row(file_writer& out, const schema& schema, const clustering_row& clustered_row);
+    void write_mc_static_row(file_writer& out, const schema& schema, const row& static_row);
+    void write_mc_range_tombstone(file_writer& out, const schema& schema, const range_tombstone& rt);
+    unit_flags write_mc_cells(bytes_ostream& out, const schema& schema, column_kind kind, const row& cells, const row_marker* liveness);
+    void write_mc_cell(bytes_ostream& out, atomic_cell_view cell, const column_definition& cdef, const row_marker* liveness, stdx::optional<bytes_view> path);
+    void write_mc_collection(bytes_ostream& out, const column_definition& cdef, collection_mutation_view collection, const row_marker* liveness);
+    unit_flags write_mc_liveness(bytes_ostream& out, const row_marker& marker);
+    void write_mc_deletion(bytes_ostream& out, tombstone t);
+    int64_t mc_timestamp_delta(api::timestamp_type timestamp);
+    int64_t mc_local_deletion_time_delta(int32_t local_deletion_time);
+    int64_t mc_ttl_delta(int32_t ttl);
+    serialization_header make_serialization_header(const schema& s) const;
+
     stdx::optional<std::pair<uint64_t, uint64_t>> get_sample_indexes_for_range(const dht::token_range& range);
 
     std::vector<unsigned> compute_shards_for_this_sstable() const;
+    // Accounts the bytes read from and written to the data and index
+    // files to the table, when it is one of the database's.
+    void account_data_io();
 public:
     std::unique_ptr<index_reader> get_index_reader(const io_priority_class& pc);
 
+    // Reads the index page of the partition at pos into the index page cache,
+    // so that a read of the partition soon after doesn't wait for it.
+    future<> prefetch_index_page(dht::ring_position pos, const io_priority_class& pc);
+
+    // Returns the first partitions of at most max index pages of this sstable
+    // which reads left in the index page cache.
+    std::vector<dht::decorated_key> hot_index_page_keys(size_t max) const;
+
     future<> read_toc();
 
     bool has_scylla_component() const {
@@ -665,6 +809,15 @@ class sstable : public enable_lw_shared_from_this<sstable> {
         return filter_has_key(key::from_partition_key(s, key));
     }
 
+    // filter_has_key() for a single-partition read, accounted in the
+    // read statistics.
+    bool filter_has_key_for_read(const key& key) {
+        ++_read_stats.partition_lookups;
+        auto present = filter_has_key(key);
+        _read_stats.filter_hits += present;
+        return present;
+    }
+
     static utils::hashed_key make_hashed_key(const schema& s, const partition_key& key);
 
     uint64_t filter_get_false_positive() {
@@ -696,6 +849,11 @@ class sstable : public enable_lw_shared_from_this<sstable> {
         const stats_metadata& s = *static_cast<stats_metadata *>(p.get());
         return s;
     }
+    // Whether the sstable may have tombstones or expiring cells, which can
+    // make the partitions it has dead.
+    bool may_have_tombstones() const {
+        return !get_stats_metadata().estimated_tombstone_drop_time.bin.empty();
+    }
     const compaction_metadata& get_compaction_metadata() const {
         auto entry = _components->statistics.contents.find(metadata_type::Compaction);
         if (entry == _components->statistics.contents.end()) {
@@ -708,6 +866,18 @@ class sstable : public enable_lw_shared_from_this<sstable> {
         const compaction_metadata& s = *static_cast<compaction_metadata *>(p.get());
         return s;
     }
+    const serialization_header& get_serialization_header() const {
+        auto entry = _components->statistics.contents.find(metadata_type::Serialization);
+        if (entry == _components->statistics.contents.end()) {
+            throw std::runtime_error("Serialization header not available");
+        }
+        auto& p = entry->second;
+        if (!p) {
+            throw std::runtime_error("Statistics is malformed");
+        }
+        const serialization_header& s = *static_cast<serialization_header *>(p.get());
+        return s;
+    }
     const std::vector<unsigned>& get_shards_for_this_sstable() const {
         return _shards;
     }
@@ -719,6 +889,15 @@ class sstable : public enable_lw_shared_from_this<sstable> {
     // This will change sstable level only in memory.
     void set_sstable_level(uint32_t);
 
+    // Sstables without a run identifier, like ones written by older versions,
+    // each form a run of their own.
+    utils::UUID run_identifier() const;
+
+    // Must be called before the sstable is written.
+    void set_run_identifier(utils::UUID id) {
+        _run_identifier = id;
+    }
+
     double get_compression_ratio() const;
 
     future<> mutate_sstable_level(uint32_t);
@@ -727,6 +906,43 @@ class sstable : public enable_lw_shared_from_this<sstable> {
         return _components->summary;
     }
 
+    const schema_ptr& get_schema() const {
+        return _schema;
+    }
+
+    int summary_sampling_level() const {
+        return _components->summary.header.sampling_level;
+    }
+
+    int summary_full_sampling_level() const {
+        return _full_sampling_level;
+    }
+
+    uint64_t take_index_reads() {
+        return std::exchange(_index_reads, 0);
+    }
+
+    read_stats get_read_stats() const {
+        auto stats = _read_stats;
+        stats.filter_false_positives = _filter_tracker.false_positive;
+        return stats;
+    }
+
+    // The partitions read per estimated partition of the sstable, as
+    // Cassandra's SSTableReader.hotness.
+    double read_hotness() const {
+        return double(_read_stats.filter_hits) / std::max<uint64_t>(get_estimated_key_count(), 1);
+    }
+
+    // Whether the summary is owned by this shard alone, so that it can be resampled.
+    bool can_resample_summary() const;
+
+    // Replaces the summary with one sampled at sampling_level, read again
+    // from disk when it is denser than the current one. Indexes being read
+    // rely on the current summary, so it is kept when there are any when
+    // the new one is ready. Resolves to whether the summary was replaced.
+    future<bool> resample_summary(int sampling_level, const io_priority_class& pc = default_priority_class());
+
     // Return sstable key range as range<partition_key> reading only the summary component.
     future<range<partition_key>>
     get_sstable_key_range(const schema& s);
@@ -756,6 +972,20 @@ class sstable : public enable_lw_shared_from_this<sstable> {
     friend class mutation_reader::impl;
 };
 
+// Estimates the number of distinct partitions of a set of sstables by
+// merging their cardinality estimators, so that partitions present in
+// several of them are counted once. When an estimator is missing, or can't
+// be merged with the others, it falls back to summing the estimated key
+// counts of the sstables.
+class partition_count_estimator {
+    stdx::optional<hll::HyperLogLog> _merged;
+    uint64_t _sum = 0;
+    bool _mergeable = true;
+public:
+    void add(const sstable& sst);
+    uint64_t estimate() const;
+};
+
 struct entry_descriptor {
     sstring ks;
     sstring cf;
@@ -815,14 +1045,32 @@ class components_writer {
     bool _index_needs_close;
     uint64_t _max_sstable_size;
     bool _tombstone_written;
+    uint64_t _partition_rows = 0;
+    uint64_t _large_partition_threshold;
+    uint64_t _rows_count_threshold;
+    uint64_t _large_row_threshold;
+    size_t _large_data_limit;
     // Remember first and last keys, which we need for the summary file.
     stdx::optional<key> _first_key, _last_key;
     stdx::optional<key> _partition_key;
     uint64_t _next_data_offset_to_write_summary = 0;
     // Enforces ratio of summary to data of 1 to N.
     size_t _summary_byte_cost = default_summary_byte_cost;
+    uint64_t _estimated_partitions;
+    // The hashes of the partition keys written, while there are few enough
+    // of them, so that a filter sized for an estimate much larger than the
+    // real count can be rebuilt for it when the sstable is sealed.
+    std::vector<utils::hashed_key> _filter_keys;
+    bool _filter_keys_dropped = false;
+    static constexpr size_t max_filter_keys = 64 * 1024;
+    // Of the partition being written, when the positions of the partitions
+    // in the key cache are to be updated.
+    bool _preheat_key_cache;
+    bytes _preheat_key;
 private:
     void maybe_add_summary_entry(const dht::token& token, bytes_view key);
+    void maybe_rebuild_filter();
+    void maybe_record_large_data(const clustering_key_prefix* ck, uint64_t size, uint64_t rows);
     uint64_t get_offset() const;
     file_writer index_file_writer(sstable& sst, const io_priority_class& pc);
     void ensure_tombstone_is_written() {
@@ -835,8 +1083,13 @@ class components_writer {
     ~components_writer();
     components_writer(components_writer&& o) : _sst(o._sst), _schema(o._schema), _out(o._out), _index(std::move(o._index)),
             _index_needs_close(o._index_needs_close), _max_sstable_size(o._max_sstable_size), _tombstone_written(o._tombstone_written),
+            _partition_rows(o._partition_rows), _large_partition_threshold(o._large_partition_threshold),
+            _rows_count_threshold(o._rows_count_threshold), _large_row_threshold(o._large_row_threshold),
+            _large_data_limit(o._large_data_limit),
             _first_key(std::move(o._first_key)), _last_key(std::move(o._last_key)), _partition_key(std::move(o._partition_key)),
-            _next_data_offset_to_write_summary(o._next_data_offset_to_write_summary), _summary_byte_cost(o._summary_byte_cost) {
+            _next_data_offset_to_write_summary(o._next_data_offset_to_write_summary), _summary_byte_cost(o._summary_byte_cost),
+            _estimated_partitions(o._estimated_partitions), _filter_keys(std::move(o._filter_keys)), _filter_keys_dropped(o._filter_keys_dropped),
+            _preheat_key_cache(o._preheat_key_cache), _preheat_key(std::move(o._preheat_key)) {
         o._index_needs_close = false;
     }
 
@@ -864,6 +1117,7 @@ class sstable_writer {
     stdx::optional<components_writer> _components_writer;
     shard_id _shard; // Specifies which shard new sstable will belong to.
     seastar::shared_ptr<write_monitor> _monitor;
+    unsigned _write_behind;
 private:
     void prepare_file_writer();
     void finish_file_writer();
@@ -873,7 +1127,8 @@ class sstable_writer {
     ~sstable_writer();
     sstable_writer(sstable_writer&& o) : _sst(o._sst), _schema(o._schema), _pc(o._pc), _backup(o._backup),
             _leave_unsealed(o._leave_unsealed), _compression_enabled(o._compression_enabled), _writer(std::move(o._writer)),
-            _components_writer(std::move(o._components_writer)), _shard(o._shard), _monitor(std::move(o._monitor)) {}
+            _components_writer(std::move(o._components_writer)), _shard(o._shard), _monitor(std::move(o._monitor)),
+            _write_behind(o._write_behind) {}
     void consume_new_partition(const dht::decorated_key& dk) { return _components_writer->consume_new_partition(dk); }
     void consume(tombstone t) { _components_writer->consume(t); }
     stop_iteration consume(static_row&& sr) { return _components_writer->consume(std::move(sr)); }
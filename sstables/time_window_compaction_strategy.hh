@@ -173,8 +173,8 @@ class time_window_compaction_strategy : public compaction_strategy_impl {
 
         // if there is no sstable to compact in standard way, try compacting single sstable whose droppable tombstone
         // ratio is greater than threshold.
-        auto e = boost::range::remove_if(non_expiring_sstables, [this, &gc_before] (const shared_sstable& sst) -> bool {
-            return !worth_dropping_tombstones(sst, gc_before);
+        auto e = boost::range::remove_if(non_expiring_sstables, [this, &gc_before, &cf] (const shared_sstable& sst) -> bool {
+            return !worth_dropping_tombstones(sst, gc_before, cf);
         });
         non_expiring_sstables.erase(e, non_expiring_sstables.end());
         if (non_expiring_sstables.empty()) {
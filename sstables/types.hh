@@ -31,9 +31,11 @@
 #include "column_name_helper.hh"
 #include "sstables/key.hh"
 #include "db/commitlog/replay_position.hh"
+#include <algorithm>
 #include <vector>
 #include <unordered_map>
 #include <type_traits>
+#include <limits>
 
 // While the sstable code works with char, bytes_view works with int8_t
 // (signed char). Rather than change all the code, let's do a cast.
@@ -93,18 +95,81 @@ enum class indexable_element {
     cell
 };
 
-// Exploded view of promoted index.
+// View of promoted index.
 // Contains pointers into external buffer, so that buffer must be kept alive
 // as long as this is used.
-struct promoted_index {
+//
+// Blocks have keys of variable length, so they can't be found by their
+// offset in the buffer. Parsing all of them for every lookup costs a lot in
+// partitions with many blocks, so only the offset of every sample_interval-th
+// block is kept, found in one pass over the lengths. Lookups binary search
+// those samples and parse at most sample_interval blocks.
+class promoted_index {
+public:
     struct entry {
         composite_view start;
         composite_view end;
         uint64_t offset;
         uint64_t width;
     };
-    deletion_time del_time;
-    std::deque<entry> entries;
+    static constexpr uint32_t sample_interval = 16;
+private:
+    bytes_view _blocks;
+    uint32_t _size;
+    bool _is_compound;
+    // Offsets in _blocks of the blocks whose index is a multiple of sample_interval.
+    std::vector<uint32_t> _samples;
+private:
+    // Parses the block starting at offset, and advances offset past it.
+    entry parse_entry(uint32_t& offset) const;
+    composite_view parse_start(uint32_t offset) const;
+public:
+    promoted_index(bytes_view blocks, uint32_t size, bool is_compound);
+
+    size_t size() const {
+        return _size;
+    }
+
+    bool empty() const {
+        return !_size;
+    }
+
+    entry operator[](size_t i) const;
+
+    // Calls f with each block, in order.
+    template <typename Func>
+    void for_each(Func&& f) const {
+        uint32_t offset = 0;
+        for (uint32_t i = 0; i < _size; ++i) {
+            f(parse_entry(offset));
+        }
+    }
+
+    // Returns the index of the first block, not before the from-th one,
+    // whose start is greater than pos, or size() if there is none, like
+    // std::upper_bound(). less(pos, start) compares pos with a block start.
+    template <typename Position, typename Less>
+    size_t upper_bound(size_t from, const Position& pos, Less&& less) const {
+        if (from >= _size) {
+            return _size;
+        }
+        // The last sample at or before from, then the first one past it
+        // whose block starts after pos.
+        auto first = from / sample_interval;
+        auto it = std::upper_bound(_samples.begin() + first + 1, _samples.end(), pos, [this, &less] (const Position& pos, uint32_t sample) {
+            return less(pos, parse_start(sample));
+        });
+        auto i = size_t(std::distance(_samples.begin(), it) - 1) * sample_interval;
+        auto offset = *std::prev(it);
+        auto end = std::min(i + sample_interval, size_t(_size));
+        for (; i < end; ++i) {
+            auto e = parse_entry(offset);
+            if (i >= from && less(pos, e.start)) {
+                break;
+            }
+        }
+        return i;
+    }
 };
 
 class promoted_index_view {
@@ -327,6 +392,40 @@ struct ka_stats_metadata : public metadata_base<ka_stats_metadata> {
 };
 using stats_metadata = ka_stats_metadata;
 
+struct serialization_header_column {
+    disk_string<uint16_t> name;
+    disk_string<uint16_t> type_name;
+
+    template <typename Describer>
+    auto describe_type(Describer f) { return f(name, type_name); }
+};
+
+// Describes the encoding of rows in the Data component of "mc" sstables.
+// Rows refer to their columns by position in static_columns and
+// regular_columns instead of by name, and timestamps, local deletion times
+// and TTLs are stored as deltas from the bases below. Cassandra uses the
+// minimum values as bases; we only write Statistics after Data, so the
+// writer fixes the bases at the first value it encounters and the deltas
+// are signed.
+struct serialization_header : public metadata_base<serialization_header> {
+    int64_t timestamp_base;
+    int32_t local_deletion_time_base;
+    int32_t ttl_base;
+    disk_array<uint32_t, serialization_header_column> static_columns;
+    disk_array<uint32_t, serialization_header_column> regular_columns;
+
+    template <typename Describer>
+    auto describe_type(Describer f) {
+        return f(
+            timestamp_base,
+            local_deletion_time_base,
+            ttl_base,
+            static_columns,
+            regular_columns
+        );
+    }
+};
+
 struct disk_token_bound {
     uint8_t exclusive; // really a boolean
     disk_string<uint16_t> token;
@@ -354,6 +453,17 @@ struct sharding_metadata {
     auto describe_type(Describer f) { return f(token_ranges); }
 };
 
+// Identifies the run of sstables this sstable belongs to. A run is produced
+// by a single compaction: its sstables (fragments) have disjoint token ranges
+// and together hold the output of that compaction.
+struct run_identifier {
+    uint64_t most_significant_bits;
+    uint64_t least_significant_bits;
+
+    template <typename Describer>
+    auto describe_type(Describer f) { return f(most_significant_bits, least_significant_bits); }
+};
+
 
 // Numbers are found on disk, so they do matter. Also, setting their sizes of
 // that of an uint32_t is a bit wasteful, but it simplifies the code a lot
@@ -363,16 +473,19 @@ enum class metadata_type : uint32_t {
     Validation = 0,
     Compaction = 1,
     Stats = 2,
+    Serialization = 3,
 };
 
 
 enum class scylla_metadata_type : uint32_t {
     Sharding = 1,
+    RunIdentifier = 2,
 };
 
 struct scylla_metadata {
     disk_set_of_tagged_union<scylla_metadata_type,
-            disk_tagged_union_member<scylla_metadata_type, scylla_metadata_type::Sharding, sharding_metadata>
+            disk_tagged_union_member<scylla_metadata_type, scylla_metadata_type::Sharding, sharding_metadata>,
+            disk_tagged_union_member<scylla_metadata_type, scylla_metadata_type::RunIdentifier, run_identifier>
             > data;
 
     template <typename Describer>
@@ -423,5 +536,47 @@ inline column_mask operator&(column_mask m1, column_mask m2) {
 inline column_mask operator|(column_mask m1, column_mask m2) {
     return column_mask(static_cast<uint8_t>(m1) | static_cast<uint8_t>(m2));
 }
+
+// Flags of a row unit in the Data component of "mc" sstables.
+enum class unit_flags : uint8_t {
+    none = 0x0,
+    end_of_partition = 0x01,
+    is_marker = 0x02, // a range tombstone rather than a row
+    has_timestamp = 0x04,
+    has_ttl = 0x08,
+    has_deletion = 0x10,
+    has_all_columns = 0x20,
+    has_shadowable_deletion = 0x40,
+    is_static = 0x80,
+};
+
+inline unit_flags operator&(unit_flags f1, unit_flags f2) {
+    return unit_flags(static_cast<uint8_t>(f1) & static_cast<uint8_t>(f2));
+}
+
+inline unit_flags operator|(unit_flags f1, unit_flags f2) {
+    return unit_flags(static_cast<uint8_t>(f1) | static_cast<uint8_t>(f2));
+}
+
+// Flags of a cell within an "mc" row unit.
+enum class cell_flags : uint8_t {
+    none = 0x0,
+    is_deleted = 0x01,
+    is_expiring = 0x02,
+    has_empty_value = 0x04,
+    use_row_timestamp = 0x08,
+    use_row_ttl = 0x10,
+};
+
+inline cell_flags operator&(cell_flags f1, cell_flags f2) {
+    return cell_flags(static_cast<uint8_t>(f1) & static_cast<uint8_t>(f2));
+}
+
+inline cell_flags operator|(cell_flags f1, cell_flags f2) {
+    return cell_flags(static_cast<uint8_t>(f1) | static_cast<uint8_t>(f2));
+}
+
+// TTL of the liveness info of an "mc" row whose row marker is dead.
+static constexpr int32_t expired_liveness_ttl = std::numeric_limits<int32_t>::max();
 }
 
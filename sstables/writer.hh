@@ -23,8 +23,10 @@
 
 #include "core/iostream.hh"
 #include "core/fstream.hh"
+#include "core/future-util.hh"
 #include "types.hh"
 #include "compress.hh"
+#include "progress_monitor.hh"
 #include <seastar/core/byteorder.hh>
 
 namespace sstables {
@@ -109,14 +111,27 @@ serialized_size(const T& object) {
     return size;
 }
 
-output_stream<char> make_checksummed_file_output_stream(file f, struct checksum& cinfo, uint32_t& full_file_checksum, bool checksum_file, file_output_stream_options options);
+output_stream<char> make_checksummed_file_output_stream(file f, struct checksum& cinfo, uint32_t& full_file_checksum, bool checksum_file, file_output_stream_options options,
+        write_monitor* monitor = nullptr);
+
+// Reports the time until a write of the data file completes to monitor, when
+// given, if the write is waited for.
+inline future<> monitor_write_wait(future<> f, write_monitor* monitor) {
+    if (!monitor || f.available()) {
+        return f;
+    }
+    auto start = std::chrono::steady_clock::now();
+    return f.finally([monitor, start] {
+        monitor->on_write_wait(std::chrono::steady_clock::now() - start);
+    });
+}
 
 class checksummed_file_writer : public file_writer {
     checksum _c;
     uint32_t _full_checksum;
 public:
-    checksummed_file_writer(file f, file_output_stream_options options, bool checksum_file = false)
-            : file_writer(make_checksummed_file_output_stream(std::move(f), _c, _full_checksum, checksum_file, options))
+    checksummed_file_writer(file f, file_output_stream_options options, bool checksum_file = false, write_monitor* monitor = nullptr)
+            : file_writer(make_checksummed_file_output_stream(std::move(f), _c, _full_checksum, checksum_file, options, monitor))
             , _c({uint32_t(std::min(size_t(DEFAULT_CHUNK_SIZE), size_t(options.buffer_size)))})
             , _full_checksum(init_checksum_adler32()) {}
 
@@ -139,12 +154,15 @@ class checksummed_file_data_sink_impl : public data_sink_impl {
     struct checksum& _c;
     uint32_t& _full_checksum;
     bool _checksum_file;
+    write_monitor* _monitor;
 public:
-    checksummed_file_data_sink_impl(file f, struct checksum& c, uint32_t& full_file_checksum, bool checksum_file, file_output_stream_options options)
+    checksummed_file_data_sink_impl(file f, struct checksum& c, uint32_t& full_file_checksum, bool checksum_file, file_output_stream_options options,
+            write_monitor* monitor)
             : _out(make_file_output_stream(std::move(f), std::move(options)))
             , _c(c)
             , _full_checksum(full_file_checksum)
             , _checksum_file(checksum_file)
+            , _monitor(monitor)
             {}
 
     future<> put(net::packet data) { abort(); }
@@ -164,7 +182,7 @@ class checksummed_file_data_sink_impl : public data_sink_impl {
                 _c.checksums.push_back(per_chunk_checksum);
             }
         }
-        auto f = _out.write(buf.begin(), buf.size());
+        auto f = monitor_write_wait(_out.write(buf.begin(), buf.size()), _monitor);
         return f.then([buf = std::move(buf)] {});
     }
 
@@ -176,14 +194,16 @@ class checksummed_file_data_sink_impl : public data_sink_impl {
 
 class checksummed_file_data_sink : public data_sink {
 public:
-    checksummed_file_data_sink(file f, struct checksum& cinfo, uint32_t& full_file_checksum, bool checksum_file, file_output_stream_options options)
-        : data_sink(std::make_unique<checksummed_file_data_sink_impl>(std::move(f), cinfo, full_file_checksum, checksum_file, std::move(options))) {}
+    checksummed_file_data_sink(file f, struct checksum& cinfo, uint32_t& full_file_checksum, bool checksum_file, file_output_stream_options options,
+            write_monitor* monitor = nullptr)
+        : data_sink(std::make_unique<checksummed_file_data_sink_impl>(std::move(f), cinfo, full_file_checksum, checksum_file, std::move(options), monitor)) {}
 };
 
 inline
-output_stream<char> make_checksummed_file_output_stream(file f, struct checksum& cinfo, uint32_t& full_file_checksum, bool checksum_file, file_output_stream_options options) {
+output_stream<char> make_checksummed_file_output_stream(file f, struct checksum& cinfo, uint32_t& full_file_checksum, bool checksum_file, file_output_stream_options options,
+        write_monitor* monitor) {
     auto buffer_size = options.buffer_size;
-    return output_stream<char>(checksummed_file_data_sink(std::move(f), cinfo, full_file_checksum, checksum_file, std::move(options)), buffer_size, true);
+    return output_stream<char>(checksummed_file_data_sink(std::move(f), cinfo, full_file_checksum, checksum_file, std::move(options), monitor), buffer_size, true);
 }
 
 // compressed_file_data_sink_impl works as a filter for a file output stream,
@@ -193,19 +213,59 @@ class compressed_file_data_sink_impl : public data_sink_impl {
     output_stream<char> _out;
     sstables::compression* _compression_metadata;
     size_t _pos = 0;
+    // Chunks held back until there is enough data to train the compression
+    // dictionary, see compression::dictionary_sample_size().
+    std::vector<temporary_buffer<char>> _samples;
+    size_t _samples_size = 0;
+    write_monitor* _monitor;
 public:
-    compressed_file_data_sink_impl(file f, sstables::compression* cm, file_output_stream_options options)
+    compressed_file_data_sink_impl(file f, sstables::compression* cm, file_output_stream_options options, write_monitor* monitor)
             : _out(make_file_output_stream(std::move(f), options))
-            , _compression_metadata(cm) {}
+            , _compression_metadata(cm)
+            , _monitor(monitor) {}
 
     future<> put(net::packet data) { abort(); }
     virtual future<> put(temporary_buffer<char> buf) override {
+        auto sample_size = _compression_metadata->dictionary_sample_size();
+        if (!sample_size) {
+            return put_compressed(std::move(buf));
+        }
+        _samples_size += buf.size();
+        _samples.push_back(std::move(buf));
+        if (_samples_size < sample_size) {
+            return make_ready_future<>();
+        }
+        return flush_samples();
+    }
+    virtual future<> close() override {
+        auto f = _samples.empty() ? make_ready_future<>() : flush_samples();
+        return f.then([this] {
+            return _out.close();
+        });
+    }
+private:
+    future<> flush_samples() {
+        _compression_metadata->train_dictionary(_samples);
+        auto samples = std::move(_samples);
+        _samples.clear();
+        _samples_size = 0;
+        return do_with(std::move(samples), [this] (std::vector<temporary_buffer<char>>& samples) {
+            return do_for_each(samples, [this] (temporary_buffer<char>& buf) {
+                return put_compressed(std::move(buf));
+            });
+        });
+    }
+    future<> put_compressed(temporary_buffer<char> buf) {
         auto output_len = _compression_metadata->compress_max_size(buf.size());
         // account space for checksum that goes after compressed data.
         temporary_buffer<char> compressed(output_len + 4);
 
         // compress flushed data.
+        auto start = _monitor ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point();
         auto len = _compression_metadata->compress(buf.get(), buf.size(), compressed.get_write(), output_len);
+        if (_monitor) {
+            _monitor->on_compress(std::chrono::steady_clock::now() - start);
+        }
         if (len > output_len) {
             throw std::runtime_error("possible overflow during compression");
         }
@@ -226,26 +286,24 @@ class compressed_file_data_sink_impl : public data_sink_impl {
 
         compressed.trim(len + 4);
 
-        auto f = _out.write(compressed.get(), compressed.size());
+        auto f = monitor_write_wait(_out.write(compressed.get(), compressed.size()), _monitor);
         return f.then([compressed = std::move(compressed)] {});
     }
-    virtual future<> close() override {
-        return _out.close();
-    }
 };
 
 class compressed_file_data_sink : public data_sink {
 public:
-    compressed_file_data_sink(file f, sstables::compression* cm, file_output_stream_options options)
+    compressed_file_data_sink(file f, sstables::compression* cm, file_output_stream_options options, write_monitor* monitor = nullptr)
         : data_sink(std::make_unique<compressed_file_data_sink_impl>(
-                std::move(f), cm, options)) {}
+                std::move(f), cm, options, monitor)) {}
 };
 
-static inline output_stream<char> make_compressed_file_output_stream(file f, file_output_stream_options options, sstables::compression* cm) {
+static inline output_stream<char> make_compressed_file_output_stream(file f, file_output_stream_options options, sstables::compression* cm,
+        write_monitor* monitor = nullptr) {
     // buffer of output stream is set to chunk length, because flush must
     // happen every time a chunk was filled up.
     auto outer_buffer_size = cm->uncompressed_chunk_length();
-    return output_stream<char>(compressed_file_data_sink(std::move(f), cm, options), outer_buffer_size, true);
+    return output_stream<char>(compressed_file_data_sink(std::move(f), cm, options, monitor), outer_buffer_size, true);
 }
 
 }
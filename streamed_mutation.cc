@@ -586,9 +586,9 @@ mutation_fragment_opt range_tombstone_stream::get_next()
 }
 
 void range_tombstone_stream::forward_to(position_in_partition_view pos) {
-    _list.erase_where([this, &pos] (const range_tombstone& rt) {
-        return !_cmp(pos, rt.end_position());
-    });
+    // The tombstones are disjoint, so those ending before pos form a prefix.
+    auto rest = _list.slice(_schema, pos, position_in_partition_view::after_all_clustered_rows());
+    _list.erase(_list.begin(), rest.begin());
 }
 
 void range_tombstone_stream::apply(const range_tombstone_list& list, const query::clustering_range& range) {
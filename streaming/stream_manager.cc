@@ -41,7 +41,9 @@
 #include "streaming/stream_result_future.hh"
 #include "log.hh"
 #include "streaming/stream_session_state.hh"
+#include "service/storage_proxy.hh"
 #include <seastar/core/metrics.hh>
+#include <seastar/core/sleep.hh>
 
 namespace streaming {
 
@@ -59,7 +61,83 @@ stream_manager::stream_manager() {
 
         sm::make_derive("total_outgoing_bytes", [this] { return get_progress_on_local_shard().bytes_sent; },
                         sm::description("This is a sent bytes rate.")),
+
+        sm::make_gauge("outbound_throughput_factor", [this] { return _throughput_factor; },
+                        sm::description("The part of the outbound throughput limits in use, lowered while the foreground latency is high.")),
     });
+
+    _latency_timer.set_callback([this] { adjust_throughput_to_latency(); });
+}
+
+// The limits are per node, and each shard sends its own part of the data.
+static double per_shard_rate(uint32_t megabits_per_sec, double factor) {
+    return double(megabits_per_sec) * 1000000 / 8 / smp::count * factor;
+}
+
+void stream_manager::update_send_rates() {
+    _send_bucket.set_rate(per_shard_rate(_limits.outbound_megabits_per_sec, _throughput_factor));
+    auto peer_rate = per_shard_rate(_limits.per_peer_outbound_megabits_per_sec, _throughput_factor);
+    for (auto& b : _peer_send_buckets) {
+        b.second.set_rate(peer_rate);
+    }
+}
+
+void stream_manager::set_limits(limits l) {
+    _limits = l;
+    _throughput_factor = 1;
+    update_send_rates();
+    _latency_timer.cancel();
+    if (_limits.latency_threshold.count()) {
+        auto& stats = service::get_local_storage_proxy().get_stats();
+        _last_latency_sum = stats.read.hist.sum + stats.write.hist.sum;
+        _last_latency_count = stats.read.hist.total + stats.write.hist.total;
+        _latency_timer.arm_periodic(std::chrono::seconds(1));
+    }
+}
+
+future<> stream_manager::set_limits_on_all_shards(limits l) {
+    return get_stream_manager().invoke_on_all([l] (auto& sm) {
+        sm.set_limits(l);
+    });
+}
+
+void stream_manager::adjust_throughput_to_latency() {
+    static constexpr double min_throughput_factor = 1.0 / 64;
+    static constexpr double throughput_factor_step = 1.0 / 16;
+    auto& stats = service::get_local_storage_proxy().get_stats();
+    auto sum = stats.read.hist.sum + stats.write.hist.sum;
+    auto count = stats.read.hist.total + stats.write.hist.total;
+    auto samples = count - _last_latency_count;
+    auto mean = std::chrono::microseconds(samples ? (sum - _last_latency_sum) / samples : 0);
+    _last_latency_sum = sum;
+    _last_latency_count = count;
+    auto factor = _throughput_factor;
+    if (mean > _limits.latency_threshold) {
+        factor = std::max(factor / 2, min_throughput_factor);
+    } else {
+        factor = std::min(factor + throughput_factor_step, 1.0);
+    }
+    if (factor != _throughput_factor) {
+        sslog.debug("stream_manager: foreground latency is {} us, outbound throughput factor is {}", mean.count(), factor);
+        _throughput_factor = factor;
+        update_send_rates();
+    }
+}
+
+future<> stream_manager::throttle_send(gms::inet_address peer, size_t bytes) {
+    auto delay = _send_bucket.take(bytes);
+    if (_limits.per_peer_outbound_megabits_per_sec) {
+        auto it = _peer_send_buckets.find(peer);
+        if (it == _peer_send_buckets.end()) {
+            auto rate = per_shard_rate(_limits.per_peer_outbound_megabits_per_sec, _throughput_factor);
+            it = _peer_send_buckets.emplace(peer, utils::token_bucket<>(rate)).first;
+        }
+        delay = std::max(delay, it->second.take(bytes));
+    }
+    if (delay == delay.zero()) {
+        return make_ready_future<>();
+    }
+    return sleep(std::chrono::duration_cast<std::chrono::microseconds>(delay));
 }
 
 void stream_manager::register_sending(shared_ptr<stream_result_future> result) {
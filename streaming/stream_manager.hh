@@ -45,8 +45,12 @@
 #include "gms/inet_address.hh"
 #include "gms/endpoint_state.hh"
 #include "gms/application_state.hh"
+#include "utils/token_bucket.hh"
 #include <seastar/core/semaphore.hh>
+#include <seastar/core/timer.hh>
+#include <seastar/core/lowres_clock.hh>
 #include <seastar/core/metrics_registration.hh>
+#include <chrono>
 #include <map>
 
 namespace streaming {
@@ -85,6 +89,18 @@ class stream_manager : public gms::i_endpoint_state_change_subscriber, public en
     using endpoint_state = gms::endpoint_state;
     using application_state = gms::application_state;
     using versioned_value = gms::versioned_value;
+public:
+    struct limits {
+        // Outbound streaming throughput of the node, and to each peer, in
+        // megabits per second. Zero means no limit.
+        uint32_t outbound_megabits_per_sec = 0;
+        uint32_t per_peer_outbound_megabits_per_sec = 0;
+        // Stream plans run with each peer at a time, by range_streamer.
+        uint32_t plans_per_peer = 1;
+        // Mean latency of foreground reads and writes above which the
+        // throughput limits are lowered. Zero disables that.
+        std::chrono::milliseconds latency_threshold{0};
+    };
     /*
      * Currently running streams. Removed after completion/failure.
      * We manage them in two different maps to distinguish plan from initiated ones to
@@ -95,6 +111,15 @@ class stream_manager : public gms::i_endpoint_state_change_subscriber, public en
     std::unordered_map<UUID, shared_ptr<stream_result_future>> _receiving_streams;
     std::unordered_map<UUID, std::unordered_map<gms::inet_address, stream_bytes>> _stream_bytes;
     semaphore _mutation_send_limiter{256};
+    limits _limits;
+    // The part of the throughput limits in use. It is halved each second the
+    // foreground latency is above the threshold, and raised back slowly.
+    double _throughput_factor = 1;
+    utils::token_bucket<> _send_bucket;
+    std::unordered_map<gms::inet_address, utils::token_bucket<>> _peer_send_buckets;
+    timer<lowres_clock> _latency_timer;
+    int64_t _last_latency_sum = 0;
+    int64_t _last_latency_count = 0;
     seastar::metrics::metric_groups _metrics;
 
 public:
@@ -102,6 +127,21 @@ class stream_manager : public gms::i_endpoint_state_change_subscriber, public en
 
     semaphore& mutation_send_limiter() { return _mutation_send_limiter; }
 
+    const limits& get_limits() const {
+        return _limits;
+    }
+
+    void set_limits(limits l);
+
+    future<> set_limits_on_all_shards(limits l);
+
+    double get_throughput_factor() const {
+        return _throughput_factor;
+    }
+
+    // Resolves once bytes can be sent to peer within the throughput limits.
+    future<> throttle_send(gms::inet_address peer, size_t bytes);
+
     void register_sending(shared_ptr<stream_result_future> result);
 
     void register_receiving(shared_ptr<stream_result_future> result);
@@ -126,6 +166,7 @@ class stream_manager : public gms::i_endpoint_state_change_subscriber, public en
     void show_streams();
 
     future<> stop() {
+        _latency_timer.cancel();
         fail_all_sessions();
         return make_ready_future<>();
     }
@@ -162,6 +203,8 @@ class stream_manager : public gms::i_endpoint_state_change_subscriber, public en
 
 private:
     void fail_all_sessions();
+    void update_send_rates();
+    void adjust_throughput_to_latency();
     void fail_sessions(inet_address endpoint);
     bool has_peer(inet_address endpoint);
 };
@@ -128,6 +128,20 @@ class stream_plan {
      */
     stream_plan& transfer_ranges(inet_address to, sstring keyspace, dht::token_range_vector ranges, std::vector<sstring> column_families);
 
+    /**
+     * Add transfer task to send the data of the given sstables of the upload
+     * directory of {@code column_family} which falls in {@code ranges}.
+     *
+     * @param to endpoint address of receiver
+     * @param keyspace name of keyspace
+     * @param column_family name of the column family
+     * @param ranges ranges to send
+     * @param sstables the sstables of the upload directory
+     * @return this object for chaining
+     */
+    stream_plan& transfer_sstables(inet_address to, sstring keyspace, sstring column_family, dht::token_range_vector ranges,
+            std::vector<sstables::entry_descriptor> sstables);
+
     stream_plan& listeners(std::vector<stream_event_handler*> handlers);
 public:
     /**
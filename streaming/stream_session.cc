@@ -45,6 +45,7 @@
 #include "mutation_reader.hh"
 #include "dht/i_partitioner.hh"
 #include "database.hh"
+#include "db/config.hh"
 #include "utils/fb_utilities.hh"
 #include "streaming/stream_plan.hh"
 #include "core/sleep.hh"
@@ -171,11 +172,34 @@ void stream_session::init_messaging_service_handler() {
                 } catch (...) {
                     throw;
                 }
+            }).then([session, cf_id] {
+                if (!session->get_local_db().column_family_exists(cf_id)) {
+                    return make_ready_future<>();
+                }
+                return session->get_sstable_receiver().load(cf_id);
             }).then([session, cf_id] {
                 session->receive_task_completed(cf_id);
             });
         });
     });
+    ms().register_stream_sstable_data([] (const rpc::client_info& cinfo, UUID plan_id, UUID cf_id, int64_t generation,
+            sstring file_name, sstring component, uint64_t offset, bytes data, unsigned dst_cpu_id) {
+        const auto& from = cinfo.retrieve_auxiliary<gms::inet_address>("baddr");
+        return smp::submit_to(dst_cpu_id, [plan_id, cf_id, generation, file_name = std::move(file_name),
+                component = std::move(component), offset, data = std::move(data), from] () mutable {
+            auto session = get_session(plan_id, from, "STREAM_SSTABLE_DATA", cf_id);
+            get_local_stream_manager().update_progress(plan_id, from, progress_info::direction::IN, data.size());
+            return session->get_sstable_receiver().write(cf_id, generation, std::move(file_name), std::move(component),
+                    offset, std::move(data)).finally([session] { });
+        });
+    });
+    ms().register_stream_sstable_done([] (const rpc::client_info& cinfo, UUID plan_id, UUID cf_id, int64_t generation, unsigned dst_cpu_id) {
+        const auto& from = cinfo.retrieve_auxiliary<gms::inet_address>("baddr");
+        return smp::submit_to(dst_cpu_id, [plan_id, cf_id, generation, from] () mutable {
+            auto session = get_session(plan_id, from, "STREAM_SSTABLE_DONE", cf_id);
+            return session->get_sstable_receiver().finish(cf_id, generation).finally([session] { });
+        });
+    });
     ms().register_complete_message([] (const rpc::client_info& cinfo, UUID plan_id, unsigned dst_cpu_id, rpc::optional<bool> failed) {
         const auto& from = cinfo.retrieve_auxiliary<gms::inet_address>("baddr");
         if (failed && *failed) {
@@ -212,6 +236,14 @@ future<> stream_session::init_streaming_service(distributed<database>& db) {
     // });
     return get_stream_manager().start().then([] {
         gms::get_local_gossiper().register_(get_local_stream_manager().shared_from_this());
+        auto& cfg = _db->local().get_config();
+        stream_manager::limits l;
+        l.outbound_megabits_per_sec = cfg.stream_throughput_outbound_megabits_per_sec();
+        l.per_peer_outbound_megabits_per_sec = cfg.stream_throughput_outbound_per_peer_megabits_per_sec();
+        l.plans_per_peer = cfg.stream_plans_per_peer();
+        l.latency_threshold = std::chrono::milliseconds(cfg.stream_throttle_latency_threshold_in_ms());
+        return get_local_stream_manager().set_limits_on_all_shards(l);
+    }).then([] {
         return _db->invoke_on_all([] (auto& db) {
             init_messaging_service_handler();
         });
@@ -452,6 +484,21 @@ void stream_session::add_transfer_ranges(sstring keyspace, dht::token_range_vect
     }
 }
 
+void stream_session::add_transfer_sstables(sstring keyspace, sstring column_family, dht::token_range_vector ranges,
+        std::vector<sstables::entry_descriptor> sstables) {
+    auto cf_id = get_local_db().find_column_family(keyspace, column_family).schema()->id();
+    auto it = _transfers.find(cf_id);
+    if (it == _transfers.end()) {
+        stream_transfer_task task(shared_from_this(), cf_id, std::move(ranges));
+        task.set_upload_sstables(std::move(sstables));
+        auto inserted = _transfers.emplace(cf_id, std::move(task)).second;
+        assert(inserted);
+    } else {
+        it->second.append_ranges(ranges);
+        it->second.set_upload_sstables(std::move(sstables));
+    }
+}
+
 future<> stream_session::receiving_failed(UUID cf_id)
 {
     return get_db().invoke_on_all([cf_id, plan_id = plan_id()] (database& db) {
@@ -482,6 +529,11 @@ void stream_session::close_session(stream_session_state final_state) {
                 receiving_failed(x.first);
                 task.abort();
             }
+            if (_sstable_receiver) {
+                _sstable_receiver->abort().handle_exception([plan_id = plan_id(), receiver = _sstable_receiver] (auto ep) {
+                    sslog.warn("[Stream #{}] Fail to remove the streamed sstables: {}", plan_id, ep);
+                });
+            }
             send_failed_complete_message();
         }
 
@@ -46,6 +46,7 @@
 #include "streaming/stream_session_state.hh"
 #include "streaming/stream_transfer_task.hh"
 #include "streaming/stream_receive_task.hh"
+#include "streaming/stream_sstable_receiver.hh"
 #include "streaming/stream_request.hh"
 #include "streaming/prepare_message.hh"
 #include "streaming/stream_detail.hh"
@@ -161,6 +162,8 @@ class stream_session : public enable_shared_from_this<stream_session> {
     std::map<UUID, stream_transfer_task> _transfers;
     // data receivers, filled after receiving prepare message
     std::map<UUID, stream_receive_task> _receivers;
+    // Created when the peer starts streaming whole sstables.
+    lw_shared_ptr<stream_sstable_receiver> _sstable_receiver;
     //private final StreamingMetrics metrics;
     /* can be null when session is created in remote */
     //private final StreamConnectionFactory factory;
@@ -255,6 +258,13 @@ class stream_session : public enable_shared_from_this<stream_session> {
      */
     void add_transfer_ranges(sstring keyspace, dht::token_range_vector ranges, std::vector<sstring> column_families);
 
+    /**
+     * Set up transfer of the data of the given sstables of the upload directory
+     * of the column family which fall in the ranges.
+     */
+    void add_transfer_sstables(sstring keyspace, sstring column_family, dht::token_range_vector ranges,
+            std::vector<sstables::entry_descriptor> sstables);
+
     std::vector<column_family*> get_column_family_stores(const sstring& keyspace, const std::vector<sstring>& column_families);
 
     void close_session(stream_session_state final_state);
@@ -332,6 +342,13 @@ class stream_session : public enable_shared_from_this<stream_session> {
 
     void receive_task_completed(UUID cf_id);
     void transfer_task_completed(UUID cf_id);
+
+    stream_sstable_receiver& get_sstable_receiver() {
+        if (!_sstable_receiver) {
+            _sstable_receiver = make_lw_shared<stream_sstable_receiver>(plan_id());
+        }
+        return *_sstable_receiver;
+    }
 private:
     void send_failed_complete_message();
     bool maybe_completed();
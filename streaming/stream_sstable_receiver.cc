@@ -0,0 +1,172 @@
+/*
+ * Copyright (C) 2017 ScyllaDB
+ */
+
+/*
+ * This file is part of Scylla.
+ *
+ * Scylla is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Scylla is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <boost/range/adaptor/map.hpp>
+#include <seastar/core/reactor.hh>
+#include "streaming/stream_sstable_receiver.hh"
+#include "streaming/stream_session.hh"
+#include "service/priority_manager.hh"
+#include "database.hh"
+#include "checked-file-impl.hh"
+#include "disk-error-handler.hh"
+#include "sstables/remove.hh"
+#include "log.hh"
+
+namespace streaming {
+
+extern logging::logger sslog;
+
+static constexpr size_t component_buffer_size = 128 * 1024;
+
+lw_shared_ptr<stream_sstable_receiver::receiving_sstable>
+stream_sstable_receiver::get_receiving(UUID cf_id, int64_t generation, const sstring& file_name) {
+    auto key = std::make_pair(cf_id, generation);
+    auto it = _receiving.find(key);
+    if (it != _receiving.end()) {
+        return it->second;
+    }
+    auto& cf = stream_session::get_local_db().find_column_family(cf_id);
+    // Only the version and the format of the sender's file name are used.
+    auto desc = sstables::entry_descriptor::make_descriptor(file_name);
+    auto rs = make_lw_shared<receiving_sstable>();
+    rs->schema = cf.schema();
+    rs->dir = cf.dir();
+    rs->generation = cf.reserve_sstable_generation();
+    rs->version = desc.version;
+    rs->format = desc.format;
+    rs->temporary_toc = sstables::sstable::filename(rs->dir, rs->schema->ks_name(), rs->schema->cf_name(),
+            rs->version, rs->generation, rs->format, sstables::sstable::component_type::TemporaryTOC);
+    sslog.debug("[Stream #{}] Receiving sstable {} of {}.{} as generation {}", _plan_id, file_name,
+            rs->schema->ks_name(), rs->schema->cf_name(), rs->generation);
+    _receiving.emplace(key, rs);
+    return rs;
+}
+
+future<> stream_sstable_receiver::write(UUID cf_id, int64_t generation, sstring file_name, sstring component, uint64_t offset, bytes data) {
+    auto rs = get_receiving(cf_id, generation, file_name);
+    auto it = rs->components.find(component);
+    future<lw_shared_ptr<receiving_sstable::component>> f = make_ready_future<lw_shared_ptr<receiving_sstable::component>>(nullptr);
+    if (it != rs->components.end()) {
+        f = make_ready_future<lw_shared_ptr<receiving_sstable::component>>(it->second);
+    } else {
+        if (rs->components.empty() && component != "TOC.txt") {
+            return make_exception_future<>(std::runtime_error(sprint("[Stream #%s] The TOC of %s was not received first", _plan_id, file_name)));
+        }
+        auto name = rs->components.empty()
+                ? rs->temporary_toc
+                : sstables::sstable::filename(rs->dir, rs->schema->ks_name(), rs->schema->cf_name(), rs->version, rs->generation, rs->format, component);
+        auto c = make_lw_shared<receiving_sstable::component>();
+        rs->components.emplace(component, c);
+        f = open_checked_file_dma(sstable_write_error_handler, name, open_flags::wo | open_flags::create | open_flags::exclusive).then([c] (file f) {
+            file_output_stream_options options;
+            options.buffer_size = component_buffer_size;
+            options.io_priority_class = service::get_local_streaming_write_priority();
+            c->out = make_file_output_stream(std::move(f), std::move(options));
+            c->opened = true;
+            return c;
+        });
+    }
+    return f.then([this, file_name = std::move(file_name), offset, data = std::move(data)] (lw_shared_ptr<receiving_sstable::component> c) {
+        if (c->written != offset) {
+            return make_exception_future<>(std::runtime_error(sprint("[Stream #%s] Received data of %s at offset %d, expected %d", _plan_id, file_name, offset, c->written)));
+        }
+        c->written += data.size();
+        return c->out.write(reinterpret_cast<const char*>(data.data()), data.size()).finally([c] { });
+    });
+}
+
+future<> stream_sstable_receiver::finish(UUID cf_id, int64_t generation) {
+    auto it = _receiving.find(std::make_pair(cf_id, generation));
+    if (it == _receiving.end()) {
+        return make_exception_future<>(std::runtime_error(sprint("[Stream #%s] Unknown streamed sstable of generation %d", _plan_id, generation)));
+    }
+    auto rs = it->second;
+    _receiving.erase(it);
+    return parallel_for_each(rs->components | boost::adaptors::map_values, [] (lw_shared_ptr<receiving_sstable::component> c) {
+        return c->out.flush().then([c] {
+            return c->out.close();
+        });
+    }).then([rs] {
+        return sstable_io_check(sstable_write_error_handler, sync_directory, rs->dir);
+    }).then([rs] {
+        auto toc = sstables::sstable::filename(rs->dir, rs->schema->ks_name(), rs->schema->cf_name(),
+                rs->version, rs->generation, rs->format, sstables::sstable::component_type::TOC);
+        return sstable_io_check(sstable_write_error_handler, [&] {
+            return engine().rename_file(rs->temporary_toc, toc);
+        });
+    }).then([rs] {
+        return sstable_io_check(sstable_write_error_handler, sync_directory, rs->dir);
+    }).then([this, rs, cf_id] {
+        _received[cf_id].emplace_back(rs->schema->ks_name(), rs->schema->cf_name(), rs->version, rs->generation,
+                rs->format, sstables::sstable::component_type::TOC);
+    });
+}
+
+future<> stream_sstable_receiver::load(UUID cf_id) {
+    auto it = _received.find(cf_id);
+    if (it == _received.end()) {
+        return make_ready_future<>();
+    }
+    auto sstables = std::move(it->second);
+    _received.erase(it);
+    auto& cf = stream_session::get_local_db().find_column_family(cf_id);
+    auto s = cf.schema();
+    sslog.info("[Stream #{}] Loading {} streamed sstables into {}.{}", _plan_id, sstables.size(), s->ks_name(), s->cf_name());
+    return distributed_loader::load_new_sstables(stream_session::get_db(), s->ks_name(), s->cf_name(), std::move(sstables));
+}
+
+future<> stream_sstable_receiver::abort() {
+    auto receiving = std::exchange(_receiving, {});
+    auto received = std::exchange(_received, {});
+    return parallel_for_each(receiving | boost::adaptors::map_values, [] (lw_shared_ptr<receiving_sstable> rs) {
+        return parallel_for_each(rs->components | boost::adaptors::map_values, [] (lw_shared_ptr<receiving_sstable::component> c) {
+            if (!c->opened) {
+                return make_ready_future<>();
+            }
+            return c->out.close().handle_exception([c] (auto ep) { });
+        }).then([rs] {
+            return file_exists(rs->temporary_toc);
+        }).then([rs] (bool exists) {
+            if (!exists) {
+                return make_ready_future<>();
+            }
+            return sstables::sstable::remove_sstable_with_temp_toc(rs->schema->ks_name(), rs->schema->cf_name(),
+                    rs->dir, rs->generation, rs->version, rs->format);
+        });
+    }).then([received = std::move(received)] () mutable {
+        return do_with(std::move(received), [] (auto& received) {
+            return parallel_for_each(received, [] (auto& e) {
+                auto& db = stream_session::get_local_db();
+                if (!db.column_family_exists(e.first)) {
+                    return make_ready_future<>();
+                }
+                auto& cf = db.find_column_family(e.first);
+                return parallel_for_each(e.second, [&cf] (const sstables::entry_descriptor& desc) {
+                    auto toc = sstables::sstable::filename(cf.dir(), desc.ks, desc.cf, desc.version, desc.generation,
+                            desc.format, sstables::sstable::component_type::TOC);
+                    return sstables::remove_by_toc_name(toc);
+                });
+            });
+        });
+    });
+}
+
+}
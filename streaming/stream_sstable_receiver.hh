@@ -0,0 +1,88 @@
+/*
+ * Copyright (C) 2017 ScyllaDB
+ */
+
+/*
+ * This file is part of Scylla.
+ *
+ * Scylla is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Scylla is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <map>
+#include <unordered_map>
+#include <vector>
+#include <seastar/core/fstream.hh>
+#include "bytes.hh"
+#include "schema.hh"
+#include "sstables/sstables.hh"
+#include "utils/UUID.hh"
+
+namespace streaming {
+
+/*
+ * Receives the sstables a peer streams whole, in a session.
+ *
+ * The components of a received sstable are written to the data directory
+ * of its table, under a generation of the receiving shard. The TOC comes
+ * first and is written as a temporary TOC, which is renamed once all the
+ * components were received, so that an sstable received in part is removed
+ * on the next boot. Received sstables are loaded into their table once all
+ * of its ranges were streamed, as nodetool refresh does, without going
+ * through memtables.
+ */
+class stream_sstable_receiver {
+    using UUID = utils::UUID;
+
+    struct receiving_sstable {
+        schema_ptr schema;
+        sstring dir;
+        int64_t generation;
+        sstables::sstable::version_types version;
+        sstables::sstable::format_types format;
+        struct component {
+            output_stream<char> out;
+            bool opened = false;
+            uint64_t written = 0;
+        };
+        std::map<sstring, lw_shared_ptr<component>> components;
+        // The name the TOC is written under until the sstable is complete.
+        sstring temporary_toc;
+    };
+
+    UUID _plan_id;
+    // By table and generation on the sender.
+    std::map<std::pair<UUID, int64_t>, lw_shared_ptr<receiving_sstable>> _receiving;
+    // Complete sstables, by table.
+    std::unordered_map<UUID, std::vector<sstables::entry_descriptor>> _received;
+private:
+    lw_shared_ptr<receiving_sstable> get_receiving(UUID cf_id, int64_t generation, const sstring& file_name);
+public:
+    explicit stream_sstable_receiver(UUID plan_id) : _plan_id(plan_id) { }
+
+    // Chunks of a component are received one after the other, in order.
+    future<> write(UUID cf_id, int64_t generation, sstring file_name, sstring component, uint64_t offset, bytes data);
+
+    // All the components of the sstable were received.
+    future<> finish(UUID cf_id, int64_t generation);
+
+    // Loads into the table the sstables received for it so far.
+    future<> load(UUID cf_id);
+
+    // Removes the sstables received and not loaded yet.
+    future<> abort();
+};
+
+}
@@ -52,6 +52,9 @@
 #include "service/storage_service.hh"
 #include <boost/icl/interval.hpp>
 #include <boost/icl/interval_set.hpp>
+#include <boost/algorithm/cxx11/any_of.hpp>
+#include "sstables/sstables.hh"
+#include "db/config.hh"
 
 namespace streaming {
 
@@ -65,6 +68,30 @@ stream_transfer_task::stream_transfer_task(shared_ptr<stream_session> session, U
 
 stream_transfer_task::~stream_transfer_task() = default;
 
+// Chunk in which the components of the sstables streamed whole are sent.
+static constexpr size_t sstable_chunk_size = 128 * 1024;
+
+// The sstables of the shard whose partitions all lie in the given ranges.
+// They are sent whole, and the receiver loads them as they are.
+static std::vector<sstables::shared_sstable> select_whole_sstables(const column_family& cf, const dht::token_range_vector& ranges) {
+    std::vector<sstables::shared_sstable> ret;
+    for (auto&& sst : *cf.get_sstables()) {
+        // A shared sstable also holds partitions of other shards, which read them on their own.
+        if (sst->is_shared()) {
+            continue;
+        }
+        auto& first = sst->get_first_decorated_key().token();
+        auto& last = sst->get_last_decorated_key().token();
+        auto contained = boost::algorithm::any_of(ranges, [&] (const dht::token_range& r) {
+            return r.contains(first, dht::token_comparator()) && r.contains(last, dht::token_comparator());
+        });
+        if (contained) {
+            ret.push_back(sst);
+        }
+    }
+    return ret;
+}
+
 struct send_info {
     database& db;
     utils::UUID plan_id;
@@ -75,10 +102,11 @@ struct send_info {
     size_t mutations_nr{0};
     semaphore mutations_done{0};
     bool error_logged = false;
+    std::vector<sstables::shared_sstable> sstables;
     mutation_reader reader;
     send_info(database& db_, utils::UUID plan_id_, utils::UUID cf_id_,
               dht::partition_range_vector prs_, netw::messaging_service::msg_addr id_,
-              uint32_t dst_cpu_id_)
+              uint32_t dst_cpu_id_, const dht::token_range_vector& ranges, bool whole_sstables)
         : db(db_)
         , plan_id(plan_id_)
         , cf_id(cf_id_)
@@ -86,15 +114,95 @@ struct send_info {
         , id(id_)
         , dst_cpu_id(dst_cpu_id_) {
         auto& cf = db.find_column_family(this->cf_id);
-        reader = cf.make_streaming_reader(cf.schema(), this->prs);
+        if (whole_sstables) {
+            sstables = select_whole_sstables(cf, ranges);
+        }
+        reader = sstables.empty()
+                ? cf.make_streaming_reader(cf.schema(), this->prs)
+                : cf.make_streaming_reader(cf.schema(), this->prs, sstables);
+    }
+    // Sends the data of the given sstables, which are not part of the column
+    // family, by mutations only.
+    send_info(database& db_, utils::UUID plan_id_, utils::UUID cf_id_,
+              dht::partition_range_vector prs_, netw::messaging_service::msg_addr id_,
+              uint32_t dst_cpu_id_, std::vector<sstables::shared_sstable> upload_sstables)
+        : db(db_)
+        , plan_id(plan_id_)
+        , cf_id(cf_id_)
+        , prs(std::move(prs_))
+        , id(id_)
+        , dst_cpu_id(dst_cpu_id_) {
+        auto& cf = db.find_column_family(this->cf_id);
+        reader = cf.make_streaming_reader_of(cf.schema(), this->prs, std::move(upload_sstables));
     }
 };
 
+static future<> send_sstable_component(lw_shared_ptr<send_info> si, int64_t generation, sstring file_name, sstring component) {
+    return open_file_dma(file_name, open_flags::ro).then([si, generation, file_name, component] (file f) {
+        return f.size().then([si, generation, f, file_name, component] (uint64_t size) mutable {
+            auto base_name = file_name.substr(file_name.find_last_of('/') + 1);
+            auto offset = make_lw_shared<uint64_t>(0);
+            return do_until([offset, size] { return *offset >= size; }, [si, generation, f, offset, size, base_name, component] () mutable {
+                auto len = std::min<uint64_t>(sstable_chunk_size, size - *offset);
+                return f.dma_read_exactly<char>(*offset, len, service::get_local_streaming_read_priority()).then(
+                        [si, generation, offset, base_name, component] (temporary_buffer<char> buf) {
+                    auto pos = *offset;
+                    auto len = buf.size();
+                    *offset += len;
+                    return get_local_stream_manager().throttle_send(si->id.addr, len).then([si, generation, base_name, component, pos, len, buf = std::move(buf)] {
+                        sslog.trace("[Stream #{}] SEND STREAM_SSTABLE_DATA to {}, {} at {}", si->plan_id, si->id, base_name, pos);
+                        return netw::get_local_messaging_service().send_stream_sstable_data(si->id, si->plan_id, si->cf_id, generation,
+                                base_name, component, pos, bytes(reinterpret_cast<const int8_t*>(buf.get()), len), si->dst_cpu_id);
+                    }).then([si, len] {
+                        get_local_stream_manager().update_progress(si->plan_id, si->id.addr, progress_info::direction::OUT, len);
+                    });
+                });
+            }).finally([f] () mutable {
+                return f.close().finally([f] { });
+            });
+        });
+    });
+}
+
+static future<> send_sstable(lw_shared_ptr<send_info> si, sstables::shared_sstable sst) {
+    auto components = sst->all_components();
+    // The receiver writes the TOC first, as a temporary one.
+    std::stable_partition(components.begin(), components.end(), [] (auto& c) {
+        return c.first == sstables::sstable::component_type::TOC;
+    });
+    auto s = si->db.find_column_family(si->cf_id).schema();
+    sslog.debug("[Stream #{}] Sending sstable {} whole to {}", si->plan_id, sst->get_filename(), si->id);
+    return do_with(std::move(components), [si, sst, s] (auto& components) {
+        return do_for_each(components, [si, sst, s] (auto& c) {
+            auto file_name = sstables::sstable::filename(sst->get_dir(), s->ks_name(), s->cf_name(), sst->get_version(),
+                    sst->generation(), sst->get_format(), c.second);
+            return send_sstable_component(si, sst->generation(), std::move(file_name), c.second);
+        });
+    }).then([si, sst] {
+        sslog.debug("[Stream #{}] SEND STREAM_SSTABLE_DONE to {}, generation={}", si->plan_id, si->id, sst->generation());
+        return netw::get_local_messaging_service().send_stream_sstable_done(si->id, si->plan_id, si->cf_id, sst->generation(), si->dst_cpu_id);
+    });
+}
+
+future<> send_sstables(lw_shared_ptr<send_info> si) {
+    return do_for_each(si->sstables, [si] (sstables::shared_sstable sst) {
+        if (!si->db.column_family_exists(si->cf_id)) {
+            return make_ready_future<>();
+        }
+        return send_sstable(si, std::move(sst));
+    }).handle_exception([si] (auto ep) {
+        sslog.warn("[Stream #{}] stream_transfer_task: Fail to send sstables to {}: {}", si->plan_id, si->id, ep);
+        return make_exception_future<>(ep);
+    });
+}
+
 future<> do_send_mutations(lw_shared_ptr<send_info> si, frozen_mutation fm, bool fragmented) {
     return get_local_stream_manager().mutation_send_limiter().wait().then([si, fragmented, fm = std::move(fm)] () mutable {
-        sslog.debug("[Stream #{}] SEND STREAM_MUTATION to {}, cf_id={}", si->plan_id, si->id, si->cf_id);
         auto fm_size = fm.representation().size();
-        netw::get_local_messaging_service().send_stream_mutation(si->id, si->plan_id, std::move(fm), si->dst_cpu_id, fragmented).then([si, fm_size] {
+        get_local_stream_manager().throttle_send(si->id.addr, fm_size).then([si, fragmented, fm = std::move(fm)] () mutable {
+            sslog.debug("[Stream #{}] SEND STREAM_MUTATION to {}, cf_id={}", si->plan_id, si->id, si->cf_id);
+            return netw::get_local_messaging_service().send_stream_mutation(si->id, si->plan_id, std::move(fm), si->dst_cpu_id, fragmented);
+        }).then([si, fm_size] {
             sslog.debug("[Stream #{}] GOT STREAM_MUTATION Reply from {}", si->plan_id, si->id.addr);
             get_local_stream_manager().update_progress(si->plan_id, si->id.addr, progress_info::direction::OUT, fm_size);
             si->mutations_done.signal();
@@ -114,17 +222,22 @@ future<> do_send_mutations(lw_shared_ptr<send_info> si, frozen_mutation fm, bool
 
 future<> send_mutations(lw_shared_ptr<send_info> si) {
     return repeat([si] () {
-        return si->reader().then([si] (auto smopt) {
+        return service::throttle(service::get_local_streaming_cpu()).then([si] {
+            return si->reader();
+        }).then([si] (auto smopt) {
             if (smopt && si->db.column_family_exists(si->cf_id)) {
                 size_t fragment_size = default_frozen_fragment_size;
                 // Mutations cannot be sent fragmented if the receiving side doesn't support that.
                 if (!service::get_local_storage_service().cluster_supports_large_partitions()) {
                     fragment_size = std::numeric_limits<size_t>::max();
                 }
-                return fragment_and_freeze(std::move(*smopt), [si] (auto fm, bool fragmented) {
-                    si->mutations_nr++;
-                    return do_send_mutations(si, std::move(fm), fragmented);
-                }, fragment_size).then([] { return stop_iteration::no; });
+                auto f = service::get_local_streaming_cpu().run([&] {
+                    return fragment_and_freeze(std::move(*smopt), [si] (auto fm, bool fragmented) {
+                        si->mutations_nr++;
+                        return do_send_mutations(si, std::move(fm), fragmented);
+                    }, fragment_size);
+                });
+                return f.then([] { return stop_iteration::no; });
             } else {
                 return make_ready_future<stop_iteration>(stop_iteration::yes);
             }
@@ -146,9 +259,24 @@ void stream_transfer_task::start() {
     parallel_for_each(_shard_ranges, [this, dst_cpu_id, plan_id, cf_id, id] (auto& item) {
         auto& shard = item.first;
         auto& prs = item.second;
-        return session->get_db().invoke_on(shard, [plan_id, cf_id, id, dst_cpu_id, prs = std::move(prs)] (database& db) mutable {
-            auto si = make_lw_shared<send_info>(db, plan_id, cf_id, prs, id, dst_cpu_id);
-            return send_mutations(std::move(si));
+        if (!_upload_sstables.empty()) {
+            // Every shard reads its share of the ranges out of all the
+            // sstables, so they are never sent whole.
+            return session->get_db().invoke_on(shard, [plan_id, cf_id, id, dst_cpu_id, prs = std::move(prs), upload = _upload_sstables] (database& db) mutable {
+                auto& cf = db.find_column_family(cf_id);
+                return cf.open_upload_sstables(std::move(upload)).then([&db, plan_id, cf_id, id, dst_cpu_id, prs = std::move(prs)] (auto ssts) mutable {
+                    auto si = make_lw_shared<send_info>(db, plan_id, cf_id, std::move(prs), id, dst_cpu_id, std::move(ssts));
+                    return send_mutations(si);
+                });
+            });
+        }
+        return session->get_db().invoke_on(shard, [plan_id, cf_id, id, dst_cpu_id, prs = std::move(prs), ranges = _ranges] (database& db) mutable {
+            auto whole_sstables = db.get_config().enable_sstable_streaming()
+                    && service::get_local_storage_service().cluster_supports_sstable_streaming();
+            auto si = make_lw_shared<send_info>(db, plan_id, cf_id, prs, id, dst_cpu_id, ranges, whole_sstables);
+            return send_sstables(si).then([si] {
+                return send_mutations(si);
+            });
         });
     }).then([this, plan_id, cf_id, id] {
         sslog.debug("[Stream #{}] SEND STREAM_MUTATION_DONE to {}, cf_id={}", plan_id, id, cf_id);
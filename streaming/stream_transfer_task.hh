@@ -41,6 +41,7 @@
 #include "utils/UUID.hh"
 #include "streaming/stream_task.hh"
 #include "streaming/stream_detail.hh"
+#include "sstables/sstables.hh"
 #include <map>
 #include <seastar/core/semaphore.hh>
 
@@ -59,6 +60,9 @@ class stream_transfer_task : public stream_task {
     // A stream_transfer_task always contains the same range to stream
     dht::token_range_vector _ranges;
     std::map<unsigned, dht::partition_range_vector> _shard_ranges;
+    // When set, the data sent is that of these sstables of the upload
+    // directory, instead of the one of the column family.
+    std::vector<sstables::entry_descriptor> _upload_sstables;
     long _total_size;
 public:
     using UUID = utils::UUID;
@@ -80,6 +84,9 @@ class stream_transfer_task : public stream_task {
     void start();
 
     void append_ranges(const dht::token_range_vector& ranges);
+    void set_upload_sstables(std::vector<sstables::entry_descriptor> sstables) {
+        _upload_sstables = std::move(sstables);
+    }
     void sort_and_merge_ranges();
 };
 
@@ -63,6 +63,14 @@ boost_tests = [
     'batchlog_manager_test',
     'logalloc_test',
     'log_heap_test',
+    'top_k_test',
+    'tournament_tree_test',
+    'token_bucket_test',
+    'cpu_quota_group_test',
+    'replica_latency_tracker_test',
+    'time_decaying_histogram_test',
+    'log_linear_histogram_test',
+    'cost_accountant_test',
     'crc_test',
     'flush_queue_test',
     'config_test',
@@ -22,6 +22,7 @@
 
 #include <boost/test/unit_test.hpp>
 #include <boost/range/adaptor/map.hpp>
+#include <boost/range/irange.hpp>
 
 #include <stdlib.h>
 #include <iostream>
@@ -32,6 +33,7 @@
 #include "tests/test-utils.hh"
 #include "core/future-util.hh"
 #include "core/do_with.hh"
+#include "core/sleep.hh"
 #include "core/scollectd_api.hh"
 #include "core/file.hh"
 #include "core/reactor.hh"
@@ -223,6 +225,54 @@ SEASTAR_TEST_CASE(test_commitlog_discard_completed_segments){
         });
 }
 
+SEASTAR_TEST_CASE(test_commitlog_recycled_segments){
+    commitlog::config cfg;
+    cfg.commitlog_segment_size_in_mb = 1;
+    cfg.max_reserve_segments = 1;
+    cfg.max_recycled_segments = 2;
+    return cl_test(cfg, [](commitlog& log) {
+        static auto fill = [] (commitlog& log, utils::UUID uuid, rp_set& set, size_t segments) {
+            auto created = log.get_num_segments_created();
+            return do_until([&log, created, segments] { return log.get_num_segments_created() >= created + segments; }, [&log, &set, uuid] {
+                sstring tmp = "hej bubba cow";
+                return log.add_mutation(uuid, tmp.size(), [tmp](db::commitlog::output& dst) {
+                    dst.write(tmp.begin(), tmp.end());
+                }).then([&set](rp_handle h) {
+                    set.put(std::move(h));
+                });
+            });
+        };
+        return do_with(rp_set(), rp_set(), [&log](auto& first, auto& second) {
+            auto uuid1 = utils::UUID_gen::get_time_UUID();
+            auto uuid2 = utils::UUID_gen::get_time_UUID();
+            return fill(log, uuid1, first, 3).then([&log] {
+                return log.sync_all_segments();
+            }).then([&log, &first, uuid1] {
+                log.discard_completed_segments(uuid1, first);
+                // Recycling the files is done in the background.
+                return sleep(std::chrono::milliseconds(100));
+            }).then([&log, &second, uuid2] {
+                // Takes the reserve, then the recycled files.
+                return fill(log, uuid2, second, 3);
+            }).then([&log] {
+                return log.sync_all_segments();
+            }).then([&log] {
+                // The previous data of the recycled files must be seen as the end of the segment, not as corruption.
+                return do_for_each(log.get_active_segment_names(), [] (sstring seg) {
+                    return db::commitlog::read_log_file(seg, [](temporary_buffer<char> buf, db::replay_position rp) {
+                        BOOST_CHECK_EQUAL(sstring(buf.get(), buf.size()), "hej bubba cow");
+                        return make_ready_future<>();
+                    }).then([](auto s) {
+                        return do_with(std::move(s), [](auto& s) {
+                            return s->done();
+                        });
+                    });
+                });
+            });
+        });
+    });
+}
+
 SEASTAR_TEST_CASE(test_equal_record_limit){
     return cl_test([](commitlog& log) {
             auto size = log.max_record_size();
@@ -358,6 +408,55 @@ SEASTAR_TEST_CASE(test_commitlog_reader){
         });
 }
 
+static future<> test_commitlog_compressed_entries(compressor c) {
+    commitlog::config cfg;
+    cfg.mode = commitlog::sync_mode::BATCH;
+    cfg.batch_window = std::chrono::microseconds(100);
+    cfg.compression = c;
+    return cl_test(cfg, [](commitlog& log) {
+        auto uuid = utils::UUID_gen::get_time_UUID();
+        auto tmp = make_lw_shared<sstring>();
+        for (int i = 0; i < 100; ++i) {
+            *tmp += "hej bubba cow ";
+        }
+        auto n = 10;
+        auto set = make_lw_shared<rp_set>();
+        // All of them are written during the same batch window.
+        return parallel_for_each(boost::irange(0, n), [&log, uuid, tmp, set] (int) {
+            return log.add_mutation(uuid, tmp->size(), [tmp](db::commitlog::output& dst) {
+                dst.write(tmp->begin(), tmp->end());
+            }).then([set] (db::rp_handle h) {
+                set->put(std::move(h));
+            });
+        }).then([&log, tmp, n, set] {
+            auto segments = log.get_active_segment_names();
+            BOOST_REQUIRE(!segments.empty());
+            auto count = make_lw_shared<int>(0);
+            return do_for_each(segments, [tmp, count] (sstring seg) {
+                return db::commitlog::read_log_file(seg, [tmp, count](temporary_buffer<char> buf, db::replay_position rp) {
+                    BOOST_CHECK_EQUAL(sstring(buf.get(), buf.size()), *tmp);
+                    ++*count;
+                    return make_ready_future<>();
+                }).then([](auto s) {
+                    return do_with(std::move(s), [](auto& s) {
+                        return s->done();
+                    });
+                });
+            }).then([count, n] {
+                BOOST_CHECK_EQUAL(*count, n);
+            });
+        });
+    });
+}
+
+SEASTAR_TEST_CASE(test_commitlog_lz4_entries){
+    return test_commitlog_compressed_entries(compressor::lz4);
+}
+
+SEASTAR_TEST_CASE(test_commitlog_zstd_entries){
+    return test_commitlog_compressed_entries(compressor::zstd);
+}
+
 static future<> corrupt_segment(sstring seg, uint64_t off, uint32_t value) {
     return open_file_dma(seg, open_flags::rw).then([off, value](file f) {
         size_t size = align_up<size_t>(off, 4096);
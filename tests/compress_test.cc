@@ -145,3 +145,51 @@ BOOST_AUTO_TEST_CASE(segmented_offsets_corner_cases) {
     BOOST_REQUIRE(offsets.at(4079) == 4079);
     BOOST_REQUIRE(offsets.at(4080) == 4080);
 }
+
+BOOST_AUTO_TEST_CASE(checksum_adler32_vs_zlib) {
+    // s2 is reduced every 5552 bytes, and saturates soonest with 0xff bytes.
+    for (auto fill : { 0x5a, 0xff }) {
+        std::vector<char> buf(3 * 5552 + 100, char(fill));
+        for (size_t i = 0; i < buf.size(); i += 7) {
+            buf[i] = char(i);
+        }
+        for (size_t size : { 0ul, 1ul, 31ul, 32ul, 33ul, 5536ul, 5552ul, 11104ul, 3 * 5552ul + 99 }) {
+            auto expected = adler32(adler32(0, Z_NULL, 0), reinterpret_cast<const unsigned char*>(buf.data() + 1), size);
+            BOOST_REQUIRE_EQUAL(checksum_adler32(buf.data() + 1, size), expected);
+            auto partial = checksum_adler32(buf.data() + 1, size / 2);
+            BOOST_REQUIRE_EQUAL(checksum_adler32(partial, buf.data() + 1 + size / 2, size - size / 2), expected);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(chunk_length_advisor_follows_read_sizes) {
+    using sstables::chunk_length_advisor;
+    chunk_length_advisor advisor;
+    auto table = utils::make_random_uuid();
+    constexpr uint32_t default_length = 16 * 1024;
+
+    for (uint64_t i = 1; i < chunk_length_advisor::min_reads; ++i) {
+        advisor.record_read(table, 200);
+    }
+    BOOST_REQUIRE_EQUAL(advisor.chunk_length(table, default_length), default_length);
+    advisor.record_read(table, 200);
+    BOOST_REQUIRE_EQUAL(advisor.chunk_length(table, default_length), chunk_length_advisor::min_chunk_length);
+
+    // A few scans don't outweigh the point reads.
+    for (auto i = 0; i < 10; ++i) {
+        advisor.record_read(table, 100 << 20);
+    }
+    BOOST_REQUIRE_EQUAL(advisor.chunk_length(table, default_length), chunk_length_advisor::min_chunk_length);
+
+    for (auto i = 0; i < 10000; ++i) {
+        advisor.record_read(table, 20 * 1024);
+    }
+    BOOST_REQUIRE_EQUAL(advisor.chunk_length(table, default_length), 32 * 1024);
+
+    for (auto i = 0; i < 10000; ++i) {
+        advisor.record_read(table, 100 << 20);
+    }
+    BOOST_REQUIRE_EQUAL(advisor.chunk_length(table, default_length), chunk_length_advisor::max_chunk_length);
+
+    BOOST_REQUIRE_EQUAL(advisor.chunk_length(utils::make_random_uuid(), default_length), default_length);
+}
@@ -0,0 +1,95 @@
+/*
+ * Copyright (C) 2018 ScyllaDB
+ */
+
+/*
+ * This file is part of Scylla.
+ *
+ * Scylla is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Scylla is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <boost/test/unit_test.hpp>
+#include <seastar/core/file.hh>
+#include <seastar/core/reactor.hh>
+#include <seastar/core/thread.hh>
+#include "seastarx.hh"
+#include "tests/test-utils.hh"
+#include "tmpdir.hh"
+#include "utils/cost_accountant.hh"
+#include "utils/UUID_gen.hh"
+
+#include "disk-error-handler.hh"
+
+thread_local disk_error_signal_type commit_error;
+thread_local disk_error_signal_type general_disk_error;
+
+using namespace std::chrono_literals;
+
+static void spin(utils::cost_accountant::clock::duration d) {
+    auto end = utils::cost_accountant::clock::now() + d;
+    while (utils::cost_accountant::clock::now() < end) { }
+}
+
+SEASTAR_TEST_CASE(test_nested_guards_charge_their_own_time) {
+    return seastar::async([] {
+        auto& accountant = utils::cost_accountant::local();
+        auto id1 = utils::UUID_gen::get_time_UUID();
+        auto id2 = utils::UUID_gen::get_time_UUID();
+        auto t1 = accountant.table(id1);
+        auto t2 = accountant.table(id2);
+        auto r = accountant.role("test_role");
+        BOOST_REQUIRE(accountant.find_table(id1) == t1);
+
+        {
+            utils::cost_guard outer(t1.get(), r.get());
+            spin(2ms);
+            {
+                utils::cost_guard inner(t2.get());
+                spin(5ms);
+            }
+            spin(2ms);
+        }
+        spin(2ms);
+
+        BOOST_REQUIRE_GE(t1->cpu_time, 4ms);
+        BOOST_REQUIRE_GE(t2->cpu_time, 5ms);
+        // The role isn't switched by the inner guard, while the outer
+        // table is, and nothing is charged past the outer guard.
+        BOOST_REQUIRE_GE(r->cpu_time, 9ms);
+        BOOST_REQUIRE_LE(t1->cpu_time + t2->cpu_time, r->cpu_time);
+
+        accountant.forget_table(id1);
+        BOOST_REQUIRE(!accountant.find_table(id1));
+        accountant.forget_table(id2);
+    });
+}
+
+SEASTAR_TEST_CASE(test_accounting_file_counts_bytes) {
+    return seastar::async([] {
+        auto tmp = make_lw_shared<tmpdir>();
+        auto u = make_lw_shared<utils::cost_accountant::usage>();
+        auto name = tmp->path + "/f";
+        auto f = utils::make_cost_accounting_file(open_file_dma(name, open_flags::create | open_flags::rw).get0(), u);
+
+        auto buf = temporary_buffer<char>::aligned(f.memory_dma_alignment(), 4096);
+        std::fill(buf.get_write(), buf.get_write() + buf.size(), 'a');
+        BOOST_REQUIRE_EQUAL(f.dma_write(0, buf.get(), buf.size()).get0(), buf.size());
+        BOOST_REQUIRE_EQUAL(u->written_bytes, 4096);
+
+        auto read = f.dma_read_exactly<char>(0, 4096).get0();
+        BOOST_REQUIRE_EQUAL(read.size(), 4096);
+        BOOST_REQUIRE_EQUAL(u->read_bytes, 4096);
+        f.close().get();
+    });
+}
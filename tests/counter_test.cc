@@ -20,6 +20,7 @@
  */
 
 #include "counters.hh"
+#include "counter_cache.hh"
 
 #include <random>
 
@@ -465,6 +466,79 @@ SEASTAR_TEST_CASE(test_transfer_updates_to_shards) {
     });
 }
 
+SEASTAR_TEST_CASE(test_counter_cache) {
+    return seastar::async([] {
+        auto s = get_schema();
+
+        auto pk = partition_key::from_single_value(*s, int32_type->decompose(0));
+        auto ck = clustering_key::from_single_value(*s, int32_type->decompose(0));
+        auto& col = *s->get_column_definition(utf8_type->decompose(sstring("c1")));
+        auto& scol = *s->get_column_definition(utf8_type->decompose(sstring("s1")));
+
+        auto make_update = [&] (int64_t c, int64_t sc) {
+            mutation m(pk, s);
+            m.set_clustered_cell(ck, col, atomic_cell::make_live_counter_update(api::new_timestamp(), c));
+            m.set_static_cell(scol, atomic_cell::make_live_counter_update(api::new_timestamp(), sc));
+            return m;
+        };
+
+        counter_cache cache(1024 * 1024);
+
+        auto m1 = make_update(5, 4);
+        auto update = m1;
+        BOOST_REQUIRE(!transform_counter_updates_to_shards(m1, cache, 0, 0));
+        BOOST_REQUIRE_EQUAL(m1, update);
+        transform_counter_updates_to_shards(m1, nullptr, 0);
+        update_counter_cache(m1, cache, 0);
+        BOOST_REQUIRE_EQUAL(cache.size(), 2);
+
+        // The cache gives the same shards as reading m1 does.
+        auto m2 = make_update(9, 8);
+        auto expected = m2;
+        transform_counter_updates_to_shards(expected, &m1, 0);
+        BOOST_REQUIRE(transform_counter_updates_to_shards(m2, cache, 0, 0));
+        BOOST_REQUIRE_EQUAL(m2, expected);
+        BOOST_REQUIRE_EQUAL(counter_cell_view(get_counter_cell(m2)).total_value(), 14);
+        BOOST_REQUIRE_EQUAL(counter_cell_view(get_static_counter_cell(m2)).total_value(), 12);
+        update_counter_cache(m2, cache, 0);
+
+        // A bumped generation makes the cache miss...
+        auto m3 = make_update(1, 1);
+        BOOST_REQUIRE(!transform_counter_updates_to_shards(m3, cache, 1, 0));
+        BOOST_REQUIRE_EQUAL(cache.size(), 1);
+
+        // ...and so does a cell dropped after a failed apply.
+        update_counter_cache(m2, cache, 1);
+        invalidate_counter_cache(m2, cache);
+        BOOST_REQUIRE_EQUAL(cache.size(), 0);
+        BOOST_REQUIRE(!transform_counter_updates_to_shards(m3, cache, 1, 0));
+
+        // A cache with no memory caches nothing.
+        counter_cache disabled(0);
+        update_counter_cache(m2, disabled, 0);
+        BOOST_REQUIRE_EQUAL(disabled.size(), 0);
+        BOOST_REQUIRE_EQUAL(disabled.memory_used(), 0);
+
+        // The least recently used cells are evicted first.
+        auto key = [&] (int32_t i) {
+            auto ck = clustering_key::from_single_value(*s, int32_type->decompose(i));
+            return counter_cache::make_key(*s, pk, &ck, col.id);
+        };
+        cache.put(key(0), 0, counter_cache::cell{1, 1});
+        auto entry_size = cache.memory_used();
+        counter_cache lru(2 * entry_size);
+        lru.put(key(0), 0, counter_cache::cell{1, 1});
+        lru.put(key(1), 0, counter_cache::cell{2, 1});
+        BOOST_REQUIRE(lru.get(key(0), 0));
+        lru.put(key(2), 0, counter_cache::cell{3, 1});
+        BOOST_REQUIRE_EQUAL(lru.size(), 2);
+        BOOST_REQUIRE_EQUAL(lru.memory_used(), 2 * entry_size);
+        BOOST_REQUIRE(!lru.get(key(1), 0));
+        BOOST_REQUIRE_EQUAL(lru.get(key(0), 0)->value, 1);
+        BOOST_REQUIRE_EQUAL(lru.get(key(2), 0)->value, 3);
+    });
+}
+
 SEASTAR_TEST_CASE(test_sanitize_corrupted_cells) {
     return seastar::async([] {
         std::random_device rd;
@@ -0,0 +1,75 @@
+/*
+ * Copyright (C) 2017 ScyllaDB
+ */
+
+/*
+ * This file is part of Scylla.
+ *
+ * Scylla is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Scylla is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#define BOOST_TEST_MODULE core
+
+#include <boost/test/unit_test.hpp>
+#include <chrono>
+
+#include "utils/cpu_quota_group.hh"
+
+using namespace std::chrono_literals;
+using group = utils::cpu_quota_group<>;
+
+static group::duration d(std::chrono::microseconds us) {
+    return std::chrono::duration_cast<group::duration>(us);
+}
+
+BOOST_AUTO_TEST_CASE(test_unlimited_group_never_waits) {
+    auto now = group::clock::now();
+    group g(d(1000us), 1, now);
+    g.account(d(10000us));
+    BOOST_REQUIRE(g.delay(now) == group::duration(0));
+    BOOST_REQUIRE(g.runtime() == d(10000us));
+}
+
+BOOST_AUTO_TEST_CASE(test_group_waits_for_its_quota) {
+    auto now = group::clock::now();
+    group g(d(1000us), 0.25, now);
+    g.account(d(100us));
+    // 100us is a quarter of 400us.
+    BOOST_REQUIRE(g.delay(now + d(100us)) == d(300us));
+    BOOST_REQUIRE(g.delay(now + d(400us)) == group::duration(0));
+    g.account(d(200us));
+    BOOST_REQUIRE(g.delay(now + d(400us)) == d(800us));
+    BOOST_REQUIRE(g.runtime() == d(300us));
+}
+
+BOOST_AUTO_TEST_CASE(test_idling_is_bounded) {
+    auto now = group::clock::now();
+    group g(d(1000us), 0.5, now);
+    // A new period starts once the work is within its quota after one.
+    BOOST_REQUIRE(g.delay(now + 1h) == group::duration(0));
+    g.account(d(1000us));
+    BOOST_REQUIRE(g.delay(now + 1h) == d(2000us));
+}
+
+BOOST_AUTO_TEST_CASE(test_run_accounts_its_time) {
+    group g(d(1000us), 0.5);
+    auto r = g.run([] {
+        auto start = group::clock::now();
+        while (group::clock::now() - start < 1ms) { }
+        return 7;
+    });
+    BOOST_REQUIRE_EQUAL(r, 7);
+    BOOST_REQUIRE(g.runtime() >= d(1000us));
+}
@@ -36,6 +36,8 @@
 #include "utils/big_decimal.hh"
 
 #include "disk-error-handler.hh"
+#include "db/config.hh"
+#include "service/storage_proxy.hh"
 
 thread_local disk_error_signal_type commit_error;
 thread_local disk_error_signal_type general_disk_error;
@@ -2413,3 +2415,588 @@ SEASTAR_TEST_CASE(test_secondary_index_query) {
         });
     });
 }
+
+SEASTAR_TEST_CASE(test_secondary_index_paging) {
+    return do_with_cql_env([] (auto& e) {
+        return seastar::async([&e] {
+            e.execute_cql("CREATE TABLE sip (p int, c int, v int, PRIMARY KEY (p, c));").get();
+            e.execute_cql("CREATE INDEX ON sip (v);").get();
+            std::vector<std::pair<int32_t, int32_t>> expected;
+            for (int32_t p = 0; p < 3; ++p) {
+                for (int32_t c = 0; c < 10; ++c) {
+                    e.execute_cql(sprint("insert into sip (p, c, v) values (%d, %d, %d);", p, c, c % 2)).get();
+                    if (c % 2) {
+                        expected.emplace_back(p, c);
+                    }
+                }
+            }
+
+            auto read = [&e] (int32_t page_size) {
+                std::vector<std::pair<int32_t, int32_t>> keys;
+                ::shared_ptr<service::pager::paging_state> paging_state;
+                do {
+                    auto qo = std::make_unique<cql3::query_options>(db::consistency_level::LOCAL_ONE, std::vector<cql3::raw_value>{},
+                            cql3::query_options::specific_options{page_size, paging_state, {}, api::new_timestamp()});
+                    auto msg = e.execute_cql("select p, c from sip where v = 1;", std::move(qo)).get0();
+                    auto rows = dynamic_pointer_cast<cql_transport::messages::result_message::rows>(msg);
+                    BOOST_REQUIRE(rows);
+                    if (page_size > 0) {
+                        BOOST_REQUIRE_LE(rows->rs().rows().size(), size_t(page_size));
+                    }
+                    for (auto&& row : rows->rs().rows()) {
+                        keys.emplace_back(value_cast<int32_t>(int32_type->deserialize(*row[0])), value_cast<int32_t>(int32_type->deserialize(*row[1])));
+                    }
+                    auto state = rows->rs().get_metadata().paging_state();
+                    paging_state = state ? service::pager::paging_state::deserialize(state->serialize()) : nullptr;
+                } while (paging_state);
+                std::sort(keys.begin(), keys.end());
+                return keys;
+            };
+
+            BOOST_REQUIRE(read(-1) == expected);
+            BOOST_REQUIRE(read(4) == expected);
+            assert_that(e.execute_cql("select count(*) from sip where v = 0;").get0())
+                .is_rows().with_rows({{ {long_type->decompose(int64_t(15))} }});
+            assert_that(e.execute_cql("select c from sip where v = 1 limit 3;").get0())
+                .is_rows().with_size(3);
+        });
+    });
+}
+
+SEASTAR_TEST_CASE(test_local_secondary_index) {
+    return do_with_cql_env([] (auto& e) {
+        return seastar::async([&e] {
+            e.execute_cql("CREATE TABLE lsi (p int, c int, v int, PRIMARY KEY (p, c));").get();
+            BOOST_REQUIRE_THROW(e.execute_cql("CREATE INDEX ON lsi ((c), v);").get(), exceptions::invalid_request_exception);
+            BOOST_REQUIRE_THROW(e.execute_cql("CREATE INDEX ON lsi ((p), p);").get(), exceptions::invalid_request_exception);
+            e.execute_cql("CREATE INDEX lsi_v ON lsi ((p), v);").get();
+
+            // The index is partitioned like the table.
+            auto view = e.local_db().find_schema("ks", "lsi_v_index");
+            BOOST_REQUIRE_EQUAL(view->partition_key_size(), 1u);
+            BOOST_REQUIRE_EQUAL(view->partition_key_columns().begin()->name_as_text(), "p");
+            BOOST_REQUIRE_EQUAL(view->clustering_key_columns().begin()->name_as_text(), "v");
+
+            for (int32_t p = 0; p < 3; ++p) {
+                for (int32_t c = 0; c < 5; ++c) {
+                    e.execute_cql(sprint("insert into lsi (p, c, v) values (%d, %d, %d);", p, c, c % 2)).get();
+                }
+            }
+
+            assert_that(e.execute_cql("select c from lsi where p = 1 and v = 1;").get0())
+                .is_rows().with_rows({{ {int32_type->decompose(1)} }, { {int32_type->decompose(3)} }});
+            assert_that(e.execute_cql("select p, c from lsi where v = 0;").get0())
+                .is_rows().with_size(9);
+
+            // The index is updated with the write of the table.
+            e.execute_cql("update lsi set v = 1 where p = 1 and c = 0;").get();
+            assert_that(e.execute_cql("select c from lsi where p = 1 and v = 1;").get0())
+                .is_rows().with_rows({{ {int32_type->decompose(0)} }, { {int32_type->decompose(1)} }, { {int32_type->decompose(3)} }});
+            assert_that(e.execute_cql("select c from lsi where p = 1 and v = 0;").get0())
+                .is_rows().with_rows({{ {int32_type->decompose(2)} }, { {int32_type->decompose(4)} }});
+        });
+    });
+}
+
+SEASTAR_TEST_CASE(test_aggregates_over_token_ranges) {
+    return do_with_cql_env([] (auto& e) {
+        return seastar::async([&e] {
+            e.execute_cql("CREATE TABLE agg (p int, c int, v int, PRIMARY KEY (p, c));").get();
+            assert_that(e.execute_cql("select count(*), min(v), max(v) from agg;").get0())
+                .is_rows().with_rows({{ {long_type->decompose(int64_t(0))}, {}, {} }});
+
+            // More partitions than are read by the replicas at a time.
+            int32_t sum = 0;
+            for (int32_t p = 0; p < 250; ++p) {
+                for (int32_t c = 0; c < 2; ++c) {
+                    e.execute_cql(sprint("insert into agg (p, c, v) values (%d, %d, %d);", p, c, p + c)).get();
+                    sum += p + c;
+                }
+            }
+            e.execute_cql("insert into agg (p, c) values (1000, 0);").get();
+
+            assert_that(e.execute_cql("select count(*), count(v), sum(v), min(v), max(v) from agg;").get0())
+                .is_rows().with_rows({{
+                    {long_type->decompose(int64_t(501))},
+                    {long_type->decompose(int64_t(500))},
+                    {int32_type->decompose(sum)},
+                    {int32_type->decompose(0)},
+                    {int32_type->decompose(250)},
+                }});
+            assert_that(e.execute_cql("select count(*) from agg where token(p) > 0;").get0())
+                .is_rows().with_size(1);
+            assert_that(e.execute_cql("select avg(v) from agg;").get0())
+                .is_rows().with_rows({{ {int32_type->decompose(sum / 500)} }});
+        });
+    });
+}
+
+SEASTAR_TEST_CASE(test_aggregates_of_fixed_width_types) {
+    return do_with_cql_env_thread([] (auto& e) {
+        e.execute_cql("create table fw (p int, c int, b bigint, d double, primary key (p, c));").get();
+        // More rows than an aggregate is given at a time, some of them null.
+        int64_t sum = 0;
+        for (int32_t c = 0; c < 600; ++c) {
+            if (c % 7) {
+                e.execute_cql(sprint("insert into fw (p, c, b, d) values (0, %d, %d, %d.5);", c, c - 300, c)).get();
+                sum += c - 300;
+            } else {
+                e.execute_cql(sprint("insert into fw (p, c) values (0, %d);", c)).get();
+            }
+        }
+        assert_that(e.execute_cql("select count(b), sum(b), min(b), max(b), min(d), max(d) from fw;").get0())
+            .is_rows().with_rows({{
+                {long_type->decompose(int64_t(514))},
+                {long_type->decompose(sum)},
+                {long_type->decompose(int64_t(-299))},
+                {long_type->decompose(int64_t(299))},
+                {double_type->decompose(1.5)},
+                {double_type->decompose(599.5)},
+            }});
+    });
+}
+
+SEASTAR_TEST_CASE(test_group_by_and_per_partition_limit) {
+    return do_with_cql_env([] (auto& e) {
+        return seastar::async([&e] {
+            e.execute_cql("CREATE TABLE gb (p int, c1 int, c2 int, v int, PRIMARY KEY (p, c1, c2));").get();
+            for (int32_t p = 0; p < 2; ++p) {
+                for (int32_t c1 = 0; c1 < 2; ++c1) {
+                    for (int32_t c2 = 0; c2 < 3; ++c2) {
+                        e.execute_cql(sprint("insert into gb (p, c1, c2, v) values (%d, %d, %d, %d);", p, c1, c2, c2)).get();
+                    }
+                }
+            }
+
+            assert_that(e.execute_cql("select p, count(*) from gb where p = 0 group by p;").get0())
+                .is_rows().with_rows({{ {int32_type->decompose(0)}, {long_type->decompose(int64_t(6))} }});
+            assert_that(e.execute_cql("select p, c1, sum(v) from gb where p = 1 group by p, c1;").get0())
+                .is_rows().with_rows({
+                    { {int32_type->decompose(1)}, {int32_type->decompose(0)}, {int32_type->decompose(3)} },
+                    { {int32_type->decompose(1)}, {int32_type->decompose(1)}, {int32_type->decompose(3)} },
+                });
+            assert_that(e.execute_cql("select p, c1, max(v) from gb group by p, c1 limit 3;").get0())
+                .is_rows().with_size(3);
+            assert_that(e.execute_cql("select count(*) from gb where p = 0 and c1 = 1 group by p, c1, c2;").get0())
+                .is_rows().with_size(3);
+
+            BOOST_REQUIRE_THROW(e.execute_cql("select count(*) from gb group by c1;").get(), exceptions::invalid_request_exception);
+            BOOST_REQUIRE_THROW(e.execute_cql("select count(*) from gb group by p, c2;").get(), exceptions::invalid_request_exception);
+            BOOST_REQUIRE_THROW(e.execute_cql("select count(*) from gb group by p, v;").get(), exceptions::invalid_request_exception);
+
+            assert_that(e.execute_cql("select c1, c2 from gb where p = 0 per partition limit 2;").get0())
+                .is_rows().with_rows({
+                    { {int32_type->decompose(0)}, {int32_type->decompose(0)} },
+                    { {int32_type->decompose(0)}, {int32_type->decompose(1)} },
+                });
+            assert_that(e.execute_cql("select * from gb per partition limit 4;").get0())
+                .is_rows().with_size(8);
+            assert_that(e.execute_cql("select * from gb per partition limit 4 limit 5;").get0())
+                .is_rows().with_size(5);
+            BOOST_REQUIRE_THROW(e.execute_cql("select distinct p from gb per partition limit 1;").get(), exceptions::invalid_request_exception);
+
+            // Resuming a page in the middle of a partition doesn't return more than its limit.
+            auto qo = std::make_unique<cql3::query_options>(db::consistency_level::LOCAL_ONE, std::vector<cql3::raw_value>{},
+                    cql3::query_options::specific_options{3, nullptr, {}, api::new_timestamp()});
+            auto msg = e.execute_cql("select * from gb per partition limit 4;", std::move(qo)).get0();
+            auto rows = dynamic_pointer_cast<cql_transport::messages::result_message::rows>(msg);
+            BOOST_REQUIRE(rows);
+            size_t total = rows->rs().size();
+            auto paging_state = rows->rs().get_metadata().paging_state();
+            while (paging_state) {
+                qo = std::make_unique<cql3::query_options>(db::consistency_level::LOCAL_ONE, std::vector<cql3::raw_value>{},
+                        cql3::query_options::specific_options{3, service::pager::paging_state::deserialize(paging_state->serialize()),
+                                {}, api::new_timestamp()});
+                msg = e.execute_cql("select * from gb per partition limit 4;", std::move(qo)).get0();
+                rows = dynamic_pointer_cast<cql_transport::messages::result_message::rows>(msg);
+                total += rows->rs().size();
+                paging_state = rows->rs().get_metadata().paging_state();
+            }
+            BOOST_REQUIRE_EQUAL(total, 8);
+        });
+    });
+}
+
+SEASTAR_TEST_CASE(test_page_size_in_bytes) {
+    return do_with_cql_env_thread([] (auto& e) {
+        e.execute_cql("create table bp (p int, c int, v text, primary key (p, c));").get();
+        auto v = sstring(1000, 'x');
+        for (auto c = 0; c < 20; ++c) {
+            e.execute_cql(sprint("insert into bp (p, c, v) values (0, %d, '%s');", c, v)).get();
+        }
+        auto query = [&e] (::shared_ptr<service::pager::paging_state> paging_state) {
+            auto qo = std::make_unique<cql3::query_options>(db::consistency_level::LOCAL_ONE, std::vector<cql3::raw_value>{},
+                    cql3::query_options::specific_options{100, std::move(paging_state), {}, api::new_timestamp(), 4096});
+            auto msg = e.execute_cql("select * from bp;", std::move(qo)).get0();
+            auto rows = dynamic_pointer_cast<cql_transport::messages::result_message::rows>(msg);
+            BOOST_REQUIRE(rows);
+            return rows;
+        };
+
+        // The pages end once the budget is used, well before the row count.
+        auto rows = query(nullptr);
+        BOOST_REQUIRE_GT(rows->rs().size(), 0);
+        BOOST_REQUIRE_LT(rows->rs().size(), 20);
+        size_t total = rows->rs().size();
+        auto paging_state = rows->rs().get_metadata().paging_state();
+        while (paging_state) {
+            rows = query(service::pager::paging_state::deserialize(paging_state->serialize()));
+            total += rows->rs().size();
+            paging_state = rows->rs().get_metadata().paging_state();
+        }
+        BOOST_REQUIRE_EQUAL(total, 20);
+    });
+}
+
+SEASTAR_TEST_CASE(test_serialized_result_rows) {
+    return do_with_cql_env([] (auto& e) {
+        return seastar::async([&e] {
+            e.execute_cql("CREATE TABLE sr (p int, c int, v int, l list<int>, PRIMARY KEY (p, c));").get();
+            e.execute_cql("insert into sr (p, c, v, l) values (0, 0, 1, [1, 2]);").get();
+            e.execute_cql("insert into sr (p, c) values (0, 1);").get();
+
+            auto is_serialized = [] (shared_ptr<cql_transport::messages::result_message> msg) {
+                auto rows = dynamic_pointer_cast<cql_transport::messages::result_message::rows>(msg);
+                BOOST_REQUIRE(rows);
+                return rows->rs().has_serialized_rows();
+            };
+
+            // Plain columns are written as they are sent, and read back the same.
+            auto msg = e.execute_cql("select c, v from sr where p = 0;").get0();
+            BOOST_REQUIRE(is_serialized(msg));
+            assert_that(msg).is_rows().with_rows({
+                { {int32_type->decompose(0)}, {int32_type->decompose(1)} },
+                { {int32_type->decompose(1)}, {} },
+            });
+            msg = e.execute_cql("select * from sr;").get0();
+            BOOST_REQUIRE(is_serialized(msg));
+            assert_that(msg).is_rows().with_size(2);
+
+            BOOST_REQUIRE(!is_serialized(e.execute_cql("select writetime(v) from sr where p = 0;").get0()));
+            BOOST_REQUIRE(!is_serialized(e.execute_cql("select count(*) from sr;").get0()));
+        });
+    });
+}
+
+SEASTAR_TEST_CASE(test_parallel_scan) {
+    return do_with_cql_env([] (auto& e) {
+        return seastar::async([&e] {
+            e.execute_cql("CREATE TABLE ps (p int, c int, v int, PRIMARY KEY (p, c));").get();
+            for (int i = 0; i < 20; ++i) {
+                e.execute_cql(sprint("insert into ps (p, c, v) values (%d, %d, %d);", i, i % 3, i)).get();
+            }
+
+            auto rows_of = [] (shared_ptr<cql_transport::messages::result_message> msg) {
+                auto rows = dynamic_pointer_cast<cql_transport::messages::result_message::rows>(msg);
+                BOOST_REQUIRE(rows);
+                return rows->rs().rows();
+            };
+
+            // The ranges are read concurrently, but the rows come in token order all the same.
+            auto expected = rows_of(e.execute_cql("select * from ps;").get0());
+            BOOST_REQUIRE_EQUAL(expected.size(), 20);
+            BOOST_REQUIRE(rows_of(e.execute_cql("select * from ps parallel scan;").get0()) == expected);
+            assert_that(e.execute_cql("select * from ps limit 7 parallel scan;").get0()).is_rows().with_size(7);
+            assert_that(e.execute_cql("select p from ps where p = 3 parallel scan;").get0())
+                .is_rows().with_rows({{ {int32_type->decompose(3)} }});
+        });
+    });
+}
+
+SEASTAR_TEST_CASE(test_paging_resumes_querier) {
+    return do_with_cql_env([] (auto& e) {
+        return seastar::async([&e] {
+            e.execute_cql("CREATE TABLE pq (p int, c int, v int, PRIMARY KEY (p, c));").get();
+            for (int i = 0; i < 10; ++i) {
+                e.execute_cql(sprint("insert into pq (p, c, v) values (0, %d, %d);", i, i)).get();
+            }
+            e.execute_cql("delete from pq where p = 0 and c = 4;").get();
+
+            auto read_all = [&e] (sstring query) {
+                std::vector<int32_t> cs;
+                auto qo = std::make_unique<cql3::query_options>(db::consistency_level::LOCAL_ONE, std::vector<cql3::raw_value>{},
+                        cql3::query_options::specific_options{3, nullptr, {}, api::new_timestamp()});
+                while (true) {
+                    auto msg = e.execute_cql(query, std::move(qo)).get0();
+                    auto rows = dynamic_pointer_cast<cql_transport::messages::result_message::rows>(msg);
+                    BOOST_REQUIRE(rows);
+                    for (auto&& row : rows->rs().rows()) {
+                        cs.push_back(value_cast<int32_t>(int32_type->deserialize(*row[0])));
+                    }
+                    auto paging_state = rows->rs().get_metadata().paging_state();
+                    if (!paging_state) {
+                        return cs;
+                    }
+                    qo = std::make_unique<cql3::query_options>(db::consistency_level::LOCAL_ONE, std::vector<cql3::raw_value>{},
+                            cql3::query_options::specific_options{3, service::pager::paging_state::deserialize(paging_state->serialize()),
+                                    {}, api::new_timestamp()});
+                }
+            };
+
+            auto hits = e.local_db().get_querier_cache().hits();
+            BOOST_REQUIRE(read_all("select c from pq where p = 0;") == std::vector<int32_t>({0, 1, 2, 3, 5, 6, 7, 8, 9}));
+            BOOST_REQUIRE_GT(e.local_db().get_querier_cache().hits(), hits);
+            BOOST_REQUIRE(read_all("select c from pq where p = 0 order by c desc;") == std::vector<int32_t>({9, 8, 7, 6, 5, 3, 2, 1, 0}));
+            BOOST_REQUIRE(read_all("select c from pq where p = 0 and c > 1 and c < 8;") == std::vector<int32_t>({2, 3, 5, 6, 7}));
+        });
+    });
+}
+
+SEASTAR_TEST_CASE(test_filtering_on_replicas) {
+    return do_with_cql_env([] (auto& e) {
+        return seastar::async([&e] {
+            e.execute_cql("CREATE TABLE fr (p int, c int, v int, s int static, tags set<text>, PRIMARY KEY (p, c));").get();
+            for (int p = 0; p < 3; ++p) {
+                e.execute_cql(sprint("insert into fr (p, s) values (%d, %d);", p, p)).get();
+                for (int c = 0; c < 10; ++c) {
+                    e.execute_cql(sprint("insert into fr (p, c, v, tags) values (%d, %d, %d, {'%s'});", p, c, c % 3, c % 2 ? "odd" : "even")).get();
+                }
+            }
+
+            BOOST_REQUIRE_THROW(e.execute_cql("select c from fr where v = 1;").get(), exceptions::invalid_request_exception);
+
+            auto c_values = [] (shared_ptr<cql_transport::messages::result_message> msg) {
+                auto rows = dynamic_pointer_cast<cql_transport::messages::result_message::rows>(msg);
+                BOOST_REQUIRE(rows);
+                std::vector<int32_t> cs;
+                for (auto&& row : rows->rs().rows()) {
+                    cs.push_back(value_cast<int32_t>(int32_type->deserialize(*row[0])));
+                }
+                return cs;
+            };
+
+            auto msg = e.execute_cql("select c from fr where p = 0 and v = 1 allow filtering;").get0();
+            BOOST_REQUIRE(c_values(msg) == std::vector<int32_t>({1, 4, 7}));
+            msg = e.execute_cql("select c from fr where p = 0 and v > 0 and v < 2 and tags contains 'odd' allow filtering;").get0();
+            BOOST_REQUIRE(c_values(msg) == std::vector<int32_t>({1, 7}));
+            msg = e.execute_cql("select c from fr where p = 1 and v in (0, 2) and c < 5 allow filtering;").get0();
+            BOOST_REQUIRE(c_values(msg) == std::vector<int32_t>({0, 2, 3}));
+            assert_that(e.execute_cql("select c from fr where s = 2 and v = 0 allow filtering;").get0())
+                .is_rows().with_size(4);
+            assert_that(e.execute_cql("select c from fr where s = 5 allow filtering;").get0())
+                .is_rows().is_empty();
+
+            // Limits count only the rows which satisfy the filters, also across pages.
+            assert_that(e.execute_cql("select c from fr where v = 2 limit 4 allow filtering;").get0())
+                .is_rows().with_size(4);
+            auto qo = std::make_unique<cql3::query_options>(db::consistency_level::LOCAL_ONE, std::vector<cql3::raw_value>{},
+                    cql3::query_options::specific_options{2, nullptr, {}, api::new_timestamp()});
+            msg = e.execute_cql("select c from fr where v = 2 allow filtering;", std::move(qo)).get0();
+            auto rows = dynamic_pointer_cast<cql_transport::messages::result_message::rows>(msg);
+            size_t total = 0;
+            while (true) {
+                BOOST_REQUIRE(rows);
+                BOOST_REQUIRE_LE(rows->rs().size(), 2);
+                total += rows->rs().size();
+                auto paging_state = rows->rs().get_metadata().paging_state();
+                if (!paging_state) {
+                    break;
+                }
+                qo = std::make_unique<cql3::query_options>(db::consistency_level::LOCAL_ONE, std::vector<cql3::raw_value>{},
+                        cql3::query_options::specific_options{2, service::pager::paging_state::deserialize(paging_state->serialize()),
+                                {}, api::new_timestamp()});
+                msg = e.execute_cql("select c from fr where v = 2 allow filtering;", std::move(qo)).get0();
+                rows = dynamic_pointer_cast<cql_transport::messages::result_message::rows>(msg);
+            }
+            BOOST_REQUIRE_EQUAL(total, 9);
+        });
+    });
+}
+
+SEASTAR_TEST_CASE(test_clustering_filter_keeps_tombstones_of_skipped_sstables) {
+    db::config cfg;
+    cfg.enable_cache(false);
+    return do_with_cql_env_thread([] (auto& e) {
+        e.execute_cql("create table ts (p int, c int, v int, primary key (p, c)) "
+                      "with compaction = {'class': 'TimeWindowCompactionStrategy'};").get();
+        e.execute_cql("insert into ts (p, c, v) values (0, 1, 1) using timestamp 10;").get();
+        e.execute_cql("insert into ts (p, c, v) values (1, 1, 1) using timestamp 10;").get();
+        e.local_db().flush_all_memtables().get();
+        // Rows outside the range read below, with a partition tombstone.
+        e.execute_cql("insert into ts (p, c, v) values (0, 5, 5) using timestamp 5;").get();
+        e.execute_cql("delete from ts using timestamp 10 where p = 0;").get();
+        e.execute_cql("insert into ts (p, c, v) values (1, 5, 5) using timestamp 5;").get();
+        e.local_db().flush_all_memtables().get();
+        // Rows outside the range, without tombstones.
+        e.execute_cql("insert into ts (p, c, v) values (1, 7, 7) using timestamp 20;").get();
+        e.local_db().flush_all_memtables().get();
+
+        // The tombstone has the timestamp of the row, so deletes it.
+        assert_that(e.execute_cql("select v from ts where p = 0 and c = 1;").get0())
+            .is_rows().is_empty();
+        assert_that(e.execute_cql("select v from ts where p = 0 and c >= 1 and c < 3;").get0())
+            .is_rows().is_empty();
+        assert_that(e.execute_cql("select v from ts where p = 1 and c = 1;").get0())
+            .is_rows().with_rows({{int32_type->decompose(1)}});
+        assert_that(e.execute_cql("select v from ts where p = 1 and c > 3;").get0())
+            .is_rows().with_rows({{int32_type->decompose(5)}, {int32_type->decompose(7)}});
+    }, cfg);
+}
+
+SEASTAR_TEST_CASE(test_single_key_reads_skip_shadowed_sstables) {
+    db::config cfg;
+    cfg.enable_cache(false);
+    return do_with_cql_env_thread([] (auto& e) {
+        auto shadowed = [&e] {
+            return e.local_db().get_cf_stats().sstables_shadowed_for_single_key_reads;
+        };
+        e.execute_cql("create table sh (p int, c int, v int, primary key (p, c));").get();
+        e.execute_cql("insert into sh (p, c, v) values (0, 1, 1) using timestamp 10;").get();
+        e.execute_cql("insert into sh (p, c, v) values (0, 2, 2) using timestamp 10;").get();
+        e.execute_cql("insert into sh (p, c, v) values (1, 1, 1) using timestamp 10;").get();
+        e.local_db().flush_all_memtables().get();
+        e.execute_cql("insert into sh (p, c, v) values (0, 1, 10) using timestamp 20;").get();
+        e.execute_cql("update sh using timestamp 20 set v = 20 where p = 0 and c = 2;").get();
+        e.execute_cql("delete from sh using timestamp 20 where p = 1;").get();
+        e.execute_cql("insert into sh (p, c, v) values (1, 3, 3) using timestamp 30;").get();
+        e.local_db().flush_all_memtables().get();
+
+        // The newer row, with its row marker, shadows the older one.
+        auto before = shadowed();
+        assert_that(e.execute_cql("select v from sh where p = 0 and c = 1;").get0())
+            .is_rows().with_rows({{int32_type->decompose(10)}});
+        BOOST_REQUIRE_EQUAL(shadowed(), before + 1);
+
+        // Without a row marker, the older row may keep the row alive.
+        before = shadowed();
+        assert_that(e.execute_cql("select c, v from sh where p = 0 and c = 2;").get0())
+            .is_rows().with_rows({{int32_type->decompose(2), int32_type->decompose(20)}});
+        BOOST_REQUIRE_EQUAL(shadowed(), before);
+
+        // The older data may have other rows.
+        before = shadowed();
+        assert_that(e.execute_cql("select c from sh where p = 0;").get0())
+            .is_rows().with_rows({{int32_type->decompose(1)}, {int32_type->decompose(2)}});
+        BOOST_REQUIRE_EQUAL(shadowed(), before);
+
+        // The partition tombstone shadows the whole partition of older sstables.
+        before = shadowed();
+        assert_that(e.execute_cql("select c from sh where p = 1;").get0())
+            .is_rows().with_rows({{int32_type->decompose(3)}});
+        BOOST_REQUIRE_EQUAL(shadowed(), before + 1);
+    }, cfg);
+}
+
+SEASTAR_TEST_CASE(test_distinct_partition_keys_read_from_index) {
+    return do_with_cql_env_thread([] (auto& e) {
+        auto index_reads = [&e] {
+            return e.local_db().get_cf_stats().partition_key_reads_from_index;
+        };
+        auto key = [] (int32_t p) {
+            return std::initializer_list<bytes_opt>{int32_type->decompose(p)};
+        };
+        e.execute_cql("create table dk (p int, c int, v int, primary key (p, c));").get();
+        for (auto p : {0, 1, 2}) {
+            e.execute_cql(sprint("insert into dk (p, c, v) values (%d, 1, 1);", p)).get();
+        }
+        e.local_db().flush_all_memtables().get();
+
+        auto before = index_reads();
+        assert_that(e.execute_cql("select distinct p from dk;").get0())
+            .is_rows().with_rows_ignore_order({key(0), key(1), key(2)});
+        BOOST_REQUIRE_GT(index_reads(), before);
+
+        // The deletion in the memtable makes the partition read from the data file.
+        e.execute_cql("delete from dk where p = 1 and c = 1;").get();
+        assert_that(e.execute_cql("select distinct p from dk;").get0())
+            .is_rows().with_rows_ignore_order({key(0), key(2)});
+
+        // The tombstone in an sstable disables the index reads.
+        e.local_db().flush_all_memtables().get();
+        before = index_reads();
+        assert_that(e.execute_cql("select distinct p from dk;").get0())
+            .is_rows().with_rows_ignore_order({key(0), key(2)});
+        BOOST_REQUIRE_EQUAL(index_reads(), before);
+    });
+}
+
+SEASTAR_TEST_CASE(test_unprepared_statements_cache) {
+    return do_with_cql_env_thread([] (auto& e) {
+        e.execute_cql("create table uc (p int primary key, v int);").get();
+        e.execute_cql("insert into uc (p, v) values (0, 1);").get();
+        assert_that(e.execute_cql("select * from uc;").get0())
+            .is_rows().with_rows({{int32_type->decompose(0), int32_type->decompose(1)}});
+        assert_that(e.execute_cql("select * from uc;").get0())
+            .is_rows().with_rows({{int32_type->decompose(0), int32_type->decompose(1)}});
+
+        // The cached statement is invalidated by the schema change.
+        e.execute_cql("alter table uc add w int;").get();
+        assert_that(e.execute_cql("select * from uc;").get0())
+            .is_rows().with_rows({{int32_type->decompose(0), int32_type->decompose(1), {}}});
+    });
+}
+
+SEASTAR_TEST_CASE(test_compact_result_rows) {
+    return do_with_cql_env_thread([] (auto& e) {
+        e.execute_cql("create table cr (p int, c int, s int static, v1 int, v2 int, v3 int, v4 int, v5 int, v6 int, v7 int, v8 int, "
+                "v9 text, l list<int>, primary key (p, c));").get();
+        e.execute_cql("insert into cr (p, c, s, v1, v3, v8, v9, l) values (0, 0, 7, 1, 3, 8, 'nine', [1, 2]);").get();
+        e.execute_cql("insert into cr (p, c, v2) values (0, 1, 2) using ttl 1000;").get();
+
+        auto i = [] (int32_t v) { return bytes_opt(int32_type->decompose(v)); };
+        auto my_list_type = list_type_impl::get_instance(int32_type, true);
+        auto l = bytes_opt(my_list_type->decompose(make_list_value(my_list_type, list_type_impl::native_type({1, 2}))));
+        // Present and missing cells on both sides of the eighth column, static ones included.
+        assert_that(e.execute_cql("select * from cr;").get0()).is_rows().with_rows({
+            {i(0), i(0), i(7), l, i(1), {}, i(3), {}, {}, {}, {}, i(8), utf8_type->decompose("nine")},
+            {i(0), i(1), i(7), {}, {}, i(2), {}, {}, {}, {}, {}, {}, {}},
+        });
+        // The metadata of the cells is still sent when it is selected.
+        auto msg = e.execute_cql("select writetime(v1), ttl(v2) from cr where p = 0 and c = 1;").get0();
+        assert_that(msg).is_rows().with_size(1);
+    });
+}
+
+SEASTAR_TEST_CASE(test_conditional_updates) {
+    return do_with_cql_env_thread([] (auto& e) {
+        e.execute_cql("create table lwt (p int, c int, v int, primary key (p, c));").get();
+        auto i = [] (int32_t v) { return bytes_opt(int32_type->decompose(v)); };
+        auto applied = bytes_opt(boolean_type->decompose(true));
+        auto not_applied = bytes_opt(boolean_type->decompose(false));
+
+        assert_that(e.execute_cql("insert into lwt (p, c, v) values (0, 0, 1) if not exists;").get0())
+            .is_rows().with_rows({{applied}});
+        // The row exists now, and the failed insert reports it.
+        assert_that(e.execute_cql("insert into lwt (p, c, v) values (0, 0, 2) if not exists;").get0())
+            .is_rows().with_rows({{not_applied, i(0), i(0), i(1)}});
+
+        assert_that(e.execute_cql("update lwt set v = 3 where p = 0 and c = 0 if v = 2;").get0())
+            .is_rows().with_rows({{not_applied, i(1)}});
+        assert_that(e.execute_cql("update lwt set v = 3 where p = 0 and c = 0 if v in (1, 2);").get0())
+            .is_rows().with_rows({{applied}});
+        assert_that(e.execute_cql("select v from lwt where p = 0 and c = 0;").get0())
+            .is_rows().with_rows({{i(3)}});
+
+        assert_that(e.execute_cql("delete from lwt where p = 0 and c = 1 if exists;").get0())
+            .is_rows().with_rows({{not_applied}});
+        assert_that(e.execute_cql("delete from lwt where p = 0 and c = 0 if exists;").get0())
+            .is_rows().with_rows({{applied}});
+        assert_that(e.execute_cql("select * from lwt;").get0()).is_rows().is_empty();
+    });
+}
+
+SEASTAR_TEST_CASE(test_coordinator_result_cache) {
+    return do_with_cql_env_thread([] (auto& e) {
+        e.execute_cql("create table flags (p int primary key, v int) with caching = "
+                      "{'keys': 'ALL', 'rows_per_partition': 'ALL', 'coordinator_ttl_ms': '60000'};").get();
+        e.execute_cql("insert into flags (p, v) values (0, 1);").get();
+        auto i = [] (int32_t v) { return bytes_opt(int32_type->decompose(v)); };
+        auto& cache = service::get_local_storage_proxy().get_result_cache();
+
+        auto hits = cache.get_stats().hits;
+        assert_that(e.execute_cql("select v from flags where p = 0;").get0()).is_rows().with_rows({{i(1)}});
+        assert_that(e.execute_cql("select v from flags where p = 0;").get0()).is_rows().with_rows({{i(1)}});
+        BOOST_REQUIRE_EQUAL(cache.get_stats().hits, hits + 1);
+
+        // Writes coordinated by the same shard are seen at once.
+        e.execute_cql("update flags set v = 2 where p = 0;").get();
+        assert_that(e.execute_cql("select v from flags where p = 0;").get0()).is_rows().with_rows({{i(2)}});
+        BOOST_REQUIRE_EQUAL(cache.get_stats().invalidations, 1);
+
+        // Scans aren't cached.
+        hits = cache.get_stats().hits;
+        e.execute_cql("select v from flags;").get();
+        e.execute_cql("select v from flags;").get();
+        BOOST_REQUIRE_EQUAL(cache.get_stats().hits, hits);
+    });
+}
@@ -79,3 +79,44 @@ SEASTAR_TEST_CASE(test_querying_with_limits) {
         });
     });
 }
+
+SEASTAR_TEST_CASE(test_shard_sstable_stats_follow_the_column_families) {
+    return do_with_cql_env([](cql_test_env& e) {
+        return seastar::async([&] {
+            e.execute_cql("create table ks.cf1 (k text, v int, primary key (k));").get();
+            e.execute_cql("create table ks.cf2 (k text, v int, primary key (k));").get();
+            auto& db = e.local_db();
+
+            auto check_shard_stats = [&] {
+                cf_stats sum;
+                for (auto&& i : db.get_column_families()) {
+                    auto& stats = i.second->get_stats();
+                    sum.live_disk_space_used += stats.live_disk_space_used;
+                    sum.total_disk_space_used += stats.total_disk_space_used;
+                    sum.live_sstable_count += stats.live_sstable_count;
+                    sum.estimated_partitions += stats.estimated_partitions;
+                }
+                auto& shard = db.get_cf_stats();
+                BOOST_REQUIRE_EQUAL(shard.live_disk_space_used, sum.live_disk_space_used);
+                BOOST_REQUIRE_EQUAL(shard.total_disk_space_used, sum.total_disk_space_used);
+                BOOST_REQUIRE_EQUAL(shard.live_sstable_count, sum.live_sstable_count);
+                BOOST_REQUIRE_EQUAL(shard.estimated_partitions, sum.estimated_partitions);
+            };
+
+            for (auto&& cf_name : {"cf1", "cf2"}) {
+                for (int i = 0; i < 2; ++i) {
+                    e.execute_cql(sprint("insert into ks.%s (k, v) values ('key%d', %d);", cf_name, i, i)).get();
+                    db.find_column_family("ks", cf_name).flush().get();
+                }
+            }
+            check_shard_stats();
+            BOOST_REQUIRE_EQUAL(db.find_column_family("ks", "cf1").get_stats().live_sstable_count, 2);
+            BOOST_REQUIRE(db.get_cf_stats().live_sstable_count >= 4);
+
+            e.execute_cql("truncate ks.cf1;").get();
+            check_shard_stats();
+            BOOST_REQUIRE_EQUAL(db.find_column_family("ks", "cf1").get_stats().live_sstable_count, 0);
+            BOOST_REQUIRE_EQUAL(db.find_column_family("ks", "cf1").get_stats().live_disk_space_used, 0);
+        });
+    });
+}
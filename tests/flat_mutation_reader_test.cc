@@ -293,4 +293,29 @@ SEASTAR_TEST_CASE(test_flat_mutation_reader_consume_two_partitions) {
             }
         });
     });
-}
\ No newline at end of file
+}
+SEASTAR_TEST_CASE(test_flat_mutation_reader_consume_pausable_resumes_at_next_fragment) {
+    return seastar::async([] {
+        for_each_mutation([] (const mutation& m) {
+            auto& s = *m.schema();
+            auto r = flat_mutation_reader_from_mutations({m}, streamed_mutation::forwarding::no);
+            auto expected = flat_mutation_reader_from_mutations({m}, streamed_mutation::forwarding::no);
+            // Stops after each fragment, so that every call consumes exactly one.
+            while (!r.is_end_of_stream() || !r.is_buffer_empty()) {
+                mutation_fragment_opt consumed;
+                r.consume_pausable([&consumed] (mutation_fragment mf) {
+                    consumed = std::move(mf);
+                    return stop_iteration::yes;
+                }).get();
+                auto mfopt = expected().get0();
+                if (!consumed) {
+                    BOOST_REQUIRE(!mfopt);
+                    break;
+                }
+                BOOST_REQUIRE(mfopt);
+                BOOST_REQUIRE(consumed->equal(s, *mfopt));
+            }
+            BOOST_REQUIRE(!expected().get0());
+        });
+    });
+}
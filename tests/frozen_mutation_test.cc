@@ -102,3 +102,38 @@ SEASTAR_TEST_CASE(test_application_of_partition_view_has_the_same_effect_as_appl
         assert_that(m_unfrozen).is_equal_to(m_frozen);
     });
 }
+
+SEASTAR_TEST_CASE(test_reading_cells_of_different_kinds_and_sizes) {
+    return seastar::async([] {
+        storage_service_for_tests ssft;
+        schema_ptr s = new_table()
+                .with_column("pk_col", bytes_type, column_kind::partition_key)
+                .with_column("ck_1", bytes_type, column_kind::clustering_key)
+                .with_column("reg_1", bytes_type)
+                .with_column("reg_2", bytes_type)
+                .with_column("reg_3", bytes_type)
+                .with_column("reg_4", bytes_type)
+                .with_column("static_1", bytes_type, column_kind::static_column)
+                .build();
+
+        partition_key key = partition_key::from_single_value(*s, bytes("key"));
+        auto column = [&] (const char* name) -> const column_definition& {
+            return *s->get_column_definition(to_bytes(name));
+        };
+
+        // Cells are read into a buffer shared by all cells of the partition,
+        // so big cells are followed by smaller ones.
+        mutation m(key, s);
+        m.set_static_cell(column("static_1"), atomic_cell::make_live(new_timestamp(), bytes(4096, 's')));
+        for (auto i : { 1, 2 }) {
+            auto ck = clustering_key::from_single_value(*s, to_bytes(sprint("ck%d", i)));
+            m.set_clustered_cell(ck, column("reg_1"), atomic_cell::make_live(new_timestamp(), bytes(1000 * i, 'a')));
+            m.set_clustered_cell(ck, column("reg_2"), atomic_cell::make_live(new_timestamp(), bytes("b"),
+                    gc_clock::now() + std::chrono::seconds(10), std::chrono::seconds(10)));
+            m.set_clustered_cell(ck, column("reg_3"), atomic_cell::make_dead(new_timestamp(), gc_clock::now()));
+            m.set_clustered_cell(ck, column("reg_4"), atomic_cell::make_live(new_timestamp(), bytes()));
+        }
+
+        assert_that(freeze(m).unfreeze(s)).is_equal_to(m);
+    });
+}
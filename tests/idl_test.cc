@@ -350,3 +350,27 @@ BOOST_AUTO_TEST_CASE(test_skip_does_not_deserialize)
         BOOST_REQUIRE(prev == final_composite_test_object::construction_count);
     }
 }
+
+BOOST_AUTO_TEST_CASE(test_chunked_vector)
+{
+    std::vector<simple_compound> v;
+    utils::chunked_vector<simple_compound> cv;
+    for (uint32_t i = 0; i < 20000; ++i) {
+        v.push_back({ i, ~i });
+        cv.push_back({ i, ~i });
+    }
+
+    // Serialized the same as std::vector, so either can be used in the IDL.
+    bytes_ostream buf1;
+    ser::serialize(buf1, v);
+    bytes_ostream buf2;
+    ser::serialize(buf2, cv);
+    BOOST_REQUIRE_EQUAL(buf1.linearize(), buf2.linearize());
+
+    auto in = ser::as_input_stream(buf1.linearize());
+    auto deser_cv = ser::deserialize(in, boost::type<utils::chunked_vector<simple_compound>>());
+    BOOST_REQUIRE_EQUAL(deser_cv.size(), v.size());
+    for (size_t i = 0; i < v.size(); ++i) {
+        BOOST_REQUIRE_EQUAL(deser_cv[i], v[i]);
+    }
+}
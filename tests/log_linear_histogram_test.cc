@@ -0,0 +1,96 @@
+/*
+ * Copyright (C) 2018 ScyllaDB
+ */
+
+/*
+ * This file is part of Scylla.
+ *
+ * Scylla is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Scylla is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#define BOOST_TEST_MODULE core
+
+#include <boost/test/unit_test.hpp>
+
+#include <limits>
+
+#include "utils/log_linear_histogram.hh"
+
+using histogram = utils::log_linear_histogram;
+
+BOOST_AUTO_TEST_CASE(test_empty_histogram) {
+    histogram h;
+    BOOST_REQUIRE_EQUAL(h.count(), 0);
+    BOOST_REQUIRE_EQUAL(h.percentile(0.99), 0);
+    BOOST_REQUIRE_EQUAL(h.min(), 0);
+    BOOST_REQUIRE_EQUAL(h.max(), 0);
+}
+
+BOOST_AUTO_TEST_CASE(test_buckets_cover_the_values) {
+    for (size_t i = 0; i < histogram::nr_buckets; ++i) {
+        BOOST_REQUIRE_EQUAL(histogram::bucket_of(histogram::bucket_lower_bound(i)), i);
+        BOOST_REQUIRE_EQUAL(histogram::bucket_of(histogram::bucket_upper_bound(i)), i);
+        if (i) {
+            BOOST_REQUIRE_EQUAL(histogram::bucket_lower_bound(i), histogram::bucket_upper_bound(i - 1) + 1);
+        }
+    }
+    BOOST_REQUIRE_EQUAL(histogram::bucket_of(histogram::max_value + 1), histogram::nr_buckets - 1);
+    BOOST_REQUIRE_EQUAL(histogram::bucket_of(std::numeric_limits<uint64_t>::max()), histogram::nr_buckets - 1);
+}
+
+BOOST_AUTO_TEST_CASE(test_percentiles_are_within_a_bucket) {
+    histogram h;
+    for (int i = 1; i <= 1000; ++i) {
+        h.add(std::chrono::microseconds(i * 100));
+    }
+    BOOST_REQUIRE_EQUAL(h.count(), 1000);
+    BOOST_REQUIRE_EQUAL(h.sum(), 100 * 1000 * 1001 / 2);
+    for (double p : { 0.5, 0.9, 0.99, 0.999 }) {
+        auto exact = uint64_t(p * 1000) * 100;
+        auto v = h.percentile(p);
+        BOOST_REQUIRE_GE(v, exact);
+        BOOST_REQUIRE_LE(v, exact + exact / histogram::sub_buckets);
+    }
+    BOOST_REQUIRE_LE(h.min(), 100);
+    BOOST_REQUIRE_GE(h.max(), 100000);
+}
+
+BOOST_AUTO_TEST_CASE(test_merge_is_lossless) {
+    histogram a, b, all;
+    for (uint64_t i = 0; i < 10000; ++i) {
+        auto v = (i * 7919) % 100000;
+        (i % 2 ? a : b).add(v);
+        all.add(v);
+    }
+    auto merged = a + b;
+    for (double p : { 0.0, 0.1, 0.5, 0.9, 0.99, 1.0 }) {
+        BOOST_REQUIRE_EQUAL(merged.percentile(p), all.percentile(p));
+    }
+    BOOST_REQUIRE_EQUAL(merged.count(), all.count());
+    BOOST_REQUIRE_EQUAL((merged - a).percentile(0.5), b.percentile(0.5));
+}
+
+BOOST_AUTO_TEST_CASE(test_sample_follows_the_distribution) {
+    histogram h;
+    for (int i = 0; i < 900; ++i) {
+        h.add(10);
+    }
+    for (int i = 0; i < 100; ++i) {
+        h.add(10000);
+    }
+    auto sample = h.make_sample(100);
+    BOOST_REQUIRE_EQUAL(sample.size(), 100);
+    BOOST_REQUIRE_EQUAL(std::count(sample.begin(), sample.end(), 10), 90);
+}
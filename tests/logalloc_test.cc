@@ -276,6 +276,52 @@ SEASTAR_TEST_CASE(test_blob) {
     });
 }
 
+#ifndef DEFAULT_ALLOCATOR
+SEASTAR_TEST_CASE(test_fragmented_blob_view) {
+    return seastar::async([] {
+        region reg;
+        with_allocator(reg.allocator(), [&] {
+            auto max_object_size = reg.allocator().preferred_max_contiguous_allocation();
+            auto src = bytes(bytes::initialized_later(), 3 * max_object_size + 7);
+            for (size_t i = 0; i < src.size(); ++i) {
+                src[i] = i % 251;
+            }
+            managed_bytes b(src);
+
+            auto v = b.view();
+            BOOST_REQUIRE(v.is_fragmented());
+            BOOST_REQUIRE_EQUAL(v.size(), src.size());
+            BOOST_REQUIRE(v.linearize() == src);
+            BOOST_REQUIRE(v == managed_bytes_view(bytes_view(src)));
+
+            size_t fragments = 0;
+            size_t total = 0;
+            v.for_each_fragment([&] (bytes_view fragment) {
+                BOOST_REQUIRE(!fragment.empty());
+                BOOST_REQUIRE(fragment == bytes_view(src).substr(total, fragment.size()));
+                total += fragment.size();
+                ++fragments;
+            });
+            BOOST_REQUIRE_EQUAL(total, src.size());
+            BOOST_REQUIRE_GT(fragments, 1);
+
+            auto offset = max_object_size + 3;
+            auto len = max_object_size;
+            auto sub = v;
+            sub.remove_prefix(offset);
+            sub = sub.prefix(len);
+            BOOST_REQUIRE_EQUAL(sub.size(), len);
+            BOOST_REQUIRE(sub.linearize() == bytes(bytes_view(src).substr(offset, len)));
+            BOOST_REQUIRE_EQUAL(sub[0], src[offset]);
+
+            reg.full_compaction();
+
+            BOOST_REQUIRE(b.view().linearize() == src);
+        });
+    });
+}
+#endif
+
 SEASTAR_TEST_CASE(test_merging) {
     return seastar::async([] {
         region reg1;
@@ -29,6 +29,7 @@
 
 #include "core/thread.hh"
 #include "memtable.hh"
+#include "frozen_mutation.hh"
 #include "mutation_source_test.hh"
 #include "mutation_reader_assertions.hh"
 #include "mutation_assertions.hh"
@@ -358,3 +359,22 @@ SEASTAR_TEST_CASE(test_fast_forward_to_after_memtable_is_flushed) {
         BOOST_REQUIRE(!rd().get0());
     });
 }
+
+SEASTAR_TEST_CASE(test_applying_frozen_mutations_merges_them_like_mutations) {
+    return seastar::async([] {
+        random_mutation_generator gen(random_mutation_generator::generate_counters::no);
+        auto s = gen.schema();
+        for (int i = 0; i < 10; ++i) {
+            auto m1 = gen();
+            auto m2 = gen();
+            auto mt = make_lw_shared<memtable>(s);
+            mt->apply(freeze(m1), s);
+            mt->apply(freeze(m2), s);
+            // Applying a mutation again, as done when retried, doesn't change the result.
+            mt->apply(freeze(m1), s);
+            assert_that(mt->make_reader(s))
+                .produces(m1 + m2)
+                .produces_end_of_stream();
+        }
+    });
+}
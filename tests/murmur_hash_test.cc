@@ -24,6 +24,7 @@
 #include <boost/test/unit_test.hpp>
 
 #include "utils/murmur_hash.hh"
+#include "murmur3_hasher.hh"
 #include "bytes.hh"
 #include "core/print.hh"
 
@@ -122,3 +123,45 @@ BOOST_AUTO_TEST_CASE(test_hash_output) {
         }
     }
 }
+
+BOOST_AUTO_TEST_CASE(test_incremental_hash_output) {
+    for (size_t i = 0; i < full_sequence.size(); ++i) {
+        auto prefix = bytes_view(full_sequence.begin(), i);
+        auto&& expected = prefix_hashes[i];
+
+        // Feed the prefix in pieces of every size, so that all buffer boundaries are crossed.
+        for (size_t piece = 1; piece <= std::max<size_t>(i, 1); ++piece) {
+            murmur3_hasher h(seed);
+            for (size_t pos = 0; pos < i; pos += piece) {
+                auto n = std::min(piece, i - pos);
+                h.update(reinterpret_cast<const char*>(prefix.begin() + pos), n);
+            }
+            auto dst = h.finalize_u64();
+            if (dst != expected) {
+                BOOST_FAIL(sprint("Hashes differ for %s fed in pieces of %d (got {0x%x, 0x%x} and {0x%x, 0x%x})", prefix, piece,
+                    dst[0], dst[1], expected[0], expected[1]));
+            }
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_batched_hash_output) {
+    // Every prefix, so that the keys hashed together have different lengths,
+    // in every position of a group of interleaved keys.
+    for (size_t first = 0; first < 8; ++first) {
+        std::vector<bytes_view> keys;
+        for (size_t i = first; i < full_sequence.size(); ++i) {
+            keys.push_back(bytes_view(full_sequence.begin(), i));
+        }
+        std::vector<std::array<uint64_t, 2>> dst;
+        utils::murmur_hash::hash3_x64_128(keys, seed, dst);
+        BOOST_REQUIRE_EQUAL(dst.size(), keys.size());
+        for (size_t i = 0; i < keys.size(); ++i) {
+            auto&& expected = prefix_hashes[first + i];
+            if (dst[i] != expected) {
+                BOOST_FAIL(sprint("Hashes differ for %s hashed in a batch (got {0x%x, 0x%x} and {0x%x, 0x%x})", keys[i],
+                    dst[i][0], dst[i][1], expected[0], expected[1]));
+            }
+        }
+    }
+}
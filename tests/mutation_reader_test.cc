@@ -36,6 +36,7 @@
 
 #include "mutation_reader.hh"
 #include "schema_builder.hh"
+#include "partition_slice_builder.hh"
 #include "sstable_mutation_readers.hh"
 #include "cell_locking.hh"
 #include "sstables/sstables.hh"
@@ -352,6 +353,49 @@ SEASTAR_TEST_CASE(test_multi_range_reader) {
         });
 }
 
+SEASTAR_TEST_CASE(test_reversing_reader) {
+    return seastar::async([] {
+        simple_schema ss;
+        auto s = ss.schema();
+        auto pkey = ss.make_pkey(0);
+
+        mutation m(pkey, s);
+        ss.add_static_row(m, "static");
+        // Large enough to be read in many windows.
+        auto value = sstring(2000, 'v');
+        for (uint32_t i = 0; i < 1000; ++i) {
+            ss.add_row(m, ss.make_ckey(i), value);
+        }
+        // Across windows, and within one.
+        ss.delete_range(m, ss.make_ckey_range(10, 500));
+        ss.delete_range(m, ss.make_ckey_range(700, 702));
+
+        auto mt = make_lw_shared<memtable>(s);
+        mt->apply(m);
+
+        auto slice = partition_slice_builder(*s).reversed().build();
+        auto pr = dht::partition_range::make_singular(pkey);
+        auto rd = make_reversing_reader(mt->as_data_source(), s, pr, slice, default_priority_class());
+        auto sm = rd().get0();
+        BOOST_REQUIRE(sm);
+
+        mutation result(pkey, s);
+        position_in_partition::less_compare less(*s);
+        stdx::optional<position_in_partition> last;
+        while (auto mf = (*sm)().get0()) {
+            if (mf->is_range_tombstone()) {
+                mf->as_mutable_range_tombstone().flip();
+            } else if (mf->is_clustering_row()) {
+                BOOST_REQUIRE(!last || less(mf->position(), *last));
+                last = position_in_partition(mf->position());
+            }
+            result.apply(*mf);
+        }
+        BOOST_REQUIRE(!rd().get0());
+        assert_that(result).is_equal_to(m);
+    });
+}
+
 struct sst_factory {
     schema_ptr s;
     sstring path;
@@ -857,6 +901,84 @@ SEASTAR_TEST_CASE(restricted_reader_max_queue_length) {
     });
 }
 
+SEASTAR_TEST_CASE(restricted_reader_admission_round_robin) {
+    return async([&] {
+        restriction_data rd(new_reader_base_cost);
+        semaphore table1_sem(1);
+        semaphore table2_sem(1);
+        auto config1 = rd.config;
+        config1.admission_sem = &table1_sem;
+        auto config2 = rd.config;
+        config2.admission_sem = &table2_sem;
+
+        {
+            simple_schema s;
+            auto tmp = make_lw_shared<tmpdir>();
+            auto sst = create_sstable(s, tmp->path);
+
+            auto reader1 = std::make_unique<reader_wrapper>(config1, s.schema(), sst);
+            (*reader1)().get();
+
+            auto reader2 = std::make_unique<reader_wrapper>(config1, s.schema(), sst);
+            auto read2 = (*reader2)();
+            auto reader3 = std::make_unique<reader_wrapper>(config1, s.schema(), sst);
+            auto read3 = (*reader3)();
+            auto reader4 = std::make_unique<reader_wrapper>(config2, s.schema(), sst);
+            auto read4 = (*reader4)();
+
+            reader1.reset();
+            REQUIRE_EVENTUALLY_EQUAL(reader2->created(), true);
+            read2.get();
+
+            // The other table's reader goes first, though it came after reader3.
+            reader2.reset();
+            REQUIRE_EVENTUALLY_EQUAL(reader4->created(), true);
+            BOOST_REQUIRE(!reader3->created());
+            read4.get();
+
+            reader4.reset();
+            REQUIRE_EVENTUALLY_EQUAL(reader3->created(), true);
+            read3.get();
+        }
+
+        REQUIRE_EVENTUALLY_EQUAL(new_reader_base_cost, rd.reader_semaphore->available_units());
+    });
+}
+
+SEASTAR_TEST_CASE(restricted_reader_estimated_memory) {
+    return async([&] {
+        restriction_data rd(4 * new_reader_base_cost);
+
+        {
+            simple_schema s;
+            auto tmp = make_lw_shared<tmpdir>();
+            auto sst = create_sstable(s, tmp->path);
+
+            auto reader1 = std::make_unique<reader_wrapper>(rd.config, s.schema(), sst);
+            (*reader1)().get();
+
+            // Only the base cost is held once admitted.
+            BOOST_REQUIRE_EQUAL(rd.reader_semaphore->available_units(), 3 * new_reader_base_cost);
+
+            auto ms = mutation_source([&] (schema_ptr schema, const dht::partition_range&) {
+                return make_empty_reader();
+            });
+            auto reader2 = make_restricted_reader(rd.config, std::move(ms), s.schema(), query::full_partition_range, s.schema()->full_slice(),
+                    default_priority_class(), nullptr, streamed_mutation::forwarding::no, mutation_reader::forwarding::yes, 4 * new_reader_base_cost);
+            auto read_fut = reader2();
+
+            // reader2 expects to need more than is available.
+            BOOST_REQUIRE(!read_fut.available());
+
+            reader1.reset();
+            read_fut.get();
+            BOOST_REQUIRE_EQUAL(rd.reader_semaphore->available_units(), 3 * new_reader_base_cost);
+        }
+
+        REQUIRE_EVENTUALLY_EQUAL(4 * new_reader_base_cost, rd.reader_semaphore->available_units());
+    });
+}
+
 SEASTAR_TEST_CASE(restricted_reader_create_reader) {
     return async([&] {
         restriction_data rd(new_reader_base_cost);
@@ -278,6 +278,50 @@ SEASTAR_TEST_CASE(test_list_mutations) {
     });
 }
 
+SEASTAR_TEST_CASE(test_collection_merge) {
+    return seastar::async([] {
+        auto my_map_type = map_type_impl::get_instance(int32_type, int32_type, true);
+        auto cell = [] (int32_t v, api::timestamp_type ts) {
+            return atomic_cell::make_live(ts, int32_type->decompose(v));
+        };
+        auto merge = [&] (const collection_type_impl::mutation& a, const collection_type_impl::mutation& b) {
+            auto merged = my_map_type->merge(my_map_type->serialize_mutation_form(a), my_map_type->serialize_mutation_form(b));
+            return my_map_type->deserialize_mutation_form(merged).materialize();
+        };
+        auto keys = [] (const collection_type_impl::mutation& m) {
+            std::vector<int32_t> ret;
+            for (auto&& c : m.cells) {
+                ret.push_back(value_cast<int32_t>(int32_type->deserialize(c.first)));
+            }
+            return ret;
+        };
+        auto k = [] (int32_t v) { return int32_type->decompose(v); };
+
+        collection_type_impl::mutation empty;
+        collection_type_impl::mutation m1{{}, {{k(1), cell(1, 1)}, {k(2), cell(2, 1)}}};
+        collection_type_impl::mutation m2{{}, {{k(3), cell(3, 2)}}};
+        collection_type_impl::mutation m3{{}, {{k(0), cell(0, 2)}, {k(4), cell(4, 2)}}};
+        collection_type_impl::mutation m4{tombstone(1, gc_clock::now()), {{k(5), cell(5, 1)}, {k(6), cell(6, 2)}}};
+
+        BOOST_REQUIRE(keys(merge(empty, m1)) == std::vector<int32_t>({1, 2}));
+        BOOST_REQUIRE(keys(merge(m1, empty)) == std::vector<int32_t>({1, 2}));
+        // Appended
+        BOOST_REQUIRE(keys(merge(m1, m2)) == std::vector<int32_t>({1, 2, 3}));
+        BOOST_REQUIRE(!merge(m1, m2).tomb);
+        // Interleaved
+        BOOST_REQUIRE(keys(merge(m1, m3)) == std::vector<int32_t>({0, 1, 2, 4}));
+        BOOST_REQUIRE(keys(merge(m4, m2)) == std::vector<int32_t>({3, 5, 6}));
+        // Shadowed by the tombstone of the other side
+        BOOST_REQUIRE(keys(merge(m1, m4)) == std::vector<int32_t>({5, 6}));
+        BOOST_REQUIRE(merge(m1, m4).tomb == m4.tomb);
+        collection_type_impl::mutation m5{{}, {{k(7), cell(7, 1)}, {k(8), cell(8, 2)}}};
+        BOOST_REQUIRE(keys(merge(m4, m5)) == std::vector<int32_t>({5, 6, 8}));
+        collection_type_impl::mutation m6{{}, {{k(7), cell(7, 2)}}};
+        BOOST_REQUIRE(keys(merge(m4, m6)) == std::vector<int32_t>({5, 6, 7}));
+        BOOST_REQUIRE(merge(m4, m6).tomb == m4.tomb);
+    });
+}
+
 SEASTAR_TEST_CASE(test_multiple_memtables_one_partition) {
     return seastar::async([] {
     auto s = make_lw_shared(schema({}, some_keyspace, some_column_family,
@@ -868,6 +912,72 @@ SEASTAR_TEST_CASE(test_apply_is_atomic_in_case_of_allocation_failures) {
     return make_ready_future<>();
 }
 
+SEASTAR_TEST_CASE(test_rows_with_sparse_columns) {
+    return seastar::async([] {
+        // Spans vector, sparse and set storage of rows.
+        schema_builder builder("ks", "cf");
+        builder.with_column("pk", bytes_type, column_kind::partition_key);
+        builder.with_column("ck", bytes_type, column_kind::clustering_key);
+        for (unsigned i = 0; i < row::max_sparse_size + 100; ++i) {
+            builder.with_column(to_bytes(sprint("v%04d", i)), bytes_type);
+        }
+        auto s = builder.build();
+
+        auto check_ids = [&] (std::vector<column_id> ids) {
+            std::random_device rd;
+            std::shuffle(ids.begin(), ids.end(), std::default_random_engine(rd()));
+            row r;
+            for (auto id : ids) {
+                r.apply(s->regular_column_at(id), atomic_cell::make_live(1, bytes_type->decompose(data_value(to_bytes(sprint("%d", id))))));
+            }
+            BOOST_REQUIRE_EQUAL(r.size(), ids.size());
+            std::sort(ids.begin(), ids.end());
+            std::vector<column_id> seen;
+            r.for_each_cell([&] (column_id id, const atomic_cell_or_collection& c) {
+                seen.push_back(id);
+                BOOST_REQUIRE(c.as_atomic_cell().value() == bytes_view(to_bytes(sprint("%d", id))));
+            });
+            BOOST_REQUIRE(seen == ids);
+            for (column_id id = 0; id < s->regular_columns_count(); ++id) {
+                BOOST_REQUIRE_EQUAL(bool(r.find_cell(id)), std::binary_search(ids.begin(), ids.end(), id));
+            }
+
+            // Newer cells overwrite older ones in place.
+            row newer;
+            for (auto id : ids) {
+                newer.apply(s->regular_column_at(id), atomic_cell::make_live(2, bytes_type->decompose(data_value(bytes("new")))));
+            }
+            auto merged = r;
+            merged.apply(*s, column_kind::regular_column, newer);
+            BOOST_REQUIRE(merged == newer);
+            BOOST_REQUIRE(r.difference(*s, column_kind::regular_column, newer).empty());
+            BOOST_REQUIRE_EQUAL(newer.difference(*s, column_kind::regular_column, r).size(), ids.size());
+
+            // Cells covered by the tombstone are removed from the middle of the storage.
+            row odd;
+            for (auto id : ids) {
+                odd.apply(s->regular_column_at(id), atomic_cell::make_live(id % 2 ? 10 : 1, bytes_type->decompose(data_value(bytes("v")))));
+            }
+            odd.compact_and_expire(*s, column_kind::regular_column, row_tombstone(tombstone(5, gc_clock::now())),
+                    gc_clock::now(), always_gc, gc_clock::now());
+            std::vector<column_id> left;
+            odd.for_each_cell([&] (column_id id, const atomic_cell_or_collection&) {
+                left.push_back(id);
+            });
+            auto expected = boost::copy_range<std::vector<column_id>>(ids | boost::adaptors::filtered([] (column_id id) { return id % 2; }));
+            BOOST_REQUIRE(left == expected);
+            for (auto id : ids) {
+                BOOST_REQUIRE_EQUAL(bool(odd.find_cell(id)), bool(id % 2));
+            }
+        };
+
+        check_ids({ 1, 5, 31 });
+        check_ids({ 0, 40, 63, 64, 65, 200, 511 });
+        check_ids({ 3, 33, 700, row::max_sparse_size - 1 });
+        check_ids({ 2, 100, row::max_sparse_size + 50 });
+    });
+}
+
 SEASTAR_TEST_CASE(test_mutation_diff) {
     return seastar::async([] {
         auto my_set_type = set_type_impl::get_instance(int32_type, true);
@@ -1064,10 +1174,13 @@ SEASTAR_TEST_CASE(test_query_digest) {
         auto check_digests_equal = [] (const mutation& m1, const mutation& m2) {
             auto ps1 = partition_slice_builder(*m1.schema()).build();
             auto ps2 = partition_slice_builder(*m2.schema()).build();
-            auto digest1 = *m1.query(ps1, query::result_request::only_digest).digest();
-            auto digest2 = *m2.query(ps2, query::result_request::only_digest).digest();
-            if (digest1 != digest2) {
-                BOOST_FAIL(sprint("Digest should be the same for %s and %s", m1, m2));
+            for (auto da : { query::digest_algorithm::MD5, query::digest_algorithm::MURMUR3 }) {
+                auto opts = query::result_options(query::result_request::only_digest, da);
+                auto digest1 = *m1.query(ps1, opts).digest();
+                auto digest2 = *m2.query(ps2, opts).digest();
+                if (digest1 != digest2) {
+                    BOOST_FAIL(sprint("Digest should be the same for %s and %s", m1, m2));
+                }
             }
         };
 
@@ -1581,3 +1694,37 @@ SEASTAR_TEST_CASE(test_continuity_merging) {
         }
     });
 }
+
+SEASTAR_TEST_CASE(test_rows_are_sorted_whether_appended_or_not) {
+    return seastar::async([] {
+        simple_schema table;
+        auto&& s = *table.schema();
+
+        // Appended, inserted before the last row, and existing keys.
+        std::vector<uint32_t> order = { 1, 2, 5, 3, 7, 0, 7, 8, 4, 8, 9 };
+        auto m = table.new_mutation("pk");
+        for (auto&& ck : order) {
+            table.add_row(m, table.make_ckey(ck), sprint("v%d", ck));
+        }
+
+        // Applied row by row, past the last row or not.
+        auto m2 = table.new_mutation("pk");
+        for (auto&& ck : { 6, 2, 10 }) {
+            auto m3 = table.new_mutation("pk");
+            table.add_row(m3, table.make_ckey(ck), sprint("v%d", ck));
+            m2.apply(m3);
+            m.apply(m3);
+        }
+
+        std::vector<clustering_key> keys;
+        for (auto&& e : m.partition().clustered_rows()) {
+            keys.push_back(e.key());
+        }
+        auto expected = table.make_ckeys(11);
+        BOOST_REQUIRE_EQUAL(keys.size(), expected.size());
+        for (unsigned i = 0; i < keys.size(); ++i) {
+            BOOST_REQUIRE(keys[i].equal(s, expected[i]));
+        }
+        BOOST_REQUIRE_EQUAL(m2.partition().clustered_rows().calculate_size(), 3);
+    });
+}
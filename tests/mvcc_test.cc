@@ -217,6 +217,86 @@ SEASTAR_TEST_CASE(test_full_eviction_marks_affected_range_as_discontinuous) {
     });
 }
 
+SEASTAR_TEST_CASE(test_eviction_of_last_rows_marks_their_range_as_discontinuous) {
+    return seastar::async([] {
+        logalloc::region r;
+        with_allocator(r.allocator(), [&] {
+            logalloc::reclaim_lock l(r);
+
+            simple_schema table;
+            auto&& s = *table.schema();
+
+            auto e = partition_entry(mutation_partition(table.schema()));
+            auto&& p = e.open_version(s).partition();
+            for (int i = 0; i < 10; ++i) {
+                p.clustered_row(s, table.make_ckey(i));
+            }
+            p.ensure_last_dummy(s);
+
+            {
+                auto snap = e.read(r, table.schema());
+                BOOST_REQUIRE_EQUAL(e.evict_last_rows(3), 0);
+            }
+
+            BOOST_REQUIRE_EQUAL(e.evict_last_rows(3), 3);
+            auto squashed = e.squashed(s);
+            BOOST_REQUIRE(squashed.find_row(s, table.make_ckey(6)));
+            BOOST_REQUIRE(!squashed.find_row(s, table.make_ckey(7)));
+            BOOST_REQUIRE(squashed.fully_continuous(s, position_range(
+                position_in_partition::before_all_clustered_rows(),
+                position_in_partition::after_key(table.make_ckey(6))
+            )));
+            BOOST_REQUIRE(squashed.fully_discontinuous(s, position_range(
+                position_in_partition::after_key(table.make_ckey(6)),
+                position_in_partition::after_all_clustered_rows()
+            )));
+
+            // Fewer than 4 rows would be left.
+            BOOST_REQUIRE_EQUAL(e.evict_last_rows(4), 0);
+        });
+    });
+}
+
+SEASTAR_TEST_CASE(test_squashing_versions_keeps_them_for_snapshots) {
+    return seastar::async([] {
+        logalloc::region r;
+        with_allocator(r.allocator(), [&] {
+            logalloc::reclaim_lock l(r);
+
+            simple_schema table;
+            auto&& s = *table.schema();
+            auto ck1 = table.make_ckey(1);
+            auto ck2 = table.make_ckey(2);
+            auto ck3 = table.make_ckey(3);
+
+            auto e = partition_entry(mutation_partition(table.schema()));
+            e.open_version(s).partition().clustered_row(s, ck1);
+            auto snap1 = e.read(r, table.schema());
+            e.open_version(s).partition().clustered_row(s, ck2);
+            auto snap2 = e.read(r, table.schema());
+            e.open_version(s).partition().clustered_row(s, ck3);
+            BOOST_REQUIRE_EQUAL(e.version_count(), 3);
+
+            e.squash_versions(table.schema());
+            BOOST_REQUIRE_EQUAL(e.version_count(), 1);
+
+            auto snap3 = e.read(r, table.schema());
+            auto squashed = snap3->squashed();
+            BOOST_REQUIRE(squashed.find_row(s, ck1));
+            BOOST_REQUIRE(squashed.find_row(s, ck2));
+            BOOST_REQUIRE(squashed.find_row(s, ck3));
+
+            BOOST_REQUIRE(!snap1->squashed().find_row(s, ck2));
+            BOOST_REQUIRE(snap2->squashed().find_row(s, ck2));
+            BOOST_REQUIRE(!snap2->squashed().find_row(s, ck3));
+
+            snap1 = {};
+            snap2 = {};
+            BOOST_REQUIRE_EQUAL(e.version_count(), 1);
+        });
+    });
+}
+
 SEASTAR_TEST_CASE(test_eviction_with_active_reader) {
     return seastar::async([] {
         logalloc::region r;
@@ -124,40 +124,41 @@ auto d2t = [](double d) {
  * @param ring_points ring description
  * @param options strategy options
  * @param ars_ptr strategy object
+ * @param tm token metadata of the strategy
  */
 void full_ring_check(const std::vector<ring_point>& ring_points,
                      const std::map<sstring, sstring>& options,
-                     abstract_replication_strategy* ars_ptr) {
+                     abstract_replication_strategy* ars_ptr,
+                     token_metadata& tm) {
     strategy_sanity_check(ars_ptr, options);
 
+    uint64_t ring_builds_count = ars_ptr->get_ring_builds_count();
     for (auto& rp : ring_points) {
         double cur_point1 = rp.point - 0.5;
         token t1({dht::token::kind::key,
              {(int8_t*)d2t(cur_point1 / ring_points.size()).data(), 8}});
-        uint64_t cache_hit_count = ars_ptr->get_cache_hits_count();
         auto endpoints1 = ars_ptr->get_natural_endpoints(t1);
 
         endpoints_check(ars_ptr, endpoints1);
-        // validate that the result hasn't been taken from the cache
-        BOOST_CHECK(cache_hit_count == ars_ptr->get_cache_hits_count());
+        // validate that the precomputed ring agrees with the strategy
+        BOOST_CHECK(endpoints1 == ars_ptr->calculate_natural_endpoints(t1, tm));
 
         print_natural_endpoints(cur_point1, endpoints1);
 
         //
         // Check a different endpoint in the same range as t1 and validate that
-        // the endpoints has been taken from the cache and that the output is
-        // identical to the one not taken from the cache.
+        // the output is identical.
         //
-        cache_hit_count = ars_ptr->get_cache_hits_count();
         double cur_point2 = rp.point - 0.2;
         token t2({dht::token::kind::key,
              {(int8_t*)d2t(cur_point2 / ring_points.size()).data(), 8}});
         auto endpoints2 = ars_ptr->get_natural_endpoints(t2);
 
         endpoints_check(ars_ptr, endpoints2);
-        BOOST_CHECK(cache_hit_count + 1 == ars_ptr->get_cache_hits_count());
         BOOST_CHECK(endpoints1 == endpoints2);
     }
+    // The whole ring is computed at most once.
+    BOOST_CHECK(ars_ptr->get_ring_builds_count() <= ring_builds_count + 1);
 }
 
 future<> simple_test() {
@@ -204,7 +205,7 @@ future<> simple_test() {
 
         auto ars_ptr = ars_uptr.get();
 
-        full_ring_check(ring_points, options323, ars_ptr);
+        full_ring_check(ring_points, options323, ars_ptr, *tm);
 
         ///////////////
         // Create the replication strategy
@@ -219,16 +220,33 @@ future<> simple_test() {
 
         ars_ptr = ars_uptr.get();
 
-        full_ring_check(ring_points, options320, ars_ptr);
+        full_ring_check(ring_points, options320, ars_ptr, *tm);
 
         //
-        // Check cache invalidation: invalidate the cache and run a full ring
-        // check once again. If cache is not properly invalidated one of the
-        // points will be taken from the cache when it shouldn't and the
-        // corresponding check will fail.
+        // Check ring invalidation: invalidate the ring and run a full ring
+        // check once again, which must compute the ring again.
         //
+        auto ring_builds_count = ars_ptr->get_ring_builds_count();
         tm->invalidate_cached_rings();
-        full_ring_check(ring_points, options320, ars_ptr);
+        full_ring_check(ring_points, options320, ars_ptr, *tm);
+        BOOST_CHECK(ars_ptr->get_ring_builds_count() == ring_builds_count + 1);
+
+        //
+        // A ring computed by another strategy, as on another shard, is used
+        // only if it was computed for the same options and token metadata.
+        //
+        auto shared_ring = ars_ptr->make_replica_ring(*tm);
+        auto other_uptr = abstract_replication_strategy::create_replication_strategy(
+            "test keyspace", "NetworkTopologyStrategy", *tm, options320);
+        other_uptr->set_replica_ring(shared_ring);
+        full_ring_check(ring_points, options320, other_uptr.get(), *tm);
+        BOOST_CHECK(other_uptr->get_ring_builds_count() == 0);
+
+        other_uptr = abstract_replication_strategy::create_replication_strategy(
+            "test keyspace", "NetworkTopologyStrategy", *tm, options323);
+        other_uptr->set_replica_ring(shared_ring);
+        full_ring_check(ring_points, options323, other_uptr.get(), *tm);
+        BOOST_CHECK(other_uptr->get_ring_builds_count() == 1);
 
         return i_endpoint_snitch::stop_snitch();
     });
@@ -290,7 +308,7 @@ future<> heavy_origin_test() {
 
         auto ars_ptr = ars_uptr.get();
 
-        full_ring_check(ring_points, config_options, ars_ptr);
+        full_ring_check(ring_points, config_options, ars_ptr, *tm);
 
         return i_endpoint_snitch::stop_snitch();
     });
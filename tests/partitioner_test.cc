@@ -80,6 +80,34 @@ BOOST_AUTO_TEST_CASE(test_decorated_key_is_compatible_with_origin) {
     BOOST_REQUIRE(dk._key.equal(*s, key));
 }
 
+BOOST_AUTO_TEST_CASE(test_get_tokens_is_same_as_get_token) {
+    auto single = schema_builder("ks", "cf1")
+        .with_column("pk", utf8_type, column_kind::partition_key)
+        .with_column("v", int32_type)
+        .build();
+    auto compound = schema_builder("ks", "cf2")
+        .with_column("c1", int32_type, column_kind::partition_key)
+        .with_column("c2", utf8_type, column_kind::partition_key)
+        .with_column("v", int32_type)
+        .build();
+
+    dht::murmur3_partitioner partitioner;
+    for (auto&& s : {single, compound}) {
+        std::vector<partition_key> keys;
+        for (int i = 0; i < 37; ++i) {
+            auto text = sstring(i, 'k');
+            keys.push_back(s == single ? partition_key::from_single_value(*s, to_bytes(text))
+                                       : partition_key::from_exploded(*s, {int32_type->decompose(i), to_bytes(text)}));
+        }
+        auto views = boost::copy_range<std::vector<partition_key_view>>(keys);
+        auto tokens = partitioner.get_tokens(*s, views);
+        BOOST_REQUIRE_EQUAL(tokens.size(), keys.size());
+        for (size_t i = 0; i < keys.size(); ++i) {
+            BOOST_REQUIRE_EQUAL(tokens[i], partitioner.get_token(*s, keys[i]));
+        }
+    }
+}
+
 BOOST_AUTO_TEST_CASE(test_token_wraparound_1) {
     auto t1 = token_from_long(0x7000'0000'0000'0000);
     auto t2 = token_from_long(0xa000'0000'0000'0000);
@@ -638,6 +666,30 @@ BOOST_AUTO_TEST_CASE(test_murmur3_sharding_with_ignorebits) {
     test_partitioner_sharding(mm3p2s4i, 2, mm3p2s_shard_limits, prev_token, 4);
 }
 
+BOOST_AUTO_TEST_CASE(test_murmur3_ring_ranges) {
+    dht::murmur3_partitioner part(7, 2);
+    BOOST_REQUIRE_EQUAL(part.ring_range_of(dht::minimum_token(), 16), 0);
+    BOOST_REQUIRE_EQUAL(part.ring_range_of(dht::maximum_token(), 16), 15);
+    BOOST_REQUIRE_EQUAL(part.ring_range_of(token_from_long(std::numeric_limits<int64_t>::min() + 1), 16), 0);
+    BOOST_REQUIRE_EQUAL(part.ring_range_of(token_from_long(-1), 16), 7);
+    BOOST_REQUIRE_EQUAL(part.ring_range_of(token_from_long(0), 16), 8);
+    BOOST_REQUIRE_EQUAL(part.ring_range_of(token_from_long(std::numeric_limits<int64_t>::max()), 16), 15);
+    // The ranges don't depend on the sharding of the node.
+    dht::murmur3_partitioner other(1);
+    for (auto t : { -4611686018427387904L, 1152921504606846976L, 8646911284551352320L }) {
+        BOOST_REQUIRE_EQUAL(part.ring_range_of(token_from_long(t), 16), other.ring_range_of(token_from_long(t), 16));
+    }
+    BOOST_REQUIRE_EQUAL(part.ring_range_start(0, 16), dht::minimum_token());
+    BOOST_REQUIRE_EQUAL(part.ring_range_start(8, 16), token_from_long(0));
+    for (unsigned nr_ranges : { 3u, 7u, 16u }) {
+        for (unsigned r = 1; r < nr_ranges; ++r) {
+            auto start = part.ring_range_start(r, nr_ranges);
+            BOOST_REQUIRE_EQUAL(part.ring_range_of(start, nr_ranges), r);
+            BOOST_REQUIRE_EQUAL(part.ring_range_of(token_from_long(long_from_token(start) - 1), nr_ranges), r - 1);
+        }
+    }
+}
+
 BOOST_AUTO_TEST_CASE(test_random_partitioner) {
     using int128 = boost::multiprecision::int128_t;
     auto prev_token = [] (const dht::i_partitioner& part, dht::token token) {
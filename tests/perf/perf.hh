@@ -28,6 +28,10 @@
 
 #include <chrono>
 #include <iosfwd>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
 #include <boost/range/irange.hpp>
 
 template <typename Func>
@@ -138,3 +142,45 @@ future<> time_parallel(Func func, unsigned concurrency_per_core, int iterations
         });
     });
 }
+
+// Counts the instructions the thread of a shard runs in user space. Not
+// available when perf events aren't allowed.
+class instruction_counter {
+    int _fd = -1;
+public:
+    instruction_counter() {
+        perf_event_attr attr{};
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.size = sizeof(attr);
+        attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        _fd = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+    }
+    instruction_counter(const instruction_counter&) = delete;
+    ~instruction_counter() {
+        if (_fd >= 0) {
+            ::close(_fd);
+        }
+    }
+    bool available() const {
+        return _fd >= 0;
+    }
+    void start() {
+        if (_fd >= 0) {
+            ::ioctl(_fd, PERF_EVENT_IOC_RESET, 0);
+            ::ioctl(_fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+    uint64_t stop() {
+        uint64_t count = 0;
+        if (_fd >= 0) {
+            ::ioctl(_fd, PERF_EVENT_IOC_DISABLE, 0);
+            if (::read(_fd, &count, sizeof(count)) != sizeof(count)) {
+                count = 0;
+            }
+        }
+        return count;
+    }
+};
@@ -0,0 +1,238 @@
+/*
+ * Copyright (C) 2018 ScyllaDB
+ */
+
+/*
+ * This file is part of Scylla.
+ *
+ * Scylla is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Scylla is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Measures the commitlog over a matrix of sync modes, segment sizes, entry
+ * sizes and concurrencies.
+ *
+ * For each combination every shard opens a commitlog in --testdir, and adds
+ * entries of that size from that many fibers for --duration seconds. The
+ * commitlog is then shut down and the segments it wrote are replayed. The
+ * results are printed as a JSON array, one object per combination, with:
+ *   - mb_per_sec, entries_per_sec: entries added per second, over all shards,
+ *   - write_us_*: latency percentiles of the additions, which in batch mode
+ *     include the flush of the entry,
+ *   - fsync_us_*: latency percentiles of the flushes of the segment files,
+ *   - disk_bytes_per_byte: bytes written to the segments, with the entry
+ *     headers, the chunk headers and the alignment slack, over the bytes of
+ *     the entries,
+ *   - replay_mb_per_sec: bytes of segments read and parsed per second.
+ */
+
+#include <boost/algorithm/string/split.hpp>
+#include <boost/algorithm/string/classification.hpp>
+#include <boost/range/irange.hpp>
+#include <core/app-template.hh>
+#include <core/distributed.hh>
+#include <core/reactor.hh>
+#include <core/sstring.hh>
+#include <core/thread.hh>
+
+#include "db/commitlog/commitlog.hh"
+#include "utils/log_linear_histogram.hh"
+#include "utils/UUID_gen.hh"
+
+#include "disk-error-handler.hh"
+
+thread_local disk_error_signal_type commit_error;
+thread_local disk_error_signal_type general_disk_error;
+
+using commitlog = db::commitlog;
+
+static const std::unordered_map<sstring, commitlog::sync_mode> sync_modes = {
+    { "periodic", commitlog::sync_mode::PERIODIC },
+    { "batch", commitlog::sync_mode::BATCH },
+};
+
+struct test_config {
+    std::chrono::seconds duration;
+    uint64_t sync_period_ms;
+    std::chrono::microseconds batch_window;
+    sstring dir;
+};
+
+struct test_case {
+    sstring sync_mode_name;
+    unsigned segment_size_mb;
+    unsigned entry_size;
+    unsigned concurrency;
+};
+
+// Of one shard, summed over all of them.
+struct shard_result {
+    uint64_t entries = 0;
+    uint64_t entry_bytes = 0;
+    uint64_t disk_bytes = 0;
+    uint64_t replayed_bytes = 0;
+    uint64_t replayed_entries = 0;
+    double write_seconds = 0;
+    double replay_seconds = 0;
+    utils::log_linear_histogram write_latency;
+    utils::log_linear_histogram fsync_latency;
+
+    shard_result& operator+=(const shard_result& o) {
+        entries += o.entries;
+        entry_bytes += o.entry_bytes;
+        disk_bytes += o.disk_bytes;
+        replayed_bytes += o.replayed_bytes;
+        replayed_entries += o.replayed_entries;
+        // The shards run concurrently.
+        write_seconds = std::max(write_seconds, o.write_seconds);
+        replay_seconds = std::max(replay_seconds, o.replay_seconds);
+        write_latency += o.write_latency;
+        fsync_latency += o.fsync_latency;
+        return *this;
+    }
+};
+
+static std::vector<sstring> split_list(const sstring& s) {
+    std::vector<sstring> ret;
+    boost::split(ret, s, boost::is_any_of(","));
+    return ret;
+}
+
+static shard_result run_on_shard(const test_config& cfg, const test_case& tc) {
+    commitlog::config clcfg;
+    clcfg.commit_log_location = cfg.dir;
+    clcfg.commitlog_segment_size_in_mb = tc.segment_size_mb;
+    clcfg.commitlog_sync_period_in_ms = cfg.sync_period_ms;
+    clcfg.mode = sync_modes.at(tc.sync_mode_name);
+    clcfg.batch_window = cfg.batch_window;
+    clcfg.metrics_category_name = "";
+    auto log = commitlog::create_commitlog(clcfg).get0();
+
+    shard_result r;
+    auto id = utils::UUID_gen::get_time_UUID();
+    auto payload = make_lw_shared<sstring>(sstring::initialized_later(), tc.entry_size);
+    std::fill(payload->begin(), payload->end(), 'x');
+
+    auto start = std::chrono::steady_clock::now();
+    auto end = start + cfg.duration;
+    parallel_for_each(boost::irange(0u, tc.concurrency), [&] (unsigned) {
+        return do_until([end] { return std::chrono::steady_clock::now() >= end; }, [&] {
+            auto write_start = std::chrono::steady_clock::now();
+            return log.add_mutation(id, payload->size(), [payload] (commitlog::output& out) {
+                out.write(payload->begin(), payload->end());
+            }).then([&, write_start] (db::rp_handle h) {
+                r.write_latency.add(std::chrono::steady_clock::now() - write_start);
+                ++r.entries;
+                r.entry_bytes += payload->size();
+                // Keeps the segment dirty, so that it is left to replay.
+                h.release();
+            });
+        });
+    }).get();
+    auto segments = log.get_active_segment_names();
+    log.shutdown().get();
+    r.write_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    r.disk_bytes = log.get_bytes_written() + log.get_bytes_slack();
+    r.fsync_latency = log.get_flush_latency();
+
+    auto replay_start = std::chrono::steady_clock::now();
+    for (auto&& seg : segments) {
+        auto s = commitlog::read_log_file(seg, [&r] (temporary_buffer<char> buf, db::replay_position) {
+            ++r.replayed_entries;
+            r.replayed_bytes += buf.size();
+            return make_ready_future<>();
+        }).get0();
+        s->done().get();
+    }
+    r.replay_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - replay_start).count();
+
+    log.clear().get();
+    return r;
+}
+
+static shard_result run_test_case(const test_config& cfg, const test_case& tc) {
+    return map_reduce(boost::irange(0u, smp::count), [&cfg, &tc] (unsigned shard) {
+        return smp::submit_to(shard, [&cfg, &tc] {
+            return seastar::async([&cfg, &tc] {
+                return run_on_shard(cfg, tc);
+            });
+        });
+    }, shard_result(), [] (shard_result a, const shard_result& b) {
+        a += b;
+        return a;
+    }).get0();
+}
+
+static sstring to_json(const test_case& tc, const shard_result& r) {
+    constexpr double mb = 1 << 20;
+    return sprint("{\"sync_mode\": \"%s\", \"segment_size_mb\": %d, \"entry_size\": %d, \"concurrency\": %d, "
+                  "\"mb_per_sec\": %.2f, \"entries_per_sec\": %.0f, "
+                  "\"write_us_p50\": %d, \"write_us_p99\": %d, \"write_us_p999\": %d, \"write_us_max\": %d, "
+                  "\"fsyncs\": %d, \"fsync_us_p50\": %d, \"fsync_us_p99\": %d, \"fsync_us_max\": %d, "
+                  "\"disk_bytes_per_byte\": %.3f, \"replayed_entries\": %d, \"replay_mb_per_sec\": %.2f}",
+                  tc.sync_mode_name, tc.segment_size_mb, tc.entry_size, tc.concurrency,
+                  r.entry_bytes / mb / r.write_seconds, r.entries / r.write_seconds,
+                  r.write_latency.percentile(0.5), r.write_latency.percentile(0.99), r.write_latency.percentile(0.999), r.write_latency.max(),
+                  r.fsync_latency.count(), r.fsync_latency.percentile(0.5), r.fsync_latency.percentile(0.99), r.fsync_latency.max(),
+                  r.entry_bytes ? double(r.disk_bytes) / r.entry_bytes : 0.0, r.replayed_entries,
+                  r.replay_seconds > 0 ? r.replayed_bytes / mb / r.replay_seconds : 0.0);
+}
+
+int main(int argc, char** argv) {
+    namespace bpo = boost::program_options;
+    app_template app;
+    app.add_options()
+        ("sync-modes", bpo::value<sstring>()->default_value("periodic,batch"), "comma-separated sync modes, of: periodic, batch")
+        ("segment-sizes", bpo::value<sstring>()->default_value("1,32"), "comma-separated segment sizes, in MB")
+        ("entry-sizes", bpo::value<sstring>()->default_value("128,1024,16384"), "comma-separated entry sizes, in bytes")
+        ("concurrency", bpo::value<sstring>()->default_value("1,16,128"), "comma-separated numbers of concurrent writers per shard")
+        ("duration", bpo::value<unsigned>()->default_value(5), "seconds of writes of each combination")
+        ("sync-period", bpo::value<uint64_t>()->default_value(10000), "sync period of the periodic mode, in ms")
+        ("batch-window", bpo::value<unsigned>()->default_value(0), "batch window of the batch mode, in microseconds")
+        ("testdir", bpo::value<sstring>()->default_value("/var/lib/scylla/perf-tests"), "directory in which to store the segments");
+
+    return app.run(argc, argv, [&app] {
+        return seastar::async([&app] {
+            auto& opts = app.configuration();
+            test_config cfg;
+            cfg.duration = std::chrono::seconds(opts["duration"].as<unsigned>());
+            cfg.sync_period_ms = opts["sync-period"].as<uint64_t>();
+            cfg.batch_window = std::chrono::microseconds(opts["batch-window"].as<unsigned>());
+            cfg.dir = opts["testdir"].as<sstring>();
+            recursive_touch_directory(cfg.dir).get();
+
+            std::vector<test_case> cases;
+            for (auto&& m : split_list(opts["sync-modes"].as<sstring>())) {
+                if (!sync_modes.count(m)) {
+                    throw std::invalid_argument(sprint("Unknown sync mode %s", m));
+                }
+                for (auto&& seg : split_list(opts["segment-sizes"].as<sstring>())) {
+                    for (auto&& size : split_list(opts["entry-sizes"].as<sstring>())) {
+                        for (auto&& c : split_list(opts["concurrency"].as<sstring>())) {
+                            cases.push_back(test_case{m, unsigned(std::stoul(seg)), unsigned(std::stoul(size)), unsigned(std::stoul(c))});
+                        }
+                    }
+                }
+            }
+
+            std::cout << "[\n";
+            for (auto it = cases.begin(); it != cases.end(); ++it) {
+                auto r = run_test_case(cfg, *it);
+                std::cout << "  " << to_json(*it, r) << (std::next(it) == cases.end() ? "\n" : ",\n") << std::flush;
+            }
+            std::cout << "]\n";
+            return 0;
+        });
+    });
+}
@@ -164,6 +164,18 @@ class counting_consumer {
     uint64_t consume_end_of_stream() { return _fragments; }
 };
 
+// Stops after that many fragments, as a page of a paged query does.
+class limited_counting_consumer {
+    uint64_t _fragments = 0;
+    uint64_t _limit;
+public:
+    explicit limited_counting_consumer(uint64_t limit) : _limit(limit) { }
+    stop_iteration consume(tombstone) { return stop_iteration::no; }
+    template<typename Fragment>
+    stop_iteration consume(Fragment&& f) { return stop_iteration(++_fragments == _limit); }
+    uint64_t consume_end_of_stream() { return _fragments; }
+};
+
 static
 uint64_t consume_all(streamed_mutation& sm) {
     return consume(sm, counting_consumer()).get0();
@@ -327,6 +339,42 @@ static test_result slice_rows_single_key(column_family& cf, int offset = 0, int
     return {before, fragments};
 }
 
+static test_result slice_rows_reversed(column_family& cf, int offset = 0, int n_read = 1) {
+    auto slice = partition_slice_builder(*cf.schema())
+        .with_range(query::clustering_range::make(
+            {clustering_key::from_singular(*cf.schema(), offset)},
+            {clustering_key::from_singular(*cf.schema(), offset + n_read), false}))
+        .reversed()
+        .build();
+    auto pr = dht::partition_range::make_singular(make_pkey(*cf.schema(), 0));
+    auto rd = make_reversing_reader(cf.as_mutation_source(), cf.schema(), pr, slice, default_priority_class());
+    return test_reading_all(rd);
+}
+
+// Reads n_pages pages of page_size rows of the partition, starting at offset.
+// Each page is read by a new reader, which resumes in the middle of the
+// partition, as for a paged query whose reader wasn't kept.
+static test_result read_pages(column_family& cf, int offset, int page_size, int n_pages) {
+    auto pr = dht::partition_range::make_singular(make_pkey(*cf.schema(), 0));
+
+    metrics_snapshot before;
+    uint64_t fragments = 0;
+    for (int page = 0; page < n_pages; ++page) {
+        auto slice = partition_slice_builder(*cf.schema())
+            .with_range(query::clustering_range::make_starting_with(
+                clustering_key::from_singular(*cf.schema(), offset + page * page_size)))
+            .build();
+        auto rd = cf.make_reader(cf.schema(), pr, slice);
+        streamed_mutation_opt smo = rd().get0();
+        if (!smo) {
+            break;
+        }
+        fragments += consume(*smo, limited_counting_consumer(page_size)).get0();
+    }
+
+    return {before, fragments};
+}
+
 // cf is for ks.small_part
 static test_result slice_partitions(column_family& cf, int n, int offset = 0, int n_read = 1) {
     auto keys = make_pkeys(cf.schema(), n);
@@ -354,6 +402,9 @@ bytes make_blob(size_t blob_size) {
     return big_blob;
 }
 
+// Number of sstables the rows of ks.multi_sstable are spread over.
+static constexpr int n_overlapping_sstables = 20;
+
 struct table_config {
     sstring name;
     int n_rows;
@@ -487,6 +538,63 @@ void populate(cql_test_env& env, table_config cfg) {
         std::cout << "compacting...\n";
         cf.compact_all_sstables().get();
     }
+
+    // Large partition with its rows spread over overlapping sstables
+    env.execute_cql("create table multi_sstable (pk int, ck int, value blob, primary key (pk, ck))"
+        " WITH compression = { 'sstable_compression' : '' }"
+        " AND compaction = { 'class' : 'SizeTieredCompactionStrategy', 'enabled' : 'false' };").get();
+
+    {
+        std::cout << "Populating ks.multi_sstable with " << cfg.n_rows << " rows in " << n_overlapping_sstables << " sstables...";
+
+        auto insert_id = env.prepare("update multi_sstable set \"value\" = ? where \"pk\" = 0 and \"ck\" = ?;").get0();
+        column_family& cf = db.find_column_family("ks", "multi_sstable");
+
+        // Each sstable has every n_overlapping_sstables-th row, so that all
+        // of them span the whole partition.
+        for (int i = 0; i < n_overlapping_sstables; ++i) {
+            for (int ck = i; ck < cfg.n_rows; ck += n_overlapping_sstables) {
+                env.execute_prepared(insert_id, {{
+                                                     cql3::raw_value::make_value(data_value(make_blob(cfg.value_size)).serialize()),
+                                                     cql3::raw_value::make_value(data_value(ck).serialize())
+                                                 }}).get();
+            }
+            cf.flush().get();
+        }
+        std::cout << "\n";
+    }
+
+    // Large partition with a range tombstone between each two rows
+    env.execute_cql("create table tombstones (pk int, ck int, value blob, primary key (pk, ck))"
+        " WITH compression = { 'sstable_compression' : '' };").get();
+
+    {
+        std::cout << "Populating ks.tombstones with " << cfg.n_rows << " rows and range tombstones...";
+
+        auto insert_id = env.prepare("update tombstones set \"value\" = ? where \"pk\" = 0 and \"ck\" = ?;").get0();
+        auto delete_id = env.prepare("delete from tombstones where \"pk\" = 0 and \"ck\" > ? and \"ck\" < ?;").get0();
+
+        // Rows have the even clustering keys, and tombstones cover the odd
+        // ones between them.
+        for (int i = 0; i < cfg.n_rows; ++i) {
+            env.execute_prepared(delete_id, {{
+                                                 cql3::raw_value::make_value(data_value(2 * i).serialize()),
+                                                 cql3::raw_value::make_value(data_value(2 * i + 2).serialize())
+                                             }}).get();
+            env.execute_prepared(insert_id, {{
+                                                 cql3::raw_value::make_value(data_value(make_blob(cfg.value_size)).serialize()),
+                                                 cql3::raw_value::make_value(data_value(2 * i).serialize())
+                                             }}).get();
+        }
+
+        column_family& cf = db.find_column_family("ks", "tombstones");
+
+        std::cout << "flushing...\n";
+        cf.flush().get();
+
+        std::cout << "compacting...\n";
+        cf.compact_all_sstables().get();
+    }
 }
 
 static unsigned cardinality(int_range r) {
@@ -521,6 +629,7 @@ int_range live_range;
 
 void clear_cache() {
     global_cache_tracker().clear();
+    sstables::shared_index_lists::evict_all_cached_pages();
 }
 
 void on_test_group() {
@@ -817,11 +926,129 @@ void test_small_partition_slicing(column_family& cf2) {
     test(cfg.n_rows / 2, 4096);
 }
 
+void test_large_partition_reversed_slicing(column_family& cf) {
+    std::cout << sprint("%-7s %-7s ", "offset", "read") << test_result::table_header() << "\n";
+    auto test = [&] (int offset, int read) {
+        on_test_case();
+        auto r = slice_rows_reversed(cf, offset, read);
+        std::cout << sprint("%-7d %-7d ", offset, read) << r.table_row() << "\n";
+        check_fragment_count(r, std::min(cfg.n_rows - offset, read));
+    };
+
+    test(0, 1);
+    test(0, 32);
+    test(0, 256);
+    test(0, 4096);
+
+    test(cfg.n_rows / 2, 1);
+    test(cfg.n_rows / 2, 32);
+    test(cfg.n_rows / 2, 256);
+    test(cfg.n_rows / 2, 4096);
+
+    test(cfg.n_rows - 4096, 4096);
+}
+
+void test_large_partition_paging(column_family& cf) {
+    std::cout << sprint("%-7s %-7s %-7s ", "offset", "page", "pages") << test_result::table_header() << "\n";
+    auto test = [&] (int offset, int page_size, int n_pages) {
+        on_test_case();
+        auto r = read_pages(cf, offset, page_size, n_pages);
+        std::cout << sprint("%-7d %-7d %-7d ", offset, page_size, n_pages) << r.table_row() << "\n";
+        check_fragment_count(r, std::min(cfg.n_rows - offset, page_size * n_pages));
+        if (cache_enabled) {
+            r = read_pages(cf, offset, page_size, n_pages);
+            std::cout << sprint("%-7d %-7d %-7d ", offset, page_size, n_pages) << r.table_row() << "\n";
+            check_no_disk_reads(r);
+        }
+    };
+
+    test(0, 100, 10);
+    test(0, 1000, 10);
+    test(0, 5000, 10);
+
+    test(cfg.n_rows / 2, 100, 10);
+    test(cfg.n_rows / 2, 1000, 10);
+    test(cfg.n_rows / 2, 5000, 10);
+}
+
+void test_multi_sstable_slicing(column_family& cf) {
+    std::cout << sprint("%-7s %-7s ", "offset", "read") << test_result::table_header() << "\n";
+    auto test = [&] (int offset, int read) {
+        on_test_case();
+        auto r = slice_rows_single_key(cf, offset, read);
+        std::cout << sprint("%-7d %-7d ", offset, read) << r.table_row() << "\n";
+        check_fragment_count(r, std::min(cfg.n_rows - offset, read));
+    };
+
+    test(0, 1);
+    test(0, 32);
+    test(0, 256);
+    test(0, 4096);
+
+    test(cfg.n_rows / 2, 1);
+    test(cfg.n_rows / 2, 32);
+    test(cfg.n_rows / 2, 256);
+    test(cfg.n_rows / 2, 4096);
+}
+
+void test_multi_sstable_skips(column_family& cf) {
+    std::cout << sprint("%-7s %-7s ", "read", "skip") << test_result::table_header() << "\n";
+    auto test = [&] (int n_read, int n_skip) {
+        on_test_case();
+        auto r = scan_rows_with_stride(cf, cfg.n_rows, n_read, n_skip);
+        std::cout << sprint("%-7d %-7d ", n_read, n_skip) << r.table_row() << "\n";
+        check_fragment_count(r, count_for_skip_pattern(cfg.n_rows, n_read, n_skip));
+    };
+
+    test(1, 0);
+    if (cache_enabled) {
+        // The whole partition is cached now.
+        auto r = scan_rows_with_stride(cf, cfg.n_rows);
+        std::cout << sprint("%-7d %-7d ", 1, 0) << r.table_row() << "\n";
+        check_no_disk_reads(r);
+        check_fragment_count(r, cfg.n_rows);
+    }
+
+    test(1, 64);
+    test(1, 4096);
+
+    test(64, 64);
+    test(64, 4096);
+}
+
+void test_range_tombstones_slicing(column_family& cf) {
+    std::cout << sprint("%-7s %-7s ", "offset", "read") << test_result::table_header() << "\n";
+    auto test = [&] (int offset, int read) {
+        on_test_case();
+        auto r = slice_rows_single_key(cf, offset, read);
+        std::cout << sprint("%-7d %-7d ", offset, read) << r.table_row() << "\n";
+    };
+
+    on_test_case();
+    auto r = scan_rows_with_stride(cf, 2 * cfg.n_rows);
+    std::cout << sprint("%-7s %-7s ", "all", "") << r.table_row() << "\n";
+    check_fragment_count(r, 2 * cfg.n_rows);
+
+    // Rows and tombstones alternate, so that a slice of n keys has about
+    // n / 2 of each.
+    test(0, 2);
+    test(0, 64);
+    test(0, 512);
+    test(0, 8192);
+
+    test(cfg.n_rows, 2);
+    test(cfg.n_rows, 64);
+    test(cfg.n_rows, 512);
+    test(cfg.n_rows, 8192);
+}
+
 struct test_group {
     using requires_cache = seastar::bool_class<class requires_cache_tag>;
     enum type {
         large_partition,
         small_partition,
+        multi_sstable,
+        range_tombstones,
     };
 
     std::string name;
@@ -875,6 +1102,21 @@ static std::initializer_list<test_group> test_groups = {
         test_group::type::large_partition,
         test_large_partition_forwarding,
     },
+    {
+        "large-partition-reversed-slicing",
+        "Testing reversed slicing of large partition",
+        test_group::requires_cache::no,
+        test_group::type::large_partition,
+        test_large_partition_reversed_slicing,
+    },
+    {
+        "large-partition-paging",
+        "Testing paging through large partition.\n" \
+        "Each page is read by a new reader, resuming in the middle of the partition",
+        test_group::requires_cache::no,
+        test_group::type::large_partition,
+        test_large_partition_paging,
+    },
     {
         "small-partition-skips",
         "Testing scanning small partitions with skips.\n" \
@@ -890,8 +1132,40 @@ static std::initializer_list<test_group> test_groups = {
         test_group::type::small_partition,
         test_small_partition_slicing,
     },
+    {
+        "multi-sstable-slicing",
+        "Testing slicing of large partition spread over overlapping sstables",
+        test_group::requires_cache::no,
+        test_group::type::multi_sstable,
+        test_multi_sstable_slicing,
+    },
+    {
+        "multi-sstable-skips",
+        "Testing scanning large partition spread over overlapping sstables with skips.\n" \
+        "Reads whole range interleaving reads with skips according to read-skip pattern",
+        test_group::requires_cache::no,
+        test_group::type::multi_sstable,
+        test_multi_sstable_skips,
+    },
+    {
+        "range-tombstones-slicing",
+        "Testing slicing of large partition with a range tombstone between each two rows",
+        test_group::requires_cache::no,
+        test_group::type::range_tombstones,
+        test_range_tombstones_slicing,
+    },
 };
 
+static const char* describe(test_group::type type) {
+    switch (type) {
+    case test_group::type::large_partition: return "large partition test";
+    case test_group::type::small_partition: return "small partition test";
+    case test_group::type::multi_sstable: return "multi-sstable large partition test";
+    case test_group::type::range_tombstones: return "range tombstone large partition test";
+    }
+    abort();
+}
+
 int main(int argc, char** argv) {
     namespace bpo = boost::program_options;
     app.add_options()
@@ -920,8 +1194,7 @@ int main(int argc, char** argv) {
             for (auto&& tc : test_groups) {
                 std::cout << "\tname: " << tc.name << "\n"
                           << (tc.needs_cache ? "\trequires: --enable-cache\n" : "")
-                          << (tc.partition_type == test_group::type::large_partition
-                              ? "\tlarge partition test\n" : "\tsmall partition test\n")
+                          << "\t" << describe(tc.partition_type) << "\n"
                           << "\tdescription:\n\t\t" << boost::replace_all_copy(tc.message, "\n", "\n\t\t") << "\n\n";
             }
             return make_ready_future<int>(0);
@@ -1007,6 +1280,18 @@ int main(int argc, char** argv) {
 
                     column_family& cf2 = db.find_column_family("ks", "small_part");
                     run_tests(cf2, test_group::type::small_partition);
+
+                    // Data sets populated by older versions don't have these tables.
+                    if (db.has_schema("ks", "multi_sstable")) {
+                        run_tests(db.find_column_family("ks", "multi_sstable"), test_group::type::multi_sstable);
+                    } else {
+                        std::cout << "\nskipping multi-sstable tests, populate again to run them\n";
+                    }
+                    if (db.has_schema("ks", "tombstones")) {
+                        run_tests(db.find_column_family("ks", "tombstones"), test_group::type::range_tombstones);
+                    } else {
+                        std::cout << "\nskipping range tombstone tests, populate again to run them\n";
+                    }
                 }
             });
         }, db_cfg).then([] {
@@ -20,8 +20,13 @@
  */
 
 #include "utils/murmur_hash.hh"
+#include "utils/crc.hh"
+#include "utils/adler32.hh"
 #include "tests/perf/perf.hh"
 
+#include <numeric>
+#include <zlib.h>
+
 #include "disk-error-handler.hh"
 
 thread_local disk_error_signal_type commit_error;
@@ -53,5 +58,32 @@ int main(int argc, char* argv[]) {
         sink += dst[1];
     });
 
+    // The sizes of a commitlog entry, and of a compressed sstable chunk.
+    for (auto size : { 512, 64 * 1024 }) {
+        auto buf = bytes(bytes::initialized_later(), size);
+        std::iota(buf.begin(), buf.end(), 0);
+        auto data = reinterpret_cast<const uint8_t*>(buf.data());
+
+        std::cout << "Timing crc32 of " << size << " bytes...\n";
+
+        time_it([&] {
+            utils::crc32 c;
+            c.process(data, buf.size());
+            sink += c.get();
+        }, 5, 100);
+
+        std::cout << "Timing adler32 of " << size << " bytes...\n";
+
+        time_it([&] {
+            sink += utils::adler32(1, data, buf.size());
+        }, 5, 100);
+
+        std::cout << "Timing zlib adler32 of " << size << " bytes...\n";
+
+        time_it([&] {
+            sink += ::adler32(1, data, buf.size());
+        }, 5, 100);
+    }
+
     black_hole = sink;
 }
@@ -0,0 +1,288 @@
+/*
+ * Copyright (C) 2018 ScyllaDB
+ */
+
+/*
+ * This file is part of Scylla.
+ *
+ * Scylla is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Scylla is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Stresses LSA allocation, compaction and eviction with allocation patterns:
+ *   - mixed: objects of sizes spread log-uniformly over 16 B - 16 KB,
+ *   - large: managed_bytes of 64 KB - 1 MB, allocated in fragments,
+ *   - growth: objects replaced by ones twice as large, as collections grow,
+ *     back to the smallest past 64 KB,
+ *   - memtable_cache: rows written to memtables, which are merged into a
+ *     cache of the same shard as they fill up, the cache being evicted from
+ *     to make room.
+ *
+ * The first three fill a region up to --occupancy of the shard's memory
+ * and then replace random objects by new ones, so that memory fills up
+ * and has to be reclaimed by compaction. The results are printed as a
+ * JSON array, one object per scenario, with:
+ *   - alloc_ns_*: latency percentiles of the allocations, or of the
+ *     memtable writes, including the reclamation they ran into,
+ *   - reclaims, reclaim_us_*: reclamation cycles run when allocating, and
+ *     their durations,
+ *   - compacted_per_allocated: bytes moved by compaction per byte allocated,
+ *   - occupancy: used fraction of the LSA memory at the end of the scenario,
+ *   - evictions: partitions evicted from the cache.
+ *
+ * Runs on a single shard, give it the memory to stress with -m.
+ */
+
+#include <boost/algorithm/string/split.hpp>
+#include <boost/algorithm/string/classification.hpp>
+#include <boost/range/algorithm/find.hpp>
+#include <core/app-template.hh>
+#include <core/thread.hh>
+#include <seastar/core/memory.hh>
+#include <cmath>
+#include <random>
+
+#include "tests/simple_schema.hh"
+#include "utils/logalloc.hh"
+#include "utils/managed_bytes.hh"
+#include "utils/log_linear_histogram.hh"
+#include "row_cache.hh"
+#include "memtable.hh"
+
+#include "disk-error-handler.hh"
+
+thread_local disk_error_signal_type commit_error;
+thread_local disk_error_signal_type general_disk_error;
+
+using clock_type = std::chrono::steady_clock;
+
+static const std::vector<sstring> scenarios = { "mixed", "large", "growth", "memtable_cache" };
+
+struct test_config {
+    uint64_t operations;
+    double occupancy;
+    unsigned partitions;
+    size_t memtable_size;
+};
+
+struct test_result {
+    uint64_t operations = 0;
+    double seconds = 0;
+    // In nanoseconds.
+    utils::log_linear_histogram alloc_latency;
+    utils::log_linear_histogram reclaim_latency;
+    uint64_t allocated = 0;
+    uint64_t compacted = 0;
+    double occupancy = 0;
+    uint64_t evictions = 0;
+};
+
+static std::vector<sstring> split_list(const sstring& s) {
+    std::vector<sstring> ret;
+    boost::split(ret, s, boost::is_any_of(","));
+    return ret;
+}
+
+// Records the allocation and reclamation statistics of the scenario run
+// during its lifetime.
+class scenario_stats {
+    test_result& _r;
+    logalloc::tracker::stats _stats;
+    utils::log_linear_histogram _reclaim_latency;
+    clock_type::time_point _start;
+public:
+    explicit scenario_stats(test_result& r)
+        : _r(r)
+        , _stats(logalloc::shard_tracker().statistics())
+        , _reclaim_latency(logalloc::shard_tracker().reclaim_latency())
+        , _start(clock_type::now()) {
+    }
+    ~scenario_stats() {
+        auto& tracker = logalloc::shard_tracker();
+        auto st = tracker.statistics();
+        _r.seconds = std::chrono::duration<double>(clock_type::now() - _start).count();
+        _r.allocated = st.memory_allocated - _stats.memory_allocated;
+        _r.compacted = st.memory_compacted - _stats.memory_compacted;
+        _r.reclaim_latency = tracker.reclaim_latency() - _reclaim_latency;
+        _r.occupancy = tracker.region_occupancy().used_fraction();
+    }
+};
+
+template <typename Func>
+static void timed(test_result& r, Func&& func) {
+    auto start = clock_type::now();
+    func();
+    r.alloc_latency.add(std::chrono::duration_cast<std::chrono::nanoseconds>(clock_type::now() - start).count());
+    ++r.operations;
+}
+
+// Fills a region with objects up to the occupancy and then replaces them
+// at random. next_size() returns the size of the object replacing one of
+// the given size.
+template <typename NextSize>
+static test_result run_churn(const test_config& cfg, NextSize&& next_size) {
+    test_result r;
+    std::default_random_engine gen;
+    logalloc::region region;
+    std::vector<managed_bytes> objects;
+    size_t live = 0;
+    auto target = size_t(memory::stats().total_memory() * cfg.occupancy);
+    {
+        scenario_stats stats(r);
+        while (live < target) {
+            auto size = next_size(gen, 0);
+            timed(r, [&] {
+                with_allocator(region.allocator(), [&] {
+                    objects.emplace_back(managed_bytes::initialized_later(), size);
+                });
+            });
+            live += size;
+        }
+        std::uniform_int_distribution<size_t> pick(0, objects.size() - 1);
+        for (uint64_t i = 0; i < cfg.operations; ++i) {
+            auto& o = objects[pick(gen)];
+            auto size = next_size(gen, o.size());
+            timed(r, [&] {
+                with_allocator(region.allocator(), [&] {
+                    live -= o.size();
+                    o = managed_bytes(managed_bytes::initialized_later(), size);
+                    live += size;
+                });
+            });
+            if (i % 1024 == 0) {
+                seastar::thread::yield();
+            }
+        }
+    }
+    with_allocator(region.allocator(), [&] {
+        objects.clear();
+    });
+    return r;
+}
+
+static test_result run_mixed(const test_config& cfg) {
+    std::uniform_real_distribution<double> log_size(std::log(16), std::log(16 << 10));
+    return run_churn(cfg, [&] (std::default_random_engine& gen, size_t) {
+        return size_t(std::exp(log_size(gen)));
+    });
+}
+
+static test_result run_large(const test_config& cfg) {
+    std::uniform_int_distribution<size_t> size(64 << 10, 1 << 20);
+    return run_churn(cfg, [&] (std::default_random_engine& gen, size_t) {
+        return size(gen);
+    });
+}
+
+static test_result run_growth(const test_config& cfg) {
+    // The objects are filled at random steps of the growth, so that the live
+    // size stays about the same as they grow and are reset.
+    std::uniform_int_distribution<unsigned> step(0, 12);
+    return run_churn(cfg, [&] (std::default_random_engine& gen, size_t prev) {
+        if (!prev) {
+            return size_t(16) << step(gen);
+        }
+        return prev < (64 << 10) ? prev * 2 : 16;
+    });
+}
+
+static test_result run_memtable_cache(const test_config& cfg) {
+    test_result r;
+    std::default_random_engine gen;
+    std::uniform_int_distribution<unsigned> pk(0, cfg.partitions - 1);
+    std::uniform_int_distribution<unsigned> ck(0, 1000);
+    std::uniform_real_distribution<double> log_size(std::log(16), std::log(4 << 10));
+    simple_schema ss;
+    auto s = ss.schema();
+    cache_tracker tracker("perf_lsa_cache");
+    row_cache cache(s, make_empty_snapshot_source(), tracker, is_continuous::yes);
+    auto mt = make_lw_shared<memtable>(s);
+    auto ops = cfg.operations;
+    {
+        scenario_stats stats(r);
+        for (uint64_t i = 0; i < ops; ++i) {
+            auto m = ss.new_mutation(sprint("pk%010d", pk(gen)));
+            ss.add_row(m, ss.make_ckey(ck(gen)), sstring(size_t(std::exp(log_size(gen))), 'v'));
+            timed(r, [&] {
+                mt->apply(m);
+            });
+            if (mt->occupancy().total_space() >= cfg.memtable_size) {
+                cache.update([] { }, *mt).get();
+                mt = make_lw_shared<memtable>(s);
+            }
+            if (i % 1024 == 0) {
+                seastar::thread::yield();
+            }
+        }
+    }
+    r.evictions = tracker.get_stats().partition_evictions;
+    return r;
+}
+
+static sstring to_json(const sstring& scenario, const test_result& r) {
+    return sprint("{\"scenario\": \"%s\", \"operations\": %d, \"ops_per_sec\": %.0f, "
+                  "\"alloc_ns_p50\": %d, \"alloc_ns_p99\": %d, \"alloc_ns_p999\": %d, \"alloc_ns_max\": %d, "
+                  "\"reclaims\": %d, \"reclaim_us_p50\": %d, \"reclaim_us_p99\": %d, \"reclaim_us_max\": %d, "
+                  "\"compacted_per_allocated\": %.3f, \"occupancy\": %.3f, \"evictions\": %d}",
+                  scenario, r.operations, r.operations / r.seconds,
+                  r.alloc_latency.percentile(0.5), r.alloc_latency.percentile(0.99), r.alloc_latency.percentile(0.999), r.alloc_latency.max(),
+                  r.reclaim_latency.count(), r.reclaim_latency.percentile(0.5), r.reclaim_latency.percentile(0.99), r.reclaim_latency.max(),
+                  r.allocated ? double(r.compacted) / r.allocated : 0.0, r.occupancy, r.evictions);
+}
+
+int main(int argc, char** argv) {
+    namespace bpo = boost::program_options;
+    app_template app;
+    app.add_options()
+        ("scenarios", bpo::value<sstring>()->default_value("mixed,large,growth,memtable_cache"), "comma-separated scenarios, of: mixed, large, growth, memtable_cache")
+        ("operations", bpo::value<uint64_t>()->default_value(1000000), "number of objects replaced, or rows written, after the fill")
+        ("occupancy", bpo::value<double>()->default_value(0.5), "fraction of the shard's memory filled with live objects")
+        ("partitions", bpo::value<unsigned>()->default_value(100000), "number of partitions written to of the memtable_cache scenario")
+        ("memtable-size", bpo::value<unsigned>()->default_value(64), "size at which memtables are merged into the cache, in MB");
+
+    return app.run(argc, argv, [&app] {
+        return seastar::async([&app] {
+            auto& opts = app.configuration();
+            test_config cfg;
+            cfg.operations = opts["operations"].as<uint64_t>();
+            cfg.occupancy = opts["occupancy"].as<double>();
+            cfg.partitions = opts["partitions"].as<unsigned>();
+            cfg.memtable_size = size_t(opts["memtable-size"].as<unsigned>()) << 20;
+
+            auto names = split_list(opts["scenarios"].as<sstring>());
+            for (auto&& name : names) {
+                if (boost::find(scenarios, name) == scenarios.end()) {
+                    throw std::invalid_argument(sprint("Unknown scenario %s", name));
+                }
+            }
+
+            std::cout << "[\n";
+            for (auto it = names.begin(); it != names.end(); ++it) {
+                test_result r;
+                if (*it == "mixed") {
+                    r = run_mixed(cfg);
+                } else if (*it == "large") {
+                    r = run_large(cfg);
+                } else if (*it == "growth") {
+                    r = run_growth(cfg);
+                } else {
+                    r = run_memtable_cache(cfg);
+                }
+                std::cout << "  " << to_json(*it, r) << (std::next(it) == names.end() ? "\n" : ",\n") << std::flush;
+            }
+            std::cout << "]\n";
+            return 0;
+        });
+    });
+}
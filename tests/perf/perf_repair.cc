@@ -0,0 +1,398 @@
+/*
+ * Copyright (C) 2018 ScyllaDB
+ */
+
+/*
+ * This file is part of Scylla.
+ *
+ * Scylla is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Scylla is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Measures the repair algorithms over replicas holding divergent data.
+ *
+ * A single node can't run several databases, so each replica is simulated by
+ * a table of its own, and the repair of a range runs the same steps as the
+ * repair master does, with the messages replaced by local calls:
+ *   - checksum: the ranges are split as repair_cf_range() does, the range
+ *     checksums of all replicas are compared, and the whole range is
+ *     streamed between the master and each replica whose checksum differs,
+ *   - row_level: the row hashes of all replicas are compared batch by batch
+ *     with plan_row_transfers(), and only the differing rows are fetched and
+ *     sent, through the master when it is neither their source nor target.
+ *
+ * For each combination of divergence and algorithm, every replica holds
+ * the same partitions, and each of its rows is, with the probability of
+ * the divergence, either missing or stale. The results are printed as a
+ * JSON array, one object per combination, with:
+ *   - transferred_bytes: bytes of frozen mutations sent between replicas,
+ *   - exchanged_bytes: bytes of checksums and row hashes sent to compare
+ *     the replicas, as serialized for the messages of repair,
+ *   - min_bytes: bytes of the frozen mutations holding only the rows each
+ *     replica misses, the least repair could send,
+ *   - amplification: transferred and exchanged bytes over min_bytes,
+ *   - wall_seconds, cpu_sec_per_gb: time of the repair, and the CPU time
+ *     of all shards per GB of data held by the replicas,
+ *   - converged: whether all replicas hold the same data afterwards.
+ */
+
+#include <sys/resource.h>
+#include <boost/algorithm/string/split.hpp>
+#include <boost/algorithm/string/classification.hpp>
+#include <boost/algorithm/cxx11/all_of.hpp>
+#include <boost/range/adaptor/transformed.hpp>
+#include <boost/range/algorithm/count_if.hpp>
+#include <boost/range/algorithm/find.hpp>
+#include <boost/range/irange.hpp>
+#include <boost/range/numeric.hpp>
+#include <random>
+#include "seastarx.hh"
+#include "tests/cql_test_env.hh"
+#include "core/app-template.hh"
+#include "core/thread.hh"
+#include "database.hh"
+#include "db/config.hh"
+#include "frozen_mutation.hh"
+#include "repair/repair.hh"
+#include "repair/range_split.hh"
+
+#include "idl/keys.dist.hh"
+#include "idl/token.dist.hh"
+#include "idl/partition_checksum.dist.hh"
+#include "serializer_impl.hh"
+#include "idl/keys.dist.impl.hh"
+#include "idl/token.dist.impl.hh"
+#include "idl/partition_checksum.dist.impl.hh"
+
+#include "disk-error-handler.hh"
+
+thread_local disk_error_signal_type commit_error;
+thread_local disk_error_signal_type general_disk_error;
+
+static const std::vector<sstring> algorithms = { "checksum", "row_level" };
+
+struct test_config {
+    unsigned peers;
+    unsigned partitions;
+    unsigned rows_per_partition;
+    unsigned value_size;
+    uint64_t target_partitions;
+    size_t batch_size;
+};
+
+struct test_case {
+    double divergence;
+    sstring algorithm;
+};
+
+struct test_result {
+    uint64_t data_bytes = 0;
+    uint64_t min_bytes = 0;
+    uint64_t transferred_bytes = 0;
+    uint64_t exchanged_bytes = 0;
+    double wall_seconds = 0;
+    double cpu_seconds = 0;
+    bool converged = false;
+};
+
+static std::vector<sstring> split_list(const sstring& s) {
+    std::vector<sstring> ret;
+    boost::split(ret, s, boost::is_any_of(","));
+    return ret;
+}
+
+// Of all the shards.
+static std::chrono::nanoseconds process_cpu_time() {
+    struct rusage ru;
+    ::getrusage(RUSAGE_SELF, &ru);
+    return std::chrono::seconds(ru.ru_utime.tv_sec + ru.ru_stime.tv_sec)
+            + std::chrono::microseconds(ru.ru_utime.tv_usec + ru.ru_stime.tv_usec);
+}
+
+static future<> apply_on_owner(distributed<database>& db, schema_ptr s, const mutation& m) {
+    auto shard = dht::shard_of(m.decorated_key().token());
+    return db.invoke_on(shard, [id = s->id(), fm = freeze(m)] (database& db) {
+        return db.apply(db.find_schema(id), fm);
+    });
+}
+
+// Applies mutations read from the replica of schema from to the one of
+// schema to.
+static void apply_to(distributed<database>& db, schema_ptr from, schema_ptr to, const std::vector<frozen_mutation>& mutations) {
+    parallel_for_each(mutations, [&db, from, to] (const frozen_mutation& fm) {
+        auto m = fm.unfreeze(from);
+        return apply_on_owner(db, to, mutation(to, m.decorated_key(), std::move(m.partition())));
+    }).get();
+}
+
+static uint64_t size_of(const std::vector<frozen_mutation>& mutations) {
+    return boost::accumulate(mutations | boost::adaptors::transformed([] (const frozen_mutation& fm) {
+        return fm.representation().size();
+    }), uint64_t(0));
+}
+
+// Reads the whole range from all shards of a replica, as streaming does.
+static std::vector<frozen_mutation> read_range(distributed<database>& db, schema_ptr s, const dht::token_range& range) {
+    std::vector<frozen_mutation> ret;
+    for (auto&& shard_range : dht::split_range_to_shards(dht::to_partition_range(range), *s)) {
+        auto mutations = db.invoke_on(shard_range.first, [id = s->id(), prs = std::move(shard_range.second)] (database& db) mutable {
+            return seastar::async([&db, id, prs = std::move(prs)] {
+                auto& cf = db.find_column_family(id);
+                auto reader = cf.make_streaming_reader(cf.schema(), prs);
+                std::vector<frozen_mutation> mutations;
+                while (auto smopt = reader().get0()) {
+                    fragment_and_freeze(std::move(*smopt), [&mutations] (frozen_mutation fm, bool) {
+                        mutations.push_back(std::move(fm));
+                        return make_ready_future<>();
+                    }).get();
+                }
+                return mutations;
+            });
+        }).get0();
+        std::move(mutations.begin(), mutations.end(), std::back_inserter(ret));
+    }
+    return ret;
+}
+
+static std::vector<partition_checksum> checksum_all(distributed<database>& db, const std::vector<schema_ptr>& peers, const dht::token_range& range) {
+    std::vector<partition_checksum> sums(peers.size());
+    parallel_for_each(boost::irange(size_t(0), peers.size()), [&] (size_t i) {
+        return checksum_range(db, peers[i]->ks_name(), peers[i]->cf_name(), range, repair_checksum::streamed_murmur3).then([&sums, i] (partition_checksum sum) {
+            sums[i] = sum;
+        });
+    }).get();
+    return sums;
+}
+
+// Fills the replicas, and returns the bytes of the rows they hold and of
+// the rows they miss.
+static std::pair<uint64_t, uint64_t> fill_peers(distributed<database>& db, const test_config& cfg, double divergence, const std::vector<schema_ptr>& peers) {
+    std::default_random_engine gen;
+    std::bernoulli_distribution diverges(divergence);
+    std::bernoulli_distribution stale(0.5);
+    std::uniform_int_distribution<int> byte_distribution(0, 255);
+    auto random_value = [&] {
+        bytes b(bytes::initialized_later(), cfg.value_size);
+        for (auto& c : b) {
+            c = byte_distribution(gen);
+        }
+        return b;
+    };
+
+    uint64_t data_bytes = 0;
+    uint64_t min_bytes = 0;
+    auto row_bytes = sizeof(int64_t) + sizeof(int32_t) + cfg.value_size;
+    for (auto p : boost::irange(0u, cfg.partitions)) {
+        std::vector<mutation> held;
+        std::vector<mutation> missing;
+        for (auto& s : peers) {
+            auto pk = partition_key::from_single_value(*s, long_type->decompose(int64_t(p)));
+            held.emplace_back(pk, s);
+            missing.emplace_back(pk, s);
+        }
+        for (auto r : boost::irange(0u, cfg.rows_per_partition)) {
+            auto ck = clustering_key::from_single_value(*peers[0], int32_type->decompose(int32_t(r)));
+            auto value = random_value();
+            for (auto i : boost::irange(size_t(0), peers.size())) {
+                auto& v = *peers[i]->get_column_definition(to_bytes("v"));
+                if (!diverges(gen)) {
+                    held[i].set_clustered_cell(ck, v, atomic_cell::make_live(2, value));
+                    data_bytes += row_bytes;
+                    continue;
+                }
+                missing[i].set_clustered_cell(ck, v, atomic_cell::make_live(2, value));
+                if (stale(gen)) {
+                    held[i].set_clustered_cell(ck, v, atomic_cell::make_live(1, random_value()));
+                    data_bytes += row_bytes;
+                }
+            }
+        }
+        for (auto i : boost::irange(size_t(0), peers.size())) {
+            if (!held[i].partition().empty()) {
+                apply_on_owner(db, peers[i], held[i]).get();
+            }
+            if (!missing[i].partition().empty()) {
+                min_bytes += freeze(missing[i]).representation().size();
+            }
+        }
+    }
+    db.invoke_on_all([&peers] (database& db) {
+        return parallel_for_each(peers, [&db] (const schema_ptr& s) {
+            return db.find_column_family(s->id()).flush();
+        });
+    }).get();
+    return { data_bytes, min_bytes };
+}
+
+static void run_checksum_repair(distributed<database>& db, const test_config& cfg, const std::vector<schema_ptr>& peers, test_result& r) {
+    range_splitter ranges(dht::token_range::make_open_ended_both_sides(), cfg.partitions, cfg.target_partitions);
+    while (ranges.has_next()) {
+        auto range = ranges.next();
+        auto sums = checksum_all(db, peers, range);
+        r.exchanged_bytes += (peers.size() - 1) * sizeof(std::array<uint8_t, 32>);
+        std::vector<size_t> differing;
+        for (auto i : boost::irange(size_t(1), peers.size())) {
+            if (sums[i] != sums[0]) {
+                differing.push_back(i);
+            }
+        }
+        if (differing.empty()) {
+            continue;
+        }
+        // Both directions are read before anything is applied, as the
+        // streams of a range run concurrently.
+        auto out = read_range(db, peers[0], range);
+        std::vector<std::vector<frozen_mutation>> in;
+        for (auto i : differing) {
+            in.push_back(read_range(db, peers[i], range));
+        }
+        for (auto j : boost::irange(size_t(0), differing.size())) {
+            auto i = differing[j];
+            r.transferred_bytes += size_of(out) + size_of(in[j]);
+            apply_to(db, peers[0], peers[i], out);
+            apply_to(db, peers[i], peers[0], in[j]);
+        }
+    }
+}
+
+static void run_row_level_repair(distributed<database>& db, const test_config& cfg, const std::vector<schema_ptr>& peers, test_result& r) {
+    range_splitter ranges(dht::token_range::make_open_ended_both_sides(), cfg.partitions, cfg.target_partitions);
+    while (ranges.has_next()) {
+        auto range = ranges.next();
+        stdx::optional<repair_row_hash> start_after;
+        do {
+            std::vector<std::vector<repair_row_hash>> hashes(peers.size());
+            parallel_for_each(boost::irange(size_t(0), peers.size()), [&] (size_t i) {
+                return get_row_hashes(db, peers[i]->ks_name(), peers[i]->cf_name(), range, start_after, cfg.batch_size).then(
+                        [&hashes, i] (std::vector<repair_row_hash> h) {
+                    hashes[i] = std::move(h);
+                });
+            }).get();
+            for (auto i : boost::irange(size_t(1), peers.size())) {
+                r.exchanged_bytes += ser::get_sizeof(hashes[i]);
+            }
+            auto plan = plan_row_transfers(*peers[0], hashes, cfg.batch_size);
+            for (auto& t : plan.transfers) {
+                auto source = t.first.first;
+                auto& targets = t.first.second;
+                auto& s = peers[source];
+                auto mutations = get_rows(db, s->ks_name(), s->cf_name(), range, start_after, t.second).get0();
+                auto size = size_of(mutations);
+                // Rows of a neighbor are fetched by the master, and forwarded
+                // to the other neighbors missing them.
+                if (source != 0) {
+                    r.exchanged_bytes += ser::get_sizeof(t.second);
+                    r.transferred_bytes += size * (1 + boost::count_if(targets, [] (size_t i) { return i != 0; }));
+                } else {
+                    r.transferred_bytes += size * targets.size();
+                }
+                for (auto target : targets) {
+                    apply_to(db, s, peers[target], mutations);
+                }
+            }
+            start_after = std::move(plan.next_start_after);
+        } while (start_after);
+    }
+}
+
+static test_result run_test_case(cql_test_env& env, const test_config& cfg, const test_case& tc, unsigned case_idx) {
+    std::vector<schema_ptr> peers;
+    for (auto i : boost::irange(0u, cfg.peers)) {
+        auto name = sprint("peer_%d_%d", case_idx, i);
+        env.execute_cql(sprint("CREATE TABLE ks.%s (pk bigint, ck int, v blob, PRIMARY KEY (pk, ck))", name)).get();
+        peers.push_back(env.local_db().find_schema("ks", name));
+    }
+
+    test_result r;
+    std::tie(r.data_bytes, r.min_bytes) = fill_peers(env.db(), cfg, tc.divergence, peers);
+
+    auto start = std::chrono::steady_clock::now();
+    auto start_cpu = process_cpu_time();
+    if (tc.algorithm == "checksum") {
+        run_checksum_repair(env.db(), cfg, peers, r);
+    } else {
+        run_row_level_repair(env.db(), cfg, peers, r);
+    }
+    r.cpu_seconds = std::chrono::duration<double>(process_cpu_time() - start_cpu).count();
+    r.wall_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    auto sums = checksum_all(env.db(), peers, dht::token_range::make_open_ended_both_sides());
+    r.converged = boost::algorithm::all_of(sums, [&sums] (const partition_checksum& sum) { return sum == sums[0]; });
+
+    for (auto& s : peers) {
+        env.execute_cql(sprint("DROP TABLE ks.%s", s->cf_name())).get();
+    }
+    return r;
+}
+
+static sstring to_json(const test_case& tc, const test_result& r) {
+    constexpr double gb = 1 << 30;
+    return sprint("{\"algorithm\": \"%s\", \"divergence\": %g, \"data_bytes\": %d, \"min_bytes\": %d, "
+                  "\"transferred_bytes\": %d, \"exchanged_bytes\": %d, \"amplification\": %.2f, "
+                  "\"wall_seconds\": %.3f, \"cpu_sec_per_gb\": %.2f, \"converged\": %s}",
+                  tc.algorithm, tc.divergence, r.data_bytes, r.min_bytes,
+                  r.transferred_bytes, r.exchanged_bytes,
+                  r.min_bytes ? double(r.transferred_bytes + r.exchanged_bytes) / r.min_bytes : 0.0,
+                  r.wall_seconds, r.data_bytes ? r.cpu_seconds / (r.data_bytes / gb) : 0.0,
+                  r.converged ? "true" : "false");
+}
+
+int main(int argc, char** argv) {
+    namespace bpo = boost::program_options;
+    app_template app;
+    app.add_options()
+        ("algorithms", bpo::value<sstring>()->default_value("checksum,row_level"), "comma-separated repair algorithms, of: checksum, row_level")
+        ("divergences", bpo::value<sstring>()->default_value("0,0.001,0.01,0.1"), "comma-separated fractions of the rows of each replica which are missing or stale")
+        ("peers", bpo::value<unsigned>()->default_value(3), "number of replicas")
+        ("partitions", bpo::value<unsigned>()->default_value(10000), "number of partitions")
+        ("rows-per-partition", bpo::value<unsigned>()->default_value(10), "number of rows per partition")
+        ("value-size", bpo::value<unsigned>()->default_value(100), "size in bytes of each row value")
+        ("target-partitions", bpo::value<uint64_t>()->default_value(100), "partitions per range compared by checksum")
+        ("batch-size", bpo::value<size_t>()->default_value(1024), "row hashes per batch of row-level repair");
+
+    return app.run(argc, argv, [&app] {
+        db::config db_cfg;
+        db_cfg.enable_commitlog(false);
+        return do_with_cql_env_thread([&app] (cql_test_env& env) {
+            auto& opts = app.configuration();
+            test_config cfg;
+            cfg.peers = opts["peers"].as<unsigned>();
+            cfg.partitions = opts["partitions"].as<unsigned>();
+            cfg.rows_per_partition = opts["rows-per-partition"].as<unsigned>();
+            cfg.value_size = opts["value-size"].as<unsigned>();
+            cfg.target_partitions = opts["target-partitions"].as<uint64_t>();
+            cfg.batch_size = opts["batch-size"].as<size_t>();
+            if (cfg.peers < 2) {
+                throw std::invalid_argument("At least two peers are needed");
+            }
+
+            std::vector<test_case> cases;
+            for (auto&& d : split_list(opts["divergences"].as<sstring>())) {
+                for (auto&& a : split_list(opts["algorithms"].as<sstring>())) {
+                    if (boost::find(algorithms, a) == algorithms.end()) {
+                        throw std::invalid_argument(sprint("Unknown algorithm %s", a));
+                    }
+                    cases.push_back(test_case{std::stod(d), a});
+                }
+            }
+
+            std::cout << "[\n";
+            for (auto it = cases.begin(); it != cases.end(); ++it) {
+                auto r = run_test_case(env, cfg, *it, it - cases.begin());
+                std::cout << "  " << to_json(*it, r) << (std::next(it) == cases.end() ? "\n" : ",\n") << std::flush;
+            }
+            std::cout << "]\n";
+        }, db_cfg);
+    });
+}
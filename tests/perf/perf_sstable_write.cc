@@ -0,0 +1,334 @@
+/*
+ * Copyright (C) 2017 ScyllaDB
+ */
+
+/*
+ * This file is part of Scylla.
+ *
+ * Scylla is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Scylla is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Measures sstable write throughput over a matrix of workloads, compressors,
+ * chunk sizes and sstable versions.
+ *
+ * For each combination a memtable is filled with the workload and flushed
+ * --iterations times. The results are printed as a JSON array, one object per
+ * combination, with:
+ *   - input_mb_per_sec: logical data (keys and cell values) written per second,
+ *   - disk_mb_per_sec: bytes of all sstable components written per second,
+ *   - cpu_ns_per_cell: CPU time of the shard spent per cell written,
+ *   - write_amplification: bytes on disk over the logical data size.
+ *
+ * Runs on a single shard.
+ */
+
+#include <sys/resource.h>
+#include <boost/algorithm/string/split.hpp>
+#include <boost/algorithm/string/classification.hpp>
+#include <boost/range/irange.hpp>
+#include <core/app-template.hh>
+#include <core/sstring.hh>
+#include <core/thread.hh>
+#include <random>
+
+// hack: perf_sstable falsely depends on Boost.Test, but we can't include it with
+// with statically linked boost
+#define BOOST_REQUIRE(x) (void)(x)
+#define BOOST_CHECK_NO_THROW(x) (void)(x)
+
+#include "tests/sstable_test.hh"
+#include "sstables/sstables.hh"
+#include "memtable-sstable.hh"
+#include "schema_builder.hh"
+#include "counters.hh"
+#include "compress.hh"
+
+#include "disk-error-handler.hh"
+
+thread_local disk_error_signal_type commit_error;
+thread_local disk_error_signal_type general_disk_error;
+
+using namespace sstables;
+
+enum class workload {
+    narrow,      // one row per partition
+    wide,        // rows_per_partition rows per partition
+    collections, // one map of num_columns elements per row
+    counters,    // counter columns
+    ttl,         // narrow, with all cells expiring
+};
+
+static const std::unordered_map<sstring, workload> workloads = {
+    { "narrow", workload::narrow },
+    { "wide", workload::wide },
+    { "collections", workload::collections },
+    { "counters", workload::counters },
+    { "ttl", workload::ttl },
+};
+
+// Compressor classes, as in the compression options of a table.
+static const std::unordered_map<sstring, sstring> compressors = {
+    { "none", "" },
+    { "lz4", "LZ4Compressor" },
+    { "snappy", "SnappyCompressor" },
+    { "deflate", "DeflateCompressor" },
+    { "zstd", "ZstdCompressor" },
+};
+
+struct test_config {
+    unsigned partitions;
+    unsigned rows_per_partition;
+    unsigned num_columns;
+    unsigned column_size;
+    unsigned key_size;
+    size_t buffer_size;
+    unsigned iterations;
+    sstring dir;
+};
+
+struct test_case {
+    sstring workload_name;
+    sstring compressor_name;
+    unsigned chunk_size_kb;
+    sstring version_name;
+};
+
+struct test_result {
+    double input_mb_per_sec;
+    double disk_mb_per_sec;
+    double cpu_ns_per_cell;
+    double write_amplification;
+};
+
+static std::vector<sstring> split_list(const sstring& s) {
+    std::vector<sstring> ret;
+    boost::split(ret, s, boost::is_any_of(","));
+    return ret;
+}
+
+static std::chrono::nanoseconds thread_cpu_time() {
+    struct rusage ru;
+    ::getrusage(RUSAGE_THREAD, &ru);
+    return std::chrono::seconds(ru.ru_utime.tv_sec + ru.ru_stime.tv_sec)
+            + std::chrono::microseconds(ru.ru_utime.tv_usec + ru.ru_stime.tv_usec);
+}
+
+static schema_ptr make_schema(workload w, const test_config& cfg, const compression_parameters& cp) {
+    schema_builder builder("ks", "perf_sstable_write");
+    builder.with_column("pk", utf8_type, column_kind::partition_key);
+    if (w == workload::wide) {
+        builder.with_column("ck", int32_type, column_kind::clustering_key);
+    }
+    for (unsigned i = 0; i < cfg.num_columns; ++i) {
+        auto name = to_bytes(sprint("column%04d", i));
+        if (w == workload::counters) {
+            builder.with_column(name, counter_type);
+        } else if (w == workload::collections) {
+            builder.with_column(name, map_type_impl::get_instance(int32_type, utf8_type, true));
+            break;
+        } else {
+            builder.with_column(name, utf8_type);
+        }
+    }
+    builder.set_is_counter(w == workload::counters);
+    builder.set_compressor_params(cp);
+    return builder.build(schema_builder::compact_storage::no);
+}
+
+class workload_generator {
+    workload _workload;
+    const test_config& _cfg;
+    schema_ptr _s;
+    std::default_random_engine _generator;
+    std::uniform_int_distribution<char> _distribution{'@', '~'};
+    uint64_t _logical_bytes = 0;
+    uint64_t _cells = 0;
+private:
+    bytes random_value(unsigned size) {
+        bytes b(bytes::initialized_later(), size);
+        for (auto& c : b) {
+            c = _distribution(_generator);
+        }
+        return b;
+    }
+
+    atomic_cell make_cell(bytes_view value) {
+        ++_cells;
+        _logical_bytes += value.size();
+        if (_workload == workload::ttl) {
+            auto ttl = std::chrono::duration_cast<gc_clock::duration>(std::chrono::hours(24));
+            return atomic_cell::make_live(api::new_timestamp(), value, gc_clock::now() + ttl, ttl);
+        }
+        return atomic_cell::make_live(api::new_timestamp(), value);
+    }
+
+    void fill_row(mutation& m, const clustering_key& ck) {
+        for (auto& cdef : _s->regular_columns()) {
+            if (_workload == workload::counters) {
+                ++_cells;
+                _logical_bytes += counter_shard::serialized_size();
+                auto cs = counter_shard(counter_id::generate_random(), _distribution(_generator), 1);
+                m.set_clustered_cell(ck, cdef, counter_cell_builder::from_single_shard(api::new_timestamp(), cs));
+            } else if (_workload == workload::collections) {
+                auto& ctype = static_cast<const collection_type_impl&>(*cdef.type);
+                map_type_impl::mutation mut;
+                for (auto i : boost::irange(0u, _cfg.num_columns)) {
+                    auto key = int32_type->decompose(int32_t(i));
+                    _logical_bytes += key.size();
+                    auto value = random_value(_cfg.column_size);
+                    mut.cells.emplace_back(key, make_cell(value));
+                }
+                m.set_clustered_cell(ck, cdef, ctype.serialize_mutation_form(mut));
+            } else {
+                auto value = random_value(_cfg.column_size);
+                m.set_clustered_cell(ck, cdef, make_cell(value));
+            }
+        }
+    }
+public:
+    workload_generator(workload w, const test_config& cfg, schema_ptr s)
+        : _workload(w), _cfg(cfg), _s(std::move(s)) { }
+
+    future<lw_shared_ptr<memtable>> fill() {
+        auto mt = make_lw_shared<memtable>(_s);
+        auto idx = boost::irange(0u, _cfg.partitions);
+        return do_for_each(idx.begin(), idx.end(), [this, mt] (unsigned) {
+            auto key = random_value(_cfg.key_size);
+            _logical_bytes += key.size();
+            mutation m(partition_key::from_single_value(*_s, key), _s);
+            if (_workload == workload::wide) {
+                for (auto i : boost::irange(0u, _cfg.rows_per_partition)) {
+                    _logical_bytes += sizeof(int32_t);
+                    fill_row(m, clustering_key::from_single_value(*_s, int32_type->decompose(int32_t(i))));
+                }
+            } else {
+                fill_row(m, clustering_key::make_empty());
+            }
+            mt->apply(std::move(m));
+        }).then([mt] {
+            return mt;
+        });
+    }
+
+    uint64_t logical_bytes() const { return _logical_bytes; }
+    uint64_t cells() const { return _cells; }
+};
+
+static test_result run_test_case(const test_config& cfg, const test_case& tc) {
+    auto w = workloads.at(tc.workload_name);
+    std::map<sstring, sstring> options;
+    if (tc.compressor_name != "none") {
+        options.emplace(compression_parameters::SSTABLE_COMPRESSION, compressors.at(tc.compressor_name));
+        options.emplace(compression_parameters::CHUNK_LENGTH_KB, to_sstring(tc.chunk_size_kb));
+    }
+    compression_parameters cp(options);
+    cp.validate();
+    auto s = make_schema(w, cfg, cp);
+    auto version_name = tc.version_name;
+    auto version = sstable::version_from_sstring(version_name);
+
+    workload_generator gen(w, cfg, s);
+    auto mt = gen.fill().get0();
+
+    double total_seconds = 0;
+    uint64_t total_cpu_ns = 0;
+    uint64_t bytes_on_disk = 0;
+    for (auto generation : boost::irange(1u, cfg.iterations + 1)) {
+        test_setup::create_empty_test_dir(cfg.dir).get();
+        auto sst = sstables::test::make_test_sstable(cfg.buffer_size, s, cfg.dir, generation, version, sstable::format_types::big);
+        auto start = std::chrono::steady_clock::now();
+        auto start_cpu = thread_cpu_time();
+        write_memtable_to_sstable(*mt, sst).get();
+        total_cpu_ns += (thread_cpu_time() - start_cpu).count();
+        total_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        sst->load().get();
+        bytes_on_disk = sst->bytes_on_disk();
+    }
+
+    constexpr double mb = 1 << 20;
+    test_result r;
+    r.input_mb_per_sec = gen.logical_bytes() * cfg.iterations / mb / total_seconds;
+    r.disk_mb_per_sec = bytes_on_disk * cfg.iterations / mb / total_seconds;
+    r.cpu_ns_per_cell = double(total_cpu_ns) / (gen.cells() * cfg.iterations);
+    r.write_amplification = double(bytes_on_disk) / gen.logical_bytes();
+    return r;
+}
+
+static sstring to_json(const test_case& tc, const test_result& r) {
+    return sprint("{\"workload\": \"%s\", \"compressor\": \"%s\", \"chunk_size_kb\": %d, \"version\": \"%s\", "
+                  "\"input_mb_per_sec\": %.2f, \"disk_mb_per_sec\": %.2f, \"cpu_ns_per_cell\": %.2f, \"write_amplification\": %.3f}",
+                  tc.workload_name, tc.compressor_name, tc.chunk_size_kb, tc.version_name,
+                  r.input_mb_per_sec, r.disk_mb_per_sec, r.cpu_ns_per_cell, r.write_amplification);
+}
+
+int main(int argc, char** argv) {
+    namespace bpo = boost::program_options;
+    app_template app;
+    app.add_options()
+        ("workloads", bpo::value<sstring>()->default_value("narrow,wide,collections,counters,ttl"), "comma-separated workloads, of: narrow, wide, collections, counters, ttl")
+        ("compressors", bpo::value<sstring>()->default_value("none,lz4,snappy,deflate,zstd"), "comma-separated compressors, of: none, lz4, snappy, deflate, zstd")
+        ("chunk-sizes", bpo::value<sstring>()->default_value("4,16,64"), "comma-separated compression chunk sizes, in KB")
+        ("versions", bpo::value<sstring>()->default_value("ka,la"), "comma-separated sstable versions")
+        ("iterations", bpo::value<unsigned>()->default_value(5), "number of flushes of each combination")
+        ("partitions", bpo::value<unsigned>()->default_value(100000), "number of partitions")
+        ("rows-per-partition", bpo::value<unsigned>()->default_value(100), "number of rows per partition of the wide workload")
+        ("num-columns", bpo::value<unsigned>()->default_value(5), "number of columns per row, or of elements per collection")
+        ("column-size", bpo::value<unsigned>()->default_value(64), "size in bytes of each column value")
+        ("key-size", bpo::value<unsigned>()->default_value(128), "size of partition key")
+        ("buffer-size", bpo::value<unsigned>()->default_value(64), "sstable buffer size, in KB")
+        ("testdir", bpo::value<sstring>()->default_value("/var/lib/scylla/perf-tests"), "directory in which to store the sstables");
+
+    return app.run(argc, argv, [&app] {
+        return seastar::async([&app] {
+            auto& opts = app.configuration();
+            test_config cfg;
+            cfg.partitions = opts["partitions"].as<unsigned>();
+            cfg.rows_per_partition = opts["rows-per-partition"].as<unsigned>();
+            cfg.num_columns = opts["num-columns"].as<unsigned>();
+            cfg.column_size = opts["column-size"].as<unsigned>();
+            cfg.key_size = opts["key-size"].as<unsigned>();
+            cfg.buffer_size = opts["buffer-size"].as<unsigned>() << 10;
+            cfg.iterations = opts["iterations"].as<unsigned>();
+            cfg.dir = opts["testdir"].as<sstring>();
+
+            std::vector<test_case> cases;
+            for (auto&& w : split_list(opts["workloads"].as<sstring>())) {
+                if (!workloads.count(w)) {
+                    throw std::invalid_argument(sprint("Unknown workload %s", w));
+                }
+                for (auto&& c : split_list(opts["compressors"].as<sstring>())) {
+                    if (!compressors.count(c)) {
+                        throw std::invalid_argument(sprint("Unknown compressor %s", c));
+                    }
+                    // Chunks don't apply to uncompressed sstables.
+                    auto chunk_sizes = c == "none" ? std::vector<sstring>{"0"} : split_list(opts["chunk-sizes"].as<sstring>());
+                    for (auto&& chunk : chunk_sizes) {
+                        for (auto&& v : split_list(opts["versions"].as<sstring>())) {
+                            cases.push_back(test_case{w, c, unsigned(std::stoul(chunk)), v});
+                        }
+                    }
+                }
+            }
+
+            std::cout << "[\n";
+            for (auto it = cases.begin(); it != cases.end(); ++it) {
+                auto r = run_test_case(cfg, *it);
+                std::cout << "  " << to_json(*it, r) << (std::next(it) == cases.end() ? "\n" : ",\n") << std::flush;
+            }
+            std::cout << "]\n";
+            return 0;
+        });
+    });
+}
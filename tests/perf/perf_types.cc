@@ -0,0 +1,382 @@
+/*
+ * Copyright (C) 2018 ScyllaDB
+ */
+
+/*
+ * This file is part of Scylla.
+ *
+ * Scylla is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Scylla is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Measures the operations on values of the native types, of reversed and
+ * frozen collection types, and of clustering keys and their prefixes:
+ *   - compare, hash: abstract_type::compare() and hash(), or those of the
+ *     compound type of the key, each value with the next one,
+ *   - serialize, deserialize: between data_value and bytes, or between the
+ *     components and the key,
+ *   - encode_comparable: the byte comparable form, for the types which have
+ *     one,
+ *   - compare_comparable: a memcmp() of two byte comparable forms, which
+ *     replaces compare() when a value is compared many times.
+ *
+ * The results are printed as a JSON array, one object per shape and
+ * operation, in ns/op and, when perf events are allowed, instructions/op.
+ * Runs on a single shard.
+ */
+
+#include <boost/algorithm/string/split.hpp>
+#include <boost/algorithm/string/classification.hpp>
+#include <boost/range/algorithm/find.hpp>
+#include <core/app-template.hh>
+#include <core/thread.hh>
+#include <map>
+#include <random>
+#include <set>
+
+#include "tests/perf/perf.hh"
+#include "types.hh"
+#include "compound.hh"
+#include "bytes_ostream.hh"
+#include "utils/UUID_gen.hh"
+
+#include "disk-error-handler.hh"
+
+thread_local disk_error_signal_type commit_error;
+thread_local disk_error_signal_type general_disk_error;
+
+volatile uint64_t black_hole;
+
+struct test_config {
+    size_t values;
+    std::chrono::milliseconds duration;
+    std::vector<sstring> shapes;
+};
+
+using generator = std::default_random_engine;
+
+static std::vector<sstring> split_list(const sstring& s) {
+    std::vector<sstring> ret;
+    boost::split(ret, s, boost::is_any_of(","));
+    return ret;
+}
+
+static sstring random_text(generator& gen, size_t min_len, size_t max_len) {
+    std::uniform_int_distribution<size_t> len(min_len, max_len);
+    std::uniform_int_distribution<char> c('a', 'z');
+    sstring s(sstring::initialized_later(), len(gen));
+    for (auto& ch : s) {
+        ch = c(gen);
+    }
+    return s;
+}
+
+template <typename T>
+static T random_int(generator& gen) {
+    return std::uniform_int_distribution<T>(std::numeric_limits<T>::min(), std::numeric_limits<T>::max())(gen);
+}
+
+// Serialized values of the native types. Those sharing the serialization
+// of another type are made through it.
+static const std::vector<std::pair<sstring, std::pair<data_type, std::function<bytes (generator&)>>>>& native_types() {
+    static thread_local std::vector<std::pair<sstring, std::pair<data_type, std::function<bytes (generator&)>>>> types = {
+        { "tinyint", { byte_type, [] (generator& g) { return data_value(random_int<int8_t>(g)).serialize(); } } },
+        { "smallint", { short_type, [] (generator& g) { return data_value(random_int<int16_t>(g)).serialize(); } } },
+        { "int", { int32_type, [] (generator& g) { return data_value(random_int<int32_t>(g)).serialize(); } } },
+        { "bigint", { long_type, [] (generator& g) { return data_value(random_int<int64_t>(g)).serialize(); } } },
+        { "varint", { varint_type, [] (generator& g) {
+            return data_value(boost::multiprecision::cpp_int(random_int<int64_t>(g)) * random_int<int64_t>(g)).serialize();
+        } } },
+        { "decimal", { decimal_type, [] (generator& g) {
+            return data_value(big_decimal(std::uniform_int_distribution<int32_t>(0, 10)(g), boost::multiprecision::cpp_int(random_int<int64_t>(g)))).serialize();
+        } } },
+        { "float", { float_type, [] (generator& g) { return data_value(std::uniform_real_distribution<float>(-1e6, 1e6)(g)).serialize(); } } },
+        { "double", { double_type, [] (generator& g) { return data_value(std::uniform_real_distribution<double>(-1e12, 1e12)(g)).serialize(); } } },
+        { "boolean", { boolean_type, [] (generator& g) { return data_value(bool(random_int<uint8_t>(g) & 1)).serialize(); } } },
+        { "ascii", { ascii_type, [] (generator& g) { return data_value(random_text(g, 1, 32)).serialize(); } } },
+        { "text", { utf8_type, [] (generator& g) { return data_value(random_text(g, 1, 32)).serialize(); } } },
+        { "blob", { bytes_type, [] (generator& g) { return to_bytes(random_text(g, 1, 64)); } } },
+        { "uuid", { uuid_type, [] (generator&) { return data_value(utils::make_random_uuid()).serialize(); } } },
+        { "timeuuid", { timeuuid_type, [] (generator&) { return data_value(utils::UUID_gen::get_time_UUID()).serialize(); } } },
+        { "timestamp", { timestamp_type, [] (generator& g) {
+            return data_value(db_clock::time_point(db_clock::duration(std::uniform_int_distribution<int64_t>(0, int64_t(1) << 42)(g)))).serialize();
+        } } },
+        { "date", { simple_date_type, [] (generator& g) { return data_value(simple_date_native_type{random_int<uint32_t>(g)}).serialize(); } } },
+        { "time", { time_type, [] (generator& g) {
+            return data_value(std::uniform_int_distribution<int64_t>(0, int64_t(86400) * 1000000000 - 1)(g)).serialize();
+        } } },
+        { "inet", { inet_addr_type, [] (generator& g) { return data_value(net::ipv4_address(random_int<uint32_t>(g))).serialize(); } } },
+    };
+    return types;
+}
+
+struct op_result {
+    double ns_per_op;
+    double insns_per_op;
+};
+
+template <typename Func>
+static op_result measure(const test_config& cfg, size_t n, Func&& op) {
+    using clk = std::chrono::steady_clock;
+    instruction_counter insns;
+    uint64_t sink = 0;
+    uint64_t ops = 0;
+    uint64_t instructions = 0;
+    auto start = clk::now();
+    auto end = start + cfg.duration;
+    while (clk::now() < end) {
+        insns.start();
+        for (size_t i = 0; i < n; ++i) {
+            sink += op(i);
+        }
+        instructions += insns.stop();
+        ops += n;
+        seastar::thread::yield();
+    }
+    black_hole = sink;
+    auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(clk::now() - start).count();
+    return op_result{double(ns) / ops, insns.available() ? double(instructions) / ops : 0.0};
+}
+
+class reporter {
+    bool _first = true;
+public:
+    reporter() {
+        std::cout << "[\n";
+    }
+    ~reporter() {
+        std::cout << "\n]\n";
+    }
+    void report(const sstring& shape, const sstring& op, const op_result& r) {
+        std::cout << (_first ? "  " : ",\n  ")
+                  << sprint("{\"shape\": \"%s\", \"op\": \"%s\", \"ns_per_op\": %.2f, \"insns_per_op\": %.1f}", shape, op, r.ns_per_op, r.insns_per_op)
+                  << std::flush;
+        _first = false;
+    }
+};
+
+static void run_type(const test_config& cfg, reporter& rep, const sstring& name, data_type t, const std::vector<bytes>& values) {
+    auto n = values.size();
+    std::vector<data_value> natives;
+    size_t max_size = 0;
+    for (auto& v : values) {
+        natives.push_back(t->deserialize(v));
+        max_size = std::max(max_size, v.size());
+    }
+    bytes buf(bytes::initialized_later(), max_size);
+
+    rep.report(name, "compare", measure(cfg, n, [&] (size_t i) {
+        return t->compare(values[i], values[(i + 1) % n]);
+    }));
+    rep.report(name, "hash", measure(cfg, n, [&] (size_t i) {
+        return t->hash(values[i]);
+    }));
+    rep.report(name, "serialize", measure(cfg, n, [&] (size_t i) {
+        auto out = buf.begin();
+        natives[i].serialize(out);
+        return out - buf.begin();
+    }));
+    rep.report(name, "deserialize", measure(cfg, n, [&] (size_t i) {
+        return t->deserialize(values[i]).is_null();
+    }));
+    if (!t->is_byte_comparable()) {
+        return;
+    }
+    rep.report(name, "encode_comparable", measure(cfg, n, [&] (size_t i) {
+        bytes_ostream out;
+        t->serialize_comparable(values[i], out);
+        return out.size();
+    }));
+    std::vector<bytes> encoded;
+    for (auto& v : values) {
+        bytes_ostream out;
+        t->serialize_comparable(v, out);
+        encoded.push_back(to_bytes(out.linearize()));
+    }
+    rep.report(name, "compare_comparable", measure(cfg, n, [&] (size_t i) {
+        return compare_unsigned(encoded[i], encoded[(i + 1) % n]);
+    }));
+}
+
+static void run_compound(const test_config& cfg, reporter& rep, const sstring& name, compound_type<allow_prefixes::yes>& ct,
+        const std::vector<std::vector<bytes>>& components) {
+    auto n = components.size();
+    std::vector<bytes> values;
+    for (auto& c : components) {
+        values.push_back(ct.serialize_value(c));
+    }
+
+    rep.report(name, "compare", measure(cfg, n, [&] (size_t i) {
+        return ct.compare(values[i], values[(i + 1) % n]);
+    }));
+    rep.report(name, "hash", measure(cfg, n, [&] (size_t i) {
+        return ct.hash(values[i]);
+    }));
+    rep.report(name, "serialize", measure(cfg, n, [&] (size_t i) {
+        return ct.serialize_value(components[i]).size();
+    }));
+    rep.report(name, "deserialize", measure(cfg, n, [&] (size_t i) {
+        return ct.deserialize_value(values[i]).size();
+    }));
+    if (!ct.is_byte_comparable()) {
+        return;
+    }
+    rep.report(name, "encode_comparable", measure(cfg, n, [&] (size_t i) {
+        return ct.serialize_comparable(values[i]).size();
+    }));
+    std::vector<bytes> encoded;
+    for (auto& v : values) {
+        encoded.push_back(ct.serialize_comparable(v));
+    }
+    rep.report(name, "compare_comparable", measure(cfg, n, [&] (size_t i) {
+        return compare_unsigned(encoded[i], encoded[(i + 1) % n]);
+    }));
+}
+
+static bool selected(const test_config& cfg, const sstring& shape) {
+    return cfg.shapes.empty() || boost::find(cfg.shapes, shape) != cfg.shapes.end();
+}
+
+static void run_all(const test_config& cfg) {
+    generator gen;
+    reporter rep;
+
+    for (auto&& e : native_types()) {
+        auto& name = e.first;
+        auto& t = e.second.first;
+        auto& make = e.second.second;
+        std::vector<bytes> values;
+        for (size_t i = 0; i < cfg.values; ++i) {
+            values.push_back(make(gen));
+        }
+        if (selected(cfg, name)) {
+            run_type(cfg, rep, name, t, values);
+        }
+        // Descending clustering columns.
+        if ((name == "int" || name == "text" || name == "timeuuid") && selected(cfg, "reversed_" + name)) {
+            run_type(cfg, rep, "reversed_" + name, reversed_type_impl::get_instance(t), values);
+        }
+    }
+
+    std::uniform_int_distribution<size_t> collection_size(1, 16);
+
+    if (selected(cfg, "frozen_list_int")) {
+        auto t = list_type_impl::get_instance(int32_type, false);
+        std::vector<bytes> values;
+        for (size_t i = 0; i < cfg.values; ++i) {
+            std::vector<data_value> elements;
+            for (size_t j = collection_size(gen); j > 0; --j) {
+                elements.push_back(data_value(random_int<int32_t>(gen)));
+            }
+            values.push_back(make_list_value(t, std::move(elements)).serialize());
+        }
+        run_type(cfg, rep, "frozen_list_int", t, values);
+    }
+    if (selected(cfg, "frozen_set_text")) {
+        auto t = set_type_impl::get_instance(utf8_type, false);
+        std::vector<bytes> values;
+        for (size_t i = 0; i < cfg.values; ++i) {
+            std::set<sstring> texts;
+            for (size_t j = collection_size(gen); j > 0; --j) {
+                texts.insert(random_text(gen, 1, 16));
+            }
+            std::vector<data_value> elements(texts.begin(), texts.end());
+            values.push_back(make_set_value(t, std::move(elements)).serialize());
+        }
+        run_type(cfg, rep, "frozen_set_text", t, values);
+    }
+    if (selected(cfg, "frozen_map_int_text")) {
+        auto t = map_type_impl::get_instance(int32_type, utf8_type, false);
+        std::vector<bytes> values;
+        for (size_t i = 0; i < cfg.values; ++i) {
+            std::map<int32_t, sstring> m;
+            for (size_t j = collection_size(gen); j > 0; --j) {
+                m.emplace(random_int<int32_t>(gen), random_text(gen, 1, 16));
+            }
+            std::vector<std::pair<data_value, data_value>> entries;
+            for (auto& kv : m) {
+                entries.emplace_back(data_value(kv.first), data_value(kv.second));
+            }
+            values.push_back(make_map_value(t, std::move(entries)).serialize());
+        }
+        run_type(cfg, rep, "frozen_map_int_text", t, values);
+    }
+
+    // Clustering keys of a table with PRIMARY KEY (pk, c1, c2, c3), the
+    // prefixes of one and two components being those of range queries.
+    std::vector<data_type> ck_types = { int32_type, utf8_type, timeuuid_type };
+    compound_type<allow_prefixes::yes> ck(ck_types);
+    std::vector<data_type> mixed_types = { int32_type, reversed_type_impl::get_instance(utf8_type), varint_type };
+    compound_type<allow_prefixes::yes> mixed_ck(mixed_types);
+    struct key_shape {
+        sstring name;
+        compound_type<allow_prefixes::yes>& type;
+        const std::vector<data_type>& types;
+        size_t components;
+    };
+    std::vector<key_shape> keys = {
+        { "ck_int_text_timeuuid", ck, ck_types, 3 },
+        { "ck_prefix_int_text", ck, ck_types, 2 },
+        { "ck_prefix_int", ck, ck_types, 1 },
+        // Not byte comparable, as varint has no byte comparable form.
+        { "ck_int_reversed_text_varint", mixed_ck, mixed_types, 3 },
+    };
+    for (auto& k : keys) {
+        if (!selected(cfg, k.name)) {
+            continue;
+        }
+        std::vector<std::vector<bytes>> components;
+        for (size_t i = 0; i < cfg.values; ++i) {
+            std::vector<bytes> c;
+            // Few distinct leading components, so that comparisons go past them.
+            c.push_back(data_value(std::uniform_int_distribution<int32_t>(0, 3)(gen)).serialize());
+            if (k.components > 1) {
+                c.push_back(data_value(random_text(gen, 1, 3)).serialize());
+            }
+            if (k.components > 2) {
+                if (k.types[2] == varint_type) {
+                    c.push_back(data_value(boost::multiprecision::cpp_int(random_int<int64_t>(gen))).serialize());
+                } else {
+                    c.push_back(data_value(utils::UUID_gen::get_time_UUID()).serialize());
+                }
+            }
+            components.push_back(std::move(c));
+        }
+        run_compound(cfg, rep, k.name, k.type, components);
+    }
+}
+
+int main(int argc, char** argv) {
+    namespace bpo = boost::program_options;
+    app_template app;
+    app.add_options()
+        ("shapes", bpo::value<sstring>()->default_value(""), "comma-separated shapes to run, all when empty")
+        ("values", bpo::value<size_t>()->default_value(1024), "number of distinct values of each shape")
+        ("duration", bpo::value<unsigned>()->default_value(200), "time spent on each operation, in ms");
+
+    return app.run(argc, argv, [&app] {
+        return seastar::async([&app] {
+            auto& opts = app.configuration();
+            test_config cfg;
+            cfg.values = opts["values"].as<size_t>();
+            cfg.duration = std::chrono::milliseconds(opts["duration"].as<unsigned>());
+            auto shapes = opts["shapes"].as<sstring>();
+            if (!shapes.empty()) {
+                cfg.shapes = split_list(shapes);
+            }
+            run_all(cfg);
+            return 0;
+        });
+    });
+}
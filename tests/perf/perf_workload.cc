@@ -0,0 +1,464 @@
+/*
+ * Copyright (C) 2017 ScyllaDB
+ */
+
+/*
+ * This file is part of Scylla.
+ *
+ * Scylla is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Scylla is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Runs the workload described by a YAML file against cql_test_env, on all
+ * shards, and reports the throughput and latency percentiles of each
+ * operation, and the instructions run per operation, as JSON.
+ *
+ * All the keys of the description are optional:
+ *
+ *   partitions: 10000          # partitions populated before the run
+ *   rows_per_partition: 1      # more than one for wide partitions
+ *   columns: 5                 # blob columns of each row
+ *   value_size: 32             # bytes in each column
+ *   ttl: 0                     # seconds, for the rows written
+ *   distribution: uniform      # of the keys, uniform, zipfian or latest
+ *   zipfian_exponent: 0.99     # for zipfian and latest
+ *   scan_rows: 100             # LIMIT of the range scans
+ *   populate: true
+ *   operations:                # weights of the operations of the mix
+ *     read: 1                  # a row
+ *     read_partition: 0        # all rows of a partition
+ *     scan: 0                  # a range scan from a random token
+ *     write: 0                 # a row
+ *     delete: 0                # a row
+ *
+ * With the latest distribution, writes add new partitions and reads pick
+ * partitions close to the last written ones.
+ */
+
+#include <fstream>
+#include <random>
+#include <yaml-cpp/yaml.h>
+#include <boost/range/irange.hpp>
+
+#include "tests/cql_test_env.hh"
+#include "tests/perf/perf.hh"
+#include "core/app-template.hh"
+#include "core/thread.hh"
+#include "core/defer.hh"
+#include "cql3/query_processor.hh"
+#include "utils/estimated_histogram.hh"
+#include "types.hh"
+
+#include "disk-error-handler.hh"
+
+thread_local disk_error_signal_type commit_error;
+thread_local disk_error_signal_type general_disk_error;
+
+enum class operation { read, read_partition, scan, write, del };
+
+static const std::vector<std::pair<operation, sstring>> operation_names = {
+    { operation::read, "read" },
+    { operation::read_partition, "read_partition" },
+    { operation::scan, "scan" },
+    { operation::write, "write" },
+    { operation::del, "delete" },
+};
+
+static constexpr size_t nr_operations = 5;
+
+enum class key_distribution { uniform, zipfian, latest };
+
+struct workload {
+    uint64_t partitions = 10000;
+    unsigned rows_per_partition = 1;
+    unsigned columns = 5;
+    unsigned value_size = 32;
+    unsigned ttl = 0;
+    key_distribution distribution = key_distribution::uniform;
+    double zipfian_exponent = 0.99;
+    unsigned scan_rows = 100;
+    bool populate = true;
+    std::array<double, nr_operations> weights = {{1, 0, 0, 0, 0}};
+};
+
+static workload read_workload(const sstring& file) {
+    workload w;
+    auto node = YAML::LoadFile(file);
+    auto get = [&node] (const char* name, auto& value) {
+        if (node[name]) {
+            value = node[name].as<std::remove_reference_t<decltype(value)>>();
+        }
+    };
+    get("partitions", w.partitions);
+    get("rows_per_partition", w.rows_per_partition);
+    get("columns", w.columns);
+    get("value_size", w.value_size);
+    get("ttl", w.ttl);
+    get("zipfian_exponent", w.zipfian_exponent);
+    get("scan_rows", w.scan_rows);
+    get("populate", w.populate);
+    if (node["distribution"]) {
+        auto d = node["distribution"].as<std::string>();
+        if (d == "uniform") {
+            w.distribution = key_distribution::uniform;
+        } else if (d == "zipfian") {
+            w.distribution = key_distribution::zipfian;
+        } else if (d == "latest") {
+            w.distribution = key_distribution::latest;
+        } else {
+            throw std::invalid_argument(sprint("unknown key distribution %s", d));
+        }
+    }
+    if (node["operations"]) {
+        w.weights.fill(0);
+        for (auto&& op : node["operations"]) {
+            auto name = op.first.as<std::string>();
+            auto it = std::find_if(operation_names.begin(), operation_names.end(), [&] (auto& p) { return p.second == name; });
+            if (it == operation_names.end()) {
+                throw std::invalid_argument(sprint("unknown operation %s", name));
+            }
+            w.weights[size_t(it->first)] = op.second.as<double>();
+        }
+    }
+    if (!w.partitions || !w.rows_per_partition || !w.columns) {
+        throw std::invalid_argument("partitions, rows_per_partition and columns must not be zero");
+    }
+    if (w.zipfian_exponent <= 0 || w.zipfian_exponent == 1) {
+        throw std::invalid_argument("zipfian_exponent must be positive and other than 1");
+    }
+    return w;
+}
+
+// Zipfian numbers in [0, n), 0 being the most frequent, with the method of
+// Gray et al., "Quickly Generating Billion-Record Synthetic Databases".
+class zipfian_generator {
+    uint64_t _n;
+    double _theta;
+    double _alpha;
+    double _zetan;
+    double _eta;
+private:
+    static double zeta(uint64_t n, double theta) {
+        double sum = 0;
+        for (uint64_t i = 1; i <= n; i++) {
+            sum += 1 / std::pow(double(i), theta);
+        }
+        return sum;
+    }
+public:
+    zipfian_generator(uint64_t n, double theta)
+        : _n(n)
+        , _theta(theta)
+        , _alpha(1 / (1 - theta))
+        , _zetan(zeta(n, theta))
+        , _eta((1 - std::pow(2.0 / n, 1 - theta)) / (1 - zeta(2, theta) / _zetan))
+    { }
+
+    template <typename RandomEngine>
+    uint64_t operator()(RandomEngine& rnd) {
+        auto u = std::uniform_real_distribution<double>(0, 1)(rnd);
+        auto uz = u * _zetan;
+        if (uz < 1) {
+            return 0;
+        }
+        if (uz < 1 + std::pow(0.5, _theta)) {
+            return std::min<uint64_t>(1, _n - 1);
+        }
+        return std::min<uint64_t>(_n * std::pow(_eta * u - _eta + 1, _alpha), _n - 1);
+    }
+};
+
+struct operation_stats {
+    uint64_t count = 0;
+    uint64_t errors = 0;
+    // In microseconds.
+    utils::estimated_histogram latency{150};
+
+    operation_stats& operator+=(const operation_stats& o) {
+        count += o.count;
+        errors += o.errors;
+        latency.merge(o.latency);
+        return *this;
+    }
+};
+
+struct results {
+    std::array<operation_stats, nr_operations> ops;
+    uint64_t instructions = 0;
+    bool instructions_available = true;
+
+    results& operator+=(const results& o) {
+        for (size_t i = 0; i < nr_operations; i++) {
+            ops[i] += o.ops[i];
+        }
+        instructions += o.instructions;
+        instructions_available &= o.instructions_available;
+        return *this;
+    }
+};
+
+struct statements {
+    std::array<cql3::prepared_cache_key_type, nr_operations> ids;
+};
+
+// The workload as run by a shard.
+class workload_runner {
+    workload _w;
+    std::default_random_engine _rnd;
+    std::discrete_distribution<size_t> _operations;
+    std::experimental::optional<zipfian_generator> _zipfian;
+    bytes _value;
+    // With the latest distribution, the partitions this shard wrote beyond
+    // the populated ones.
+    uint64_t _written = 0;
+    results _results;
+private:
+    uint64_t next_partition() {
+        switch (_w.distribution) {
+        case key_distribution::uniform:
+            return std::uniform_int_distribution<uint64_t>(0, _w.partitions - 1)(_rnd);
+        case key_distribution::zipfian:
+            return (*_zipfian)(_rnd);
+        case key_distribution::latest: {
+            auto latest = _w.partitions + _written * smp::count + engine().cpu_id();
+            return latest - std::min(latest, (*_zipfian)(_rnd));
+        }
+        }
+        abort();
+    }
+
+    uint64_t new_partition() {
+        return _w.partitions + _written++ * smp::count + engine().cpu_id();
+    }
+
+    std::vector<cql3::raw_value> row_values(uint64_t partition, int32_t row) {
+        std::vector<cql3::raw_value> values;
+        values.push_back(cql3::raw_value::make_value(long_type->decompose(int64_t(partition))));
+        values.push_back(cql3::raw_value::make_value(int32_type->decompose(row)));
+        for (unsigned i = 0; i < _w.columns; i++) {
+            values.push_back(cql3::raw_value::make_value(_value));
+        }
+        return values;
+    }
+
+    std::vector<cql3::raw_value> values_for(operation op) {
+        auto row = [this] {
+            return int32_t(std::uniform_int_distribution<unsigned>(0, _w.rows_per_partition - 1)(_rnd));
+        };
+        auto key = [] (uint64_t partition) {
+            return cql3::raw_value::make_value(long_type->decompose(int64_t(partition)));
+        };
+        switch (op) {
+        case operation::read:
+        case operation::del:
+            return { key(next_partition()), cql3::raw_value::make_value(int32_type->decompose(row())) };
+        case operation::read_partition:
+            return { key(next_partition()) };
+        case operation::scan:
+            return { cql3::raw_value::make_value(long_type->decompose(int64_t(std::uniform_int_distribution<int64_t>()(_rnd)))) };
+        case operation::write:
+            return row_values(_w.distribution == key_distribution::latest ? new_partition() : next_partition(), row());
+        }
+        abort();
+    }
+
+    future<> run_one(cql_test_env& env, const statements& st) {
+        auto op = operation(_operations(_rnd));
+        auto start = std::chrono::steady_clock::now();
+        return env.execute_prepared(st.ids[size_t(op)], values_for(op)).then_wrapped([this, op, start] (auto f) {
+            auto& s = _results.ops[size_t(op)];
+            ++s.count;
+            try {
+                f.get();
+                s.latency.add(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count());
+            } catch (...) {
+                ++s.errors;
+            }
+        });
+    }
+public:
+    explicit workload_runner(workload w)
+        : _w(std::move(w))
+        , _rnd(engine().cpu_id())
+        , _operations(_w.weights.begin(), _w.weights.end())
+        , _value(bytes::initialized_later(), _w.value_size)
+    {
+        if (_w.distribution != key_distribution::uniform) {
+            _zipfian.emplace(_w.partitions, _w.zipfian_exponent);
+        }
+        std::uniform_int_distribution<int> byte(0, 255);
+        for (auto& b : _value) {
+            b = byte(_rnd);
+        }
+    }
+
+    // Writes the partitions this shard owns in the sequence of keys.
+    future<> populate(cql_test_env& env, const statements& st, unsigned concurrency) {
+        auto next = make_lw_shared<uint64_t>(engine().cpu_id());
+        auto workers = boost::irange(0u, concurrency);
+        return parallel_for_each(workers.begin(), workers.end(), [this, &env, &st, next] (unsigned) {
+            return do_until([this, next] { return *next >= _w.partitions; }, [this, &env, &st, next] {
+                auto partition = *next;
+                *next += smp::count;
+                auto rows = boost::irange(0u, _w.rows_per_partition);
+                return do_for_each(rows.begin(), rows.end(), [this, &env, &st, partition] (unsigned row) {
+                    return env.execute_prepared(st.ids[size_t(operation::write)], row_values(partition, row)).discard_result();
+                });
+            });
+        });
+    }
+
+    future<> run(cql_test_env& env, const statements& st, unsigned concurrency, lowres_clock::time_point end, uint64_t operations) {
+        auto done = make_lw_shared<uint64_t>(0);
+        auto counter = make_lw_shared<instruction_counter>();
+        _results.instructions_available = counter->available();
+        counter->start();
+        auto workers = boost::irange(0u, concurrency);
+        return parallel_for_each(workers.begin(), workers.end(), [this, &env, &st, end, operations, done] (unsigned) {
+            return do_until([end, operations, done] {
+                return operations ? *done >= operations : lowres_clock::now() >= end;
+            }, [this, &env, &st, done] {
+                ++*done;
+                return run_one(env, st);
+            });
+        }).finally([this, counter] {
+            _results.instructions = counter->stop();
+        });
+    }
+
+    results get_results() const {
+        return _results;
+    }
+
+    future<> stop() {
+        return make_ready_future<>();
+    }
+};
+
+static sstring value_columns(const workload& w) {
+    sstring ret;
+    for (unsigned i = 0; i < w.columns; i++) {
+        ret += sprint("%sc%d", i ? ", " : "", i);
+    }
+    return ret;
+}
+
+static statements prepare_statements(cql_test_env& env, const workload& w) {
+    statements st;
+    auto prepare = [&] (operation op, sstring query) {
+        st.ids[size_t(op)] = env.prepare(std::move(query)).get0();
+    };
+    sstring markers;
+    for (unsigned i = 0; i < w.columns; i++) {
+        markers += ", ?";
+    }
+    prepare(operation::write, sprint("INSERT INTO cf (pk, ck, %s) VALUES (?, ?%s)%s;", value_columns(w), markers,
+            w.ttl ? sprint(" USING TTL %d", w.ttl) : sstring()));
+    prepare(operation::read, "SELECT * FROM cf WHERE pk = ? AND ck = ?;");
+    prepare(operation::read_partition, "SELECT * FROM cf WHERE pk = ?;");
+    prepare(operation::scan, sprint("SELECT * FROM cf WHERE token(pk) >= ? LIMIT %d;", w.scan_rows));
+    prepare(operation::del, "DELETE FROM cf WHERE pk = ? AND ck = ?;");
+    return st;
+}
+
+static void write_json(std::ostream& out, const workload& w, const results& r, double duration) {
+    uint64_t total = 0;
+    out << "{\n  \"duration\": " << duration << ",\n  \"shards\": " << smp::count << ",\n  \"operations\": {";
+    bool first = true;
+    for (auto& op : operation_names) {
+        auto& s = r.ops[size_t(op.first)];
+        if (!s.count) {
+            continue;
+        }
+        total += s.count;
+        out << (first ? "\n" : ",\n") << "    \"" << op.second << "\": {"
+            << "\"count\": " << s.count
+            << ", \"errors\": " << s.errors
+            << ", \"throughput\": " << s.count / duration
+            << ", \"latency_us\": {"
+            << "\"mean\": " << s.latency.mean()
+            << ", \"p50\": " << s.latency.percentile(0.5)
+            << ", \"p90\": " << s.latency.percentile(0.9)
+            << ", \"p99\": " << s.latency.percentile(0.99)
+            << ", \"p999\": " << s.latency.percentile(0.999)
+            << ", \"max\": " << s.latency.max()
+            << "}}";
+        first = false;
+    }
+    out << "\n  },\n  \"total\": {\"count\": " << total << ", \"throughput\": " << total / duration << ", \"instructions_per_op\": ";
+    if (r.instructions_available && total) {
+        out << double(r.instructions) / total;
+    } else {
+        out << "null";
+    }
+    out << "}\n}\n";
+}
+
+int main(int argc, char** argv) {
+    namespace bpo = boost::program_options;
+    app_template app;
+    app.add_options()
+        ("workload", bpo::value<sstring>(), "YAML description of the workload, the defaults of all its keys when not given")
+        ("duration", bpo::value<unsigned>()->default_value(10), "test duration in seconds")
+        ("operations-per-shard", bpo::value<uint64_t>(), "run this many operations per shard (overrides duration)")
+        ("concurrency", bpo::value<unsigned>()->default_value(100), "workers per core")
+        ("output", bpo::value<sstring>(), "file to write the JSON results to, instead of the standard output");
+
+    return app.run(argc, argv, [&app] {
+        return do_with_cql_env_thread([&app] (cql_test_env& env) {
+            auto& config = app.configuration();
+            auto w = config.count("workload") ? read_workload(config["workload"].as<sstring>()) : workload();
+            auto concurrency = config["concurrency"].as<unsigned>();
+            uint64_t operations = config.count("operations-per-shard") ? config["operations-per-shard"].as<uint64_t>() : 0;
+
+            sstring columns;
+            for (unsigned i = 0; i < w.columns; i++) {
+                columns += sprint("c%d blob, ", i);
+            }
+            env.execute_cql(sprint("CREATE TABLE cf (pk bigint, ck int, %sPRIMARY KEY (pk, ck));", columns)).get();
+            auto st = prepare_statements(env, w);
+
+            distributed<workload_runner> runners;
+            runners.start(w).get();
+            auto stop_runners = defer([&runners] { runners.stop().get(); });
+
+            if (w.populate) {
+                std::cerr << "Populating " << w.partitions << " partitions of " << w.rows_per_partition << " rows..." << std::endl;
+                runners.invoke_on_all([&env, &st, concurrency] (workload_runner& r) {
+                    return r.populate(env, st, concurrency);
+                }).get();
+            }
+
+            std::cerr << "Running..." << std::endl;
+            auto start = std::chrono::steady_clock::now();
+            auto end = lowres_clock::now() + std::chrono::seconds(config["duration"].as<unsigned>());
+            runners.invoke_on_all([&env, &st, concurrency, end, operations] (workload_runner& r) {
+                return r.run(env, st, concurrency, end, operations);
+            }).get();
+            auto duration = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+            auto r = runners.map_reduce0([] (workload_runner& r) { return r.get_results(); }, results(), [] (results a, results b) {
+                a += b;
+                return a;
+            }).get0();
+
+            if (config.count("output")) {
+                std::ofstream out(config["output"].as<sstring>());
+                write_json(out, w, r, duration);
+            } else {
+                write_json(std::cout, w, r, duration);
+            }
+        });
+    });
+}
@@ -480,6 +480,38 @@ BOOST_AUTO_TEST_CASE(test_add_random) {
     }
 }
 
+BOOST_AUTO_TEST_CASE(test_merge_random) {
+    for (uint32_t i = 0; i < 1000; ++i) {
+        range_tombstone_list l1(*s);
+        for (auto&& rt : make_random()) {
+            l1.apply(*s, rt);
+        }
+        range_tombstone_list l2(*s);
+        for (auto&& rt : make_random()) {
+            l2.apply(*s, rt);
+        }
+
+        auto expected = l1;
+        expected.apply(*s, l2);
+
+        auto copied = l1;
+        copied.apply_monotonically(*s, l2);
+        BOOST_REQUIRE(assert_valid(copied));
+        assert_that(*s, copied).is_equal_to(expected);
+
+        auto moved = l1;
+        moved.apply_monotonically(*s, std::move(l2));
+        BOOST_REQUIRE(assert_valid(moved));
+        assert_that(*s, moved).is_equal_to(expected);
+
+        auto original = l1;
+        range_tombstone_list empty(*s);
+        empty.apply_monotonically(*s, std::move(l1));
+        BOOST_REQUIRE(l1.empty());
+        assert_that(*s, empty).is_equal_to(original);
+    }
+}
+
 BOOST_AUTO_TEST_CASE(test_non_sorted_addition_with_one_range_with_empty_end) {
     range_tombstone_list l(*s);
 
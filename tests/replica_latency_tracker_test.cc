@@ -0,0 +1,94 @@
+/*
+ * Copyright (C) 2017 ScyllaDB
+ */
+
+/*
+ * This file is part of Scylla.
+ *
+ * Scylla is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Scylla is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#define BOOST_TEST_MODULE core
+
+#include <boost/test/unit_test.hpp>
+#include <vector>
+
+#include "service/replica_latency_tracker.hh"
+
+using namespace std::chrono_literals;
+using tracker = service::replica_latency_tracker;
+
+static const gms::inet_address a(uint32_t(1));
+static const gms::inet_address b(uint32_t(2));
+static const gms::inet_address c(uint32_t(3));
+
+BOOST_AUTO_TEST_CASE(test_order_is_kept_within_the_threshold) {
+    tracker t;
+    auto now = tracker::clock::now();
+    t.end_read(a, 1050us, now);
+    t.end_read(b, 1000us, now);
+    std::vector<gms::inet_address> eps = { a, b };
+    t.sort(eps.begin(), eps.end(), 0.1, 60s, now);
+    BOOST_REQUIRE(eps == std::vector<gms::inet_address>({ a, b }));
+}
+
+BOOST_AUTO_TEST_CASE(test_slow_replica_is_moved_back) {
+    tracker t;
+    auto now = tracker::clock::now();
+    t.end_read(a, 10ms, now);
+    t.end_read(b, 2ms, now);
+    t.end_read(c, 1ms, now);
+    std::vector<gms::inet_address> eps = { a, b, c };
+    t.sort(eps.begin(), eps.end(), 0.1, 60s, now);
+    BOOST_REQUIRE(eps == std::vector<gms::inet_address>({ c, b, a }));
+}
+
+BOOST_AUTO_TEST_CASE(test_pending_reads_count) {
+    tracker t;
+    auto now = tracker::clock::now();
+    t.end_read(a, 1ms, now);
+    t.end_read(b, 1ms, now);
+    // a stalls: reads pile up before any slow answer comes back.
+    t.start_read(a);
+    t.start_read(a);
+    BOOST_REQUIRE_EQUAL(t.score(a, 60s, now), 3 * t.score(b, 60s, now));
+    std::vector<gms::inet_address> eps = { a, b };
+    t.sort(eps.begin(), eps.end(), 0.1, 60s, now);
+    BOOST_REQUIRE(eps == std::vector<gms::inet_address>({ b, a }));
+}
+
+BOOST_AUTO_TEST_CASE(test_latency_is_averaged) {
+    tracker t;
+    auto now = tracker::clock::now();
+    t.end_read(a, 1ms, now);
+    t.start_read(a);
+    t.end_read(a, 11ms, now);
+    BOOST_REQUIRE_CLOSE(t.score(a, 60s, now), 2000, 0.001);
+}
+
+BOOST_AUTO_TEST_CASE(test_scores_are_reset) {
+    tracker t;
+    auto now = tracker::clock::now();
+    t.end_read(a, 10ms, now);
+    t.end_read(b, 1ms, now + 30s);
+    // a wasn't read from for longer than the reset interval, so it is tried again.
+    BOOST_REQUIRE_EQUAL(t.score(a, 60s, now + 61s), 0);
+    std::vector<gms::inet_address> eps = { b, a };
+    t.sort(eps.begin(), eps.end(), 0.1, 60s, now + 61s);
+    BOOST_REQUIRE(eps == std::vector<gms::inet_address>({ a, b }));
+    // Unless reads to it are still pending.
+    t.start_read(a);
+    BOOST_REQUIRE_GT(t.score(a, 60s, now + 61s), 0);
+}
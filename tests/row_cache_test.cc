@@ -172,6 +172,62 @@ mutation_reader make_counting_reader(mutation_reader mr, int& counter) {
     return make_mutation_reader<partition_counting_reader>(std::move(mr), counter);
 }
 
+class range_counting_reader final : public mutation_reader::impl {
+    mutation_reader _reader;
+    int& _counter;
+public:
+    range_counting_reader(mutation_reader mr, int& counter)
+        : _reader(std::move(mr)), _counter(counter) {
+        _counter++;
+    }
+
+    virtual future<streamed_mutation_opt> operator()() override {
+        return _reader();
+    }
+
+    virtual future<> fast_forward_to(const dht::partition_range& pr) override {
+        _counter++;
+        return _reader.fast_forward_to(pr);
+    }
+};
+
+SEASTAR_TEST_CASE(test_scan_reads_missing_ranges_around_cached_partitions_together) {
+    return seastar::async([] {
+        auto s = make_schema();
+        auto mt = make_lw_shared<memtable>(s);
+
+        std::vector<mutation> mutations;
+        for (int i = 0; i < 6; i++) {
+            auto m = make_new_mutation(s);
+            mt->apply(m);
+            mutations.push_back(m);
+        }
+        std::sort(mutations.begin(), mutations.end(), mutation_decorated_key_less_comparator());
+
+        int ranges_read = 0;
+        cache_tracker tracker;
+        row_cache cache(s, snapshot_source_from_snapshot(mutation_source([&] (schema_ptr s, const dht::partition_range& range,
+                const query::partition_slice& slice, const io_priority_class& pc, tracing::trace_state_ptr trace, streamed_mutation::forwarding fwd) {
+            return make_mutation_reader<range_counting_reader>(mt->as_data_source()(s, range, slice, pc, std::move(trace), fwd), ranges_read);
+        })), tracker);
+
+        // Neither partition is continuous with the one before it.
+        cache.populate(mutations[1]);
+        cache.populate(mutations[3]);
+
+        assert_that(cache.make_reader(s, query::full_partition_range))
+            .produces(mutations)
+            .produces_end_of_stream();
+        // The ranges before and after mutations[1] are read together; the one after mutations[3] on its own.
+        BOOST_REQUIRE_EQUAL(ranges_read, 2);
+
+        assert_that(cache.make_reader(s, query::full_partition_range))
+            .produces(mutations)
+            .produces_end_of_stream();
+        BOOST_REQUIRE_EQUAL(ranges_read, 2);
+    });
+}
+
 SEASTAR_TEST_CASE(test_cache_delegates_to_underlying_only_once_empty_full_range) {
     return seastar::async([] {
         auto s = make_schema();
@@ -711,6 +767,99 @@ SEASTAR_TEST_CASE(test_eviction) {
     });
 }
 
+SEASTAR_TEST_CASE(test_eviction_respects_table_shares) {
+    return seastar::async([] {
+        auto small_s = schema_builder("ks", "small")
+            .with_column("pk", bytes_type, column_kind::partition_key)
+            .with_column("v", bytes_type, column_kind::regular_column)
+            .set_caching_options(caching_options::from_map(std::map<sstring, sstring>{{"min_share", "0.5"}}))
+            .build();
+        auto big_s = make_schema();
+        auto small_mt = make_lw_shared<memtable>(small_s);
+        auto big_mt = make_lw_shared<memtable>(big_s);
+
+        cache_tracker tracker;
+        row_cache small_cache(small_s, snapshot_source_from_snapshot(small_mt->as_data_source()), tracker);
+        row_cache big_cache(big_s, snapshot_source_from_snapshot(big_mt->as_data_source()), tracker);
+
+        // The small table's partitions are the least recently used ones.
+        for (int i = 0; i < 10; i++) {
+            small_cache.populate(make_new_mutation(small_s));
+        }
+        for (int i = 0; i < 90; i++) {
+            big_cache.populate(make_new_mutation(big_s));
+        }
+        BOOST_REQUIRE_EQUAL(tracker.table_partitions(small_s->id()), 10);
+        BOOST_REQUIRE_EQUAL(tracker.table_partitions(big_s->id()), 90);
+
+        while (tracker.partitions() > 20) {
+            BOOST_REQUIRE(tracker.region().evict_some() == memory::reclaiming_result::reclaimed_something);
+        }
+        BOOST_REQUIRE_EQUAL(tracker.table_partitions(small_s->id()), 10);
+        BOOST_REQUIRE_EQUAL(tracker.table_partitions(big_s->id()), 10);
+    });
+}
+
+SEASTAR_TEST_CASE(test_no_eviction_below_eviction_floor) {
+    return seastar::async([] {
+        auto s = make_schema();
+        auto mt = make_lw_shared<memtable>(s);
+
+        cache_tracker tracker;
+        row_cache cache(s, snapshot_source_from_snapshot(mt->as_data_source()), tracker);
+        for (int i = 0; i < 10; i++) {
+            cache.populate(make_new_mutation(s));
+        }
+
+        tracker.set_eviction_floor(tracker.region().occupancy().used_space());
+        BOOST_REQUIRE(tracker.region().evict_some() == memory::reclaiming_result::reclaimed_nothing);
+        BOOST_REQUIRE_EQUAL(tracker.partitions(), 10);
+
+        // Above the floor, eviction goes on as usual.
+        tracker.set_eviction_floor(0);
+        BOOST_REQUIRE(tracker.region().evict_some() == memory::reclaiming_result::reclaimed_something);
+        BOOST_REQUIRE_EQUAL(tracker.partitions(), 9);
+    });
+}
+
+SEASTAR_TEST_CASE(test_partitions_populated_by_scans_are_evicted_first) {
+    return seastar::async([] {
+        auto s = make_schema();
+        auto mt = make_lw_shared<memtable>(s);
+
+        std::vector<mutation> mutations;
+        for (int i = 0; i < 10; i++) {
+            auto m = make_new_mutation(s);
+            mt->apply(m);
+            mutations.push_back(m);
+        }
+        std::sort(mutations.begin(), mutations.end(), mutation_decorated_key_less_comparator());
+
+        cache_tracker tracker;
+        row_cache cache(s, snapshot_source_from_snapshot(mt->as_data_source()), tracker);
+
+        auto& hot = mutations[5];
+        assert_that(cache.make_reader(s, dht::partition_range::make_singular(hot.decorated_key())))
+            .produces(hot)
+            .produces_end_of_stream();
+
+        assert_that(cache.make_reader(s, query::full_partition_range))
+            .produces(mutations)
+            .produces_end_of_stream();
+        BOOST_REQUIRE_EQUAL(tracker.get_stats().cold_partition_insertions, 9);
+
+        while (tracker.partitions() > 1) {
+            BOOST_REQUIRE(tracker.region().evict_some() == memory::reclaiming_result::reclaimed_something);
+        }
+
+        auto hits = tracker.get_stats().partition_hits;
+        assert_that(cache.make_reader(s, dht::partition_range::make_singular(hot.decorated_key())))
+            .produces(hot)
+            .produces_end_of_stream();
+        BOOST_REQUIRE_EQUAL(tracker.get_stats().partition_hits, hits + 1);
+    });
+}
+
 bool has_key(row_cache& cache, const dht::decorated_key& key) {
     auto range = dht::partition_range::make_singular(key);
     auto reader = cache.make_reader(cache.schema(), range);
@@ -2534,3 +2683,56 @@ SEASTAR_TEST_CASE(test_concurrent_setting_of_continuity_on_read_upper_bound) {
         }
     });
 }
+
+SEASTAR_TEST_CASE(test_tinylfu_admission_policy) {
+    return seastar::async([] {
+        tinylfu_admission_policy policy(1024);
+        uint64_t hot = 1;
+
+        for (int i = 0; i < 5; ++i) {
+            policy.record_access(hot);
+        }
+
+        // Partitions touched once by a scan must not displace the hot one.
+        for (uint64_t k = 100; k < 600; ++k) {
+            policy.record_access(k);
+            BOOST_REQUIRE(!policy.admit(k, hot));
+        }
+
+        uint64_t warm = 10;
+        for (int i = 0; i < 10; ++i) {
+            policy.record_access(warm);
+        }
+        BOOST_REQUIRE(policy.admit(warm, hot));
+
+        policy.clear();
+        BOOST_REQUIRE(!policy.admit(warm, hot));
+    });
+}
+
+SEASTAR_TEST_CASE(test_compressed_cache_entry_round_trip) {
+    return seastar::async([] {
+        random_mutation_generator gen(random_mutation_generator::generate_counters::no);
+        for (auto&& m : gen(8)) {
+            auto data = compressed_cache_entry::compress(m);
+            if (data.empty()) {
+                continue;
+            }
+            compressed_cache_entry ce(m.schema(), m.decorated_key(), data);
+            with_linearized_managed_bytes([&] {
+                assert_that(ce.decompress()).is_equal_to(m);
+            });
+        }
+
+        // Repetitive data compresses.
+        auto s = make_schema();
+        mutation m(new_key(s), s);
+        m.set_clustered_cell(clustering_key::make_empty(), "v", data_value(bytes(10000, int8_t('a'))), next_timestamp++);
+        auto data = compressed_cache_entry::compress(m);
+        BOOST_REQUIRE(!data.empty());
+        compressed_cache_entry ce(s, m.decorated_key(), data);
+        with_linearized_managed_bytes([&] {
+            assert_that(ce.decompress()).is_equal_to(m);
+        });
+    });
+}
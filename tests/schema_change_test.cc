@@ -402,6 +402,42 @@ SEASTAR_TEST_CASE(test_notifications) {
     });
 }
 
+SEASTAR_TEST_CASE(test_altering_a_table_leaves_the_other_tables_of_the_keyspace_alone) {
+    return do_with_cql_env([](cql_test_env& e) {
+        return seastar::async([&] {
+            e.execute_cql("create keyspace tests with replication = { 'class' : 'SimpleStrategy', 'replication_factor' : 1 };").get();
+            e.execute_cql("create table tests.table1 (pk int primary key, c1 int);").get();
+            e.execute_cql("create table tests.table2 (pk int primary key, c1 int);").get();
+            e.execute_cql("create table tests.table3 (pk int primary key, c1 int);").get();
+
+            auto s2 = e.local_db().find_schema("tests", "table2");
+            auto s3 = e.local_db().find_schema("tests", "table3");
+
+            counting_migration_listener listener;
+            service::get_local_migration_manager().register_listener(&listener);
+            auto listener_lease = defer([&listener] { service::get_local_migration_manager().unregister_listener(&listener); });
+
+            e.execute_cql("alter table tests.table1 add c2 int;").get();
+
+            BOOST_REQUIRE_EQUAL(listener.update_column_family_count, 1);
+            BOOST_REQUIRE(e.local_db().find_schema("tests", "table1")->get_column_definition("c2"));
+            BOOST_REQUIRE(e.local_db().find_schema("tests", "table2") == s2);
+            BOOST_REQUIRE(e.local_db().find_schema("tests", "table3") == s3);
+
+            e.execute_cql("drop table tests.table2;").get();
+
+            BOOST_REQUIRE_EQUAL(listener.drop_column_family_count, 1);
+            BOOST_REQUIRE(!e.local_db().has_schema("tests", "table2"));
+            BOOST_REQUIRE(e.local_db().find_schema("tests", "table3") == s3);
+
+            e.execute_cql("drop keyspace tests;").get();
+
+            BOOST_REQUIRE_EQUAL(listener.drop_column_family_count, 3);
+            BOOST_REQUIRE_EQUAL(listener.drop_keyspace_count, 1);
+        });
+    });
+}
+
 SEASTAR_TEST_CASE(test_prepared_statement_is_invalidated_by_schema_change) {
     return do_with_cql_env([](cql_test_env& e) {
         return seastar::async([&] {
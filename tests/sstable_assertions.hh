@@ -48,18 +48,18 @@ class index_reader_assertions {
             prev = rp;
 
             auto* pi = _r->current_partition_entry().get_promoted_index(s);
-            if (!pi->entries.empty()) {
-                auto& prev = pi->entries[0];
-                for (size_t i = 1; i < pi->entries.size(); ++i) {
-                    auto& cur = pi->entries[i];
+            if (!pi->empty()) {
+                auto prev = (*pi)[0];
+                for (size_t i = 1; i < pi->size(); ++i) {
+                    auto cur = (*pi)[i];
                     if (!pos_cmp(prev.end, cur.start)) {
                         std::cout << "promoted index:\n";
-                        for (auto& e : pi->entries) {
+                        pi->for_each([] (const sstables::promoted_index::entry& e) {
                             std::cout << "  " << e.start << "-" << e.end << ": +" << e.offset << " len=" << e.width << std::endl;
-                        }
+                        });
                         BOOST_FAIL(sprint("Index blocks are not monotonic: %s >= %s", prev.end, cur.start));
                     }
-                    cur = prev;
+                    prev = cur;
                 }
             }
             _r->advance_to_next_partition().get();
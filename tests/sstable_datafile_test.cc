@@ -54,6 +54,8 @@
 #include <stdio.h>
 #include <ftw.h>
 #include <unistd.h>
+#include <boost/range/adaptor/transformed.hpp>
+#include <boost/range/iterator_range_core.hpp>
 #include <boost/range/algorithm/find_if.hpp>
 #include <boost/algorithm/cxx11/all_of.hpp>
 #include <boost/algorithm/cxx11/is_sorted.hpp>
@@ -892,7 +894,7 @@ SEASTAR_TEST_CASE(datafile_generation_12) {
     });
 }
 
-static future<> sstable_compression_test(compressor c, unsigned generation) {
+static future<> sstable_compression_test(compression_parameters c, unsigned generation) {
     return test_setup::do_with_test_directory([c, generation] {
         // NOTE: set a given compressor algorithm to schema.
         schema_builder builder(complex_schema());
@@ -941,6 +943,19 @@ SEASTAR_TEST_CASE(datafile_generation_15) {
     return sstable_compression_test(compressor::deflate, 15);
 }
 
+SEASTAR_TEST_CASE(datafile_generation_15_zstd) {
+    return sstable_compression_test(compressor::zstd, 1015);
+}
+
+SEASTAR_TEST_CASE(datafile_generation_15_zstd_dictionary) {
+    // Too little data to train a dictionary, the sstable must still be readable.
+    return sstable_compression_test(compression_parameters({
+        {compression_parameters::SSTABLE_COMPRESSION, "ZstdCompressor"},
+        {compression_parameters::COMPRESSION_LEVEL, "5"},
+        {compression_parameters::DICTIONARY_SIZE_KB, "16"},
+    }), 1016);
+}
+
 SEASTAR_TEST_CASE(datafile_generation_16) {
     return test_setup::do_with_test_directory([] {
         auto s = uncompressed_schema();
@@ -2210,6 +2225,76 @@ SEASTAR_TEST_CASE(leveled_stcs_on_L0) {
     return make_ready_future<>();
 }
 
+SEASTAR_TEST_CASE(leveled_parallel_compactions) {
+    auto s = make_lw_shared(schema({}, some_keyspace, some_column_family,
+        {{"p1", utf8_type}}, {}, {}, {}, utf8_type));
+
+    column_family::config cfg;
+    cell_locker_stats cl_stats;
+    compaction_manager cm;
+    cfg.enable_disk_writes = false;
+    cfg.enable_commitlog = false;
+
+    // L1 holds 11 sstables of max size, one more than it should.
+    auto sstables_no = 11;
+    auto key_and_token_pair = token_generation_for_current_shard(sstables_no);
+    auto sstable_max_size = 1024*1024;
+    auto without = [] (std::vector<shared_sstable> candidates, const std::vector<shared_sstable>& compacting) {
+        candidates.erase(boost::remove_if(candidates, [&] (auto& sst) {
+            return boost::algorithm::any_of(compacting, [&] (auto& c) { return c == sst; });
+        }), candidates.end());
+        return candidates;
+    };
+    auto make_strategy = [] {
+        return sstables::make_compaction_strategy(sstables::compaction_strategy_type::leveled, {{ "sstable_size_in_mb", "1" }});
+    };
+
+    {
+        auto cf = make_lw_shared<column_family>(s, cfg, column_family::no_commitlog(), cm, cl_stats);
+        cf->mark_ready_for_writes();
+        for (auto i = 0; i < sstables_no; i++) {
+            add_sstable_for_leveled_test(cf, i, sstable_max_size, /*level*/1, key_and_token_pair[i].first, key_and_token_pair[i].first);
+        }
+        auto cs = make_strategy();
+        auto candidates = get_candidates_for_leveled_strategy(*cf);
+        auto first = cs.get_sstables_for_compaction(*cf, candidates);
+        BOOST_REQUIRE(first.level == 2);
+        BOOST_REQUIRE(first.sstables.size() == 1);
+
+        // The sstables of L1 don't overlap, so another one is compacted while the first one is.
+        auto second = cs.get_sstables_for_compaction(*cf, without(candidates, first.sstables));
+        BOOST_REQUIRE(second.level == 2);
+        BOOST_REQUIRE(second.sstables.size() == 1);
+        BOOST_REQUIRE(second.sstables.front() != first.sstables.front());
+    }
+
+    {
+        auto cf = make_lw_shared<column_family>(s, cfg, column_family::no_commitlog(), cm, cl_stats);
+        cf->mark_ready_for_writes();
+        for (auto i = 0; i < sstables_no; i++) {
+            add_sstable_for_leveled_test(cf, i, sstable_max_size, /*level*/1, key_and_token_pair[i].first, key_and_token_pair[i].first);
+        }
+        // An L2 sstable spanning all keys takes part in any compaction of L1 into L2.
+        add_sstable_for_leveled_test(cf, sstables_no, sstable_max_size, /*level*/2, key_and_token_pair.front().first, key_and_token_pair.back().first);
+        auto cs = make_strategy();
+        auto candidates = get_candidates_for_leveled_strategy(*cf);
+        auto first = cs.get_sstables_for_compaction(*cf, candidates);
+        BOOST_REQUIRE(first.level == 2);
+        BOOST_REQUIRE(first.sstables.size() == 2);
+
+        // Any other compaction into L2 would overlap the running one.
+        auto second = cs.get_sstables_for_compaction(*cf, without(candidates, first.sstables));
+        BOOST_REQUIRE(second.sstables.empty());
+
+        // Once the first compaction is done, or failed, its sstables are candidates again.
+        auto retry = cs.get_sstables_for_compaction(*cf, candidates);
+        BOOST_REQUIRE(retry.level == 2);
+        BOOST_REQUIRE(retry.sstables.size() == 2);
+    }
+
+    return make_ready_future<>();
+}
+
 SEASTAR_TEST_CASE(overlapping_starved_sstables_test) {
     auto s = make_lw_shared(schema({}, some_keyspace, some_column_family,
         {{"p1", utf8_type}}, {}, {}, {}, utf8_type));
@@ -3867,6 +3952,63 @@ SEASTAR_TEST_CASE(sstable_set_incremental_selector) {
     return make_ready_future<>();
 }
 
+SEASTAR_TEST_CASE(sstable_set_selects_overlapping_sstables) {
+    auto s = make_lw_shared(schema({}, some_keyspace, some_column_family,
+        {{"p1", utf8_type}}, {}, {}, {}, utf8_type));
+    auto cs = sstables::make_compaction_strategy(sstables::compaction_strategy_type::size_tiered, s->compaction_strategy_options());
+    auto key_and_token_pair = token_generation_for_current_shard(8);
+
+    auto gens = [] (const std::vector<shared_sstable>& sstables) {
+        return boost::copy_range<std::unordered_set<int64_t>>(sstables | boost::adaptors::transformed([] (auto& sst) {
+            return sst->generation();
+        }));
+    };
+    auto check = [&] (sstable_set::incremental_selector& selector, const dht::token& token, std::unordered_set<int64_t> expected_gens) {
+        BOOST_REQUIRE(gens(selector.select(token).sstables) == expected_gens);
+    };
+    auto check_range = [&] (const sstable_set& set, int start, int end, std::unordered_set<int64_t> expected_gens) {
+        auto pr = dht::partition_range::make(dht::ring_position::starting_at(key_and_token_pair[start].second),
+            dht::ring_position::ending_at(key_and_token_pair[end].second));
+        BOOST_REQUIRE(gens(set.select(pr)) == expected_gens);
+    };
+
+    sstable_set set = cs.make_sstable_set(s);
+    set.insert(sstable_for_overlapping_test(s, 1, key_and_token_pair[0].first, key_and_token_pair[6].first, 0));
+    set.insert(sstable_for_overlapping_test(s, 2, key_and_token_pair[0].first, key_and_token_pair[1].first, 0));
+    set.insert(sstable_for_overlapping_test(s, 3, key_and_token_pair[3].first, key_and_token_pair[4].first, 0));
+    set.insert(sstable_for_overlapping_test(s, 4, key_and_token_pair[4].first, key_and_token_pair[4].first, 0));
+    set.insert(sstable_for_overlapping_test(s, 5, key_and_token_pair[4].first, key_and_token_pair[5].first, 0));
+    set.insert(sstable_for_overlapping_test(s, 6, key_and_token_pair[2].first, key_and_token_pair[5].first, 0));
+
+    check_range(set, 0, 0, {1, 2});
+    check_range(set, 2, 2, {1, 6});
+    check_range(set, 1, 3, {1, 2, 3, 6});
+    check_range(set, 5, 5, {1, 5, 6});
+    check_range(set, 7, 7, {});
+    BOOST_REQUIRE_EQUAL(set.select(query::full_partition_range).size(), 6);
+
+    sstable_set::incremental_selector sel = set.make_incremental_selector();
+    check(sel, key_and_token_pair[0].second, {1, 2});
+    check(sel, key_and_token_pair[1].second, {1, 2});
+    check(sel, key_and_token_pair[2].second, {1, 6});
+    check(sel, key_and_token_pair[3].second, {1, 3, 6});
+    check(sel, key_and_token_pair[4].second, {1, 3, 4, 5, 6});
+    check(sel, key_and_token_pair[5].second, {1, 5, 6});
+    check(sel, key_and_token_pair[6].second, {1});
+    check(sel, key_and_token_pair[7].second, {});
+    // The selector doesn't need monotonic tokens.
+    check(sel, key_and_token_pair[2].second, {1, 6});
+
+    auto selection = sel.select(key_and_token_pair[1].second);
+    BOOST_REQUIRE(selection.next_token == key_and_token_pair[2].second);
+
+    set.erase(*boost::find_if(*set.all(), [] (auto& sst) { return sst->generation() == 6; }));
+    check_range(set, 2, 2, {1});
+    check_range(set, 1, 3, {1, 2, 3});
+
+    return make_ready_future<>();
+}
+
 SEASTAR_TEST_CASE(sstable_resharding_strategy_tests) {
     // TODO: move it to sstable_resharding_test.cc. Unable to do so now because of linking issues
     // when using sstables::stats_metadata at sstable_resharding_test.cc.
@@ -3896,6 +4038,9 @@ SEASTAR_TEST_CASE(sstable_resharding_strategy_tests) {
         // until we move this test case to sstable_resharding_test.
         auto descriptors = stcs.get_resharding_jobs(*cf, { sst1, sst2 });
         BOOST_REQUIRE(descriptors.size() == 2);
+        for (auto& d : descriptors) {
+            BOOST_REQUIRE(d.reshard_at < smp::count);
+        }
     }
     {
         auto ssts = std::vector<sstables::shared_sstable>{ sst1, sst2 };
@@ -4064,6 +4209,26 @@ SEASTAR_TEST_CASE(sstable_expired_data_ratio) {
             auto descriptor = cs.get_sstables_for_compaction(*cf, { sst });
             BOOST_REQUIRE(descriptor.sstables.size() == 0);
         }
+        // sstable whose keys are all in a sstable with data as old as its tombstones won't be
+        // included, because compacting it alone can't purge them, unless the check is disabled
+        {
+            auto overlapping = make_sstable(s, tmp->path, 3, la, big);
+            write_memtable_to_sstable(*mt, overlapping).get();
+            overlapping = reusable_sst(s, tmp->path, 3).get0();
+            column_family_test(cf).add_sstable(sst);
+            column_family_test(cf).add_sstable(overlapping);
+            sstables::test(sst).set_data_file_write_time(db_clock::time_point::min());
+            auto cs = sstables::make_compaction_strategy(sstables::compaction_strategy_type::size_tiered, options);
+            auto descriptor = cs.get_sstables_for_compaction(*cf, { sst });
+            BOOST_REQUIRE(descriptor.sstables.size() == 0);
+
+            auto unchecked_options = options;
+            unchecked_options.emplace("unchecked_tombstone_compaction", "true");
+            cs = sstables::make_compaction_strategy(sstables::compaction_strategy_type::size_tiered, unchecked_options);
+            descriptor = cs.get_sstables_for_compaction(*cf, { sst });
+            BOOST_REQUIRE(descriptor.sstables.size() == 1);
+            BOOST_REQUIRE(descriptor.sstables.front() == sst);
+        }
     });
 }
 
@@ -4318,3 +4483,390 @@ SEASTAR_TEST_CASE(compaction_correctness_with_partitioned_sstable_set) {
                 .produces_end_of_stream();
     });
 }
+
+SEASTAR_TEST_CASE(incremental_compaction_releases_exhausted_sstables) {
+    return seastar::async([] {
+        cell_locker_stats cl_stats;
+
+        auto builder = schema_builder("tests", "incremental_compaction")
+                .with_column("id", utf8_type, column_kind::partition_key)
+                .with_column("value", int32_type);
+        auto s = builder.build();
+
+        auto tmp = make_lw_shared<tmpdir>();
+        auto sst_gen = [s, tmp, gen = make_lw_shared<unsigned>(1)] () mutable {
+            auto sst = make_sstable(s, tmp->path, (*gen)++, la, big);
+            sst->set_unshared();
+            return sst;
+        };
+
+        auto make_insert = [&] (auto p) {
+            auto key = partition_key::from_exploded(*s, {to_bytes(p.first)});
+            mutation m(key, s);
+            m.set_clustered_cell(clustering_key::make_empty(), bytes("value"), data_value(int32_t(1)), 1 /* ts */);
+            BOOST_REQUIRE(m.decorated_key().token() == p.second);
+            return m;
+        };
+
+        auto tokens = token_generation_for_current_shard(4);
+        auto mut1 = make_insert(tokens[0]);
+        auto mut2 = make_insert(tokens[1]);
+        auto mut3 = make_insert(tokens[2]);
+        auto mut4 = make_insert(tokens[3]);
+        auto sst1 = make_sstable_containing(sst_gen, {mut1, mut2});
+        auto sst2 = make_sstable_containing(sst_gen, {mut3, mut4});
+
+        std::vector<std::pair<std::vector<shared_sstable>, std::vector<shared_sstable>>> replacements;
+        auto replacer = [&] (const std::vector<shared_sstable>& new_sstables, const std::vector<shared_sstable>& exhausted_sstables) {
+            replacements.emplace_back(new_sstables, exhausted_sstables);
+        };
+
+        auto cm = make_lw_shared<compaction_manager>();
+        auto cf = make_lw_shared<column_family>(s, column_family::config(), column_family::no_commitlog(), *cm, cl_stats);
+        cf->mark_ready_for_writes();
+        // Writes one partition per sstable.
+        auto info = sstables::compact_sstables({ sst1, sst2 }, *cf, sst_gen, 0, 0, false, nullptr, replacer).get0();
+        BOOST_REQUIRE_EQUAL(4, info.new_sstables.size());
+
+        // Each input is released once the sstable holding its last partition is sealed.
+        BOOST_REQUIRE_EQUAL(2, replacements.size());
+        BOOST_REQUIRE(replacements[0].first == std::vector<shared_sstable>({ info.new_sstables[0], info.new_sstables[1] }));
+        BOOST_REQUIRE(replacements[0].second == std::vector<shared_sstable>({ sst1 }));
+        BOOST_REQUIRE(replacements[1].first == std::vector<shared_sstable>({ info.new_sstables[2], info.new_sstables[3] }));
+        BOOST_REQUIRE(replacements[1].second == std::vector<shared_sstable>({ sst2 }));
+
+        // The output is a single run.
+        for (auto& sst : info.new_sstables) {
+            auto reopened = make_sstable(s, tmp->path, sst->generation(), la, big);
+            reopened->load().get();
+            BOOST_REQUIRE(reopened->run_identifier() == info.new_sstables[0]->run_identifier());
+        }
+        BOOST_REQUIRE(sst1->run_identifier() != sst2->run_identifier());
+    });
+}
+
+SEASTAR_TEST_CASE(split_compaction_writes_non_overlapping_run) {
+    return seastar::async([] {
+        cell_locker_stats cl_stats;
+
+        auto builder = schema_builder("tests", "split_compaction")
+                .with_column("id", utf8_type, column_kind::partition_key)
+                .with_column("value", utf8_type);
+        auto s = builder.build();
+
+        auto tmp = make_lw_shared<tmpdir>();
+        auto sst_gen = [s, tmp, gen = make_lw_shared<unsigned>(1)] () mutable {
+            auto sst = make_sstable(s, tmp->path, (*gen)++, la, big);
+            sst->set_unshared();
+            return sst;
+        };
+
+        // Values are large enough for each partition to have its own summary entry.
+        auto make_insert = [&] (auto p) {
+            auto key = partition_key::from_exploded(*s, {to_bytes(p.first)});
+            mutation m(key, s);
+            m.set_clustered_cell(clustering_key::make_empty(), bytes("value"), data_value(sstring(4096, 'v')), 1 /* ts */);
+            return m;
+        };
+
+        auto tokens = token_generation_for_current_shard(8);
+        std::vector<mutation> muts;
+        for (auto& t : tokens) {
+            muts.push_back(make_insert(t));
+        }
+        auto sst1 = make_sstable_containing(sst_gen, {muts[0], muts[2], muts[4], muts[6]});
+        auto sst2 = make_sstable_containing(sst_gen, {muts[1], muts[3], muts[5], muts[7]});
+
+        auto cm = make_lw_shared<compaction_manager>();
+        auto cf = make_lw_shared<column_family>(s, column_family::config(), column_family::no_commitlog(), *cm, cl_stats);
+        cf->mark_ready_for_writes();
+        auto info = sstables::compact_sstables({ sst1, sst2 }, *cf, sst_gen, std::numeric_limits<uint64_t>::max(), 0,
+                false, nullptr, {}, 2).get0();
+        BOOST_REQUIRE_EQUAL(2, info.new_sstables.size());
+        BOOST_REQUIRE_EQUAL(2, info.sstables);
+        BOOST_REQUIRE_EQUAL(8, info.total_keys_written);
+
+        // Each job wrote a disjoint token range, and all jobs wrote a single run.
+        auto& first = info.new_sstables[0];
+        auto& second = info.new_sstables[1];
+        BOOST_REQUIRE(first->get_last_decorated_key().tri_compare(*s, second->get_first_decorated_key()) < 0);
+        BOOST_REQUIRE(first->run_identifier() == second->run_identifier());
+
+        auto next = muts.begin();
+        for (auto& sst : info.new_sstables) {
+            auto reopened = make_sstable(s, tmp->path, sst->generation(), la, big);
+            reopened->load().get();
+            auto reader = assert_that(sstable_reader(reopened, s));
+            while (next != muts.end() && next->decorated_key().tri_compare(*s, reopened->get_last_decorated_key()) <= 0) {
+                reader.produces(*next++);
+            }
+            reader.produces_end_of_stream();
+        }
+        BOOST_REQUIRE(next == muts.end());
+    });
+}
+
+SEASTAR_TEST_CASE(compaction_drops_fully_expired_sstables) {
+    return seastar::async([] {
+        cell_locker_stats cl_stats;
+
+        auto builder = schema_builder("tests", "expired_sstables")
+                .with_column("id", utf8_type, column_kind::partition_key)
+                .with_column("value", int32_type);
+        auto s = builder.build();
+
+        auto tmp = make_lw_shared<tmpdir>();
+        auto sst_gen = [s, tmp, gen = make_lw_shared<unsigned>(1)] () mutable {
+            auto sst = make_sstable(s, tmp->path, (*gen)++, la, big);
+            sst->set_unshared();
+            return sst;
+        };
+
+        auto make_insert = [&] (auto p, api::timestamp_type ts, stdx::optional<gc_clock::time_point> expiry) {
+            auto key = partition_key::from_exploded(*s, {to_bytes(p.first)});
+            mutation m(key, s);
+            auto& col = *s->get_column_definition("value");
+            auto value = int32_type->decompose(1);
+            m.set_clustered_cell(clustering_key::make_empty(), col, expiry
+                    ? atomic_cell::make_live(ts, value, *expiry, gc_clock::duration(3600))
+                    : atomic_cell::make_live(ts, value));
+            return m;
+        };
+
+        // The expired data is older than any other data, so it can't be shadowed.
+        auto tokens = token_generation_for_current_shard(2);
+        auto expiry = gc_clock::now() - s->gc_grace_seconds() - std::chrono::hours(1);
+        auto expired = make_insert(tokens[0], 1, expiry);
+        auto live = make_insert(tokens[1], 2, stdx::nullopt);
+        auto expired_sst = make_sstable_containing(sst_gen, {expired});
+        auto live_sst = make_sstable_containing(sst_gen, {live});
+
+        auto cm = make_lw_shared<compaction_manager>();
+        auto cf = make_lw_shared<column_family>(s, column_family::config(), column_family::no_commitlog(), *cm, cl_stats);
+        cf->mark_ready_for_writes();
+        auto info = sstables::compact_sstables({ expired_sst, live_sst }, *cf, sst_gen, std::numeric_limits<uint64_t>::max(), 0).get0();
+        BOOST_REQUIRE_EQUAL(1, info.new_sstables.size());
+        BOOST_REQUIRE_EQUAL(1, info.total_keys_written);
+        BOOST_REQUIRE_EQUAL(1, cm->get_stats().expired_sstables);
+        BOOST_REQUIRE_EQUAL(expired_sst->bytes_on_disk(), cm->get_stats().expired_sstables_bytes);
+        assert_that(sstable_reader(info.new_sstables[0], s))
+            .produces(live)
+            .produces_end_of_stream();
+    });
+}
+
+SEASTAR_TEST_CASE(compaction_strategy_backlog_test) {
+    auto s = make_lw_shared(schema({}, some_keyspace, some_column_family,
+        {{"p1", utf8_type}}, {}, {}, {}, utf8_type));
+
+    column_family::config cfg;
+    cell_locker_stats cl_stats;
+    compaction_manager cm;
+    cfg.enable_disk_writes = false;
+    cfg.enable_commitlog = false;
+    auto cf = make_lw_shared<column_family>(s, cfg, column_family::no_commitlog(), cm, cl_stats);
+    cf->mark_ready_for_writes();
+
+    auto stcs = sstables::make_compaction_strategy(sstables::compaction_strategy_type::size_tiered, s->compaction_strategy_options());
+    auto lcs = sstables::make_compaction_strategy(sstables::compaction_strategy_type::leveled, {{ "sstable_size_in_mb", "1" }});
+    auto null_cs = sstables::make_compaction_strategy(sstables::compaction_strategy_type::null, s->compaction_strategy_options());
+
+    auto key_and_token_pair = token_generation_for_current_shard(2);
+    auto min_key = key_and_token_pair[0].first;
+    auto max_key = key_and_token_pair[1].first;
+    uint64_t sstable_size = 1024 * 1024;
+
+    add_sstable_for_leveled_test(cf, /*gen*/1, sstable_size, /*level*/0, min_key, max_key);
+    // A single sstable has nothing to be compacted with.
+    BOOST_REQUIRE_EQUAL(stcs.backlog(*cf), 0);
+
+    for (auto gen = 2; gen <= 4; gen++) {
+        add_sstable_for_leveled_test(cf, gen, sstable_size, /*level*/0, min_key, max_key);
+    }
+    // Four sstables of the same size make a single tier when min_threshold is 4.
+    BOOST_REQUIRE_EQUAL(s->min_compaction_threshold(), 4);
+    BOOST_REQUIRE_EQUAL(stcs.backlog(*cf), 4 * sstable_size);
+    // L0 data is merged into L1.
+    BOOST_REQUIRE_EQUAL(lcs.backlog(*cf), 4 * sstable_size * 10);
+    BOOST_REQUIRE_EQUAL(null_cs.backlog(*cf), 0);
+    return make_ready_future<>();
+}
+
+SEASTAR_TEST_CASE(blocked_bloom_filter_test) {
+    return seastar::async([] {
+        auto s = schema_builder("ks", "cf")
+            .with_column("p1", utf8_type, column_kind::partition_key)
+            .with_column("r1", int32_type)
+            .set_compaction_strategy_options({{ "bloom_filter_format", "blocked" }})
+            .build();
+        const column_definition& r1_col = *s->get_column_definition("r1");
+
+        auto mt = make_lw_shared<memtable>(s);
+        std::vector<partition_key> keys;
+        for (auto i = 0; i < 1000; i++) {
+            auto key = partition_key::from_exploded(*s, {to_bytes(sprint("key%d", i))});
+            mutation m(key, s);
+            m.set_clustered_cell(clustering_key::make_empty(), r1_col, make_atomic_cell(int32_type->decompose(i)));
+            mt->apply(std::move(m));
+            keys.push_back(std::move(key));
+        }
+
+        auto tmp = make_lw_shared<tmpdir>();
+        auto sst = make_sstable(s, tmp->path, 1, la, big);
+        write_memtable_to_sstable(*mt, sst).get();
+        sst = reusable_sst(s, tmp->path, 1).get0();
+
+        for (auto&& key : keys) {
+            BOOST_REQUIRE(sst->filter_has_key(*s, key));
+        }
+        auto false_positives = 0;
+        for (auto i = 0; i < 10000; i++) {
+            auto key = partition_key::from_exploded(*s, {to_bytes(sprint("absent%d", i))});
+            false_positives += sst->filter_has_key(*s, key);
+        }
+        // fp chance is 0.01 by default.
+        BOOST_REQUIRE_LT(false_positives, 300);
+    });
+}
+
+SEASTAR_TEST_CASE(test_filter_is_sized_for_the_partitions_written) {
+    return seastar::async([] {
+        auto s = schema_builder("ks", "cf")
+            .with_column("p1", utf8_type, column_kind::partition_key)
+            .with_column("r1", int32_type)
+            .build();
+        const column_definition& r1_col = *s->get_column_definition("r1");
+
+        auto mt = make_lw_shared<memtable>(s);
+        std::vector<partition_key> keys;
+        for (auto i = 0; i < 100; i++) {
+            auto key = partition_key::from_exploded(*s, {to_bytes(sprint("key%d", i))});
+            mutation m(key, s);
+            m.set_clustered_cell(clustering_key::make_empty(), r1_col, make_atomic_cell(int32_type->decompose(i)));
+            mt->apply(std::move(m));
+            keys.push_back(std::move(key));
+        }
+
+        auto tmp = make_lw_shared<tmpdir>();
+        auto sst = make_sstable(s, tmp->path, 1, la, big);
+        // As if the partitions of the compacted sstables overlapped much more than estimated.
+        sst->write_components(mt->make_flush_reader(s, default_priority_class()), 1000000, s, sstable_writer_config()).get();
+        sst = reusable_sst(s, tmp->path, 1).get0();
+
+        auto expected = utils::i_filter::get_filter(keys.size(), s->bloom_filter_fp_chance());
+        BOOST_REQUIRE_EQUAL(sst->filter_memory_size(), expected->memory_size());
+        for (auto&& key : keys) {
+            BOOST_REQUIRE(sst->filter_has_key(*s, key));
+        }
+    });
+}
+
+SEASTAR_TEST_CASE(test_summary_resampling) {
+    return seastar::async([] {
+        auto s = schema_builder("ks", "cf")
+            .with_column("p1", utf8_type, column_kind::partition_key)
+            .with_column("r1", int32_type)
+            .set_min_index_interval(1)
+            .set_max_index_interval(4)
+            .build();
+        const column_definition& r1_col = *s->get_column_definition("r1");
+
+        auto mt = make_lw_shared<memtable>(s);
+        std::vector<partition_key> keys;
+        for (auto i = 0; i < 256; i++) {
+            auto key = partition_key::from_exploded(*s, {to_bytes(sprint("key%d", i))});
+            mutation m(key, s);
+            m.set_clustered_cell(clustering_key::make_empty(), r1_col, make_atomic_cell(int32_type->decompose(i)));
+            mt->apply(std::move(m));
+            keys.push_back(std::move(key));
+        }
+
+        auto tmp = make_lw_shared<tmpdir>();
+        auto sst = make_sstable(s, tmp->path, 1, la, big);
+        write_memtable_to_sstable(*mt, sst).get();
+        sst = reusable_sst(s, tmp->path, 1).get0();
+
+        auto read_all = [&] {
+            for (auto&& key : keys) {
+                auto sm = sst->read_row(s, sstables::key::from_partition_key(*s, key)).get0();
+                BOOST_REQUIRE(sm);
+                BOOST_REQUIRE(sm->key().equal(*s, key));
+            }
+        };
+
+        BOOST_REQUIRE(sst->can_resample_summary());
+        BOOST_REQUIRE_EQUAL(sst->summary_sampling_level(), downsampling::BASE_SAMPLING_LEVEL);
+        auto full_entries = sst->get_summary().entries.size();
+        auto full_memory = sst->get_summary().memory_footprint();
+        read_all();
+        BOOST_REQUIRE_GE(sst->take_index_reads(), keys.size());
+        BOOST_REQUIRE_EQUAL(sst->take_index_reads(), 0);
+
+        BOOST_REQUIRE(sst->resample_summary(downsampling::BASE_SAMPLING_LEVEL / 4).get0());
+        BOOST_REQUIRE_EQUAL(sst->summary_sampling_level(), downsampling::BASE_SAMPLING_LEVEL / 4);
+        BOOST_REQUIRE_EQUAL(sst->get_summary().entries.size(), full_entries / 4);
+        BOOST_REQUIRE_LT(sst->get_summary().memory_footprint(), full_memory);
+        read_all();
+
+        BOOST_REQUIRE(sst->resample_summary(downsampling::BASE_SAMPLING_LEVEL).get0());
+        BOOST_REQUIRE_EQUAL(sst->summary_sampling_level(), downsampling::BASE_SAMPLING_LEVEL);
+        BOOST_REQUIRE_EQUAL(sst->get_summary().entries.size(), full_entries);
+        read_all();
+    });
+}
+
+SEASTAR_TEST_CASE(test_sstable_read_stats) {
+    return seastar::async([] {
+        auto s = schema_builder("ks", "cf")
+            .with_column("p1", utf8_type, column_kind::partition_key)
+            .with_column("r1", int32_type)
+            .set_compressor_params(compression_parameters(compressor::lz4))
+            .build();
+        const column_definition& r1_col = *s->get_column_definition("r1");
+
+        auto mt = make_lw_shared<memtable>(s);
+        std::vector<partition_key> keys;
+        for (auto i = 0; i < 64; i++) {
+            auto key = partition_key::from_exploded(*s, {to_bytes(sprint("key%d", i))});
+            mutation m(key, s);
+            m.set_clustered_cell(clustering_key::make_empty(), r1_col, make_atomic_cell(int32_type->decompose(i)));
+            mt->apply(std::move(m));
+            keys.push_back(std::move(key));
+        }
+
+        auto tmp = make_lw_shared<tmpdir>();
+        auto sst = make_sstable(s, tmp->path, 1, la, big);
+        write_memtable_to_sstable(*mt, sst).get();
+        sst = reusable_sst(s, tmp->path, 1).get0();
+
+        auto stats = sst->get_read_stats();
+        BOOST_REQUIRE_EQUAL(stats.partition_lookups, 0);
+        BOOST_REQUIRE_EQUAL(stats.data_bytes_read, 0);
+        BOOST_REQUIRE_EQUAL(sst->read_hotness(), 0);
+
+        for (auto&& key : keys) {
+            auto k = sstables::key::from_partition_key(*s, key);
+            BOOST_REQUIRE(sst->filter_has_key_for_read(k));
+            auto sm = sst->read_row(s, k).get0();
+            BOOST_REQUIRE(sm);
+            mutation_from_streamed_mutation(std::move(sm)).get();
+        }
+
+        stats = sst->get_read_stats();
+        BOOST_REQUIRE_EQUAL(stats.partition_lookups, keys.size());
+        BOOST_REQUIRE_EQUAL(stats.filter_hits, keys.size());
+        BOOST_REQUIRE_EQUAL(stats.filter_false_positives, 0);
+        BOOST_REQUIRE_GT(stats.index_page_reads, 0);
+        BOOST_REQUIRE_GT(stats.data_bytes_read, 0);
+        BOOST_REQUIRE_GT(stats.decompressed_bytes, 0);
+        BOOST_REQUIRE_GT(sst->read_hotness(), 0);
+
+        // A key the sstable doesn't have is a false positive when its filter lets it through.
+        auto missing = sstables::key::from_partition_key(*s, partition_key::from_exploded(*s, {to_bytes("missing")}));
+        if (sst->filter_has_key_for_read(missing)) {
+            BOOST_REQUIRE(!sst->read_row(s, missing).get0());
+            BOOST_REQUIRE_EQUAL(sst->get_read_stats().filter_false_positives, 1);
+        }
+        BOOST_REQUIRE_EQUAL(sst->get_read_stats().partition_lookups, keys.size() + 1);
+    });
+}
@@ -37,6 +37,7 @@
 #include "memtable-sstable.hh"
 #include "disk-error-handler.hh"
 #include "tests/sstable_assertions.hh"
+#include "partition_slice_builder.hh"
 
 thread_local disk_error_signal_type commit_error;
 thread_local disk_error_signal_type general_disk_error;
@@ -387,7 +388,7 @@ void test_mutation_source(sstable_writer_config cfg, sstables::sstable::version_
 
 SEASTAR_TEST_CASE(test_sstable_conforms_to_mutation_source) {
     return seastar::async([] {
-        for (auto version : {sstables::sstable::version_types::ka, sstables::sstable::version_types::la}) {
+        for (auto version : {sstables::sstable::version_types::ka, sstables::sstable::version_types::la, sstables::sstable::version_types::mc}) {
             for (auto index_block_size : {1, 128, 64*1024}) {
                 sstable_writer_config cfg;
                 cfg.promoted_index_block_size = index_block_size;
@@ -437,6 +438,91 @@ SEASTAR_TEST_CASE(test_sstable_can_write_and_read_range_tombstone) {
     });
 }
 
+SEASTAR_TEST_CASE(test_index_pages_are_cached_after_last_reader) {
+    return seastar::async([] {
+        auto dir = make_lw_shared<tmpdir>();
+        auto s = make_lw_shared(schema({}, "ks", "cf",
+            {{"p1", utf8_type}}, {{"c1", int32_type}}, {{"r1", int32_type}}, {}, utf8_type));
+
+        auto key = partition_key::from_exploded(*s, {to_bytes("key1")});
+        mutation m(key, s);
+        m.set_clustered_cell(clustering_key::from_exploded(*s, {int32_type->decompose(1)}), "r1", data_value(1), api::new_timestamp());
+
+        auto mt = make_lw_shared<memtable>(s);
+        mt->apply(std::move(m));
+
+        auto sst = sstables::make_sstable(s,
+                dir->path,
+                1 /* generation */,
+                sstables::sstable::version_types::la,
+                sstables::sstable::format_types::big);
+        write_memtable_to_sstable(*mt, sst).get();
+        sst->load().get();
+
+        auto read = [&] {
+            auto sm = sst->read_row(s, sstables::key::from_partition_key(*s, key)).get0();
+            auto mut = mutation_from_streamed_mutation(std::move(sm)).get0();
+            BOOST_REQUIRE(bool(mut));
+        };
+
+        auto before = shared_index_lists::shard_stats();
+        read();
+        auto after_first = shared_index_lists::shard_stats();
+        BOOST_REQUIRE_EQUAL(after_first.cache_misses, before.cache_misses + 1);
+        BOOST_REQUIRE_EQUAL(after_first.cache_populations, before.cache_populations + 1);
+
+        // The page is no longer referenced by any reader, but is still cached.
+        read();
+        auto after_second = shared_index_lists::shard_stats();
+        BOOST_REQUIRE_EQUAL(after_second.cache_misses, after_first.cache_misses);
+        BOOST_REQUIRE_EQUAL(after_second.cache_hits, after_first.cache_hits + 1);
+
+        auto pages = after_second.cached_pages;
+        sst = {};
+        BOOST_REQUIRE_EQUAL(shared_index_lists::shard_stats().cached_pages, pages - 1);
+    });
+}
+
+SEASTAR_TEST_CASE(test_prefetched_index_page_is_cached) {
+    return seastar::async([] {
+        auto dir = make_lw_shared<tmpdir>();
+        auto s = make_lw_shared(schema({}, "ks", "cf",
+            {{"p1", utf8_type}}, {{"c1", int32_type}}, {{"r1", int32_type}}, {}, utf8_type));
+
+        auto key = partition_key::from_exploded(*s, {to_bytes("key1")});
+        mutation m(key, s);
+        m.set_clustered_cell(clustering_key::from_exploded(*s, {int32_type->decompose(1)}), "r1", data_value(1), api::new_timestamp());
+
+        auto mt = make_lw_shared<memtable>(s);
+        mt->apply(std::move(m));
+
+        auto sst = sstables::make_sstable(s,
+                dir->path,
+                1 /* generation */,
+                sstables::sstable::version_types::la,
+                sstables::sstable::format_types::big);
+        write_memtable_to_sstable(*mt, sst).get();
+        sst->load().get();
+
+        auto before = shared_index_lists::shard_stats();
+        sst->prefetch_index_page(dht::global_partitioner().decorate_key(*s, key), default_priority_class()).get();
+        auto after_prefetch = shared_index_lists::shard_stats();
+        BOOST_REQUIRE_EQUAL(after_prefetch.cache_misses, before.cache_misses + 1);
+        BOOST_REQUIRE_EQUAL(after_prefetch.cache_populations, before.cache_populations + 1);
+
+        auto sm = sst->read_row(s, sstables::key::from_partition_key(*s, key)).get0();
+        auto mut = mutation_from_streamed_mutation(std::move(sm)).get0();
+        BOOST_REQUIRE(bool(mut));
+        auto after_read = shared_index_lists::shard_stats();
+        BOOST_REQUIRE_EQUAL(after_read.cache_misses, after_prefetch.cache_misses);
+        BOOST_REQUIRE_EQUAL(after_read.cache_hits, after_prefetch.cache_hits + 1);
+
+        auto hot = sst->hot_index_page_keys(10);
+        BOOST_REQUIRE_EQUAL(hot.size(), 1);
+        BOOST_REQUIRE(hot[0]._key.equal(*s, key));
+    });
+}
+
 SEASTAR_TEST_CASE(compact_storage_sparse_read) {
     return reusable_sst(compact_sparse_schema(), "tests/sstables/compact_sparse", 1).then([] (auto sstp) {
         return do_with(sstables::key("first_row"), [sstp] (auto& key) {
@@ -852,3 +938,127 @@ SEASTAR_TEST_CASE(test_promoted_index_blocks_are_monotonic) {
         assert_that(sst->get_index_reader(default_priority_class())).has_monotonic_positions(*s);
     });
 }
+
+SEASTAR_TEST_CASE(test_sliced_read_skips_static_row_when_not_selected) {
+    return seastar::async([] {
+        auto dir = make_lw_shared<tmpdir>();
+        schema_builder builder("ks", "cf");
+        builder.with_column("p", utf8_type, column_kind::partition_key);
+        builder.with_column("c", int32_type, column_kind::clustering_key);
+        builder.with_column("s", int32_type, column_kind::static_column);
+        builder.with_column("v", int32_type);
+        auto s = builder.build();
+
+        auto pk = partition_key::from_exploded(*s, {to_bytes("key1")});
+        auto dk = dht::global_partitioner().decorate_key(*s, pk);
+        mutation m(pk, s);
+        m.set_static_cell(to_bytes("s"), data_value(7), 1);
+        for (int i = 0; i < 100; ++i) {
+            m.set_clustered_cell(clustering_key::from_exploded(*s, {int32_type->decompose(i)}), to_bytes("v"), data_value(i), 1);
+        }
+
+        auto mt = make_lw_shared<memtable>(s);
+        mt->apply(m);
+        auto sst = sstables::make_sstable(s,
+                                dir->path,
+                                1 /* generation */,
+                                sstables::sstable::version_types::ka,
+                                sstables::sstable::format_types::big);
+        sstable_writer_config cfg;
+        cfg.promoted_index_block_size = 1;
+        sst->write_components(mt->make_reader(s), 1, s, cfg).get();
+        sst->load().get();
+
+        auto range = query::clustering_range::make(
+            {clustering_key_prefix::from_single_value(*s, int32_type->decompose(50)), true},
+            {clustering_key_prefix::from_single_value(*s, int32_type->decompose(52)), true});
+        auto read = [&] (const query::partition_slice& slice) {
+            auto sm = sst->read_row(s, dk, slice).get0();
+            auto mut = mutation_from_streamed_mutation(std::move(sm)).get0();
+            BOOST_REQUIRE(bool(mut));
+            return std::move(*mut);
+        };
+
+        auto without_static = partition_slice_builder(*s)
+            .with_range(range)
+            .with_no_static_columns()
+            .build();
+        auto mut = read(without_static);
+        BOOST_REQUIRE(mut.partition().static_row().empty());
+        BOOST_REQUIRE_EQUAL(mut.partition().clustered_rows().calculate_size(), 3);
+
+        auto with_static = partition_slice_builder(*s)
+            .with_range(range)
+            .build();
+        mut = read(with_static);
+        BOOST_REQUIRE(!mut.partition().static_row().empty());
+        BOOST_REQUIRE_EQUAL(mut.partition().clustered_rows().calculate_size(), 3);
+
+        // A partition without rows may be returned for its static row.
+        auto full = partition_slice_builder(*s)
+            .with_no_static_columns()
+            .build();
+        mut = read(full);
+        BOOST_REQUIRE(!mut.partition().static_row().empty());
+    });
+}
+
+SEASTAR_TEST_CASE(test_promoted_index_lookup) {
+    return seastar::async([] {
+        auto dir = make_lw_shared<tmpdir>();
+        schema_builder builder("ks", "cf");
+        builder.with_column("p", utf8_type, column_kind::partition_key);
+        builder.with_column("c", int32_type, column_kind::clustering_key);
+        builder.with_column("v", int32_type);
+        auto s = builder.build();
+
+        auto pk = partition_key::from_exploded(*s, {to_bytes("key1")});
+        mutation m(pk, s);
+        std::vector<clustering_key> keys;
+        for (int i = 0; i < 200; ++i) {
+            keys.push_back(clustering_key::from_exploded(*s, {int32_type->decompose(i)}));
+            m.set_clustered_cell(keys.back(), to_bytes("v"), data_value(i), 1);
+        }
+
+        auto mt = make_lw_shared<memtable>(s);
+        mt->apply(m);
+        auto sst = sstables::make_sstable(s,
+                                dir->path,
+                                1 /* generation */,
+                                sstables::sstable::version_types::ka,
+                                sstables::sstable::format_types::big);
+        sstable_writer_config cfg;
+        cfg.promoted_index_block_size = 1;
+        sst->write_components(mt->make_reader(s), 1, s, cfg).get();
+        sst->load().get();
+
+        auto ir = sst->get_index_reader(default_priority_class());
+        ir->read_partition_data().get();
+        auto* pi = ir->current_partition_entry().get_promoted_index(*s);
+        BOOST_REQUIRE(pi);
+        BOOST_REQUIRE_GT(pi->size(), 2 * sstables::promoted_index::sample_interval);
+
+        auto less = [pos_cmp = position_in_partition::composite_less_compare(*s)] (position_in_partition_view pos, composite_view start) {
+            return pos_cmp(pos, start);
+        };
+        std::vector<sstables::promoted_index::entry> entries;
+        pi->for_each([&] (const sstables::promoted_index::entry& e) {
+            entries.push_back(e);
+        });
+        BOOST_REQUIRE_EQUAL(entries.size(), pi->size());
+        for (size_t i = 0; i < entries.size(); ++i) {
+            BOOST_REQUIRE_EQUAL((*pi)[i].offset, entries[i].offset);
+        }
+        for (auto&& ck : keys) {
+            auto pos = position_in_partition_view::for_key(ck);
+            for (size_t from : {size_t(0), size_t(17), entries.size() / 2, entries.size() - 1, entries.size()}) {
+                auto expected = from;
+                while (expected < entries.size() && !less(pos, entries[expected].start)) {
+                    ++expected;
+                }
+                BOOST_REQUIRE_EQUAL(pi->upper_bound(from, pos, less), expected);
+            }
+        }
+        ir->close().get();
+    });
+}
@@ -42,6 +42,7 @@
 #include "cell_locking.hh"
 #include "memtable-sstable.hh"
 #include "disk-error-handler.hh"
+#include "utils/murmur_hash.hh"
 
 thread_local disk_error_signal_type commit_error;
 thread_local disk_error_signal_type general_disk_error;
@@ -1251,6 +1252,57 @@ SEASTAR_TEST_CASE(promoted_index_write) {
     });
 }
 
+SEASTAR_TEST_CASE(test_adaptive_read_ahead_stream) {
+    return seastar::async([] {
+        tmpdir tmp;
+        auto file_path = tmp.path + "/test";
+        file f = open_file_dma(file_path, open_flags::create | open_flags::wo).get0();
+        auto size = 300 * 1024 + 123;
+        std::vector<char> data(size);
+        for (size_t i = 0; i < data.size(); ++i) {
+            data[i] = char(i * 7 + i / 4096);
+        }
+        auto out = make_file_output_stream(f);
+        out.write(data.data(), data.size()).get();
+        out.close().get();
+        f = open_file_dma(file_path, open_flags::ro).get0();
+
+        auto& pc = default_priority_class();
+        auto policies = {
+            sstables::read_ahead_policy{sstables::read_ahead_page_size, 128 * 1024, 4},
+            sstables::read_ahead_policy{sstables::read_ahead_page_size, 128 * 1024, 1},
+            sstables::read_ahead_policy{128 * 1024, 128 * 1024, 2},
+        };
+        for (auto policy : policies) {
+            for (uint64_t pos : {0, 1, 4095, 4096, 70001}) {
+                auto len = size - pos - 17;
+                auto in = sstables::make_adaptive_file_input_stream(f, pos, len, pc, policy);
+                auto buf = in.read_exactly(len).get0();
+                BOOST_REQUIRE_EQUAL(buf.size(), len);
+                BOOST_REQUIRE(std::equal(buf.begin(), buf.end(), data.begin() + pos));
+                BOOST_REQUIRE(in.read().get0().empty());
+                in.close().get();
+
+                // Skips within the buffers read ahead, and past them.
+                in = sstables::make_adaptive_file_input_stream(f, pos, len, pc, policy);
+                uint64_t at = pos;
+                for (uint64_t skip : {0, 10, 5000, 40000, 1, 150000}) {
+                    auto b = in.read_exactly(100).get0();
+                    BOOST_REQUIRE_EQUAL(b.size(), 100u);
+                    BOOST_REQUIRE(std::equal(b.begin(), b.end(), data.begin() + at));
+                    at += 100;
+                    if (at + skip + 100 > pos + len) {
+                        break;
+                    }
+                    in.skip(skip).get();
+                    at += skip;
+                }
+                in.close().get();
+            }
+        }
+    });
+}
+
 SEASTAR_TEST_CASE(test_skipping_in_compressed_stream) {
     return seastar::async([] {
         tmpdir tmp;
@@ -1329,3 +1381,77 @@ SEASTAR_TEST_CASE(test_skipping_in_compressed_stream) {
         expect_eof(in);
     });
 }
+
+SEASTAR_TEST_CASE(test_zstd_dictionary_compressed_stream) {
+    return seastar::async([] {
+        tmpdir tmp;
+        auto file_path = tmp.path + "/test";
+        file f = open_file_dma(file_path, open_flags::create | open_flags::wo).get0();
+
+        sstables::compression c;
+        c.set_compressor(compression_parameters({
+            {compression_parameters::SSTABLE_COMPRESSION, "ZstdCompressor"},
+            {compression_parameters::DICTIONARY_SIZE_KB, "4"},
+        }));
+        c.set_uncompressed_chunk_length(4096);
+        c.init_full_checksum();
+        BOOST_REQUIRE(c.dictionary_sample_size() > 0);
+
+        // Enough similar chunks to fill the training sample and then some.
+        std::vector<temporary_buffer<char>> chunks;
+        size_t uncompressed_size = 0;
+        for (unsigned i = 0; uncompressed_size < 2 * c.dictionary_sample_size(); ++i) {
+            temporary_buffer<char> buf(c.uncompressed_chunk_length());
+            for (size_t pos = 0; pos < buf.size(); ) {
+                auto s = sprint("{\"id\": %d, \"name\": \"user-%d\", \"tags\": [\"a%d\", \"b\"]}", pos + i, i % 17, pos % 13);
+                auto n = std::min(s.size(), buf.size() - pos);
+                std::copy_n(s.begin(), n, buf.get_write() + pos);
+                pos += n;
+            }
+            uncompressed_size += buf.size();
+            chunks.push_back(std::move(buf));
+        }
+
+        auto out = make_compressed_file_output_stream(f, file_output_stream_options(), &c);
+        for (auto&& buf : chunks) {
+            out.write(buf.get(), buf.size()).get();
+        }
+        out.close().get();
+        BOOST_REQUIRE_EQUAL(c.dictionary_sample_size(), 0);
+        BOOST_REQUIRE_EQUAL(c.uncompressed_file_length(), uncompressed_size);
+
+        // Decompress with the metadata as it would be loaded from CompressionInfo.
+        c.update(f.size().get0());
+
+        file_input_stream_options opts;
+        f = open_file_dma(file_path, open_flags::ro).get0();
+        auto in = make_compressed_file_input_stream(f, &c, 0, uncompressed_size, opts);
+        for (auto&& buf : chunks) {
+            auto b = in.read_exactly(buf.size()).get0();
+            BOOST_REQUIRE(b == buf);
+        }
+        BOOST_REQUIRE(in.read().get0().empty());
+        in.close().get();
+    });
+}
+
+SEASTAR_TEST_CASE(test_merging_cardinality_estimators) {
+    auto offer = [] (hll::HyperLogLog& hll, int from, int to) {
+        for (int i = from; i < to; ++i) {
+            hll.offer_hashed(utils::murmur_hash::hash2_64(to_bytes(sprint("key%d", i)), 0));
+        }
+    };
+    auto a = metadata_collector::hyperloglog(13, 25);
+    auto b = metadata_collector::hyperloglog(13, 25);
+    offer(a, 0, 10000);
+    offer(b, 5000, 15000);
+
+    auto a_read = hll::HyperLogLog::from_bytes(a.get_bytes());
+    BOOST_REQUIRE_EQUAL(a_read.precision(), 13);
+    BOOST_REQUIRE_EQUAL(a_read.estimate(), a.estimate());
+    BOOST_REQUIRE_LT(std::abs(a_read.estimate() - 10000), 500);
+
+    a_read.merge(hll::HyperLogLog::from_bytes(b.get_bytes()));
+    BOOST_REQUIRE_LT(std::abs(a_read.estimate() - 15000), 750);
+    return make_ready_future<>();
+}
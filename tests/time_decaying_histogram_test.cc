@@ -0,0 +1,76 @@
+/*
+ * Copyright (C) 2017 ScyllaDB
+ */
+
+/*
+ * This file is part of Scylla.
+ *
+ * Scylla is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Scylla is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#define BOOST_TEST_MODULE core
+
+#include <boost/test/unit_test.hpp>
+
+#include "utils/time_decaying_histogram.hh"
+
+using namespace std::chrono_literals;
+using histogram = utils::time_decaying_histogram<>;
+
+BOOST_AUTO_TEST_CASE(test_empty_histogram) {
+    auto now = histogram::clock::now();
+    histogram h(10s, now);
+    BOOST_REQUIRE_EQUAL(h.count(now), 0);
+    BOOST_REQUIRE(h.percentile(0.99, now) == 0us);
+}
+
+BOOST_AUTO_TEST_CASE(test_percentiles_are_within_a_bucket) {
+    auto now = histogram::clock::now();
+    histogram h(10s, now);
+    for (int i = 1; i <= 100; ++i) {
+        h.add(std::chrono::milliseconds(i), now);
+    }
+    BOOST_REQUIRE_EQUAL(h.count(now), 100);
+    auto p50 = h.percentile(0.5, now);
+    BOOST_REQUIRE(p50 >= 50ms && p50 <= 60ms);
+    auto p99 = h.percentile(0.99, now);
+    BOOST_REQUIRE(p99 >= 99ms && p99 <= 119ms);
+}
+
+BOOST_AUTO_TEST_CASE(test_samples_decay) {
+    auto now = histogram::clock::now();
+    histogram h(10s, now);
+    for (int i = 0; i < 100; ++i) {
+        h.add(1ms, now);
+    }
+    BOOST_REQUIRE_CLOSE(h.count(now + 10s), 50, 0.01);
+    BOOST_REQUIRE_CLOSE(h.count(now + 20s), 25, 0.01);
+}
+
+BOOST_AUTO_TEST_CASE(test_percentile_follows_new_latencies) {
+    auto now = histogram::clock::now();
+    histogram h(1s, now);
+    for (int i = 0; i < 1000; ++i) {
+        h.add(1ms, now);
+    }
+    BOOST_REQUIRE(h.percentile(0.9, now) < 2ms);
+
+    // A hundred slow reads, after a few half-lives, outweigh many fast ones.
+    now += 5s;
+    for (int i = 0; i < 100; ++i) {
+        h.add(100ms, now);
+    }
+    BOOST_REQUIRE(h.percentile(0.9, now) >= 100ms);
+}
@@ -0,0 +1,74 @@
+/*
+ * Copyright (C) 2017 ScyllaDB
+ */
+
+/*
+ * This file is part of Scylla.
+ *
+ * Scylla is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Scylla is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#define BOOST_TEST_MODULE core
+
+#include <boost/test/unit_test.hpp>
+#include <chrono>
+
+#include "utils/token_bucket.hh"
+
+using namespace std::chrono_literals;
+using bucket = utils::token_bucket<>;
+
+BOOST_AUTO_TEST_CASE(test_unlimited_bucket_never_waits) {
+    auto now = bucket::clock::now();
+    bucket b(0, now);
+    BOOST_REQUIRE(b.take(1000000000, now) == bucket::duration(0));
+    BOOST_REQUIRE(b.take(1000000000, now) == bucket::duration(0));
+}
+
+BOOST_AUTO_TEST_CASE(test_takes_are_spaced_at_the_rate) {
+    auto now = bucket::clock::now();
+    bucket b(1000, now);
+    // The initial burst is one second worth of tokens.
+    BOOST_REQUIRE(b.take(1000, now) == bucket::duration(0));
+    BOOST_REQUIRE(b.take(500, now) == std::chrono::duration_cast<bucket::duration>(500ms));
+    BOOST_REQUIRE(b.take(500, now) == std::chrono::duration_cast<bucket::duration>(1s));
+    // The debt is paid back as time passes.
+    BOOST_REQUIRE(b.take(1000, now + 1s) == std::chrono::duration_cast<bucket::duration>(1s));
+    BOOST_REQUIRE(b.take(0, now + 3s) == bucket::duration(0));
+}
+
+BOOST_AUTO_TEST_CASE(test_burst_is_bounded) {
+    auto now = bucket::clock::now();
+    bucket b(1000, now);
+    BOOST_REQUIRE(b.take(1000, now) == bucket::duration(0));
+    // Idling for long doesn't allow more than one second worth of tokens.
+    BOOST_REQUIRE(b.take(1000, now + 1h) == bucket::duration(0));
+    BOOST_REQUIRE(b.take(1000, now + 1h) == std::chrono::duration_cast<bucket::duration>(1s));
+}
+
+BOOST_AUTO_TEST_CASE(test_rate_change) {
+    auto now = bucket::clock::now();
+    bucket b(1000, now);
+    BOOST_REQUIRE(b.take(2000, now) == std::chrono::duration_cast<bucket::duration>(1s));
+    // The debt is kept, and paid back at the new rate.
+    b.set_rate(2000, now);
+    BOOST_REQUIRE_EQUAL(b.rate(), 2000);
+    BOOST_REQUIRE(b.take(1000, now) == std::chrono::duration_cast<bucket::duration>(1s));
+    // No more than the new burst is kept when the rate drops.
+    b.set_rate(100, now + 1h);
+    BOOST_REQUIRE(b.take(200, now + 1h) == std::chrono::duration_cast<bucket::duration>(1s));
+    b.set_rate(0, now + 1h);
+    BOOST_REQUIRE(b.take(1000000, now + 1h) == bucket::duration(0));
+}
@@ -0,0 +1,99 @@
+/*
+ * Copyright (C) 2017 ScyllaDB
+ */
+
+/*
+ * This file is part of Scylla.
+ *
+ * Scylla is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Scylla is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#define BOOST_TEST_MODULE core
+
+#include <boost/test/unit_test.hpp>
+#include <string>
+
+#include "utils/top_k.hh"
+
+using top_k = utils::space_saving_top_k<std::string>;
+
+BOOST_AUTO_TEST_CASE(test_counts_are_exact_within_capacity) {
+    top_k t(4);
+    for (int i = 0; i < 3; ++i) {
+        t.append("a");
+    }
+    t.append("b");
+    t.append("c", 5);
+
+    auto top = t.top(10);
+    BOOST_REQUIRE_EQUAL(top.size(), 3);
+    BOOST_REQUIRE_EQUAL(top[0].item, "c");
+    BOOST_REQUIRE_EQUAL(top[0].count, 5);
+    BOOST_REQUIRE_EQUAL(top[1].item, "a");
+    BOOST_REQUIRE_EQUAL(top[1].count, 3);
+    BOOST_REQUIRE_EQUAL(top[2].item, "b");
+    BOOST_REQUIRE_EQUAL(top[2].count, 1);
+    for (auto&& r : top) {
+        BOOST_REQUIRE_EQUAL(r.error, 0);
+    }
+
+    BOOST_REQUIRE_EQUAL(t.top(1).size(), 1);
+}
+
+BOOST_AUTO_TEST_CASE(test_frequent_items_survive_eviction) {
+    top_k t(8);
+    for (int i = 0; i < 1000; ++i) {
+        t.append("hot");
+        t.append(std::to_string(i));
+    }
+    BOOST_REQUIRE_EQUAL(t.size(), 8);
+
+    auto top = t.top(1);
+    BOOST_REQUIRE_EQUAL(top[0].item, "hot");
+    BOOST_REQUIRE_GE(top[0].count, 1000);
+    BOOST_REQUIRE_LE(top[0].count - top[0].error, 1000);
+
+    // The replaced items start from the count of the evicted one.
+    for (auto&& r : t.top(8)) {
+        if (r.item != "hot") {
+            BOOST_REQUIRE_EQUAL(r.count, r.error + 1);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_merge) {
+    top_k a(4);
+    top_k b(4);
+    a.append("x", 10);
+    a.append("y", 2);
+    b.append("x", 5);
+    b.append("z", 7);
+
+    top_k merged(8);
+    merged.merge(a);
+    merged.merge(b);
+
+    auto top = merged.top(3);
+    BOOST_REQUIRE_EQUAL(top.size(), 3);
+    BOOST_REQUIRE_EQUAL(top[0].item, "x");
+    BOOST_REQUIRE_EQUAL(top[0].count, 15);
+    BOOST_REQUIRE_EQUAL(top[1].item, "z");
+    BOOST_REQUIRE_EQUAL(top[1].count, 7);
+    BOOST_REQUIRE_EQUAL(top[2].item, "y");
+
+    merged.clear();
+    BOOST_REQUIRE_EQUAL(merged.size(), 0);
+    BOOST_REQUIRE(merged.top(1).empty());
+}
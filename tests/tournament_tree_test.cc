@@ -0,0 +1,89 @@
+/*
+ * Copyright (C) 2017 ScyllaDB
+ */
+
+/*
+ * This file is part of Scylla.
+ *
+ * Scylla is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Scylla is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#define BOOST_TEST_MODULE core
+
+#include <boost/test/unit_test.hpp>
+#include <memory>
+#include <queue>
+#include <random>
+
+#include "utils/tournament_tree.hh"
+
+struct int_ptr_less {
+    bool operator()(const std::unique_ptr<int>& a, const std::unique_ptr<int>& b) const {
+        return *a < *b;
+    }
+};
+
+using tree = utils::tournament_tree<std::unique_ptr<int>, int_ptr_less>;
+
+BOOST_AUTO_TEST_CASE(test_pops_in_order) {
+    tree t;
+    BOOST_REQUIRE(t.empty());
+    for (int v : { 5, 3, 8, 1, 9, 2, 7 }) {
+        t.push(std::make_unique<int>(v));
+    }
+    BOOST_REQUIRE_EQUAL(t.size(), 7);
+    for (int v : { 1, 2, 3, 5, 7, 8, 9 }) {
+        BOOST_REQUIRE(!t.empty());
+        BOOST_REQUIRE_EQUAL(*t.top(), v);
+        t.pop();
+    }
+    BOOST_REQUIRE(t.empty());
+}
+
+BOOST_AUTO_TEST_CASE(test_interleaved_pushes_and_pops_match_a_heap) {
+    std::default_random_engine rnd(0);
+    std::uniform_int_distribution<int> value(0, 100);
+    std::uniform_int_distribution<int> action(0, 2);
+    tree t;
+    std::priority_queue<int, std::vector<int>, std::greater<int>> expected;
+    for (int i = 0; i < 10000; ++i) {
+        if (expected.empty() || action(rnd)) {
+            auto v = value(rnd);
+            t.push(std::make_unique<int>(v));
+            expected.push(v);
+        } else {
+            BOOST_REQUIRE_EQUAL(*t.top(), expected.top());
+            t.pop();
+            expected.pop();
+        }
+        BOOST_REQUIRE_EQUAL(t.size(), expected.size());
+    }
+    while (!expected.empty()) {
+        BOOST_REQUIRE_EQUAL(*t.top(), expected.top());
+        t.pop();
+        expected.pop();
+    }
+    BOOST_REQUIRE(t.empty());
+}
+
+BOOST_AUTO_TEST_CASE(test_clear) {
+    tree t;
+    t.push(std::make_unique<int>(1));
+    t.push(std::make_unique<int>(2));
+    t.clear();
+    BOOST_REQUIRE(t.empty());
+    t.push(std::make_unique<int>(3));
+    BOOST_REQUIRE_EQUAL(*t.top(), 3);
+}
@@ -842,3 +842,128 @@ SEASTAR_TEST_CASE(test_simple_type_compatibility) {
     }
     return make_ready_future<>();
 }
+
+static bytes serialize_comparable(const abstract_type& type, bytes_view v) {
+    bytes_ostream out;
+    type.serialize_comparable(v, out);
+    return to_bytes(out.linearize());
+}
+
+static int sign(int c) {
+    return c < 0 ? -1 : c > 0 ? 1 : 0;
+}
+
+// values don't need to be sorted, they are compared with each other.
+// Also checks that component_tri_compare agrees with the type.
+static void verify_byte_comparable(data_type type, const std::vector<bytes>& values) {
+    BOOST_REQUIRE(type->is_byte_comparable());
+    component_tri_compare cmp(type);
+    for (auto&& a : values) {
+        for (auto&& b : values) {
+            auto expected = sign(type->compare(a, b));
+            BOOST_REQUIRE_EQUAL(sign(cmp(a, b)), expected);
+            auto actual = sign(compare_unsigned(serialize_comparable(*type, a), serialize_comparable(*type, b)));
+            BOOST_REQUIRE_MESSAGE(expected == actual, sprint("%s: %s vs %s compares %d, its byte comparable form %d",
+                type->name(), to_hex(a), to_hex(b), expected, actual));
+        }
+    }
+}
+
+template <typename Type>
+static std::vector<bytes> from_strings(const Type& type, std::vector<sstring> strings) {
+    return boost::copy_range<std::vector<bytes>>(strings | boost::adaptors::transformed([&] (const sstring& s) {
+        return type->from_string(s);
+    }));
+}
+
+BOOST_AUTO_TEST_CASE(test_byte_comparable_forms) {
+    verify_byte_comparable(byte_type, from_strings(byte_type, { "", "-128", "-1", "0", "1", "127" }));
+    verify_byte_comparable(short_type, from_strings(short_type, { "", "-32768", "-256", "-1", "0", "1", "255", "256", "32767" }));
+    auto ints = from_strings(int32_type, { "", "-2147483648", "-65536", "-1", "0", "1", "255", "65536", "2147483647" });
+    verify_byte_comparable(int32_type, ints);
+    verify_byte_comparable(reversed_type_impl::get_instance(int32_type), ints);
+    verify_byte_comparable(long_type, from_strings(long_type, { "", "-9223372036854775808", "-1", "0", "1", "4294967296", "9223372036854775807" }));
+    verify_byte_comparable(boolean_type, from_strings(boolean_type, { "", "false", "true" }));
+    verify_byte_comparable(timestamp_type, { bytes(),
+        timestamp_type->decompose(db_clock::time_point(db_clock::duration(-1000))),
+        timestamp_type->decompose(db_clock::time_point(db_clock::duration(0))),
+        timestamp_type->decompose(db_clock::time_point(db_clock::duration(1000))) });
+    verify_byte_comparable(simple_date_type, from_strings(simple_date_type, { "", "-5877641-06-23", "1969-12-31", "1970-01-01", "5881580-07-11" }));
+    verify_byte_comparable(time_type, from_strings(time_type, { "", "00:00:00", "00:00:00.000000001", "12:34:56", "23:59:59.999999999" }));
+
+    auto strings = std::vector<bytes>{ bytes(), to_bytes("a"), to_bytes(sstring("a\0", 2)), to_bytes(sstring("a\0b", 3)),
+        to_bytes("ab"), to_bytes("b"), to_bytes(sstring("\0", 1)), to_bytes(sstring("\0\0", 2)) };
+    verify_byte_comparable(utf8_type, strings);
+    verify_byte_comparable(ascii_type, strings);
+    verify_byte_comparable(reversed_type_impl::get_instance(utf8_type), strings);
+    verify_byte_comparable(bytes_type, from_strings(bytes_type, { "", "00", "0000", "00ff", "01", "7f", "80", "ff", "ff00" }));
+    verify_byte_comparable(inet_addr_type, from_strings(inet_addr_type, { "", "0.0.0.0", "10.0.0.1", "127.0.0.1", "255.255.255.255" }));
+
+    for (auto&& type : { float_type, double_type }) {
+        auto value = [&] (double d) {
+            return type == float_type ? float_type->decompose(float(d)) : double_type->decompose(d);
+        };
+        auto inf = std::numeric_limits<double>::infinity();
+        verify_byte_comparable(type, { bytes(), value(-inf), value(-1e30), value(-1.5), value(-1e-30), value(-0.0), value(0.0),
+            value(1e-30), value(1), value(1.5), value(1e30), value(inf), value(std::numeric_limits<double>::quiet_NaN()) });
+    }
+
+    verify_byte_comparable(uuid_type, from_strings(uuid_type, { "",
+        "d2177dd0-eaa2-11de-a572-001b779c76e3", "d2177dd0-eaa2-11de-a572-001b779c76e4", "00000000-eaa2-11df-0000-000000000000",
+        "ffffffff-ffff-1000-0000-000000000000", "6ba7b810-9dad-41d1-80b4-00c04fd430c8", "6ba7b810-9dad-41d1-80b4-00c04fd430c9",
+        "00000000-0000-4000-0000-000000000000" }));
+    verify_byte_comparable(timeuuid_type, from_strings(timeuuid_type, { "",
+        "d2177dd0-eaa2-11de-a572-001b779c76e3", "d2177dd0-eaa2-11de-0572-001b779c76e3", "d2177dd0-eaa2-11de-f572-001b779c76e3",
+        "d2177dd1-eaa2-11de-a572-001b779c76e3", "d2177dd0-eaa3-11de-a572-001b779c76e3", "d2177dd0-eaa2-11df-a572-001b779c76e3",
+        "00000000-0000-1000-8000-000000000000" }));
+
+    auto varints = from_strings(varint_type, { "", "-100000000000000000000", "-65536", "-256", "-255", "-128", "-1", "0", "1",
+        "127", "128", "255", "256", "65535", "100000000000000000000" });
+    // Not the shortest representation of 1.
+    varints.push_back(bytes({ int8_t(0), int8_t(1) }));
+    verify_byte_comparable(varint_type, varints);
+    verify_byte_comparable(decimal_type, from_strings(decimal_type, { "", "-1000", "-10.5", "-1.00", "-1", "-0.01", "-0.001", "0", "0.00",
+        "0.001", "0.01", "0.1", "0.10", "0.11", "1", "1.0", "1.01", "1.1", "9.99", "10", "100", "100.0" }));
+
+    BOOST_REQUIRE(!duration_type->is_byte_comparable());
+    BOOST_REQUIRE(!counter_type->is_byte_comparable());
+}
+
+BOOST_AUTO_TEST_CASE(test_byte_comparable_compound) {
+    compound_type<allow_prefixes::yes> t({ int32_type, reversed_type_impl::get_instance(utf8_type), empty_type });
+    BOOST_REQUIRE(t.is_byte_comparable());
+    auto i = [] (int32_t v) { return int32_type->decompose(v); };
+    std::vector<bytes> values = {
+        t.serialize_value(std::vector<bytes>{}),
+        t.serialize_value(std::vector<bytes>{ i(-1) }),
+        t.serialize_value(std::vector<bytes>{ i(1) }),
+        t.serialize_value(std::vector<bytes>{ i(1), to_bytes("a") }),
+        t.serialize_value(std::vector<bytes>{ i(1), to_bytes("ab") }),
+        t.serialize_value(std::vector<bytes>{ i(1), to_bytes("b") }),
+        t.serialize_value(std::vector<bytes>{ i(1), to_bytes("b"), bytes() }),
+        t.serialize_value(std::vector<bytes>{ i(2), to_bytes("a"), bytes() }),
+    };
+    for (auto&& a : values) {
+        for (auto&& b : values) {
+            BOOST_REQUIRE_EQUAL(sign(t.compare(a, b)), sign(compare_unsigned(t.serialize_comparable(a), t.serialize_comparable(b))));
+        }
+    }
+    compound_type<allow_prefixes::no> with_duration({ int32_type, duration_type });
+    BOOST_REQUIRE(!with_duration.is_byte_comparable());
+}
+
+BOOST_AUTO_TEST_CASE(test_inline_comparison_kinds) {
+    using kind = abstract_type::comparison_kind;
+    for (auto&& type : { byte_type, short_type, int32_type, long_type, timestamp_type, time_type }) {
+        BOOST_REQUIRE(type->comparison() == kind::signed_integer);
+    }
+    for (auto&& type : { utf8_type, ascii_type, bytes_type, inet_addr_type, simple_date_type, date_type }) {
+        BOOST_REQUIRE(type->comparison() == kind::bytes);
+    }
+    BOOST_REQUIRE(timeuuid_type->comparison() == kind::timeuuid);
+    // Reversed types are compared by the comparators of their underlying type.
+    BOOST_REQUIRE(reversed_type_impl::get_instance(int32_type)->comparison() == kind::generic);
+    for (auto&& type : { double_type, decimal_type, uuid_type, boolean_type }) {
+        BOOST_REQUIRE(type->comparison() == kind::generic);
+    }
+}
@@ -34,6 +34,7 @@
 
 #include "db/size_estimates_virtual_reader.hh"
 #include "core/future-util.hh"
+#include "core/thread.hh"
 #include "cql3/query_processor.hh"
 #include "cql3/untyped_result_set.hh"
 #include "transport/messages/result_message.hh"
@@ -220,3 +221,28 @@ SEASTAR_TEST_CASE(test_query_virtual_table) {
         }).discard_result();
     });
 }
+
+SEASTAR_TEST_CASE(test_size_estimates_are_kept_until_the_sstables_change) {
+    return do_with_cql_env([] (auto& e) {
+        return seastar::async([&e] {
+            e.execute_cql("create table cf(pk text PRIMARY KEY, v int);").get();
+            auto& cf = e.local_db().find_column_family("ks", "cf");
+            auto& qp = e.local_qp();
+
+            qp.execute_internal("select * from system.size_estimates where keyspace_name = 'ks';").get();
+            BOOST_REQUIRE_EQUAL(cf.get_size_estimates_cache().size(), 256);
+
+            e.execute_cql("insert into cf (pk, v) values ('key', 1);").get();
+            cf.flush().get();
+            BOOST_REQUIRE(cf.get_size_estimates_cache().empty());
+
+            auto rs = qp.execute_internal("select * from system.size_estimates where keyspace_name = 'ks';").get0();
+            int64_t partitions = 0;
+            for (auto&& row : *rs) {
+                partitions += row.template get_as<int64_t>("partitions_count");
+            }
+            BOOST_REQUIRE_GE(partitions, 1);
+            BOOST_REQUIRE_EQUAL(cf.get_size_estimates_cache().size(), 256);
+        });
+    });
+}
@@ -52,6 +52,7 @@
 #include <boost/range/adaptor/indirected.hpp>
 #include "query-result-reader.hh"
 #include "thrift/server.hh"
+#include <unordered_set>
 
 using namespace ::apache::thrift;
 using namespace ::apache::thrift::protocol;
@@ -1485,9 +1486,16 @@ class thrift_handler : public CassandraCobSvIf {
         }
         return ret;
     }
+    // A key given more than once is read once: the partition would be read
+    // again, and its columns returned twice.
     static dht::partition_range_vector make_partition_ranges(const schema& s, const std::vector<std::string>& keys) {
         dht::partition_range_vector ranges;
+        ranges.reserve(keys.size());
+        std::unordered_set<std::string> seen;
         for (auto&& key : keys) {
+            if (keys.size() > 1 && !seen.insert(key).second) {
+                continue;
+            }
             auto pk = key_from_thrift(s, to_bytes_view(key));
             auto dk = dht::global_partitioner().decorate_key(s, pk);
             ranges.emplace_back(dht::partition_range::make_singular(std::move(dk)));
@@ -0,0 +1,376 @@
+/*
+ * Copyright (C) 2018 ScyllaDB
+ */
+
+/*
+ * This file is part of Scylla.
+ *
+ * Scylla is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Scylla is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Scans sstables offline and reports on their partitions: sizes, rows,
+// tombstones and the largest ones, optionally dumping the statistics of each
+// partition as JSON lines.
+//
+// Each sstable is split between the shards by its summary, so every shard
+// reads, decompresses and parses its own range of the data file, starting at
+// a partition boundary found through the index. Run it with as many shards
+// as the disk can keep busy.
+//
+// The sstables don't record the schema, so the types of the key columns
+// must be given, as in the schema tables, e.g. Int32Type or
+// org.apache.cassandra.db.marshal.UTF8Type. Regular columns not given are
+// skipped, along with their cell tombstones.
+
+#include <core/app-template.hh>
+#include <core/bitops.hh>
+#include <core/distributed.hh>
+#include <core/fstream.hh>
+#include <core/reactor.hh>
+#include <core/thread.hh>
+#include <boost/algorithm/string/split.hpp>
+#include <boost/algorithm/string/classification.hpp>
+#include <boost/iterator/counting_iterator.hpp>
+#include <iomanip>
+
+#include "sstables/sstables.hh"
+#include "sstables/index_reader.hh"
+#include "schema_builder.hh"
+#include "db/marshal/type_parser.hh"
+#include "disk-error-handler.hh"
+
+thread_local disk_error_signal_type commit_error;
+thread_local disk_error_signal_type general_disk_error;
+
+using namespace sstables;
+
+struct partition_stats {
+    sstring key;
+    // Uncompressed, as found in the index.
+    uint64_t size = 0;
+    uint64_t rows = 0;
+    bool partition_tombstone = false;
+    uint64_t range_tombstones = 0;
+    uint64_t row_tombstones = 0;
+    uint64_t cell_tombstones = 0;
+
+    uint64_t tombstones() const {
+        return partition_tombstone + range_tombstones + row_tombstones + cell_tombstones;
+    }
+};
+
+struct scan_stats {
+    uint64_t partitions = 0;
+    uint64_t rows = 0;
+    uint64_t bytes = 0;
+    uint64_t partition_tombstones = 0;
+    uint64_t range_tombstones = 0;
+    uint64_t row_tombstones = 0;
+    uint64_t cell_tombstones = 0;
+    // The number of partitions with no tombstones in bucket 0, and with
+    // [2^(i-1), 2^i) of them in bucket i.
+    std::array<uint64_t, 65> tombstone_histogram{};
+    // The largest partitions, as a min-heap by size.
+    std::vector<partition_stats> largest;
+
+    static bool larger(const partition_stats& a, const partition_stats& b) {
+        return a.size > b.size;
+    }
+
+    void add_largest(partition_stats ps, size_t top) {
+        if (largest.size() < top) {
+            largest.push_back(std::move(ps));
+            std::push_heap(largest.begin(), largest.end(), larger);
+        } else if (top && ps.size > largest.front().size) {
+            std::pop_heap(largest.begin(), largest.end(), larger);
+            largest.back() = std::move(ps);
+            std::push_heap(largest.begin(), largest.end(), larger);
+        }
+    }
+
+    void add(partition_stats ps, size_t top) {
+        partitions++;
+        rows += ps.rows;
+        bytes += ps.size;
+        partition_tombstones += ps.partition_tombstone;
+        range_tombstones += ps.range_tombstones;
+        row_tombstones += ps.row_tombstones;
+        cell_tombstones += ps.cell_tombstones;
+        auto t = ps.tombstones();
+        tombstone_histogram[t ? 64 - count_leading_zeros(t) : 0]++;
+        add_largest(std::move(ps), top);
+    }
+
+    void merge(scan_stats o, size_t top) {
+        partitions += o.partitions;
+        rows += o.rows;
+        bytes += o.bytes;
+        partition_tombstones += o.partition_tombstones;
+        range_tombstones += o.range_tombstones;
+        row_tombstones += o.row_tombstones;
+        cell_tombstones += o.cell_tombstones;
+        for (size_t i = 0; i < tombstone_histogram.size(); i++) {
+            tombstone_histogram[i] += o.tombstone_histogram[i];
+        }
+        for (auto&& ps : o.largest) {
+            add_largest(std::move(ps), top);
+        }
+    }
+};
+
+static sstring json_escape(const sstring& s) {
+    std::ostringstream out;
+    for (auto c : s) {
+        if (c == '"' || c == '\\') {
+            out << '\\' << c;
+        } else if (uint8_t(c) < 0x20) {
+            out << "\\u" << std::hex << std::setw(4) << std::setfill('0') << unsigned(uint8_t(c)) << std::dec;
+        } else {
+            out << c;
+        }
+    }
+    return out.str();
+}
+
+static sstring to_json(const partition_stats& ps) {
+    return sprint("{\"key\": \"%s\", \"size\": %d, \"rows\": %d, \"partition_tombstone\": %s, "
+                  "\"range_tombstones\": %d, \"row_tombstones\": %d, \"cell_tombstones\": %d}\n",
+                  json_escape(ps.key), ps.size, ps.rows, ps.partition_tombstone ? "true" : "false",
+                  ps.range_tombstones, ps.row_tombstones, ps.cell_tombstones);
+}
+
+static sstring key_to_string(const schema& s, const partition_key& pk) {
+    sstring ret;
+    auto components = pk.explode(s);
+    auto& columns = s.partition_key_columns();
+    auto column = columns.begin();
+    for (auto&& c : components) {
+        if (!ret.empty()) {
+            ret += ":";
+        }
+        ret += column->type->to_string(c);
+        ++column;
+    }
+    return ret;
+}
+
+static uint64_t cell_tombstones(const schema& s, column_kind kind, const row& cells) {
+    uint64_t n = 0;
+    cells.for_each_cell([&] (column_id id, const atomic_cell_or_collection& c) {
+        auto& cdef = s.column_at(kind, id);
+        if (cdef.is_atomic()) {
+            n += !c.as_atomic_cell().is_live();
+        } else {
+            auto mut = collection_type_impl::deserialize_mutation_form(c.as_collection_mutation());
+            n += bool(mut.tomb);
+            for (auto&& cell : mut.cells) {
+                n += !cell.second.is_live();
+            }
+        }
+    });
+    return n;
+}
+
+// The range of the sstable this shard scans: the partitions between two
+// summary entries, so that it starts at a partition boundary.
+static stdx::optional<dht::partition_range> shard_range(const schema& s, const sstable& sst) {
+    auto& entries = sst.get_summary().entries;
+    auto n = entries.size();
+    auto shard = engine().cpu_id();
+    auto first = shard * n / smp::count;
+    auto last = (shard + 1) * n / smp::count;
+    if (first == last && n) {
+        return { };
+    }
+    auto bound = [&] (size_t i, bool inclusive) {
+        auto dk = dht::global_partitioner().decorate_key(s, key::from_bytes(entries[i].key).to_partition_key(s));
+        return dht::partition_range::bound(dht::ring_position(std::move(dk)), inclusive);
+    };
+    stdx::optional<dht::partition_range::bound> start;
+    stdx::optional<dht::partition_range::bound> end;
+    if (shard > 0 && n) {
+        start = bound(first, true);
+    } else if (shard > 0) {
+        return { };
+    }
+    if (shard + 1 < smp::count && n) {
+        end = bound(last, false);
+    }
+    return dht::partition_range(std::move(start), std::move(end));
+}
+
+static scan_stats scan_shard(schema_ptr s, sstring dir, entry_descriptor desc, size_t top, sstring json_prefix) {
+    scan_stats stats;
+    auto sst = make_sstable(s, dir, desc.generation, desc.version, desc.format);
+    sst->load().get();
+    auto range = shard_range(*s, *sst);
+    if (!range) {
+        return stats;
+    }
+
+    stdx::optional<output_stream<char>> json;
+    if (!json_prefix.empty()) {
+        auto name = sprint("%s-%d.%d.json", json_prefix, desc.generation, engine().cpu_id());
+        auto f = open_file_dma(name, open_flags::wo | open_flags::create | open_flags::truncate).get0();
+        json = make_file_output_stream(std::move(f));
+    }
+
+    // Sizes come from the index, walked along with the data.
+    auto index = sst->get_index_reader(default_priority_class());
+    index->advance_to_start(*range).get();
+    auto reader = sst->read_range_rows(s, *range);
+    while (auto sm = reader.read().get0()) {
+        partition_stats ps;
+        ps.key = key_to_string(*s, sm->key());
+        auto pos = index->data_file_position();
+        index->advance_to_next_partition().get();
+        ps.size = index->data_file_position() - pos;
+        ps.partition_tombstone = bool(sm->partition_tombstone());
+        while (auto mf = (*sm)().get0()) {
+            if (mf->is_clustering_row()) {
+                auto& cr = mf->as_clustering_row();
+                ps.rows++;
+                ps.row_tombstones += bool(cr.tomb());
+                ps.cell_tombstones += cell_tombstones(*s, column_kind::regular_column, cr.cells());
+            } else if (mf->is_static_row()) {
+                ps.cell_tombstones += cell_tombstones(*s, column_kind::static_column, mf->as_static_row().cells());
+            } else if (mf->is_range_tombstone()) {
+                ps.range_tombstones++;
+            }
+        }
+        if (json) {
+            auto line = to_json(ps);
+            json->write(line.data(), line.size()).get();
+        }
+        stats.add(std::move(ps), top);
+    }
+    index->close().get();
+    if (json) {
+        json->flush().get();
+        json->close().get();
+    }
+    return stats;
+}
+
+static schema_ptr make_schema(const boost::program_options::variables_map& cfg) {
+    auto split = [] (const sstring& s) {
+        std::vector<sstring> ret;
+        if (!s.empty()) {
+            boost::split(ret, s, boost::is_any_of(","));
+        }
+        return ret;
+    };
+    schema_builder builder(cfg["keyspace"].as<sstring>(), cfg["table"].as<sstring>());
+    auto pk = split(cfg["partition-key"].as<sstring>());
+    for (size_t i = 0; i < pk.size(); i++) {
+        builder.with_column(to_bytes(sprint("pk%d", i)), db::marshal::type_parser::parse(pk[i]), column_kind::partition_key);
+    }
+    auto ck = split(cfg["clustering-key"].as<sstring>());
+    for (size_t i = 0; i < ck.size(); i++) {
+        builder.with_column(to_bytes(sprint("ck%d", i)), db::marshal::type_parser::parse(ck[i]), column_kind::clustering_key);
+    }
+    for (auto&& column : split(cfg["columns"].as<sstring>())) {
+        auto kind = column_kind::regular_column;
+        if (column.find("static ") == 0) {
+            kind = column_kind::static_column;
+            column = column.substr(7);
+        }
+        auto colon = column.find(':');
+        if (colon == sstring::npos) {
+            throw std::invalid_argument(sprint("Column %s should be given as name:type", column));
+        }
+        builder.with_column(to_bytes(column.substr(0, colon)), db::marshal::type_parser::parse(column.substr(colon + 1)), kind);
+    }
+    if (cfg.count("compact-storage")) {
+        builder.with(schema_builder::compact_storage::yes);
+    }
+    return builder.build();
+}
+
+static void print(const sstring& name, const scan_stats& stats) {
+    std::cout << name << ":\n"
+              << "  partitions: " << stats.partitions << "\n"
+              << "  rows: " << stats.rows << "\n"
+              << "  uncompressed bytes: " << stats.bytes << "\n"
+              << "  tombstones: partition " << stats.partition_tombstones
+              << ", range " << stats.range_tombstones
+              << ", row " << stats.row_tombstones
+              << ", cell " << stats.cell_tombstones << "\n"
+              << "  partitions by tombstones:\n";
+    for (size_t i = 0; i < stats.tombstone_histogram.size(); i++) {
+        if (!stats.tombstone_histogram[i]) {
+            continue;
+        }
+        if (i == 0) {
+            std::cout << "    0: ";
+        } else {
+            std::cout << "    [" << (uint64_t(1) << (i - 1)) << ", " << ((uint64_t(1) << (i - 1)) * 2) << "): ";
+        }
+        std::cout << stats.tombstone_histogram[i] << "\n";
+    }
+    auto largest = stats.largest;
+    std::sort(largest.begin(), largest.end(), scan_stats::larger);
+    std::cout << "  largest partitions:\n";
+    for (auto&& ps : largest) {
+        std::cout << "    " << ps.key << ": " << ps.size << " bytes, " << ps.rows << " rows, " << ps.tombstones() << " tombstones\n";
+    }
+}
+
+int main(int argc, char** argv) {
+    namespace bpo = boost::program_options;
+    app_template app;
+    app.add_options()
+        ("sstable", bpo::value<std::vector<sstring>>()->required(), "Data.db file of an sstable to scan; may be repeated")
+        ("keyspace", bpo::value<sstring>()->default_value("ks"), "keyspace of the sstables, if not in their names")
+        ("table", bpo::value<sstring>()->default_value("cf"), "table of the sstables, if not in their names")
+        ("partition-key", bpo::value<sstring>()->default_value("BytesType"), "comma-separated types of the partition key columns")
+        ("clustering-key", bpo::value<sstring>()->default_value(""), "comma-separated types of the clustering key columns")
+        ("columns", bpo::value<sstring>()->default_value(""), "comma-separated name:type of the regular columns, prefixed with \"static \" for static ones")
+        ("compact-storage", "the table was created WITH COMPACT STORAGE")
+        ("partitioner", bpo::value<sstring>()->default_value("org.apache.cassandra.dht.Murmur3Partitioner"), "partitioner of the cluster")
+        ("top", bpo::value<size_t>()->default_value(10), "number of largest partitions to report")
+        ("json", bpo::value<sstring>()->default_value(""), "when set, each shard writes the statistics of its partitions, one JSON object per line, "
+                                                           "to <value>-<generation>.<shard>.json, in token order within the file")
+        ;
+
+    return app.run(argc, argv, [&app] {
+        return seastar::async([&app] {
+            auto& cfg = app.configuration();
+            auto partitioner = cfg["partitioner"].as<sstring>();
+            smp::invoke_on_all([partitioner] {
+                dht::set_global_partitioner(partitioner);
+            }).get();
+            auto top = cfg["top"].as<size_t>();
+            auto json = cfg["json"].as<sstring>();
+            for (auto&& path : cfg["sstable"].as<std::vector<sstring>>()) {
+                auto slash = path.find_last_of('/');
+                auto dir = slash == sstring::npos ? sstring(".") : path.substr(0, slash);
+                auto desc = entry_descriptor::make_descriptor(slash == sstring::npos ? path : path.substr(slash + 1));
+                auto stats = map_reduce(boost::counting_iterator<unsigned>(0), boost::counting_iterator<unsigned>(smp::count),
+                        [&cfg, dir, desc, top, json] (unsigned shard) {
+                    return smp::submit_to(shard, [&cfg, dir, desc, top, json] {
+                        return seastar::async([&cfg, dir, desc, top, json] {
+                            return scan_shard(make_schema(cfg), dir, desc, top, json);
+                        });
+                    });
+                }, scan_stats(), [top] (scan_stats acc, scan_stats stats) {
+                    acc.merge(std::move(stats), top);
+                    return acc;
+                }).get0();
+                print(path, stats);
+            }
+            return 0;
+        });
+    });
+}
@@ -0,0 +1,160 @@
+/*
+ * Copyright (C) 2017 ScyllaDB
+ */
+
+/*
+ * This file is part of Scylla.
+ *
+ * Scylla is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Scylla is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <vector>
+#include <experimental/optional>
+#include <seastar/core/lowres_clock.hh>
+#include "keys.hh"
+#include "schema.hh"
+#include "utils/top_k.hh"
+
+/*
+ * Finds the partitions of a table which are read and written the most.
+ *
+ * One in sample_every operations is counted in a Space-Saving sketch, reads
+ * and writes separately. Sketches cover a window of time, after which the
+ * current ones become the previous ones and new ones are started. Results
+ * cover the previous window and what passed of the current one.
+ *
+ * Partitions are owned by a single shard, so the results of the trackers of
+ * all shards can be merged by just putting them together.
+ */
+class top_partitions_tracker {
+public:
+    using clock = seastar::lowres_clock;
+
+    struct config {
+        // Zero disables the tracking.
+        unsigned sample_every = 0;
+        size_t capacity = 256;
+        clock::duration window = std::chrono::seconds(60);
+    };
+
+    struct partition_count {
+        partition_key key;
+        // Estimated number of operations, sampling accounted for.
+        uint64_t count;
+        // Maximum over-estimation of count.
+        uint64_t error;
+    };
+
+    struct result {
+        std::vector<partition_count> reads;
+        std::vector<partition_count> writes;
+        // The time the counts were taken over.
+        clock::duration duration;
+    };
+private:
+    using sketch = utils::space_saving_top_k<partition_key, partition_key::hashing, partition_key::equality>;
+
+    struct window {
+        sketch reads;
+        sketch writes;
+
+        window(const schema& s, size_t capacity)
+            : reads(capacity, partition_key::hashing(s), partition_key::equality(s))
+            , writes(capacity, partition_key::hashing(s), partition_key::equality(s))
+        { }
+    };
+
+    schema_ptr _schema;
+    config _cfg;
+    unsigned _until_next_sample;
+    clock::time_point _window_start;
+    window _current;
+    std::experimental::optional<window> _previous;
+private:
+    void maybe_rotate() {
+        auto now = clock::now();
+        auto elapsed = now - _window_start;
+        if (elapsed < _cfg.window) {
+            return;
+        }
+        if (elapsed < 2 * _cfg.window) {
+            _previous = std::move(_current);
+        } else {
+            _previous = {};
+        }
+        _current = window(*_schema, _cfg.capacity);
+        _window_start = now;
+    }
+
+    std::vector<partition_count> top(sketch window::*which, size_t limit) const {
+        sketch merged(2 * _cfg.capacity, partition_key::hashing(*_schema), partition_key::equality(*_schema));
+        merged.merge(_current.*which);
+        if (_previous) {
+            merged.merge((*_previous).*which);
+        }
+        std::vector<partition_count> ret;
+        for (auto&& r : merged.top(limit)) {
+            ret.push_back(partition_count{std::move(r.item), r.count * _cfg.sample_every, r.error * _cfg.sample_every});
+        }
+        return ret;
+    }
+public:
+    top_partitions_tracker(schema_ptr s, config cfg)
+        : _schema(std::move(s))
+        , _cfg(cfg)
+        , _until_next_sample(_cfg.sample_every)
+        , _window_start(clock::now())
+        , _current(*_schema, _cfg.capacity)
+    { }
+
+    // Returns true if the operation is to be recorded.
+    bool sample() {
+        if (!_cfg.sample_every || --_until_next_sample) {
+            return false;
+        }
+        _until_next_sample = _cfg.sample_every;
+        return true;
+    }
+
+    void record_read(const partition_key& key) {
+        maybe_rotate();
+        _current.reads.append(key);
+    }
+
+    void record_write(const partition_key& key) {
+        maybe_rotate();
+        _current.writes.append(key);
+    }
+
+    result get(size_t limit) {
+        maybe_rotate();
+        auto duration = clock::now() - _window_start + (_previous ? _cfg.window : clock::duration(0));
+        return result{top(&window::reads, limit), top(&window::writes, limit), duration};
+    }
+
+    // The estimated number of operations on the most read partition.
+    uint64_t top_read_count() const {
+        auto t = top(&window::reads, 1);
+        return t.empty() ? 0 : t.front().count;
+    }
+
+    // The estimated number of operations on the most written partition.
+    uint64_t top_write_count() const {
+        auto t = top(&window::writes, 1);
+        return t.empty() ? 0 : t.front().count;
+    }
+};
@@ -140,6 +140,11 @@ void trace_state::stop_foreground_and_write() {
     trace_state_logger.trace("{}: Current records count is {}",  session_id(), _records->size());
 
     if (should_write_records()) {
+        // A summary session only gets its trace points written when it is
+        // logged as a slow query.
+        if (summary_only() && !_records->do_log_slow_query) {
+            _records->drop_events_records();
+        }
         _local_tracing_ptr->write_session_records(_records, write_on_close());
     } else {
         _records->drop_records();
@@ -130,8 +130,8 @@ class trace_state final {
         : _state_props(props)
         , _local_tracing_ptr(tracing::get_local_tracing_instance().shared_from_this())
     {
-        if (!full_tracing() && !log_slow_query()) {
-            throw std::logic_error("A primary session has to be created for either full tracing or a slow query logging");
+        if (!full_tracing() && !log_slow_query() && !summary_only()) {
+            throw std::logic_error("A primary session has to be created for either full tracing, a summary or a slow query logging");
         }
 
         // This is a primary session
@@ -202,6 +202,10 @@ class trace_state final {
         return _state_props.contains(trace_state_props::log_slow_query);
     }
 
+    bool summary_only() const {
+        return _state_props.contains(trace_state_props::summary_only);
+    }
+
     trace_state_props_set raw_props() const {
         return _state_props;
     }
@@ -236,7 +240,7 @@ class trace_state final {
         _records = make_lw_shared<one_session_records>();
         _records->session_id = session_id ? *session_id : utils::UUID_gen::get_time_UUID();
 
-        if (full_tracing()) {
+        if (full_tracing() || summary_only()) {
             if (!log_slow_query()) {
                 _records->ttl = ttl_by_type(type);
             } else {
@@ -253,7 +257,15 @@ class trace_state final {
     }
 
     bool should_write_records() const {
-        return full_tracing() || _records->do_log_slow_query;
+        return full_tracing() || summary_only() || _records->do_log_slow_query;
+    }
+
+    /**
+     * Trace points of a summary session are only needed if it may turn out
+     * to be a slow query.
+     */
+    bool should_trace_events() const {
+        return !summary_only() || log_slow_query();
     }
 
     /**
@@ -439,6 +451,10 @@ inline void trace_state::trace(sstring message) {
         throw std::logic_error("trying to use a trace() before begin() for \"" + message + "\" tracepoint");
     }
 
+    if (!should_trace_events()) {
+        return;
+    }
+
     // We don't want the total amount of pending, active and flushing records to
     // bypass two times the maximum number of pending records.
     //
@@ -481,6 +497,9 @@ inline void trace_state::trace(sstring message) {
 
 template <typename... A>
 void trace_state::trace(const char* fmt, A&&... a) {
+    if (!should_trace_events()) {
+        return;
+    }
     try {
         trace(seastar::format(fmt, std::forward<A>(a)...));
     } catch (...) {
@@ -603,8 +622,13 @@ inline std::experimental::optional<trace_info> make_trace_info(const trace_state
     // When only a slow query logging is enabled we don't really care what
     // happens on a remote replica after a Client has received a response for
     // his/her query.
+    //
+    // Summary sessions are only continued on remote replicas for the slow query
+    // logging.
     if (state && (state->full_tracing() || (state->log_slow_query() && !state->is_in_state(trace_state::state::background)))) {
-        return trace_info{state->session_id(), state->type(), state->write_on_close(), state->raw_props(), state->slow_query_threshold_us(), state->slow_query_ttl_sec(), state->my_span_id()};
+        auto props = state->raw_props();
+        props.remove(trace_state_props::summary_only);
+        return trace_info{state->session_id(), state->type(), state->write_on_close(), props, state->slow_query_threshold_us(), state->slow_query_ttl_sec(), state->my_span_id()};
     }
 
     return std::experimental::nullopt;
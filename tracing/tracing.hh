@@ -124,15 +124,18 @@ std::ostream& operator<<(std::ostream& os, const span_id& id);
 // ones.
 //
 // Otherwise this may break IDL's backward compatibility.
+//
+// summary_only sessions are never sent to other Nodes.
 enum class trace_state_props {
-    write_on_close, primary, log_slow_query, full_tracing
+    write_on_close, primary, log_slow_query, full_tracing, summary_only
 };
 
 using trace_state_props_set = enum_set<super_enum<trace_state_props,
     trace_state_props::write_on_close,
     trace_state_props::primary,
     trace_state_props::log_slow_query,
-    trace_state_props::full_tracing>>;
+    trace_state_props::full_tracing,
+    trace_state_props::summary_only>>;
 
 class trace_info {
 public:
@@ -274,6 +277,15 @@ class one_session_records {
         session_rec.set_consumed();
     }
 
+    /**
+     * Drop the pending events' records, keeping the session's record, and
+     * return their budget.
+     */
+    void drop_events_records() {
+        (*budget_ptr) -= events_recs.size();
+        events_recs.clear();
+    }
+
     /**
      * Should be called when a record is scheduled for write.
      * From that point till data_consumed() call all new records will be written
@@ -393,6 +405,7 @@ class tracing : public seastar::async_sharded_service<tracing> {
     seastar::metrics::metric_groups _metrics;
     double _trace_probability = 0.0; // keep this one for querying purposes
     uint64_t _normalized_trace_probability = 0;
+    bool _trace_probability_summary_only = false;
     std::ranlux48_base _gen;
     std::chrono::microseconds _slow_query_duration_threshold;
     std::chrono::seconds _slow_query_record_ttl;
@@ -528,6 +541,22 @@ class tracing : public seastar::async_sharded_service<tracing> {
         return _normalized_trace_probability != 0 && _gen() < _normalized_trace_probability;
     }
 
+    /**
+     * Makes the sessions of requests traced due to the tracing probability
+     * record only their session's record - the request, its parameters and
+     * its duration - instead of all their trace points, on this Node only.
+     *
+     * Such sessions cost a single record, which makes it possible to keep a
+     * tracing probability in production.
+     */
+    void set_trace_probability_summary_only(bool summary_only) {
+        _trace_probability_summary_only = summary_only;
+    }
+
+    bool trace_probability_summary_only() const {
+        return _trace_probability_summary_only;
+    }
+
     std::unique_ptr<backend_session_state_base> allocate_backend_session_state() const {
         return _tracing_backend_helper_ptr->allocate_session_state();
     }
@@ -27,10 +27,13 @@
 #include <boost/assign.hpp>
 #include <boost/locale/encoding_utf.hpp>
 #include <boost/range/adaptor/sliced.hpp>
+#include <boost/lexical_cast.hpp>
 
 #include "cql3/statements/batch_statement.hh"
 #include "service/migration_manager.hh"
 #include "service/storage_service.hh"
+#include "service/storage_proxy.hh"
+#include "service/priority_manager.hh"
 #include "db/consistency_level.hh"
 #include "db/write_type.hh"
 #include "core/future-util.hh"
@@ -38,17 +41,20 @@
 #include "utils/UUID.hh"
 #include "database.hh"
 #include "net/byteorder.hh"
+#include "bytes_ostream.hh"
 #include <seastar/core/metrics.hh>
 #include <seastar/net/byteorder.hh>
 #include <seastar/util/lazy.hh>
 #include <seastar/core/execution_stage.hh>
 
 #include "enum_set.hh"
+#include "utils/task_context_guard.hh"
 #include "service/query_state.hh"
 #include "service/client_state.hh"
 #include "exceptions/exceptions.hh"
 
 #include "auth/authenticator.hh"
+#include "utils/cost_accountant.hh"
 
 #include <cassert>
 #include <string>
@@ -187,15 +193,16 @@ class cql_server::response {
     int16_t           _stream;
     cql_binary_opcode _opcode;
     uint8_t           _flags = 0; // a bitwise OR mask of zero or more cql_frame_flags values
-    std::vector<char> _body;
+    // Written in fragments, which are sent as they are, so that large
+    // responses are neither reallocated as they grow nor copied when sent.
+    bytes_ostream     _body;
 public:
     response(int16_t stream, cql_binary_opcode opcode, const tracing::trace_state_ptr& tr_state_ptr)
         : _stream{stream}
         , _opcode{opcode}
-        , _body(tracing::should_return_id_in_response(tr_state_ptr) ? utils::UUID::serialized_size() : 0)
     {
         if (tracing::should_return_id_in_response(tr_state_ptr)) {
-            auto i = _body.begin();
+            auto i = reinterpret_cast<char*>(_body.write_place_holder(utils::UUID::serialized_size()));
             tr_state_ptr->session_id().serialize(i);
             set_frame_flag(cql_frame_flags::tracing);
         }
@@ -205,7 +212,9 @@ class cql_server::response {
         _flags |= flag;
     }
 
-    scattered_message<char> make_message(uint8_t version);
+    // The fragments of the body aren't copied into the message, so the
+    // response has to outlive it.
+    scattered_message<char> make_message(uint8_t version, cql_compression compression);
     void serialize(const event::schema_change& event, uint8_t version);
     void write_byte(uint8_t b);
     void write_int(int32_t n);
@@ -224,15 +233,19 @@ class cql_server::response {
     void write_value(bytes_opt value);
     void write(const cql3::metadata& m, bool skip = false);
     void write(const cql3::prepared_metadata& m, uint8_t version);
-    future<> output(output_stream<char>& out, uint8_t version, cql_compression compression);
+    void write(const bytes_ostream& b);
 
     cql_binary_opcode opcode() const {
         return _opcode;
     }
+
+    size_t size() const {
+        return _body.size();
+    }
 private:
-    void compress(cql_compression compression);
-    std::vector<char> compress_lz4(const std::vector<char>& body);
-    std::vector<char> compress_snappy(const std::vector<char>& body);
+    temporary_buffer<char> compress(cql_compression compression);
+    temporary_buffer<char> compress_lz4(bytes_view body);
+    temporary_buffer<char> compress_snappy(bytes_view body);
 
     template <typename CqlFrameHeaderType>
     sstring make_frame_one(uint8_t version, size_t length) {
@@ -265,6 +278,7 @@ cql_server::cql_server(distributed<service::storage_proxy>& proxy, distributed<c
     , _query_processor(qp)
     , _max_request_size(memory::stats().total_memory() / 10)
     , _memory_available(_max_request_size)
+    , _large_memory_available(_max_request_size / 2)
     , _notifier(std::make_unique<event_notifier>())
     , _lb(lb)
 {
@@ -277,16 +291,22 @@ cql_server::cql_server(distributed<service::storage_proxy>& proxy, distributed<c
         sm::make_gauge("current_connections", _connections,
                         sm::description("Holds a current number of client connections.")),
 
+        sm::make_derive("tls_connections", _tls_connects,
+                        sm::description("Counts the client connections accepted on the encrypted ports, each of which took a full TLS handshake.")),
+
         sm::make_derive("requests_served", _requests_served,
                         sm::description("Counts a number of served requests.")),
 
         sm::make_gauge("requests_serving", _requests_serving,
                         sm::description("Holds a number of requests that are being processed right now.")),
 
+        sm::make_histogram("request_latency", sm::description("Histogram of the time taken to process the requests, in microseconds."),
+                        [this] { return _request_latency.get_histogram(16, 20); }),
+
         sm::make_counter("unpaged_queries", _unpaged_queries,
                         sm::description("The number of unpaged queries served.")),
 
-        sm::make_gauge("requests_blocked_memory", [this] { return _memory_available.waiters(); },
+        sm::make_gauge("requests_blocked_memory", [this] { return _memory_available.waiters() + _large_memory_available.waiters(); },
                         sm::description(
                             seastar::format("Holds a number of requests that are blocked due to reaching the memory quota limit ({}B). "
                                             "Non-zero value indicates that our bottleneck is memory and more specifically - the memory quota allocated for the \"CQL transport\" component.", _max_request_size))),
@@ -315,9 +335,12 @@ future<> cql_server::stop() {
 }
 
 future<>
-cql_server::listen(ipv4_addr addr, std::shared_ptr<seastar::tls::credentials_builder> creds, bool keepalive) {
+cql_server::listen(ipv4_addr addr, std::shared_ptr<seastar::tls::credentials_builder> creds, bool keepalive, bool is_shard_aware) {
     listen_options lo;
     lo.reuse_address = true;
+    if (is_shard_aware) {
+        lo.lba = server_socket::load_balancing_algorithm::port;
+    }
     server_socket ss;
     try {
         ss = creds
@@ -326,15 +349,18 @@ cql_server::listen(ipv4_addr addr, std::shared_ptr<seastar::tls::credentials_bui
     } catch (...) {
         throw std::runtime_error(sprint("CQLServer error while listening on %s -> %s", make_ipv4_address(addr), std::current_exception()));
     }
+    if (is_shard_aware) {
+        (creds ? _shard_aware_ssl_port : _shard_aware_port) = addr.port;
+    }
     _listeners.emplace_back(std::move(ss));
-    _stopped = when_all(std::move(_stopped), do_accepts(_listeners.size() - 1, keepalive, addr)).discard_result();
+    _stopped = when_all(std::move(_stopped), do_accepts(_listeners.size() - 1, keepalive, addr, bool(creds))).discard_result();
     return make_ready_future<>();
 }
 
 future<>
-cql_server::do_accepts(int which, bool keepalive, ipv4_addr server_addr) {
+cql_server::do_accepts(int which, bool keepalive, ipv4_addr server_addr, bool tls) {
     ++_connections_being_accepted;
-    return _listeners[which].accept().then_wrapped([this, which, keepalive, server_addr] (future<connected_socket, socket_address> f_cs_sa) mutable {
+    return _listeners[which].accept().then_wrapped([this, which, keepalive, server_addr, tls] (future<connected_socket, socket_address> f_cs_sa) mutable {
         --_connections_being_accepted;
         if (_stopping) {
             f_cs_sa.ignore_ready_future();
@@ -348,6 +374,7 @@ cql_server::do_accepts(int which, bool keepalive, ipv4_addr server_addr) {
         fd.set_keepalive(keepalive);
         auto conn = make_shared<connection>(*this, server_addr, std::move(fd), std::move(addr));
         ++_connects;
+        _tls_connects += tls;
         ++_connections;
         conn->process().then_wrapped([this, conn] (future<> f) {
             --_connections;
@@ -357,13 +384,13 @@ cql_server::do_accepts(int which, bool keepalive, ipv4_addr server_addr) {
                 clogger.debug("connection error: {}", std::current_exception());
             }
         });
-        return do_accepts(which, keepalive, server_addr);
-    }).then_wrapped([this, which, keepalive, server_addr] (future<> f) {
+        return do_accepts(which, keepalive, server_addr, tls);
+    }).then_wrapped([this, which, keepalive, server_addr, tls] (future<> f) {
         try {
             f.get();
         } catch (...) {
             clogger.debug("accept failed: {}", std::current_exception());
-            return do_accepts(which, keepalive, server_addr);
+            return do_accepts(which, keepalive, server_addr, tls);
         }
         return make_ready_future<>();
     });
@@ -446,13 +473,31 @@ cql_server::connection::read_frame() {
     }
 }
 
+// The role the usage of a connection's requests is charged to.
+static utils::cost_accountant::usage_ptr role_usage(const service::client_state& client_state) {
+    auto user = client_state.user();
+    return utils::cost_accountant::local().role(user ? user->name() : auth::authenticated_user::ANONYMOUS_USERNAME);
+}
+
 future<response_type>
     cql_server::connection::process_request_one(bytes_view buf, uint8_t op, uint16_t stream, service::client_state client_state, tracing_request_type tracing_request) {
+    // Only up to the first wait; the rest runs in other contexts' turns.
+    utils::task_context_guard task_ctx(utils::task_context::cql);
+    auto role = role_usage(client_state);
+    utils::cost_guard cost(nullptr, role.get());
+    ++role->requests;
+    role->request_bytes += buf.size();
+    utils::latency_counter lc;
+    lc.start();
     auto cqlop = static_cast<cql_binary_opcode>(op);
     tracing::trace_state_props_set trace_props;
 
-    trace_props.set_if<tracing::trace_state_props::log_slow_query>(tracing::tracing::get_local_tracing_instance().slow_query_tracing_enabled());
-    trace_props.set_if<tracing::trace_state_props::full_tracing>(tracing_request != tracing_request_type::not_requested);
+    auto& local_tracing = tracing::tracing::get_local_tracing_instance();
+    bool summary_only = tracing_request == tracing_request_type::no_write_on_close && local_tracing.trace_probability_summary_only();
+
+    trace_props.set_if<tracing::trace_state_props::log_slow_query>(local_tracing.slow_query_tracing_enabled());
+    trace_props.set_if<tracing::trace_state_props::full_tracing>(tracing_request != tracing_request_type::not_requested && !summary_only);
+    trace_props.set_if<tracing::trace_state_props::summary_only>(summary_only);
 
     if (trace_props) {
         if (cqlop == cql_binary_opcode::QUERY ||
@@ -464,7 +509,14 @@ future<response_type>
         }
     }
 
-    return make_ready_future<>().then([this, cqlop, stream, buf = std::move(buf), client_state] () mutable {
+    // The queries of users with a service level run within its share of the CPU.
+    service::service_level* sl = nullptr;
+    if (cqlop == cql_binary_opcode::QUERY || cqlop == cql_binary_opcode::EXECUTE || cqlop == cql_binary_opcode::BATCH) {
+        sl = service::get_local_priority_manager().find_service_level(client_state.get_service_level());
+    }
+    auto f = sl ? service::throttle(sl->cpu) : make_ready_future<>();
+
+    return f.then([this, cqlop, stream, buf = std::move(buf), client_state, sl] () mutable {
         // When using authentication, we need to ensure we are doing proper state transitions,
         // i.e. we cannot simply accept any query/exec ops unless auth is complete
         switch (_state) {
@@ -488,19 +540,35 @@ future<response_type>
 
         tracing::set_username(client_state.get_trace_state(), client_state.user());
 
-        switch (cqlop) {
-        case cql_binary_opcode::STARTUP:       return process_startup(stream, std::move(buf), std::move(client_state));
-        case cql_binary_opcode::AUTH_RESPONSE: return process_auth_response(stream, std::move(buf), std::move(client_state));
-        case cql_binary_opcode::OPTIONS:       return process_options(stream, std::move(buf), std::move(client_state));
-        case cql_binary_opcode::QUERY:         return process_query(stream, std::move(buf), std::move(client_state));
-        case cql_binary_opcode::PREPARE:       return process_prepare(stream, std::move(buf), std::move(client_state));
-        case cql_binary_opcode::EXECUTE:       return process_execute(stream, std::move(buf), std::move(client_state));
-        case cql_binary_opcode::BATCH:         return process_batch(stream, std::move(buf), std::move(client_state));
-        case cql_binary_opcode::REGISTER:      return process_register(stream, std::move(buf), std::move(client_state));
-        default:                               throw exceptions::protocol_exception(sprint("Unknown opcode %d", int(cqlop)));
+        if (cqlop == cql_binary_opcode::QUERY || cqlop == cql_binary_opcode::EXECUTE || cqlop == cql_binary_opcode::BATCH) {
+            // Fail fast rather than queue behind the work the node can't keep up with.
+            switch (_server._proxy.local().shed_request()) {
+            case service::storage_proxy::overload_reason::none:
+                break;
+            case service::storage_proxy::overload_reason::write_bytes:
+                throw exceptions::overloaded_exception("Too much memory held by writes in flight");
+            case service::storage_proxy::overload_reason::hints:
+                throw exceptions::overloaded_exception("Too many hints in flight");
+            }
         }
-    }).then_wrapped([this, cqlop, stream, client_state] (future<response_type> f) {
+
+        auto process = [&] () -> future<response_type> {
+            switch (cqlop) {
+            case cql_binary_opcode::STARTUP:       return process_startup(stream, std::move(buf), std::move(client_state));
+            case cql_binary_opcode::AUTH_RESPONSE: return process_auth_response(stream, std::move(buf), std::move(client_state));
+            case cql_binary_opcode::OPTIONS:       return process_options(stream, std::move(buf), std::move(client_state));
+            case cql_binary_opcode::QUERY:         return process_query(stream, std::move(buf), std::move(client_state));
+            case cql_binary_opcode::PREPARE:       return process_prepare(stream, std::move(buf), std::move(client_state));
+            case cql_binary_opcode::EXECUTE:       return process_execute(stream, std::move(buf), std::move(client_state));
+            case cql_binary_opcode::BATCH:         return process_batch(stream, std::move(buf), std::move(client_state));
+            case cql_binary_opcode::REGISTER:      return process_register(stream, std::move(buf), std::move(client_state));
+            default:                               throw exceptions::protocol_exception(sprint("Unknown opcode %d", int(cqlop)));
+            }
+        };
+        return sl ? sl->cpu.run(process) : process();
+    }).then_wrapped([this, cqlop, stream, client_state, lc] (future<response_type> f) {
         --_server._requests_serving;
+        _server._request_latency.add(utils::latency_counter(lc).stop().latency());
         try {
             response_type response = f.get0();
             auto res_op = response.first->opcode();
@@ -642,7 +710,7 @@ future<> cql_server::connection::process_request() {
                     f.length, mem_estimate, _server._max_request_size));
         }
 
-        return get_units(_server._memory_available, mem_estimate).then([this, length = f.length, flags = f.flags, op, stream, tracing_requested] (semaphore_units<> mem_permit) {
+        return get_memory_permit(mem_estimate).then([this, length = f.length, flags = f.flags, op, stream, tracing_requested] (memory_permit mem_permit) {
           return this->read_and_decompress_frame(length, flags).then([this, flags, op, stream, tracing_requested, mem_permit = std::move(mem_permit)] (temporary_buffer<char> buf) mutable {
 
             ++_server._requests_served;
@@ -655,10 +723,17 @@ future<> cql_server::connection::process_request() {
                     return process_request_stage(this, bv, op, stream, std::move(client_state), tracing_requested).then([] (auto&& response) {
                         return std::make_pair(make_foreign(response.first), response.second);
                     });
-                }).then([this, flags] (auto&& response) {
+                }).then([this, flags, mem_permit = std::move(mem_permit)] (auto&& response) mutable {
                     _client_state.merge(response.second);
-                    return this->write_response(std::move(response.first), _compression);
-                }).then([buf = std::move(buf), mem_permit = std::move(mem_permit)] {
+                    // The response holds the memory of the request, and its own,
+                    // until it was sent. It may go over the quota, rather than
+                    // wait with the request done.
+                    auto size = response.first->size();
+                    role_usage(_client_state)->response_bytes += size;
+                    _server._memory_available.consume(size);
+                    mem_permit.emplace_back(_server._memory_available, size);
+                    return this->write_response(std::move(response.first), std::move(mem_permit), _compression);
+                }).then([buf = std::move(buf)] {
                     // Keep buf alive.
                 });
             }).handle_exception([] (std::exception_ptr ex) {
@@ -671,6 +746,24 @@ future<> cql_server::connection::process_request() {
     });
 }
 
+future<cql_server::connection::memory_permit> cql_server::connection::get_memory_permit(size_t mem_estimate) {
+    auto f = make_ready_future<memory_permit>();
+    if (mem_estimate > large_request_threshold) {
+        auto large_estimate = std::min(mem_estimate, _server._max_request_size / 2);
+        f = get_units(_server._large_memory_available, large_estimate).then([] (semaphore_units<> units) {
+            memory_permit permit;
+            permit.emplace_back(std::move(units));
+            return permit;
+        });
+    }
+    return f.then([this, mem_estimate] (memory_permit permit) {
+        return get_units(_server._memory_available, mem_estimate).then([permit = std::move(permit)] (semaphore_units<> units) mutable {
+            permit.emplace_back(std::move(units));
+            return std::move(permit);
+        });
+    });
+}
+
 static inline bytes_view to_bytes_view(temporary_buffer<char>& b)
 {
     using byte = bytes_view::value_type;
@@ -748,6 +841,15 @@ future<response_type> cql_server::connection::process_startup(uint16_t stream, b
              throw exceptions::protocol_exception(sprint("Unknown compression algorithm: %s", compression));
          }
     }
+    auto page_size_opt = options.find("SCYLLA_PAGE_SIZE_IN_BYTES");
+    if (page_size_opt != options.end()) {
+        try {
+            _page_size_in_bytes = std::max<uint64_t>(boost::lexical_cast<uint64_t>(page_size_opt->second),
+                    query::result_memory_limiter::minimum_result_size);
+        } catch (const boost::bad_lexical_cast&) {
+            throw exceptions::protocol_exception(sprint("Invalid page size in bytes: %s", page_size_opt->second));
+        }
+    }
     auto& a = auth::authenticator::get();
     if (a.require_authentication()) {
         return make_ready_future<response_type>(std::make_pair(make_autheticate(stream, a.class_name(), client_state.get_trace_state()), client_state));
@@ -765,10 +867,13 @@ future<response_type> cql_server::connection::process_auth_response(uint16_t str
     if (_sasl_challenge->is_complete()) {
         return _sasl_challenge->get_authenticated_user().then([this, stream, client_state = std::move(client_state), challenge = std::move(challenge)](::shared_ptr<auth::authenticated_user> user) mutable {
             client_state.set_login(std::move(user));
-            auto f = client_state.check_user_exists();
-            return f.then([this, stream, client_state = std::move(client_state), challenge = std::move(challenge)]() mutable {
-                auto tr_state = client_state.get_trace_state();
-                return make_ready_future<response_type>(std::make_pair(make_auth_success(stream, std::move(challenge), tr_state), std::move(client_state)));
+            return do_with(std::move(client_state), [this, stream, challenge = std::move(challenge)] (service::client_state& client_state) mutable {
+                return client_state.check_user_exists().then([&client_state] {
+                    return client_state.load_service_level();
+                }).then([this, stream, &client_state, challenge = std::move(challenge)]() mutable {
+                    auto tr_state = client_state.get_trace_state();
+                    return make_ready_future<response_type>(std::make_pair(make_auth_success(stream, std::move(challenge), tr_state), std::move(client_state)));
+                });
             });
         });
     }
@@ -1087,6 +1192,20 @@ shared_ptr<cql_server::response> cql_server::connection::make_supported(int16_t
     opts.insert({"CQL_VERSION", cql3::query_processor::CQL_VERSION});
     opts.insert({"COMPRESSION", "lz4"});
     opts.insert({"COMPRESSION", "snappy"});
+    // Sharding information, letting drivers send each request to the
+    // connection of the shard owning its token.
+    auto& partitioner = dht::global_partitioner();
+    opts.insert({"SCYLLA_SHARD", sprint("%d", engine().cpu_id())});
+    opts.insert({"SCYLLA_NR_SHARDS", sprint("%d", smp::count)});
+    opts.insert({"SCYLLA_PARTITIONER", partitioner.name()});
+    opts.insert({"SCYLLA_SHARDING_ALGORITHM", "biased-token-round-robin"});
+    opts.insert({"SCYLLA_SHARDING_IGNORE_MSB", sprint("%d", partitioner.sharding_ignore_msb())});
+    if (_server._shard_aware_port) {
+        opts.insert({"SCYLLA_SHARD_AWARE_PORT", sprint("%d", *_server._shard_aware_port)});
+    }
+    if (_server._shard_aware_ssl_port) {
+        opts.insert({"SCYLLA_SHARD_AWARE_PORT_SSL", sprint("%d", *_server._shard_aware_ssl_port)});
+    }
     auto response = make_shared<cql_server::response>(stream, cql_binary_opcode::SUPPORTED, tr_state);
     response->write_string_multimap(opts);
     return response;
@@ -1141,6 +1260,10 @@ class cql_server::fmt_visitor : public messages::result_message::visitor_base {
         auto& rs = m.rs();
         _response->write(rs.get_metadata(), _skip_metadata);
         _response->write_int(rs.size());
+        if (rs.has_serialized_rows()) {
+            _response->write(rs.serialized_rows());
+            return;
+        }
         for (auto&& row : rs.rows()) {
             for (auto&& cell : row | boost::adaptors::sliced(0, rs.get_metadata().column_count())) {
                 _response->write_value(cell);
@@ -1189,11 +1312,24 @@ cql_server::connection::make_schema_change_event(const event::schema_change& eve
 
 future<> cql_server::connection::write_response(foreign_ptr<shared_ptr<cql_server::response>>&& response, cql_compression compression)
 {
-    _ready_to_respond = _ready_to_respond.then([this, compression, response = std::move(response)] () mutable {
-        return do_with(std::move(response), [this, compression] (auto& response) {
-            return response->output(_write_buf, _version, compression).then([this] {
-                return _write_buf.flush();
-            });
+    return write_response(std::move(response), memory_permit(), compression);
+}
+
+future<> cql_server::connection::write_response(foreign_ptr<shared_ptr<cql_server::response>>&& response, memory_permit permit, cql_compression compression)
+{
+    ++_pending_responses;
+    _ready_to_respond = _ready_to_respond.then([this, compression, response = std::move(response), permit = std::move(permit)] () mutable {
+        --_pending_responses;
+        auto msg = response->make_message(_version, compression);
+        // The message refers to the fragments of the response, which is freed
+        // on its shard once the message was sent.
+        msg.on_delete([response = std::move(response), permit = std::move(permit)] { });
+        return _write_buf.write(std::move(msg)).then([this] {
+            // The responses which got ready meanwhile are sent with this one.
+            if (_pending_responses) {
+                return make_ready_future<>();
+            }
+            return _write_buf.flush();
         });
     });
     return make_ready_future<>();
@@ -1411,7 +1547,7 @@ std::unique_ptr<cql3::query_options> cql_server::connection::read_options(bytes_
             onames = std::move(names);
         }
         options = std::make_unique<cql3::query_options>(consistency, std::move(onames), std::move(values), skip_metadata,
-            cql3::query_options::specific_options{page_size, std::move(paging_state), serial_consistency, ts},
+            cql3::query_options::specific_options{page_size, std::move(paging_state), serial_consistency, ts, _page_size_in_bytes},
             _cql_serialization_format);
     } else {
         options = std::make_unique<cql3::query_options>(consistency, std::experimental::nullopt, std::move(values), skip_metadata,
@@ -1487,51 +1623,51 @@ cql3::raw_value_view cql_server::connection::read_value_view(bytes_view& buf) {
     return cql3::raw_value_view::make_value(std::move(bv));
 }
 
-scattered_message<char> cql_server::response::make_message(uint8_t version) {
+// Responses smaller than this are sent uncompressed, even when compression
+// was negotiated: they gain few bytes, if any, for the cost of linearizing
+// and compressing them. The compression flag of the frame tells the client.
+static constexpr size_t min_compressed_response_size = 512;
+
+scattered_message<char> cql_server::response::make_message(uint8_t version, cql_compression compression) {
     scattered_message<char> msg;
-    sstring body{_body.data(), _body.size()};
-    sstring frame = make_frame(version, _body.size());
-    msg.append(std::move(frame));
-    msg.append(std::move(body));
+    if (compression != cql_compression::none && _body.size() >= min_compressed_response_size) {
+        auto body = compress(compression);
+        if (body.size() < _body.size()) {
+            set_frame_flag(cql_frame_flags::compression);
+            msg.append(make_frame(version, body.size()));
+            msg.append(std::move(body));
+            return msg;
+        }
+    }
+    msg.append(make_frame(version, _body.size()));
+    for (bytes_view fragment : _body.fragments()) {
+        msg.append_static(reinterpret_cast<const char*>(fragment.data()), fragment.size());
+    }
     return msg;
 }
 
-future<>
-cql_server::response::output(output_stream<char>& out, uint8_t version, cql_compression compression) {
-    if (compression != cql_compression::none) {
-        compress(compression);
-    }
-    auto frame = make_frame(version, _body.size());
-    auto tmp = temporary_buffer<char>(frame.size());
-    std::copy_n(frame.begin(), frame.size(), tmp.get_write());
-    auto f = out.write(tmp.get(), tmp.size());
-    return f.then([this, &out, tmp = std::move(tmp)] {
-        return out.write(_body.data(), _body.size());
-    });
-}
-
-void cql_server::response::compress(cql_compression compression)
+// Both LZ4 and Snappy frames are compressed as a single block, so the body
+// is linearized first. The body is sent uncompressed when compressing it
+// didn't make it smaller.
+temporary_buffer<char> cql_server::response::compress(cql_compression compression)
 {
+    auto body = _body.linearize();
     switch (compression) {
     case cql_compression::lz4:
-        _body = compress_lz4(_body);
-        break;
+        return compress_lz4(body);
     case cql_compression::snappy:
-        _body = compress_snappy(_body);
-        break;
+        return compress_snappy(body);
     default:
         throw std::invalid_argument("Invalid CQL compression algorithm");
     }
-    set_frame_flag(cql_frame_flags::compression);
 }
 
-std::vector<char> cql_server::response::compress_lz4(const std::vector<char>& body)
+temporary_buffer<char> cql_server::response::compress_lz4(bytes_view body)
 {
-    const char* input = body.data();
+    const char* input = reinterpret_cast<const char*>(body.data());
     size_t input_len = body.size();
-    std::vector<char> comp;
-    comp.resize(LZ4_COMPRESSBOUND(input_len) + 4);
-    char *output = comp.data();
+    temporary_buffer<char> comp(LZ4_COMPRESSBOUND(input_len) + 4);
+    char *output = comp.get_write();
     output[0] = (input_len >> 24) & 0xFF;
     output[1] = (input_len >> 16) & 0xFF;
     output[2] = (input_len >> 8) & 0xFF;
@@ -1545,22 +1681,21 @@ std::vector<char> cql_server::response::compress_lz4(const std::vector<char>& bo
         throw std::runtime_error("CQL frame LZ4 compression failure");
     }
     size_t output_len = ret + 4;
-    comp.resize(output_len);
+    comp.trim(output_len);
     return comp;
 }
 
-std::vector<char> cql_server::response::compress_snappy(const std::vector<char>& body)
+temporary_buffer<char> cql_server::response::compress_snappy(bytes_view body)
 {
-    const char* input = body.data();
+    const char* input = reinterpret_cast<const char*>(body.data());
     size_t input_len = body.size();
-    std::vector<char> comp;
     size_t output_len = snappy_max_compressed_length(input_len);
-    comp.resize(output_len);
-    char *output = comp.data();
+    temporary_buffer<char> comp(output_len);
+    char *output = comp.get_write();
     if (snappy_compress(input, input_len, output, &output_len) != SNAPPY_OK) {
         throw std::runtime_error("CQL frame Snappy compression failure");
     }
-    comp.resize(output_len);
+    comp.trim(output_len);
     return comp;
 }
 
@@ -1594,28 +1729,28 @@ void cql_server::response::serialize(const event::schema_change& event, uint8_t
 
 void cql_server::response::write_byte(uint8_t b)
 {
-    _body.insert(_body.end(), b);
+    _body.write(reinterpret_cast<const char*>(&b), sizeof(b));
 }
 
 void cql_server::response::write_int(int32_t n)
 {
     auto u = htonl(n);
     auto *s = reinterpret_cast<const char*>(&u);
-    _body.insert(_body.end(), s, s+sizeof(u));
+    _body.write(s, sizeof(u));
 }
 
 void cql_server::response::write_long(int64_t n)
 {
     auto u = htonq(n);
     auto *s = reinterpret_cast<const char*>(&u);
-    _body.insert(_body.end(), s, s+sizeof(u));
+    _body.write(s, sizeof(u));
 }
 
 void cql_server::response::write_short(uint16_t n)
 {
     auto u = htons(n);
     auto *s = reinterpret_cast<const char*>(&u);
-    _body.insert(_body.end(), s, s+sizeof(u));
+    _body.write(s, sizeof(u));
 }
 
 template<typename T>
@@ -1631,19 +1766,19 @@ T cast_if_fits(size_t v) {
 void cql_server::response::write_string(const sstring& s)
 {
     write_short(cast_if_fits<uint16_t>(s.size()));
-    _body.insert(_body.end(), s.begin(), s.end());
+    _body.write(s.begin(), s.size());
 }
 
 void cql_server::response::write_bytes_as_string(bytes_view s)
 {
     write_short(cast_if_fits<uint16_t>(s.size()));
-    _body.insert(_body.end(), s.begin(), s.end());
+    _body.write(s);
 }
 
 void cql_server::response::write_long_string(const sstring& s)
 {
     write_int(cast_if_fits<int32_t>(s.size()));
-    _body.insert(_body.end(), s.begin(), s.end());
+    _body.write(s.begin(), s.size());
 }
 
 void cql_server::response::write_string_list(std::vector<sstring> string_list)
@@ -1657,13 +1792,13 @@ void cql_server::response::write_string_list(std::vector<sstring> string_list)
 void cql_server::response::write_bytes(bytes b)
 {
     write_int(cast_if_fits<int32_t>(b.size()));
-    _body.insert(_body.end(), b.begin(), b.end());
+    _body.write(b);
 }
 
 void cql_server::response::write_short_bytes(bytes b)
 {
     write_short(cast_if_fits<uint16_t>(b.size()));
-    _body.insert(_body.end(), b.begin(), b.end());
+    _body.write(b);
 }
 
 void cql_server::response::write_inet(ipv4_addr inet)
@@ -1708,6 +1843,11 @@ void cql_server::response::write_string_multimap(std::multimap<sstring, sstring>
     }
 }
 
+void cql_server::response::write(const bytes_ostream& b)
+{
+    _body.append(b);
+}
+
 void cql_server::response::write_value(bytes_opt value)
 {
     if (!value) {
@@ -1716,7 +1856,7 @@ void cql_server::response::write_value(bytes_opt value)
     }
 
     write_int(value->size());
-    _body.insert(_body.end(), value->begin(), value->end());
+    _body.write(*value);
 }
 
 class type_codec {
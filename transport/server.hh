@@ -34,6 +34,8 @@
 #include <boost/intrusive/list.hpp>
 #include <seastar/net/tls.hh>
 #include <seastar/core/metrics_registration.hh>
+#include "utils/latency.hh"
+#include "utils/log_linear_histogram.hh"
 
 namespace scollectd {
 
@@ -109,19 +111,36 @@ class cql_server {
     distributed<cql3::query_processor>& _query_processor;
     size_t _max_request_size;
     semaphore _memory_available;
+    // Requests whose memory is above large_request_threshold take it from
+    // this half of the quota too, so that they can't take all of it from
+    // the small ones.
+    semaphore _large_memory_available;
+    static constexpr size_t large_request_threshold = 1 << 20;
     seastar::metrics::metric_groups _metrics;
     std::unique_ptr<event_notifier> _notifier;
 private:
     uint64_t _connects = 0;
+    // Each of which took a full handshake: the TLS layer doesn't resume sessions.
+    uint64_t _tls_connects = 0;
     uint64_t _connections = 0;
     uint64_t _requests_served = 0;
     uint64_t _unpaged_queries = 0;
     uint64_t _requests_serving = 0;
+    // From the time a request is read off its connection until its
+    // response is ready, in microseconds.
+    utils::log_linear_histogram _request_latency;
     cql_load_balance _lb;
+    // Ports on which connections are assigned to shards based on the client's
+    // port number, advertised to drivers in SUPPORTED.
+    std::experimental::optional<uint16_t> _shard_aware_port;
+    std::experimental::optional<uint16_t> _shard_aware_ssl_port;
 public:
     cql_server(distributed<service::storage_proxy>& proxy, distributed<cql3::query_processor>& qp, cql_load_balance lb);
-    future<> listen(ipv4_addr addr, std::shared_ptr<seastar::tls::credentials_builder> = {}, bool keepalive = false);
-    future<> do_accepts(int which, bool keepalive, ipv4_addr server_addr);
+    // If is_shard_aware is set, each connection is handled by the shard equal to
+    // the client's source port modulo the shard count, instead of being
+    // distributed by the number of connections each shard has.
+    future<> listen(ipv4_addr addr, std::shared_ptr<seastar::tls::credentials_builder> = {}, bool keepalive = false, bool is_shard_aware = false);
+    future<> do_accepts(int which, bool keepalive, ipv4_addr server_addr, bool tls);
     future<> stop();
 public:
     class response;
@@ -140,10 +159,16 @@ class cql_server {
         future<> _ready_to_respond = make_ready_future<>();
         cql_protocol_version_type _version = 0;
         cql_compression _compression = cql_compression::none;
+        // The byte budget of the pages of the queries of the connection,
+        // asked for in STARTUP; zero for the server's default.
+        uint64_t _page_size_in_bytes = 0;
         cql_serialization_format _cql_serialization_format = cql_serialization_format::latest();
         service::client_state _client_state;
         std::unordered_map<uint16_t, cql_query_state> _query_states;
         unsigned _request_cpu = 0;
+        // Responses waiting to be written after the one being written, which
+        // are flushed together with it.
+        unsigned _pending_responses = 0;
 
         enum class state : uint8_t {
             UNINITIALIZED, AUTHENTICATION, READY
@@ -196,7 +221,11 @@ class cql_server {
         shared_ptr<cql_server::response> make_auth_success(int16_t, bytes, const tracing::trace_state_ptr& tr_state);
         shared_ptr<cql_server::response> make_auth_challenge(int16_t, bytes, const tracing::trace_state_ptr& tr_state);
 
+        // The memory a request holds until its response was sent.
+        using memory_permit = std::vector<semaphore_units<>>;
+        future<memory_permit> get_memory_permit(size_t mem_estimate);
         future<> write_response(foreign_ptr<shared_ptr<cql_server::response>>&& response, cql_compression compression = cql_compression::none);
+        future<> write_response(foreign_ptr<shared_ptr<cql_server::response>>&& response, memory_permit permit, cql_compression compression);
 
         void check_room(bytes_view& buf, size_t n);
         void validate_utf8(sstring_view s);
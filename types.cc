@@ -49,6 +49,7 @@
 #include "utils/big_decimal.hh"
 #include "utils/date.h"
 #include "mutation_partition.hh"
+#include "bytes_ostream.hh"
 
 template<typename T>
 sstring time_point_to_string(const T& tp)
@@ -128,6 +129,100 @@ struct simple_type_traits<db_clock::time_point> {
     }
 };
 
+// In byte comparable forms, empty values of the types which have a fixed
+// size are marked, so that they sort before all the others.
+static constexpr uint8_t comparable_empty = 0;
+static constexpr uint8_t comparable_nonempty = 1;
+
+static void write_comparable_byte(bytes_ostream& out, uint8_t b) {
+    auto v = int8_t(b);
+    out.write(bytes_view(&v, 1));
+}
+
+// Zero bytes are escaped as 0x00 0xff, and the value is terminated by
+// 0x00 0x00, which sorts before anything a longer value could continue with.
+static void serialize_comparable_bytes(bytes_view v, bytes_ostream& out) {
+    while (!v.empty()) {
+        auto zero = std::find(v.begin(), v.end(), 0);
+        out.write(bytes_view(v.begin(), zero - v.begin()));
+        if (zero == v.end()) {
+            break;
+        }
+        write_comparable_byte(out, 0x00);
+        write_comparable_byte(out, 0xff);
+        v.remove_prefix(zero - v.begin() + 1);
+    }
+    write_comparable_byte(out, 0x00);
+    write_comparable_byte(out, 0x00);
+}
+
+// Big endian, with the sign bit flipped so that two's complement integers
+// sort as unsigned ones.
+template <typename T>
+static void serialize_comparable_integer(bytes_view v, bytes_ostream& out) {
+    if (v.empty()) {
+        write_comparable_byte(out, comparable_empty);
+        return;
+    }
+    if (v.size() != sizeof(T)) {
+        throw marshal_exception();
+    }
+    write_comparable_byte(out, comparable_nonempty);
+    write_comparable_byte(out, uint8_t(v[0]) ^ (std::is_signed<T>::value ? 0x80 : 0));
+    out.write(bytes_view(v.begin() + 1, v.size() - 1));
+}
+
+static void write_comparable_int64(bytes_ostream& out, int64_t i) {
+    auto u = net::hton(uint64_t(i) ^ (uint64_t(1) << 63));
+    out.write(reinterpret_cast<const char*>(&u), sizeof(u));
+}
+
+// Writes what func writes, inverted, so that the encodings sort in the
+// reverse order. That of prefixes is reversed too, so func's encodings
+// mustn't be prefixes of each other.
+template <typename Func>
+static void serialize_comparable_inverted(bytes_ostream& out, Func&& func) {
+    bytes_ostream tmp;
+    func(tmp);
+    for (bytes_view fragment : tmp.fragments()) {
+        bytes inverted(bytes::initialized_later(), fragment.size());
+        std::transform(fragment.begin(), fragment.end(), inverted.begin(), [] (int8_t b) {
+            return int8_t(~b);
+        });
+        out.write(inverted);
+    }
+}
+
+// Signs, between the empty value and the magnitude of decimals and varints.
+static constexpr uint8_t comparable_negative = 1;
+static constexpr uint8_t comparable_zero = 2;
+static constexpr uint8_t comparable_positive = 3;
+
+// Writes the sign of the number, then its magnitude written by func,
+// inverted for negative numbers.
+template <typename Func>
+static void serialize_comparable_signed(int sign, bytes_ostream& out, Func&& func) {
+    if (sign < 0) {
+        write_comparable_byte(out, comparable_negative);
+        serialize_comparable_inverted(out, std::forward<Func>(func));
+    } else if (sign == 0) {
+        write_comparable_byte(out, comparable_zero);
+    } else {
+        write_comparable_byte(out, comparable_positive);
+        func(out);
+    }
+}
+
+void abstract_type::serialize_comparable(bytes_view v, bytes_ostream& out) const {
+    throw std::runtime_error(sprint("%s has no byte comparable form", name()));
+}
+
+void reversed_type_impl::serialize_comparable(bytes_view v, bytes_ostream& out) const {
+    serialize_comparable_inverted(out, [&] (bytes_ostream& out) {
+        _underlying_type->serialize_comparable(v, out);
+    });
+}
+
 template <typename T>
 struct simple_type_impl : concrete_type<T> {
     simple_type_impl(sstring name) : concrete_type<T>(std::move(name)) {}
@@ -162,6 +257,15 @@ struct simple_type_impl : concrete_type<T> {
 template<typename T>
 struct integer_type_impl : simple_type_impl<T> {
     integer_type_impl(sstring name) : simple_type_impl<T>(name) {}
+    virtual abstract_type::comparison_kind comparison() const override {
+        return abstract_type::comparison_kind::signed_integer;
+    }
+    virtual bool is_byte_comparable() const override {
+        return true;
+    }
+    virtual void serialize_comparable(bytes_view v, bytes_ostream& out) const override {
+        serialize_comparable_integer<T>(v, out);
+    }
     virtual void serialize(const void* value, bytes::iterator& out) const override {
         if (!value) {
             return;
@@ -312,6 +416,12 @@ struct string_type_impl : public concrete_type<sstring> {
     virtual bool is_byte_order_comparable() const override {
         return true;
     }
+    virtual bool is_byte_comparable() const override {
+        return true;
+    }
+    virtual void serialize_comparable(bytes_view v, bytes_ostream& out) const override {
+        serialize_comparable_bytes(v, out);
+    }
     virtual size_t hash(bytes_view v) const override {
         return std::hash<bytes_view>()(v);
     }
@@ -385,6 +495,12 @@ struct bytes_type_impl final : public concrete_type<bytes> {
     virtual bool is_byte_order_comparable() const override {
         return true;
     }
+    virtual bool is_byte_comparable() const override {
+        return true;
+    }
+    virtual void serialize_comparable(bytes_view v, bytes_ostream& out) const override {
+        serialize_comparable_bytes(v, out);
+    }
     virtual size_t hash(bytes_view v) const override {
         return std::hash<bytes_view>()(v);
     }
@@ -441,6 +557,17 @@ struct boolean_type_impl : public simple_type_impl<bool> {
         }
         return make_value(*v.begin() != 0);
     }
+    virtual bool is_byte_comparable() const override {
+        return true;
+    }
+    virtual void serialize_comparable(bytes_view v, bytes_ostream& out) const override {
+        if (v.empty()) {
+            write_comparable_byte(out, comparable_empty);
+            return;
+        }
+        write_comparable_byte(out, comparable_nonempty);
+        write_comparable_byte(out, simple_type_traits<bool>::read_nonempty(v));
+    }
     virtual void validate(bytes_view v) const override {
         if (v.size() != 0 && v.size() != 1) {
             throw marshal_exception();
@@ -506,6 +633,12 @@ class date_type_impl : public concrete_type<db_clock::time_point> {
     virtual bool is_byte_order_comparable() const override {
         return true;
     }
+    virtual bool is_byte_comparable() const override {
+        return true;
+    }
+    virtual void serialize_comparable(bytes_view v, bytes_ostream& out) const override {
+        serialize_comparable_bytes(v, out);
+    }
     virtual size_t hash(bytes_view v) const override {
         return std::hash<bytes_view>()(v);
     }
@@ -570,19 +703,11 @@ struct timeuuid_type_impl : public concrete_type<utils::UUID> {
         }
         return make_value(utils::UUID(msb, lsb));
     }
+    virtual int32_t compare(bytes_view b1, bytes_view b2) const override {
+        return timeuuid_tri_compare(b1, b2);
+    }
     virtual bool less(bytes_view b1, bytes_view b2) const override {
-        if (b1.empty()) {
-            return b2.empty() ? false : true;
-        }
-        if (b2.empty()) {
-            return false;
-        }
-        auto r = compare_bytes(b1, b2);
-        if (r != 0) {
-            return r < 0;
-        } else {
-            return std::lexicographical_compare(b1.begin(), b1.end(), b2.begin(), b2.end());
-        }
+        return timeuuid_tri_compare(b1, b2) < 0;
     }
     virtual bool is_byte_order_equal() const override {
         return true;
@@ -590,6 +715,29 @@ struct timeuuid_type_impl : public concrete_type<utils::UUID> {
     virtual size_t hash(bytes_view v) const override {
         return std::hash<bytes_view>()(v);
     }
+    virtual comparison_kind comparison() const override {
+        return comparison_kind::timeuuid;
+    }
+    virtual bool is_byte_comparable() const override {
+        return true;
+    }
+    virtual void serialize_comparable(bytes_view v, bytes_ostream& out) const override {
+        if (v.empty()) {
+            write_comparable_byte(out, comparable_empty);
+            return;
+        }
+        if (v.size() != 16) {
+            throw marshal_exception();
+        }
+        write_comparable_byte(out, comparable_nonempty);
+        serialize_comparable_timestamp(v, out);
+        // Ties are broken by comparing the bytes as signed ones.
+        int8_t signed_bytes[16];
+        std::transform(v.begin(), v.end(), signed_bytes, [] (int8_t b) {
+            return int8_t(uint8_t(b) ^ 0x80);
+        });
+        out.write(bytes_view(signed_bytes, sizeof(signed_bytes)));
+    }
     virtual void validate(bytes_view v) const override {
         if (v.size() != 0 && v.size() != 16) {
             throw marshal_exception();
@@ -626,6 +774,12 @@ struct timeuuid_type_impl : public concrete_type<utils::UUID> {
         return cql3::cql3_type::timeuuid;
     }
 private:
+    // The timestamp of a version 1 uuid, most significant byte first, which
+    // sorts as compare_bytes() does.
+    static void serialize_comparable_timestamp(bytes_view v, bytes_ostream& out) {
+        int8_t timestamp[8] = { int8_t(v[6] & 0xf), v[7], v[4], v[5], v[0], v[1], v[2], v[3] };
+        out.write(bytes_view(timestamp, sizeof(timestamp)));
+    }
     static int compare_bytes(bytes_view o1, bytes_view o2) {
         auto compare_pos = [&] (unsigned pos, int mask, int ifequal) {
             int d = (o1[pos] & mask) - (o2[pos] & mask);
@@ -673,6 +827,15 @@ class timestamp_type_impl : public simple_type_impl<db_clock::time_point> {
         return make_value(db_clock::time_point(db_clock::duration(v)));
     }
     // FIXME: isCompatibleWith(timestampuuid)
+    virtual comparison_kind comparison() const override {
+        return comparison_kind::signed_integer;
+    }
+    virtual bool is_byte_comparable() const override {
+        return true;
+    }
+    virtual void serialize_comparable(bytes_view v, bytes_ostream& out) const override {
+        serialize_comparable_integer<int64_t>(v, out);
+    }
     virtual void validate(bytes_view v) const override {
         if (v.size() != 0 && v.size() != sizeof(uint64_t)) {
             throw marshal_exception();
@@ -834,6 +997,16 @@ struct simple_date_type_impl : public simple_type_impl<uint32_t> {
         auto v = read_simple_exactly<uint32_t>(in);
         return make_value(v);
     }
+    // Unsigned big endian integers.
+    virtual comparison_kind comparison() const override {
+        return comparison_kind::bytes;
+    }
+    virtual bool is_byte_comparable() const override {
+        return true;
+    }
+    virtual void serialize_comparable(bytes_view v, bytes_ostream& out) const override {
+        serialize_comparable_integer<uint32_t>(v, out);
+    }
     virtual void validate(bytes_view v) const override {
         if (v.size() != 0 && v.size() != 4) {
             throw marshal_exception(sprint("Expected 4 byte long for date (%d)", v.size()));
@@ -921,6 +1094,15 @@ struct time_type_impl : public simple_type_impl<int64_t> {
         auto v = read_simple_exactly<int64_t>(in);
         return make_value(v);
     }
+    virtual comparison_kind comparison() const override {
+        return comparison_kind::signed_integer;
+    }
+    virtual bool is_byte_comparable() const override {
+        return true;
+    }
+    virtual void serialize_comparable(bytes_view v, bytes_ostream& out) const override {
+        serialize_comparable_integer<int64_t>(v, out);
+    }
     virtual void validate(bytes_view v) const override {
         if (v.size() != 0 && v.size() != 8) {
             throw marshal_exception(sprint("Expected 8 byte long for time (%d)", v.size()));
@@ -1042,6 +1224,22 @@ struct uuid_type_impl : concrete_type<utils::UUID> {
     virtual size_t hash(bytes_view v) const override {
         return std::hash<bytes_view>()(v);
     }
+    virtual bool is_byte_comparable() const override {
+        return true;
+    }
+    virtual void serialize_comparable(bytes_view v, bytes_ostream& out) const override {
+        if (v.size() < 16) {
+            write_comparable_byte(out, comparable_empty);
+            return;
+        }
+        write_comparable_byte(out, comparable_nonempty);
+        auto version = (v[6] >> 4) & 0x0f;
+        write_comparable_byte(out, version);
+        if (version == 1) {
+            timeuuid_type_impl::serialize_comparable_timestamp(v, out);
+        }
+        serialize_comparable_bytes(v, out);
+    }
     virtual void validate(bytes_view v) const override {
         if (v.size() != 0 && v.size() != 16) {
             throw marshal_exception();
@@ -1116,6 +1314,12 @@ struct inet_addr_type_impl : concrete_type<net::ipv4_address> {
     virtual bool is_byte_order_comparable() const override {
         return true;
     }
+    virtual bool is_byte_comparable() const override {
+        return true;
+    }
+    virtual void serialize_comparable(bytes_view v, bytes_ostream& out) const override {
+        serialize_comparable_bytes(v, out);
+    }
     virtual size_t hash(bytes_view v) const override {
         return std::hash<bytes_view>()(v);
     }
@@ -1249,6 +1453,31 @@ struct floating_type_impl : public simple_type_impl<T> {
         }
         return a == b ? 0 : a < b ? -1 : 1;
     }
+    virtual bool is_byte_comparable() const override {
+        return true;
+    }
+    // Positive values get their sign bit set and negative ones all their
+    // bits inverted, which orders them as compare() does, -0 before 0. All
+    // NaNs are the greatest value.
+    virtual void serialize_comparable(bytes_view v, bytes_ostream& out) const override {
+        using itype = typename int_of_size<T>::itype;
+        if (v.empty()) {
+            write_comparable_byte(out, comparable_empty);
+            return;
+        }
+        auto i = read_simple_exactly<itype>(v);
+        constexpr auto sign_bit = itype(1) << (sizeof(itype) * 8 - 1);
+        if (std::isnan(simple_type_traits<T>::read_nonempty(v))) {
+            i = std::numeric_limits<itype>::max();
+        } else if (i & sign_bit) {
+            i = ~i;
+        } else {
+            i |= sign_bit;
+        }
+        write_comparable_byte(out, comparable_nonempty);
+        i = net::hton(i);
+        out.write(reinterpret_cast<const char*>(&i), sizeof(i));
+    }
     virtual void validate(bytes_view v) const override {
         if (v.size() != 0 && v.size() != sizeof(T)) {
             throw marshal_exception();
@@ -1353,6 +1582,29 @@ class varint_type_impl : public concrete_type<boost::multiprecision::cpp_int> {
     virtual bool less(bytes_view v1, bytes_view v2) const override {
         return compare(v1, v2) < 0;
     }
+    virtual bool is_byte_comparable() const override {
+        return true;
+    }
+    // The sign, then the length of the magnitude and the magnitude.
+    virtual void serialize_comparable(bytes_view v, bytes_ostream& out) const override {
+        if (v.empty()) {
+            write_comparable_byte(out, comparable_empty);
+            return;
+        }
+        auto num = from_value(deserialize(v)).get();
+        serialize_comparable_signed(num.sign(), out, [&num] (bytes_ostream& out) {
+            boost::multiprecision::cpp_int pnum = boost::multiprecision::abs(num);
+            std::vector<int8_t> magnitude;
+            while (pnum) {
+                magnitude.push_back(int8_t(uint8_t(boost::multiprecision::integer_modulus(pnum, 256))));
+                pnum >>= 8;
+            }
+            std::reverse(magnitude.begin(), magnitude.end());
+            auto size = net::hton(uint32_t(magnitude.size()));
+            out.write(reinterpret_cast<const char*>(&size), sizeof(size));
+            out.write(bytes_view(magnitude.data(), magnitude.size()));
+        });
+    }
     virtual size_t hash(bytes_view v) const override {
         bytes b(v.begin(), v.end());
         return std::hash<sstring>()(to_string(b));
@@ -1459,6 +1711,32 @@ class decimal_type_impl : public concrete_type<big_decimal> {
     virtual bool less(bytes_view v1, bytes_view v2) const override {
         return compare(v1, v2) < 0;
     }
+    virtual bool is_byte_comparable() const override {
+        return true;
+    }
+    /*
+     * The value, without the trailing zeroes of its unscaled value, is
+     * 0.d1...dn * 10^exponent, with d1 and dn not zero. After the sign come
+     * the exponent, then the digits, terminated, so that values which compare
+     * equal, like 1.0 and 1.00, have the same encoding.
+     */
+    virtual void serialize_comparable(bytes_view v, bytes_ostream& out) const override {
+        if (v.empty()) {
+            write_comparable_byte(out, comparable_empty);
+            return;
+        }
+        auto bd = from_value(deserialize(v)).get();
+        auto& unscaled_value = bd.unscaled_value();
+        serialize_comparable_signed(unscaled_value.sign(), out, [&] (bytes_ostream& out) {
+            auto digits = boost::multiprecision::cpp_int(boost::multiprecision::abs(unscaled_value)).str();
+            write_comparable_int64(out, int64_t(digits.size()) - bd.scale());
+            digits.resize(digits.find_last_not_of('0') + 1);
+            for (auto d : digits) {
+                write_comparable_byte(out, d - '0' + 1);
+            }
+            write_comparable_byte(out, 0);
+        });
+    }
     virtual size_t hash(bytes_view v) const override {
         bytes b(v.begin(), v.end());
         return std::hash<sstring>()(to_string(b));
@@ -1723,6 +2001,11 @@ struct empty_type_impl : abstract_type {
     virtual bool less(bytes_view v1, bytes_view v2) const override {
         return false;
     }
+    virtual bool is_byte_comparable() const override {
+        return true;
+    }
+    virtual void serialize_comparable(bytes_view v, bytes_ostream& out) const override {
+    }
     virtual size_t hash(bytes_view v) const override {
         return 0;
     }
@@ -2362,8 +2645,87 @@ collection_type_impl::serialize_mutation_form_only_live(mutation_view mut, gc_cl
     }));
 }
 
+namespace {
+
+// The serialized form of a collection mutation, split into its header and its
+// cells, which are left serialized.
+struct serialized_mutation_form {
+    bytes_view tomb;
+    std::experimental::optional<api::timestamp_type> tomb_timestamp;
+    uint32_t count;
+    bytes_view cells;
+
+    explicit serialized_mutation_form(bytes_view in) {
+        auto start = in;
+        auto has_tomb = read_simple<bool>(in);
+        if (has_tomb) {
+            tomb_timestamp = read_simple<api::timestamp_type>(in);
+            (void)read_simple<gc_clock::duration::rep>(in);
+        }
+        tomb = bytes_view(start.begin(), in.begin() - start.begin());
+        count = read_simple<uint32_t>(in);
+        cells = in;
+    }
+};
+
+std::pair<bytes_view, atomic_cell_view> read_serialized_cell(bytes_view& in) {
+    auto ksize = read_simple<uint32_t>(in);
+    auto key = read_simple_bytes(in, ksize);
+    auto vsize = read_simple<uint32_t>(in);
+    return std::make_pair(key, atomic_cell_view::from_bytes(read_simple_bytes(in, vsize)));
+}
+
+}
+
+// Appending to a collection, e.g. adding to a list or writing a new key of a
+// map, produces a mutation whose cells all sort after the existing ones. In
+// that case the cells of both sides are copied as they are, without
+// deserializing and serializing them one by one.
+std::experimental::optional<collection_mutation>
+collection_type_impl::try_append(collection_mutation_view a, collection_mutation_view b) const {
+    serialized_mutation_form aa(a.data);
+    serialized_mutation_form bb(b.data);
+    if (!aa.count && !aa.tomb_timestamp) {
+        return collection_mutation(b);
+    }
+    if (!bb.count && !bb.tomb_timestamp) {
+        return collection_mutation(a);
+    }
+    if (bb.tomb_timestamp || !aa.count) {
+        return { };
+    }
+    auto in = aa.cells;
+    bytes_view last_key;
+    for (uint32_t i = 0; i != aa.count; ++i) {
+        last_key = read_serialized_cell(in).first;
+    }
+    in = bb.cells;
+    auto first = read_serialized_cell(in);
+    if (!name_comparator()->less(last_key, first.first)) {
+        return { };
+    }
+    if (aa.tomb_timestamp) {
+        // The tombstone wins if timestamps are equal, see merge().
+        in = bb.cells;
+        for (uint32_t i = 0; i != bb.count; ++i) {
+            if (*aa.tomb_timestamp >= read_serialized_cell(in).second.timestamp()) {
+                return { };
+            }
+        }
+    }
+    bytes ret(bytes::initialized_later(), aa.tomb.size() + 4 + aa.cells.size() + bb.cells.size());
+    auto out = std::copy(aa.tomb.begin(), aa.tomb.end(), ret.begin());
+    serialize_int32(out, aa.count + bb.count);
+    out = std::copy(aa.cells.begin(), aa.cells.end(), out);
+    std::copy(bb.cells.begin(), bb.cells.end(), out);
+    return collection_mutation{std::move(ret)};
+}
+
 collection_mutation
 collection_type_impl::merge(collection_mutation_view a, collection_mutation_view b) const {
+    if (auto appended = try_append(a, b)) {
+        return std::move(*appended);
+    }
     auto aa = deserialize_mutation_form(a);
     auto bb = deserialize_mutation_form(b);
     mutation_view merged;
@@ -3250,6 +3612,28 @@ thread_local const shared_ptr<const abstract_type> counter_type(make_shared<coun
 thread_local const shared_ptr<const abstract_type> duration_type(make_shared<duration_type_impl>());
 thread_local const data_type empty_type(make_shared<empty_type_impl>());
 
+int32_t abstract_type::compare(managed_bytes_view v1, managed_bytes_view v2) const {
+    if (is_byte_order_comparable()) {
+        return compare_unsigned(v1, v2);
+    }
+    return v1.with_linearized([this, v2] (bytes_view l1) {
+        return v2.with_linearized([this, l1] (bytes_view l2) {
+            return compare(l1, l2);
+        });
+    });
+}
+
+bool abstract_type::equal(managed_bytes_view v1, managed_bytes_view v2) const {
+    if (is_byte_order_equal()) {
+        return v1 == v2;
+    }
+    return v1.with_linearized([this, v2] (bytes_view l1) {
+        return v2.with_linearized([this, l1] (bytes_view l2) {
+            return equal(l1, l2);
+        });
+    });
+}
+
 data_type abstract_type::parse_type(const sstring& name)
 {
     static thread_local const std::unordered_map<sstring, data_type> types = {
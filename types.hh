@@ -21,6 +21,7 @@
 
 #pragma once
 
+#include <algorithm>
 #include <experimental/optional>
 #include <boost/functional/hash.hpp>
 #include <iosfwd>
@@ -50,6 +51,7 @@
 
 class tuple_type_impl;
 class big_decimal;
+class bytes_ostream;
 
 namespace cql3 {
 
@@ -225,6 +227,21 @@ inline int32_t compare_unsigned(bytes_view v1, bytes_view v2) {
     return (int32_t) (v1.size() - v2.size());
 }
 
+inline int32_t compare_unsigned(managed_bytes_view v1, managed_bytes_view v2) {
+    while (!v1.empty() && !v2.empty()) {
+        auto f1 = v1.current_fragment();
+        auto f2 = v2.current_fragment();
+        auto now = std::min(f1.size(), f2.size());
+        auto n = memcmp(f1.begin(), f2.begin(), now);
+        if (n) {
+            return n;
+        }
+        v1.remove_prefix(now);
+        v2.remove_prefix(now);
+    }
+    return (int32_t) (v1.size() - v2.size());
+}
+
 struct empty_t {};
 
 class empty_value_exception : public std::exception {
@@ -437,6 +454,10 @@ class abstract_type : public enable_shared_from_this<abstract_type> {
             return 0;
         }
     }
+    // Fragmented values are compared fragment by fragment when the type allows it,
+    // and linearized otherwise.
+    int32_t compare(managed_bytes_view v1, managed_bytes_view v2) const;
+    bool equal(managed_bytes_view v1, managed_bytes_view v2) const;
     virtual data_value deserialize(bytes_view v) const = 0;
     data_value deserialize_value(bytes_view v) const {
         return deserialize(v);
@@ -518,6 +539,33 @@ class abstract_type : public enable_shared_from_this<abstract_type> {
         // If we're byte order comparable, then we must also be byte order equal.
         return is_byte_order_comparable();
     }
+    // How serialized values of this type compare, for the comparators which
+    // compare the common types inline, see component_tri_compare.
+    enum class comparison_kind {
+        generic,
+        // As unsigned bytes.
+        bytes,
+        // As big endian two's complement integers.
+        signed_integer,
+        timeuuid,
+    };
+    virtual comparison_kind comparison() const {
+        return is_byte_order_comparable() ? comparison_kind::bytes : comparison_kind::generic;
+    }
+    // Whether values of this type have a byte comparable form, see below.
+    virtual bool is_byte_comparable() const {
+        return false;
+    }
+    /**
+     * Appends the byte comparable form of v to out: an encoding such that
+     * comparing the encodings of two values as unsigned bytes gives the
+     * result of compare(). Values which compare equal have the same encoding,
+     * and no encoding is a prefix of another one, so encodings can be
+     * concatenated.
+     *
+     * Only defined when is_byte_comparable().
+     */
+    virtual void serialize_comparable(bytes_view v, bytes_ostream& out) const;
     virtual sstring get_string(const bytes& b) const {
         validate(b);
         return to_string(b);
@@ -713,6 +761,35 @@ bool optional_equal(data_type t, bytes_view_opt e1, bytes_view_opt e2) {
     return t->equal(*e1, *e2);
 }
 
+// Compares serialized timeuuids by their timestamp, then by their bytes
+// as signed ones.
+inline
+int timeuuid_tri_compare(bytes_view o1, bytes_view o2) {
+    if (o1.empty()) {
+        return o2.empty() ? 0 : -1;
+    }
+    if (o2.empty()) {
+        return 1;
+    }
+    // Time high, mid and low, without the version.
+    static constexpr unsigned timestamp_bytes[] = { 6, 7, 4, 5, 0, 1, 2, 3 };
+    for (auto pos : timestamp_bytes) {
+        auto mask = pos == 6 ? 0xf : 0xff;
+        int d = (o1[pos] & mask) - (o2[pos] & mask);
+        if (d) {
+            return d;
+        }
+    }
+    auto m = std::mismatch(o1.begin(), o1.end(), o2.begin(), o2.end());
+    if (m.first == o1.end()) {
+        return m.second == o2.end() ? 0 : -1;
+    }
+    if (m.second == o2.end()) {
+        return 1;
+    }
+    return *m.first < *m.second ? -1 : 1;
+}
+
 static inline
 bool less_compare(data_type t, bytes_view e1, bytes_view e2) {
     return t->less(e1, e2);
@@ -806,6 +883,9 @@ class collection_type_impl : public abstract_type {
     static collection_mutation serialize_mutation_form(mutation_view mut);
     static collection_mutation serialize_mutation_form_only_live(mutation_view mut, gc_clock::time_point now);
     collection_mutation merge(collection_mutation_view a, collection_mutation_view b) const;
+private:
+    std::experimental::optional<collection_mutation> try_append(collection_mutation_view a, collection_mutation_view b) const;
+public:
     collection_mutation difference(collection_mutation_view a, collection_mutation_view b) const;
     // Calls Func(atomic_cell_view) for each cell in this collection.
     // noexcept if Func doesn't throw.
@@ -931,6 +1011,14 @@ class reversed_type_impl : public abstract_type {
     virtual bool is_byte_order_equal() const override {
         return _underlying_type->is_byte_order_equal();
     }
+    // The order is that of underlying_type(), reversed.
+    virtual comparison_kind comparison() const override {
+        return comparison_kind::generic;
+    }
+    virtual bool is_byte_comparable() const override {
+        return _underlying_type->is_byte_comparable();
+    }
+    virtual void serialize_comparable(bytes_view v, bytes_ostream& out) const override;
     virtual size_t hash(bytes_view v) const override {
         return _underlying_type->hash(v);
     }
@@ -0,0 +1,91 @@
+/*
+ * Copyright (C) 2017 ScyllaDB
+ */
+
+/*
+ * This file is part of Scylla.
+ *
+ * Scylla is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Scylla is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "adler32.hh"
+#include <algorithm>
+#include <tmmintrin.h>
+
+namespace utils {
+
+namespace {
+
+constexpr uint32_t base = 65521;
+// The largest number of bytes after which s2 may still fit in 32 bits,
+// from zlib.
+constexpr size_t nmax = 5552;
+constexpr size_t block = 32;
+
+}
+
+/*
+ * For a block of 32 bytes b[0..31], s1 grows by their sum, and s2 by
+ * 32 * s1 plus the sum of (32 - i) * b[i]. The sums are done on vectors
+ * of bytes, and reduced modulo base once per nmax bytes, as zlib does.
+ */
+uint32_t adler32(uint32_t adler, const uint8_t* in, size_t size) {
+    uint32_t s1 = adler & 0xffff;
+    uint32_t s2 = adler >> 16;
+
+    const __m128i weights_high = _mm_setr_epi8(32, 31, 30, 29, 28, 27, 26, 25, 24, 23, 22, 21, 20, 19, 18, 17);
+    const __m128i weights_low = _mm_setr_epi8(16, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1);
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i ones = _mm_set1_epi16(1);
+
+    auto blocks = size / block;
+    size -= blocks * block;
+    while (blocks) {
+        auto n = std::min(blocks, nmax / block);
+        blocks -= n;
+        // The sum of the s1 of each block before it, times 32 at the end.
+        __m128i v_ps = _mm_setr_epi32(s1 * n, 0, 0, 0);
+        __m128i v_s1 = zero;
+        __m128i v_s2 = _mm_setr_epi32(s2, 0, 0, 0);
+        do {
+            auto b1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in));
+            auto b2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + 16));
+            v_ps = _mm_add_epi32(v_ps, v_s1);
+            v_s1 = _mm_add_epi32(v_s1, _mm_sad_epu8(b1, zero));
+            v_s1 = _mm_add_epi32(v_s1, _mm_sad_epu8(b2, zero));
+            v_s2 = _mm_add_epi32(v_s2, _mm_madd_epi16(_mm_maddubs_epi16(b1, weights_high), ones));
+            v_s2 = _mm_add_epi32(v_s2, _mm_madd_epi16(_mm_maddubs_epi16(b2, weights_low), ones));
+            in += block;
+        } while (--n);
+        v_s2 = _mm_add_epi32(v_s2, _mm_slli_epi32(v_ps, 5));
+
+        v_s1 = _mm_add_epi32(v_s1, _mm_shuffle_epi32(v_s1, _MM_SHUFFLE(2, 3, 0, 1)));
+        v_s1 = _mm_add_epi32(v_s1, _mm_shuffle_epi32(v_s1, _MM_SHUFFLE(1, 0, 3, 2)));
+        s1 += _mm_cvtsi128_si32(v_s1);
+        v_s2 = _mm_add_epi32(v_s2, _mm_shuffle_epi32(v_s2, _MM_SHUFFLE(2, 3, 0, 1)));
+        v_s2 = _mm_add_epi32(v_s2, _mm_shuffle_epi32(v_s2, _MM_SHUFFLE(1, 0, 3, 2)));
+        s2 = _mm_cvtsi128_si32(v_s2);
+
+        s1 %= base;
+        s2 %= base;
+    }
+
+    while (size--) {
+        s1 += *in++;
+        s2 += s1;
+    }
+    return (s1 % base) | ((s2 % base) << 16);
+}
+
+}
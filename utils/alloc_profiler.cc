@@ -0,0 +1,71 @@
+/*
+ * Copyright (C) 2018 ScyllaDB
+ */
+
+/*
+ * This file is part of Scylla.
+ *
+ * Scylla is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Scylla is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <execinfo.h>
+#include "utils/alloc_profiler.hh"
+#include "core/memory.hh"
+#include "core/print.hh"
+
+namespace utils {
+
+// Beyond that many distinct stacks per shard, new ones are folded into their context.
+static constexpr size_t max_stacks = 10000;
+static constexpr int max_frames = 32;
+
+void alloc_profiler::enable(uint64_t sample_every) {
+    _stacks.clear();
+    _sample_every = std::max<uint64_t>(sample_every, 1);
+    _until_sample = _sample_every;
+    _current = task_context::other;
+    _mark = memory::stats().mallocs();
+    _enabled = true;
+}
+
+void alloc_profiler::disable() {
+    _enabled = false;
+}
+
+void alloc_profiler::account() {
+    auto mallocs = memory::stats().mallocs();
+    _until_sample -= mallocs - _mark;
+    while (_until_sample <= 0) {
+        sample();
+        _until_sample += _sample_every;
+    }
+    // The samples allocate too; don't count that against anyone.
+    _mark = memory::stats().mallocs();
+}
+
+void alloc_profiler::sample() {
+    void* frames[max_frames];
+    auto n = ::backtrace(frames, max_frames);
+    sstring stack = to_string(_current);
+    // Root first, skipping account() and sample().
+    for (auto i = n - 1; i >= 2; --i) {
+        stack += sprint(";%p", frames[i]);
+    }
+    if (_stacks.size() >= max_stacks && !_stacks.count(stack)) {
+        stack = to_string(_current);
+    }
+    _stacks[stack] += _sample_every;
+}
+
+}
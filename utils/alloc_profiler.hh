@@ -0,0 +1,79 @@
+/*
+ * Copyright (C) 2018 ScyllaDB
+ */
+
+/*
+ * This file is part of Scylla.
+ *
+ * Scylla is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Scylla is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <unordered_map>
+#include <utility>
+#include "core/sstring.hh"
+#include "seastarx.hh"
+#include "utils/task_context.hh"
+
+namespace utils {
+
+// Attributes the allocations of each shard to the task_context of the code
+// making them, sampling one in sample_every of them with the backtrace of the
+// code, so that the subsystems churning the allocator can be told apart.
+//
+// The allocator can't be hooked, so the allocations are counted from the
+// allocator's statistics when the context changes, and a sample is the
+// backtrace of the code switching out of the context in which the sampled
+// allocation happened: the stacks are those of the task_context_guard
+// scopes, not of the allocations themselves.
+//
+// Costs a thread-local check per guard when disabled.
+class alloc_profiler {
+public:
+    // Folded stack, rooted at the context name -> estimated allocations.
+    using stacks = std::unordered_map<sstring, uint64_t>;
+private:
+    bool _enabled = false;
+    uint64_t _sample_every = 0;
+    int64_t _until_sample = 0;
+    task_context _current = task_context::other;
+    uint64_t _mark = 0;
+    stacks _stacks;
+private:
+    void account();
+    void sample();
+public:
+    static alloc_profiler& local() {
+        static thread_local alloc_profiler profiler;
+        return profiler;
+    }
+
+    bool enabled() const {
+        return _enabled;
+    }
+    // Drops the stacks collected so far.
+    void enable(uint64_t sample_every);
+    void disable();
+    const stacks& get_stacks() const {
+        return _stacks;
+    }
+
+    task_context switch_to(task_context ctx) {
+        account();
+        return std::exchange(_current, ctx);
+    }
+};
+
+}
@@ -78,7 +78,11 @@ bool bloom_filter::is_present(hashed_key key) {
 }
 
 void bloom_filter::add(const bytes_view& key) {
-    for_each_index(make_hashed_key(key), _hash_count, _bitset.size(), [this] (auto i) {
+    add(make_hashed_key(key));
+}
+
+void bloom_filter::add(hashed_key key) {
+    for_each_index(key, _hash_count, _bitset.size(), [this] (auto i) {
         _bitset.set(i);
         return stop_iteration::no;
     });
@@ -88,11 +92,64 @@ bool bloom_filter::is_present(const bytes_view& key) {
     return is_present(make_hashed_key(key));
 }
 
-filter_ptr create_filter(int hash, large_bitset&& bitset) {
+size_t blocked_bloom_filter::block_of(hashed_key key) const {
+    auto nr_blocks = _bitset.size() / block_bits;
+    return (key.hash()[0] % nr_blocks) * block_bits;
+}
+
+blocked_bloom_filter::block_mask blocked_bloom_filter::make_mask(hashed_key key) const {
+    auto h = key.hash();
+    // h[0] picked the block, derive the in-block positions from the rest.
+    uint32_t base = h[1];
+    uint32_t inc = (h[1] >> 32) | 1;
+    block_mask mask = {};
+    for (int i = 0; i < _hash_count; i++) {
+        auto bit = base % block_bits;
+        mask[bit / 64] |= uint64_t(1) << (bit % 64);
+        base += inc;
+    }
+    return mask;
+}
+
+bool blocked_bloom_filter::is_present(hashed_key key) {
+    auto mask = make_mask(key);
+    auto words = _bitset.int_at(block_of(key));
+    uint64_t missing = 0;
+    for (size_t i = 0; i < block_ints; i++) {
+        missing |= mask[i] & ~words[i];
+    }
+    return !missing;
+}
+
+void blocked_bloom_filter::add(const bytes_view& key) {
+    add(make_hashed_key(key));
+}
+
+void blocked_bloom_filter::add(hashed_key hk) {
+    auto mask = make_mask(hk);
+    auto words = _bitset.int_at(block_of(hk));
+    for (size_t i = 0; i < block_ints; i++) {
+        words[i] |= mask[i];
+    }
+}
+
+bool blocked_bloom_filter::is_present(const bytes_view& key) {
+    return is_present(make_hashed_key(key));
+}
+
+filter_ptr create_filter(int hash, large_bitset&& bitset, filter_format format) {
+    if (format == filter_format::blocked) {
+        return std::make_unique<blocked_bloom_filter>(hash, std::move(bitset));
+    }
     return std::make_unique<murmur3_bloom_filter>(hash, std::move(bitset));
 }
 
-filter_ptr create_filter(int hash, int64_t num_elements, int buckets_per) {
+filter_ptr create_filter(int hash, int64_t num_elements, int buckets_per, filter_format format) {
+    if (format == filter_format::blocked) {
+        int64_t num_bits = num_elements * (buckets_per + 1);
+        large_bitset bitset(align_up<int64_t>(std::max<int64_t>(num_bits, 1), blocked_bloom_filter::block_bits));
+        return std::make_unique<blocked_bloom_filter>(hash, std::move(bitset));
+    }
     int64_t num_bits = (num_elements * buckets_per) + bloom_calculations::EXCESS;
     num_bits = align_up<int64_t>(num_bits, 64);  // Seems to be implied in origin
     large_bitset bitset(num_bits);
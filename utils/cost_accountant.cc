@@ -0,0 +1,157 @@
+/*
+ * Copyright (C) 2018 ScyllaDB
+ */
+
+/*
+ * This file is part of Scylla.
+ *
+ * Scylla is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Scylla is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "utils/cost_accountant.hh"
+#include "core/metrics.hh"
+
+namespace utils {
+
+cost_accountant::usage_ptr cost_accountant::table(const utils::UUID& id) {
+    auto& u = _tables[id];
+    if (!u) {
+        u = make_lw_shared<usage>();
+    }
+    return u;
+}
+
+void cost_accountant::forget_table(const utils::UUID& id) {
+    auto it = _tables.find(id);
+    if (it == _tables.end()) {
+        return;
+    }
+    if (_table.u == it->second.get()) {
+        switch_to(_table, nullptr, clock::now());
+    }
+    _tables.erase(it);
+}
+
+cost_accountant::usage_ptr cost_accountant::role(const sstring& name) {
+    auto& u = _roles[name];
+    if (!u) {
+        u = make_lw_shared<usage>();
+        register_role_metrics(name, u);
+    }
+    return u;
+}
+
+void cost_accountant::register_role_metrics(const sstring& role, const usage_ptr& u) {
+    namespace sm = seastar::metrics;
+    static const sm::label role_label("role");
+    auto r = role_label(role);
+    _metrics.add_group("role", {
+        sm::make_derive("cpu_time_us", [u] { return std::chrono::duration_cast<std::chrono::microseconds>(u->cpu_time).count(); },
+                sm::description("Microseconds spent in the synchronous sections of the CQL requests of the role"))(r),
+        sm::make_derive("requests", [u] { return u->requests; },
+                sm::description("CQL requests of the role"))(r),
+        sm::make_derive("request_bytes", [u] { return u->request_bytes; },
+                sm::description("Bytes of the frames of the CQL requests of the role"))(r),
+        sm::make_derive("response_bytes", [u] { return u->response_bytes; },
+                sm::description("Bytes of the frames of the CQL responses to the role"))(r),
+    });
+}
+
+class cost_accounting_file_impl : public file_impl {
+    file _file;
+    cost_accountant::usage_ptr _usage;
+private:
+    future<size_t> account_read(future<size_t> f) {
+        return f.then([u = _usage] (size_t ret) {
+            u->read_bytes += ret;
+            return ret;
+        });
+    }
+    future<size_t> account_write(future<size_t> f) {
+        return f.then([u = _usage] (size_t ret) {
+            u->written_bytes += ret;
+            return ret;
+        });
+    }
+public:
+    cost_accounting_file_impl(file f, cost_accountant::usage_ptr u)
+        : _file(std::move(f))
+        , _usage(std::move(u)) {
+    }
+
+    virtual future<size_t> write_dma(uint64_t pos, const void* buffer, size_t len, const io_priority_class& pc) override {
+        return account_write(get_file_impl(_file)->write_dma(pos, buffer, len, pc));
+    }
+
+    virtual future<size_t> write_dma(uint64_t pos, std::vector<iovec> iov, const io_priority_class& pc) override {
+        return account_write(get_file_impl(_file)->write_dma(pos, std::move(iov), pc));
+    }
+
+    virtual future<size_t> read_dma(uint64_t pos, void* buffer, size_t len, const io_priority_class& pc) override {
+        return account_read(get_file_impl(_file)->read_dma(pos, buffer, len, pc));
+    }
+
+    virtual future<size_t> read_dma(uint64_t pos, std::vector<iovec> iov, const io_priority_class& pc) override {
+        return account_read(get_file_impl(_file)->read_dma(pos, std::move(iov), pc));
+    }
+
+    virtual future<> flush(void) override {
+        return get_file_impl(_file)->flush();
+    }
+
+    virtual future<struct stat> stat(void) override {
+        return get_file_impl(_file)->stat();
+    }
+
+    virtual future<> truncate(uint64_t length) override {
+        return get_file_impl(_file)->truncate(length);
+    }
+
+    virtual future<> discard(uint64_t offset, uint64_t length) override {
+        return get_file_impl(_file)->discard(offset, length);
+    }
+
+    virtual future<> allocate(uint64_t position, uint64_t length) override {
+        return get_file_impl(_file)->allocate(position, length);
+    }
+
+    virtual future<uint64_t> size(void) override {
+        return get_file_impl(_file)->size();
+    }
+
+    virtual future<> close() override {
+        return get_file_impl(_file)->close();
+    }
+
+    virtual std::unique_ptr<file_handle_impl> dup() override {
+        return get_file_impl(_file)->dup();
+    }
+
+    virtual subscription<directory_entry> list_directory(std::function<future<> (directory_entry de)> next) override {
+        return get_file_impl(_file)->list_directory(std::move(next));
+    }
+
+    virtual future<temporary_buffer<uint8_t>> dma_read_bulk(uint64_t offset, size_t range_size, const io_priority_class& pc) override {
+        return get_file_impl(_file)->dma_read_bulk(offset, range_size, pc).then([u = _usage] (temporary_buffer<uint8_t> buf) {
+            u->read_bytes += buf.size();
+            return buf;
+        });
+    }
+};
+
+file make_cost_accounting_file(file f, cost_accountant::usage_ptr u) {
+    return file(make_shared<cost_accounting_file_impl>(std::move(f), std::move(u)));
+}
+
+}
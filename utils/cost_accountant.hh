@@ -0,0 +1,139 @@
+/*
+ * Copyright (C) 2018 ScyllaDB
+ */
+
+/*
+ * This file is part of Scylla.
+ *
+ * Scylla is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Scylla is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <unordered_map>
+#include "core/file.hh"
+#include "core/metrics_registration.hh"
+#include "core/shared_ptr.hh"
+#include "core/sstring.hh"
+#include "seastarx.hh"
+#include "utils/UUID.hh"
+
+namespace utils {
+
+// Attributes the time each shard spends running code, and the bytes its
+// sstables read and write, to the table and to the role the work is for, so
+// that the tables and the tenants loading a node can be told apart.
+//
+// The reactor can't be hooked, so only the synchronous sections within a
+// cost_guard are charged, like those of a task_context_guard: the CQL
+// requests up to their first wait, the database's writes and the reads of
+// its tables, compaction and memtable flushes. Within the guard of a table,
+// or of a role, the guard of another one charges its own time to it only.
+//
+// The usage of tables is exported by them, that of roles as the role
+// metrics, labelled by role.
+class cost_accountant {
+public:
+    using clock = std::chrono::steady_clock;
+    struct usage {
+        clock::duration cpu_time = clock::duration::zero();
+        uint64_t read_bytes = 0;
+        uint64_t written_bytes = 0;
+        // Of roles: the CQL requests, and the size of their frames.
+        uint64_t requests = 0;
+        uint64_t request_bytes = 0;
+        uint64_t response_bytes = 0;
+    };
+    using usage_ptr = lw_shared_ptr<usage>;
+private:
+    // The usage being charged in a dimension, table or role, since when.
+    struct current {
+        usage* u = nullptr;
+        clock::time_point since;
+    };
+    std::unordered_map<utils::UUID, usage_ptr> _tables;
+    std::unordered_map<sstring, usage_ptr> _roles;
+    current _table;
+    current _role;
+    seastar::metrics::metric_groups _metrics;
+private:
+    static usage* switch_to(current& c, usage* u, clock::time_point now) {
+        if (c.u) {
+            c.u->cpu_time += now - c.since;
+        }
+        c.since = now;
+        return std::exchange(c.u, u);
+    }
+    void register_role_metrics(const sstring& role, const usage_ptr& u);
+public:
+    static cost_accountant& local() {
+        static thread_local cost_accountant accountant;
+        return accountant;
+    }
+
+    // The usage of the table, which the accountant keeps until
+    // forget_table(), and whoever holds it afterwards.
+    usage_ptr table(const utils::UUID& id);
+    void forget_table(const utils::UUID& id);
+    // Null when the table isn't known.
+    usage_ptr find_table(const utils::UUID& id) const {
+        auto it = _tables.find(id);
+        return it != _tables.end() ? it->second : usage_ptr();
+    }
+
+    usage_ptr role(const sstring& name);
+
+    struct state {
+        usage* table;
+        usage* role;
+    };
+
+    // Charges the time from now on to the given usages, those not null, and
+    // returns the ones charged until now.
+    state enter(usage* table, usage* role) {
+        auto now = clock::now();
+        return state{table ? switch_to(_table, table, now) : _table.u, role ? switch_to(_role, role, now) : _role.u};
+    }
+    void leave(const state& previous) {
+        auto now = clock::now();
+        if (_table.u != previous.table) {
+            switch_to(_table, previous.table, now);
+        }
+        if (_role.u != previous.role) {
+            switch_to(_role, previous.role, now);
+        }
+    }
+};
+
+// Charges the synchronous section it spans to a table, a role, or both. It
+// mustn't span a preemption point, as the time of the other tasks run then
+// would be charged too.
+class cost_guard {
+    cost_accountant::state _previous;
+public:
+    explicit cost_guard(cost_accountant::usage* table, cost_accountant::usage* role = nullptr)
+        : _previous(cost_accountant::local().enter(table, role)) {
+    }
+    ~cost_guard() {
+        cost_accountant::local().leave(_previous);
+    }
+    cost_guard(const cost_guard&) = delete;
+    cost_guard& operator=(const cost_guard&) = delete;
+};
+
+// Wraps f so that the bytes read from it and written to it are added to u.
+file make_cost_accounting_file(file f, cost_accountant::usage_ptr u);
+
+}
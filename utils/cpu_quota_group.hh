@@ -0,0 +1,109 @@
+/*
+ * Copyright (C) 2017 ScyllaDB
+ */
+
+/*
+ * This file is part of Scylla.
+ *
+ * Scylla is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Scylla is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+
+namespace utils {
+
+/**
+ * A share of the CPU for a kind of background work which runs as
+ * continuations, which seastar::thread_scheduling_group can't limit as it
+ * only applies to threads.
+ *
+ * The work accounts the time it runs, and asks before running more how long
+ * to wait for its time to be within quota times the time elapsed since the
+ * start of the current period. A period ends once the work is within its
+ * quota after it, so that idling doesn't bank more than a period worth of
+ * time. A quota of one or more means no limit.
+ */
+template <typename Clock = std::chrono::steady_clock>
+class cpu_quota_group {
+public:
+    using clock = Clock;
+    using time_point = typename clock::time_point;
+    using duration = typename clock::duration;
+private:
+    duration _period;
+    double _quota;
+    time_point _period_start;
+    duration _used{0};
+    duration _runtime{0};
+public:
+    cpu_quota_group(duration period, double quota, time_point now = clock::now())
+        : _period(period)
+        , _quota(quota)
+        , _period_start(now)
+    { }
+
+    double quota() const {
+        return _quota;
+    }
+
+    void set_quota(double quota) {
+        _quota = quota;
+    }
+
+    // The time accounted so far.
+    duration runtime() const {
+        return _runtime;
+    }
+
+    void account(duration d) {
+        _used += d;
+        _runtime += d;
+    }
+
+    // Runs func, accounting the time it takes to return. For functions
+    // returning a future, that's the part which runs before they defer.
+    template <typename Func>
+    auto run(Func&& func) {
+        struct accounter {
+            cpu_quota_group& g;
+            time_point start = clock::now();
+            ~accounter() {
+                g.account(clock::now() - start);
+            }
+        } a{*this};
+        return func();
+    }
+
+    // How long to wait before running more.
+    duration delay(time_point now = clock::now()) {
+        if (_quota >= 1 || _quota <= 0) {
+            return duration(0);
+        }
+        auto elapsed = now - _period_start;
+        auto allowed = std::chrono::duration_cast<duration>(elapsed * _quota);
+        if (_used > allowed) {
+            return std::chrono::duration_cast<duration>(_used / _quota) - elapsed;
+        }
+        if (elapsed >= _period) {
+            _period_start = now;
+            _used = duration(0);
+        }
+        return duration(0);
+    }
+};
+
+}
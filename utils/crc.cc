@@ -0,0 +1,129 @@
+/*
+ * Copyright (C) 2017 ScyllaDB
+ */
+
+/*
+ * This file is part of Scylla.
+ *
+ * Scylla is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Scylla is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "crc.hh"
+
+namespace utils {
+
+namespace {
+
+// The reflected CRC32C polynomial, which the crc32 instruction uses.
+constexpr uint32_t polynomial = 0x82f63b78;
+
+uint32_t gf2_matrix_times(const uint32_t* mat, uint32_t vec) {
+    uint32_t sum = 0;
+    while (vec) {
+        if (vec & 1) {
+            sum ^= *mat;
+        }
+        vec >>= 1;
+        ++mat;
+    }
+    return sum;
+}
+
+void gf2_matrix_square(uint32_t* square, const uint32_t* mat) {
+    for (unsigned n = 0; n < 32; ++n) {
+        square[n] = gf2_matrix_times(mat, mat[n]);
+    }
+}
+
+/*
+ * The crc of a buffer A followed by a buffer B of len bytes is the crc of
+ * A followed by len zero bytes, xor the crc of B started from zero. Feeding
+ * len zero bytes to a crc is linear, so it is done by a table per byte of
+ * the crc, instead of len / 8 dependent crc32 instructions.
+ */
+class zeros_operator {
+    uint32_t _table[4][256];
+public:
+    // len must be a power of two.
+    explicit zeros_operator(size_t len) {
+        uint32_t even[32];
+        uint32_t odd[32];
+        // One zero bit.
+        odd[0] = polynomial;
+        for (unsigned n = 1; n < 32; ++n) {
+            odd[n] = uint32_t(1) << (n - 1);
+        }
+        gf2_matrix_square(even, odd);
+        gf2_matrix_square(odd, even);
+        // odd feeds four zero bits, square it up to len bytes.
+        uint32_t* op = odd;
+        for (bool to_even = true; ; to_even = !to_even) {
+            if (to_even) {
+                gf2_matrix_square(even, odd);
+                op = even;
+            } else {
+                gf2_matrix_square(odd, even);
+                op = odd;
+            }
+            len >>= 1;
+            if (!len) {
+                break;
+            }
+        }
+        for (uint32_t n = 0; n < 256; ++n) {
+            _table[0][n] = gf2_matrix_times(op, n);
+            _table[1][n] = gf2_matrix_times(op, n << 8);
+            _table[2][n] = gf2_matrix_times(op, n << 16);
+            _table[3][n] = gf2_matrix_times(op, n << 24);
+        }
+    }
+
+    uint32_t operator()(uint32_t crc) const {
+        return _table[0][crc & 0xff] ^ _table[1][(crc >> 8) & 0xff]
+             ^ _table[2][(crc >> 16) & 0xff] ^ _table[3][crc >> 24];
+    }
+};
+
+template <size_t Block>
+inline uint32_t process_triple(uint32_t crc, const uint8_t* in, const zeros_operator& shift) {
+    uint64_t crc0 = crc;
+    uint64_t crc1 = 0;
+    uint64_t crc2 = 0;
+    for (auto end = in + Block; in != end; in += 8) {
+        crc0 = _mm_crc32_u64(crc0, *reinterpret_cast<const uint64_t*>(in));
+        crc1 = _mm_crc32_u64(crc1, *reinterpret_cast<const uint64_t*>(in + Block));
+        crc2 = _mm_crc32_u64(crc2, *reinterpret_cast<const uint64_t*>(in + 2 * Block));
+    }
+    crc0 = shift(crc0) ^ crc1;
+    return shift(crc0) ^ crc2;
+}
+
+}
+
+void crc32::process_interleaved(const uint8_t*& in, size_t& size) {
+    static const zeros_operator long_shift(long_block);
+    static const zeros_operator short_shift(short_block);
+    while (size >= 3 * long_block) {
+        _r = process_triple<long_block>(_r, in, long_shift);
+        in += 3 * long_block;
+        size -= 3 * long_block;
+    }
+    while (size >= 3 * short_block) {
+        _r = process_triple<short_block>(_r, in, short_shift);
+        in += 3 * short_block;
+        size -= 3 * short_block;
+    }
+}
+
+}
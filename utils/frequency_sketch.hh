@@ -0,0 +1,105 @@
+/*
+ * Copyright (C) 2017 ScyllaDB
+ */
+
+/*
+ * This file is part of Scylla.
+ *
+ * Scylla is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Scylla is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <vector>
+
+namespace utils {
+
+/**
+ * Approximate access frequency counter (count-min sketch).
+ *
+ * Each key is counted in one small saturating counter per row, the
+ * estimate being the minimum over the rows. Once as many increments as
+ * ten times the width were recorded, all counters are halved, so the
+ * sketch tracks recent popularity rather than all-time popularity.
+ */
+class frequency_sketch {
+public:
+    static constexpr unsigned depth = 4;
+    static constexpr uint8_t max_count = 15;
+private:
+    std::vector<uint8_t> _counters;
+    uint64_t _mask;
+    uint64_t _increments = 0;
+    uint64_t _sample_size;
+private:
+    static constexpr std::array<uint64_t, depth> seeds() {
+        return {{ 0xc3a5c85c97cb3127ULL, 0xb492b66fbe98f273ULL, 0x9ae16a3b2f90404fULL, 0xcbf29ce484222325ULL }};
+    }
+
+    size_t index_of(uint64_t hash, unsigned row) const {
+        uint64_t h = (hash + seeds()[row]) * seeds()[(row + 1) % depth];
+        h ^= h >> 32;
+        return row * (_mask + 1) + (h & _mask);
+    }
+
+    void age() {
+        for (auto& c : _counters) {
+            c >>= 1;
+        }
+        _increments /= 2;
+    }
+public:
+    // Width is rounded up to a power of two.
+    explicit frequency_sketch(size_t width) {
+        size_t w = 1;
+        while (w < std::max<size_t>(width, 16)) {
+            w <<= 1;
+        }
+        _mask = w - 1;
+        _counters.resize(w * depth);
+        _sample_size = w * 10;
+    }
+
+    void increment(uint64_t hash) {
+        bool added = false;
+        for (unsigned row = 0; row < depth; ++row) {
+            auto& c = _counters[index_of(hash, row)];
+            if (c < max_count) {
+                ++c;
+                added = true;
+            }
+        }
+        if (added && ++_increments >= _sample_size) {
+            age();
+        }
+    }
+
+    unsigned estimate(uint64_t hash) const {
+        unsigned ret = max_count;
+        for (unsigned row = 0; row < depth; ++row) {
+            ret = std::min<unsigned>(ret, _counters[index_of(hash, row)]);
+        }
+        return ret;
+    }
+
+    void clear() {
+        std::fill(_counters.begin(), _counters.end(), 0);
+        _increments = 0;
+    }
+};
+
+}
@@ -21,8 +21,8 @@
 
 #pragma once
 
-#include <boost/circular_buffer.hpp>
 #include "latency.hh"
+#include "utils/log_linear_histogram.hh"
 #include <cmath>
 #include "core/timer.hh"
 #include <iosfwd>
@@ -72,13 +72,19 @@ class moving_average {
     }
 };
 
+/**
+ * Statistics of the values, in Unit, of a series of events, usually
+ * latencies, with their distribution in a log_linear_histogram. Every event
+ * is recorded, so they are exact but for the distribution, which is known to
+ * within the precision of log_linear_histogram.
+ */
 template <typename Unit>
 class basic_ihistogram {
 public:
     using duration_unit = Unit;
     // count holds all the events
     int64_t count;
-    // total holds only the events we sample
+    // total holds only the events with a value
     int64_t total;
     int64_t min;
     int64_t max;
@@ -86,16 +92,13 @@ class basic_ihistogram {
     int64_t started;
     double mean;
     double variance;
-    int64_t sample_mask;
-    boost::circular_buffer<int64_t> sample;
-    basic_ihistogram(size_t size = 1024, int64_t _sample_mask = 0x80)
-            : count(0), total(0), min(0), max(0), sum(0), started(0), mean(0), variance(0),
-              sample_mask(_sample_mask), sample(
-                    size) {
+    log_linear_histogram values;
+    basic_ihistogram()
+            : count(0), total(0), min(0), max(0), sum(0), started(0), mean(0), variance(0) {
     }
 
-    template <typename Rep, typename Ratio>
-    void mark(std::chrono::duration<Rep, Ratio> dur) {
+    template <typename Rep, typename Period>
+    void mark(std::chrono::duration<Rep, Period> dur) {
         auto value = std::chrono::duration_cast<Unit>(dur).count();
         if (total == 0 || value < min) {
             min = value;
@@ -116,7 +119,7 @@ class basic_ihistogram {
         sum += value;
         total++;
         count++;
-        sample.push_back(value);
+        values.add(uint64_t(std::max<decltype(value)>(value, 0)));
     }
 
     void mark(latency_counter& lc) {
@@ -128,20 +131,10 @@ class basic_ihistogram {
     }
 
     /**
-     * Return true if the current event should be sample.
-     * In the typical case, there is no need to use this method
-     * Call set_latency, that would start a latency object if needed.
-     */
-    bool should_sample() const {
-        return total == 0 || (started & sample_mask);
-    }
-    /**
-     * Set the latency according to the sample rate.
+     * Start the latency counter of an event, which mark() then records.
      */
     basic_ihistogram& set_latency(latency_counter& lc) {
-        if (should_sample()) {
-            lc.start();
-        }
+        lc.start();
         started++;
         return *this;
     }
@@ -149,7 +142,7 @@ class basic_ihistogram {
     /**
      * Allow to use the histogram as a counter
      * Increment the total number of events without
-     * sampling the value.
+     * recording a value.
      */
     basic_ihistogram& inc() {
         count++;
@@ -186,9 +179,7 @@ class basic_ihistogram {
             mean = m;
             count += o.count;
             total += o.total;
-            for (auto i : o.sample) {
-                sample.push_back(i);
-            }
+            values += o.values;
         }
         return *this;
     }
@@ -307,7 +298,6 @@ class timed_rate_moving_average_and_histogram {
     timed_rate_moving_average_and_histogram() = default;
     timed_rate_moving_average_and_histogram(timed_rate_moving_average_and_histogram&&) = default;
     timed_rate_moving_average_and_histogram(const timed_rate_moving_average_and_histogram&) = default;
-    timed_rate_moving_average_and_histogram(size_t size, int64_t _sample_mask = 0x80) : hist(size, _sample_mask) {}
     timed_rate_moving_average_and_histogram& operator=(const timed_rate_moving_average_and_histogram&) = default;
 
     template <typename Rep, typename Ratio>
@@ -45,6 +45,17 @@
 
 namespace utils {
 
+namespace filter {
+
+enum class filter_format {
+    // k probes spread over the whole bitmap, as in origin.
+    classic,
+    // k probes within a single 512-bit block.
+    blocked,
+};
+
+}
+
 struct i_filter;
 using filter_ptr = std::unique_ptr<i_filter>;
 
@@ -64,6 +75,7 @@ struct i_filter {
     virtual ~i_filter() {}
 
     virtual void add(const bytes_view& key) = 0;
+    virtual void add(hashed_key key) = 0;
     virtual bool is_present(const bytes_view& key) = 0;
     virtual bool is_present(hashed_key) = 0;
     virtual void clear() = 0;
@@ -78,7 +90,8 @@ struct i_filter {
      *         Asserts that the given probability can be satisfied using this
      *         filter.
      */
-    static filter_ptr get_filter(int64_t num_elements, double max_false_pos_prob);
+    static filter_ptr get_filter(int64_t num_elements, double max_false_pos_prob,
+            filter::filter_format format = filter::filter_format::classic);
     /**
      * @return A bloom_filter with the lowest practical false positive
      *         probability for the given number of elements.
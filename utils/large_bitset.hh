@@ -31,8 +31,10 @@
 #include <algorithm>
 
 class large_bitset {
-    static constexpr size_t block_size() { return 128 * 1024; }
+public:
     using int_type = unsigned long;
+private:
+    static constexpr size_t block_size() { return 128 * 1024; }
     static constexpr size_t bits_per_int() {
         return std::numeric_limits<int_type>::digits;
     }
@@ -82,6 +84,19 @@ class large_bitset {
         _storage[idx1][idx2] &= ~(int_type(1) << idx3);
     }
     void clear();
+    // Direct access to the int holding bit idx. The ints following it up to
+    // the next multiple of 128k bytes are contiguous.
+    const int_type* int_at(size_t idx) const {
+        return &_storage[idx / bits_per_block()][idx % bits_per_block() / bits_per_int()];
+    }
+    int_type* int_at(size_t idx) {
+        return &_storage[idx / bits_per_block()][idx % bits_per_block() / bits_per_int()];
+    }
+    // The number of ints, from the one holding bit idx, which are contiguous
+    // from int_at(idx).
+    size_t contiguous_ints_at(size_t idx) const {
+        return ints_per_block() - idx % bits_per_block() / bits_per_int();
+    }
     // load data from host bitmap (in host byte order); returns end bit position
     template <typename IntegerIterator>
     size_t load(IntegerIterator start, IntegerIterator finish, size_t position = 0);
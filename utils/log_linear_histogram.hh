@@ -0,0 +1,243 @@
+/*
+ * Copyright (C) 2018 ScyllaDB
+ */
+
+/*
+ * This file is part of Scylla.
+ *
+ * Scylla is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Scylla is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+#include "core/bitops.hh"
+#include "core/metrics_types.hh"
+#include "utils/estimated_histogram.hh"
+
+namespace utils {
+
+/**
+ * Histogram of non-negative values, usually latencies in microseconds, in
+ * the manner of HdrHistogram: each power of two is split into sub_buckets
+ * linear buckets, so that a value is recorded in a few instructions without
+ * searching, and is known to within 1/sub_buckets of itself. Values up to
+ * 2 * sub_buckets are exact. Values above max_value, over an hour in
+ * microseconds, are recorded as max_value.
+ *
+ * Histograms are merged by adding their buckets, with no further loss, so
+ * the ones of all shards, or of consecutive time windows, can be summed.
+ *
+ * Not thread safe: each shard keeps its own.
+ */
+class log_linear_histogram {
+public:
+    static constexpr unsigned sub_bucket_bits = 3;
+    static constexpr unsigned sub_buckets = 1u << sub_bucket_bits;
+    static constexpr unsigned max_exponent = 31;
+    static constexpr uint64_t max_value = (uint64_t(1) << (max_exponent + 1)) - 1;
+    static constexpr size_t nr_buckets = (max_exponent - sub_bucket_bits + 2) * sub_buckets;
+private:
+    std::array<uint64_t, nr_buckets> _buckets{};
+    uint64_t _count = 0;
+    uint64_t _sum = 0;
+public:
+    // The values of [2^e, 2^(e+1)), for e >= sub_bucket_bits, are shifted
+    // right until sub_bucket_bits + 1 bits remain, whose top one is always
+    // set, so that each power of two takes the sub_buckets buckets following
+    // the previous one.
+    static size_t bucket_of(uint64_t value) {
+        value = std::min(value, max_value);
+        unsigned exponent = 63 - count_leading_zeros(value | sub_buckets);
+        unsigned shift = exponent - sub_bucket_bits;
+        return (size_t(shift) << sub_bucket_bits) + (value >> shift);
+    }
+
+    static uint64_t bucket_lower_bound(size_t i) {
+        if (i < 2 * sub_buckets) {
+            return i;
+        }
+        unsigned shift = (i >> sub_bucket_bits) - 1;
+        return uint64_t((i & (sub_buckets - 1)) | sub_buckets) << shift;
+    }
+
+    static uint64_t bucket_upper_bound(size_t i) {
+        return i + 1 < nr_buckets ? bucket_lower_bound(i + 1) - 1 : max_value;
+    }
+
+    void add(uint64_t value) {
+        _buckets[bucket_of(value)]++;
+        _count++;
+        _sum += value;
+    }
+
+    // Records the latency in microseconds. Negative ones, which a clock
+    // going backwards can produce, count as zero.
+    template <typename Rep, typename Period>
+    void add(std::chrono::duration<Rep, Period> latency) {
+        auto us = std::chrono::duration_cast<std::chrono::microseconds>(latency).count();
+        add(uint64_t(std::max<decltype(us)>(us, 0)));
+    }
+
+    uint64_t count() const {
+        return _count;
+    }
+
+    // The sum of the values recorded, exactly.
+    uint64_t sum() const {
+        return _sum;
+    }
+
+    double mean() const {
+        return _count ? double(_sum) / _count : 0;
+    }
+
+    // perc is in [0, 1]. Returns the upper bound of the bucket of the
+    // value at that rank, zero when the histogram is empty.
+    uint64_t percentile(double perc) const {
+        if (!_count) {
+            return 0;
+        }
+        auto target = std::max<uint64_t>(1, uint64_t(std::ceil(_count * perc)));
+        uint64_t seen = 0;
+        for (size_t i = 0; i < nr_buckets; ++i) {
+            seen += _buckets[i];
+            if (seen >= target) {
+                return bucket_upper_bound(i);
+            }
+        }
+        return max_value;
+    }
+
+    // Bounds of the smallest and largest values recorded, zero when empty.
+    uint64_t min() const {
+        auto it = std::find_if(_buckets.begin(), _buckets.end(), [] (uint64_t c) { return c != 0; });
+        return it == _buckets.end() ? 0 : bucket_lower_bound(it - _buckets.begin());
+    }
+
+    uint64_t max() const {
+        auto it = std::find_if(_buckets.rbegin(), _buckets.rend(), [] (uint64_t c) { return c != 0; });
+        return it == _buckets.rend() ? 0 : bucket_upper_bound(_buckets.rend() - it - 1);
+    }
+
+    void clear() {
+        _buckets.fill(0);
+        _count = 0;
+        _sum = 0;
+    }
+
+    log_linear_histogram& operator+=(const log_linear_histogram& o) {
+        for (size_t i = 0; i < nr_buckets; ++i) {
+            _buckets[i] += o._buckets[i];
+        }
+        _count += o._count;
+        _sum += o._sum;
+        return *this;
+    }
+
+    // The difference with an earlier state of the same histogram: the values
+    // recorded since then.
+    log_linear_histogram& operator-=(const log_linear_histogram& o) {
+        for (size_t i = 0; i < nr_buckets; ++i) {
+            _buckets[i] -= o._buckets[i];
+        }
+        _count -= o._count;
+        _sum -= o._sum;
+        return *this;
+    }
+
+    friend log_linear_histogram operator+(log_linear_histogram a, const log_linear_histogram& b) {
+        a += b;
+        return a;
+    }
+
+    friend log_linear_histogram operator-(log_linear_histogram a, const log_linear_histogram& b) {
+        a -= b;
+        return a;
+    }
+
+    // Cumulative counts at the bounds lower_bound, 2 * lower_bound, ... in
+    // the manner of estimated_histogram::get_histogram(). A bucket which
+    // straddles a bound is counted above it.
+    seastar::metrics::histogram get_histogram(uint64_t lower_bound = 1, size_t max_buckets = 16) const {
+        seastar::metrics::histogram res;
+        res.buckets.resize(max_buckets);
+        res.sample_count = _count;
+        res.sample_sum = _sum;
+        uint64_t bound = lower_bound;
+        uint64_t cumulative = 0;
+        size_t pos = 0;
+        for (auto& b : res.buckets) {
+            while (pos < nr_buckets && bucket_upper_bound(pos) <= bound) {
+                cumulative += _buckets[pos++];
+            }
+            b.upper_bound = bound;
+            b.count = cumulative;
+            bound <<= 1;
+        }
+        return res;
+    }
+
+    template <typename Rep, typename Period>
+    seastar::metrics::histogram get_histogram(std::chrono::duration<Rep, Period> minimal_latency, size_t max_buckets = 16) const {
+        return get_histogram(std::chrono::duration_cast<std::chrono::microseconds>(minimal_latency).count(), max_buckets);
+    }
+
+    // The non-empty range of buckets, for the REST API which reports
+    // histograms in the form of estimated_histogram.
+    estimated_histogram to_estimated_histogram() const {
+        estimated_histogram res(0);
+        auto first = std::find_if(_buckets.begin(), _buckets.end(), [] (uint64_t c) { return c != 0; });
+        auto last = std::find_if(_buckets.rbegin(), _buckets.rend(), [] (uint64_t c) { return c != 0; }).base();
+        for (auto it = first; it < last; ++it) {
+            res.bucket_offsets.push_back(bucket_upper_bound(it - _buckets.begin()));
+            res.buckets.push_back(*it);
+        }
+        // The overflow bucket, which stays empty.
+        res.buckets.push_back(0);
+        res._count = _count;
+        return res;
+    }
+
+    // Up to n values distributed like the recorded ones, each the upper
+    // bound of its bucket, for the consumers of the REST API which compute
+    // percentiles out of a sample.
+    std::vector<int64_t> make_sample(size_t n = 1024) const {
+        std::vector<int64_t> res;
+        if (!_count) {
+            return res;
+        }
+        res.reserve(std::min<uint64_t>(n, _count));
+        uint64_t seen = 0;
+        for (size_t i = 0; i < nr_buckets; ++i) {
+            if (!_buckets[i]) {
+                continue;
+            }
+            seen += _buckets[i];
+            // The values of rank up to seen, scaled to n.
+            auto upto = std::min<uint64_t>(n, (seen * n + _count - 1) / _count);
+            while (res.size() < upto) {
+                res.push_back(bucket_upper_bound(i));
+            }
+        }
+        return res;
+    }
+};
+
+}
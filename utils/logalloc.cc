@@ -27,7 +27,9 @@
 #include <boost/intrusive/set.hpp>
 #include <boost/intrusive/slist.hpp>
 #include <boost/range/adaptors.hpp>
+#include <boost/range/numeric.hpp>
 #include <stack>
+#include <sys/mman.h>
 
 #include <seastar/core/memory.hh>
 #include <seastar/core/align.hh>
@@ -39,6 +41,7 @@
 #include "log.hh"
 #include "utils/dynamic_bitset.hh"
 #include "utils/log_heap.hh"
+#include "utils/log_linear_histogram.hh"
 
 namespace bi = boost::intrusive;
 
@@ -85,7 +88,11 @@ class tracker::impl {
     seastar::metrics::metric_groups _metrics;
     bool _reclaiming_enabled = true;
     size_t _reclamation_step = 1;
+    size_t _free_segments_reserve = 0;
+    uint64_t _segments_reclaimed_on_idle = 0;
     bool _abort_on_bad_alloc = false;
+    // Of the reclamation cycles run synchronously with allocation, in microseconds.
+    utils::log_linear_histogram _reclaim_latency;
 private:
     // Prevents tracker's reclaimer from running while live. Reclaimer may be
     // invoked synchronously with allocator. This guard ensures that this
@@ -111,6 +118,7 @@ class tracker::impl {
     void unregister_region(region::impl*);
     size_t reclaim(size_t bytes);
     reactor::idle_cpu_handler_result compact_on_idle(reactor::work_waiting_on_reactor check_for_work);
+    reactor::idle_cpu_handler_result refill_reserve_on_idle(reactor::work_waiting_on_reactor check_for_work);
     size_t compact_and_evict(size_t bytes);
     size_t compact_and_evict_locked(size_t bytes);
     void full_compaction();
@@ -119,8 +127,13 @@ class tracker::impl {
     occupancy_stats occupancy();
     void set_reclamation_step(size_t step_in_segments) { _reclamation_step = step_in_segments; }
     size_t reclamation_step() const { return _reclamation_step; }
+    void set_free_segments_reserve(size_t segments) { _free_segments_reserve = segments; }
+    size_t free_segments_reserve() const { return _free_segments_reserve; }
+    void set_hugepage_zones(bool enable);
     void enable_abort_on_bad_alloc() { _abort_on_bad_alloc = true; }
     bool should_abort_on_bad_alloc() const { return _abort_on_bad_alloc; }
+    void on_reclaim(clock::duration d) { _reclaim_latency.add(d); }
+    const utils::log_linear_histogram& reclaim_latency() const { return _reclaim_latency; }
 };
 
 class tracker_reclaimer_lock {
@@ -145,6 +158,10 @@ reactor::idle_cpu_handler_result tracker::compact_on_idle(reactor::work_waiting_
     return _impl->compact_on_idle(check_for_work);
 }
 
+reactor::idle_cpu_handler_result tracker::refill_reserve_on_idle(reactor::work_waiting_on_reactor check_for_work) {
+    return _impl->refill_reserve_on_idle(check_for_work);
+}
+
 occupancy_stats tracker::region_occupancy() {
     return _impl->region_occupancy();
 }
@@ -294,6 +311,10 @@ class segment_zone : public bi::set_base_hook<>, public bi::slist_base_hook<> {
     static constexpr size_t maximum_size = 256;
     static constexpr size_t minimum_size = 16;
     static thread_local size_t next_attempt_size;
+public:
+    static constexpr size_t hugepage_size = 2 << 20;
+    static_assert((minimum_size << segment::size_shift) % hugepage_size == 0, "zones must span whole hugepages");
+private:
 
     // Bitset of all segments belonging to this zone. Used segments have their
     // corresponding bit clear, free segments - set.
@@ -302,6 +323,7 @@ class segment_zone : public bi::set_base_hook<>, public bi::slist_base_hook<> {
     bi::slist<free_segment, bi::constant_time_size<false>> _free_segments;
     size_t _used_segment_count = 0;
     segment* _base;
+    bool _hugepage_backed = false;
 private:
     segment* segment_from_position(size_t pos) const {
         return _base + pos;
@@ -315,7 +337,8 @@ class segment_zone : public bi::set_base_hook<>, public bi::slist_base_hook<> {
     segment_zone(segment* base, size_t size) : _base(base) {
         _segments.resize(size, true);
     }
-    static std::unique_ptr<segment_zone> try_creating_zone();
+    // With use_hugepages, the zone is aligned to hugepages and advised to be backed by them.
+    static std::unique_ptr<segment_zone> try_creating_zone(bool use_hugepages);
     ~segment_zone() {
         assert(empty());
         if (_segments.size()) {
@@ -364,13 +387,19 @@ class segment_zone : public bi::set_base_hook<>, public bi::slist_base_hook<> {
     size_t free_segment_count() const { return _segments.size() - _used_segment_count; }
 
     segment* base() const { return _base; }
+
+    bool hugepage_backed() const { return _hugepage_backed; }
+    // Bytes of this zone spanning whole hugepages, which the kernel can map with them.
+    size_t hugepage_bytes() const {
+        return _hugepage_backed ? align_down(segment_count() << segment::size_shift, hugepage_size) : 0;
+    }
 };
 
 thread_local size_t segment_zone::next_attempt_size = segment_zone::maximum_size;
 constexpr size_t segment_zone::minimum_size;
 constexpr size_t segment_zone::maximum_size;
 
-std::unique_ptr<segment_zone> segment_zone::try_creating_zone()
+std::unique_ptr<segment_zone> segment_zone::try_creating_zone(bool use_hugepages)
 {
     std::unique_ptr<segment_zone> zone;
     auto next_size = next_attempt_size;
@@ -383,13 +412,17 @@ std::unique_ptr<segment_zone> segment_zone::try_creating_zone()
         }
         memory::disable_abort_on_alloc_failure_temporarily no_abort_guard;
         seastar::memory::scoped_large_allocation_warning_disable slawd;
-        auto ptr = aligned_alloc(segment::size, size << segment::size_shift);
+        auto ptr = aligned_alloc(use_hugepages ? hugepage_size : segment::size, size << segment::size_shift);
         if (!ptr) {
             continue;
         }
         try {
             zone = std::make_unique<segment_zone>(static_cast<segment*>(ptr), size);
-            llogger.debug("Creating new zone @{}, size: {}", zone.get(), size);
+            // Without transparent hugepages madvise() fails, and the zone works as any other.
+            if (use_hugepages && !::madvise(ptr, size << segment::size_shift, MADV_HUGEPAGE)) {
+                zone->_hugepage_backed = true;
+            }
+            llogger.debug("Creating new zone @{}, size: {}, hugepages: {}", zone.get(), size, zone->_hugepage_backed);
             next_attempt_size = std::min(std::max(size << 1, minimum_size), maximum_size);
             while (size--) {
                 auto seg = zone->segment_from_position(size);
@@ -467,6 +500,7 @@ class segment_pool {
     all_zones_type _all_zones;
     bi::slist<segment_zone> _not_full_zones;
     size_t _free_segments_in_zones = 0;
+    bool _hugepage_zones = false;
 private:
     segment* allocate_segment();
     void deallocate_segment(segment* seg);
@@ -524,16 +558,30 @@ class segment_pool {
     struct stats {
         size_t segments_migrated;
         size_t segments_compacted;
+        uint64_t memory_allocated;
+        uint64_t memory_compacted;
     };
 private:
     stats _stats{};
 public:
     size_t zone_count() const { return _all_zones.size(); }
+    // Applies to zones created from now on.
+    void set_hugepage_zones(bool enable) { _hugepage_zones = enable; }
+    size_t hugepage_zone_count() const {
+        return boost::count_if(_all_zones, [] (const segment_zone& z) { return z.hugepage_backed(); });
+    }
+    size_t hugepage_zone_bytes() const {
+        return boost::accumulate(_all_zones | boost::adaptors::transformed([] (const segment_zone& z) { return z.hugepage_bytes(); }), size_t(0));
+    }
     const stats& statistics() const { return _stats; }
     void on_segment_migration() { _stats.segments_migrated++; }
     void on_segment_compaction() { _stats.segments_compacted++; }
+    void on_memory_allocation(size_t size) { _stats.memory_allocated += size; }
+    void on_memory_compaction(size_t size) { _stats.memory_compacted += size; }
     size_t free_segments_in_zones() const { return _free_segments_in_zones; }
     size_t free_segments() const { return _free_segments_in_zones + _emergency_reserve.size(); }
+    // False when allocating a segment would have to reclaim first.
+    bool can_allocate_more_segments() const { return can_allocate_more_memory(segment::size); }
 };
 
 size_t segment_pool::reclaim_segments(size_t target) {
@@ -633,7 +681,7 @@ segment* segment_pool::allocate_segment()
         if (can_allocate_more_memory(segment::size)) {
             segment_zone* zone;
             try {
-                zone = segment_zone::try_creating_zone().release();
+                zone = segment_zone::try_creating_zone(_hugepage_zones).release();
                 if (!zone) {
                     continue;
                 }
@@ -860,16 +908,24 @@ class segment_pool {
     struct stats {
         size_t segments_migrated;
         size_t segments_compacted;
+        uint64_t memory_allocated;
+        uint64_t memory_compacted;
     };
 private:
     stats _stats{};
 public:
     size_t zone_count() const { return 0; }
+    void set_hugepage_zones(bool) { }
+    size_t hugepage_zone_count() const { return 0; }
+    size_t hugepage_zone_bytes() const { return 0; }
     const stats& statistics() const { return _stats; }
     void on_segment_migration() { _stats.segments_migrated++; }
     void on_segment_compaction() { _stats.segments_compacted++; }
+    void on_memory_allocation(size_t size) { _stats.memory_allocated += size; }
+    void on_memory_compaction(size_t size) { _stats.memory_compacted += size; }
     size_t free_segments_in_zones() const { return 0; }
     size_t free_segments() const { return 0; }
+    bool can_allocate_more_segments() const { return true; }
 public:
     class reservation_goal;
 };
@@ -1189,6 +1245,7 @@ class region_impl : public allocation_strategy {
             auto size = desc->live_size(obj);
             auto dst = alloc_small(desc->migrator(), size, desc->alignment());
             desc->migrator()->migrate(obj, dst);
+            shard_segment_pool.on_memory_compaction(size);
         });
 
         free_segment(seg, desc);
@@ -1298,6 +1355,7 @@ class region_impl : public allocation_strategy {
     virtual void* alloc(allocation_strategy::migrate_fn migrator, size_t size, size_t alignment) override {
         compaction_lock _(*this);
         memory::on_alloc_point();
+        shard_segment_pool.on_memory_allocation(size);
         if (size > max_managed_object_size) {
             auto ptr = standard_allocator().alloc(migrator, size, alignment);
             // This isn't very acurrate, the correct free_space value would be
@@ -1562,6 +1620,27 @@ size_t tracker::reclamation_step() const {
     return _impl->reclamation_step();
 }
 
+void tracker::set_free_segments_reserve(size_t segments) {
+    _impl->set_free_segments_reserve(segments);
+}
+
+void tracker::set_hugepage_zones(bool enable) {
+    _impl->set_hugepage_zones(enable);
+}
+
+tracker::stats tracker::statistics() const {
+    auto& st = shard_segment_pool.statistics();
+    return stats{st.memory_allocated, st.memory_compacted, st.segments_compacted};
+}
+
+const utils::log_linear_histogram& tracker::reclaim_latency() const {
+    return _impl->reclaim_latency();
+}
+
+void tracker::impl::set_hugepage_zones(bool enable) {
+    shard_segment_pool.set_hugepage_zones(enable);
+}
+
 void tracker::enable_abort_on_bad_alloc() {
     return _impl->enable_abort_on_bad_alloc();
 }
@@ -1728,33 +1807,20 @@ static void reclaim_from_evictable(region::impl& r, size_t target_mem_in_use) {
 }
 
 struct reclaim_timer {
+    tracker::impl& tracker;
     clock::time_point start;
     bool enabled;
-    reclaim_timer() {
-        if (timing_logger.is_enabled(logging::log_level::debug)) {
-            start = clock::now();
-            enabled = true;
-        } else {
-            enabled = false;
-        }
+    explicit reclaim_timer(tracker::impl& t) : tracker(t), start(clock::now()) {
+        enabled = timing_logger.is_enabled(logging::log_level::debug);
     }
     ~reclaim_timer() {
+        auto duration = clock::now() - start;
+        tracker.on_reclaim(duration);
         if (enabled) {
-            auto duration = clock::now() - start;
             timing_logger.debug("Reclamation cycle took {} us.",
                 std::chrono::duration_cast<std::chrono::duration<double, std::micro>>(duration).count());
         }
     }
-    void stop(size_t released) {
-        if (enabled) {
-            enabled = false;
-            auto duration = clock::now() - start;
-            auto bytes_per_second = static_cast<float>(released) / std::chrono::duration_cast<std::chrono::duration<float>>(duration).count();
-            timing_logger.debug("Reclamation cycle took {} us. Reclamation rate = {} MiB/s",
-                                std::chrono::duration_cast<std::chrono::duration<double, std::micro>>(duration).count(),
-                                sprint("%.3f", bytes_per_second / (1024*1024)));
-        }
-    }
 };
 
 reactor::idle_cpu_handler_result tracker::impl::compact_on_idle(reactor::work_waiting_on_reactor check_for_work) {
@@ -1791,6 +1857,27 @@ reactor::idle_cpu_handler_result tracker::impl::compact_on_idle(reactor::work_wa
     return reactor::idle_cpu_handler_result::interrupted_by_higher_priority_task;
 }
 
+reactor::idle_cpu_handler_result tracker::impl::refill_reserve_on_idle(reactor::work_waiting_on_reactor check_for_work) {
+    if (!_reclaiming_enabled || !_free_segments_reserve) {
+        return reactor::idle_cpu_handler_result::no_more_work;
+    }
+    reclaiming_lock rl(*this);
+    segment_pool::reservation_goal open_emergency_pool(shard_segment_pool, 0);
+
+    // Segments freed here stay in the zones, so the next allocations take them
+    // instead of compacting or evicting inline.
+    while (!shard_segment_pool.can_allocate_more_segments() && shard_segment_pool.free_segments() < _free_segments_reserve) {
+        if (check_for_work()) {
+            return reactor::idle_cpu_handler_result::interrupted_by_higher_priority_task;
+        }
+        if (!compact_and_evict_locked(segment::size)) {
+            break;
+        }
+        ++_segments_reclaimed_on_idle;
+    }
+    return reactor::idle_cpu_handler_result::no_more_work;
+}
+
 size_t tracker::impl::reclaim(size_t memory_to_release) {
     // Reclamation steps:
     // 1. Try to release free segments from zones and emergency reserve.
@@ -1800,7 +1887,7 @@ size_t tracker::impl::reclaim(size_t memory_to_release) {
         return 0;
     }
     reclaiming_lock rl(*this);
-    reclaim_timer timing_guard;
+    reclaim_timer timing_guard(*this);
 
     size_t mem_released;
     {
@@ -1821,7 +1908,7 @@ size_t tracker::impl::compact_and_evict(size_t memory_to_release) {
         return 0;
     }
     reclaiming_lock rl(*this);
-    reclaim_timer timing_guard;
+    reclaim_timer timing_guard(*this);
     return compact_and_evict_locked(memory_to_release);
 }
 
@@ -2024,11 +2111,30 @@ tracker::impl::impl() {
         sm::make_gauge("zones", [this] { return shard_segment_pool.zone_count(); },
                        sm::description("Holds a current number of zones.")),
 
+        sm::make_gauge("hugepage_zones", [this] { return shard_segment_pool.hugepage_zone_count(); },
+                       sm::description("Holds a current number of zones advised to be backed by transparent hugepages.")),
+
+        sm::make_gauge("hugepage_zone_bytes", [this] { return shard_segment_pool.hugepage_zone_bytes(); },
+                       sm::description("Holds a current amount of zone memory spanning whole hugepages.")),
+
         sm::make_derive("segments_migrated", [this] { return shard_segment_pool.statistics().segments_migrated; },
                         sm::description("Counts a number of migrated segments.")),
 
         sm::make_derive("segments_compacted", [this] { return shard_segment_pool.statistics().segments_compacted; },
                         sm::description("Counts a number of compacted segments.")),
+
+        sm::make_derive("memory_allocated", [this] { return shard_segment_pool.statistics().memory_allocated; },
+                        sm::description("Counts a number of bytes allocated by LSA regions.")),
+
+        sm::make_derive("memory_compacted", [this] { return shard_segment_pool.statistics().memory_compacted; },
+                        sm::description("Counts a number of bytes of live objects moved by segment compaction. "
+                                        "Divide by memory_allocated to get the compaction bytes per byte allocated.")),
+
+        sm::make_histogram("reclaim_latency", sm::description("Holds the latency histogram of the reclamation cycles run when allocating, in microseconds."),
+                           [this] { return _reclaim_latency.get_histogram(std::chrono::microseconds(10)); }),
+
+        sm::make_derive("segments_reclaimed_on_idle", [this] { return _segments_reclaimed_on_idle; },
+                        sm::description("Counts a number of segments freed by compaction or eviction while the cpu was idle, to keep the free segment reserve.")),
     });
 }
 
@@ -34,6 +34,8 @@
 #include <boost/heap/binomial_heap.hpp>
 #include "seastarx.hh"
 
+namespace utils { class log_linear_histogram; }
+
 namespace logalloc {
 
 struct occupancy_stats;
@@ -442,6 +444,11 @@ class tracker {
     // or there are no more segments to compact.
     reactor::idle_cpu_handler_result compact_on_idle(reactor::work_waiting_on_reactor);
 
+    // Compacts the sparsest segments, and evicts when that is not enough, until the shard has the
+    // reserve of free segments set with set_free_segments_reserve() or work_waiting_on_reactor
+    // returns true. Does nothing while memory can still be allocated without reclaiming.
+    reactor::idle_cpu_handler_result refill_reserve_on_idle(reactor::work_waiting_on_reactor);
+
     // Compacts as much as possible. Very expensive, mainly for testing.
     // Guarantees that every live object from reclaimable regions will be moved.
     // Invalidates references to objects in all compactible and evictable regions.
@@ -463,6 +470,26 @@ class tracker {
     // Returns the minimum number of segments reclaimed during single reclamation cycle.
     size_t reclamation_step() const;
 
+    // Set the number of free segments refill_reserve_on_idle() keeps around, zero disables it.
+    void set_free_segments_reserve(size_t segments);
+
+    // Aligns new zones to 2 MiB and advises the kernel to back them with transparent hugepages.
+    // Zones are in the shard's memory, so they stay on its NUMA node either way.
+    void set_hugepage_zones(bool enable);
+
+    struct stats {
+        // Bytes allocated in regions, and the bytes of live objects moved
+        // by segment compaction since the start.
+        uint64_t memory_allocated;
+        uint64_t memory_compacted;
+        uint64_t segments_compacted;
+    };
+    stats statistics() const;
+
+    // Latencies of the reclamation cycles run synchronously with
+    // allocation, in microseconds.
+    const utils::log_linear_histogram& reclaim_latency() const;
+
     // Abort on allocation failure from LSA
     void enable_abort_on_bad_alloc();
 
@@ -74,6 +74,8 @@ struct blob_storage {
     }
 } __attribute__((packed));
 
+class managed_bytes_view;
+
 // A managed version of "bytes" (can be used with LSA).
 class managed_bytes {
     struct linearization_context {
@@ -405,10 +407,160 @@ class managed_bytes {
         return 0;
     }
 
+    // Returns a view of the contents which doesn't linearize them.
+    managed_bytes_view view() const;
+
     template <typename Func>
     friend std::result_of_t<Func()> with_linearized_managed_bytes(Func&& func);
 };
 
+// A view of the contents of managed_bytes, fragment by fragment, so that
+// large values can be consumed without linearization and without the need
+// for a linearization context.
+//
+// The fragments are not empty, unless the whole view is. Like bytes_view,
+// the view is invalidated by anything which may move or free the viewed object.
+class managed_bytes_view {
+public:
+    using size_type = blob_storage::size_type;
+private:
+    bytes_view _current_fragment;
+    const blob_storage* _next_fragments = nullptr;
+    size_type _size = 0;
+private:
+    managed_bytes_view(bytes_view current_fragment, const blob_storage* next_fragments, size_type size)
+        : _current_fragment(current_fragment)
+        , _next_fragments(next_fragments)
+        , _size(size)
+    { }
+    friend class managed_bytes;
+public:
+    managed_bytes_view() = default;
+    managed_bytes_view(bytes_view v)
+        : _current_fragment(v)
+        , _size(v.size())
+    { }
+
+    size_type size() const {
+        return _size;
+    }
+    bool empty() const {
+        return !_size;
+    }
+    bool is_fragmented() const {
+        return _size != _current_fragment.size();
+    }
+    bytes_view current_fragment() const {
+        return _current_fragment;
+    }
+    void remove_current() {
+        _size -= _current_fragment.size();
+        if (_size) {
+            size_type frag_size = _next_fragments->frag_size;
+            _current_fragment = bytes_view(_next_fragments->data, std::min(_size, frag_size));
+            _next_fragments = _next_fragments->next;
+        } else {
+            _current_fragment = bytes_view();
+        }
+    }
+    void remove_prefix(size_t n) {
+        assert(n <= _size);
+        while (n && n >= _current_fragment.size()) {
+            n -= _current_fragment.size();
+            remove_current();
+        }
+        _current_fragment.remove_prefix(n);
+        _size -= n;
+    }
+    // Returns a view of the first len bytes.
+    managed_bytes_view prefix(size_type len) const {
+        assert(len <= _size);
+        auto v = *this;
+        v._size = len;
+        if (len < v._current_fragment.size()) {
+            v._current_fragment.remove_suffix(v._current_fragment.size() - len);
+        }
+        return v;
+    }
+    bytes_view::value_type operator[](size_type index) const {
+        auto v = *this;
+        while (index >= v._current_fragment.size()) {
+            index -= v._current_fragment.size();
+            v.remove_current();
+        }
+        return v._current_fragment[index];
+    }
+
+    template<typename Func>
+    void for_each_fragment(Func&& func) const {
+        auto v = *this;
+        while (!v.empty()) {
+            func(v.current_fragment());
+            v.remove_current();
+        }
+    }
+
+    // Copies the contents into contiguous memory.
+    bytes linearize() const {
+        bytes b(bytes::initialized_later(), _size);
+        auto out = b.begin();
+        for_each_fragment([&out] (bytes_view fragment) {
+            out = std::copy(fragment.begin(), fragment.end(), out);
+        });
+        return b;
+    }
+
+    // Calls func with a bytes_view of the contents, copying them only if fragmented.
+    template<typename Func>
+    std::result_of_t<Func(bytes_view)> with_linearized(Func&& func) const {
+        if (!is_fragmented()) {
+            return func(_current_fragment);
+        }
+        auto b = linearize();
+        return func(bytes_view(b));
+    }
+
+    bool operator==(managed_bytes_view o) const {
+        if (_size != o._size) {
+            return false;
+        }
+        auto a = *this;
+        while (!a.empty()) {
+            auto now = std::min(a._current_fragment.size(), o._current_fragment.size());
+            if (a._current_fragment.substr(0, now) != o._current_fragment.substr(0, now)) {
+                return false;
+            }
+            a.remove_prefix(now);
+            o.remove_prefix(now);
+        }
+        return true;
+    }
+    bool operator!=(managed_bytes_view o) const {
+        return !(*this == o);
+    }
+};
+
+inline
+managed_bytes_view
+managed_bytes::view() const {
+    if (!external()) {
+        return managed_bytes_view(bytes_view(_u.small.data, _u.small.size));
+    }
+    return managed_bytes_view(bytes_view(_u.ptr->data, _u.ptr->frag_size), _u.ptr->next, _u.ptr->size);
+}
+
+// Gives the same result as feeding the linearized value as bytes_view.
+template<>
+struct appending_hash<managed_bytes_view> {
+    template<typename Hasher>
+    void operator()(Hasher& h, managed_bytes_view v) const {
+        feed_hash(h, size_t(v.size()));
+        v.for_each_fragment([&h] (bytes_view fragment) {
+            h.update(reinterpret_cast<const char*>(fragment.begin()), fragment.size() * sizeof(bytes_view::value_type));
+        });
+    }
+};
+
 // Run func() while ensuring that reads of managed_bytes objects are
 // temporarlily linearized
 template <typename Func>
@@ -21,6 +21,7 @@
 
 #pragma once
 
+#include <algorithm>
 #include <array>
 #include <type_traits>
 
@@ -216,6 +217,14 @@ class managed_vector {
         new (_data + _size) T(std::forward<Args>(args)...);
         _size++;
     }
+    // Inserts before pos, shifting the elements after it. Strong exception guarantee.
+    template<typename... Args>
+    iterator emplace(const_iterator pos, Args&&... args) {
+        auto i = pos - begin();
+        emplace_back(std::forward<Args>(args)...);
+        std::rotate(begin() + i, end() - 1, end());
+        return begin() + i;
+    }
     void pop_back() {
         _data[_size - 1].~T();
         _size--;
@@ -37,6 +37,7 @@
  * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <algorithm>
 #include "murmur_hash.hh"
 
 namespace utils {
@@ -170,25 +171,17 @@ static inline uint64_t getblock(bytes_view key, uint32_t index)
             | (uint64_t(p[7]) << 56);
 }
 
-void hash3_x64_128(bytes_view key, uint64_t seed, std::array<uint64_t,2> &result)
-{
-    uint32_t length = key.size();
-    const uint32_t nblocks = length >> 4; // Process as 128-bit blocks.
+// The state of a hash3_x64_128() computation, advanced by 128-bit blocks.
+struct hash3_state {
+    uint64_t h1;
+    uint64_t h2;
 
-    uint64_t h1 = seed;
-    uint64_t h2 = seed;
+    static constexpr uint64_t c1 = 0x87c37b91114253d5L;
+    static constexpr uint64_t c2 = 0x4cf5ad432745937fL;
 
-    uint64_t c1 = 0x87c37b91114253d5L;
-    uint64_t c2 = 0x4cf5ad432745937fL;
-
-    //----------
-    // body
-
-    for(uint32_t i = 0; i < nblocks; i++)
-    {
-        uint64_t k1 = getblock(key, i*2+0);
-        uint64_t k2 = getblock(key, i*2+1);
+    explicit hash3_state(uint64_t seed) : h1(seed), h2(seed) { }
 
+    void block(uint64_t k1, uint64_t k2) {
         k1 *= c1; k1 = rotl64(k1,31); k1 *= c2; h1 ^= k1;
 
         h1 = rotl64(h1,27); h1 += h2; h1 = h1*5+0x52dce729;
@@ -198,52 +191,98 @@ void hash3_x64_128(bytes_view key, uint64_t seed, std::array<uint64_t,2> &result
         h2 = rotl64(h2,31); h2 += h1; h2 = h2*5+0x38495ab5;
     }
 
-    //----------
-    // tail
+    // Hashes the blocks of the key from the given one on, its tail, and
+    // finalizes the hash.
+    void finish(bytes_view key, uint32_t first_block, std::array<uint64_t, 2>& result) {
+        uint32_t length = key.size();
+        const uint32_t nblocks = length >> 4; // Process as 128-bit blocks.
 
-    // Advance offset to the unprocessed tail of the data.
-    key.remove_prefix(nblocks * 16);
+        //----------
+        // body
 
-    uint64_t k1 = 0;
-    uint64_t k2 = 0;
-
-    switch(length & 15)
-    {
-    case 15: k2 ^= ((uint64_t) key[14]) << 48;
-    case 14: k2 ^= ((uint64_t) key[13]) << 40;
-    case 13: k2 ^= ((uint64_t) key[12]) << 32;
-    case 12: k2 ^= ((uint64_t) key[11]) << 24;
-    case 11: k2 ^= ((uint64_t) key[10]) << 16;
-    case 10: k2 ^= ((uint64_t) key[9]) << 8;
-    case  9: k2 ^= ((uint64_t) key[8]) << 0;
-        k2 *= c2; k2  = rotl64(k2,33); k2 *= c1; h2 ^= k2;
-    case  8: k1 ^= ((uint64_t) key[7]) << 56;
-    case  7: k1 ^= ((uint64_t) key[6]) << 48;
-    case  6: k1 ^= ((uint64_t) key[5]) << 40;
-    case  5: k1 ^= ((uint64_t) key[4]) << 32;
-    case  4: k1 ^= ((uint64_t) key[3]) << 24;
-    case  3: k1 ^= ((uint64_t) key[2]) << 16;
-    case  2: k1 ^= ((uint64_t) key[1]) << 8;
-    case  1: k1 ^= ((uint64_t) key[0]);
-        k1 *= c1; k1  = rotl64(k1,31); k1 *= c2; h1 ^= k1;
-    };
+        for(uint32_t i = first_block; i < nblocks; i++)
+        {
+            block(getblock(key, i*2+0), getblock(key, i*2+1));
+        }
 
-    //----------
-    // finalization
+        //----------
+        // tail
 
-    h1 ^= length; h2 ^= length;
+        // Advance offset to the unprocessed tail of the data.
+        key.remove_prefix(nblocks * 16);
 
-    h1 += h2;
-    h2 += h1;
+        uint64_t k1 = 0;
+        uint64_t k2 = 0;
 
-    h1 = fmix(h1);
-    h2 = fmix(h2);
+        switch(length & 15)
+        {
+        case 15: k2 ^= ((uint64_t) key[14]) << 48;
+        case 14: k2 ^= ((uint64_t) key[13]) << 40;
+        case 13: k2 ^= ((uint64_t) key[12]) << 32;
+        case 12: k2 ^= ((uint64_t) key[11]) << 24;
+        case 11: k2 ^= ((uint64_t) key[10]) << 16;
+        case 10: k2 ^= ((uint64_t) key[9]) << 8;
+        case  9: k2 ^= ((uint64_t) key[8]) << 0;
+            k2 *= c2; k2  = rotl64(k2,33); k2 *= c1; h2 ^= k2;
+        case  8: k1 ^= ((uint64_t) key[7]) << 56;
+        case  7: k1 ^= ((uint64_t) key[6]) << 48;
+        case  6: k1 ^= ((uint64_t) key[5]) << 40;
+        case  5: k1 ^= ((uint64_t) key[4]) << 32;
+        case  4: k1 ^= ((uint64_t) key[3]) << 24;
+        case  3: k1 ^= ((uint64_t) key[2]) << 16;
+        case  2: k1 ^= ((uint64_t) key[1]) << 8;
+        case  1: k1 ^= ((uint64_t) key[0]);
+            k1 *= c1; k1  = rotl64(k1,31); k1 *= c2; h1 ^= k1;
+        };
+
+        //----------
+        // finalization
+
+        h1 ^= length; h2 ^= length;
+
+        h1 += h2;
+        h2 += h1;
+
+        h1 = fmix(h1);
+        h2 = fmix(h2);
+
+        h1 += h2;
+        h2 += h1;
+
+        result[0] = h1;
+        result[1] = h2;
+    }
+};
 
-    h1 += h2;
-    h2 += h1;
+void hash3_x64_128(bytes_view key, uint64_t seed, std::array<uint64_t,2> &result)
+{
+    hash3_state(seed).finish(key, 0, result);
+}
 
-    result[0] = h1;
-    result[1] = h2;
+void hash3_x64_128(const std::vector<bytes_view>& keys, uint64_t seed, std::vector<std::array<uint64_t, 2>>& results)
+{
+    // Each block depends on the previous one of the same key, through
+    // multiplications of several cycles. Interleaving the blocks of a few
+    // keys keeps the multiplier busy with the others meanwhile.
+    constexpr size_t lanes = 4;
+    results.resize(keys.size());
+    size_t i = 0;
+    for (; i + lanes <= keys.size(); i += lanes) {
+        auto k = &keys[i];
+        hash3_state st[lanes] = { hash3_state(seed), hash3_state(seed), hash3_state(seed), hash3_state(seed) };
+        uint32_t common_blocks = std::min({k[0].size(), k[1].size(), k[2].size(), k[3].size()}) >> 4;
+        for (uint32_t b = 0; b < common_blocks; ++b) {
+            for (size_t l = 0; l < lanes; ++l) {
+                st[l].block(getblock(k[l], b*2+0), getblock(k[l], b*2+1));
+            }
+        }
+        for (size_t l = 0; l < lanes; ++l) {
+            st[l].finish(k[l], common_blocks, results[i + l]);
+        }
+    }
+    for (; i < keys.size(); ++i) {
+        hash3_x64_128(keys[i], seed, results[i]);
+    }
 }
 
 } // namespace murmur_hash
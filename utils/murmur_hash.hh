@@ -40,6 +40,7 @@
 
 #include <cstdint>
 #include <array>
+#include <vector>
 
 #include "bytes.hh"
 
@@ -167,6 +168,10 @@ void hash3_x64_128(InputIterator in, uint32_t length, uint64_t seed, std::array<
 
 void hash3_x64_128(bytes_view key, uint64_t seed, std::array<uint64_t, 2>& result);
 
+// Hashes each of the keys as hash3_x64_128() does, into the element of
+// results of the same index. Faster than hashing them one by one.
+void hash3_x64_128(const std::vector<bytes_view>& keys, uint64_t seed, std::vector<std::array<uint64_t, 2>>& results);
+
 } // namespace murmur_hash
 
 } // namespace utils
@@ -0,0 +1,76 @@
+/*
+ * Copyright (C) 2018 ScyllaDB
+ */
+
+/*
+ * This file is part of Scylla.
+ *
+ * Scylla is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Scylla is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <execinfo.h>
+#include "utils/stall_detector.hh"
+#include "core/metrics.hh"
+#include "core/print.hh"
+#include "core/reactor.hh"
+#include "log.hh"
+
+namespace utils {
+
+static logging::logger slogger("stall_detector");
+
+static constexpr int max_frames = 32;
+
+constexpr std::chrono::seconds stall_detector::log_interval;
+
+void stall_detector::report(task_context ctx, clock::duration duration) {
+    ++_stalls;
+    ++_stalls_by_context[unsigned(ctx)];
+    auto now = clock::now();
+    auto& last = _last_logged[unsigned(ctx)];
+    if (last != clock::time_point() && now - last < log_interval) {
+        return;
+    }
+    last = now;
+    void* frames[max_frames];
+    auto n = ::backtrace(frames, max_frames);
+    sstring trace;
+    // Skipping report() and leave().
+    for (auto i = 2; i < n; ++i) {
+        trace += sprint(" %p", frames[i]);
+    }
+    slogger.warn("Reactor stalled for {} ms in {}, backtrace:{}",
+            std::chrono::duration_cast<std::chrono::milliseconds>(duration).count(), to_string(ctx), trace);
+}
+
+void stall_detector::register_metrics() {
+    namespace sm = seastar::metrics;
+    static const sm::label context_label("context");
+    for (unsigned i = 0; i < task_context_count; ++i) {
+        _metrics.add_group("task_context", {
+            sm::make_derive("stalls", _stalls_by_context[i],
+                    sm::description("Synchronous sections of the subsystem which ran for longer than task_stall_report_threshold_ms"))(context_label(to_string(task_context(i)))),
+        });
+    }
+}
+
+future<> init_stall_detector(std::chrono::milliseconds threshold) {
+    return smp::invoke_on_all([threshold] {
+        auto& detector = stall_detector::local();
+        detector.set_threshold(threshold);
+        detector.register_metrics();
+    });
+}
+
+}
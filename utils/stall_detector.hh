@@ -0,0 +1,87 @@
+/*
+ * Copyright (C) 2018 ScyllaDB
+ */
+
+/*
+ * This file is part of Scylla.
+ *
+ * Scylla is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Scylla is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <array>
+#include <chrono>
+#include "core/future.hh"
+#include "core/metrics_registration.hh"
+#include "seastarx.hh"
+#include "utils/task_context.hh"
+
+namespace utils {
+
+// Reports the task_context_guard scopes which hold the reactor for longer
+// than the threshold: they are counted per task_context, exported as the
+// task_context_stalls metric, and logged with a backtrace, at most once per
+// context every log_interval.
+//
+// Complements seastar's own blocked reactor notifications, which can't tell
+// which subsystem was running.
+class stall_detector {
+public:
+    using clock = std::chrono::steady_clock;
+    struct scope {
+        clock::time_point start;
+        // Of the detector when entering, so that the scopes enclosing one
+        // which was reported aren't reported again.
+        uint64_t stalls;
+    };
+    static constexpr std::chrono::seconds log_interval{10};
+private:
+    clock::duration _threshold = clock::duration::zero();
+    uint64_t _stalls = 0;
+    std::array<uint64_t, task_context_count> _stalls_by_context{};
+    std::array<clock::time_point, task_context_count> _last_logged{};
+    seastar::metrics::metric_groups _metrics;
+private:
+    void report(task_context ctx, clock::duration duration);
+public:
+    static stall_detector& local() {
+        static thread_local stall_detector detector;
+        return detector;
+    }
+
+    // Zero disables the detector.
+    void set_threshold(clock::duration threshold) {
+        _threshold = threshold;
+    }
+    void register_metrics();
+
+    scope enter() const {
+        return scope{_threshold.count() ? clock::now() : clock::time_point(), _stalls};
+    }
+    void leave(task_context ctx, const scope& s) {
+        if (!_threshold.count() || s.start == clock::time_point() || s.stalls != _stalls) {
+            return;
+        }
+        auto duration = clock::now() - s.start;
+        if (duration >= _threshold) {
+            report(ctx, duration);
+        }
+    }
+};
+
+// Starts the detectors of all shards.
+future<> init_stall_detector(std::chrono::milliseconds threshold);
+
+}
@@ -0,0 +1,55 @@
+/*
+ * Copyright (C) 2018 ScyllaDB
+ */
+
+/*
+ * This file is part of Scylla.
+ *
+ * Scylla is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Scylla is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstdlib>
+
+namespace utils {
+
+// The subsystem on whose behalf the code of a shard runs.
+enum class task_context : uint8_t {
+    other,
+    cql,
+    storage_proxy,
+    compaction,
+    memtable_flush,
+    cache_population,
+    repair,
+};
+
+static constexpr unsigned task_context_count = unsigned(task_context::repair) + 1;
+
+inline const char* to_string(task_context ctx) {
+    switch (ctx) {
+    case task_context::other: return "other";
+    case task_context::cql: return "cql";
+    case task_context::storage_proxy: return "storage_proxy";
+    case task_context::compaction: return "compaction";
+    case task_context::memtable_flush: return "memtable_flush";
+    case task_context::cache_population: return "cache_population";
+    case task_context::repair: return "repair";
+    }
+    abort();
+}
+
+}
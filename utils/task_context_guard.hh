@@ -0,0 +1,57 @@
+/*
+ * Copyright (C) 2018 ScyllaDB
+ */
+
+/*
+ * This file is part of Scylla.
+ *
+ * Scylla is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Scylla is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "utils/alloc_profiler.hh"
+#include "utils/stall_detector.hh"
+
+namespace utils {
+
+// Runs the scope in ctx: its allocations are attributed to ctx by the
+// alloc_profiler, and it is reported by the stall_detector if it takes too
+// long. The scope mustn't span a preemption point: guards belong around
+// synchronous code.
+class task_context_guard {
+    task_context _ctx;
+    task_context _previous;
+    bool _profiling;
+    stall_detector::scope _stall_scope;
+public:
+    explicit task_context_guard(task_context ctx)
+        : _ctx(ctx)
+        , _profiling(alloc_profiler::local().enabled())
+        , _stall_scope(stall_detector::local().enter()) {
+        if (_profiling) {
+            _previous = alloc_profiler::local().switch_to(ctx);
+        }
+    }
+    ~task_context_guard() {
+        if (_profiling) {
+            alloc_profiler::local().switch_to(_previous);
+        }
+        stall_detector::local().leave(_ctx, _stall_scope);
+    }
+    task_context_guard(const task_context_guard&) = delete;
+    task_context_guard& operator=(const task_context_guard&) = delete;
+};
+
+}
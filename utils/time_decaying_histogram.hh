@@ -0,0 +1,124 @@
+/*
+ * Copyright (C) 2017 ScyllaDB
+ */
+
+/*
+ * This file is part of Scylla.
+ *
+ * Scylla is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Scylla is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+
+namespace utils {
+
+/**
+ * Histogram of latencies in which samples lose half of their weight every
+ * half-life, so that percentiles follow changes of the latency within a few
+ * half-lives, whatever the number of samples seen before.
+ *
+ * Buckets grow by 20%, from 1us to a few hours, so percentiles are accurate
+ * to 20%. They are the upper bound of their bucket.
+ */
+template <typename Clock = std::chrono::steady_clock>
+class time_decaying_histogram {
+public:
+    using clock = Clock;
+    using time_point = typename clock::time_point;
+    using duration = typename clock::duration;
+private:
+    static constexpr size_t nr_buckets = 128;
+    static constexpr double growth = 1.2;
+
+    std::array<double, nr_buckets> _buckets{};
+    double _count = 0;
+    duration _half_life;
+    time_point _last_decay;
+private:
+    static size_t bucket_of(double us) {
+        if (us <= 1) {
+            return 0;
+        }
+        auto i = size_t(std::ceil(std::log(us) / std::log(growth)));
+        return std::min(i, nr_buckets - 1);
+    }
+
+    static double bucket_upper_bound(size_t i) {
+        return std::pow(growth, i);
+    }
+
+    // Decays in steps of a sixteenth of the half-life, so that adding a
+    // sample is cheap.
+    void decay(time_point now) {
+        auto elapsed = now - _last_decay;
+        if (elapsed < _half_life / 16) {
+            return;
+        }
+        auto factor = std::exp2(-std::chrono::duration<double>(elapsed) / std::chrono::duration<double>(_half_life));
+        for (auto& b : _buckets) {
+            b *= factor;
+        }
+        _count *= factor;
+        _last_decay = now;
+    }
+public:
+    explicit time_decaying_histogram(duration half_life, time_point now = clock::now())
+        : _half_life(half_life)
+        , _last_decay(now)
+    { }
+
+    template <typename Rep, typename Period>
+    void add(std::chrono::duration<Rep, Period> latency, time_point now = clock::now()) {
+        decay(now);
+        auto us = std::chrono::duration_cast<std::chrono::duration<double, std::micro>>(latency).count();
+        _buckets[bucket_of(us)] += 1;
+        _count += 1;
+    }
+
+    // The weight of the samples, each counting for one when added.
+    double count(time_point now = clock::now()) {
+        decay(now);
+        return _count;
+    }
+
+    // perc is in [0, 1]. Zero when there are no samples.
+    std::chrono::microseconds percentile(double perc, time_point now = clock::now()) {
+        decay(now);
+        auto target = _count * perc;
+        double seen = 0;
+        size_t last = nr_buckets;
+        for (size_t i = 0; i < nr_buckets; ++i) {
+            if (!_buckets[i]) {
+                continue;
+            }
+            last = i;
+            seen += _buckets[i];
+            if (seen >= target) {
+                break;
+            }
+        }
+        if (last == nr_buckets) {
+            return std::chrono::microseconds(0);
+        }
+        return std::chrono::microseconds(int64_t(std::ceil(bucket_upper_bound(last))));
+    }
+};
+
+}
@@ -0,0 +1,89 @@
+/*
+ * Copyright (C) 2017 ScyllaDB
+ */
+
+/*
+ * This file is part of Scylla.
+ *
+ * Scylla is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Scylla is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+
+namespace utils {
+
+/**
+ * Token bucket, filled at rate tokens per second up to a burst of one second
+ * worth of tokens.
+ *
+ * Tokens are taken without waiting for them: the bucket goes into debt, and
+ * the caller is told how long to wait before using what it took. Callers
+ * taking tokens one after the other are thus spaced at the rate, in the
+ * order they took them. A rate of zero means no limit.
+ */
+template <typename Clock = std::chrono::steady_clock>
+class token_bucket {
+public:
+    using clock = Clock;
+    using time_point = typename clock::time_point;
+    using duration = typename clock::duration;
+private:
+    double _rate;
+    double _tokens;
+    time_point _last;
+private:
+    void refill(time_point now) {
+        if (now > _last) {
+            auto elapsed = std::chrono::duration_cast<std::chrono::duration<double>>(now - _last).count();
+            _tokens = std::min(_rate, _tokens + elapsed * _rate);
+            _last = now;
+        }
+    }
+public:
+    explicit token_bucket(double rate = 0, time_point now = clock::now())
+        : _rate(rate)
+        , _tokens(rate)
+        , _last(now)
+    { }
+
+    double rate() const {
+        return _rate;
+    }
+
+    // What was taken at the previous rate is still owed.
+    void set_rate(double rate, time_point now = clock::now()) {
+        refill(now);
+        _rate = rate;
+        _tokens = std::min(_tokens, _rate);
+    }
+
+    // Takes n tokens and returns how long to wait before using them.
+    duration take(uint64_t n, time_point now = clock::now()) {
+        if (!_rate) {
+            return duration(0);
+        }
+        refill(now);
+        _tokens -= n;
+        if (_tokens >= 0) {
+            return duration(0);
+        }
+        return std::chrono::duration_cast<duration>(std::chrono::duration<double>(-_tokens / _rate));
+    }
+};
+
+}
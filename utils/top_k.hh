@@ -0,0 +1,169 @@
+/*
+ * Copyright (C) 2017 ScyllaDB
+ */
+
+/*
+ * This file is part of Scylla.
+ *
+ * Scylla is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Scylla is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <unordered_map>
+#include <vector>
+
+namespace utils {
+
+/**
+ * Approximate most frequent items of a stream (Space-Saving).
+ *
+ * At most capacity items are counted. An item which is not counted yet
+ * replaces the least counted one and starts from its count, which is then
+ * the maximum over-estimation (error) of the new item's count. Any item
+ * making up more than 1/capacity of the stream is guaranteed to be counted.
+ *
+ * The least counted item is found with a min-heap, so adding to the count
+ * of an item is O(log capacity).
+ */
+template <typename T, typename Hash = std::hash<T>, typename KeyEqual = std::equal_to<T>>
+class space_saving_top_k {
+public:
+    struct result {
+        T item;
+        uint64_t count;
+        uint64_t error;
+    };
+private:
+    struct counter {
+        uint64_t count;
+        uint64_t error;
+        size_t heap_index;
+    };
+    using map_type = std::unordered_map<T, counter, Hash, KeyEqual>;
+    using entry = typename map_type::value_type;
+
+    size_t _capacity;
+    map_type _counters;
+    // Min-heap on the count. Elements of an unordered_map don't move when it grows.
+    std::vector<entry*> _heap;
+private:
+    void swap_heap(size_t a, size_t b) {
+        std::swap(_heap[a], _heap[b]);
+        _heap[a]->second.heap_index = a;
+        _heap[b]->second.heap_index = b;
+    }
+
+    void sift_up(size_t i) {
+        while (i > 0) {
+            auto parent = (i - 1) / 2;
+            if (_heap[parent]->second.count <= _heap[i]->second.count) {
+                break;
+            }
+            swap_heap(i, parent);
+            i = parent;
+        }
+    }
+
+    void sift_down(size_t i) {
+        for (;;) {
+            auto smallest = i;
+            for (auto child : { 2 * i + 1, 2 * i + 2 }) {
+                if (child < _heap.size() && _heap[child]->second.count < _heap[smallest]->second.count) {
+                    smallest = child;
+                }
+            }
+            if (smallest == i) {
+                break;
+            }
+            swap_heap(i, smallest);
+            i = smallest;
+        }
+    }
+public:
+    explicit space_saving_top_k(size_t capacity, Hash hash = Hash(), KeyEqual equal = KeyEqual())
+        : _capacity(std::max<size_t>(capacity, 1))
+        , _counters(_capacity, std::move(hash), std::move(equal))
+    {
+        _heap.reserve(_capacity);
+    }
+
+    space_saving_top_k(space_saving_top_k&&) = default;
+    space_saving_top_k& operator=(space_saving_top_k&&) = default;
+    space_saving_top_k(const space_saving_top_k&) = delete;
+
+    // error is the over-estimation already in inc, when merging sketches.
+    void append(const T& item, uint64_t inc = 1, uint64_t error = 0) {
+        auto it = _counters.find(item);
+        if (it != _counters.end()) {
+            it->second.count += inc;
+            it->second.error += error;
+            sift_down(it->second.heap_index);
+            return;
+        }
+        if (_heap.size() < _capacity) {
+            auto& e = *_counters.emplace(item, counter{inc, error, _heap.size()}).first;
+            _heap.push_back(&e);
+            sift_up(_heap.size() - 1);
+            return;
+        }
+        auto min_count = _heap.front()->second.count;
+        _counters.erase(_heap.front()->first);
+        auto& e = *_counters.emplace(item, counter{min_count + inc, min_count + error, 0}).first;
+        _heap.front() = &e;
+        sift_down(0);
+    }
+
+    // Adds the counts of another sketch. The result is as accurate as the
+    // least accurate of the two.
+    void merge(const space_saving_top_k& o) {
+        for (auto&& e : o._counters) {
+            append(e.first, e.second.count, e.second.error);
+        }
+    }
+
+    // The k most counted items, most counted first.
+    std::vector<result> top(size_t k) const {
+        std::vector<result> ret;
+        ret.reserve(_counters.size());
+        for (auto&& e : _counters) {
+            ret.push_back(result{e.first, e.second.count, e.second.error});
+        }
+        std::sort(ret.begin(), ret.end(), [] (const result& a, const result& b) {
+            return a.count > b.count;
+        });
+        if (ret.size() > k) {
+            ret.erase(ret.begin() + k, ret.end());
+        }
+        return ret;
+    }
+
+    size_t size() const {
+        return _counters.size();
+    }
+
+    size_t capacity() const {
+        return _capacity;
+    }
+
+    void clear() {
+        _counters.clear();
+        _heap.clear();
+    }
+};
+
+}
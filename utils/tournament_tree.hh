@@ -0,0 +1,145 @@
+/*
+ * Copyright (C) 2017 ScyllaDB
+ */
+
+/*
+ * This file is part of Scylla.
+ *
+ * Scylla is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Scylla is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <vector>
+
+#include "stdx.hh"
+
+namespace utils {
+
+/*
+ * A priority queue of elements which stay in place, in the leaves of a
+ * tournament tree, each internal node of which holds the winner of the match
+ * between its children.
+ *
+ * Pushing and popping replay the matches on the path of a single leaf, so
+ * both take log2(n) comparisons, where a heap pops with twice as many, and
+ * neither moves the elements, which only move when the tree grows.
+ *
+ * less(a, b) is true when a comes before b. Any of equal elements may be the
+ * top.
+ */
+template <typename T, typename LessCompare>
+class tournament_tree {
+    LessCompare _less;
+    // A power of two, or 0.
+    size_t _capacity = 0;
+    std::vector<stdx::optional<T>> _leaves;
+    // _nodes[i], for 0 < i < _capacity, is the leaf which won the match of
+    // the node i, between the nodes 2i and 2i + 1. The node of the leaf j is
+    // _capacity + j, and holds j.
+    std::vector<size_t> _nodes;
+    std::vector<size_t> _free_leaves;
+    size_t _size = 0;
+private:
+    bool beats(size_t a, size_t b) const {
+        if (!_leaves[a]) {
+            return false;
+        }
+        return !_leaves[b] || _less(*_leaves[a], *_leaves[b]);
+    }
+
+    size_t match(size_t node) const {
+        auto a = _nodes[2 * node];
+        auto b = _nodes[2 * node + 1];
+        return beats(b, a) ? b : a;
+    }
+
+    void replay(size_t leaf) {
+        for (auto node = (_capacity + leaf) / 2; node > 0; node /= 2) {
+            _nodes[node] = match(node);
+        }
+    }
+
+    void grow() {
+        auto capacity = std::max<size_t>(1, _capacity * 2);
+        _leaves.resize(capacity);
+        // The lowest free leaves are reused first.
+        for (auto leaf = capacity; leaf > _capacity; leaf--) {
+            _free_leaves.push_back(leaf - 1);
+        }
+        _nodes.resize(2 * capacity);
+        for (size_t leaf = 0; leaf < capacity; leaf++) {
+            _nodes[capacity + leaf] = leaf;
+        }
+        _capacity = capacity;
+        for (auto node = capacity - 1; node > 0; node--) {
+            _nodes[node] = match(node);
+        }
+    }
+
+    size_t top_leaf() const {
+        return _nodes[1];
+    }
+public:
+    explicit tournament_tree(LessCompare less = LessCompare())
+        : _less(std::move(less))
+    { }
+
+    bool empty() const {
+        return !_size;
+    }
+
+    size_t size() const {
+        return _size;
+    }
+
+    void push(T value) {
+        if (_free_leaves.empty()) {
+            grow();
+        }
+        auto leaf = _free_leaves.back();
+        _free_leaves.pop_back();
+        _leaves[leaf].emplace(std::move(value));
+        ++_size;
+        replay(leaf);
+    }
+
+    // The first element. Must not be called when empty.
+    T& top() {
+        return *_leaves[top_leaf()];
+    }
+    const T& top() const {
+        return *_leaves[top_leaf()];
+    }
+
+    // Removes the first element. Must not be called when empty.
+    void pop() {
+        auto leaf = top_leaf();
+        _leaves[leaf] = { };
+        _free_leaves.push_back(leaf);
+        --_size;
+        replay(leaf);
+    }
+
+    void clear() {
+        _leaves.clear();
+        _nodes.clear();
+        _free_leaves.clear();
+        _capacity = 0;
+        _size = 0;
+    }
+};
+
+}
@@ -42,6 +42,9 @@ struct unsigned_vint final {
     static vint_size_type serialize(value_type, bytes::iterator out);
 
     static deserialized_type deserialize(bytes_view v);
+
+    // The total size of a serialized value, as encoded in its first byte.
+    static vint_size_type serialized_size_from_first_byte(bytes::value_type first_byte);
 };
 
 struct signed_vint final {